@@ -22,16 +22,17 @@
 #include "cache_service.hh"
 #include "api/api-doc/cache_service.json.hh"
 #include "column_family.hh"
+#include "db/config.hh"
+#include <boost/lexical_cast.hpp>
 
 namespace api {
 using namespace json;
 namespace cs = httpd::cache_service_json;
 
 void set_cache_service(http_context& ctx, routes& r) {
-    cs::get_row_cache_save_period_in_seconds.set(r, [](std::unique_ptr<request> req) {
-        // We never save the cache
+    cs::get_row_cache_save_period_in_seconds.set(r, [&ctx](std::unique_ptr<request> req) {
         // Origin uses 0 for never
-        return make_ready_future<json::json_return_type>(0);
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().row_cache_save_period());
     });
 
     cs::set_row_cache_save_period_in_seconds.set(r, [](std::unique_ptr<request> req) {
@@ -67,10 +68,8 @@ void set_cache_service(http_context& ctx, routes& r) {
         return make_ready_future<json::json_return_type>(json_void());
     });
 
-    cs::get_row_cache_keys_to_save.set(r, [](std::unique_ptr<request> req) {
-        // TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+    cs::get_row_cache_keys_to_save.set(r, [&ctx](std::unique_ptr<request> req) {
+        return make_ready_future<json::json_return_type>(ctx.db.local().get_config().row_cache_keys_to_save());
     });
 
     cs::set_row_cache_keys_to_save.set(r, [](std::unique_ptr<request> req) {
@@ -262,6 +261,41 @@ void set_cache_service(http_context& ctx, routes& r) {
         }, std::plus<uint64_t>());
     });
 
+    cs::get_row_cache_eviction_weight.set(r, [&ctx] (std::unique_ptr<request> req) {
+        // The weight is the same on all shards.
+        auto& cf = ctx.db.local().find_column_family(get_uuid(req->param["name"], ctx.db.local()));
+        return make_ready_future<json::json_return_type>(cf.get_row_cache().eviction_weight());
+    });
+
+    cs::set_row_cache_eviction_weight.set(r, [&ctx] (std::unique_ptr<request> req) {
+        float weight;
+        try {
+            weight = boost::lexical_cast<float>(req->get_query_param("weight"));
+        } catch (boost::bad_lexical_cast& e) {
+            throw bad_param_exception("Invalid eviction weight: " + req->get_query_param("weight"));
+        }
+        if (!(weight > 0)) {
+            throw bad_param_exception("Eviction weight must be positive");
+        }
+        return foreach_column_family(ctx, req->param["name"], [weight] (column_family& cf) {
+            cf.get_row_cache().set_eviction_weight(weight);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
+    });
+
+    cs::get_cf_row_entries.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_cf(ctx, req->param["name"], uint64_t(0), [](const column_family& cf) {
+            return cf.get_row_cache().cached_partitions();
+        }, std::plus<uint64_t>());
+    });
+
+    cs::get_cf_row_evictions.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return map_reduce_cf(ctx, req->param["name"], uint64_t(0), [](const column_family& cf) {
+            return cf.get_row_cache().evictions();
+        }, std::plus<uint64_t>());
+    });
+
     cs::get_counter_capacity.set(r, [] (std::unique_ptr<request> req) {
         // TBD
         // FIXME
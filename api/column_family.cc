@@ -24,7 +24,11 @@
 #include <vector>
 #include "http/exception.hh"
 #include "sstables/sstables.hh"
+#include "db/system_keyspace.hh"
 #include "utils/estimated_histogram.hh"
+#include "core/sleep.hh"
+#include <boost/lexical_cast.hpp>
+#include <boost/range/irange.hpp>
 #include <algorithm>
 
 namespace api {
@@ -284,6 +288,114 @@ ratio_holder filter_recent_false_positive_as_ratio_holder(const sstables::shared
     return ratio_holder(f + sst->filter_get_recent_true_positive(), f);
 }
 
+// Partition key components, separated by ':'.
+static sstring partition_key_to_string(const schema& s, const partition_key& key) {
+    sstring ret;
+    auto type = s.partition_key_columns().begin();
+    for (auto&& component : key.explode(s)) {
+        if (!ret.empty()) {
+            ret += ":";
+        }
+        ret += type++->type->to_string(component);
+    }
+    return ret;
+}
+
+// Counts of sampled partitions, merged across shards by key.
+struct sampled_partition_counts {
+    struct counts {
+        uint64_t count = 0;
+        uint64_t error = 0;
+    };
+    std::unordered_map<sstring, counts> reads;
+    std::unordered_map<sstring, counts> writes;
+
+    static void merge(std::unordered_map<sstring, counts>& to, const std::unordered_map<sstring, counts>& from) {
+        for (auto&& e : from) {
+            auto& c = to[e.first];
+            c.count += e.second.count;
+            c.error += e.second.error;
+        }
+    }
+    void merge(const sampled_partition_counts& o) {
+        merge(reads, o.reads);
+        merge(writes, o.writes);
+    }
+};
+
+static void add_sampled_partitions(const schema& s, std::unordered_map<sstring, sampled_partition_counts::counts>& to,
+        const std::vector<column_family::partition_counter::result>& from) {
+    for (auto&& r : from) {
+        auto& c = to[partition_key_to_string(s, r.item)];
+        c.count += r.count;
+        c.error += r.error;
+    }
+}
+
+static void set_toppartitions_records(std::unordered_map<sstring, sampled_partition_counts::counts>& counts, size_t list_size,
+        json::json_list<cf::toppartitions_record>& records) {
+    using entry = std::pair<sstring, sampled_partition_counts::counts>;
+    std::vector<entry> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), [] (const entry& a, const entry& b) {
+        return a.second.count > b.second.count;
+    });
+    sorted.resize(std::min(sorted.size(), list_size));
+    for (auto&& e : sorted) {
+        cf::toppartitions_record r;
+        r.partition = e.first;
+        r.count = e.second.count;
+        r.error = e.second.error;
+        records.push(std::move(r));
+    }
+}
+
+static size_t get_size_param(const request& req, const sstring& name, size_t default_value) {
+    auto value = req.get_query_param(name);
+    if (value.empty()) {
+        return default_value;
+    }
+    try {
+        return boost::lexical_cast<size_t>(value);
+    } catch (boost::bad_lexical_cast&) {
+        throw bad_param_exception(sprint("%s should be a non negative integer, got %s", name, value));
+    }
+}
+
+static cf::memory_footprint to_json(const memory_footprint& f) {
+    cf::memory_footprint res;
+    res.partitions = f.partitions;
+    res.rows = f.rows;
+    res.cells = f.cells;
+    res.objects = f.objects;
+    res.keys = f.keys;
+    res.tree_nodes = f.tree_nodes;
+    res.values = f.values;
+    res.fragmentation = f.fragmentation;
+    res.total = f.total();
+    res.bytes_per_row = f.bytes_per_row();
+    res.bytes_per_cell = f.bytes_per_cell();
+    return res;
+}
+
+struct table_latency_histograms {
+    utils::latency_histogram read;
+    utils::latency_histogram write;
+};
+
+static cf::latency_histogram to_json(const utils::latency_histogram& h) {
+    cf::latency_histogram res;
+    res.count = h.count();
+    res.sum = h.sum();
+    res.max = h.max();
+    for (size_t i = 0; i < h.bucket_count; ++i) {
+        if (h.buckets()[i]) {
+            res.bucket_offsets.push(utils::latency_histogram::bucket_upper_bound(i));
+            res.buckets.push(h.buckets()[i]);
+        }
+    }
+    return res;
+}
+
 void set_column_family(http_context& ctx, routes& r) {
     cf::get_column_family_name.set(r, [&ctx] (const_req req){
         vector<sstring> res;
@@ -506,6 +618,46 @@ void set_column_family(http_context& ctx, routes& r) {
         return get_cf_rate_and_histogram(ctx, &column_family::stats::writes);
     });
 
+    cf::get_all_latency_histograms.set(r, [&ctx] (std::unique_ptr<request> req) {
+        // The histograms of the tables of this shard are the accumulators,
+        // which the shards add theirs to in place, one at a time, so that
+        // nothing is copied or allocated per table but the result.
+        auto acc = make_lw_shared<std::unordered_map<utils::UUID, table_latency_histograms>>();
+        for (auto&& e : ctx.db.local().get_column_families()) {
+            acc->emplace(e.first, table_latency_histograms());
+        }
+        return do_for_each(boost::irange(0u, smp::count), [&ctx, acc] (unsigned shard) {
+            return ctx.db.invoke_on(shard, [&acc = *acc] (database& db) {
+                auto& cfs = db.get_column_families();
+                for (auto&& e : acc) {
+                    auto cf = cfs.find(e.first);
+                    // Tables created or dropped meanwhile are left out.
+                    if (cf != cfs.end()) {
+                        e.second.read += cf->second->get_stats().read_latency;
+                        e.second.write += cf->second->get_stats().write_latency;
+                    }
+                }
+            });
+        }).then([&ctx, acc] {
+            auto& cfs = ctx.db.local().get_column_families();
+            std::vector<cf::table_latency_histograms> res;
+            res.reserve(acc->size());
+            for (auto&& e : *acc) {
+                auto cf = cfs.find(e.first);
+                if (cf == cfs.end()) {
+                    continue;
+                }
+                cf::table_latency_histograms h;
+                h.ks = cf->second->schema()->ks_name();
+                h.cf = cf->second->schema()->cf_name();
+                h.read = to_json(e.second.read);
+                h.write = to_json(e.second.write);
+                res.push_back(std::move(h));
+            }
+            return make_ready_future<json::json_return_type>(std::move(res));
+        });
+    });
+
     cf::get_pending_compactions.set(r, [&ctx] (std::unique_ptr<request> req) {
         return map_reduce_cf(ctx, req->param["name"], int64_t(0), [](column_family& cf) {
             return cf.get_compaction_strategy().estimated_pending_compactions(cf);
@@ -873,6 +1025,23 @@ void set_column_family(http_context& ctx, routes& r) {
         utils::estimated_histogram_merge, utils_json::estimated_histogram());
     });
 
+    cf::get_stage_latency_estimated_histogram.set(r, [&ctx](std::unique_ptr<request> req) {
+        static const std::unordered_map<sstring, utils::estimated_histogram column_family::stats::*> stages = {
+            {"read_admission", &column_family::stats::estimated_read_admission},
+            {"read_execution", &column_family::stats::estimated_read_execution},
+            {"read_serialization", &column_family::stats::estimated_read_serialization},
+            {"write_commitlog", &column_family::stats::estimated_write_commitlog},
+        };
+        auto stage = stages.find(req->get_query_param("stage"));
+        if (stage == stages.end()) {
+            throw bad_param_exception(sprint("Unknown stage %s", req->get_query_param("stage")));
+        }
+        return map_reduce_cf(ctx, req->param["name"], utils::estimated_histogram(0), [hist = stage->second](column_family& cf) {
+            return cf.get_stats().*hist;
+        },
+        utils::estimated_histogram_merge, utils_json::estimated_histogram());
+    });
+
     cf::set_compaction_strategy_class.set(r, [&ctx](std::unique_ptr<request> req) {
         sstring strategy = req->get_query_param("class_name");
         return foreach_column_family(ctx, req->param["name"], [strategy](column_family& cf) {
@@ -905,5 +1074,98 @@ void set_column_family(http_context& ctx, routes& r) {
             return make_ready_future<json::json_return_type>(res);
         });
     });
+
+    cf::toppartitions.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto uuid = get_uuid(req->param["name"], ctx.db.local());
+        auto duration = std::chrono::milliseconds(get_size_param(*req, "duration", 5000));
+        auto list_size = get_size_param(*req, "list_size", 10);
+        auto capacity = std::max(get_size_param(*req, "capacity", 256), list_size);
+        if (!capacity) {
+            throw bad_param_exception("capacity should be positive");
+        }
+        return ctx.db.invoke_on_all([uuid, capacity] (database& db) {
+            db.find_column_family(uuid).start_partition_sampling(capacity);
+        }).then([duration] {
+            return sleep(duration);
+        }).then([&ctx, uuid, capacity] {
+            // All counted partitions of each shard are merged, not just the
+            // top list_size ones, since a partition hot overall may not be in
+            // the top of any single shard.
+            return ctx.db.map_reduce0([uuid, capacity] (database& db) {
+                auto& cf = db.find_column_family(uuid);
+                auto sampled = cf.stop_partition_sampling(capacity);
+                sampled_partition_counts counts;
+                add_sampled_partitions(*cf.schema(), counts.reads, sampled.reads);
+                add_sampled_partitions(*cf.schema(), counts.writes, sampled.writes);
+                return counts;
+            }, sampled_partition_counts(), [] (sampled_partition_counts a, const sampled_partition_counts& b) {
+                a.merge(b);
+                return a;
+            });
+        }).then([list_size] (sampled_partition_counts counts) {
+            cf::toppartitions_query_results results;
+            set_toppartitions_records(counts.reads, list_size, results.read);
+            set_toppartitions_records(counts.writes, list_size, results.write);
+            return make_ready_future<json::json_return_type>(results);
+        });
+    });
+
+    cf::get_rate_limit_offenders.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto uuid = get_uuid(req->param["name"], ctx.db.local());
+        auto list_size = get_size_param(*req, "list_size", 10);
+        // Each shard keeps the partitions its own limiter rejected, which
+        // are those it owns, so the lists add up without overlapping.
+        return ctx.db.map_reduce0([uuid, list_size] (database& db) {
+            auto& cf = db.find_column_family(uuid);
+            auto offenders = cf.rate_limit_offenders(list_size);
+            sampled_partition_counts counts;
+            add_sampled_partitions(*cf.schema(), counts.reads, offenders.reads);
+            add_sampled_partitions(*cf.schema(), counts.writes, offenders.writes);
+            return counts;
+        }, sampled_partition_counts(), [] (sampled_partition_counts a, const sampled_partition_counts& b) {
+            a.merge(b);
+            return a;
+        }).then([list_size] (sampled_partition_counts counts) {
+            cf::toppartitions_query_results results;
+            set_toppartitions_records(counts.reads, list_size, results.read);
+            set_toppartitions_records(counts.writes, list_size, results.write);
+            return make_ready_future<json::json_return_type>(results);
+        });
+    });
+
+    cf::get_large_partitions.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto uuid = get_uuid(req->param["name"], ctx.db.local());
+        auto s = ctx.db.local().find_schema(uuid);
+        return db::system_keyspace::load_large_partitions(s->ks_name(), s->cf_name()).then([] (std::vector<db::system_keyspace::large_partition_entry> entries) {
+            std::vector<cf::large_partition_record> res;
+            for (auto&& e : entries) {
+                cf::large_partition_record r;
+                r.sstable = e.sstable_name;
+                r.partition = e.partition_key;
+                r.partition_size = e.partition_size;
+                r.row = e.clustering_key;
+                r.row_size = e.row_size;
+                r.compaction_time = std::chrono::duration_cast<std::chrono::milliseconds>(e.compaction_time.time_since_epoch()).count();
+                res.push_back(std::move(r));
+            }
+            return make_ready_future<json::json_return_type>(res);
+        });
+    });
+
+    cf::get_memory_footprint.set(r, [&ctx](std::unique_ptr<request> req) {
+        auto uuid = get_uuid(req->param["name"], ctx.db.local());
+        return ctx.db.map_reduce0([uuid] (database& db) {
+            return db.find_column_family(uuid).memory_footprint();
+        }, table_memory_footprint(), [] (table_memory_footprint a, const table_memory_footprint& b) {
+            a += b;
+            return a;
+        }).then([] (table_memory_footprint f) {
+            cf::table_memory_footprint res;
+            res.memtable = to_json(f.memtable);
+            res.row_cache = to_json(f.row_cache);
+            res.index_cache = to_json(f.index_cache);
+            return make_ready_future<json::json_return_type>(res);
+        });
+    });
 }
 }
@@ -19,57 +19,89 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <strings.h>
 #include "hinted_handoff.hh"
 #include "api/api-doc/hinted_handoff.json.hh"
+#include "service/storage_proxy.hh"
 
 namespace api {
 
 using namespace json;
 namespace hh = httpd::hinted_handoff_json;
 
-void set_hinted_handoff(http_context& ctx, routes& r) {
-    hh::list_endpoints_pending_hints.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        std::vector<sstring> res;
+using proxy = service::storage_proxy;
+
+// Applies func to the hints manager of each shard, if hinted handoff is
+// enabled.
+template <typename Func>
+static future<> for_all_hints_managers(http_context& ctx, Func func) {
+    return ctx.sp.invoke_on_all([func] (proxy& p) {
+        auto hm = p.hints_manager();
+        return hm ? futurize_apply(func, *hm) : make_ready_future<>();
+    });
+}
+
+static future<json::json_return_type> sum_hints_for(http_context& ctx, gms::inet_address ep,
+        uint64_t (db::hints::manager::*f)(gms::inet_address) const) {
+    return ctx.sp.map_reduce0([ep, f] (proxy& p) {
+        auto hm = p.hints_manager();
+        return hm ? (hm->*f)(ep) : uint64_t(0);
+    }, uint64_t(0), std::plus<uint64_t>()).then([] (uint64_t res) {
         return make_ready_future<json::json_return_type>(res);
     });
+}
 
-    hh::truncate_all_hints.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(json_void());
+void set_hinted_handoff(http_context& ctx, routes& r) {
+    hh::list_endpoints_pending_hints.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return ctx.sp.map_reduce0([] (proxy& p) {
+            auto hm = p.hints_manager();
+            return hm ? hm->endpoints_pending_hints() : std::vector<gms::inet_address>();
+        }, std::set<gms::inet_address>(), [] (std::set<gms::inet_address> a, std::vector<gms::inet_address> b) {
+            a.insert(b.begin(), b.end());
+            return a;
+        }).then([] (std::set<gms::inet_address> res) {
+            return make_ready_future<json::json_return_type>(container_to_vec(res));
+        });
     });
 
-    hh::schedule_hint_delivery.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
+    hh::truncate_all_hints.set(r, [&ctx] (std::unique_ptr<request> req) {
         sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(json_void());
+        std::experimental::optional<gms::inet_address> ep;
+        if (!host.empty()) {
+            ep = gms::inet_address(host);
+        }
+        return for_all_hints_managers(ctx, [ep] (db::hints::manager& hm) {
+            return hm.truncate_hints(ep);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::pause_hints_delivery.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring pause = req->get_query_param("pause");
-        return make_ready_future<json::json_return_type>(json_void());
+    hh::schedule_hint_delivery.set(r, [&ctx] (std::unique_ptr<request> req) {
+        gms::inet_address ep(req->get_query_param("host"));
+        return for_all_hints_managers(ctx, [ep] (db::hints::manager& hm) {
+            hm.schedule_delivery(ep);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::get_create_hint_count.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(0);
+    hh::pause_hints_delivery.set(r, [&ctx] (std::unique_ptr<request> req) {
+        bool pause = strcasecmp(req->get_query_param("pause").c_str(), "true") == 0;
+        return for_all_hints_managers(ctx, [pause] (db::hints::manager& hm) {
+            hm.pause_delivery(pause);
+        }).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
-    hh::get_not_stored_hints_count.set(r, [] (std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        sstring host = req->get_query_param("host");
-        return make_ready_future<json::json_return_type>(0);
+    hh::get_create_hint_count.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return sum_hints_for(ctx, gms::inet_address(req->param["addr"]), &db::hints::manager::created_hints_for);
     });
-}
 
+    hh::get_not_stored_hints_count.set(r, [&ctx] (std::unique_ptr<request> req) {
+        return sum_hints_for(ctx, gms::inet_address(req->param["addr"]), &db::hints::manager::not_stored_hints_for);
+    });
 }
 
+}
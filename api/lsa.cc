@@ -40,6 +40,21 @@ void set_lsa(http_context& ctx, routes& r) {
             return json::json_return_type(json::json_void());
         });
     });
+
+    httpd::lsa_json::get_huge_page_coverage.set(r, [&ctx](std::unique_ptr<request> req) {
+        return ctx.db.map_reduce0([] (database&) {
+            return logalloc::shard_tracker().huge_pages();
+        }, logalloc::huge_page_coverage{}, [] (logalloc::huge_page_coverage a, const logalloc::huge_page_coverage& b) {
+            a.total_bytes += b.total_bytes;
+            a.huge_page_bytes += b.huge_page_bytes;
+            return a;
+        }).then([] (logalloc::huge_page_coverage hp) {
+            httpd::lsa_json::huge_page_coverage res;
+            res.total_bytes = hp.total_bytes;
+            res.huge_page_bytes = hp.huge_page_bytes;
+            return make_ready_future<json::json_return_type>(res);
+        });
+    });
 }
 
 }
@@ -34,6 +34,8 @@
 #include "column_family.hh"
 #include "log.hh"
 #include "release.hh"
+#include "service/priority_manager.hh"
+#include <boost/lexical_cast.hpp>
 
 namespace api {
 
@@ -47,6 +49,29 @@ static sstring validate_keyspace(http_context& ctx, const parameters& param) {
     throw bad_param_exception("Keyspace " + param["keyspace"] + " Does not exist");
 }
 
+static uint32_t get_throughput_param(const request& req) {
+    auto value = req.get_query_param("value");
+    try {
+        return boost::lexical_cast<uint32_t>(value);
+    } catch (boost::bad_lexical_cast&) {
+        throw bad_param_exception(sprint("value should be a non negative integer, got %s", value));
+    }
+}
+
+using bandwidth_limiter_getter = utils::token_bucket_rate_limiter& (service::priority_manager::*)();
+
+// Limits are set in MB/s for the whole node, and split evenly between shards.
+static future<> set_bandwidth_limit(bandwidth_limiter_getter limiter, uint32_t mb_per_sec) {
+    auto rate = uint64_t(mb_per_sec) * 1024 * 1024 / smp::count;
+    return smp::invoke_on_all([limiter, rate] {
+        (service::get_local_priority_manager().*limiter)().set_rate(rate);
+    });
+}
+
+static int get_bandwidth_limit(bandwidth_limiter_getter limiter) {
+    auto rate = (service::get_local_priority_manager().*limiter)().rate();
+    return (rate * smp::count + 1024 * 1024 / 2) / (1024 * 1024);
+}
 
 static std::vector<ss::token_range> describe_ring(const sstring& keyspace) {
     std::vector<ss::token_range> res;
@@ -367,6 +392,26 @@ void set_storage_service(http_context& ctx, routes& r) {
         });
     });
 
+    ss::repair_async_stats.set(r, [&ctx](std::unique_ptr<request> req) {
+        return repair_get_stats(ctx.db, boost::lexical_cast<int>( req->get_query_param("id")))
+                .then_wrapped([] (future<repair_stats>&& fut) {
+            ss::repair_stats res;
+            try {
+                auto stats = fut.get0();
+                res.ranges_checked = stats.ranges_checked;
+                res.ranges_mismatched = stats.ranges_mismatched;
+                res.bytes_hashed = stats.bytes_hashed;
+                res.bytes_streamed = stats.bytes_streamed;
+                res.checksum_time = stats.checksum_time.count();
+                res.sync_time = stats.sync_time.count();
+                res.streaming_time = stats.streaming_time.count();
+            } catch(std::runtime_error& e) {
+                return make_ready_future<json::json_return_type>(json_exception(httpd::bad_param_exception(e.what())));
+            }
+            return make_ready_future<json::json_return_type>(res);
+        });
+    });
+
     ss::force_terminate_all_repair_sessions.set(r, [](std::unique_ptr<request> req) {
         //TBD
         unimplemented();
@@ -555,28 +600,25 @@ void set_storage_service(http_context& ctx, routes& r) {
     });
 
     ss::set_stream_throughput_mb_per_sec.set(r, [](std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        auto value = req->get_query_param("value");
-        return make_ready_future<json::json_return_type>(json_void());
+        auto value = get_throughput_param(*req);
+        return set_bandwidth_limit(&service::priority_manager::streaming_bandwidth_limiter, value).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
     ss::get_stream_throughput_mb_per_sec.set(r, [](std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        return make_ready_future<json::json_return_type>(0);
+        return make_ready_future<json::json_return_type>(get_bandwidth_limit(&service::priority_manager::streaming_bandwidth_limiter));
     });
 
-    ss::get_compaction_throughput_mb_per_sec.set(r, [&ctx](std::unique_ptr<request> req) {
-        int value = ctx.db.local().get_config().compaction_throughput_mb_per_sec();
-        return make_ready_future<json::json_return_type>(value);
+    ss::get_compaction_throughput_mb_per_sec.set(r, [](std::unique_ptr<request> req) {
+        return make_ready_future<json::json_return_type>(get_bandwidth_limit(&service::priority_manager::compaction_bandwidth_limiter));
     });
 
     ss::set_compaction_throughput_mb_per_sec.set(r, [](std::unique_ptr<request> req) {
-        //TBD
-        unimplemented();
-        auto value = req->get_query_param("value");
-        return make_ready_future<json::json_return_type>(json_void());
+        auto value = get_throughput_param(*req);
+        return set_bandwidth_limit(&service::priority_manager::compaction_bandwidth_limiter, value).then([] {
+            return make_ready_future<json::json_return_type>(json_void());
+        });
     });
 
     ss::is_incremental_backups_enabled.set(r, [](std::unique_ptr<request> req) {
@@ -646,11 +688,12 @@ void set_storage_service(http_context& ctx, routes& r) {
     ss::load_new_ss_tables.set(r, [&ctx](std::unique_ptr<request> req) {
         auto ks = validate_keyspace(ctx, req->param);
         auto cf = req->get_query_param("cf");
+        bool load_and_stream = strcasecmp(req->get_query_param("load_and_stream").c_str(), "true") == 0;
         // No need to add the keyspace, since all we want is to avoid always sending this to the same
         // CPU. Even then I am being overzealous here. This is not something that happens all the time.
         auto coordinator = std::hash<sstring>()(cf) % smp::count;
-        return service::get_storage_service().invoke_on(coordinator, [ks = std::move(ks), cf = std::move(cf)] (service::storage_service& s) {
-            return s.load_new_sstables(ks, cf);
+        return service::get_storage_service().invoke_on(coordinator, [ks = std::move(ks), cf = std::move(cf), load_and_stream] (service::storage_service& s) {
+            return s.load_new_sstables(ks, cf, load_and_stream);
         }).then([] {
             return make_ready_future<json::json_return_type>(json_void());
         });
@@ -24,6 +24,8 @@
 
 #include "http/exception.hh"
 #include "log.hh"
+#include "utils/task_group.hh"
+#include <boost/range/irange.hpp>
 
 namespace api {
 
@@ -65,6 +67,33 @@ void set_system(http_context& ctx, routes& r) {
         }
         return json::json_void();
     });
+
+    hs::get_task_groups.set(r, [](std::unique_ptr<request> req) {
+        return map_reduce(boost::irange(0u, smp::count), [] (unsigned shard) {
+            return smp::submit_to(shard, [shard] {
+                std::vector<hs::task_group_stats> res;
+                for (size_t i = 0; i < size_t(utils::task_group::count); ++i) {
+                    auto g = utils::task_group(i);
+                    auto stats = utils::get_task_group_stats(g);
+                    hs::task_group_stats s;
+                    s.shard = shard;
+                    s.group = utils::task_group_name(g);
+                    s.tasks = stats.tasks;
+                    s.failed_tasks = stats.failed_tasks;
+                    s.running_tasks = stats.running_tasks;
+                    s.queued_tasks = stats.queued_tasks;
+                    s.busy_time_us = std::chrono::duration_cast<std::chrono::microseconds>(stats.busy_time).count();
+                    res.push_back(std::move(s));
+                }
+                return res;
+            });
+        }, std::vector<hs::task_group_stats>(), [] (std::vector<hs::task_group_stats> a, std::vector<hs::task_group_stats> b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        }).then([] (std::vector<hs::task_group_stats> res) {
+            return make_ready_future<json::json_return_type>(std::move(res));
+        });
+    });
 }
 
 }
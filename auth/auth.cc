@@ -125,12 +125,15 @@ class auth::auth::permissions_cache {
     permissions_cache(const db::config& cfg)
                     : _cache(cfg.permissions_cache_max_entries(), std::chrono::milliseconds(cfg.permissions_validity_in_ms()), std::chrono::milliseconds(cfg.permissions_update_interval_in_ms()), alogger,
                         [] (const key_type& k) {
-                            alogger.debug("Refreshing permissions for {}", k.first.name());
+                            alogger.debug("Loading permissions for {}", k.first.name());
                             return authorizer::get().authorize(::make_shared<authenticated_user>(k.first), k.second);
+                        },
+                        [] (const std::vector<key_type>& keys) {
+                            return reload(keys);
                         }) {}
 
     future<> stop() {
-        return make_ready_future<>();
+        return _cache.stop();
     }
 
     future<permission_set> get(::shared_ptr<authenticated_user> user, data_resource resource) {
@@ -138,6 +141,36 @@ class auth::auth::permissions_cache {
     }
 
 private:
+    // Reloads the permissions of each user on all of its resources at once.
+    static future<cache_type::reload_result_type> reload(const std::vector<key_type>& keys) {
+        auto result = make_lw_shared<cache_type::reload_result_type>(keys.size());
+        auto users = make_lw_shared<std::unordered_map<authenticated_user, std::vector<size_t>>>();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            (*users)[keys[i].first].push_back(i);
+        }
+        return parallel_for_each(*users, [&keys, result] (auto& user_keys) {
+            auto& user = user_keys.first;
+            auto& idx = user_keys.second;
+            std::vector<data_resource> resources;
+            for (auto i : idx) {
+                resources.push_back(keys[i].second);
+            }
+            alogger.debug("Refreshing permissions for {} on {} resources", user.name(), resources.size());
+            return authorizer::get().authorize(::make_shared<authenticated_user>(user), std::move(resources)).then_wrapped([&user, &idx, result] (future<std::vector<permission_set>> f) {
+                try {
+                    auto perms = f.get0();
+                    for (size_t i = 0; i < idx.size(); ++i) {
+                        (*result)[idx[i]] = perms[i];
+                    }
+                } catch (std::exception& e) {
+                    alogger.debug("Refreshing permissions for {} failed: {}", user.name(), e.what());
+                }
+            });
+        }).then([users, result] {
+            return std::move(*result);
+        });
+    }
+
     cache_type _cache;
 };
 
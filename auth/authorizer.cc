@@ -39,6 +39,8 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <boost/range/irange.hpp>
+
 #include "authorizer.hh"
 #include "authenticated_user.hh"
 #include "default_authorizer.hh"
@@ -98,6 +100,21 @@ auth::authorizer::setup(const sstring& type) {
     return make_ready_future();
 }
 
+future<std::vector<auth::permission_set>> auth::authorizer::authorize(
+                ::shared_ptr<authenticated_user> user, std::vector<data_resource> resources) const {
+    return do_with(std::move(resources), std::vector<permission_set>(), [this, user](auto& resources, auto& result) {
+        result.resize(resources.size());
+        auto idx = boost::irange<size_t>(0, resources.size());
+        return parallel_for_each(idx.begin(), idx.end(), [this, user, &resources, &result](size_t i) {
+            return this->authorize(user, resources[i]).then([&result, i](permission_set set) {
+                result[i] = set;
+            });
+        }).then([&result] {
+            return std::move(result);
+        });
+    });
+}
+
 auth::authorizer& auth::authorizer::get() {
     assert(global_authorizer);
     return *global_authorizer;
@@ -84,6 +84,13 @@ class authorizer {
      */
     virtual future<permission_set> authorize(::shared_ptr<authenticated_user>, data_resource) const = 0;
 
+    /**
+     * Like the above, for several resources at once. The default implementation authorizes them one by one.
+     *
+     * @return The sets of permissions of the user on the resources, in the same order.
+     */
+    virtual future<std::vector<permission_set>> authorize(::shared_ptr<authenticated_user>, std::vector<data_resource>) const;
+
     /**
      * Grants a set of permissions on a resource to a user.
      * The opposite of revoke().
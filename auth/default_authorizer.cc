@@ -114,6 +114,44 @@ future<auth::permission_set> auth::default_authorizer::authorize(
     });
 }
 
+future<std::vector<auth::permission_set>> auth::default_authorizer::authorize(
+                ::shared_ptr<authenticated_user> user, std::vector<data_resource> resources) const {
+    return user->is_super().then([user, resources = std::move(resources)](bool is_super) {
+        if (is_super) {
+            return make_ready_future<std::vector<permission_set>>(std::vector<permission_set>(resources.size(), permissions::ALL));
+        }
+
+        // All the permissions of a user are in its partition, so a single
+        // query reads them for all the resources.
+        auto& qp = cql3::get_local_query_processor();
+        auto query = sprint("SELECT %s, %s FROM %s.%s WHERE %s = ?"
+                        , RESOURCE_NAME, PERMISSIONS_NAME, auth::AUTH_KS, PERMISSIONS_CF, USER_NAME);
+        return qp.process(query, db::consistency_level::LOCAL_ONE, { user->name() })
+                        .then_wrapped([=](future<::shared_ptr<cql3::untyped_result_set>> f) {
+            std::vector<permission_set> result(resources.size(), permissions::NONE);
+            try {
+                auto res = f.get0();
+
+                std::unordered_map<sstring, permission_set> by_resource;
+                for (auto& row : *res) {
+                    if (row.has(PERMISSIONS_NAME)) {
+                        by_resource.emplace(row.get_as<sstring>(RESOURCE_NAME), permissions::from_strings(row.get_set<sstring>(PERMISSIONS_NAME)));
+                    }
+                }
+                for (size_t i = 0; i < resources.size(); ++i) {
+                    auto it = by_resource.find(resources[i].name());
+                    if (it != by_resource.end()) {
+                        result[i] = it->second;
+                    }
+                }
+            } catch (exceptions::request_execution_exception& e) {
+                alogger.warn("CassandraAuthorizer failed to authorize {} for {} resources", user->name(), resources.size());
+            }
+            return make_ready_future<std::vector<permission_set>>(std::move(result));
+        });
+    });
+}
+
 #include <boost/range.hpp>
 
 future<> auth::default_authorizer::modify(
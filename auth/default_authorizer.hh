@@ -56,6 +56,8 @@ class default_authorizer : public authorizer {
 
     future<permission_set> authorize(::shared_ptr<authenticated_user>, data_resource) const override;
 
+    future<std::vector<permission_set>> authorize(::shared_ptr<authenticated_user>, std::vector<data_resource>) const override;
+
     future<> grant(::shared_ptr<authenticated_user>, permission_set, data_resource, sstring) override;
 
     future<> revoke(::shared_ptr<authenticated_user>, permission_set, data_resource, sstring) override;
@@ -43,7 +43,9 @@
 #include <crypt.h>
 #include <random>
 #include <chrono>
+#include <unordered_map>
 
+#include <cryptopp/sha.h>
 #include <seastar/core/reactor.hh>
 
 #include "auth.hh"
@@ -105,6 +107,91 @@ static bool checkpw(const sstring& pass, const sstring& salted_hash) {
     return tmp == salted_hash;
 }
 
+// crypt_r() takes milliseconds and blocks the reactor, so that a storm of
+// connections to one shard would stall it for long. The checks are spread
+// round-robin over all the shards instead.
+static future<bool> checkpw_on_some_shard(sstring pass, sstring salted_hash) {
+    static thread_local unsigned next_shard = engine().cpu_id();
+    auto shard = next_shard++ % smp::count;
+    return smp::submit_to(shard, [pass = std::move(pass), salted_hash = std::move(salted_hash)] {
+        return checkpw(pass, salted_hash);
+    });
+}
+
+// The passwords which were recently verified successfully, so that clients
+// which reconnect all at once, e.g. after a restart, don't redo the expensive
+// check on each connection. Only a hash of the password, salted with a random
+// per-shard salt, is kept. An entry is valid for the salted hash which was
+// stored for the user when it was made, so that changing or dropping the user
+// invalidates it right away; and then for a short time only.
+class verified_passwords_cache {
+    static constexpr size_t max_entries = 1024;
+    static constexpr std::chrono::seconds validity{10};
+
+    struct entry {
+        sstring salted_hash;
+        bytes digest;
+        lowres_clock::time_point expiry;
+    };
+    std::unordered_map<sstring, entry> _entries;
+    bytes _salt;
+private:
+    bytes digest(const sstring& pass) const {
+        CryptoPP::SHA256 hash;
+        hash.Update(reinterpret_cast<const byte*>(_salt.data()), _salt.size());
+        hash.Update(reinterpret_cast<const byte*>(pass.data()), pass.size());
+        bytes digest(bytes::initialized_later(), CryptoPP::SHA256::DIGESTSIZE);
+        hash.Final(reinterpret_cast<byte*>(digest.begin()));
+        return digest;
+    }
+
+    void drop_expired() {
+        auto now = lowres_clock::now();
+        for (auto it = _entries.begin(); it != _entries.end();) {
+            if (it->second.expiry <= now) {
+                it = _entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+public:
+    verified_passwords_cache()
+        : _salt(bytes::initialized_later(), rand_bytes) {
+        std::random_device rd;
+        std::uniform_int_distribution<int> dist(0, 255);
+        for (auto& b : _salt) {
+            b = dist(rd);
+        }
+    }
+
+    bool contains(const sstring& username, const sstring& salted_hash, const sstring& pass) {
+        auto it = _entries.find(username);
+        if (it == _entries.end()) {
+            return false;
+        }
+        if (it->second.expiry <= lowres_clock::now()) {
+            _entries.erase(it);
+            return false;
+        }
+        return it->second.salted_hash == salted_hash && it->second.digest == digest(pass);
+    }
+
+    void insert(const sstring& username, const sstring& salted_hash, const sstring& pass) {
+        if (_entries.size() >= max_entries) {
+            drop_expired();
+            if (_entries.size() >= max_entries) {
+                _entries.clear();
+            }
+        }
+        _entries[username] = entry{salted_hash, digest(pass), lowres_clock::now() + validity};
+    }
+};
+
+constexpr std::chrono::seconds verified_passwords_cache::validity;
+
+static thread_local verified_passwords_cache verified_passwords;
+
 static sstring gensalt() {
     static sstring prefix;
 
@@ -222,10 +309,23 @@ future<::shared_ptr<auth::authenticated_user> > auth::password_authenticator::au
         return qp.process(sprint("SELECT %s FROM %s.%s WHERE %s = ?", SALTED_HASH,
                                         auth::AUTH_KS, CREDENTIALS_CF, USER_NAME),
                         consistency_for_user(username), {username}, true);
-    }).then_wrapped([=](future<::shared_ptr<cql3::untyped_result_set>> f) {
+    }).then([=](::shared_ptr<cql3::untyped_result_set> res) {
+        if (res->empty()) {
+            return make_ready_future<bool>(false);
+        }
+        auto salted_hash = res->one().get_as<sstring>(SALTED_HASH);
+        if (verified_passwords.contains(username, salted_hash, password)) {
+            return make_ready_future<bool>(true);
+        }
+        return checkpw_on_some_shard(password, salted_hash).then([=](bool ok) {
+            if (ok) {
+                verified_passwords.insert(username, salted_hash, password);
+            }
+            return ok;
+        });
+    }).then_wrapped([=](future<bool> f) {
         try {
-            auto res = f.get0();
-            if (res->empty() || !checkpw(password, res->one().get_as<sstring>(SALTED_HASH))) {
+            if (!f.get0()) {
                 throw exceptions::authentication_exception("Username and/or password are incorrect");
             }
             return make_ready_future<::shared_ptr<authenticated_user>>(::make_shared<authenticated_user>(username));
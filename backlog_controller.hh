@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/timer.hh>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "seastarx.hh"
+
+// Adjusts the resources given to a background process, like compaction or
+// memtable flushing, to how far behind it is.
+//
+// Every interval the backlog of the process is measured, and translated into
+// shares of its I/O priority class, and into a CPU quota of the scheduling
+// group its threads run in, if it has one. The translation is a piecewise
+// linear function defined by control points, which must be sorted by input.
+// Backlogs below the first point, and above the last one, get the shares of
+// that point.
+//
+// So the process stays out of the way of foreground requests while it keeps
+// up, and speeds up when it falls behind.
+class backlog_controller {
+public:
+    struct control_point {
+        float input;
+        float output;
+    };
+
+    static constexpr float max_shares = 1000;
+protected:
+    const ::io_priority_class& _io_priority;
+    seastar::thread_scheduling_group* _cpu_group;
+    std::chrono::milliseconds _interval{0};
+    timer<> _update_timer;
+    std::vector<control_point> _control_points;
+    std::function<float()> _current_backlog;
+    float _current_shares = 0;
+
+    void adjust() {
+        update_shares(shares_for(_current_backlog()));
+    }
+
+    void update_shares(float shares) {
+        if (shares == _current_shares) {
+            return;
+        }
+        _current_shares = shares;
+        engine().update_shares_for_class(_io_priority, uint32_t(shares));
+        if (_cpu_group) {
+            // The quota caps CPU usage even when nothing else runs, so some
+            // progress is always allowed.
+            _cpu_group->update_usage(std::max(shares / max_shares, 0.05f));
+        }
+    }
+
+    float shares_for(float backlog) const {
+        if (backlog <= _control_points.front().input) {
+            return _control_points.front().output;
+        }
+        for (size_t i = 1; i < _control_points.size(); ++i) {
+            auto& prev = _control_points[i - 1];
+            auto& next = _control_points[i];
+            if (backlog <= next.input) {
+                auto fraction = (backlog - prev.input) / (next.input - prev.input);
+                return prev.output + fraction * (next.output - prev.output);
+            }
+        }
+        return _control_points.back().output;
+    }
+
+    backlog_controller(const ::io_priority_class& iop, seastar::thread_scheduling_group* cpu_group,
+            std::chrono::milliseconds interval, std::vector<control_point> control_points, std::function<float()> backlog)
+        : _io_priority(iop)
+        , _cpu_group(cpu_group)
+        , _interval(interval)
+        , _update_timer([this] { adjust(); })
+        , _control_points(std::move(control_points))
+        , _current_backlog(std::move(backlog))
+    {
+        _update_timer.arm_periodic(_interval);
+    }
+
+    // Fixed shares, the backlog is not looked at.
+    backlog_controller(const ::io_priority_class& iop, seastar::thread_scheduling_group* cpu_group, float static_shares)
+        : _io_priority(iop)
+        , _cpu_group(cpu_group)
+    {
+        update_shares(static_shares);
+    }
+
+    virtual ~backlog_controller() {}
+public:
+    backlog_controller(backlog_controller&&) = delete;
+
+    float current_shares() const {
+        return _current_shares;
+    }
+};
+
+// The backlog of memtable flushing is the amount of virtual dirty memory
+// above the soft limit, where flushing starts, relative to the hard limit,
+// where writes are throttled.
+class flush_controller : public backlog_controller {
+    static std::vector<control_point> control_points(float soft_limit) {
+        return {{soft_limit, 10}, {soft_limit + (1 - soft_limit) / 2, 200}, {1.0f, max_shares}};
+    }
+public:
+    // soft_limit is the ratio of the soft limit to the hard limit.
+    flush_controller(const ::io_priority_class& iop, float soft_limit, std::function<float()> dirty_ratio)
+        : backlog_controller(iop, nullptr, std::chrono::milliseconds(50), control_points(soft_limit), std::move(dirty_ratio)) {}
+    flush_controller(const ::io_priority_class& iop, float static_shares)
+        : backlog_controller(iop, nullptr, static_shares) {}
+};
+
+// The backlog of compaction is the amount of data compaction still has to
+// write, as estimated by the compaction strategies, normalized by the memory
+// memtables may use. So it is measured in flushes of all the memtables.
+class compaction_controller : public backlog_controller {
+public:
+    // Backlog at which compaction gets all the shares.
+    static constexpr float normalization_factor = 30;
+
+    compaction_controller(const ::io_priority_class& iop, seastar::thread_scheduling_group& cpu_group,
+            std::function<float()> normalized_backlog)
+        : backlog_controller(iop, &cpu_group, std::chrono::milliseconds(250),
+                {{0.0f, 50}, {1.5f, 100}, {normalization_factor, max_shares}}, std::move(normalized_backlog)) {}
+    compaction_controller(const ::io_priority_class& iop, seastar::thread_scheduling_group& cpu_group, float static_shares)
+        : backlog_controller(iop, &cpu_group, static_shares) {}
+};
@@ -27,6 +27,7 @@
 #include "core/unaligned.hh"
 #include "hashing.hh"
 #include "seastar/core/simple-stream.hh"
+#include "net/packet.hh"
 /**
  * Utility for writing data into a buffer when its final size is not known up front.
  *
@@ -57,12 +58,13 @@ class bytes_ostream {
         value_type data[0];
         void operator delete(void* ptr) { free(ptr); }
     };
-    // FIXME: consider increasing chunk size as the buffer grows
     static constexpr size_type chunk_size{512};
 private:
     std::unique_ptr<chunk> _begin;
     chunk* _current;
     size_type _size;
+    // The expected total size, see reserve().
+    size_type _size_hint = 0;
 public:
     class fragment_iterator : public std::iterator<std::input_iterator_tag, bytes_view> {
         chunk* _current;
@@ -101,13 +103,18 @@ class bytes_ostream {
     }
     // Figure out next chunk size.
     //   - must be enough for data_size
-    //   - must be at least chunk_size
+    //   - must be at least chunk_size, unless the hint says less will do
     //   - try to double each time to prevent too many allocations
+    //   - fit what is left of the hint, if any, in one go
     //   - do not exceed max_chunk_size
     size_type next_alloc_size(size_t data_size) const {
         auto next_size = _current
-                ? _current->size * 2
+                ? std::max<size_type>(_current->size * 2, size_type(chunk_size))
                 : chunk_size;
+        if (_size_hint > _size) {
+            auto hinted_size = _size_hint - _size + sizeof(chunk);
+            next_size = _current ? std::max<size_type>(next_size, hinted_size) : hinted_size;
+        }
         next_size = std::min(next_size, max_chunk_size());
         // FIXME: check for overflow?
         return std::max<size_type>(next_size, data_size + sizeof(chunk));
@@ -152,9 +159,11 @@ class bytes_ostream {
         : _begin(std::move(o._begin))
         , _current(o._current)
         , _size(o._size)
+        , _size_hint(o._size_hint)
     {
         o._current = nullptr;
         o._size = 0;
+        o._size_hint = 0;
     }
 
     bytes_ostream(const bytes_ostream& o)
@@ -162,6 +171,7 @@ class bytes_ostream {
         , _current(nullptr)
         , _size(0)
     {
+        reserve(o.size());
         append(o);
     }
 
@@ -279,8 +289,12 @@ class bytes_ostream {
         return _size == 0;
     }
 
+    // Hints that size more bytes are going to be written, so that the
+    // chunks can be sized for them: small buffers don't allocate more than
+    // they need, and large ones go to max_chunk_size() right away instead of
+    // growing there one small chunk at a time. Allocates nothing by itself.
     void reserve(size_t size) {
-        // FIXME: implement
+        _size_hint = std::max<size_t>(_size_hint, _size + size);
     }
 
     void append(const bytes_ostream& o) {
@@ -346,6 +360,22 @@ class bytes_ostream {
         }
     }
 
+    // Moves the data into a packet, one fragment per chunk, without copying
+    // it. The chunks are freed when the packet is. Leaves this empty.
+    net::packet to_packet() && {
+        std::vector<net::fragment> fragments;
+        for (auto c = _begin.get(); c; c = c->next.get()) {
+            if (c->offset) {
+                fragments.push_back(net::fragment{reinterpret_cast<char*>(c->data), c->offset});
+            }
+        }
+        auto del = make_object_deleter(std::move(_begin));
+        _current = nullptr;
+        _size = 0;
+        _size_hint = 0;
+        return net::packet(std::move(fragments), std::move(del));
+    }
+
     bool operator==(const bytes_ostream& other) const {
         auto as = fragments().begin();
         auto as_end = fragments().end();
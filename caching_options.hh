@@ -20,6 +20,8 @@
  */
 
 #pragma once
+#include <chrono>
+#include <limits>
 #include <core/sstring.hh>
 #include <boost/lexical_cast.hpp>
 #include "exceptions/exceptions.hh"
@@ -32,14 +34,43 @@ class caching_options {
     // For Origin, the default value for the row is "NONE". However, since our
     // row_cache will cache both keys and rows, we will default to ALL.
     //
-    // FIXME: We don't yet make any changes to our caching policies based on
-    // this (and maybe we shouldn't)
+    // FIXME: We don't yet make any changes to our row caching policies based
+    // on this (and maybe we shouldn't)
     static constexpr auto default_key = "ALL";
     static constexpr auto default_row = "ALL";
+    // Scylla extension: relative priority of the table's partitions in the
+    // row cache. A table with twice the weight of another loses half as many
+    // partitions to eviction. Not stored unless set, to keep schemas of
+    // tables which don't use it as they were.
+    static constexpr float default_eviction_weight = 1;
+    // Scylla extension: which partitions read from sstables are put in the
+    // row cache. "ALL" caches every one of them, "FREQUENT" only those read
+    // more often than the partitions they would push out of cache. Not
+    // stored unless set, like eviction_weight.
+    static constexpr auto default_admission = "ALL";
+    // Scylla extension: for how long, in milliseconds, coordinators may
+    // answer a prepared statement reading single partitions of the table
+    // with the result they last returned for the same bound values. Zero,
+    // the default, disables it. Meant for tables whose partitions are
+    // written once, not stored unless set.
+    static constexpr uint32_t default_coordinator_ttl_in_ms = 0;
 
     sstring _key_cache;
     sstring _row_cache;
-    caching_options(sstring k, sstring r) : _key_cache(k), _row_cache(r) {
+    float _eviction_weight = default_eviction_weight;
+    sstring _admission = default_admission;
+    uint32_t _coordinator_ttl_in_ms = default_coordinator_ttl_in_ms;
+    caching_options(sstring k, sstring r, float w = default_eviction_weight, sstring a = default_admission,
+            uint32_t coordinator_ttl_in_ms = default_coordinator_ttl_in_ms)
+        : _key_cache(k), _row_cache(r), _eviction_weight(w), _admission(a), _coordinator_ttl_in_ms(coordinator_ttl_in_ms) {
+        if (!(w > 0)) {
+            throw exceptions::configuration_exception("Invalid eviction_weight value: " + to_sstring(w) + ", must be positive");
+        }
+
+        if ((a != "ALL") && (a != "FREQUENT")) {
+            throw exceptions::configuration_exception("Invalid admission value: " + a);
+        }
+
         if ((k != "ALL") && (k != "NONE")) {
             throw exceptions::configuration_exception("Invalid key value: " + k); 
         }
@@ -60,7 +91,39 @@ class caching_options {
 public:
 
     std::map<sstring, sstring> to_map() const {
-        return {{ "keys", _key_cache }, { "rows_per_partition", _row_cache }};
+        std::map<sstring, sstring> map = {{ "keys", _key_cache }, { "rows_per_partition", _row_cache }};
+        if (_eviction_weight != default_eviction_weight) {
+            map.emplace("eviction_weight", to_sstring(_eviction_weight));
+        }
+        if (_admission != default_admission) {
+            map.emplace("admission", _admission);
+        }
+        if (_coordinator_ttl_in_ms != default_coordinator_ttl_in_ms) {
+            map.emplace("coordinator_ttl_in_ms", to_sstring(_coordinator_ttl_in_ms));
+        }
+        return map;
+    }
+
+    float eviction_weight() const {
+        return _eviction_weight;
+    }
+
+    // Whether partitions are cached only if they are read more often than
+    // the ones they would displace.
+    bool frequency_admission() const {
+        return _admission == "FREQUENT";
+    }
+
+    // For how long coordinators may reuse the results of the prepared
+    // statements reading the table, zero if they may not.
+    std::chrono::milliseconds coordinator_ttl() const {
+        return std::chrono::milliseconds(_coordinator_ttl_in_ms);
+    }
+
+    // Whether the positions of the table's partitions in its sstables are
+    // kept in the key cache.
+    bool cache_keys() const {
+        return _key_cache != "NONE";
     }
 
     sstring to_sstring() const {
@@ -71,24 +134,48 @@ class caching_options {
     static caching_options from_map(const Map & map) {
         sstring k = default_key;
         sstring r = default_row;
+        float w = default_eviction_weight;
+        sstring a = default_admission;
+        uint32_t t = default_coordinator_ttl_in_ms;
 
         for (auto& p : map) {
             if (p.first == "keys") {
                 k = p.second;
             } else if (p.first == "rows_per_partition") {
                 r = p.second;
+            } else if (p.first == "eviction_weight") {
+                try {
+                    w = boost::lexical_cast<float>(p.second);
+                } catch (boost::bad_lexical_cast& e) {
+                    throw exceptions::configuration_exception("Invalid eviction_weight value: " + p.second);
+                }
+            } else if (p.first == "admission") {
+                a = p.second;
+            } else if (p.first == "coordinator_ttl_in_ms") {
+                int64_t v;
+                try {
+                    v = boost::lexical_cast<int64_t>(p.second);
+                } catch (boost::bad_lexical_cast& e) {
+                    throw exceptions::configuration_exception("Invalid coordinator_ttl_in_ms value: " + p.second);
+                }
+                if (v < 0 || v > std::numeric_limits<uint32_t>::max()) {
+                    throw exceptions::configuration_exception("Invalid coordinator_ttl_in_ms value: " + p.second);
+                }
+                t = v;
             } else {
                 throw exceptions::configuration_exception("Invalid caching option: " + p.first);
             }
         }
-        return caching_options(k, r);
+        return caching_options(k, r, w, a, t);
     }
     static caching_options from_sstring(const sstring& str) {
         return from_map(json::to_map(str));
     }
 
     bool operator==(const caching_options& other) const {
-        return _key_cache == other._key_cache && _row_cache == other._row_cache;
+        return _key_cache == other._key_cache && _row_cache == other._row_cache
+            && _eviction_weight == other._eviction_weight && _admission == other._admission
+            && _coordinator_ttl_in_ms == other._coordinator_ttl_in_ms;
     }
     bool operator!=(const caching_options& other) const {
         return !(*this == other);
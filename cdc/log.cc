@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "cdc/log.hh"
+#include "database.hh"
+#include "schema_builder.hh"
+#include "canonical_mutation.hh"
+#include "utils/UUID_gen.hh"
+#include "serializer.hh"
+#include "idl/uuid.dist.hh"
+#include "idl/frozen_schema.dist.hh"
+#include "serializer_impl.hh"
+#include "serialization_visitors.hh"
+#include "idl/uuid.dist.impl.hh"
+#include "idl/frozen_schema.dist.impl.hh"
+
+namespace cdc {
+
+static const sstring log_suffix = "_scylla_cdc_log";
+
+sstring log_name(const sstring& table_name) {
+    return table_name + log_suffix;
+}
+
+schema_ptr create_log_schema(const schema& base) {
+    schema_builder b(base.ks_name(), log_name(base.cf_name()));
+    b.with_column("bucket", timestamp_type, column_kind::partition_key);
+    b.with_column("stream", int32_type, column_kind::partition_key);
+    b.with_column("time", timeuuid_type, column_kind::clustering_key);
+    b.with_column("batch_seq_no", int32_type, column_kind::clustering_key);
+    b.with_column("key", bytes_type);
+    b.with_column("mutation", bytes_type);
+    b.set_comment(sprint("CDC log for %s.%s", base.ks_name(), base.cf_name()));
+    b.set_default_time_to_live(std::chrono::duration_cast<gc_clock::duration>(log_ttl));
+    // The entries are never deleted, only expire.
+    b.set_gc_grace_seconds(0);
+    b.set_compaction_strategy(sstables::compaction_strategy_type::time_window);
+    return b.build();
+}
+
+static int32_t stream_of(const dht::token& t) {
+    // The token is a big endian fraction, so its top bits split the ring
+    // into stream_count equal parts.
+    return t._data.empty() ? 0 : uint8_t(t._data[0]) * stream_count / 256;
+}
+
+static bytes serialize(const mutation& m) {
+    bytes_ostream out;
+    ser::serialize(out, canonical_mutation(m));
+    return to_bytes(out.linearize());
+}
+
+void append_log_mutations(database& db, std::vector<mutation>& mutations) {
+    auto now = db_clock::now();
+    auto bucket = now - now.time_since_epoch() % bucket_width;
+    auto time = utils::UUID_gen::get_time_UUID();
+    auto ts = api::new_timestamp();
+    auto ttl = ttl_opt(std::chrono::duration_cast<gc_clock::duration>(log_ttl));
+    int32_t seq_no = 0;
+    auto base_count = mutations.size();
+    // At most one log mutation per base one, so that m stays valid.
+    mutations.reserve(base_count * 2);
+    for (size_t i = 0; i < base_count; ++i) {
+        auto& m = mutations[i];
+        auto& s = *m.schema();
+        if (!s.cdc() || s.is_view() || s.is_counter()) {
+            continue;
+        }
+        schema_ptr log;
+        try {
+            log = db.find_schema(s.ks_name(), log_name(s.cf_name()));
+        } catch (no_such_column_family&) {
+            // The log table isn't created yet, or was dropped.
+            continue;
+        }
+        auto pk = partition_key::from_exploded(*log, {
+            timestamp_type->decompose(bucket),
+            int32_type->decompose(stream_of(m.token())),
+        });
+        auto ck = clustering_key::from_exploded(*log, {
+            timeuuid_type->decompose(time),
+            int32_type->decompose(seq_no++),
+        });
+        auto key = bytes(m.key().representation());
+        auto data = serialize(m);
+        // The changes to the partitions of the same stream go to the same
+        // log partition, so that they are written as a single mutation.
+        auto it = std::find_if(mutations.begin() + base_count, mutations.end(), [&] (const mutation& lm) {
+            return lm.schema() == log && lm.key().equal(*log, pk);
+        });
+        if (it == mutations.end()) {
+            mutations.emplace_back(std::move(pk), log);
+            it = std::prev(mutations.end());
+        }
+        it->set_cell(ck, to_bytes("key"), data_value(std::move(key)), ts, ttl);
+        it->set_cell(ck, to_bytes("mutation"), data_value(std::move(data)), ts, ttl);
+    }
+}
+
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include "schema.hh"
+#include "mutation.hh"
+
+class database;
+
+// Change data capture.
+//
+// The writes to a table created or altered WITH cdc = true are also recorded,
+// as they are, in the log table <table>_scylla_cdc_log of its keyspace. The
+// log holds only the delta of each write, the serialized mutation, and never
+// the preimage of the rows, so capturing a write costs a single extra write
+// and no read.
+//
+// The log is partitioned by a time bucket of bucket_width and by one of
+// stream_count streams, derived from the token of the base partition, so
+// that the changes of a given period can be read a stream at a time, in
+// the order of their timeuuid. The entries expire after log_ttl.
+//
+// CREATE TABLE ks.t_scylla_cdc_log (
+//     bucket timestamp,
+//     stream int,
+//     time timeuuid,
+//     batch_seq_no int,
+//     key blob,
+//     mutation blob,
+//     PRIMARY KEY ((bucket, stream), time, batch_seq_no)
+// ) WITH default_time_to_live = 86400 AND gc_grace_seconds = 0
+//   AND compaction = {'class': 'TimeWindowCompactionStrategy'};
+namespace cdc {
+
+constexpr unsigned stream_count = 16;
+constexpr std::chrono::seconds bucket_width(60);
+constexpr std::chrono::seconds log_ttl(24 * 3600);
+
+sstring log_name(const sstring& table_name);
+
+schema_ptr create_log_schema(const schema& base);
+
+// Appends to mutations the log entries of those of the mutations which
+// belong to a table with cdc enabled, so that the base and the log are
+// written by the same coordinator request.
+void append_log_mutations(database& db, std::vector<mutation>& mutations);
+
+}
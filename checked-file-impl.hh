@@ -23,6 +23,7 @@
 
 #include "seastar/core/file.hh"
 #include "disk-error-handler.hh"
+#include "service/priority_manager.hh"
 
 class checked_file_impl : public file_impl {
 public:
@@ -35,26 +36,36 @@ class checked_file_impl : public file_impl {
     }
 
     virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
-        return do_io_check(_error_handler, [&] {
-            return get_file_impl(_file)->write_dma(pos, buffer, len, pc);
+        return with_bandwidth(pc, len, [&eh = _error_handler, f = _file, pos, buffer, len, pc] () mutable {
+            return do_io_check(eh, [&] {
+                return get_file_impl(f)->write_dma(pos, buffer, len, pc);
+            });
         });
     }
 
     virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
-        return do_io_check(_error_handler, [&] {
-            return get_file_impl(_file)->write_dma(pos, iov, pc);
+        auto len = iovec_len(iov);
+        return with_bandwidth(pc, len, [&eh = _error_handler, f = _file, pos, iov = std::move(iov), pc] () mutable {
+            return do_io_check(eh, [&] {
+                return get_file_impl(f)->write_dma(pos, std::move(iov), pc);
+            });
         });
     }
 
     virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
-        return do_io_check(_error_handler, [&] {
-            return get_file_impl(_file)->read_dma(pos, buffer, len, pc);
+        return with_bandwidth(pc, len, [&eh = _error_handler, f = _file, pos, buffer, len, pc] () mutable {
+            return do_io_check(eh, [&] {
+                return get_file_impl(f)->read_dma(pos, buffer, len, pc);
+            });
         });
     }
 
     virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
-        return do_io_check(_error_handler, [&] {
-            return get_file_impl(_file)->read_dma(pos, iov, pc);
+        auto len = iovec_len(iov);
+        return with_bandwidth(pc, len, [&eh = _error_handler, f = _file, pos, iov = std::move(iov), pc] () mutable {
+            return do_io_check(eh, [&] {
+                return get_file_impl(f)->read_dma(pos, std::move(iov), pc);
+            });
         });
     }
 
@@ -113,11 +124,31 @@ class checked_file_impl : public file_impl {
     }
 
     virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
-        return do_io_check(_error_handler, [&] {
-            return get_file_impl(_file)->dma_read_bulk(offset, range_size, pc);
+        return with_bandwidth(pc, range_size, [&eh = _error_handler, f = _file, offset, range_size, pc] () mutable {
+            return do_io_check(eh, [&] {
+                return get_file_impl(f)->dma_read_bulk(offset, range_size, pc);
+            });
         });
     }
 private:
+    static size_t iovec_len(const std::vector<iovec>& iov) {
+        size_t len = 0;
+        for (auto& v : iov) {
+            len += v.iov_len;
+        }
+        return len;
+    }
+
+    // Runs the I/O once the bandwidth limit of its class, if any, allows it.
+    template <typename Func>
+    static futurize_t<std::result_of_t<Func()>> with_bandwidth(const io_priority_class& pc, size_t len, Func&& func) {
+        auto limiter = service::get_local_priority_manager().bandwidth_limiter(pc);
+        if (!limiter || !limiter->rate()) {
+            return func();
+        }
+        return limiter->reserve(len).then(std::forward<Func>(func));
+    }
+
     const io_error_handler& _error_handler;
     file _file;
 };
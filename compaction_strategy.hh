@@ -33,6 +33,7 @@ enum class compaction_strategy_type {
     size_tiered,
     leveled,
     date_tiered,
+    time_window,
 };
 
 class compaction_strategy_impl;
@@ -40,6 +41,7 @@ class sstable;
 class sstable_set;
 struct compaction_descriptor;
 struct resharding_descriptor;
+class output_splitter;
 
 class compaction_strategy {
     ::shared_ptr<compaction_strategy_impl> _compaction_strategy_impl;
@@ -70,6 +72,17 @@ class compaction_strategy {
     // An estimation of number of compaction for strategy to be satisfied.
     int64_t estimated_pending_compactions(column_family& cf) const;
 
+    // Size of the sstables the output of any compaction is split into, so
+    // that the compaction can release its input as it goes.
+    uint64_t fragment_size() const;
+
+    // An estimation of the bytes compaction has to write for strategy to be satisfied.
+    double backlog(column_family& cf) const;
+
+    // Splitter of the output of the compactions of the strategy, see
+    // compact_sstables(), or null if the output is a single stream.
+    ::shared_ptr<const output_splitter> make_output_splitter() const;
+
     static sstring name(compaction_strategy_type type) {
         switch (type) {
         case compaction_strategy_type::null:
@@ -82,6 +95,8 @@ class compaction_strategy {
             return "LeveledCompactionStrategy";
         case compaction_strategy_type::date_tiered:
             return "DateTieredCompactionStrategy";
+        case compaction_strategy_type::time_window:
+            return "TimeWindowCompactionStrategy";
         default:
             throw std::runtime_error("Invalid Compaction Strategy");
         }
@@ -100,6 +115,8 @@ class compaction_strategy {
             return compaction_strategy_type::leveled;
         } else if (short_name == "DateTieredCompactionStrategy") {
             return compaction_strategy_type::date_tiered;
+        } else if (short_name == "TimeWindowCompactionStrategy") {
+            return compaction_strategy_type::time_window;
         } else {
             throw exceptions::configuration_exception(sprint("Unable to find compaction strategy class '%s'", name));
         }
@@ -32,13 +32,207 @@
 
 enum class allow_prefixes { no, yes };
 
+// How compound_type compares the values of one of its components. The most
+// common key component types are compared here, without going through the
+// virtual abstract_type::compare().
+enum class component_compare_kind : uint8_t {
+    generic,
+    unsigned_bytes,
+    int32,
+    int64,
+    timeuuid,
+};
+
+class component_comparator {
+    const abstract_type* _type;
+    component_compare_kind _kind;
+    bool _reversed;
+    // The size of the non-empty values of a type which compares like its
+    // bytes, if it is fixed, 0 otherwise.
+    uint8_t _fixed_size = 0;
+private:
+    template<typename T>
+    static int compare_integers(const abstract_type& t, bytes_view v1, bytes_view v2) {
+        if (v1.size() != sizeof(T) || v2.size() != sizeof(T)) {
+            return t.compare(v1, v2);
+        }
+        auto a = read_simple_exactly<T>(v1);
+        auto b = read_simple_exactly<T>(v2);
+        return a == b ? 0 : a < b ? -1 : 1;
+    }
+public:
+    explicit component_comparator(const abstract_type& t)
+        : _type(&t)
+        , _reversed(t.is_reversed())
+    {
+        // Types are compared by name, as the type objects are per shard.
+        auto& u = *t.underlying_type();
+        auto& name = u.name();
+        if (name == int32_type->name()) {
+            _kind = component_compare_kind::int32;
+        } else if (name == long_type->name() || name == timestamp_type->name() || name == time_type->name()) {
+            _kind = component_compare_kind::int64;
+        } else if (name == timeuuid_type->name()) {
+            _kind = component_compare_kind::timeuuid;
+        } else if (name == simple_date_type->name()) {
+            _kind = component_compare_kind::unsigned_bytes;
+            _fixed_size = sizeof(uint32_t);
+        } else if (name == date_type->name()) {
+            _kind = component_compare_kind::unsigned_bytes;
+            _fixed_size = sizeof(int64_t);
+        } else if (u.is_byte_order_comparable() && !u.is_collection()) {
+            _kind = component_compare_kind::unsigned_bytes;
+        } else {
+            _kind = component_compare_kind::generic;
+        }
+        if (_kind == component_compare_kind::generic) {
+            // t.compare() takes care of the order.
+            _reversed = false;
+        } else {
+            _type = &u;
+        }
+    }
+
+    component_compare_kind kind() const {
+        return _kind;
+    }
+    bool is_reversed() const {
+        return _reversed;
+    }
+    size_t fixed_size() const {
+        return _fixed_size;
+    }
+
+    template<component_compare_kind Kind>
+    int compare_as(bytes_view v1, bytes_view v2) const {
+        int r;
+        switch (Kind) {
+        case component_compare_kind::unsigned_bytes:
+            r = compare_unsigned(v1, v2);
+            break;
+        case component_compare_kind::int32:
+            r = compare_integers<int32_t>(*_type, v1, v2);
+            break;
+        case component_compare_kind::int64:
+            r = compare_integers<int64_t>(*_type, v1, v2);
+            break;
+        case component_compare_kind::timeuuid:
+            if (v1.size() != 16 || v2.size() != 16) {
+                r = _type->compare(v1, v2);
+                break;
+            }
+            r = timeuuid_compare_timestamps(v1, v2);
+            if (!r) {
+                // Like timeuuid_type_impl, which compares signed bytes.
+                auto m = std::mismatch(v1.begin(), v1.end(), v2.begin());
+                r = m.first == v1.end() ? 0 : *m.first < *m.second ? -1 : 1;
+            }
+            break;
+        default:
+            return _type->compare(v1, v2);
+        }
+        return _reversed ? -r : r;
+    }
+
+    int compare(bytes_view v1, bytes_view v2) const {
+        switch (_kind) {
+        case component_compare_kind::unsigned_bytes:
+            return compare_as<component_compare_kind::unsigned_bytes>(v1, v2);
+        case component_compare_kind::int32:
+            return compare_as<component_compare_kind::int32>(v1, v2);
+        case component_compare_kind::int64:
+            return compare_as<component_compare_kind::int64>(v1, v2);
+        case component_compare_kind::timeuuid:
+            return compare_as<component_compare_kind::timeuuid>(v1, v2);
+        default:
+            return compare_as<component_compare_kind::generic>(v1, v2);
+        }
+    }
+
+    // Byte-comparable encoding of values: compare_unsigned() of the
+    // encodings of two values orders them like compare(), and no encoding
+    // is a prefix of another, so that the encodings of the components of a
+    // compound can be concatenated. Empty values encode to a single zero
+    // byte, or a zero terminator for variable size values. Bytes of
+    // variable size values which are zero are followed by 0xff.
+    //
+    // Returns the size of the encoding of v, 0 if v has none, because its
+    // type isn't supported or v isn't valid.
+    size_t encoded_size(bytes_view v) const {
+        switch (_kind) {
+        case component_compare_kind::unsigned_bytes:
+            if (_fixed_size) {
+                return v.empty() ? 1 : v.size() == _fixed_size ? 1 + v.size() : 0;
+            }
+            return v.size() + std::count(v.begin(), v.end(), 0) + 2;
+        case component_compare_kind::int32:
+            return v.empty() ? 1 : v.size() == sizeof(int32_t) ? 1 + v.size() : 0;
+        case component_compare_kind::int64:
+            return v.empty() ? 1 : v.size() == sizeof(int64_t) ? 1 + v.size() : 0;
+        case component_compare_kind::timeuuid:
+            // The timestamp, then the bytes, in which order timeuuid_type_impl
+            // compares them.
+            return v.empty() ? 1 : v.size() == 16 ? 1 + 8 + 16 : 0;
+        default:
+            return 0;
+        }
+    }
+
+    // Writes the encoding of v, of encoded_size(v) > 0 bytes, at out.
+    int8_t* encode(bytes_view v, int8_t* out) const {
+        auto start = out;
+        if (_kind == component_compare_kind::unsigned_bytes && !_fixed_size) {
+            for (auto b : v) {
+                *out++ = b;
+                if (!b) {
+                    *out++ = int8_t(0xff);
+                }
+            }
+            *out++ = 0;
+            *out++ = 0;
+        } else if (v.empty()) {
+            *out++ = 0;
+        } else {
+            *out++ = 1;
+            switch (_kind) {
+            case component_compare_kind::int32:
+            case component_compare_kind::int64:
+                out = std::copy(v.begin(), v.end(), out);
+                start[1] ^= int8_t(0x80);
+                break;
+            case component_compare_kind::timeuuid:
+                *out++ = v[6] & 0xf;
+                for (auto pos : { 7, 4, 5, 0, 1, 2, 3 }) {
+                    *out++ = v[pos];
+                }
+                for (auto b : v) {
+                    *out++ = b ^ int8_t(0x80);
+                }
+                break;
+            default:
+                out = std::copy(v.begin(), v.end(), out);
+            }
+        }
+        if (_reversed) {
+            std::transform(start, out, start, [] (int8_t b) { return ~b; });
+        }
+        return out;
+    }
+};
+
 template<allow_prefixes AllowPrefixes = allow_prefixes::no>
 class compound_type final {
 private:
     const std::vector<data_type> _types;
     const bool _byte_order_equal;
-    const bool _byte_order_comparable;
-    const bool _is_reversed;
+    const std::vector<component_comparator> _comparators;
+    // The serialized size, and number, of the leading components which
+    // compare like their bytes and have fixed size, so that they can be
+    // compared together with a single memcmp().
+    size_t _memcmp_prefix_size = 0;
+    size_t _memcmp_prefix_components = 0;
+    int (compound_type::*_compare)(bytes_view, bytes_view) const;
+    const bool _byte_comparable_encodable;
 public:
     static constexpr bool is_prefixable = AllowPrefixes == allow_prefixes::yes;
     using prefix_type = compound_type<allow_prefixes::yes>;
@@ -50,9 +244,21 @@ class compound_type final {
         , _byte_order_equal(std::all_of(_types.begin(), _types.end(), [] (auto t) {
                 return t->is_byte_order_equal();
             }))
-        , _byte_order_comparable(false)
-        , _is_reversed(_types.size() == 1 && _types[0]->is_reversed())
-    { }
+        , _comparators(boost::copy_range<std::vector<component_comparator>>(_types
+                | boost::adaptors::transformed([] (const data_type& t) { return component_comparator(*t); })))
+        , _compare(select_compare())
+        , _byte_comparable_encodable(std::none_of(_comparators.begin(), _comparators.end(), [] (const component_comparator& c) {
+                return c.kind() == component_compare_kind::generic;
+            }))
+    {
+        for (auto&& c : _comparators) {
+            if (!c.fixed_size() || c.is_reversed()) {
+                break;
+            }
+            _memcmp_prefix_size += sizeof(size_type) + c.fixed_size();
+            ++_memcmp_prefix_components;
+        }
+    }
 
     compound_type(compound_type&&) = default;
 
@@ -187,7 +393,7 @@ class compound_type final {
         });
         return result;
     }
-    bool less(bytes_view b1, bytes_view b2) {
+    bool less(bytes_view b1, bytes_view b2) const {
         return compare(b1, b2) < 0;
     }
     size_t hash(bytes_view v) {
@@ -202,18 +408,118 @@ class compound_type final {
         }
         return h;
     }
-    int compare(bytes_view b1, bytes_view b2) {
-        if (_byte_order_comparable) {
-            if (_is_reversed) {
-                return compare_unsigned(b2, b1);
-            } else {
-                return compare_unsigned(b1, b2);
+private:
+    // Compares the components of b1 and b2 until one of them ends.
+    struct components_compare_result {
+        int result;
+        bool b1_ended;
+        bool b2_ended;
+    };
+    bool has_full_memcmp_prefix(bytes_view v) const {
+        for (size_t i = 0; i < _memcmp_prefix_components; ++i) {
+            auto len = read_simple<size_type>(v);
+            if (len != _comparators[i].fixed_size()) {
+                return false;
             }
+            v.remove_prefix(len);
         }
-        return lexicographical_tri_compare(_types.begin(), _types.end(),
-            begin(b1), end(b1), begin(b2), end(b2), [] (auto&& type, auto&& v1, auto&& v2) {
-                return type->compare(v1, v2);
-            });
+        return true;
+    }
+    components_compare_result compare_components(bytes_view b1, bytes_view b2) const {
+        auto c = _comparators.begin();
+        if (_memcmp_prefix_size && b1.size() >= _memcmp_prefix_size && b2.size() >= _memcmp_prefix_size
+                && has_full_memcmp_prefix(b1)) {
+            // Up to the first difference, b2 has the same lengths as b1. If
+            // the difference is in a length, the value of b2 is the empty
+            // one, which sorts first.
+            auto r = memcmp(b1.begin(), b2.begin(), _memcmp_prefix_size);
+            if (r) {
+                return { r, false, false };
+            }
+            b1.remove_prefix(_memcmp_prefix_size);
+            b2.remove_prefix(_memcmp_prefix_size);
+            c += _memcmp_prefix_components;
+        }
+        auto first1 = begin(b1), last1 = end(b1);
+        auto first2 = begin(b2), last2 = end(b2);
+        while (first1 != last1 && first2 != last2) {
+            auto r = c->compare(*first1, *first2);
+            if (r) {
+                return { r, false, false };
+            }
+            ++first1;
+            ++first2;
+            ++c;
+        }
+        return { 0, first1 == last1, first2 == last2 };
+    }
+    int compare_lexicographically(bytes_view b1, bytes_view b2) const {
+        auto r = compare_components(b1, b2);
+        if (r.result || r.b1_ended == r.b2_ended) {
+            return r.result;
+        }
+        return r.b1_ended ? -1 : 1;
+    }
+    template<component_compare_kind Kind>
+    int compare_singular(bytes_view b1, bytes_view b2) const {
+        if (b1.empty() || b2.empty()) {
+            return compare_lexicographically(b1, b2);
+        }
+        return _comparators.front().compare_as<Kind>(*begin(b1), *begin(b2));
+    }
+    decltype(_compare) select_compare() const {
+        if (_comparators.size() != 1) {
+            return &compound_type::compare_lexicographically;
+        }
+        switch (_comparators.front().kind()) {
+        case component_compare_kind::unsigned_bytes:
+            return &compound_type::compare_singular<component_compare_kind::unsigned_bytes>;
+        case component_compare_kind::int32:
+            return &compound_type::compare_singular<component_compare_kind::int32>;
+        case component_compare_kind::int64:
+            return &compound_type::compare_singular<component_compare_kind::int64>;
+        case component_compare_kind::timeuuid:
+            return &compound_type::compare_singular<component_compare_kind::timeuuid>;
+        default:
+            return &compound_type::compare_singular<component_compare_kind::generic>;
+        }
+    }
+public:
+    int compare(bytes_view b1, bytes_view b2) const {
+        return (this->*_compare)(b1, b2);
+    }
+    // Whether every component may have a byte-comparable encoding.
+    bool is_byte_comparable_encodable() const {
+        return _byte_comparable_encodable;
+    }
+    // Returns an encoding of v such that compare_unsigned() of the encodings
+    // of two compounds orders them like compare(), or a disengaged optional
+    // if some component of v can't be encoded.
+    bytes_opt encode_byte_comparable(bytes_view v) const {
+        if (!_byte_comparable_encodable) {
+            return { };
+        }
+        size_t size = 0;
+        auto c = _comparators.begin();
+        for (auto&& value : components(v)) {
+            auto s = (c++)->encoded_size(value);
+            if (!s) {
+                return { };
+            }
+            size += s;
+        }
+        bytes b(bytes::initialized_later(), size);
+        auto out = b.begin();
+        c = _comparators.begin();
+        for (auto&& value : components(v)) {
+            out = (c++)->encode(value, out);
+        }
+        return { std::move(b) };
+    }
+    // Compares in prefix equality order, in which two compounds are equal
+    // iff one of them is a prefix of the other.
+    int prefix_equality_compare(bytes_view b1, bytes_view b2) const {
+        return compare_components(b1, b2).result;
     }
     // Retruns true iff given prefix has no missing components
     bool is_full(bytes_view v) const {
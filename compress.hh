@@ -22,26 +22,40 @@
 #pragma once
 
 #include "exceptions/exceptions.hh"
+#include "bytes.hh"
 
 enum class compressor {
     none,
     lz4,
     snappy,
     deflate,
+    zstd,
 };
 
 class compression_parameters {
 public:
     static constexpr int32_t DEFAULT_CHUNK_LENGTH = 4 * 1024;
     static constexpr double DEFAULT_CRC_CHECK_CHANCE = 1.0;
+    static constexpr int DEFAULT_ZSTD_COMPRESSION_LEVEL = 3;
+    static constexpr int MAX_ZSTD_COMPRESSION_LEVEL = 22;
+    // The dictionary is stored hex-encoded in a 16-bit length string of the
+    // CompressionInfo component.
+    static constexpr size_t MAX_ZSTD_DICTIONARY_SIZE = std::numeric_limits<uint16_t>::max() / 2;
 
     static constexpr auto SSTABLE_COMPRESSION = "sstable_compression";
     static constexpr auto CHUNK_LENGTH_KB = "chunk_length_kb";
     static constexpr auto CRC_CHECK_CHANCE = "crc_check_chance";
+    static constexpr auto COMPRESSION_LEVEL = "compression_level";
+    // A dictionary trained on the table's data (e.g. with "zstd --train"),
+    // hex-encoded. It makes small chunks compress much better, since each
+    // chunk is compressed independently.
+    static constexpr auto ZSTD_DICTIONARY = "zstd_dictionary";
 private:
     compressor _compressor;
     std::experimental::optional<int> _chunk_length;
     std::experimental::optional<double> _crc_check_chance;
+    std::experimental::optional<int> _compression_level;
+    std::experimental::optional<sstring> _zstd_dictionary;
 public:
     compression_parameters(compressor c = compressor::lz4) : _compressor(c) { }
     compression_parameters(const std::map<sstring, sstring>& options) {
@@ -59,6 +73,8 @@ class compression_parameters {
             _compressor = compressor::snappy;
         } else if (is_compressor_class(compressor_class, "DeflateCompressor")) {
             _compressor = compressor::deflate;
+        } else if (is_compressor_class(compressor_class, "ZstdCompressor")) {
+            _compressor = compressor::zstd;
         } else {
             throw exceptions::configuration_exception(sstring("Unsupported compression class '") + compressor_class + "'.");
         }
@@ -78,11 +94,25 @@ class compression_parameters {
                 throw exceptions::syntax_exception(sstring("Invalid double value ") + crc_chance->second + "for " + CRC_CHECK_CHANCE);
             }
         }
+        auto level = options.find(COMPRESSION_LEVEL);
+        if (level != options.end()) {
+            try {
+                _compression_level = std::stoi(level->second);
+            } catch (const std::exception& e) {
+                throw exceptions::syntax_exception(sstring("Invalid integer value ") + level->second + " for " + COMPRESSION_LEVEL);
+            }
+        }
+        auto dictionary = options.find(ZSTD_DICTIONARY);
+        if (dictionary != options.end()) {
+            _zstd_dictionary = dictionary->second;
+        }
     }
 
     compressor get_compressor() const { return _compressor; }
     int32_t chunk_length() const { return _chunk_length.value_or(int(DEFAULT_CHUNK_LENGTH)); }
     double crc_check_chance() const { return _crc_check_chance.value_or(double(DEFAULT_CRC_CHECK_CHANCE)); }
+    int compression_level() const { return _compression_level.value_or(int(DEFAULT_ZSTD_COMPRESSION_LEVEL)); }
+    const std::experimental::optional<sstring>& zstd_dictionary() const { return _zstd_dictionary; }
 
     void validate() {
         if (_chunk_length) {
@@ -98,6 +128,23 @@ class compression_parameters {
         if (_crc_check_chance && (_crc_check_chance.value() < 0.0 || _crc_check_chance.value() > 1.0)) {
             throw exceptions::configuration_exception(sstring(CRC_CHECK_CHANCE) + " must be between 0.0 and 1.0.");
         }
+        if ((_compression_level || _zstd_dictionary) && _compressor != compressor::zstd) {
+            throw exceptions::configuration_exception(sprint("%s and %s are only supported by ZstdCompressor.", COMPRESSION_LEVEL, ZSTD_DICTIONARY));
+        }
+        if (_compression_level && (_compression_level.value() < 1 || _compression_level.value() > MAX_ZSTD_COMPRESSION_LEVEL)) {
+            throw exceptions::configuration_exception(sprint("%s must be between 1 and %d.", COMPRESSION_LEVEL, MAX_ZSTD_COMPRESSION_LEVEL));
+        }
+        if (_zstd_dictionary) {
+            bytes dictionary;
+            try {
+                dictionary = from_hex(_zstd_dictionary.value());
+            } catch (const std::invalid_argument& e) {
+                throw exceptions::configuration_exception(sprint("Invalid %s: %s", ZSTD_DICTIONARY, e.what()));
+            }
+            if (dictionary.empty() || dictionary.size() > MAX_ZSTD_DICTIONARY_SIZE) {
+                throw exceptions::configuration_exception(sprint("%s must hold between 1 and %d bytes.", ZSTD_DICTIONARY, MAX_ZSTD_DICTIONARY_SIZE));
+            }
+        }
     }
 
     std::map<sstring, sstring> get_options() const {
@@ -112,23 +159,33 @@ class compression_parameters {
         if (_crc_check_chance) {
             opts.emplace(sstring(CRC_CHECK_CHANCE), std::to_string(_crc_check_chance.value()));
         }
+        if (_compression_level) {
+            opts.emplace(sstring(COMPRESSION_LEVEL), std::to_string(_compression_level.value()));
+        }
+        if (_zstd_dictionary) {
+            opts.emplace(sstring(ZSTD_DICTIONARY), _zstd_dictionary.value());
+        }
         return opts;
     }
     bool operator==(const compression_parameters& other) const {
         return _compressor == other._compressor
                && _chunk_length == other._chunk_length
-               && _crc_check_chance == other._crc_check_chance;
+               && _crc_check_chance == other._crc_check_chance
+               && _compression_level == other._compression_level
+               && _zstd_dictionary == other._zstd_dictionary;
     }
     bool operator!=(const compression_parameters& other) const {
         return !(*this == other);
     }
 private:
     void validate_options(const std::map<sstring, sstring>& options) {
-        // currently, there are no options specific to a particular compressor
+        // compression_level and zstd_dictionary are specific to zstd, see validate()
         static std::set<sstring> keywords({
             sstring(SSTABLE_COMPRESSION),
             sstring(CHUNK_LENGTH_KB),
             sstring(CRC_CHECK_CHANCE),
+            sstring(COMPRESSION_LEVEL),
+            sstring(ZSTD_DICTIONARY),
         });
         for (auto&& opt : options) {
             if (!keywords.count(opt.first)) {
@@ -148,6 +205,8 @@ class compression_parameters {
             return "org.apache.cassandra.io.compress.SnappyCompressor";
         case compressor::deflate:
             return "org.apache.cassandra.io.compress.DeflateCompressor";
+        case compressor::zstd:
+            return "org.apache.cassandra.io.compress.ZstdCompressor";
         default:
             abort();
         }
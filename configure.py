@@ -181,15 +181,22 @@ scylla_tests = [
     'tests/row_cache_alloc_stress',
     'tests/perf_row_cache_update',
     'tests/perf/perf_hash',
+    'tests/perf/perf_checksum',
+    'tests/perf/perf_key_compare',
+    'tests/perf/perf_range_tombstone_list',
     'tests/perf/perf_cql_parser',
     'tests/perf/perf_simple_query',
+    'tests/perf/perf_scenario',
+    'tests/perf/perf_thrift_batch_mutate',
     'tests/perf/perf_fast_forward',
     'tests/memory_footprint',
     'tests/perf/perf_sstable',
+    'tests/perf/perf_compaction',
     'tests/cql_query_test',
     'tests/storage_proxy_test',
     'tests/schema_change_test',
     'tests/mutation_reader_test',
+    'tests/flat_mutation_reader_test',
     'tests/mutation_query_test',
     'tests/row_cache_test',
     'tests/test-serialization',
@@ -210,6 +217,7 @@ scylla_tests = [
     'tests/ec2_snitch_test',
     'tests/snitch_reset_test',
     'tests/network_topology_strategy_test',
+    'tests/dynamic_snitch_test',
     'tests/query_processor_test',
     'tests/batchlog_manager_test',
     'tests/bytes_ostream_test',
@@ -219,8 +227,11 @@ scylla_tests = [
     'tests/logalloc_test',
     'tests/log_histogram_test',
     'tests/managed_vector_test',
+    'tests/bptree_test',
     'tests/crc_test',
     'tests/flush_queue_test',
+    'tests/loading_cache_test',
+    'tests/rate_limiter_test',
     'tests/dynamic_bitset_test',
     'tests/auth_test',
     'tests/idl_test',
@@ -232,8 +243,16 @@ scylla_tests = [
     'tests/sstable_atomic_deletion_test',
     'tests/virtual_reader_test',
     'tests/view_schema_test',
+    'tests/secondary_index_test',
+    'tests/cdc_test',
     'tests/counter_test',
     'tests/cell_locker_test',
+    'tests/vint_serialization_test',
+    'tests/top_k_test',
+    'tests/frequency_sketch_test',
+    'tests/interval_tree_test',
+    'tests/latency_histogram_test',
+    'tests/task_group_test',
 ]
 
 apps = [
@@ -301,13 +320,16 @@ scylla_core = (['database.cc',
                  'frozen_schema.cc',
                  'schema_registry.cc',
                  'bytes.cc',
+                 'vint-serialization.cc',
                  'mutation.cc',
                  'streamed_mutation.cc',
+                 'flat_mutation_reader.cc',
                  'partition_version.cc',
                  'row_cache.cc',
                  'canonical_mutation.cc',
                  'frozen_mutation.cc',
                  'memtable.cc',
+                 'memory_footprint.cc',
                  'schema_mutations.cc',
                  'release.cc',
                  'supervisor.cc',
@@ -317,11 +339,17 @@ scylla_core = (['database.cc',
                  'mutation_partition_view.cc',
                  'mutation_partition_serializer.cc',
                  'mutation_reader.cc',
+                 'reader_concurrency_semaphore.cc',
+                 'querier.cc',
                  'mutation_query.cc',
                  'keys.cc',
                  'counters.cc',
+                 'counter_shard_cache.cc',
                  'sstables/sstables.cc',
+                 'sstables/index_summary_manager.cc',
+                 'sstables/data_placement.cc',
                  'sstables/compress.cc',
+                 'sstables/read_ahead.cc',
                  'sstables/row.cc',
                  'sstables/partition.cc',
                  'sstables/filter.cc',
@@ -392,11 +420,13 @@ scylla_core = (['database.cc',
                  'utils/murmur_hash.cc',
                  'utils/uuid.cc',
                  'utils/big_decimal.cc',
+                 'utils/utf8.cc',
                  'types.cc',
                  'validation.cc',
                  'service/priority_manager.cc',
                  'service/migration_manager.cc',
                  'service/storage_proxy.cc',
+                 'service/coordinator_result_cache.cc',
                  'cql3/operator.cc',
                  'cql3/relation.cc',
                  'cql3/column_identifier.cc',
@@ -426,13 +456,17 @@ scylla_core = (['database.cc',
                  'db/commitlog/commitlog.cc',
                  'db/commitlog/commitlog_replayer.cc',
                  'db/commitlog/commitlog_entry.cc',
+                 'db/hints/manager.cc',
                  'db/config.cc',
                  'db/heat_load_balance.cc',
+                 'db/per_partition_rate_limiter.cc',
                  'db/index/secondary_index.cc',
                  'db/marshal/type_parser.cc',
                  'db/batchlog_manager.cc',
                  'db/view/view.cc',
+                 'db/view/view_builder.cc',
                  'index/secondary_index_manager.cc',
+                 'cdc/log.cc',
                  'io/io.cc',
                  'utils/utils.cc',
                  'utils/UUID_gen.cc',
@@ -440,6 +474,8 @@ scylla_core = (['database.cc',
                  'utils/bloom_filter.cc',
                  'utils/bloom_calculations.cc',
                  'utils/rate_limiter.cc',
+                 'utils/stall_detector.cc',
+                 'utils/task_group.cc',
                  'utils/file_lock.cc',
                  'utils/dynamic_bitset.cc',
                  'utils/managed_bytes.cc',
@@ -471,6 +507,7 @@ scylla_core = (['database.cc',
                  'locator/token_metadata.cc',
                  'locator/locator.cc',
                  'locator/snitch_base.cc',
+                 'locator/dynamic_snitch.cc',
                  'locator/simple_snitch.cc',
                  'locator/rack_inferring_snitch.cc',
                  'locator/gossiping_property_file_snitch.cc',
@@ -482,8 +519,10 @@ scylla_core = (['database.cc',
                  'service/migration_task.cc',
                  'service/storage_service.cc',
                  'service/misc_services.cc',
+                 'service/cache_warmup.cc',
                  'service/pager/paging_state.cc',
                  'service/pager/query_pagers.cc',
+                 'service/paxos/paxos_state.cc',
                  'streaming/stream_task.cc',
                  'streaming/stream_session.cc',
                  'streaming/stream_request.cc',
@@ -579,6 +618,7 @@ idls = ['idl/gossip_digest.idl.hh',
         'idl/tracing.idl.hh',
         'idl/consistency_level.idl.hh',
         'idl/cache_temperature.idl.hh',
+        'idl/paxos.idl.hh',
         ]
 
 scylla_tests_dependencies = scylla_core + api + idls + [
@@ -609,9 +649,15 @@ pure_boost_tests = set([
     'tests/range_test',
     'tests/crc_test',
     'tests/managed_vector_test',
+    'tests/bptree_test',
     'tests/dynamic_bitset_test',
     'tests/idl_test',
     'tests/cartesian_product_test',
+    'tests/vint_serialization_test',
+    'tests/top_k_test',
+    'tests/frequency_sketch_test',
+    'tests/interval_tree_test',
+    'tests/latency_histogram_test',
 ])
 
 tests_not_using_seastar_test_framework = set([
@@ -621,13 +667,19 @@ tests_not_using_seastar_test_framework = set([
     'tests/row_cache_alloc_stress',
     'tests/perf_row_cache_update',
     'tests/perf/perf_hash',
+    'tests/perf/perf_checksum',
+    'tests/perf/perf_key_compare',
+    'tests/perf/perf_range_tombstone_list',
     'tests/perf/perf_cql_parser',
     'tests/message',
     'tests/perf/perf_simple_query',
+    'tests/perf/perf_scenario',
+    'tests/perf/perf_thrift_batch_mutate',
     'tests/perf/perf_fast_forward',
     'tests/memory_footprint',
     'tests/gossip',
     'tests/perf/perf_sstable',
+    'tests/perf/perf_compaction',
 ]) | pure_boost_tests
 
 for t in tests_not_using_seastar_test_framework:
@@ -651,6 +703,11 @@ deps['tests/murmur_hash_test'] = ['bytes.cc', 'utils/murmur_hash.cc', 'tests/mur
 deps['tests/allocation_strategy_test'] = ['tests/allocation_strategy_test.cc', 'utils/logalloc.cc', 'utils/dynamic_bitset.cc']
 deps['tests/log_histogram_test'] = ['tests/log_histogram_test.cc']
 deps['tests/anchorless_list_test'] = ['tests/anchorless_list_test.cc']
+deps['tests/vint_serialization_test'] = ['tests/vint_serialization_test.cc', 'vint-serialization.cc', 'bytes.cc']
+deps['tests/top_k_test'] = ['tests/top_k_test.cc']
+deps['tests/frequency_sketch_test'] = ['tests/frequency_sketch_test.cc']
+deps['tests/interval_tree_test'] = ['tests/interval_tree_test.cc']
+deps['tests/latency_histogram_test'] = ['tests/latency_histogram_test.cc']
 
 warnings = [
     '-Wno-mismatched-tags',  # clang-only
@@ -790,7 +847,7 @@ for mode in build_modes:
 seastar_deps = 'practically_anything_can_change_so_lets_run_it_every_time_and_restat.'
 
 args.user_cflags += " " + pkg_config("--cflags", "jsoncpp")
-libs = ' '.join(['-lyaml-cpp', '-llz4', '-lz', '-lsnappy', pkg_config("--libs", "jsoncpp"),
+libs = ' '.join(['-lyaml-cpp', '-llz4', '-lz', '-lsnappy', '-lzstd', pkg_config("--libs", "jsoncpp"),
                  maybe_static(args.staticboost, '-lboost_filesystem'), ' -lcrypt',
                  maybe_static(args.staticboost, '-lboost_date_time'),
                 ])
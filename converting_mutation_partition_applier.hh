@@ -33,7 +33,22 @@ class converting_mutation_partition_applier : public mutation_partition_visitor
     mutation_partition& _p;
     const column_mapping& _visited_column_mapping;
     deletable_row* _current_row;
+    // The target column of each visited one, by kind and visited column_id,
+    // looked up by name once per column rather than once per cell.
+    std::vector<stdx::optional<const column_definition*>> _static_columns;
+    std::vector<stdx::optional<const column_definition*>> _regular_columns;
 private:
+    const column_definition* target_column(column_kind kind, column_id id) {
+        auto& columns = kind == column_kind::static_column ? _static_columns : _regular_columns;
+        if (id >= columns.size()) {
+            columns.resize(id + 1);
+        }
+        if (!columns[id]) {
+            columns[id] = _p_schema.get_column_definition(_visited_column_mapping.column_at(kind, id).name());
+        }
+        return *columns[id];
+    }
+
     static bool is_compatible(const column_definition& new_def, const data_type& old_type, column_kind kind) {
         return ::is_compatible(new_def.kind, kind) && new_def.type->is_value_compatible_with(*old_type);
     }
@@ -76,7 +91,7 @@ class converting_mutation_partition_applier : public mutation_partition_visitor
 
     virtual void accept_static_cell(column_id id, atomic_cell_view cell) override {
         const column_mapping_entry& col = _visited_column_mapping.static_column_at(id);
-        const column_definition* def = _p_schema.get_column_definition(col.name());
+        const column_definition* def = target_column(column_kind::static_column, id);
         if (def) {
             accept_cell(_p._static_row, column_kind::static_column, *def, col.type(), cell);
         }
@@ -84,7 +99,7 @@ class converting_mutation_partition_applier : public mutation_partition_visitor
 
     virtual void accept_static_cell(column_id id, collection_mutation_view collection) override {
         const column_mapping_entry& col = _visited_column_mapping.static_column_at(id);
-        const column_definition* def = _p_schema.get_column_definition(col.name());
+        const column_definition* def = target_column(column_kind::static_column, id);
         if (def) {
             accept_cell(_p._static_row, column_kind::static_column, *def, col.type(), collection);
         }
@@ -103,7 +118,7 @@ class converting_mutation_partition_applier : public mutation_partition_visitor
 
     virtual void accept_row_cell(column_id id, atomic_cell_view cell) override {
         const column_mapping_entry& col = _visited_column_mapping.regular_column_at(id);
-        const column_definition* def = _p_schema.get_column_definition(col.name());
+        const column_definition* def = target_column(column_kind::regular_column, id);
         if (def) {
             accept_cell(_current_row->cells(), column_kind::regular_column, *def, col.type(), cell);
         }
@@ -111,7 +126,7 @@ class converting_mutation_partition_applier : public mutation_partition_visitor
 
     virtual void accept_row_cell(column_id id, collection_mutation_view collection) override {
         const column_mapping_entry& col = _visited_column_mapping.regular_column_at(id);
-        const column_definition* def = _p_schema.get_column_definition(col.name());
+        const column_definition* def = target_column(column_kind::regular_column, id);
         if (def) {
             accept_cell(_current_row->cells(), column_kind::regular_column, *def, col.type(), collection);
         }
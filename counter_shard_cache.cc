@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <seastar/core/metrics.hh>
+
+#include "counter_shard_cache.hh"
+#include "mutation.hh"
+#include "frozen_mutation.hh"
+#include "mutation_partition_visitor.hh"
+
+counter_shard_cache_tracker::counter_shard_cache_tracker(size_t max_size)
+    : _max_size(max_size)
+{
+    namespace sm = seastar::metrics;
+    _metrics.add_group("counter_cache", {
+        sm::make_gauge("bytes_used", sm::description("estimated memory used by the cached local counter shards"), [this] { return _size; }),
+        sm::make_gauge("partitions", sm::description("number of partitions with cached local counter shards"), _stats.partitions),
+        sm::make_derive("hits", sm::description("number of counter updates which didn't need to read the current counter shards"), _stats.hits),
+        sm::make_derive("misses", sm::description("number of counter updates which read the current counter shards"), _stats.misses),
+        sm::make_derive("evictions", sm::description("number of partitions evicted from the counter cache"), _stats.evictions),
+        sm::make_derive("invalidations", sm::description("number of partitions invalidated in the counter cache by deletions"), _stats.invalidations),
+    });
+}
+
+void counter_shard_cache_tracker::evict_until_fits() {
+    // The most recently stored partition, at the front, is never evicted.
+    while (_size > _max_size && !_lru.empty() && &_lru.back() != &_lru.front()) {
+        _lru.back().evict();
+        ++_stats.evictions;
+    }
+}
+
+counter_shard_cache::entry::entry(counter_shard_cache& cache, const partition_key& key)
+    : _cache(cache)
+    , _key(key)
+    , _rows(clustering_key::less_compare(*cache._schema))
+    , _size(sizeof(std::pair<const partition_key, entry>) + 2 * sizeof(void*) + key.external_memory_usage())
+{ }
+
+void counter_shard_cache::entry::evict() noexcept {
+    _cache.erase(_cache._entries.find(_key));
+}
+
+counter_shard_cache::counter_shard_cache(schema_ptr s, counter_shard_cache_tracker& tracker)
+    : _schema(std::move(s))
+    , _tracker(tracker)
+    , _entries(0, partition_key::hashing(*_schema), partition_key::equality(*_schema))
+{ }
+
+counter_shard_cache::~counter_shard_cache() {
+    clear();
+}
+
+size_t counter_shard_cache::cell_size() {
+    return sizeof(std::pair<const column_id, counter_shard>) + 2 * sizeof(void*);
+}
+
+size_t counter_shard_cache::row_size(const clustering_key& ck) const {
+    return sizeof(std::pair<const clustering_key, cells_type>) + 4 * sizeof(void*) + ck.external_memory_usage();
+}
+
+void counter_shard_cache::erase(map_type::iterator it) noexcept {
+    _tracker._size -= it->second._size;
+    --_tracker._stats.partitions;
+    _entries.erase(it);
+}
+
+bool counter_shard_cache::transform_counter_updates_to_shards(mutation& m, uint64_t clock_offset) {
+    auto it = m.schema() == _schema ? _entries.find(m.key()) : _entries.end();
+    if (it == _entries.end()) {
+        ++_tracker._stats.misses;
+        return false;
+    }
+    auto& e = it->second;
+
+    auto all_cached = [] (const cells_type* cached, const row& cells) {
+        bool found = true;
+        cells.for_each_cell_until([&] (column_id id, const atomic_cell_or_collection& ac_o_c) {
+            if (ac_o_c.as_atomic_cell().is_live() && (!cached || !cached->count(id))) {
+                found = false;
+                return stop_iteration::yes;
+            }
+            return stop_iteration::no;
+        });
+        return found;
+    };
+
+    // Look everything up first, so that m is either transformed whole or not at all.
+    std::vector<cells_type*> rows;
+    bool hit = all_cached(&e._static_cells, m.partition().static_row());
+    for (auto& cr : m.partition().clustered_rows()) {
+        if (!hit) {
+            break;
+        }
+        auto rit = e._rows.find(cr.key());
+        rows.emplace_back(rit == e._rows.end() ? nullptr : &rit->second);
+        hit = all_cached(rows.back(), cr.row().cells());
+    }
+    if (!hit) {
+        ++_tracker._stats.misses;
+        return false;
+    }
+
+    auto transform_row_to_shards = [clock_offset] (cells_type* cached, row& cells) {
+        cells.for_each_cell([&] (column_id id, atomic_cell_or_collection& ac_o_c) {
+            auto acv = ac_o_c.as_atomic_cell();
+            if (!acv.is_live()) {
+                return; // continue -- we are in lambda
+            }
+            auto cs = cached->at(id);
+            cs.update(acv.counter_update_value(), clock_offset + 1);
+            ac_o_c = counter_cell_builder::from_single_shard(acv.timestamp(), cs);
+        });
+    };
+
+    transform_row_to_shards(&e._static_cells, m.partition().static_row());
+    auto row_it = rows.begin();
+    for (auto& cr : m.partition().clustered_rows()) {
+        transform_row_to_shards(*row_it++, cr.row().cells());
+    }
+    ++_tracker._stats.hits;
+    return true;
+}
+
+void counter_shard_cache::store(const mutation& m) {
+    // The column ids of m may not be valid in the current schema anymore.
+    if (m.schema() != _schema) {
+        return;
+    }
+    auto it = _entries.find(m.key());
+    try {
+        if (it == _entries.end()) {
+            it = _entries.emplace(std::piecewise_construct, std::forward_as_tuple(m.key()),
+                                  std::forward_as_tuple(*this, m.key())).first;
+            _tracker._size += it->second._size;
+            ++_tracker._stats.partitions;
+        }
+        auto& e = it->second;
+
+        auto store_row = [&] (cells_type& cached, const row& cells) {
+            cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection& ac_o_c) {
+                auto acv = ac_o_c.as_atomic_cell();
+                if (!acv.is_live()) {
+                    return; // continue -- we are in lambda
+                }
+                auto cs = counter_cell_view(acv).local_shard();
+                if (!cs) {
+                    return; // continue
+                }
+                auto r = cached.emplace(id, counter_shard(*cs));
+                if (r.second) {
+                    e._size += cell_size();
+                    _tracker._size += cell_size();
+                } else {
+                    r.first->second = counter_shard(*cs);
+                }
+            });
+        };
+
+        store_row(e._static_cells, m.partition().static_row());
+        for (auto& cr : m.partition().clustered_rows()) {
+            auto rit = e._rows.find(cr.key());
+            if (rit == e._rows.end()) {
+                rit = e._rows.emplace(cr.key(), cells_type()).first;
+                auto size = row_size(cr.key());
+                e._size += size;
+                _tracker._size += size;
+            }
+            store_row(rit->second, cr.row().cells());
+        }
+        _tracker.touch(e);
+    } catch (...) {
+        // A partially stored partition is still correct, but not worth keeping
+        // when memory is that short.
+        if (it != _entries.end()) {
+            erase(it);
+        }
+        return;
+    }
+    _tracker.evict_until_fits();
+}
+
+namespace {
+
+// Finds out whether a mutation deletes anything.
+class deletion_detector final : public mutation_partition_visitor {
+    bool _found = false;
+public:
+    virtual void accept_partition_tombstone(tombstone t) override {
+        _found |= bool(t);
+    }
+    virtual void accept_static_cell(column_id, atomic_cell_view cell) override {
+        _found |= !cell.is_live();
+    }
+    virtual void accept_static_cell(column_id, collection_mutation_view) override { }
+    virtual void accept_row_tombstone(const range_tombstone&) override {
+        _found = true;
+    }
+    virtual void accept_row(clustering_key_view, const row_tombstone& deleted_at, const row_marker&) override {
+        _found |= bool(deleted_at);
+    }
+    virtual void accept_row_cell(column_id, atomic_cell_view cell) override {
+        _found |= !cell.is_live();
+    }
+    virtual void accept_row_cell(column_id, collection_mutation_view) override { }
+
+    bool found() const {
+        return _found;
+    }
+};
+
+}
+
+void counter_shard_cache::invalidate(const mutation& m) {
+    if (_entries.empty()) {
+        return;
+    }
+    deletion_detector v;
+    m.partition().accept(*m.schema(), v);
+    if (v.found()) {
+        invalidate(m.key());
+    }
+}
+
+void counter_shard_cache::invalidate(const frozen_mutation& fm, const schema& m_schema) {
+    if (_entries.empty()) {
+        return;
+    }
+    deletion_detector v;
+    fm.partition().accept(m_schema, v);
+    if (v.found()) {
+        invalidate(partition_key(fm.key(m_schema)));
+    }
+}
+
+void counter_shard_cache::invalidate(const partition_key& key) {
+    auto it = _entries.find(key);
+    if (it != _entries.end()) {
+        erase(it);
+        ++_tracker._stats.invalidations;
+    }
+}
+
+void counter_shard_cache::clear() noexcept {
+    while (!_entries.empty()) {
+        erase(_entries.begin());
+    }
+}
+
+void counter_shard_cache::set_schema(schema_ptr s) {
+    // Column ids and key comparators may have changed.
+    clear();
+    _schema = std::move(s);
+    _entries = map_type(0, partition_key::hashing(*_schema), partition_key::equality(*_schema));
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <boost/intrusive/list.hpp>
+#include <seastar/core/metrics_registration.hh>
+
+#include "counters.hh"
+#include "keys.hh"
+#include "schema.hh"
+
+class mutation;
+class frozen_mutation;
+
+namespace bi = boost::intrusive;
+
+class counter_shard_cache;
+
+// Bounds the memory used by the counter shard caches of all tables of a shard,
+// evicting the least recently updated partitions when it is exceeded.
+class counter_shard_cache_tracker {
+public:
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+        uint64_t partitions = 0;
+    };
+private:
+    class entry_base : public bi::list_base_hook<bi::link_mode<bi::auto_unlink>> {
+    public:
+        virtual ~entry_base() = default;
+        virtual void evict() noexcept = 0;
+    };
+    using lru_type = bi::list<entry_base, bi::constant_time_size<false>>;
+
+    // MRU is at the front, LRU at the back.
+    lru_type _lru;
+    size_t _max_size;
+    size_t _size = 0;
+    stats _stats;
+    seastar::metrics::metric_groups _metrics;
+
+    friend class counter_shard_cache;
+private:
+    void touch(entry_base& e) {
+        e.unlink();
+        _lru.push_front(e);
+    }
+    void evict_until_fits();
+public:
+    // A max_size of 0 disables the caches.
+    explicit counter_shard_cache_tracker(size_t max_size);
+    counter_shard_cache_tracker(counter_shard_cache_tracker&&) = delete;
+
+    bool enabled() const { return _max_size; }
+    size_t memory_usage() const { return _size; }
+    const stats& get_stats() const { return _stats; }
+};
+
+// The local shards of the counter cells of one table which were recently
+// updated by this shard, so that counter updates can build their new shards
+// without reading the current ones from the memtables and sstables.
+//
+// Only counter updates coordinated by this node write the local shard, and
+// they do it under the cell locks, so the cached shards stay equal to what a
+// read would return as long as every such update goes through store() or
+// invalidate(). Flushes, compactions and writes applied on behalf of other
+// leaders don't change the local shards, so the cache is kept across those.
+// Deletions, truncation, and sstables brought from outside do, and they
+// invalidate the affected partitions, or the whole cache.
+class counter_shard_cache {
+    using cells_type = std::unordered_map<column_id, counter_shard>;
+
+    class entry final : public counter_shard_cache_tracker::entry_base {
+    public:
+        counter_shard_cache& _cache;
+        partition_key _key;
+        cells_type _static_cells;
+        std::map<clustering_key, cells_type, clustering_key::less_compare> _rows;
+        size_t _size;
+    public:
+        entry(counter_shard_cache& cache, const partition_key& key);
+        virtual void evict() noexcept override;
+    };
+    using map_type = std::unordered_map<partition_key, entry, partition_key::hashing, partition_key::equality>;
+
+    schema_ptr _schema;
+    counter_shard_cache_tracker& _tracker;
+    map_type _entries;
+private:
+    void erase(map_type::iterator it) noexcept;
+    static size_t cell_size();
+    size_t row_size(const clustering_key& ck) const;
+public:
+    counter_shard_cache(schema_ptr s, counter_shard_cache_tracker& tracker);
+    counter_shard_cache(counter_shard_cache&&) = delete;
+    ~counter_shard_cache();
+
+    // Transforms the counter update m from deltas to counter shards, like
+    // transform_counter_updates_to_shards(), using the cached local shards.
+    // Returns false, leaving m unchanged, if any of the updated cells isn't
+    // cached, in which case the current state has to be read.
+    bool transform_counter_updates_to_shards(mutation& m, uint64_t clock_offset);
+
+    // Remembers the local shards of m, the result of a successfully applied
+    // counter update.
+    void store(const mutation& m);
+
+    // Drops the partitions m or fm could change the local shards of, that
+    // is those it deletes anything from.
+    void invalidate(const mutation& m);
+    void invalidate(const frozen_mutation& fm, const schema& m_schema);
+    void invalidate(const partition_key& key);
+
+    void clear() noexcept;
+    void set_schema(schema_ptr s);
+
+    bool empty() const { return _entries.empty(); }
+    size_t size() const { return _entries.size(); }
+};
@@ -364,8 +364,11 @@ selectStatement returns [shared_ptr<raw::select_statement> expr]
     @init {
         bool is_distinct = false;
         ::shared_ptr<cql3::term::raw> limit;
+        ::shared_ptr<cql3::term::raw> per_partition_limit;
         raw::select_statement::parameters::orderings_type orderings;
+        std::vector<shared_ptr<cql3::column_identifier::raw>> group_by_columns;
         bool allow_filtering = false;
+        bool bypass_cache = false;
     }
     : K_SELECT ( ( K_DISTINCT { is_distinct = true; } )?
                  sclause=selectClause
@@ -373,13 +376,17 @@ selectStatement returns [shared_ptr<raw::select_statement> expr]
                )
       K_FROM cf=columnFamilyName
       ( K_WHERE wclause=whereClause )?
+      ( K_GROUP K_BY groupByClause[group_by_columns] ( ',' groupByClause[group_by_columns] )* )?
       ( K_ORDER K_BY orderByClause[orderings] ( ',' orderByClause[orderings] )* )?
+      ( K_PER K_PARTITION K_LIMIT ppl=intValue { per_partition_limit = ppl; } )?
       ( K_LIMIT rows=intValue { limit = rows; } )?
       ( K_ALLOW K_FILTERING  { allow_filtering = true; } )?
+      ( K_BYPASS K_CACHE { bypass_cache = true; } )?
       {
-          auto params = ::make_shared<raw::select_statement::parameters>(std::move(orderings), is_distinct, allow_filtering);
+          auto params = ::make_shared<raw::select_statement::parameters>(std::move(orderings), is_distinct, allow_filtering, bypass_cache);
           $expr = ::make_shared<raw::select_statement>(std::move(cf), std::move(params),
-            std::move(sclause), std::move(wclause), std::move(limit));
+            std::move(sclause), std::move(wclause), std::move(limit), std::move(per_partition_limit),
+            std::move(group_by_columns));
       }
     ;
 
@@ -432,6 +439,10 @@ whereClause returns [std::vector<cql3::relation_ptr> clause]
     : relation[$clause] (K_AND relation[$clause])*
     ;
 
+groupByClause[std::vector<shared_ptr<cql3::column_identifier::raw>>& columns]
+    : c=cident { columns.push_back(c); }
+    ;
+
 orderByClause[raw::select_statement::parameters::orderings_type& orderings]
     @init{
         bool reversed = false;
@@ -1560,6 +1571,11 @@ basic_unreserved_keyword returns [sstring str]
         | K_LANGUAGE
         | K_NON
         | K_DETERMINISTIC
+        | K_BYPASS
+        | K_CACHE
+        | K_PER
+        | K_PARTITION
+        | K_GROUP
         ) { $str = $k.text; }
     ;
 
@@ -1615,10 +1631,15 @@ K_COMPACT:     C O M P A C T;
 K_STORAGE:     S T O R A G E;
 K_ORDER:       O R D E R;
 K_BY:          B Y;
+K_GROUP:       G R O U P;
 K_ASC:         A S C;
 K_DESC:        D E S C;
 K_ALLOW:       A L L O W;
 K_FILTERING:   F I L T E R I N G;
+K_BYPASS:      B Y P A S S;
+K_PER:         P E R;
+K_PARTITION:   P A R T I T I O N;
+K_CACHE:       C A C H E;
 K_IF:          I F;
 K_IS:          I S;
 K_CONTAINS:    C O N T A I N S;
@@ -43,7 +43,10 @@
 #include "unimplemented.hh"
 #include "lists.hh"
 #include "maps.hh"
+#include "atomic_cell_or_collection.hh"
+#include "cql3/query_options.hh"
 #include <boost/range/algorithm_ext/push_back.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
 
 namespace cql3 {
 
@@ -74,7 +77,87 @@ void column_condition::collect_marker_specificaton(::shared_ptr<variable_specifi
             value->collect_marker_specification(bound_names);
         }
     }
-    _value->collect_marker_specification(bound_names);
+    if (_value) {
+        _value->collect_marker_specification(bound_names);
+    }
+}
+
+// Returns whether "cell_value op value" holds, where a missing value is null.
+static bool compare_with_operator(const operator_type& op, const abstract_type& type, const bytes_opt& value, const stdx::optional<bytes_view>& cell_value) {
+    if (!value) {
+        if (op == operator_type::EQ) {
+            return !cell_value;
+        } else if (op == operator_type::NEQ) {
+            return bool(cell_value);
+        }
+        throw exceptions::invalid_request_exception(sprint("Invalid comparison with null for operator \"%s\"", op));
+    }
+    if (!cell_value) {
+        // the condition value is not null, so only NEQ can return true
+        return op == operator_type::NEQ;
+    }
+    auto comparison = type.compare(*cell_value, *value);
+    if (op == operator_type::EQ) {
+        return comparison == 0;
+    } else if (op == operator_type::LT) {
+        return comparison < 0;
+    } else if (op == operator_type::LTE) {
+        return comparison <= 0;
+    } else if (op == operator_type::GT) {
+        return comparison > 0;
+    } else if (op == operator_type::GTE) {
+        return comparison >= 0;
+    } else if (op == operator_type::NEQ) {
+        return comparison != 0;
+    }
+    // we shouldn't get IN, CONTAINS, or CONTAINS KEY here
+    throw std::logic_error(sprint("Unexpected operator %s in a condition", op));
+}
+
+static bytes_opt bind_condition_value(::shared_ptr<term> value, const query_options& options) {
+    auto v = value->bind_and_get(options);
+    if (v.is_unset_value()) {
+        throw exceptions::invalid_request_exception("Invalid 'unset' value in condition");
+    }
+    return to_bytes_opt(v);
+}
+
+bool column_condition::applies_to(const atomic_cell_or_collection* cell, const query_options& options) {
+    if (column.type->is_multi_cell()) {
+        throw exceptions::invalid_request_exception(sprint("Conditions on non-frozen collection column %s are not supported", column.name_as_text()));
+    }
+    if (_collection_element) {
+        throw exceptions::invalid_request_exception(sprint("Conditions on elements of collection column %s are not supported", column.name_as_text()));
+    }
+
+    stdx::optional<bytes_view> cell_value;
+    if (cell) {
+        auto c = cell->as_atomic_cell();
+        if (c.is_live()) {
+            cell_value = c.value();
+        }
+    }
+
+    if (_op != operator_type::IN) {
+        return compare_with_operator(_op, *column.type, bind_condition_value(_value, options), cell_value);
+    }
+
+    std::vector<bytes_opt> in_values;
+    if (_in_values.empty()) {
+        auto terminal = _value->bind(options);
+        auto elements = dynamic_pointer_cast<multi_item_terminal>(terminal);
+        if (!elements) {
+            throw exceptions::invalid_request_exception("Invalid null value for IN condition");
+        }
+        in_values = elements->get_elements();
+    } else {
+        for (auto&& value : _in_values) {
+            in_values.push_back(bind_condition_value(value, options));
+        }
+    }
+    return boost::algorithm::any_of(in_values, [&] (const bytes_opt& value) {
+        return compare_with_operator(operator_type::EQ, *column.type, value, cell_value);
+    });
 }
 
 ::shared_ptr<column_condition>
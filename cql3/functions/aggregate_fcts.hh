@@ -43,6 +43,7 @@
 
 #include "aggregate_function.hh"
 #include "native_aggregate_function.hh"
+#include "utils/big_decimal.hh"
 
 namespace cql3 {
 namespace functions {
@@ -152,6 +153,173 @@ make_avg_function() {
     return make_shared<avg_function_for<Type>>();
 }
 
+// Sums varints in a native integer, and only the part of the sum which would
+// overflow it in a cpp_int.
+class varint_sum {
+    int64_t _small = 0;
+    boost::multiprecision::cpp_int _big;
+public:
+    void add(bytes_view v) {
+        auto i = varint_to_int64(v);
+        if (!i) {
+            _big += value_cast<boost::multiprecision::cpp_int>(varint_type->deserialize(v));
+            return;
+        }
+        int64_t r;
+        if (__builtin_add_overflow(_small, *i, &r)) {
+            _big += _small;
+            r = *i;
+        }
+        _small = r;
+    }
+    boost::multiprecision::cpp_int get() const {
+        return _big + _small;
+    }
+    boost::multiprecision::cpp_int div(int64_t count) const {
+        if (!_big) {
+            return _small / count;
+        }
+        return get() / count;
+    }
+};
+
+// Sums decimals in a native integer as long as their unscaled values, scaled
+// to the largest scale seen, fit in it.
+class decimal_sum {
+    int64_t _small = 0;
+    int64_t _small_scale = 0;
+    big_decimal _big;
+private:
+    bool add_small(int64_t scale, int64_t unscaled) {
+        auto small = _small;
+        auto small_scale = _small_scale;
+        if (scale > small_scale) {
+            if (!multiply_by_power_of_ten(small, scale - small_scale)) {
+                return false;
+            }
+            small_scale = scale;
+        } else if (!multiply_by_power_of_ten(unscaled, small_scale - scale)) {
+            return false;
+        }
+        if (__builtin_add_overflow(small, unscaled, &small)) {
+            return false;
+        }
+        _small = small;
+        _small_scale = small_scale;
+        return true;
+    }
+public:
+    void add(bytes_view v) {
+        if (v.size() > sizeof(int32_t)) {
+            auto in = v;
+            int64_t scale = read_simple<int32_t>(in);
+            auto unscaled = varint_to_int64(in);
+            if (unscaled) {
+                if (add_small(scale, *unscaled)) {
+                    return;
+                }
+                _big += big_decimal(_small_scale, _small);
+                _small = 0;
+                if (add_small(scale, *unscaled)) {
+                    return;
+                }
+            }
+        }
+        _big += value_cast<big_decimal>(decimal_type->deserialize(v));
+    }
+    big_decimal get() const {
+        auto sum = _big;
+        sum += big_decimal(_small_scale, _small);
+        return sum;
+    }
+};
+
+template <>
+class impl_sum_function_for<boost::multiprecision::cpp_int> final : public aggregate_function::aggregate {
+    varint_sum _sum;
+public:
+    virtual void reset() override {
+        _sum = {};
+    }
+    virtual opt_bytes compute(cql_serialization_format sf) override {
+        return varint_type->decompose(_sum.get());
+    }
+    virtual void add_input(cql_serialization_format sf, const std::vector<opt_bytes>& values) override {
+        if (!values[0]) {
+            return;
+        }
+        _sum.add(*values[0]);
+    }
+};
+
+template <>
+class impl_avg_function_for<boost::multiprecision::cpp_int> final : public aggregate_function::aggregate {
+    varint_sum _sum;
+    int64_t _count = 0;
+public:
+    virtual void reset() override {
+        _sum = {};
+        _count = 0;
+    }
+    virtual opt_bytes compute(cql_serialization_format sf) override {
+        boost::multiprecision::cpp_int ret = 0;
+        if (_count) {
+            ret = _sum.div(_count);
+        }
+        return varint_type->decompose(ret);
+    }
+    virtual void add_input(cql_serialization_format sf, const std::vector<opt_bytes>& values) override {
+        if (!values[0]) {
+            return;
+        }
+        ++_count;
+        _sum.add(*values[0]);
+    }
+};
+
+template <>
+class impl_sum_function_for<big_decimal> final : public aggregate_function::aggregate {
+    decimal_sum _sum;
+public:
+    virtual void reset() override {
+        _sum = {};
+    }
+    virtual opt_bytes compute(cql_serialization_format sf) override {
+        return decimal_type->decompose(_sum.get());
+    }
+    virtual void add_input(cql_serialization_format sf, const std::vector<opt_bytes>& values) override {
+        if (!values[0]) {
+            return;
+        }
+        _sum.add(*values[0]);
+    }
+};
+
+template <>
+class impl_avg_function_for<big_decimal> final : public aggregate_function::aggregate {
+    decimal_sum _sum;
+    int64_t _count = 0;
+public:
+    virtual void reset() override {
+        _sum = {};
+        _count = 0;
+    }
+    virtual opt_bytes compute(cql_serialization_format sf) override {
+        big_decimal ret;
+        if (_count) {
+            ret = _sum.get().div(_count);
+        }
+        return decimal_type->decompose(ret);
+    }
+    virtual void add_input(cql_serialization_format sf, const std::vector<opt_bytes>& values) override {
+        if (!values[0]) {
+            return;
+        }
+        ++_count;
+        _sum.add(*values[0]);
+    }
+};
+
 template <typename Type>
 class impl_max_function_for final : public aggregate_function::aggregate {
    std::experimental::optional<Type> _max{};
@@ -88,18 +88,14 @@ functions::init() {
     declare(aggregate_fcts::make_sum_function<int64_t>());
     declare(aggregate_fcts::make_sum_function<float>());
     declare(aggregate_fcts::make_sum_function<double>());
-#if 0
-    declare(AggregateFcts.sumFunctionForDecimal);
-    declare(AggregateFcts.sumFunctionForVarint);
-#endif
+    declare(aggregate_fcts::make_sum_function<big_decimal>());
+    declare(aggregate_fcts::make_sum_function<boost::multiprecision::cpp_int>());
     declare(aggregate_fcts::make_avg_function<int32_t>());
     declare(aggregate_fcts::make_avg_function<int64_t>());
     declare(aggregate_fcts::make_avg_function<float>());
     declare(aggregate_fcts::make_avg_function<double>());
-#if 0
-    declare(AggregateFcts.avgFunctionForVarint);
-    declare(AggregateFcts.avgFunctionForDecimal);
-#endif
+    declare(aggregate_fcts::make_avg_function<boost::multiprecision::cpp_int>());
+    declare(aggregate_fcts::make_avg_function<big_decimal>());
 
     // also needed for smp:
 #if 0
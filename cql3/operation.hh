@@ -87,6 +87,10 @@ class operation {
 
     virtual ~operation() {}
 
+    const ::shared_ptr<term>& get_term() const {
+        return _t;
+    }
+
     atomic_cell make_dead_cell(const update_parameters& params) const {
         return params.make_dead_cell();
     }
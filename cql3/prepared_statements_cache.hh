@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <boost/intrusive/list.hpp>
+
+#include "cql3/statements/prepared_statement.hh"
+
+namespace bi = boost::intrusive;
+
+namespace cql3 {
+
+// Prepared statements of a shard, bounded by their estimated memory usage.
+//
+// When the cache is full the least recently used statements are evicted.
+// Executing an evicted statement fails with an UNPREPARED error, upon which
+// the clients prepare it again. Readers holding a checked_weak_ptr to an
+// evicted statement get an invalidated_prepared_usage_attempt_exception,
+// which is reported to the client as UNPREPARED too.
+template<typename Key, typename Hash = std::hash<Key>>
+class prepared_statements_cache {
+public:
+    using value_ptr = std::unique_ptr<statements::prepared_statement>;
+
+    struct stats {
+        uint64_t evictions = 0;
+    };
+private:
+    struct entry : public bi::list_base_hook<bi::link_mode<bi::auto_unlink>> {
+        Key key;
+        value_ptr statement;
+        size_t size;
+
+        entry(const Key& k, value_ptr ps, size_t sz) : key(k), statement(std::move(ps)), size(sz) { }
+    };
+    using lru_type = bi::list<entry, bi::constant_time_size<false>>;
+    using map_type = std::unordered_map<Key, entry, Hash>;
+
+    map_type _entries;
+    // MRU is at the front, LRU at the back.
+    lru_type _lru;
+    size_t _max_size;
+    size_t _size = 0;
+    stats _stats;
+private:
+    void erase(typename map_type::iterator i) {
+        _size -= i->second.size;
+        _entries.erase(i);
+    }
+
+    void evict_lru() {
+        erase(_entries.find(_lru.back().key));
+        ++_stats.evictions;
+    }
+public:
+    explicit prepared_statements_cache(size_t max_size)
+        : _max_size(max_size)
+    { }
+
+    // A rough estimate of the memory held by a prepared statement. The parsed
+    // statement holds about as much as its source text, in identifiers and
+    // literals.
+    static size_t estimated_size(const statements::prepared_statement& ps) {
+        return sizeof(entry) + sizeof(Key) + sizeof(ps) + 2 * ps.raw_cql_statement.size()
+            + ps.bound_names.size() * (sizeof(column_specification) + sizeof(column_identifier));
+    }
+
+    // Returns nullptr if there is no statement with the given id.
+    statements::prepared_statement* find(const Key& id) {
+        auto i = _entries.find(id);
+        if (i == _entries.end()) {
+            return nullptr;
+        }
+        auto& e = i->second;
+        e.unlink();
+        _lru.push_front(e);
+        return e.statement.get();
+    }
+
+    // Stores the statement, evicting the least recently used ones to make room
+    // for it. The inserted statement itself is never evicted here, even if it
+    // alone is bigger than the cache.
+    statements::prepared_statement& insert(const Key& id, value_ptr ps) {
+        auto size = estimated_size(*ps);
+        auto i = _entries.find(id);
+        if (i != _entries.end()) {
+            erase(i);
+        }
+        while (!_lru.empty() && _size + size > _max_size) {
+            evict_lru();
+        }
+        i = _entries.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple(id, std::move(ps), size)).first;
+        _lru.push_front(i->second);
+        _size += size;
+        return *i->second.statement;
+    }
+
+    // Erases the statements for which filter returns true.
+    template <typename Pred>
+    void remove_if(Pred filter) {
+        for (auto it = _entries.begin(); it != _entries.end(); ) {
+            if (filter(it->second.statement->statement)) {
+                _size -= it->second.size;
+                it = _entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    size_t size() const { return _entries.size(); }
+    size_t memory_usage() const { return _size; }
+    size_t max_size() const { return _max_size; }
+    const stats& get_stats() const { return _stats; }
+};
+
+}
@@ -44,7 +44,11 @@
 #include "cql3/CqlParser.hpp"
 #include "cql3/error_collector.hh"
 #include "cql3/statements/batch_statement.hh"
+#include "cql3/statements/modification_statement.hh"
+#include "cql3/statements/select_statement.hh"
 #include "cql3/util.hh"
+#include "db/config.hh"
+#include "database.hh"
 
 #include "transport/messages/result_message.hh"
 
@@ -85,6 +89,14 @@ class query_processor::internal_state {
     }
 };
 
+// Each of the caches of CQL, Thrift and unprepared statements of a shard gets that much.
+static size_t prepared_statements_cache_size(const db::config& cfg) {
+    if (cfg.prepared_statements_cache_size_mb()) {
+        return size_t(cfg.prepared_statements_cache_size_mb()) * 1024 * 1024 / smp::count;
+    }
+    return std::max(memory::stats().total_memory() / 256, size_t(1024 * 1024));
+}
+
 api::timestamp_type query_processor::next_timestamp() {
     return _internal_state->next_timestamp();
 }
@@ -95,12 +107,33 @@ query_processor::query_processor(distributed<service::storage_proxy>& proxy,
     , _proxy(proxy)
     , _db(db)
     , _internal_state(new internal_state())
+    , _prepared_statements(prepared_statements_cache_size(db.local().get_config()))
+    , _thrift_prepared_statements(prepared_statements_cache_size(db.local().get_config()))
+    , _unprepared_statements(prepared_statements_cache_size(db.local().get_config()))
 {
     namespace sm = seastar::metrics;
 
     _metrics.add_group("query_processor", {
         sm::make_derive("statements_prepared", _stats.prepare_invocations,
                         sm::description("Counts a total number of parsed CQL requests.")),
+
+        sm::make_derive("prepared_cache_evictions", [this] { return _prepared_statements.get_stats().evictions + _thrift_prepared_statements.get_stats().evictions; },
+                        sm::description("Counts a total number of prepared statements evicted from the cache to make room for new ones.")),
+
+        sm::make_gauge("prepared_cache_size", [this] { return _prepared_statements.size() + _thrift_prepared_statements.size(); },
+                        sm::description("Holds a number of prepared statements in the cache.")),
+
+        sm::make_gauge("prepared_cache_memory_footprint", [this] { return _prepared_statements.memory_usage() + _thrift_prepared_statements.memory_usage(); },
+                        sm::description("Holds an estimated number of bytes held by the prepared statements in the cache.")),
+
+        sm::make_derive("unprepared_cache_hits", _stats.unprepared_cache_hits,
+                        sm::description("Counts a number of unprepared statements found parsed in the cache.")),
+
+        sm::make_derive("unprepared_cache_misses", _stats.unprepared_cache_misses,
+                        sm::description("Counts a number of unprepared statements which had to be parsed.")),
+
+        sm::make_gauge("unprepared_cache_size", [this] { return _unprepared_statements.size(); },
+                        sm::description("Holds a number of parsed unprepared statements in the cache.")),
     });
 
     _metrics.add_group("cql", {
@@ -148,8 +181,25 @@ future<::shared_ptr<result_message>>
 query_processor::process(const sstring_view& query_string, service::query_state& query_state, query_options& options)
 {
     log.trace("process: \"{}\"", query_string);
-    tracing::trace(query_state.get_trace_state(), "Parsing a statement");
-    auto p = get_statement(query_string, query_state.get_client_state());
+    auto& client_state = query_state.get_client_state();
+    auto key = unprepared_statement_key(query_string, client_state.get_raw_keyspace());
+    std::unique_ptr<prepared_statement> parsed;
+    auto p = _unprepared_statements.find(key);
+    if (p) {
+        ++_stats.unprepared_cache_hits;
+        tracing::trace(query_state.get_trace_state(), "Using a cached parsed statement");
+    } else {
+        ++_stats.unprepared_cache_misses;
+        tracing::trace(query_state.get_trace_state(), "Parsing a statement");
+        parsed = get_statement(query_string, client_state);
+        p = parsed.get();
+        if (is_cacheable_unprepared(*p->statement)) {
+            parsed->raw_cql_statement = query_string.to_string();
+            p = &_unprepared_statements.insert(key, std::move(parsed));
+        }
+    }
+    // Only the values of the options and a reference to the statement are
+    // kept, so the cached entry may be evicted while the statement executes.
     options.prepare(p->bound_names);
     auto cql_statement = p->statement;
     if (cql_statement->get_bound_terms() != options.get_values_count()) {
@@ -231,18 +281,18 @@ query_processor::get_stored_prepared_statement(const std::experimental::string_v
 {
     if (for_thrift) {
         auto statement_id = compute_thrift_id(query_string, keyspace);
-        auto it = _thrift_prepared_statements.find(statement_id);
-        if (it == _thrift_prepared_statements.end()) {
+        auto ps = _thrift_prepared_statements.find(statement_id);
+        if (!ps) {
             return ::shared_ptr<result_message::prepared>();
         }
-        return ::make_shared<result_message::prepared::thrift>(statement_id, it->second->checked_weak_from_this());
+        return ::make_shared<result_message::prepared::thrift>(statement_id, ps->checked_weak_from_this());
     } else {
         auto statement_id = compute_id(query_string, keyspace);
-        auto it = _prepared_statements.find(statement_id);
-        if (it == _prepared_statements.end()) {
+        auto ps = _prepared_statements.find(statement_id);
+        if (!ps) {
             return ::shared_ptr<result_message::prepared>();
         }
-        return ::make_shared<result_message::prepared::cql>(statement_id, it->second->checked_weak_from_this());
+        return ::make_shared<result_message::prepared::cql>(statement_id, ps->checked_weak_from_this());
     }
 }
 
@@ -265,13 +315,13 @@ query_processor::store_prepared_statement(const std::experimental::string_view&
     prepared->raw_cql_statement = query_string.data();
     if (for_thrift) {
         auto statement_id = compute_thrift_id(query_string, keyspace);
-        auto msg = ::make_shared<result_message::prepared::thrift>(statement_id, prepared->checked_weak_from_this());
-        _thrift_prepared_statements.emplace(statement_id, std::move(prepared));
+        auto& ps = _thrift_prepared_statements.insert(statement_id, std::move(prepared));
+        auto msg = ::make_shared<result_message::prepared::thrift>(statement_id, ps.checked_weak_from_this());
         return make_ready_future<::shared_ptr<result_message::prepared>>(std::move(msg));
     } else {
         auto statement_id = compute_id(query_string, keyspace);
-        auto msg = ::make_shared<result_message::prepared::cql>(statement_id, prepared->checked_weak_from_this());
-        _prepared_statements.emplace(statement_id, std::move(prepared));
+        auto& ps = _prepared_statements.insert(statement_id, std::move(prepared));
+        auto msg = ::make_shared<result_message::prepared::cql>(statement_id, ps.checked_weak_from_this());
         return make_ready_future<::shared_ptr<result_message::prepared>>(std::move(msg));
     }
 }
@@ -285,6 +335,34 @@ static bytes md5_calculate(const std::experimental::string_view& s)
     return std::move(bytes{reinterpret_cast<const int8_t*>(digest), size});
 }
 
+// Queries differing only by leading and trailing whitespace, or a trailing
+// semicolon, share an entry. The keyspace comes first and can't contain NUL,
+// so different keyspace and query pairs never map to the same key.
+sstring query_processor::unprepared_statement_key(const sstring_view& query_string, const sstring& keyspace) {
+    auto is_space = [] (char c) { return std::isspace(static_cast<unsigned char>(c)); };
+    auto b = query_string.begin();
+    auto e = query_string.end();
+    while (b != e && is_space(*b)) {
+        ++b;
+    }
+    while (b != e && (is_space(*(e - 1)) || *(e - 1) == ';')) {
+        --e;
+    }
+    auto key = keyspace;
+    key += '\0';
+    key += sstring(b, e);
+    return key;
+}
+
+// Only statements which are invalidated on schema changes, along with the
+// prepared ones, may be cached. Others, e.g. schema statements, are rare
+// enough not to be worth it.
+bool query_processor::is_cacheable_unprepared(const cql_statement& statement) {
+    return dynamic_cast<const select_statement*>(&statement)
+        || dynamic_cast<const modification_statement*>(&statement)
+        || dynamic_cast<const batch_statement*>(&statement);
+}
+
 static sstring hash_target(const std::experimental::string_view& query_string, const sstring& keyspace) {
     return keyspace + query_string.to_string();
 }
@@ -23,6 +23,7 @@
 #include <boost/range/algorithm/transform.hpp>
 #include <boost/range/algorithm.hpp>
 #include <boost/range/adaptors.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
 
 #include "statement_restrictions.hh"
 #include "single_column_primary_key_restrictions.hh"
@@ -30,6 +31,7 @@
 
 #include "cql3/single_column_relation.hh"
 #include "cql3/constants.hh"
+#include "index/secondary_index_manager.hh"
 
 #include "stdx.hh"
 
@@ -266,10 +268,17 @@ statement_restrictions::statement_restrictions(database& db,
 #endif
     }
     // Even if uses_secondary_indexing is false at this point, we'll still have to use one if
-    // there is restrictions not covered by the PK.
+    // there is restrictions not covered by the PK, unless the replicas can filter on them.
     if (!_nonprimary_key_restrictions->empty()) {
-        _uses_secondary_indexing = true;
-        _index_restrictions.push_back(_nonprimary_key_restrictions);
+        if (type.is_select() && !for_view && can_filter_on_replicas()) {
+            _filters_on_replicas = true;
+            if (_partition_key_restrictions->empty()) {
+                _indexed_column = find_indexed_column(db);
+            }
+        } else {
+            _uses_secondary_indexing = true;
+            _index_restrictions.push_back(_nonprimary_key_restrictions);
+        }
     }
 
     if (_uses_secondary_indexing && !for_view) {
@@ -388,6 +397,58 @@ std::vector<query::clustering_range> statement_restrictions::get_clustering_boun
     return _clustering_columns_restrictions->bounds_ranges(options);
 }
 
+bool statement_restrictions::can_filter_on_replicas() const {
+    return boost::algorithm::all_of(_nonprimary_key_restrictions->restrictions(), [] (auto&& e) {
+        auto& def = *e.first;
+        auto& r = *e.second;
+        return def.is_regular() && def.is_atomic() && !def.type->is_counter() && (r.is_EQ() || r.is_IN() || r.is_slice());
+    });
+}
+
+const column_definition* statement_restrictions::find_indexed_column(database& db) const {
+    for (auto&& e : _nonprimary_key_restrictions->restrictions()) {
+        if (!e.second->is_EQ()) {
+            continue;
+        }
+        auto index = secondary_index::find_index_on(*_schema, *e.first);
+        if (index && db.has_schema(_schema->ks_name(), secondary_index::index_table_name(index->name()))) {
+            return e.first;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<query::column_filter> statement_restrictions::get_column_filters(const query_options& options) const {
+    std::vector<query::column_filter> filters;
+    if (!_filters_on_replicas) {
+        return filters;
+    }
+    for (auto&& e : _nonprimary_key_restrictions->restrictions()) {
+        auto& def = *e.first;
+        auto& r = *e.second;
+        auto to_value = [&def] (const bytes_opt& v) {
+            if (!v) {
+                throw exceptions::invalid_request_exception(sprint("Invalid null value for column %s", def.name_as_text()));
+            }
+            return *v;
+        };
+        if (r.is_slice()) {
+            for (auto b : { statements::bound::START, statements::bound::END }) {
+                if (!r.has_bound(b)) {
+                    continue;
+                }
+                auto op = statements::is_start(b) ? (r.is_inclusive(b) ? query::filter_op::gte : query::filter_op::gt)
+                                      : (r.is_inclusive(b) ? query::filter_op::lte : query::filter_op::lt);
+                filters.push_back(query::column_filter{def.id, op, { to_value(r.bounds(b, options).front()) }});
+            }
+        } else {
+            auto values = boost::copy_range<std::vector<bytes>>(r.values(options) | transformed(to_value));
+            filters.push_back(query::column_filter{def.id, r.is_EQ() ? query::filter_op::eq : query::filter_op::in, std::move(values)});
+        }
+    }
+    return filters;
+}
+
 bool statement_restrictions::need_filtering() {
     uint32_t number_of_restricted_columns = 0;
     for (auto&& restrictions : _index_restrictions) {
@@ -96,6 +96,18 @@ class statement_restrictions {
      */
     bool _uses_secondary_indexing = false;
 
+    /**
+     * <code>true</code> if the restrictions on non-primary key columns are
+     * evaluated by the replicas on the rows they read, see get_column_filters().
+     */
+    bool _filters_on_replicas = false;
+
+    /**
+     * The column whose index table is read first to find the partitions
+     * matching an EQ restriction on it, if any, see find_indexed_column().
+     */
+    const column_definition* _indexed_column = nullptr;
+
     /**
      * Specify if the query will return a range of partition keys.
      */
@@ -121,6 +133,7 @@ class statement_restrictions {
 private:
     void add_restriction(::shared_ptr<restriction> restriction);
     void add_single_column_restriction(::shared_ptr<single_column_restriction> restriction);
+    const column_definition* find_indexed_column(database& db) const;
 public:
     bool uses_function(const sstring& ks_name, const sstring& function_name) const;
 
@@ -370,6 +383,32 @@ class statement_restrictions {
      */
     bool need_filtering();
 
+    /**
+     * Checks if the query has restrictions on regular columns, which the
+     * replicas filter the rows they read on.
+     */
+    bool has_filtering_restrictions() const {
+        return _filters_on_replicas;
+    }
+
+    /**
+     * Returns the regular column with an EQ restriction and an index, when
+     * the partitions to read are looked up in the index table of that
+     * column, or nullptr.
+     */
+    const column_definition* indexed_column() const {
+        return _indexed_column;
+    }
+
+    /**
+     * Returns the filters checked by the replicas, for the partition slice
+     * of the query.
+     */
+    std::vector<query::column_filter> get_column_filters(const query_options& options) const;
+private:
+    bool can_filter_on_replicas() const;
+public:
+
     void validate_secondary_index_selections(bool selects_only_static_columns);
 
     /**
@@ -39,6 +39,8 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <seastar/core/byteorder.hh>
+
 #include "cql3/result_set.hh"
 
 namespace cql3 {
@@ -136,19 +138,21 @@ result_set::result_set(::shared_ptr<metadata> metadata)
 { }
 
 size_t result_set::size() const {
-    return _rows.size();
+    return _rows.size() + _serialized_row_count;
 }
 
 bool result_set::empty() const {
-    return _rows.empty();
+    return _rows.empty() && !_serialized_row_count;
 }
 
 void result_set::add_row(std::vector<bytes_opt> row) {
     assert(row.size() == _metadata->value_count());
+    materialize();
     _rows.emplace_back(std::move(row));
 }
 
 void result_set::add_column_value(bytes_opt value) {
+    materialize();
     if (_rows.empty() || _rows.back().size() == _metadata->value_count()) {
         std::vector<bytes_opt> row;
         row.reserve(_metadata->value_count());
@@ -158,11 +162,49 @@ void result_set::add_column_value(bytes_opt value) {
     _rows.back().emplace_back(std::move(value));
 }
 
+void result_set::add_serialized_value(bytes_view value) {
+    auto size = cpu_to_be(int32_t(value.size()));
+    _serialized_rows.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    _serialized_rows.write(value);
+}
+
+void result_set::add_serialized_null() {
+    auto size = cpu_to_be(int32_t(-1));
+    _serialized_rows.write(reinterpret_cast<const char*>(&size), sizeof(size));
+}
+
+void result_set::materialize() const {
+    if (!_serialized_row_count) {
+        return;
+    }
+    auto in = _serialized_rows.linearize();
+    auto columns = _metadata->column_count();
+    for (size_t i = 0; i < _serialized_row_count; ++i) {
+        std::vector<bytes_opt> row;
+        row.reserve(columns);
+        for (uint32_t j = 0; j < columns; ++j) {
+            auto size = read_be<int32_t>(reinterpret_cast<const char*>(in.begin()));
+            in.remove_prefix(sizeof(size));
+            if (size < 0) {
+                row.emplace_back();
+            } else {
+                row.emplace_back(bytes(in.begin(), size));
+                in.remove_prefix(size);
+            }
+        }
+        _rows.emplace_back(std::move(row));
+    }
+    _serialized_rows = bytes_ostream();
+    _serialized_row_count = 0;
+}
+
 void result_set::reverse() {
+    materialize();
     std::reverse(_rows.begin(), _rows.end());
 }
 
 void result_set::trim(size_t limit) {
+    materialize();
     if (_rows.size() > limit) {
         _rows.resize(limit);
     }
@@ -177,6 +219,7 @@ const metadata& result_set::get_metadata() const {
 }
 
 const std::deque<std::vector<bytes_opt>>& result_set::rows() const {
+    materialize();
     return _rows;
 }
 
@@ -44,6 +44,7 @@
 #include <deque>
 #include <vector>
 #include "enum_set.hh"
+#include "bytes_ostream.hh"
 #include "service/pager/paging_state.hh"
 #include "schema.hh"
 
@@ -134,7 +135,16 @@ class prepared_metadata {
 class result_set {
 public:
     ::shared_ptr<metadata> _metadata;
-    std::deque<std::vector<bytes_opt>> _rows;
+    mutable std::deque<std::vector<bytes_opt>> _rows;
+private:
+    // Rows of simple selections are serialized as they are built, in the
+    // format of the rows of a CQL ROWS response: the [value] of each of the
+    // column_count() columns. They are deserialized into _rows only if
+    // accessed as such.
+    mutable bytes_ostream _serialized_rows;
+    mutable size_t _serialized_row_count = 0;
+
+    void materialize() const;
 public:
     result_set(std::vector<::shared_ptr<column_specification>> metadata_);
 
@@ -148,12 +158,27 @@ class result_set {
 
     void add_column_value(bytes_opt value);
 
+    // Starts a serialized row. Callers then add the values of its first
+    // column_count() columns.
+    void add_serialized_row() {
+        ++_serialized_row_count;
+    }
+    void add_serialized_value(bytes_view value);
+    void add_serialized_null();
+
+    // Returns the rows in the format of a ROWS response, if the result
+    // set was built that way and they were not accessed as rows() since.
+    const bytes_ostream* serialized_rows() const {
+        return _serialized_row_count ? &_serialized_rows : nullptr;
+    }
+
     void reverse();
 
     void trim(size_t limit);
 
     template<typename RowComparator>
     void sort(const RowComparator& cmp) {
+        materialize();
         std::sort(_rows.begin(), _rows.end(), std::ref(cmp));
     }
 
@@ -105,6 +105,7 @@ class simple_selection : public selection {
     { }
 
     virtual bool is_wildcard() const override { return _is_wildcard; }
+    virtual bool is_simple() const override { return true; }
     virtual bool is_aggregate() const override { return false; }
 protected:
     class simple_selectors : public selectors {
@@ -138,13 +139,13 @@ class selection_with_processing : public selection {
     ::shared_ptr<selector_factories> _factories;
 public:
     selection_with_processing(schema_ptr schema, std::vector<const column_definition*> columns,
-            std::vector<::shared_ptr<column_specification>> metadata, ::shared_ptr<selector_factories> factories)
+            std::vector<::shared_ptr<column_specification>> metadata, ::shared_ptr<selector_factories> factories, bool grouped)
         : selection(schema, std::move(columns), std::move(metadata),
             factories->contains_write_time_selector_factory(),
             factories->contains_ttl_selector_factory())
         , _factories(std::move(factories))
     {
-        if (_factories->does_aggregation() && !_factories->contains_only_aggregate_functions()) {
+        if (!grouped && _factories->does_aggregation() && !_factories->contains_only_aggregate_functions()) {
             throw exceptions::invalid_request_exception("the select clause must either contains only aggregates or none");
         }
     }
@@ -160,7 +161,7 @@ class selection_with_processing : public selection {
     }
 
     virtual bool is_aggregate() const override {
-        return _factories->contains_only_aggregate_functions();
+        return _factories->does_aggregation();
     }
 protected:
     class selectors_with_processing : public selectors {
@@ -180,7 +181,7 @@ class selection_with_processing : public selection {
         }
 
         virtual bool is_aggregate() override {
-            return _factories->contains_only_aggregate_functions();
+            return _factories->does_aggregation();
         }
 
         virtual std::vector<bytes_opt> get_output_row(cql_serialization_format sf) override {
@@ -222,7 +223,8 @@ uint32_t selection::add_column_for_ordering(const column_definition& c) {
     return _columns.size() - 1;
 }
 
-::shared_ptr<selection> selection::from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors) {
+::shared_ptr<selection> selection::from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors,
+        bool grouped) {
     std::vector<const column_definition*> defs;
 
     ::shared_ptr<selector_factories> factories =
@@ -231,7 +233,7 @@ ::shared_ptr<selection> selection::from_selectors(database& db, schema_ptr schem
 
     auto metadata = collect_metadata(schema, raw_selectors, *factories);
     if (processes_selection(raw_selectors) || raw_selectors.size() != defs.size()) {
-        return ::make_shared<selection_with_processing>(schema, std::move(defs), std::move(metadata), std::move(factories));
+        return ::make_shared<selection_with_processing>(schema, std::move(defs), std::move(metadata), std::move(factories), grouped);
     } else {
         return ::make_shared<simple_selection>(schema, std::move(defs), std::move(metadata), false);
     }
@@ -251,11 +253,15 @@ selection::collect_metadata(schema_ptr schema, const std::vector<::shared_ptr<ra
     return r;
 }
 
-result_set_builder::result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf)
+result_set_builder::result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf,
+        std::vector<size_t> group_by_cell_indices)
     : _result_set(std::make_unique<result_set>(::make_shared<metadata>(*(s.get_result_metadata()))))
     , _selectors(s.new_selectors())
+    , _group_by_cell_indices(std::move(group_by_cell_indices))
     , _now(now)
     , _cql_serialization_format(sf)
+    , _serialize_rows(s.is_simple() && _group_by_cell_indices.empty()
+            && _result_set->get_metadata().value_count() == _result_set->get_metadata().column_count())
 {
     if (s._collect_timestamps) {
         _timestamps.resize(s._columns.size(), 0);
@@ -266,6 +272,10 @@ result_set_builder::result_set_builder(const selection& s, gc_clock::time_point
 }
 
 void result_set_builder::add_empty() {
+    if (_serialize_rows) {
+        _result_set->add_serialized_null();
+        return;
+    }
     current->emplace_back();
     if (!_timestamps.empty()) {
         _timestamps[current->size() - 1] = api::missing_timestamp;
@@ -276,10 +286,22 @@ void result_set_builder::add_empty() {
 }
 
 void result_set_builder::add(bytes_opt value) {
+    if (_serialize_rows) {
+        if (value) {
+            _result_set->add_serialized_value(*value);
+        } else {
+            _result_set->add_serialized_null();
+        }
+        return;
+    }
     current->emplace_back(std::move(value));
 }
 
 void result_set_builder::add(const column_definition& def, const query::result_atomic_cell_view& c) {
+    if (_serialize_rows) {
+        _result_set->add_serialized_value(c.value());
+        return;
+    }
     current->emplace_back(get_value(def.type, c));
     if (!_timestamps.empty()) {
         _timestamps[current->size() - 1] = c.timestamp();
@@ -295,17 +317,21 @@ void result_set_builder::add(const column_definition& def, const query::result_a
 }
 
 void result_set_builder::add_collection(const column_definition& def, bytes_view c) {
+    if (_serialize_rows) {
+        _result_set->add_serialized_value(c);
+        return;
+    }
     current->emplace_back(to_bytes(c));
     // timestamps, ttls meaningless for collections
 }
 
 void result_set_builder::new_row() {
+    if (_serialize_rows) {
+        _result_set->add_serialized_row();
+        return;
+    }
     if (current) {
-        _selectors->add_input_row(_cql_serialization_format, *this);
-        if (!_selectors->is_aggregate()) {
-            _result_set->add_row(_selectors->get_output_row(_cql_serialization_format));
-            _selectors->reset();
-        }
+        accept_current_row();
         current->clear();
     } else {
         // FIXME: we use optional<> here because we don't have an end_row() signal
@@ -315,15 +341,50 @@ void result_set_builder::new_row() {
     }
 }
 
-std::unique_ptr<result_set> result_set_builder::build() {
-    if (current) {
+void result_set_builder::accept_current_row() {
+    if (!_group_by_cell_indices.empty()) {
+        // Rows come in primary key order, so those of a group are adjacent.
+        bool same_group = bool(_last_group);
+        for (size_t i = 0; same_group && i < _group_by_cell_indices.size(); ++i) {
+            same_group = (*current)[_group_by_cell_indices[i]] == (*_last_group)[i];
+        }
+        if (!same_group) {
+            if (_last_group) {
+                flush_group();
+            }
+            _last_group.emplace();
+            for (auto i : _group_by_cell_indices) {
+                _last_group->push_back((*current)[i]);
+            }
+        }
         _selectors->add_input_row(_cql_serialization_format, *this);
+        return;
+    }
+    _selectors->add_input_row(_cql_serialization_format, *this);
+    if (!_selectors->is_aggregate()) {
         _result_set->add_row(_selectors->get_output_row(_cql_serialization_format));
         _selectors->reset();
+    }
+}
+
+void result_set_builder::flush_group() {
+    _result_set->add_row(_selectors->get_output_row(_cql_serialization_format));
+    _selectors->reset();
+}
+
+std::unique_ptr<result_set> result_set_builder::build() {
+    if (current) {
+        accept_current_row();
         current = std::experimental::nullopt;
     }
-    if (_result_set->empty() && _selectors->is_aggregate()) {
-        _result_set->add_row(_selectors->get_output_row(_cql_serialization_format));
+    if (!_group_by_cell_indices.empty()) {
+        // There is no row for an empty result of a grouped query.
+        if (_last_group) {
+            flush_group();
+            _last_group = std::experimental::nullopt;
+        }
+    } else if (_selectors->is_aggregate()) {
+        flush_group();
     }
     return std::move(_result_set);
 }
@@ -98,6 +98,12 @@ class selection {
         return false;
     }
 
+    // Whether the selection returns the values of its columns as they are,
+    // without applying functions to them.
+    virtual bool is_simple() const {
+        return false;
+    }
+
     /**
      * Checks if this selection contains static columns.
      * @return <code>true</code> if this selection contains static columns, <code>false</code> otherwise;
@@ -184,7 +190,10 @@ class selection {
     static std::vector<::shared_ptr<column_specification>> collect_metadata(schema_ptr schema,
         const std::vector<::shared_ptr<raw_selector>>& raw_selectors, const selector_factories& factories);
 public:
-    static ::shared_ptr<selection> from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors);
+    // A grouped selection may mix aggregates with other selectors, which
+    // then take their value from the last row of each group.
+    static ::shared_ptr<selection> from_selectors(database& db, schema_ptr schema, const std::vector<::shared_ptr<raw_selector>>& raw_selectors,
+        bool grouped = false);
 
     virtual std::unique_ptr<selectors> new_selectors() const = 0;
 
@@ -230,6 +239,10 @@ class result_set_builder {
 private:
     std::unique_ptr<result_set> _result_set;
     std::unique_ptr<selectors> _selectors;
+    // The indices in the rows of the cells of the GROUP BY columns, and
+    // their values in the group being aggregated.
+    const std::vector<size_t> _group_by_cell_indices;
+    std::experimental::optional<std::vector<bytes_opt>> _last_group;
 public:
     std::experimental::optional<std::vector<bytes_opt>> current;
 private:
@@ -237,14 +250,22 @@ class result_set_builder {
     std::vector<int32_t> _ttls;
     const gc_clock::time_point _now;
     cql_serialization_format _cql_serialization_format;
+    // Values of simple selections go straight into the serialized rows of
+    // the result set, see result_set::serialized_rows().
+    const bool _serialize_rows;
 public:
-    result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf);
+    result_set_builder(const selection& s, gc_clock::time_point now, cql_serialization_format sf,
+            std::vector<size_t> group_by_cell_indices = {});
     void add_empty();
     void add(bytes_opt value);
     void add(const column_definition& def, const query::result_atomic_cell_view& c);
     void add_collection(const column_definition& def, bytes_view c);
     void new_row();
     std::unique_ptr<result_set> build();
+    // The number of rows of the result so far.
+    size_t result_size() const {
+        return _result_set->size();
+    }
     api::timestamp_type timestamp_of(size_t idx);
     int32_t ttl_of(size_t idx);
     
@@ -272,6 +293,8 @@ class result_set_builder {
         void accept_partition_end(const query::result_row_view& static_row);
     };
 private:
+    void accept_current_row();
+    void flush_group();
     bytes_opt get_value(data_type t, query::result_atomic_cell_view c);
 };
 
@@ -40,6 +40,7 @@
  */
 
 #include "cql3/statements/cf_prop_defs.hh"
+#include "service/storage_service.hh"
 
 namespace cql3 {
 
@@ -62,6 +63,8 @@ const sstring cf_prop_defs::KW_MEMTABLE_FLUSH_PERIOD = "memtable_flush_period_in
 const sstring cf_prop_defs::KW_COMPACTION = "compaction";
 const sstring cf_prop_defs::KW_COMPRESSION = "compression";
 const sstring cf_prop_defs::KW_CRC_CHECK_CHANCE = "crc_check_chance";
+const sstring cf_prop_defs::KW_CDC = "cdc";
+const sstring cf_prop_defs::KW_PER_PARTITION_RATE_LIMIT = "per_partition_rate_limit";
 
 const sstring cf_prop_defs::COMPACTION_STRATEGY_CLASS_KEY = "class";
 
@@ -77,7 +80,7 @@ void cf_prop_defs::validate() {
         KW_GCGRACESECONDS, KW_CACHING, KW_DEFAULT_TIME_TO_LIVE,
         KW_MIN_INDEX_INTERVAL, KW_MAX_INDEX_INTERVAL, KW_SPECULATIVE_RETRY,
         KW_BF_FP_CHANCE, KW_MEMTABLE_FLUSH_PERIOD, KW_COMPACTION,
-        KW_COMPRESSION, KW_CRC_CHECK_CHANCE
+        KW_COMPRESSION, KW_CRC_CHECK_CHANCE, KW_CDC, KW_PER_PARTITION_RATE_LIMIT
     });
     static std::set<sstring> obsolete_keywords({
         sstring("index_interval"),
@@ -110,6 +113,14 @@ void cf_prop_defs::validate() {
         cp.validate();
     }
 
+    auto caching_options = get_caching_options();
+    // Older nodes would refuse to load a schema with a weighted cache.
+    if (caching_options && caching_options->to_map().count("eviction_weight")
+            && !service::get_local_storage_service().cluster_supports_eviction_weight()) {
+        throw exceptions::invalid_request_exception("Caching option eviction_weight is not supported until all nodes of the cluster are upgraded");
+    }
+    get_per_partition_rate_limit_options();
+
     validate_minimum_int(KW_DEFAULT_TIME_TO_LIVE, 0, DEFAULT_DEFAULT_TIME_TO_LIVE);
 
     auto min_index_interval = get_int(KW_MIN_INDEX_INTERVAL, DEFAULT_MIN_INDEX_INTERVAL);
@@ -140,6 +151,28 @@ stdx::optional<std::map<sstring, sstring>> cf_prop_defs::get_compression_options
     return { };
 }
 
+stdx::optional<caching_options> cf_prop_defs::get_caching_options() const {
+    stdx::optional<std::map<sstring, sstring>> caching_map;
+    try {
+        caching_map = get_map(KW_CACHING);
+    } catch (const exceptions::syntax_exception&) {
+        // The legacy string syntax is accepted, and ignored, as it always was.
+        return { };
+    }
+    if (!caching_map) {
+        return { };
+    }
+    return caching_options::from_map(*caching_map);
+}
+
+stdx::optional<db::per_partition_rate_limit_options> cf_prop_defs::get_per_partition_rate_limit_options() const {
+    auto options = get_map(KW_PER_PARTITION_RATE_LIMIT);
+    if (!options) {
+        return { };
+    }
+    return db::per_partition_rate_limit_options::from_map(*options);
+}
+
 int32_t cf_prop_defs::get_default_time_to_live() const
 {
     return get_int(KW_DEFAULT_TIME_TO_LIVE, 0);
@@ -216,11 +249,17 @@ void cf_prop_defs::apply_to_builder(schema_builder& builder) {
     if (compression_options) {
         builder.set_compressor_params(compression_parameters(*compression_options));
     }
-#if 0
-    CachingOptions cachingOptions = getCachingOptions();
-    if (cachingOptions != null)
-        cfm.caching(cachingOptions);
-#endif
+    auto caching_options = get_caching_options();
+    if (caching_options) {
+        builder.set_caching_options(std::move(*caching_options));
+    }
+    if (has_property(KW_CDC)) {
+        builder.set_cdc(get_boolean(KW_CDC, builder.get_cdc()));
+    }
+    auto rate_limit_options = get_per_partition_rate_limit_options();
+    if (rate_limit_options) {
+        builder.set_per_partition_rate_limit_options(*rate_limit_options);
+    }
 }
 
 void cf_prop_defs::validate_minimum_int(const sstring& field, int32_t minimum_value, int32_t default_value) const
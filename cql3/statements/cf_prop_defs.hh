@@ -71,6 +71,8 @@ class cf_prop_defs : public property_definitions {
     static const sstring KW_COMPACTION;
     static const sstring KW_COMPRESSION;
     static const sstring KW_CRC_CHECK_CHANCE;
+    static const sstring KW_CDC;
+    static const sstring KW_PER_PARTITION_RATE_LIMIT;
 
     static const sstring COMPACTION_STRATEGY_CLASS_KEY;
 
@@ -84,6 +86,8 @@ class cf_prop_defs : public property_definitions {
     void validate();
     std::map<sstring, sstring> get_compaction_options() const;
     stdx::optional<std::map<sstring, sstring>> get_compression_options() const;
+    stdx::optional<caching_options> get_caching_options() const;
+    stdx::optional<db::per_partition_rate_limit_options> get_per_partition_rate_limit_options() const;
 #if 0
     public CachingOptions getCachingOptions() throws SyntaxException, ConfigurationException
     {
@@ -47,6 +47,7 @@
 #include "service/storage_service.hh"
 #include "schema.hh"
 #include "schema_builder.hh"
+#include "index/secondary_index_manager.hh"
 
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -242,7 +243,13 @@ create_index_statement::announce_migration(distributed<service::storage_proxy>&
     schema_builder builder{schema};
     builder.with_index(index);
     return service::get_local_migration_manager().announce_column_family_update(
-            builder.build(), false, {}, is_local_only).then([this]() {
+            builder.build(), false, {}, is_local_only).then([schema, index, is_local_only] {
+        if (!secondary_index::index_target_column(*schema, index)) {
+            return make_ready_future<>();
+        }
+        return service::get_local_migration_manager().announce_new_view(
+                secondary_index::create_view_for_index(*schema, index), is_local_only);
+    }).then([this]() {
         using namespace cql_transport;
         return make_shared<event::schema_change>(
                 event::schema_change::change_type::UPDATED,
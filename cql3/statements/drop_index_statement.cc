@@ -44,6 +44,7 @@
 #include "service/migration_manager.hh"
 #include "service/storage_service.hh"
 #include "schema_builder.hh"
+#include "index/secondary_index_manager.hh"
 
 namespace cql3 {
 
@@ -88,7 +89,14 @@ future<shared_ptr<cql_transport::event::schema_change>> drop_index_statement::an
     }
     auto builder = schema_builder(cfm);
     builder.without_index(_index_name);
-    return service::get_local_migration_manager().announce_column_family_update(builder.build(), false, {}, is_local_only).then([cfm] {
+    auto& db = proxy.local().get_db().local();
+    auto index_table = secondary_index::index_table_name(_index_name);
+    auto f = db.has_schema(keyspace(), index_table)
+            ? service::get_local_migration_manager().announce_view_drop(keyspace(), index_table, is_local_only)
+            : make_ready_future<>();
+    return f.then([builder = std::move(builder), is_local_only] () mutable {
+        return service::get_local_migration_manager().announce_column_family_update(builder.build(), false, {}, is_local_only);
+    }).then([cfm] {
         // Dropping an index is akin to updating the CF
         // Note that we shouldn't call columnFamily() at this point because the index has been dropped and the call to lookupIndexedTable()
         // in that method would now throw.
@@ -53,6 +53,10 @@
 #include <boost/range/adaptor/indirected.hpp>
 #include "service/storage_service.hh"
 #include <seastar/core/execution_stage.hh>
+#include "service/paxos/cas_request.hh"
+#include "partition_slice_builder.hh"
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/range/algorithm/find.hpp>
 
 namespace cql3 {
 
@@ -151,8 +155,15 @@ future<> modification_statement::check_access(const service::client_state& state
 
 future<std::vector<mutation>>
 modification_statement::get_mutations(distributed<service::storage_proxy>& proxy, const query_options& options, bool local, int64_t now, tracing::trace_state_ptr trace_state) {
-    auto keys = make_lw_shared(build_partition_keys(options));
-    auto ranges = make_lw_shared(create_clustering_ranges(options));
+    auto partition_keys = build_partition_keys(options);
+    auto clustering_ranges = create_clustering_ranges(options);
+    if (!has_conditions()) {
+        if (auto mutations = get_simple_mutations(partition_keys, clustering_ranges, options, now)) {
+            return make_ready_future<std::vector<mutation>>(std::move(*mutations));
+        }
+    }
+    auto keys = make_lw_shared(std::move(partition_keys));
+    auto ranges = make_lw_shared(std::move(clustering_ranges));
     return make_update_parameters(proxy, keys, ranges, options, local, now, std::move(trace_state)).then(
             [this, keys, ranges, now] (auto params_ptr) {
                 std::vector<mutation> mutations;
@@ -396,32 +407,193 @@ modification_statement::execute_without_condition(distributed<service::storage_p
     });
 }
 
+// The update of a statement with conditions, which storage_proxy::cas()
+// applies if they hold on the current data of the partition.
+class modification_statement_cas_request : public service::paxos::cas_request {
+    modification_statement& _stmt;
+    distributed<service::storage_proxy>& _proxy;
+    const query_options& _options;
+    query::clustering_row_ranges _ranges;
+    clustering_key _ckey;
+    tracing::trace_state_ptr _trace_state;
+    // The data the conditions were checked against, compacted.
+    mutation_opt _current;
+    bool _row_exists = false;
+public:
+    modification_statement_cas_request(modification_statement& stmt, distributed<service::storage_proxy>& proxy, const query_options& options,
+            query::clustering_row_ranges ranges, clustering_key ckey, tracing::trace_state_ptr trace_state)
+        : _stmt(stmt)
+        , _proxy(proxy)
+        , _options(options)
+        , _ranges(std::move(ranges))
+        , _ckey(std::move(ckey))
+        , _trace_state(std::move(trace_state)) {
+    }
+
+    virtual future<stdx::optional<mutation>> apply(const stdx::optional<mutation>& current, api::timestamp_type ts) override {
+        const schema& s = *_stmt.s;
+        _current = current;
+        _row_exists = false;
+        if (_current) {
+            auto now = gc_clock::now();
+            auto rows = _current->partition().compact_for_query(s, now, _ranges, false, query::max_rows);
+            _row_exists = _stmt.applies_only_to_static_columns() ? _current->partition().is_static_row_live(s, now) : rows > 0;
+        }
+        if (!_stmt.applies_to(_current, _row_exists, _ckey, _options)) {
+            return make_ready_future<stdx::optional<mutation>>();
+        }
+        return _stmt.get_mutations(_proxy, _options, false, ts, _trace_state).then([] (std::vector<mutation> mutations) {
+            // There's a single partition key, checked by execute_with_condition().
+            assert(mutations.size() == 1);
+            return stdx::optional<mutation>(std::move(mutations.front()));
+        });
+    }
+
+    std::unique_ptr<result_set> build_result_set(bool applied) {
+        return _stmt.build_cas_result_set(applied, _current, _row_exists, _ckey, _options);
+    }
+};
+
 future<::shared_ptr<cql_transport::messages::result_message>>
 modification_statement::execute_with_condition(distributed<service::storage_proxy>& proxy, service::query_state& qs, const query_options& options) {
-    fail(unimplemented::cause::LWT);
-#if 0
-        List<ByteBuffer> keys = buildPartitionKeyNames(options);
-        // We don't support IN for CAS operation so far
-        if (keys.size() > 1)
-            throw new InvalidRequestException("IN on the partition key is not supported with conditional updates");
-
-        ByteBuffer key = keys.get(0);
-        long now = options.getTimestamp(queryState);
-        Composite prefix = createClusteringPrefix(options);
-
-        CQL3CasRequest request = new CQL3CasRequest(cfm, key, false);
-        addConditions(prefix, request, options);
-        request.addRowUpdate(prefix, this, options, now);
-
-        ColumnFamily result = StorageProxy.cas(keyspace(),
-                                               columnFamily(),
-                                               key,
-                                               request,
-                                               options.getSerialConsistency(),
-                                               options.getConsistency(),
-                                               queryState.getClientState());
-        return new ResultMessage.Rows(buildCasResultSet(key, result, options));
-#endif
+    if (!service::get_local_storage_service().cluster_supports_lwt()) {
+        throw exceptions::invalid_request_exception("Conditional updates are not supported until all nodes of the cluster are upgraded");
+    }
+    auto cl_for_paxos = options.get_serial_consistency().value_or(db::consistency_level::SERIAL);
+    db::validate_for_cas(cl_for_paxos);
+    db::validate_for_cas_commit(keyspace(), options.get_consistency());
+
+    auto keys = build_partition_keys(options);
+    // We don't support IN for CAS operation so far
+    if (keys.size() != 1 || !keys.front().is_singular()) {
+        throw exceptions::invalid_request_exception("IN on the partition key is not supported with conditional updates");
+    }
+    auto key = std::move(*keys.front().start()->value().key());
+
+    auto ranges = create_clustering_ranges(options);
+    auto ckey = clustering_key::make_empty();
+    if (!applies_only_to_static_columns() && s->clustering_key_size() > 0) {
+        if (ranges.size() != 1) {
+            throw exceptions::invalid_request_exception("IN on the clustering key columns is not supported with conditional updates");
+        }
+        if (!ranges.front().is_singular() || !ranges.front().start()->value().is_full(*s)) {
+            throw exceptions::invalid_request_exception(sprint(
+                    "%s statements must restrict all PRIMARY KEY columns with equality relations in order to use IF conditions", type));
+        }
+        ckey = ranges.front().start()->value();
+    }
+
+    auto cmd = make_lw_shared<query::read_command>(s->id(), s->version(), partition_slice_builder(*s).with_ranges(ranges).build(),
+            query::max_rows, gc_clock::now(), tracing::make_trace_info(qs.get_trace_state()));
+    auto request = ::make_shared<modification_statement_cas_request>(*this, proxy, options, std::move(ranges), std::move(ckey), qs.get_trace_state());
+
+    inc_cql_stats();
+
+    return proxy.local().cas(s, request, std::move(cmd), std::move(key), cl_for_paxos, qs.get_trace_state()).then([request] (bool applied) {
+        return ::shared_ptr<cql_transport::messages::result_message>(
+                ::make_shared<cql_transport::messages::result_message::rows>(request->build_result_set(applied)));
+    });
+}
+
+bool modification_statement::applies_to(const mutation_opt& current, bool row_exists, const clustering_key& ckey, const query_options& options) {
+    if (_if_not_exists) {
+        return !row_exists;
+    }
+    if (_if_exists) {
+        return row_exists;
+    }
+    auto check = [&] (const std::vector<::shared_ptr<column_condition>>& conditions, const row* r) {
+        return boost::algorithm::all_of(conditions, [&] (const ::shared_ptr<column_condition>& cond) {
+            return cond->applies_to(r ? r->find_cell(cond->column.id) : nullptr, options);
+        });
+    };
+    const row* regular_row = nullptr;
+    const row* static_row = nullptr;
+    if (current) {
+        regular_row = current->partition().find_row(*s, ckey);
+        static_row = &current->partition().static_row();
+    }
+    return check(_column_conditions, regular_row) && check(_static_conditions, static_row);
+}
+
+stdx::optional<std::vector<const column_definition*>> modification_statement::get_columns_with_conditions() const {
+    if (_if_not_exists || _if_exists) {
+        return {};
+    }
+    // We can have multiple conditions on the same columns, so the duplicates
+    // are dropped, preserving the order of the conditions.
+    std::vector<const column_definition*> columns;
+    for (auto&& conditions : {std::cref(_column_conditions), std::cref(_static_conditions)}) {
+        for (auto&& cond : conditions.get()) {
+            if (boost::range::find(columns, &cond->column) == columns.end()) {
+                columns.push_back(&cond->column);
+            }
+        }
+    }
+    return columns;
+}
+
+static bytes_opt get_cell_value(const column_definition& def, const atomic_cell_or_collection* cell, cql_serialization_format sf) {
+    if (!cell) {
+        return {};
+    }
+    if (def.type->is_multi_cell()) {
+        auto ctype = static_pointer_cast<const collection_type_impl>(def.type);
+        return ctype->to_value(cell->as_collection_mutation(), sf);
+    }
+    auto c = cell->as_atomic_cell();
+    if (!c.is_live()) {
+        return {};
+    }
+    return to_bytes(c.value());
+}
+
+std::unique_ptr<result_set> modification_statement::build_cas_result_set(bool applied, const mutation_opt& current, bool row_exists,
+        const clustering_key& ckey, const query_options& options) {
+    std::vector<::shared_ptr<column_specification>> specs;
+    specs.push_back(::make_shared<column_specification>(keyspace(), column_family(), CAS_RESULT_COLUMN, boolean_type));
+    std::vector<bytes_opt> values;
+    values.push_back(boolean_type->decompose(applied));
+    if (applied || !row_exists) {
+        auto rs = std::make_unique<result_set>(std::move(specs));
+        rs->add_row(std::move(values));
+        return rs;
+    }
+
+    // The conditions didn't hold on the existing row, which is returned.
+    std::vector<const column_definition*> columns;
+    if (auto with_conditions = get_columns_with_conditions()) {
+        columns = std::move(*with_conditions);
+    } else {
+        boost::range::push_back(columns, s->all_columns_in_select_order() | boost::adaptors::transformed([] (const column_definition& def) {
+            return &def;
+        }));
+    }
+    auto pk = current->key().explode(*s);
+    auto ck = ckey.explode(*s);
+    auto regular_row = current->partition().find_row(*s, ckey);
+    auto& static_row = current->partition().static_row();
+    auto sf = options.get_cql_serialization_format();
+    for (auto def : columns) {
+        specs.push_back(def->column_specification);
+        switch (def->kind) {
+        case column_kind::partition_key:
+            values.push_back(pk[def->component_index()]);
+            break;
+        case column_kind::clustering_key:
+            values.push_back(def->component_index() < ck.size() ? bytes_opt(ck[def->component_index()]) : bytes_opt());
+            break;
+        case column_kind::static_column:
+            values.push_back(get_cell_value(*def, static_row.find_cell(def->id), sf));
+            break;
+        case column_kind::regular_column:
+            values.push_back(get_cell_value(*def, regular_row ? regular_row->find_cell(def->id) : nullptr, sf));
+            break;
+        }
+    }
+    auto rs = std::make_unique<result_set>(std::move(specs));
+    rs->add_row(std::move(values));
+    return rs;
 }
 
 future<::shared_ptr<cql_transport::messages::result_message>>
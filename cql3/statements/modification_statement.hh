@@ -54,6 +54,7 @@
 #include "cql3/restrictions/statement_restrictions.hh"
 #include "cql3/single_column_relation.hh"
 #include "cql3/statements/statement_type.hh"
+#include "cql3/result_set.hh"
 
 #include "db/consistency_level.hh"
 
@@ -125,6 +126,15 @@ class modification_statement : public cql_statement_no_metadata {
 
     virtual void add_update_for_key(mutation& m, const query::clustering_range& range, const update_parameters& params) = 0;
 
+    // Statements which chose, when prepared, to build their mutations
+    // straight from the bound values, without the update_parameters and the
+    // operations of add_update_for_key(), return them here. The others
+    // return a disengaged optional.
+    virtual stdx::optional<std::vector<mutation>> get_simple_mutations(dht::partition_range_vector& keys,
+            const query::clustering_row_ranges& ranges, const query_options& options, int64_t now) {
+        return {};
+    }
+
     virtual uint32_t get_bound_terms() override;
 
     virtual const sstring& keyspace() const;
@@ -151,16 +161,9 @@ class modification_statement : public cql_statement_no_metadata {
 
     void add_operation(::shared_ptr<operation> op);
 
-#if 0
-    public Iterable<ColumnDefinition> getColumnsWithConditions()
-    {
-        if (ifNotExists || ifExists)
-            return null;
-
-        return Iterables.concat(columnConditions == null ? Collections.<ColumnDefinition>emptyList() : Iterables.transform(columnConditions, getColumnForCondition),
-                                staticConditions == null ? Collections.<ColumnDefinition>emptyList() : Iterables.transform(staticConditions, getColumnForCondition));
-    }
-#endif
+    // The columns the conditions are on, which the result of a conditional
+    // update which didn't apply has, or nothing for all of them.
+    stdx::optional<std::vector<const column_definition*>> get_columns_with_conditions() const;
 
     void inc_cql_stats() {
         ++(*_cql_modification_counter_ptr);
@@ -224,119 +227,14 @@ class modification_statement : public cql_statement_no_metadata {
     future<::shared_ptr<cql_transport::messages::result_message>>
     execute_with_condition(distributed<service::storage_proxy>& proxy, service::query_state& qs, const query_options& options);
 
-#if 0
-    public void addConditions(Composite clusteringPrefix, CQL3CasRequest request, QueryOptions options) throws InvalidRequestException
-    {
-        if (ifNotExists)
-        {
-            // If we use ifNotExists, if the statement applies to any non static columns, then the condition is on the row of the non-static
-            // columns and the prefix should be the clusteringPrefix. But if only static columns are set, then the ifNotExists apply to the existence
-            // of any static columns and we should use the prefix for the "static part" of the partition.
-            request.addNotExist(clusteringPrefix);
-        }
-        else if (ifExists)
-        {
-            request.addExist(clusteringPrefix);
-        }
-        else
-        {
-            if (columnConditions != null)
-                request.addConditions(clusteringPrefix, columnConditions, options);
-            if (staticConditions != null)
-                request.addConditions(cfm.comparator.staticPrefix(), staticConditions, options);
-        }
-    }
-
-    private ResultSet buildCasResultSet(ByteBuffer key, ColumnFamily cf, QueryOptions options) throws InvalidRequestException
-    {
-        return buildCasResultSet(keyspace(), key, columnFamily(), cf, getColumnsWithConditions(), false, options);
-    }
-
-    public static ResultSet buildCasResultSet(String ksName, ByteBuffer key, String cfName, ColumnFamily cf, Iterable<ColumnDefinition> columnsWithConditions, boolean isBatch, QueryOptions options)
-    throws InvalidRequestException
-    {
-        boolean success = cf == null;
-
-        ColumnSpecification spec = new ColumnSpecification(ksName, cfName, CAS_RESULT_COLUMN, BooleanType.instance);
-        ResultSet.Metadata metadata = new ResultSet.Metadata(Collections.singletonList(spec));
-        List<List<ByteBuffer>> rows = Collections.singletonList(Collections.singletonList(BooleanType.instance.decompose(success)));
+    // Whether the conditions hold on the current data of the partition, as
+    // compacted by a cas_request, whose row_exists tells if the row of ckey,
+    // or the static row for an update of static columns only, has live data.
+    bool applies_to(const mutation_opt& current, bool row_exists, const clustering_key& ckey, const query_options& options);
 
-        ResultSet rs = new ResultSet(metadata, rows);
-        return success ? rs : merge(rs, buildCasFailureResultSet(key, cf, columnsWithConditions, isBatch, options));
-    }
-
-    private static ResultSet merge(ResultSet left, ResultSet right)
-    {
-        if (left.size() == 0)
-            return right;
-        else if (right.size() == 0)
-            return left;
-
-        assert left.size() == 1;
-        int size = left.metadata.names.size() + right.metadata.names.size();
-        List<ColumnSpecification> specs = new ArrayList<ColumnSpecification>(size);
-        specs.addAll(left.metadata.names);
-        specs.addAll(right.metadata.names);
-        List<List<ByteBuffer>> rows = new ArrayList<>(right.size());
-        for (int i = 0; i < right.size(); i++)
-        {
-            List<ByteBuffer> row = new ArrayList<ByteBuffer>(size);
-            row.addAll(left.rows.get(0));
-            row.addAll(right.rows.get(i));
-            rows.add(row);
-        }
-        return new ResultSet(new ResultSet.Metadata(specs), rows);
-    }
-
-    private static ResultSet buildCasFailureResultSet(ByteBuffer key, ColumnFamily cf, Iterable<ColumnDefinition> columnsWithConditions, boolean isBatch, QueryOptions options)
-    throws InvalidRequestException
-    {
-        CFMetaData cfm = cf.metadata();
-        Selection selection;
-        if (columnsWithConditions == null)
-        {
-            selection = Selection.wildcard(cfm);
-        }
-        else
-        {
-            // We can have multiple conditions on the same columns (for collections) so use a set
-            // to avoid duplicate, but preserve the order just to it follows the order of IF in the query in general
-            Set<ColumnDefinition> defs = new LinkedHashSet<>();
-            // Adding the partition key for batches to disambiguate if the conditions span multipe rows (we don't add them outside
-            // of batches for compatibility sakes).
-            if (isBatch)
-            {
-                defs.addAll(cfm.partitionKeyColumns());
-                defs.addAll(cfm.clusteringColumns());
-            }
-            for (ColumnDefinition def : columnsWithConditions)
-                defs.add(def);
-            selection = Selection.forColumns(cfm, new ArrayList<>(defs));
-
-        }
-
-        long now = System.currentTimeMillis();
-        Selection.ResultSetBuilder builder = selection.resultSetBuilder(now);
-        SelectStatement.forSelection(cfm, selection).processColumnFamily(key, cf, options, now, builder);
-
-        return builder.build(options.getProtocolVersion());
-    }
-
-    public ResultMessage executeInternal(QueryState queryState, QueryOptions options) throws RequestValidationException, RequestExecutionException
-    {
-        if (hasConditions())
-            throw new UnsupportedOperationException();
-
-        for (IMutation mutation : getMutations(options, true, queryState.getTimestamp()))
-        {
-            // We don't use counters internally.
-            assert mutation instanceof Mutation;
-
-            ((Mutation) mutation).apply();
-        }
-        return null;
-    }
-#endif
+    std::unique_ptr<result_set> build_cas_result_set(bool applied, const mutation_opt& current, bool row_exists,
+            const clustering_key& ckey, const query_options& options);
+    friend class modification_statement_cas_request;
 
 public:
     /**
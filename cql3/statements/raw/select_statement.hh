@@ -48,6 +48,7 @@
 #include "cql3/selection/raw_selector.hh"
 #include "cql3/restrictions/statement_restrictions.hh"
 #include "cql3/result_set.hh"
+#include "query-request.hh"
 #include "exceptions/unrecognized_entity_exception.hh"
 #include "service/client_state.hh"
 #include "core/shared_ptr.hh"
@@ -75,13 +76,18 @@ class select_statement : public cf_statement
         const orderings_type _orderings;
         const bool _is_distinct;
         const bool _allow_filtering;
+        const bool _bypass_cache;
     public:
         parameters();
         parameters(orderings_type orderings,
             bool is_distinct,
-            bool allow_filtering);
+            bool allow_filtering,
+            bool bypass_cache = false);
         bool is_distinct();
         bool allow_filtering();
+        // BYPASS CACHE: read from memtables and sstables only, without
+        // populating the cache, for scans which would evict the working set.
+        bool bypass_cache();
         orderings_type const& orderings();
     };
     template<typename T>
@@ -94,12 +100,16 @@ class select_statement : public cf_statement
     std::vector<::shared_ptr<selection::raw_selector>> _select_clause;
     std::vector<::shared_ptr<relation>> _where_clause;
     ::shared_ptr<term::raw> _limit;
+    ::shared_ptr<term::raw> _per_partition_limit;
+    std::vector<::shared_ptr<cql3::column_identifier::raw>> _group_by_columns;
 public:
     select_statement(::shared_ptr<cf_name> cf_name,
             ::shared_ptr<parameters> parameters,
             std::vector<::shared_ptr<selection::raw_selector>> select_clause,
             std::vector<::shared_ptr<relation>> where_clause,
-            ::shared_ptr<term::raw> limit);
+            ::shared_ptr<term::raw> limit,
+            ::shared_ptr<term::raw> per_partition_limit = {},
+            std::vector<::shared_ptr<cql3::column_identifier::raw>> group_by_columns = {});
 
     virtual std::unique_ptr<prepared> prepare(database& db, cql_stats& stats) override {
         return prepare(db, stats, false);
@@ -114,7 +124,15 @@ class select_statement : public cf_statement
         bool for_view = false);
 
     /** Returns a ::shared_ptr<term> for the limit or null if no limit is set */
-    ::shared_ptr<term> prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names);
+    ::shared_ptr<term> prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names,
+        ::shared_ptr<term::raw> limit, ::shared_ptr<column_specification> receiver);
+
+    /**
+     * Returns the indices in the rows read of the cells of the GROUP BY
+     * columns, which must be a prefix of the primary key including the whole
+     * partition key. Adds the columns the selection lacks to it.
+     */
+    std::vector<size_t> prepare_group_by(schema_ptr schema, selection::selection& selection) const;
 
     static void verify_ordering_is_allowed(::shared_ptr<restrictions::statement_restrictions> restrictions);
 
@@ -130,6 +148,15 @@ class select_statement : public cf_statement
 
     bool is_reversed(schema_ptr schema);
 
+    /**
+     * Returns the aggregates of the selection if it consists only of
+     * COUNT(*), and COUNT, SUM, MIN and MAX of regular columns, which the
+     * nodes reading the data can compute.
+     */
+    std::experimental::optional<std::vector<query::aggregate_selector>> get_pushed_down_aggregates(schema_ptr schema,
+        ::shared_ptr<selection::selection> selection,
+        ::shared_ptr<restrictions::statement_restrictions> restrictions);
+
     /** If ALLOW FILTERING was not specified, this verifies that it is not needed */
     void check_needs_filtering(::shared_ptr<restrictions::statement_restrictions> restrictions);
 
@@ -137,6 +164,8 @@ class select_statement : public cf_statement
 
     ::shared_ptr<column_specification> limit_receiver();
 
+    ::shared_ptr<column_specification> per_partition_limit_receiver();
+
 #if 0
     public:
         virtual sstring to_string() override {
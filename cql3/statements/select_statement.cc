@@ -49,8 +49,15 @@
 #include "query-result-reader.hh"
 #include "query_result_merger.hh"
 #include "service/pager/query_pagers.hh"
+#include "service/storage_service.hh"
+#include "service/storage_proxy.hh"
+#include "service/priority_manager.hh"
 #include <seastar/core/execution_stage.hh>
 #include "view_info.hh"
+#include "index/secondary_index_manager.hh"
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include "utils/serialization.hh"
 
 namespace cql3 {
 
@@ -58,17 +65,22 @@ namespace statements {
 
 thread_local const shared_ptr<select_statement::parameters> select_statement::_default_parameters = ::make_shared<select_statement::parameters>();
 
+static thread_local uint64_t next_result_cache_id = 0;
+
 select_statement::parameters::parameters()
     : _is_distinct{false}
     , _allow_filtering{false}
+    , _bypass_cache{false}
 { }
 
 select_statement::parameters::parameters(orderings_type orderings,
                                          bool is_distinct,
-                                         bool allow_filtering)
+                                         bool allow_filtering,
+                                         bool bypass_cache)
     : _orderings{std::move(orderings)}
     , _is_distinct{is_distinct}
     , _allow_filtering{allow_filtering}
+    , _bypass_cache{bypass_cache}
 { }
 
 bool select_statement::parameters::is_distinct() {
@@ -79,6 +91,10 @@ bool select_statement::parameters::allow_filtering() {
     return _allow_filtering;
 }
 
+bool select_statement::parameters::bypass_cache() {
+    return _bypass_cache;
+}
+
 select_statement::parameters::orderings_type const& select_statement::parameters::orderings() {
     return _orderings;
 }
@@ -91,7 +107,10 @@ select_statement::select_statement(schema_ptr schema,
                                    bool is_reversed,
                                    ordering_comparator_type ordering_comparator,
                                    ::shared_ptr<term> limit,
-                                   cql_stats& stats)
+                                   ::shared_ptr<term> per_partition_limit,
+                                   cql_stats& stats,
+                                   std::experimental::optional<std::vector<query::aggregate_selector>> pushed_down_aggregates,
+                                   std::vector<size_t> group_by_cell_indices)
     : _schema(schema)
     , _bound_terms(bound_terms)
     , _parameters(std::move(parameters))
@@ -99,16 +118,24 @@ select_statement::select_statement(schema_ptr schema,
     , _restrictions(std::move(restrictions))
     , _is_reversed(is_reversed)
     , _limit(std::move(limit))
+    , _per_partition_limit(std::move(per_partition_limit))
     , _ordering_comparator(std::move(ordering_comparator))
     , _stats(stats)
+    , _pushed_down_aggregates(std::move(pushed_down_aggregates))
+    , _group_by_cell_indices(std::move(group_by_cell_indices))
+    , _result_cache_id(next_result_cache_id++)
 {
     _opts = _selection->get_query_options();
+    if (_parameters->bypass_cache()) {
+        _opts.set(query::partition_slice::option::bypass_cache);
+    }
 }
 
 bool select_statement::uses_function(const sstring& ks_name, const sstring& function_name) const {
     return _selection->uses_function(ks_name, function_name)
         || _restrictions->uses_function(ks_name, function_name)
-        || (_limit && _limit->uses_function(ks_name, function_name));
+        || (_limit && _limit->uses_function(ks_name, function_name))
+        || (_per_partition_limit && _per_partition_limit->uses_function(ks_name, function_name));
 }
 
 ::shared_ptr<const cql3::metadata> select_statement::get_result_metadata() const {
@@ -183,17 +210,18 @@ select_statement::make_partition_slice(const query_options& options)
         std::reverse(bounds.begin(), bounds.end());
     }
     return query::partition_slice(std::move(bounds),
-        std::move(static_columns), std::move(regular_columns), _opts, nullptr, options.get_cql_serialization_format());
+        std::move(static_columns), std::move(regular_columns), _opts, nullptr, options.get_cql_serialization_format(),
+        get_per_partition_limit(options), _restrictions->get_column_filters(options));
 }
 
-int32_t select_statement::get_limit(const query_options& options) const {
-    if (!_limit) {
+static int32_t bind_limit(::shared_ptr<term> limit, const query_options& options, const char* keyword, const char* name) {
+    if (!limit) {
         return std::numeric_limits<int32_t>::max();
     }
 
-    auto val = _limit->bind_and_get(options);
+    auto val = limit->bind_and_get(options);
     if (val.is_null()) {
-        throw exceptions::invalid_request_exception("Invalid null value of limit");
+        throw exceptions::invalid_request_exception(sprint("Invalid null value of %s", name));
     }
     if (val.is_unset_value()) {
         return std::numeric_limits<int32_t>::max();
@@ -202,14 +230,27 @@ int32_t select_statement::get_limit(const query_options& options) const {
         int32_type->validate(*val);
         auto l = value_cast<int32_t>(int32_type->deserialize(*val));
         if (l <= 0) {
-            throw exceptions::invalid_request_exception("LIMIT must be strictly positive");
+            throw exceptions::invalid_request_exception(sprint("%s must be strictly positive", keyword));
         }
         return l;
     } catch (const marshal_exception& e) {
-        throw exceptions::invalid_request_exception("Invalid limit value");
+        throw exceptions::invalid_request_exception(sprint("Invalid %s value", name));
     }
 }
 
+int32_t select_statement::get_limit(const query_options& options) const {
+    return bind_limit(_limit, options, "LIMIT", "limit");
+}
+
+// The number of rows to return from each partition, enforced by the
+// replicas, see partition_slice::partition_row_limit().
+uint32_t select_statement::get_per_partition_limit(const query_options& options) const {
+    if (!_per_partition_limit) {
+        return query::max_rows;
+    }
+    return bind_limit(_per_partition_limit, options, "PER PARTITION LIMIT", "per partition limit");
+}
+
 bool select_statement::needs_post_query_ordering() const {
     // We need post-query ordering only for queries with IN on the partition key and an ORDER BY.
     return _restrictions->key_is_in_relation() && !_parameters->orderings().empty();
@@ -239,25 +280,136 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
 
     validate_for_read(_schema->ks_name(), cl);
 
-    int32_t limit = get_limit(options);
+    // The limit of a grouped query is on the groups, see execute_on_ranges().
+    int32_t limit = _group_by_cell_indices.empty() ? get_limit(options) : std::numeric_limits<int32_t>::max();
     auto now = gc_clock::now();
 
     ++_stats.reads;
 
     auto command = ::make_lw_shared<query::read_command>(_schema->id(), _schema->version(),
         make_partition_slice(options), limit, now, tracing::make_trace_info(state.get_trace_state()), query::max_partitions, options.get_timestamp(state));
+    auto user = state.get_client_state().user();
+    if (user && service::get_local_priority_manager().has_workload(user->name())) {
+        command->workload = user->name();
+    }
 
     int32_t page_size = options.get_page_size();
 
     // An aggregation query will never be paged for the user, but we always page it internally to avoid OOM.
     // If we user provided a page_size we'll use that to page internally (because why not), otherwise we use our default
     // Note that if there are some nodes in the cluster with a version less than 2.0, we can't use paging (CASSANDRA-6707).
-    auto aggregate = _selection->is_aggregate();
+    auto aggregate = _selection->is_aggregate() || !_group_by_cell_indices.empty();
     if (aggregate && page_size <= 0) {
         page_size = DEFAULT_COUNT_PAGE_SIZE;
     }
 
+    if (_restrictions->has_filtering_restrictions() && !service::get_local_storage_service().cluster_supports_replica_filtering()) {
+        throw exceptions::invalid_request_exception("Restrictions on regular columns are not supported until all nodes in the cluster are upgraded");
+    }
+
+    if (_restrictions->indexed_column()) {
+        return find_index_partition_ranges(proxy, state, options).then([this, &proxy, &state, &options, command, page_size, now] (dht::partition_range_vector key_ranges) {
+            if (key_ranges.empty()) {
+                cql3::selection::result_set_builder builder(*_selection, now, options.get_cql_serialization_format(),
+                        _group_by_cell_indices);
+                auto msg = ::make_shared<cql_transport::messages::result_message::rows>(builder.build());
+                return make_ready_future<shared_ptr<cql_transport::messages::result_message>>(std::move(msg));
+            }
+            return this->execute_on_ranges(proxy, command, std::move(key_ranges), state, options, page_size, now);
+        });
+    }
+
     auto key_ranges = _restrictions->get_partition_key_ranges(options);
+    auto cache_key = result_cache_key(options, key_ranges);
+    if (!cache_key) {
+        return execute_on_ranges(proxy, command, std::move(key_ranges), state, options, page_size, now);
+    }
+
+    auto& cache = proxy.local().result_cache();
+    if (auto cached = cache.find(*cache_key)) {
+        tracing::trace(state.get_trace_state(), "Result found in the coordinator result cache");
+        return make_ready_future<shared_ptr<cql_transport::messages::result_message>>(std::move(cached));
+    }
+    auto tokens = boost::copy_range<std::vector<dht::token>>(key_ranges | boost::adaptors::transformed([] (const dht::partition_range& r) {
+        return r.start()->value().token();
+    }));
+    auto epoch = cache.epoch(_schema->id(), tokens);
+    return execute_on_ranges(proxy, command, std::move(key_ranges), state, options, page_size, now).then(
+            [this, &proxy, cache_key = std::move(*cache_key), tokens = std::move(tokens), epoch] (shared_ptr<cql_transport::messages::result_message> msg) mutable {
+        auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+        if (rows && !rows->rs().get_metadata().flags().contains<cql3::metadata::flag::HAS_MORE_PAGES>()) {
+            auto& rs = rows->rs();
+            size_t memory = 0;
+            if (auto serialized = rs.serialized_rows()) {
+                memory += serialized->size();
+            } else {
+                for (auto&& row : rs.rows()) {
+                    for (auto&& v : row) {
+                        memory += sizeof(bytes_opt) + (v ? v->size() : 0);
+                    }
+                }
+            }
+            proxy.local().result_cache().insert(epoch, std::move(cache_key), msg, _schema->id(), std::move(tokens),
+                    memory, _schema->caching_options().coordinator_ttl());
+        }
+        return msg;
+    });
+}
+
+std::experimental::optional<service::coordinator_result_cache::key>
+select_statement::result_cache_key(const query_options& options, const dht::partition_range_vector& key_ranges) const {
+    // Reads of more partitions than this are not worth keeping.
+    static constexpr size_t max_cached_partitions = 16;
+
+    if (!_schema->caching_options().coordinator_ttl().count()
+            || _parameters->bypass_cache()
+            || options.get_paging_state()
+            || key_ranges.empty()
+            || key_ranges.size() > max_cached_partitions
+            || !boost::algorithm::all_of(key_ranges, [] (const dht::partition_range& r) { return r.is_singular(); })) {
+        return {};
+    }
+
+    // The response depends on the bound values, on what is read, and on
+    // how it is serialized and paged.
+    size_t size = 3 * serialize_int32_size;
+    for (size_t i = 0; i < options.get_values_count(); ++i) {
+        auto v = options.get_value_at(i);
+        size += serialize_int32_size + (v.is_value() ? v->size() : 0);
+    }
+    bytes values(bytes::initialized_later(), size);
+    auto out = values.begin();
+    serialize_int32(out, options.get_protocol_version());
+    serialize_int32(out, uint32_t(options.get_consistency()));
+    serialize_int32(out, options.get_page_size());
+    for (size_t i = 0; i < options.get_values_count(); ++i) {
+        auto v = options.get_value_at(i);
+        if (v.is_null()) {
+            serialize_int32(out, -1);
+        } else if (v.is_unset_value()) {
+            serialize_int32(out, -2);
+        } else {
+            serialize_int32(out, v->size());
+            out = std::copy(v->begin(), v->end(), out);
+        }
+    }
+    return service::coordinator_result_cache::key{_result_cache_id, std::move(values)};
+}
+
+future<shared_ptr<cql_transport::messages::result_message>>
+select_statement::execute_on_ranges(distributed<service::storage_proxy>& proxy,
+                          lw_shared_ptr<query::read_command> command,
+                          dht::partition_range_vector&& key_ranges,
+                          service::query_state& state,
+                          const query_options& options,
+                          int32_t page_size,
+                          gc_clock::time_point now)
+{
+    auto aggregate = _selection->is_aggregate() || !_group_by_cell_indices.empty();
+
+    if (_pushed_down_aggregates && service::get_local_storage_service().cluster_supports_aggregation_pushdown()) {
+        return execute_pushed_down_aggregates(proxy, command, std::move(key_ranges), state, options);
+    }
 
     if (!aggregate && (page_size <= 0
             || !service::pager::query_pagers::may_need_paging(page_size,
@@ -270,16 +422,23 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
             state, options, command, std::move(key_ranges));
 
     if (aggregate) {
+        // The rows of grouped queries are aggregated as the pages are
+        // fetched, so only the rows of the groups are kept. Their limit is
+        // on the groups, and once as many were complete the rest is not read.
+        uint32_t group_limit = _group_by_cell_indices.empty() ? query::max_rows : get_limit(options);
         return do_with(
                 cql3::selection::result_set_builder(*_selection, now,
-                        options.get_cql_serialization_format()),
-                [p, page_size, now](auto& builder) {
-                    return do_until([p] {return p->is_exhausted();},
+                        options.get_cql_serialization_format(), _group_by_cell_indices),
+                [p, page_size, now, group_limit](auto& builder) {
+                    return do_until([p, &builder, group_limit] { return p->is_exhausted() || builder.result_size() > group_limit; },
                             [p, &builder, page_size, now] {
                                 return p->fetch_page(builder, page_size, now);
                             }
-                    ).then([&builder] {
+                    ).then([&builder, group_limit] {
                                 auto rs = builder.build();
+                                if (rs->size() > group_limit) {
+                                    rs->trim(group_limit);
+                                }
                                 auto msg = ::make_shared<cql_transport::messages::result_message::rows>(std::move(rs));
                                 return make_ready_future<shared_ptr<cql_transport::messages::result_message>>(std::move(msg));
                             });
@@ -293,7 +452,7 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
     }
 
     return p->fetch_page(page_size, now).then(
-            [this, p, &options, limit, now](std::unique_ptr<cql3::result_set> rs) {
+            [this, p, &options, now](std::unique_ptr<cql3::result_set> rs) {
 
                 if (!p->is_exhausted()) {
                     rs->get_metadata().set_has_more_pages(p->state());
@@ -304,6 +463,84 @@ select_statement::do_execute(distributed<service::storage_proxy>& proxy,
             });
 }
 
+// Reads the partition of the index table holding the base rows with the
+// value the query restricts the indexed column to, a page at a time so that
+// a popular value doesn't have to fit in memory as a single result, and
+// returns the base partitions it lists in ring order, for the base read to
+// walk them as it would a token range.
+future<dht::partition_range_vector>
+select_statement::find_index_partition_ranges(distributed<service::storage_proxy>& proxy,
+                          service::query_state& state,
+                          const query_options& options)
+{
+    static constexpr uint32_t index_page_size = 1000;
+    auto& cdef = *_restrictions->indexed_column();
+    auto index = secondary_index::find_index_on(*_schema, cdef);
+    auto view = proxy.local().get_db().local().find_schema(_schema->ks_name(), secondary_index::index_table_name(index->name()));
+    auto values = _restrictions->get_non_pk_restriction().at(&cdef)->values(options);
+    if (values.empty() || !values.front()) {
+        throw exceptions::invalid_request_exception(sprint("Invalid null value for column %s", cdef.name_as_text()));
+    }
+    auto index_key = dht::global_partitioner().decorate_key(*view, partition_key::from_single_value(*view, *values.front()));
+    auto ck_columns = boost::copy_range<std::vector<const column_definition*>>(view->clustering_key_columns()
+            | boost::adaptors::transformed([] (const column_definition& c) { return &c; }));
+    auto selection = selection::selection::for_columns(view, std::move(ck_columns));
+
+    struct lookup_state {
+        std::vector<dht::decorated_key> keys;
+        stdx::optional<clustering_key> last;
+    };
+    return do_with(lookup_state(), [this, &proxy, &state, &options, view, selection, index_key = std::move(index_key)] (lookup_state& ls) {
+        return repeat([this, &proxy, &state, &options, view, selection, &index_key, &ls] {
+            auto range = ls.last
+                    ? query::clustering_range::make_starting_with({*ls.last, false})
+                    : query::clustering_range::make_open_ended_both_sides();
+            auto cmd = ::make_lw_shared<query::read_command>(view->id(), view->version(),
+                    query::partition_slice({ std::move(range) }, {}, {}, selection->get_query_options()), index_page_size);
+            dht::partition_range_vector ranges{dht::partition_range::make_singular(index_key)};
+            return proxy.local().query(view, cmd, std::move(ranges), options.get_consistency(), state.get_trace_state())
+                    .then([this, view, selection, cmd, &options, &ls] (foreign_ptr<lw_shared_ptr<query::result>> results) {
+                cql3::selection::result_set_builder builder(*selection, gc_clock::now(), options.get_cql_serialization_format());
+                query::result_view::consume(*results, cmd->slice, cql3::selection::result_set_builder::visitor(builder, *view, *selection));
+                auto rs = builder.build();
+                auto pk_size = _schema->partition_key_size();
+                for (auto&& row : rs->rows()) {
+                    auto components = boost::copy_range<std::vector<bytes>>(row
+                            | boost::adaptors::transformed([] (const bytes_opt& v) { return v ? *v : bytes(); }));
+                    ls.last = clustering_key::from_exploded(*view, components);
+                    components.resize(pk_size);
+                    ls.keys.push_back(dht::global_partitioner().decorate_key(*_schema, partition_key::from_exploded(*_schema, components)));
+                }
+                return rs->rows().size() < index_page_size ? stop_iteration::yes : stop_iteration::no;
+            });
+        }).then([this, &ls] {
+            dht::decorated_key::less_comparator less(_schema);
+            std::sort(ls.keys.begin(), ls.keys.end(), less);
+            auto end = std::unique(ls.keys.begin(), ls.keys.end(), [this] (const dht::decorated_key& a, const dht::decorated_key& b) {
+                return a.equal(*_schema, b);
+            });
+            return boost::copy_range<dht::partition_range_vector>(boost::make_iterator_range(ls.keys.begin(), end)
+                    | boost::adaptors::transformed([] (const dht::decorated_key& k) { return dht::partition_range::make_singular(k); }));
+        });
+    });
+}
+
+future<shared_ptr<cql_transport::messages::result_message>>
+select_statement::execute_pushed_down_aggregates(distributed<service::storage_proxy>& proxy,
+                          lw_shared_ptr<query::read_command> cmd,
+                          dht::partition_range_vector&& partition_ranges,
+                          service::query_state& state,
+                          const query_options& options)
+{
+    return proxy.local().query_aggregates(_schema, cmd, *_pushed_down_aggregates, std::move(partition_ranges),
+            options.get_consistency(), state.get_trace_state()).then([this] (std::vector<bytes_opt> row) {
+        auto rs = std::make_unique<result_set>(::make_shared<metadata>(*_selection->get_result_metadata()));
+        rs->add_row(std::move(row));
+        auto msg = ::make_shared<cql_transport::messages::result_message::rows>(std::move(rs));
+        return make_ready_future<shared_ptr<cql_transport::messages::result_message>>(std::move(msg));
+    });
+}
+
 future<shared_ptr<cql_transport::messages::result_message>>
 select_statement::execute(distributed<service::storage_proxy>& proxy,
                           lw_shared_ptr<query::read_command> cmd,
@@ -403,12 +640,16 @@ select_statement::select_statement(::shared_ptr<cf_name> cf_name,
                                    ::shared_ptr<parameters> parameters,
                                    std::vector<::shared_ptr<selection::raw_selector>> select_clause,
                                    std::vector<::shared_ptr<relation>> where_clause,
-                                   ::shared_ptr<term::raw> limit)
+                                   ::shared_ptr<term::raw> limit,
+                                   ::shared_ptr<term::raw> per_partition_limit,
+                                   std::vector<::shared_ptr<cql3::column_identifier::raw>> group_by_columns)
     : cf_statement(std::move(cf_name))
     , _parameters(std::move(parameters))
     , _select_clause(std::move(select_clause))
     , _where_clause(std::move(where_clause))
     , _limit(std::move(limit))
+    , _per_partition_limit(std::move(per_partition_limit))
+    , _group_by_columns(std::move(group_by_columns))
 { }
 
 std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_stats& stats, bool for_view) {
@@ -417,7 +658,7 @@ std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_
 
     auto selection = _select_clause.empty()
                      ? selection::selection::wildcard(schema)
-                     : selection::selection::from_selectors(db, schema, _select_clause);
+                     : selection::selection::from_selectors(db, schema, _select_clause, !_group_by_columns.empty());
 
     auto restrictions = prepare_restrictions(db, schema, bound_names, selection, for_view);
 
@@ -425,6 +666,17 @@ std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_
         validate_distinct_selection(schema, selection, restrictions);
     }
 
+    std::vector<size_t> group_by_cell_indices;
+    if (!_group_by_columns.empty()) {
+        if (_parameters->is_distinct()) {
+            throw exceptions::invalid_request_exception("GROUP BY is not allowed with SELECT DISTINCT queries");
+        }
+        if (_per_partition_limit) {
+            throw exceptions::invalid_request_exception("PER PARTITION LIMIT is not allowed with GROUP BY queries");
+        }
+        group_by_cell_indices = prepare_group_by(schema, *selection);
+    }
+
     select_statement::ordering_comparator_type ordering_comparator;
     bool is_reversed_ = false;
 
@@ -437,6 +689,17 @@ std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_
 
     check_needs_filtering(restrictions);
 
+    if (_per_partition_limit) {
+        if (_parameters->is_distinct()) {
+            throw exceptions::invalid_request_exception("PER PARTITION LIMIT is not allowed with SELECT DISTINCT queries");
+        }
+        if (selection->is_aggregate()) {
+            throw exceptions::invalid_request_exception("PER PARTITION LIMIT is not allowed with aggregate queries.");
+        }
+    }
+
+    auto pushed_down_aggregates = get_pushed_down_aggregates(schema, selection, restrictions);
+
     auto stmt = ::make_shared<cql3::statements::select_statement>(schema,
         bound_names->size(),
         _parameters,
@@ -444,14 +707,52 @@ std::unique_ptr<prepared_statement> select_statement::prepare(database& db, cql_
         std::move(restrictions),
         is_reversed_,
         std::move(ordering_comparator),
-        prepare_limit(db, bound_names),
-        stats);
+        prepare_limit(db, bound_names, _limit, limit_receiver()),
+        prepare_limit(db, bound_names, _per_partition_limit, per_partition_limit_receiver()),
+        stats,
+        std::move(pushed_down_aggregates),
+        std::move(group_by_cell_indices));
 
     auto partition_key_bind_indices = bound_names->get_partition_key_bind_indexes(schema);
 
     return std::make_unique<prepared>(std::move(stmt), std::move(*bound_names), std::move(partition_key_bind_indices));
 }
 
+std::experimental::optional<std::vector<query::aggregate_selector>>
+select_statement::get_pushed_down_aggregates(schema_ptr schema,
+                                             ::shared_ptr<selection::selection> selection,
+                                             ::shared_ptr<restrictions::statement_restrictions> restrictions)
+{
+    // With a limit, or an index, the aggregates are not over all rows read
+    // from the ranges.
+    if (!selection->is_aggregate() || !_group_by_columns.empty() || _limit
+            || restrictions->uses_secondary_indexing() || restrictions->indexed_column()) {
+        return {};
+    }
+    std::vector<query::aggregate_selector> aggregates;
+    for (auto&& s : selection::raw_selector::to_selectables(_select_clause, schema)) {
+        auto fn = dynamic_pointer_cast<selection::selectable::with_function>(s);
+        if (!fn || (fn->function_name().has_keyspace() && !(fn->function_name() == fn->function_name().as_native_function()))) {
+            return {};
+        }
+        auto& name = fn->function_name().name;
+        if (name == "countRows" && fn->args().empty()) {
+            aggregates.push_back(query::aggregate_selector{name, {}});
+            continue;
+        }
+        if ((name != "count" && name != "sum" && name != "min" && name != "max") || fn->args().size() != 1) {
+            return {};
+        }
+        auto id = dynamic_pointer_cast<column_identifier>(fn->args().front());
+        auto def = id ? schema->get_column_definition(id->name()) : nullptr;
+        if (!def || !def->is_regular() || def->type->is_counter()) {
+            return {};
+        }
+        aggregates.push_back(query::aggregate_selector{name, id->text()});
+    }
+    return aggregates;
+}
+
 ::shared_ptr<restrictions::statement_restrictions>
 select_statement::prepare_restrictions(database& db,
                                        schema_ptr schema,
@@ -472,17 +773,48 @@ select_statement::prepare_restrictions(database& db,
 
 /** Returns a ::shared_ptr<term> for the limit or null if no limit is set */
 ::shared_ptr<term>
-select_statement::prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names)
+select_statement::prepare_limit(database& db, ::shared_ptr<variable_specifications> bound_names,
+                                ::shared_ptr<term::raw> limit, ::shared_ptr<column_specification> receiver)
 {
-    if (!_limit) {
+    if (!limit) {
         return {};
     }
 
-    auto prep_limit = _limit->prepare(db, keyspace(), limit_receiver());
+    auto prep_limit = limit->prepare(db, keyspace(), receiver);
     prep_limit->collect_marker_specification(bound_names);
     return prep_limit;
 }
 
+std::vector<size_t> select_statement::prepare_group_by(schema_ptr schema, selection::selection& selection) const
+{
+    std::vector<size_t> indices;
+    auto pk_columns = schema->partition_key_columns();
+    auto ck_columns = schema->clustering_key_columns();
+    auto pk = pk_columns.begin();
+    auto ck = ck_columns.begin();
+    for (auto&& raw : _group_by_columns) {
+        auto column = raw->prepare_column_identifier(schema);
+        auto def = schema->get_column_definition(column->name());
+        if (!def) {
+            throw exceptions::invalid_request_exception(sprint("Undefined column name %s", *column));
+        }
+        bool in_order = pk != pk_columns.end() ? def == &*pk++ : ck != ck_columns.end() && def == &*ck++;
+        if (!in_order) {
+            throw exceptions::invalid_request_exception(
+                "Group by currently only support groups of columns following their declared order in the PRIMARY KEY");
+        }
+        auto index = selection.index_of(*def);
+        if (index < 0) {
+            index = selection.add_column_for_ordering(*def);
+        }
+        indices.push_back(index);
+    }
+    if (pk != pk_columns.end()) {
+        throw exceptions::invalid_request_exception("Group by must include all the partition key columns");
+    }
+    return indices;
+}
+
 void select_statement::verify_ordering_is_allowed(::shared_ptr<restrictions::statement_restrictions> restrictions)
 {
     if (restrictions->uses_secondary_indexing()) {
@@ -505,6 +837,10 @@ void select_statement::validate_distinct_selection(schema_ptr schema,
         }
     }
 
+    if (restrictions->has_filtering_restrictions()) {
+        throw exceptions::invalid_request_exception("SELECT DISTINCT queries cannot restrict regular columns");
+    }
+
     // If it's a key range, we require that all partition key columns are selected so we don't have to bother
     // with post-query grouping.
     if (!restrictions->is_key_range()) {
@@ -624,17 +960,21 @@ bool select_statement::is_reversed(schema_ptr schema) {
 /** If ALLOW FILTERING was not specified, this verifies that it is not needed */
 void select_statement::check_needs_filtering(::shared_ptr<restrictions::statement_restrictions> restrictions)
 {
-    // non-key-range non-indexed queries cannot involve filtering underneath
-    if (!_parameters->allow_filtering() && (restrictions->is_key_range() || restrictions->uses_secondary_indexing())) {
-        // We will potentially filter data if either:
-        //  - Have more than one IndexExpression
-        //  - Have no index expression and the column filter is not the identity
-        if (restrictions->need_filtering()) {
-            throw exceptions::invalid_request_exception(
-                "Cannot execute this query as it might involve data filtering and "
-                    "thus may have unpredictable performance. If you want to execute "
-                    "this query despite the performance unpredictability, use ALLOW FILTERING");
-        }
+    if (_parameters->allow_filtering()) {
+        return;
+    }
+    // Restrictions on regular columns are evaluated by filtering the rows read,
+    // unless a single EQ restriction is answered by the index on its column.
+    // Otherwise, non-key-range non-indexed queries cannot involve filtering underneath.
+    // We will potentially filter data if either:
+    //  - Have more than one IndexExpression
+    //  - Have no index expression and the column filter is not the identity
+    if ((restrictions->has_filtering_restrictions() && !(restrictions->indexed_column() && restrictions->get_non_pk_restriction().size() == 1))
+            || ((restrictions->is_key_range() || restrictions->uses_secondary_indexing()) && restrictions->need_filtering())) {
+        throw exceptions::invalid_request_exception(
+            "Cannot execute this query as it might involve data filtering and "
+                "thus may have unpredictable performance. If you want to execute "
+                "this query despite the performance unpredictability, use ALLOW FILTERING");
     }
 }
 
@@ -649,6 +989,11 @@ ::shared_ptr<column_specification> select_statement::limit_receiver() {
         int32_type);
 }
 
+::shared_ptr<column_specification> select_statement::per_partition_limit_receiver() {
+    return ::make_shared<column_specification>(keyspace(), column_family(), ::make_shared<column_identifier>("[per_partition_limit]", true),
+        int32_type);
+}
+
 }
 
 }
@@ -50,6 +50,7 @@
 #include "cql3/result_set.hh"
 #include "exceptions/unrecognized_entity_exception.hh"
 #include "service/client_state.hh"
+#include "service/coordinator_result_cache.hh"
 #include "core/shared_ptr.hh"
 #include "core/distributed.hh"
 #include "validation.hh"
@@ -76,6 +77,7 @@ class select_statement : public cql_statement {
     ::shared_ptr<restrictions::statement_restrictions> _restrictions;
     bool _is_reversed;
     ::shared_ptr<term> _limit;
+    ::shared_ptr<term> _per_partition_limit;
 
     template<typename T>
     using compare_fn = raw::select_statement::compare_fn<T>;
@@ -90,9 +92,28 @@ class select_statement : public cql_statement {
 
     query::partition_slice::option_set _opts;
     cql_stats& _stats;
+    // The aggregates of the selection, when they can be computed by the
+    // nodes reading the data, see storage_proxy::query_aggregates().
+    std::experimental::optional<std::vector<query::aggregate_selector>> _pushed_down_aggregates;
+    // The indices in the rows read of the cells of the GROUP BY columns.
+    std::vector<size_t> _group_by_cell_indices;
+    // Identifies the statement in the coordinator result cache of its shard.
+    uint64_t _result_cache_id;
 private:
     future<::shared_ptr<cql_transport::messages::result_message>> do_execute(distributed<service::storage_proxy>& proxy,
         service::query_state& state, const query_options& options);
+    future<::shared_ptr<cql_transport::messages::result_message>> execute_pushed_down_aggregates(distributed<service::storage_proxy>& proxy,
+        lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector&& partition_ranges, service::query_state& state,
+        const query_options& options);
+    future<::shared_ptr<cql_transport::messages::result_message>> execute_on_ranges(distributed<service::storage_proxy>& proxy,
+        lw_shared_ptr<query::read_command> command, dht::partition_range_vector&& key_ranges, service::query_state& state,
+        const query_options& options, int32_t page_size, gc_clock::time_point now);
+    // Returns the key of the results of the statement in the coordinator
+    // result cache, if it may be cached.
+    std::experimental::optional<service::coordinator_result_cache::key> result_cache_key(const query_options& options,
+        const dht::partition_range_vector& key_ranges) const;
+    future<dht::partition_range_vector> find_index_partition_ranges(distributed<service::storage_proxy>& proxy,
+        service::query_state& state, const query_options& options);
     friend class select_statement_executor;
 public:
     select_statement(schema_ptr schema,
@@ -103,7 +124,10 @@ class select_statement : public cql_statement {
             bool is_reversed,
             ordering_comparator_type ordering_comparator,
             ::shared_ptr<term> limit,
-            cql_stats& stats);
+            ::shared_ptr<term> per_partition_limit,
+            cql_stats& stats,
+            std::experimental::optional<std::vector<query::aggregate_selector>> pushed_down_aggregates = {},
+            std::vector<size_t> group_by_cell_indices = {});
 
     virtual bool uses_function(const sstring& ks_name, const sstring& function_name) const override;
 
@@ -198,6 +222,7 @@ class select_statement : public cql_statement {
 
 private:
     int32_t get_limit(const query_options& options) const;
+    uint32_t get_per_partition_limit(const query_options& options) const;
     bool needs_post_query_ordering() const;
 
 #if 0
@@ -45,6 +45,13 @@
 #include "unimplemented.hh"
 
 #include "cql3/operation_impl.hh"
+#include "cql3/constants.hh"
+
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/range/algorithm/adjacent_find.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include <typeinfo>
 
 namespace cql3 {
 
@@ -116,6 +123,90 @@ void update_statement::add_update_for_key(mutation& m, const query::clustering_r
 #endif
 }
 
+void update_statement::prepare_simple_write() {
+    auto is_multi_cell = [] (const column_definition& def) {
+        return def.type->is_multi_cell();
+    };
+    if (s->is_counter() || s->is_dense() || s->has_static_columns()
+            || boost::algorithm::any_of(s->regular_columns(), is_multi_cell)) {
+        return;
+    }
+    // Setting a non-collection column to a value is all a constants::setter
+    // does; the other operations need update_parameters.
+    bool only_setters = boost::algorithm::all_of(_column_operations, [] (const ::shared_ptr<operation>& op) {
+        return typeid(*op) == typeid(constants::setter) && op->column.is_regular();
+    });
+    if (!only_setters) {
+        return;
+    }
+    _simple_write_columns.clear();
+    for (auto&& op : _column_operations) {
+        _simple_write_columns.push_back(simple_write_column{&op->column, op->get_term()});
+    }
+    auto by_id = [] (const simple_write_column& a, const simple_write_column& b) {
+        return a.column->id < b.column->id;
+    };
+    boost::sort(_simple_write_columns, by_id);
+    auto same_id = [] (const simple_write_column& a, const simple_write_column& b) {
+        return a.column->id == b.column->id;
+    };
+    _simple_write = boost::adjacent_find(_simple_write_columns, same_id) == _simple_write_columns.end();
+}
+
+// Does what add_update_for_key() and constants::setter do, for the
+// statements prepare_simple_write() chose: the row is looked up once, and its
+// cells are appended in column id order.
+stdx::optional<std::vector<mutation>>
+update_statement::get_simple_mutations(dht::partition_range_vector& keys, const query::clustering_row_ranges& ranges,
+        const query_options& options, int64_t now) {
+    if (!_simple_write) {
+        return {};
+    }
+    auto timestamp = get_timestamp(now, options);
+    if (timestamp < api::min_timestamp || timestamp > api::max_timestamp) {
+        throw exceptions::invalid_request_exception(sprint("Out of bound timestamp, must be in [%d, %d]",
+                api::min_timestamp, api::max_timestamp));
+    }
+    auto ttl = get_time_to_live(options);
+    if (ttl.count() <= 0) {
+        ttl = s->default_time_to_live();
+    }
+    auto local_deletion_time = gc_clock::now();
+    bool row_marker_needed = type.is_insert() && s->is_cql3_table();
+
+    std::vector<mutation> mutations;
+    mutations.reserve(keys.size());
+    for (auto&& key : keys) {
+        // We know key.start() must be defined since we only allow EQ relations on the partition key.
+        mutations.emplace_back(std::move(*key.start()->value().key()), s);
+        auto& m = mutations.back();
+        for (auto&& r : ranges) {
+            auto& row = m.partition().clustered_row(*s, r.start() ? r.start()->value() : clustering_key_prefix::make_empty());
+            if (row_marker_needed) {
+                row.apply(row_marker(timestamp, ttl, local_deletion_time + ttl));
+            }
+            auto& cells = row.cells();
+            // The same row may be listed twice by an IN restriction.
+            bool append = cells.empty();
+            for (auto&& c : _simple_write_columns) {
+                auto value = c.value->bind_and_get(options);
+                if (value.is_unset_value()) {
+                    continue;
+                }
+                auto cell = value.is_null() ? atomic_cell::make_dead(timestamp, local_deletion_time)
+                        : ttl.count() > 0 ? atomic_cell::make_live(timestamp, *value, local_deletion_time + ttl, ttl)
+                        : atomic_cell::make_live(timestamp, *value);
+                if (append) {
+                    cells.append_cell(c.column->id, std::move(cell));
+                } else {
+                    cells.apply(*c.column, std::move(cell));
+                }
+            }
+        }
+    }
+    return std::move(mutations);
+}
+
 namespace raw {
 
 insert_statement::insert_statement(            ::shared_ptr<cf_name> name,
@@ -172,6 +263,7 @@ insert_statement::prepare_internal(database& db, schema_ptr schema,
         };
     }
     stmt->process_where_clause(db, relations, std::move(bound_names));
+    stmt->prepare_simple_write();
     return stmt;
 }
 
@@ -208,6 +300,7 @@ update_statement::prepare_internal(database& db, schema_ptr schema,
     }
 
     stmt->process_where_clause(db, _where_clause, std::move(bound_names));
+    stmt->prepare_simple_write();
     return stmt;
 }
 
@@ -66,12 +66,30 @@ class update_statement : public modification_statement {
 #endif
 
     update_statement(statement_type type, uint32_t bound_terms, schema_ptr s, std::unique_ptr<attributes> attrs, uint64_t* cql_stats_counter_ptr);
+
+    // Chooses the simple write path, once the operations and the where clause
+    // are known, if the statement only sets regular columns of a table
+    // without collections, counters or static columns to plain values.
+    void prepare_simple_write();
 private:
+    // A column set by a statement on the simple write path, to the value of
+    // its term.
+    struct simple_write_column {
+        const column_definition* column;
+        ::shared_ptr<term> value;
+    };
+    // In column id order, so that their cells are appended to the row.
+    std::vector<simple_write_column> _simple_write_columns;
+    bool _simple_write = false;
+
     virtual bool require_full_clustering_key() const override;
 
     virtual bool allow_clustering_key_slices() const override;
 
     virtual void add_update_for_key(mutation& m, const query::clustering_range& range, const update_parameters& params) override;
+
+    virtual stdx::optional<std::vector<mutation>> get_simple_mutations(dht::partition_range_vector& keys,
+            const query::clustering_row_ranges& ranges, const query_options& options, int64_t now) override;
 };
 
 }
@@ -69,8 +69,11 @@
 #include "schema_registry.hh"
 #include "service/priority_manager.hh"
 #include "cell_locking.hh"
+#include "counter_shard_cache.hh"
+#include "sstables/index_summary_manager.hh"
 #include <seastar/core/execution_stage.hh>
 #include "view_info.hh"
+#include "utils/task_group.hh"
 
 #include "checked-file-impl.hh"
 #include "disk-error-handler.hh"
@@ -149,9 +152,18 @@ column_family::column_family(schema_ptr schema, config config, db::commitlog* cl
     , _flush_queue(std::make_unique<memtable_flush_queue>())
     , _counter_cell_locks(std::make_unique<cell_locker>(_schema, cl_stats))
 {
+    if (_schema->is_counter() && _config.counter_cache_tracker && _config.counter_cache_tracker->enabled()) {
+        _counter_shard_cache = std::make_unique<counter_shard_cache>(_schema, *_config.counter_cache_tracker);
+    }
     if (!_config.enable_disk_writes) {
         dblog.warn("Writes disabled, column family no durable.");
     }
+    if (_config.write_admission_group) {
+        _write_admission = std::make_unique<logalloc::region_group::admission_class>(*_config.write_admission_group);
+    }
+    if (_schema->per_partition_rate_limit_options().enabled()) {
+        _rate_limiter = std::make_unique<db::per_partition_rate_limiter>(_schema, _schema->per_partition_rate_limit_options());
+    }
     set_metrics();
 }
 
@@ -207,6 +219,25 @@ logalloc::occupancy_stats column_family::occupancy() const {
     return res;
 }
 
+table_memory_footprint column_family::memory_footprint() const {
+    table_memory_footprint res;
+    auto add_memtables = [&res] (const memtable_list& memtables) {
+        for (auto&& m : memtables) {
+            res.memtable += m->footprint();
+        }
+    };
+    add_memtables(*_memtables);
+    add_memtables(*_streaming_memtables);
+    for (auto&& smb : _streaming_memtables_big) {
+        add_memtables(*smb.second->memtables);
+    }
+    res.row_cache = _cache.footprint();
+    for (auto&& sst : *_sstables->all()) {
+        sst->add_index_cache_footprint(res.index_cache);
+    }
+    return res;
+}
+
 static
 bool belongs_to_current_shard(const streamed_mutation& m) {
     return dht::shard_of(m.decorated_key().token()) == engine().cpu_id();
@@ -290,6 +321,103 @@ contains_rows(const sstables::sstable& sst, const schema_ptr& schema, const ck_f
     });
 }
 
+// Whether slice names the rows and cells it reads in the partition key, so
+// that data older than all of them can't change its result.
+static bool
+can_read_in_timestamp_order(const schema& s, const query::partition_slice& slice, const partition_key& key) {
+    if (s.is_counter()) {
+        return false;
+    }
+    auto& ranges = slice.row_ranges(s, key);
+    if (ranges.empty() || !s.clustering_key_size()) {
+        return false;
+    }
+    auto names_row = [&] (const query::clustering_range& r) {
+        return r.is_singular() && r.start()->value().is_full(s);
+    };
+    auto atomic = [&] (column_kind kind) {
+        return [&s, kind] (column_id id) {
+            return s.column_at(kind, id).is_atomic();
+        };
+    };
+    return boost::algorithm::all_of(ranges, names_row)
+        && boost::algorithm::all_of(slice.static_columns, atomic(column_kind::static_column))
+        && boost::algorithm::all_of(slice.regular_columns, atomic(column_kind::regular_column));
+}
+
+// Whether the given cells of a row, read for such a slice, are all written
+// after max_timestamp. Sets all_live to false if any of them is dead.
+static bool
+cells_are_newer_than(const row& cells, const std::vector<column_id>& columns, api::timestamp_type max_timestamp, bool& all_live) {
+    return boost::algorithm::all_of(columns, [&] (column_id id) {
+        auto c = cells.find_cell(id);
+        if (!c) {
+            return false;
+        }
+        auto cell = c->as_atomic_cell();
+        all_live &= cell.is_live();
+        return cell.timestamp() > max_timestamp;
+    });
+}
+
+// Whether the named row key of p, read for such a slice, holds all the
+// result for it no matter what data written before max_timestamp has: the
+// row is deleted after it, or all its named cells are written after it, and
+// the row is alive after it, through its cells or its marker.
+static bool
+row_is_newer_than(const schema& s, const mutation_partition& p, const query::partition_slice& slice,
+        const clustering_key_prefix& key, api::timestamp_type max_timestamp) {
+    if (p.tombstone_for_row(s, key).tomb().timestamp > max_timestamp) {
+        return true;
+    }
+    auto i = p.clustered_rows().find(key, rows_entry::compare(s));
+    if (i == p.clustered_rows().end()) {
+        return false;
+    }
+    auto& cr = i->row();
+    bool all_live = true;
+    if (!cells_are_newer_than(cr.cells(), slice.regular_columns, max_timestamp, all_live)) {
+        return false;
+    }
+    return all_live || (cr.marker().is_live() && cr.marker().timestamp() > max_timestamp);
+}
+
+// Whether m, read for such a slice, holds all the result of the slice no
+// matter what data written before max_timestamp has.
+static bool
+is_newer_than(const schema& s, const mutation& m, const query::partition_slice& slice, api::timestamp_type max_timestamp) {
+    auto& p = m.partition();
+    if (p.partition_tombstone().timestamp > max_timestamp) {
+        return true;
+    }
+    bool static_live = true;
+    if (!cells_are_newer_than(p.static_row(), slice.static_columns, max_timestamp, static_live)) {
+        return false;
+    }
+    return boost::algorithm::all_of(slice.row_ranges(s, m.key()), [&] (const query::clustering_range& r) {
+        return row_is_newer_than(s, p, slice, r.start()->value(), max_timestamp);
+    });
+}
+
+// The part of such a slice which data written before max_timestamp can still
+// change the result of, given m read for it so far: the named rows which
+// aren't newer than it, and the static columns, unless they all are.
+static query::partition_slice
+narrow_to_older_than(const schema& s, const mutation& m, const query::partition_slice& slice, api::timestamp_type max_timestamp) {
+    auto& p = m.partition();
+    query::clustering_row_ranges ranges;
+    for (auto&& r : slice.row_ranges(s, m.key())) {
+        if (!row_is_newer_than(s, p, slice, r.start()->value(), max_timestamp)) {
+            ranges.push_back(r);
+        }
+    }
+    bool static_live = true;
+    auto static_columns = cells_are_newer_than(p.static_row(), slice.static_columns, max_timestamp, static_live)
+            ? std::vector<column_id>() : slice.static_columns;
+    return query::partition_slice(std::move(ranges), std::move(static_columns), slice.regular_columns, slice.options,
+            nullptr, slice.cql_format(), slice.partition_row_limit(), slice.filters());
+}
+
 // Filter out sstables for reader using bloom filter and sstable metadata that keeps track
 // of a range for each clustering component.
 static std::vector<sstables::shared_sstable>
@@ -344,6 +472,10 @@ filter_sstable_for_reader(std::vector<sstables::shared_sstable>&& sstables, colu
     return sstables;
 }
 
+// Reads the sstables overlapping a partition range, opening the reader of
+// each sstable only once the scan reaches its first partition, and closing
+// it once it has read its last one, so that a scan of a leveled table keeps
+// about one reader per level open instead of one for each of its sstables.
 class range_sstable_reader final : public combined_mutation_reader {
     schema_ptr _s;
     const dht::partition_range* _pr;
@@ -374,10 +506,14 @@ class range_sstable_reader final : public combined_mutation_reader {
         };
     };
     std::vector<sstable_and_reader> _current_readers;
+    // The sstables overlapping the range which weren't opened yet, in
+    // descending order of their first key, so that the next one is last.
+    std::vector<sstables::shared_sstable> _pending;
 
     // Use a pointer instead of copying, so we don't need to regenerate the reader if
     // the priority changes.
     const io_priority_class& _pc;
+    reader_resource_tracker _resource_tracker;
     tracing::trace_state_ptr _trace_state;
     const query::partition_slice& _slice;
     streamed_mutation::forwarding _fwd;
@@ -387,18 +523,51 @@ class range_sstable_reader final : public combined_mutation_reader {
         tracing::trace(_trace_state, "Reading partition range {} from sstable {}", *_pr, seastar::value_of([&sst] { return sst->get_filename(); }));
         // FIXME: make sstable::read_range_rows() return ::mutation_reader so that we can drop this wrapper.
         mutation_reader reader =
-            make_mutation_reader<sstable_range_wrapping_reader>(sst, _s, *_pr, _slice, _pc, _fwd, _fwd_mr);
+            make_mutation_reader<sstable_range_wrapping_reader>(sst, _s, *_pr, _slice, _pc, _fwd, _fwd_mr, _resource_tracker);
         if (sst->is_shared()) {
             reader = make_filtering_reader(std::move(reader), belongs_to_current_shard);
         }
         return std::make_unique<mutation_reader>(std::move(reader));
     }
+
+    void set_pending(std::vector<sstables::shared_sstable> ssts) {
+        boost::range::sort(ssts, [this] (const sstables::shared_sstable& a, const sstables::shared_sstable& b) {
+            return b->get_first_decorated_key().less_compare(*_s, a->get_first_decorated_key());
+        });
+        _pending = std::move(ssts);
+    }
+protected:
+    virtual std::vector<mutation_reader*> create_new_readers(const dht::decorated_key* key) override {
+        std::vector<mutation_reader*> readers;
+        auto opens_before = [&] (const sstables::shared_sstable& sst) {
+            return !key || !key->less_compare(*_s, sst->get_first_decorated_key());
+        };
+        while (!_pending.empty() && opens_before(_pending.back())) {
+            auto sst = std::move(_pending.back());
+            _pending.pop_back();
+            auto reader = create_reader(sst);
+            readers.emplace_back(reader.get());
+            _current_readers.emplace_back(sstable_and_reader { std::move(sst), std::move(reader) });
+            if (!key) {
+                break;
+            }
+        }
+        return readers;
+    }
+
+    virtual bool on_readers_exhausted(const std::vector<mutation_reader*>& readers) override {
+        _current_readers.erase(boost::remove_if(_current_readers, [&] (const sstable_and_reader& s_a_r) {
+            return boost::algorithm::any_of_equal(readers, s_a_r._reader.get());
+        }), _current_readers.end());
+        return true;
+    }
 public:
     range_sstable_reader(schema_ptr s,
                          lw_shared_ptr<sstables::sstable_set> sstables,
                          const dht::partition_range& pr,
                          const query::partition_slice& slice,
                          const io_priority_class& pc,
+                         reader_resource_tracker resource_tracker,
                          tracing::trace_state_ptr trace_state,
                          streamed_mutation::forwarding fwd,
                          mutation_reader::forwarding fwd_mr)
@@ -406,21 +575,14 @@ class range_sstable_reader final : public combined_mutation_reader {
         , _pr(&pr)
         , _sstables(std::move(sstables))
         , _pc(pc)
+        , _resource_tracker(std::move(resource_tracker))
         , _trace_state(std::move(trace_state))
         , _slice(slice)
         , _fwd(fwd)
         , _fwd_mr(fwd_mr)
     {
-        auto ssts = _sstables->select(pr);
-        std::vector<mutation_reader*> readers;
-        readers.reserve(ssts.size());
-        _current_readers.reserve(ssts.size());
-        for (auto& sst : ssts) {
-            auto reader = create_reader(sst);
-            readers.emplace_back(reader.get());
-            _current_readers.emplace_back(sstable_and_reader { sst, std::move(reader) });
-        }
-        init_mutation_reader_set(std::move(readers));
+        set_pending(_sstables->select(pr));
+        init_mutation_reader_set({ });
     }
 
     range_sstable_reader(range_sstable_reader&&) = delete; // reader takes reference to member fields
@@ -428,38 +590,30 @@ class range_sstable_reader final : public combined_mutation_reader {
     virtual future<> fast_forward_to(const dht::partition_range& pr) override {
         _pr = &pr;
 
+        // The readers still open are reused for the new range, the other
+        // sstables it overlaps are opened as the scan reaches them, as usual.
         auto new_sstables = _sstables->select(pr);
         boost::range::sort(new_sstables);
         boost::range::sort(_current_readers);
 
-        std::vector<sstables::shared_sstable> to_add;
+        std::vector<sstables::shared_sstable> to_open;
         std::vector<sstable_and_reader> to_remove, unchanged;
         sstable_and_reader::less_compare cmp;
-        boost::set_difference(new_sstables, _current_readers, std::back_inserter(to_add), cmp);
+        boost::set_difference(new_sstables, _current_readers, std::back_inserter(to_open), cmp);
         std::set_difference(_current_readers.begin(), _current_readers.end(), new_sstables.begin(), new_sstables.end(),
                             boost::back_move_inserter(to_remove), cmp);
         std::set_intersection(_current_readers.begin(), _current_readers.end(), new_sstables.begin(), new_sstables.end(),
                               boost::back_move_inserter(unchanged), cmp);
 
-        std::vector<sstable_and_reader> to_add_sar;
-        boost::transform(to_add, std::back_inserter(to_add_sar), [&] (const sstables::shared_sstable& sst) {
-            return sstable_and_reader { sst, create_reader(sst) };
+        std::vector<mutation_reader*> to_remove_mrs;
+        to_remove_mrs.reserve(to_remove.size());
+        boost::range::transform(to_remove, std::back_inserter(to_remove_mrs), [] (const sstable_and_reader& s_a_r) {
+            return s_a_r._reader.get();
         });
 
-        auto get_mutation_readers = [] (std::vector<sstable_and_reader>& ssts) {
-            std::vector<mutation_reader*> mrs;
-            mrs.reserve(ssts.size());
-            boost::range::transform(ssts, std::back_inserter(mrs), [] (const sstable_and_reader& s_a_r) {
-                return s_a_r._reader.get();
-            });
-            return mrs;
-        };
-
-        auto to_add_mrs = get_mutation_readers(to_add_sar);
-        auto to_remove_mrs = get_mutation_readers(to_remove);
-
-        unchanged.insert(unchanged.end(), std::make_move_iterator(to_add_sar.begin()), std::make_move_iterator(to_add_sar.end()));
-        return combined_mutation_reader::fast_forward_to(std::move(to_add_mrs), std::move(to_remove_mrs), pr).then([this, new_readers = std::move(unchanged)] () mutable {
+        set_pending(std::move(to_open));
+        return combined_mutation_reader::fast_forward_to({ }, std::move(to_remove_mrs), pr).then(
+                [this, new_readers = std::move(unchanged), to_remove = std::move(to_remove)] () mutable {
             _current_readers = std::move(new_readers);
         });
     }
@@ -477,9 +631,11 @@ class single_key_sstable_reader final : public mutation_reader::impl {
     // Use a pointer instead of copying, so we don't need to regenerate the reader if
     // the priority changes.
     const io_priority_class& _pc;
+    reader_resource_tracker _resource_tracker;
     const query::partition_slice& _slice;
     tracing::trace_state_ptr _trace_state;
     streamed_mutation::forwarding _fwd;
+    uint64_t _mutations_read = 0;
 public:
     single_key_sstable_reader(column_family* cf,
                               schema_ptr schema,
@@ -488,6 +644,7 @@ class single_key_sstable_reader final : public mutation_reader::impl {
                               const dht::partition_range& pr, // must be singular
                               const query::partition_slice& slice,
                               const io_priority_class& pc,
+                              reader_resource_tracker resource_tracker,
                               tracing::trace_state_ptr trace_state,
                               streamed_mutation::forwarding fwd)
         : _cf(cf)
@@ -497,20 +654,81 @@ class single_key_sstable_reader final : public mutation_reader::impl {
         , _sstables(std::move(sstables))
         , _sstable_histogram(sstable_histogram)
         , _pc(pc)
+        , _resource_tracker(std::move(resource_tracker))
         , _slice(slice)
         , _trace_state(std::move(trace_state))
         , _fwd(fwd)
     { }
 
+private:
+    // Reads the sstables one at a time, newest data first, until the rest
+    // can only hold older data than that of the slice read so far. The
+    // older sstables are only asked for the rows the newer ones haven't
+    // completed.
+    future<streamed_mutation_opt> read_in_timestamp_order(std::vector<sstables::shared_sstable> sstables) {
+        boost::sort(sstables, [] (const sstables::shared_sstable& a, const sstables::shared_sstable& b) {
+            return a->get_stats_metadata().max_timestamp > b->get_stats_metadata().max_timestamp;
+        });
+        return do_with(std::move(sstables), size_t(0), mutation_opt(), stdx::optional<query::partition_slice>(),
+                [this] (auto& sstables, size_t& read, mutation_opt& result, stdx::optional<query::partition_slice>& narrowed) {
+            return repeat([this, &sstables, &read, &result, &narrowed] {
+                if (read == sstables.size()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                auto& sstable = sstables[read++];
+                auto& slice = narrowed ? *narrowed : _slice;
+                tracing::trace(_trace_state, "Reading key {} from sstable {}", _pr, seastar::value_of([&sstable] { return sstable->get_filename(); }));
+                return sstable->read_row(_schema, _pr.start()->value(), slice, _pc, _fwd, _resource_tracker).then([] (streamed_mutation_opt smo) {
+                    return mutation_from_streamed_mutation(std::move(smo));
+                }).then([this, &sstables, &read, &result, &narrowed] (mutation_opt mo) {
+                    if (mo) {
+                        _mutations_read++;
+                        if (result) {
+                            result->apply(std::move(*mo));
+                        } else {
+                            result = std::move(mo);
+                        }
+                    }
+                    if (read == sstables.size() || !result) {
+                        return stop_iteration::no;
+                    }
+                    auto max_timestamp = sstables[read]->get_stats_metadata().max_timestamp;
+                    if (is_newer_than(*_schema, *result, _slice, max_timestamp)) {
+                        auto skipped = sstables.size() - read;
+                        _cf->cf_stats()->sstables_skipped_by_timestamp += skipped;
+                        tracing::trace(_trace_state, "Skipping {} sstables with only older data for key {}", skipped, _pr);
+                        return stop_iteration::yes;
+                    }
+                    narrowed = narrow_to_older_than(*_schema, *result, _slice, max_timestamp);
+                    return stop_iteration::no;
+                });
+            }).then([this, &result] () -> streamed_mutation_opt {
+                _done = true;
+                if (!result) {
+                    return { };
+                }
+                _sstable_histogram.add(_mutations_read);
+                return streamed_mutation_from_mutation(std::move(*result));
+            });
+        });
+    }
+public:
     virtual future<streamed_mutation_opt> operator()() override {
         if (_done) {
             return make_ready_future<streamed_mutation_opt>();
         }
-        auto candidates = filter_sstable_for_reader(_sstables->select(_pr), *_cf, _schema, _key, _slice);
+        auto selected = _sstables->select(_pr);
+        auto selected_count = selected.size();
+        auto candidates = filter_sstable_for_reader(std::move(selected), *_cf, _schema, _key, _slice);
+        tracing::trace(_trace_state, "Filters skipped {} of {} sstables for key {}", selected_count - candidates.size(), selected_count, _pr);
+        if (_fwd == streamed_mutation::forwarding::no && candidates.size() > 1
+                && can_read_in_timestamp_order(*_schema, _slice, *_pr.start()->value().key())) {
+            return read_in_timestamp_order(std::move(candidates));
+        }
         return parallel_for_each(std::move(candidates),
             [this](const lw_shared_ptr<sstables::sstable>& sstable) {
                 tracing::trace(_trace_state, "Reading key {} from sstable {}", _pr, seastar::value_of([&sstable] { return sstable->get_filename(); }));
-                return sstable->read_row(_schema, _pr.start()->value(), _slice, _pc, _fwd).then([this](auto smo) {
+                return sstable->read_row(_schema, _pr.start()->value(), _slice, _pc, _fwd, _resource_tracker).then([this](auto smo) {
                     if (smo) {
                         _mutations.emplace_back(std::move(*smo));
                     }
@@ -534,8 +752,20 @@ column_family::make_sstable_reader(schema_ptr s,
                                    tracing::trace_state_ptr trace_state,
                                    streamed_mutation::forwarding fwd,
                                    mutation_reader::forwarding fwd_mr) const {
+    return make_sstable_reader(std::move(s), _sstables, pr, slice, pc, std::move(trace_state), fwd, fwd_mr);
+}
+
+mutation_reader
+column_family::make_sstable_reader(schema_ptr s,
+                                   lw_shared_ptr<sstables::sstable_set> sstables,
+                                   const dht::partition_range& pr,
+                                   const query::partition_slice& slice,
+                                   const io_priority_class& pc,
+                                   tracing::trace_state_ptr trace_state,
+                                   streamed_mutation::forwarding fwd,
+                                   mutation_reader::forwarding fwd_mr) const {
     // restricts a reader's concurrency if the configuration specifies it
-    auto restrict_reader = [&] (mutation_reader&& in) {
+    auto restrict_reader = [&] (std::function<mutation_reader (reader_resource_tracker)> create_reader) {
         auto&& config = [this, &pc] () -> const restricted_mutation_reader_config& {
             if (service::get_local_streaming_read_priority().id() == pc.id()) {
                 return _config.streaming_read_concurrency_config;
@@ -543,9 +773,9 @@ column_family::make_sstable_reader(schema_ptr s,
             return _config.read_concurrency_config;
         }();
         if (config.sem) {
-            return make_restricted_reader(config, 1, std::move(in));
+            return make_restricted_reader(config, std::move(create_reader));
         } else {
-            return std::move(in);
+            return create_reader(no_resource_tracking());
         }
     };
 
@@ -554,11 +784,15 @@ column_family::make_sstable_reader(schema_ptr s,
         if (dht::shard_of(pos.token()) != engine().cpu_id()) {
             return make_empty_reader(); // range doesn't belong to this shard
         }
-        return restrict_reader(make_mutation_reader<single_key_sstable_reader>(const_cast<column_family*>(this), std::move(s), _sstables,
-            _stats.estimated_sstable_per_read, pr, slice, pc, std::move(trace_state), fwd));
+        return restrict_reader([this, s = std::move(s), sstables = std::move(sstables), &pr, &slice, &pc, trace_state = std::move(trace_state), fwd] (reader_resource_tracker tracker) mutable {
+            return make_mutation_reader<single_key_sstable_reader>(const_cast<column_family*>(this), std::move(s), std::move(sstables),
+                _stats.estimated_sstable_per_read, pr, slice, pc, std::move(tracker), std::move(trace_state), fwd);
+        });
     } else {
         // range_sstable_reader is not movable so we need to wrap it
-        return restrict_reader(make_mutation_reader<range_sstable_reader>(std::move(s), _sstables, pr, slice, pc, std::move(trace_state), fwd, fwd_mr));
+        return restrict_reader([s = std::move(s), sstables = std::move(sstables), &pr, &slice, &pc, trace_state = std::move(trace_state), fwd, fwd_mr] (reader_resource_tracker tracker) mutable {
+            return make_mutation_reader<range_sstable_reader>(std::move(s), std::move(sstables), pr, slice, pc, std::move(tracker), std::move(trace_state), fwd, fwd_mr);
+        });
     }
 }
 
@@ -635,11 +869,15 @@ column_family::make_reader(schema_ptr s,
     // https://github.com/scylladb/scylla/issues/309
     // https://github.com/scylladb/scylla/issues/185
 
+    auto single_partition = query::is_single_partition(range);
     for (auto&& mt : *_memtables) {
+        if (single_partition && !mt->may_contain(range.start()->value())) {
+            continue;
+        }
         readers.emplace_back(mt->make_reader(s, range, slice, pc, trace_state, fwd, fwd_mr));
     }
 
-    if (_config.enable_cache) {
+    if (_config.enable_cache && !slice.options.contains(query::partition_slice::option::bypass_cache)) {
         readers.emplace_back(_cache.make_reader(s, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
     } else {
         readers.emplace_back(make_sstable_reader(s, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
@@ -668,24 +906,66 @@ column_family::make_streaming_reader(schema_ptr s,
 
 mutation_reader
 column_family::make_streaming_reader(schema_ptr s,
-                           const dht::partition_range_vector& ranges) const {
+                           const dht::partition_range_vector& ranges,
+                           const std::vector<sstables::shared_sstable>& excluded) const {
     auto& slice = query::full_slice;
     auto& pc = service::get_local_streaming_read_priority();
 
-    auto source = mutation_source([this] (schema_ptr s, const dht::partition_range& range, const query::partition_slice& slice,
+    auto sstables = _sstables;
+    if (!excluded.empty()) {
+        sstables = make_lw_shared<sstables::sstable_set>(*_sstables);
+        for (auto& sst : excluded) {
+            sstables->erase(sst);
+        }
+    }
+
+    auto source = mutation_source([this, sstables = std::move(sstables)] (schema_ptr s, const dht::partition_range& range, const query::partition_slice& slice,
                                       const io_priority_class& pc, tracing::trace_state_ptr trace_state, streamed_mutation::forwarding fwd, mutation_reader::forwarding fwd_mr) {
         std::vector<mutation_reader> readers;
         readers.reserve(_memtables->size() + 1);
         for (auto&& mt : *_memtables) {
             readers.emplace_back(mt->make_reader(s, range, slice, pc, trace_state, fwd, fwd_mr));
         }
-        readers.emplace_back(make_sstable_reader(s, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
+        readers.emplace_back(make_sstable_reader(s, sstables, range, slice, pc, std::move(trace_state), fwd, fwd_mr));
         return make_combined_reader(std::move(readers));
     });
 
     return make_multi_range_reader(s, std::move(source), ranges, slice, pc, nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::no);
 }
 
+mutation_reader
+column_family::make_streaming_reader(schema_ptr s,
+                           const dht::partition_range_vector& ranges,
+                           lw_shared_ptr<sstables::sstable_set> sstables) const {
+    auto& slice = query::full_slice;
+    auto& pc = service::get_local_streaming_read_priority();
+
+    auto source = mutation_source([this, sstables = std::move(sstables)] (schema_ptr s, const dht::partition_range& range, const query::partition_slice& slice,
+                                      const io_priority_class& pc, tracing::trace_state_ptr trace_state, streamed_mutation::forwarding fwd, mutation_reader::forwarding fwd_mr) {
+        return make_sstable_reader(s, sstables, range, slice, pc, std::move(trace_state), fwd, fwd_mr);
+    });
+
+    return make_multi_range_reader(s, std::move(source), ranges, slice, pc, nullptr, streamed_mutation::forwarding::no, mutation_reader::forwarding::no);
+}
+
+std::experimental::optional<std::vector<int64_t>>
+column_family::sstable_generations_for(const dht::partition_range_vector& ranges) const {
+    std::vector<int64_t> generations;
+    for (auto& range : ranges) {
+        for (auto&& mt : *_memtables) {
+            if (mt->has_partitions_in(range)) {
+                return std::experimental::nullopt;
+            }
+        }
+        for (auto&& sst : _sstables->select(range)) {
+            generations.push_back(sst->generation());
+        }
+    }
+    boost::sort(generations);
+    generations.erase(std::unique(generations.begin(), generations.end()), generations.end());
+    return generations;
+}
+
 future<std::vector<locked_cell>> column_family::lock_counter_cells(const mutation& m, timeout_clock::time_point timeout) {
     assert(m.schema() == _counter_cell_locks->schema());
     return _counter_cell_locks->lock_cells(m.decorated_key(), partition_cells_range(m.partition()), timeout);
@@ -788,10 +1068,20 @@ void column_family::update_stats_for_new_sstable(uint64_t disk_space_used_by_sst
     }
 }
 
+column_family::sstable_placement column_family::place_new_sstable(uint64_t estimated_size) {
+    if (!_config.data_placement || _config.extra_datadirs.empty()) {
+        return sstable_placement{_config.datadir, data_placement::write()};
+    }
+    auto write = _config.data_placement->place(estimated_size);
+    auto& dir = write.directory() ? _config.extra_datadirs[write.directory() - 1] : _config.datadir;
+    return sstable_placement{dir, std::move(write)};
+}
+
 void column_family::add_sstable(lw_shared_ptr<sstables::sstable> sstable, std::vector<unsigned>&& shards_for_the_sstable) {
     // allow in-progress reads to continue using old list
     _sstables = make_lw_shared(*_sstables);
     update_stats_for_new_sstable(sstable->bytes_on_disk(), std::move(shards_for_the_sstable));
+    sstable->set_read_ahead_stats(_read_ahead_stats);
     _sstables->insert(std::move(sstable));
 }
 
@@ -800,13 +1090,39 @@ column_family::update_cache(memtable& m, lw_shared_ptr<sstables::sstable_set> ol
     if (_config.enable_cache) {
        // be careful to use the old sstable list, since the new one will hit every
        // mutation in m.
-       return _cache.update(m, make_partition_presence_checker(std::move(old_sstables)));
+       return utils::run_in_task_group(utils::task_group::cache_update, [this, &m, old_sstables = std::move(old_sstables)] () mutable {
+           return _cache.update(m, make_partition_presence_checker(std::move(old_sstables)));
+       });
 
     } else {
        return m.clear_gently();
     }
 }
 
+future<>
+column_family::update_cache_from_streaming(memtable& m, lw_shared_ptr<sstables::sstable_set> old_sstables) {
+    if (_config.streaming_cache_update_policy == streaming_cache_policy::populate_if_present) {
+        // Partitions not in cache only make cache ranges around them incomplete.
+        return utils::run_in_task_group(utils::task_group::cache_update, [this, &m] {
+            return _cache.update(m, [] (const dht::decorated_key&) {
+                return partition_presence_checker_result::maybe_exists;
+            });
+        });
+    }
+    return update_cache(m, std::move(old_sstables));
+}
+
+column_family::streaming_cache_policy column_family::streaming_cache_policy_from_string(const sstring& name) {
+    if (name == "invalidate") {
+        return streaming_cache_policy::invalidate;
+    } else if (name == "update") {
+        return streaming_cache_policy::update;
+    } else if (name == "populate_if_present") {
+        return streaming_cache_policy::populate_if_present;
+    }
+    throw std::invalid_argument(sprint("Unknown streaming cache update policy: %s", name));
+}
+
 // FIXME: because we are coalescing, it could be that mutations belonging to the same
 // range end up in two different tables. Technically, we should wait for both. However,
 // the only way we have to make this happen now is to wait on all previous writes. This
@@ -851,9 +1167,10 @@ column_family::seal_active_streaming_memtable_immediate() {
         auto f = current_waiters.get_shared_future(); // for this seal
 
         with_lock(_sstables_lock.for_read(), [this, old] {
+            auto placement = make_lw_shared(place_new_sstable(old->occupancy().used_space()));
             auto newtab = make_lw_shared<sstables::sstable>(_schema,
-                _config.datadir, calculate_generation_for_new_table(),
-                sstables::sstable::version_types::ka,
+                placement->dir, calculate_generation_for_new_table(),
+                _config.sstable_format,
                 sstables::sstable::format_types::big);
 
             newtab->set_unshared();
@@ -865,19 +1182,32 @@ column_family::seal_active_streaming_memtable_immediate() {
             // If we ever need to, we'll keep them separate statistics, but we don't want to polute the
             // main stats about memtables with streaming memtables.
             //
-            // Second, we will not bother touching the cache after this flush. The current streaming code
-            // will invalidate the ranges it touches, so we won't do it twice. Even when that changes, the
-            // cache management code in here will have to differ from the main memtable's one. Please see
-            // the comment at flush_streaming_mutations() for details.
+            // Second, unless streaming_cache_update_policy says otherwise, we will not bother touching
+            // the cache after this flush. The streaming code will invalidate the ranges it touches, so we
+            // won't do it twice. Please see the comment at flush_streaming_mutations() for details.
             //
             // Lastly, we don't have any commitlog RP to update, and we don't need to deal manipulate the
             // memtable list, since this memtable was not available for reading up until this point.
             return newtab->write_components(*old, incremental_backups_enabled(), priority).then([this, newtab, old] {
                 return newtab->open_data();
-            }).then([this, old, newtab] () {
-                add_sstable(newtab, {engine().cpu_id()});
-                trigger_compaction();
-                return old->clear_gently();
+            }).then([this, old, newtab, placement] () {
+                placement->write.written(newtab->ondisk_data_size());
+                if (!_config.enable_cache || _config.streaming_cache_update_policy == streaming_cache_policy::invalidate) {
+                    add_sstable(newtab, {engine().cpu_id()});
+                    trigger_compaction();
+                    return old->clear_gently();
+                }
+                // Like for the main memtable, see try_flush_memtable_to_sstable().
+                return with_semaphore(_cache_update_sem, 1, [this, old, newtab] {
+                    auto old_sstables = _sstables;
+                    add_sstable(newtab, {engine().cpu_id()});
+                    old->mark_flushed(newtab->as_mutation_source());
+                    trigger_compaction();
+                    return update_cache_from_streaming(*old, std::move(old_sstables)).handle_exception([newtab] (auto ep) {
+                        // The cache invalidates what it failed to update.
+                        dblog.error("failed to move streamed memtable for {} to cache: {}", newtab->get_filename(), ep);
+                    });
+                });
             }).handle_exception([old] (auto ep) {
                 dblog.error("failed to write streamed sstable: {}", ep);
                 return make_exception_future<>(ep);
@@ -906,15 +1236,18 @@ future<> column_family::seal_active_streaming_memtable_big(streaming_memtable_bi
     return with_gate(_streaming_flush_gate, [this, old, &smb] {
         return with_gate(smb.flush_in_progress, [this, old, &smb] {
             return with_lock(_sstables_lock.for_read(), [this, old, &smb] {
+                auto placement = make_lw_shared(place_new_sstable(old->occupancy().used_space()));
                 auto newtab = make_lw_shared<sstables::sstable>(_schema,
-                                                                _config.datadir, calculate_generation_for_new_table(),
-                                                                sstables::sstable::version_types::ka,
+                                                                placement->dir, calculate_generation_for_new_table(),
+                                                                _config.sstable_format,
                                                                 sstables::sstable::format_types::big);
 
                 newtab->set_unshared();
 
                 auto&& priority = service::get_local_streaming_write_priority();
-                return newtab->write_components(*old, incremental_backups_enabled(), priority, true).then([this, newtab, old, &smb] {
+                return newtab->write_components(*old, incremental_backups_enabled(), priority, true).then([this, newtab, old, &smb, placement] {
+                    // The sstable isn't opened yet, so the placement only
+                    // accounts for it while it's being written.
                     smb.sstables.emplace_back(newtab);
                 }).handle_exception([] (auto ep) {
                     dblog.error("failed to write streamed sstable: {}", ep);
@@ -950,7 +1283,9 @@ column_family::seal_active_memtable(memtable_list::flush_behavior ignored) {
       return repeat([this, old] {
         return with_lock(_sstables_lock.for_read(), [this, old] {
             _flush_queue->check_open_gate();
-            return try_flush_memtable_to_sstable(old);
+            return utils::run_in_task_group(utils::task_group::memtable_flush, [this, old] {
+                return try_flush_memtable_to_sstable(old);
+            });
         });
       }).then([this, memtable_size] {
         _config.cf_stats->pending_memtables_flushes_count--;
@@ -968,10 +1303,11 @@ column_family::seal_active_memtable(memtable_list::flush_behavior ignored) {
 future<stop_iteration>
 column_family::try_flush_memtable_to_sstable(lw_shared_ptr<memtable> old) {
     auto gen = calculate_generation_for_new_table();
+    auto placement = make_lw_shared(place_new_sstable(old->occupancy().used_space()));
 
     auto newtab = make_lw_shared<sstables::sstable>(_schema,
-        _config.datadir, gen,
-        sstables::sstable::version_types::ka,
+        placement->dir, gen,
+        _config.sstable_format,
         sstables::sstable::format_types::big);
 
     newtab->set_unshared();
@@ -990,10 +1326,11 @@ column_family::try_flush_memtable_to_sstable(lw_shared_ptr<memtable> old) {
     auto&& priority = service::get_local_memtable_flush_priority();
     return newtab->write_components(*old, incremental_backups_enabled(), priority).then([this, newtab, old] {
         return newtab->open_data();
-    }).then_wrapped([this, old, newtab] (future<> ret) {
+    }).then_wrapped([this, old, newtab, placement] (future<> ret) {
         dblog.debug("Flushing to {} done", newtab->get_filename());
         try {
             ret.get();
+            placement->write.written(newtab->ondisk_data_size());
 
             // Cache updates are serialized because partition_presence_checker
             // is using data source snapshot created before the update starts, so that
@@ -1121,6 +1458,34 @@ distributed_loader::flush_upload_dir(distributed<database>& db, sstring ks_name,
     });
 }
 
+future<std::vector<sstables::entry_descriptor>>
+distributed_loader::get_upload_dir_sstables(distributed<database>& db, sstring ks_name, sstring cf_name) {
+    auto& cf = db.local().find_column_family(ks_name, cf_name);
+    auto descriptors = make_lw_shared<std::vector<sstables::entry_descriptor>>();
+    return lister::scan_dir(lister::path(cf._config.datadir) / "upload", { directory_entry_type::regular },
+            [descriptors] (lister::path parent_dir, directory_entry de) {
+        auto comps = sstables::entry_descriptor::make_descriptor(de.name);
+        if (comps.component == sstables::sstable::component_type::TOC) {
+            descriptors->push_back(std::move(comps));
+        }
+        return make_ready_future<>();
+    }, &column_family::manifest_json_filter).then([descriptors] {
+        return std::move(*descriptors);
+    });
+}
+
+future<> distributed_loader::remove_upload_dir_sstables(distributed<database>& db, sstring ks_name, sstring cf_name,
+        std::vector<sstables::entry_descriptor> sstables) {
+    auto& cf = db.local().find_column_family(ks_name, cf_name);
+    auto dir = cf._config.datadir + "/upload";
+    return do_with(std::move(sstables), [&cf, dir = std::move(dir)] (auto& sstables) {
+        return parallel_for_each(sstables, [&cf, &dir] (const sstables::entry_descriptor& comps) {
+            auto sst = make_lw_shared<sstables::sstable>(cf.schema(), dir, comps.generation, comps.version, comps.format);
+            return sstables::remove_by_toc_name(sst->toc_filename(), error_handler_for_upload_dir());
+        });
+    });
+}
+
 future<std::vector<sstables::entry_descriptor>>
 column_family::reshuffle_sstables(std::set<int64_t> all_generations, int64_t start) {
     struct work {
@@ -1188,16 +1553,50 @@ void column_family::set_metrics() {
     _metrics.add_group("column_family", {
             ms::make_histogram("read_latency", ms::description("Read latency histogram"), [this] {return _stats.estimated_read.get_histogram();})(cf)(ks),
             ms::make_histogram("write_latency", ms::description("Write latency histogram"), [this] {return _stats.estimated_write.get_histogram();})(cf)(ks),
+            ms::make_histogram("read_admission_latency", ms::description("Histogram of the time reads waited for memory for their results"), [this] {return _stats.estimated_read_admission.get_histogram();})(cf)(ks),
+            ms::make_histogram("read_execution_latency", ms::description("Histogram of the time reads spent reading and merging data from memtables, cache and sstables"), [this] {return _stats.estimated_read_execution.get_histogram();})(cf)(ks),
+            ms::make_histogram("read_serialization_latency", ms::description("Histogram of the time reads spent building their results"), [this] {return _stats.estimated_read_serialization.get_histogram();})(cf)(ks),
+            ms::make_histogram("write_commitlog_latency", ms::description("Histogram of the time writes spent being appended to the commitlog"), [this] {return _stats.estimated_write_commitlog.get_histogram();})(cf)(ks),
+            ms::make_histogram("memtable_flush_queue_time", ms::description("Histogram of the time memtable flushes waited to start, in microseconds"), [this] {return _memtables->get_flush_stats().queue_time.get_histogram();})(cf)(ks),
+            ms::make_histogram("memtable_flush_latency", ms::description("Histogram of the time memtable flushes took, in microseconds"), [this] {return _memtables->get_flush_stats().latency.get_histogram();})(cf)(ks),
             ms::make_derive("memtable_switch", ms::description("Number of times flush has resulted in the memtable being switched out"), _stats.memtable_switch_count)(cf)(ks),
             ms::make_gauge("pending_taks", ms::description("Estimated number of tasks pending for this column family"), _stats.pending_flushes)(cf)(ks),
             ms::make_gauge("live_disk_space", ms::description("Live disk space used"), _stats.live_disk_space_used)(cf)(ks),
             ms::make_gauge("total_disk_space", ms::description("Total disk space used"), _stats.total_disk_space_used)(cf)(ks),
             ms::make_gauge("live_sstable", ms::description("Live sstable count"), _stats.live_sstable_count)(cf)(ks),
-            ms::make_gauge("pending_compaction", ms::description("Estimated number of compactions pending for this column family"), _stats.pending_compactions)(cf)(ks)
+            ms::make_gauge("pending_compaction", ms::description("Estimated number of compactions pending for this column family"), _stats.pending_compactions)(cf)(ks),
+            ms::make_derive("read_ahead_bytes", ms::description("Bytes read from the data files of the sstables of this column family"), [this] {return _read_ahead_stats->bytes_read;})(cf)(ks),
+            ms::make_derive("read_ahead_wasted_bytes", ms::description("Bytes read ahead from the data files of the sstables of this column family which were skipped over or never consumed"), [this] {return _read_ahead_stats->wasted_bytes;})(cf)(ks),
+            ms::make_derive("sequential_sstable_reads", ms::description("Number of data file reads of this column family detected as scans, which read ahead"), [this] {return _read_ahead_stats->sequential_readers;})(cf)(ks)
     });
+    if (_write_admission) {
+        _metrics.add_group("column_family", {
+                ms::make_histogram("write_admission_wait", ms::description("Histogram of the time writes waited for dirty memory, in microseconds"), [this] {return _write_admission->wait_time().get_histogram();})(cf)(ks),
+                ms::make_gauge("writes_blocked_memory", ms::description("Number of writes currently blocked on dirty memory"), [this] {return _write_admission->blocked_requests();})(cf)(ks)
+        });
+    }
+    if (_schema->is_view()) {
+        _metrics.add_group("column_family", {
+                ms::make_derive("view_update_messages", ms::description("Number of messages the updates of this view were sent to its paired replicas in"), _stats.view_update_messages)(cf)(ks),
+                ms::make_histogram("view_update_fanout", ms::description("Histogram of the number of messages the updates of this view from a single base write were sent in"), [this] {return _stats.view_update_fanout.get_histogram();})(cf)(ks)
+        });
+    }
     if (_schema->ks_name() != db::system_keyspace::NAME) {
         _metrics.add_group("column_family", {
-                ms::make_gauge("cache_hit_rate", ms::description("Cache hit rate"), [this] {return float(_global_cache_hit_rate);})(cf)(ks)
+                ms::make_gauge("cache_hit_rate", ms::description("Cache hit rate"), [this] {return float(_global_cache_hit_rate);})(cf)(ks),
+                ms::make_gauge("cache_partitions", ms::description("Number of partitions of this column family in cache"), [this] {return _cache.cached_partitions();})(cf)(ks),
+                ms::make_derive("cache_evictions", ms::description("Number of partitions of this column family evicted from cache"), [this] {return _cache.evictions();})(cf)(ks),
+                ms::make_gauge("cache_eviction_weight", ms::description("Eviction weight of this column family in cache"), [this] {return _cache.eviction_weight();})(cf)(ks),
+                ms::make_derive("rate_limited_reads", ms::description("Number of reads of this column family rejected by its per-partition rate limit"), _stats.rate_limited_reads)(cf)(ks),
+                ms::make_derive("rate_limited_writes", ms::description("Number of writes to this column family rejected by its per-partition rate limit"), _stats.rate_limited_writes)(cf)(ks),
+                ms::make_gauge("key_cache_hit_rate", ms::description("Key cache hit rate of the partition reads from the live sstables of this column family"), [this] {
+                    uint64_t hits = 0, misses = 0;
+                    for (auto&& sst : *get_sstables()) {
+                        hits += sst->get_key_cache().hits();
+                        misses += sst->get_key_cache().misses();
+                    }
+                    return hits + misses ? float(hits) / (hits + misses) : 0.0f;
+                })(cf)(ks)
         });
     }
 }
@@ -1223,15 +1622,16 @@ column_family::rebuild_sstable_list(const std::vector<sstables::shared_sstable>&
     // Build a new list of _sstables: We remove from the existing list the
     // tables we compacted (by now, there might be more sstables flushed
     // later), and we add the new tables generated by the compaction.
-    // We create a new list rather than modifying it in-place, so that
-    // on-going reads can continue to use the old list.
+    // We change a copy of the list rather than the list itself, so that
+    // on-going reads can continue to use the old list. The copy shares
+    // most of its structure with the old list, so it's cheap.
     //
     // We only remove old sstables after they are successfully deleted,
     // to avoid a new compaction from ignoring data in the old sstables
     // if the deletion fails (note deletion of shared sstables can take
     // unbounded time, because all shards must agree on the deletion).
-    auto current_sstables = _sstables;
-    auto new_sstable_list = _compaction_strategy.make_sstable_set(_schema);
+    auto current_sstables = _sstables->all();
+    auto new_sstable_list = *_sstables;
     auto new_compacted_but_not_deleted = _sstables_compacted_but_not_deleted;
 
 
@@ -1239,18 +1639,21 @@ column_family::rebuild_sstable_list(const std::vector<sstables::shared_sstable>&
            sstables_to_remove.begin(), sstables_to_remove.end());
 
     // First, add the new sstables.
-
-    // this might seem dangerous, but "move" here just avoids constness,
-    // making the two ranges compatible when compiling with boost 1.55.
-    // Noone is actually moving anything...
-    for (auto&& tab : boost::range::join(new_sstables, std::move(*current_sstables->all()))) {
-        // Checks if oldtab is a sstable not being compacted.
+    for (auto&& tab : new_sstables) {
+        tab->set_read_ahead_stats(_read_ahead_stats);
+        // Checks if tab is a sstable not being compacted.
         if (!s.count(tab)) {
             new_sstable_list.insert(tab);
         } else {
             new_compacted_but_not_deleted.push_back(tab);
         }
     }
+    for (auto&& tab : s) {
+        if (current_sstables->count(tab)) {
+            new_sstable_list.erase(tab);
+            new_compacted_but_not_deleted.push_back(tab);
+        }
+    }
     _sstables = make_lw_shared(std::move(new_sstable_list));
     _sstables_compacted_but_not_deleted = std::move(new_compacted_but_not_deleted);
 
@@ -1330,22 +1733,78 @@ column_family::compact_sstables(sstables::compaction_descriptor descriptor, bool
         return make_ready_future<>();
     }
 
-    return with_lock(_sstables_lock.for_read(), [this, descriptor = std::move(descriptor), cleanup] {
-        auto sstables_to_compact = make_lw_shared<std::vector<sstables::shared_sstable>>(std::move(descriptor.sstables));
-
-        auto create_sstable = [this] {
+    return with_lock(_sstables_lock.for_read(), [this, descriptor = std::move(descriptor), cleanup] () mutable {
+        uint64_t input_size = 0;
+        for (auto& sst : descriptor.sstables) {
+            input_size += sst->data_size();
+        }
+        auto estimated_size = std::min(input_size, descriptor.max_sstable_bytes);
+        // Compacting cold sstables together keeps them cold.
+        auto output_dir = descriptor.output_dir;
+        if (output_dir.empty() && !_config.cold_datadir.empty() && boost::algorithm::all_of(descriptor.sstables, [this] (auto& sst) {
+            return sst->get_dir() == _config.cold_datadir;
+        })) {
+            output_dir = _config.cold_datadir;
+        }
+        // Each output goes to the data directory picked for it when it's created.
+        auto outputs = make_lw_shared<std::vector<std::pair<sstables::shared_sstable, data_placement::write>>>();
+        auto create_sstable = [this, outputs, estimated_size, output_dir] {
                 auto gen = this->calculate_generation_for_new_table();
+                auto placement = output_dir.empty() ? this->place_new_sstable(estimated_size)
+                        : sstable_placement{output_dir, data_placement::write()};
                 // FIXME: use "tmp" marker in names of incomplete sstable
-                auto sst = make_lw_shared<sstables::sstable>(_schema, _config.datadir, gen,
-                        sstables::sstable::version_types::ka,
+                auto sst = make_lw_shared<sstables::sstable>(_schema, placement.dir, gen,
+                        _config.sstable_format,
                         sstables::sstable::format_types::big);
                 sst->set_unshared();
+                outputs->emplace_back(sst, std::move(placement.write));
                 return sst;
         };
-        return sstables::compact_sstables(*sstables_to_compact, *this, create_sstable, descriptor.max_sstable_bytes, descriptor.level,
-                cleanup).then([this, sstables_to_compact] (auto new_sstables) {
-            _compaction_strategy.notify_completion(*sstables_to_compact, new_sstables);
-            return this->rebuild_sstable_list(new_sstables, *sstables_to_compact);
+        // The compaction replaces its input incrementally, so that the space
+        // of exhausted input sstables is reclaimed while it still runs.
+        auto replacer = [this, release_exhausted = std::move(descriptor.release_exhausted)] (std::vector<sstables::shared_sstable> removed,
+                std::vector<sstables::shared_sstable> added) {
+            _compaction_strategy.notify_completion(removed, added);
+            this->rebuild_sstable_list(added, removed);
+            if (release_exhausted) {
+                release_exhausted(removed);
+            }
+        };
+        if (!cleanup) {
+            // Fully expired sstables hold nothing a compaction would write, so
+            // rather than being read and rewritten, they are just deleted.
+            // Finding them is expensive, so it's up to the strategy, which
+            // looks for them only every once in a while.
+            auto expired = std::move(descriptor.expired);
+            if (!expired.empty()) {
+                dblog.info("Dropping {} fully expired sstable(s) of {}.{}", expired.size(), _schema->ks_name(), _schema->cf_name());
+                std::unordered_set<sstables::shared_sstable> s(expired.begin(), expired.end());
+                descriptor.sstables.erase(boost::range::remove_if(descriptor.sstables, [&s] (auto& sst) {
+                    return s.count(sst);
+                }), descriptor.sstables.end());
+                replacer(std::move(expired), {});
+            }
+            if (descriptor.sstables.empty()) {
+                return make_ready_future<>();
+            }
+        }
+        auto max_sstable_bytes = std::min(descriptor.max_sstable_bytes, _compaction_strategy.fragment_size());
+        for (auto& sst : descriptor.sstables) {
+            _stats.compaction_bytes_read += sst->data_size();
+        }
+        return utils::run_in_task_group(utils::task_group::compaction, [&] {
+            return sstables::compact_sstables(std::move(descriptor.sstables), *this, create_sstable, max_sstable_bytes, descriptor.level,
+                    cleanup, std::move(replacer), _compaction_strategy.make_output_splitter());
+        }).then([this, outputs] (std::vector<sstables::shared_sstable> new_sstables) {
+            for (auto& sst : new_sstables) {
+                _stats.compaction_bytes_written += sst->data_size();
+            }
+            std::unordered_set<sstables::shared_sstable> written(new_sstables.begin(), new_sstables.end());
+            for (auto& output : *outputs) {
+                if (written.count(output.first)) {
+                    output.second.written(output.first->ondisk_data_size());
+                }
+            }
         });
     });
 }
@@ -1430,7 +1889,7 @@ void column_family::set_compaction_strategy(sstables::compaction_strategy_type s
 }
 
 size_t column_family::sstables_count() const {
-    return _sstables->all()->size();
+    return _sstables->size();
 }
 
 std::vector<uint64_t> column_family::sstable_count_per_level() const {
@@ -1527,7 +1986,8 @@ future<> distributed_loader::open_sstable(distributed<database>& db, sstables::e
     return db.invoke_on(column_family::calculate_shard_from_sstable_generation(comps.generation),
             [&db, comps = std::move(comps), func = std::move(func), pc] (database& local) {
 
-        return with_semaphore(local.sstable_load_concurrency_sem(), 1, [&db, &local, comps = std::move(comps), func = std::move(func), pc] {
+        return local.sstable_load_concurrency().wait().then([&db, &local, comps = std::move(comps), func = std::move(func), pc] {
+          return futurize_apply([&db, &local, comps = std::move(comps), func = std::move(func), pc] {
             auto& cf = local.find_column_family(comps.ks, comps.cf);
 
             auto f = sstables::sstable::load_shared_components(cf.schema(), cf._config.datadir, comps.generation, comps.version, comps.format, pc);
@@ -1541,10 +2001,53 @@ future<> distributed_loader::open_sstable(distributed<database>& db, sstables::e
                     });
                 });
             });
+          }).finally([&local] {
+            local.sstable_load_concurrency().signal();
+          });
         });
     });
 }
 
+void sstable_load_concurrency_controller::signal() {
+    if (_excess) {
+        --_excess;
+    } else {
+        _sem.signal();
+    }
+    if (++_loads_in_window >= 2 * _concurrency) {
+        adjust();
+    }
+}
+
+// Hill climbing: keeps changing the concurrency in the same direction while
+// the throughput of the loads improves, and turns around when it drops.
+void sstable_load_concurrency_controller::adjust() {
+    auto now = clock::now();
+    auto elapsed = std::chrono::duration<double>(now - _window_start).count();
+    auto throughput = _loads_in_window / std::max(elapsed, 1e-6);
+    _loads_in_window = 0;
+    _window_start = now;
+    if (!_sem.waiters()) {
+        // Loads didn't queue up, so the throughput says nothing about the disk.
+        return;
+    }
+    if (throughput < _last_throughput * 0.95) {
+        _increasing = !_increasing;
+    }
+    _last_throughput = throughput;
+    if (_increasing && _concurrency < max_concurrency) {
+        ++_concurrency;
+        if (_excess) {
+            --_excess;
+        } else {
+            _sem.signal();
+        }
+    } else if (!_increasing && _concurrency > 1) {
+        --_concurrency;
+        ++_excess;
+    }
+}
+
 // global_column_family_ptr provides a way to easily retrieve local instance of a given column family.
 class global_column_family_ptr {
     distributed<database>& _db;
@@ -1573,7 +2076,8 @@ load_sstables_with_open_info(std::vector<sstables::foreign_sstable_open_info> ss
             if (!pred(info)) {
                 return make_ready_future<>();
             }
-            auto sst = make_lw_shared<sstables::sstable>(s, dir, info.generation, info.version, info.format);
+            // With several data directories, the sstable may not be in the first one.
+            auto sst = make_lw_shared<sstables::sstable>(s, info.dir.empty() ? dir : info.dir, info.generation, info.version, info.format);
             return sst->load(std::move(info)).then([&ssts, sst] {
                 ssts.push_back(std::move(sst));
                 return make_ready_future<>();
@@ -1646,16 +2150,24 @@ static future<> forward_sstables_to(shard_id shard, std::vector<sstables::shared
 }
 
 // invokes each descriptor at its target shard, which involves forwarding sstables too.
+// Each job's compaction is visible, as of type RESHARD, through the compaction manager
+// of its shard while it runs, and the completion of every job is logged.
 template <typename Func>
 static future<> invoke_all_resharding_jobs(global_column_family_ptr cf, std::vector<sstables::resharding_descriptor> jobs, Func&& func) {
-    return parallel_for_each(std::move(jobs), [cf, func] (sstables::resharding_descriptor& job) mutable {
-        return forward_sstables_to(job.reshard_at, std::move(job.sstables), cf,
+    auto total = jobs.size();
+    auto completed = make_lw_shared<size_t>(0);
+    return parallel_for_each(std::move(jobs), [cf, func, total, completed] (sstables::resharding_descriptor& job) mutable {
+        auto shard = job.reshard_at;
+        return forward_sstables_to(shard, std::move(job.sstables), cf,
                 [func, level = job.level, max_sstable_bytes = job.max_sstable_bytes] (auto sstables) {
             // used to ensure that only one reshard operation will run per shard.
             static thread_local semaphore sem(1);
             return with_semaphore(sem, 1, [func, sstables = std::move(sstables), level, max_sstable_bytes] () mutable {
                 return func(std::move(sstables), level, max_sstable_bytes);
             });
+        }).then([cf, shard, total, completed] {
+            dblog.info("Resharding of {}.{}: job at shard {} done, {} out of {} jobs completed",
+                cf->schema()->ks_name(), cf->schema()->cf_name(), shard, ++*completed, total);
         });
     });
 }
@@ -1695,18 +2207,28 @@ void distributed_loader::reshard(distributed<database>& db, sstring ks_name, sst
             auto candidates = get_all_shared_sstables(db, cf).get0();
             dblog.debug("{} candidates for resharding for {}.{}", candidates.size(), cf->schema()->ks_name(), cf->schema()->cf_name());
             auto jobs = cf->get_compaction_strategy().get_resharding_jobs(*cf, std::move(candidates));
-            dblog.debug("{} resharding jobs for {}.{}", jobs.size(), cf->schema()->ks_name(), cf->schema()->cf_name());
+            std::vector<uint64_t> bytes_per_shard(smp::count, 0);
+            for (auto& job : jobs) {
+                for (auto& sst : job.sstables) {
+                    bytes_per_shard[job.reshard_at] += sst->data_size();
+                }
+            }
+            dblog.info("Resharding {}.{}: {} jobs spread across {} shards, bytes per shard: [{}]", cf->schema()->ks_name(),
+                cf->schema()->cf_name(), jobs.size(), smp::count, ::join(", ", bytes_per_shard));
 
             invoke_all_resharding_jobs(cf, std::move(jobs), [&cf] (auto sstables, auto level, auto max_sstable_bytes) {
-                auto creator = [&cf] (shard_id shard) mutable {
+                auto creator = [&cf, max_sstable_bytes] (shard_id shard) mutable {
                     // we need generation calculated by instance of cf at requested shard,
                     // or resource usage wouldn't be fairly distributed among shards.
-                    auto gen = smp::submit_to(shard, [&cf] () {
-                        return cf->calculate_generation_for_new_table();
+                    // The same goes for the data directory, though the write isn't
+                    // accounted for there, since it's done from another shard.
+                    auto gen_and_dir = smp::submit_to(shard, [&cf, max_sstable_bytes] () {
+                        return std::make_pair(cf->calculate_generation_for_new_table(), cf->place_new_sstable(max_sstable_bytes).dir);
                     }).get0();
+                    auto gen = gen_and_dir.first;
 
-                    auto sst = make_lw_shared<sstables::sstable>(cf->schema(), cf->dir(), gen,
-                        sstables::sstable::version_types::ka, sstables::sstable::format_types::big,
+                    auto sst = make_lw_shared<sstables::sstable>(cf->schema(), gen_and_dir.second, gen,
+                        cf->sstable_format(), sstables::sstable::format_types::big,
                         gc_clock::now(), default_io_error_handler_gen());
                     return sst;
                 };
@@ -1789,7 +2311,11 @@ future<> distributed_loader::load_new_sstables(distributed<database>& db, sstrin
             cf._sstables_opened_but_not_loaded.clear();
             cf.trigger_compaction();
             // Drop entire cache for this column family because it may be populated
-            // with stale data.
+            // with stale data. The new sstables may carry local counter shards
+            // too, e.g. when restoring a backup.
+            if (auto ccache = cf.get_counter_shard_cache()) {
+                ccache->clear();
+            }
             return cf.get_row_cache().clear();
         });
     }).then([&db, ks, cf] () mutable {
@@ -1967,26 +2493,84 @@ future<> distributed_loader::populate_column_family(distributed<database>& db, s
 
 utils::UUID database::empty_version = utils::UUID_gen::get_name_UUID(bytes{});
 
+size_t database::max_memory_concurrent_reads() {
+    return memory::stats().total_memory() * 0.02;
+}
+
+size_t database::max_memory_system_concurrent_reads() {
+    return memory::stats().total_memory() * 0.002;
+}
+
 database::database() : database(db::config())
 {}
 
 database::database(const db::config& cfg)
     : _stats(make_lw_shared<db_stats>())
     , _cl_stats(std::make_unique<cell_locker_stats>())
+    , _counter_cache_tracker(std::make_unique<counter_shard_cache_tracker>(size_t(cfg.counter_cache_size_in_mb()) * 1024 * 1024 / smp::count))
     , _cfg(std::make_unique<db::config>(cfg))
     // Allow system tables a pool of 10 MB memory to write, but never block on other regions.
     , _system_dirty_memory_manager(*this, 10 << 20, cfg.virtual_dirty_soft_limit())
-    , _dirty_memory_manager(*this, memory::stats().total_memory() * 0.45, cfg.virtual_dirty_soft_limit())
+    , _dirty_memory_manager(*this, memory::stats().total_memory() * 0.45, cfg.virtual_dirty_soft_limit(), cfg.memtable_flush_writers())
     , _streaming_dirty_memory_manager(*this, memory::stats().total_memory() * 0.10, cfg.virtual_dirty_soft_limit())
     , _version(empty_version)
+    , _memtable_controller(make_flush_controller(cfg))
+    , _compaction_controller(make_compaction_controller(cfg))
     , _enable_incremental_backups(cfg.incremental_backups())
 {
     _compaction_manager.start();
+    _read_concurrency_sem.set_evict_an_inactive_reader([this] { return _querier_cache.evict_one(); });
+    _system_read_concurrency_sem.set_evict_an_inactive_reader([this] { return _querier_cache.evict_one(); });
+    sstables::key_cache::set_shard_capacity(size_t(cfg.key_cache_size_in_mb()) * 1024 * 1024 / smp::count);
+    if (cfg.index_summary_capacity_in_mb() && cfg.index_summary_resize_interval_in_minutes() != std::numeric_limits<uint32_t>::max()) {
+        _index_summary_manager = std::make_unique<index_summary_manager>(size_t(cfg.index_summary_capacity_in_mb()) * 1024 * 1024 / smp::count,
+                std::chrono::minutes(std::max(1u, cfg.index_summary_resize_interval_in_minutes())), [this] {
+            std::vector<sstables::shared_sstable> ret;
+            for (auto& cf : _column_families) {
+                auto ssts = cf.second->get_sstables();
+                ret.insert(ret.end(), ssts->begin(), ssts->end());
+            }
+            return ret;
+        });
+    }
+    if (cfg.data_file_directories().size() > 1) {
+        _data_placement = std::make_unique<data_placement>(cfg.data_file_directories(), std::chrono::seconds(10));
+    }
     setup_metrics();
+    utils::set_task_group_queue_length(utils::task_group::memtable_flush, [this] {
+        return _system_dirty_memory_manager.waiting_flushes() + _dirty_memory_manager.waiting_flushes()
+                + _streaming_dirty_memory_manager.waiting_flushes();
+    });
 
     dblog.info("Row: max_vector_size: {}, internal_count: {}", size_t(row::max_vector_size), size_t(row::internal_count));
 }
 
+std::unique_ptr<flush_controller>
+database::make_flush_controller(const db::config& cfg) {
+    auto& iop = service::get_local_memtable_flush_priority();
+    if (cfg.memtable_flush_static_shares() > 0) {
+        return std::make_unique<flush_controller>(iop, cfg.memtable_flush_static_shares());
+    }
+    return std::make_unique<flush_controller>(iop, cfg.virtual_dirty_soft_limit(), [this] {
+        return float(_dirty_memory_manager.virtual_dirty_memory()) / _dirty_memory_manager.throttle_threshold();
+    });
+}
+
+std::unique_ptr<compaction_controller>
+database::make_compaction_controller(const db::config& cfg) {
+    auto& iop = service::get_local_compaction_priority();
+    auto& group = sstables::compaction_scheduling_group();
+    if (cfg.compaction_static_shares() > 0) {
+        return std::make_unique<compaction_controller>(iop, group, cfg.compaction_static_shares());
+    }
+    return std::make_unique<compaction_controller>(iop, group, [this] {
+        double backlog = 0;
+        for (auto& cf : _column_families) {
+            backlog += cf.second->get_compaction_strategy().backlog(*cf.second);
+        }
+        return float(backlog / _dirty_memory_manager.throttle_threshold());
+    });
+}
 
 void
 dirty_memory_manager::setup_collectd(sstring namestr) {
@@ -2029,6 +2613,14 @@ database::setup_metrics() {
         sm::make_gauge("pending_flushes_bytes", _cf_stats.pending_memtables_flushes_bytes,
                        sm::description("Holds the current number of bytes in memtables that are currently being flushed to sstables. "
                                        "High value in this mertic may be an indication of storage being a bottleneck.")),
+
+        sm::make_gauge("flush_shares", [this] { return _memtable_controller->current_shares(); },
+                       sm::description("Holds the current I/O shares of memtable flushes, as set by their controller.")),
+    });
+
+    _metrics.add_group("compaction_manager", {
+        sm::make_gauge("shares", [this] { return _compaction_controller->current_shares(); },
+                       sm::description("Holds the current I/O shares of compactions, as set by their controller.")),
     });
 
     _metrics.add_group("database", {
@@ -2055,6 +2647,9 @@ database::setup_metrics() {
                        sm::description("Counts sstables that survived the clustering key filtering. "
                                        "High value indicates that bloom filter is not very efficient and still have to access a lot of sstables to get data.")),
 
+        sm::make_derive("timestamp_filter_skipped_sstables", _cf_stats.sstables_skipped_by_timestamp,
+                       sm::description("Counts sstables not read by reads naming their rows, because the rows read from newer sstables were newer than all their data.")),
+
         sm::make_derive("total_writes", _stats->total_writes,
                        sm::description("Counts the total number of successful write operations performed by this shard.")),
 
@@ -2072,11 +2667,14 @@ database::setup_metrics() {
                        sm::description("Counts the total number of failed read operations. "
                                        "Add the total_reads to this value to get the total amount of reads issued on this shard.")),
 
+        sm::make_derive("reads_bypassing_cache", _stats->reads_bypassing_cache,
+                       sm::description("Counts the reads which bypassed the cache (BYPASS CACHE), reading from memtables and sstables without populating it.")),
+
         sm::make_derive("sstable_read_queue_overloads", _stats->sstable_read_queue_overloaded,
                        sm::description("Counts the number of times the sstable read queue was overloaded. "
                                        "A non-zero value indicates that we have to drop read requests because they arrive faster than we can serve them.")),
 
-        sm::make_gauge("active_reads", [this] { return max_concurrent_reads() - _read_concurrency_sem.current(); },
+        sm::make_gauge("active_reads", [this] { return max_concurrent_reads() - _read_concurrency_sem.available_resources().count; },
                        sm::description(seastar::format("Holds the number of currently active read operations. "
                                                        "If this vlaue gets close to {} we are likely to start dropping new read requests. "
                                                        "In that case sstable_read_queue_overloads is going to get a non-zero value.", max_concurrent_reads()))),
@@ -2084,7 +2682,11 @@ database::setup_metrics() {
         sm::make_gauge("queued_reads", [this] { return _read_concurrency_sem.waiters(); },
                        sm::description("Holds the number of currently queued read operations.")),
 
-        sm::make_gauge("active_reads_system_keyspace", [this] { return max_system_concurrent_reads() - _system_read_concurrency_sem.current(); },
+        sm::make_gauge("reads_memory_consumption", [this] { return ssize_t(max_memory_concurrent_reads()) - _read_concurrency_sem.available_resources().memory; },
+                       sm::description(seastar::format("Holds the amount of memory consumed by the buffers of the currently active read operations. "
+                                                       "If this value gets close to {} new read operations are queued.", max_memory_concurrent_reads()))),
+
+        sm::make_gauge("active_reads_system_keyspace", [this] { return max_system_concurrent_reads() - _system_read_concurrency_sem.available_resources().count; },
                        sm::description(seastar::format("Holds the number of currently active read operations from \"system\" keyspace tables. "
                                                        "If this vlaue gets close to {} we are likely to start dropping new read requests. "
                                                        "In that case sstable_read_queue_overloads is going to get a non-zero value.", max_system_concurrent_reads()))),
@@ -2092,6 +2694,9 @@ database::setup_metrics() {
         sm::make_gauge("queued_reads_system_keyspace", [this] { return _system_read_concurrency_sem.waiters(); },
                        sm::description("Holds the number of currently queued read operations from \"system\" keyspace tables.")),
 
+        sm::make_gauge("reads_memory_consumption_system_keyspace", [this] { return ssize_t(max_memory_system_concurrent_reads()) - _system_read_concurrency_sem.available_resources().memory; },
+                       sm::description("Holds the amount of memory consumed by the buffers of the currently active read operations from \"system\" keyspace tables.")),
+
         sm::make_gauge("total_result_bytes", [this] { return get_result_memory_limiter().total_used_memory(); },
                        sm::description("Holds the current amount of memory used for results.")),
 
@@ -2110,6 +2715,7 @@ database::setup_metrics() {
 }
 
 database::~database() {
+    utils::set_task_group_queue_length(utils::task_group::memtable_flush, {});
 }
 
 void database::update_version(const utils::UUID& version) {
@@ -2137,10 +2743,21 @@ future<> distributed_loader::populate_keyspace(distributed<database>& db, sstrin
                 utils::UUID uuid = s->id();
                 lw_shared_ptr<column_family> cf = column_families[uuid];
                 sstring cfname = cf->schema()->cf_name();
-                auto sstdir = ks.column_family_directory(cfname, uuid);
+                auto sstdirs = ks.column_family_directories(cfname, uuid);
+                auto colddir = ks.cold_column_family_directory(cfname, uuid);
+                if (!colddir.empty()) {
+                    sstdirs.push_back(std::move(colddir));
+                }
+                auto sstdir = ::join(", ", sstdirs);
                 dblog.info("Keyspace {}: Reading CF {} ", ks_name, cfname);
-                return ks.make_directory_for_column_family(cfname, uuid).then([&db, sstdir, uuid, ks_name, cfname] {
-                    return distributed_loader::populate_column_family(db, sstdir, ks_name, cfname);
+                return ks.make_directory_for_column_family(cfname, uuid).then([&db, sstdirs = std::move(sstdirs), ks_name, cfname] {
+                    // The sstables of the table are spread across all data directories,
+                    // the cold one included.
+                    return do_with(std::move(sstdirs), [&db, ks_name, cfname] (const std::vector<sstring>& sstdirs) {
+                        return do_for_each(sstdirs, [&db, ks_name, cfname] (const sstring& sstdir) {
+                            return distributed_loader::populate_column_family(db, sstdir, ks_name, cfname);
+                        });
+                    });
                 }).handle_exception([ks_name, cfname, sstdir](std::exception_ptr eptr) {
                     std::string msg =
                         sprint("Exception while populating keyspace '%s' with column family '%s' from file '%s': %s",
@@ -2254,12 +2871,13 @@ future<> distributed_loader::init_system_keyspace(distributed<database>& db) {
             db::system_keyspace::make(db, durable, cfg.volatile_system_keyspace_for_testing());
         }).get();
 
-        // FIXME support multiple directories
         const auto& cfg = db.local().get_config();
         auto data_dir = cfg.data_file_directories()[0];
 
         for (auto ksname : system_keyspaces) {
-            io_check(touch_directory, data_dir + "/" + ksname).get();
+            for (auto& dir : cfg.data_file_directories()) {
+                io_check(touch_directory, dir + "/" + ksname).get();
+            }
             distributed_loader::populate_keyspace(db, data_dir, ksname).get();
 
             db.invoke_on_all([ksname] (database& db) {
@@ -2424,6 +3042,7 @@ future<> database::drop_column_family(const sstring& ks_name, const sstring& cf_
     auto uuid = find_uuid(ks_name, cf_name);
     auto cf = _column_families.at(uuid);
     remove(*cf);
+    _querier_cache.evict_all_for_table(uuid);
     auto& ks = find_keyspace(ks_name);
     return truncate(ks, *cf, std::move(tsf)).then([this, cf] {
         return cf->stop();
@@ -2555,6 +3174,10 @@ column_family::config
 keyspace::make_column_family_config(const schema& s, const db::config& db_config) const {
     column_family::config cfg;
     cfg.datadir = column_family_directory(s.cf_name(), s.id());
+    auto dirs = column_family_directories(s.cf_name(), s.id());
+    cfg.extra_datadirs.assign(dirs.begin() + 1, dirs.end());
+    cfg.data_placement = _config.data_placement;
+    cfg.cold_datadir = cold_column_family_directory(s.cf_name(), s.id());
     cfg.enable_disk_reads = _config.enable_disk_reads;
     cfg.enable_disk_writes = _config.enable_disk_writes;
     cfg.enable_commitlog = _config.enable_commitlog;
@@ -2564,8 +3187,15 @@ keyspace::make_column_family_config(const schema& s, const db::config& db_config
     cfg.read_concurrency_config = _config.read_concurrency_config;
     cfg.streaming_read_concurrency_config = _config.streaming_read_concurrency_config;
     cfg.cf_stats = _config.cf_stats;
+    cfg.write_admission_group = _config.write_admission_group;
+    cfg.counter_cache_tracker = _config.counter_cache_tracker;
     cfg.enable_incremental_backups = _config.enable_incremental_backups;
     cfg.max_cached_partition_size_in_bytes = db_config.max_cached_partition_size_in_kb() * 1024;
+    cfg.streaming_cache_update_policy = column_family::streaming_cache_policy_from_string(db_config.streaming_cache_update_policy());
+    cfg.streaming_write_to_sstables = db_config.streaming_write_to_sstables();
+    sstring sstable_format = db_config.sstable_format();
+    cfg.sstable_format = sstables::sstable::version_from_sstring(sstable_format);
+    cfg.max_concurrent_compactions = db_config.compaction_max_concurrent_per_table();
 
     return cfg;
 }
@@ -2577,12 +3207,44 @@ keyspace::column_family_directory(const sstring& name, utils::UUID uuid) const {
     return sprint("%s/%s-%s", _config.datadir, name, uuid_sstring);
 }
 
+std::vector<sstring>
+keyspace::column_family_directories(const sstring& name, utils::UUID uuid) const {
+    auto cfdir = column_family_directory(name, uuid);
+    std::vector<sstring> ret{cfdir};
+    // Same name, under the keyspace directory of each data directory.
+    auto cfname = cfdir.substr(_config.datadir.size());
+    for (auto& ksdir : _config.extra_datadirs) {
+        ret.push_back(ksdir + cfname);
+    }
+    return ret;
+}
+
+sstring
+keyspace::cold_column_family_directory(const sstring& name, utils::UUID uuid) const {
+    if (_config.cold_datadir.empty()) {
+        return "";
+    }
+    auto cfdir = column_family_directory(name, uuid);
+    return _config.cold_datadir + cfdir.substr(_config.datadir.size());
+}
+
 future<>
 keyspace::make_directory_for_column_family(const sstring& name, utils::UUID uuid) {
-    auto cfdir = column_family_directory(name, uuid);
-    return seastar::async([cfdir = std::move(cfdir)] {
-        io_check(touch_directory, cfdir).get();
-        io_check(touch_directory, cfdir + "/upload").get();
+    auto cfdirs = column_family_directories(name, uuid);
+    auto colddir = cold_column_family_directory(name, uuid);
+    return seastar::async([this, cfdirs = std::move(cfdirs), colddir = std::move(colddir)] {
+        // Sstables are uploaded to the first data directory only.
+        io_check(touch_directory, cfdirs[0]).get();
+        io_check(touch_directory, cfdirs[0] + "/upload").get();
+        for (unsigned i = 1; i < cfdirs.size(); ++i) {
+            // The data directory may have been added after the keyspace was created.
+            io_check(touch_directory, _config.extra_datadirs[i - 1]).get();
+            io_check(touch_directory, cfdirs[i]).get();
+        }
+        if (!colddir.empty()) {
+            io_check(touch_directory, _config.cold_datadir).get();
+            io_check(touch_directory, colddir).get();
+        }
     });
 }
 
@@ -2660,9 +3322,15 @@ database::create_keyspace(const lw_shared_ptr<keyspace_metadata>& ksm) {
     }
 
     create_in_memory_keyspace(ksm);
-    auto& datadir = _keyspaces.at(ksm->name()).datadir();
-    if (datadir != "") {
-        return io_check(touch_directory, datadir);
+    auto& ks = _keyspaces.at(ksm->name());
+    if (ks.datadir() != "") {
+        return io_check(touch_directory, ks.datadir()).then([&ks] {
+            return parallel_for_each(ks.extra_datadirs(), [] (const sstring& dir) {
+                return io_check(touch_directory, dir);
+            }).then([&ks] {
+                return ks.cold_datadir().empty() ? make_ready_future<>() : io_check(touch_directory, ks.cold_datadir());
+            });
+        });
     } else {
         return make_ready_future<>();
     }
@@ -2725,21 +3393,34 @@ struct query_state {
                          const query::read_command& cmd,
                          query::result_request request,
                          const dht::partition_range_vector& ranges,
-                         query::result_memory_accounter memory_accounter = { })
+                         query::result_memory_accounter memory_accounter = { },
+                         query::digest_algorithm da = query::digest_algorithm::MD5)
             : schema(std::move(s))
             , cmd(cmd)
-            , builder(cmd.slice, request, std::move(memory_accounter))
+            , builder(cmd.slice, request, std::move(memory_accounter), da)
             , limit(cmd.row_limit)
             , partition_limit(cmd.partition_limit)
+            , ranges_begin(ranges.begin())
             , current_partition_range(ranges.begin())
             , range_end(ranges.end()){
+        // Only the values of the selected columns make it into the result,
+        // so the readers needn't build the others. Counter cells can't do
+        // without their value.
+        auto& slice = cmd.slice;
+        if (!schema->is_counter() && (slice.regular_columns.size() < schema->regular_columns_count()
+                || slice.static_columns.size() < schema->static_columns_count())) {
+            projected_slice.emplace(slice);
+            projected_slice->set_project_columns(true);
+        }
     }
     schema_ptr schema;
     const query::read_command& cmd;
+    stdx::optional<query::partition_slice> projected_slice;
     query::result::builder builder;
     uint32_t limit;
     uint32_t partition_limit;
     bool range_empty = false;   // Avoid ubsan false-positive when moving after construction
+    dht::partition_range_vector::const_iterator ranges_begin;
     dht::partition_range_vector::const_iterator current_partition_range;
     dht::partition_range_vector::const_iterator range_end;
     mutation_reader reader;
@@ -2752,36 +3433,126 @@ struct query_state {
     bool done() const {
         return !remaining_rows() || !remaining_partitions() || current_partition_range == range_end || builder.is_short_read();
     }
+    // The slice to read with.
+    const query::partition_slice& reader_slice() const {
+        return projected_slice ? *projected_slice : cmd.slice;
+    }
 };
 
+static void add_stage_latency(utils::estimated_histogram& h, utils::latency_counter::time_point start, utils::latency_counter::time_point end) {
+    h.add(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
 future<lw_shared_ptr<query::result>>
 column_family::query(schema_ptr s, const query::read_command& cmd, query::result_request request,
                      const dht::partition_range_vector& partition_ranges,
                      tracing::trace_state_ptr trace_state, query::result_memory_limiter& memory_limiter,
-                     uint64_t max_size) {
+                     uint64_t max_size, timeout_clock::time_point timeout, query::querier_cache* cache,
+                     query::digest_algorithm da) {
     utils::latency_counter lc;
     _stats.reads.set_latency(lc);
+    auto start = lc.is_start() ? utils::latency_counter::now() : utils::latency_counter::time_point();
+    if (_partition_sampler) {
+        for (auto&& pr : partition_ranges) {
+            if (pr.is_singular() && pr.start()->value().has_key()) {
+                _partition_sampler->reads.append(*pr.start()->value().key());
+            }
+        }
+    }
+    if (_rate_limiter) {
+        // Only reads of single partitions are limited, scans aren't
+        // attributed to any partition.
+        for (auto&& pr : partition_ranges) {
+            if (pr.is_singular() && pr.start()->value().has_key()
+                    && !_rate_limiter->account(db::per_partition_rate_limiter::op_type::read, *pr.start()->value().key())) {
+                ++_stats.rate_limited_reads;
+                return make_exception_future<lw_shared_ptr<query::result>>(
+                        exceptions::rate_limit_exception(_schema->ks_name(), _schema->cf_name(), "reads"));
+            }
+        }
+    }
     auto f = request == query::result_request::only_digest
              ? memory_limiter.new_digest_read(max_size) : memory_limiter.new_data_read(max_size);
-    return f.then([this, lc, s = std::move(s), &cmd, request, &partition_ranges, trace_state = std::move(trace_state)] (query::result_memory_accounter accounter) mutable {
-        auto qs_ptr = std::make_unique<query_state>(std::move(s), cmd, request, partition_ranges, std::move(accounter));
+    return f.then([this, lc, start, s = std::move(s), &cmd, request, &partition_ranges, trace_state = std::move(trace_state), timeout, cache, da] (query::result_memory_accounter accounter) mutable {
+        // The read may have waited for memory for long.
+        if (reader_timed_out(timeout)) {
+            return make_exception_future<lw_shared_ptr<query::result>>(timed_out_error());
+        }
+        auto admitted = start;
+        if (lc.is_start()) {
+            admitted = utils::latency_counter::now();
+            add_stage_latency(_stats.estimated_read_admission, start, admitted);
+        }
+        auto qs_ptr = std::make_unique<query_state>(std::move(s), cmd, request, partition_ranges, std::move(accounter), da);
         auto& qs = *qs_ptr;
-        return do_until(std::bind(&query_state::done, &qs), [this, &qs, trace_state = std::move(trace_state)] {
+        if (!cache || qs.cmd.query_uuid == utils::UUID()) {
+            cache = nullptr;
+        }
+        return do_until(std::bind(&query_state::done, &qs), [this, &qs, trace_state = std::move(trace_state), timeout, cache] {
+            auto first = qs.current_partition_range == qs.ranges_begin;
             auto&& range = *qs.current_partition_range++;
-            return data_query(qs.schema, as_mutation_source(), range, qs.cmd.slice, qs.remaining_rows(),
-                              qs.remaining_partitions(), qs.cmd.timestamp, qs.builder, trace_state);
-        }).then([qs_ptr = std::move(qs_ptr), &qs] {
-            return make_ready_future<lw_shared_ptr<query::result>>(
-                    make_lw_shared<query::result>(qs.builder.build()));
+            auto& pc = service::get_local_sstable_query_read_priority(qs.cmd.workload);
+            if (!cache) {
+                return data_query(qs.schema, as_mutation_source(), range, qs.reader_slice(), qs.remaining_rows(),
+                                  qs.remaining_partitions(), qs.cmd.timestamp, qs.builder, trace_state, pc, timeout,
+                                  reversed_read_window_splitter(pc));
+            }
+            // Paged queries resume the reads of the previous page, which
+            // ended in the first range of this one, and keep the reads of
+            // the range this page ends in for the next one.
+            auto q = first && !qs.cmd.is_first_page
+                    ? cache->lookup(qs.cmd.query_uuid, *qs.schema, range, qs.reader_slice())
+                    : stdx::optional<query::querier>();
+            if (!q) {
+                q.emplace(as_mutation_source(), qs.schema, range, qs.reader_slice(), qs.cmd.timestamp, pc, trace_state,
+                        reversed_read_window_splitter(pc));
+            }
+            return do_with(std::move(*q), [&qs, timeout, cache] (query::querier& q) {
+                return q.consume_page(qs.builder, qs.remaining_rows(), qs.remaining_partitions(), timeout).then([&qs, &q, cache] {
+                    if (qs.done() && !q.is_exhausted()) {
+                        cache->insert(qs.cmd.query_uuid, std::move(q));
+                    }
+                });
+            });
+        }).then([this, lc, admitted, qs_ptr = std::move(qs_ptr), &qs] {
+            if (!lc.is_start()) {
+                return make_ready_future<lw_shared_ptr<query::result>>(
+                        make_lw_shared<query::result>(qs.builder.build()));
+            }
+            auto executed = utils::latency_counter::now();
+            add_stage_latency(_stats.estimated_read_execution, admitted, executed);
+            auto result = make_lw_shared<query::result>(qs.builder.build());
+            add_stage_latency(_stats.estimated_read_serialization, executed, utils::latency_counter::now());
+            return make_ready_future<lw_shared_ptr<query::result>>(std::move(result));
         }).finally([lc, this]() mutable {
             _stats.reads.mark(lc);
             if (lc.is_start()) {
                 _stats.estimated_read.add(lc.latency(), _stats.reads.hist.count);
+                _stats.read_latency.add(lc.latency(), _stats.reads.hist.count);
             }
         });
     });
 }
 
+future<std::vector<clustering_key_prefix>>
+column_family::get_partition_window_starts(const dht::decorated_key& dk, const io_priority_class& pc) const {
+    auto sstables = _sstables->select(dht::partition_range::make_singular(dk));
+    return do_with(std::move(sstables), std::vector<clustering_key_prefix>(), [&dk, &pc] (auto& sstables, auto& starts) {
+        // Cutting at the blocks of every sstable would make the windows as
+        // small as the blocks of all of them together, and each window costs
+        // a lookup in all of them.
+        return parallel_for_each(sstables, [&dk, &pc, &starts] (const sstables::shared_sstable& sst) {
+            return sst->get_promoted_index_block_starts(dk, pc).then([&starts] (std::vector<clustering_key_prefix> sst_starts) {
+                if (sst_starts.size() > starts.size()) {
+                    starts = std::move(sst_starts);
+                }
+            });
+        }).then([&starts] {
+            return std::move(starts);
+        });
+    });
+}
+
 mutation_source
 column_family::as_mutation_source() const {
     return mutation_source([this] (schema_ptr s,
@@ -2799,11 +3570,12 @@ static thread_local auto data_query_stage = seastar::make_execution_stage("data_
 
 future<lw_shared_ptr<query::result>, cache_temperature>
 database::query(schema_ptr s, const query::read_command& cmd, query::result_request request, const dht::partition_range_vector& ranges, tracing::trace_state_ptr trace_state,
-                uint64_t max_result_size) {
+                uint64_t max_result_size, timeout_clock::time_point timeout, query::digest_algorithm da) {
     column_family& cf = find_column_family(cmd.cf_id);
     return data_query_stage(&cf, std::move(s), seastar::cref(cmd), request, seastar::cref(ranges),
                             std::move(trace_state), seastar::ref(get_result_memory_limiter()),
-                            max_result_size).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate()] (auto f) {
+                            max_result_size, timeout, &_querier_cache, da).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate(),
+                bypass_cache = cmd.slice.options.contains(query::partition_slice::option::bypass_cache)] (auto f) {
         if (f.failed()) {
             ++s->total_reads_failed;
             return make_exception_future<lw_shared_ptr<query::result>, cache_temperature>(f.get_exception());
@@ -2811,6 +3583,7 @@ database::query(schema_ptr s, const query::read_command& cmd, query::result_requ
             ++s->total_reads;
             auto result = f.get0();
             s->short_data_queries += bool(result->is_short_read());
+            s->reads_bypassing_cache += bypass_cache;
             return make_ready_future<lw_shared_ptr<query::result>, cache_temperature>(std::move(result), hit_rate);
         }
     });
@@ -2818,10 +3591,12 @@ database::query(schema_ptr s, const query::read_command& cmd, query::result_requ
 
 future<reconcilable_result, cache_temperature>
 database::query_mutations(schema_ptr s, const query::read_command& cmd, const dht::partition_range& range,
-                          query::result_memory_accounter&& accounter, tracing::trace_state_ptr trace_state) {
+                          query::result_memory_accounter&& accounter, tracing::trace_state_ptr trace_state,
+                          timeout_clock::time_point timeout) {
     column_family& cf = find_column_family(cmd.cf_id);
     return mutation_query(std::move(s), cf.as_mutation_source(), range, cmd.slice, cmd.row_limit, cmd.partition_limit,
-            cmd.timestamp, std::move(accounter), std::move(trace_state)).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate()] (auto f) {
+            cmd.timestamp, std::move(accounter), std::move(trace_state), service::get_local_sstable_query_read_priority(cmd.workload), timeout).then_wrapped([this, s = _stats, hit_rate = cf.get_global_cache_hit_rate(),
+                bypass_cache = cmd.slice.options.contains(query::partition_slice::option::bypass_cache)] (auto f) {
         if (f.failed()) {
             ++s->total_reads_failed;
             return make_exception_future<reconcilable_result, cache_temperature>(f.get_exception());
@@ -2829,6 +3604,7 @@ database::query_mutations(schema_ptr s, const query::read_command& cmd, const dh
             ++s->total_reads;
             auto result = f.get0();
             s->short_mutation_queries += bool(result.is_short_read());
+            s->reads_bypassing_cache += bypass_cache;
             return make_ready_future<reconcilable_result, cache_temperature>(std::move(result), hit_rate);
         }
     });
@@ -2873,9 +3649,10 @@ bool database::is_replacing() {
 
 void database::register_connection_drop_notifier(netw::messaging_service& ms) {
     ms.register_connection_drop_notifier([this] (gms::inet_address ep) {
-        dblog.debug("Drop hit rate info for {} because of disconnect", ep);
+        dblog.debug("Drop hit rate and read latency info for {} because of disconnect", ep);
         for (auto&& cf : get_non_system_column_families()) {
             cf->drop_hit_rate(ep);
+            cf->drop_replica_read_latency(ep);
         }
     });
 }
@@ -2921,19 +3698,62 @@ void column_family::do_apply(db::rp_handle&& h, Args&&... args) {
     _stats.writes.mark(lc);
     if (lc.is_start()) {
         _stats.estimated_write.add(lc.latency(), _stats.writes.hist.count);
+        _stats.write_latency.add(lc.latency(), _stats.writes.hist.count);
     }
 }
 
 void
 column_family::apply(const mutation& m, db::rp_handle&& h) {
+    if (_partition_sampler) {
+        _partition_sampler->writes.append(m.key());
+    }
+    if (_counter_shard_cache) {
+        _counter_shard_cache->invalidate(m);
+    }
     do_apply(std::move(h), m);
 }
 
 void
 column_family::apply(const frozen_mutation& m, const schema_ptr& m_schema, db::rp_handle&& h) {
+    if (_partition_sampler) {
+        _partition_sampler->writes.append(partition_key(m.key(*m_schema)));
+    }
+    if (_counter_shard_cache) {
+        _counter_shard_cache->invalidate(m, *m_schema);
+    }
     do_apply(std::move(h), m, m_schema);
 }
 
+void column_family::start_partition_sampling(size_t capacity) {
+    if (_partition_sampler) {
+        throw std::runtime_error(sprint("Partitions of %s.%s are being sampled already", _schema->ks_name(), _schema->cf_name()));
+    }
+    _partition_sampler = std::make_unique<partition_sampler>(_schema, capacity);
+}
+
+void column_family::account_write_for_rate_limit(const partition_key& key) {
+    if (_rate_limiter && !_rate_limiter->account(db::per_partition_rate_limiter::op_type::write, key)) {
+        ++_stats.rate_limited_writes;
+        throw exceptions::rate_limit_exception(_schema->ks_name(), _schema->cf_name(), "writes");
+    }
+}
+
+column_family::sampled_partitions column_family::rate_limit_offenders(size_t list_size) const {
+    if (!_rate_limiter) {
+        return { };
+    }
+    auto offenders = _rate_limiter->top_offenders(list_size);
+    return { std::move(offenders.reads), std::move(offenders.writes) };
+}
+
+column_family::sampled_partitions column_family::stop_partition_sampling(size_t list_size) {
+    if (!_partition_sampler) {
+        return { };
+    }
+    auto sampler = std::move(_partition_sampler);
+    return { sampler->reads.top(list_size), sampler->writes.top(list_size) };
+}
+
 future<mutation> database::do_apply_counter_update(column_family& cf, const frozen_mutation& fm, schema_ptr m_schema,
                                                    timeout_clock::time_point timeout,tracing::trace_state_ptr trace_state) {
     auto m = fm.unfreeze(m_schema);
@@ -2972,19 +3792,39 @@ future<mutation> database::do_apply_counter_update(column_family& cf, const froz
             locks = std::move(lcs);
 
             // Before counter update is applied it needs to be transformed from
-            // deltas to counter shards. To do that, we need to read the current
-            // counter state for each modified cell...
-
-            tracing::trace(trace_state, "Reading counter values from the CF");
-            return counter_write_query(m_schema, cf.as_mutation_source(), m.decorated_key(), slice, trace_state)
-                    .then([this, &cf, &m, m_schema, timeout, trace_state] (auto mopt) {
-                // ...now, that we got existing state of all affected counter
-                // cells we can look for our shard in each of them, increment
-                // its clock and apply the delta.
-                transform_counter_updates_to_shards(m, mopt ? &*mopt : nullptr, cf.failed_counter_applies_to_memtable());
+            // deltas to counter shards. To do that, we need the current local
+            // shard of each modified cell. The ones this shard updated recently
+            // are cached, otherwise we need to read the current counter state...
+
+            auto ccache = cf.get_counter_shard_cache();
+            auto transformed = make_ready_future<>();
+            if (ccache && ccache->transform_counter_updates_to_shards(m, cf.failed_counter_applies_to_memtable())) {
+                tracing::trace(trace_state, "Counter shards found in the counter cache");
+            } else {
+                tracing::trace(trace_state, "Reading counter values from the CF");
+                transformed = counter_write_query(m_schema, cf.as_mutation_source(), m.decorated_key(), slice, trace_state)
+                        .then([&cf, &m] (auto mopt) {
+                    // ...now, that we got existing state of all affected counter
+                    // cells we can look for our shard in each of them, increment
+                    // its clock and apply the delta.
+                    transform_counter_updates_to_shards(m, mopt ? &*mopt : nullptr, cf.failed_counter_applies_to_memtable());
+                });
+            }
+            return transformed.then([this, &cf, &m, timeout, trace_state] {
                 tracing::trace(trace_state, "Applying counter update");
                 return this->apply_with_commitlog(cf, m, timeout);
-            }).then([&m] {
+            }).then_wrapped([&cf, &m] (future<> f) {
+                // The cell locks are still held, so no other update of these
+                // cells can have been transformed in the meantime.
+                if (auto ccache = cf.get_counter_shard_cache()) {
+                    if (f.failed()) {
+                        // The update may have been partially applied.
+                        ccache->invalidate(m.key());
+                    } else {
+                        ccache->store(m);
+                    }
+                }
+                f.get();
                 return std::move(m);
             });
         });
@@ -3025,6 +3865,7 @@ db::replay_position column_family::set_low_replay_position_mark() {
 future<> dirty_memory_manager::shutdown() {
     _db_shutdown_requested = true;
     _should_flush.signal();
+    _flush_done.broadcast();
     return std::move(_waiting_flush).then([this] {
         return _region_group.shutdown();
     });
@@ -3035,10 +3876,11 @@ future<> memtable_list::request_flush() {
         return make_ready_future<>();
     } else if (!_flush_coalescing) {
         _flush_coalescing = shared_promise<>();
-        return _dirty_memory_manager->get_flush_permit().then([this] (auto permit) {
+        auto queued_at = utils::latency_counter::now();
+        return _dirty_memory_manager->get_flush_permit().then([this, queued_at] (auto permit) {
             auto current_flush = std::move(*_flush_coalescing);
             _flush_coalescing = {};
-            return _dirty_memory_manager->flush_one(*this, std::move(permit)).then_wrapped([this, current_flush = std::move(current_flush)] (auto f) mutable {
+            return _dirty_memory_manager->flush_one(*this, std::move(permit), queued_at).then_wrapped([this, current_flush = std::move(current_flush)] (auto f) mutable {
                 if (f.failed()) {
                     current_flush.set_exception(f.get_exception());
                 } else {
@@ -3055,7 +3897,7 @@ lw_shared_ptr<memtable> memtable_list::new_memtable() {
     return make_lw_shared<memtable>(_current_schema(), *_dirty_memory_manager, this);
 }
 
-future<> dirty_memory_manager::flush_one(memtable_list& mtlist, semaphore_units<> permit) {
+future<> dirty_memory_manager::flush_one(memtable_list& mtlist, semaphore_units<> permit, utils::latency_counter::time_point queued_at) {
     if (mtlist.back()->empty()) {
         return make_ready_future<>();
     }
@@ -3063,9 +3905,11 @@ future<> dirty_memory_manager::flush_one(memtable_list& mtlist, semaphore_units<
     auto* region = &(mtlist.back()->region());
     auto schema = mtlist.back()->schema();
 
+    auto started = utils::latency_counter::now();
+    add_stage_latency(mtlist.get_flush_stats().queue_time, queued_at, started);
     add_to_flush_manager(region, std::move(permit));
-    return get_units(_background_work_flush_serializer, 1).then([this, &mtlist, region, schema] (auto permit) mutable {
-        return mtlist.seal_active_memtable(memtable_list::flush_behavior::immediate).then_wrapped([this, region, schema, permit = std::move(permit)] (auto f) {
+    return get_units(_background_work_flush_serializer, 1).then([this, &mtlist, region, schema, started] (auto permit) mutable {
+        return mtlist.seal_active_memtable(memtable_list::flush_behavior::immediate).then_wrapped([this, &mtlist, region, schema, started, permit = std::move(permit)] (auto f) {
             // There are two cases in which we may still need to remove the permits from here.
             //
             // 1) Some exception happenend, and we can't know at which point. It could be that because
@@ -3076,6 +3920,8 @@ future<> dirty_memory_manager::flush_one(memtable_list& mtlist, semaphore_units<
             this->remove_from_flush_manager(region);
             if (f.failed()) {
                 dblog.error("Failed to flush memtable, {}:{}", schema->ks_name(), schema->cf_name());
+            } else {
+                add_stage_latency(mtlist.get_flush_stats().latency, started, utils::latency_counter::now());
             }
             return std::move(f);
         });
@@ -3090,7 +3936,8 @@ future<> dirty_memory_manager::flush_when_needed() {
     return do_until([this] { return _db_shutdown_requested; }, [this] {
         auto has_work = [this] { return has_pressure() || _db_shutdown_requested; };
         return _should_flush.wait(std::move(has_work)).then([this] {
-            return get_flush_permit().then([this] (auto permit) {
+            auto queued_at = utils::latency_counter::now();
+            return get_flush_permit().then([this, queued_at] (auto permit) {
                 // We give priority to explicit flushes. They are mainly user-initiated flushes,
                 // flushes coming from a DROP statement, or commitlog flushes.
                 if (_flush_serializer.waiters()) {
@@ -3108,12 +3955,27 @@ future<> dirty_memory_manager::flush_when_needed() {
                 // memtable. The advantage of doing this is that this is objectively the one that will
                 // release the biggest amount of memory and is less likely to be generating tiny
                 // SSTables.
-                memtable& candidate_memtable = memtable::from_region(*(this->_region_group.get_largest_region()));
+                //
+                // When several flushes may run at once, the largest memtable may be the one we are
+                // flushing already, so we pick the largest one of those which are not.
+                auto candidate_region = this->_region_group.get_largest_region([] (logalloc::region& r) {
+                    auto& mt = memtable::from_region(r);
+                    return !dirty_memory_manager::from_region_group(mt.region_group()).is_being_flushed(&r);
+                });
+                if (!candidate_region) {
+                    // Everything is being flushed. Flushing again wouldn't release anything but
+                    // tiny memtables, so wait for one of the flushes to be done instead.
+                    if (_flush_manager.empty()) {
+                        return make_ready_future<>();
+                    }
+                    return _flush_done.wait();
+                }
+                memtable& candidate_memtable = memtable::from_region(*candidate_region);
                 dirty_memory_manager* candidate_dirty_manager = &(dirty_memory_manager::from_region_group(candidate_memtable.region_group()));
                 // Do not wait. The semaphore will protect us against a concurrent flush. But we
                 // want to start a new one as soon as the permits are destroyed and the semaphore is
                 // made ready again, not when we are done with the current one.
-                candidate_dirty_manager->flush_one(*(candidate_memtable.get_memtable_list()), std::move(permit));
+                candidate_dirty_manager->flush_one(*(candidate_memtable.get_memtable_list()), std::move(permit), queued_at);
                 return make_ready_future<>();
             });
         });
@@ -3131,8 +3993,23 @@ void dirty_memory_manager::start_reclaiming() noexcept {
     _should_flush.signal();
 }
 
+// Writes to a table are admitted in its own class, with their size as the
+// cost, so that large writes to one table don't hold up the writes to others.
+template <typename Func>
+static future<> run_write_when_memory_available(logalloc::region_group& rg, column_family* cf, size_t size,
+        Func&& func, lowres_clock::time_point timeout) {
+    auto cls = cf ? cf->write_admission_class() : nullptr;
+    if (cls && &cls->group() == &rg) {
+        return rg.run_when_memory_available(*cls, size, std::forward<Func>(func), timeout);
+    }
+    return rg.run_when_memory_available(std::forward<Func>(func), timeout);
+}
+
 future<> database::apply_in_memory(const frozen_mutation& m, schema_ptr m_schema, db::rp_handle&& h, timeout_clock::time_point timeout) {
-    return _dirty_memory_manager.region_group().run_when_memory_available([this, &m, m_schema = std::move(m_schema), h = std::move(h)]() mutable {
+    auto i = _column_families.find(m.column_family_id());
+    auto cf = i != _column_families.end() ? i->second.get() : nullptr;
+    return run_write_when_memory_available(_dirty_memory_manager.region_group(), cf, m.representation().size(),
+            [this, &m, m_schema = std::move(m_schema), h = std::move(h)]() mutable {
         try {
             auto& cf = find_column_family(m.column_family_id());
             cf.apply(m, m_schema, std::move(h));
@@ -3143,7 +4020,10 @@ future<> database::apply_in_memory(const frozen_mutation& m, schema_ptr m_schema
 }
 
 future<> database::apply_in_memory(const mutation& m, column_family& cf, db::rp_handle&& h, timeout_clock::time_point timeout) {
-    return _dirty_memory_manager.region_group().run_when_memory_available([this, &m, &cf, h = std::move(h)]() mutable {
+    memory_footprint size;
+    size.add(m.partition());
+    return run_write_when_memory_available(_dirty_memory_manager.region_group(), &cf, size.total(),
+            [this, &m, &cf, h = std::move(h)]() mutable {
         cf.apply(m, std::move(h));
     }, timeout);
 }
@@ -3155,6 +4035,9 @@ future<mutation> database::apply_counter_update(schema_ptr s, const frozen_mutat
     }
     try {
         auto& cf = find_column_family(m.column_family_id());
+        if (cf.has_rate_limit()) {
+            cf.account_write_for_rate_limit(m.key(*s));
+        }
         return do_apply_counter_update(cf, m, s, timeout, std::move(trace_state));
     } catch (no_such_column_family&) {
         dblog.error("Attempting to mutate non-existent table {}", m.column_family_id());
@@ -3190,7 +4073,11 @@ future<> database::apply_with_commitlog(schema_ptr s, column_family& cf, utils::
     auto cl = cf.commitlog();
     if (cl != nullptr) {
         commitlog_entry_writer cew(s, m);
-        return cf.commitlog()->add_entry(uuid, cew, timeout).then([&m, this, s, timeout, cl](db::rp_handle h) {
+        auto start = cf.get_stats().writes.hist.should_sample() ? utils::latency_counter::now() : utils::latency_counter::time_point();
+        return cf.commitlog()->add_entry(uuid, cew, timeout).then([&m, &cf, this, s, timeout, cl, start](db::rp_handle h) {
+            if (start.time_since_epoch().count()) {
+                cf.add_write_commitlog_latency(utils::latency_counter::now() - start);
+            }
             return this->apply_in_memory(m, s, std::move(h), timeout).handle_exception([this, s, &m, timeout] (auto ep) {
                 try {
                     std::rethrow_exception(ep);
@@ -3219,6 +4106,9 @@ future<> database::do_apply(schema_ptr s, const frozen_mutation& m, timeout_cloc
         throw std::runtime_error(sprint("attempted to mutate using not synced schema of %s.%s, version=%s",
                                  s->ks_name(), s->cf_name(), s->version()));
     }
+    if (cf.has_rate_limit()) {
+        cf.account_write_for_rate_limit(m.key(*s));
+    }
     if (cf.views().empty()) {
         return apply_with_commitlog(std::move(s), cf, std::move(uuid), m, timeout);
     }
@@ -3254,11 +4144,77 @@ future<> database::apply(schema_ptr s, const frozen_mutation& m, timeout_clock::
     });
 }
 
+future<> database::apply(schema_ptr s, const std::vector<const frozen_mutation*>& ms, timeout_clock::time_point timeout) {
+    if (ms.size() == 1) {
+        return apply(std::move(s), *ms.front(), timeout);
+    }
+    auto& cf = find_column_family(s->id());
+    // View updates are generated from each mutation, with the base row it
+    // is applied to. Rate limited mutations are rejected one by one.
+    if (!s->is_synced() || !cf.views().empty() || cf.has_rate_limit()) {
+        return parallel_for_each(ms, [this, s, timeout] (const frozen_mutation* m) {
+            return apply(s, *m, timeout);
+        });
+    }
+    auto handles = make_lw_shared<std::vector<db::rp_handle>>(ms.size());
+    auto f = make_ready_future<>();
+    if (auto cl = cf.commitlog()) {
+        f = parallel_for_each(boost::irange<size_t>(0, ms.size()), [cl, s, &ms, handles, timeout] (size_t i) {
+            commitlog_entry_writer cew(s, *ms[i]);
+            return cl->add_entry(s->id(), cew, timeout).then([handles, i] (db::rp_handle h) {
+                (*handles)[i] = std::move(h);
+            });
+        });
+    }
+    auto reordered = make_lw_shared<std::vector<size_t>>();
+    return f.then([this, s, &ms, &cf, handles, reordered, timeout] {
+        size_t size = 0;
+        for (auto m : ms) {
+            size += m->representation().size();
+        }
+        return run_write_when_memory_available(_dirty_memory_manager.region_group(), &cf, size,
+                [&ms, &cf, s, handles, reordered] {
+            for (size_t i = 0; i < ms.size(); ++i) {
+                try {
+                    cf.apply(*ms[i], s, std::move((*handles)[i]));
+                } catch (replay_position_reordered_exception&) {
+                    reordered->push_back(i);
+                }
+            }
+        }, timeout);
+    }).then([this, s, &ms, reordered, timeout] {
+        // See apply_with_commitlog().
+        return parallel_for_each(*reordered, [this, s, &ms, timeout] (size_t i) {
+            dblog.debug("replay_position reordering detected");
+            return this->apply(s, *ms[i], timeout);
+        });
+    }).then_wrapped([this, stats = _stats, n = ms.size()] (future<> f) {
+        if (f.failed()) {
+            stats->total_writes_failed += n;
+            try {
+                f.get();
+            } catch (const timed_out_error&) {
+                stats->total_writes_timedout += n;
+                throw;
+            }
+            assert(0 && "should not reach");
+        }
+        stats->total_writes += n;
+        return f;
+    });
+}
+
 future<> database::apply_streaming_mutation(schema_ptr s, utils::UUID plan_id, const frozen_mutation& m, bool fragmented) {
     if (!s->is_synced()) {
         throw std::runtime_error(sprint("attempted to mutate using not synced schema of %s.%s, version=%s",
                                  s->ks_name(), s->cf_name(), s->version()));
     }
+    auto& cf = find_column_family(m.column_family_id());
+    if (cf.writes_streaming_mutations_to_sstables()) {
+        // Not kept in memory, so not throttled by streaming dirty memory,
+        // but by the sstable writes.
+        return cf.write_streaming_mutation(std::move(s), plan_id, m);
+    }
     return _streaming_dirty_memory_manager.region_group().run_when_memory_available([this, &m, plan_id, fragmented, s = std::move(s)] {
         auto uuid = m.column_family_id();
         auto& cf = find_column_family(uuid);
@@ -3268,10 +4224,16 @@ future<> database::apply_streaming_mutation(schema_ptr s, utils::UUID plan_id, c
 
 keyspace::config
 database::make_keyspace_config(const keyspace_metadata& ksm) {
-    // FIXME support multiple directories
     keyspace::config cfg;
     if (_cfg->data_file_directories().size() > 0) {
         cfg.datadir = sprint("%s/%s", _cfg->data_file_directories()[0], ksm.name());
+        for (unsigned i = 1; i < _cfg->data_file_directories().size(); ++i) {
+            cfg.extra_datadirs.push_back(sprint("%s/%s", _cfg->data_file_directories()[i], ksm.name()));
+        }
+        cfg.data_placement = _data_placement.get();
+        if (!_cfg->cold_data_file_directory().empty()) {
+            cfg.cold_datadir = sprint("%s/%s", _cfg->cold_data_file_directory(), ksm.name());
+        }
         cfg.enable_disk_writes = !_cfg->enable_in_memory_data_store();
         cfg.enable_disk_reads = true; // we allways read from disk
         cfg.enable_commitlog = ksm.durable_writes() && _cfg->enable_commitlog() && !_cfg->enable_in_memory_data_store();
@@ -3286,6 +4248,9 @@ database::make_keyspace_config(const keyspace_metadata& ksm) {
     }
     cfg.dirty_memory_manager = &_dirty_memory_manager;
     cfg.streaming_dirty_memory_manager = &_streaming_dirty_memory_manager;
+    cfg.counter_cache_tracker = _counter_cache_tracker.get();
+    // All writes are admitted through the regular group, see apply_in_memory().
+    cfg.write_admission_group = &_dirty_memory_manager.region_group();
     cfg.read_concurrency_config.sem = &_read_concurrency_sem;
     cfg.read_concurrency_config.timeout = _cfg->read_request_timeout_in_ms() * 1ms;
     // Assume a queued read takes up 10kB of memory, and allow 2% of memory to be filled up with such reads.
@@ -3385,7 +4350,13 @@ schema_ptr database::find_indexed_table(const sstring& ks_name, const sstring& i
 
 future<>
 database::stop() {
-    return _compaction_manager.stop().then([this] {
+    while (_querier_cache.evict_one()) { }
+    auto stop_index_summary_manager = _index_summary_manager ? _index_summary_manager->stop() : make_ready_future<>();
+    return stop_index_summary_manager.then([this] {
+        return _data_placement ? _data_placement->stop() : make_ready_future<>();
+    }).then([this] {
+        return _compaction_manager.stop();
+    }).then([this] {
         // try to ensure that CL has done disk flushing
         if (_commitlog != nullptr) {
             return _commitlog->shutdown();
@@ -3433,8 +4404,11 @@ future<> database::truncate(const keyspace& ks, column_family& cf, timestamp_fun
     // call.
     auto low_mark = cf.set_low_replay_position_mark();
 
+    // Only a snapshot needs the data of the memtables; otherwise it is
+    // dropped without being written. Its commitlog entries, all below
+    // low_mark, are then skipped on replay because of the truncation record.
     future<> f = make_ready_future<>();
-    if (durable || auto_snapshot) {
+    if (auto_snapshot) {
         // TODO:
         // this is not really a guarantee at all that we've actually
         // gotten all things to disk. Again, need queue-ish or something.
@@ -3443,19 +4417,23 @@ future<> database::truncate(const keyspace& ks, column_family& cf, timestamp_fun
         f = cf.clear();
     }
 
-    return cf.run_with_compaction_disabled([f = std::move(f), &cf, auto_snapshot, tsf = std::move(tsf), low_mark]() mutable {
-        return f.then([&cf, auto_snapshot, tsf = std::move(tsf), low_mark] {
+    return cf.run_with_compaction_disabled([f = std::move(f), &cf, auto_snapshot, durable, tsf = std::move(tsf), low_mark]() mutable {
+        return f.then([&cf, auto_snapshot, durable, tsf = std::move(tsf), low_mark] {
             dblog.debug("Discarding sstable data for truncated CF + indexes");
             // TODO: notify truncation
 
-            return tsf().then([&cf, auto_snapshot, low_mark](db_clock::time_point truncated_at) {
+            return tsf().then([&cf, auto_snapshot, durable, low_mark](db_clock::time_point truncated_at) {
                 future<> f = make_ready_future<>();
                 if (auto_snapshot) {
                     auto name = sprint("%d-%s", truncated_at.time_since_epoch().count(), cf.schema()->cf_name());
                     f = cf.snapshot(name);
                 }
-                return f.then([&cf, truncated_at, low_mark] {
-                    return cf.discard_sstables(truncated_at).then([&cf, truncated_at, low_mark](db::replay_position rp) {
+                return f.then([&cf, truncated_at, low_mark, durable] {
+                    return cf.discard_sstables(truncated_at).then([&cf, truncated_at, low_mark, durable](db::replay_position rp) {
+                        // Memtables which weren't flushed don't show up in rp.
+                        if (durable) {
+                            rp = std::max(rp, low_mark);
+                        }
                         // TODO: verify that rp == db::replay_position is because we have no sstables (and no data flushed)
                         if (rp == db::replay_position()) {
                             return make_ready_future();
@@ -3574,6 +4552,8 @@ future<> update_schema_version_and_announce(distributed<service::storage_proxy>&
 // This code assumes that all shards will be snapshotting at the same time. So
 // far this is a safe assumption, but if we ever want to take snapshots from a
 // group of shards only, this code will have to be updated to account for that.
+static constexpr size_t max_concurrent_snapshot_links = 64;
+
 struct snapshot_manager {
     std::unordered_set<sstring> files;
     semaphore requests;
@@ -3584,26 +4564,25 @@ static thread_local std::unordered_map<sstring, lw_shared_ptr<snapshot_manager>>
 
 static future<>
 seal_snapshot(sstring jsondir) {
-    std::ostringstream ss;
-    int n = 0;
-    ss << "{" << std::endl << "\t\"files\" : [ ";
-    for (auto&& rf: pending_snapshots.at(jsondir)->files) {
-        if (n++ > 0) {
-            ss << ", ";
-        }
-        ss << "\"" << rf << "\"";
-    }
-    ss << " ]" << std::endl << "}" << std::endl;
-
-    auto json = ss.str();
     auto jsonfile = jsondir + "/manifest.json";
 
     dblog.debug("Storing manifest {}", jsonfile);
 
-    return io_check(recursive_touch_directory, jsondir).then([jsonfile, json = std::move(json)] {
-        return open_checked_file_dma(general_disk_error_handler, jsonfile, open_flags::wo | open_flags::create | open_flags::truncate).then([json](file f) {
-            return do_with(make_file_output_stream(std::move(f)), [json] (output_stream<char>& out) {
-                return out.write(json.c_str(), json.size()).then([&out] {
+    // The file names are streamed to the manifest, instead of being formatted
+    // into a single string first, which gets large on tables with many sstables.
+    auto snapshot = pending_snapshots.at(jsondir);
+    return io_check(recursive_touch_directory, jsondir).then([jsonfile, snapshot] {
+        return open_checked_file_dma(general_disk_error_handler, jsonfile, open_flags::wo | open_flags::create | open_flags::truncate).then([snapshot](file f) {
+            return do_with(make_file_output_stream(std::move(f)), bool(true), [snapshot] (output_stream<char>& out, bool& first) {
+                return out.write("{\n\t\"files\" : [ ").then([&out, &first, snapshot] {
+                    return do_for_each(snapshot->files, [&out, &first] (const sstring& rf) {
+                        auto entry = sprint("%s\"%s\"", first ? "" : ", ", rf);
+                        first = false;
+                        return out.write(entry);
+                    });
+                }).then([&out] {
+                    return out.write(" ]\n}\n");
+                }).then([&out] {
                    return out.flush();
                 }).then([&out] {
                    return out.close();
@@ -3623,31 +4602,45 @@ future<> column_family::snapshot(sstring name) {
         auto tables = boost::copy_range<std::vector<sstables::shared_sstable>>(*_sstables->all());
         return do_with(std::move(tables), [this, name](std::vector<sstables::shared_sstable> & tables) {
             auto jsondir = _config.datadir + "/snapshots/" + name;
+            auto dirs = boost::copy_range<std::unordered_set<sstring>>(tables | boost::adaptors::transformed([&name] (auto& sst) {
+                return sst->get_dir() + "/snapshots/" + name;
+            }));
 
-            return parallel_for_each(tables, [name](sstables::shared_sstable sstable) {
-                auto dir = sstable->get_dir() + "/snapshots/" + name;
-                return io_check(recursive_touch_directory, dir).then([sstable, dir] {
-                    return sstable->create_links(dir).then_wrapped([] (future<> f) {
-                        // If the SSTables are shared, one of the CPUs will fail here.
-                        // That is completely fine, though. We only need one link.
-                        try {
-                            f.get();
-                        } catch (std::system_error& e) {
-                            if (e.code() != std::error_code(EEXIST, std::system_category())) {
-                                throw;
-                            }
+            // The directories are created, and synced, once for all the
+            // sstables in them, and at most max_concurrent_snapshot_links
+            // sstables of a shard are being linked at a time.
+            return do_with(std::move(dirs), [&tables, name] (std::unordered_set<sstring>& dirs) {
+                return parallel_for_each(dirs, [] (const sstring& dir) {
+                    return io_check(recursive_touch_directory, dir);
+                }).then([&tables, name] {
+                    static thread_local semaphore links_sem(max_concurrent_snapshot_links);
+                    return parallel_for_each(tables, [name] (sstables::shared_sstable sstable) {
+                        // A shared sstable is linked by the first of its shards only.
+                        if (sstable->is_shared() && sstable->get_shards_for_this_sstable().front() != engine().cpu_id()) {
+                            return make_ready_future<>();
                         }
-                        return make_ready_future<>();
+                        auto dir = sstable->get_dir() + "/snapshots/" + name;
+                        return with_semaphore(links_sem, 1, [sstable, dir = std::move(dir)] {
+                            return sstable->create_snapshot_links(dir).then_wrapped([] (future<> f) {
+                                // A previous attempt at the same snapshot may have linked some
+                                // of the files already. That is completely fine.
+                                try {
+                                    f.get();
+                                } catch (std::system_error& e) {
+                                    if (e.code() != std::error_code(EEXIST, std::system_category())) {
+                                        throw;
+                                    }
+                                }
+                                return make_ready_future<>();
+                            });
+                        });
+                    });
+                }).then([&dirs] {
+                    // If we have no files, no directory was created and there is nothing to sync.
+                    return parallel_for_each(dirs, [] (const sstring& dir) {
+                        return io_check(sync_directory, dir);
                     });
                 });
-            }).then([jsondir, &tables] {
-                // This is not just an optimization. If we have no files, jsondir may not have been created,
-                // and sync_directory would throw.
-                if (tables.size()) {
-                    return io_check(sync_directory, std::move(jsondir));
-                } else {
-                    return make_ready_future<>();
-                }
             }).finally([this, &tables, jsondir] {
                 auto shard = std::hash<sstring>()(jsondir) % smp::count;
                 std::unordered_set<sstring> table_names;
@@ -3783,28 +4776,34 @@ future<> column_family::flush(const db::replay_position& pos) {
     return _memtables->request_flush();
 }
 
-// FIXME: We can do much better than this in terms of cache management. Right
-// now, we only have to flush the touched ranges because of the possibility of
-// streaming containing token ownership changes.
-//
-// Right now we can't differentiate between that and a normal repair process,
-// so we always flush. When we can differentiate those streams, we should not
-// be indiscriminately touching the cache during repair. We will just have to
-// invalidate the entries that are relevant to things we already have in the cache.
+// Unless streaming_cache_update_policy is invalidate, the streamed partitions are
+// moved to cache as the streaming memtables are flushed, which keeps the cache
+// consistent across token ownership changes too. Partitions sent in fragments
+// go to sstables of the plan though, so the touched ranges are invalidated if
+// there are any of those. With streaming_write_to_sstables, the cache is updated
+// when the sstables of the plan are added, see add_streaming_plan_sstables().
 future<> column_family::flush_streaming_mutations(utils::UUID plan_id, dht::partition_range_vector ranges) {
     // This will effectively take the gate twice for this call. The proper way to fix that would
     // be to change seal_active_streaming_memtable_delayed to take a range parameter. However, we
     // need this code to go away as soon as we can (see FIXME above). So the double gate is a better
     // temporary counter measure.
     return with_gate(_streaming_flush_gate, [this, plan_id, ranges = std::move(ranges)] {
-        return flush_streaming_big_mutations(plan_id).then([this] {
+        auto invalidate_ranges = make_lw_shared<bool>(false);
+        return flush_streaming_big_mutations(plan_id).then([this, plan_id, invalidate_ranges] (bool added) {
+            *invalidate_ranges = added;
+            return add_streaming_plan_sstables(plan_id);
+        }).then([this, invalidate_ranges] (bool invalidate) {
+            *invalidate_ranges |= invalidate;
             return _streaming_memtables->seal_active_memtable(memtable_list::flush_behavior::delayed);
         }).finally([this] {
             return _streaming_flush_phaser.advance_and_await();
-        }).finally([this, ranges = std::move(ranges)] {
+        }).finally([this, ranges = std::move(ranges), invalidate_ranges] {
             if (!_config.enable_cache) {
                 return make_ready_future<>();
             }
+            if (_config.streaming_cache_update_policy != streaming_cache_policy::invalidate && !*invalidate_ranges) {
+                return make_ready_future<>();
+            }
             return do_with(std::move(ranges), [this] (auto& ranges) {
                 return parallel_for_each(ranges, [this](auto&& range) {
                     return _cache.invalidate(range);
@@ -3814,10 +4813,10 @@ future<> column_family::flush_streaming_mutations(utils::UUID plan_id, dht::part
     });
 }
 
-future<> column_family::flush_streaming_big_mutations(utils::UUID plan_id) {
+future<bool> column_family::flush_streaming_big_mutations(utils::UUID plan_id) {
     auto it = _streaming_memtables_big.find(plan_id);
     if (it == _streaming_memtables_big.end()) {
-        return make_ready_future<>();
+        return make_ready_future<bool>(false);
     }
     auto entry = it->second;
     _streaming_memtables_big.erase(it);
@@ -3834,24 +4833,329 @@ future<> column_family::flush_streaming_big_mutations(utils::UUID plan_id) {
                 add_sstable(sst, {engine().cpu_id()});
             }
             trigger_compaction();
+            return !entry->sstables.empty();
         });
     });
 }
 
 future<> column_family::fail_streaming_mutations(utils::UUID plan_id) {
+    auto f = fail_streaming_plan_sstables(plan_id);
     auto it = _streaming_memtables_big.find(plan_id);
     if (it == _streaming_memtables_big.end()) {
-        return make_ready_future<>();
+        return f;
     }
     auto entry = it->second;
     _streaming_memtables_big.erase(it);
-    return entry->flush_in_progress.close().then([this, entry] {
+    return f.then([entry] {
+        return entry->flush_in_progress.close();
+    }).then([this, entry] {
         for (auto&& sst : entry->sstables) {
             sst->mark_for_deletion();
         }
     });
 }
 
+// The most sstables a plan writes to at the same time, for each table and
+// shard.
+static constexpr size_t max_streaming_sstable_writers = 16;
+// Mutations a plan's sstables can each have waiting to be written.
+static constexpr size_t streaming_sstable_writer_queue_size = 16;
+// The partitions a plan writes to each of its sstables, which they are sized
+// for. Their bloom filters are allocated up front, so it's kept moderate.
+static constexpr uint64_t streaming_sstable_partitions = 256 * 1024;
+// What a plan keeps, at most, to update cache with once it completes.
+static constexpr size_t max_streaming_cache_update_keys = 100 * 1024;
+static constexpr size_t max_streaming_cache_update_bytes = 32 << 20;
+
+// Writes the mutations it is given, which must come in increasing partition
+// order, to an sstable as they come, until it's closed.
+class column_family::streaming_sstable_writer {
+    class reader final : public mutation_reader::impl {
+        streaming_sstable_writer& _writer;
+    public:
+        explicit reader(streaming_sstable_writer& w) : _writer(w) { }
+        virtual future<streamed_mutation_opt> operator()() override {
+            return _writer.next();
+        }
+    };
+
+    schema_ptr _schema;
+    sstable_placement _placement;
+    std::deque<mutation> _pending;
+    // Waiters get room in the order they ask for it, so the mutations are
+    // written in the order they are given.
+    semaphore _room{streaming_sstable_writer_queue_size};
+    size_t _waiting_for_room = 0;
+    stdx::optional<promise<>> _reader_waiting;
+    stdx::optional<dht::decorated_key> _last_key;
+    uint64_t _partitions = 0;
+    bool _closed = false;
+    std::exception_ptr _ex;
+    future<> _written = make_ready_future<>();
+
+    void wake_reader() {
+        if (_reader_waiting) {
+            _reader_waiting->set_value();
+            _reader_waiting = {};
+        }
+    }
+
+    future<streamed_mutation_opt> next() {
+        if (!_pending.empty()) {
+            auto m = std::move(_pending.front());
+            _pending.pop_front();
+            _room.signal(1);
+            return make_ready_future<streamed_mutation_opt>(streamed_mutation_from_mutation(std::move(m)));
+        }
+        if (_ex) {
+            return make_exception_future<streamed_mutation_opt>(_ex);
+        }
+        if (_closed && !_waiting_for_room) {
+            return make_ready_future<streamed_mutation_opt>();
+        }
+        _reader_waiting.emplace();
+        return _reader_waiting->get_future().then([this] {
+            return next();
+        });
+    }
+public:
+    streaming_sstable_writer(sstables::shared_sstable sst, schema_ptr s, sstable_placement placement, bool backup)
+            : _schema(std::move(s))
+            , _placement(std::move(placement)) {
+        sstables::sstable_writer_config cfg;
+        cfg.backup = backup;
+        cfg.leave_unsealed = true;
+        auto&& priority = service::get_local_streaming_write_priority();
+        _written = sst->write_components(make_mutation_reader<reader>(*this), streaming_sstable_partitions, _schema, cfg, priority)
+                .handle_exception([this] (auto ep) {
+            abort(ep);
+            return make_exception_future<>(ep);
+        });
+    }
+
+    const schema_ptr& schema() const {
+        return _schema;
+    }
+
+    const dht::decorated_key& last_key() const {
+        return *_last_key;
+    }
+
+    bool full() const {
+        return _partitions >= streaming_sstable_partitions;
+    }
+
+    // Requires: m comes after last_key(), and has the writer's schema.
+    future<> write(mutation m) {
+        _last_key = m.decorated_key();
+        ++_partitions;
+        ++_waiting_for_room;
+        return _room.wait(1).then_wrapped([this, m = std::move(m)] (future<> f) mutable {
+            --_waiting_for_room;
+            f.get();
+            _pending.push_back(std::move(m));
+            wake_reader();
+        });
+    }
+
+    // No more mutations are written, the sstable ends after those given.
+    void close() {
+        _closed = true;
+        wake_reader();
+    }
+
+    void abort(std::exception_ptr ex) {
+        _ex = ex;
+        _room.broken();
+        _pending.clear();
+        if (_reader_waiting) {
+            _reader_waiting->set_exception(ex);
+            _reader_waiting = {};
+        }
+    }
+
+    // Resolves once the sstable is written, unsealed, or failed to be.
+    // Can be called only once.
+    future<> written() {
+        return std::move(_written);
+    }
+};
+
+void column_family::open_streaming_sstable_writer(streaming_plan_sstables& plan) {
+    auto placement = place_new_sstable(0);
+    auto sst = make_lw_shared<sstables::sstable>(_schema, placement.dir, calculate_generation_for_new_table(),
+            _config.sstable_format, sstables::sstable::format_types::big);
+    sst->set_unshared();
+    auto w = make_lw_shared<streaming_sstable_writer>(sst, _schema, std::move(placement), incremental_backups_enabled());
+    plan.sstables.push_back(std::move(sst));
+    plan.written.push_back(w->written().finally([w] { }));
+    plan.writers.push_back(std::move(w));
+}
+
+void column_family::close_streaming_sstable_writer(streaming_plan_sstables& plan, size_t i) {
+    plan.writers[i]->close();
+    plan.writers.erase(plan.writers.begin() + i);
+}
+
+future<> column_family::write_streaming_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& fm) {
+    auto it = _streaming_plan_sstables.find(plan_id);
+    if (it == _streaming_plan_sstables.end()) {
+        it = _streaming_plan_sstables.emplace(plan_id, make_lw_shared<streaming_plan_sstables>()).first;
+    }
+    auto& plan = *it->second;
+    auto m = fm.unfreeze(m_schema);
+    m.upgrade(_schema);
+    if (_config.enable_cache && _config.streaming_cache_update_policy != streaming_cache_policy::invalidate) {
+        keep_for_cache_update(plan, m);
+    }
+
+    // The writer whose last partition is the closest one before m's. Those
+    // of older schemas aren't written to anymore.
+    auto& dk = m.decorated_key();
+    stdx::optional<size_t> closest;
+    for (size_t i = 0; i < plan.writers.size(); i++) {
+        auto& w = *plan.writers[i];
+        if (w.schema() == _schema && w.last_key().less_compare(*_schema, dk)
+                && (!closest || plan.writers[*closest]->last_key().less_compare(*_schema, w.last_key()))) {
+            closest = i;
+        }
+    }
+    if (!closest) {
+        if (plan.writers.size() >= max_streaming_sstable_writers) {
+            // Makes room by closing the writer the furthest behind.
+            auto i = boost::min_element(plan.writers, [this] (auto& a, auto& b) {
+                return a->last_key().less_compare(*_schema, b->last_key());
+            });
+            close_streaming_sstable_writer(plan, i - plan.writers.begin());
+        }
+        open_streaming_sstable_writer(plan);
+        closest = plan.writers.size() - 1;
+    }
+    auto w = plan.writers[*closest];
+    auto f = w->write(std::move(m));
+    if (w->full()) {
+        close_streaming_sstable_writer(plan, *closest);
+    }
+    return f;
+}
+
+void column_family::keep_for_cache_update(streaming_plan_sstables& plan, const mutation& m) {
+    if (plan.invalidate_ranges) {
+        return;
+    }
+    if (_cache.contains(m.decorated_key())) {
+        if (!plan.cache_updates) {
+            // Not accounted as dirty memory, but bounded, see below.
+            plan.cache_updates = make_lw_shared<memtable>(_schema);
+        }
+        plan.cache_updates->apply(m);
+    } else {
+        plan.uncached_keys.push_back(m.decorated_key());
+    }
+    if (plan.uncached_keys.size() > max_streaming_cache_update_keys
+            || (plan.cache_updates && plan.cache_updates->occupancy().total_space() > max_streaming_cache_update_bytes)) {
+        plan.invalidate_ranges = true;
+        plan.cache_updates = {};
+        std::vector<dht::decorated_key>().swap(plan.uncached_keys);
+    }
+}
+
+future<bool> column_family::add_streaming_plan_sstables(utils::UUID plan_id) {
+    auto it = _streaming_plan_sstables.find(plan_id);
+    if (it == _streaming_plan_sstables.end()) {
+        return make_ready_future<bool>(false);
+    }
+    auto plan = it->second;
+    _streaming_plan_sstables.erase(it);
+    while (!plan->writers.empty()) {
+        close_streaming_sstable_writer(*plan, plan->writers.size() - 1);
+    }
+    return when_all(plan->written.begin(), plan->written.end()).then([this, plan] (std::vector<future<>> written) {
+        std::exception_ptr ex;
+        for (auto& f : written) {
+            if (f.failed()) {
+                ex = f.get_exception();
+            }
+        }
+        if (ex) {
+            return make_exception_future<>(ex);
+        }
+        return parallel_for_each(plan->sstables, [this] (auto& sst) {
+            return sst->seal_sstable(this->incremental_backups_enabled()).then([sst] {
+                return sst->open_data();
+            });
+        });
+    }).then([this, plan] {
+        if (plan->sstables.empty()) {
+            return make_ready_future<bool>(false);
+        }
+        if (!_config.enable_cache || _config.streaming_cache_update_policy == streaming_cache_policy::invalidate
+                || plan->invalidate_ranges) {
+            for (auto&& sst : plan->sstables) {
+                add_sstable(sst, {engine().cpu_id()});
+            }
+            trigger_compaction();
+            return make_ready_future<bool>(true);
+        }
+        return with_semaphore(_cache_update_sem, 1, [this, plan] {
+            for (auto&& sst : plan->sstables) {
+                add_sstable(sst, {engine().cpu_id()});
+            }
+            trigger_compaction();
+            // The partitions populated into cache while the plan was running
+            // were read without the streamed data. Invalidating the others
+            // also keeps the cache from thinking it has every partition of
+            // the ranges around them.
+            return do_for_each(plan->uncached_keys, [this] (const dht::decorated_key& dk) {
+                return _cache.invalidate(dk);
+            }).then([this, plan] {
+                if (!plan->cache_updates) {
+                    return make_ready_future<>();
+                }
+                return utils::run_in_task_group(utils::task_group::cache_update, [this, plan] {
+                    return _cache.update(*plan->cache_updates, [] (const dht::decorated_key&) {
+                        return partition_presence_checker_result::maybe_exists;
+                    });
+                });
+            }).then_wrapped([plan] (future<> f) {
+                if (f.failed()) {
+                    dblog.error("failed to update cache with streamed partitions: {}", f.get_exception());
+                    return true;
+                }
+                return false;
+            });
+        });
+    }).handle_exception([plan] (auto ep) {
+        dblog.error("failed to write streamed sstables: {}", ep);
+        for (auto&& sst : plan->sstables) {
+            sst->mark_for_deletion();
+        }
+        return make_exception_future<bool>(ep);
+    });
+}
+
+future<> column_family::fail_streaming_plan_sstables(utils::UUID plan_id) {
+    auto it = _streaming_plan_sstables.find(plan_id);
+    if (it == _streaming_plan_sstables.end()) {
+        return make_ready_future<>();
+    }
+    auto plan = it->second;
+    _streaming_plan_sstables.erase(it);
+    auto ex = std::make_exception_ptr(std::runtime_error("streaming plan failed"));
+    for (auto&& w : plan->writers) {
+        w->abort(ex);
+    }
+    plan->writers.clear();
+    return when_all(plan->written.begin(), plan->written.end()).then([plan] (std::vector<future<>> written) {
+        for (auto& f : written) {
+            f.ignore_ready_future();
+        }
+        for (auto&& sst : plan->sstables) {
+            sst->mark_for_deletion();
+        }
+    });
+}
+
 future<> column_family::clear() {
     if (_commitlog) {
         _commitlog->discard_completed_segments(_schema->id());
@@ -3861,6 +5165,9 @@ future<> column_family::clear() {
     _streaming_memtables->clear();
     _streaming_memtables->add_memtable();
     _streaming_memtables_big.clear();
+    if (_counter_shard_cache) {
+        _counter_shard_cache->clear();
+    }
     return _cache.clear();
 }
 
@@ -3886,6 +5193,9 @@ future<db::replay_position> column_family::discard_sstables(db_clock::time_point
         }
 
         _sstables = std::move(pruned);
+        if (_counter_shard_cache) {
+            _counter_shard_cache->clear();
+        }
         dblog.debug("cleaning out row cache");
         return _cache.clear().then([rp, remove = std::move(remove)] () mutable {
             return parallel_for_each(remove, [](sstables::shared_sstable s) {
@@ -3951,8 +5261,20 @@ void column_family::set_schema(schema_ptr s) {
 
     _cache.set_schema(s);
     _counter_cell_locks->set_schema(s);
+    if (_counter_shard_cache) {
+        _counter_shard_cache->set_schema(s);
+    }
     _schema = std::move(s);
 
+    auto& rate_limit = _schema->per_partition_rate_limit_options();
+    if (!rate_limit.enabled()) {
+        _rate_limiter.reset();
+    } else if (_rate_limiter) {
+        _rate_limiter->set_options(rate_limit);
+    } else {
+        _rate_limiter = std::make_unique<db::per_partition_rate_limiter>(_schema, rate_limit);
+    }
+
     set_compaction_strategy(_schema->compaction_strategy());
     trigger_compaction();
 }
@@ -4032,11 +5354,11 @@ future<> column_family::push_view_replica_updates(const schema_ptr& s, const fro
     if (cr_ranges.empty()) {
         return generate_and_propagate_view_updates(base, std::move(views), std::move(m), { });
     }
-    // We read the whole set of regular columns in case the update now causes a base row to pass
-    // a view's filters, and a view happens to include columns that have no value in this update.
-    // Also, one of those columns can determine the lifetime of the base row, if it has a TTL.
-    auto columns = boost::copy_range<std::vector<column_id>>(
-            base->regular_columns() | boost::adaptors::transformed(std::mem_fn(&column_definition::id)));
+    // We read the columns the views select in case the update now causes a base row to pass
+    // a view's filters, and a view happens to include columns that have no value in this update,
+    // as well as the ones the filters are on. When a view's key is the base key, all the columns
+    // can determine the lifetime of the base row, if it has a TTL.
+    auto columns = db::view::base_columns_needed_by_views(*base, views);
     query::partition_slice::option_set opts;
     opts.set(query::partition_slice::option::send_partition_key);
     opts.set(query::partition_slice::option::send_clustering_key);
@@ -4100,3 +5422,32 @@ column_family::cache_hit_rate column_family::get_hit_rate(gms::inet_address addr
 void column_family::drop_hit_rate(gms::inet_address addr) {
     _cluster_cache_hit_rates.erase(addr);
 }
+
+// Samples needed before the latencies of a replica are trusted, and after
+// which older samples start counting half.
+static constexpr int64_t min_replica_read_latency_samples = 100;
+static constexpr int64_t max_replica_read_latency_samples = 10000;
+
+void column_family::add_replica_read_latency(gms::inet_address addr, std::chrono::microseconds latency) {
+    auto& h = _replica_read_latencies[addr];
+    if (h._count >= max_replica_read_latency_samples) {
+        for (auto& b : h.buckets) {
+            b /= 2;
+        }
+        h._count = h.count();
+    }
+    h.add(latency.count());
+}
+
+std::experimental::optional<std::chrono::microseconds>
+column_family::get_replica_read_latency(gms::inet_address addr, double percentile) const {
+    auto it = _replica_read_latencies.find(addr);
+    if (it == _replica_read_latencies.end() || it->second._count < min_replica_read_latency_samples) {
+        return { };
+    }
+    return std::chrono::microseconds(it->second.percentile(percentile));
+}
+
+void column_family::drop_replica_read_latency(gms::inet_address addr) {
+    _replica_read_latencies.erase(addr);
+}
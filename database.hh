@@ -57,6 +57,7 @@
 #include "tombstone.hh"
 #include "atomic_cell.hh"
 #include "query-request.hh"
+#include "digest_algorithm.hh"
 #include "keys.hh"
 #include "mutation.hh"
 #include "memtable.hh"
@@ -68,8 +69,13 @@
 #include "utils/exponential_backoff_retry.hh"
 #include "utils/histogram.hh"
 #include "utils/estimated_histogram.hh"
+#include "utils/latency_histogram.hh"
+#include "utils/top_k.hh"
 #include "sstables/compaction.hh"
 #include "sstables/sstable_set.hh"
+#include "sstables/read_ahead.hh"
+#include "sstables/data_placement.hh"
+#include "db/per_partition_rate_limiter.hh"
 #include <seastar/core/rwlock.hh>
 #include <seastar/core/shared_future.hh>
 #include <seastar/core/metrics_registration.hh>
@@ -77,9 +83,14 @@
 #include <boost/intrusive/parent_from_member.hpp>
 #include "db/view/view.hh"
 #include "lister.hh"
+#include "backlog_controller.hh"
+#include "querier.hh"
 
 class cell_locker;
 class cell_locker_stats;
+class counter_shard_cache;
+class counter_shard_cache_tracker;
+class index_summary_manager;
 class locked_cell;
 
 class frozen_mutation;
@@ -127,11 +138,12 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
     database* _db;
     logalloc::region_group _region_group;
 
-    // We would like to serialize the flushing of memtables. While flushing many memtables
-    // simultaneously can sustain high levels of throughput, the memory is not freed until the
-    // memtable is totally gone. That means that if we have throttled requests, they will stay
-    // throttled for a long time. Even when we have virtual dirty, that only provides a rough
-    // estimate, and we can't release requests that early.
+    // We would like to limit the number of memtables flushed at once. While flushing many
+    // memtables simultaneously can sustain high levels of throughput, the memory is not freed
+    // until the memtable is totally gone. That means that if we have throttled requests, they will
+    // stay throttled for a long time. Even when we have virtual dirty, that only provides a rough
+    // estimate, and we can't release requests that early. So by default we flush one memtable
+    // at a time, but disks which need more parallelism to be kept busy can be given more.
     semaphore _flush_serializer;
     // We will accept a new flush before another one ends, once it is done with the data write.
     // That is so we can keep the disk always busy. But there is still some background work that is
@@ -142,6 +154,9 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
     static constexpr unsigned _max_background_work = 20;
     semaphore _background_work_flush_serializer = { _max_background_work };
     condition_variable _should_flush;
+    // Signalled whenever a flush is done with its data write, which is what pressure flushes
+    // wait for when all the regions which could be flushed already are.
+    condition_variable _flush_done;
     int64_t _dirty_bytes_released_pre_accounted = 0;
 
     future<> flush_when_needed();
@@ -202,11 +217,11 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
     //
     // We then set the soft limit to 80 % of the virtual dirty hard limit, which is equal to 40 % of
     // the user-supplied threshold.
-    dirty_memory_manager(database& db, size_t threshold, double soft_limit)
+    dirty_memory_manager(database& db, size_t threshold, double soft_limit, unsigned flush_concurrency = 1)
         : logalloc::region_group_reclaimer(threshold / 2, threshold * soft_limit / 2)
         , _db(&db)
         , _region_group(*this)
-        , _flush_serializer(1)
+        , _flush_serializer(std::max(flush_concurrency, 1u))
         , _waiting_flush(flush_when_needed()) {}
 
     dirty_memory_manager() : logalloc::region_group_reclaimer()
@@ -223,6 +238,11 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
         return _region_group;
     }
 
+    // The flushes waiting for their turn.
+    size_t waiting_flushes() const {
+        return _flush_serializer.waiters() + _background_work_flush_serializer.waiters();
+    }
+
     const logalloc::region_group& region_group() const {
         return _region_group;
     }
@@ -250,9 +270,14 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
         auto it = _flush_manager.find(region);
         if (it != _flush_manager.end()) {
             _flush_manager.erase(it);
+            _flush_done.broadcast();
         }
     }
 
+    bool is_being_flushed(const logalloc::region* region) const {
+        return _flush_manager.count(region);
+    }
+
     void add_to_flush_manager(const logalloc::region *region, flush_permit&& permit) {
         _flush_manager.emplace(region, std::move(permit));
     }
@@ -265,7 +290,8 @@ class dirty_memory_manager: public logalloc::region_group_reclaimer {
         return _region_group.memory_used();
     }
 
-    future<> flush_one(memtable_list& cf, semaphore_units<> permit);
+    // queued_at is when the flush started waiting for its permit.
+    future<> flush_one(memtable_list& cf, semaphore_units<> permit, utils::latency_counter::time_point queued_at);
 
     future<semaphore_units<>> get_flush_permit() {
         return get_units(_flush_serializer, 1);
@@ -295,12 +321,21 @@ extern thread_local dirty_memory_manager default_dirty_memory_manager;
 class memtable_list {
 public:
     enum class flush_behavior { delayed, immediate };
+
+    // In microseconds.
+    struct flush_stats {
+        // The time flushes waited for the dirty_memory_manager to let them start.
+        utils::estimated_histogram queue_time;
+        // The time from the start of flushes to their end.
+        utils::estimated_histogram latency;
+    };
 private:
     std::vector<shared_memtable> _memtables;
     std::function<future<> (flush_behavior)> _seal_fn;
     std::function<schema_ptr()> _current_schema;
     dirty_memory_manager* _dirty_memory_manager;
     std::experimental::optional<shared_promise<>> _flush_coalescing;
+    flush_stats _flush_stats;
 public:
     memtable_list(std::function<future<> (flush_behavior)> seal_fn, std::function<schema_ptr()> cs, dirty_memory_manager* dirty_memory_manager)
         : _memtables({})
@@ -369,6 +404,14 @@ class memtable_list {
     logalloc::region_group& region_group() {
         return _dirty_memory_manager->region_group();
     }
+
+    flush_stats& get_flush_stats() {
+        return _flush_stats;
+    }
+
+    const flush_stats& get_flush_stats() const {
+        return _flush_stats;
+    }
     // This is used for explicit flushes. Will queue the memtable for flushing and proceed when the
     // dirty_memory_manager allows us to. We will not seal at this time since the flush itself
     // wouldn't happen anyway. Keeping the memtable in memory will potentially increase the time it
@@ -397,6 +440,8 @@ struct cf_stats {
     int64_t clustering_filter_fast_path_count = 0;
     // how many sstables survived the clustering key checks
     int64_t surviving_sstables_after_clustering_filter = 0;
+    // sstables not read because the rows read from newer ones were newer than all their data
+    int64_t sstables_skipped_by_timestamp = 0;
 };
 
 class cache_temperature {
@@ -417,8 +462,26 @@ class column_family : public enable_lw_shared_from_this<column_family> {
 public:
     using timeout_clock = lowres_clock;
 
+    // How data received through streaming and repair is reflected in cache.
+    enum class streaming_cache_policy {
+        // The streamed ranges are evicted from cache.
+        invalidate,
+        // Streamed partitions are merged into cache, like flushed memtables are.
+        update,
+        // Streamed partitions are merged only into partitions already in cache.
+        populate_if_present,
+    };
+    static streaming_cache_policy streaming_cache_policy_from_string(const sstring&);
+
     struct config {
         sstring datadir;
+        // The directories of the table in the other data directories, if any.
+        // New sstables are spread across all of them by data_placement.
+        std::vector<sstring> extra_datadirs;
+        ::data_placement* data_placement = nullptr;
+        // The directory of the table in the cold data directory, if any, which
+        // sstables with old enough data are moved to.
+        sstring cold_datadir;
         bool enable_disk_writes = true;
         bool enable_disk_reads = true;
         bool enable_cache = true;
@@ -429,7 +492,17 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         restricted_mutation_reader_config read_concurrency_config;
         restricted_mutation_reader_config streaming_read_concurrency_config;
         ::cf_stats* cf_stats = nullptr;
+        // The region group writes to the table are admitted through while
+        // dirty memory is over the limit, if any.
+        logalloc::region_group* write_admission_group = nullptr;
+        // Bounds the local counter shards cached by counter tables, if any.
+        counter_shard_cache_tracker* counter_cache_tracker = nullptr;
         uint64_t max_cached_partition_size_in_bytes;
+        sstables::sstable::version_types sstable_format = sstables::sstable::version_types::ka;
+        unsigned max_concurrent_compactions = 4;
+        streaming_cache_policy streaming_cache_update_policy = streaming_cache_policy::invalidate;
+        // Write streamed mutations straight to sstables of their plan.
+        bool streaming_write_to_sstables = false;
     };
     struct no_commitlog {};
     struct stats {
@@ -442,13 +515,37 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         int64_t live_sstable_count = 0;
         /** Estimated number of compactions pending for this column family */
         int64_t pending_compactions = 0;
+        /** Data bytes compactions of this column family read and wrote */
+        int64_t compaction_bytes_read = 0;
+        int64_t compaction_bytes_written = 0;
         utils::timed_rate_moving_average_and_histogram reads{256};
         utils::timed_rate_moving_average_and_histogram writes{256};
         utils::estimated_histogram estimated_read;
         utils::estimated_histogram estimated_write;
+        // The same latencies, in fixed-size histograms which are cheap to
+        // add up across shards and tables.
+        utils::latency_histogram read_latency;
+        utils::latency_histogram write_latency;
         utils::estimated_histogram estimated_sstable_per_read{35};
+        // The latency of the stages of the sampled reads, in microseconds:
+        // waiting for memory for their results, reading and merging their
+        // data from the memtables, cache and sstables, and building their
+        // results.
+        utils::estimated_histogram estimated_read_admission;
+        utils::estimated_histogram estimated_read_execution;
+        utils::estimated_histogram estimated_read_serialization;
+        // The latency of appending the sampled writes to the commitlog, in
+        // microseconds, before they're applied to the memtable.
+        utils::estimated_histogram estimated_write_commitlog;
         utils::timed_rate_moving_average_and_histogram tombstone_scanned;
         utils::timed_rate_moving_average_and_histogram live_scanned;
+        // Operations rejected by the per_partition_rate_limit.
+        int64_t rate_limited_reads = 0;
+        int64_t rate_limited_writes = 0;
+        // For views, the messages their updates were sent to the paired
+        // replicas in, and how many of them each base write needed.
+        int64_t view_update_messages = 0;
+        utils::estimated_histogram view_update_fanout{35};
     };
 
     struct snapshot_details {
@@ -459,6 +556,24 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         cache_temperature rate;
         lowres_clock::time_point last_updated;
     };
+    using partition_counter = utils::space_saving_top_k<partition_key, partition_key::hashing, partition_key::equality>;
+    struct sampled_partitions {
+        std::vector<partition_counter::result> reads;
+        std::vector<partition_counter::result> writes;
+    };
+private:
+    // Counts the partitions read and written while they are being sampled.
+    struct partition_sampler {
+        schema_ptr schema; // Keeps the schema the counters hash keys with alive.
+        partition_counter reads;
+        partition_counter writes;
+
+        partition_sampler(schema_ptr s, size_t capacity)
+            : schema(std::move(s))
+            , reads(capacity, partition_key::hashing(*schema), partition_key::equality(*schema))
+            , writes(capacity, partition_key::hashing(*schema), partition_key::equality(*schema))
+        { }
+    };
 private:
     schema_ptr _schema;
     config _config;
@@ -505,10 +620,44 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     };
     std::unordered_map<utils::UUID, lw_shared_ptr<streaming_memtable_big>> _streaming_memtables_big;
 
-    future<> flush_streaming_big_mutations(utils::UUID plan_id);
+    // Resolves to whether any sstables were added.
+    future<bool> flush_streaming_big_mutations(utils::UUID plan_id);
     void apply_streaming_big_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& m);
     future<> seal_active_streaming_memtable_big(streaming_memtable_big& smb);
 
+    // With streaming_write_to_sstables, the mutations of a plan bypass
+    // memtables and are appended to sstables of the plan as they arrive,
+    // which are added at once when the plan completes. Mutations are sent
+    // concurrently, so they arrive mostly, but not entirely, in token order:
+    // each one goes to the sstable whose last partition is the closest one
+    // before it, and a new sstable is started if there's none. A plan thus
+    // writes about as many sstables as there are concurrent senders.
+    class streaming_sstable_writer;
+    struct streaming_plan_sstables {
+        // The writers still open.
+        std::vector<lw_shared_ptr<streaming_sstable_writer>> writers;
+        // Of all writers, including those already closed.
+        std::vector<sstables::shared_sstable> sstables;
+        std::vector<future<>> written;
+        // Unless streaming_cache_update_policy is invalidate, the streamed
+        // partitions which were in cache when they arrived are kept here, to
+        // be merged into cache when the plan completes, and the others are
+        // invalidated one by one. If that's too much to keep, the streamed
+        // ranges are invalidated instead.
+        lw_shared_ptr<memtable> cache_updates;
+        std::vector<dht::decorated_key> uncached_keys;
+        bool invalidate_ranges = false;
+    };
+    std::unordered_map<utils::UUID, lw_shared_ptr<streaming_plan_sstables>> _streaming_plan_sstables;
+
+    void open_streaming_sstable_writer(streaming_plan_sstables& plan);
+    void close_streaming_sstable_writer(streaming_plan_sstables& plan, size_t i);
+    void keep_for_cache_update(streaming_plan_sstables& plan, const mutation& m);
+    // Resolves to whether any sstables were added, and the target ranges of
+    // the plan have to be invalidated in cache.
+    future<bool> add_streaming_plan_sstables(utils::UUID plan_id);
+    future<> fail_streaming_plan_sstables(utils::UUID plan_id);
+
     lw_shared_ptr<memtable_list> make_memory_only_memtable_list();
     lw_shared_ptr<memtable_list> make_memtable_list();
     lw_shared_ptr<memtable_list> make_streaming_memtable_list();
@@ -517,6 +666,9 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     sstables::compaction_strategy _compaction_strategy;
     // generation -> sstable. Ordered by key so we can easily get the most recent.
     lw_shared_ptr<sstables::sstable_set> _sstables;
+    // The read-ahead of the reads of their data files, shared by the
+    // sstables added to this table.
+    lw_shared_ptr<sstables::read_ahead_stats> _read_ahead_stats = make_lw_shared<sstables::read_ahead_stats>();
     // sstables that have been compacted (so don't look up in query) but
     // have not been deleted yet, so must not GC any tombstones in other sstables
     // that may delete data in these sstables:
@@ -561,6 +713,8 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     semaphore _cache_update_sem{1};
 
     std::unique_ptr<cell_locker> _counter_cell_locks;
+    // Engaged for counter tables, when the counter cache is enabled.
+    std::unique_ptr<counter_shard_cache> _counter_shard_cache;
     void set_metrics();
     seastar::metrics::metric_groups _metrics;
 
@@ -572,6 +726,21 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     // may not have information for some node, since it fills
     // in dynamically
     std::unordered_map<gms::inet_address, cache_hit_rate> _cluster_cache_hit_rates;
+
+    // The latencies, in microseconds, of the reads of this table from each
+    // replica, as seen by this node as a coordinator. Old samples decay, so
+    // that the percentiles follow the current latencies.
+    std::unordered_map<gms::inet_address, utils::estimated_histogram> _replica_read_latencies;
+
+    // Engaged while partitions are sampled.
+    std::unique_ptr<partition_sampler> _partition_sampler;
+
+    // Engaged when the table has a per_partition_rate_limit.
+    std::unique_ptr<db::per_partition_rate_limiter> _rate_limiter;
+
+    // The writes to this table, so that they get their fair share of the
+    // writes released when dirty memory is over the limit.
+    std::unique_ptr<logalloc::region_group::admission_class> _write_admission;
 private:
     void update_stats_for_new_sstable(uint64_t disk_space_used_by_sstable, std::vector<unsigned>&& shards_for_the_sstable);
     // Adds new sstable to the set of sstables
@@ -586,6 +755,8 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     lw_shared_ptr<memtable> new_streaming_memtable();
     future<stop_iteration> try_flush_memtable_to_sstable(lw_shared_ptr<memtable> memt);
     future<> update_cache(memtable&, lw_shared_ptr<sstables::sstable_set> old_sstables);
+    // Moves a flushed streaming memtable to cache, according to streaming_cache_update_policy.
+    future<> update_cache_from_streaming(memtable&, lw_shared_ptr<sstables::sstable_set> old_sstables);
     struct merge_comparator;
 
     // update the sstable generation, making sure that new new sstables don't overwrite this one.
@@ -596,6 +767,14 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         _sstable_generation = std::max<uint64_t>(*_sstable_generation, generation /  smp::count + 1);
     }
 
+    struct sstable_placement {
+        sstring dir;
+        // Accounts the write to the data directory while alive.
+        data_placement::write write;
+    };
+    // Picks the directory for a new sstable of about estimated_size bytes.
+    sstable_placement place_new_sstable(uint64_t estimated_size);
+
     uint64_t calculate_generation_for_new_table() {
         assert(_sstable_generation);
         // FIXME: better way of ensuring we don't attempt to
@@ -630,6 +809,15 @@ class column_family : public enable_lw_shared_from_this<column_family> {
                                         tracing::trace_state_ptr trace_state,
                                         streamed_mutation::forwarding fwd,
                                         mutation_reader::forwarding fwd_mr) const;
+    // Like above, but covers the given set of sstables instead of all of them.
+    mutation_reader make_sstable_reader(schema_ptr schema,
+                                        lw_shared_ptr<sstables::sstable_set> sstables,
+                                        const dht::partition_range& range,
+                                        const query::partition_slice& slice,
+                                        const io_priority_class& pc,
+                                        tracing::trace_state_ptr trace_state,
+                                        streamed_mutation::forwarding fwd,
+                                        mutation_reader::forwarding fwd_mr) const;
 
     mutation_source sstables_as_mutation_source();
     partition_presence_checker make_partition_presence_checker(lw_shared_ptr<sstables::sstable_set>);
@@ -640,10 +828,19 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         return bool(_sstables_need_rewrite.size());
     }
 
+    // Empty if there is no cold data directory.
+    const sstring& cold_dir() const {
+        return _config.cold_datadir;
+    }
+
     sstring dir() const {
         return _config.datadir;
     }
 
+    sstables::sstable::version_types sstable_format() const {
+        return _config.sstable_format;
+    }
+
     uint64_t failed_counter_applies_to_memtable() const {
         return _failed_counter_applies_to_memtable;
     }
@@ -691,11 +888,34 @@ class column_family : public enable_lw_shared_from_this<column_family> {
             const dht::partition_range& range = query::full_partition_range) const;
 
     // Requires ranges to be sorted and disjoint.
+    //
+    // Data of the excluded sstables is not returned, they are expected to be
+    // streamed separately, as whole files.
     mutation_reader make_streaming_reader(schema_ptr schema,
-            const dht::partition_range_vector& ranges) const;
+            const dht::partition_range_vector& ranges,
+            const std::vector<sstables::shared_sstable>& excluded = {}) const;
+
+    // Like above, but reads the given sstables instead of the data of the
+    // column family. They are not expected to be part of it, for example when
+    // streaming imported sstables out.
+    mutation_reader make_streaming_reader(schema_ptr schema,
+            const dht::partition_range_vector& ranges,
+            lw_shared_ptr<sstables::sstable_set> sstables) const;
 
     mutation_source as_mutation_source() const;
 
+    // Returns the positions at which the partition with given key can be cut
+    // into windows for reading it backwards one window at a time: the
+    // promoted index block starts of the sstable holding most of it.
+    future<std::vector<clustering_key_prefix>> get_partition_window_starts(const dht::decorated_key& dk,
+            const io_priority_class& pc) const;
+
+    partition_window_splitter reversed_read_window_splitter(const io_priority_class& pc) const {
+        return [this, &pc] (const dht::decorated_key& dk) {
+            return get_partition_window_starts(dk, pc);
+        };
+    }
+
     void set_virtual_reader(mutation_source virtual_reader) {
         _virtual_reader = std::move(virtual_reader);
     }
@@ -717,7 +937,22 @@ class column_family : public enable_lw_shared_from_this<column_family> {
 
     future<std::vector<locked_cell>> lock_counter_cells(const mutation& m, timeout_clock::time_point timeout);
 
+    // The recently updated local counter shards, or nullptr if they aren't
+    // cached for this table.
+    counter_shard_cache* get_counter_shard_cache() {
+        return _counter_shard_cache.get();
+    }
+
+    // The generations of the sstables which may hold data in the ranges,
+    // sorted, or disengaged if the memtables also hold some, that is if the
+    // data in the ranges isn't all in immutable sstables.
+    std::experimental::optional<std::vector<int64_t>> sstable_generations_for(const dht::partition_range_vector& ranges) const;
+
     logalloc::occupancy_stats occupancy() const;
+    // Memory used by the data of this table, in memtables, cache and
+    // cached index pages. Walks all of it without yielding, so it's meant
+    // for diagnostics.
+    table_memory_footprint memory_footprint() const;
 private:
     column_family(schema_ptr schema, config cfg, db::commitlog* cl, compaction_manager&, cell_locker_stats& cl_stats);
 public:
@@ -738,6 +973,38 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     void apply(const frozen_mutation& m, const schema_ptr& m_schema, db::rp_handle&& = {});
     void apply(const mutation& m, db::rp_handle&& = {});
     void apply_streaming_mutation(schema_ptr, utils::UUID plan_id, const frozen_mutation&, bool fragmented);
+    // Writes a streamed mutation to an sstable of the plan, see
+    // streaming_write_to_sstables. Resolves once it's queued for writing.
+    future<> write_streaming_mutation(schema_ptr m_schema, utils::UUID plan_id, const frozen_mutation& m);
+    bool writes_streaming_mutations_to_sstables() const {
+        return _config.streaming_write_to_sstables && _config.enable_disk_writes;
+    }
+
+    // Starts counting the partitions read and written, to find the most
+    // frequently accessed ones. At most capacity partitions are counted at
+    // a time, so the counts are approximate.
+    // Throws if partitions are being sampled already.
+    void start_partition_sampling(size_t capacity);
+    // Stops sampling, and returns at most list_size of the most frequently
+    // read and written partitions each, most frequent first.
+    sampled_partitions stop_partition_sampling(size_t list_size);
+
+    // Counts a write to the partition against the table's
+    // per_partition_rate_limit, throws rate_limit_exception if it is over
+    // the limit. Called before the write goes to the commitlog.
+    void account_write_for_rate_limit(const partition_key& key);
+    // Returns at most list_size of the partitions whose reads and writes
+    // were rejected the most by the per_partition_rate_limit, most rejected
+    // first.
+    sampled_partitions rate_limit_offenders(size_t list_size) const;
+    bool has_rate_limit() const {
+        return bool(_rate_limiter);
+    }
+
+    // Null if the table has no write_admission_group.
+    logalloc::region_group::admission_class* write_admission_class() {
+        return _write_admission.get();
+    }
 
     // Returns at most "cmd.limit" rows
     future<lw_shared_ptr<query::result>> query(schema_ptr,
@@ -745,7 +1012,10 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         const dht::partition_range_vector& ranges,
         tracing::trace_state_ptr trace_state,
         query::result_memory_limiter& memory_limiter,
-        uint64_t max_result_size);
+        uint64_t max_result_size,
+        timeout_clock::time_point timeout = timeout_clock::time_point::max(),
+        query::querier_cache* cache = nullptr,
+        query::digest_algorithm da = query::digest_algorithm::MD5);
 
     void start();
     future<> stop();
@@ -830,6 +1100,10 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         _config.enable_incremental_backups = val;
     }
 
+    unsigned max_concurrent_compactions() const {
+        return _config.max_concurrent_compactions;
+    }
+
     const sstables::sstable_set& get_sstable_set() const;
     lw_shared_ptr<sstable_list> get_sstables() const;
     lw_shared_ptr<sstable_list> get_sstables_including_compacted_undeleted() const;
@@ -857,6 +1131,15 @@ class column_family : public enable_lw_shared_from_this<column_family> {
         return _stats;
     }
 
+    void add_write_commitlog_latency(utils::latency_counter::duration d) {
+        _stats.estimated_write_commitlog.add(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    }
+
+    void add_view_update_fanout(unsigned messages) {
+        _stats.view_update_messages += messages;
+        _stats.view_update_fanout.add(messages);
+    }
+
     ::cf_stats* cf_stats() {
         return _config.cf_stats;
     }
@@ -877,6 +1160,12 @@ class column_family : public enable_lw_shared_from_this<column_family> {
     cache_hit_rate get_hit_rate(gms::inet_address addr);
     void drop_hit_rate(gms::inet_address addr);
 
+    void add_replica_read_latency(gms::inet_address addr, std::chrono::microseconds latency);
+    // The given percentile of the latencies of the reads from the replica.
+    // Disengaged if there are too few samples for it to be meaningful.
+    std::experimental::optional<std::chrono::microseconds> get_replica_read_latency(gms::inet_address addr, double percentile) const;
+    void drop_replica_read_latency(gms::inet_address addr);
+
     template<typename Func, typename Result = futurize_t<std::result_of_t<Func()>>>
     Result run_with_compaction_disabled(Func && func) {
         ++_compaction_disabled;
@@ -1059,6 +1348,11 @@ class keyspace {
 public:
     struct config {
         sstring datadir;
+        // The directories of the keyspace in the other data directories, if any.
+        std::vector<sstring> extra_datadirs;
+        ::data_placement* data_placement = nullptr;
+        // The directory of the keyspace in the cold data directory, if any.
+        sstring cold_datadir;
         bool enable_commitlog = true;
         bool enable_disk_reads = true;
         bool enable_disk_writes = true;
@@ -1069,6 +1363,8 @@ class keyspace {
         restricted_mutation_reader_config read_concurrency_config;
         restricted_mutation_reader_config streaming_read_concurrency_config;
         ::cf_stats* cf_stats = nullptr;
+        logalloc::region_group* write_admission_group = nullptr;
+        counter_shard_cache_tracker* counter_cache_tracker = nullptr;
     };
 private:
     std::unique_ptr<locator::abstract_replication_strategy> _replication_strategy;
@@ -1126,7 +1422,21 @@ class keyspace {
         return _config.datadir;
     }
 
+    const std::vector<sstring>& extra_datadirs() const {
+        return _config.extra_datadirs;
+    }
+
+    const sstring& cold_datadir() const {
+        return _config.cold_datadir;
+    }
+
     sstring column_family_directory(const sstring& name, utils::UUID uuid) const;
+    // The directories of the table in all data directories, the one returned
+    // by column_family_directory() first.
+    std::vector<sstring> column_family_directories(const sstring& name, utils::UUID uuid) const;
+    // The directory of the table in the cold data directory, or an empty
+    // string if there's none.
+    sstring cold_column_family_directory(const sstring& name, utils::UUID uuid) const;
 };
 
 class no_such_keyspace : public std::runtime_error {
@@ -1140,6 +1450,36 @@ class no_such_column_family : public std::runtime_error {
     no_such_column_family(const sstring& ks_name, const sstring& cf_name);
 };
 
+// Limits the number of sstables a shard loads at once, climbing towards the
+// concurrency which loads them the fastest. Loading an sstable is a handful of
+// small reads, so how many loads the disk serves in parallel before they just
+// queue up depends on the device.
+class sstable_load_concurrency_controller {
+public:
+    using clock = std::chrono::steady_clock;
+    static constexpr size_t initial_concurrency = 3;
+    static constexpr size_t max_concurrency = 64;
+private:
+    semaphore _sem{initial_concurrency};
+    size_t _concurrency = initial_concurrency;
+    // Units not to give back to the semaphore, after the concurrency was lowered.
+    size_t _excess = 0;
+    bool _increasing = true;
+    double _last_throughput = 0;
+    uint64_t _loads_in_window = 0;
+    clock::time_point _window_start = clock::now();
+private:
+    void adjust();
+public:
+    future<> wait() {
+        return _sem.wait();
+    }
+    void signal();
+    size_t concurrency() const {
+        return _concurrency;
+    }
+};
+
 // Policy for distributed<database>:
 //   broadcast metadata writes
 //   local metadata reads
@@ -1152,7 +1492,9 @@ class database {
     ::cf_stats _cf_stats;
     static constexpr size_t max_concurrent_reads() { return 100; }
     static constexpr size_t max_system_concurrent_reads() { return 10; }
-    static constexpr size_t max_concurrent_sstable_loads() { return 3; }
+    // The memory the buffers of the sstable readers may take.
+    static size_t max_memory_concurrent_reads();
+    static size_t max_memory_system_concurrent_reads();
     struct db_stats {
         uint64_t total_writes = 0;
         uint64_t total_writes_failed = 0;
@@ -1163,10 +1505,16 @@ class database {
 
         uint64_t short_data_queries = 0;
         uint64_t short_mutation_queries = 0;
+        uint64_t reads_bypassing_cache = 0;
     };
 
     lw_shared_ptr<db_stats> _stats;
     std::unique_ptr<cell_locker_stats> _cl_stats;
+    std::unique_ptr<counter_shard_cache_tracker> _counter_cache_tracker;
+    // Disengaged if index_summary_capacity_in_mb is 0.
+    std::unique_ptr<index_summary_manager> _index_summary_manager;
+    // Engaged if there is more than one data directory.
+    std::unique_ptr<data_placement> _data_placement;
 
     std::unique_ptr<db::config> _cfg;
 
@@ -1174,12 +1522,12 @@ class database {
     dirty_memory_manager _dirty_memory_manager;
     dirty_memory_manager _streaming_dirty_memory_manager;
 
-    semaphore _read_concurrency_sem{max_concurrent_reads()};
+    reader_concurrency_semaphore _read_concurrency_sem{max_concurrent_reads(), max_memory_concurrent_reads()};
     restricted_mutation_reader_config _read_concurrency_config;
-    semaphore _system_read_concurrency_sem{max_system_concurrent_reads()};
+    reader_concurrency_semaphore _system_read_concurrency_sem{max_system_concurrent_reads(), max_memory_system_concurrent_reads()};
     restricted_mutation_reader_config _system_read_concurrency_config;
 
-    semaphore _sstable_load_concurrency_sem{max_concurrent_sstable_loads()};
+    sstable_load_concurrency_controller _sstable_load_concurrency;
 
     std::unordered_map<sstring, keyspace> _keyspaces;
     std::unordered_map<utils::UUID, lw_shared_ptr<column_family>> _column_families;
@@ -1188,6 +1536,9 @@ class database {
     utils::UUID _version;
     // compaction_manager object is referenced by all column families of a database.
     compaction_manager _compaction_manager;
+    // Adjust the shares of memtable flushes and compactions to their backlogs.
+    std::unique_ptr<flush_controller> _memtable_controller;
+    std::unique_ptr<compaction_controller> _compaction_controller;
     seastar::metrics::metric_groups _metrics;
     bool _enable_incremental_backups = false;
 
@@ -1201,6 +1552,8 @@ class database {
     void create_in_memory_keyspace(const lw_shared_ptr<keyspace_metadata>& ksm);
     friend void db::system_keyspace::make(database& db, bool durable, bool volatile_testing_only);
     void setup_metrics();
+    std::unique_ptr<flush_controller> make_flush_controller(const db::config& cfg);
+    std::unique_ptr<compaction_controller> make_compaction_controller(const db::config& cfg);
 
     friend class db_apply_executor;
     future<> do_apply(schema_ptr, const frozen_mutation&, timeout_clock::time_point timeout);
@@ -1208,6 +1561,9 @@ class database {
     future<> apply_with_commitlog(column_family& cf, const mutation& m, timeout_clock::time_point timeout);
 
     query::result_memory_limiter _result_memory_limiter;
+    // Holds reads of the column families and the resources of the
+    // semaphores above, so goes away before them.
+    query::querier_cache _querier_cache;
 
     future<mutation> do_apply_counter_update(column_family& cf, const frozen_mutation& fm, schema_ptr m_schema, timeout_clock::time_point timeout,
                                              tracing::trace_state_ptr trace_state);
@@ -1218,6 +1574,10 @@ class database {
         return _result_memory_limiter;
     }
 
+    query::querier_cache& get_querier_cache() {
+        return _querier_cache;
+    }
+
     void set_enable_incremental_backups(bool val) { _enable_incremental_backups = val; }
 
     future<> parse_system_tables(distributed<service::storage_proxy>&);
@@ -1280,13 +1640,23 @@ class database {
     unsigned shard_of(const dht::token& t);
     unsigned shard_of(const mutation& m);
     unsigned shard_of(const frozen_mutation& m);
+    // The queries fail with timed_out_error if they are still running after
+    // timeout, without reading any further.
     future<lw_shared_ptr<query::result>, cache_temperature> query(schema_ptr, const query::read_command& cmd, query::result_request request, const dht::partition_range_vector& ranges,
-                                               tracing::trace_state_ptr trace_state, uint64_t max_result_size);
+                                               tracing::trace_state_ptr trace_state, uint64_t max_result_size,
+                                               timeout_clock::time_point timeout = timeout_clock::time_point::max(),
+                                               query::digest_algorithm da = query::digest_algorithm::MD5);
     future<reconcilable_result, cache_temperature> query_mutations(schema_ptr, const query::read_command& cmd, const dht::partition_range& range,
-                                                query::result_memory_accounter&& accounter, tracing::trace_state_ptr trace_state);
+                                                query::result_memory_accounter&& accounter, tracing::trace_state_ptr trace_state,
+                                                timeout_clock::time_point timeout = timeout_clock::time_point::max());
     // Apply the mutation atomically.
     // Throws timed_out_error when timeout is reached.
     future<> apply(schema_ptr, const frozen_mutation&, timeout_clock::time_point timeout = timeout_clock::time_point::max());
+    // Applies mutations of the table of the given schema at once: they are
+    // added to the commitlog together, admitted into memory as a whole, and
+    // applied to the memtable in one go. Each is applied atomically, but the
+    // batch isn't: if it fails, some of them may have been applied.
+    future<> apply(schema_ptr, const std::vector<const frozen_mutation*>&, timeout_clock::time_point timeout = timeout_clock::time_point::max());
     future<> apply_streaming_mutation(schema_ptr, utils::UUID plan_id, const frozen_mutation&, bool fragmented);
     future<mutation> apply_counter_update(schema_ptr, const frozen_mutation& m, timeout_clock::time_point timeout, tracing::trace_state_ptr trace_state);
     keyspace::config make_keyspace_config(const keyspace_metadata& ksm);
@@ -1342,11 +1712,11 @@ class database {
     std::unordered_set<sstring> get_initial_tokens();
     std::experimental::optional<gms::inet_address> get_replace_address();
     bool is_replacing();
-    semaphore& system_keyspace_read_concurrency_sem() {
+    reader_concurrency_semaphore& system_keyspace_read_concurrency_sem() {
         return _system_read_concurrency_sem;
     }
-    semaphore& sstable_load_concurrency_sem() {
-        return _sstable_load_concurrency_sem;
+    sstable_load_concurrency_controller& sstable_load_concurrency() {
+        return _sstable_load_concurrency;
     }
     void register_connection_drop_notifier(netw::messaging_service& ms);
 
@@ -1366,6 +1736,8 @@ class distributed_loader {
         const io_priority_class& pc = default_priority_class());
     static future<> load_new_sstables(distributed<database>& db, sstring ks, sstring cf, std::vector<sstables::entry_descriptor> new_tables);
     static future<std::vector<sstables::entry_descriptor>> flush_upload_dir(distributed<database>& db, sstring ks_name, sstring cf_name);
+    static future<std::vector<sstables::entry_descriptor>> get_upload_dir_sstables(distributed<database>& db, sstring ks_name, sstring cf_name);
+    static future<> remove_upload_dir_sstables(distributed<database>& db, sstring ks_name, sstring cf_name, std::vector<sstables::entry_descriptor> sstables);
     static future<sstables::entry_descriptor> probe_file(distributed<database>& db, sstring sstdir, sstring fname);
     static future<> populate_column_family(distributed<database>& db, sstring sstdir, sstring ks, sstring cf);
     static future<> populate_keyspace(distributed<database>& db, sstring datadir, sstring ks_name);
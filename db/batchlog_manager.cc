@@ -58,6 +58,7 @@
 #include "database.hh"
 #include "unimplemented.hh"
 #include "db/config.hh"
+#include "stdx.hh"
 #include "gms/failure_detector.hh"
 #include "service/storage_service.hh"
 #include "schema_registry.hh"
@@ -73,6 +74,7 @@ static logging::logger blogger("batchlog_manager");
 
 const uint32_t db::batchlog_manager::replay_interval;
 const uint32_t db::batchlog_manager::page_size;
+const size_t db::batchlog_manager::replay_concurrency;
 
 db::batchlog_manager::batchlog_manager(cql3::query_processor& qp)
         : _qp(qp)
@@ -181,27 +183,30 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
     // max rate is scaled by the number of nodes in the cluster (same as for HHOM - see CASSANDRA-5272).
     auto throttle_in_kb = _qp.db().local().get_config().batchlog_replay_throttle_in_kb() / service::get_storage_service().local().get_token_metadata().get_all_endpoints().size();
     auto limiter = make_lw_shared<utils::rate_limiter>(throttle_in_kb * 1000);
+    typedef ::shared_ptr<cql3::untyped_result_set> page_ptr;
 
-    auto batch = [this, limiter](const cql3::untyped_result_set::row& row) {
+    // Decodes the mutations of a batch which are left to replay, or nothing
+    // if the batch has to stay in the batchlog for now.
+    auto decode = [this] (const cql3::untyped_result_set::row& row) -> future<stdx::optional<std::vector<mutation>>> {
         auto written_at = row.get_as<db_clock::time_point>("written_at");
         auto id = row.get_as<utils::UUID>("id");
         // enough time for the actual write + batchlog entry mutation delivery (two separate requests).
         auto timeout = get_batch_log_timeout();
         if (db_clock::now() < written_at + timeout) {
             blogger.debug("Skipping replay of {}, too fresh", id);
-            return make_ready_future<>();
+            return make_ready_future<stdx::optional<std::vector<mutation>>>();
         }
 
         // check version of serialization format
         if (!row.has("version")) {
             blogger.warn("Skipping logged batch because of unknown version");
-            return make_ready_future<>();
+            return make_ready_future<stdx::optional<std::vector<mutation>>>();
         }
 
         auto version = row.get_as<int32_t>("version");
         if (version != netw::messaging_service::current_version) {
             blogger.warn("Skipping logged batch because of incorrect version");
-            return make_ready_future<>();
+            return make_ready_future<stdx::optional<std::vector<mutation>>>();
         }
 
         auto data = row.get_blob("data");
@@ -214,9 +219,7 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
             fms->emplace_back(ser::deserialize(in, boost::type<canonical_mutation>()));
         }
 
-        auto size = data.size();
-
-        return map_reduce(*fms, [this, written_at] (canonical_mutation& fm) {
+        return map_reduce(*fms, [written_at] (canonical_mutation& fm) {
             return system_keyspace::get_truncated_at(fm.column_family_id()).then([written_at, &fm] (db_clock::time_point t) ->
                     std::experimental::optional<std::reference_wrapper<canonical_mutation>> {
                 if (written_at > t) {
@@ -229,15 +232,16 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
         std::vector<mutation>(),
         [this] (std::vector<mutation> mutations, std::experimental::optional<std::reference_wrapper<canonical_mutation>> fm) {
             if (fm) {
-                schema_ptr s = _qp.db().local().find_schema(fm.value().get().column_family_id());
-                mutations.emplace_back(fm.value().get().to_mutation(s));
+                try {
+                    schema_ptr s = _qp.db().local().find_schema(fm.value().get().column_family_id());
+                    mutations.emplace_back(fm.value().get().to_mutation(s));
+                } catch (no_such_column_family&) {
+                    // The table was dropped since, there's nothing left to write to.
+                }
             }
             return mutations;
-        }).then([this, id, limiter, written_at, size, fms] (std::vector<mutation> mutations) {
-            if (mutations.empty()) {
-                return make_ready_future<>();
-            }
-            const auto ttl = [this, &mutations, written_at]() -> clock_type {
+        }).then([written_at, fms] (std::vector<mutation> mutations) {
+            const auto ttl = [&mutations, written_at]() -> clock_type {
                 /*
                  * Calculate ttl for the mutations' hints (and reduce ttl by the time the mutations spent in the batchlog).
                  * This ensures that deletes aren't "undone" by an old batch replay.
@@ -253,58 +257,129 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
             }();
 
             if (ttl <= 0) {
-                return make_ready_future<>();
+                mutations.clear();
             }
-            // Origin does the send manually, however I can't see a super great reason to do so.
-            // Our normal write path does not add much redundancy to the dispatch, and rate is handled after send
-            // in both cases.
-            // FIXME: verify that the above is reasonably true.
-            return limiter->reserve(size).then([this, mutations = std::move(mutations), id] {
-                _stats.write_attempts += mutations.size();
-                // #1222 - change cl level to ALL, emulating origins behaviour of sending/hinting
-                // to all natural end points.
-                // Note however that origin uses hints here, and actually allows for this
-                // send to partially or wholly fail in actually sending stuff. Since we don't
-                // have hints (yet), send with CL=ALL, and hope we can re-do this soon.
-                // See below, we use retry on write failure.
-                return _qp.proxy().local().mutate(mutations, db::consistency_level::ALL, nullptr);
-            });
-        }).then_wrapped([this, id](future<> batch_result) {
-            try {
-                batch_result.get();
-            } catch (no_such_keyspace& ex) {
-                // should probably ignore and drop the batch
-            } catch (...) {
-                // timeout, overload etc.
-                // Do _not_ remove the batch, assuning we got a node write error.
-                // Since we don't have hints (which origin is satisfied with),
-                // we have to resort to keeping this batch to next lap.
-                return make_ready_future<>();
+            return stdx::make_optional(std::move(mutations));
+        });
+    };
+
+    // Replays the batches of a page together: their mutations are merged by
+    // partition, so that each replica gets a single write per partition for
+    // all of them, and the replayed batches are then removed with a single
+    // write to the batchlog.
+    auto replay_page = [this, limiter, decode] (page_ptr page) {
+        struct page_replay {
+            std::vector<utils::UUID> ids;
+            size_t size = 0;
+            std::unordered_map<utils::UUID, std::map<dht::decorated_key, mutation, dht::decorated_key::less_comparator>> partitions;
+
+            void add(mutation m) {
+                auto s = m.schema();
+                auto& by_key = partitions.emplace(s->id(), std::map<dht::decorated_key, mutation, dht::decorated_key::less_comparator>(
+                        dht::decorated_key::less_comparator(s))).first->second;
+                auto it = by_key.find(m.decorated_key());
+                if (it == by_key.end()) {
+                    auto key = m.decorated_key();
+                    by_key.emplace(std::move(key), std::move(m));
+                } else {
+                    it->second.apply(std::move(m));
+                }
+            }
+            std::vector<mutation> release() {
+                std::vector<mutation> mutations;
+                for (auto&& by_key : partitions | boost::adaptors::map_values) {
+                    for (auto&& m : by_key | boost::adaptors::map_values) {
+                        mutations.emplace_back(std::move(m));
+                    }
+                }
+                partitions.clear();
+                return mutations;
             }
-            // delete batch
-            auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG);
-            auto key = partition_key::from_singular(*schema, id);
-            mutation m(key, schema);
-            auto now = service::client_state(service::client_state::internal_tag()).get_timestamp();
-            m.partition().apply_delete(*schema, clustering_key_prefix::make_empty(), tombstone(now, gc_clock::now()));
-            return _qp.proxy().local().mutate_locally(m);
+        };
+        return do_with(std::move(page), page_replay(), [this, limiter, decode] (page_ptr& page, page_replay& pr) {
+            return parallel_for_each(*page, [&pr, decode] (const cql3::untyped_result_set::row& row) {
+                return decode(row).then([&pr, &row] (stdx::optional<std::vector<mutation>> mutations) {
+                    if (!mutations) {
+                        return;
+                    }
+                    pr.ids.push_back(row.get_as<utils::UUID>("id"));
+                    pr.size += row.get_blob("data").size();
+                    for (auto&& m : *mutations) {
+                        pr.add(std::move(m));
+                    }
+                });
+            }).then([this, limiter, &pr] {
+                auto mutations = pr.release();
+                if (mutations.empty()) {
+                    return make_ready_future<>();
+                }
+                // Origin does the send manually, however I can't see a super great reason to do so.
+                // Our normal write path does not add much redundancy to the dispatch, and rate is handled after send
+                // in both cases.
+                // FIXME: verify that the above is reasonably true.
+                return limiter->reserve(pr.size).then([this, mutations = std::move(mutations)] () mutable {
+                    _stats.write_attempts += mutations.size();
+                    // #1222 - change cl level to ALL, emulating origins behaviour of sending/hinting
+                    // to all natural end points.
+                    // Note however that origin uses hints here, and actually allows for this
+                    // send to partially or wholly fail in actually sending stuff. Since we don't
+                    // have hints (yet), send with CL=ALL, and hope we can re-do this soon.
+                    // See below, we use retry on write failure.
+                    return _qp.proxy().local().mutate(std::move(mutations), db::consistency_level::ALL, nullptr);
+                });
+            }).then_wrapped([this, &pr] (future<> batch_result) {
+                try {
+                    batch_result.get();
+                } catch (no_such_keyspace& ex) {
+                    // should probably ignore and drop the batch
+                } catch (...) {
+                    // timeout, overload etc.
+                    // Do _not_ remove the batches, assuning we got a node write error.
+                    // Since we don't have hints (which origin is satisfied with),
+                    // we have to resort to keeping them to next lap.
+                    return make_ready_future<>();
+                }
+                // delete the batches, each is a partition of its own
+                auto schema = _qp.db().local().find_schema(system_keyspace::NAME, system_keyspace::BATCHLOG);
+                auto now = service::client_state(service::client_state::internal_tag()).get_timestamp();
+                std::vector<mutation> deletions;
+                deletions.reserve(pr.ids.size());
+                for (auto&& id : pr.ids) {
+                    deletions.emplace_back(partition_key::from_singular(*schema, id), schema);
+                    deletions.back().partition().apply(tombstone(now, gc_clock::now()));
+                }
+                _total_batches_replayed += pr.ids.size();
+                return _qp.proxy().local().mutate_locally(std::move(deletions));
+            });
         });
     };
 
-    return seastar::with_gate(_gate, [this, batch = std::move(batch)] {
+    return seastar::with_gate(_gate, [this, replay_page = std::move(replay_page)] {
         blogger.debug("Started replayAllFailedBatches (cpu {})", engine().cpu_id());
 
-        typedef ::shared_ptr<cql3::untyped_result_set> page_ptr;
+        // The next page is read while the previous ones are replayed, up to
+        // replay_concurrency of them.
+        auto pages_sem = make_lw_shared<semaphore>(replay_concurrency);
+        auto replay = [replay_page, pages_sem] (page_ptr page) {
+            return pages_sem->wait().then([replay_page, pages_sem, page = std::move(page)] () mutable {
+                replay_page(std::move(page)).handle_exception([] (auto ep) {
+                    blogger.warn("Failed to replay batches: {}", ep);
+                }).finally([pages_sem] {
+                    pages_sem->signal();
+                });
+            });
+        };
         sstring query = sprint("SELECT id, data, written_at, version FROM %s.%s LIMIT %d", system_keyspace::NAME, system_keyspace::BATCHLOG, page_size);
-        return _qp.execute_internal(query).then([this, batch = std::move(batch)](page_ptr page) {
-            return do_with(std::move(page), [this, batch = std::move(batch)](page_ptr & page) mutable {
-                return repeat([this, &page, batch = std::move(batch)]() mutable {
+        return _qp.execute_internal(query).then([this, replay](page_ptr page) {
+            return do_with(std::move(page), [this, replay](page_ptr & page) mutable {
+                return repeat([this, &page, replay]() mutable {
                     if (page->empty()) {
                         return make_ready_future<stop_iteration>(stop_iteration::yes);
                     }
                     auto id = page->back().get_as<utils::UUID>("id");
-                    return parallel_for_each(*page, batch).then([this, &page, id]() {
-                        if (page->size() < page_size) {
+                    auto exhausted = page->size() < page_size;
+                    return replay(std::move(page)).then([this, &page, id, exhausted]() {
+                        if (exhausted) {
                             return make_ready_future<stop_iteration>(stop_iteration::yes); // we've exhausted the batchlog, next query would be empty.
                         }
                         sstring query = sprint("SELECT id, data, written_at, version FROM %s.%s WHERE token(id) > token(?) LIMIT %d",
@@ -318,7 +393,7 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
                     });
                 });
             });
-        }).then([this] {
+        }).then([pages_sem] {
         // TODO FIXME : cleanup()
 #if 0
             ColumnFamilyStore cfs = Keyspace.open(SystemKeyspace.NAME).getColumnFamilyStore(SystemKeyspace.BATCHLOG);
@@ -330,7 +405,7 @@ future<> db::batchlog_manager::replay_all_failed_batches() {
             CompactionManager.instance.submitUserDefined(cfs, descriptors, Integer.MAX_VALUE).get();
 
 #endif
-
+            return pages_sem->wait(replay_concurrency);
         }).then([this] {
             blogger.debug("Finished replayAllFailedBatches");
         });
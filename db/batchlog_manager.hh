@@ -58,6 +58,7 @@ class batchlog_manager {
 private:
     static constexpr uint32_t replay_interval = 60 * 1000; // milliseconds
     static constexpr uint32_t page_size = 128; // same as HHOM, for now, w/out using any heuristics. TODO: set based on avg batch size.
+    static constexpr size_t replay_concurrency = 4; // pages replayed at the same time
 
     using clock_type = lowres_clock;
 
@@ -41,12 +41,17 @@
 #include <stdexcept>
 #include <string>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <fstream>
 #include <malloc.h>
 #include <regex>
 #include <boost/range/adaptor/map.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 #include <exception>
+#include <lz4.h>
 
 #include <core/align.hh>
 #include <core/reactor.hh>
@@ -68,6 +73,7 @@
 #include "rp_set.hh"
 #include "db/config.hh"
 #include "utils/data_input.hh"
+#include "bytes_ostream.hh"
 #include "utils/crc.hh"
 #include "utils/runtime.hh"
 #include "utils/flush_queue.hh"
@@ -117,7 +123,11 @@ db::commitlog::config::config(const db::config& cfg)
     , commitlog_total_space_in_mb(cfg.commitlog_total_space_in_mb() >= 0 ? cfg.commitlog_total_space_in_mb() : (memory::stats().total_memory() * smp::count) >> 20)
     , commitlog_segment_size_in_mb(cfg.commitlog_segment_size_in_mb())
     , commitlog_sync_period_in_ms(cfg.commitlog_sync_period_in_ms())
-    , mode(cfg.commitlog_sync() == "batch" ? sync_mode::BATCH : sync_mode::PERIODIC)
+    , reuse_segments(cfg.commitlog_reuse_segments())
+    , compress_segments(cfg.commitlog_compression())
+    , group_commit_bytes(cfg.commitlog_sync_group_size_in_kb() * 1024)
+    , group_commit_max_window_in_us(cfg.commitlog_sync_group_max_window_in_us())
+    , mode(cfg.commitlog_sync() == "batch" ? sync_mode::BATCH : cfg.commitlog_sync() == "group" ? sync_mode::GROUP : sync_mode::PERIODIC)
 {}
 
 db::commitlog::descriptor::descriptor(segment_id_type i, uint32_t v)
@@ -166,6 +176,7 @@ const std::string db::commitlog::descriptor::SEPARATOR("-");
 const std::string db::commitlog::descriptor::FILENAME_PREFIX(
         "CommitLog" + SEPARATOR);
 const std::string db::commitlog::descriptor::FILENAME_EXTENSION(".log");
+const std::string db::commitlog::descriptor::INDEX_EXTENSION(".idx");
 
 class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_manager> {
 public:
@@ -176,6 +187,9 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
     // Divide the size-on-disk threshold by #cpus used, since we assume
     // we distribute stuff more or less equally across shards.
     const uint64_t max_disk_size; // per-shard
+    // The size of the buffers entries are gathered in before being written,
+    // and of the fragments of larger entries.
+    const size_t buffer_size;
 
     bool _shutdown = false;
     std::experimental::optional<shared_promise<>> _shutdown_promise = {};
@@ -217,6 +231,11 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
         uint64_t bytes_slack = 0;
         uint64_t segments_created = 0;
         uint64_t segments_destroyed = 0;
+        uint64_t segments_recycled = 0;
+        uint64_t segments_reused = 0;
+        uint64_t group_syncs = 0;
+        uint64_t bytes_uncompressed = 0;
+        uint64_t bytes_compressed = 0;
         uint64_t pending_flushes = 0;
         uint64_t flush_limit_exceeded = 0;
         uint64_t total_size = 0;
@@ -243,6 +262,26 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
         _flush_semaphore.signal();
         --totals.pending_flushes;
     }
+
+    // Moving average of the time the file flushes take, which the group
+    // commit window follows.
+    std::chrono::steady_clock::duration _flush_latency = std::chrono::steady_clock::duration::zero();
+
+    void update_flush_latency(std::chrono::steady_clock::duration d) {
+        if (_flush_latency == std::chrono::steady_clock::duration::zero()) {
+            _flush_latency = d;
+        } else {
+            _flush_latency += (d - _flush_latency) / 8;
+        }
+    }
+    // Waiting about half a flush before starting one lets the writes which
+    // arrive meanwhile share it, for a fraction of the flush latency added
+    // to each write. The bound keeps a slow device from stalling writes.
+    std::chrono::microseconds group_commit_window() const {
+        auto w = std::chrono::duration_cast<std::chrono::microseconds>(_flush_latency / 2);
+        return std::max(std::chrono::microseconds(cfg.group_commit_min_window_in_us),
+                        std::min(w, std::chrono::microseconds(cfg.group_commit_max_window_in_us)));
+    }
     segment_manager(config c);
     ~segment_manager() {
         clogger.trace("Commitlog {} disposed", cfg.commit_log_location);
@@ -266,6 +305,10 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
     future<sseg_ptr> new_segment();
     future<sseg_ptr> active_segment(commitlog::timeout_clock::time_point timeout);
     future<sseg_ptr> allocate_segment(bool active);
+    // Keeps the file of a segment which is no longer needed for reuse, or
+    // deletes it. used is the number of bytes written to it.
+    void recycle_segment_file(const sstring& file_name, size_t used) noexcept;
+    void delete_segment_index(const sstring& file_name) noexcept;
 
     future<> clear();
     future<> sync_all_segments(bool shutdown = false);
@@ -295,7 +338,9 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
     buffer_type acquire_buffer(size_t s);
     void release_buffer(buffer_type&&);
 
-    future<std::vector<descriptor>> list_descriptors(sstring dir);
+    // Segments kept for reuse, which are left behind by a crash, are added
+    // to recycled, if given.
+    future<std::vector<descriptor>> list_descriptors(sstring dir, std::vector<descriptor>* recycled = nullptr);
 
     flush_handler_id add_flush_handler(flush_handler h) {
         auto id = ++_flush_ids;
@@ -311,10 +356,24 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
 private:
     future<> clear_reserve_segments();
 
+    // Clean segments are renamed to recycled_prefix + their name, and become
+    // new segments again once the part written to was zeroed, so that
+    // neither their creation nor the first writes to them need to allocate
+    // space in the file system.
+    struct recycled_segment {
+        sstring file_name;
+        size_t used;
+    };
+    static const sstring recycled_prefix;
+    future<file> create_segment_file(sstring file_name);
+    future<file> reuse_segment_file(recycled_segment r, sstring file_name);
+    void delete_recycled_segments() noexcept;
+
     size_t max_request_controller_units() const;
     segment_id_type _ids = 0;
     std::vector<sseg_ptr> _segments;
     queue<sseg_ptr> _reserve_segments;
+    std::deque<recycled_segment> _recycled_segments;
     std::vector<buffer_type> _temp_buffers;
     std::unordered_map<flush_handler_id, flush_handler> _flush_handlers;
     flush_handler_id _flush_ids = 0;
@@ -346,6 +405,8 @@ class db::commitlog::segment_manager : public ::enable_shared_from_this<segment_
  *        Note that the write lock is released prior to issuing the
  *        actual file flush, thus we are allowed to write data to
  *        after a flush point concurrently with a pending flush.
+ *  - In "group" mode, the writes wait for a sync started once enough of
+ *    them are waiting, or when a window following the flush latency expires
  *
  * Sync timer:
  *  - In periodic mode, we try to primarily issue sync calls in
@@ -377,10 +438,16 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     descriptor _desc;
     file _file;
     sstring _file_name;
+    // The alignment of the writes to the file, which the device may allow
+    // to be finer than that of the buffers, for less slack to write.
+    size_t _alignment;
 
     uint64_t _file_pos = 0;
     uint64_t _flush_pos = 0;
     uint64_t _buf_pos = 0;
+    // The position of the buffer in the segment as its entries see it, which
+    // is the file position unless the segment is compressed.
+    uint64_t _logical_pos = 0;
     bool _closed = false;
 
     using buffer_type = segment_manager::buffer_type;
@@ -389,7 +456,16 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     using time_point = segment_manager::time_point;
 
     buffer_type _buffer;
+    // The rest of the buffer, when it holds an entry too large for
+    // buffer_size. It is then kept in fragments of buffer_size, written
+    // to the file consecutively, so that large entries don't need a
+    // contiguous buffer of their size.
+    std::vector<buffer_type> _buffer_tail;
     std::unordered_map<cf_id_type, uint64_t> _cf_dirty;
+    // The positions of the first and last entries of each table, for
+    // the segment index.
+    std::unordered_map<cf_id_type, std::pair<position_type, position_type>> _cf_positions;
+    bool _indexed = false;
     time_point _sync_time;
     seastar::gate _gate;
     uint64_t _write_waiters = 0;
@@ -397,6 +473,19 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
     uint64_t _num_allocs = 0;
 
+    // GROUP mode: the writes waiting for the next sync of the segment.
+    struct group_sync_waiters {
+        promise<> done;
+        shared_future<with_clock<commitlog::timeout_clock>> synced;
+        group_sync_waiters() : synced(done.get_future()) {}
+    };
+    std::unique_ptr<group_sync_waiters> _group_waiters;
+    uint64_t _group_bytes = 0;
+    timer<> _group_timer;
+
+    // The schema versions whose column mappings were written to the segment.
+    // Each is written once, by the first entry of that version, and the
+    // following entries refer to it by the version they carry.
     std::unordered_set<table_schema_version> _known_schema_versions;
 
     friend std::ostream& operator<<(std::ostream&, const segment&);
@@ -423,7 +512,14 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     static constexpr size_t entry_overhead_size = 3 * sizeof(uint32_t);
     static constexpr size_t segment_overhead_size = 2 * sizeof(uint32_t);
     static constexpr size_t descriptor_header_size = 5 * sizeof(uint32_t);
+    // Following the chunk header in compressed segments (int: logical position
+    // of the data + int: data size + int: compressed size, zero if stored as is
+    // + int: checksum [these + compressed data])
+    static constexpr size_t compressed_chunk_header_size = 4 * sizeof(uint32_t);
+    static constexpr uint32_t compressed_version = 2;
     static constexpr uint32_t segment_magic = ('S'<<24) |('C'<< 16) | ('L' << 8) | 'C';
+    static constexpr uint32_t segment_index_magic = ('S'<<24) |('C'<< 16) | ('L' << 8) | 'I';
+    static constexpr uint32_t segment_index_version = 1;
 
     // The commit log (chained) sync marker/header size in bytes (int: length + int: checksum [segmentId, position])
     static constexpr size_t sync_marker_size = 2 * sizeof(uint32_t);
@@ -434,24 +530,28 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
 
     segment(::shared_ptr<segment_manager> m, const descriptor& d, file && f, bool active)
             : _segment_manager(std::move(m)), _desc(std::move(d)), _file(std::move(f)),
-        _file_name(_segment_manager->cfg.commit_log_location + "/" + _desc.filename()), _sync_time(
+        _file_name(_segment_manager->cfg.commit_log_location + "/" + _desc.filename()),
+        _alignment(std::min<size_t>(alignment, _file.disk_write_dma_alignment())), _sync_time(
                     clock_type::now()), _pending_ops(true) // want exception propagation
     {
+        _group_timer.set_callback([this] {
+            sync().discard_result().handle_exception([] (auto ex) {
+                clogger.error("Failed to flush commits to disk: {}", ex);
+            });
+        });
         ++_segment_manager->totals.segments_created;
         clogger.debug("Created new {} segment {}", active ? "active" : "reserve", *this);
     }
     ~segment() {
         if (is_clean()) {
-            clogger.debug("Segment {} is no longer active and will be deleted now", *this);
+            clogger.debug("Segment {} is no longer active and will be recycled or deleted now", *this);
             ++_segment_manager->totals.segments_destroyed;
             _segment_manager->totals.total_size_on_disk -= size_on_disk();
             _segment_manager->totals.total_size -= (size_on_disk() + _buffer.size());
-            try {
-                commit_io_check([] (const char* fname) { ::unlink(fname); },
-                        _file_name.c_str());
-            } catch (...) {
-                clogger.error("Could not delete segment {}: {}", *this, std::current_exception());
+            if (_indexed) {
+                _segment_manager->delete_segment_index(_file_name);
             }
+            _segment_manager->recycle_segment_file(_file_name, size_on_disk());
         } else {
             clogger.warn("Segment {} is dirty and is left on disk.", *this);
         }
@@ -463,9 +563,6 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     void add_schema_version(schema_ptr s) {
         _known_schema_versions.emplace(s->version());
     }
-    void forget_schema_versions() {
-        _known_schema_versions.clear();
-    }
 
     void release_cf_count(const cf_id_type& cf) override {
         mark_clean(cf, 1);
@@ -475,7 +572,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     }
 
     bool must_sync() {
-        if (_segment_manager->cfg.mode == sync_mode::BATCH) {
+        if (_segment_manager->cfg.mode != sync_mode::PERIODIC) {
             return false;
         }
         auto now = clock_type::now();
@@ -492,9 +589,57 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
      */
     future<sseg_ptr> finish_and_get_new(commitlog::timeout_clock::time_point timeout) {
         _closed = true;
-        sync();
+        sync().then([] (sseg_ptr s) {
+            return s->write_index();
+        }).handle_exception([] (auto ex) {
+            clogger.warn("Could not sync and index closed segment: {}", ex);
+        });
         return _segment_manager->active_segment(timeout);
     }
+    /**
+     * Writes the index of the segment, once it takes no more entries
+     * and they are all on disk. Replaying a segment without an index, or
+     * with a broken one, just means reading all of it.
+     *
+     * Format: int: magic + int: version + long: segment id + int: number of
+     * tables, then for each table long, long: id + int: first position +
+     * int: last position, and int: checksum [all of the above].
+     */
+    future<> write_index() {
+        if (is_clean() || _indexed) {
+            return make_ready_future<>();
+        }
+        auto size = 5 * sizeof(uint32_t) + _cf_positions.size() * (2 * sizeof(uint64_t) + 2 * sizeof(uint32_t)) + sizeof(uint32_t);
+        temporary_buffer<char> buf(size);
+        data_output out(buf.get_write(), size);
+        out.write(segment_index_magic);
+        out.write(segment_index_version);
+        out.write(_desc.id);
+        out.write(uint32_t(_cf_positions.size()));
+        for (auto&& p : _cf_positions) {
+            out.write(p.first.get_most_significant_bits());
+            out.write(p.first.get_least_significant_bits());
+            out.write(uint32_t(p.second.first));
+            out.write(uint32_t(p.second.second));
+        }
+        crc32_nbo crc;
+        crc.process_bytes(buf.get(), size - sizeof(uint32_t));
+        out.write(crc.checksum());
+
+        // Set first, so that the index is deleted with the segment
+        // even if writing it fails halfway.
+        _indexed = true;
+        auto me = shared_from_this();
+        auto name = commitlog::segment_index_file_name(_file_name);
+        return open_checked_file_dma(commit_error_handler, name, open_flags::wo | open_flags::create | open_flags::truncate).then([me, buf = std::move(buf)] (file f) mutable {
+            auto out = make_lw_shared<output_stream<char>>(make_file_output_stream(std::move(f)));
+            return out->write(buf.get(), buf.size()).then([out] {
+                return out->flush();
+            }).finally([out] {
+                return out->close().finally([out] {});
+            });
+        });
+    }
     void reset_sync_time() {
         _sync_time = clock_type::now();
     }
@@ -515,6 +660,12 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
                     // When we get here, nothing should add ops,
                     // and we should have waited out all pending.
                     return me->_pending_ops.close();
+                }).then([] (sseg_ptr s) {
+                    return s->write_index().handle_exception([] (auto ex) {
+                        clogger.warn("Could not index segment: {}", ex);
+                    }).then([s] {
+                        return s;
+                    });
                 });
             });
         }
@@ -522,8 +673,28 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         // Note: this is not a marker for when sync was finished.
         // It is when it was initiated
         reset_sync_time();
+        if (_group_waiters) {
+            return group_sync();
+        }
         return cycle(true);
     }
+    // Syncs the segment for the writes waiting in GROUP mode, which the
+    // writes coming after them won't wait for anymore.
+    future<sseg_ptr> group_sync() {
+        _group_timer.cancel();
+        auto waiters = std::move(_group_waiters);
+        _group_bytes = 0;
+        ++_segment_manager->totals.group_syncs;
+        return cycle(true).then_wrapped([waiters = std::move(waiters)] (future<sseg_ptr> f) {
+            if (f.failed()) {
+                auto ep = f.get_exception();
+                waiters->done.set_exception(ep);
+                return make_exception_future<sseg_ptr>(ep);
+            }
+            waiters->done.set_value();
+            return std::move(f);
+        });
+    }
     // See class comment for info
     future<sseg_ptr> flush(uint64_t pos = 0) {
         auto me = shared_from_this();
@@ -552,9 +723,11 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
                 clogger.trace("{} already synced! ({} < {})", *this, pos, _flush_pos);
                 return make_ready_future<>();
             }
-            return _file.flush().then_wrapped([this, pos](future<> f) {
+            auto start = std::chrono::steady_clock::now();
+            return _file.flush().then_wrapped([this, pos, start](future<> f) {
                 try {
                     f.get();
+                    _segment_manager->update_flush_latency(std::chrono::steady_clock::now() - start);
                     // TODO: retry/ignore/fail/stop - optional behaviour in origin.
                     // we fast-fail the whole commit.
                     _flush_pos = std::max(pos, _flush_pos);
@@ -578,15 +751,33 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     void new_buffer(size_t s) {
         assert(_buffer.empty());
 
-        auto overhead = segment_overhead_size;
-        if (_file_pos == 0) {
-            overhead += descriptor_header_size;
-        }
+        auto overhead = chunk_overhead_size();
 
+        auto buffer_size = _segment_manager->buffer_size;
         auto a = align_up(s + overhead, alignment);
-        auto k = std::max(a, default_size);
+        auto k = std::max(a, buffer_size);
+
+        if (k > buffer_size) {
+            auto acquire_fragment = [this] (size_t size) {
+                auto buf = _segment_manager->acquire_buffer(size);
+                buf.trim(size);
+                return buf;
+            };
+            try {
+                _buffer = acquire_fragment(buffer_size);
+                for (auto left = k - buffer_size; left;) {
+                    auto now = std::min(left, buffer_size);
+                    _buffer_tail.push_back(acquire_fragment(now));
+                    left -= now;
+                }
+            } catch (...) {
+                _buffer = {};
+                _buffer_tail.clear();
+                throw;
+            }
+        }
 
-        for (;;) {
+        while (_buffer.empty()) {
             try {
                 _buffer = _segment_manager->acquire_buffer(k);
                 break;
@@ -606,6 +797,155 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         _segment_manager->totals.total_size += k;
     }
 
+    // Space left in the buffer for new entries. A buffer holding a large
+    // entry in fragments has none.
+    size_t buffer_space_left() const {
+        return _buffer_tail.empty() ? _buffer.size() - _buf_pos : 0;
+    }
+
+    // Copies data to the buffer, at the given position from its beginning,
+    // across fragments if any.
+    void write_to_buffer(size_t pos, const char* data, size_t size) {
+        auto frag = &_buffer;
+        auto next = _buffer_tail.begin();
+        while (size) {
+            if (pos >= frag->size()) {
+                pos -= frag->size();
+                frag = &*next++;
+                continue;
+            }
+            auto now = std::min(size, frag->size() - pos);
+            std::copy_n(data, now, frag->get_write() + pos);
+            data += now;
+            size -= now;
+            pos += now;
+        }
+    }
+
+    // Writes an entry of the given size, with its overhead, to the
+    // fragmented buffer at pos.
+    void write_fragmented_entry(size_t pos, size_t size, entry_writer& writer) {
+        bytes_ostream data;
+        writer.write(*this, data);
+        assert(data.size() == size);
+
+        const uint32_t s = size + entry_overhead_size;
+        crc32_nbo crc;
+        char header[2 * sizeof(uint32_t)];
+        data_output out(header, sizeof(header));
+        out.write(s);
+        crc.process(s);
+        out.write(crc.checksum());
+        write_to_buffer(pos, header, sizeof(header));
+        pos += sizeof(header);
+
+        for (bytes_view frag : data) {
+            auto p = reinterpret_cast<const char*>(frag.data());
+            crc.process_bytes(p, frag.size());
+            write_to_buffer(pos, p, frag.size());
+            pos += frag.size();
+        }
+
+        char tail[sizeof(uint32_t)];
+        out = data_output(tail, sizeof(tail));
+        out.write(crc.checksum());
+        write_to_buffer(pos, tail, sizeof(tail));
+    }
+
+    future<> write_fragment(uint64_t off, const char* p, size_t size) {
+        auto written = make_lw_shared<size_t>(0);
+        return repeat([this, size, off, written, p]() mutable {
+            auto&& priority_class = service::get_local_commitlog_priority();
+            return _file.dma_write(off + *written, p + *written, size - *written, priority_class).then_wrapped([this, size, written](future<size_t>&& f) {
+                try {
+                    auto bytes = std::get<0>(f.get());
+                    *written += bytes;
+                    _segment_manager->totals.bytes_written += bytes;
+                    _segment_manager->totals.total_size_on_disk += bytes;
+                    ++_segment_manager->totals.cycle_count;
+                    if (*written == size) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    // gah, partial write. should always get here with dma chunk sized
+                    // "bytes", but lets make sure...
+                    clogger.debug("Partial write {}: {}/{} bytes", *this, *written, size);
+                    *written = align_down(*written, _alignment);
+                    return make_ready_future<stop_iteration>(stop_iteration::no);
+                    // TODO: retry/ignore/fail/stop - optional behaviour in origin.
+                    // we fast-fail the whole commit.
+                } catch (...) {
+                    clogger.error("Failed to persist commits to disk for {}: {}", *this, std::current_exception());
+                    throw;
+                }
+            });
+        });
+    }
+
+    bool compressed() const {
+        return _desc.ver == compressed_version;
+    }
+
+    size_t chunk_overhead_size() const {
+        auto overhead = segment_overhead_size;
+        if (compressed()) {
+            overhead += compressed_chunk_header_size;
+        }
+        if (_file_pos == 0) {
+            overhead += descriptor_header_size;
+        }
+        return overhead;
+    }
+
+    /**
+     * Replaces the entries in the buffer with their LZ4 compressed form,
+     * if that takes fewer blocks, and fills in the compressed chunk header.
+     * The chunk header and file header are left for cycle().
+     */
+    void compress_buffer() {
+        auto data_start = chunk_overhead_size();
+        auto header_pos = data_start - compressed_chunk_header_size;
+        uint32_t logical_start = _logical_pos + data_start;
+        uint32_t data_size = _buf_pos - data_start;
+        uint32_t compressed_size = 0;
+
+        // Large entries, in fragments, are stored as is.
+        if (_buffer_tail.empty()) {
+            auto max = LZ4_compressBound(data_size);
+            auto cbuf = _segment_manager->acquire_buffer(align_up<size_t>(data_start + max, alignment));
+#ifdef HAVE_LZ4_COMPRESS_DEFAULT
+            auto len = LZ4_compress_default(_buffer.get() + data_start, cbuf.get_write() + data_start, data_size, max);
+#else
+            auto len = LZ4_compress(_buffer.get() + data_start, cbuf.get_write() + data_start, data_size);
+#endif
+            if (len > 0 && align_up<size_t>(data_start + len, _alignment) < align_up<size_t>(_buf_pos, _alignment)) {
+                std::fill_n(cbuf.get_write(), data_start, 0);
+                cbuf.trim(align_up<size_t>(data_start + len, _alignment));
+                std::swap(_buffer, cbuf);
+                compressed_size = len;
+                // The memory which was accounted for the entries as they were
+                // won't be written.
+                _segment_manager->notify_memory_written(_buf_pos - (data_start + len));
+                _buf_pos = data_start + len;
+            }
+            _segment_manager->release_buffer(std::move(cbuf));
+        }
+
+        crc32_nbo crc;
+        crc.process(logical_start);
+        crc.process(data_size);
+        crc.process(compressed_size);
+        crc.process_bytes(_buffer.get() + data_start, compressed_size);
+
+        data_output out(_buffer.get_write() + header_pos, compressed_chunk_header_size);
+        out.write(logical_start);
+        out.write(data_size);
+        out.write(compressed_size);
+        out.write(crc.checksum());
+
+        _segment_manager->totals.bytes_uncompressed += data_size;
+        _segment_manager->totals.bytes_compressed += compressed_size ? compressed_size : data_size;
+    }
+
     bool buffer_is_empty() const {
         return _buf_pos <= segment_overhead_size
                         || (_file_pos == 0 && _buf_pos <= (segment_overhead_size + descriptor_header_size));
@@ -619,13 +959,20 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
             return flush_after ? flush() : make_ready_future<sseg_ptr>(shared_from_this());
         }
 
+        auto logical_size = _buf_pos;
+        if (compressed()) {
+            compress_buffer();
+        }
+
         auto size = clear_buffer_slack();
         auto buf = std::move(_buffer);
+        auto tail = std::exchange(_buffer_tail, {});
         auto off = _file_pos;
         auto top = off + size;
         auto num = _num_allocs;
 
         _file_pos = top;
+        _logical_pos += compressed() ? logical_size : size;
         _buf_pos = 0;
         _num_allocs = 0;
 
@@ -661,43 +1008,28 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         out.write(uint32_t(_file_pos));
         out.write(crc.checksum());
 
-        forget_schema_versions();
-
         replay_position rp(_desc.id, position_type(off));
 
         clogger.trace("Writing {} entries, {} k in {} -> {}", num, size, off, off + size);
 
         // The write will be allowed to start now, but flush (below) must wait for not only this,
         // but all previous write/flush pairs.
-        return _pending_ops.run_with_ordered_post_op(rp, [this, size, off, buf = std::move(buf)]() mutable {
-                auto written = make_lw_shared<size_t>(0);
-                auto p = buf.get();
-                return repeat([this, size, off, written, p]() mutable {
-                    auto&& priority_class = service::get_local_commitlog_priority();
-                    return _file.dma_write(off + *written, p + *written, size - *written, priority_class).then_wrapped([this, size, written](future<size_t>&& f) {
-                        try {
-                            auto bytes = std::get<0>(f.get());
-                            *written += bytes;
-                            _segment_manager->totals.bytes_written += bytes;
-                            _segment_manager->totals.total_size_on_disk += bytes;
-                            ++_segment_manager->totals.cycle_count;
-                            if (*written == size) {
-                                return make_ready_future<stop_iteration>(stop_iteration::yes);
-                            }
-                            // gah, partial write. should always get here with dma chunk sized
-                            // "bytes", but lets make sure...
-                            clogger.debug("Partial write {}: {}/{} bytes", *this, *written, size);
-                            *written = align_down(*written, alignment);
-                            return make_ready_future<stop_iteration>(stop_iteration::no);
-                            // TODO: retry/ignore/fail/stop - optional behaviour in origin.
-                            // we fast-fail the whole commit.
-                        } catch (...) {
-                            clogger.error("Failed to persist commits to disk for {}: {}", *this, std::current_exception());
-                            throw;
-                        }
-                    });
-                }).finally([this, buf = std::move(buf), size]() mutable {
-                    _segment_manager->release_buffer(std::move(buf));
+        return _pending_ops.run_with_ordered_post_op(rp, [this, size, off, buf = std::move(buf), tail = std::move(tail)]() mutable {
+                auto bufs = make_lw_shared<std::vector<buffer_type>>();
+                bufs->reserve(tail.size() + 1);
+                bufs->push_back(std::move(buf));
+                std::move(tail.begin(), tail.end(), std::back_inserter(*bufs));
+                auto pos = make_lw_shared<size_t>(0);
+                // Fragments are written one after another, each where the previous one ends.
+                return do_for_each(*bufs, [this, size, off, pos] (const buffer_type& b) {
+                    auto len = std::min(b.size(), size - *pos);
+                    auto frag_off = off + *pos;
+                    *pos += len;
+                    return write_fragment(frag_off, b.get(), len);
+                }).finally([this, bufs, size]() mutable {
+                    for (auto&& b : *bufs) {
+                        _segment_manager->release_buffer(std::move(b));
+                    }
                     _segment_manager->notify_memory_written(size);
                 });
         }, [me, flush_after, top, rp] { // lambda instead of bind, so we keep "me" alive.
@@ -743,6 +1075,39 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         });
     }
 
+    future<sseg_ptr> group_cycle(size_t size, timeout_clock::time_point timeout) {
+        /**
+         * For group mode we wait for a sync shared with the writes
+         * around us. It starts when enough data is waiting for it, or
+         * when the window, which lets a sync's worth of writes gather,
+         * expires.
+         */
+        if (!_group_waiters) {
+            _group_waiters = std::make_unique<group_sync_waiters>();
+            _group_timer.arm(_segment_manager->group_commit_window());
+        }
+        auto me = shared_from_this();
+        auto f = _group_waiters->synced.get_future(timeout);
+        _group_bytes += size;
+        if (_group_bytes >= _segment_manager->cfg.group_commit_bytes) {
+            // The waiters get the error, if any.
+            sync().discard_result().handle_exception([] (auto ex) {});
+        }
+        return f.then([me = std::move(me)] {
+            return make_ready_future<sseg_ptr>(me);
+        }).handle_exception([me](auto p) {
+            // Keep the segment open if we only timed out waiting,
+            // the sync is still going.
+            try {
+                std::rethrow_exception(p);
+            } catch (timed_out_error&) {
+            } catch (...) {
+                me->_closed = true;
+            }
+            return make_exception_future<sseg_ptr>(p);
+        });
+    }
+
     /**
      * Add a "mutation" to the segment.
      */
@@ -765,7 +1130,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
             return finish_and_get_new(timeout).then([id, writer = std::move(writer), permit = std::move(permit), timeout] (auto new_seg) mutable {
                 return new_seg->allocate(id, std::move(writer), std::move(permit), timeout);
             });
-        } else if (!_buffer.empty() && (s > (_buffer.size() - _buf_pos))) {  // enough data?
+        } else if (!_buffer.empty() && (s > buffer_space_left())) {  // enough data?
             if (_segment_manager->cfg.mode == sync_mode::BATCH) {
                 // TODO: this could cause starvation if we're really unlucky.
                 // If we run batch mode and find ourselves not fit in a non-empty
@@ -795,26 +1160,32 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         auto pos = _buf_pos;
         _buf_pos += s;
         _cf_dirty[id]++; // increase use count for cf.
+        auto& positions = _cf_positions.emplace(id, std::make_pair(rp.pos, rp.pos)).first->second;
+        positions.second = rp.pos;
 
         rp_handle h(static_pointer_cast<cf_holder>(shared_from_this()), std::move(id), rp);
 
-        auto * p = _buffer.get_write() + pos;
-        auto * e = _buffer.get_write() + pos + s - sizeof(uint32_t);
+        if (!_buffer_tail.empty()) {
+            write_fragmented_entry(pos, size, *writer);
+        } else {
+            auto * p = _buffer.get_write() + pos;
+            auto * e = _buffer.get_write() + pos + s - sizeof(uint32_t);
 
-        data_output out(p, e);
-        crc32_nbo crc;
+            data_output out(p, e);
+            crc32_nbo crc;
 
-        out.write(uint32_t(s));
-        crc.process(uint32_t(s));
-        out.write(crc.checksum());
+            out.write(uint32_t(s));
+            crc.process(uint32_t(s));
+            out.write(crc.checksum());
 
-        // actual data
-        writer->write(*this, out);
+            // actual data
+            writer->write(*this, out);
 
-        crc.process_bytes(p + 2 * sizeof(uint32_t), size);
+            crc.process_bytes(p + 2 * sizeof(uint32_t), size);
 
-        out = data_output(e, sizeof(uint32_t));
-        out.write(crc.checksum());
+            out = data_output(e, sizeof(uint32_t));
+            out.write(crc.checksum());
+        }
 
         ++_segment_manager->totals.allocation_count;
         ++_num_allocs;
@@ -825,11 +1196,20 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
             return batch_cycle(timeout).then([h = std::move(h)](auto s) mutable {
                 return make_ready_future<rp_handle>(std::move(h));
             });
+        } else if (_segment_manager->cfg.mode == sync_mode::GROUP) {
+            if ((_buf_pos >= _segment_manager->buffer_size)) {
+                cycle().discard_result().handle_exception([] (auto ex) {
+                    clogger.error("Failed to flush commits to disk: {}", ex);
+                });
+            }
+            return group_cycle(s, timeout).then([h = std::move(h)](auto s) mutable {
+                return make_ready_future<rp_handle>(std::move(h));
+            });
         } else {
             // If this buffer alone is too big, potentially bigger than the maximum allowed size,
             // then no other request will be allowed in to force the cycle()ing of this buffer. We
             // have to do it ourselves.
-            if ((_buf_pos >= (db::commitlog::segment::default_size))) {
+            if ((_buf_pos >= _segment_manager->buffer_size)) {
                 cycle().discard_result().handle_exception([] (auto ex) {
                     clogger.error("Failed to flush commits to disk: {}", ex);
                 });
@@ -839,7 +1219,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     }
 
     position_type position() const {
-        return position_type(_file_pos + _buf_pos);
+        return position_type(_logical_pos + _buf_pos);
     }
 
     size_t size_on_disk() const {
@@ -849,9 +1229,9 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
     // ensures no more of this segment is writeable, by allocating any unused section at the end and marking it discarded
     // a.k.a. zero the tail.
     size_t clear_buffer_slack() {
-        auto size = align_up(_buf_pos, alignment);
-        std::fill(_buffer.get_write() + _buf_pos, _buffer.get_write() + size,
-                0);
+        auto size = align_up<size_t>(_buf_pos, _alignment);
+        static const std::array<char, alignment> zeros{};
+        write_to_buffer(_buf_pos, zeros.data(), size - _buf_pos);
         _segment_manager->totals.bytes_slack += (size - _buf_pos);
         _segment_manager->account_memory_usage(size - _buf_pos);
         return size;
@@ -882,7 +1262,7 @@ class db::commitlog::segment : public enable_shared_from_this<segment>, public c
         return !is_still_allocating() && is_clean();
     }
     bool is_flushed() const {
-        return position() <= _flush_pos;
+        return _file_pos + _buf_pos <= _flush_pos;
     }
     bool can_delete() const {
         return is_unused() && is_flushed();
@@ -919,6 +1299,34 @@ db::commitlog::segment_manager::allocate_when_possible(const cf_id_type& id, sha
 
 const size_t db::commitlog::segment::default_size;
 
+// The size of the commitlog buffers: the default, unless the device holding
+// dir reports an optimal write size, like the stripe width of a RAID, in
+// which case at least one such write.
+static size_t commitlog_buffer_size(const sstring& dir) {
+    static constexpr size_t max_buffer_size = 1024 * 1024;
+    auto size = db::commitlog::segment::default_size;
+
+    struct stat st;
+    if (::stat(dir.c_str(), &st) == -1) {
+        return size;
+    }
+    auto dev = sprint("/sys/dev/block/{}:{}", major(st.st_dev), minor(st.st_dev));
+    // Partitions have the queue of their disk.
+    for (auto&& path : { dev + "/queue/optimal_io_size", dev + "/../queue/optimal_io_size" }) {
+        std::ifstream f(path);
+        size_t optimal;
+        if (f >> optimal) {
+            if (optimal && optimal % db::commitlog::segment::alignment == 0 && optimal <= max_buffer_size) {
+                // Not necessarily a power of two.
+                size = (size + optimal - 1) / optimal * optimal;
+                clogger.debug("Commitlog buffer size {} for an optimal write size of {}", size, optimal);
+            }
+            break;
+        }
+    }
+    return size;
+}
+
 db::commitlog::segment_manager::segment_manager(config c)
     : cfg([&c] {
         config cfg(c);
@@ -943,6 +1351,7 @@ db::commitlog::segment_manager::segment_manager(config c)
     , max_size(std::min<size_t>(std::numeric_limits<position_type>::max(), std::max<size_t>(cfg.commitlog_segment_size_in_mb, 1) * 1024 * 1024))
     , max_mutation_size(max_size >> 1)
     , max_disk_size(size_t(std::ceil(cfg.commitlog_total_space_in_mb / double(smp::count))) * 1024 * 1024)
+    , buffer_size(commitlog_buffer_size(cfg.commit_log_location))
     , _flush_semaphore(cfg.max_active_flushes)
     // That is enough concurrency to allow for our largest mutation (max_mutation_size), plus
     // an existing in-flight buffer. Since we'll force the cycling() of any buffer that is bigger
@@ -962,7 +1371,7 @@ db::commitlog::segment_manager::segment_manager(config c)
 }
 
 size_t db::commitlog::segment_manager::max_request_controller_units() const {
-    return max_mutation_size + db::commitlog::segment::default_size;
+    return max_mutation_size + buffer_size;
 }
 
 future<> db::commitlog::segment_manager::replenish_reserve() {
@@ -988,12 +1397,13 @@ future<> db::commitlog::segment_manager::replenish_reserve() {
 }
 
 future<std::vector<db::commitlog::descriptor>>
-db::commitlog::segment_manager::list_descriptors(sstring dirname) {
+db::commitlog::segment_manager::list_descriptors(sstring dirname, std::vector<descriptor>* recycled) {
     struct helper {
         sstring _dirname;
         file _file;
         subscription<directory_entry> _list;
         std::vector<db::commitlog::descriptor> _result;
+        std::vector<db::commitlog::descriptor> _recycled;
 
         helper(helper&&) = default;
         helper(sstring n, file && f)
@@ -1011,9 +1421,14 @@ db::commitlog::segment_manager::list_descriptors(sstring dirname) {
                 return make_ready_future<std::experimental::optional<directory_entry_type>>(de.type);
             };
             return entry_type(de).then([this, de](std::experimental::optional<directory_entry_type> type) {
-                if (type == directory_entry_type::regular && de.name[0] != '.' && !is_cassandra_segment(de.name)) {
+                if (type == directory_entry_type::regular && de.name[0] != '.' && !is_cassandra_segment(de.name)
+                        && !boost::ends_with(de.name, descriptor::INDEX_EXTENSION)) {
                     try {
-                        _result.emplace_back(de.name);
+                        if (boost::starts_with(de.name, recycled_prefix)) {
+                            _recycled.emplace_back(de.name.substr(recycled_prefix.size()));
+                        } else {
+                            _result.emplace_back(de.name);
+                        }
                     } catch (std::domain_error& e) {
                         clogger.warn(e.what());
                     }
@@ -1038,20 +1453,33 @@ db::commitlog::segment_manager::list_descriptors(sstring dirname) {
 
     return open_checked_directory(commit_error_handler, dirname).then([this, dirname](file dir) {
         auto h = make_lw_shared<helper>(std::move(dirname), std::move(dir));
-        return h->done().then([h]() {
+        return h->done().then([h, recycled]() {
+            if (recycled) {
+                *recycled = std::move(h->_recycled);
+            }
             return make_ready_future<std::vector<db::commitlog::descriptor>>(std::move(h->_result));
         }).finally([h] {});
     });
 }
 
 future<> db::commitlog::segment_manager::init() {
-    return list_descriptors(cfg.commit_log_location).then([this](std::vector<descriptor> descs) {
+    auto recycled = make_lw_shared<std::vector<descriptor>>();
+    return list_descriptors(cfg.commit_log_location, recycled.get()).then([this, recycled](std::vector<descriptor> descs) {
         assert(_reserve_segments.empty()); // _segments_to_replay must not pick them up
         segment_id_type id = std::chrono::duration_cast<std::chrono::milliseconds>(runtime::get_boot_time().time_since_epoch()).count() + 1;
         for (auto& d : descs) {
             id = std::max(id, replay_position(d.id).base_id());
             _segments_to_replay.push_back(cfg.commit_log_location + "/" + d.filename());
         }
+        // Segments recycled by the previous run may not have been zeroed, so
+        // they are not reused. They are divided between the shards like the
+        // segments to replay are.
+        for (auto& d : *recycled) {
+            if (replay_position(d.id).shard_id() % smp::count == engine().cpu_id()) {
+                _recycled_segments.push_back(recycled_segment{cfg.commit_log_location + "/" + recycled_prefix + d.filename(), 0});
+            }
+        }
+        delete_recycled_segments();
 
         // base id counter is [ <shard> | <base> ]
         _ids = replay_position(engine().cpu_id(), id).id;
@@ -1095,6 +1523,27 @@ void db::commitlog::segment_manager::create_counters() {
                        sm::description("Counts a number of bytes written to the disk. "
                                        "Divide this value by \"alloc\" to get the average number of bytes per mutation written to the disk.")),
 
+        sm::make_derive("segments_recycled", totals.segments_recycled,
+                       sm::description("Counts a number of segments kept for reuse once they were no longer needed, rather than deleted.")),
+
+        sm::make_derive("segments_reused", totals.segments_reused,
+                       sm::description("Counts a number of new segments made of a recycled segment, rather than of a new file.")),
+
+        sm::make_derive("group_syncs", totals.group_syncs,
+                       sm::description("Counts a number of syncs shared by the writes waiting for them, in group commit mode.")),
+
+        sm::make_gauge("group_commit_window", [this] { return group_commit_window().count(); },
+                       sm::description("Holds the time in microseconds group commit mode waits for more writes before starting a sync.")),
+
+        sm::make_derive("bytes_uncompressed", totals.bytes_uncompressed,
+                       sm::description("Counts a number of bytes of entries written to compressed segments, before compression.")),
+
+        sm::make_derive("bytes_compressed", totals.bytes_compressed,
+                       sm::description("Counts a number of bytes written for the entries of compressed segments.")),
+
+        sm::make_gauge("compression_ratio", [this] { return totals.bytes_uncompressed ? double(totals.bytes_compressed) / totals.bytes_uncompressed : 1.0; },
+                       sm::description("Holds the ratio of the bytes written for the entries of compressed segments to their size.")),
+
         sm::make_derive("slack", totals.bytes_slack,
                        sm::description("Counts a number of unused bytes written to the disk due to disk segment alignment.")),
 
@@ -1163,16 +1612,120 @@ void db::commitlog::segment_manager::flush_segments(bool force) {
     }
 }
 
-future<db::commitlog::segment_manager::sseg_ptr> db::commitlog::segment_manager::allocate_segment(bool active) {
-    descriptor d(next_id());
+const sstring db::commitlog::segment_manager::recycled_prefix("Recycled-");
+
+future<file> db::commitlog::segment_manager::create_segment_file(sstring file_name) {
     file_open_options opt;
     opt.extent_allocation_size_hint = max_size;
-    return open_checked_file_dma(commit_error_handler, cfg.commit_log_location + "/" + d.filename(), open_flags::wo | open_flags::create, opt).then([this, d, active](file f) {
+    return open_checked_file_dma(commit_error_handler, file_name, open_flags::wo | open_flags::create, opt).then([this](file f) {
         // xfs doesn't like files extended betond eof, so enlarge the file
-        return f.truncate(max_size).then([this, d, active, f] () mutable {
-            auto s = make_shared<segment>(this->shared_from_this(), d, std::move(f), active);
-            return make_ready_future<sseg_ptr>(s);
+        return f.truncate(max_size).then([f] () mutable {
+            return std::move(f);
+        });
+    });
+}
+
+future<file> db::commitlog::segment_manager::reuse_segment_file(recycled_segment r, sstring file_name) {
+    return open_checked_file_dma(commit_error_handler, r.file_name, open_flags::wo).then([this, r, file_name] (file f) {
+        // Replay stops at the first chunk which is all zeroes, and would take
+        // what the previous segment wrote past that for corruption.
+        auto end = align_up<uint64_t>(r.used, segment::alignment);
+        auto zeroes = make_lw_shared(temporary_buffer<char>::aligned(segment::alignment, segment::default_size));
+        std::fill_n(zeroes->get_write(), zeroes->size(), 0);
+        auto pos = make_lw_shared<uint64_t>(0);
+        return do_until([pos, end] { return *pos >= end; }, [f, pos, end, zeroes] () mutable {
+            auto size = std::min<uint64_t>(zeroes->size(), end - *pos);
+            return f.dma_write(*pos, zeroes->get(), size, service::get_local_commitlog_priority()).then([pos] (size_t written) {
+                *pos += align_down<uint64_t>(written, segment::alignment);
+            });
+        }).then([f] () mutable {
+            return f.flush();
+        }).then([r, file_name] {
+            // Only named as a segment once zeroed, a crash before leaves a
+            // recycled file, which is deleted on restart.
+            return commit_io_check(rename_file, r.file_name, file_name);
+        }).then([f] () mutable {
+            return std::move(f);
         });
+    }).then_wrapped([this, r, file_name] (future<file> f) {
+        try {
+            auto ret = f.get0();
+            ++totals.segments_reused;
+            return make_ready_future<file>(std::move(ret));
+        } catch (...) {
+            clogger.warn("Could not reuse segment {}, creating a new one: {}", r.file_name, std::current_exception());
+            try {
+                commit_io_check([] (const char* fname) { ::unlink(fname); }, r.file_name.c_str());
+            } catch (...) {
+            }
+            return create_segment_file(file_name);
+        }
+    });
+}
+
+void db::commitlog::segment_manager::delete_segment_index(const sstring& file_name) noexcept {
+    auto index_name = commitlog::segment_index_file_name(file_name);
+    try {
+        commit_io_check([] (const char* fname) {
+            if (::unlink(fname) == -1 && errno != ENOENT) {
+                throw std::system_error(errno, std::system_category());
+            }
+        }, index_name.c_str());
+    } catch (...) {
+        clogger.error("Could not delete segment index {}: {}", index_name, std::current_exception());
+    }
+}
+
+void db::commitlog::segment_manager::recycle_segment_file(const sstring& file_name, size_t used) noexcept {
+    try {
+        if (cfg.reuse_segments && !_shutdown && _recycled_segments.size() < cfg.max_reserve_segments) {
+            auto pos = file_name.find_last_of('/') + 1;
+            auto recycled_name = file_name.substr(0, pos) + recycled_prefix + file_name.substr(pos);
+            commit_io_check([] (const char* from, const char* to) {
+                if (::rename(from, to) == -1) {
+                    throw std::system_error(errno, std::system_category());
+                }
+            }, file_name.c_str(), recycled_name.c_str());
+            _recycled_segments.push_back(recycled_segment{std::move(recycled_name), used});
+            ++totals.segments_recycled;
+            clogger.debug("Recycled segment {}", file_name);
+            return;
+        }
+    } catch (...) {
+        clogger.warn("Could not recycle segment {}, deleting it: {}", file_name, std::current_exception());
+    }
+    try {
+        commit_io_check([] (const char* fname) { ::unlink(fname); }, file_name.c_str());
+    } catch (...) {
+        clogger.error("Could not delete segment {}: {}", file_name, std::current_exception());
+    }
+}
+
+// FIXME: unlinks in the reactor thread, like the segment destructor does.
+void db::commitlog::segment_manager::delete_recycled_segments() noexcept {
+    for (auto& r : _recycled_segments) {
+        try {
+            commit_io_check([] (const char* fname) { ::unlink(fname); }, r.file_name.c_str());
+        } catch (...) {
+            clogger.error("Could not delete recycled segment {}: {}", r.file_name, std::current_exception());
+        }
+    }
+    _recycled_segments.clear();
+}
+
+future<db::commitlog::segment_manager::sseg_ptr> db::commitlog::segment_manager::allocate_segment(bool active) {
+    descriptor d(next_id(), cfg.compress_segments ? segment::compressed_version : 1);
+    auto file_name = cfg.commit_log_location + "/" + d.filename();
+    auto f = make_ready_future<file>();
+    if (!_recycled_segments.empty()) {
+        auto r = std::move(_recycled_segments.front());
+        _recycled_segments.pop_front();
+        f = reuse_segment_file(std::move(r), std::move(file_name));
+    } else {
+        f = create_segment_file(std::move(file_name));
+    }
+    return f.then([this, d, active] (file f) {
+        return make_shared<segment>(this->shared_from_this(), d, std::move(f), active);
     });
 }
 
@@ -1291,6 +1844,7 @@ future<> db::commitlog::segment_manager::clear_reserve_segments() {
     while (!_reserve_segments.empty()) {
         _reserve_segments.pop();
     }
+    delete_recycled_segments();
     return make_ready_future<>();
 }
 
@@ -1369,7 +1923,7 @@ void db::commitlog::segment_manager::on_timer() {
     // without waiting for them, so segement_manager could be shut down
     // while they are running.
     seastar::with_gate(_gate, [this] {
-        if (cfg.mode != sync_mode::BATCH) {
+        if (cfg.mode == sync_mode::PERIODIC) {
             sync();
         }
         // IFF a new segment was put in use since last we checked, and we're
@@ -1450,6 +2004,14 @@ void db::commitlog::segment_manager::release_buffer(buffer_type&& b) {
             size_t(0), std::plus<size_t>());
 }
 
+void db::commitlog::entry_writer::write(segment& seg, bytes_ostream& out) {
+    auto size = this->size(seg);
+    bytes buf(bytes::initialized_later(), size);
+    data_output o(buf);
+    write(seg, o);
+    out.write(buf);
+}
+
 /**
  * Add mutation.
  */
@@ -1467,6 +2029,7 @@ future<db::rp_handle> db::commitlog::add(const cf_id_type& id,
         virtual void write(segment&, output& out) override {
             _func(out);
         }
+        using entry_writer::write;
     };
     auto writer = ::make_shared<serializer_func_entry_writer>(size, std::move(func));
     return _segment_manager->allocate_when_possible(id, writer, timeout);
@@ -1491,6 +2054,12 @@ future<db::rp_handle> db::commitlog::add_entry(const cf_id_type& id, const commi
             }
             _writer.write(out);
         }
+        virtual void write(segment& seg, bytes_ostream& out) override {
+            if (_writer.with_schema()) {
+                seg.add_schema_version(_writer.schema());
+            }
+            _writer.write(out);
+        }
     };
     auto writer = ::make_shared<cl_entry_writer>(cew);
     return _segment_manager->allocate_when_possible(id, writer, timeout);
@@ -1593,6 +2162,59 @@ const db::commitlog::config& db::commitlog::active_config() const {
     return _segment_manager->cfg;
 }
 
+sstring db::commitlog::segment_index_file_name(const sstring& segment_file) {
+    return segment_file + descriptor::INDEX_EXTENSION;
+}
+
+future<stdx::optional<db::commitlog::segment_index>>
+db::commitlog::read_segment_index(const sstring& segment_file) {
+    using ret_type = stdx::optional<segment_index>;
+    auto name = segment_index_file_name(segment_file);
+    return engine().file_exists(name).then([name, segment_file] (bool exists) {
+        if (!exists) {
+            return make_ready_future<ret_type>();
+        }
+        return open_checked_file_dma(commit_error_handler, name, open_flags::ro).then([] (file f) {
+            return f.size().then([f] (uint64_t size) mutable {
+                return f.dma_read_exactly<char>(0, size);
+            }).finally([f] () mutable {
+                return f.close().finally([f] {});
+            });
+        }).then([name, segment_file] (temporary_buffer<char> buf) {
+            static constexpr size_t header_size = 5 * sizeof(uint32_t);
+            static constexpr size_t table_size = 2 * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+            data_input in(buf);
+            auto magic = in.read<uint32_t>();
+            auto ver = in.read<uint32_t>();
+            auto id = in.read<uint64_t>();
+            auto count = in.read<uint32_t>();
+            if (magic != segment::segment_index_magic || ver != segment::segment_index_version
+                    || id != descriptor(segment_file).id || buf.size() != header_size + count * table_size + sizeof(uint32_t)) {
+                throw std::runtime_error("Not an index of this segment");
+            }
+            crc32_nbo crc;
+            crc.process_bytes(buf.get(), buf.size() - sizeof(uint32_t));
+
+            segment_index index;
+            for (uint32_t i = 0; i < count; ++i) {
+                auto msb = in.read<uint64_t>();
+                auto lsb = in.read<uint64_t>();
+                auto first = in.read<uint32_t>();
+                auto last = in.read<uint32_t>();
+                index.tables.emplace(utils::UUID(msb, lsb), std::make_pair(position_type(first), position_type(last)));
+            }
+            if (in.read<uint32_t>() != crc.checksum()) {
+                throw std::runtime_error("Checksum error");
+            }
+            return make_ready_future<ret_type>(std::move(index));
+        }).handle_exception([name] (auto ep) {
+            clogger.warn("Could not read segment index {}, the whole segment will be replayed: {}", name, ep);
+            return make_ready_future<ret_type>();
+        });
+    });
+}
+
 // No commit_io_check needed in the log reader since the database will fail
 // on error at startup if required
 future<std::unique_ptr<subscription<temporary_buffer<char>, db::replay_position>>>
@@ -1628,9 +2250,13 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
         size_t skip_to = 0;
         size_t file_size = 0;
         size_t corrupt_size = 0;
+        // The replay position of the entries read from the file, less
+        // their file position.
+        int64_t logical_offset = 0;
         bool eof = false;
         bool header = true;
         bool failed = false;
+        bool compressed = false;
 
         work(file f, position_type o = 0)
                 : f(f), fin(make_file_input_stream(f, 0, make_file_input_stream_options())), start_off(o) {
@@ -1702,6 +2328,7 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
 
                 this->id = id;
                 this->next = 0;
+                this->compressed = ver == segment::compressed_version;
 
                 return make_ready_future<>();
             });
@@ -1739,6 +2366,10 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
 
                 this->next = next;
 
+                if (compressed) {
+                    return read_compressed_chunk();
+                }
+
                 if (start_off >= next) {
                     return skip(next - pos);
                 }
@@ -1746,6 +2377,121 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
                 return do_until(std::bind(&work::end_of_chunk, this), std::bind(&work::read_entry, this));
             });
         }
+        future<> skip_corrupt_chunk() {
+            corrupt_size += next - pos;
+            return skip(next - pos);
+        }
+        future<> read_compressed_chunk() {
+            if (pos + segment::compressed_chunk_header_size > next) {
+                clogger.debug("Compressed segment chunk at {} is too short.", pos);
+                return skip_corrupt_chunk();
+            }
+            return fin.read_exactly(segment::compressed_chunk_header_size).then([this](temporary_buffer<char> buf) {
+                if (!advance(buf)) {
+                    return make_ready_future<>();
+                }
+
+                data_input in(buf);
+                auto logical_start = in.read<uint32_t>();
+                auto data_size = in.read<uint32_t>();
+                auto compressed_size = in.read<uint32_t>();
+                auto checksum = in.read<uint32_t>();
+
+                crc32_nbo crc;
+                crc.process(logical_start);
+                crc.process(data_size);
+                crc.process(compressed_size);
+
+                if (compressed_size == 0) {
+                    // Stored as is, entries are read from the file.
+                    if (crc.checksum() != checksum || pos + data_size > next) {
+                        clogger.debug("Checksum error in compressed segment chunk header at {}.", pos);
+                        return skip_corrupt_chunk();
+                    }
+                    logical_offset = int64_t(logical_start) - int64_t(pos);
+                    if (start_off >= logical_start + data_size) {
+                        return skip(next - pos);
+                    }
+                    return do_until(std::bind(&work::end_of_chunk, this), std::bind(&work::read_entry, this));
+                }
+
+                if (pos + compressed_size > next) {
+                    clogger.debug("Compressed segment chunk at {} has broken header.", pos);
+                    return skip_corrupt_chunk();
+                }
+                return fin.read_exactly(compressed_size).then([this, logical_start, data_size, checksum, crc = std::move(crc)](temporary_buffer<char> buf) mutable {
+                    auto start = pos;
+                    if (!advance(buf)) {
+                        return make_ready_future<>();
+                    }
+                    crc.process_bytes(buf.get(), buf.size());
+                    if (crc.checksum() != checksum) {
+                        // Unlike with the entries of an uncompressed chunk, none
+                        // of the chunk can be trusted, but the next one can.
+                        clogger.debug("Checksum error in compressed segment chunk at {}. Skipping to next chunk ({} bytes)", start, next - start);
+                        corrupt_size += buf.size();
+                        return skip_corrupt_chunk();
+                    }
+                    if (start_off >= logical_start + data_size) {
+                        return skip(next - pos);
+                    }
+                    temporary_buffer<char> data(data_size);
+                    auto len = LZ4_decompress_safe(buf.get(), data.get_write(), buf.size(), data_size);
+                    if (len < 0 || uint32_t(len) != data_size) {
+                        clogger.debug("Segment chunk at {} could not be decompressed. Skipping to next chunk ({} bytes)", start, next - start);
+                        corrupt_size += buf.size();
+                        return skip_corrupt_chunk();
+                    }
+                    return read_decompressed_entries(std::move(data), logical_start).then([this] {
+                        return skip(next - pos);
+                    });
+                });
+            });
+        }
+        // Like read_entry(), for the entries of a decompressed chunk.
+        future<> read_decompressed_entries(temporary_buffer<char> data, uint32_t logical_start) {
+            static constexpr size_t entry_header_size = segment::entry_overhead_size - sizeof(uint32_t);
+
+            return do_with(std::move(data), size_t(0), [this, logical_start] (temporary_buffer<char>& data, size_t& off) {
+                return do_until([this, &data, &off] { return eof || off + entry_header_size >= data.size(); }, [this, &data, &off, logical_start] {
+                    replay_position rp(id, position_type(logical_start + off));
+
+                    data_input in(bytes_view(reinterpret_cast<const int8_t*>(data.get() + off), data.size() - off));
+
+                    auto size = in.read<uint32_t>();
+                    auto checksum = in.read<uint32_t>();
+
+                    crc32_nbo crc;
+                    crc.process(size);
+
+                    if (size < 3 * sizeof(uint32_t) || checksum != crc.checksum() || off + size > data.size()) {
+                        // Without the size, the next entries can't be found.
+                        clogger.debug("Segment entry at {} has broken header. Skipping to next chunk ({} bytes)", rp, data.size() - off);
+                        corrupt_size += data.size() - off;
+                        off = data.size();
+                        return make_ready_future<>();
+                    }
+
+                    auto data_size = size - segment::entry_overhead_size;
+                    crc.process_bytes(data.get() + off + entry_header_size, data_size);
+                    in.skip(data_size);
+                    checksum = in.read<uint32_t>();
+
+                    auto entry = data.share(off + entry_header_size, data_size);
+                    off += size;
+
+                    if (crc.checksum() != checksum) {
+                        clogger.debug("Segment entry at {} checksum error. Skipping {} bytes", rp, size);
+                        corrupt_size += size;
+                        return make_ready_future<>();
+                    }
+
+                    return s.produce(std::move(entry), rp).handle_exception([this](auto ep) {
+                        return this->fail();
+                    });
+                });
+            });
+        }
         future<> read_entry() {
             static constexpr size_t entry_header_size = segment::entry_overhead_size - sizeof(uint32_t);
 
@@ -1760,7 +2506,7 @@ db::commitlog::read_log_file(file f, commit_load_reader_func next, position_type
             }
 
             return fin.read_exactly(entry_header_size).then([this](temporary_buffer<char> buf) {
-                replay_position rp(id, position_type(pos));
+                replay_position rp(id, position_type(pos + logical_offset));
 
                 if (!advance(buf)) {
                     return make_ready_future<>();
@@ -1882,6 +2628,22 @@ uint64_t db::commitlog::get_num_segments_destroyed() const {
     return _segment_manager->totals.segments_destroyed;
 }
 
+uint64_t db::commitlog::get_num_segments_reused() const {
+    return _segment_manager->totals.segments_reused;
+}
+
+uint64_t db::commitlog::get_num_group_syncs() const {
+    return _segment_manager->totals.group_syncs;
+}
+
+uint64_t db::commitlog::get_bytes_uncompressed() const {
+    return _segment_manager->totals.bytes_uncompressed;
+}
+
+uint64_t db::commitlog::get_bytes_compressed() const {
+    return _segment_manager->totals.bytes_compressed;
+}
+
 uint64_t db::commitlog::get_num_dirty_segments() const {
     return _segment_manager->get_num_dirty_segments();
 }
@@ -41,6 +41,8 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
+#include <experimental/optional>
 
 #include "utils/data_output.hh"
 #include "core/future.hh"
@@ -51,6 +53,8 @@
 
 namespace seastar { class file; }
 
+class bytes_ostream;
+
 #include "seastarx.hh"
 
 namespace db {
@@ -105,7 +109,7 @@ class commitlog {
     ::shared_ptr<segment_manager> _segment_manager;
 public:
     enum class sync_mode {
-        PERIODIC, BATCH
+        PERIODIC, BATCH, GROUP
     };
     struct config {
         config() = default;
@@ -123,6 +127,19 @@ class commitlog {
         // zero means try to figure it out ourselves
         uint64_t max_active_writes = 0;
         uint64_t max_active_flushes = 0;
+        // Rename the segments which are no longer needed and reuse them,
+        // keeping up to max_reserve_segments of them, rather than delete
+        // them and create new ones.
+        bool reuse_segments = false;
+        // Compress the chunks of the segments with LZ4.
+        bool compress_segments = false;
+        // In GROUP mode, writes wait for a sync shared with the writes around
+        // them, which starts once group_commit_bytes are waiting for it, or
+        // when the group commit window expires. The window follows the
+        // measured sync latency, within the bounds below.
+        uint64_t group_commit_bytes = 128 * 1024;
+        uint64_t group_commit_min_window_in_us = 50;
+        uint64_t group_commit_max_window_in_us = 2000;
 
         sync_mode mode = sync_mode::PERIODIC;
     };
@@ -134,6 +151,7 @@ class commitlog {
         static const std::string SEPARATOR;
         static const std::string FILENAME_PREFIX;
         static const std::string FILENAME_EXTENSION;
+        static const std::string INDEX_EXTENSION;
 
         descriptor(descriptor&&) = default;
         descriptor(const descriptor&) = default;
@@ -277,6 +295,12 @@ class commitlog {
     uint64_t get_flush_limit_exceeded_count() const;
     uint64_t get_num_segments_created() const;
     uint64_t get_num_segments_destroyed() const;
+    uint64_t get_num_segments_reused() const;
+    uint64_t get_num_group_syncs() const;
+    // The bytes of entries given to compressed segments, and those
+    // written for them.
+    uint64_t get_bytes_uncompressed() const;
+    uint64_t get_bytes_compressed() const;
     /**
      * Get number of inactive (finished), segments lingering
      * due to still being dirty
@@ -343,6 +367,18 @@ class commitlog {
         uint64_t _bytes;
     };
 
+    // The positions of the first and last entries of each table in a
+    // segment. It is written next to the segment once the segment is
+    // closed, so that replay can tell which parts of a segment it needs
+    // without reading the segment.
+    struct segment_index {
+        std::unordered_map<cf_id_type, std::pair<position_type, position_type>> tables;
+    };
+
+    static sstring segment_index_file_name(const sstring& segment_file);
+    // Disengaged if the segment has no index, or its index can't be read.
+    static future<std::experimental::optional<segment_index>> read_segment_index(const sstring& segment_file);
+
     static subscription<temporary_buffer<char>, replay_position> read_log_file(file, commit_load_reader_func, position_type = 0);
     static future<std::unique_ptr<subscription<temporary_buffer<char>, replay_position>>> read_log_file(
             const sstring&, commit_load_reader_func, position_type = 0);
@@ -354,6 +390,9 @@ class commitlog {
         // Returns segment-independent size of the entry. Must be <= than segment-dependant size.
         virtual size_t size() = 0;
         virtual void write(segment&, output&) = 0;
+        // Writes entries too large for a single buffer, which are kept in fragments.
+        // The default writes to a contiguous buffer first.
+        virtual void write(segment&, bytes_ostream&);
     };
 };
 
@@ -56,6 +56,10 @@ void commitlog_entry_writer::write(data_output& out) const {
     serialize(str);
 }
 
+void commitlog_entry_writer::write(bytes_ostream& out) const {
+    serialize(out);
+}
+
 commitlog_entry_reader::commitlog_entry_reader(const temporary_buffer<char>& buffer)
     : _ce([&] {
     seastar::simple_input_stream in(buffer.get(), buffer.size());
@@ -63,3 +67,9 @@ commitlog_entry_reader::commitlog_entry_reader(const temporary_buffer<char>& buf
 }())
 {
 }
+
+bool commitlog_entry_reader::has_column_mapping(const temporary_buffer<char>& buffer) {
+    seastar::simple_input_stream in(buffer.get(), buffer.size());
+    auto ev = ser::deserialize(in, boost::type<ser::commitlog_entry_view>());
+    return bool(ev.mapping());
+}
@@ -73,6 +73,7 @@ class commitlog_entry_writer {
     }
 
     void write(data_output& out) const;
+    void write(bytes_ostream& out) const;
 };
 
 class commitlog_entry_reader {
@@ -82,4 +83,8 @@ class commitlog_entry_reader {
 
     const stdx::optional<column_mapping>& get_column_mapping() const { return _ce.mapping(); }
     const frozen_mutation& mutation() const { return _ce.mutation(); }
+
+    // Whether the entry in buffer carries a column mapping, found without
+    // deserializing its mutation.
+    static bool has_column_mapping(const temporary_buffer<char>& buffer);
 };
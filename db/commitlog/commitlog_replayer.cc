@@ -47,6 +47,7 @@
 
 #include <core/future.hh>
 #include <core/sharded.hh>
+#include <core/semaphore.hh>
 
 #include "commitlog.hh"
 #include "commitlog_replayer.hh"
@@ -109,7 +110,8 @@ class db::commitlog_replayer::impl {
         return _column_mappings.stop();
     }
 
-    future<> process(stats*, temporary_buffer<char> buf, replay_position rp) const;
+    // Entries before start are only looked at for their column mappings.
+    future<> process(stats*, temporary_buffer<char> buf, replay_position rp, replay_position start) const;
     future<stats> recover(sstring file) const;
 
     typedef std::unordered_map<utils::UUID, replay_position> rp_map;
@@ -220,27 +222,55 @@ db::commitlog_replayer::impl::recover(sstring file) const {
         p = gp.pos;
     }
 
-    auto s = make_lw_shared<stats>();
-
-    return db::commitlog::read_log_file(file,
-            std::bind(&impl::process, this, s.get(), std::placeholders::_1,
-                    std::placeholders::_2), p).then([](auto s) {
-        auto f = s->done();
-        return f.finally([s = std::move(s)] {});
-    }).then_wrapped([s](future<> f) {
-        try {
-            f.get();
-        } catch (commitlog::segment_data_corruption_error& e) {
-            s->corrupt_bytes += e.bytes();
-        } catch (...) {
-            throw;
+    return db::commitlog::read_segment_index(file).then([this, file, rp, p] (stdx::optional<commitlog::segment_index> index) mutable {
+        if (index) {
+            // Only the entries of the tables which weren't flushed past
+            // them are needed, and they start no earlier than the first
+            // such table does in the segment.
+            stdx::optional<position_type> start;
+            auto& cfs = _qp.local().db().local().get_column_families();
+            for (auto&& t : index->tables) {
+                if (!cfs.count(t.first) || replay_position(rp.id, t.second.second) <= cf_min_pos(t.first, rp.shard_id())) {
+                    continue;
+                }
+                start = std::min(start.value_or(t.second.first), t.second.first);
+            }
+            if (!start) {
+                rlogger.debug("skipping replay of fully-flushed {}, according to its index", file);
+                return make_ready_future<stats>();
+            }
+            p = std::max(p, *start);
         }
-        return make_ready_future<stats>(*s);
+
+        auto s = make_lw_shared<stats>();
+
+        // The column mapping of each schema version is written once per
+        // segment, possibly before p, so the entries before it are still
+        // read, but only for their column mappings.
+        return db::commitlog::read_log_file(file,
+                std::bind(&impl::process, this, s.get(), std::placeholders::_1,
+                        std::placeholders::_2, replay_position(rp.id, p)), 0).then([](auto s) {
+            auto f = s->done();
+            return f.finally([s = std::move(s)] {});
+        }).then_wrapped([s](future<> f) {
+            try {
+                f.get();
+            } catch (commitlog::segment_data_corruption_error& e) {
+                s->corrupt_bytes += e.bytes();
+            } catch (...) {
+                throw;
+            }
+            return make_ready_future<stats>(*s);
+        });
     });
 }
 
-future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char> buf, replay_position rp) const {
+future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char> buf, replay_position rp, replay_position start) const {
     try {
+        if (rp < start && !commitlog_entry_reader::has_column_mapping(buf)) {
+            s->skipped_mutations++;
+            return make_ready_future<>();
+        }
 
         commitlog_entry_reader cer(buf);
         auto& fm = cer.mutation();
@@ -248,11 +278,21 @@ future<> db::commitlog_replayer::impl::process(stats* s, temporary_buffer<char>
         auto& local_cm = _column_mappings.local().map;
         auto cm_it = local_cm.find(fm.schema_version());
         if (cm_it == local_cm.end()) {
-            if (!cer.get_column_mapping()) {
+            if (cer.get_column_mapping()) {
+                rlogger.debug("new schema version {} in entry {}", fm.schema_version(), rp);
+                cm_it = local_cm.emplace(fm.schema_version(), *cer.get_column_mapping()).first;
+            } else if (auto fs = local_schema_registry().get_or_null(fm.schema_version())) {
+                // The entry carrying the mapping was lost, but the version
+                // is still known locally.
+                cm_it = local_cm.emplace(fm.schema_version(), fs->get_column_mapping()).first;
+            } else {
                 throw std::runtime_error(sprint("unknown schema version {}", fm.schema_version()));
             }
-            rlogger.debug("new schema version {} in entry {}", fm.schema_version(), rp);
-            cm_it = local_cm.emplace(fm.schema_version(), *cer.get_column_mapping()).first;
+        }
+        if (rp < start) {
+            rlogger.trace("entry {} is before the replay start {}. skipping", rp, start);
+            s->skipped_mutations++;
+            return make_ready_future<>();
         }
         const column_mapping& src_cm = cm_it->second;
 
@@ -342,6 +382,7 @@ future<db::commitlog_replayer> db::commitlog_replayer::create_replayer(seastar::
 
 future<> db::commitlog_replayer::recover(std::vector<sstring> files) {
     typedef std::unordered_multimap<unsigned, sstring> shard_file_map;
+    static constexpr size_t max_concurrent_segments = 4;
 
     rlogger.info("Replaying {}", join(", ", files));
 
@@ -357,11 +398,13 @@ future<> db::commitlog_replayer::recover(std::vector<sstring> files) {
         return map_reduce(smp::all_cpus(), [this, map](unsigned id) {
             return smp::submit_to(id, [this, id, map]() {
                 auto total = ::make_lw_shared<impl::stats>();
-                // TODO: or something. For now, we do this serialized per shard,
-                // to reduce mutation congestion. We could probably (says avi)
-                // do 2 segments in parallel or something, but lets use this first.
+                // A few segments are replayed at a time on each shard, so
+                // that reading one overlaps with applying the mutations of
+                // the others, without flooding the shards with mutations.
+                auto sem = ::make_lw_shared<semaphore>(max_concurrent_segments);
                 auto range = map->equal_range(id);
-                return do_for_each(range.first, range.second, [this, total](const std::pair<unsigned, sstring>& p) {
+                return parallel_for_each(range.first, range.second, [this, total, sem](const std::pair<unsigned, sstring>& p) {
+                  return with_semaphore(*sem, 1, [this, total, &p] {
                     auto&f = p.second;
                     rlogger.debug("Replaying {}", f);
                     return _impl->recover(f).then([f, total](impl::stats stats) {
@@ -376,7 +419,8 @@ future<> db::commitlog_replayer::recover(std::vector<sstring> files) {
                         );
                         *total += stats;
                     });
-                }).then([total] {
+                  });
+                }).then([total, sem] {
                     return make_ready_future<impl::stats>(*total);
                 });
             });
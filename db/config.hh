@@ -188,9 +188,15 @@ class config {
             "The directory where the commit log is stored. For optimal write performance, it is recommended the commit log be on a separate disk partition (ideally, a separate physical device) from the data file directories."   \
     )                                           \
     val(data_file_directories, string_list, { "/var/lib/scylla/data" }, Used,   \
-            "The directory location where table data (SSTables) is stored"   \
+            "The directory locations where table data (SSTables) is stored. New SSTables are spread across them by free space and by the writes in progress to each."   \
     )                                           \
-    val(saved_caches_directory, sstring, "/var/lib/scylla/saved_caches", Unused, \
+    val(cold_data_file_directory, sstring, "", Used,   \
+            "The directory, on a slower and cheaper volume, which SSTables holding only data older than the cold_storage_after_days compaction option of their table are moved to. Empty to keep all data in data_file_directories."   \
+    )                                           \
+    val(hints_directory, sstring, "/var/lib/scylla/hints", Used,   \
+            "The directory where hints files are stored if hinted handoff is enabled."   \
+    )                                           \
+    val(saved_caches_directory, sstring, "/var/lib/scylla/saved_caches", Used, \
             "The directory location where table key and row caches are stored."  \
     )                                                   \
     /* Commonly used properties */  \
@@ -252,12 +258,15 @@ class config {
             "Related information: Initializing a multiple node cluster (single data center) and Initializing a multiple node cluster (multiple data centers)."  \
     )                                                   \
     /* Common compaction settings */    \
-    val(compaction_throughput_mb_per_sec, uint32_t, 16, Unused,     \
-            "Throttles compaction to the specified total throughput across the entire system. The faster you insert data, the faster you need to compact in order to keep the SSTable count down. The recommended Value is 16 to 32 times the rate of write throughput (in MBs/second). Setting the value to 0 disables compaction throttling.\n"  \
+    val(compaction_throughput_mb_per_sec, uint32_t, 0, Used,     \
+            "Throttles the disk reads and writes of compaction to the specified total throughput across the node, in MB/s. The faster you insert data, the faster you need to compact in order to keep the SSTable count down. The recommended Value is 16 to 32 times the rate of write throughput (in MBs/second). Setting the value to 0 disables compaction throttling. Can be changed at runtime through the REST API.\n"  \
             "Related information: Configuring compaction"   \
     )                                                   \
-    val(compaction_large_partition_warning_threshold_mb, uint32_t, 100, Unused, \
-            "Log a warning when compacting partitions larger than this value"   \
+    val(compaction_large_partition_warning_threshold_mb, uint32_t, 100, Used, \
+            "Log a warning, and record the partition in system.large_partitions, when writing partitions larger than this value to sstables"   \
+    )                                               \
+    val(compaction_large_row_warning_threshold_mb, uint32_t, 10, Used, \
+            "Log a warning, and record the partition in system.large_partitions, when writing rows larger than this value to sstables"   \
     )                                               \
     /* Common memtable settings */  \
     val(memtable_total_space_in_mb, uint32_t, 0, Invalid,     \
@@ -287,6 +296,9 @@ class config {
             "Adjusts the sensitivity of the failure detector on an exponential scale. Generally this setting never needs adjusting.\n"  \
             "Related information: Failure detection and recovery"  \
     )                                                   \
+    val(phi_convict_variance_aware, bool, false, Used,     \
+            "Estimate phi from both the mean and the variance of the heartbeat inter-arrival times of each node, rather than from their mean only. phi_convict_threshold is then the -log10 of the probability that the node is still alive, so lower thresholds, like 5, are suitable. Nodes with irregular heartbeats are convicted later than regular ones."  \
+    )                                                   \
     /* Performance tuning properties */ \
     /* Tuning performance and system reso   urce utilization, including commit log, compaction, memory, disk I/O, CPU, reads, and writes. */    \
     /* Commit log settings */   \
@@ -295,6 +307,7 @@ class config {
             "\n"    \
             "\tperiodic : Used with commitlog_sync_period_in_ms (Default: 10000 - 10 seconds ) to control how often the commit log is synchronized to disk. Periodic syncs are acknowledged immediately.\n"   \
             "\tbatch : Used with commitlog_sync_batch_window_in_ms (Default: disabled **) to control how long Scylla waits for other writes before performing a sync. When using this method, writes are not acknowledged until fsynced to disk.\n"  \
+            "\tgroup : Writes wait for a sync shared with the writes around them, which starts once commitlog_sync_group_size_in_kb of them are waiting, or after a window which follows the measured sync latency, up to commitlog_sync_group_max_window_in_us. When using this method, writes are not acknowledged until fsynced to disk.\n"  \
             "Related information: Durability"   \
     )                                                   \
     val(commitlog_segment_size_in_mb, uint32_t, 64, Used,     \
@@ -309,6 +322,18 @@ class config {
     val(commitlog_sync_batch_window_in_ms, uint32_t, 10000, Used,     \
             "Controls how long the system waits for other writes before performing a sync in \"batch\" mode."    \
     )   \
+    val(commitlog_sync_group_size_in_kb, uint32_t, 128, Used,     \
+            "The amount of writes waiting for a sync which starts it right away in \"group\" mode."    \
+    )   \
+    val(commitlog_sync_group_max_window_in_us, uint32_t, 2000, Used,     \
+            "The longest time writes wait for others to share a sync with in \"group\" mode, however slow the syncs are."    \
+    )   \
+    val(commitlog_reuse_segments, bool, true, Used,     \
+            "Keep the commitlog segments which are no longer needed, zeroed, to be reused as new segments, rather than delete them and create new files. This saves the file system from allocating space for the segments, while writes wait for them."  \
+    )   \
+    val(commitlog_compression, bool, false, Used,     \
+            "Compress the chunks of commitlog entries with LZ4 before writing them, trading some CPU for fewer bytes written to the commitlog disk. Segments written this way can't be replayed by versions which don't know about compression."  \
+    )   \
     val(commitlog_total_space_in_mb, int64_t, -1, Used,     \
             "Total space used for commitlogs. If the used space goes above this value, Scylla rounds up to the next nearest segment multiple and flushes memtables to disk for the oldest commitlog segments, removing those log segments. This reduces the amount of data to replay on startup, and prevents infrequently-updated tables from indefinitely keeping commitlog segments. A small total commitlog space tends to cause more flush activity on less-active tables.\n"  \
             "Related information: Configuring memtable throughput"  \
@@ -348,8 +373,8 @@ class config {
             "The number of full memtables to allow pending flush (memtables waiting for a write thread). At a minimum, set to the maximum number of indexes created on a single table.\n"  \
             "Related information: Flushing data from the memtable"  \
     )   \
-    val(memtable_flush_writers, uint32_t, 1, Invalid,     \
-            "Sets the number of memtable flush writer threads. These threads are blocked by disk I/O, and each one holds a memtable in memory while blocked. If you have a large Java heap size and many data directories, you can increase the value for better flush performance."  \
+    val(memtable_flush_writers, uint32_t, 1, Used,     \
+            "Sets the number of memtables each shard flushes at once under memory pressure. Each flush holds a memtable in memory until it is done, so more concurrent flushes release memory later, but they can keep disks which need parallelism busy. Under pressure the largest memtables which aren't being flushed yet are flushed first, after the explicit flushes requested by the commitlog and by users."  \
     )   \
     val(memtable_heap_space_in_mb, uint32_t, 0, Unused,     \
             "Total permitted memory to use for memtables. Triggers a flush based on memtable_cleanup_threshold. Cassandra stops accepting writes when the limit is exceeded until a flush completes. If unset, sets to default."  \
@@ -361,10 +386,10 @@ class config {
     val(column_index_size_in_kb, uint32_t, 64, Unused,     \
             "Granularity of the index of rows within a partition. For huge rows, decrease this setting to improve seek time. If you use key cache, be careful not to make this setting too large because key cache will be overwhelmed. If you're unsure of the size of the rows, it's best to use the default setting."  \
     )   \
-    val(index_summary_capacity_in_mb, uint32_t, 0, Unused,     \
-            "Fixed memory pool size in MB for SSTable index summaries. If the memory usage of all index summaries exceeds this limit, any SSTables with low read rates shrink their index summaries to meet this limit. This is a best-effort process. In extreme conditions, Cassandra may need to use more than this amount of memory."  \
+    val(index_summary_capacity_in_mb, uint32_t, 0, Used,     \
+            "Fixed memory pool size in MB for SSTable index summaries. If the memory usage of all index summaries exceeds this limit, any SSTables with low read rates shrink their index summaries to meet this limit. This is a best-effort process. In extreme conditions, Scylla may need to use more than this amount of memory. Set to 0 (the default) to never resample index summaries."  \
     )   \
-    val(index_summary_resize_interval_in_minutes, uint32_t, 60, Unused,     \
+    val(index_summary_resize_interval_in_minutes, uint32_t, 60, Used,     \
             "How frequently index summaries should be re-sampled. This is done periodically to redistribute memory from the fixed-size pool to SSTables proportional their recent read rates. To disable, set to -1. This leaves existing index summaries at their current sampling level."  \
     )   \
     val(reduce_cache_capacity_to, double, .6, Invalid,     \
@@ -448,18 +473,40 @@ class config {
     val(key_cache_save_period, uint32_t, 14400, Unused,                \
             "Duration in seconds that keys are saved in cache. Caches are saved to saved_caches_directory. Saved caches greatly improve cold-start speeds and has relatively little effect on I/O."  \
     )   \
-    val(key_cache_size_in_mb, uint32_t, 100, Unused,                \
-            "A global cache setting for tables. It is the maximum size of the key cache in memory. To disable set to 0.\n"  \
+    val(key_cache_size_in_mb, uint32_t, 100, Used,                \
+            "A global cache setting for tables. It is the maximum size of the key cache in memory, divided among the shards. Key cache entries are also evicted along with the row cache under memory pressure. To disable set to 0.\n"  \
             "Related information: nodetool setcachecapacity."   \
     )   \
-    val(row_cache_keys_to_save, uint32_t, 0, Unused,                \
-            "Number of keys from the row cache to save."  \
+    val(row_cache_keys_to_save, uint32_t, 10000, Used,                \
+            "Number of keys of the most recently used partitions to save from the row cache of each table, per shard. (0: all)"  \
     )   \
     val(row_cache_size_in_mb, uint32_t, 0, Unused,                \
             "Maximum size of the row cache in memory. Row cache can save more time than key_cache_size_in_mb, but is space-intensive because it contains the entire row. Use the row cache only for hot rows or static rows. If you reduce the size, you may not get you hottest keys loaded on start up."  \
     )   \
-    val(row_cache_save_period, uint32_t, 0, Unused,     \
-            "Duration in seconds that rows are saved in cache. Caches are saved to saved_caches_directory."  \
+    val(row_cache_save_period, uint32_t, 0, Used,     \
+            "Duration in seconds between saves of the keys of the most recently used partitions in the row cache. Caches are saved to saved_caches_directory, and the saved partitions are read back into cache in the background when the node starts. (0: never save)"  \
+    )   \
+    val(row_cache_warmup_throughput_mb_per_sec, uint32_t, 16, Used,     \
+            "Throttles reading saved partitions back into the row cache on start to the given total throughput in MB/s across the node. (0: unthrottled)"  \
+    )   \
+    val(prepared_statements_cache_size_mb, uint32_t, 0, Used,     \
+            "Maximum size in memory, in MB, of each of the caches of CQL and Thrift prepared statements of the node. When a cache is full, the least recently used statements are evicted, and clients executing them have to prepare them again. (0: 1/256th of the memory of each shard)"  \
+    )   \
+    val(streaming_throughput_mb_per_sec, uint32_t, 0, Used,     \
+            "Throttles the data sent over the network by streaming and repair to the given total throughput in MB/s across the node, so that range movements leave network bandwidth to client requests. Only limits the sending side. The disk reads of the data sent are also subject to streaming_io_throughput_mb_per_sec, so the lower of the two limits applies to them. (0: unthrottled)"  \
+    )   \
+    val(streaming_io_throughput_mb_per_sec, uint32_t, 0, Used,     \
+            "Throttles the disk reads and writes of streaming and repair, on both the sending and the receiving sides, to the given total throughput in MB/s across the node, so that range movements leave disk bandwidth to client requests and compaction. Reads and writes share the same limit, independent of streaming_throughput_mb_per_sec, which limits what is sent over the network. Can be changed at runtime through the REST API. (0: unthrottled)"  \
+    )   \
+    val(streaming_write_to_sstables, bool, false, Used,     \
+            "Write the data received by each streaming or repair session straight to sstables of its own, without going through memtables, and add them to the tables at once when the session completes. The streamed data isn't readable until the session completes. With streaming_cache_update_policy set to update or populate_if_present, the streamed partitions which were in cache when they arrived are then merged into it, and the others are evicted, unless there are too many to keep track of, in which case the streamed ranges are evicted."  \
+    )   \
+    val(streaming_cache_update_policy, sstring, "invalidate", Used,     \
+            "How data received through streaming and repair is reflected in the row cache:\n"  \
+            "\n"  \
+            "\tinvalidate            The streamed token ranges are evicted from cache.\n"  \
+            "\tupdate                Streamed partitions are merged into cache, like flushed memtables are.\n"  \
+            "\tpopulate_if_present   Streamed partitions are merged only into partitions already in cache."  \
     )   \
     val(memory_allocator, sstring, "NativeAllocator", Invalid,     \
             "The off-heap memory allocator. In addition to caches, this property affects storage engine meta data. Supported values:\n"  \
@@ -471,8 +518,8 @@ class config {
     /* Counter caches properties */ \
     /* Counter cache helps to reduce counter locks' contention for hot counter cells. In case of RF = 1 a counter cache hit will cause Cassandra to skip the read before write entirely. With RF > 1 a counter cache hit will still help to reduce the duration of the lock hold, helping with hot counter cell updates, but will not allow skipping the read entirely. Only the local (clock, count) tuple of a counter cell is kept in memory, not the whole counter, so it's relatively cheap. */    \
     /* Note: Reducing the size counter cache may result in not getting the hottest keys loaded on start-up. */  \
-    val(counter_cache_size_in_mb, uint32_t, 0, Unused,     \
-            "When no value is specified a minimum of 2.5% of Heap or 50MB. If you perform counter deletes and rely on low gc_grace_seconds, you should disable the counter cache. To disable, set to 0"  \
+    val(counter_cache_size_in_mb, uint32_t, 50, Used,     \
+            "The memory, shared by all shards, used to cache the local shards of recently updated counter cells, which lets their updates skip reading them. To disable, set to 0"  \
     )   \
     val(counter_cache_save_period, uint32_t, 7200, Unused,     \
             "Duration after which Cassandra should save the counter cache (keys only). Caches are saved to saved_caches_directory."  \
@@ -499,7 +546,7 @@ class config {
     val(counter_write_request_timeout_in_ms, uint32_t, 5000, Used,     \
             "The time that the coordinator waits for counter writes to complete."  \
     )   \
-    val(cas_contention_timeout_in_ms, uint32_t, 5000, Unused,     \
+    val(cas_contention_timeout_in_ms, uint32_t, 5000, Used,       \
             "The time that the coordinator continues to retry a CAS (compare and set) operation that contends with other proposals for the same row."  \
     )   \
     val(truncate_request_timeout_in_ms, uint32_t, 10000, Used,     \
@@ -558,6 +605,16 @@ class config {
             "from native_transport_port will use encryption for native_transport_port_ssl while"    \
             "keeping native_transport_port unencrypted" \
     )   \
+    val(native_transport_max_flush_delay_in_us, uint32_t, 100, Used,                \
+            "Responses to CQL requests completing together are written to the client connection in one go. This is the longest a response may wait for others to be written with it. 0 writes each response on its own." \
+    )   \
+    val(native_transport_max_queue_time_in_ms, uint32_t, 1000, Used,                \
+            "CQL requests waiting for the memory of the native transport for longer than that are answered with an OVERLOADED error without being executed. 0 never sheds requests." \
+    )   \
+    val(native_shard_aware_transport_port, uint16_t, 19042, Used,                \
+            "Like native_transport_port, but clients are handed to the shard selected by their source port modulo the number of shards. " \
+            "Drivers aware of the sharding of data, as advertised in the SUPPORTED message, use it to connect to each shard. Set to 0 to disable." \
+    )   \
     val(native_transport_max_threads, uint32_t, 128, Invalid,                \
             "The maximum number of thread handling requests. The meaning is the same as rpc_max_threads.\n"  \
             "Default is different (128 versus unlimited).\n"  \
@@ -604,28 +661,53 @@ class config {
     val(cache_hit_rate_read_balancing, bool, true, Used, \
             "This boolean controls whether the replicas for read query will be choosen based on cache hit ratio"\
     ) \
+    val(workload_io_shares, string_map, /*none*/, Used, \
+            "Gives the sstable reads of the queries of the listed users their own I/O priority class, with the given shares, e.g. {analytics: 20}. " \
+            "The reads of the queries of all other users share the query class, of 100 shares. Should be the same on all nodes, as the replicas schedule the reads of the users known to the coordinator." \
+    ) \
+    val(max_concurrent_partition_reads, uint32_t, 64, Used, \
+            "The maximum number of partitions the coordinator reads concurrently for a query restricting the partition key with IN." \
+    ) \
+    val(counter_update_coalescing_window_in_us, uint32_t, 0, Used, \
+            "Counter updates the coordinator receives within that window are combined, the deltas to the same partition of a table being summed, and sent to their leader as one update. The clients whose updates were combined are acknowledged together. 0 sends each update on its own." \
+    ) \
+    val(mutation_batch_size_in_kb, uint32_t, 64, Used, \
+            "Mutations the coordinator sends to the same replica while running the same batch of tasks are coalesced into one message, of at most that size. 0 sends each mutation on its own." \
+    ) \
+    val(background_read_repair, bool, false, Used, \
+            "When a read finds the replicas inconsistent, return the reconciled result right away and write the repairing mutations to the replicas in the background, rather than before replying. Reads are then faster, but a quorum read may return a value a later quorum read doesn't see, until the repair is done." \
+    ) \
+    val(background_read_repair_concurrency, uint32_t, 32, Used, \
+            "The number of background read repairs each shard writes concurrently." \
+    ) \
+    val(background_read_repair_queue_size, uint32_t, 1024, Used, \
+            "The number of background read repairs each shard queues, waiting for concurrency, before it drops new ones." \
+    ) \
     /* Advanced fault detection settings */ \
     /* Settings to handle poorly performing or failing nodes. */    \
-    val(dynamic_snitch_badness_threshold, double, 0, Unused,     \
+    val(dynamic_snitch, bool, true, Used,     \
+            "Order the replicas of reads by the latency of their recent responses, in addition to their proximity, so that a slow replica is avoided."  \
+    )   \
+    val(dynamic_snitch_badness_threshold, double, 0.1, Used,     \
             "Sets the performance threshold for dynamically routing requests away from a poorly performing node. A value of 0.2 means Cassandra continues to prefer the static snitch values until the node response time is 20% worse than the best performing node. Until the threshold is reached, incoming client requests are statically routed to the closest replica (as determined by the snitch). Having requests consistently routed to a given replica can help keep a working set of data hot when read repair is less than 1."  \
     )   \
-    val(dynamic_snitch_reset_interval_in_ms, uint32_t, 60000, Unused,     \
+    val(dynamic_snitch_reset_interval_in_ms, uint32_t, 60000, Used,     \
             "Time interval in milliseconds to reset all node scores, which allows a bad node to recover."  \
     )   \
     val(dynamic_snitch_update_interval_in_ms, uint32_t, 100, Unused,     \
             "The time interval for how often the snitch calculates node scores. Because score calculation is CPU intensive, be careful when reducing this interval."  \
     )   \
-    val(hinted_handoff_enabled, bool, true, Unused,     \
+    val(hinted_handoff_enabled, bool, true, Used,     \
             "Enable or disable hinted handoff. To enable per data center, add data center list. For example: hinted_handoff_enabled: DC1,DC2. A hint indicates that the write needs to be replayed to an unavailable node. Where Cassandra writes the hint depends on the version:\n"  \
             "\n"    \
             "\tPrior to 1.0: Writes to a live replica node.\n"  \
             "\t1.0 and later: Writes to the coordinator node.\n"  \
             "Related information: About hinted handoff writes"  \
     )   \
-    val(hinted_handoff_throttle_in_kb, uint32_t, 1024, Unused,     \
+    val(hinted_handoff_throttle_in_kb, uint32_t, 1024, Used,     \
             "Maximum throttle per delivery thread in kilobytes per second. This rate reduces proportionally to the number of nodes in the cluster. For example, if there are two nodes in the cluster, each delivery thread will use the maximum rate. If there are three, each node will throttle to half of the maximum, since the two nodes are expected to deliver hints simultaneously."  \
     )   \
-    val(max_hint_window_in_ms, uint32_t, 10800000, Unused,     \
+    val(max_hint_window_in_ms, uint32_t, 10800000, Used,     \
             "Maximum amount of time that hints are generates hints for an unresponsive node. After this interval, new hints are no longer generated until the node is back up and responsive. If the node goes down again, a new interval begins. This setting can prevent a sudden demand for resources when a node is brought back online and the rest of the cluster attempts to replay a large volume of hinted writes.\n"  \
             "Related information: Failure detection and recovery"  \
     )   \
@@ -635,6 +717,9 @@ class config {
     val(batchlog_replay_throttle_in_kb, uint32_t, 1024, Unused,     \
             "Total maximum throttle. Throttling is reduced proportionally to the number of nodes in the cluster."  \
     )   \
+    val(batchlog_local_writes, bool, false, Used,     \
+            "Write the batchlog entries of logged batches to the local batchlog, on the coordinating shard, instead of to two other nodes of the data center. This saves the round trips to them, but the coordinator is then the only node able to replay a batch which it failed to apply, so a batch may be applied partially until it comes back. Intended for single data center deployments which accept that."  \
+    )   \
     /* Request scheduler properties */  \
     /* Settings to handle incoming client requests according to a defined policy. If you need to use these properties, your nodes are overloaded and dropping requests. It is recommended that you add more nodes and not try to prioritize requests. */    \
     val(request_scheduler, sstring, "org.apache.cassandra.scheduler.NoScheduler", Unused,     \
@@ -756,18 +841,33 @@ class config {
     val(replace_address, sstring, "", Used, "The listen_address or broadcast_address of the dead node to replace. Same as -Dcassandra.replace_address.") \
     val(replace_address_first_boot, sstring, "", Used, "Like replace_address option, but if the node has been bootstrapped successfully it will be ignored. Same as -Dcassandra.replace_address_first_boot.") \
     val(override_decommission, bool, false, Used, "Set true to force a decommissioned node to join the cluster") \
+    val(fast_restart, bool, false, Used, "When set to true, a node that already joined the ring and restarts with unchanged tokens uses the ring state persisted in the system tables: it skips the gossip shadow round and the wait for gossip to settle, and starts serving right away while gossip reconciles the ring state in the background. Requires load_ring_state.") \
     val(ring_delay_ms, uint32_t, 30 * 1000, Used, "Time a node waits to hear from other nodes before joining the ring in milliseconds. Same as -Dcassandra.ring_delay_ms in cassandra.") \
     val(shutdown_announce_in_ms, uint32_t, 2 * 1000, Used, "Time a node waits after sending gossip shutdown message in milliseconds. Same as -Dcassandra.shutdown_announce_in_ms in cassandra.") \
     val(developer_mode, bool, false, Used, "Relax environment checks. Setting to true can reduce performance and reliability significantly.") \
     val(skip_wait_for_gossip_to_settle, int32_t, -1, Used, "An integer to configure the wait for gossip to settle. -1: wait normally, 0: do not wait at all, n: wait for at most n polls. Same as -Dcassandra.skip_wait_for_gossip_to_settle in cassandra.") \
     val(experimental, bool, false, Used, "Set to true to unlock experimental features.") \
     val(lsa_reclamation_step, size_t, 1, Used, "Minimum number of segments to reclaim in a single step") \
+    val(lsa_background_reclaim_free_memory_percent, double, 1, Used, "Percentage of the memory of each shard to keep free by compacting and evicting in the background, so that allocations don't have to. (0: disabled)") \
+    val(lsa_background_reclaim_cpu_percent, double, 5, Used, "Maximum percentage of the CPU of each shard used for reclaiming memory in the background") \
+    val(lsa_cache_segment_eviction, bool, false, Used, "Reclaim memory from the row cache by evicting all partitions held in its least recently filled segment together, which frees the segment without compacting it") \
     val(prometheus_port, uint16_t, 9180, Used, "Prometheus port, set to zero to disable") \
     val(prometheus_address, sstring, "0.0.0.0", Used, "Prometheus listening address") \
     val(prometheus_prefix, sstring, "scylla", Used, "Set the prefix of the exported Prometheus metrics. Changing this will break Scylla's dashboard compatibility, do not change unless you know what you are doing.") \
     val(abort_on_lsa_bad_alloc, bool, false, Used, "Abort when allocation in LSA region fails") \
     val(murmur3_partitioner_ignore_msb_bits, unsigned, 0, Used, "Number of most siginificant token bits to ignore in murmur3 partitioner; increase for very large clusters") \
     val(virtual_dirty_soft_limit, double, 0.6, Used, "Soft limit of virtual dirty memory expressed as a portion of the hard limit") \
+    val(compaction_max_concurrent_per_table, unsigned, 4, Used, "Maximum number of compactions which may run in parallel on a table, on each shard. Jobs on the same table only run in parallel when they compact disjoint sstables of different size tiers, or of disjoint levels") \
+    val(compaction_static_shares, float, 0, Used, "If set to higher than 0, ignore the controller's output and set the compaction shares statically. Do not set this unless you know what you are doing and suspect a problem in the controller. This option will be retired when the controller reaches more maturity") \
+    val(memtable_flush_static_shares, float, 0, Used, "If set to higher than 0, ignore the controller's output and set the memtable shares statically. Do not set this unless you know what you are doing and suspect a problem in the controller. This option will be retired when the controller reaches more maturity") \
+    val(sstable_format, sstring, "ka", Used, "Format of newly written sstables: 'ka', or 'sa' (Scylla's own format with delta-encoded rows, modelled on Cassandra 3.x's mc but not readable by Cassandra)") \
+    val(sstable_filter_type, sstring, "classic", Used, "Layout of the bloom filter of newly written sstables: 'classic', or 'blocked', which confines the bits of each key to a single cache line for cheaper lookups at a slightly larger size. Sstables with blocked filters are not readable by versions which do not support them") \
+    val(sstable_index_compression, sstring, "none", Used, "Compression of the Index.db component of newly written sstables: 'none', 'lz4', 'snappy', 'deflate' or 'zstd'. The index entries are compressed in chunks of 8 kB, located through a table of their offsets recorded in the Scylla component, so that reading the entries between two Summary entries only reads the chunks holding them. Sstables with compressed indexes are not readable by versions which do not support them") \
+    val(sstable_compression_checksum, sstring, "adler32", Used, "Checksum of the compressed chunks of newly written sstables: 'adler32', or 'crc32c', which is computed with SSE4.2 or ARMv8 CRC instructions and is much cheaper to verify. Sstables with crc32c checksums are not readable by versions which do not support them") \
+    val(stream_mutation_fragment_size_in_kb, uint32_t, 128, Used, "Partitions are streamed in messages of about this size, each holding some of the rows and range tombstones of a partition, which the receiver applies as they arrive. With at most 256 messages in flight per shard, this bounds the memory used by streaming regardless of the size of the partitions. Ignored until all the nodes support fragmented partitions") \
+    val(stream_sstable_files, bool, true, Used, "Stream whole sstables, whose token range lies entirely within a streamed range, by sending their component files as they are instead of re-serializing their mutations. Used by bootstrap, decommission and other range movements once all the nodes support it") \
+    val(reactor_stall_threshold_ms, uint32_t, 200, Used, "Log the backtrace of the tasks which run on a shard for longer than this, at most once every 10 seconds per shard, and count them per subsystem in the stall_detector_stalls metric. 0 disables the detection") \
+    val(coordinator_result_cache_size_in_mb, uint32_t, 64, Used, "Memory used, on each node, to cache the results of prepared SELECT statements of single partitions of the tables which set the coordinator_ttl_in_ms caching option. Cached results are dropped when this node coordinates a write to their partition, and otherwise live at most coordinator_ttl_in_ms") \
     /* done! */
 
 #define _make_value_member(name, type, deflt, status, desc, ...)    \
@@ -200,6 +200,10 @@ void validate_for_read(const sstring& keyspace_name, consistency_level cl);
 
 void validate_for_write(const sstring& keyspace_name, consistency_level cl);
 
+void validate_for_cas_commit(const sstring& keyspace_name, consistency_level cl);
+
+void validate_for_cas(consistency_level cl);
+
 bool is_serial_consistency(consistency_level cl);
 
 void validate_counter_for_write(schema_ptr s, consistency_level cl);
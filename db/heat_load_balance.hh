@@ -65,8 +65,9 @@ class combination_generator {
     // of the nodes returned does not answer.
     // The "extra" is guaranteed to be different from any of the regular nodes,
     // but does not participate in the probability calculation and we do
-    // not make a guarantee how it will be distributed (it will in fact
-    // be uniformly distributed over the remaining nodes).
+    // not make a guarantee how it will be distributed (it is chosen among
+    // the remaining nodes in proportion to their probabilities, so that a
+    // node with a cold cache is less likely to be it).
     // In particular, the caller should only use the extra node in
     // exceptional situations. If the caller always plans to send a request
     // to one additional node up-front, it should use a combination_generator
@@ -89,23 +90,46 @@ class combination_generator {
         }
         if (_extra) {
             // Choose one of the remaining n-k nodes as the extra (k+1)th
-            // returned node. Currently, we choose the nodes with equal
-            // probablities. We could have also used _pp or the original p
-            // for this - I don't know which is better, if it even matters.
+            // returned node, weighted by _pp. The extra node usually gets
+            // a digest request, and a cold node would be the slowest to
+            // answer it. If none of the remaining nodes has a non-zero
+            // probability, we choose them with equal probabilities.
             std::vector<bool> used(n);
             for (int i : r) {
                 used[i] = true;
             }
-            int m = ::rand_float() * (n - _k);
+            float total = 0;
             for (unsigned i = 0; i < n; i++) {
                 if (!used[i]) {
-                    if (!m) {
-                        ret.push_back(_nodes[i]);
-                        break;
+                    total += _pp[i];
+                }
+            }
+            unsigned last = n;
+            if (total > 0) {
+                float m = ::rand_float() * total;
+                for (unsigned i = 0; i < n; i++) {
+                    if (!used[i]) {
+                        last = i;
+                        m -= _pp[i];
+                        if (m < 0) {
+                            break;
+                        }
+                    }
+                }
+            } else {
+                int m = ::rand_float() * (n - _k);
+                for (unsigned i = 0; i < n; i++) {
+                    if (!used[i]) {
+                        last = i;
+                        if (!m) {
+                            break;
+                        }
+                        --m;
                     }
-                    --m;
                 }
             }
+            // Rounding may leave m positive after the last unused node.
+            ret.push_back(_nodes[last]);
         }
         assert(ret.size() == ke);
         return ret;
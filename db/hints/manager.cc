@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/range/adaptor/map.hpp>
+#include <boost/range/algorithm/find.hpp>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/semaphore.hh>
+#include <seastar/core/reactor.hh>
+#include "db/hints/manager.hh"
+#include "db/commitlog/commitlog_entry.hh"
+#include "service/storage_proxy.hh"
+#include "gms/gossiper.hh"
+#include "converting_mutation_partition_applier.hh"
+#include "utils/data_input.hh"
+#include "lister.hh"
+#include "log.hh"
+
+namespace db {
+namespace hints {
+
+static logging::logger hlogger("hints_manager");
+
+// How often the endpoints are checked for hints to send.
+static constexpr auto hints_check_period = std::chrono::seconds(10);
+static constexpr uint64_t hint_segment_size_in_mb = 32;
+static constexpr uint64_t max_hints_per_ep_size_mb = 128;
+// Hints of an endpoint in flight at a time.
+static constexpr size_t max_hints_send_concurrency = 16;
+
+static future<std::vector<sstring>> list_segments(sstring dir) {
+    auto segments = make_lw_shared<std::vector<sstring>>();
+    return lister::scan_dir(dir, { directory_entry_type::regular }, [segments] (lister::path dir, directory_entry de) {
+        if (boost::starts_with(de.name, commitlog::descriptor::FILENAME_PREFIX)) {
+            segments->push_back((dir / de.name).native());
+        }
+        return make_ready_future<>();
+    }).then([segments] {
+        return std::move(*segments);
+    });
+}
+
+manager::end_point_hints_manager::end_point_hints_manager(gms::inet_address key, manager& shard_manager)
+    : _key(key)
+    , _shard_manager(shard_manager)
+    , _dir(sprint("%s/%s", shard_manager._hints_dir, key))
+{ }
+
+commitlog::config manager::end_point_hints_manager::store_config() const {
+    commitlog::config cfg;
+    cfg.commit_log_location = _dir;
+    cfg.commitlog_segment_size_in_mb = hint_segment_size_in_mb;
+    cfg.commitlog_total_space_in_mb = max_hints_per_ep_size_mb;
+    return cfg;
+}
+
+future<> manager::end_point_hints_manager::open_store() {
+    if (_hints_store) {
+        return make_ready_future<>();
+    }
+    return with_lock(_store_lock.for_write(), [this] {
+        if (_hints_store) {
+            return make_ready_future<>();
+        }
+        return recursive_touch_directory(_dir).then([this] {
+            return commitlog::create_commitlog(store_config());
+        }).then([this] (commitlog cl) {
+            // The segments already in the directory were queued for sending
+            // when the manager started, or when the store was switched.
+            cl.get_segments_to_replay();
+            _hints_store.emplace(std::move(cl));
+        });
+    });
+}
+
+// Requires _store_lock to be held for writing.
+future<> manager::end_point_hints_manager::close_store() {
+    if (!_hints_store) {
+        return make_ready_future<>();
+    }
+    return _hints_store->shutdown().then([this] {
+        return _hints_store->release();
+    }).finally([this] {
+        _hints_store = {};
+    });
+}
+
+// Closes the store, so that all hints written so far are in complete
+// segments, which can be sent. The store is reopened by the next hint.
+future<> manager::end_point_hints_manager::switch_store() {
+    return with_lock(_store_lock.for_write(), [this] {
+        if (!_hints_store || !_unsent_hints) {
+            return make_ready_future<>();
+        }
+        return close_store().then([this] {
+            return list_segments(_dir);
+        }).then([this] (std::vector<sstring> segments) {
+            add_segments(std::move(segments));
+            _unsent_hints = 0;
+        });
+    });
+}
+
+void manager::end_point_hints_manager::add_segments(std::vector<sstring> segments) {
+    for (auto&& s : segments) {
+        if (boost::find(_segments_to_send, s) == _segments_to_send.end()) {
+            _segments_to_send.push_back(std::move(s));
+        }
+    }
+}
+
+future<> manager::end_point_hints_manager::store_hint(schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) {
+    ++_hints_in_progress;
+    ++_shard_manager._stats.size_of_hints_in_progress;
+    return open_store().then([this, s = std::move(s), fm = std::move(fm)] () mutable {
+        return with_lock(_store_lock.for_read(), [this, s = std::move(s), fm = std::move(fm)] () mutable {
+            if (!_hints_store) {
+                throw std::runtime_error("hints were truncated");
+            }
+            // Each hint starts with the time it was written at, so that too
+            // old hints are not replayed.
+            auto created = gc_clock::now().time_since_epoch().count();
+            commitlog_entry_writer cew(s, *fm);
+            cew.set_with_schema(true);
+            auto size = sizeof(int64_t) + cew.size();
+            return _hints_store->add(s->id(), size, commitlog::timeout_clock::time_point::max(), [s, fm, created] (commitlog::output& out) {
+                commitlog_entry_writer cew(s, *fm);
+                cew.set_with_schema(true);
+                out.write<int64_t>(created);
+                cew.write(out);
+            }).then([this] (rp_handle h) {
+                // The segments are never flushed like those of the commitlog
+                // are, so they stay dirty, and aren't deleted, until they
+                // are sent.
+                h.release();
+                ++_unsent_hints;
+                ++_created;
+                ++_shard_manager._stats.written;
+            });
+        });
+    }).then_wrapped([this] (future<> f) {
+        --_hints_in_progress;
+        --_shard_manager._stats.size_of_hints_in_progress;
+        try {
+            f.get();
+        } catch (...) {
+            ++_not_stored;
+            ++_shard_manager._stats.errors;
+            hlogger.warn("Failed to store a hint for {}: {}", _key, std::current_exception());
+        }
+    });
+}
+
+bool manager::end_point_hints_manager::can_send() const {
+    return !_shard_manager._paused && !_shard_manager._stopping && gms::get_local_gossiper().is_alive(_key);
+}
+
+future<> manager::end_point_hints_manager::send_one_hint(temporary_buffer<char> buf) {
+    data_input in(buf);
+    auto created = gc_clock::time_point(gc_clock::duration(in.read<int64_t>()));
+    buf.trim_front(sizeof(int64_t));
+    commitlog_entry_reader cer(buf);
+    auto& fm = cer.mutation();
+
+    schema_ptr s;
+    try {
+        s = _shard_manager._proxy.get_db().local().find_schema(fm.column_family_id());
+    } catch (no_such_column_family&) {
+        ++_shard_manager._stats.discarded;
+        return make_ready_future<>();
+    }
+    // The replica may have purged the tombstones the hint shadows by now,
+    // so the hint could resurrect deleted data.
+    if (gc_clock::now() > created + s->gc_grace_seconds()) {
+        ++_shard_manager._stats.discarded;
+        return make_ready_future<>();
+    }
+    auto m = [&] {
+        if (s->version() == fm.schema_version()) {
+            return fm.unfreeze(s);
+        }
+        auto& cm = *cer.get_column_mapping();
+        mutation m(fm.decorated_key(*s), s);
+        converting_mutation_partition_applier v(cm, *s, m.partition());
+        fm.partition().accept(cm, v);
+        return m;
+    }();
+    return _shard_manager._send_limiter.reserve(fm.representation().size()).then([this, m = std::move(m)] () mutable {
+        return _shard_manager._proxy.send_to_endpoint(std::move(m), _key, db::write_type::SIMPLE);
+    }).then([this] {
+        ++_shard_manager._stats.sent;
+    });
+}
+
+// Resolves to true if all hints of the segment were either sent or
+// discarded, so that it can be deleted.
+future<bool> manager::end_point_hints_manager::send_segment(sstring file_name) {
+    struct send_state {
+        semaphore units{max_hints_send_concurrency};
+        bool failed = false;
+    };
+    auto st = make_lw_shared<send_state>();
+    return commitlog::read_log_file(file_name, [this, st] (temporary_buffer<char> buf, replay_position) {
+        if (st->failed || !can_send()) {
+            st->failed = true;
+            return make_ready_future<>();
+        }
+        return st->units.wait().then([this, st, buf = std::move(buf)] () mutable {
+            // Not waited for, so that a few hints are in flight at a time.
+            send_one_hint(std::move(buf)).handle_exception([this, st] (std::exception_ptr ep) {
+                hlogger.debug("Failed to send a hint to {}: {}", _key, ep);
+                st->failed = true;
+            }).finally([st] {
+                st->units.signal();
+            });
+        });
+    }).then([] (auto s) {
+        auto f = s->done();
+        return f.finally([s = std::move(s)] { });
+    }).then_wrapped([this, st, file_name] (future<> f) {
+        try {
+            f.get();
+        } catch (commitlog::segment_data_corruption_error& e) {
+            hlogger.warn("Hints segment {} is corrupt, {} bytes of hints to {} were lost", file_name, e.bytes(), _key);
+        } catch (...) {
+            hlogger.warn("Failed to read hints segment {}: {}", file_name, std::current_exception());
+            st->failed = true;
+        }
+        return st->units.wait(max_hints_send_concurrency).then([st] {
+            return !st->failed;
+        });
+    });
+}
+
+void manager::end_point_hints_manager::maybe_send() {
+    if (_sending || !has_pending_hints() || !can_send()) {
+        return;
+    }
+    _sending = true;
+    with_gate(_shard_manager._gate, [this] {
+        return switch_store().then([this] {
+            return repeat([this] {
+                if (_segments_to_send.empty() || !can_send()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                auto name = _segments_to_send.front();
+                return send_segment(name).then([this, name] (bool done) {
+                    if (!done) {
+                        // Retried at the next check.
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    _segments_to_send.remove(name);
+                    return remove_file(name).then([] {
+                        return stop_iteration::no;
+                    });
+                });
+            });
+        });
+    }).handle_exception([this] (std::exception_ptr ep) {
+        hlogger.warn("Failed to send hints to {}: {}", _key, ep);
+    }).finally([this] {
+        _sending = false;
+    });
+}
+
+future<> manager::end_point_hints_manager::truncate() {
+    return with_lock(_store_lock.for_write(), [this] {
+        return close_store().then([this] {
+            _unsent_hints = 0;
+            auto segments = std::exchange(_segments_to_send, {});
+            // Segments left by other shards are elsewhere.
+            return parallel_for_each(segments, [] (sstring& name) {
+                return remove_file(name).handle_exception([] (std::exception_ptr) { });
+            }).finally([segments = std::move(segments)] { });
+        }).then([this] {
+            return engine().file_exists(_dir);
+        }).then([this] (bool exists) {
+            return exists ? lister::rmdir(_dir) : make_ready_future<>();
+        });
+    });
+}
+
+future<> manager::end_point_hints_manager::stop() {
+    return with_lock(_store_lock.for_write(), [this] {
+        return close_store();
+    });
+}
+
+manager::manager(sstring hints_dir, service::storage_proxy& proxy, std::chrono::milliseconds max_hint_window, size_t send_rate)
+    : _hints_base_dir(std::move(hints_dir))
+    , _hints_dir(sprint("%s/%d", _hints_base_dir, engine().cpu_id()))
+    , _proxy(proxy)
+    , _max_hint_window(max_hint_window)
+    , _send_limiter(send_rate)
+    , _timer([this] { on_timer(); })
+{
+    namespace sm = seastar::metrics;
+    _metrics.add_group("hints_manager", {
+        sm::make_gauge("size_of_hints_in_progress", [this] { return _stats.size_of_hints_in_progress; },
+                       sm::description("number of hints being written")),
+
+        sm::make_derive("written", [this] { return _stats.written; },
+                        sm::description("number of hints written")),
+
+        sm::make_derive("errors", [this] { return _stats.errors; },
+                        sm::description("number of hints which failed to be written")),
+
+        sm::make_derive("dropped", [this] { return _stats.dropped; },
+                        sm::description("number of hints not written because the manager was stopping, or couldn't keep track of the endpoint")),
+
+        sm::make_derive("sent", [this] { return _stats.sent; },
+                        sm::description("number of hints delivered")),
+
+        sm::make_derive("discarded", [this] { return _stats.discarded; },
+                        sm::description("number of hints not delivered because their table was dropped, or they were older than its gc_grace_seconds")),
+    });
+}
+
+manager::end_point_hints_manager& manager::get_ep_manager(gms::inet_address ep) {
+    auto it = _ep_managers.find(ep);
+    if (it == _ep_managers.end()) {
+        it = _ep_managers.emplace(std::piecewise_construct, std::forward_as_tuple(ep), std::forward_as_tuple(ep, *this)).first;
+    }
+    return it->second;
+}
+
+future<> manager::load_segments(sstring shard_dir) {
+    return lister::scan_dir(shard_dir, { directory_entry_type::directory }, [this] (lister::path dir, directory_entry de) {
+        gms::inet_address ep;
+        try {
+            ep = gms::inet_address(de.name);
+        } catch (...) {
+            hlogger.warn("Ignoring {}/{}, which isn't named after an endpoint", dir.native(), de.name);
+            return make_ready_future<>();
+        }
+        return list_segments((dir / de.name).native()).then([this, ep] (std::vector<sstring> segments) {
+            if (!segments.empty()) {
+                hlogger.info("Found {} hints segments for {}", segments.size(), ep);
+                get_ep_manager(ep).add_segments(std::move(segments));
+            }
+        });
+    });
+}
+
+future<> manager::start() {
+    return recursive_touch_directory(_hints_dir).then([this] {
+        return lister::scan_dir(_hints_base_dir, { directory_entry_type::directory }, [this] (lister::path dir, directory_entry de) {
+            unsigned shard;
+            try {
+                shard = boost::lexical_cast<unsigned>(de.name);
+            } catch (boost::bad_lexical_cast&) {
+                return make_ready_future<>();
+            }
+            if (shard % smp::count != engine().cpu_id()) {
+                return make_ready_future<>();
+            }
+            return load_segments((dir / de.name).native());
+        });
+    }).then([this] {
+        _started = true;
+        _timer.arm_periodic(hints_check_period);
+    });
+}
+
+future<> manager::stop() {
+    _stopping = true;
+    _timer.cancel();
+    return _gate.close().then([this] {
+        return parallel_for_each(_ep_managers | boost::adaptors::map_values, [] (end_point_hints_manager& ep_man) {
+            return ep_man.stop();
+        });
+    });
+}
+
+void manager::on_timer() {
+    for (auto&& ep_man : _ep_managers | boost::adaptors::map_values) {
+        ep_man.maybe_send();
+    }
+}
+
+bool manager::can_hint_for(gms::inet_address ep) const {
+    if (!_started || _stopping) {
+        return false;
+    }
+    auto downtime = std::chrono::microseconds(gms::get_local_gossiper().get_endpoint_downtime(ep));
+    if (downtime > _max_hint_window) {
+        hlogger.trace("Not hinting {}, which has been down for {}ms", ep, std::chrono::duration_cast<std::chrono::milliseconds>(downtime).count());
+        return false;
+    }
+    return true;
+}
+
+bool manager::store_hint(gms::inet_address ep, schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept {
+    if (!_started || _stopping) {
+        ++_stats.dropped;
+        return false;
+    }
+    try {
+        auto& ep_man = get_ep_manager(ep);
+        with_gate(_gate, [&ep_man, s = std::move(s), fm = std::move(fm)] () mutable {
+            return ep_man.store_hint(std::move(s), std::move(fm));
+        });
+        return true;
+    } catch (...) {
+        ++_stats.dropped;
+        hlogger.warn("Dropped a hint for {}: {}", ep, std::current_exception());
+        return false;
+    }
+}
+
+uint64_t manager::hints_in_progress_for(gms::inet_address ep) const {
+    auto it = _ep_managers.find(ep);
+    return it == _ep_managers.end() ? 0 : it->second.hints_in_progress();
+}
+
+std::vector<gms::inet_address> manager::endpoints_pending_hints() const {
+    std::vector<gms::inet_address> ret;
+    for (auto&& e : _ep_managers) {
+        if (e.second.has_pending_hints()) {
+            ret.push_back(e.first);
+        }
+    }
+    return ret;
+}
+
+uint64_t manager::created_hints_for(gms::inet_address ep) const {
+    auto it = _ep_managers.find(ep);
+    return it == _ep_managers.end() ? 0 : it->second.created_hints();
+}
+
+uint64_t manager::not_stored_hints_for(gms::inet_address ep) const {
+    auto it = _ep_managers.find(ep);
+    return it == _ep_managers.end() ? 0 : it->second.not_stored_hints();
+}
+
+future<> manager::truncate_hints(std::experimental::optional<gms::inet_address> ep) {
+    return with_gate(_gate, [this, ep] {
+        if (ep) {
+            auto it = _ep_managers.find(*ep);
+            return it == _ep_managers.end() ? make_ready_future<>() : it->second.truncate();
+        }
+        return parallel_for_each(_ep_managers | boost::adaptors::map_values, [] (end_point_hints_manager& ep_man) {
+            return ep_man.truncate();
+        });
+    });
+}
+
+void manager::schedule_delivery(gms::inet_address ep) {
+    auto it = _ep_managers.find(ep);
+    if (it != _ep_managers.end()) {
+        it->second.maybe_send();
+    }
+}
+
+void manager::pause_delivery(bool pause) {
+    _paused = pause;
+}
+
+}
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <experimental/optional>
+#include <seastar/core/gate.hh>
+#include <seastar/core/rwlock.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/metrics_registration.hh>
+#include "db/commitlog/commitlog.hh"
+#include "gms/inet_address.hh"
+#include "frozen_mutation.hh"
+#include "schema.hh"
+#include "utils/rate_limiter.hh"
+#include "seastarx.hh"
+
+namespace service {
+class storage_proxy;
+}
+
+namespace db {
+namespace hints {
+
+// Keeps the writes which couldn't be delivered to a replica, the hints, and
+// replays them once the replica comes back up, so that a short outage
+// doesn't call for a repair.
+//
+// The hints of each endpoint are written to a commitlog of their own, in
+// <hints_directory>/<shard>/<endpoint>. When gossip sees the endpoint alive,
+// its commitlog is switched to new segments, and the previous segments are
+// sent, one hint at a time, rate limited, and deleted once all their hints
+// were either delivered or are too old to be. Hints older than the
+// gc_grace_seconds of their table are dropped, since they could resurrect
+// deleted data.
+//
+// Each shard replays the hint logs of all shards which were numbered like it
+// modulo the current number of shards, so that none are lost when the number
+// of shards changes.
+class manager {
+public:
+    struct stats {
+        // Hints being written.
+        uint64_t size_of_hints_in_progress = 0;
+        uint64_t written = 0;
+        uint64_t errors = 0;
+        uint64_t dropped = 0;
+        uint64_t sent = 0;
+        uint64_t discarded = 0;
+    };
+private:
+    class end_point_hints_manager {
+        gms::inet_address _key;
+        manager& _shard_manager;
+        sstring _dir;
+        // Engaged once there is something to hint.
+        std::experimental::optional<commitlog> _hints_store;
+        // Segments of previous instances of the store, oldest first.
+        std::list<sstring> _segments_to_send;
+        // Held for reading while a hint is written, for writing while the
+        // store is switched or removed.
+        rwlock _store_lock;
+        // Hints written since the store was last switched.
+        uint64_t _unsent_hints = 0;
+        uint64_t _hints_in_progress = 0;
+        uint64_t _created = 0;
+        uint64_t _not_stored = 0;
+        bool _sending = false;
+    private:
+        commitlog::config store_config() const;
+        future<> open_store();
+        future<> switch_store();
+        future<> close_store();
+        future<bool> send_segment(sstring file_name);
+        future<> send_one_hint(temporary_buffer<char> buf);
+        bool can_send() const;
+    public:
+        end_point_hints_manager(gms::inet_address key, manager& shard_manager);
+
+        future<> store_hint(schema_ptr s, lw_shared_ptr<const frozen_mutation> fm);
+        void add_segments(std::vector<sstring> segments);
+        // Sends the pending hints in the background, if the endpoint is alive
+        // and there is no send in progress already.
+        void maybe_send();
+        future<> truncate();
+        future<> stop();
+
+        bool has_pending_hints() const {
+            return _unsent_hints || !_segments_to_send.empty();
+        }
+        uint64_t hints_in_progress() const {
+            return _hints_in_progress;
+        }
+        uint64_t created_hints() const {
+            return _created;
+        }
+        uint64_t not_stored_hints() const {
+            return _not_stored;
+        }
+    };
+
+    sstring _hints_base_dir;
+    // The directory of this shard's hints.
+    sstring _hints_dir;
+    service::storage_proxy& _proxy;
+    std::chrono::milliseconds _max_hint_window;
+    utils::rate_limiter _send_limiter;
+    std::unordered_map<gms::inet_address, end_point_hints_manager> _ep_managers;
+    timer<lowres_clock> _timer;
+    seastar::gate _gate;
+    bool _started = false;
+    bool _paused = false;
+    bool _stopping = false;
+    stats _stats;
+    seastar::metrics::metric_groups _metrics;
+private:
+    end_point_hints_manager& get_ep_manager(gms::inet_address ep);
+    future<> load_segments(sstring shard_dir);
+    void on_timer();
+public:
+    // Hints are kept in hints_dir/<shard>. Hints are sent at most at
+    // send_rate bytes per second.
+    manager(sstring hints_dir, service::storage_proxy& proxy, std::chrono::milliseconds max_hint_window, size_t send_rate);
+    manager(manager&&) = delete;
+
+    // Picks up the hints left by a previous run and starts replaying hints.
+    future<> start();
+    future<> stop();
+
+    // Whether the endpoint may be hinted for, i.e. it wasn't down for longer
+    // than the hint window.
+    bool can_hint_for(gms::inet_address ep) const;
+
+    // Writes the hint in the background. Returns false if it wasn't
+    // accepted, because the manager is stopping.
+    bool store_hint(gms::inet_address ep, schema_ptr s, lw_shared_ptr<const frozen_mutation> fm) noexcept;
+
+    uint64_t hints_in_progress() const {
+        return _stats.size_of_hints_in_progress;
+    }
+    uint64_t hints_in_progress_for(gms::inet_address ep) const;
+
+    std::vector<gms::inet_address> endpoints_pending_hints() const;
+    uint64_t created_hints_for(gms::inet_address ep) const;
+    uint64_t not_stored_hints_for(gms::inet_address ep) const;
+
+    // Removes the hints of the endpoint, of all endpoints if disengaged.
+    future<> truncate_hints(std::experimental::optional<gms::inet_address> ep);
+    // Starts sending the hints of the endpoint now, rather than at the next
+    // periodic check.
+    void schedule_delivery(gms::inet_address ep);
+    void pause_delivery(bool pause);
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
+
+}
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <limits>
+#include <map>
+#include <boost/lexical_cast.hpp>
+#include <core/sstring.hh>
+#include "exceptions/exceptions.hh"
+#include "json.hh"
+#include "seastarx.hh"
+
+namespace db {
+
+// The per_partition_rate_limit table option: how many reads and writes per
+// second each partition of the table may get on a replica. Zero means no
+// limit. A Scylla extension, not stored unless a limit is set.
+class per_partition_rate_limit_options {
+    uint32_t _max_writes_per_second = 0;
+    uint32_t _max_reads_per_second = 0;
+private:
+    static uint32_t parse_limit(const sstring& name, const sstring& value) {
+        try {
+            auto limit = boost::lexical_cast<int64_t>(value);
+            if (limit < 0 || limit > std::numeric_limits<uint32_t>::max()) {
+                throw exceptions::configuration_exception(sprint("Invalid %s value: %s, must be between 0 and %d",
+                        name, value, std::numeric_limits<uint32_t>::max()));
+            }
+            return limit;
+        } catch (boost::bad_lexical_cast&) {
+            throw exceptions::configuration_exception(sprint("Invalid %s value: %s", name, value));
+        }
+    }
+public:
+    per_partition_rate_limit_options() = default;
+    per_partition_rate_limit_options(uint32_t max_writes_per_second, uint32_t max_reads_per_second)
+        : _max_writes_per_second(max_writes_per_second)
+        , _max_reads_per_second(max_reads_per_second)
+    { }
+
+    uint32_t max_writes_per_second() const {
+        return _max_writes_per_second;
+    }
+
+    uint32_t max_reads_per_second() const {
+        return _max_reads_per_second;
+    }
+
+    bool enabled() const {
+        return _max_writes_per_second || _max_reads_per_second;
+    }
+
+    std::map<sstring, sstring> to_map() const {
+        std::map<sstring, sstring> map;
+        if (_max_writes_per_second) {
+            map.emplace("max_writes_per_second", to_sstring(_max_writes_per_second));
+        }
+        if (_max_reads_per_second) {
+            map.emplace("max_reads_per_second", to_sstring(_max_reads_per_second));
+        }
+        return map;
+    }
+
+    sstring to_sstring() const {
+        return json::to_json(to_map());
+    }
+
+    template<typename Map>
+    static per_partition_rate_limit_options from_map(const Map& map) {
+        per_partition_rate_limit_options ret;
+        for (auto& p : map) {
+            if (p.first == "max_writes_per_second") {
+                ret._max_writes_per_second = parse_limit(p.first, p.second);
+            } else if (p.first == "max_reads_per_second") {
+                ret._max_reads_per_second = parse_limit(p.first, p.second);
+            } else {
+                throw exceptions::configuration_exception("Invalid per_partition_rate_limit option: " + p.first);
+            }
+        }
+        return ret;
+    }
+
+    static per_partition_rate_limit_options from_sstring(const sstring& str) {
+        return from_map(json::to_map(str));
+    }
+
+    bool operator==(const per_partition_rate_limit_options& o) const {
+        return _max_writes_per_second == o._max_writes_per_second && _max_reads_per_second == o._max_reads_per_second;
+    }
+    bool operator!=(const per_partition_rate_limit_options& o) const {
+        return !(*this == o);
+    }
+};
+
+}
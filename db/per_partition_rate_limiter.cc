@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <limits>
+#include "db/per_partition_rate_limiter.hh"
+
+namespace db {
+
+constexpr std::chrono::seconds per_partition_rate_limiter::window;
+
+per_partition_rate_limiter::per_partition_rate_limiter(schema_ptr s, per_partition_rate_limit_options options)
+    : _schema(std::move(s))
+    , _hash(*_schema)
+    , _options(options)
+    , _window_start(clock_type::now())
+    , _rejected_reads(offenders_capacity, partition_key::hashing(*_schema), partition_key::equality(*_schema))
+    , _rejected_writes(offenders_capacity, partition_key::hashing(*_schema), partition_key::equality(*_schema))
+{ }
+
+void per_partition_rate_limiter::maybe_start_window(clock_type::time_point now) {
+    if (now - _window_start < window) {
+        return;
+    }
+    for (auto& sk : _sketches) {
+        sk.clear();
+    }
+    _window_start = now;
+}
+
+bool per_partition_rate_limiter::account(op_type op, const partition_key& key, clock_type::time_point now) {
+    auto max = limit(op);
+    if (!max) {
+        return true;
+    }
+    maybe_start_window(now);
+    auto& sk = _sketches[op == op_type::read ? 0 : 1];
+    auto counters = sk.counters(_hash(key));
+    uint32_t count = std::numeric_limits<uint32_t>::max();
+    for (auto c : counters) {
+        count = std::min(count, *c);
+    }
+    if (count >= max) {
+        if (op == op_type::read) {
+            _rejected_reads.append(key);
+        } else {
+            _rejected_writes.append(key);
+        }
+        return false;
+    }
+    // Conservative update: only the counters which hold the estimate are
+    // incremented, the others already count more than this partition got.
+    for (auto c : counters) {
+        *c = std::max(*c, count + 1);
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <core/lowres_clock.hh>
+#include "db/per_partition_rate_limit_options.hh"
+#include "keys.hh"
+#include "schema.hh"
+#include "utils/top_k.hh"
+#include "utils/count_min_sketch.hh"
+
+namespace db {
+
+// Enforces the per_partition_rate_limit option of a table on one shard.
+//
+// The operations of each partition in the current one-second window are
+// counted in a Count-Min sketch with conservative update, so that memory
+// doesn't grow with the number of partitions. A partition is never counted
+// less than it got, only more when it collides with hot partitions in every
+// row, so no partition gets more than the limit, though one sharing counters
+// with a hot partition may be limited early. The window is reset every
+// second, so a partition can get up to twice the limit across the boundary.
+//
+// The partitions whose operations were rejected the most are kept for the
+// REST API.
+class per_partition_rate_limiter {
+public:
+    enum class op_type { read, write };
+    using clock_type = lowres_clock;
+    using partition_counter = utils::space_saving_top_k<partition_key, partition_key::hashing, partition_key::equality>;
+    struct offenders {
+        std::vector<partition_counter::result> reads;
+        std::vector<partition_counter::result> writes;
+    };
+    static constexpr size_t width = 1024;
+    static constexpr std::chrono::seconds window{1};
+    static constexpr size_t offenders_capacity = 64;
+private:
+    using sketch = utils::count_min_sketch<uint32_t>;
+
+    schema_ptr _schema; // Keeps the schema the offenders hash keys with alive.
+    partition_key::hashing _hash;
+    per_partition_rate_limit_options _options;
+    std::array<sketch, 2> _sketches{{sketch(width), sketch(width)}};
+    clock_type::time_point _window_start;
+    partition_counter _rejected_reads;
+    partition_counter _rejected_writes;
+private:
+    void maybe_start_window(clock_type::time_point now);
+    uint32_t limit(op_type op) const {
+        return op == op_type::read ? _options.max_reads_per_second() : _options.max_writes_per_second();
+    }
+public:
+    per_partition_rate_limiter(schema_ptr s, per_partition_rate_limit_options options);
+
+    // The counts of the current window are kept across changes of limits.
+    void set_options(per_partition_rate_limit_options options) {
+        _options = options;
+    }
+
+    // Counts an operation on the partition, unless the partition already
+    // got as many operations of that type in this window as the limit, in
+    // which case the operation is counted as rejected and false is returned.
+    bool account(op_type op, const partition_key& key, clock_type::time_point now = clock_type::now());
+
+    offenders top_offenders(size_t k) const {
+        return { _rejected_reads.top(k), _rejected_writes.top(k) };
+    }
+};
+
+}
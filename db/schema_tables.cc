@@ -63,13 +63,17 @@
 #include "db/marshal/type_parser.hh"
 #include "db/config.hh"
 #include "md5_hasher.hh"
+#include "bytes_ostream.hh"
+#include "core/semaphore.hh"
 
 #include <boost/range/algorithm/copy.hpp>
+#include <boost/range/irange.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/join.hpp>
 
 #include "compaction_strategy.hh"
 #include "utils/joinpoint.hh"
+#include "utils/stall_detector.hh"
 #include "view_info.hh"
 #include "cql_type_parser.hh"
 
@@ -193,6 +197,12 @@ namespace v3 {
 
 static constexpr auto schema_gc_grace = std::chrono::duration_cast<std::chrono::seconds>(days(7)).count();
 
+// The key in system_schema.tables.extensions of the tables with a change log.
+static constexpr auto CDC_EXTENSION = "cdc";
+// The key in system_schema.tables.extensions of the per_partition_rate_limit
+// option, stored as a JSON map.
+static constexpr auto PER_PARTITION_RATE_LIMIT_EXTENSION = "per_partition_rate_limit";
+
 schema_ptr keyspaces() {
     static thread_local auto schema = [] {
         schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, KEYSPACES), NAME, KEYSPACES,
@@ -510,40 +520,143 @@ schema_ptr aggregates() {
     }
 #endif
 
+// Records what feed_hash_for_schema_digest() feeds, so that it can be fed
+// again without reading and compacting the mutation.
+class recording_hasher {
+    bytes_ostream _out;
+public:
+    void update(const char* ptr, size_t length) {
+        _out.write(ptr, length);
+    }
+    bytes_ostream finalize() && {
+        return std::move(_out);
+    }
+};
+
+// The input of the schema digest, per schema table and keyspace, so that a
+// schema change only calls for reading the partitions of the keyspaces it
+// touched instead of every schema table. Used on shard 0 only.
+//
+// The digest itself stays the MD5 of all partitions of all schema tables,
+// fed in ring order, so that it matches the one calculated by nodes which
+// don't cache it.
+class schema_digest_cache {
+    using partitions_type = std::map<dht::decorated_key, bytes_ostream, dht::decorated_key::less_comparator>;
+    // Indexed like ALL.
+    std::vector<partitions_type> _tables;
+    bool _populated = false;
+    std::set<sstring> _dirty_keyspaces;
+    // Only one calculation at a time, so that an older read never replaces
+    // the cached partitions of a newer one.
+    semaphore _sem{1};
+private:
+    static schema_ptr table_schema(distributed<service::storage_proxy>& proxy, size_t table) {
+        return proxy.local().get_db().local().find_schema(NAME, ALL[table]);
+    }
+    static partition_key keyspace_key(const schema& s, const sstring& keyspace_name) {
+        return partition_key::from_singular(s, keyspace_name);
+    }
+    static bytes_ostream feed(const mutation& m) {
+        recording_hasher h;
+        feed_hash_for_schema_digest(h, m);
+        return std::move(h).finalize();
+    }
+
+    future<> populate(distributed<service::storage_proxy>& proxy) {
+        _tables.clear();
+        return do_for_each(boost::irange<size_t>(0, ALL.size()), [this, &proxy] (size_t table) {
+            auto s = table_schema(proxy, table);
+            _tables.emplace_back(dht::decorated_key::less_comparator(s));
+            return db::system_keyspace::query_mutations(proxy, NAME, ALL[table]).then([this, s, table] (auto rs) {
+                for (auto&& p : rs->partitions()) {
+                    auto mut = p.mut().unfreeze(s);
+                    auto partition_key = value_cast<sstring>(utf8_type->deserialize(mut.key().get_component(*s, 0)));
+                    if (partition_key == NAME) {
+                        continue;
+                    }
+                    _tables[table].emplace(mut.decorated_key(), feed(mut));
+                }
+            });
+        }).then([this] {
+            _populated = true;
+        });
+    }
+
+    future<> refresh(distributed<service::storage_proxy>& proxy, std::set<sstring> keyspaces) {
+        return do_with(std::move(keyspaces), [this, &proxy] (auto& keyspaces) {
+            return do_for_each(boost::irange<size_t>(0, ALL.size()), [this, &proxy, &keyspaces] (size_t table) {
+                auto s = table_schema(proxy, table);
+                return do_for_each(keyspaces, [this, &proxy, s, table] (const sstring& keyspace_name) {
+                    auto dk = dht::global_partitioner().decorate_key(*s, keyspace_key(*s, keyspace_name));
+                    auto cmd = make_lw_shared<query::read_command>(s->id(), s->version(), query::full_slice);
+                    return do_with(dht::partition_range::make_singular(dk), [this, &proxy, s, cmd, dk, table] (auto& range) {
+                        return proxy.local().query_mutations_locally(s, cmd, range).then([this, s, dk, table] (foreign_ptr<lw_shared_ptr<reconcilable_result>> res, cache_temperature) {
+                            auto& partitions = _tables[table];
+                            partitions.erase(dk);
+                            // Only partitions which a scan of the table returns are part of the digest.
+                            for (auto&& p : res->partitions()) {
+                                auto mut = p.mut().unfreeze(s);
+                                partitions.emplace(mut.decorated_key(), feed(mut));
+                            }
+                        });
+                    });
+                });
+            });
+        });
+    }
+
+    utils::UUID digest() const {
+        md5_hasher hash;
+        for (auto&& partitions : _tables) {
+            for (auto&& p : partitions) {
+                for (bytes_view fragment : p.second) {
+                    hash.update(reinterpret_cast<const char*>(fragment.data()), fragment.size());
+                }
+            }
+        }
+        return utils::UUID_gen::get_name_UUID(hash.finalize());
+    }
+public:
+    future<utils::UUID> calculate(distributed<service::storage_proxy>& proxy) {
+        return with_semaphore(_sem, 1, [this, &proxy] {
+            auto keyspaces = std::exchange(_dirty_keyspaces, {});
+            keyspaces.erase(NAME);
+            auto f = !_populated ? populate(proxy) : refresh(proxy, std::move(keyspaces));
+            return f.then([this] {
+                return digest();
+            }).handle_exception([this] (std::exception_ptr ep) {
+                // Start over next time, what is cached may be incomplete.
+                _populated = false;
+                return make_exception_future<utils::UUID>(std::move(ep));
+            });
+        });
+    }
+
+    // Must be called once the keyspaces' schema mutations were applied.
+    void invalidate(const std::set<sstring>& keyspaces) {
+        _dirty_keyspaces.insert(keyspaces.begin(), keyspaces.end());
+    }
+};
+
+static thread_local schema_digest_cache the_schema_digest_cache;
+
 /**
  * Read schema from system keyspace and calculate MD5 digest of every row, resulting digest
  * will be converted into UUID which would act as content-based version of the schema.
+ *
+ * Only the keyspaces changed since the last calculation are read again, see schema_digest_cache.
  */
 future<utils::UUID> calculate_schema_digest(distributed<service::storage_proxy>& proxy)
 {
-    auto map = [&proxy] (sstring table) {
-        return db::system_keyspace::query_mutations(proxy, NAME, table).then([&proxy, table] (auto rs) {
-            auto s = proxy.local().get_db().local().find_schema(NAME, table);
-            std::vector<mutation> mutations;
-            for (auto&& p : rs->partitions()) {
-                auto mut = p.mut().unfreeze(s);
-                auto partition_key = value_cast<sstring>(utf8_type->deserialize(mut.key().get_component(*s, 0)));
-                if (partition_key == NAME) {
-                    continue;
-                }
-                mutations.emplace_back(std::move(mut));
-            }
-            return mutations;
-        });
-    };
-    auto reduce = [] (auto& hash, auto&& mutations) {
-        for (const mutation& m : mutations) {
-            feed_hash_for_schema_digest(hash, m);
-        }
-    };
-    return do_with(md5_hasher(), [map, reduce] (auto& hash) {
-        return do_for_each(ALL.begin(), ALL.end(), [&hash, map, reduce] (auto& table) {
-            return map(table).then([&hash, reduce] (auto&& mutations) {
-                reduce(hash, mutations);
-            });
-        }).then([&hash] {
-            return make_ready_future<utils::UUID>(utils::UUID_gen::get_name_UUID(hash.finalize()));
-        });
+    return smp::submit_to(0, [&proxy] {
+        return the_schema_digest_cache.calculate(proxy);
+    });
+}
+
+static future<> invalidate_schema_digest(std::set<sstring> keyspaces)
+{
+    return smp::submit_to(0, [keyspaces = std::move(keyspaces)] {
+        the_schema_digest_cache.invalidate(keyspaces);
     });
 }
 
@@ -754,6 +867,7 @@ static future<> do_merge_schema(distributed<service::storage_proxy>& proxy, std:
 #endif
 
        proxy.local().mutate_locally(std::move(mutations)).get0();
+       invalidate_schema_digest(keyspaces).get();
 
        if (do_flush) {
            proxy.local().get_db().invoke_on_all([s, cfs = std::move(column_families)] (database& db) {
@@ -867,6 +981,7 @@ static schema_diff diff_table_or_view(distributed<service::storage_proxy>& proxy
     std::map<qualified_name, schema_mutations>&& after,
     CreateSchema&& create_schema)
 {
+    utils::stall_context_scope stall_context(utils::stall_context::schema_merge);
     schema_diff d;
     auto diff = difference(before, after);
     for (auto&& key : diff.entries_only_on_left) {
@@ -915,8 +1030,11 @@ static void merge_tables_and_views(distributed<service::storage_proxy>& proxy,
             }
             std::vector<bool> columns_changed;
             columns_changed.reserve(tables_diff.altered.size() + views_diff.altered.size());
-            for (auto&& gs : boost::range::join(tables_diff.altered, views_diff.altered)) {
-                columns_changed.push_back(db.update_column_family(gs));
+            {
+                utils::stall_context_scope stall_context(utils::stall_context::schema_merge);
+                for (auto&& gs : boost::range::join(tables_diff.altered, views_diff.altered)) {
+                    columns_changed.push_back(db.update_column_family(gs));
+                }
             }
             parallel_for_each(boost::range::join(tables_diff.dropped, views_diff.dropped), [&] (schema_diff::dropped_schema& dt) {
                 auto& s = *dt.schema.get();
@@ -1396,7 +1514,19 @@ static void add_table_params_to_mutations(mutation& m, const clustering_key& cke
     }
 
     store_map(m, ckey, "compression", timestamp, table->get_compressor_params().get_options());
-    store_map(m, ckey, "extensions", timestamp, std::map<data_value, data_value>());
+    {
+        // Only set extensions are stored, so that the schemas of the tables
+        // which don't use them stay the same.
+        std::map<data_value, data_value> extensions;
+        if (table->cdc()) {
+            extensions.emplace(sstring(CDC_EXTENSION), data_value(bytes(1, int8_t(1))));
+        }
+        auto& rate_limit = table->per_partition_rate_limit_options();
+        if (rate_limit.enabled()) {
+            extensions.emplace(sstring(PER_PARTITION_RATE_LIMIT_EXTENSION), data_value(to_bytes(rate_limit.to_sstring())));
+        }
+        store_map(m, ckey, "extensions", timestamp, std::move(extensions));
+    }
 }
 
 static data_type expand_user_type(data_type);
@@ -1797,7 +1927,13 @@ static void prepare_builder_from_table_row(schema_builder& builder, const query:
 
     if (table_row.has("extensions")) {
         auto map = get_map<sstring, bytes>(table_row, "extensions");
-        // TODO: extensions
+        builder.set_cdc(map.count(CDC_EXTENSION));
+        auto rate_limit = map.find(PER_PARTITION_RATE_LIMIT_EXTENSION);
+        if (rate_limit != map.end()) {
+            auto& b = rate_limit->second;
+            builder.set_per_partition_rate_limit_options(db::per_partition_rate_limit_options::from_sstring(
+                    sstring(reinterpret_cast<const char*>(b.data()), b.size())));
+        }
     }
 
     if (table_row.has("gc_grace_seconds")) {
@@ -21,6 +21,9 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
 #include <boost/range/adaptor/indirected.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -34,6 +37,7 @@
 #include "partition_range_compat.hh"
 #include "range.hh"
 #include "service/storage_service.hh"
+#include "sstables/hyperloglog.hh"
 #include "stdx.hh"
 #include "streamed_mutation.hh"
 
@@ -41,11 +45,197 @@ namespace db {
 
 namespace size_estimates {
 
-class size_estimates_mutation_reader final : public mutation_reader::impl {
-    struct token_range {
-        bytes start;
-        bytes end;
+struct token_range {
+    bytes start;
+    bytes end;
+
+    bool operator==(const token_range& o) const {
+        return start == o.start && end == o.end;
+    }
+};
+
+/**
+ * The estimates of the partitions of a table in each of a set of token ranges,
+ * kept up to date with the sstables of the table rather than computed from
+ * their summaries on every query: what an sstable contributes to each range is
+ * computed once, when the sstable is first seen, and taken back once it's gone.
+ *
+ * Partitions present in several sstables are counted once, as far as the
+ * cardinality estimates of the sstables, found in their compaction metadata,
+ * tell.
+ */
+class table_estimates {
+    struct sstable_estimates {
+        // For each range.
+        std::vector<int64_t> partitions;
+        // The sum and count of the partition sizes, for the mean size.
+        int64_t size_sum = 0;
+        int64_t size_count = 0;
+        stdx::optional<hll::HyperLogLog> cardinality;
+    };
+    struct range_estimates {
+        int64_t partitions = 0;
+        int64_t size_sum = 0;
+        int64_t size_count = 0;
     };
+    std::vector<token_range> _ranges;
+    std::vector<dht::token_range_vector> _unwrapped_ranges;
+    std::vector<range_estimates> _estimates;
+    // By generation, so as not to keep deleted sstables alive.
+    std::unordered_map<int64_t, sstable_estimates> _sstables;
+    // Of the sstables without cardinality estimates.
+    size_t _without_cardinality = 0;
+    double _cardinality_sum = 0;
+    // The cardinality of the union of all the sstables, invalidated when they
+    // change.
+    stdx::optional<hll::HyperLogLog> _union;
+    double _duplicates_factor = 1;
+private:
+    void reset(const std::vector<token_range>& ranges) {
+        auto from_bytes = [] (auto& b) {
+            return dht::global_partitioner().from_sstring(utf8_type->to_string(b));
+        };
+        _ranges = ranges;
+        _unwrapped_ranges.clear();
+        for (auto&& r : ranges) {
+            dht::token_range_vector unwrapped;
+            compat::unwrap_into(
+                wrapping_range<dht::token>({{ from_bytes(r.start) }}, {{ from_bytes(r.end) }}),
+                dht::token_comparator(),
+                [&] (auto&& rng) { unwrapped.push_back(std::move(rng)); });
+            _unwrapped_ranges.push_back(std::move(unwrapped));
+        }
+        _estimates.assign(ranges.size(), range_estimates());
+        _sstables.clear();
+        _without_cardinality = 0;
+        _cardinality_sum = 0;
+        _union = stdx::nullopt;
+    }
+
+    void add(sstables::sstable& sst) {
+        sstable_estimates e;
+        auto sstable_range = dht::token_range::make(dht::token_range::bound(sst.get_first_decorated_key().token()),
+                dht::token_range::bound(sst.get_last_decorated_key().token()));
+        auto& hist = sst.get_stats_metadata().estimated_row_size;
+        for (size_t i = 0; i < hist.buckets.size() - 1; ++i) {
+            e.size_sum += hist.buckets[i] * hist.bucket_offsets[i];
+            e.size_count += hist.buckets[i];
+        }
+        e.partitions.assign(_ranges.size(), 0);
+        for (size_t i = 0; i < _ranges.size(); ++i) {
+            bool overlaps = false;
+            for (auto&& r : _unwrapped_ranges[i]) {
+                if (r.overlaps(sstable_range, dht::token_comparator())) {
+                    e.partitions[i] += sst.estimated_keys_for_range(r);
+                    overlaps = true;
+                }
+            }
+            if (overlaps) {
+                _estimates[i].partitions += e.partitions[i];
+                _estimates[i].size_sum += e.size_sum;
+                _estimates[i].size_count += e.size_count;
+            }
+        }
+        e.cardinality = sst.get_cardinality();
+        if (e.cardinality) {
+            _cardinality_sum += e.cardinality->estimate();
+            _union = stdx::nullopt;
+        } else {
+            ++_without_cardinality;
+        }
+        _sstables.emplace(sst.generation(), std::move(e));
+    }
+
+    void remove(const sstable_estimates& e) {
+        for (size_t i = 0; i < _ranges.size(); ++i) {
+            if (e.partitions[i]) {
+                _estimates[i].partitions -= e.partitions[i];
+                _estimates[i].size_sum -= e.size_sum;
+                _estimates[i].size_count -= e.size_count;
+            }
+        }
+        if (e.cardinality) {
+            _cardinality_sum -= e.cardinality->estimate();
+            _union = stdx::nullopt;
+        } else {
+            --_without_cardinality;
+        }
+    }
+
+    void update_duplicates_factor() {
+        _duplicates_factor = 1;
+        if (_without_cardinality || _sstables.size() < 2 || _cardinality_sum <= 0) {
+            return;
+        }
+        if (!_union) {
+            try {
+                for (auto&& e : _sstables | boost::adaptors::map_values) {
+                    if (!_union) {
+                        _union = *e.cardinality;
+                    } else {
+                        _union->merge(*e.cardinality);
+                    }
+                }
+            } catch (std::invalid_argument&) {
+                // Estimates of different precisions can't be merged.
+                _union = stdx::nullopt;
+                return;
+            }
+        }
+        // Dividing one cardinality estimate by others cancels out their bias.
+        _duplicates_factor = std::min(1.0, _union->estimate() / _cardinality_sum);
+    }
+public:
+    /**
+     * Brings the estimates up to date with the sstables of cf, for the given
+     * ranges. Only the sstables added since the last update are read.
+     */
+    void update(const column_family& cf, const std::vector<token_range>& ranges) {
+        if (ranges != _ranges) {
+            reset(ranges);
+        }
+        auto sstables = cf.get_sstables();
+        std::unordered_set<int64_t> generations;
+        for (auto&& sst : *sstables) {
+            generations.insert(sst->generation());
+        }
+        for (auto it = _sstables.begin(); it != _sstables.end();) {
+            if (!generations.count(it->first)) {
+                remove(it->second);
+                it = _sstables.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto&& sst : *sstables) {
+            if (!_sstables.count(sst->generation())) {
+                add(*sst);
+            }
+        }
+        update_duplicates_factor();
+    }
+
+    /**
+     * The estimates for the range of the given index in the ranges of the last update().
+     */
+    system_keyspace::range_estimates estimate(schema_ptr s, size_t range_idx) const {
+        auto& e = _estimates[range_idx];
+        auto& r = _ranges[range_idx];
+        int64_t count = std::llround(e.partitions * _duplicates_factor);
+        int64_t mean = e.size_count > 0 ? (e.size_sum + e.size_count - 1) / e.size_count : 0;
+        return {std::move(s), r.start, r.end, count, count > 0 ? mean : 0};
+    }
+
+    /**
+     * The estimates of the tables of this shard, by table id.
+     */
+    static std::unordered_map<utils::UUID, table_estimates>& shard_estimates() {
+        static thread_local std::unordered_map<utils::UUID, table_estimates> estimates;
+        return estimates;
+    }
+};
+
+class size_estimates_mutation_reader final : public mutation_reader::impl {
     schema_ptr _schema;
     const dht::partition_range& _prange;
     const query::partition_slice& _slice;
@@ -186,6 +376,16 @@ class size_estimates_mutation_reader final : public mutation_reader::impl {
             return utf8_type->less(n1, n2);
         });
         std::vector<db::system_keyspace::range_estimates> estimates;
+        auto& shard_estimates = table_estimates::shard_estimates();
+        // Forget about the dropped tables.
+        for (auto it = shard_estimates.begin(); it != shard_estimates.end();) {
+            if (!db.column_family_exists(it->first)) {
+                it = shard_estimates.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::unordered_set<utils::UUID> updated;
         for (auto& range : _slice.row_ranges(*_schema, pkey)) {
             auto rows = boost::make_iterator_range(
                     virtual_row_iterator(cf_names, local_ranges),
@@ -193,7 +393,11 @@ class size_estimates_mutation_reader final : public mutation_reader::impl {
             auto rows_to_estimate = range.slice(rows, virtual_row_comparator(_schema));
             for (auto&& r : rows_to_estimate) {
                 auto& cf = db.find_column_family(*_current_partition, utf8_type->to_string(r.cf_name));
-                estimates.push_back(estimate(cf, r.tokens));
+                auto& table = shard_estimates[cf.schema()->id()];
+                if (updated.insert(cf.schema()->id()).second) {
+                    table.update(cf, local_ranges);
+                }
+                estimates.push_back(table.estimate(cf.schema(), &r.tokens - local_ranges.data()));
                 if (estimates.size() >= _slice.partition_row_limit()) {
                     return estimates;
                 }
@@ -228,44 +432,6 @@ class size_estimates_mutation_reader final : public mutation_reader::impl {
         boost::sort(keyspaces, cmp);
         return boost::copy_range<ks_range>(range.slice(keyspaces, std::move(cmp)));
     }
-
-    /**
-     * Makes a wrapping range of ring_position from a nonwrapping range of token, used to select sstables.
-     */
-    static dht::partition_range as_ring_position_range(dht::token_range& r) {
-        stdx::optional<range<dht::ring_position>::bound> start_bound, end_bound;
-        if (r.start()) {
-            start_bound = {{ dht::ring_position(r.start()->value(), dht::ring_position::token_bound::start), r.start()->is_inclusive() }};
-        }
-        if (r.end()) {
-            end_bound = {{ dht::ring_position(r.end()->value(), dht::ring_position::token_bound::end), r.end()->is_inclusive() }};
-        }
-        return dht::partition_range(std::move(start_bound), std::move(end_bound), r.is_singular());
-    }
-
-    /**
-     * Add a new range_estimates for the specified range, considering the sstables associated with `cf`.
-     */
-    static system_keyspace::range_estimates estimate(const column_family& cf, const token_range& r) {
-        int64_t count{0};
-        utils::estimated_histogram hist{0};
-        auto from_bytes = [] (auto& b) {
-            return dht::global_partitioner().from_sstring(utf8_type->to_string(b));
-        };
-        dht::token_range_vector ranges;
-        compat::unwrap_into(
-            wrapping_range<dht::token>({{ from_bytes(r.start) }}, {{ from_bytes(r.end) }}),
-            dht::token_comparator(),
-            [&] (auto&& rng) { ranges.push_back(std::move(rng)); });
-        for (auto&& r : ranges) {
-            auto rp_range = as_ring_position_range(r);
-            for (auto&& sstable : cf.select_sstables(rp_range)) {
-                count += sstable->estimated_keys_for_range(r);
-                hist.merge(sstable->get_stats_metadata().estimated_row_size);
-            }
-        }
-        return {cf.schema(), r.start, r.end, count, count > 0 ? hist.mean() : 0};
-    }
 };
 
 struct virtual_reader {
@@ -71,6 +71,7 @@
 #include "message/messaging_service.hh"
 #include "mutation_query.hh"
 #include "db/size_estimates_virtual_reader.hh"
+#include "service/paxos/paxos_state.hh"
 
 using days = std::chrono::duration<int, std::ratio<24 * 3600>>;
 
@@ -438,6 +439,98 @@ schema_ptr size_estimates() {
     return size_estimates;
 }
 
+schema_ptr streamed_ranges() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, STREAMED_RANGES), NAME, STREAMED_RANGES,
+        // partition key
+        {{"keyspace_name", utf8_type}},
+        // clustering key
+        {{"table_id", uuid_type}, {"range", bytes_type}},
+        // regular columns
+        {},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "ranges of each table received by the bootstrap or rebuild in progress"
+        )));
+        builder.set_gc_grace_seconds(0);
+        builder.with_version(generate_schema_version(builder.uuid()));
+        return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
+schema_ptr views_builds_in_progress() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, VIEWS_BUILDS_IN_PROGRESS), NAME, VIEWS_BUILDS_IN_PROGRESS,
+        // partition key
+        {{"keyspace_name", utf8_type}},
+        // clustering key
+        {{"view_name", utf8_type}, {"cpu_id", int32_type}},
+        // regular columns
+        {{"shard_count", int32_type}, {"last_token", utf8_type}, {"finished", boolean_type}},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "progress of the views being built from the existing data of their base tables, per shard"
+        )));
+        builder.set_gc_grace_seconds(0);
+        builder.with_version(generate_schema_version(builder.uuid()));
+        return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
+schema_ptr built_views() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, BUILT_VIEWS), NAME, BUILT_VIEWS,
+        // partition key
+        {{"keyspace_name", utf8_type}},
+        // clustering key
+        {{"view_name", utf8_type}},
+        // regular columns
+        {},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "views built from the existing data of their base tables"
+        )));
+        builder.set_gc_grace_seconds(0);
+        builder.with_version(generate_schema_version(builder.uuid()));
+        return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
+schema_ptr large_partitions() {
+    static thread_local auto schema = [] {
+        schema_builder builder(make_lw_shared(::schema(generate_legacy_id(NAME, LARGE_PARTITIONS), NAME, LARGE_PARTITIONS,
+        // partition key
+        {{"keyspace_name", utf8_type}, {"table_name", utf8_type}},
+        // clustering key
+        {{"sstable_name", utf8_type}, {"partition_key", utf8_type}},
+        // regular columns
+        {{"partition_size", long_type}, {"clustering_key", utf8_type}, {"row_size", long_type}, {"compaction_time", timestamp_type}},
+        // static columns
+        {},
+        // regular column name type
+        utf8_type,
+        // comment
+        "partitions larger than compaction_large_partition_warning_threshold_mb, or with rows larger than compaction_large_row_warning_threshold_mb"
+        )));
+        builder.set_gc_grace_seconds(0);
+        builder.with_version(generate_schema_version(builder.uuid()));
+        return builder.build(schema_builder::compact_storage::no);
+    }();
+    return schema;
+}
+
 namespace v3 {
 
 schema_ptr batches() {
@@ -1066,9 +1159,13 @@ struct truncation_record {
 
 #include "idl/replay_position.dist.hh"
 #include "idl/truncation_record.dist.hh"
+#include "idl/token.dist.hh"
+#include "idl/range.dist.hh"
 #include "serializer_impl.hh"
 #include "idl/replay_position.dist.impl.hh"
 #include "idl/truncation_record.dist.impl.hh"
+#include "idl/token.dist.impl.hh"
+#include "idl/range.dist.impl.hh"
 
 namespace db {
 namespace system_keyspace {
@@ -1450,6 +1547,94 @@ future<> check_health() {
     });
 }
 
+future<> update_streamed_ranges(sstring ks_name, utils::UUID cf_id, const dht::token_range_vector& ranges) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, table_id, range) VALUES (?, ?, ?)", STREAMED_RANGES);
+    return parallel_for_each(ranges, [req, ks_name, cf_id] (const dht::token_range& range) {
+        return execute_cql(req, ks_name, cf_id, ser::serialize_to_buffer<bytes>(range)).discard_result();
+    }).then([] {
+        return force_blocking_flush(STREAMED_RANGES);
+    });
+}
+
+future<std::unordered_map<utils::UUID, dht::token_range_vector>> get_streamed_ranges(sstring ks_name) {
+    sstring req = sprint("SELECT table_id, range FROM system.%s WHERE keyspace_name = ?", STREAMED_RANGES);
+    return execute_cql(req, ks_name).then([] (::shared_ptr<cql3::untyped_result_set> msg) {
+        std::unordered_map<utils::UUID, dht::token_range_vector> ret;
+        for (auto& row : *msg) {
+            auto range = ser::deserialize_from_buffer(row.get_blob("range"), boost::type<dht::token_range>());
+            ret[row.get_as<utils::UUID>("table_id")].push_back(std::move(range));
+        }
+        return ret;
+    });
+}
+
+future<> reset_streamed_ranges(sstring ks_name) {
+    sstring req = sprint("DELETE FROM system.%s WHERE keyspace_name = ?", STREAMED_RANGES);
+    return execute_cql(req, ks_name).discard_result().then([] {
+        return force_blocking_flush(STREAMED_RANGES);
+    });
+}
+
+future<std::vector<view_build_progress>> load_view_build_progress() {
+    sstring req = sprint("SELECT keyspace_name, view_name, cpu_id, shard_count, last_token, finished FROM system.%s", VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req).then([] (::shared_ptr<cql3::untyped_result_set> msg) {
+        std::vector<view_build_progress> ret;
+        for (auto& row : *msg) {
+            stdx::optional<dht::token> last_token;
+            if (row.has("last_token")) {
+                last_token = dht::global_partitioner().from_sstring(row.get_as<sstring>("last_token"));
+            }
+            ret.push_back(view_build_progress{
+                    row.get_as<sstring>("keyspace_name"),
+                    row.get_as<sstring>("view_name"),
+                    unsigned(row.get_as<int32_t>("cpu_id")),
+                    unsigned(row.get_or<int32_t>("shard_count", 0)),
+                    std::move(last_token),
+                    row.get_or<bool>("finished", false)});
+        }
+        return ret;
+    });
+}
+
+future<> update_view_build_progress(sstring ks_name, sstring view_name, const dht::token& last_token) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, view_name, cpu_id, shard_count, last_token) VALUES (?, ?, ?, ?, ?)",
+            VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name), int32_t(engine().cpu_id()), int32_t(smp::count),
+            dht::global_partitioner().to_sstring(last_token)).discard_result();
+}
+
+future<> mark_view_build_finished_on_shard(sstring ks_name, sstring view_name) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, view_name, cpu_id, shard_count, finished) VALUES (?, ?, ?, ?, ?)",
+            VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name), int32_t(engine().cpu_id()), int32_t(smp::count), true).discard_result();
+}
+
+future<> remove_view_build_progress(sstring ks_name, sstring view_name) {
+    sstring req = sprint("DELETE FROM system.%s WHERE keyspace_name = ? AND view_name = ?", VIEWS_BUILDS_IN_PROGRESS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name)).discard_result();
+}
+
+future<std::vector<std::pair<sstring, sstring>>> load_built_views() {
+    sstring req = sprint("SELECT keyspace_name, view_name FROM system.%s", BUILT_VIEWS);
+    return execute_cql(req).then([] (::shared_ptr<cql3::untyped_result_set> msg) {
+        std::vector<std::pair<sstring, sstring>> ret;
+        for (auto& row : *msg) {
+            ret.emplace_back(row.get_as<sstring>("keyspace_name"), row.get_as<sstring>("view_name"));
+        }
+        return ret;
+    });
+}
+
+future<> mark_view_as_built(sstring ks_name, sstring view_name) {
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, view_name) VALUES (?, ?)", BUILT_VIEWS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name)).discard_result();
+}
+
+future<> remove_built_view(sstring ks_name, sstring view_name) {
+    sstring req = sprint("DELETE FROM system.%s WHERE keyspace_name = ? AND view_name = ?", BUILT_VIEWS);
+    return execute_cql(req, std::move(ks_name), std::move(view_name)).discard_result();
+}
+
 future<std::unordered_set<dht::token>> get_saved_tokens() {
     sstring req = sprint("SELECT tokens FROM system.%s WHERE key = ?", LOCAL);
     return execute_cql(req, sstring(LOCAL)).then([] (auto msg) {
@@ -1526,6 +1711,37 @@ set_index_removed(const sstring& ks_name, const sstring& index_name) {
     });
 }
 
+future<> record_large_partition(sstring ks_name, sstring cf_name, sstring sstable_name, sstring partition_key,
+        int64_t partition_size, sstring clustering_key, int64_t row_size) {
+    if (!qctx) {
+        // The sstables written before the system keyspace is set up, or by tools.
+        return make_ready_future<>();
+    }
+    sstring req = sprint("INSERT INTO system.%s (keyspace_name, table_name, sstable_name, partition_key, partition_size, clustering_key, row_size, compaction_time) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?) USING TTL %d", LARGE_PARTITIONS, large_partitions_ttl.count());
+    return execute_cql(req, std::move(ks_name), std::move(cf_name), std::move(sstable_name), std::move(partition_key),
+            partition_size, std::move(clustering_key), row_size, db_clock::now()).discard_result();
+}
+
+future<std::vector<large_partition_entry>> load_large_partitions(sstring ks_name, sstring cf_name) {
+    sstring req = sprint("SELECT * FROM system.%s WHERE keyspace_name = ? AND table_name = ?", LARGE_PARTITIONS);
+    return execute_cql(req, std::move(ks_name), std::move(cf_name)).then([] (::shared_ptr<cql3::untyped_result_set> msg) {
+        std::vector<large_partition_entry> ret;
+        for (auto& row : *msg) {
+            ret.push_back(large_partition_entry{
+                    row.get_as<sstring>("keyspace_name"),
+                    row.get_as<sstring>("table_name"),
+                    row.get_as<sstring>("sstable_name"),
+                    row.get_as<sstring>("partition_key"),
+                    row.get_or<int64_t>("partition_size", 0),
+                    row.get_or<sstring>("clustering_key", ""),
+                    row.get_or<int64_t>("row_size", 0),
+                    row.get_or<db_clock::time_point>("compaction_time", db_clock::time_point())});
+        }
+        return ret;
+    });
+}
+
 std::vector<schema_ptr> all_tables() {
     std::vector<schema_ptr> r;
     auto schema_tables = db::schema_tables::all_tables();
@@ -1533,7 +1749,8 @@ std::vector<schema_ptr> all_tables() {
     r.insert(r.end(), { built_indexes(), hints(), batchlog(), paxos(), local(),
                     peers(), peer_events(), range_xfers(),
                     compactions_in_progress(), compaction_history(),
-                    sstable_activity(), size_estimates(),
+                    sstable_activity(), size_estimates(), streamed_ranges(),
+                    views_builds_in_progress(), built_views(), large_partitions(),
     });
     // legacy schema
     r.insert(r.end(), {
@@ -1617,6 +1834,54 @@ future<utils::UUID> set_local_host_id(const utils::UUID& host_id) {
     });
 }
 
+static int32_t paxos_ttl(const schema& s) {
+    // keep paxos state around for at least 3h
+    return std::max<int32_t>(3 * 3600, std::chrono::duration_cast<std::chrono::seconds>(s.gc_grace_seconds()).count());
+}
+
+future<service::paxos::paxos_state> load_paxos_state(const partition_key& key, schema_ptr s) {
+    sstring req = sprint("SELECT * FROM system.%s WHERE row_key = ? AND cf_id = ?", PAXOS);
+    return execute_cql(req, to_bytes(key.representation()), s->id()).then([s] (::shared_ptr<cql3::untyped_result_set> results) {
+        if (results->empty()) {
+            return service::paxos::paxos_state();
+        }
+        auto& row = results->one();
+        auto promised = row.get_or<utils::UUID>("in_progress_ballot", utils::UUID());
+        // either we have both a recently accepted ballot and update or we have neither
+        stdx::optional<service::paxos::proposal> accepted;
+        if (row.has("proposal")) {
+            accepted = service::paxos::proposal{row.get_as<utils::UUID>("proposal_ballot"), canonical_mutation(row.get_blob("proposal"))};
+        }
+        // either most_recent_commit and most_recent_commit_at will both be set, or neither
+        stdx::optional<service::paxos::proposal> most_recent;
+        if (row.has("most_recent_commit")) {
+            most_recent = service::paxos::proposal{row.get_as<utils::UUID>("most_recent_commit_at"), canonical_mutation(row.get_blob("most_recent_commit"))};
+        }
+        return service::paxos::paxos_state(promised, std::move(accepted), std::move(most_recent));
+    });
+}
+
+future<> save_paxos_promise(const schema& s, const partition_key& key, const utils::UUID& ballot) {
+    sstring req = sprint("UPDATE system.%s USING TIMESTAMP %d AND TTL %d SET in_progress_ballot = ? WHERE row_key = ? AND cf_id = ?",
+            PAXOS, utils::UUID_gen::micros_timestamp(ballot), paxos_ttl(s));
+    return execute_cql(req, ballot, to_bytes(key.representation()), s.id()).discard_result();
+}
+
+future<> save_paxos_proposal(const schema& s, const partition_key& key, const service::paxos::proposal& proposal) {
+    sstring req = sprint("UPDATE system.%s USING TIMESTAMP %d AND TTL %d SET proposal_ballot = ?, proposal = ? WHERE row_key = ? AND cf_id = ?",
+            PAXOS, utils::UUID_gen::micros_timestamp(proposal.ballot), paxos_ttl(s));
+    return execute_cql(req, proposal.ballot, proposal.update.representation(), to_bytes(key.representation()), s.id()).discard_result();
+}
+
+future<> save_paxos_decision(const schema& s, const partition_key& key, const service::paxos::proposal& decision) {
+    // We always erase the last proposal (with the commit timestamp to not erase a more recent proposal in case the commit is old)
+    // even though that's really just an optimization since the coordinator ignores accepted proposals older than the most recent commit.
+    sstring req = sprint("UPDATE system.%s USING TIMESTAMP %d AND TTL %d SET proposal_ballot = null, proposal = null, "
+            "most_recent_commit_at = ?, most_recent_commit = ? WHERE row_key = ? AND cf_id = ?",
+            PAXOS, utils::UUID_gen::micros_timestamp(decision.ballot), paxos_ttl(s));
+    return execute_cql(req, decision.ballot, decision.update.representation(), to_bytes(key.representation()), s.id()).discard_result();
+}
+
 std::unordered_map<gms::inet_address, locator::endpoint_dc_rack>
 load_dc_rack_info() {
     return _local_cache.local()._cached_dc_rack_info;
@@ -50,12 +50,20 @@
 #include "locator/token_metadata.hh"
 #include "db_clock.hh"
 #include "db/commitlog/replay_position.hh"
+#include "stdx.hh"
 #include <map>
 
 namespace service {
 
 class storage_proxy;
 
+namespace paxos {
+
+class paxos_state;
+struct proposal;
+
+}
+
 }
 
 namespace cql3 {
@@ -78,6 +86,10 @@ static constexpr auto COMPACTIONS_IN_PROGRESS = "compactions_in_progress";
 static constexpr auto COMPACTION_HISTORY = "compaction_history";
 static constexpr auto SSTABLE_ACTIVITY = "sstable_activity";
 static constexpr auto SIZE_ESTIMATES = "size_estimates";
+static constexpr auto STREAMED_RANGES = "streamed_ranges";
+static constexpr auto VIEWS_BUILDS_IN_PROGRESS = "scylla_views_builds_in_progress";
+static constexpr auto BUILT_VIEWS = "built_views";
+static constexpr auto LARGE_PARTITIONS = "large_partitions";
 
 namespace v3 {
 static constexpr auto BATCHES = "batches";
@@ -142,6 +154,57 @@ future<> remove_endpoint(gms::inet_address ep);
 
 future<> update_hints_dropped(gms::inet_address ep, utils::UUID time_period, int value);
 
+// The ranges of each table which the bootstrap or rebuild in progress already
+// received, so that they are not streamed again if it is retried.
+future<> update_streamed_ranges(sstring ks_name, utils::UUID cf_id, const dht::token_range_vector& ranges);
+future<std::unordered_map<utils::UUID, dht::token_range_vector>> get_streamed_ranges(sstring ks_name);
+future<> reset_streamed_ranges(sstring ks_name);
+
+// The progress of the build of a view from the existing data of its base
+// table, on one shard. Tokens are only meaningful for the shard count they
+// were saved with.
+struct view_build_progress {
+    sstring ks_name;
+    sstring view_name;
+    unsigned shard;
+    unsigned shard_count;
+    // The token of the last partition the shard built the view for.
+    stdx::optional<dht::token> last_token;
+    bool finished;
+};
+
+future<std::vector<view_build_progress>> load_view_build_progress();
+// For the current shard.
+future<> update_view_build_progress(sstring ks_name, sstring view_name, const dht::token& last_token);
+future<> mark_view_build_finished_on_shard(sstring ks_name, sstring view_name);
+// For all shards.
+future<> remove_view_build_progress(sstring ks_name, sstring view_name);
+
+future<std::vector<std::pair<sstring, sstring>>> load_built_views();
+future<> mark_view_as_built(sstring ks_name, sstring view_name);
+future<> remove_built_view(sstring ks_name, sstring view_name);
+
+// A partition larger than compaction_large_partition_warning_threshold_mb,
+// or with a row larger than compaction_large_row_warning_threshold_mb, found
+// when writing an sstable. The entries expire after large_partitions_ttl.
+struct large_partition_entry {
+    sstring ks_name;
+    sstring cf_name;
+    sstring sstable_name;
+    sstring partition_key;
+    int64_t partition_size;
+    // The largest row of the partition, empty for the static row.
+    sstring clustering_key;
+    int64_t row_size;
+    db_clock::time_point compaction_time;
+};
+
+constexpr std::chrono::seconds large_partitions_ttl(30 * 24 * 3600);
+
+future<> record_large_partition(sstring ks_name, sstring cf_name, sstring sstable_name, sstring partition_key,
+        int64_t partition_size, sstring clustering_key, int64_t row_size);
+future<std::vector<large_partition_entry>> load_large_partitions(sstring ks_name, sstring cf_name);
+
 std::vector<schema_ptr> all_tables();
 void make(database& db, bool durable, bool volatile_testing_only = false);
 
@@ -515,71 +578,14 @@ future<> set_bootstrap_state(bootstrap_state state);
      */
     future<utils::UUID> set_local_host_id(const utils::UUID& host_id);
 
-#if 0
-
-    public static PaxosState loadPaxosState(ByteBuffer key, CFMetaData metadata)
-    {
-        String req = "SELECT * FROM system.%s WHERE row_key = ? AND cf_id = ?";
-        UntypedResultSet results = executeInternal(String.format(req, PAXOS), key, metadata.cfId);
-        if (results.isEmpty())
-            return new PaxosState(key, metadata);
-        UntypedResultSet.Row row = results.one();
-        Commit promised = row.has("in_progress_ballot")
-                        ? new Commit(key, row.getUUID("in_progress_ballot"), ArrayBackedSortedColumns.factory.create(metadata))
-                        : Commit.emptyCommit(key, metadata);
-        // either we have both a recently accepted ballot and update or we have neither
-        Commit accepted = row.has("proposal")
-                        ? new Commit(key, row.getUUID("proposal_ballot"), ColumnFamily.fromBytes(row.getBytes("proposal")))
-                        : Commit.emptyCommit(key, metadata);
-        // either most_recent_commit and most_recent_commit_at will both be set, or neither
-        Commit mostRecent = row.has("most_recent_commit")
-                          ? new Commit(key, row.getUUID("most_recent_commit_at"), ColumnFamily.fromBytes(row.getBytes("most_recent_commit")))
-                          : Commit.emptyCommit(key, metadata);
-        return new PaxosState(promised, accepted, mostRecent);
-    }
-
-    public static void savePaxosPromise(Commit promise)
-    {
-        String req = "UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET in_progress_ballot = ? WHERE row_key = ? AND cf_id = ?";
-        executeInternal(String.format(req, PAXOS),
-                        UUIDGen.microsTimestamp(promise.ballot),
-                        paxosTtl(promise.update.metadata),
-                        promise.ballot,
-                        promise.key,
-                        promise.update.id());
-    }
-
-    public static void savePaxosProposal(Commit proposal)
-    {
-        executeInternal(String.format("UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET proposal_ballot = ?, proposal = ? WHERE row_key = ? AND cf_id = ?", PAXOS),
-                        UUIDGen.microsTimestamp(proposal.ballot),
-                        paxosTtl(proposal.update.metadata),
-                        proposal.ballot,
-                        proposal.update.toBytes(),
-                        proposal.key,
-                        proposal.update.id());
-    }
-
-    private static int paxosTtl(CFMetaData metadata)
-    {
-        // keep paxos state around for at least 3h
-        return Math.max(3 * 3600, metadata.getGcGraceSeconds());
-    }
-
-    public static void savePaxosCommit(Commit commit)
-    {
-        // We always erase the last proposal (with the commit timestamp to no erase more recent proposal in case the commit is old)
-        // even though that's really just an optimization  since SP.beginAndRepairPaxos will exclude accepted proposal older than the mrc.
-        String cql = "UPDATE system.%s USING TIMESTAMP ? AND TTL ? SET proposal_ballot = null, proposal = null, most_recent_commit_at = ?, most_recent_commit = ? WHERE row_key = ? AND cf_id = ?";
-        executeInternal(String.format(cql, PAXOS),
-                        UUIDGen.microsTimestamp(commit.ballot),
-                        paxosTtl(commit.update.metadata),
-                        commit.ballot,
-                        commit.update.toBytes(),
-                        commit.key,
-                        commit.update.id());
-    }
+    // The state of the Paxos rounds on the partition key of s.
+    future<service::paxos::paxos_state> load_paxos_state(const partition_key& key, schema_ptr s);
+    future<> save_paxos_promise(const schema& s, const partition_key& key, const utils::UUID& ballot);
+    future<> save_paxos_proposal(const schema& s, const partition_key& key, const service::paxos::proposal& proposal);
+    // Also drops the accepted proposal, unless it's of a later round.
+    future<> save_paxos_decision(const schema& s, const partition_key& key, const service::paxos::proposal& decision);
 
+#if 0
     /**
      * Returns a RestorableMeter tracking the average read rate of a particular SSTable, restoring the last-seen rate
      * from values in system.sstable_activity if present.
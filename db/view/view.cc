@@ -41,14 +41,18 @@
 
 #include <vector>
 #include <functional>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/range/algorithm/transform.hpp>
 #include <boost/range/adaptors.hpp>
+#include <boost/range/numeric.hpp>
 
 #include "clustering_bounds_comparator.hh"
 #include "cql3/statements/select_statement.hh"
 #include "cql3/util.hh"
 #include "db/view/view.hh"
+#include "frozen_mutation.hh"
 #include "gms/inet_address.hh"
 #include "keys.hh"
 #include "locator/network_topology_strategy.hh"
@@ -93,11 +97,31 @@ const dht::partition_range_vector& view_info::partition_ranges() const {
     return *_partition_ranges;
 }
 
+const view_info::base_dependent_columns& view_info::base_dependent(const schema& base) const {
+    if (!_base_dependent_columns || _base_dependent_columns->base_version != base.version()) {
+        base_dependent_columns columns;
+        columns.base_version = base.version();
+        columns.view_columns.reserve(base.regular_columns_count());
+        for (auto&& base_col : base.regular_columns()) {
+            columns.view_columns.push_back(_schema.get_column_definition(base_col.name()));
+        }
+        for (auto&& view_col : boost::range::join(_schema.partition_key_columns(), _schema.clustering_key_columns())) {
+            auto* base_col = base.get_column_definition(view_col.name());
+            assert(base_col);
+            columns.base_key_columns.push_back(base_col - base.all_columns().data());
+        }
+        _base_dependent_columns = std::move(columns);
+    }
+    return *_base_dependent_columns;
+}
+
 const column_definition* view_info::view_column(const schema& base, column_id base_id) const {
-    // FIXME: Map base column_ids to view_column_ids, which can be something like
-    // a boost::small_vector where the position is the base column_id, and the
-    // value is either empty or the view's column_id.
-    return _schema.get_column_definition(base.regular_column_at(base_id).name());
+    return base_dependent(base).view_columns.at(base_id);
+}
+
+const column_definition& view_info::base_key_column(const schema& base, const column_definition& view_key_column) const {
+    auto i = view_key_column.is_partition_key() ? view_key_column.id : _schema.partition_key_size() + view_key_column.id;
+    return base.all_columns()[base_dependent(base).base_key_columns.at(i)];
 }
 
 stdx::optional<column_id> view_info::base_non_pk_column_in_view_pk(const schema& base) const {
@@ -289,8 +313,7 @@ row_marker view_updates::compute_row_marker(const clustering_row& base_row) cons
 
 deletable_row& view_updates::get_view_row(const partition_key& base_key, const clustering_row& update) {
     auto get_value = boost::adaptors::transformed([&, this] (const column_definition& cdef) {
-        auto* base_col = _base->get_column_definition(cdef.name());
-        assert(base_col);
+        auto* base_col = &_view_info.base_key_column(*_base, cdef);
         switch (base_col->kind) {
         case column_kind::partition_key:
             return base_key.get_component(*_base, base_col->position());
@@ -310,10 +333,7 @@ deletable_row& view_updates::get_view_row(const partition_key& base_key, const c
 }
 
 static const column_definition* view_column(const schema& base, const schema& view, column_id base_id) {
-    // FIXME: Map base column_ids to view_column_ids, which can be something like
-    // a boost::small_vector where the position is the base column_id, and the
-    // value is either empty or the view's column_id.
-    return view.get_column_definition(base.regular_column_at(base_id).name());
+    return view.view_info()->view_column(base, base_id);
 }
 
 static void add_cells_to_view(const schema& base, const schema& view, const row& base_cells, row& view_cells) {
@@ -657,6 +677,42 @@ future<std::vector<mutation>> generate_view_updates(
     return f.finally([builder = std::move(builder)] { });
 }
 
+std::vector<column_id> base_columns_needed_by_views(const schema& base, const std::vector<view_ptr>& views) {
+    auto all_columns = [&] {
+        return boost::copy_range<std::vector<column_id>>(
+                base.regular_columns() | boost::adaptors::transformed(std::mem_fn(&column_definition::id)));
+    };
+    std::vector<bool> needed(base.regular_columns_count(), false);
+    for (auto&& v : views) {
+        auto& vi = *v->view_info();
+        auto& non_pk_restrictions = vi.select_statement().get_restrictions()->get_non_pk_restriction();
+        // A view with the same primary key as the base lives as long as
+        // anything in the base row, so the TTLs of all columns matter when
+        // it is the one which required the read.
+        if (vi.include_all_columns() || (!vi.base_non_pk_column_in_view_pk(base) && !non_pk_restrictions.empty())) {
+            return all_columns();
+        }
+        for (auto&& cdef : base.regular_columns()) {
+            if (vi.view_column(base, cdef.id)) {
+                needed[cdef.id] = true;
+            }
+        }
+        for (auto&& r : non_pk_restrictions | boost::adaptors::map_keys) {
+            auto* cdef = base.get_column_definition(r->name());
+            if (cdef && cdef->is_regular()) {
+                needed[cdef->id] = true;
+            }
+        }
+    }
+    std::vector<column_id> columns;
+    for (column_id id = 0; id < needed.size(); ++id) {
+        if (needed[id]) {
+            columns.push_back(id);
+        }
+    }
+    return columns;
+}
+
 query::clustering_row_ranges calculate_affected_clustering_ranges(const schema& base,
         const dht::decorated_key& key,
         const mutation_partition& mp,
@@ -815,24 +871,28 @@ void mutate_MV(const dht::token& base_token,
                                                                                                           () -> asyncRemoveFromBatchlog(batchlogEndpoints, batchUUID));
             // add a handler for each mutation - includes checking availability, but doesn't initiate any writes, yet
 #endif
+    // The updates going to the same replica are sent together, in one
+    // message, rather than one per view partition: the local ones are applied
+    // by a single mutate_locally(), which groups them per shard, and the
+    // remote ones are sent in one MUTATION_BATCH per paired endpoint, which
+    // the replica applies per shard in the same way.
+    auto my_address = utils::fb_utilities::get_broadcast_address();
+    std::vector<mutation> local_mutations;
+    std::unordered_map<gms::inet_address, std::vector<mutation>> remote_mutations;
+    // The destinations of the updates of each view, for its fan-out metric.
+    std::unordered_map<utils::UUID, std::unordered_set<gms::inet_address>> destinations;
     for (auto& mut : mutations) {
         auto view_token = mut.token();
         auto keyspace_name = mut.schema()->ks_name();
         auto paired_endpoint = get_view_natural_endpoint(keyspace_name, base_token, view_token);
         auto pending_endpoints = service::get_local_storage_service().get_token_metadata().pending_endpoints_for(view_token, keyspace_name);
         if (paired_endpoint) {
+            destinations[mut.schema()->id()].insert(*paired_endpoint);
             // When local node is the endpoint and there are no pending nodes we can
             // Just apply the mutation locally.
-            auto my_address = utils::fb_utilities::get_broadcast_address();
             if (*paired_endpoint == my_address && pending_endpoints.empty() &&
                 service::get_local_storage_service().is_joined()) {
-                    // Note that we start here an asynchronous apply operation, and
-                    // do not wait for it to complete.
-                    // Note also that mutate_locally(mut) copies mut (in
-                    // frozen from) so don't need to increase its lifetime.
-                    service::get_local_storage_proxy().mutate_locally(mut).handle_exception([] (auto ep) {
-                        vlogger.error("Error applying local view update: {}", ep);
-                    });
+                    local_mutations.push_back(std::move(mut));
             } else {
 #if 0
                         wrappers.add(wrapViewBatchResponseHandler(mutation,
@@ -844,13 +904,7 @@ void mutate_MV(const dht::token& base_token,
                                                                   cleanup,
                                                                   queryStartNanoTime));
 #endif
-                // FIXME: Temporary hack: send the write directly to paired_endpoint,
-                // without a batchlog, and without checking for success
-                // Note we don't wait for the asynchronous operation to complete
-                // FIXME: need to extend mut's lifetime???
-                service::get_local_storage_proxy().send_to_endpoint(mut, *paired_endpoint, db::write_type::VIEW).handle_exception([paired_endpoint] (auto ep) {
-                    vlogger.error("Error applying view update to {}: {}", *paired_endpoint, ep);
-                });;
+                remote_mutations[*paired_endpoint].push_back(std::move(mut));
             }
         } else {
 #if 0
@@ -867,6 +921,39 @@ void mutate_MV(const dht::token& base_token,
 #endif
         }
     }
+    auto serialized_size = [] (const std::vector<mutation>& muts) {
+        return boost::accumulate(muts | boost::adaptors::transformed([] (const mutation& m) {
+            return estimate_serialized_size(m);
+        }), size_t(0));
+    };
+    if (!local_mutations.empty()) {
+        // Note that we start here an asynchronous apply operation, and
+        // do not wait for it to complete.
+        // Note also that mutate_locally() copies the mutations (in
+        // frozen from) so don't need to increase their lifetime.
+        auto units = service::get_local_storage_proxy().track_view_update(serialized_size(local_mutations));
+        service::get_local_storage_proxy().mutate_locally(std::move(local_mutations)).handle_exception([] (auto ep) {
+            vlogger.error("Error applying local view update: {}", ep);
+        }).finally([units = std::move(units)] { });
+    }
+    for (auto&& e : remote_mutations) {
+        // FIXME: Temporary hack: send the writes directly to paired_endpoint,
+        // without a batchlog, and without checking for success
+        // Note we don't wait for the asynchronous operation to complete
+        auto paired_endpoint = e.first;
+        auto units = service::get_local_storage_proxy().track_view_update(serialized_size(e.second));
+        service::get_local_storage_proxy().send_to_endpoint(std::move(e.second), paired_endpoint, db::write_type::VIEW).handle_exception([paired_endpoint] (auto ep) {
+            vlogger.error("Error applying view update to {}: {}", paired_endpoint, ep);
+        }).finally([units = std::move(units)] { });
+    }
+    auto& db = service::get_local_storage_proxy().get_db().local();
+    for (auto&& e : destinations) {
+        try {
+            db.find_column_family(e.first).add_view_update_fanout(e.second.size());
+        } catch (no_such_column_family&) {
+            // The view was dropped meanwhile.
+        }
+    }
 #if 0
             if (!wrappers.isEmpty())
             {
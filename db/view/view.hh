@@ -85,6 +85,17 @@ future<std::vector<mutation>> generate_view_updates(
         streamed_mutation&& updates,
         streamed_mutation_opt&& existings);
 
+/**
+ * The regular columns of the base table the views need from the existing
+ * base rows to generate their updates: the ones the views select or filter
+ * on, or all of them when the lifetime of a view row depends on every cell.
+ *
+ * @param base the base table schema.
+ * @param views the views to update.
+ * @return the column ids, in increasing order.
+ */
+std::vector<column_id> base_columns_needed_by_views(const schema& base, const std::vector<view_ptr>& views);
+
 query::clustering_row_ranges calculate_affected_clustering_ranges(
         const schema& base,
         const dht::decorated_key& key,
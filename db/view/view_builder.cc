@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/range/algorithm_ext/erase.hpp>
+#include <seastar/core/metrics.hh>
+
+#include "db/view/view_builder.hh"
+#include "db/system_keyspace.hh"
+#include "core/sleep.hh"
+#include "core/thread.hh"
+#include "log.hh"
+#include "service/migration_manager.hh"
+#include "service/storage_proxy.hh"
+#include "view_info.hh"
+
+namespace db {
+
+namespace view {
+
+static logging::logger vblogger("view_builder");
+
+constexpr size_t view_builder::partitions_per_checkpoint;
+
+static seastar::thread_scheduling_group& view_building_scheduling_group() {
+    static thread_local seastar::thread_scheduling_group group(std::chrono::milliseconds(1), 0.2);
+    return group;
+}
+
+view_builder::view_builder(seastar::sharded<database>& db, seastar::sharded<view_builder>& container)
+    : _container(container)
+    , _db(db.local())
+{
+    namespace sm = seastar::metrics;
+    _metrics.add_group("view_builder", {
+        sm::make_queue_length("builds_in_progress", [this] { return _pending.size() + _building; },
+                sm::description("number of views this shard has yet to build from the data of their base tables")),
+        sm::make_derive("partitions_processed", sm::description("number of base table partitions read to build views"), _stats.partitions_processed),
+        sm::make_derive("views_built", sm::description("number of views this shard finished building"), _stats.views_built),
+    });
+}
+
+static future<> mark_as_built(sstring ks_name, sstring view_name) {
+    return system_keyspace::mark_view_as_built(ks_name, view_name).then([ks_name, view_name] {
+        vblogger.info("Finished building view {}.{}", ks_name, view_name);
+        return system_keyspace::remove_view_build_progress(ks_name, view_name);
+    });
+}
+
+future<> view_builder::start() {
+    return system_keyspace::load_built_views().then([this] (std::vector<std::pair<sstring, sstring>> built) {
+        return system_keyspace::load_view_build_progress().then([this, built = std::move(built)] (std::vector<system_keyspace::view_build_progress> progress) {
+            auto is_built = [&] (const schema& view) {
+                return std::find(built.begin(), built.end(), std::make_pair(view.ks_name(), view.cf_name())) != built.end();
+            };
+            for (auto&& e : _db.get_column_families()) {
+                auto& s = *e.second->schema();
+                if (!s.is_view() || is_built(s)) {
+                    continue;
+                }
+                stdx::optional<dht::token> last_token;
+                bool finished = false;
+                unsigned finished_shards = 0;
+                for (auto&& p : progress) {
+                    // Tokens saved with a different shard count belong to
+                    // other shards now, so the build starts over.
+                    if (p.ks_name != s.ks_name() || p.view_name != s.cf_name() || p.shard_count != smp::count) {
+                        continue;
+                    }
+                    finished_shards += p.finished;
+                    if (p.shard == engine().cpu_id()) {
+                        finished = p.finished;
+                        last_token = p.last_token;
+                    }
+                }
+                if (engine().cpu_id() == 0 && finished_shards) {
+                    _finished_shards[s.id()] = finished_shards;
+                }
+                if (!finished) {
+                    enqueue(s, std::move(last_token));
+                } else if (engine().cpu_id() == 0 && finished_shards == smp::count) {
+                    // The node stopped before recording the view as built.
+                    _finished_shards.erase(s.id());
+                    with_gate(_gate, [ks_name = s.ks_name(), view_name = s.cf_name()] {
+                        return mark_as_built(ks_name, view_name);
+                    });
+                }
+            }
+            service::get_local_migration_manager().register_listener(this);
+        });
+    });
+}
+
+future<> view_builder::stop() {
+    _stopping = true;
+    service::get_local_migration_manager().unregister_listener(this);
+    return _gate.close();
+}
+
+void view_builder::enqueue(const schema& view, stdx::optional<dht::token> last_token) {
+    _pending.push_back(build_task{view.id(), view.ks_name(), view.cf_name(), std::move(last_token)});
+    if (_building || _gate.is_closed()) {
+        return;
+    }
+    _building = true;
+    with_gate(_gate, [this] {
+        auto attr = seastar::thread_attributes();
+        attr.scheduling_group = &view_building_scheduling_group();
+        return seastar::async(std::move(attr), [this] {
+            build_pending();
+        }).finally([this] {
+            _building = false;
+        });
+    });
+}
+
+void view_builder::build_pending() {
+    while (!_pending.empty() && !_stopping) {
+        auto task = std::move(_pending.front());
+        _pending.pop_front();
+        try {
+            build(task);
+        } catch (...) {
+            vblogger.warn("Failed to build view {}.{}: {}", task.ks_name, task.view_name, std::current_exception());
+        }
+    }
+}
+
+void view_builder::build(const build_task& task) {
+    if (!_db.column_family_exists(task.view_id)) {
+        return;
+    }
+    auto view = view_ptr(_db.find_schema(task.view_id));
+    auto& base = _db.find_column_family(view->view_info()->base_id());
+    auto base_schema = base.schema();
+    auto range = task.last_token
+            ? dht::partition_range::make_starting_with({dht::ring_position::ending_at(*task.last_token), false})
+            : query::full_partition_range;
+    vblogger.info("Building view {}.{}, starting at token {}", task.ks_name, task.view_name,
+            task.last_token ? *task.last_token : dht::minimum_token());
+
+    auto& proxy = service::get_local_storage_proxy();
+    auto reader = base.make_streaming_reader(base_schema, range);
+    size_t partitions = 0;
+    stdx::optional<dht::token> last_token;
+    while (!_stopping) {
+        auto smopt = reader().get0();
+        if (!smopt) {
+            break;
+        }
+        if (!_db.column_family_exists(task.view_id)) {
+            vblogger.info("View {}.{} was dropped while being built", task.ks_name, task.view_name);
+            return;
+        }
+        auto token = smopt->decorated_key().token();
+        auto updates = generate_view_updates(base_schema, std::vector<view_ptr>{view}, std::move(*smopt), streamed_mutation_opt()).get0();
+        mutate_MV(token, std::move(updates));
+        ++_stats.partitions_processed;
+        last_token = token;
+        if (++partitions % partitions_per_checkpoint == 0) {
+            system_keyspace::update_view_build_progress(task.ks_name, task.view_name, token).get();
+        }
+        // Let the view replicas catch up before sending more.
+        while (proxy.view_update_backlog() > proxy.max_view_update_backlog() / 2 && !_stopping) {
+            sleep(std::chrono::milliseconds(10)).get();
+        }
+    }
+    if (_stopping) {
+        if (last_token) {
+            system_keyspace::update_view_build_progress(task.ks_name, task.view_name, *last_token).get();
+        }
+        return;
+    }
+    system_keyspace::mark_view_build_finished_on_shard(task.ks_name, task.view_name).get();
+    ++_stats.views_built;
+    vblogger.info("Finished building view {}.{} on this shard", task.ks_name, task.view_name);
+    _container.invoke_on(0, [id = task.view_id, ks_name = task.ks_name, view_name = task.view_name] (view_builder& vb) {
+        return vb.on_shard_finished(id, ks_name, view_name);
+    }).get();
+}
+
+future<> view_builder::on_shard_finished(utils::UUID view_id, sstring ks_name, sstring view_name) {
+    if (++_finished_shards[view_id] < smp::count) {
+        return make_ready_future<>();
+    }
+    _finished_shards.erase(view_id);
+    return mark_as_built(std::move(ks_name), std::move(view_name));
+}
+
+void view_builder::on_create_view(const sstring& ks_name, const sstring& view_name) {
+    try {
+        enqueue(*_db.find_schema(ks_name, view_name), { });
+    } catch (no_such_column_family&) {
+        // Dropped already.
+    }
+}
+
+void view_builder::on_drop_view(const sstring& ks_name, const sstring& view_name) {
+    // A build in progress notices the view is gone by itself.
+    boost::remove_erase_if(_pending, [&] (const build_task& t) {
+        return t.ks_name == ks_name && t.view_name == view_name;
+    });
+    if (engine().cpu_id() != 0) {
+        return;
+    }
+    for (auto it = _finished_shards.begin(); it != _finished_shards.end();) {
+        it = _db.column_family_exists(it->first) ? std::next(it) : _finished_shards.erase(it);
+    }
+    system_keyspace::remove_view_build_progress(ks_name, view_name).then([ks_name, view_name] {
+        return system_keyspace::remove_built_view(ks_name, view_name);
+    }).get();
+}
+
+}
+
+}
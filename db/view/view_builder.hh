@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <deque>
+#include <unordered_map>
+#include "database.hh"
+#include "core/gate.hh"
+#include "core/sharded.hh"
+#include <seastar/core/metrics_registration.hh>
+#include "service/migration_listener.hh"
+#include "stdx.hh"
+
+namespace db {
+
+namespace view {
+
+// Builds the views created on tables which already have data, by reading
+// the data of the base table and generating view updates for it, as if it
+// was being written.
+//
+// Each shard builds the views from the data it owns, in token order, one
+// view at a time, checkpointing its progress in
+// system.scylla_views_builds_in_progress every partitions_per_checkpoint
+// partitions, so that a restarted node resumes the build where it was.
+// Shard 0 records the view in system.built_views once all shards are done.
+//
+// The build runs in a thread of a low priority scheduling group and reads
+// with the streaming priority class, and waits for the view updates it sent
+// whenever the view update backlog exceeds half of its maximum, so that it
+// doesn't compete with the regular workload.
+class view_builder final : public service::migration_listener {
+public:
+    struct stats {
+        uint64_t partitions_processed = 0;
+        uint64_t views_built = 0;
+    };
+    static constexpr size_t partitions_per_checkpoint = 128;
+private:
+    struct build_task {
+        utils::UUID view_id;
+        sstring ks_name;
+        sstring view_name;
+        stdx::optional<dht::token> last_token;
+    };
+    seastar::sharded<view_builder>& _container;
+    database& _db;
+    std::deque<build_task> _pending;
+    bool _building = false;
+    bool _stopping = false;
+    // On shard 0, the number of shards which finished building each view.
+    std::unordered_map<utils::UUID, unsigned> _finished_shards;
+    seastar::gate _gate;
+    stats _stats;
+    seastar::metrics::metric_groups _metrics;
+private:
+    void enqueue(const schema& view, stdx::optional<dht::token> last_token);
+    void build_pending();
+    void build(const build_task& task);
+    future<> on_shard_finished(utils::UUID view_id, sstring ks_name, sstring view_name);
+public:
+    view_builder(seastar::sharded<database>& db, seastar::sharded<view_builder>& container);
+    view_builder(view_builder&&) = delete;
+
+    // Starts building the views which aren't built yet, in the background,
+    // and the views created from now on.
+    future<> start();
+    future<> stop();
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+
+    virtual void on_create_keyspace(const sstring& ks_name) override { }
+    virtual void on_create_column_family(const sstring& ks_name, const sstring& cf_name) override { }
+    virtual void on_create_user_type(const sstring& ks_name, const sstring& type_name) override { }
+    virtual void on_create_function(const sstring& ks_name, const sstring& function_name) override { }
+    virtual void on_create_aggregate(const sstring& ks_name, const sstring& aggregate_name) override { }
+    virtual void on_create_view(const sstring& ks_name, const sstring& view_name) override;
+
+    virtual void on_update_keyspace(const sstring& ks_name) override { }
+    virtual void on_update_column_family(const sstring& ks_name, const sstring& cf_name, bool columns_changed) override { }
+    virtual void on_update_user_type(const sstring& ks_name, const sstring& type_name) override { }
+    virtual void on_update_function(const sstring& ks_name, const sstring& function_name) override { }
+    virtual void on_update_aggregate(const sstring& ks_name, const sstring& aggregate_name) override { }
+    virtual void on_update_view(const sstring& ks_name, const sstring& view_name, bool columns_changed) override { }
+
+    virtual void on_drop_keyspace(const sstring& ks_name) override { }
+    virtual void on_drop_column_family(const sstring& ks_name, const sstring& cf_name) override { }
+    virtual void on_drop_user_type(const sstring& ks_name, const sstring& type_name) override { }
+    virtual void on_drop_function(const sstring& ks_name, const sstring& function_name) override { }
+    virtual void on_drop_aggregate(const sstring& ks_name, const sstring& aggregate_name) override { }
+    virtual void on_drop_view(const sstring& ks_name, const sstring& view_name) override;
+};
+
+}
+
+}
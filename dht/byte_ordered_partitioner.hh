@@ -50,6 +50,15 @@ class byte_ordered_partitioner final : public i_partitioner {
     virtual int tri_compare(const token& t1, const token& t2) const override {
         return compare_unsigned(t1._data, t2._data);
     }
+    virtual uint64_t token_prefix(const token& t) const override {
+        // The first 8 bytes, big endian. Shorter tokens are padded with zeros.
+        uint64_t prefix = 0;
+        auto n = std::min<size_t>(t._data.size(), sizeof(prefix));
+        for (size_t i = 0; i < sizeof(prefix); ++i) {
+            prefix = (prefix << 8) | (i < n ? uint8_t(t._data[i]) : 0);
+        }
+        return prefix;
+    }
     virtual token midpoint(const token& t1, const token& t2) const;
     virtual sstring to_sstring(const dht::token& t) const override {
         if (t._kind == dht::token::kind::before_all_keys) {
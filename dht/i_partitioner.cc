@@ -46,6 +46,16 @@ maximum_token() {
     return max_token;
 }
 
+std::vector<token>
+i_partitioner::get_tokens(const std::vector<sstables::key_view>& keys) {
+    std::vector<token> tokens;
+    tokens.reserve(keys.size());
+    for (auto& k : keys) {
+        tokens.push_back(get_token(k));
+    }
+    return tokens;
+}
+
 // result + overflow bit
 std::pair<bytes, bool>
 add_bytes(bytes_view b1, bytes_view b2, bool carry = false) {
@@ -121,6 +131,17 @@ int tri_compare(const token& t1, const token& t2) {
     return 1;
 }
 
+uint64_t token_prefix(const token& t) {
+    switch (t._kind) {
+    case token::kind::before_all_keys:
+        return 0;
+    case token::kind::after_all_keys:
+        return std::numeric_limits<uint64_t>::max();
+    default:
+        return global_partitioner().token_prefix(t);
+    }
+}
+
 bool operator==(const token& t1, const token& t2)
 {
     if (t1._kind != t2._kind) {
@@ -373,8 +394,9 @@ ring_position_exponential_vector_sharder::next(const schema& s) {
 }
 
 
-ring_position_range_vector_sharder::ring_position_range_vector_sharder(dht::partition_range_vector ranges)
-        : _ranges(std::move(ranges))
+ring_position_range_vector_sharder::ring_position_range_vector_sharder(const i_partitioner& partitioner, dht::partition_range_vector ranges)
+        : _partitioner(partitioner)
+        , _ranges(std::move(ranges))
         , _current_range(_ranges.begin()) {
     next_range();
 }
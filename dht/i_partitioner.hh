@@ -118,6 +118,10 @@ const token& maximum_token();
 bool operator==(const token& t1, const token& t2);
 bool operator<(const token& t1, const token& t2);
 int tri_compare(const token& t1, const token& t2);
+// A 64-bit value ordering tokens like tri_compare() does, though not strictly:
+// t1 < t2 implies token_prefix(t1) <= token_prefix(t2). Lets containers resolve
+// most comparisons of tokens by comparing integers.
+uint64_t token_prefix(const token& t);
 inline bool operator!=(const token& t1, const token& t2) { return std::rel_ops::operator!=(t1, t2); }
 inline bool operator>(const token& t1, const token& t2) { return std::rel_ops::operator>(t1, t2); }
 inline bool operator<=(const token& t1, const token& t2) { return std::rel_ops::operator<=(t1, t2); }
@@ -231,6 +235,12 @@ class i_partitioner {
     virtual token get_token(const schema& s, partition_key_view key) = 0;
     virtual token get_token(const sstables::key_view& key) = 0;
 
+    /**
+     * @return the tokens of the keys, like get_token() of each would, but
+     * possibly faster, for computing the tokens of many keys at once.
+     */
+    virtual std::vector<token> get_tokens(const std::vector<sstables::key_view>& keys);
+
 
     /**
      * @return a partitioner-specific string representation of this token
@@ -295,6 +305,13 @@ class i_partitioner {
      */
     virtual token token_for_next_shard(const token& t, shard_id shard, unsigned spans = 1) const = 0;
 
+    /**
+     * @return number of most significant token bits ignored when calculating the shard of a token
+     */
+    virtual unsigned sharding_ignore_msb() const {
+        return 0;
+    }
+
     /**
      * Gets the first shard of the minimum token.
      */
@@ -325,6 +342,14 @@ class i_partitioner {
     bool is_less(const token& t1, const token& t2) const {
         return tri_compare(t1, t2) < 0;
     }
+    /**
+     * @return a value ordering tokens like tri_compare() does, see dht::token_prefix().
+     * _kind should be handled separately. The default maps all tokens to the same
+     * value, so that comparisons always fall back to tri_compare().
+     */
+    virtual uint64_t token_prefix(const token& t) const {
+        return 0;
+    }
 
     /**
      * @return number of shards configured for this partitioner
@@ -628,19 +653,25 @@ class ring_position_exponential_vector_sharder {
     stdx::optional<ring_position_exponential_vector_sharder_result> next(const schema& s);
 };
 
+// Walks a vector of ranges one (shard, subrange) pair at a time, in ring order,
+// so that only the shards owning a part of the ranges are ever visited and no
+// per-shard containers need to be built up front.
 class ring_position_range_vector_sharder {
     using vec_type = dht::partition_range_vector;
+    const i_partitioner& _partitioner;
     vec_type _ranges;
     vec_type::iterator _current_range;
     stdx::optional<ring_position_range_sharder> _current_sharder;
 private:
     void next_range() {
         if (_current_range != _ranges.end()) {
-            _current_sharder.emplace(std::move(*_current_range++));
+            _current_sharder.emplace(_partitioner, std::move(*_current_range++));
         }
     }
 public:
-    explicit ring_position_range_vector_sharder(dht::partition_range_vector ranges);
+    explicit ring_position_range_vector_sharder(dht::partition_range_vector ranges)
+            : ring_position_range_vector_sharder(global_partitioner(), std::move(ranges)) {}
+    ring_position_range_vector_sharder(const i_partitioner& partitioner, dht::partition_range_vector ranges);
     // results are returned sorted by index within the vector first, then within each vector item
     stdx::optional<ring_position_range_and_shard_and_element> next(const schema& s);
 };
@@ -92,6 +92,23 @@ murmur3_partitioner::get_token(const sstables::key_view& key) {
     return get_token(bytes_view(key));
 }
 
+std::vector<token>
+murmur3_partitioner::get_tokens(const std::vector<sstables::key_view>& keys) {
+    std::vector<bytes_view> views;
+    views.reserve(keys.size());
+    for (auto& k : keys) {
+        views.emplace_back(bytes_view(k));
+    }
+    std::vector<std::array<uint64_t, 2>> hashes(keys.size());
+    utils::murmur_hash::hash3_x64_128(views.data(), views.size(), 0, hashes.data());
+    std::vector<token> tokens;
+    tokens.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        tokens.push_back(views[i].empty() ? minimum_token() : get_token(hashes[i][0]));
+    }
+    return tokens;
+}
+
 token
 murmur3_partitioner::get_token(const schema& s, partition_key_view key) {
     std::array<uint64_t, 2> hash;
@@ -168,6 +185,11 @@ int murmur3_partitioner::tri_compare(const token& t1, const token& t2) const {
     }
 }
 
+uint64_t murmur3_partitioner::token_prefix(const token& t) const {
+    // Order preserving, and exact.
+    return unbias(t);
+}
+
 // Assuming that x>=y, return the positive difference x-y.
 // The return type is an unsigned type, as the difference may overflow
 // a signed type (e.g., consider very positive x and very negative y).
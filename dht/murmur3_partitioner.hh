@@ -40,11 +40,13 @@ class murmur3_partitioner final : public i_partitioner {
     virtual const sstring name() const { return "org.apache.cassandra.dht.Murmur3Partitioner"; }
     virtual token get_token(const schema& s, partition_key_view key) override;
     virtual token get_token(const sstables::key_view& key) override;
+    virtual std::vector<token> get_tokens(const std::vector<sstables::key_view>& keys) override;
     virtual token get_random_token() override;
     virtual bool preserves_order() override { return false; }
     virtual std::map<token, float> describe_ownership(const std::vector<token>& sorted_tokens) override;
     virtual data_type get_token_validator() override;
     virtual int tri_compare(const token& t1, const token& t2) const override;
+    virtual uint64_t token_prefix(const token& t) const override;
     virtual token midpoint(const token& t1, const token& t2) const override;
     virtual sstring to_sstring(const dht::token& t) const override;
     virtual dht::token from_sstring(const sstring& t) const override;
@@ -52,6 +54,7 @@ class murmur3_partitioner final : public i_partitioner {
 
     virtual unsigned shard_of(const token& t) const override;
     virtual token token_for_next_shard(const token& t, shard_id shard, unsigned spans) const override;
+    virtual unsigned sharding_ignore_msb() const override { return _sharding_ignore_msb_bits; }
 private:
     using uint128_t = unsigned __int128;
     static int64_t normalize(int64_t in);
@@ -46,6 +46,7 @@
 #include "streaming/stream_plan.hh"
 #include "streaming/stream_state.hh"
 #include "service/storage_service.hh"
+#include "db/system_keyspace.hh"
 
 namespace dht {
 
@@ -67,10 +68,13 @@ range_streamer::get_range_fetch_map(const std::unordered_multimap<dht::token_ran
                                     const std::unordered_set<std::unique_ptr<i_source_filter>>& source_filters,
                                     const sstring& keyspace) {
     std::unordered_multimap<inet_address, dht::token_range> range_fetch_map_map;
+    std::unordered_map<inet_address, size_t> ranges_per_source;
+    auto& snitch = locator::i_endpoint_snitch::get_local_snitch_ptr();
     for (auto x : unordered_multimap_to_unordered_map(ranges_with_sources)) {
         const dht::token_range& range_ = x.first;
         const std::unordered_set<inet_address>& addresses = x.second;
         bool found_source = false;
+        std::unordered_set<inet_address> sources;
         for (auto address : addresses) {
             if (address == utils::fb_utilities::get_broadcast_address()) {
                 // If localhost is a source, we have found one, but we don't add it to the map to avoid streaming locally
@@ -90,9 +94,24 @@ range_streamer::get_range_fetch_map(const std::unordered_multimap<dht::token_ran
                 continue;
             }
 
-            range_fetch_map_map.emplace(address, range_);
+            sources.emplace(address);
+        }
+
+        if (!sources.empty()) {
+            // We only stream from one other node for each range, but spread the
+            // ranges over the replicas of the closest data center, so that they
+            // are streamed from several nodes at once.
+            auto preferred = snitch->get_sorted_list_by_proximity(utils::fb_utilities::get_broadcast_address(), sources);
+            auto dc = snitch->get_datacenter(preferred.front());
+            auto source = preferred.front();
+            for (auto address : preferred) {
+                if (snitch->get_datacenter(address) == dc && ranges_per_source[address] < ranges_per_source[source]) {
+                    source = address;
+                }
+            }
+            range_fetch_map_map.emplace(source, range_);
+            ++ranges_per_source[source];
             found_source = true;
-            break; // ensure we only stream from one other node for each range
         }
 
         if (!found_source) {
@@ -235,21 +254,78 @@ void range_streamer::add_ranges(const sstring& keyspace_name, dht::token_range_v
     _to_fetch.emplace(keyspace_name, std::move(range_fetch_map));
 }
 
-future<streaming::stream_state> range_streamer::fetch_async() {
-    for (auto& fetch : _to_fetch) {
-        const auto& keyspace = fetch.first;
-        for (auto& x : fetch.second) {
-            auto& source = x.first;
-            auto& ranges = x.second;
-            /* Send messages to respective folks to stream data over to me */
-            if (logger.is_enabled(logging::log_level::debug)) {
-                logger.debug("{}ing from {} ranges {}", _description, source, ranges);
+void range_streamer::streamed_ranges_recorder::handle_stream_event(streaming::table_complete_event event) {
+    auto& db = _db.local();
+    if (!db.column_family_exists(event.cf_id)) {
+        return;
+    }
+    auto ks_name = db.find_column_family(event.cf_id).schema()->ks_name();
+    with_gate(_writes, [ks_name = std::move(ks_name), event = std::move(event)] {
+        return db::system_keyspace::update_streamed_ranges(ks_name, event.cf_id, event.ranges).handle_exception([cf_id = event.cf_id] (auto ep) {
+            logger.warn("Failed to save the ranges streamed for cf_id={}: {}", cf_id, ep);
+        });
+    });
+}
+
+void range_streamer::request_ranges(inet_address source, const sstring& keyspace, const dht::token_range_vector& ranges,
+                                    const std::unordered_map<utils::UUID, dht::token_range_vector>& streamed_ranges) {
+    if (streamed_ranges.empty()) {
+        _stream_plan.request_ranges(source, keyspace, ranges);
+        return;
+    }
+    for (auto& x : _db.local().find_keyspace(keyspace).metadata()->cf_meta_data()) {
+        auto& cf_name = x.first;
+        auto it = streamed_ranges.find(x.second->id());
+        dht::token_range_vector to_stream;
+        for (auto& range : ranges) {
+            auto contains_range = [&range] (const dht::token_range& r) {
+                return r.contains(range, dht::token_comparator());
+            };
+            if (it == streamed_ranges.end() || std::none_of(it->second.begin(), it->second.end(), contains_range)) {
+                to_stream.push_back(range);
             }
-            _stream_plan.request_ranges(source, keyspace, ranges);
+        }
+        if (to_stream.size() < ranges.size()) {
+            logger.info("{} : skipping {} ranges of {}.{} from source {}, received already", _description,
+                        ranges.size() - to_stream.size(), keyspace, cf_name, source);
+        }
+        if (!to_stream.empty()) {
+            _stream_plan.request_ranges(source, keyspace, std::move(to_stream), {cf_name});
         }
     }
+}
 
-    return _stream_plan.execute();
+future<streaming::stream_state> range_streamer::fetch_async() {
+    return do_for_each(_to_fetch, [this] (auto& fetch) {
+        const auto& keyspace = fetch.first;
+        return db::system_keyspace::get_streamed_ranges(keyspace).then([this, &fetch] (auto streamed_ranges) {
+            const auto& keyspace = fetch.first;
+            for (auto& x : fetch.second) {
+                auto& source = x.first;
+                auto& ranges = x.second;
+                /* Send messages to respective folks to stream data over to me */
+                if (logger.is_enabled(logging::log_level::debug)) {
+                    logger.debug("{}ing from {} ranges {}", _description, source, ranges);
+                }
+                this->request_ranges(source, keyspace, ranges, streamed_ranges);
+            }
+        });
+    }).then([this] {
+        _stream_plan.listeners({&_recorder});
+        return _stream_plan.execute();
+    }).then_wrapped([this] (future<streaming::stream_state> f) {
+        return _recorder.stop().then([this, f = std::move(f)] () mutable {
+            if (f.failed()) {
+                return std::move(f);
+            }
+            // Everything was received, so a later bootstrap or rebuild starts from scratch.
+            return do_for_each(_to_fetch, [] (auto& fetch) {
+                return db::system_keyspace::reset_streamed_ranges(fetch.first);
+            }).then([f = std::move(f)] () mutable {
+                return std::move(f);
+            });
+        });
+    });
 }
 
 std::unordered_multimap<inet_address, dht::token_range>
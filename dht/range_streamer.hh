@@ -42,10 +42,12 @@
 #include "locator/snitch_base.hh"
 #include "streaming/stream_plan.hh"
 #include "streaming/stream_state.hh"
+#include "streaming/stream_event_handler.hh"
 #include "gms/inet_address.hh"
 #include "gms/i_failure_detector.hh"
 #include "range.hh"
 #include <seastar/core/distributed.hh>
+#include <seastar/core/gate.hh>
 #include <unordered_map>
 #include <memory>
 
@@ -101,13 +103,27 @@ class range_streamer {
         }
     };
 
+    /**
+     * Saves the ranges of each table as they are received, so that they can be
+     * skipped if the streaming fails and is retried.
+     */
+    class streamed_ranges_recorder : public streaming::stream_event_handler {
+        distributed<database>& _db;
+        seastar::gate _writes;
+    public:
+        explicit streamed_ranges_recorder(distributed<database>& db) : _db(db) { }
+        virtual void handle_stream_event(streaming::table_complete_event event) override;
+        future<> stop() { return _writes.close(); }
+    };
+
     range_streamer(distributed<database>& db, token_metadata& tm, std::unordered_set<token> tokens, inet_address address, sstring description)
         : _db(db)
         , _metadata(tm)
         , _tokens(std::move(tokens))
         , _address(address)
         , _description(std::move(description))
-        , _stream_plan(_description) {
+        , _stream_plan(_description)
+        , _recorder(db) {
     }
 
     range_streamer(distributed<database>& db, token_metadata& tm, inet_address address, sstring description)
@@ -158,7 +174,12 @@ class range_streamer {
         return toFetch;
     }
 #endif
+    // Requests the ranges from the source for the tables which didn't receive
+    // them already.
+    void request_ranges(inet_address source, const sstring& keyspace, const dht::token_range_vector& ranges,
+                        const std::unordered_map<utils::UUID, dht::token_range_vector>& streamed_ranges);
 public:
+    // Ranges received by a previous attempt which failed are not streamed again.
     future<streaming::stream_state> fetch_async();
 private:
     distributed<database>& _db;
@@ -169,6 +190,7 @@ class range_streamer {
     std::unordered_multimap<sstring, std::unordered_map<inet_address, dht::token_range_vector>> _to_fetch;
     std::unordered_set<std::unique_ptr<i_source_filter>> _source_filters;
     stream_plan _stream_plan;
+    streamed_ranges_recorder _recorder;
 };
 
 } // dht
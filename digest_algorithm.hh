@@ -26,6 +26,7 @@ namespace query {
 enum class digest_algorithm : uint8_t {
     none = 0,  // digest not required
     MD5 = 1,   // default algorithm
+    MURMUR3 = 2,   // 128-bit murmur3, once the cluster supports MURMUR3_DIGEST
 };
 
 }
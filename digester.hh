@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include "digest_algorithm.hh"
+#include "md5_hasher.hh"
+#include "utils/murmur_hash.hh"
+
+namespace query {
+
+// Computes the digest of a query result with the algorithm the coordinator
+// asked for, so that all the replicas of a read agree on it.
+class digester {
+    digest_algorithm _algorithm;
+    md5_hasher _md5;
+    utils::murmur_hash::hasher3_x64_128 _murmur3;
+public:
+    explicit digester(digest_algorithm algorithm = digest_algorithm::MD5)
+        : _algorithm(algorithm)
+    { }
+
+    void update(const char* ptr, size_t length) {
+        if (_algorithm == digest_algorithm::MURMUR3) {
+            _murmur3.update(ptr, length);
+        } else {
+            _md5.update(ptr, length);
+        }
+    }
+
+    std::array<uint8_t, 16> finalize_array() {
+        if (_algorithm != digest_algorithm::MURMUR3) {
+            return _md5.finalize_array();
+        }
+        std::array<uint64_t, 2> hash;
+        _murmur3.finalize(hash);
+        // Little endian, to match on all replicas.
+        std::array<uint8_t, 16> digest;
+        for (size_t i = 0; i < digest.size(); ++i) {
+            digest[i] = uint8_t(hash[i / 8] >> (8 * (i % 8)));
+        }
+        return digest;
+    }
+};
+
+}
@@ -166,6 +166,14 @@ struct overloaded_exception : public cassandra_exception {
         cassandra_exception(exception_code::OVERLOADED, prepare_message("Too many in flight hints: %lu", c)) {}
 };
 
+// An operation on a partition which already got as many operations as its
+// table's per_partition_rate_limit allows. The protocol has no dedicated
+// code, so clients see it as overloaded, with this message.
+struct rate_limit_exception : public cassandra_exception {
+    rate_limit_exception(const sstring& ks, const sstring& cf, const char* op) noexcept :
+        cassandra_exception(exception_code::OVERLOADED, prepare_message("Per-partition rate limit reached for %s to %s.%s", op, ks, cf)) {}
+};
+
 class request_validation_exception : public cassandra_exception {
 public:
     using cassandra_exception::cassandra_exception;
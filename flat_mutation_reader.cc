@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/range/algorithm/find_if.hpp>
+#include <boost/range/algorithm/heap_algorithm.hpp>
+
+#include "flat_mutation_reader.hh"
+
+std::ostream& operator<<(std::ostream& os, const partition_start& ps) {
+    return os << "{partition_start: key " << ps._key << " tombstone " << ps._partition_tombstone << "}";
+}
+
+std::ostream& operator<<(std::ostream& os, const flat_mutation_fragment& f) {
+    switch (f._kind) {
+    case flat_mutation_fragment::kind::partition_start:
+        return os << *f._partition_start;
+    case flat_mutation_fragment::kind::mutation_fragment:
+        return os << *f._fragment;
+    case flat_mutation_fragment::kind::partition_end:
+        return os << "{partition_end}";
+    }
+    abort();
+}
+
+namespace {
+
+// A flat reader, with whether it is in the middle of a partition, shared by
+// the streamed_mutations of its partitions.
+struct flat_reader_cursor {
+    flat_mutation_reader reader;
+    bool in_partition = false;
+
+    explicit flat_reader_cursor(flat_mutation_reader rd)
+        : reader(std::move(rd))
+    { }
+
+    // Drops what is left of the current partition.
+    future<> skip_partition() {
+        return do_until([this] { return !in_partition; }, [this] {
+            while (in_partition && !reader.is_buffer_empty()) {
+                in_partition = !reader.pop_fragment().is_partition_end();
+            }
+            if (!in_partition || (reader.is_buffer_empty() && reader.is_end_of_stream())) {
+                in_partition = false;
+                return make_ready_future<>();
+            }
+            return reader.fill_buffer();
+        });
+    }
+
+    // The partition_start of the next partition, or a disengaged optional if
+    // there are no more. Requires !in_partition.
+    future<stdx::optional<partition_start>> next_partition() {
+        if (reader.is_buffer_empty()) {
+            if (reader.is_end_of_stream()) {
+                return make_ready_future<stdx::optional<partition_start>>();
+            }
+            return reader.fill_buffer().then([this] {
+                return next_partition();
+            });
+        }
+        auto f = reader.pop_fragment();
+        assert(f.is_partition_start());
+        in_partition = true;
+        return make_ready_future<stdx::optional<partition_start>>(std::move(f).as_partition_start());
+    }
+};
+
+// The current partition of a flat_reader_cursor as a streamed_mutation.
+class flat_partition_streamed_mutation final : public streamed_mutation::impl {
+    lw_shared_ptr<flat_reader_cursor> _cursor;
+private:
+    void move_buffer() {
+        auto& rd = _cursor->reader;
+        while (!is_buffer_full() && !rd.is_buffer_empty()) {
+            auto f = rd.pop_fragment();
+            if (f.is_partition_end()) {
+                _cursor->in_partition = false;
+                _end_of_stream = true;
+                return;
+            }
+            push_mutation_fragment(std::move(f).as_mutation_fragment());
+        }
+        if (rd.is_buffer_empty() && rd.is_end_of_stream()) {
+            _cursor->in_partition = false;
+            _end_of_stream = true;
+        }
+    }
+public:
+    flat_partition_streamed_mutation(schema_ptr s, partition_start ps, lw_shared_ptr<flat_reader_cursor> cursor)
+        : streamed_mutation::impl(std::move(s), std::move(ps.key()), ps.partition_tombstone())
+        , _cursor(std::move(cursor))
+    {
+        move_buffer();
+    }
+
+    virtual future<> fill_buffer() override {
+        return do_until([this] { return is_end_of_stream() || is_buffer_full(); }, [this] {
+            move_buffer();
+            if (is_end_of_stream() || is_buffer_full()) {
+                return make_ready_future<>();
+            }
+            return _cursor->reader.fill_buffer();
+        });
+    }
+};
+
+class flat_reader_from_mutation_reader final : public flat_mutation_reader::impl {
+    mutation_reader _reader;
+    streamed_mutation_opt _current;
+private:
+    void move_buffer() {
+        while (!is_buffer_full() && !_current->is_buffer_empty()) {
+            push_fragment(_current->pop_mutation_fragment());
+        }
+        if (_current->is_buffer_empty() && _current->is_end_of_stream()) {
+            push_fragment(partition_end());
+            _current = { };
+        }
+    }
+public:
+    flat_reader_from_mutation_reader(schema_ptr s, mutation_reader rd)
+        : impl(std::move(s))
+        , _reader(std::move(rd))
+    { }
+
+    virtual future<> fill_buffer() override {
+        return do_until([this] { return is_end_of_stream() || is_buffer_full(); }, [this] {
+            if (!_current) {
+                return _reader().then([this] (streamed_mutation_opt smo) {
+                    if (!smo) {
+                        _end_of_stream = true;
+                        return;
+                    }
+                    push_fragment(partition_start(smo->decorated_key(), smo->partition_tombstone()));
+                    _current = std::move(smo);
+                    move_buffer();
+                });
+            }
+            move_buffer();
+            if (!_current || is_buffer_full()) {
+                return make_ready_future<>();
+            }
+            return _current->fill_buffer();
+        });
+    }
+
+    virtual future<> fast_forward_to(const dht::partition_range& pr) override {
+        clear_buffer();
+        _current = { };
+        _end_of_stream = false;
+        return _reader.fast_forward_to(pr);
+    }
+};
+
+class mutation_reader_from_flat_reader final : public mutation_reader::impl {
+    schema_ptr _schema;
+    lw_shared_ptr<flat_reader_cursor> _cursor;
+public:
+    explicit mutation_reader_from_flat_reader(flat_mutation_reader rd)
+        : _schema(rd.schema())
+        , _cursor(make_lw_shared<flat_reader_cursor>(std::move(rd)))
+    { }
+
+    virtual future<streamed_mutation_opt> operator()() override {
+        return _cursor->skip_partition().then([this] {
+            return _cursor->next_partition();
+        }).then([this] (stdx::optional<partition_start> ps) -> streamed_mutation_opt {
+            if (!ps) {
+                return { };
+            }
+            return make_streamed_mutation<flat_partition_streamed_mutation>(_schema, std::move(*ps), _cursor);
+        });
+    }
+
+    virtual future<> fast_forward_to(const dht::partition_range& pr) override {
+        _cursor->in_partition = false;
+        return _cursor->reader.fast_forward_to(pr);
+    }
+};
+
+class combined_flat_reader final : public flat_mutation_reader::impl {
+    std::vector<lw_shared_ptr<flat_reader_cursor>> _cursors;
+
+    struct partition_and_cursor {
+        partition_start start;
+        flat_reader_cursor* cursor;
+    };
+    // The readers positioned at the start of a partition which is yet to be
+    // emitted.
+    std::vector<partition_and_cursor> _heap;
+    // The readers which need to get to the start of their next partition.
+    std::vector<flat_reader_cursor*> _next;
+    // The reader of the partition being emitted, when only one reader has
+    // it.
+    flat_reader_cursor* _single = nullptr;
+    // The merged partition being emitted, when several readers have it.
+    streamed_mutation_opt _merged;
+    std::vector<flat_reader_cursor*> _merged_cursors;
+private:
+    bool heap_less(const partition_and_cursor& a, const partition_and_cursor& b) const {
+        // The order is inverted, because heaps produce the greatest value first.
+        return b.start.key().less_compare(*_schema, a.start.key());
+    }
+
+    void move_single_buffer() {
+        auto& rd = _single->reader;
+        while (!is_buffer_full() && !rd.is_buffer_empty()) {
+            auto f = rd.pop_fragment();
+            auto end = f.is_partition_end();
+            push_fragment(std::move(f));
+            if (end) {
+                finish_single();
+                return;
+            }
+        }
+        if (rd.is_buffer_empty() && rd.is_end_of_stream()) {
+            push_fragment(partition_end());
+            finish_single();
+        }
+    }
+
+    void finish_single() {
+        _single->in_partition = false;
+        _next.emplace_back(_single);
+        _single = nullptr;
+    }
+
+    void move_merged_buffer() {
+        while (!is_buffer_full() && !_merged->is_buffer_empty()) {
+            push_fragment(_merged->pop_mutation_fragment());
+        }
+        if (_merged->is_buffer_empty() && _merged->is_end_of_stream()) {
+            push_fragment(partition_end());
+            _merged = { };
+            for (auto&& c : _merged_cursors) {
+                _next.emplace_back(c);
+            }
+            _merged_cursors.clear();
+        }
+    }
+
+    // Gets the readers in _next to the start of their next partition.
+    future<> prepare_next() {
+        return parallel_for_each(_next, [this] (flat_reader_cursor* c) {
+            return c->next_partition().then([this, c] (stdx::optional<partition_start> ps) {
+                if (ps) {
+                    _heap.emplace_back(partition_and_cursor{std::move(*ps), c});
+                    boost::range::push_heap(_heap, [this] (auto& a, auto& b) { return this->heap_less(a, b); });
+                } else {
+                    c->in_partition = false;
+                }
+            });
+        }).then([this] {
+            _next.clear();
+        });
+    }
+
+    // Starts emitting the smallest partition of the readers in _heap.
+    void start_next_partition() {
+        auto cmp = [this] (auto& a, auto& b) { return this->heap_less(a, b); };
+        boost::range::pop_heap(_heap, cmp);
+        auto first = std::move(_heap.back());
+        _heap.pop_back();
+        if (_heap.empty() || !_heap.front().start.key().equal(*_schema, first.start.key())) {
+            push_fragment(std::move(first.start));
+            _single = first.cursor;
+            return;
+        }
+        std::vector<streamed_mutation> partitions;
+        auto add = [&] (partition_and_cursor&& pc) {
+            _merged_cursors.emplace_back(pc.cursor);
+            auto cursor = boost::find_if(_cursors, [&pc] (auto& c) { return c.get() == pc.cursor; });
+            partitions.emplace_back(make_streamed_mutation<flat_partition_streamed_mutation>(_schema, std::move(pc.start), *cursor));
+        };
+        add(std::move(first));
+        while (!_heap.empty() && _heap.front().start.key().equal(*_schema, partitions.front().decorated_key())) {
+            boost::range::pop_heap(_heap, cmp);
+            add(std::move(_heap.back()));
+            _heap.pop_back();
+        }
+        _merged = merge_mutations(std::move(partitions));
+        push_fragment(partition_start(_merged->decorated_key(), _merged->partition_tombstone()));
+    }
+public:
+    combined_flat_reader(schema_ptr s, std::vector<flat_mutation_reader> readers)
+        : impl(std::move(s))
+    {
+        _cursors.reserve(readers.size());
+        for (auto&& rd : readers) {
+            _cursors.emplace_back(make_lw_shared<flat_reader_cursor>(std::move(rd)));
+            _next.emplace_back(_cursors.back().get());
+        }
+    }
+
+    virtual future<> fill_buffer() override {
+        return do_until([this] { return is_end_of_stream() || is_buffer_full(); }, [this] {
+            if (_single) {
+                move_single_buffer();
+                if (!_single || is_buffer_full()) {
+                    return make_ready_future<>();
+                }
+                return _single->reader.fill_buffer();
+            }
+            if (_merged) {
+                move_merged_buffer();
+                if (!_merged || is_buffer_full()) {
+                    return make_ready_future<>();
+                }
+                return _merged->fill_buffer();
+            }
+            if (!_next.empty()) {
+                return prepare_next();
+            }
+            if (_heap.empty()) {
+                _end_of_stream = true;
+                return make_ready_future<>();
+            }
+            start_next_partition();
+            return make_ready_future<>();
+        });
+    }
+
+    virtual future<> fast_forward_to(const dht::partition_range& pr) override {
+        clear_buffer();
+        _end_of_stream = false;
+        _heap.clear();
+        _single = nullptr;
+        _merged = { };
+        _merged_cursors.clear();
+        _next.clear();
+        return parallel_for_each(_cursors, [this, &pr] (lw_shared_ptr<flat_reader_cursor>& c) {
+            c->in_partition = false;
+            _next.emplace_back(c.get());
+            return c->reader.fast_forward_to(pr);
+        });
+    }
+};
+
+}
+
+flat_mutation_reader flat_mutation_reader_from_mutation_reader(schema_ptr s, mutation_reader rd) {
+    return make_flat_mutation_reader<flat_reader_from_mutation_reader>(std::move(s), std::move(rd));
+}
+
+mutation_reader mutation_reader_from_flat_mutation_reader(flat_mutation_reader rd) {
+    return make_mutation_reader<mutation_reader_from_flat_reader>(std::move(rd));
+}
+
+flat_mutation_reader make_combined_flat_reader(schema_ptr s, std::vector<flat_mutation_reader> readers) {
+    return make_flat_mutation_reader<combined_flat_reader>(std::move(s), std::move(readers));
+}
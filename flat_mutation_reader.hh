@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <experimental/optional>
+#include <vector>
+
+#include "core/circular_buffer.hh"
+#include "core/future-util.hh"
+#include "core/do_with.hh"
+#include "dht/i_partitioner.hh"
+#include "mutation_reader.hh"
+#include "streamed_mutation.hh"
+
+// The start of a partition in a flat stream: its key and tombstone.
+class partition_start {
+    dht::decorated_key _key;
+    tombstone _partition_tombstone;
+public:
+    partition_start(dht::decorated_key key, tombstone partition_tombstone)
+        : _key(std::move(key))
+        , _partition_tombstone(partition_tombstone)
+    { }
+
+    const dht::decorated_key& key() const { return _key; }
+    dht::decorated_key& key() { return _key; }
+    tombstone partition_tombstone() const { return _partition_tombstone; }
+
+    size_t external_memory_usage() const {
+        return _key.key().external_memory_usage();
+    }
+
+    friend std::ostream& operator<<(std::ostream&, const partition_start&);
+};
+
+// The end of a partition in a flat stream.
+class partition_end {
+public:
+    size_t external_memory_usage() const {
+        return 0;
+    }
+};
+
+// An element of a flat stream, which holds the fragments of many partitions
+// one after another: the start of a partition, one of its mutation_fragments,
+// or its end. The fragments of each partition come in the order they do in a
+// streamed_mutation, between the partition_start and the partition_end of the
+// partition.
+class flat_mutation_fragment {
+public:
+    enum class kind {
+        partition_start,
+        mutation_fragment,
+        partition_end,
+    };
+private:
+    kind _kind;
+    stdx::optional<partition_start> _partition_start;
+    mutation_fragment_opt _fragment;
+public:
+    flat_mutation_fragment(partition_start ps)
+        : _kind(kind::partition_start)
+        , _partition_start(std::move(ps))
+    { }
+    flat_mutation_fragment(mutation_fragment mf)
+        : _kind(kind::mutation_fragment)
+        , _fragment(std::move(mf))
+    { }
+    flat_mutation_fragment(partition_end)
+        : _kind(kind::partition_end)
+    { }
+
+    kind fragment_kind() const { return _kind; }
+
+    bool is_partition_start() const { return _kind == kind::partition_start; }
+    bool is_mutation_fragment() const { return _kind == kind::mutation_fragment; }
+    bool is_partition_end() const { return _kind == kind::partition_end; }
+
+    const partition_start& as_partition_start() const & { return *_partition_start; }
+    partition_start&& as_partition_start() && { return std::move(*_partition_start); }
+
+    const mutation_fragment& as_mutation_fragment() const & { return *_fragment; }
+    mutation_fragment&& as_mutation_fragment() && { return std::move(*_fragment); }
+
+    size_t memory_usage() const {
+        switch (_kind) {
+        case kind::partition_start:
+            return sizeof(*this) + _partition_start->external_memory_usage();
+        case kind::mutation_fragment:
+            return sizeof(*this) + _fragment->memory_usage();
+        case kind::partition_end:
+            return sizeof(*this);
+        }
+        abort();
+    }
+
+    friend std::ostream& operator<<(std::ostream&, const flat_mutation_fragment&);
+};
+
+using flat_mutation_fragment_opt = stdx::optional<flat_mutation_fragment>;
+
+// A flat_mutation_reader is a single stream of the fragments of a sequence of
+// partitions, as opposed to a mutation_reader, which returns a
+// streamed_mutation for each partition.
+//
+// The readers fill their buffer with as many fragments as fit, across
+// partition boundaries, at once. The consumers then work through the buffer
+// without waiting on a future for every fragment, or for every partition,
+// which is what small partitions and small rows pay for with
+// mutation_reader.
+//
+// The partitions have strictly monotonically increasing keys, like the ones
+// of a mutation_reader. The caller must keep the reader alive until the
+// futures it returns are resolved.
+class flat_mutation_reader final {
+public:
+    class impl {
+        circular_buffer<flat_mutation_fragment> _buffer;
+        size_t _buffer_size = 0;
+    protected:
+        static constexpr size_t max_buffer_size_in_bytes = 8 * 1024;
+
+        schema_ptr _schema;
+        bool _end_of_stream = false;
+    protected:
+        template<typename... Args>
+        void push_fragment(Args&&... args) {
+            _buffer.emplace_back(std::forward<Args>(args)...);
+            _buffer_size += _buffer.back().memory_usage();
+        }
+
+        void clear_buffer() {
+            _buffer.clear();
+            _buffer_size = 0;
+        }
+    public:
+        explicit impl(schema_ptr s)
+            : _schema(std::move(s))
+        { }
+
+        virtual ~impl() { }
+
+        // Adds fragments to the buffer until is_buffer_full() or the end of
+        // stream.
+        virtual future<> fill_buffer() = 0;
+
+        // See flat_mutation_reader::fast_forward_to().
+        virtual future<> fast_forward_to(const dht::partition_range&) {
+            throw std::bad_function_call();
+        }
+
+        const schema_ptr& schema() const { return _schema; }
+
+        bool is_end_of_stream() const { return _end_of_stream; }
+        bool is_buffer_empty() const { return _buffer.empty(); }
+        bool is_buffer_full() const { return _buffer_size >= max_buffer_size_in_bytes; }
+
+        const flat_mutation_fragment& peek_buffer() const { return _buffer.front(); }
+
+        flat_mutation_fragment pop_fragment() {
+            auto f = std::move(_buffer.front());
+            _buffer.pop_front();
+            _buffer_size -= f.memory_usage();
+            return f;
+        }
+
+        future<flat_mutation_fragment_opt> operator()() {
+            if (is_buffer_empty()) {
+                if (is_end_of_stream()) {
+                    return make_ready_future<flat_mutation_fragment_opt>();
+                }
+                return fill_buffer().then([this] { return operator()(); });
+            }
+            return make_ready_future<flat_mutation_fragment_opt>(pop_fragment());
+        }
+    };
+private:
+    std::unique_ptr<impl> _impl;
+
+    template<typename Consumer>
+    class flattened_consumer_adapter;
+public:
+    explicit flat_mutation_reader(std::unique_ptr<impl> i)
+        : _impl(std::move(i))
+    { }
+
+    const schema_ptr& schema() const { return _impl->schema(); }
+
+    bool is_end_of_stream() const { return _impl->is_end_of_stream(); }
+    bool is_buffer_empty() const { return _impl->is_buffer_empty(); }
+    bool is_buffer_full() const { return _impl->is_buffer_full(); }
+
+    // Requirements: !is_buffer_empty()
+    const flat_mutation_fragment& peek_buffer() const { return _impl->peek_buffer(); }
+    flat_mutation_fragment pop_fragment() { return _impl->pop_fragment(); }
+
+    future<> fill_buffer() { return _impl->fill_buffer(); }
+
+    // Changes the range of partitions to pr, after the current one, like
+    // mutation_reader::fast_forward_to(). Drops what is left of the
+    // current partition.
+    future<> fast_forward_to(const dht::partition_range& pr) {
+        return _impl->fast_forward_to(pr);
+    }
+
+    // The next fragment, or a disengaged optional at the end of stream.
+    future<flat_mutation_fragment_opt> operator()() {
+        return _impl->operator()();
+    }
+
+    // Feeds the stream to a FlattenedConsumer (see consume_flattened()). The
+    // consumer may stop the current partition with the result of consuming
+    // any of its fragments, and the whole stream with the result of
+    // consume_end_of_partition().
+    //
+    // The fragments in the buffer are consumed in a loop, futures are only
+    // waited on when the buffer runs out.
+    template<typename FlattenedConsumer>
+    auto consume(FlattenedConsumer consumer) {
+        return do_with(flattened_consumer_adapter<FlattenedConsumer>(std::move(consumer)), [this] (auto& c) {
+            return repeat([this, &c] {
+                while (!is_buffer_empty()) {
+                    if (c(pop_fragment()) == stop_iteration::yes) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                }
+                if (is_end_of_stream()) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return fill_buffer().then([] { return stop_iteration::no; });
+            }).then([&c] {
+                return c.consumer().consume_end_of_stream();
+            });
+        });
+    }
+};
+
+template<typename Consumer>
+class flat_mutation_reader::flattened_consumer_adapter {
+    Consumer _consumer;
+    // The consumer stopped the current partition, which is skipped until
+    // its end.
+    bool _skipping = false;
+public:
+    explicit flattened_consumer_adapter(Consumer consumer)
+        : _consumer(std::move(consumer))
+    { }
+
+    Consumer& consumer() { return _consumer; }
+
+    stop_iteration operator()(flat_mutation_fragment&& f) {
+        switch (f.fragment_kind()) {
+        case flat_mutation_fragment::kind::partition_start: {
+            auto& ps = f.as_partition_start();
+            _consumer.consume_new_partition(ps.key());
+            if (ps.partition_tombstone()) {
+                _consumer.consume(ps.partition_tombstone());
+            }
+            return stop_iteration::no;
+        }
+        case flat_mutation_fragment::kind::mutation_fragment:
+            if (!_skipping) {
+                _skipping = std::move(f).as_mutation_fragment().consume(_consumer) == stop_iteration::yes;
+            }
+            return stop_iteration::no;
+        case flat_mutation_fragment::kind::partition_end:
+            _skipping = false;
+            return _consumer.consume_end_of_partition();
+        }
+        abort();
+    }
+};
+
+// Impl: derived from flat_mutation_reader::impl; Args/args: arguments for Impl's constructor
+template <typename Impl, typename... Args>
+inline
+flat_mutation_reader make_flat_mutation_reader(Args&&... args) {
+    return flat_mutation_reader(std::make_unique<Impl>(std::forward<Args>(args)...));
+}
+
+// Adapts a mutation_reader of partitions of schema s to a flat stream. The
+// fragments already in the buffers of the streamed_mutations are moved to the
+// flat buffer in bulk.
+flat_mutation_reader flat_mutation_reader_from_mutation_reader(schema_ptr s, mutation_reader);
+
+// Adapts a flat stream to a mutation_reader, for the consumers which aren't
+// flat yet.
+mutation_reader mutation_reader_from_flat_mutation_reader(flat_mutation_reader);
+
+// Merges the partitions of several flat readers of the same schema, like
+// make_combined_reader(). The partitions only one of the readers has, which
+// are most of them in the usual case of scans over sstables which don't
+// overlap much, are passed through without being merged.
+flat_mutation_reader make_combined_flat_reader(schema_ptr s, std::vector<flat_mutation_reader>);
@@ -90,11 +90,27 @@ frozen_mutation::frozen_mutation(bytes_ostream&& b, partition_key pk)
     _bytes.reduce_chunk_count();
 }
 
+// An estimate of the serialized size of m, from the memory used by its
+// keys and cells, so that the representation is allocated in as few chunks
+// as possible, and doesn't need to be linearized when it is small.
+size_t estimate_serialized_size(const mutation& m) {
+    auto& p = m.partition();
+    size_t size = m.key().external_memory_usage() + p.static_row().external_memory_usage();
+    for (auto&& e : p.clustered_rows()) {
+        size += sizeof(clustering_row) + e.key().external_memory_usage() + e.row().cells().external_memory_usage();
+    }
+    for (auto&& rt : p.row_tombstones()) {
+        size += rt.memory_usage();
+    }
+    return size;
+}
+
 frozen_mutation::frozen_mutation(const mutation& m)
     : _pk(m.key())
 {
     mutation_partition_serializer part_ser(*m.schema(), m.partition());
 
+    _bytes.reserve(estimate_serialized_size(m));
     ser::writer_of_mutation<bytes_ostream> wom(_bytes);
     std::move(wom).write_table_id(m.schema()->id())
                   .write_schema_version(m.schema()->version())
@@ -193,6 +209,7 @@ class fragmenting_mutation_freezer {
 private:
     future<> flush() {
         bytes_ostream out;
+        out.reserve(_dirty_size);
         ser::writer_of_mutation<bytes_ostream> wom(out);
         std::move(wom).write_table_id(_schema.id())
                       .write_schema_version(_schema.version())
@@ -77,6 +77,9 @@ class frozen_mutation final {
 
 frozen_mutation freeze(const mutation& m);
 
+// A cheap estimate of the size of the frozen form of m.
+size_t estimate_serialized_size(const mutation& m);
+
 // Can receive streamed_mutation in reversed order.
 class streamed_mutation_freezer {
     const schema& _schema;
@@ -44,6 +44,8 @@
 #include "gms/application_state.hh"
 #include "gms/inet_address.hh"
 #include "log.hh"
+#include <seastar/core/metrics.hh>
+#include <algorithm>
 #include <iostream>
 #include <chrono>
 
@@ -110,6 +112,10 @@ double arrival_window::mean() {
     return _arrival_intervals.mean();
 }
 
+double arrival_window::stddev() {
+    return _arrival_intervals.stddev();
+}
+
 double arrival_window::phi(clk::time_point tnow) {
     assert(_arrival_intervals.size() > 0 && _tlast > clk::time_point::min()); // should not be called before any samples arrive
     auto t = (tnow - _tlast).count();
@@ -120,6 +126,24 @@ double arrival_window::phi(clk::time_point tnow) {
     return phi;
 }
 
+double arrival_window::phi_normal(clk::time_point tnow) {
+    assert(_arrival_intervals.size() > 0 && _tlast > clk::time_point::min()); // should not be called before any samples arrive
+    double t = (tnow - _tlast).count();
+    auto m = mean();
+    // Heartbeats which happen to arrive at regular intervals would make any
+    // small delay look like a failure.
+    auto sd = std::max(stddev(), m / 4);
+    auto y = (t - m) / sd;
+    // A logistic approximation of the cumulative distribution function of
+    // the normal distribution, which is accurate enough and doesn't
+    // underflow for large values of y like 1 - cdf(y) does.
+    auto e = std::exp(-y * (1.5976 + 0.070566 * y * y));
+    double phi = t > m ? -std::log10(e / (1.0 + e)) : -std::log10(1.0 - 1.0 / (1.0 + e));
+    logger.debug("failure_detector: now={}, tlast={}, t={}, mean={}, stddev={}, phi={}",
+        tnow.time_since_epoch().count(), _tlast.time_since_epoch().count(), t, m, sd, phi);
+    return phi;
+}
+
 std::ostream& operator<<(std::ostream& os, const arrival_window& w) {
     for (auto& x : w._arrival_intervals.deque()) {
         os << x << " ";
@@ -127,6 +151,31 @@ std::ostream& operator<<(std::ostream& os, const arrival_window& w) {
     return os;
 }
 
+constexpr std::array<double, 8> failure_detector::PHI_BUCKETS;
+
+failure_detector::failure_detector(double phi, bool variance_aware)
+        : _phi(phi)
+        , _variance_aware(variance_aware) {
+    namespace sm = seastar::metrics;
+    _metrics.add_group("failure_detector", {
+        sm::make_histogram("phi", sm::description("Histogram of the phi of the nodes, as compared to phi_convict_threshold"),
+                [this] { return get_phi_histogram(); }),
+        sm::make_derive("convictions", sm::description("Counts the times a node was convicted"), _convictions),
+    });
+}
+
+seastar::metrics::histogram failure_detector::get_phi_histogram() const {
+    seastar::metrics::histogram res;
+    res.buckets.resize(PHI_BUCKETS.size());
+    for (size_t i = 0; i < PHI_BUCKETS.size(); i++) {
+        res.buckets[i].count = _phi_histogram[i];
+        res.buckets[i].upper_bound = PHI_BUCKETS[i];
+    }
+    res.sample_count = _phi_samples;
+    res.sample_sum = _phi_sum;
+    return res;
+}
+
 sstring failure_detector::get_all_endpoint_states() {
     std::stringstream ss;
     for (auto& entry : get_local_gossiper().endpoint_state_map) {
@@ -253,11 +302,17 @@ void failure_detector::interpret(inet_address ep) {
         logger.debug("Still not marking nodes down due to local pause");
         return;
     }
-    double phi = hb_wnd.phi(now);
+    // Keep the scale of phi_convict_threshold for the original estimate.
+    double phi = _variance_aware ? hb_wnd.phi_normal(now) : PHI_FACTOR * hb_wnd.phi(now);
     logger.trace("failure_detector: PHI for {} : {}", ep, phi);
     logger.trace("failure_detector: phi_convict_threshold={}", _phi);
+    auto bucket = std::lower_bound(PHI_BUCKETS.begin(), PHI_BUCKETS.end(), phi);
+    ++_phi_histogram[std::min<size_t>(std::distance(PHI_BUCKETS.begin(), bucket), PHI_BUCKETS.size() - 1)];
+    ++_phi_samples;
+    _phi_sum += phi;
 
-    if (PHI_FACTOR * phi > get_phi_convict_threshold()) {
+    if (phi > get_phi_convict_threshold()) {
+        ++_convictions;
         logger.trace("failure_detector: notifying listeners that {} is down", ep);
         logger.trace("failure_detector: intervals: {} mean: {}", hb_wnd, hb_wnd.mean());
         for (auto& listener : _fd_evnt_listeners) {
@@ -42,10 +42,14 @@
 #include "core/sstring.hh"
 #include "core/shared_ptr.hh"
 #include "core/distributed.hh"
+#include <seastar/core/metrics_registration.hh>
+#include <seastar/core/metrics_types.hh>
 #include "utils/bounded_stats_deque.hh"
 #include "gms/i_failure_detector.hh"
 #include <iosfwd>
+#include <array>
 #include <cmath>
+#include <limits>
 #include <list>
 #include <map>
 #include <experimental/optional>
@@ -84,9 +88,18 @@ class arrival_window {
 
     double mean();
 
+    double stddev();
+
     // see CASSANDRA-2597 for an explanation of the math at work here.
     double phi(clk::time_point tnow);
 
+    // The phi of the paper: -log10 of the probability that the next
+    // heartbeat arrives later than tnow, assuming the inter-arrival times
+    // are normally distributed with the mean and the standard deviation of
+    // the recorded ones. A peer which is regularly late gets a large
+    // deviation, which keeps its phi low until it is really late.
+    double phi_normal(clk::time_point tnow);
+
     friend std::ostream& operator<<(std::ostream& os, const arrival_window& w);
 
 };
@@ -106,9 +119,21 @@ class failure_detector : public i_failure_detector, public seastar::async_sharde
     // change.
     static constexpr double PHI_FACTOR{M_LOG10El};
 
+    // Upper bounds of the buckets of the phi histogram.
+    static constexpr std::array<double, 8> PHI_BUCKETS{{0.5, 1, 2, 4, 8, 16, 32, std::numeric_limits<double>::infinity()}};
+
     std::map<inet_address, arrival_window> _arrival_samples;
     std::list<i_failure_detection_event_listener*> _fd_evnt_listeners;
     double _phi = 8;
+    // Whether to use arrival_window::phi_normal() rather than phi().
+    bool _variance_aware = false;
+
+    // The phis computed by interpret().
+    std::array<uint64_t, PHI_BUCKETS.size()> _phi_histogram{};
+    uint64_t _phi_samples = 0;
+    double _phi_sum = 0;
+    uint64_t _convictions = 0;
+    seastar::metrics::metric_groups _metrics;
 
     static constexpr std::chrono::milliseconds DEFAULT_MAX_PAUSE{5000};
 
@@ -130,11 +155,11 @@ class failure_detector : public i_failure_detector, public seastar::async_sharde
     arrival_window::clk::time_point _last_paused;
 
 public:
-    failure_detector() = default;
-
-    failure_detector(double phi) : _phi(phi) {
+    failure_detector() : failure_detector(8) {
     }
 
+    explicit failure_detector(double phi, bool variance_aware = false);
+
     future<> stop() {
         return make_ready_future<>();
     }
@@ -183,6 +208,8 @@ class failure_detector : public i_failure_detector, public seastar::async_sharde
 
     void set_phi_convict_threshold(double phi);
 
+    seastar::metrics::histogram get_phi_histogram() const;
+
     double get_phi_convict_threshold();
 
 
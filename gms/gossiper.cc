@@ -52,12 +52,14 @@
 #include "service/storage_service.hh"
 #include "message/messaging_service.hh"
 #include "dht/i_partitioner.hh"
+#include "utils/task_group.hh"
 #include "log.hh"
 #include <seastar/core/sleep.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/metrics.hh>
 #include <chrono>
 #include "dht/i_partitioner.hh"
+#include "utils/task_group.hh"
 #include <boost/range/algorithm/set_algorithm.hpp>
 
 namespace gms {
@@ -555,6 +557,7 @@ void gossiper::do_status_check() {
 // - on_remove callbacks, e.g, storage_service -> access token_metadata
 void gossiper::run() {
     timer_callback_lock().then([this, g = this->shared_from_this()] {
+      return utils::run_in_task_group(utils::task_group::gossip, [this, g] {
         return seastar::async([this, g] {
             logger.trace("=== Gossip round START");
 
@@ -625,13 +628,29 @@ void gossiper::run() {
             //      them across all other shards.
             //    - Reschedule the gossiper only after execution on all nodes is done.
             //
-            bool endpoint_map_changed = (shadow_endpoint_state_map != endpoint_state_map);
+            // Only the states which changed are copied, since with many nodes
+            // copying the whole map each round is costly, and most states
+            // don't change between rounds.
+            std::vector<inet_address> changed_endpoints;
+            std::vector<inet_address> removed_endpoints;
+            for (auto& x : endpoint_state_map) {
+                auto it = shadow_endpoint_state_map.find(x.first);
+                if (it == shadow_endpoint_state_map.end() || !(it->second == x.second)) {
+                    changed_endpoints.push_back(x.first);
+                }
+            }
+            for (auto& x : shadow_endpoint_state_map) {
+                if (!endpoint_state_map.count(x.first)) {
+                    removed_endpoints.push_back(x.first);
+                }
+            }
+            bool endpoint_map_changed = !changed_endpoints.empty() || !removed_endpoints.empty();
             bool live_endpoint_changed = (_live_endpoints != _shadow_live_endpoints);
             bool unreachable_endpoint_changed = (_unreachable_endpoints != _shadow_unreachable_endpoints);
 
             if (endpoint_map_changed || live_endpoint_changed || unreachable_endpoint_changed) {
                 if (endpoint_map_changed) {
-                    shadow_endpoint_state_map = endpoint_state_map;
+                    apply_endpoint_state_changes(shadow_endpoint_state_map, endpoint_state_map, changed_endpoints, removed_endpoints);
                     _features_condvar.broadcast();
                     maybe_enable_features();
                 }
@@ -645,11 +664,13 @@ void gossiper::run() {
                 }
 
                 _the_gossiper.invoke_on_all([this, endpoint_map_changed,
-                    live_endpoint_changed, unreachable_endpoint_changed] (gossiper& local_gossiper) {
+                    live_endpoint_changed, unreachable_endpoint_changed,
+                    &changed_endpoints, &removed_endpoints] (gossiper& local_gossiper) {
                     // Don't copy gossiper(CPU0) maps into themselves!
                     if (engine().cpu_id() != 0) {
                         if (endpoint_map_changed) {
-                            local_gossiper.endpoint_state_map = shadow_endpoint_state_map;
+                            apply_endpoint_state_changes(local_gossiper.endpoint_state_map, shadow_endpoint_state_map,
+                                    changed_endpoints, removed_endpoints);
                             local_gossiper._features_condvar.broadcast();
                             local_gossiper.maybe_enable_features();
                         }
@@ -665,6 +686,7 @@ void gossiper::run() {
                 }).get();
             }
         });
+      });
     }).then_wrapped([this] (auto&& f) {
         try {
             f.get();
@@ -686,6 +708,17 @@ void gossiper::run() {
     });
 }
 
+void gossiper::apply_endpoint_state_changes(std::unordered_map<inet_address, endpoint_state>& to,
+        const std::unordered_map<inet_address, endpoint_state>& from,
+        const std::vector<inet_address>& changed_endpoints, const std::vector<inet_address>& removed_endpoints) {
+    for (auto& ep : removed_endpoints) {
+        to.erase(ep);
+    }
+    for (auto& ep : changed_endpoints) {
+        to[ep] = from.at(ep);
+    }
+}
+
 bool gossiper::seen_any_seed() {
     for (auto& entry : endpoint_state_map) {
         if (_seeds.count(entry.first)) {
@@ -1741,6 +1774,10 @@ future<> gossiper::wait_for_gossip_to_settle() {
         if (force_after == 0) {
             return;
         }
+        if (service::get_local_storage_service().is_fast_restart()) {
+            logger.info("Fast restart from persisted ring state, not waiting for gossip to settle");
+            return;
+        }
         static constexpr std::chrono::milliseconds GOSSIP_SETTLE_MIN_WAIT_MS{5000};
         static constexpr std::chrono::milliseconds GOSSIP_SETTLE_POLL_INTERVAL_MS{1000};
         static constexpr int32_t GOSSIP_SETTLE_POLL_SUCCESSES_REQUIRED = 3;
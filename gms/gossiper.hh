@@ -212,6 +212,11 @@ class gossiper : public i_failure_detection_event_listener, public seastar::asyn
     std::set<inet_address> _shadow_live_endpoints;
 
     void run();
+    // Makes the states of changed_endpoints in to equal to their states in
+    // from, and drops the states of removed_endpoints.
+    static void apply_endpoint_state_changes(std::unordered_map<inet_address, endpoint_state>& to,
+            const std::unordered_map<inet_address, endpoint_state>& from,
+            const std::vector<inet_address>& changed_endpoints, const std::vector<inet_address>& removed_endpoints);
 public:
     gossiper();
 
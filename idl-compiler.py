@@ -241,6 +241,10 @@ def is_enum(obj):
     except:
         return False
 local_types = {}
+# The types which are not writable, which get a read only view too
+view_types = {}
+# The names of the types which are writable in any of the idl files
+writable_type_names = set()
 
 def list_types(lst):
     if isinstance(lst, str):
@@ -690,12 +694,17 @@ def add_to_types(cls, namespaces, parent_template_param ):
         if is_class(param) or is_enum(param):
             continue
 
-def sort_dependencies():
+def get_view_dependency(cls):
+    members = get_members(cls)
+    return {l for m in members for l in list_types(m["type"]) if l in view_types}
+
+def sort_dependencies(types = None, dependency = get_dependency):
+    types = local_types if types is None else types
     dep_tree = {}
     res = []
-    for k in local_types:
-        [cls, namespaces, parent_template_param] = local_types[k]
-        dep_tree[k] = get_dependency(cls)
+    for k in types:
+        [cls, namespaces, parent_template_param] = types[k]
+        dep_tree[k] = dependency(cls)
     while (len(dep_tree) > 0):
         found = set()
         found = found | { k for k in dep_tree if not dep_tree[k]}
@@ -726,6 +735,32 @@ def param_view_type(lst):
         return lst[0] + join_template_view(lst[1], ["unknown_variant_type"])
     return lst[0] + join_template_view(lst[1])
 
+def to_lazy_view(val):
+    if val in local_types or val in view_types:
+        return val + "_view"
+    return val
+
+# The views of the types which are not writable read their members lazily,
+# including the elements of vectors and optionals, other templates are
+# deserialized.
+def param_lazy_view_type(lst):
+    if isinstance(lst, str):
+        return to_lazy_view(lst)
+    if len(lst) == 1:
+        return to_lazy_view(lst[0])
+    if is_vector(lst) or is_optional(lst):
+        return lst[0] + "<" + param_lazy_view_type(lst[1][0]) + ">"
+    return param_type(lst)
+
+def member_view_type(m):
+    return param_view_type(m["type"])
+
+def member_lazy_view_type(m):
+    # The default of a member missing from an older version is an object
+    if "attribute" in m:
+        return param_type(m["type"])
+    return param_lazy_view_type(m["type"])
+
 read_sizes = set()
 
 def add_variant_read_size(hout, typ):
@@ -765,7 +800,7 @@ $type deserialize(Input& v, boost::type<${type}>) {
     }""").substitute({'ind' : index, 'type' : param_view_type(param), 'full_type' : t}))
     fprintln(hout, '    return ' + t + '(deserialize(v, boost::type<unknown_variant_type>()));\n  });\n}')
 
-def add_view(hout, info):
+def add_view(hout, info, view_type = member_view_type, type_name = None):
     [cls, namespaces, parent_template_param] = info
     members = get_members(cls)
     for m in members:
@@ -775,20 +810,20 @@ def add_view(hout, info):
     utils::input_stream v;
     """).substitute({'name' : cls["name"]}))
 
-    if not is_stub(cls["name"]) and is_local_type(cls["name"]):
+    if not is_stub(cls["name"]) and (type_name or is_local_type(cls["name"])):
         fprintln(hout, Template(reindent(4, """
             operator $type() const {
                auto in = v;
                return deserialize(in, boost::type<$type>());
             }
-        """)).substitute({'type' : cls["name"]}))
+        """)).substitute({'type' : type_name or cls["name"]}))
 
     skip = "" if is_final(cls) else "ser::skip(in, boost::type<size_type>());"
     local_names = {}
     for m in members:
         name = get_member_name(m["name"])
         local_names[name] = "this->" + name + "()"
-        full_type = param_view_type(m["type"])
+        full_type = view_type(m)
         if "attribute" in m:
             deflt = m["default"][0] if "default" in m else param_type(m["type"]) + "()"
             if deflt in local_names:
@@ -843,11 +878,14 @@ struct serializer<${type}_view> {
 def add_views(hout):
     for k in sort_dependencies():
         add_view(hout, local_types[k])
+    for k in sort_dependencies(view_types, get_view_dependency):
+        [cls, namespaces, parent_template_param] = view_types[k]
+        add_view(hout, view_types[k], member_lazy_view_type, combine_ns(namespaces + [cls["name"]]))
 
 def add_visitors(hout):
+    add_views(hout)
     if not local_types:
         return
-    add_views(hout)
     fprintln(hout, "\n////// State holders")
     for k in local_types:
         handle_visitors_state(local_types[k], hout)
@@ -951,10 +989,19 @@ def handle_objects(tree, hout, cout, namespaces=[]):
         else:
             print("unknown type ", obj, obj["type"])
 
+def add_to_view_types(cls, namespaces):
+    if "attribute" in cls or "stub" in cls or "template" in cls:
+        return
+    # A name which is writable elsewhere would get two different views
+    if cls["name"] in writable_type_names:
+        return
+    view_types[cls["name"]] = [cls, namespaces, []]
+
 def handle_types(tree, namespaces=[]):
     for obj in tree:
         if is_class(obj):
             add_to_types(obj, namespaces, [])
+            add_to_view_types(obj, namespaces)
         elif is_enum(obj):
             pass
         elif obj["type"] == "namespace":
@@ -962,6 +1009,13 @@ def handle_types(tree, namespaces=[]):
         else:
             print("unknown type ", obj, obj["type"])
 
+def load_writable_type_names(name):
+    global writable_type_names
+    pattern = re.compile(r'(?:class|struct)\s+(\w+)[^{;]*\[\[writable\]\]')
+    for f in glob.glob(os.path.join(os.path.dirname(name), '*' + EXTENSION)):
+        with open(f) as idl:
+            writable_type_names |= set(pattern.findall(idl.read()))
+
 def load_file(name):
     if config.o:
         cout = open(config.o.replace('.hh', '.impl.hh'), "w+")
@@ -980,6 +1034,7 @@ def load_file(name):
     fprintln(hout, "#include \"serializer.hh\"\n")
     if config.ns != '':
         fprintln(cout, "namespace ", config.ns, " {")
+    load_writable_type_names(name)
     data = parse_file(name)
     if data:
         handle_types(data)
@@ -4,6 +4,8 @@ class paging_state {
     partition_key get_partition_key();
     std::experimental::optional<clustering_key> get_clustering_key();
     uint32_t get_remaining();
+    uint32_t get_rows_fetched_for_last_partition() [[version 2.0]] = 0;
+    utils::UUID get_query_uuid() [[version 2.1]];
 };
 }
 }
@@ -30,6 +30,21 @@ class specific_ranges {
     std::vector<nonwrapping_range<clustering_key_prefix>> ranges();
 };
 
+enum class filter_op : uint8_t {
+    eq,
+    lt,
+    lte,
+    gt,
+    gte,
+    in,
+};
+
+class column_filter {
+    uint32_t id;
+    query::filter_op op;
+    std::vector<bytes> values;
+};
+
 class partition_slice {
     std::vector<nonwrapping_range<clustering_key_prefix>> default_row_ranges();
     std::vector<uint32_t> static_columns;
@@ -38,6 +53,7 @@ class partition_slice {
     std::unique_ptr<query::specific_ranges> get_specific_ranges();
     cql_serialization_format cql_format();
     uint32_t partition_row_limit() [[version 1.3]] = std::numeric_limits<uint32_t>::max();
+    std::vector<query::column_filter> filters() [[version 2.0]];
 };
 
 class read_command {
@@ -48,6 +64,14 @@ class read_command {
     std::chrono::time_point<gc_clock, gc_clock::duration> timestamp;
     std::experimental::optional<tracing::trace_info> trace_info [[version 1.3]];
     uint32_t partition_limit [[version 1.3]] = std::numeric_limits<uint32_t>::max();
+    std::experimental::optional<sstring> workload [[version 2.0]];
+    utils::UUID query_uuid [[version 2.1]];
+    bool is_first_page [[version 2.1]] = false;
+};
+
+class aggregate_selector {
+    sstring function_name;
+    std::experimental::optional<sstring> column_name;
 };
 
 }
@@ -40,9 +40,67 @@
  */
 
 #include "index/secondary_index_manager.hh"
+#include "cql3/statements/index_target.hh"
+#include "cql3/util.hh"
+#include "schema_builder.hh"
 
 namespace secondary_index {
 
+sstring index_table_name(const sstring& index_name) {
+    return index_name + "_index";
+}
+
+const column_definition* index_target_column(const schema& base, const index_metadata& im) {
+    if (im.kind() == index_metadata_kind::custom) {
+        return nullptr;
+    }
+    auto it = im.options().find(cql3::statements::index_target::target_option_name);
+    if (it == im.options().end()) {
+        return nullptr;
+    }
+    // Targets other than the values of a simple column, like values(c) or
+    // several columns, aren't plain quoted column names.
+    for (auto&& cdef : base.regular_columns()) {
+        if (cdef.is_atomic() && !cdef.type->is_counter() && it->second == cql3::util::maybe_quote(cdef.name_as_text())) {
+            return &cdef;
+        }
+    }
+    return nullptr;
+}
+
+stdx::optional<index_metadata> find_index_on(const schema& base, const column_definition& cdef) {
+    for (auto&& im : base.indices()) {
+        if (index_target_column(base, im) == &cdef) {
+            return im;
+        }
+    }
+    return stdx::nullopt;
+}
+
+bool is_index_table(const schema& base, const schema& view) {
+    for (auto&& im : base.indices()) {
+        if (view.cf_name() == index_table_name(im.name())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+view_ptr create_view_for_index(const schema& base, const index_metadata& im) {
+    auto target = index_target_column(base, im);
+    assert(target);
+    schema_builder builder{base.ks_name(), index_table_name(im.name())};
+    builder.with_column(target->name(), target->type, column_kind::partition_key);
+    for (auto&& cdef : base.partition_key_columns()) {
+        builder.with_column(cdef.name(), cdef.type, column_kind::clustering_key);
+    }
+    for (auto&& cdef : base.clustering_key_columns()) {
+        builder.with_column(cdef.name(), cdef.type, column_kind::clustering_key);
+    }
+    builder.with_view_info(base, false, sprint("%s IS NOT NULL", cql3::util::maybe_quote(target->name_as_text())));
+    return view_ptr(builder.build());
+}
+
 seastar::sharded<secondary_index_manager> _the_secondary_index_manager;
 
 std::set<index_metadata> secondary_index_manager::get_dependent_indices(const column_definition& cdef) const {
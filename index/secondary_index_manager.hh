@@ -42,11 +42,33 @@
 #pragma once
 
 #include "schema.hh"
+#include "stdx.hh"
 
 #include <seastar/core/sharded.hh>
 
 namespace secondary_index {
 
+// Each index on a single regular column is backed by a materialized view,
+// the index table, whose partition key is the indexed column and whose
+// clustering key is the primary key of the base table. So the base rows
+// with a given value are the rows of a single index partition.
+
+// The name of the table backing the index.
+sstring index_table_name(const sstring& index_name);
+
+// The column of the base table the index is on, or nullptr if the index
+// isn't backed by an index table.
+const column_definition* index_target_column(const schema& base, const index_metadata& im);
+
+// The index of the base table backed by an index table on cdef, if any.
+stdx::optional<index_metadata> find_index_on(const schema& base, const column_definition& cdef);
+
+// Whether view is the index table of one of the indexes of base.
+bool is_index_table(const schema& base, const schema& view);
+
+// The schema of the index table of im, which must have a target column.
+view_ptr create_view_for_index(const schema& base, const index_metadata& im);
+
 class secondary_index_manager : public seastar::async_sharded_service<secondary_index_manager> {
 public:
   std::set<index_metadata> get_dependent_indices(const column_definition& cdef) const;
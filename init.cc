@@ -53,7 +53,8 @@ void init_ms_fd_gossiper(sstring listen_address_in
                 , db::seed_provider_type seed_provider
                 , sstring cluster_name
                 , double phi
-                , bool sltba)
+                , bool sltba
+                , bool phi_variance_aware)
 {
     const auto listen = gms::inet_address::lookup(listen_address_in).get0();
 
@@ -107,7 +108,7 @@ void init_ms_fd_gossiper(sstring listen_address_in
     // #293 - do not stop anything
     //engine().at_exit([] { return netw::get_messaging_service().stop(); });
     // Init failure_detector
-    gms::get_failure_detector().start(std::move(phi)).get();
+    gms::get_failure_detector().start(phi, phi_variance_aware).get();
     // #293 - do not stop anything
     //engine().at_exit([]{ return gms::get_failure_detector().stop(); });
     // Init gossiper
@@ -45,4 +45,5 @@ void init_ms_fd_gossiper(sstring listen_address
                 , db::seed_provider_type seed_provider
                 , sstring cluster_name = "Test Cluster"
                 , double phi = 8
-                , bool sltba = false);
+                , bool sltba = false
+                , bool phi_variance_aware = false);
@@ -464,19 +464,11 @@ class prefixable_full_compound : public compound_wrapper<TopLevel, TopLevelView>
         { }
 
         bool operator()(const TopLevel& k1, const PrefixTopLevel& k2) const {
-            return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
-                full_type->begin(k1), full_type->end(k1),
-                prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+            return prefix_type->compare(k1.representation(), k2.representation()) < 0;
         }
 
         bool operator()(const PrefixTopLevel& k1, const TopLevel& k2) const {
-            return lexicographical_tri_compare(
-                prefix_type->types().begin(), prefix_type->types().end(),
-                prefix_type->begin(k1), prefix_type->end(k1),
-                full_type->begin(k2), full_type->end(k2),
-                tri_compare) < 0;
+            return prefix_type->compare(k1.representation(), k2.representation()) < 0;
         }
     };
 
@@ -494,17 +486,11 @@ class prefixable_full_compound : public compound_wrapper<TopLevel, TopLevelView>
         { }
 
         bool operator()(const TopLevel& k1, const PrefixTopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
-                full_type->begin(k1), full_type->end(k1),
-                prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+            return prefix_type->prefix_equality_compare(k1.representation(), k2.representation()) < 0;
         }
 
         bool operator()(const PrefixTopLevel& k1, const TopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
-                prefix_type->begin(k1), prefix_type->end(k1),
-                full_type->begin(k2), full_type->end(k2),
-                tri_compare) < 0;
+            return prefix_type->prefix_equality_compare(k1.representation(), k2.representation()) < 0;
         }
     };
 
@@ -576,10 +562,7 @@ class prefix_compound_wrapper : public compound_wrapper<TopLevel, TopLevelView>
         { }
 
         bool operator()(const TopLevel& k1, const TopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
-                prefix_type->begin(k1), prefix_type->end(k1),
-                prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare) < 0;
+            return prefix_type->prefix_equality_compare(k1.representation(), k2.representation()) < 0;
         }
     };
 
@@ -592,10 +575,7 @@ class prefix_compound_wrapper : public compound_wrapper<TopLevel, TopLevelView>
         { }
 
         int operator()(const TopLevel& k1, const TopLevel& k2) const {
-            return prefix_equality_tri_compare(prefix_type->types().begin(),
-                prefix_type->begin(k1), prefix_type->end(k1),
-                prefix_type->begin(k2), prefix_type->end(k2),
-                tri_compare);
+            return prefix_type->prefix_equality_compare(k1.representation(), k2.representation());
         }
     };
 };
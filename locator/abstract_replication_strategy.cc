@@ -74,19 +74,24 @@ void abstract_replication_strategy::validate_replication_strategy(const sstring&
 }
 
 std::vector<inet_address> abstract_replication_strategy::get_natural_endpoints(const token& search_token) {
-    const token& key_token = _token_metadata.first_token(search_token);
-    auto& cached_endpoints = get_cached_endpoints();
-    auto res = cached_endpoints.find(key_token);
+    maybe_invalidate_cached_endpoints();
+    auto idx = _token_metadata.first_token_index(search_token);
+    auto& id = _token_replica_sets[idx];
 
-    if (res == cached_endpoints.end()) {
+    if (id == no_replica_set) {
         auto endpoints = calculate_natural_endpoints(search_token, _token_metadata);
-        cached_endpoints.emplace(key_token, endpoints);
+        auto it = _replica_set_ids.find(endpoints);
+        if (it == _replica_set_ids.end()) {
+            it = _replica_set_ids.emplace(endpoints, _replica_sets.size()).first;
+            _replica_sets.push_back(endpoints);
+        }
+        id = it->second;
 
         return std::move(endpoints);
     }
 
     ++_cache_hits_count;
-    return res->second;
+    return _replica_sets[id];
 }
 
 void abstract_replication_strategy::validate_replication_factor(sstring rf) const
@@ -102,14 +107,14 @@ void abstract_replication_strategy::validate_replication_factor(sstring rf) cons
     }
 }
 
-inline std::unordered_map<token, std::vector<inet_address>>&
-abstract_replication_strategy::get_cached_endpoints() {
-    if (_last_invalidated_ring_version != _token_metadata.get_ring_version()) {
-        _cached_endpoints.clear();
+inline void abstract_replication_strategy::maybe_invalidate_cached_endpoints() {
+    if (_last_invalidated_ring_version != _token_metadata.get_ring_version()
+            || _token_replica_sets.size() != _token_metadata.sorted_tokens().size()) {
+        _token_replica_sets.assign(_token_metadata.sorted_tokens().size(), no_replica_set);
+        _replica_sets.clear();
+        _replica_set_ids.clear();
         _last_invalidated_ring_version = _token_metadata.get_ring_version();
     }
-
-    return _cached_endpoints;
 }
 
 static
@@ -24,6 +24,8 @@
 #include <memory>
 #include <functional>
 #include <unordered_map>
+#include <map>
+#include <limits>
 #include "gms/inet_address.hh"
 #include "dht/i_partitioner.hh"
 #include "token_metadata.hh"
@@ -47,13 +49,20 @@ enum class replication_strategy_type {
 class abstract_replication_strategy {
 private:
     long _last_invalidated_ring_version = 0;
-    std::unordered_map<token, std::vector<inet_address>> _cached_endpoints;
+    // The natural endpoints of each token of the ring, computed on first use,
+    // indexed like token_metadata::sorted_tokens(). Each entry refers to an
+    // element of _replica_sets, which holds each distinct set of endpoints
+    // once, since with vnodes many tokens share the same replicas.
+    static constexpr uint32_t no_replica_set = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> _token_replica_sets;
+    std::vector<std::vector<inet_address>> _replica_sets;
+    std::map<std::vector<inet_address>, uint32_t> _replica_set_ids;
     uint64_t _cache_hits_count = 0;
 
     static logging::logger logger;
 
-    std::unordered_map<token, std::vector<inet_address>>&
-    get_cached_endpoints();
+    // Resets the cached endpoints if the ring changed since they were computed.
+    void maybe_invalidate_cached_endpoints();
 protected:
     sstring _ks_name;
     // TODO: Do we need this member at all?
@@ -100,6 +109,7 @@ class abstract_replication_strategy {
     virtual size_t get_replication_factor() const = 0;
     uint64_t get_cache_hits_count() const { return _cache_hits_count; }
     replication_strategy_type get_type() const { return _my_type; }
+    const std::map<sstring, sstring>& get_config_options() const { return _config_options; }
 
     // get_ranges() returns the list of ranges held by the given endpoint.
     // The list is sorted, and its elements are non overlapping and non wrap-around.
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/range/algorithm/stable_sort.hpp>
+
+#include "locator/dynamic_snitch.hh"
+
+namespace locator {
+
+dynamic_snitch::dynamic_snitch(double badness_threshold, clock_type::duration reset_interval)
+    : _badness_threshold(badness_threshold)
+    , _reset_interval(reset_interval)
+    , _last_reset(clock_type::now())
+{ }
+
+void dynamic_snitch::maybe_reset() {
+    auto now = clock_type::now();
+    if (now - _last_reset >= _reset_interval) {
+        _scores.clear();
+        _last_reset = now;
+    }
+}
+
+void dynamic_snitch::add_latency(gms::inet_address ep, std::chrono::microseconds latency) {
+    maybe_reset();
+    auto r = _scores.emplace(ep, latency.count());
+    if (!r.second) {
+        r.first->second = alpha * latency.count() + (1 - alpha) * r.first->second;
+    }
+}
+
+std::experimental::optional<double> dynamic_snitch::get_score(gms::inet_address ep) const {
+    auto it = _scores.find(ep);
+    if (it == _scores.end()) {
+        return std::experimental::nullopt;
+    }
+    return it->second;
+}
+
+void dynamic_snitch::sort_by_score(std::vector<gms::inet_address>& eps) {
+    maybe_reset();
+    if (eps.size() < 2) {
+        return;
+    }
+    std::vector<double> scores;
+    scores.reserve(eps.size());
+    for (auto& ep : eps) {
+        auto it = _scores.find(ep);
+        if (it == _scores.end()) {
+            return;
+        }
+        scores.push_back(it->second);
+    }
+    auto sorted_scores = scores;
+    boost::sort(sorted_scores);
+    for (size_t i = 0; i < scores.size(); ++i) {
+        if (scores[i] > sorted_scores[i] * (1 + _badness_threshold)) {
+            // Endpoints with equal scores stay in proximity order.
+            boost::stable_sort(eps, [this] (gms::inet_address a, gms::inet_address b) {
+                return _scores.at(a) < _scores.at(b);
+            });
+            return;
+        }
+    }
+}
+
+}
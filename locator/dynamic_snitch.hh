@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+#include <experimental/optional>
+#include <seastar/core/lowres_clock.hh>
+#include "gms/inet_address.hh"
+#include "seastarx.hh"
+
+namespace locator {
+
+// Ranks replicas by the latency of their recent responses, on top of the
+// proximity order of the snitch, so that reads move away from a replica
+// which became slow, e.g. because of a bad disk or a compaction backlog.
+//
+// This is the analogue of Origin's DynamicEndpointSnitch, except that it
+// doesn't wrap the configured snitch: each shard has its own, fed with the
+// latencies observed by the reads it coordinates, and it reorders endpoints
+// which were already sorted by proximity.
+class dynamic_snitch {
+public:
+    using clock_type = seastar::lowres_clock;
+private:
+    // The weight of a new latency in the score of an endpoint.
+    static constexpr double alpha = 0.25;
+
+    double _badness_threshold;
+    clock_type::duration _reset_interval;
+    clock_type::time_point _last_reset;
+    // Exponentially weighted moving averages of the latencies, in
+    // microseconds.
+    std::unordered_map<gms::inet_address, double> _scores;
+private:
+    void maybe_reset();
+public:
+    // The proximity order is kept unless an endpoint is slower than the one
+    // which would replace it by more than badness_threshold, as a fraction.
+    // Scores are forgotten every reset_interval, so that an endpoint which
+    // recovered gets requests again.
+    dynamic_snitch(double badness_threshold, clock_type::duration reset_interval);
+
+    void add_latency(gms::inet_address ep, std::chrono::microseconds latency);
+
+    // Reorders eps, sorted by proximity, by score if the proximity order is
+    // bad enough. Endpoints are only reordered once all have a score.
+    void sort_by_score(std::vector<gms::inet_address>& eps);
+
+    // Disengaged if the endpoint has no score.
+    std::experimental::optional<double> get_score(gms::inet_address ep) const;
+};
+
+}
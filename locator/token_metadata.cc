@@ -138,6 +138,7 @@ void token_metadata::update_normal_tokens(std::unordered_map<inet_address, std::
     if (should_sort_tokens) {
         _sorted_tokens = sort_tokens();
     }
+    invalidate_cached_rings();
 }
 
 size_t token_metadata::first_token_index(const token& start) const {
@@ -289,6 +290,7 @@ void token_metadata::add_bootstrap_tokens(std::unordered_set<token> tokens, inet
     for (auto t : tokens) {
         _bootstrap_tokens[t] = endpoint;
     }
+    invalidate_pending_ranges_cache();
 }
 
 void token_metadata::remove_bootstrap_tokens(std::unordered_set<token> tokens) {
@@ -296,6 +298,7 @@ void token_metadata::remove_bootstrap_tokens(std::unordered_set<token> tokens) {
     for (auto t : tokens) {
         _bootstrap_tokens.erase(t);
     }
+    invalidate_pending_ranges_cache();
 }
 
 bool token_metadata::is_leaving(inet_address endpoint) {
@@ -444,14 +447,35 @@ token_metadata::get_pending_ranges(sstring keyspace_name, inet_address endpoint)
 }
 
 void token_metadata::calculate_pending_ranges(abstract_replication_strategy& strategy, const sstring& keyspace_name) {
-    std::unordered_multimap<range<token>, inet_address> new_pending_ranges;
-
     if (_bootstrap_tokens.empty() && _leaving_endpoints.empty() && _moving_endpoints.empty()) {
         tlogger.debug("No bootstrapping, leaving or moving nodes -> empty pending ranges for {}", keyspace_name);
-        set_pending_ranges(keyspace_name, std::move(new_pending_ranges));
+        set_pending_ranges(keyspace_name, {});
         return;
     }
 
+    // The pending ranges only depend on the ring and on the strategy, so
+    // keyspaces with the same strategy and options have the same ones.
+    auto key = sprint("%d", static_cast<int>(strategy.get_type()));
+    for (auto& opt : strategy.get_config_options()) {
+        key += sprint(" %s=%s", opt.first, opt.second);
+    }
+    auto it = _pending_ranges_cache.find(key);
+    if (it == _pending_ranges_cache.end()) {
+        it = _pending_ranges_cache.emplace(std::move(key), compute_pending_ranges(strategy)).first;
+    } else {
+        tlogger.debug("Reusing the pending ranges of replication strategy {} for {}", it->first, keyspace_name);
+    }
+    set_pending_ranges(keyspace_name, it->second);
+
+    if (tlogger.is_enabled(logging::log_level::debug)) {
+        tlogger.debug("Pending ranges: {}", (_pending_ranges.empty() ? "<empty>" : print_pending_ranges()));
+    }
+}
+
+std::unordered_multimap<range<token>, inet_address>
+token_metadata::compute_pending_ranges(abstract_replication_strategy& strategy) {
+    std::unordered_multimap<range<token>, inet_address> new_pending_ranges;
+
     std::unordered_multimap<inet_address, dht::token_range> address_ranges = strategy.get_address_ranges(*this);
 
     // FIMXE
@@ -533,11 +557,7 @@ void token_metadata::calculate_pending_ranges(abstract_replication_strategy& str
         all_left_metadata.remove_endpoint(endpoint);
     }
 
-    set_pending_ranges(keyspace_name, std::move(new_pending_ranges));
-
-    if (tlogger.is_enabled(logging::log_level::debug)) {
-        tlogger.debug("Pending ranges: {}", (_pending_ranges.empty() ? "<empty>" : print_pending_ranges()));
-    }
+    return new_pending_ranges;
 }
 sstring token_metadata::print_pending_ranges() {
     std::stringstream ss;
@@ -556,6 +576,7 @@ sstring token_metadata::print_pending_ranges() {
 
 void token_metadata::add_leaving_endpoint(inet_address endpoint) {
      _leaving_endpoints.emplace(endpoint);
+    invalidate_pending_ranges_cache();
 }
 
 token_metadata token_metadata::clone_after_all_settled() {
@@ -575,6 +596,7 @@ token_metadata token_metadata::clone_after_all_settled() {
 
 void token_metadata::add_moving_endpoint(token t, inet_address endpoint) {
     _moving_endpoints[t] = endpoint;
+    invalidate_pending_ranges_cache();
 }
 
 std::vector<gms::inet_address> token_metadata::pending_endpoints_for(const token& token, const sstring& keyspace_name) {
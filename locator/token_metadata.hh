@@ -148,6 +148,11 @@ class token_metadata final {
     std::unordered_map<sstring, std::unordered_multimap<range<token>, inet_address>> _pending_ranges;
     std::unordered_map<sstring, std::unordered_map<range<token>, std::unordered_set<inet_address>>> _pending_ranges_map;
     std::unordered_map<sstring, boost::icl::interval_map<token, std::unordered_set<inet_address>>> _pending_ranges_interval_map;
+    // The pending ranges computed by calculate_pending_ranges(), by replication
+    // strategy configuration, so that keyspaces replicated the same way share
+    // them. Cleared whenever the ring, the topology, or the set of bootstrapping,
+    // leaving or moving endpoints changes.
+    std::unordered_map<sstring, std::unordered_multimap<range<token>, inet_address>> _pending_ranges_cache;
 
     std::vector<token> _sorted_tokens;
 
@@ -251,6 +256,7 @@ class token_metadata final {
 
     void update_topology(inet_address ep) {
         _topology.update_endpoint(ep);
+        invalidate_pending_ranges_cache();
     }
 
     tokens_iterator tokens_end() const {
@@ -618,6 +624,10 @@ class token_metadata final {
 private:
     std::unordered_multimap<range<token>, inet_address>& get_pending_ranges_mm(sstring keyspace_name);
     void set_pending_ranges(const sstring& keyspace_name, std::unordered_multimap<range<token>, inet_address> new_pending_ranges);
+    std::unordered_multimap<range<token>, inet_address> compute_pending_ranges(abstract_replication_strategy& strategy);
+    void invalidate_pending_ranges_cache() {
+        _pending_ranges_cache.clear();
+    }
 
 public:
     /** a mutable map may be returned but caller should not modify it */
@@ -644,8 +654,9 @@ class token_metadata final {
      * node could have. It might be that other bootstraps make our actual final ranges smaller,
      * but it does not matter as we can clean up the data afterwards.
      *
-     * NOTE: This is heavy and ineffective operation. This will be done only once when a node
-     * changes state in the cluster, so it should be manageable.
+     * NOTE: This is heavy and ineffective operation. The result is cached by replication strategy
+     * configuration, so it is only done once for all keyspaces replicated the same way, and only
+     * again once the ring or the pending operations change.
      */
     void calculate_pending_ranges(abstract_replication_strategy& strategy, const sstring& keyspace_name);
 public:
@@ -1023,6 +1034,7 @@ class token_metadata final {
 
     void invalidate_cached_rings() {
         ++_ring_version;
+        invalidate_pending_ranges_cache();
         //cachedTokenMap.set(null);
     }
 };
@@ -39,6 +39,7 @@
 #include "db/commitlog/commitlog_replayer.hh"
 #include "utils/runtime.hh"
 #include "utils/file_lock.hh"
+#include "utils/stall_detector.hh"
 #include "log.hh"
 #include "debug.hh"
 #include "init.hh"
@@ -54,6 +55,10 @@
 #include "message/messaging_service.hh"
 #include <seastar/net/dns.hh>
 #include "service/cache_hitrate_calculator.hh"
+#include "service/cache_warmup.hh"
+#include "db/view/view_builder.hh"
+#include "service/priority_manager.hh"
+#include <boost/lexical_cast.hpp>
 
 thread_local disk_error_signal_type commit_error;
 thread_local disk_error_signal_type general_disk_error;
@@ -292,6 +297,9 @@ int main(int ac, char** av) {
 
     distributed<database> db;
     seastar::sharded<service::cache_hitrate_calculator> cf_cache_hitrate_calculator;
+    seastar::sharded<service::cache_warmup> cache_warmup;
+    seastar::sharded<db::view::view_builder> view_builder;
+    seastar::sharded<utils::stall_detector> stall_detector;
     debug::db = &db;
     auto& qp = cql3::get_query_processor();
     auto& proxy = service::get_storage_proxy();
@@ -334,7 +342,7 @@ int main(int ac, char** av) {
 
         tcp_syncookies_sanity();
 
-        return seastar::async([cfg, &db, &qp, &proxy, &mm, &ctx, &opts, &dirs, &pctx, &prometheus_server, &return_value, &cf_cache_hitrate_calculator] {
+        return seastar::async([cfg, &db, &qp, &proxy, &mm, &ctx, &opts, &dirs, &pctx, &prometheus_server, &return_value, &cf_cache_hitrate_calculator, &cache_warmup, &view_builder, &stall_detector] {
             read_config(opts, *cfg).get();
             apply_logger_settings(cfg->default_log_level(), cfg->logger_log_level(),
                     cfg->log_to_stdout(), cfg->log_to_syslog());
@@ -422,6 +430,9 @@ int main(int ac, char** av) {
             if (opts.count("developer-mode")) {
                 smp::invoke_on_all([] { engine().set_strict_dma(false); }).get();
             }
+            supervisor::notify("starting stall detector");
+            stall_detector.start(std::chrono::milliseconds(cfg->reactor_stall_threshold_ms())).get();
+            engine().at_exit([&stall_detector] { return stall_detector.stop(); });
             supervisor::notify("creating tracing");
             tracing::tracing::create_tracing("trace_keyspace_helper").get();
             supervisor::notify("creating snitch");
@@ -436,6 +447,17 @@ int main(int ac, char** av) {
             api::set_server_init(ctx).get();
             ctx.http_server.listen(ipv4_addr{ip, api_port}).get();
             startlog.info("Scylla API server listening on {}:{} ...", api_address, api_port);
+            supervisor::notify("creating workload priority classes");
+            smp::invoke_on_all([workloads = cfg->workload_io_shares(),
+                    compaction_bandwidth = uint64_t(cfg->compaction_throughput_mb_per_sec()) * 1024 * 1024 / smp::count,
+                    streaming_bandwidth = uint64_t(cfg->streaming_io_throughput_mb_per_sec()) * 1024 * 1024 / smp::count] {
+                auto& pm = service::get_local_priority_manager();
+                for (auto&& w : workloads) {
+                    pm.add_workload(w.first, boost::lexical_cast<uint32_t>(w.second));
+                }
+                pm.compaction_bandwidth_limiter().set_rate(compaction_bandwidth);
+                pm.streaming_bandwidth_limiter().set_rate(streaming_bandwidth);
+            }).get();
             supervisor::notify("initializing storage service");
             init_storage_service(db);
             supervisor::notify("starting per-shard database core");
@@ -460,13 +482,24 @@ int main(int ac, char** av) {
             verify_seastar_io_scheduler(opts.count("max-io-requests"), db.local().get_config().developer_mode()).get();
             supervisor::notify("creating data directories");
             dirs.touch_and_lock(db.local().get_config().data_file_directories()).get();
+            if (!db.local().get_config().cold_data_file_directory().empty()) {
+                supervisor::notify("creating cold data directory");
+                dirs.touch_and_lock(db.local().get_config().cold_data_file_directory()).get();
+            }
             supervisor::notify("creating commitlog directory");
             dirs.touch_and_lock(db.local().get_config().commitlog_directory()).get();
+            if (db.local().get_config().hinted_handoff_enabled()) {
+                supervisor::notify("creating hints directory");
+                dirs.touch_and_lock(db.local().get_config().hints_directory()).get();
+            }
             supervisor::notify("verifying data and commitlog directories");
             std::unordered_set<sstring> directories;
             directories.insert(db.local().get_config().data_file_directories().cbegin(),
                     db.local().get_config().data_file_directories().cend());
             directories.insert(db.local().get_config().commitlog_directory());
+            if (!db.local().get_config().cold_data_file_directory().empty()) {
+                directories.insert(db.local().get_config().cold_data_file_directory());
+            }
             parallel_for_each(directories, [&db] (sstring pathname) {
                 return disk_sanity(pathname, db.local().get_config().developer_mode());
             }).get();
@@ -509,7 +542,8 @@ int main(int ac, char** av) {
                     , seed_provider
                     , cluster_name
                     , phi
-                    , cfg->listen_on_broadcast_address());
+                    , cfg->listen_on_broadcast_address()
+                    , cfg->phi_convict_variance_aware());
             supervisor::notify("starting messaging service");
             supervisor::notify("starting storage proxy");
             proxy.start(std::ref(db)).get();
@@ -560,6 +594,7 @@ int main(int ac, char** av) {
                     }).get();
                     supervisor::notify("replaying commit log - removing old commitlog segments");
                     for (auto& path : paths) {
+                        ::unlink(db::commitlog::segment_index_file_name(path).c_str());
                         ::unlink(path.c_str());
                     }
                 }
@@ -594,10 +629,14 @@ int main(int ac, char** av) {
             proxy.invoke_on_all([] (service::storage_proxy& p) {
                 p.init_messaging_service();
             }).get();
+            supervisor::notify("starting hints manager");
+            proxy.invoke_on_all([] (service::storage_proxy& p) {
+                return p.start_hints_manager();
+            }).get();
             supervisor::notify("starting streaming service");
             streaming::stream_session::init_streaming_service(db).get();
             api::set_server_stream_manager(ctx).get();
-            // Start handling REPAIR_CHECKSUM_RANGE messages
+            // Start handling REPAIR_CHECKSUM_RANGE and row-level repair messages
             netw::get_messaging_service().invoke_on_all([&db] (auto& ms) {
                 ms.register_repair_checksum_range([&db] (sstring keyspace, sstring cf, dht::token_range range, rpc::optional<repair_checksum> hash_version) {
                     auto hv = hash_version ? *hash_version : repair_checksum::legacy;
@@ -606,6 +645,32 @@ int main(int ac, char** av) {
                         return checksum_range(db, keyspace, cf, range, hv);
                     });
                 });
+                ms.register_repair_checksum_ranges([&db] (sstring keyspace, sstring cf, dht::token_range_vector ranges, repair_checksum hash_version) {
+                    return do_with(std::move(keyspace), std::move(cf), std::move(ranges),
+                            [&db, hash_version] (auto& keyspace, auto& cf, auto& ranges) {
+                        return checksum_ranges(db, keyspace, cf, ranges, hash_version);
+                    });
+                });
+                ms.register_repair_row_hashes([&db] (sstring keyspace, sstring cf, dht::token_range range) {
+                    return do_with(std::move(keyspace), std::move(cf), std::move(range),
+                            [&db] (auto& keyspace, auto& cf, auto& range) {
+                        return repair_row_hashes(db, keyspace, cf, range);
+                    });
+                });
+                ms.register_repair_get_rows([&db] (sstring keyspace, sstring cf, dht::token_range range, std::vector<uint64_t> hashes) {
+                    return do_with(std::move(keyspace), std::move(cf), std::move(range),
+                            [&db, hashes = std::move(hashes)] (auto& keyspace, auto& cf, auto& range) mutable {
+                        return repair_get_rows(db, keyspace, cf, range, std::move(hashes));
+                    });
+                });
+                ms.register_repair_put_rows([&db] (const rpc::client_info& cinfo, utils::UUID plan_id, sstring keyspace, sstring cf,
+                        dht::token_range range, std::vector<frozen_mutation> rows) {
+                    auto from = netw::messaging_service::get_source(cinfo).addr;
+                    return do_with(std::move(keyspace), std::move(cf), std::move(range),
+                            [&db, from, plan_id, rows = std::move(rows)] (auto& keyspace, auto& cf, auto& range) mutable {
+                        return repair_put_rows(db, from, plan_id, keyspace, cf, range, std::move(rows));
+                    });
+                });
             }).get();
             supervisor::notify("starting storage service", true);
             auto& ss = service::get_local_storage_service();
@@ -626,6 +691,18 @@ int main(int ac, char** av) {
             cf_cache_hitrate_calculator.start(std::ref(db), std::ref(cf_cache_hitrate_calculator)).get();
             engine().at_exit([&cf_cache_hitrate_calculator] { return cf_cache_hitrate_calculator.stop(); });
             cf_cache_hitrate_calculator.local().run_on(engine().cpu_id());
+            supervisor::notify("starting cache warm-up");
+            cache_warmup.start(std::ref(db)).get();
+            engine().at_exit([&cache_warmup] { return cache_warmup.stop(); });
+            cache_warmup.invoke_on_all([] (service::cache_warmup& cw) {
+                cw.start();
+            }).get();
+            supervisor::notify("starting view builder");
+            view_builder.start(std::ref(db), std::ref(view_builder)).get();
+            engine().at_exit([&view_builder] { return view_builder.stop(); });
+            view_builder.invoke_on_all([] (db::view::view_builder& vb) {
+                return vb.start();
+            }).get();
             supervisor::notify("starting native transport");
             gms::get_local_gossiper().wait_for_gossip_to_settle();
             api::set_server_gossip_settle(ctx).get();
@@ -644,6 +721,22 @@ int main(int ac, char** av) {
             smp::invoke_on_all([&cfg] () {
                 return logalloc::shard_tracker().set_reclamation_step(cfg->lsa_reclamation_step());
             }).get();
+            if (cfg->lsa_background_reclaim_free_memory_percent()) {
+                smp::invoke_on_all([&cfg] () {
+                    auto target = memory::stats().total_memory() * cfg->lsa_background_reclaim_free_memory_percent() / 100;
+                    logalloc::shard_tracker().start_background_reclaim(target, cfg->lsa_background_reclaim_cpu_percent() / 100);
+                }).get();
+                engine().at_exit([] {
+                    return smp::invoke_on_all([] {
+                        logalloc::shard_tracker().stop_background_reclaim();
+                    });
+                });
+            }
+            if (cfg->lsa_cache_segment_eviction()) {
+                smp::invoke_on_all([] {
+                    global_cache_tracker().enable_segment_eviction();
+                }).get();
+            }
             if (cfg->abort_on_lsa_bad_alloc()) {
                 smp::invoke_on_all([&cfg]() {
                     return logalloc::shard_tracker().enable_abort_on_bad_alloc();
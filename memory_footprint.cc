@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <ostream>
+
+#include "memory_footprint.hh"
+#include "mutation_partition.hh"
+#include "partition_version.hh"
+
+uint64_t memory_footprint::bytes_per_row() const {
+    auto n = std::max(rows, partitions);
+    return n ? total() / n : 0;
+}
+
+uint64_t memory_footprint::bytes_per_cell() const {
+    return cells ? total() / cells : 0;
+}
+
+void memory_footprint::add(const partition_version& v) {
+    objects += sizeof(partition_version);
+    add(v.partition());
+}
+
+void memory_footprint::add(const mutation_partition& mp) {
+    add(mp.static_row());
+    for (const rows_entry& e : mp.clustered_rows()) {
+        ++rows;
+        objects += sizeof(rows_entry);
+        keys += e.key().external_memory_usage();
+        add(e.row().cells());
+    }
+    for (const range_tombstone& rt : mp.row_tombstones()) {
+        objects += sizeof(range_tombstone);
+        keys += rt.external_memory_usage();
+    }
+}
+
+void memory_footprint::add(const row& r) {
+    uint64_t row_values = 0;
+    r.for_each_cell([&] (column_id, const atomic_cell_or_collection& c) {
+        row_values += c.external_memory_usage();
+    });
+    cells += r.size();
+    values += row_values;
+    objects += r.external_memory_usage() - row_values;
+}
+
+void memory_footprint::set_fragmentation(uint64_t total_space) {
+    fragmentation = 0;
+    auto used = total();
+    fragmentation = total_space > used ? total_space - used : 0;
+}
+
+memory_footprint& memory_footprint::operator+=(const memory_footprint& o) {
+    partitions += o.partitions;
+    rows += o.rows;
+    cells += o.cells;
+    objects += o.objects;
+    keys += o.keys;
+    tree_nodes += o.tree_nodes;
+    values += o.values;
+    fragmentation += o.fragmentation;
+    return *this;
+}
+
+std::ostream& operator<<(std::ostream& out, const memory_footprint& f) {
+    return out << "{partitions=" << f.partitions << ", rows=" << f.rows << ", cells=" << f.cells
+               << ", objects=" << f.objects << ", keys=" << f.keys << ", tree_nodes=" << f.tree_nodes
+               << ", values=" << f.values << ", fragmentation=" << f.fragmentation
+               << ", total=" << f.total() << ", bytes_per_row=" << f.bytes_per_row()
+               << ", bytes_per_cell=" << f.bytes_per_cell() << "}";
+}
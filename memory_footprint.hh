@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+class mutation_partition;
+class partition_version;
+class row;
+
+// Breakdown of the memory used by the data of a table in one of the
+// containers holding it in memory. Used for telling how much memory a data
+// set will need, and where it goes.
+struct memory_footprint {
+    uint64_t partitions = 0;
+    uint64_t rows = 0;
+    uint64_t cells = 0;
+
+    // Partition and row entries, versions, tombstones and the storage of
+    // cells within rows, including the hooks linking them.
+    uint64_t objects = 0;
+    // Copies of partition and clustering keys.
+    uint64_t keys = 0;
+    // Nodes of the trees indexing the objects.
+    uint64_t tree_nodes = 0;
+    // Values of cells which are not stored inline.
+    uint64_t values = 0;
+    // The rest of the memory backing the container: space left free between
+    // objects, and the allocator's own overhead. For containers sharing
+    // their memory with other tables, this is the table's share of it.
+    uint64_t fragmentation = 0;
+
+    uint64_t total() const {
+        return objects + keys + tree_nodes + values + fragmentation;
+    }
+    // Of all categories. Partitions with no clustering rows count as
+    // having one.
+    uint64_t bytes_per_row() const;
+    uint64_t bytes_per_cell() const;
+
+    void add(const partition_version&);
+    void add(const mutation_partition&);
+    void add(const row&);
+
+    // Sets fragmentation to the memory not accounted for in the other
+    // categories out of the given amount.
+    void set_fragmentation(uint64_t total_space);
+
+    memory_footprint& operator+=(const memory_footprint&);
+};
+
+std::ostream& operator<<(std::ostream&, const memory_footprint&);
+
+struct table_memory_footprint {
+    memory_footprint memtable;
+    memory_footprint row_cache;
+    memory_footprint index_cache;
+
+    table_memory_footprint& operator+=(const table_memory_footprint& o) {
+        memtable += o.memtable;
+        row_cache += o.row_cache;
+        index_cache += o.index_cache;
+        return *this;
+    }
+};
@@ -31,6 +31,7 @@ memtable::memtable(schema_ptr schema, dirty_memory_manager& dmm, memtable_list*
         , _dirty_mgr(dmm)
         , _memtable_list(memtable_list)
         , _schema(std::move(schema))
+        , _version_merger(*this)
         , partitions(memtable_entry::compare(_schema)) {
 }
 
@@ -54,6 +55,7 @@ void memtable::clear() noexcept {
     with_allocator(allocator(), [this] {
         partitions.clear_and_dispose(current_deleter<memtable_entry>());
     });
+    _token_filter.clear();
     remove_flushed_memory(dirty_before - dirty_size());
 }
 
@@ -66,6 +68,7 @@ future<> memtable::clear_gently() noexcept {
             auto& alloc = allocator();
 
             auto p = std::move(partitions);
+            _token_filter.clear();
             while (!p.empty()) {
                 auto batch_size = std::min<size_t>(p.size(), 32);
                 auto dirty_before = dirty_size();
@@ -114,9 +117,11 @@ memtable::find_or_create_partition(const dht::decorated_key& key) {
     // call lower_bound so we have a hint for the insert, just in case.
     auto i = partitions.lower_bound(key, memtable_entry::compare(_schema));
     if (i == partitions.end() || !key.equal(*_schema, i->key())) {
+        reserve_token_filter();
         memtable_entry* entry = current_allocator().construct<memtable_entry>(
             _schema, dht::decorated_key(key), mutation_partition(_schema));
         i = partitions.insert(i, *entry);
+        _token_filter.add(dht::token_prefix(key.token()));
         return entry->partition();
     } else {
         upgrade_entry(*i);
@@ -124,10 +129,26 @@ memtable::find_or_create_partition(const dht::decorated_key& key) {
     return i->partition();
 }
 
+// Doubles the filter when it's full, so that its size stays proportional to
+// the number of partitions and refilling it is amortized over the inserts.
+void memtable::reserve_token_filter() {
+    if (partitions.size() < _token_filter.capacity()) {
+        return;
+    }
+    utils::token_filter filter(_token_filter.capacity() * 2);
+    for (const memtable_entry& e : partitions) {
+        filter.add(dht::token_prefix(e.key().token()));
+    }
+    _token_filter = std::move(filter);
+}
+
 boost::iterator_range<memtable::partitions_type::const_iterator>
 memtable::slice(const dht::partition_range& range) const {
     if (query::is_single_partition(range)) {
         const query::ring_position& pos = range.start()->value();
+        if (!may_contain(pos)) {
+            return boost::make_iterator_range(partitions.end(), partitions.end());
+        }
         auto i = partitions.find(pos, memtable_entry::compare(_schema));
         if (i != partitions.end()) {
             return boost::make_iterator_range(i, std::next(i));
@@ -224,6 +245,10 @@ class iterator_reader: public mutation_reader::impl {
         return _memtable->_read_section;
     }
 
+    partition_version_merger& version_merger() {
+        return _memtable->_version_merger;
+    }
+
     lw_shared_ptr<memtable> mtbl() {
         return _memtable;
     }
@@ -413,7 +438,7 @@ class flush_reader final : public iterator_reader {
                     auto cr = query::clustering_key_filter_ranges::get_ranges(*schema(), query::full_slice, e->key().key());
                     auto snp = e->partition().read(schema());
                     auto mpsr = make_partition_snapshot_reader<partition_snapshot_accounter>(schema(), e->key(), std::move(cr),
-                            snp, region(), read_section(), mtbl(), streamed_mutation::forwarding::no, _flushed_memory);
+                            snp, region(), read_section(), version_merger(), mtbl(), streamed_mutation::forwarding::no, _flushed_memory);
                     _flushed_memory.account_component(*e);
                     _flushed_memory.account_component(*snp);
                     auto ret = make_ready_future<streamed_mutation_opt>(std::move(mpsr));
@@ -435,6 +460,9 @@ memtable::make_reader(schema_ptr s,
                       mutation_reader::forwarding fwd_mr) {
     if (query::is_single_partition(range)) {
         const query::ring_position& pos = range.start()->value();
+        if (!may_contain(pos)) {
+            return make_empty_reader();
+        }
         return _read_section(*this, [&] {
         managed_bytes::linearization_context_guard lcg;
         auto i = partitions.find(pos, memtable_entry::compare(_schema));
@@ -525,15 +553,28 @@ size_t memtable::partition_count() const {
     return partitions.size();
 }
 
+memory_footprint memtable::footprint() const {
+    memory_footprint f;
+    f.tree_nodes += partitions.memory_usage();
+    for (const memtable_entry& e : partitions) {
+        ++f.partitions;
+        f.objects += sizeof(memtable_entry);
+        f.keys += e.external_memory_usage_without_rows();
+        e.partition().for_each_version([&f] (const partition_version& v) {
+            f.add(v);
+        });
+    }
+    f.set_fragmentation(occupancy().total_space());
+    return f;
+}
+
 memtable_entry::memtable_entry(memtable_entry&& o) noexcept
     : _link()
     , _schema(std::move(o._schema))
     , _key(std::move(o._key))
     , _pe(std::move(o._pe))
 {
-    using container_type = memtable::partitions_type;
-    container_type::node_algorithms::replace_node(o._link.this_ptr(), _link.this_ptr());
-    container_type::node_algorithms::init(o._link.this_ptr());
+    memtable::partitions_type::replace(o, *this);
 }
 
 void memtable::mark_flushed(mutation_source underlying) {
@@ -556,7 +597,7 @@ memtable_entry::read(lw_shared_ptr<memtable> mtbl,
         return streamed_mutation_from_mutation(std::move(m), fwd);
     }
     auto snp = _pe.read(_schema);
-    return make_partition_snapshot_reader(_schema, _key, std::move(cr), snp, *mtbl, mtbl->_read_section, mtbl, fwd);
+    return make_partition_snapshot_reader(_schema, _key, std::move(cr), snp, *mtbl, mtbl->_read_section, mtbl->_version_merger, mtbl, fwd);
 }
 
 void memtable::upgrade_entry(memtable_entry& e) {
@@ -30,7 +30,10 @@
 #include "db/commitlog/replay_position.hh"
 #include "db/commitlog/rp_set.hh"
 #include "utils/logalloc.hh"
+#include "utils/bptree.hh"
+#include "utils/token_filter.hh"
 #include "partition_version.hh"
+#include "memory_footprint.hh"
 
 class frozen_mutation;
 
@@ -38,7 +41,7 @@ class frozen_mutation;
 namespace bi = boost::intrusive;
 
 class memtable_entry {
-    bi::set_member_hook<> _link;
+    bplus::member_hook _link;
     schema_ptr _schema;
     dht::decorated_key _key;
     partition_entry _pe;
@@ -92,6 +95,21 @@ class memtable_entry {
             return _c(k1, k2._key);
         }
     };
+
+    // Orders entries like compare does, see dht::token_prefix().
+    struct token_prefix {
+        uint64_t operator()(const memtable_entry& e) const {
+            return dht::token_prefix(e._key.token());
+        }
+
+        uint64_t operator()(const dht::decorated_key& k) const {
+            return dht::token_prefix(k.token());
+        }
+
+        uint64_t operator()(const dht::ring_position& k) const {
+            return dht::token_prefix(k.token());
+        }
+    };
 };
 
 class dirty_memory_manager;
@@ -99,16 +117,22 @@ class dirty_memory_manager;
 // Managed by lw_shared_ptr<>.
 class memtable final : public enable_lw_shared_from_this<memtable>, private logalloc::region {
 public:
-    using partitions_type = bi::set<memtable_entry,
-        bi::member_hook<memtable_entry, bi::set_member_hook<>, &memtable_entry::_link>,
-        bi::compare<memtable_entry::compare>>;
+    using partitions_type = bplus::tree<memtable_entry,
+        bplus::member_hook_of<memtable_entry, &memtable_entry::_link>,
+        memtable_entry::compare,
+        memtable_entry::token_prefix>;
 private:
     dirty_memory_manager& _dirty_mgr;
     memtable_list *_memtable_list;
     schema_ptr _schema;
     logalloc::allocating_section _read_section;
     logalloc::allocating_section _allocating_section;
+    partition_version_merger _version_merger;
     partitions_type partitions;
+    // Tokens of the partitions, so that single partition reads can skip
+    // memtables which don't have it. Partitions moved away to the cache
+    // remain in it, which only makes it less selective.
+    utils::token_filter _token_filter;
     db::replay_position _replay_position;
     db::rp_set _rp_set;
     // mutation source to which reads fall-back after mark_flushed()
@@ -128,6 +152,7 @@ class memtable final : public enable_lw_shared_from_this<memtable>, private loga
     boost::iterator_range<partitions_type::const_iterator> slice(const dht::partition_range& r) const;
     partition_entry& find_or_create_partition(const dht::decorated_key& key);
     partition_entry& find_or_create_partition_slow(partition_key_view key);
+    void reserve_token_filter();
     void upgrade_entry(memtable_entry&);
     void add_flushed_memory(uint64_t);
     void remove_flushed_memory(uint64_t);
@@ -168,6 +193,8 @@ class memtable final : public enable_lw_shared_from_this<memtable>, private loga
 
     size_t partition_count() const;
     logalloc::occupancy_stats occupancy() const;
+    // Walks all partitions without yielding, so it's meant for diagnostics.
+    memory_footprint footprint() const;
 
     // Creates a reader of data in this memtable for given partition range.
     //
@@ -191,6 +218,11 @@ class memtable final : public enable_lw_shared_from_this<memtable>, private loga
     mutation_source as_data_source();
 
     bool empty() const { return partitions.empty(); }
+    bool has_partitions_in(const dht::partition_range& range) const { return !slice(range).empty(); }
+    // False if this memtable certainly has no partition at the position.
+    bool may_contain(const dht::ring_position& pos) const {
+        return _token_filter.may_contain(dht::token_prefix(pos.token()));
+    }
     void mark_flushed(mutation_source);
     bool is_flushed() const;
     void on_detach_from_region_group() noexcept;
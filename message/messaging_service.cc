@@ -21,6 +21,7 @@
 
 #include "message/messaging_service.hh"
 #include "core/distributed.hh"
+#include <seastar/core/metrics.hh>
 #include "gms/failure_detector.hh"
 #include "gms/gossiper.hh"
 #include "service/storage_service.hh"
@@ -38,6 +39,7 @@
 #include "frozen_schema.hh"
 #include "repair/repair.hh"
 #include "digest_algorithm.hh"
+#include "service/paxos/proposal.hh"
 #include "idl/consistency_level.dist.hh"
 #include "idl/tracing.dist.hh"
 #include "idl/result.dist.hh"
@@ -55,6 +57,7 @@
 #include "idl/partition_checksum.dist.hh"
 #include "idl/query.dist.hh"
 #include "idl/cache_temperature.dist.hh"
+#include "idl/paxos.dist.hh"
 #include "serializer_impl.hh"
 #include "serialization_visitors.hh"
 #include "idl/consistency_level.dist.impl.hh"
@@ -74,6 +77,7 @@
 #include "idl/partition_checksum.dist.impl.hh"
 #include "idl/query.dist.impl.hh"
 #include "idl/cache_temperature.dist.impl.hh"
+#include "idl/paxos.dist.impl.hh"
 #include "rpc/lz4_compressor.hh"
 #include "rpc/multi_algo_compressor_factory.hh"
 #include "partition_range_compat.hh"
@@ -122,6 +126,56 @@ using namespace std::chrono_literals;
 static rpc::lz4_compressor::factory lz4_compressor_factory;
 static rpc::multi_algo_compressor_factory compressor_factory(&lz4_compressor_factory);
 
+struct compression_stats {
+    uint64_t bytes_sent = 0;
+    uint64_t compressed_bytes_sent = 0;
+    uint64_t bytes_received = 0;
+    uint64_t compressed_bytes_received = 0;
+};
+
+class counting_compressor final : public rpc::compressor {
+    std::unique_ptr<rpc::compressor> _compressor;
+    compression_stats& _stats;
+public:
+    counting_compressor(std::unique_ptr<rpc::compressor> c, compression_stats& stats)
+        : _compressor(std::move(c)), _stats(stats) { }
+    virtual rpc::snd_buf compress(size_t head_space, rpc::snd_buf data) override {
+        _stats.bytes_sent += data.size;
+        auto ret = _compressor->compress(head_space, std::move(data));
+        _stats.compressed_bytes_sent += ret.size - head_space;
+        return ret;
+    }
+    virtual rpc::rcv_buf decompress(rpc::rcv_buf data) override {
+        _stats.compressed_bytes_received += data.size;
+        auto ret = _compressor->decompress(std::move(data));
+        _stats.bytes_received += ret.size;
+        return ret;
+    }
+    virtual sstring name() const override {
+        return _compressor->name();
+    }
+};
+
+// Negotiates compression like compressor_factory, counting the bytes going
+// through the compressors it creates.
+class messaging_service::counting_compressor_factory final : public rpc::compressor::factory {
+    mutable compression_stats _stats;
+public:
+    virtual const sstring& supported() const override {
+        return compressor_factory.supported();
+    }
+    virtual std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override {
+        auto c = compressor_factory.negotiate(std::move(feature), is_server);
+        if (!c) {
+            return nullptr;
+        }
+        return std::make_unique<counting_compressor>(std::move(c), _stats);
+    }
+    const compression_stats& stats() const {
+        return _stats;
+    }
+};
+
 struct messaging_service::rpc_protocol_wrapper : public rpc_protocol { using rpc_protocol::rpc_protocol; };
 
 // This wrapper pretends to be rpc_protocol::client, but also handles
@@ -253,9 +307,9 @@ rpc_resource_limits() {
 void messaging_service::start_listen() {
     bool listen_to_bc = _should_listen_to_broadcast_address && _listen_address != utils::fb_utilities::get_broadcast_address();
     rpc::server_options so;
-    if (_compress_what != compress_what::none) {
-        so.compressor_factory = &compressor_factory;
-    }
+    // Compression is negotiated by the clients, which only ask for it where
+    // configured, and always for gossip.
+    so.compressor_factory = _compressor_factories.back().get();
     if (!_server[0]) {
         auto listen = [&] (const gms::inet_address& a) {
             auto addr = ipv4_addr{a.raw_addr(), _port};
@@ -316,6 +370,26 @@ messaging_service::messaging_service(gms::inet_address ip
     _rpc->set_logger([] (const sstring& log) {
             rpc_logger.info("{}", log);
     });
+
+    namespace sm = seastar::metrics;
+    static const std::array<sstring, 5> connection_types = { "default", "gossip", "streaming", "mutation_done", "incoming" };
+    static_assert(std::tuple_size<decltype(_clients)>::value + 1 == std::tuple_size<decltype(_compressor_factories)>::value, "a compressor factory is needed for each clients map");
+    auto connection_type_label = sm::label("connection_type");
+    for (size_t i = 0; i < _compressor_factories.size(); ++i) {
+        _compressor_factories[i] = std::make_unique<counting_compressor_factory>();
+        auto& stats = _compressor_factories[i]->stats();
+        _metrics.add_group("messaging_service", {
+            sm::make_derive("compression_bytes_sent", [&stats] { return stats.bytes_sent; },
+                            sm::description("Counts the bytes of messages sent compressed, before compression."), {connection_type_label(connection_types[i])}),
+            sm::make_derive("compressed_bytes_sent", [&stats] { return stats.compressed_bytes_sent; },
+                            sm::description("Counts the bytes of compressed messages sent, after compression."), {connection_type_label(connection_types[i])}),
+            sm::make_derive("compression_bytes_received", [&stats] { return stats.bytes_received; },
+                            sm::description("Counts the bytes of compressed messages received, after decompression."), {connection_type_label(connection_types[i])}),
+            sm::make_derive("compressed_bytes_received", [&stats] { return stats.compressed_bytes_received; },
+                            sm::description("Counts the bytes of compressed messages received, before decompression."), {connection_type_label(connection_types[i])}),
+        });
+    }
+
     register_handler(this, messaging_verb::CLIENT_ID, [] (rpc::client_info& ci, gms::inet_address broadcast_address, uint32_t src_cpu_id, rpc::optional<uint64_t> max_result_size) {
         ci.attach_auxiliary("baddr", broadcast_address);
         ci.attach_auxiliary("src_cpu_id", src_cpu_id);
@@ -380,28 +454,57 @@ rpc::no_wait_type messaging_service::no_wait() {
     return rpc::no_wait;
 }
 
+// Each class of verbs gets its own connection to a peer, so that a backlog
+// of messages of one class doesn't delay the others: user reads and writes
+// (0), gossip (1), streaming and repair (2), and mutation acknowledgements
+// (3). Verbs sent while handling others, like GET_SCHEMA_VERSION, go on a
+// different connection to avoid potential deadlocks.
 static unsigned get_rpc_client_idx(messaging_verb verb) {
-    unsigned idx = 0;
-    // GET_SCHEMA_VERSION is sent from read/mutate verbs so should be
-    // sent on a different connection to avoid potential deadlocks
-    // as well as reduce latency as there are potentially many requests
-    // blocked on schema version request.
-    if (verb == messaging_verb::GOSSIP_DIGEST_SYN ||
-        verb == messaging_verb::GOSSIP_DIGEST_ACK2 ||
-        verb == messaging_verb::GOSSIP_SHUTDOWN ||
-        verb == messaging_verb::GOSSIP_ECHO ||
-        verb == messaging_verb::GET_SCHEMA_VERSION) {
-        idx = 1;
-    } else if (verb == messaging_verb::PREPARE_MESSAGE ||
-               verb == messaging_verb::PREPARE_DONE_MESSAGE ||
-               verb == messaging_verb::STREAM_MUTATION ||
-               verb == messaging_verb::STREAM_MUTATION_DONE ||
-               verb == messaging_verb::COMPLETE_MESSAGE) {
-        idx = 2;
-    } else if (verb == messaging_verb::MUTATION_DONE) {
-        idx = 3;
+    switch (verb) {
+    case messaging_verb::GOSSIP_DIGEST_SYN:
+    case messaging_verb::GOSSIP_DIGEST_ACK:
+    case messaging_verb::GOSSIP_DIGEST_ACK2:
+    case messaging_verb::GOSSIP_SHUTDOWN:
+    case messaging_verb::GOSSIP_ECHO:
+    // GET_SCHEMA_VERSION also is sent from read/mutate verbs, and many
+    // requests may be blocked on it.
+    case messaging_verb::GET_SCHEMA_VERSION:
+        return 1;
+    case messaging_verb::PREPARE_MESSAGE:
+    case messaging_verb::PREPARE_DONE_MESSAGE:
+    case messaging_verb::STREAM_MUTATION:
+    case messaging_verb::STREAM_MUTATION_DONE:
+    case messaging_verb::STREAM_SSTABLE_FILE:
+    case messaging_verb::COMPLETE_MESSAGE:
+    case messaging_verb::REPAIR_CHECKSUM_RANGE:
+    case messaging_verb::REPAIR_CHECKSUM_RANGES:
+    case messaging_verb::REPAIR_ROW_HASHES:
+    case messaging_verb::REPAIR_GET_ROWS:
+    case messaging_verb::REPAIR_PUT_ROWS:
+        return 2;
+    case messaging_verb::MUTATION_DONE:
+    case messaging_verb::MUTATION_BATCH_DONE:
+        return 3;
+    case messaging_verb::CLIENT_ID:
+    case messaging_verb::MUTATION:
+    case messaging_verb::READ_DATA:
+    case messaging_verb::READ_MUTATION_DATA:
+    case messaging_verb::READ_DIGEST:
+    case messaging_verb::DEFINITIONS_UPDATE:
+    case messaging_verb::TRUNCATE:
+    case messaging_verb::REPLICATION_FINISHED:
+    case messaging_verb::MIGRATION_REQUEST:
+    case messaging_verb::SCHEMA_CHECK:
+    case messaging_verb::COUNTER_MUTATION:
+    case messaging_verb::AGGREGATE:
+    case messaging_verb::MUTATION_BATCH:
+    case messaging_verb::PAXOS_PREPARE:
+    case messaging_verb::PAXOS_ACCEPT:
+    case messaging_verb::PAXOS_LEARN:
+    case messaging_verb::LAST:
+        return 0;
     }
-    return idx;
+    abort();
 }
 
 /**
@@ -482,7 +585,14 @@ shared_ptr<messaging_service::rpc_protocol_client_wrapper> messaging_service::ge
                         != snitch_ptr->get_rack(utils::fb_utilities::get_broadcast_address());
     }();
 
-    auto must_compress = [&id, this] {
+    auto must_compress = [&id, idx, this] {
+        // Gossip messages carry the application states of all nodes, which
+        // are mostly text, like the TOKENS, and compress well. Their volume
+        // grows with the size of the cluster, while the CPU cost of
+        // compressing them is small.
+        if (idx == 1) {
+            return true;
+        }
         if (_compress_what == compress_what::none) {
             return false;
         }
@@ -503,7 +613,7 @@ shared_ptr<messaging_service::rpc_protocol_client_wrapper> messaging_service::ge
     // send keepalive messages each minute if connection is idle, drop connection after 10 failures
     opts.keepalive = std::experimental::optional<net::tcp_keepalive_params>({60s, 60s, 10});
     if (must_compress) {
-        opts.compressor_factory = &compressor_factory;
+        opts.compressor_factory = _compressor_factories[idx].get();
     }
 
     auto client = must_encrypt ?
@@ -744,6 +854,18 @@ future<> messaging_service::send_stream_mutation_done(msg_addr id, UUID plan_id,
         plan_id, std::move(ranges), cf_id, dst_cpu_id);
 }
 
+// STREAM_SSTABLE_FILE
+void messaging_service::register_stream_sstable_file(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t sstable_id,
+        sstring version, sstring format, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id)>&& func) {
+    register_handler(this, messaging_verb::STREAM_SSTABLE_FILE, std::move(func));
+}
+future<> messaging_service::send_stream_sstable_file(msg_addr id, UUID plan_id, UUID cf_id, int64_t sstable_id,
+        sstring version, sstring format, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id) {
+    return send_message_timeout_and_retry<void>(this, messaging_verb::STREAM_SSTABLE_FILE, id,
+        streaming_timeout, streaming_nr_retry, streaming_wait_before_retry,
+        plan_id, cf_id, sstable_id, std::move(version), std::move(format), std::move(component), offset, std::move(data), dst_cpu_id);
+}
+
 // COMPLETE_MESSAGE
 void messaging_service::register_complete_message(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, unsigned dst_cpu_id)>&& func) {
     register_handler(this, messaging_verb::COMPLETE_MESSAGE, std::move(func));
@@ -850,6 +972,18 @@ future<> messaging_service::send_counter_mutation(msg_addr id, clock_type::time_
     return send_message_timeout<void>(this, messaging_verb::COUNTER_MUTATION, std::move(id), timeout, std::move(fms), cl, std::move(trace_info));
 }
 
+void messaging_service::register_aggregate(std::function<future<std::vector<bytes_opt>> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd,
+        std::vector<query::aggregate_selector> selectors, dht::partition_range_vector ranges, db::consistency_level cl)>&& func) {
+    register_handler(this, netw::messaging_verb::AGGREGATE, std::move(func));
+}
+void messaging_service::unregister_aggregate() {
+    _rpc->unregister_handler(netw::messaging_verb::AGGREGATE);
+}
+future<std::vector<bytes_opt>> messaging_service::send_aggregate(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd,
+        const std::vector<query::aggregate_selector>& selectors, const dht::partition_range_vector& ranges, db::consistency_level cl) {
+    return send_message_timeout<std::vector<bytes_opt>>(this, messaging_verb::AGGREGATE, std::move(id), timeout, cmd, selectors, ranges, cl);
+}
+
 void messaging_service::register_mutation_done(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, response_id_type response_id)>&& func) {
     register_handler(this, netw::messaging_verb::MUTATION_DONE, std::move(func));
 }
@@ -860,7 +994,30 @@ future<> messaging_service::send_mutation_done(msg_addr id, unsigned shard, resp
     return send_message_oneway(this, messaging_verb::MUTATION_DONE, std::move(id), std::move(shard), std::move(response_id));
 }
 
-void messaging_service::register_read_data(std::function<future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda)>&& func) {
+void messaging_service::register_mutation_batch(std::function<future<rpc::no_wait_type> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms,
+    std::vector<response_id_type> response_ids, inet_address reply_to, unsigned shard)>&& func) {
+    register_handler(this, netw::messaging_verb::MUTATION_BATCH, std::move(func));
+}
+void messaging_service::unregister_mutation_batch() {
+    _rpc->unregister_handler(netw::messaging_verb::MUTATION_BATCH);
+}
+future<> messaging_service::send_mutation_batch(msg_addr id, clock_type::time_point timeout, const std::vector<frozen_mutation>& fms,
+    const std::vector<response_id_type>& response_ids, inet_address reply_to, unsigned shard) {
+    return send_message_oneway_timeout(this, timeout, messaging_verb::MUTATION_BATCH, std::move(id), fms, response_ids,
+        std::move(reply_to), std::move(shard));
+}
+
+void messaging_service::register_mutation_batch_done(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, std::vector<response_id_type> response_ids)>&& func) {
+    register_handler(this, netw::messaging_verb::MUTATION_BATCH_DONE, std::move(func));
+}
+void messaging_service::unregister_mutation_batch_done() {
+    _rpc->unregister_handler(netw::messaging_verb::MUTATION_BATCH_DONE);
+}
+future<> messaging_service::send_mutation_batch_done(msg_addr id, unsigned shard, std::vector<response_id_type> response_ids) {
+    return send_message_oneway(this, messaging_verb::MUTATION_BATCH_DONE, std::move(id), std::move(shard), std::move(response_ids));
+}
+
+void messaging_service::register_read_data(std::function<future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda)>&& func) {
     register_handler(this, netw::messaging_verb::READ_DATA, std::move(func));
 }
 void messaging_service::unregister_read_data() {
@@ -890,7 +1047,7 @@ future<utils::UUID> messaging_service::send_schema_check(msg_addr dst) {
     return send_message<utils::UUID>(this, netw::messaging_verb::SCHEMA_CHECK, dst);
 }
 
-void messaging_service::register_read_mutation_data(std::function<future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func) {
+void messaging_service::register_read_mutation_data(std::function<future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, compat::wrapping_partition_range pr)>&& func) {
     register_handler(this, netw::messaging_verb::READ_MUTATION_DATA, std::move(func));
 }
 void messaging_service::unregister_read_mutation_data() {
@@ -900,14 +1057,47 @@ future<reconcilable_result, rpc::optional<cache_temperature>> messaging_service:
     return send_message_timeout<future<reconcilable_result, rpc::optional<cache_temperature>>>(this, messaging_verb::READ_MUTATION_DATA, std::move(id), timeout, cmd, pr);
 }
 
-void messaging_service::register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func) {
+void messaging_service::register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda)>&& func) {
     register_handler(this, netw::messaging_verb::READ_DIGEST, std::move(func));
 }
 void messaging_service::unregister_read_digest() {
     _rpc->unregister_handler(netw::messaging_verb::READ_DIGEST);
 }
-future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> messaging_service::send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr) {
-    return send_message_timeout<future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>>>(this, netw::messaging_verb::READ_DIGEST, std::move(id), timeout, cmd, pr);
+future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> messaging_service::send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da) {
+    return send_message_timeout<future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>>>(this, netw::messaging_verb::READ_DIGEST, std::move(id), timeout, cmd, pr, da);
+}
+
+// Wrapper for PAXOS_PREPARE
+void messaging_service::register_paxos_prepare(std::function<future<service::paxos::prepare_response> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, partition_key key, utils::UUID ballot)>&& func) {
+    register_handler(this, netw::messaging_verb::PAXOS_PREPARE, std::move(func));
+}
+void messaging_service::unregister_paxos_prepare() {
+    _rpc->unregister_handler(netw::messaging_verb::PAXOS_PREPARE);
+}
+future<service::paxos::prepare_response> messaging_service::send_paxos_prepare(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const partition_key& key, utils::UUID ballot) {
+    return send_message_timeout<service::paxos::prepare_response>(this, messaging_verb::PAXOS_PREPARE, std::move(id), timeout, cmd, key, ballot);
+}
+
+// Wrapper for PAXOS_ACCEPT
+void messaging_service::register_paxos_accept(std::function<future<bool> (const rpc::client_info&, rpc::opt_time_point, service::paxos::proposal proposal)>&& func) {
+    register_handler(this, netw::messaging_verb::PAXOS_ACCEPT, std::move(func));
+}
+void messaging_service::unregister_paxos_accept() {
+    _rpc->unregister_handler(netw::messaging_verb::PAXOS_ACCEPT);
+}
+future<bool> messaging_service::send_paxos_accept(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& proposal) {
+    return send_message_timeout<bool>(this, messaging_verb::PAXOS_ACCEPT, std::move(id), timeout, proposal);
+}
+
+// Wrapper for PAXOS_LEARN
+void messaging_service::register_paxos_learn(std::function<future<> (const rpc::client_info&, rpc::opt_time_point, service::paxos::proposal decision)>&& func) {
+    register_handler(this, netw::messaging_verb::PAXOS_LEARN, std::move(func));
+}
+void messaging_service::unregister_paxos_learn() {
+    _rpc->unregister_handler(netw::messaging_verb::PAXOS_LEARN);
+}
+future<> messaging_service::send_paxos_learn(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& decision) {
+    return send_message_timeout<void>(this, messaging_verb::PAXOS_LEARN, std::move(id), timeout, decision);
 }
 
 // Wrapper for TRUNCATE
@@ -952,4 +1142,71 @@ future<partition_checksum> messaging_service::send_repair_checksum_range(
             std::move(keyspace), std::move(cf), std::move(range), hash_version);
 }
 
+// Wrapper for REPAIR_CHECKSUM_RANGES
+void messaging_service::register_repair_checksum_ranges(
+        std::function<future<std::vector<partition_checksum>> (sstring keyspace,
+                sstring cf, dht::token_range_vector ranges, repair_checksum hash_version)>&& f) {
+    register_handler(this, messaging_verb::REPAIR_CHECKSUM_RANGES, std::move(f));
+}
+void messaging_service::unregister_repair_checksum_ranges() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_CHECKSUM_RANGES);
+}
+future<std::vector<partition_checksum>> messaging_service::send_repair_checksum_ranges(
+        msg_addr id, sstring keyspace, sstring cf, ::dht::token_range_vector ranges, repair_checksum hash_version)
+{
+    return send_message<std::vector<partition_checksum>>(this,
+            messaging_verb::REPAIR_CHECKSUM_RANGES, std::move(id),
+            std::move(keyspace), std::move(cf), std::move(ranges), hash_version);
+}
+
+// Wrapper for REPAIR_ROW_HASHES
+void messaging_service::register_repair_row_hashes(
+        std::function<future<std::vector<uint64_t>> (sstring keyspace, sstring cf, dht::token_range range)>&& f) {
+    register_handler(this, messaging_verb::REPAIR_ROW_HASHES, std::move(f));
+}
+void messaging_service::unregister_repair_row_hashes() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_ROW_HASHES);
+}
+future<std::vector<uint64_t>> messaging_service::send_repair_row_hashes(
+        msg_addr id, sstring keyspace, sstring cf, ::dht::token_range range)
+{
+    return send_message<std::vector<uint64_t>>(this,
+            messaging_verb::REPAIR_ROW_HASHES, std::move(id),
+            std::move(keyspace), std::move(cf), std::move(range));
+}
+
+// Wrapper for REPAIR_GET_ROWS
+void messaging_service::register_repair_get_rows(
+        std::function<future<std::vector<frozen_mutation>> (sstring keyspace, sstring cf, dht::token_range range,
+                std::vector<uint64_t> hashes)>&& f) {
+    register_handler(this, messaging_verb::REPAIR_GET_ROWS, std::move(f));
+}
+void messaging_service::unregister_repair_get_rows() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_GET_ROWS);
+}
+future<std::vector<frozen_mutation>> messaging_service::send_repair_get_rows(
+        msg_addr id, sstring keyspace, sstring cf, ::dht::token_range range, std::vector<uint64_t> hashes)
+{
+    return send_message<std::vector<frozen_mutation>>(this,
+            messaging_verb::REPAIR_GET_ROWS, std::move(id),
+            std::move(keyspace), std::move(cf), std::move(range), std::move(hashes));
+}
+
+// Wrapper for REPAIR_PUT_ROWS
+void messaging_service::register_repair_put_rows(
+        std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, sstring keyspace, sstring cf,
+                dht::token_range range, std::vector<frozen_mutation> rows)>&& f) {
+    register_handler(this, messaging_verb::REPAIR_PUT_ROWS, std::move(f));
+}
+void messaging_service::unregister_repair_put_rows() {
+    _rpc->unregister_handler(messaging_verb::REPAIR_PUT_ROWS);
+}
+future<> messaging_service::send_repair_put_rows(
+        msg_addr id, UUID plan_id, sstring keyspace, sstring cf, ::dht::token_range range, std::vector<frozen_mutation> rows)
+{
+    return send_message<void>(this,
+            messaging_verb::REPAIR_PUT_ROWS, std::move(id),
+            std::move(plan_id), std::move(keyspace), std::move(cf), std::move(range), std::move(rows));
+}
+
 } // namespace net
@@ -36,6 +36,7 @@
 #include "digest_algorithm.hh"
 
 #include <seastar/net/tls.hh>
+#include <seastar/core/metrics_registration.hh>
 
 // forward declarations
 namespace streaming {
@@ -58,6 +59,7 @@ class seed_provider_type;
 
 class frozen_mutation;
 class frozen_schema;
+class partition_key;
 class partition_checksum;
 
 namespace dht {
@@ -68,6 +70,14 @@ namespace query {
     using partition_range = dht::partition_range;
     class read_command;
     class result;
+    struct aggregate_selector;
+}
+
+namespace service {
+namespace paxos {
+struct proposal;
+struct prepare_response;
+}
 }
 
 namespace compat {
@@ -108,7 +118,19 @@ enum class messaging_verb : int32_t {
     GET_SCHEMA_VERSION = 21,
     SCHEMA_CHECK = 22,
     COUNTER_MUTATION = 23,
-    LAST = 24,
+    STREAM_SSTABLE_FILE = 24,
+    AGGREGATE = 25,
+    MUTATION_BATCH = 26,
+    MUTATION_BATCH_DONE = 27,
+    REPAIR_ROW_HASHES = 28,
+    REPAIR_GET_ROWS = 29,
+    REPAIR_PUT_ROWS = 30,
+    REPAIR_CHECKSUM_RANGES = 31,
+    // Used by lightweight transactions
+    PAXOS_PREPARE = 32,
+    PAXOS_ACCEPT = 33,
+    PAXOS_LEARN = 34,
+    LAST = 35,
 };
 
 } // namespace netw
@@ -144,6 +166,7 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     struct rpc_protocol_client_wrapper;
     struct rpc_protocol_server_wrapper;
     struct shard_info;
+    class counting_compressor_factory;
 
     using msg_addr = netw::msg_addr;
     using inet_address = gms::inet_address;
@@ -201,6 +224,10 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     uint64_t _dropped_messages[static_cast<int32_t>(messaging_verb::LAST)] = {};
     bool _stopping = false;
     std::list<std::function<void(gms::inet_address ep)>> _connection_drop_notifiers;
+    // Count the bytes compressed on the connections of each of the _clients
+    // maps, and on the accepted connections, the last one.
+    std::array<std::unique_ptr<counting_compressor_factory>, 5> _compressor_factories;
+    seastar::metrics::metric_groups _metrics;
 
 public:
     using clock_type = lowres_clock;
@@ -243,6 +270,16 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void register_stream_mutation_done(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, dht::token_range_vector ranges, UUID cf_id, unsigned dst_cpu_id)>&& func);
     future<> send_stream_mutation_done(msg_addr id, UUID plan_id, dht::token_range_vector ranges, UUID cf_id, unsigned dst_cpu_id);
 
+    // Wrapper for STREAM_SSTABLE_FILE verb
+    //
+    // Carries one chunk of an sstable component file which is streamed as is.
+    // sstable_id identifies the sstable on the sender, version, format and component
+    // are the matching parts of the component file name.
+    void register_stream_sstable_file(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t sstable_id,
+            sstring version, sstring format, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id)>&& func);
+    future<> send_stream_sstable_file(msg_addr id, UUID plan_id, UUID cf_id, int64_t sstable_id,
+            sstring version, sstring format, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id);
+
     void register_complete_message(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, unsigned dst_cpu_id)>&& func);
     future<> send_complete_message(msg_addr id, UUID plan_id, unsigned dst_cpu_id);
 
@@ -251,6 +288,26 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void unregister_repair_checksum_range();
     future<partition_checksum> send_repair_checksum_range(msg_addr id, sstring keyspace, sstring cf, dht::token_range range, repair_checksum hash_version);
 
+    // Wrapper for REPAIR_CHECKSUM_RANGES verb, the checksums of several ranges in one request
+    void register_repair_checksum_ranges(std::function<future<std::vector<partition_checksum>> (sstring keyspace, sstring cf, dht::token_range_vector ranges, repair_checksum hash_version)>&& func);
+    void unregister_repair_checksum_ranges();
+    future<std::vector<partition_checksum>> send_repair_checksum_ranges(msg_addr id, sstring keyspace, sstring cf, dht::token_range_vector ranges, repair_checksum hash_version);
+
+    // Wrapper for REPAIR_ROW_HASHES verb, the hashes of the rows in a range
+    void register_repair_row_hashes(std::function<future<std::vector<uint64_t>> (sstring keyspace, sstring cf, dht::token_range range)>&& func);
+    void unregister_repair_row_hashes();
+    future<std::vector<uint64_t>> send_repair_row_hashes(msg_addr id, sstring keyspace, sstring cf, dht::token_range range);
+
+    // Wrapper for REPAIR_GET_ROWS verb, the rows of a range with the given hashes
+    void register_repair_get_rows(std::function<future<std::vector<frozen_mutation>> (sstring keyspace, sstring cf, dht::token_range range, std::vector<uint64_t> hashes)>&& func);
+    void unregister_repair_get_rows();
+    future<std::vector<frozen_mutation>> send_repair_get_rows(msg_addr id, sstring keyspace, sstring cf, dht::token_range range, std::vector<uint64_t> hashes);
+
+    // Wrapper for REPAIR_PUT_ROWS verb, rows of a range the receiver is missing
+    void register_repair_put_rows(std::function<future<> (const rpc::client_info& cinfo, UUID plan_id, sstring keyspace, sstring cf, dht::token_range range, std::vector<frozen_mutation> rows)>&& func);
+    void unregister_repair_put_rows();
+    future<> send_repair_put_rows(msg_addr id, UUID plan_id, sstring keyspace, sstring cf, dht::token_range range, std::vector<frozen_mutation> rows);
+
     // Wrapper for GOSSIP_ECHO verb
     void register_gossip_echo(std::function<future<> ()>&& func);
     void unregister_gossip_echo();
@@ -300,14 +357,33 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     void unregister_counter_mutation();
     future<> send_counter_mutation(msg_addr id, clock_type::time_point timeout, std::vector<frozen_mutation> fms, db::consistency_level cl, stdx::optional<tracing::trace_info> trace_info = std::experimental::nullopt);
 
+    // Wrapper for AGGREGATE
+    void register_aggregate(std::function<future<std::vector<bytes_opt>> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd,
+            std::vector<query::aggregate_selector> selectors, dht::partition_range_vector ranges, db::consistency_level cl)>&& func);
+    void unregister_aggregate();
+    future<std::vector<bytes_opt>> send_aggregate(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd,
+            const std::vector<query::aggregate_selector>& selectors, const dht::partition_range_vector& ranges, db::consistency_level cl);
+
     // Wrapper for MUTATION_DONE
     void register_mutation_done(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, response_id_type response_id)>&& func);
     void unregister_mutation_done();
     future<> send_mutation_done(msg_addr id, unsigned shard, response_id_type response_id);
 
+    // Wrapper for MUTATION_BATCH, the mutations and the ids of their response handlers
+    void register_mutation_batch(std::function<future<rpc::no_wait_type> (const rpc::client_info&, rpc::opt_time_point, std::vector<frozen_mutation> fms,
+        std::vector<response_id_type> response_ids, inet_address reply_to, unsigned shard)>&& func);
+    void unregister_mutation_batch();
+    future<> send_mutation_batch(msg_addr id, clock_type::time_point timeout, const std::vector<frozen_mutation>& fms,
+        const std::vector<response_id_type>& response_ids, inet_address reply_to, unsigned shard);
+
+    // Wrapper for MUTATION_BATCH_DONE, the ids of the response handlers of the mutations applied
+    void register_mutation_batch_done(std::function<future<rpc::no_wait_type> (const rpc::client_info& cinfo, unsigned shard, std::vector<response_id_type> response_ids)>&& func);
+    void unregister_mutation_batch_done();
+    future<> send_mutation_batch_done(msg_addr id, unsigned shard, std::vector<response_id_type> response_ids);
+
     // Wrapper for READ_DATA
     // Note: WTH is future<foreign_ptr<lw_shared_ptr<query::result>>
-    void register_read_data(std::function<future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> digest)>&& func);
+    void register_read_data(std::function<future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> digest)>&& func);
     void unregister_read_data();
     future<query::result, rpc::optional<cache_temperature>> send_read_data(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da);
 
@@ -322,14 +398,29 @@ class messaging_service : public seastar::async_sharded_service<messaging_servic
     future<utils::UUID> send_schema_check(msg_addr);
 
     // Wrapper for READ_MUTATION_DATA
-    void register_read_mutation_data(std::function<future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func);
+    void register_read_mutation_data(std::function<future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, compat::wrapping_partition_range pr)>&& func);
     void unregister_read_mutation_data();
     future<reconcilable_result, rpc::optional<cache_temperature>> send_read_mutation_data(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr);
 
     // Wrapper for READ_DIGEST
-    void register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, query::read_command cmd, compat::wrapping_partition_range pr)>&& func);
+    void register_read_digest(std::function<future<query::result_digest, api::timestamp_type, cache_temperature> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> digest)>&& func);
     void unregister_read_digest();
-    future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr);
+    future<query::result_digest, rpc::optional<api::timestamp_type>, rpc::optional<cache_temperature>> send_read_digest(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const dht::partition_range& pr, query::digest_algorithm da);
+
+    // Wrapper for PAXOS_PREPARE, the prepare of a ballot along with the read of the partition
+    void register_paxos_prepare(std::function<future<service::paxos::prepare_response> (const rpc::client_info&, rpc::opt_time_point, query::read_command cmd, partition_key key, utils::UUID ballot)>&& func);
+    void unregister_paxos_prepare();
+    future<service::paxos::prepare_response> send_paxos_prepare(msg_addr id, clock_type::time_point timeout, const query::read_command& cmd, const partition_key& key, utils::UUID ballot);
+
+    // Wrapper for PAXOS_ACCEPT
+    void register_paxos_accept(std::function<future<bool> (const rpc::client_info&, rpc::opt_time_point, service::paxos::proposal proposal)>&& func);
+    void unregister_paxos_accept();
+    future<bool> send_paxos_accept(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& proposal);
+
+    // Wrapper for PAXOS_LEARN
+    void register_paxos_learn(std::function<future<> (const rpc::client_info&, rpc::opt_time_point, service::paxos::proposal decision)>&& func);
+    void unregister_paxos_learn();
+    future<> send_paxos_learn(msg_addr id, clock_type::time_point timeout, const service::paxos::proposal& decision);
 
     // Wrapper for TRUNCATE
     void register_truncate(std::function<future<>(sstring, sstring)>&& func);
@@ -108,6 +108,22 @@ class compact_mutation {
         return t.max_deletion_time() < _gc_before && can_gc(t.tomb());
     };
 
+    // Whether the live cells of a clustering row satisfy the filters of the
+    // query. Rows which don't are neither emitted nor counted.
+    bool satisfies_filters(const row& cells) const {
+        for (auto&& f : _slice.filters()) {
+            auto c = cells.find_cell(f.id);
+            if (!c) {
+                return false;
+            }
+            auto cell = c->as_atomic_cell();
+            if (!cell.is_live() || !f.is_satisfied_by(*_schema.regular_column_at(f.id).type, cell.value())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     bool can_gc(tombstone t) {
         if (!sstable_compaction()) {
             return true;
@@ -157,7 +173,9 @@ class compact_mutation {
     void consume_new_partition(const dht::decorated_key& dk) {
         auto& pk = dk.key();
         _dk = &dk;
-        _has_ck_selector = has_ck_selector(_slice.row_ranges(_schema, pk));
+        // A partition reduced to its static row doesn't satisfy filters on
+        // regular columns either.
+        _has_ck_selector = has_ck_selector(_slice.row_ranges(_schema, pk)) || !_slice.filters().empty();
         _empty_partition = true;
         _rows_in_current_partition = 0;
         _static_row_live = false;
@@ -195,6 +213,9 @@ class compact_mutation {
         t.apply(current_tombstone);
         bool is_live = cr.marker().compact_and_expire(t.tomb(), _query_time, _can_gc, _gc_before);
         is_live |= cr.cells().compact_and_expire(_schema, column_kind::regular_column, t, _query_time, _can_gc, _gc_before);
+        if (is_live && !sstable_compaction() && !_slice.filters().empty() && !satisfies_filters(cr.cells())) {
+            return stop_iteration::no;
+        }
         if (only_live() && is_live) {
             partition_is_not_empty();
             auto stop = _consumer.consume(std::move(cr), t, true);
@@ -249,6 +270,36 @@ class compact_mutation {
     auto consume_end_of_stream() {
         return _consumer.consume_end_of_stream();
     }
+
+    // Prepares the compactor of a query suspended at the end of a page for
+    // the next page, with the limits of that page.
+    void start_new_page(uint32_t row_limit, uint32_t partition_limit) {
+        static_assert(!sstable_compaction(), "Compaction is not paged.");
+        _row_limit = row_limit;
+        _partition_limit = partition_limit;
+    }
+
+    // Continues, after start_new_page(), the partition the previous page
+    // ended in. Its rows are emitted as those of a new partition, which is
+    // restricted by the ranges after the last row of the previous page, the
+    // rows of the previous pages counting towards its partition row limit.
+    void continue_partition() {
+        _empty_partition = true;
+        _has_ck_selector = true;
+        // consume_end_of_partition() takes all the rows of the partition off.
+        auto max = std::numeric_limits<uint32_t>::max();
+        _row_limit = _row_limit > max - _rows_in_current_partition ? max : _row_limit + _rows_in_current_partition;
+        _current_partition_limit = std::min(_row_limit, _partition_row_limit);
+    }
+
+    // Whether the partition the previous page ended in has all its rows.
+    bool is_partition_row_limit_reached() const {
+        return _rows_in_current_partition >= _partition_row_limit;
+    }
+
+    CompactedMutationsConsumer& consumer() {
+        return _consumer;
+    }
 };
 
 template<emit_only_live_rows only_live, typename CompactedMutationsConsumer>
@@ -20,6 +20,7 @@
  */
 
 #include <boost/range/adaptor/reversed.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
 #include <seastar/util/defer.hh>
 #include "mutation_partition.hh"
 #include "mutation_partition_applier.hh"
@@ -30,6 +31,7 @@
 #include "reversibly_mergeable.hh"
 #include "streamed_mutation.hh"
 #include "mutation_query.hh"
+#include "querier.hh"
 #include "service/priority_manager.hh"
 #include "mutation_compactor.hh"
 #include "intrusive_set_external_comparator.hh"
@@ -214,7 +216,7 @@ auto apply_reversibly_intrusive_set(const schema& s, mutation_partition::rows_ty
             auto i = dst.lower_bound(src_e, cmp);
             if (i == dst.end() || cmp(src_e, *i)) {
                 // Construct neutral entry which will represent missing dst entry for revert.
-                rows_entry* empty_e = current_allocator().construct<rows_entry>(src_e.key());
+                rows_entry* empty_e = current_allocator().construct<rows_entry>(src_e.key(), bytes_view(src_e._encoded_key));
                 [&] () noexcept {
                     src_i = src.erase(src_i);
                     src_i = src.insert_before(src_i, *empty_e);
@@ -363,7 +365,18 @@ mutation_partition::apply(const schema& s, mutation_partition&& p) {
 
 void
 mutation_partition::apply(const schema& s, mutation_partition_view p, const schema& p_schema) {
-    if (p_schema.version() == s.version()) {
+    if (p_schema.version() == s.version() && empty()) {
+        // Nothing to merge with, so build in place, in a single pass over
+        // the serialized form. Should that fail, drop what was built.
+        mutation_partition cleared(*this, copy_comparators_only{});
+        try {
+            partition_builder b(s, *this);
+            p.accept(s, b);
+        } catch (...) {
+            *this = std::move(cleared);
+            throw;
+        }
+    } else if (p_schema.version() == s.version()) {
         mutation_partition p2(*this, copy_comparators_only{});
         partition_builder b(s, p2);
         p.accept(s, b);
@@ -466,18 +479,18 @@ mutation_partition::apply_insert(const schema& s, clustering_key_view key, api::
 }
 
 void mutation_partition::insert_row(const schema& s, const clustering_key& key, deletable_row&& row) {
-    auto e = current_allocator().construct<rows_entry>(key, std::move(row));
+    auto e = current_allocator().construct<rows_entry>(s, key, std::move(row));
     _rows.insert(_rows.end(), *e, rows_entry::compare(s));
 }
 
 void mutation_partition::insert_row(const schema& s, const clustering_key& key, const deletable_row& row) {
-    auto e = current_allocator().construct<rows_entry>(key, row);
+    auto e = current_allocator().construct<rows_entry>(s, key, row);
     _rows.insert(_rows.end(), *e, rows_entry::compare(s));
 }
 
 const row*
 mutation_partition::find_row(const schema& s, const clustering_key& key) const {
-    auto i = _rows.find(key, rows_entry::compare(s));
+    auto i = _rows.find(rows_entry::lookup_key(s, key), rows_entry::compare(s));
     if (i == _rows.end()) {
         return nullptr;
     }
@@ -486,9 +499,10 @@ mutation_partition::find_row(const schema& s, const clustering_key& key) const {
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, clustering_key&& key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
+    rows_entry::lookup_key lk(s, key);
+    auto i = _rows.find(lk, rows_entry::compare(s));
     if (i == _rows.end()) {
-        auto e = current_allocator().construct<rows_entry>(std::move(key));
+        auto e = current_allocator().construct<rows_entry>(std::move(key), lk.encoded_key());
         _rows.insert(i, *e, rows_entry::compare(s));
         return e->row();
     }
@@ -497,9 +511,10 @@ mutation_partition::clustered_row(const schema& s, clustering_key&& key) {
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, const clustering_key& key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
+    rows_entry::lookup_key lk(s, key);
+    auto i = _rows.find(lk, rows_entry::compare(s));
     if (i == _rows.end()) {
-        auto e = current_allocator().construct<rows_entry>(key);
+        auto e = current_allocator().construct<rows_entry>(key, lk.encoded_key());
         _rows.insert(i, *e, rows_entry::compare(s));
         return e->row();
     }
@@ -508,9 +523,10 @@ mutation_partition::clustered_row(const schema& s, const clustering_key& key) {
 
 deletable_row&
 mutation_partition::clustered_row(const schema& s, const clustering_key_view& key) {
-    auto i = _rows.find(key, rows_entry::compare(s));
+    rows_entry::lookup_key lk(s, key);
+    auto i = _rows.find(lk, rows_entry::compare(s));
     if (i == _rows.end()) {
-        auto e = current_allocator().construct<rows_entry>(key);
+        auto e = current_allocator().construct<rows_entry>(clustering_key(key), lk.encoded_key());
         _rows.insert(i, *e, rows_entry::compare(s));
         return e->row();
     }
@@ -640,7 +656,7 @@ void write_counter_cell(RowWriter& w, const query::partition_slice& slice, ::ato
 }
 
 // returns the timestamp of a latest update to the row
-static api::timestamp_type hash_row_slice(md5_hasher& hasher,
+static api::timestamp_type hash_row_slice(query::digester& hasher,
     const schema& s,
     column_kind kind,
     const row& cells,
@@ -1332,9 +1348,28 @@ mutation_partition::live_row_count(const schema& s, gc_clock::time_point query_t
 rows_entry::rows_entry(rows_entry&& o) noexcept
     : _link(std::move(o._link))
     , _key(std::move(o._key))
+    , _encoded_key(std::move(o._encoded_key))
     , _row(std::move(o._row))
 { }
 
+bytes_opt rows_entry::encode_lookup_key(const schema& s, clustering_key_view key) {
+    auto encoded = s.clustering_key_type()->encode_byte_comparable(key.representation());
+    if (encoded && encoded->size() > max_encoded_key_size) {
+        return { };
+    }
+    return encoded;
+}
+
+managed_bytes rows_entry::encode_key(const schema& s, const clustering_key& key) {
+    auto encoded = encode_lookup_key(s, key);
+    return encoded ? managed_bytes(*encoded) : managed_bytes();
+}
+
+rows_entry::lookup_key::lookup_key(const schema& s, clustering_key_view key)
+    : _key(key)
+    , _encoded_key(encode_lookup_key(s, key).value_or(bytes()))
+{ }
+
 row::row(const row& o)
     : _type(o._type)
     , _size(o._size)
@@ -1828,7 +1863,7 @@ uint32_t mutation_querier::consume_end_of_stream() {
     // If ck:s exist, and we do a restriction on them, we either have maching
     // rows, or return nothing, since cql does not allow "is null".
     if (!_live_clustering_rows
-        && (has_ck_selector(_pw.ranges()) || !_live_data_in_static_row)) {
+        && (has_ck_selector(_pw.ranges()) || !_pw.slice().filters().empty() || !_live_data_in_static_row)) {
         _pw.retract();
         return 0;
     } else {
@@ -1842,30 +1877,50 @@ uint32_t mutation_querier::consume_end_of_stream() {
 
 class query_result_builder {
     const schema& _schema;
-    query::result::builder& _rb;
+    query::result::builder* _rb;
     stdx::optional<query::result::partition_writer> _pw;
     stdx::optional<mutation_querier> _mutation_consumer;
     stop_iteration _stop;
     stop_iteration _short_read_allowed;
+    // Of the current partition, kept when paged, so that the partition can
+    // be continued in the next page.
+    bool _paged = false;
+    bool _continuing = false;
+    stdx::optional<std::pair<static_row, tombstone>> _static_row;
+    stdx::optional<clustering_key_prefix> _last_ckey;
 public:
-    query_result_builder(const schema& s, query::result::builder& rb)
-        : _schema(s), _rb(rb)
-        , _short_read_allowed(_rb.slice().options.contains<query::partition_slice::option::allow_short_read>())
+    query_result_builder(const schema& s, query::result::builder& rb, bool paged = false)
+        : _schema(s), _rb(&rb)
+        , _short_read_allowed(_rb->slice().options.contains<query::partition_slice::option::allow_short_read>())
+        , _paged(paged)
     { }
 
     void consume_new_partition(const dht::decorated_key& dk) {
-        _pw.emplace(_rb.add_partition(_schema, dk.key()));
-        _mutation_consumer.emplace(mutation_querier(_schema, *_pw, _rb.memory_accounter()));
+        _pw.emplace(_rb->add_partition(_schema, dk.key()));
+        _mutation_consumer.emplace(mutation_querier(_schema, *_pw, _rb->memory_accounter()));
+        if (!_continuing) {
+            _static_row = { };
+            _last_ckey = { };
+        } else if (_static_row) {
+            _mutation_consumer->consume(static_row(_static_row->first.cells()), _static_row->second);
+        }
+        _continuing = false;
     }
 
     void consume(tombstone t) {
         _mutation_consumer->consume(t);
     }
     stop_iteration consume(static_row&& sr, tombstone t, bool) {
+        if (_paged) {
+            _static_row.emplace(static_row(sr.cells()), t);
+        }
         _stop = _mutation_consumer->consume(std::move(sr), t) && _short_read_allowed;
         return _stop;
     }
     stop_iteration consume(clustering_row&& cr, row_tombstone t,  bool) {
+        if (_paged) {
+            _last_ckey = cr.key();
+        }
         _stop = _mutation_consumer->consume(std::move(cr), t) && _short_read_allowed;
         return _stop;
     }
@@ -1877,16 +1932,38 @@ class query_result_builder {
     stop_iteration consume_end_of_partition() {
         auto live_rows_in_partition = _mutation_consumer->consume_end_of_stream();
         if (_short_read_allowed && live_rows_in_partition > 0 && !_stop) {
-            _stop = _rb.memory_accounter().check();
+            _stop = _rb->memory_accounter().check();
         }
         if (_stop) {
-            _rb.mark_as_short_read();
+            _rb->mark_as_short_read();
         }
         return _stop;
     }
 
     void consume_end_of_stream() {
     }
+
+    // Makes the next page go into rb.
+    void start_new_page(query::result::builder& rb) {
+        _rb = &rb;
+        _pw = { };
+        _mutation_consumer = { };
+        _stop = stop_iteration::no;
+    }
+
+    // Continues the current partition in the next partition started, with
+    // its static row, until end_continued_partition().
+    void continue_partition() {
+        _continuing = true;
+    }
+    void end_continued_partition() {
+        _continuing = false;
+    }
+
+    // The last row of the current partition emitted.
+    const stdx::optional<clustering_key_prefix>& last_clustering_key() const {
+        return _last_ckey;
+    }
 };
 
 future<> data_query(
@@ -1898,7 +1975,10 @@ future<> data_query(
         uint32_t partition_limit,
         gc_clock::time_point query_time,
         query::result::builder& builder,
-        tracing::trace_state_ptr trace_ptr)
+        tracing::trace_state_ptr trace_ptr,
+        const io_priority_class& pc,
+        reader_timeout_clock::time_point timeout,
+        partition_window_splitter splitter)
 {
     if (row_limit == 0 || slice.partition_row_limit() == 0 || partition_limit == 0) {
         return make_ready_future<>();
@@ -1910,8 +1990,140 @@ future<> data_query(
     auto cfq = make_stable_flattened_mutations_consumer<compact_for_query<emit_only_live_rows::yes, query_result_builder>>(
             *s, query_time, slice, row_limit, partition_limit, std::move(qrb));
 
-    auto reader = source(s, range, slice, service::get_local_sstable_query_read_priority(), std::move(trace_ptr));
-    return consume_flattened(std::move(reader), std::move(cfq), is_reversed);
+    auto reader = source(s, range, slice, pc, trace_ptr);
+    if (is_reversed && splitter) {
+        auto reverse = [source = mutation_source(source), &slice, &pc, trace_ptr = std::move(trace_ptr), splitter = std::move(splitter)]
+                (streamed_mutation sm) {
+            return reverse_streamed_mutation_by_windows(std::move(sm), source, slice, pc, trace_ptr, splitter);
+        };
+        return consume_flattened_reversed(std::move(reader), std::move(cfq), std::move(reverse), timeout);
+    }
+    return consume_flattened(std::move(reader), std::move(cfq), is_reversed, timeout);
+}
+
+namespace query {
+
+class paged_data_query_state {
+public:
+    compact_for_query<emit_only_live_rows::yes, query_result_builder> compactor;
+
+    paged_data_query_state(const schema& s, gc_clock::time_point query_time, const partition_slice& slice,
+            result::builder& builder, uint32_t row_limit, uint32_t partition_limit)
+        : compactor(s, query_time, slice, row_limit, partition_limit, query_result_builder(s, builder, true))
+    { }
+};
+
+querier::querier(const mutation_source& ms, schema_ptr s, const dht::partition_range& range, const partition_slice& slice,
+        gc_clock::time_point query_time, const io_priority_class& pc, tracing::trace_state_ptr trace_ptr,
+        partition_window_splitter splitter)
+    : _schema(std::move(s))
+    , _range(std::make_unique<const dht::partition_range>(range))
+    , _slice(std::make_unique<const partition_slice>(slice))
+    , _query_time(query_time)
+    , _reader(ms(_schema, *_range, *_slice, pc, trace_ptr))
+    , _pc(&pc)
+{
+    if (splitter && _slice->options.contains(partition_slice::option::reversed)) {
+        _source = mutation_source(ms);
+        _trace_ptr = std::move(trace_ptr);
+        _splitter = std::move(splitter);
+    }
+}
+
+querier::querier(querier&&) = default;
+querier& querier::operator=(querier&&) = default;
+querier::~querier() = default;
+
+future<> querier::consume_page(result::builder& builder, uint32_t row_limit, uint32_t partition_limit,
+        reader_timeout_clock::time_point timeout) {
+    if (row_limit == 0 || _slice->partition_row_limit() == 0 || partition_limit == 0) {
+        return make_ready_future<>();
+    }
+    if (!_state) {
+        _state = std::make_unique<paged_data_query_state>(*_schema, _query_time, *_slice, builder, row_limit, partition_limit);
+    } else {
+        _state->compactor.start_new_page(row_limit, partition_limit);
+        _state->compactor.consumer().start_new_page(builder);
+    }
+    auto& compactor = _state->compactor;
+    auto continued = make_ready_future<stop_iteration>(stop_iteration::no);
+    if (_sm) {
+        compactor.continue_partition();
+        compactor.consumer().continue_partition();
+        continued = do_consume_streamed_mutation_flattened(*_sm, compactor, timeout).then([&compactor] (stop_iteration stop) {
+            compactor.consumer().end_continued_partition();
+            return stop;
+        });
+    }
+    return continued.then([this, &compactor, timeout] (stop_iteration stop) {
+        if (stop) {
+            return make_ready_future<>();
+        }
+        auto is_reversed = _slice->options.contains(partition_slice::option::reversed);
+        return repeat([this, &compactor, is_reversed, timeout] {
+            if (reader_timed_out(timeout)) {
+                return make_exception_future<stop_iteration>(timed_out_error());
+            }
+            return _reader().then([this, &compactor, is_reversed, timeout] (streamed_mutation_opt smopt) {
+                if (!smopt) {
+                    _sm = { };
+                    _exhausted = true;
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                if (!is_reversed) {
+                    _sm.emplace(std::move(*smopt));
+                } else if (_splitter) {
+                    _sm.emplace(reverse_streamed_mutation_by_windows(std::move(*smopt), *_source, *_slice, *_pc, _trace_ptr, _splitter));
+                } else {
+                    _sm.emplace(reverse_streamed_mutation(std::move(*smopt)));
+                }
+                compactor.consume_new_partition(_sm->decorated_key());
+                if (_sm->partition_tombstone()) {
+                    compactor.consume(_sm->partition_tombstone());
+                }
+                return do_consume_streamed_mutation_flattened(*_sm, compactor, timeout);
+            });
+        });
+    }).then([&compactor] {
+        compactor.consume_end_of_stream();
+    });
+}
+
+bool querier::resume_at(const schema& s, const dht::partition_range& range, const partition_slice& slice) {
+    if (_exhausted || !_sm || s.version() != _schema->version()) {
+        return false;
+    }
+    dht::ring_position_comparator cmp(s);
+    auto same_bound = [&] (const stdx::optional<dht::partition_range::bound>& a, const stdx::optional<dht::partition_range::bound>& b) {
+        return bool(a) == bool(b) && (!a || (a->is_inclusive() == b->is_inclusive() && cmp(a->value(), b->value()) == 0));
+    };
+    if (!same_bound(range.end(), _range->end()) || !range.start()
+            || cmp(range.start()->value(), _sm->decorated_key()) != 0) {
+        return false;
+    }
+    if (!range.start()->is_inclusive()) {
+        // The page starts after the partition the last one ended in.
+        _sm = { };
+        return true;
+    }
+    if (_state->compactor.is_partition_row_limit_reached()) {
+        return false;
+    }
+    // The page continues the partition after its last row.
+    auto& last_ckey = _state->compactor.consumer().last_clustering_key();
+    auto ranges = slice.get_specific_ranges() ? slice.get_specific_ranges()->range_for(s, _sm->key()) : nullptr;
+    if (!last_ckey || !ranges) {
+        return false;
+    }
+    clustering_key_prefix::equality eq(s);
+    auto starts_after_last_row = [&] (const stdx::optional<clustering_range::bound>& b) {
+        return b && !b->is_inclusive() && eq(b->value(), *last_ckey);
+    };
+    return boost::algorithm::any_of(*ranges, [&] (const clustering_range& r) {
+        return starts_after_last_row(r.start()) || starts_after_last_row(r.end());
+    });
+}
+
 }
 
 class reconcilable_result_builder {
@@ -2002,7 +2214,9 @@ static do_mutation_query(schema_ptr s,
                uint32_t partition_limit,
                gc_clock::time_point query_time,
                query::result_memory_accounter&& accounter,
-               tracing::trace_state_ptr trace_ptr)
+               tracing::trace_state_ptr trace_ptr,
+               const io_priority_class& pc,
+               reader_timeout_clock::time_point timeout)
 {
     if (row_limit == 0 || slice.partition_row_limit() == 0 || partition_limit == 0) {
         return make_ready_future<reconcilable_result>(reconcilable_result());
@@ -2014,8 +2228,8 @@ static do_mutation_query(schema_ptr s,
     auto cfq = make_stable_flattened_mutations_consumer<compact_for_query<emit_only_live_rows::no, reconcilable_result_builder>>(
             *s, query_time, slice, row_limit, partition_limit, std::move(rrb));
 
-    auto reader = source(s, range, slice, service::get_local_sstable_query_read_priority(), std::move(trace_ptr));
-    return consume_flattened(std::move(reader), std::move(cfq), is_reversed);
+    auto reader = source(s, range, slice, pc, std::move(trace_ptr));
+    return consume_flattened(std::move(reader), std::move(cfq), is_reversed, timeout);
 }
 
 static thread_local auto mutation_query_stage = seastar::make_execution_stage("mutation_query", do_mutation_query);
@@ -2029,10 +2243,12 @@ mutation_query(schema_ptr s,
                uint32_t partition_limit,
                gc_clock::time_point query_time,
                query::result_memory_accounter&& accounter,
-               tracing::trace_state_ptr trace_ptr)
+               tracing::trace_state_ptr trace_ptr,
+               const io_priority_class& pc,
+               reader_timeout_clock::time_point timeout)
 {
     return mutation_query_stage(std::move(s), std::move(source), seastar::cref(range), seastar::cref(slice),
-                                row_limit, partition_limit, query_time, std::move(accounter), std::move(trace_ptr));
+                                row_limit, partition_limit, query_time, std::move(accounter), std::move(trace_ptr), seastar::cref(pc), timeout);
 }
 
 deletable_row::deletable_row(clustering_row&& cr)
@@ -641,8 +641,18 @@ class deletable_row final {
 class rows_entry {
     intrusive_set_external_comparator_member_hook _link;
     clustering_key _key;
+    // The byte-comparable encoding of _key, computed once when the entry is
+    // created with a schema whose clustering key types support it, so that
+    // comparing entries is a single memcmp(). Empty if _key has none.
+    // See compound_type::encode_byte_comparable().
+    managed_bytes _encoded_key;
     deletable_row _row;
     friend class mutation_partition;
+private:
+    // Longer encodings aren't kept, so that they are never fragmented.
+    static constexpr size_t max_encoded_key_size = 1024;
+    static bytes_opt encode_lookup_key(const schema& s, clustering_key_view key);
+    static managed_bytes encode_key(const schema& s, const clustering_key& key);
 public:
     explicit rows_entry(clustering_key&& key)
         : _key(std::move(key))
@@ -656,9 +666,26 @@ class rows_entry {
     rows_entry(const clustering_key& key, const deletable_row& row)
         : _key(key), _row(row)
     { }
+    rows_entry(const schema& s, const clustering_key& key)
+        : _key(key), _encoded_key(encode_key(s, _key))
+    { }
+    rows_entry(const schema& s, const clustering_key& key, deletable_row&& row)
+        : _key(key), _encoded_key(encode_key(s, _key)), _row(std::move(row))
+    { }
+    rows_entry(const schema& s, const clustering_key& key, const deletable_row& row)
+        : _key(key), _encoded_key(encode_key(s, _key)), _row(row)
+    { }
+    // encoded_key must be the encoding of key, or empty.
+    rows_entry(clustering_key&& key, bytes_view encoded_key)
+        : _key(std::move(key)), _encoded_key(encoded_key)
+    { }
+    rows_entry(const clustering_key& key, bytes_view encoded_key)
+        : _key(key), _encoded_key(encoded_key)
+    { }
     rows_entry(rows_entry&& o) noexcept;
     rows_entry(const rows_entry& e)
         : _key(e._key)
+        , _encoded_key(e._encoded_key)
         , _row(e._row)
     { }
     clustering_key& key() {
@@ -687,12 +714,42 @@ class rows_entry {
     bool empty() const {
         return _row.empty();
     }
+    // A key looked up in the rows of a partition, encoded once for all the
+    // comparisons of the lookup.
+    class lookup_key {
+        clustering_key_view _key;
+        bytes _encoded_key;
+    public:
+        lookup_key(const schema& s, clustering_key_view key);
+        clustering_key_view key() const {
+            return _key;
+        }
+        // Empty if the key has no encoding.
+        bytes_view encoded_key() const {
+            return _encoded_key;
+        }
+    };
     struct compare {
         clustering_key::less_compare _c;
         compare(const schema& s) : _c(s) {}
         bool operator()(const rows_entry& e1, const rows_entry& e2) const {
+            if (!e1._encoded_key.empty() && !e2._encoded_key.empty()) {
+                return compare_unsigned(e1._encoded_key, e2._encoded_key) < 0;
+            }
             return _c(e1._key, e2._key);
         }
+        bool operator()(const lookup_key& k, const rows_entry& e) const {
+            if (!k.encoded_key().empty() && !e._encoded_key.empty()) {
+                return compare_unsigned(k.encoded_key(), e._encoded_key) < 0;
+            }
+            return _c(k.key(), e._key);
+        }
+        bool operator()(const rows_entry& e, const lookup_key& k) const {
+            if (!k.encoded_key().empty() && !e._encoded_key.empty()) {
+                return compare_unsigned(e._encoded_key, k.encoded_key()) < 0;
+            }
+            return _c(e._key, k.key());
+        }
         bool operator()(const clustering_key& key, const rows_entry& e) const {
             return _c(key, e._key);
         }
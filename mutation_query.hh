@@ -25,6 +25,7 @@
 #include "query-result.hh"
 #include "mutation_reader.hh"
 #include "frozen_mutation.hh"
+#include "service/priority_manager.hh"
 
 class reconcilable_result;
 class frozen_reconcilable_result;
@@ -118,6 +119,8 @@ query::result to_data_query_result(const reconcilable_result&, schema_ptr, const
 // is absent in the results.
 //
 // 'source' doesn't have to survive deferring.
+//
+// Fails with timed_out_error if the query is still running after 'timeout'.
 future<reconcilable_result> mutation_query(
     schema_ptr,
     mutation_source source,
@@ -127,7 +130,9 @@ future<reconcilable_result> mutation_query(
     uint32_t partition_limit,
     gc_clock::time_point query_time,
     query::result_memory_accounter&& accounter = { },
-    tracing::trace_state_ptr trace_ptr = nullptr);
+    tracing::trace_state_ptr trace_ptr = nullptr,
+    const io_priority_class& pc = service::get_local_sstable_query_read_priority(),
+    reader_timeout_clock::time_point timeout = reader_timeout_clock::time_point::max());
 
 future<> data_query(
     schema_ptr s,
@@ -138,7 +143,10 @@ future<> data_query(
     uint32_t partition_limit,
     gc_clock::time_point query_time,
     query::result::builder& builder,
-    tracing::trace_state_ptr trace_ptr = nullptr);
+    tracing::trace_state_ptr trace_ptr = nullptr,
+    const io_priority_class& pc = service::get_local_sstable_query_read_priority(),
+    reader_timeout_clock::time_point timeout = reader_timeout_clock::time_point::max(),
+    partition_window_splitter splitter = {});
 
 // Performs a query for counter updates.
 future<mutation_opt> counter_write_query(schema_ptr, const mutation_source&,
@@ -21,6 +21,7 @@
 
 #include <boost/range/algorithm/heap_algorithm.hpp>
 #include <boost/range/algorithm/reverse.hpp>
+#include <boost/range/adaptor/reversed.hpp>
 #include <boost/move/iterator.hpp>
 
 #include "mutation_reader.hh"
@@ -36,15 +37,26 @@ T move_and_clear(T& obj) {
 }
 
 future<> combined_mutation_reader::prepare_next() {
-    return parallel_for_each(_next, [this] (mutation_reader* mr) {
-        return (*mr)().then([this, mr] (streamed_mutation_opt next) {
-            if (next) {
-                _ptables.emplace_back(mutation_and_reader { std::move(*next), mr });
-                boost::range::push_heap(_ptables, &heap_compare);
+    return do_with(std::vector<mutation_reader*>(), [this] (std::vector<mutation_reader*>& exhausted) {
+        return parallel_for_each(_next, [this, &exhausted] (mutation_reader* mr) {
+            return (*mr)().then([this, mr, &exhausted] (streamed_mutation_opt next) {
+                if (next) {
+                    _ptables.emplace_back(mutation_and_reader { std::move(*next), mr });
+                    boost::range::push_heap(_ptables, &heap_compare);
+                } else {
+                    exhausted.push_back(mr);
+                }
+            });
+        }).then([this, &exhausted] {
+            _next.clear();
+            if (!exhausted.empty() && on_readers_exhausted(exhausted)) {
+                boost::range::sort(_all_readers);
+                boost::range::sort(exhausted);
+                std::vector<mutation_reader*> remaining;
+                boost::range::set_difference(_all_readers, exhausted, std::back_inserter(remaining));
+                _all_readers = std::move(remaining);
             }
         });
-    }).then([this] {
-        _next.clear();
     });
 }
 
@@ -52,6 +64,14 @@ future<streamed_mutation_opt> combined_mutation_reader::next() {
     if (_current.empty() && !_next.empty()) {
         return prepare_next().then([this] { return next(); });
     }
+    if (_current.empty()) {
+        auto new_readers = create_new_readers(_ptables.empty() ? nullptr : &_ptables.front().m.decorated_key());
+        if (!new_readers.empty()) {
+            _all_readers.insert(_all_readers.end(), new_readers.begin(), new_readers.end());
+            _next = std::move(new_readers);
+            return next();
+        }
+    }
     if (_ptables.empty()) {
         return make_ready_future<streamed_mutation_opt>();
     };
@@ -231,44 +251,52 @@ mutation_reader make_empty_reader() {
 
 class restricting_mutation_reader : public mutation_reader::impl {
     const restricted_mutation_reader_config& _config;
-    unsigned _weight = 0;
-    bool _waited = false;
-    mutation_reader _base;
+    std::function<mutation_reader (reader_resource_tracker)> _create_reader;
+    // Engaged once admitted.
+    lw_shared_ptr<reader_permit> _permit;
+    stdx::optional<mutation_reader> _base;
+private:
+    future<> admit() {
+        if (_base) {
+            return make_ready_future<>();
+        }
+        auto timeout = _config.timeout.count() != 0
+                ? reader_concurrency_semaphore::clock::now() + std::chrono::duration_cast<reader_concurrency_semaphore::clock::duration>(_config.timeout)
+                : reader_concurrency_semaphore::clock::time_point::max();
+        return _config.sem->wait_admission(timeout).then([this] (lw_shared_ptr<reader_permit> permit) {
+            _permit = std::move(permit);
+            _base = _create_reader(reader_resource_tracker(_permit));
+            _create_reader = { };
+        });
+    }
 public:
-    restricting_mutation_reader(const restricted_mutation_reader_config& config, unsigned weight, mutation_reader&& base)
-            : _config(config), _weight(weight), _base(std::move(base)) {
+    restricting_mutation_reader(const restricted_mutation_reader_config& config, std::function<mutation_reader (reader_resource_tracker)> create_reader)
+            : _config(config), _create_reader(std::move(create_reader)) {
         if (_config.sem->waiters() >= _config.max_queue_length) {
             _config.raise_queue_overloaded_exception();
         }
     }
-    ~restricting_mutation_reader() {
-        if (_waited) {
-            _config.sem->signal(_weight);
-        }
-    }
     future<streamed_mutation_opt> operator()() override {
         // FIXME: we should defer freeing until the mutation is freed, perhaps,
         //        rather than just returned
-        if (_waited) {
-            return _base();
+        if (_base) {
+            return (*_base)();
         }
-        auto waited = _config.timeout.count() != 0
-                ? _config.sem->wait(_config.timeout, _weight)
-                : _config.sem->wait(_weight);
-        return waited.then([this] {
-            _waited = true;
-            return _base();
+        return admit().then([this] {
+            return (*_base)();
         });
     }
 
     virtual future<> fast_forward_to(const dht::partition_range& pr) override {
-        return _base.fast_forward_to(pr);
+        return admit().then([this, &pr] {
+            return _base->fast_forward_to(pr);
+        });
     }
 };
 
 mutation_reader
-make_restricted_reader(const restricted_mutation_reader_config& config, unsigned weight, mutation_reader&& base) {
-    return make_mutation_reader<restricting_mutation_reader>(config, weight, std::move(base));
+make_restricted_reader(const restricted_mutation_reader_config& config, std::function<mutation_reader (reader_resource_tracker)> create_reader) {
+    return make_mutation_reader<restricting_mutation_reader>(config, std::move(create_reader));
 }
 
 class multi_range_mutation_reader : public mutation_reader::impl {
@@ -324,3 +352,140 @@ make_multi_range_reader(schema_ptr s, mutation_source source, const dht::partiti
     return make_mutation_reader<multi_range_mutation_reader>(std::move(s), std::move(source), ranges,
                                                              slice, pc, std::move(trace_state), fwd, fwd_mr);
 }
+
+class windowed_reversing_streamed_mutation final : public streamed_mutation::impl {
+    mutation_source _source;
+    const query::partition_slice& _slice;
+    const io_priority_class& _pc;
+    tracing::trace_state_ptr _trace_state;
+    partition_window_splitter _splitter;
+    dht::partition_range _range;
+    // The windows not read yet, in clustering order. The last one is read
+    // next.
+    std::vector<query::clustering_range> _windows;
+    bool _windows_ready = false;
+    bool _first_window = true;
+private:
+    void make_windows(const std::vector<clustering_key_prefix>& starts) {
+        bound_view::compare less(*_schema);
+        auto it = starts.begin();
+        // The ranges of a reversed slice are in reverse clustering order.
+        const auto& ranges = _slice.row_ranges(*_schema, _key.key());
+        for (auto&& r : boost::adaptors::reverse(ranges)) {
+            auto start = bound_view::from_range_start(r);
+            auto end = bound_view::from_range_end(r);
+            auto window_start = r.start();
+            while (it != starts.end() && !less(start, bound_view(*it, bound_kind::incl_start))) {
+                ++it;
+            }
+            while (it != starts.end() && less(bound_view(*it, bound_kind::incl_start), end)) {
+                _windows.emplace_back(window_start, query::clustering_range::bound(*it, false));
+                window_start = query::clustering_range::bound(*it, true);
+                ++it;
+            }
+            _windows.emplace_back(std::move(window_start), r.end());
+        }
+    }
+
+    // The window reader returns the range tombstones which overlap the
+    // window whole, so the ones spanning several windows are cut to each.
+    void trim_to(range_tombstone& rt, const query::clustering_range& window) const {
+        bound_view::compare less(*_schema);
+        auto start = bound_view::from_range_start(window);
+        auto end = bound_view::from_range_end(window);
+        if (less(rt.start_bound(), start)) {
+            rt.start = start.prefix;
+            rt.start_kind = start.kind;
+        }
+        if (less(end, rt.end_bound())) {
+            rt.end = end.prefix;
+            rt.end_kind = end.kind;
+        }
+    }
+
+    future<> read_window(query::clustering_range window) {
+        auto options = _slice.options;
+        options.remove<query::partition_slice::option::reversed>();
+        auto slice = std::make_unique<query::partition_slice>(query::clustering_row_ranges{window},
+            _first_window ? _slice.static_columns : std::vector<column_id>(), _slice.regular_columns, options,
+            nullptr, _slice.cql_format(), _slice.partition_row_limit(), _slice.filters());
+        auto& slice_ref = *slice;
+        auto rd = _source(_schema, _range, slice_ref, _pc, _trace_state);
+        return do_with(std::move(slice), std::move(rd), std::move(window), std::vector<mutation_fragment>(),
+                [this] (auto&, mutation_reader& rd, const query::clustering_range& window, std::vector<mutation_fragment>& frags) {
+            return rd().then([&frags] (streamed_mutation_opt smopt) {
+                if (!smopt) {
+                    return make_ready_future<>();
+                }
+                return do_with(std::move(*smopt), [&frags] (streamed_mutation& sm) {
+                    return repeat([&sm, &frags] {
+                        return sm().then([&frags] (mutation_fragment_opt mf) {
+                            if (!mf) {
+                                return stop_iteration::yes;
+                            }
+                            frags.emplace_back(std::move(*mf));
+                            return stop_iteration::no;
+                        });
+                    });
+                });
+            }).then([this, &window, &frags] {
+                bound_view::compare less(*_schema);
+                if (_first_window && !frags.empty() && frags.front().is_static_row()) {
+                    push_mutation_fragment(std::move(frags.front()));
+                }
+                for (auto&& mf : boost::adaptors::reverse(frags)) {
+                    if (mf.is_static_row()) {
+                        continue;
+                    }
+                    if (mf.is_range_tombstone()) {
+                        auto& rt = mf.as_mutable_range_tombstone();
+                        trim_to(rt, window);
+                        if (!less(rt.start_bound(), rt.end_bound())) {
+                            continue;
+                        }
+                        rt.flip();
+                    }
+                    push_mutation_fragment(std::move(mf));
+                }
+                _first_window = false;
+            });
+        });
+    }
+public:
+    windowed_reversing_streamed_mutation(streamed_mutation sm, mutation_source source, const query::partition_slice& slice,
+            const io_priority_class& pc, tracing::trace_state_ptr trace_state, partition_window_splitter splitter)
+        : streamed_mutation::impl(sm.schema(), sm.decorated_key(), sm.partition_tombstone())
+        , _source(std::move(source))
+        , _slice(slice)
+        , _pc(pc)
+        , _trace_state(std::move(trace_state))
+        , _splitter(std::move(splitter))
+        , _range(dht::partition_range::make_singular(_key))
+    { }
+
+    virtual future<> fill_buffer() override {
+        if (!_windows_ready) {
+            return _splitter(_key).then([this] (std::vector<clustering_key_prefix> starts) {
+                make_windows(starts);
+                _windows_ready = true;
+                return fill_buffer();
+            });
+        }
+        return do_until([this] { return is_end_of_stream() || is_buffer_full(); }, [this] {
+            if (_windows.empty()) {
+                _end_of_stream = true;
+                return make_ready_future<>();
+            }
+            auto window = std::move(_windows.back());
+            _windows.pop_back();
+            return read_window(std::move(window));
+        });
+    }
+};
+
+streamed_mutation reverse_streamed_mutation_by_windows(streamed_mutation sm, mutation_source source,
+        const query::partition_slice& slice, const io_priority_class& pc, tracing::trace_state_ptr trace_state,
+        partition_window_splitter splitter) {
+    return make_streamed_mutation<windowed_reversing_streamed_mutation>(std::move(sm), std::move(source), slice, pc,
+        std::move(trace_state), std::move(splitter));
+}
@@ -29,6 +29,7 @@
 #include "core/future-util.hh"
 #include "core/do_with.hh"
 #include "tracing/trace_state.hh"
+#include "reader_concurrency_semaphore.hh"
 
 // A mutation_reader is an object which allows iterating on mutations: invoke
 // the function to get a future for the next mutation, with an unset optional
@@ -147,6 +148,21 @@ class combined_mutation_reader : public mutation_reader::impl {
     combined_mutation_reader() = default;
     void init_mutation_reader_set(std::vector<mutation_reader*>);
     future<> fast_forward_to(std::vector<mutation_reader*> to_add, std::vector<mutation_reader*> to_remove, const dht::partition_range& pr);
+
+    // Lets a subclass open its readers lazily. Called before each partition
+    // is picked, with the key of the smallest partition read so far, or
+    // nullptr if all readers are exhausted, until it returns no readers.
+    // Returns the readers which may have partitions up to that key, or the
+    // next reader to open in key order if there is no key.
+    virtual std::vector<mutation_reader*> create_new_readers(const dht::decorated_key* key) {
+        return { };
+    }
+    // Called with the readers which reached their end of stream, which the
+    // reader uses no more until the next fast_forward_to(), if the subclass
+    // returns true, so that it can close them.
+    virtual bool on_readers_exhausted(const std::vector<mutation_reader*>& readers) {
+        return false;
+    }
 public:
     combined_mutation_reader(std::vector<mutation_reader> readers);
     virtual future<streamed_mutation_opt> operator()() override;
@@ -169,7 +185,7 @@ mutation_reader make_reader_returning_many(std::vector<streamed_mutation>);
 mutation_reader make_empty_reader();
 
 struct restricted_mutation_reader_config {
-    semaphore* sem = nullptr;
+    reader_concurrency_semaphore* sem = nullptr;
     std::chrono::nanoseconds timeout = {};
     size_t max_queue_length = std::numeric_limits<size_t>::max();
     std::function<void ()> raise_queue_overloaded_exception = default_raise_queue_overloaded_exception;
@@ -179,11 +195,13 @@ struct restricted_mutation_reader_config {
     }
 };
 
-// Restricts a given `mutation_reader` to a concurrency limited according to settings in
+// Restricts the reader created by create_reader to a concurrency limited according to settings in
 // a restricted_mutation_reader_config.  These settings include a semaphore for limiting the number
-// of active concurrent readers, a timeout for inactive readers, and a maximum queue size for
-// inactive readers.
-mutation_reader make_restricted_reader(const restricted_mutation_reader_config& config, unsigned weight, mutation_reader&& base);
+// and the memory of active concurrent readers, a timeout for inactive readers, and a maximum queue
+// size for inactive readers. The reader is only created once admitted, with the tracker its
+// buffers are to be charged through.
+mutation_reader make_restricted_reader(const restricted_mutation_reader_config& config,
+        std::function<mutation_reader (reader_resource_tracker)> create_reader);
 
 /*
 template<typename T>
@@ -346,17 +364,30 @@ partition_presence_checker make_default_partition_presence_checker() {
     return [] (const dht::decorated_key&) { return partition_presence_checker_result::maybe_exists; };
 }
 
+// Reads consumed past their timeout fail with timed_out_error. The
+// timeout is checked before reading each partition and each buffer of
+// fragments, so that no more data is read for a query nobody waits for.
+using reader_timeout_clock = lowres_clock;
+
+inline bool reader_timed_out(reader_timeout_clock::time_point timeout) {
+    return timeout != reader_timeout_clock::time_point::max() && reader_timeout_clock::now() > timeout;
+}
+
 template<typename Consumer>
-future<stop_iteration> do_consume_streamed_mutation_flattened(streamed_mutation& sm, Consumer& c)
+future<stop_iteration> do_consume_streamed_mutation_flattened(streamed_mutation& sm, Consumer& c,
+        reader_timeout_clock::time_point timeout = reader_timeout_clock::time_point::max())
 {
     do {
         if (sm.is_buffer_empty()) {
             if (sm.is_end_of_stream()) {
                 break;
             }
+            if (reader_timed_out(timeout)) {
+                return make_exception_future<stop_iteration>(timed_out_error());
+            }
             auto f = sm.fill_buffer();
             if (!f.available()) {
-                return f.then([&] { return do_consume_streamed_mutation_flattened(sm, c); });
+                return f.then([&, timeout] { return do_consume_streamed_mutation_flattened(sm, c, timeout); });
             }
             f.get();
         } else {
@@ -377,25 +408,29 @@ concept bool FlattenedConsumer() {
     };
 }
 */
-template<typename FlattenedConsumer>
-auto consume_flattened(mutation_reader mr, FlattenedConsumer&& c, bool reverse_mutations = false)
+// Like consume_flattened(), but each partition of mr is passed through
+// reverse, which maps it to a streamed_mutation emitting its fragments in
+// reverse clustering order, before being consumed.
+template<typename FlattenedConsumer, typename Reverser>
+auto consume_flattened_reversed(mutation_reader mr, FlattenedConsumer&& c, Reverser&& reverse,
+        reader_timeout_clock::time_point timeout = reader_timeout_clock::time_point::max())
 {
-    return do_with(std::move(mr), std::move(c), stdx::optional<streamed_mutation>(), [reverse_mutations] (auto& mr, auto& c, auto& sm) {
-        return repeat([&, reverse_mutations] {
-            return mr().then([&, reverse_mutations] (auto smopt) {
+    return do_with(std::move(mr), std::move(c), std::forward<Reverser>(reverse), stdx::optional<streamed_mutation>(),
+            [timeout] (auto& mr, auto& c, auto& reverse, auto& sm) {
+        return repeat([&, timeout] {
+            if (reader_timed_out(timeout)) {
+                return make_exception_future<stop_iteration>(timed_out_error());
+            }
+            return mr().then([&, timeout] (auto smopt) {
                 if (!smopt) {
                     return make_ready_future<stop_iteration>(stop_iteration::yes);
                 }
-                if (!reverse_mutations) {
-                    sm.emplace(std::move(*smopt));
-                } else {
-                    sm.emplace(reverse_streamed_mutation(std::move(*smopt)));
-                }
+                sm.emplace(reverse(std::move(*smopt)));
                 c.consume_new_partition(sm->decorated_key());
                 if (sm->partition_tombstone()) {
                     c.consume(sm->partition_tombstone());
                 }
-                return do_consume_streamed_mutation_flattened(*sm, c);
+                return do_consume_streamed_mutation_flattened(*sm, c, timeout);
             });
         }).then([&] {
             return c.consume_end_of_stream();
@@ -403,6 +438,15 @@ auto consume_flattened(mutation_reader mr, FlattenedConsumer&& c, bool reverse_m
     });
 }
 
+template<typename FlattenedConsumer>
+auto consume_flattened(mutation_reader mr, FlattenedConsumer&& c, bool reverse_mutations = false,
+        reader_timeout_clock::time_point timeout = reader_timeout_clock::time_point::max())
+{
+    return consume_flattened_reversed(std::move(mr), std::forward<FlattenedConsumer>(c), [reverse_mutations] (streamed_mutation sm) {
+        return reverse_mutations ? reverse_streamed_mutation(std::move(sm)) : std::move(sm);
+    }, timeout);
+}
+
 /*
 template<typename T>
 concept bool StreamedMutationFilter() {
@@ -475,6 +519,24 @@ stable_flattened_mutations_consumer<FlattenedConsumer> make_stable_flattened_mut
     return { std::make_unique<FlattenedConsumer>(std::forward<Args>(args)...) };
 }
 
+// Returns the clustering prefixes at which the given partition can be cut
+// into windows which are cheap to read one at a time, in clustering order.
+using partition_window_splitter = std::function<future<std::vector<clustering_key_prefix>>(const dht::decorated_key&)>;
+
+// Reverses sm, a partition returned for a reversed read of slice from source,
+// without reading all of it into memory first.
+//
+// The clustering ranges of the slice are cut into windows at the positions
+// returned by splitter. The windows are read from source one at a time, from
+// the last one, each forward, and the fragments of each are emitted in
+// reverse. So only a window has to be kept in memory, and a consumer which
+// stops after a few rows never reads the windows before them.
+//
+// slice and pc must be kept alive as long as the returned streamed_mutation.
+streamed_mutation reverse_streamed_mutation_by_windows(streamed_mutation sm, mutation_source source,
+        const query::partition_slice& slice, const io_priority_class& pc, tracing::trace_state_ptr trace_state,
+        partition_window_splitter splitter);
+
 // Requires ranges to be sorted and disjoint.
 mutation_reader
 make_multi_range_reader(schema_ptr s, mutation_source source, const dht::partition_range_vector& ranges,
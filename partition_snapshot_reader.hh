@@ -83,6 +83,7 @@ class partition_snapshot_reader : public streamed_mutation::impl, public MemoryA
 
     logalloc::region& _lsa_region;
     logalloc::allocating_section& _read_section;
+    partition_version_merger& _merger;
 
     MemoryAccounter& mem_accounter() {
         return *this;
@@ -212,7 +213,7 @@ class partition_snapshot_reader : public streamed_mutation::impl, public MemoryA
     partition_snapshot_reader(schema_ptr s, dht::decorated_key dk, lw_shared_ptr<partition_snapshot> snp,
         query::clustering_key_filter_ranges crr,
         logalloc::region& region, logalloc::allocating_section& read_section,
-        boost::any pointer_to_container, Args&&... args)
+        partition_version_merger& merger, boost::any pointer_to_container, Args&&... args)
     : streamed_mutation::impl(s, std::move(dk), tomb(*snp))
     , MemoryAccounter(std::forward<Args>(args)...)
     , _container_guard(std::move(pointer_to_container))
@@ -225,7 +226,8 @@ class partition_snapshot_reader : public streamed_mutation::impl, public MemoryA
     , _snapshot(snp)
     , _range_tombstones(*s)
     , _lsa_region(region)
-    , _read_section(read_section) {
+    , _read_section(read_section)
+    , _merger(merger) {
         for (auto&& v : _snapshot->versions()) {
             auto&& rt_list = v.partition().row_tombstones();
             for (auto&& range : _ck_ranges.ranges()) {
@@ -236,21 +238,9 @@ class partition_snapshot_reader : public streamed_mutation::impl, public MemoryA
     }
 
     ~partition_snapshot_reader() {
-        if (!_snapshot.owned()) {
-            return;
-        }
-        // If no one else is using this particular snapshot try to merge partition
-        // versions.
-        with_allocator(_lsa_region.allocator(), [this] {
-            return with_linearized_managed_bytes([this] {
-                try {
-                    _read_section(_lsa_region, [this] {
-                        _snapshot->merge_partition_versions();
-                    });
-                } catch (...) { }
-                _snapshot = {};
-            });
-        });
+        // If no one else is using this particular snapshot its partition
+        // versions are merged in the background.
+        _merger.merge(std::move(_snapshot));
     }
 
     virtual future<> fill_buffer() override {
@@ -271,12 +261,13 @@ make_partition_snapshot_reader(schema_ptr s,
     lw_shared_ptr<partition_snapshot> snp,
     logalloc::region& region,
     logalloc::allocating_section& read_section,
+    partition_version_merger& merger,
     boost::any pointer_to_container,
     streamed_mutation::forwarding fwd,
     Args&&... args)
 {
     auto sm = make_streamed_mutation<partition_snapshot_reader<MemoryAccounter>>(s, std::move(dk),
-           snp, std::move(crr), region, read_section, std::move(pointer_to_container), std::forward<Args>(args)...);
+           snp, std::move(crr), region, read_section, merger, std::move(pointer_to_container), std::forward<Args>(args)...);
     if (fwd) {
         return make_forwardable(std::move(sm)); // FIXME: optimize
     } else {
@@ -291,9 +282,10 @@ make_partition_snapshot_reader(schema_ptr s,
     lw_shared_ptr<partition_snapshot> snp,
     logalloc::region& region,
     logalloc::allocating_section& read_section,
+    partition_version_merger& merger,
     boost::any pointer_to_container,
     streamed_mutation::forwarding fwd)
 {
     return make_partition_snapshot_reader<partition_snapshot_reader_dummy_accounter>(std::move(s),
-        std::move(dk), std::move(crr), std::move(snp), region, read_section, std::move(pointer_to_container), fwd);
+        std::move(dk), std::move(crr), std::move(snp), region, read_section, merger, std::move(pointer_to_container), fwd);
 }
@@ -21,6 +21,8 @@
 
 #include <boost/range/algorithm/heap_algorithm.hpp>
 
+#include "core/future-util.hh"
+
 #include "partition_version.hh"
 
 static void remove_or_mark_as_unique_owner(partition_version* current)
@@ -72,7 +74,8 @@ partition_snapshot::~partition_snapshot() {
     }
 }
 
-void partition_snapshot::merge_partition_versions() {
+template<typename Preempt>
+stop_iteration partition_snapshot::do_merge_partition_versions(size_t& merged, Preempt&& preempt) {
     if (_version && !_version.is_unique_owner()) {
         auto v = &*_version;
         _version = { };
@@ -92,9 +95,25 @@ void partition_snapshot::merge_partition_versions() {
                 _version = partition_version_ref(*current);
                 throw;
             }
+            ++merged;
             current = next;
+            if (current && !current->is_referenced() && preempt()) {
+                // Resumed the same way as a failed merge is retried.
+                _version = partition_version_ref(*current);
+                return stop_iteration::no;
+            }
         }
     }
+    return stop_iteration::yes;
+}
+
+void partition_snapshot::merge_partition_versions() {
+    size_t merged = 0;
+    do_merge_partition_versions(merged, [] { return false; });
+}
+
+stop_iteration partition_snapshot::merge_partition_versions_preemptibly(size_t& merged) {
+    return do_merge_partition_versions(merged, [] { return need_preempt(); });
 }
 
 unsigned partition_snapshot::version_count()
@@ -282,6 +301,14 @@ void partition_entry::upgrade(schema_ptr from, schema_ptr to)
     remove_or_mark_as_unique_owner(old_version);
 }
 
+mutation_partition* partition_entry::exclusive_partition()
+{
+    if (_snapshot || !_version || !_version->is_single()) {
+        return nullptr;
+    }
+    return &_version->partition();
+}
+
 lw_shared_ptr<partition_snapshot> partition_entry::read(schema_ptr entry_schema)
 {
     if (_snapshot) {
@@ -292,3 +319,97 @@ lw_shared_ptr<partition_snapshot> partition_entry::read(schema_ptr entry_schema)
         return snp;
     }
 }
+
+partition_version_merger::stats& partition_version_merger::shard_stats() {
+    static thread_local stats s;
+    return s;
+}
+
+partition_version_merger::partition_version_merger(logalloc::region& r)
+    : _state(make_lw_shared<state>(r))
+{ }
+
+partition_version_merger::~partition_version_merger() {
+    auto& st = *_state;
+    with_allocator(st.region->allocator(), [&st] {
+        while (!st.snapshots.empty()) {
+            st.snapshots.pop_front();
+            --shard_stats().pending;
+        }
+    });
+    // Stops the background task, if it's running.
+    st.region = nullptr;
+}
+
+void partition_version_merger::release(state& st, lw_shared_ptr<partition_snapshot> snp) noexcept {
+    with_allocator(st.region->allocator(), [&snp] {
+        snp = {};
+    });
+}
+
+void partition_version_merger::merge(lw_shared_ptr<partition_snapshot> snp) noexcept {
+    if (!snp) {
+        return;
+    }
+    if (!snp.owned()) {
+        release(*_state, std::move(snp));
+        return;
+    }
+    auto count = snp->version_count();
+    shard_stats().chain_length.add(count);
+    if (count == 1) {
+        release(*_state, std::move(snp));
+        return;
+    }
+    try {
+        _state->snapshots.push_back(std::move(snp));
+    } catch (...) {
+        // Versions will be merged by the next reader of the partition.
+        release(*_state, std::move(snp));
+        return;
+    }
+    ++shard_stats().pending;
+    if (!_state->running) {
+        run(_state);
+    }
+}
+
+void partition_version_merger::run(lw_shared_ptr<state> stp) {
+    stp->running = true;
+    // Runs in the background, the merger waits for nothing.
+    (void)repeat([stp] {
+        auto& st = *stp;
+        if (!st.region || st.snapshots.empty()) {
+            st.running = false;
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        with_allocator(st.region->allocator(), [&st] {
+            with_linearized_managed_bytes([&st] {
+                try {
+                    st.section(*st.region, [&st] {
+                        while (!st.snapshots.empty()) {
+                            size_t merged = 0;
+                            auto done = st.snapshots.front()->merge_partition_versions_preemptibly(merged);
+                            shard_stats().merged_versions += merged;
+                            if (done == stop_iteration::no) {
+                                return;
+                            }
+                            st.snapshots.pop_front();
+                            --shard_stats().pending;
+                            if (need_preempt()) {
+                                return;
+                            }
+                        }
+                    });
+                } catch (...) {
+                    // Give up on this one, the next reader of the partition will merge it.
+                    st.snapshots.pop_front();
+                    --shard_stats().pending;
+                }
+            });
+        });
+        return later().then([] {
+            return stop_iteration::no;
+        });
+    });
+}
@@ -25,6 +25,8 @@
 #include "streamed_mutation.hh"
 #include "utils/anchorless_list.hh"
 #include "utils/logalloc.hh"
+#include "utils/estimated_histogram.hh"
+#include "core/circular_buffer.hh"
 
 // This is MVCC implementation for mutation_partitions.
 //
@@ -162,6 +164,8 @@ class partition_version_ref {
 
     explicit operator bool() { return _version; }
 
+    const partition_version* get() const { return _version; }
+
     partition_version& operator*() {
         assert(_version);
         return *_version;
@@ -197,6 +201,12 @@ class partition_snapshot : public enable_lw_shared_from_this<partition_snapshot>
     // Can be retried if previous merge attempt has failed.
     void merge_partition_versions();
 
+    // Like merge_partition_versions(), but stops when the task quota is
+    // exhausted, leaving the snapshot in a state from which the merge can be
+    // resumed. Returns stop_iteration::yes when there is nothing more to merge.
+    // Adds the number of merged versions to merged.
+    stop_iteration merge_partition_versions_preemptibly(size_t& merged);
+
     ~partition_snapshot();
 
     partition_version_ref& version();
@@ -206,6 +216,9 @@ class partition_snapshot : public enable_lw_shared_from_this<partition_snapshot>
     }
 
     unsigned version_count();
+private:
+    template<typename Preempt>
+    stop_iteration do_merge_partition_versions(size_t& merged, Preempt&& preempt);
 };
 
 class partition_entry {
@@ -260,6 +273,19 @@ class partition_entry {
     void upgrade(schema_ptr from, schema_ptr to);
 
     lw_shared_ptr<partition_snapshot> read(schema_ptr entry_schema);
+
+    // Returns the partition held by this entry if it can be modified in place,
+    // that is if there are no snapshots of it and it has a single version.
+    // Returns nullptr otherwise.
+    mutation_partition* exclusive_partition();
+
+    // Calls func with each version of this entry, newest first.
+    template<typename Func>
+    void for_each_version(Func&& func) const {
+        for (auto v = _version.get(); v; v = v->next()) {
+            func(*v);
+        }
+    }
 };
 
 inline partition_version_ref& partition_snapshot::version()
@@ -270,3 +296,49 @@ inline partition_version_ref& partition_snapshot::version()
         return _entry->_version;
     }
 }
+
+// Merges the versions of released snapshots in the background, so that
+// neither the reader releasing a snapshot nor later reads of the partition
+// pay for squashing a long chain of versions at once.
+//
+// Snapshots handed over to the merger are merged in submission order, in a
+// preemptible task running under the allocator of the region holding them.
+// The merger must be destroyed before the region; snapshots still pending
+// by then are released without merging, and their versions are merged by
+// the next reader of the partition.
+class partition_version_merger {
+public:
+    struct stats {
+        uint64_t merged_versions = 0;
+        uint64_t pending = 0;
+        // Length of the version chain of snapshots handed over to mergers.
+        utils::estimated_histogram chain_length{64};
+    };
+private:
+    struct state {
+        logalloc::region* region;
+        logalloc::allocating_section section;
+        circular_buffer<lw_shared_ptr<partition_snapshot>> snapshots;
+        bool running = false;
+
+        explicit state(logalloc::region& r) : region(&r) { }
+    };
+    lw_shared_ptr<state> _state;
+private:
+    static void run(lw_shared_ptr<state>);
+    static void release(state&, lw_shared_ptr<partition_snapshot>) noexcept;
+public:
+    explicit partition_version_merger(logalloc::region&);
+    ~partition_version_merger();
+    partition_version_merger(partition_version_merger&&) = delete;
+
+    // Takes over snp, which must be allocated in the region of this merger.
+    // If snp is the last reference to the snapshot, merges its versions in
+    // the background, otherwise just releases it.
+    void merge(lw_shared_ptr<partition_snapshot> snp) noexcept;
+
+    size_t pending() const { return _state->snapshots.size(); }
+
+    // Shard-wide, across all mergers.
+    static stats& shard_stats();
+};
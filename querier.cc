@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <seastar/core/metrics.hh>
+
+#include "querier.hh"
+#include "schema.hh"
+#include "log.hh"
+
+namespace query {
+
+static logging::logger qclog("querier_cache");
+
+const std::chrono::seconds querier_cache::default_entry_ttl{10};
+
+querier_cache::querier_cache(std::chrono::seconds entry_ttl)
+    : _entry_ttl(entry_ttl)
+    , _expiry_timer([this] { scan_cache_entries(); })
+{
+    _expiry_timer.arm_periodic(_entry_ttl / 2);
+
+    namespace sm = seastar::metrics;
+    _metrics.add_group("querier_cache", {
+        sm::make_derive("inserts", _stats.inserts,
+                sm::description("Counts the queriers suspended at the end of a page.")),
+        sm::make_derive("lookups", _stats.lookups,
+                sm::description("Counts the pages which looked for the querier of the previous page.")),
+        sm::make_derive("misses", _stats.misses,
+                sm::description("Counts the pages which found no querier to resume, and created a new one.")),
+        sm::make_derive("time_based_evictions", _stats.time_based_evictions,
+                sm::description("Counts the queriers evicted because their next page didn't come in time.")),
+        sm::make_derive("resource_based_evictions", _stats.resource_based_evictions,
+                sm::description("Counts the queriers evicted to free the resources of their reads for new ones.")),
+        sm::make_gauge("population", _stats.population,
+                sm::description("The number of queriers suspended in the cache.")),
+    });
+}
+
+void querier_cache::erase(entries::iterator it) {
+    auto range = _index.equal_range(it->key);
+    for (auto i = range.first; i != range.second; ++i) {
+        if (i->second == it) {
+            _index.erase(i);
+            break;
+        }
+    }
+    _entries.erase(it);
+    --_stats.population;
+}
+
+void querier_cache::scan_cache_entries() {
+    auto expired = lowres_clock::now() - _entry_ttl;
+    while (!_entries.empty() && _entries.front().inserted <= expired) {
+        erase(_entries.begin());
+        ++_stats.time_based_evictions;
+    }
+}
+
+void querier_cache::insert(utils::UUID key, querier&& q) {
+    auto it = _entries.emplace(_entries.end(), entry{key, lowres_clock::now(), std::move(q)});
+    _index.emplace(key, it);
+    ++_stats.inserts;
+    ++_stats.population;
+}
+
+stdx::optional<querier> querier_cache::lookup(utils::UUID key, const schema& s, const dht::partition_range& range,
+        const partition_slice& slice) {
+    ++_stats.lookups;
+    auto candidates = _index.equal_range(key);
+    for (auto i = candidates.first; i != candidates.second; ++i) {
+        auto it = i->second;
+        if (it->q.resume_at(s, range, slice)) {
+            auto q = std::move(it->q);
+            erase(it);
+            return std::move(q);
+        }
+    }
+    qclog.trace("No querier of query {} resumes at {}", key, range);
+    ++_stats.misses;
+    return { };
+}
+
+bool querier_cache::evict_one() {
+    if (_entries.empty()) {
+        return false;
+    }
+    erase(_entries.begin());
+    ++_stats.resource_based_evictions;
+    return true;
+}
+
+void querier_cache::evict_all_for_table(const utils::UUID& schema_id) {
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        auto next = std::next(it);
+        if (it->q.schema()->id() == schema_id) {
+            erase(it);
+        }
+        it = next;
+    }
+}
+
+void querier_cache::set_entry_ttl(std::chrono::seconds entry_ttl) {
+    _entry_ttl = entry_ttl;
+    _expiry_timer.rearm_periodic(_entry_ttl / 2);
+}
+
+}
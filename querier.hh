@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include "core/timer.hh"
+#include "core/lowres_clock.hh"
+#include <seastar/core/metrics_registration.hh>
+#include "mutation_reader.hh"
+#include "query-request.hh"
+#include "query-result-writer.hh"
+#include "utils/UUID.hh"
+#include "stdx.hh"
+
+namespace query {
+
+class paged_data_query_state;
+
+// A data query which can be suspended at the end of a page and resumed in
+// the next one, reading on from where it stopped, with the same reader and
+// compaction state, instead of looking up the position of the next page
+// in the index and merging the sstables over again.
+//
+// The querier owns the range and the slice its reader was created with.
+class querier {
+    schema_ptr _schema;
+    std::unique_ptr<const dht::partition_range> _range;
+    std::unique_ptr<const partition_slice> _slice;
+    gc_clock::time_point _query_time;
+    mutation_reader _reader;
+    // For reversing the partitions of reversed reads window by window,
+    // see reverse_streamed_mutation_by_windows(). Only set for these.
+    mutation_source_opt _source;
+    const io_priority_class* _pc;
+    tracing::trace_state_ptr _trace_ptr;
+    partition_window_splitter _splitter;
+    // The partition the last page ended in, if any.
+    stdx::optional<streamed_mutation> _sm;
+    std::unique_ptr<paged_data_query_state> _state;
+    bool _exhausted = false;
+public:
+    querier(const mutation_source& ms, schema_ptr s, const dht::partition_range& range, const partition_slice& slice,
+            gc_clock::time_point query_time, const io_priority_class& pc, tracing::trace_state_ptr trace_ptr,
+            partition_window_splitter splitter = {});
+    querier(querier&&);
+    querier& operator=(querier&&);
+    ~querier();
+
+    const schema_ptr& schema() const {
+        return _schema;
+    }
+
+    // Reads the next page into builder, at most row_limit rows from at most
+    // partition_limit partitions.
+    future<> consume_page(result::builder& builder, uint32_t row_limit, uint32_t partition_limit,
+            reader_timeout_clock::time_point timeout);
+
+    // Whether the reader has nothing more to read.
+    bool is_exhausted() const {
+        return _exhausted;
+    }
+
+    // Whether the next page, reading range with slice, starts where the
+    // last page ended. May skip the rest of the last partition, if the
+    // page starts after it.
+    bool resume_at(const schema& s, const dht::partition_range& range, const partition_slice& slice);
+};
+
+// The queriers suspended between the pages of paged queries, on a shard,
+// by the id of their query.
+//
+// Queriers are evicted after entry_ttl, and when the reads they hold the
+// resources of, which wait for no one while suspended, make new reads wait.
+class querier_cache {
+public:
+    static const std::chrono::seconds default_entry_ttl;
+
+    struct stats {
+        uint64_t inserts = 0;
+        uint64_t lookups = 0;
+        uint64_t misses = 0;
+        uint64_t time_based_evictions = 0;
+        uint64_t resource_based_evictions = 0;
+        uint64_t population = 0;
+    };
+private:
+    struct entry {
+        utils::UUID key;
+        lowres_clock::time_point inserted;
+        querier q;
+    };
+    using entries = std::list<entry>;
+    // Oldest first.
+    entries _entries;
+    std::unordered_multimap<utils::UUID, entries::iterator> _index;
+    std::chrono::seconds _entry_ttl;
+    timer<lowres_clock> _expiry_timer;
+    stats _stats;
+    seastar::metrics::metric_groups _metrics;
+private:
+    void erase(entries::iterator it);
+    void scan_cache_entries();
+public:
+    explicit querier_cache(std::chrono::seconds entry_ttl = default_entry_ttl);
+    querier_cache(const querier_cache&) = delete;
+
+    void insert(utils::UUID key, querier&& q);
+
+    // The querier of the query key which resumes at the start of range,
+    // removed from the cache.
+    stdx::optional<querier> lookup(utils::UUID key, const schema& s, const dht::partition_range& range,
+            const partition_slice& slice);
+
+    // Evicts the oldest querier, releasing the resources of its reads.
+    // Returns false if the cache is empty.
+    bool evict_one();
+
+    // Evicts the queriers reading the table, before it goes away.
+    void evict_all_for_table(const utils::UUID& schema_id);
+
+    void set_entry_ttl(std::chrono::seconds entry_ttl);
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
+
+}
@@ -89,13 +89,29 @@ class specific_ranges {
 
 constexpr auto max_rows = std::numeric_limits<uint32_t>::max();
 
+enum class filter_op : uint8_t { eq, lt, lte, gt, gte, in };
+
+// A restriction on a regular column, which replicas check on each row
+// they read, so that only the matching rows are returned, and counted
+// against the limits of the query.
+struct column_filter {
+    column_id id;
+    filter_op op;
+    // A single value, except for filter_op::in.
+    std::vector<bytes> values;
+
+    bool is_satisfied_by(const abstract_type& type, bytes_view value) const;
+
+    friend std::ostream& operator<<(std::ostream& out, const column_filter& f);
+};
+
 // Specifies subset of rows, columns and cell attributes to be returned in a query.
 // Can be accessed across cores.
 // Schema-dependent.
 class partition_slice {
 public:
     enum class option { send_clustering_key, send_partition_key, send_timestamp, send_expiry, reversed, distinct, collections_as_maps, send_ttl,
-                        allow_short_read, };
+                        allow_short_read, bypass_cache, };
     using option_set = enum_set<super_enum<option,
         option::send_clustering_key,
         option::send_partition_key,
@@ -105,7 +121,8 @@ class partition_slice {
         option::distinct,
         option::collections_as_maps,
         option::send_ttl,
-        option::allow_short_read>>;
+        option::allow_short_read,
+        option::bypass_cache>>;
     clustering_row_ranges _row_ranges;
 public:
     std::vector<column_id> static_columns; // TODO: consider using bitmap
@@ -115,12 +132,15 @@ class partition_slice {
     std::unique_ptr<specific_ranges> _specific_ranges;
     cql_serialization_format _cql_format;
     uint32_t _partition_row_limit;
+    std::vector<column_filter> _filters;
+    bool _project_columns = false;
 public:
     partition_slice(clustering_row_ranges row_ranges, std::vector<column_id> static_columns,
         std::vector<column_id> regular_columns, option_set options,
         std::unique_ptr<specific_ranges> specific_ranges = nullptr,
         cql_serialization_format = cql_serialization_format::internal(),
-        uint32_t partition_row_limit = max_rows);
+        uint32_t partition_row_limit = max_rows,
+        std::vector<column_filter> filters = {});
     partition_slice(const partition_slice&);
     partition_slice(partition_slice&&);
     ~partition_slice();
@@ -148,6 +168,21 @@ class partition_slice {
     void set_partition_row_limit(uint32_t limit) {
         _partition_row_limit = limit;
     }
+    // Rows not satisfying all the filters are not returned. Only
+    // cluster_supports_replica_filtering() replicas know about them.
+    const std::vector<column_filter>& filters() const {
+        return _filters;
+    }
+    // Readers whose output only goes into a query::result may leave out the
+    // values of the cells of the columns which are neither selected nor
+    // filtered on, keeping the cells for the liveness of their rows. Local
+    // to the replica, not sent to other nodes.
+    bool project_columns() const {
+        return _project_columns;
+    }
+    void set_project_columns(bool project) {
+        _project_columns = project;
+    }
 
     friend std::ostream& operator<<(std::ostream& out, const partition_slice& ps);
     friend std::ostream& operator<<(std::ostream& out, const specific_ranges& ps);
@@ -172,6 +207,14 @@ class read_command {
     std::experimental::optional<tracing::trace_info> trace_info;
     uint32_t partition_limit; // The maximum number of live partitions to return.
     api::timestamp_type read_timestamp; // not serialized
+    // The workload the query belongs to, scheduling its reads on the
+    // replicas, see priority_manager::add_workload().
+    std::experimental::optional<sstring> workload;
+    // The id of the paged query the command reads a page of, by which the
+    // replicas keep the reads of the query between pages, see querier_cache.
+    // Null for queries which aren't paged.
+    utils::UUID query_uuid;
+    bool is_first_page = false;
 public:
     read_command(utils::UUID cf_id,
                  table_schema_version schema_version,
@@ -191,7 +234,35 @@ class read_command {
         , read_timestamp(rt)
     { }
 
+    // For the IDL.
+    read_command(utils::UUID cf_id,
+                 table_schema_version schema_version,
+                 partition_slice slice,
+                 uint32_t row_limit,
+                 gc_clock::time_point now,
+                 std::experimental::optional<tracing::trace_info> ti,
+                 uint32_t partition_limit,
+                 std::experimental::optional<sstring> workload,
+                 utils::UUID query_uuid,
+                 bool is_first_page)
+        : read_command(std::move(cf_id), std::move(schema_version), std::move(slice), row_limit, now, std::move(ti), partition_limit)
+    {
+        this->workload = std::move(workload);
+        this->query_uuid = query_uuid;
+        this->is_first_page = is_first_page;
+    }
+
     friend std::ostream& operator<<(std::ostream& out, const read_command& r);
 };
 
+// An aggregate function of a query computed on the node which reads the
+// data, so that only its partial result is sent back to the coordinator.
+// See storage_proxy::query_aggregates().
+struct aggregate_selector {
+    // One of "countRows" (for COUNT(*)), "count", "sum", "min" and "max".
+    sstring function_name;
+    // The regular column being aggregated, absent for countRows.
+    std::experimental::optional<sstring> column_name;
+};
+
 }
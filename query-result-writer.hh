@@ -25,7 +25,7 @@
 #include "atomic_cell.hh"
 #include "query-request.hh"
 #include "query-result.hh"
-#include "digest_algorithm.hh"
+#include "digester.hh"
 
 #include "idl/uuid.dist.hh"
 #include "idl/keys.dist.hh"
@@ -49,8 +49,8 @@ class result::partition_writer {
     ser::query_result__partitions<bytes_ostream>& _pw;
     ser::vector_position _pos;
     bool _static_row_added = false;
-    md5_hasher& _digest;
-    md5_hasher _digest_pos;
+    digester& _digest;
+    digester _digest_pos;
     uint32_t& _row_count;
     uint32_t& _partition_count;
     api::timestamp_type& _last_modified;
@@ -62,7 +62,7 @@ class result::partition_writer {
         ser::query_result__partitions<bytes_ostream>& pw,
         ser::vector_position pos,
         ser::after_qr_partition__key<bytes_ostream> w,
-        md5_hasher& digest,
+        digester& digest,
         uint32_t& row_count,
         uint32_t& partition_count,
         api::timestamp_type& last_modified)
@@ -105,7 +105,7 @@ class result::partition_writer {
     const partition_slice& slice() const {
         return _slice;
     }
-    md5_hasher& digest() {
+    digester& digest() {
         return _digest;
     }
     uint32_t& row_count() {
@@ -122,7 +122,7 @@ class result::partition_writer {
 
 class result::builder {
     bytes_ostream _out;
-    md5_hasher _digest;
+    digester _digest;
     const partition_slice& _slice;
     ser::query_result__partitions<bytes_ostream> _w;
     result_request _request;
@@ -132,8 +132,10 @@ class result::builder {
     short_read _short_read;
     result_memory_accounter _memory_accounter;
 public:
-    builder(const partition_slice& slice, result_request request, result_memory_accounter memory_accounter)
-        : _slice(slice)
+    builder(const partition_slice& slice, result_request request, result_memory_accounter memory_accounter,
+            digest_algorithm da = digest_algorithm::MD5)
+        : _digest(da)
+        , _slice(slice)
         , _w(ser::writer_of_query_result<bytes_ostream>(_out).start_partitions())
         , _request(request)
         , _memory_accounter(std::move(memory_accounter))
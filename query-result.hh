@@ -386,6 +386,13 @@ class result {
         return _short_read;
     }
 
+    // Ends the result here even though the replicas could have returned
+    // more, so that the results merged after it are dropped and the pager
+    // continues from its last row.
+    void mark_as_short_read() {
+        _short_read = short_read::yes;
+    }
+
     const stdx::optional<uint32_t>& partition_count() const {
         return _partition_count;
     }
@@ -20,6 +20,8 @@
  */
 
 #include <limits>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/numeric.hpp>
 #include "query-request.hh"
 #include "query-result.hh"
 #include "query-result-writer.hh"
@@ -56,9 +58,33 @@ std::ostream& operator<<(std::ostream& out, const partition_slice& ps) {
     out << ", options=" << sprint("%x", ps.options.mask()); // FIXME: pretty print options
     out << ", cql_format=" << ps.cql_format();
     out << ", partition_row_limit=" << ps._partition_row_limit;
+    if (!ps._filters.empty()) {
+        out << ", filters=[" << join(", ", ps._filters) << "]";
+    }
     return out << "}";
 }
 
+bool column_filter::is_satisfied_by(const abstract_type& type, bytes_view value) const {
+    auto cmp = [&] { return type.compare(value, values.front()); };
+    switch (op) {
+    case filter_op::eq: return cmp() == 0;
+    case filter_op::lt: return cmp() < 0;
+    case filter_op::lte: return cmp() <= 0;
+    case filter_op::gt: return cmp() > 0;
+    case filter_op::gte: return cmp() >= 0;
+    case filter_op::in:
+        return std::any_of(values.begin(), values.end(), [&] (const bytes& v) {
+            return type.compare(value, v) == 0;
+        });
+    }
+    abort();
+}
+
+std::ostream& operator<<(std::ostream& out, const column_filter& f) {
+    static const char* ops[] = { "=", "<", "<=", ">", ">=", "IN" };
+    return out << "{column=" << f.id << " " << ops[static_cast<unsigned>(f.op)] << " " << join(", ", f.values) << "}";
+}
+
 std::ostream& operator<<(std::ostream& out, const read_command& r) {
     return out << "read_command{"
         << "cf_id=" << r.cf_id
@@ -66,7 +92,10 @@ std::ostream& operator<<(std::ostream& out, const read_command& r) {
         << ", slice=" << r.slice << ""
         << ", limit=" << r.row_limit
         << ", timestamp=" << r.timestamp.time_since_epoch().count() << "}"
-        << ", partition_limit=" << r.partition_limit << "}";
+        << ", partition_limit=" << r.partition_limit
+        << ", workload=" << (r.workload ? *r.workload : sstring("none"))
+        << ", query_uuid=" << r.query_uuid
+        << ", is_first_page=" << r.is_first_page << "}";
 }
 
 std::ostream& operator<<(std::ostream& out, const specific_ranges& s) {
@@ -79,7 +108,8 @@ partition_slice::partition_slice(clustering_row_ranges row_ranges,
     option_set options,
     std::unique_ptr<specific_ranges> specific_ranges,
     cql_serialization_format cql_format,
-    uint32_t partition_row_limit)
+    uint32_t partition_row_limit,
+    std::vector<column_filter> filters)
     : _row_ranges(std::move(row_ranges))
     , static_columns(std::move(static_columns))
     , regular_columns(std::move(regular_columns))
@@ -87,6 +117,7 @@ partition_slice::partition_slice(clustering_row_ranges row_ranges,
     , _specific_ranges(std::move(specific_ranges))
     , _cql_format(std::move(cql_format))
     , _partition_row_limit(partition_row_limit)
+    , _filters(std::move(filters))
 {}
 
 partition_slice::partition_slice(partition_slice&&) = default;
@@ -103,6 +134,8 @@ partition_slice::partition_slice(const partition_slice& s)
     , _specific_ranges(s._specific_ranges ? std::make_unique<specific_ranges>(*s._specific_ranges) : nullptr)
     , _cql_format(s._cql_format)
     , _partition_row_limit(s._partition_row_limit)
+    , _filters(s._filters)
+    , _project_columns(s._project_columns)
 {}
 
 partition_slice::~partition_slice()
@@ -229,6 +262,7 @@ foreign_ptr<lw_shared_ptr<query::result>> result_merger::get() {
     }
 
     bytes_ostream w;
+    w.reserve(boost::accumulate(_partial | boost::adaptors::transformed([] (auto&& r) { return r->buf().size(); }), size_t(0)));
     auto partitions = ser::writer_of_query_result<bytes_ostream>(w).start_partitions();
     uint32_t row_count = 0;
     short_read is_short_read;
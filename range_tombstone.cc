@@ -68,10 +68,14 @@ void range_tombstone_accumulator::drop_unneeded_tombstones(const clustering_key_
     auto cmp = [&] (bound_view bv, const clustering_key_prefix& ck, int w) {
         return _reversed ? _cmp(ck, w, bv.prefix, weight(bv.kind)) : _cmp(bv.prefix, weight(bv.kind), ck, w);
     };
+    bool dropped = false;
     while (!_range_tombstones.empty() && cmp(_range_tombstones.begin()->end_bound(), ck, w)) {
         _range_tombstones.pop_front();
+        dropped = true;
+    }
+    if (dropped) {
+        update_current_tombstone();
     }
-    update_current_tombstone();
 }
 
 void range_tombstone_accumulator::apply(range_tombstone rt) {
@@ -273,6 +273,13 @@ range_tombstone_list range_tombstone_list::difference(const schema& s, const ran
 }
 
 void range_tombstone_list::apply(const schema& s, const range_tombstone_list& rt_list) {
+    if (empty()) {
+        // rt_list is already disjoint and ordered.
+        for (auto&& rt : rt_list) {
+            _tombstones.push_back(*current_allocator().construct<range_tombstone>(rt));
+        }
+        return;
+    }
     for (auto&& rt : rt_list) {
         apply(s, rt);
     }
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "reader_concurrency_semaphore.hh"
+
+constexpr ssize_t reader_concurrency_semaphore::new_reader_base_cost;
+
+reader_concurrency_semaphore::reader_permit::reader_permit(reader_concurrency_semaphore& semaphore, resources base_cost)
+    : _semaphore(semaphore)
+    , _base_cost(base_cost) {
+}
+
+reader_concurrency_semaphore::reader_permit::~reader_permit() {
+    _semaphore.signal(_base_cost);
+}
+
+void reader_concurrency_semaphore::reader_permit::consume_memory(size_t memory) {
+    _semaphore.consume(resources(0, memory));
+}
+
+void reader_concurrency_semaphore::reader_permit::signal_memory(size_t memory) {
+    _semaphore.signal(resources(0, memory));
+}
+
+void reader_concurrency_semaphore::signal(const resources& r) {
+    _resources += r;
+    while (!_wait_list.empty() && may_admit(_wait_list.front().res)) {
+        auto& x = _wait_list.front();
+        consume(x.res);
+        x.pr.set_value(make_lw_shared<reader_permit>(*this, x.res));
+        _wait_list.pop_front();
+    }
+}
+
+future<lw_shared_ptr<reader_permit>> reader_concurrency_semaphore::wait_admission(clock::time_point timeout) {
+    auto r = resources(1, new_reader_base_cost);
+    // Evicted readers signal their resources, admitting the waiters first.
+    while (!may_admit(r) && _evict_an_inactive_reader && _evict_an_inactive_reader()) { }
+    if (_wait_list.empty() && may_admit(r)) {
+        consume(r);
+        return make_ready_future<lw_shared_ptr<reader_permit>>(make_lw_shared<reader_permit>(*this, r));
+    }
+    promise<lw_shared_ptr<reader_permit>> pr;
+    auto fut = pr.get_future();
+    _wait_list.push_back(entry(std::move(pr), r), timeout);
+    return fut;
+}
+
+// Forwards everything to the tracked file, and charges the buffers
+// returned by dma_read_bulk() to the permit until they are freed.
+class tracking_file_impl : public file_impl {
+    file _tracked_file;
+    lw_shared_ptr<reader_permit> _permit;
+public:
+    tracking_file_impl(file tracked_file, lw_shared_ptr<reader_permit> permit)
+        : _tracked_file(std::move(tracked_file))
+        , _permit(std::move(permit)) {
+        _memory_dma_alignment = _tracked_file.memory_dma_alignment();
+        _disk_read_dma_alignment = _tracked_file.disk_read_dma_alignment();
+        _disk_write_dma_alignment = _tracked_file.disk_write_dma_alignment();
+    }
+
+    virtual future<size_t> write_dma(uint64_t pos, const void* buffer, size_t len, const io_priority_class& pc) override {
+        return get_file_impl(_tracked_file)->write_dma(pos, buffer, len, pc);
+    }
+
+    virtual future<size_t> write_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return get_file_impl(_tracked_file)->write_dma(pos, std::move(iov), pc);
+    }
+
+    virtual future<size_t> read_dma(uint64_t pos, void* buffer, size_t len, const io_priority_class& pc) override {
+        return get_file_impl(_tracked_file)->read_dma(pos, buffer, len, pc);
+    }
+
+    virtual future<size_t> read_dma(uint64_t pos, std::vector<iovec> iov, const io_priority_class& pc) override {
+        return get_file_impl(_tracked_file)->read_dma(pos, std::move(iov), pc);
+    }
+
+    virtual future<> flush() override {
+        return get_file_impl(_tracked_file)->flush();
+    }
+
+    virtual future<struct stat> stat() override {
+        return get_file_impl(_tracked_file)->stat();
+    }
+
+    virtual future<> truncate(uint64_t length) override {
+        return get_file_impl(_tracked_file)->truncate(length);
+    }
+
+    virtual future<> discard(uint64_t offset, uint64_t length) override {
+        return get_file_impl(_tracked_file)->discard(offset, length);
+    }
+
+    virtual future<> allocate(uint64_t position, uint64_t length) override {
+        return get_file_impl(_tracked_file)->allocate(position, length);
+    }
+
+    virtual future<uint64_t> size() override {
+        return get_file_impl(_tracked_file)->size();
+    }
+
+    virtual future<> close() override {
+        return get_file_impl(_tracked_file)->close();
+    }
+
+    virtual std::unique_ptr<seastar::file_handle_impl> dup() override {
+        return get_file_impl(_tracked_file)->dup();
+    }
+
+    virtual subscription<directory_entry> list_directory(std::function<future<> (directory_entry de)> next) override {
+        return get_file_impl(_tracked_file)->list_directory(std::move(next));
+    }
+
+    virtual future<temporary_buffer<uint8_t>> dma_read_bulk(uint64_t offset, size_t range_size, const io_priority_class& pc) override {
+        return get_file_impl(_tracked_file)->dma_read_bulk(offset, range_size, pc).then([permit = _permit] (temporary_buffer<uint8_t> buf) {
+            auto size = buf.size();
+            permit->consume_memory(size);
+            return make_ready_future<temporary_buffer<uint8_t>>(temporary_buffer<uint8_t>(buf.get_write(), size,
+                    make_deleter(buf.release(), [permit = std::move(permit), size] {
+                        permit->signal_memory(size);
+                    })));
+        });
+    }
+};
+
+file reader_resource_tracker::track(file f) const {
+    if (!_permit) {
+        return f;
+    }
+    return file(make_shared<tracking_file_impl>(std::move(f), _permit));
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include "core/file.hh"
+#include "core/future.hh"
+#include "core/shared_ptr.hh"
+#include "core/expiring_fifo.hh"
+#include "core/lowres_clock.hh"
+#include "seastarx.hh"
+
+// Admits the readers of sstables by both their number and the memory of
+// the buffers they read from disk.
+//
+// A reader is admitted while there are free reader slots and more free
+// memory than its base cost, and holds a slot and its base cost until
+// destroyed. The buffers it reads from the index and data files through
+// its reader_resource_tracker are charged to it as they come in, and
+// credited back when freed, so that a few readers of wide partitions use
+// up the memory and make the next readers wait, where they would each
+// have counted for one reader. Readers are admitted in the order they
+// asked.
+class reader_concurrency_semaphore {
+public:
+    using clock = lowres_clock;
+
+    struct resources {
+        int count = 0;
+        ssize_t memory = 0;
+
+        resources() = default;
+        resources(int count, ssize_t memory) : count(count), memory(memory) { }
+
+        resources& operator+=(const resources& o) {
+            count += o.count;
+            memory += o.memory;
+            return *this;
+        }
+        resources& operator-=(const resources& o) {
+            count -= o.count;
+            memory -= o.memory;
+            return *this;
+        }
+    };
+
+    // The resources of an admitted reader, released when destroyed.
+    class reader_permit {
+        reader_concurrency_semaphore& _semaphore;
+        resources _base_cost;
+    public:
+        reader_permit(reader_concurrency_semaphore& semaphore, resources base_cost);
+        ~reader_permit();
+        reader_permit(const reader_permit&) = delete;
+
+        void consume_memory(size_t memory);
+        void signal_memory(size_t memory);
+    };
+private:
+    struct entry {
+        promise<lw_shared_ptr<reader_permit>> pr;
+        resources res;
+        entry(promise<lw_shared_ptr<reader_permit>>&& pr, resources res) : pr(std::move(pr)), res(res) { }
+    };
+    struct expiry_handler {
+        void operator()(entry& e) noexcept {
+            e.pr.set_exception(semaphore_timed_out());
+        }
+    };
+
+    const resources _initial_resources;
+    resources _resources;
+    expiring_fifo<entry, expiry_handler, clock> _wait_list;
+    std::function<bool ()> _evict_an_inactive_reader;
+private:
+    bool may_admit(const resources& r) const {
+        return _resources.count >= r.count && _resources.memory >= r.memory;
+    }
+    void consume(const resources& r) {
+        _resources -= r;
+    }
+    void signal(const resources& r);
+public:
+    // The memory a reader needs to be admitted, before it read anything.
+    static constexpr ssize_t new_reader_base_cost = 16 * 1024;
+
+    reader_concurrency_semaphore(int count, ssize_t memory)
+        : _initial_resources(count, memory)
+        , _resources(count, memory) {
+    }
+    reader_concurrency_semaphore(const reader_concurrency_semaphore&) = delete;
+
+    // Sets the function called when a reader cannot be admitted, to release
+    // the resources held by a reader which isn't reading, like the ones of
+    // suspended paged queries. Returns false if there is no such reader.
+    void set_evict_an_inactive_reader(std::function<bool ()> fn) {
+        _evict_an_inactive_reader = std::move(fn);
+    }
+
+    future<lw_shared_ptr<reader_permit>> wait_admission(clock::time_point timeout = clock::time_point::max());
+
+    const resources& initial_resources() const {
+        return _initial_resources;
+    }
+    // The memory can be negative, when the admitted readers read more than
+    // the semaphore has.
+    const resources& available_resources() const {
+        return _resources;
+    }
+    size_t waiters() const {
+        return _wait_list.size();
+    }
+};
+
+using reader_permit = reader_concurrency_semaphore::reader_permit;
+
+// Charges the buffers read by a reader to its permit, if any.
+class reader_resource_tracker {
+    lw_shared_ptr<reader_permit> _permit;
+public:
+    reader_resource_tracker() = default;
+    explicit reader_resource_tracker(lw_shared_ptr<reader_permit> permit) : _permit(std::move(permit)) { }
+
+    // The file whose dma_read_bulk() buffers, used by the file input
+    // streams, are charged to the permit for as long as they live.
+    file track(file f) const;
+};
+
+inline reader_resource_tracker no_resource_tracking() {
+    return reader_resource_tracker();
+}
@@ -28,16 +28,24 @@
 #include "db/config.hh"
 #include "service/storage_service.hh"
 #include "service/priority_manager.hh"
+#include "service/storage_proxy.hh"
+#include "service/migration_manager.hh"
 #include "message/messaging_service.hh"
+#include "frozen_mutation.hh"
+#include "utils/murmur_hash.hh"
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/cxx11/any_of.hpp>
+#include <boost/algorithm/cxx11/all_of.hpp>
 #include <boost/range/algorithm.hpp>
+#include <boost/range/irange.hpp>
 
 #include <cryptopp/sha.h>
 #include <seastar/core/gate.hh>
+#include "utils/task_group.hh"
+#include <deque>
 
 static logging::logger rlogger("repair");
 
@@ -46,6 +54,34 @@ struct failed_range {
     ::dht::token_range range;
 };
 
+using repair_clock = std::chrono::steady_clock;
+
+static std::chrono::milliseconds elapsed_since(repair_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(repair_clock::now() - start);
+}
+
+repair_stats& repair_stats::operator+=(const repair_stats& o) {
+    ranges_checked += o.ranges_checked;
+    ranges_mismatched += o.ranges_mismatched;
+    bytes_hashed += o.bytes_hashed;
+    bytes_streamed += o.bytes_streamed;
+    checksum_time += o.checksum_time;
+    sync_time += o.sync_time;
+    streaming_time += o.streaming_time;
+    return *this;
+}
+
+// The stats of the repairs run by this shard, by repair id. Like failed
+// repairs in the tracker, they are kept so they can be queried after the
+// repair completed.
+static thread_local std::unordered_map<int, repair_stats> repair_stats_on_shard;
+
+struct traced_range {
+    sstring cf;
+    ::dht::token_range range;
+    std::chrono::milliseconds duration;
+};
+
 class repair_info {
 public:
     seastar::sharded<database>& db;
@@ -57,11 +93,23 @@ class repair_info {
     std::vector<sstring> data_centers;
     std::vector<sstring> hosts;
     std::vector<failed_range> failed_ranges;
+    repair_stats& stats;
+    // With tracing, the slowest subranges checked and synced, slowest first.
+    bool trace;
+    static constexpr size_t max_traced_ranges = 10;
+    std::vector<traced_range> slowest_ranges;
     // Map of peer -> <cf, ranges>
     std::unordered_map<gms::inet_address, std::unordered_map<sstring, dht::token_range_vector>> ranges_need_repair_in;
     std::unordered_map<gms::inet_address, std::unordered_map<sstring, dht::token_range_vector>> ranges_need_repair_out;
     // FIXME: this "100" needs to be a parameter.
     uint64_t target_partitions = 100;
+    // When the cluster supports checksumming several ranges in one request,
+    // ranges are first split into subranges this many times larger than
+    // target_partitions. Those whose checksums differ are split into
+    // checksum_fanout children, down to target_partitions, and only the
+    // children whose checksums differ are synced.
+    uint64_t checksum_split_factor = 256;
+    unsigned checksum_fanout = 4;
     // This affects how many ranges we put in a stream plan. The more the more
     // memory we use to store the ranges in memory. However, it can reduce the
     // total number of stream_plan we use for the repair.
@@ -79,7 +127,8 @@ class repair_info {
             const std::vector<sstring>& cfs_,
             int id_,
             const std::vector<sstring>& data_centers_,
-            const std::vector<sstring>& hosts_)
+            const std::vector<sstring>& hosts_,
+            bool trace_)
         : db(db_)
         , keyspace(keyspace_)
         , ranges(ranges_)
@@ -87,7 +136,9 @@ class repair_info {
         , id(id_)
         , shard(engine().cpu_id())
         , data_centers(data_centers_)
-        , hosts(hosts_) {
+        , hosts(hosts_)
+        , stats(repair_stats_on_shard[id_])
+        , trace(trace_) {
     }
     future<> do_streaming() {
         size_t ranges_in = 0;
@@ -124,13 +175,36 @@ class repair_info {
         }
         sp_index++;
 
+        auto start = repair_clock::now();
         return sp_in->execute().discard_result().then([sp_in, sp_out] {
                 return sp_out->execute().discard_result();
         }).handle_exception([] (auto ep) {
             rlogger.warn("repair's stream failed: {}", ep);
             return make_exception_future(ep);
+        }).finally([this, start] {
+            stats.streaming_time += elapsed_since(start);
         });
     }
+    void trace_range(const sstring& cf, const ::dht::token_range& range, std::chrono::milliseconds duration) {
+        auto it = std::find_if(slowest_ranges.begin(), slowest_ranges.end(), [duration] (const traced_range& r) {
+            return r.duration < duration;
+        });
+        if (it == slowest_ranges.end() && slowest_ranges.size() >= max_traced_ranges) {
+            return;
+        }
+        slowest_ranges.insert(it, traced_range{cf, range, duration});
+        if (slowest_ranges.size() > max_traced_ranges) {
+            slowest_ranges.pop_back();
+        }
+    }
+    void log_stats() {
+        rlogger.info("repair {} on shard {}: ranges_checked={}, ranges_mismatched={}, bytes_hashed={}, bytes_streamed={}, checksum_time={}ms, sync_time={}ms, streaming_time={}ms",
+                id, shard, stats.ranges_checked, stats.ranges_mismatched, stats.bytes_hashed, stats.bytes_streamed,
+                stats.checksum_time.count(), stats.sync_time.count(), stats.streaming_time.count());
+        for (auto& r : slowest_ranges) {
+            rlogger.info("repair {} on shard {}: cf {} range {} took {}ms", id, shard, r.cf, r.range, r.duration.count());
+        }
+    }
     void check_failed_ranges() {
         if (failed_ranges.empty()) {
             rlogger.info("repair {} on shard {} completed successfully", id, shard);
@@ -382,11 +456,17 @@ static void check_in_shutdown() {
     repair_tracker.check_in_shutdown();
 }
 
+// The hashers add the length of the data they hash to *bytes_hashed, if given.
 class sha256_hasher {
     CryptoPP::SHA256 hash{};
+    uint64_t* _bytes_hashed;
 public:
+    explicit sha256_hasher(uint64_t* bytes_hashed = nullptr) : _bytes_hashed(bytes_hashed) { }
     void update(const char* ptr, size_t length) {
         static_assert(sizeof(char) == sizeof(byte), "Assuming lengths will be the same");
+        if (_bytes_hashed) {
+            *_bytes_hashed += length;
+        }
         hash.Update(reinterpret_cast<const byte*>(ptr), length * sizeof(byte));
     }
 
@@ -397,25 +477,46 @@ class sha256_hasher {
     }
 };
 
-future<partition_checksum> partition_checksum::compute_legacy(streamed_mutation m)
+class murmur3_hasher {
+    utils::murmur_hash::hasher3_x64_128 hash;
+    uint64_t* _bytes_hashed;
+public:
+    explicit murmur3_hasher(uint64_t* bytes_hashed = nullptr) : _bytes_hashed(bytes_hashed) { }
+    void update(const char* ptr, size_t length) {
+        if (_bytes_hashed) {
+            *_bytes_hashed += length;
+        }
+        hash.update(ptr, length);
+    }
+
+    void finalize(std::array<uint8_t, 32>& digest) {
+        std::array<uint64_t, 2> result;
+        hash.finalize(result);
+        digest.fill(0);
+        std::copy_n(reinterpret_cast<const uint8_t*>(result.data()), sizeof(result), digest.begin());
+    }
+};
+
+future<partition_checksum> partition_checksum::compute_legacy(streamed_mutation m, uint64_t* bytes_hashed)
 {
-    return mutation_from_streamed_mutation(std::move(m)).then([] (auto mopt) {
+    return mutation_from_streamed_mutation(std::move(m)).then([bytes_hashed] (auto mopt) {
         assert(mopt);
         std::array<uint8_t, 32> digest;
-        sha256_hasher h;
+        sha256_hasher h(bytes_hashed);
         feed_hash(h, *mopt);
         h.finalize(digest);
         return partition_checksum(digest);
     });
 }
 
-future<partition_checksum> partition_checksum::compute_streamed(streamed_mutation m)
+template <typename Hasher>
+future<partition_checksum> partition_checksum::compute_streamed(streamed_mutation m, uint64_t* bytes_hashed)
 {
     auto& s = *m.schema();
-    auto h = make_lw_shared<sha256_hasher>();
+    auto h = make_lw_shared<Hasher>(bytes_hashed);
     m.key().feed_hash(*h, s);
     return do_with(std::move(m), [&s, h] (auto& sm) mutable {
-        mutation_hasher<sha256_hasher> mh(s, *h);
+        mutation_hasher<Hasher> mh(s, *h);
         return consume(sm, std::move(mh)).then([ h ] {
             std::array<uint8_t, 32> digest;
             h->finalize(digest);
@@ -424,11 +525,12 @@ future<partition_checksum> partition_checksum::compute_streamed(streamed_mutatio
     });
 }
 
-future<partition_checksum> partition_checksum::compute(streamed_mutation m, repair_checksum hash_version)
+future<partition_checksum> partition_checksum::compute(streamed_mutation m, repair_checksum hash_version, uint64_t* bytes_hashed)
 {
     switch (hash_version) {
-    case repair_checksum::legacy: return compute_legacy(std::move(m));
-    case repair_checksum::streamed: return compute_streamed(std::move(m));
+    case repair_checksum::legacy: return compute_legacy(std::move(m), bytes_hashed);
+    case repair_checksum::streamed: return compute_streamed<sha256_hasher>(std::move(m), bytes_hashed);
+    case repair_checksum::streamed_murmur3: return compute_streamed<murmur3_hasher>(std::move(m), bytes_hashed);
     default: throw std::runtime_error(sprint("Unknown hash version: %d", static_cast<int>(hash_version)));
     }
 }
@@ -471,8 +573,43 @@ std::ostream& operator<<(std::ostream& out, const partition_checksum& c) {
     return out;
 }
 
+// Caches the checksums of ranges of this shard whose data is all in sstables,
+// keyed by the generations of those sstables. Since sstables are immutable,
+// such a checksum stays valid as long as the same sstables cover the range,
+// which is the case of ranges which weren't written to, or compacted, since
+// the previous repair.
+class checksum_cache {
+    // The oldest entries are evicted first.
+    static constexpr size_t max_entries = 64 * 1024;
+    std::unordered_map<sstring, partition_checksum> _checksums;
+    std::deque<sstring> _keys;
+public:
+    // The schema version is part of the key since it affects what is read,
+    // e.g. dropped columns are not.
+    static sstring key(const schema& s, const dht::partition_range_vector& prs, repair_checksum hash_version,
+            const std::vector<int64_t>& generations) {
+        return sprint("%s %s %d %s %s", s.id(), s.version(), static_cast<int>(hash_version), prs, generations);
+    }
+    const partition_checksum* find(const sstring& key) const {
+        auto it = _checksums.find(key);
+        return it == _checksums.end() ? nullptr : &it->second;
+    }
+    void insert(sstring key, partition_checksum checksum) {
+        if (!_checksums.emplace(key, checksum).second) {
+            return;
+        }
+        _keys.push_back(std::move(key));
+        if (_keys.size() > max_entries) {
+            _checksums.erase(_keys.front());
+            _keys.pop_front();
+        }
+    }
+};
+
+static thread_local checksum_cache range_checksum_cache;
+
 // Calculate the checksum of the data held *on this shard* of a column family,
-// in the given token range.
+// in the given token range, along with the number of bytes hashed.
 // All parameters to this function are constant references, and the caller
 // must ensure they live as long as the future returned by this function is
 // not resolved.
@@ -480,17 +617,25 @@ std::ostream& operator<<(std::ostream& out, const partition_checksum& c) {
 // so it would be useful to have this code cache its stopping point or have
 // some object live throughout the operation. Moreover, it makes sense to to
 // vary the collection of sstables used throught a long repair.
-static future<partition_checksum> checksum_range_shard(database &db,
+static future<std::pair<partition_checksum, uint64_t>> checksum_range_shard(database &db,
         const sstring& keyspace_name, const sstring& cf_name,
         const dht::partition_range_vector& prs, repair_checksum hash_version) {
     auto& cf = db.find_column_family(keyspace_name, cf_name);
+    auto generations = cf.sstable_generations_for(prs);
+    sstring key;
+    if (generations) {
+        key = checksum_cache::key(*cf.schema(), prs, hash_version, *generations);
+        if (auto checksum = range_checksum_cache.find(key)) {
+            return make_ready_future<std::pair<partition_checksum, uint64_t>>(*checksum, 0);
+        }
+    }
     auto reader = cf.make_streaming_reader(cf.schema(), prs);
-    return do_with(std::move(reader), partition_checksum(),
-        [hash_version] (auto& reader, auto& checksum) {
-        return repeat([&reader, &checksum, hash_version] () {
-            return reader().then([&checksum, hash_version] (auto mopt) {
+    return do_with(std::move(reader), partition_checksum(), uint64_t(0), std::move(key),
+        [&db, &keyspace_name, &cf_name, &prs, hash_version, generations = std::move(generations)] (auto& reader, auto& checksum, uint64_t& bytes_hashed, auto& key) {
+        return repeat([&reader, &checksum, &bytes_hashed, hash_version] () {
+            return reader().then([&checksum, &bytes_hashed, hash_version] (auto mopt) {
                 if (mopt) {
-                    return partition_checksum::compute(std::move(*mopt), hash_version).then([&checksum] (auto pc) {
+                    return partition_checksum::compute(std::move(*mopt), hash_version, &bytes_hashed).then([&checksum] (auto pc) {
                         checksum.add(pc);
                         return stop_iteration::no;
                     });
@@ -498,8 +643,14 @@ static future<partition_checksum> checksum_range_shard(database &db,
                     return make_ready_future<stop_iteration>(stop_iteration::yes);
                 }
             });
-        }).then([&checksum] {
-            return checksum;
+        }).then([&db, &keyspace_name, &cf_name, &prs, &checksum, &bytes_hashed, &key, generations = std::move(generations)] {
+            // Only cache the checksum if the range wasn't written to while it
+            // was read, so that it really is the checksum of those sstables.
+            if (generations && db.has_schema(keyspace_name, cf_name)
+                    && db.find_column_family(keyspace_name, cf_name).sstable_generations_for(prs) == generations) {
+                range_checksum_cache.insert(std::move(key), checksum);
+            }
+            return std::make_pair(checksum, bytes_hashed);
         });
     });
 }
@@ -517,19 +668,23 @@ static future<partition_checksum> checksum_range_shard(database &db,
 // function is not resolved.
 future<partition_checksum> checksum_range(seastar::sharded<database> &db,
         const sstring& keyspace, const sstring& cf,
-        const ::dht::token_range& range, repair_checksum hash_version) {
+        const ::dht::token_range& range, repair_checksum hash_version,
+        uint64_t* bytes_hashed) {
     auto& schema = db.local().find_column_family(keyspace, cf).schema();
     auto shard_ranges = dht::split_range_to_shards(dht::to_partition_range(range), *schema);
-    return do_with(partition_checksum(), std::move(shard_ranges), [&db, &keyspace, &cf, hash_version] (auto& result, auto& shard_ranges) {
-        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &result, hash_version] (auto& shard_range) {
+    return do_with(partition_checksum(), std::move(shard_ranges), [&db, &keyspace, &cf, hash_version, bytes_hashed] (auto& result, auto& shard_ranges) {
+        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &result, hash_version, bytes_hashed] (auto& shard_range) {
             auto& shard = shard_range.first;
             auto& prs = shard_range.second;
             return db.invoke_on(shard, [keyspace, cf, prs = std::move(prs), hash_version] (database& db) mutable {
                 return do_with(std::move(keyspace), std::move(cf), std::move(prs), [&db, hash_version] (auto& keyspace, auto& cf, auto& prs) {
                     return checksum_range_shard(db, keyspace, cf, prs, hash_version);
                 });
-            }).then([&result] (partition_checksum sum) {
-                result.add(sum);
+            }).then([&result, bytes_hashed] (std::pair<partition_checksum, uint64_t> sum) {
+                result.add(sum.first);
+                if (bytes_hashed) {
+                    *bytes_hashed += sum.second;
+                }
             });
         }).then([&result] {
             return make_ready_future<partition_checksum>(result);
@@ -537,6 +692,215 @@ future<partition_checksum> checksum_range(seastar::sharded<database> &db,
     });
 }
 
+future<std::vector<partition_checksum>> checksum_ranges(seastar::sharded<database> &db,
+        const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range_vector& ranges, repair_checksum hash_version,
+        uint64_t* bytes_hashed) {
+    return do_with(std::vector<partition_checksum>(ranges.size()), [&db, &keyspace, &cf, &ranges, hash_version, bytes_hashed] (auto& result) {
+        return parallel_for_each(boost::irange<size_t>(0, ranges.size()), [&db, &keyspace, &cf, &ranges, hash_version, bytes_hashed, &result] (size_t i) {
+            return checksum_range(db, keyspace, cf, ranges[i], hash_version, bytes_hashed).then([&result, i] (partition_checksum sum) {
+                result[i] = sum;
+            });
+        }).then([&result] {
+            return std::move(result);
+        });
+    });
+}
+
+// Splits each partition of a streamed mutation into its rows, each in a
+// mutation of its own, which are passed to func.
+template <typename Func>
+class row_splitter {
+    schema_ptr _schema;
+    const dht::decorated_key& _key;
+    Func& _func;
+private:
+    mutation make_row() const {
+        return mutation(_key, _schema);
+    }
+public:
+    row_splitter(schema_ptr s, const dht::decorated_key& key, Func& func)
+        : _schema(std::move(s)), _key(key), _func(func) { }
+
+    stop_iteration consume(tombstone t) {
+        if (t) {
+            auto m = make_row();
+            m.partition().apply(t);
+            _func(std::move(m));
+        }
+        return stop_iteration::no;
+    }
+
+    stop_iteration consume(range_tombstone&& rt) {
+        auto m = make_row();
+        m.partition().apply_row_tombstone(*_schema, std::move(rt));
+        _func(std::move(m));
+        return stop_iteration::no;
+    }
+
+    stop_iteration consume(static_row&& sr) {
+        auto m = make_row();
+        m.partition().static_row().apply(*_schema, column_kind::static_column, std::move(sr.cells()));
+        _func(std::move(m));
+        return stop_iteration::no;
+    }
+
+    stop_iteration consume(clustering_row&& cr) {
+        auto m = make_row();
+        auto& dr = m.partition().clustered_row(*_schema, std::move(cr.key()));
+        dr.apply(cr.tomb());
+        dr.apply(cr.marker());
+        dr.cells().apply(*_schema, column_kind::regular_column, std::move(cr.cells()));
+        _func(std::move(m));
+        return stop_iteration::no;
+    }
+
+    void consume_end_of_stream() { }
+};
+
+static uint64_t row_hash(const mutation& row) {
+    std::array<uint8_t, 32> digest;
+    sha256_hasher h;
+    feed_hash(h, row);
+    h.finalize(digest);
+    uint64_t hash;
+    std::copy_n(digest.begin(), sizeof(hash), reinterpret_cast<uint8_t*>(&hash));
+    return hash;
+}
+
+// Pass each row held *on this shard* of a column family, in the given ranges,
+// to func, in a mutation of its own. The same requirements on the parameters
+// as checksum_range_shard().
+template <typename Func>
+static future<> for_each_row_shard(database& db,
+        const sstring& keyspace_name, const sstring& cf_name,
+        const dht::partition_range_vector& prs, Func& func) {
+    auto& cf = db.find_column_family(keyspace_name, cf_name);
+    auto reader = cf.make_streaming_reader(cf.schema(), prs);
+    return do_with(std::move(reader), [&func] (auto& reader) {
+        return repeat([&reader, &func] () {
+            return reader().then([&func] (auto mopt) {
+                if (!mopt) {
+                    return make_ready_future<stop_iteration>(stop_iteration::yes);
+                }
+                return do_with(std::move(*mopt), [&func] (auto& sm) {
+                    return consume(sm, row_splitter<Func>(sm.schema(), sm.decorated_key(), func));
+                }).then([] {
+                    return stop_iteration::no;
+                });
+            });
+        });
+    });
+}
+
+future<std::vector<uint64_t>> repair_row_hashes(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range& range) {
+    auto& schema = db.local().find_column_family(keyspace, cf).schema();
+    auto shard_ranges = dht::split_range_to_shards(dht::to_partition_range(range), *schema);
+    return do_with(std::vector<uint64_t>(), std::move(shard_ranges), [&db, &keyspace, &cf] (auto& result, auto& shard_ranges) {
+        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &result] (auto& shard_range) {
+            auto& shard = shard_range.first;
+            auto& prs = shard_range.second;
+            return db.invoke_on(shard, [keyspace, cf, prs = std::move(prs)] (database& db) mutable {
+                return do_with(std::move(keyspace), std::move(cf), std::move(prs), std::vector<uint64_t>(),
+                        [&db] (auto& keyspace, auto& cf, auto& prs, auto& hashes) {
+                    auto add_hash = [&hashes] (mutation row) {
+                        hashes.push_back(row_hash(row));
+                    };
+                    return do_with(std::move(add_hash), [&db, &keyspace, &cf, &prs, &hashes] (auto& add_hash) {
+                        return for_each_row_shard(db, keyspace, cf, prs, add_hash).then([&hashes] {
+                            return std::move(hashes);
+                        });
+                    });
+                });
+            }).then([&result] (std::vector<uint64_t> hashes) {
+                result.insert(result.end(), hashes.begin(), hashes.end());
+            });
+        }).then([&result] {
+            return std::move(result);
+        });
+    });
+}
+
+future<std::vector<frozen_mutation>> repair_get_rows(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range& range, std::vector<uint64_t> hashes) {
+    auto& schema = db.local().find_column_family(keyspace, cf).schema();
+    auto shard_ranges = dht::split_range_to_shards(dht::to_partition_range(range), *schema);
+    std::unordered_set<uint64_t> wanted(hashes.begin(), hashes.end());
+    return do_with(std::vector<frozen_mutation>(), std::move(shard_ranges), std::move(wanted),
+            [&db, &keyspace, &cf] (auto& result, auto& shard_ranges, auto& wanted) {
+        return parallel_for_each(shard_ranges, [&db, &keyspace, &cf, &result, &wanted] (auto& shard_range) {
+            auto& shard = shard_range.first;
+            auto& prs = shard_range.second;
+            return db.invoke_on(shard, [keyspace, cf, prs = std::move(prs), wanted] (database& db) mutable {
+                return do_with(std::move(keyspace), std::move(cf), std::move(prs), std::move(wanted),
+                        std::vector<frozen_mutation>(), mutation_opt(),
+                        [&db] (auto& keyspace, auto& cf, auto& prs, auto& wanted, auto& rows, auto& current) {
+                    // The rows come partition by partition, those of the
+                    // current one are gathered in one mutation.
+                    auto add_row = [&wanted, &rows, &current] (mutation row) {
+                        if (!wanted.count(row_hash(row))) {
+                            return;
+                        }
+                        if (current && current->decorated_key().equal(*row.schema(), row.decorated_key())) {
+                            current->apply(std::move(row));
+                            return;
+                        }
+                        if (current) {
+                            rows.emplace_back(freeze(*current));
+                        }
+                        current = std::move(row);
+                    };
+                    return do_with(std::move(add_row), [&db, &keyspace, &cf, &prs, &rows, &current] (auto& add_row) {
+                        return for_each_row_shard(db, keyspace, cf, prs, add_row).then([&rows, &current] {
+                            if (current) {
+                                rows.emplace_back(freeze(*current));
+                            }
+                            return std::move(rows);
+                        });
+                    });
+                });
+            }).then([&result] (std::vector<frozen_mutation> rows) {
+                std::move(rows.begin(), rows.end(), std::back_inserter(result));
+            });
+        }).then([&result] {
+            return std::move(result);
+        });
+    });
+}
+
+// Flush the rows of the given range written with plan_id, on all shards, to
+// sstables.
+static future<> flush_rows(seastar::sharded<database>& db, utils::UUID plan_id,
+        const sstring& keyspace, const sstring& cf, const ::dht::token_range& range) {
+    return db.invoke_on_all([plan_id, keyspace, cf, range] (database& db) {
+        auto& t = db.find_column_family(keyspace, cf);
+        return t.flush_streaming_mutations(plan_id, dht::partition_range_vector{dht::to_partition_range(range)});
+    });
+}
+
+// Write the rows received from the node from, with plan_id, without
+// flushing them.
+static future<> apply_rows(gms::inet_address from, utils::UUID plan_id, std::vector<frozen_mutation> rows) {
+    return do_with(std::move(rows), [from, plan_id] (auto& rows) {
+        return parallel_for_each(rows, [from, plan_id] (const frozen_mutation& fm) {
+            return service::get_schema_for_write(fm.schema_version(), netw::msg_addr{from}).then([plan_id, &fm] (schema_ptr s) {
+                return service::get_local_storage_proxy().mutate_streaming_mutation(s, plan_id, fm, false);
+            });
+        });
+    });
+}
+
+future<> repair_put_rows(seastar::sharded<database>& db, gms::inet_address from,
+        utils::UUID plan_id, const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range& range, std::vector<frozen_mutation> rows) {
+    return apply_rows(from, plan_id, std::move(rows)).then([&db, plan_id, &keyspace, &cf, &range] {
+        return flush_rows(db, plan_id, keyspace, cf, range);
+    });
+}
+
 // We don't need to wait for one checksum to finish before we start the
 // next, but doing too many of these operations in parallel also doesn't
 // make sense, so we limit the number of concurrent ongoing checksum
@@ -571,6 +935,308 @@ static future<uint64_t> estimate_partitions(seastar::sharded<database>& db, cons
     );
 }
 
+// Sync a range which differs between this node and some of its neighbors row
+// by row: the rows of neighbors_in which this node lacks are fetched and
+// written to its sstables, then the rows this node has which those of
+// neighbors_out lack are sent to them. Only the hashes of the rows which are
+// the same on both sides go over the network, rather than the whole range.
+static future<> sync_rows(repair_info& ri, const sstring& cf, ::dht::token_range range,
+        std::vector<gms::inet_address> neighbors_in, std::vector<gms::inet_address> neighbors_out) {
+    auto plan_id = utils::UUID_gen::get_time_UUID();
+    std::unordered_set<gms::inet_address> peers(neighbors_in.begin(), neighbors_in.end());
+    peers.insert(neighbors_out.begin(), neighbors_out.end());
+    return do_with(std::move(peers), std::move(neighbors_in), std::move(neighbors_out), std::unordered_map<gms::inet_address, std::unordered_set<uint64_t>>(),
+            std::unordered_set<uint64_t>(), [&ri, &cf, range, plan_id] (auto& peers, auto& neighbors_in, auto& neighbors_out, auto& peer_hashes, auto& local_hashes) {
+        return parallel_for_each(peers, [&ri, &cf, range, &peer_hashes] (gms::inet_address peer) {
+            return netw::get_local_messaging_service().send_repair_row_hashes(netw::msg_addr{peer}, ri.keyspace, cf, range).then([&peer_hashes, peer] (std::vector<uint64_t> hashes) {
+                peer_hashes.emplace(peer, std::unordered_set<uint64_t>(hashes.begin(), hashes.end()));
+            });
+        }).then([&ri, &cf, range] {
+            return repair_row_hashes(ri.db, ri.keyspace, cf, range);
+        }).then([&ri, &cf, range, plan_id, &neighbors_in, &peer_hashes, &local_hashes] (std::vector<uint64_t> hashes) {
+            local_hashes.insert(hashes.begin(), hashes.end());
+            auto rows_in = make_lw_shared<size_t>(0);
+            return parallel_for_each(neighbors_in, [&ri, &cf, range, plan_id, &peer_hashes, &local_hashes, rows_in] (gms::inet_address peer) {
+                std::vector<uint64_t> missing;
+                for (auto h : peer_hashes[peer]) {
+                    if (!local_hashes.count(h)) {
+                        missing.push_back(h);
+                    }
+                }
+                if (missing.empty()) {
+                    return make_ready_future<>();
+                }
+                *rows_in += missing.size();
+                return netw::get_local_messaging_service().send_repair_get_rows(netw::msg_addr{peer}, ri.keyspace, cf, range, std::move(missing)).then(
+                        [&ri, peer, plan_id] (std::vector<frozen_mutation> rows) {
+                    for (auto& fm : rows) {
+                        ri.stats.bytes_streamed += fm.representation().size();
+                    }
+                    return apply_rows(peer, plan_id, std::move(rows));
+                });
+            }).then([&ri, &cf, range, plan_id, rows_in] {
+                if (!*rows_in) {
+                    return make_ready_future<bool>(false);
+                }
+                rlogger.debug("Fetched {} rows of range {} for repair id={}", *rows_in, range, ri.id);
+                return flush_rows(ri.db, plan_id, ri.keyspace, cf, range).then([] {
+                    return true;
+                });
+            });
+        }).then([&ri, &cf, range, &local_hashes] (bool fetched) {
+            // The fetched rows were merged with the local ones, which
+            // changes the hashes of those.
+            if (!fetched) {
+                return make_ready_future<>();
+            }
+            return repair_row_hashes(ri.db, ri.keyspace, cf, range).then([&local_hashes] (std::vector<uint64_t> hashes) {
+                local_hashes = std::unordered_set<uint64_t>(hashes.begin(), hashes.end());
+            });
+        }).then([&ri, &cf, range, plan_id, &neighbors_out, &peer_hashes, &local_hashes] {
+            return parallel_for_each(neighbors_out, [&ri, &cf, range, plan_id, &peer_hashes, &local_hashes] (gms::inet_address peer) {
+                auto& hashes = peer_hashes[peer];
+                std::vector<uint64_t> missing;
+                for (auto h : local_hashes) {
+                    if (!hashes.count(h)) {
+                        missing.push_back(h);
+                    }
+                }
+                if (missing.empty()) {
+                    return make_ready_future<>();
+                }
+                rlogger.debug("Sending {} rows of range {} to {} for repair id={}", missing.size(), range, peer, ri.id);
+                return repair_get_rows(ri.db, ri.keyspace, cf, range, std::move(missing)).then([&ri, &cf, range, plan_id, peer] (std::vector<frozen_mutation> rows) {
+                    for (auto& fm : rows) {
+                        ri.stats.bytes_streamed += fm.representation().size();
+                    }
+                    return netw::get_local_messaging_service().send_repair_put_rows(netw::msg_addr{peer}, plan_id, ri.keyspace, cf, range, std::move(rows));
+                });
+            });
+        });
+    });
+}
+
+// Sync a range of a cf given the checksums of the range on this node, first,
+// and on all neighbors.
+static future<> sync_range(repair_info& ri, const sstring& cf,
+        const ::dht::token_range& range, const std::vector<gms::inet_address>& neighbors,
+        bool& success, std::vector<future<partition_checksum>> checksums) {
+    // If only some of the replicas of this range are alive,
+    // we set success=false so repair will fail, but we can
+    // still do our best to repair available replicas.
+    std::vector<gms::inet_address> live_neighbors;
+    std::vector<partition_checksum> live_neighbors_checksum;
+    for (unsigned i = 0; i < checksums.size(); i++) {
+        if (checksums[i].failed()) {
+            rlogger.warn(
+                "Checksum of range {} on {} failed: {}",
+                range,
+                (i ? neighbors[i-1] :
+                 utils::fb_utilities::get_broadcast_address()),
+                checksums[i].get_exception());
+            success = false;
+            ri.failed_ranges.push_back(failed_range{cf, range});
+            // Do not break out of the loop here, so we can log
+            // (and discard) all the exceptions.
+        } else if (i > 0) {
+            live_neighbors.push_back(neighbors[i - 1]);
+            live_neighbors_checksum.push_back(checksums[i].get0());
+        }
+    }
+    if (!checksums[0].available() || live_neighbors.empty() || live_neighbors_checksum.empty()) {
+        return make_ready_future<>();
+    }
+    // If one of the available checksums is different, repair
+    // all the neighbors which returned a checksum.
+    auto checksum0 = checksums[0].get0();
+    std::vector<gms::inet_address> live_neighbors_in(live_neighbors);
+    std::vector<gms::inet_address> live_neighbors_out(live_neighbors);
+
+    std::unordered_map<partition_checksum, std::vector<gms::inet_address>> checksum_map;
+    for (size_t idx = 0 ; idx < live_neighbors.size(); idx++) {
+        checksum_map[live_neighbors_checksum[idx]].emplace_back(live_neighbors[idx]);
+    }
+
+    auto node_reducer = [] (std::vector<gms::inet_address>& live_neighbors_in_or_out,
+            std::vector<gms::inet_address>& nodes_with_same_checksum, size_t nr_nodes_to_keep) {
+        auto nr_nodes = nodes_with_same_checksum.size();
+        if (nr_nodes <= nr_nodes_to_keep) {
+            return;
+        }
+
+        // TODO: Remove the "far" nodes and keep the "near" nodes
+        // to have better streaming performance
+        nodes_with_same_checksum.resize(nr_nodes - nr_nodes_to_keep);
+
+        // Now, nodes_with_same_checksum contains nodes we want to remove, remove it from live_neighbors_in_or_out
+        auto it = boost::range::remove_if(live_neighbors_in_or_out, [&nodes_with_same_checksum] (const auto& ip) {
+            return boost::algorithm::any_of_equal(nodes_with_same_checksum, ip);
+        });
+        live_neighbors_in_or_out.erase(it, live_neighbors_in_or_out.end());
+    };
+
+    // Reduce in traffic
+    for (auto& item : checksum_map) {
+        auto& sum = item.first;
+        auto nodes_with_same_checksum = item.second;
+        // If remote nodes have the same checksum, fetch only from one of them
+        size_t nr_nodes_to_fetch = 1;
+        // If remote nodes have zero checksum or have the same
+        // checksum as local checksum, do not fetch from them at all
+        if (sum == partition_checksum() || sum == checksum0) {
+            nr_nodes_to_fetch = 0;
+        }
+        // E.g.,
+        // Local  Remote1 Remote2 Remote3
+        // 5      5       5       5         : IN: 0
+        // 5      5       5       0         : IN: 0
+        // 5      5       0       0         : IN: 0
+        // 5      0       0       0         : IN: 0
+        // 0      5       5       5         : IN: 1
+        // 0      5       5       0         : IN: 1
+        // 0      5       0       0         : IN: 1
+        // 0      0       0       0         : IN: 0
+        // 3      5       5       3         : IN: 1
+        // 3      5       3       3         : IN: 1
+        // 3      3       3       3         : IN: 0
+        // 3      5       4       3         : IN: 2
+        node_reducer(live_neighbors_in, nodes_with_same_checksum, nr_nodes_to_fetch);
+    }
+
+    // Reduce out traffic
+    if (live_neighbors_in.empty()) {
+        for (auto& item : checksum_map) {
+            auto& sum = item.first;
+            auto nodes_with_same_checksum = item.second;
+            // Skip to send to the nodes with the same checksum as local node
+            // E.g.,
+            // Local  Remote1 Remote2 Remote3
+            // 5      5       5       5         : IN: 0  OUT: 0 SKIP_OUT: Remote1, Remote2, Remote3
+            // 5      5       5       0         : IN: 0  OUT: 1 SKIP_OUT: Remote1, Remote2
+            // 5      5       0       0         : IN: 0  OUT: 2 SKIP_OUT: Remote1
+            // 5      0       0       0         : IN: 0  OUT: 3 SKIP_OUT: None
+            // 0      0       0       0         : IN: 0  OUT: 0 SKIP_OUT: Remote1, Remote2, Remote3
+            if (sum == checksum0) {
+                size_t nr_nodes_to_send = 0;
+                node_reducer(live_neighbors_out, nodes_with_same_checksum, nr_nodes_to_send);
+            }
+        }
+    } else if (live_neighbors_in.size() == 1 && checksum0 == partition_checksum()) {
+        for (auto& item : checksum_map) {
+            auto& sum = item.first;
+            auto nodes_with_same_checksum = item.second;
+            // Skip to send to the nodes with none zero checksum
+            // E.g.,
+            // Local  Remote1 Remote2 Remote3
+            // 0      5       5       5         : IN: 1  OUT: 0 SKIP_OUT: Remote1, Remote2, Remote3
+            // 0      5       5       0         : IN: 1  OUT: 1 SKIP_OUT: Remote1, Remote2
+            // 0      5       0       0         : IN: 1  OUT: 2 SKIP_OUT: Remote1
+            if (sum != checksum0) {
+                size_t nr_nodes_to_send = 0;
+                node_reducer(live_neighbors_out, nodes_with_same_checksum, nr_nodes_to_send);
+            }
+        }
+    }
+    if (!(live_neighbors_in.empty() && live_neighbors_out.empty())) {
+        rlogger.debug("Found differing range {} on nodes {}, in = {}, out = {}", range,
+                live_neighbors, live_neighbors_in, live_neighbors_out);
+        ri.stats.ranges_mismatched++;
+        auto start = repair_clock::now();
+        auto f = service::get_local_storage_service().cluster_supports_row_level_repair()
+                ? sync_rows(ri, cf, range, std::move(live_neighbors_in), std::move(live_neighbors_out))
+                : ri.request_transfer_ranges(cf, range, live_neighbors_in, live_neighbors_out);
+        return f.finally([&ri, start] {
+            ri.stats.sync_time += elapsed_since(start);
+        });
+    }
+    return make_ready_future<>();
+}
+
+// Repair a subrange of a cf, estimated to hold estimated_partitions, given its
+// checksums on this node, first, and on all neighbors. If the checksums differ
+// and the subrange is larger than target_partitions, it is split into
+// checksum_fanout children, whose checksums are fetched from each node in one
+// request, and each child is repaired the same way. Otherwise the subrange is
+// synced as a whole.
+static future<> repair_subrange(repair_info& ri, const sstring& cf,
+        ::dht::token_range range, uint64_t estimated_partitions,
+        const std::vector<gms::inet_address>& neighbors, bool& success,
+        repair_checksum checksum_type, std::vector<future<partition_checksum>> checksums) {
+    auto failed = std::any_of(checksums.begin(), checksums.end(), [] (auto& f) { return f.failed(); });
+    if (failed || estimated_partitions <= ri.target_partitions
+            || !service::get_local_storage_service().cluster_supports_repair_checksum_ranges()) {
+        return sync_range(ri, cf, range, neighbors, success, std::move(checksums));
+    }
+    std::vector<partition_checksum> sums;
+    sums.reserve(checksums.size());
+    for (auto& f : checksums) {
+        sums.push_back(f.get0());
+    }
+    if (boost::algorithm::all_of_equal(sums, sums[0])) {
+        return make_ready_future<>();
+    }
+    dht::token_range_vector children;
+    range_splitter splitter(range, ri.checksum_fanout, 1);
+    while (splitter.has_next()) {
+        children.push_back(splitter.next());
+    }
+    if (children.size() < 2) {
+        checksums.clear();
+        for (auto& sum : sums) {
+            checksums.push_back(make_ready_future<partition_checksum>(sum));
+        }
+        return sync_range(ri, cf, range, neighbors, success, std::move(checksums));
+    }
+    rlogger.debug("Checksums of range {} differ, comparing the checksums of {} subranges", range, children.size());
+
+    std::vector<future<std::vector<partition_checksum>>> child_checksums;
+    child_checksums.reserve(1 + neighbors.size());
+    auto start = repair_clock::now();
+    return do_with(std::move(children), [&ri, &cf, estimated_partitions, &neighbors, &success, checksum_type, start, child_checksums = std::move(child_checksums)] (auto& children) mutable {
+        child_checksums.push_back(checksum_ranges(ri.db, ri.keyspace, cf, children, checksum_type, &ri.stats.bytes_hashed));
+        for (auto&& neighbor : neighbors) {
+            child_checksums.push_back(
+                    netw::get_local_messaging_service().send_repair_checksum_ranges(
+                            netw::msg_addr{neighbor}, ri.keyspace, cf, children, checksum_type));
+        }
+        return when_all(child_checksums.begin(), child_checksums.end()).then(
+                [&ri, &cf, &children, estimated_partitions, &neighbors, &success, checksum_type, start]
+                (std::vector<future<std::vector<partition_checksum>>> results) {
+            ri.stats.checksum_time += elapsed_since(start);
+            ri.stats.ranges_checked += children.size();
+            // The checksums of each node, or why it couldn't provide them.
+            std::vector<std::vector<partition_checksum>> sums;
+            std::vector<std::exception_ptr> errors;
+            for (auto& r : results) {
+                sums.emplace_back();
+                errors.emplace_back();
+                if (r.failed()) {
+                    errors.back() = r.get_exception();
+                    continue;
+                }
+                sums.back() = r.get0();
+                if (sums.back().size() != children.size()) {
+                    errors.back() = std::make_exception_ptr(std::runtime_error(sprint("expected %d checksums, got %d",
+                            children.size(), sums.back().size())));
+                }
+            }
+            auto child_partitions = estimated_partitions / children.size();
+            return do_with(std::move(sums), std::move(errors), [&ri, &cf, &children, child_partitions, &neighbors, &success, checksum_type] (auto& sums, auto& errors) {
+                return parallel_for_each(boost::irange<size_t>(0, children.size()),
+                        [&ri, &cf, &children, child_partitions, &neighbors, &success, checksum_type, &sums, &errors] (size_t i) {
+                    std::vector<future<partition_checksum>> checksums;
+                    checksums.reserve(sums.size());
+                    for (size_t n = 0; n < sums.size(); n++) {
+                        checksums.push_back(errors[n] ? make_exception_future<partition_checksum>(errors[n])
+                                                      : make_ready_future<partition_checksum>(sums[n][i]));
+                    }
+                    return repair_subrange(ri, cf, children[i], child_partitions, neighbors, success, checksum_type, std::move(checksums));
+                });
+            });
+        });
+    });
+}
+
 // Repair a single cf in a single local range.
 // Comparable to RepairJob in Origin.
 static future<> repair_cf_range(repair_info& ri,
@@ -583,25 +1249,34 @@ static future<> repair_cf_range(repair_info& ri,
     }
 
     return estimate_partitions(ri.db, ri.keyspace, cf, range).then([&ri, cf, range, &neighbors] (uint64_t estimated_partitions) {
-    range_splitter ranges(range, estimated_partitions, ri.target_partitions);
+    auto target_partitions = ri.target_partitions;
+    if (service::get_local_storage_service().cluster_supports_repair_checksum_ranges()) {
+        target_partitions *= ri.checksum_split_factor;
+    }
+    range_splitter ranges(range, estimated_partitions, target_partitions);
+    // The subranges hold target_partitions at most.
+    auto estimated = std::min(estimated_partitions, target_partitions);
     rlogger.info("Repair {} out of {} ranges, id={}, shard={}, keyspace={}, cf={}, range={}, target_partitions={}, estimated_partitions={}",
-            ri.ranges_index, ri.ranges.size(), ri.id, ri.shard, ri.keyspace, cf, range, ri.target_partitions, estimated_partitions);
+            ri.ranges_index, ri.ranges.size(), ri.id, ri.shard, ri.keyspace, cf, range, target_partitions, estimated_partitions);
     return do_with(seastar::gate(), true, std::move(cf), std::move(ranges),
-        [&ri, &neighbors] (auto& completion, auto& success, const auto& cf, auto& ranges) {
+        [&ri, &neighbors, estimated] (auto& completion, auto& success, const auto& cf, auto& ranges) {
         return do_until([&ranges] () { return !ranges.has_next(); },
-            [&ranges, &ri, &completion, &success, &neighbors, &cf] () {
+            [&ranges, &ri, &completion, &success, &neighbors, &cf, estimated] () {
             auto range = ranges.next();
             check_in_shutdown();
-            return parallelism_semaphore.wait(1).then([&ri, &completion, &success, &neighbors, &cf, range] {
-                auto checksum_type = service::get_local_storage_service().cluster_supports_large_partitions()
-                                     ? repair_checksum::streamed : repair_checksum::legacy;
+            return parallelism_semaphore.wait(1).then([&ri, &completion, &success, &neighbors, &cf, range, estimated] {
+                auto& ss = service::get_local_storage_service();
+                auto checksum_type = ss.cluster_supports_murmur3_repair_checksum() ? repair_checksum::streamed_murmur3
+                                     : ss.cluster_supports_large_partitions() ? repair_checksum::streamed
+                                     : repair_checksum::legacy;
 
                 // Ask this node, and all neighbors, to calculate checksums in
                 // this range. When all are done, compare the results, and if
                 // there are any differences, sync the content of this range.
                 std::vector<future<partition_checksum>> checksums;
                 checksums.reserve(1 + neighbors.size());
-                checksums.push_back(checksum_range(ri.db, ri.keyspace, cf, range, checksum_type));
+                auto start = repair_clock::now();
+                checksums.push_back(checksum_range(ri.db, ri.keyspace, cf, range, checksum_type, &ri.stats.bytes_hashed));
                 for (auto&& neighbor : neighbors) {
                     checksums.push_back(
                             netw::get_local_messaging_service().send_repair_checksum_range(
@@ -610,130 +1285,15 @@ static future<> repair_cf_range(repair_info& ri,
 
                 completion.enter();
                 when_all(checksums.begin(), checksums.end()).then(
-                        [&ri, &cf, range, &neighbors, &success]
+                        [&ri, &cf, range, &neighbors, &success, checksum_type, estimated, start]
                         (std::vector<future<partition_checksum>> checksums) {
-                    // If only some of the replicas of this range are alive,
-                    // we set success=false so repair will fail, but we can
-                    // still do our best to repair available replicas.
-                    std::vector<gms::inet_address> live_neighbors;
-                    std::vector<partition_checksum> live_neighbors_checksum;
-                    for (unsigned i = 0; i < checksums.size(); i++) {
-                        if (checksums[i].failed()) {
-                            rlogger.warn(
-                                "Checksum of range {} on {} failed: {}",
-                                range,
-                                (i ? neighbors[i-1] :
-                                 utils::fb_utilities::get_broadcast_address()),
-                                checksums[i].get_exception());
-                            success = false;
-                            ri.failed_ranges.push_back(failed_range{cf, range});
-                            // Do not break out of the loop here, so we can log
-                            // (and discard) all the exceptions.
-                        } else if (i > 0) {
-                            live_neighbors.push_back(neighbors[i - 1]);
-                            live_neighbors_checksum.push_back(checksums[i].get0());
-                        }
-                    }
-                    if (!checksums[0].available() || live_neighbors.empty() || live_neighbors_checksum.empty()) {
-                        return make_ready_future<>();
-                    }
-                    // If one of the available checksums is different, repair
-                    // all the neighbors which returned a checksum.
-                    auto checksum0 = checksums[0].get0();
-                    std::vector<gms::inet_address> live_neighbors_in(live_neighbors);
-                    std::vector<gms::inet_address> live_neighbors_out(live_neighbors);
-
-                    std::unordered_map<partition_checksum, std::vector<gms::inet_address>> checksum_map;
-                    for (size_t idx = 0 ; idx < live_neighbors.size(); idx++) {
-                        checksum_map[live_neighbors_checksum[idx]].emplace_back(live_neighbors[idx]);
-                    }
-
-                    auto node_reducer = [] (std::vector<gms::inet_address>& live_neighbors_in_or_out,
-                            std::vector<gms::inet_address>& nodes_with_same_checksum, size_t nr_nodes_to_keep) {
-                        auto nr_nodes = nodes_with_same_checksum.size();
-                        if (nr_nodes <= nr_nodes_to_keep) {
-                            return;
-                        }
-
-                        // TODO: Remove the "far" nodes and keep the "near" nodes
-                        // to have better streaming performance
-                        nodes_with_same_checksum.resize(nr_nodes - nr_nodes_to_keep);
-
-                        // Now, nodes_with_same_checksum contains nodes we want to remove, remove it from live_neighbors_in_or_out
-                        auto it = boost::range::remove_if(live_neighbors_in_or_out, [&nodes_with_same_checksum] (const auto& ip) {
-                            return boost::algorithm::any_of_equal(nodes_with_same_checksum, ip);
-                        });
-                        live_neighbors_in_or_out.erase(it, live_neighbors_in_or_out.end());
-                    };
-
-                    // Reduce in traffic
-                    for (auto& item : checksum_map) {
-                        auto& sum = item.first;
-                        auto nodes_with_same_checksum = item.second;
-                        // If remote nodes have the same checksum, fetch only from one of them
-                        size_t nr_nodes_to_fetch = 1;
-                        // If remote nodes have zero checksum or have the same
-                        // checksum as local checksum, do not fetch from them at all
-                        if (sum == partition_checksum() || sum == checksum0) {
-                            nr_nodes_to_fetch = 0;
-                        }
-                        // E.g.,
-                        // Local  Remote1 Remote2 Remote3
-                        // 5      5       5       5         : IN: 0
-                        // 5      5       5       0         : IN: 0
-                        // 5      5       0       0         : IN: 0
-                        // 5      0       0       0         : IN: 0
-                        // 0      5       5       5         : IN: 1
-                        // 0      5       5       0         : IN: 1
-                        // 0      5       0       0         : IN: 1
-                        // 0      0       0       0         : IN: 0
-                        // 3      5       5       3         : IN: 1
-                        // 3      5       3       3         : IN: 1
-                        // 3      3       3       3         : IN: 0
-                        // 3      5       4       3         : IN: 2
-                        node_reducer(live_neighbors_in, nodes_with_same_checksum, nr_nodes_to_fetch);
+                    ri.stats.checksum_time += elapsed_since(start);
+                    ri.stats.ranges_checked++;
+                    return repair_subrange(ri, cf, range, estimated, neighbors, success, checksum_type, std::move(checksums));
+                }).then([&ri, &cf, range, start] {
+                    if (ri.trace) {
+                        ri.trace_range(cf, range, elapsed_since(start));
                     }
-
-                    // Reduce out traffic
-                    if (live_neighbors_in.empty()) {
-                        for (auto& item : checksum_map) {
-                            auto& sum = item.first;
-                            auto nodes_with_same_checksum = item.second;
-                            // Skip to send to the nodes with the same checksum as local node
-                            // E.g.,
-                            // Local  Remote1 Remote2 Remote3
-                            // 5      5       5       5         : IN: 0  OUT: 0 SKIP_OUT: Remote1, Remote2, Remote3
-                            // 5      5       5       0         : IN: 0  OUT: 1 SKIP_OUT: Remote1, Remote2
-                            // 5      5       0       0         : IN: 0  OUT: 2 SKIP_OUT: Remote1
-                            // 5      0       0       0         : IN: 0  OUT: 3 SKIP_OUT: None
-                            // 0      0       0       0         : IN: 0  OUT: 0 SKIP_OUT: Remote1, Remote2, Remote3
-                            if (sum == checksum0) {
-                                size_t nr_nodes_to_send = 0;
-                                node_reducer(live_neighbors_out, nodes_with_same_checksum, nr_nodes_to_send);
-                            }
-                        }
-                    } else if (live_neighbors_in.size() == 1 && checksum0 == partition_checksum()) {
-                        for (auto& item : checksum_map) {
-                            auto& sum = item.first;
-                            auto nodes_with_same_checksum = item.second;
-                            // Skip to send to the nodes with none zero checksum
-                            // E.g.,
-                            // Local  Remote1 Remote2 Remote3
-                            // 0      5       5       5         : IN: 1  OUT: 0 SKIP_OUT: Remote1, Remote2, Remote3
-                            // 0      5       5       0         : IN: 1  OUT: 1 SKIP_OUT: Remote1, Remote2
-                            // 0      5       0       0         : IN: 1  OUT: 2 SKIP_OUT: Remote1
-                            if (sum != checksum0) {
-                                size_t nr_nodes_to_send = 0;
-                                node_reducer(live_neighbors_out, nodes_with_same_checksum, nr_nodes_to_send);
-                            }
-                        }
-                    }
-                    if (!(live_neighbors_in.empty() && live_neighbors_out.empty())) {
-                        rlogger.debug("Found differing range {} on nodes {}, in = {}, out = {}", range,
-                                live_neighbors, live_neighbors_in, live_neighbors_out);
-                        return ri.request_transfer_ranges(cf, range, live_neighbors_in, live_neighbors_out);
-                    }
-                    return make_ready_future<>();
                 }).handle_exception([&ri, &success, &cf, range] (std::exception_ptr eptr) {
                     // Something above (e.g., request_transfer_ranges) failed. We could
                     // stop the repair immediately, or let it continue with
@@ -768,11 +1328,13 @@ static future<> repair_cf_range(repair_info& ri,
 // Comparable to RepairSession in Origin
 static future<> repair_range(repair_info& ri, const dht::token_range& range) {
     auto id = utils::UUID_gen::get_time_UUID();
-    return do_with(get_neighbors(ri.db.local(), ri.keyspace, range, ri.data_centers, ri.hosts), [&ri, range, id] (const auto& neighbors) {
+    return utils::run_in_task_group(utils::task_group::repair, [&ri, &range, id] {
+      return do_with(get_neighbors(ri.db.local(), ri.keyspace, range, ri.data_centers, ri.hosts), [&ri, range, id] (const auto& neighbors) {
         rlogger.debug("[repair #{}] new session: will sync {} on range {} for {}.{}", id, neighbors, range, ri.keyspace, ri.cfs);
         return do_for_each(ri.cfs.begin(), ri.cfs.end(), [&ri, &neighbors, range] (auto&& cf) {
             return repair_cf_range(ri, cf, range, neighbors);
         });
+      });
     });
 }
 
@@ -828,6 +1390,9 @@ struct repair_options {
     // The node starting the repair must be in the data center; Issuing a
     // repair to a data center other than the named one returns an error.
     std::vector<sstring> data_centers;
+    // If trace is true, the slowest subranges repaired by each shard are
+    // logged when the repair completes.
+    bool trace = false;
 
     repair_options(std::unordered_map<sstring, sstring> options) {
         bool_opt(primary_range, options, PRIMARY_RANGE_KEY);
@@ -855,11 +1420,7 @@ struct repair_options {
         string_opt(start_token, options, START_TOKEN);
         string_opt(end_token, options, END_TOKEN);
 
-        bool trace = false;
         bool_opt(trace, options, TRACE_KEY);
-        if (trace) {
-            throw std::runtime_error("unsupported trace");
-        }
         // Consume, ignore.
         int job_threads;
         int_opt(job_threads, options, JOB_THREADS_KEY);
@@ -979,6 +1540,8 @@ struct repair_options {
 // is assumed to be a indivisible in the sense that all the tokens in has the
 // same nodes as replicas.
 static future<> repair_ranges(repair_info ri) {
+    // The subranges waiting for their turn to be checksummed.
+    utils::set_task_group_queue_length(utils::task_group::repair, [] { return parallelism_semaphore.waiters(); });
     return do_with(std::move(ri), [] (auto& ri) {
     #if 0
         // repair all the ranges in parallel
@@ -993,6 +1556,8 @@ static future<> repair_ranges(repair_info ri) {
             // Do streaming for the remaining ranges we do not stream in
             // repair_cf_range
             return ri.do_streaming();
+        }).finally([&ri] {
+            ri.log_stats();
         }).then([&ri] {
             ri.check_failed_ranges();
             return make_ready_future<>();
@@ -1144,10 +1709,10 @@ static int do_repair_start(seastar::sharded<database>& db, sstring keyspace,
         shard_id shard = x.first;
         auto& ranges = x.second;
         auto f = db.invoke_on(shard, [keyspace, cfs, id, ranges = std::move(ranges),
-                data_centers = options.data_centers, hosts = options.hosts] (database& localdb) mutable {
+                data_centers = options.data_centers, hosts = options.hosts, trace = options.trace] (database& localdb) mutable {
             return repair_ranges(repair_info(service::get_local_storage_service().db(),
                     std::move(keyspace), std::move(ranges), std::move(cfs),
-                    id, std::move(data_centers), std::move(hosts)));
+                    id, std::move(data_centers), std::move(hosts), trace));
         });
         repair_results.push_back(std::move(f));
     }
@@ -1182,6 +1747,21 @@ future<repair_status> repair_get_status(seastar::sharded<database>& db, int id)
     });
 }
 
+future<repair_stats> repair_get_stats(seastar::sharded<database>& db, int id) {
+    return db.invoke_on(0, [id] (database& localdb) {
+        // Throws if there is no such repair.
+        repair_tracker.get(id);
+    }).then([&db, id] {
+        return db.map_reduce0([id] (database& localdb) {
+            auto it = repair_stats_on_shard.find(id);
+            return it == repair_stats_on_shard.end() ? repair_stats() : it->second;
+        }, repair_stats(), [] (repair_stats result, const repair_stats& stats) {
+            result += stats;
+            return result;
+        });
+    });
+}
+
 future<> repair_shutdown(seastar::sharded<database>& db) {
     rlogger.info("Starting shutdown of repair");
     return db.invoke_on(0, [] (database& localdb) {
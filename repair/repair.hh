@@ -63,6 +63,28 @@ enum class repair_status { RUNNING, SUCCESSFUL, FAILED };
 // different CPU (cpu 0) and that might be a deferring operation.
 future<repair_status> repair_get_status(seastar::sharded<database>& db, int id);
 
+// The work done so far by a repair started on this node, summed over all
+// shards. The time spent in each phase is summed over the subranges, which
+// are repaired concurrently, so it can exceed the duration of the repair.
+struct repair_stats {
+    // Subranges whose checksums were compared, and those of them which
+    // differed between the replicas and were synced.
+    uint64_t ranges_checked = 0;
+    uint64_t ranges_mismatched = 0;
+    // Data checksummed on this node.
+    uint64_t bytes_hashed = 0;
+    // Rows sent to and received from the neighbors by row-level repair.
+    // Ranges synced with streaming are accounted by the streaming metrics.
+    uint64_t bytes_streamed = 0;
+    std::chrono::milliseconds checksum_time{0};
+    std::chrono::milliseconds sync_time{0};
+    std::chrono::milliseconds streaming_time{0};
+
+    repair_stats& operator+=(const repair_stats& o);
+};
+
+future<repair_stats> repair_get_stats(seastar::sharded<database>& db, int id);
+
 // repair_shutdown() stops all ongoing repairs started on this node (and
 // prevents any further repairs from being started). It returns a future
 // saying when all repairs have stopped, and attempts to stop them as
@@ -73,6 +95,7 @@ future<> repair_shutdown(seastar::sharded<database>& db);
 enum class repair_checksum {
     legacy = 0,
     streamed = 1,
+    streamed_murmur3 = 2,
 };
 
 // The class partition_checksum calculates a 256-bit cryptographically-secure
@@ -83,16 +106,21 @@ enum class repair_checksum {
 // independently calculate the checksums of different subsets of the original
 // set, and then combine the results into one checksum with the add() method.
 // The hash of an individual partition uses both its key and value.
+// With repair_checksum::streamed_murmur3, the individual hashes are the much
+// cheaper, but not cryptographically secure, 128-bit Murmur3 instead, in the
+// first half of the digest.
 class partition_checksum {
 private:
     std::array<uint8_t, 32> _digest; // 256 bits
 private:
-    static future<partition_checksum> compute_legacy(streamed_mutation m);
-    static future<partition_checksum> compute_streamed(streamed_mutation m);
+    static future<partition_checksum> compute_legacy(streamed_mutation m, uint64_t* bytes_hashed);
+    template <typename Hasher>
+    static future<partition_checksum> compute_streamed(streamed_mutation m, uint64_t* bytes_hashed);
 public:
     constexpr partition_checksum() : _digest{} { }
     explicit partition_checksum(std::array<uint8_t, 32> digest) : _digest(std::move(digest)) { }
-    static future<partition_checksum> compute(streamed_mutation m, repair_checksum rt);
+    // The length of the data hashed is added to *bytes_hashed, if given.
+    static future<partition_checksum> compute(streamed_mutation m, repair_checksum rt, uint64_t* bytes_hashed = nullptr);
     void add(const partition_checksum& other);
     bool operator==(const partition_checksum& other) const;
     bool operator!=(const partition_checksum& other) const { return !operator==(other); }
@@ -101,13 +129,48 @@ class partition_checksum {
 };
 
 // Calculate the checksum of the data held on all shards of a column family,
-// in the given token range.
+// in the given token range. The number of bytes hashed is added to
+// *bytes_hashed, if given.
 // All parameters to this function are constant references, and the caller
 // must ensure they live as long as the future returned by this function is
 // not resolved.
 future<partition_checksum> checksum_range(seastar::sharded<database> &db,
         const sstring& keyspace, const sstring& cf,
-        const ::dht::token_range& range, repair_checksum rt);
+        const ::dht::token_range& range, repair_checksum rt,
+        uint64_t* bytes_hashed = nullptr);
+
+// Calculate the checksums of the data held on all shards of a column family,
+// in each of the given token ranges. Same requirements on the parameters as
+// checksum_range().
+future<std::vector<partition_checksum>> checksum_ranges(seastar::sharded<database> &db,
+        const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range_vector& ranges, repair_checksum rt,
+        uint64_t* bytes_hashed = nullptr);
+
+// Row-level repair compares the rows of a range by their hashes, so that only
+// the rows which differ are sent between the replicas. A row is a clustering
+// row, the static row, a range tombstone or the partition tombstone, with its
+// partition key.
+
+// Calculate the hashes of the rows held on all shards of a column family, in
+// the given token range. Same requirements on the parameters as
+// checksum_range().
+future<std::vector<uint64_t>> repair_row_hashes(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range& range);
+
+// Read the rows of a column family in the given token range whose hashes are
+// among hashes, the rows of each partition in one mutation.
+future<std::vector<frozen_mutation>> repair_get_rows(seastar::sharded<database>& db,
+        const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range& range, std::vector<uint64_t> hashes);
+
+// Write the rows of the given token range received from the node from to
+// sstables, the way streamed mutations are. Same requirements on the
+// parameters as checksum_range().
+future<> repair_put_rows(seastar::sharded<database>& db, gms::inet_address from,
+        utils::UUID plan_id, const sstring& keyspace, const sstring& cf,
+        const ::dht::token_range& range, std::vector<frozen_mutation> rows);
 
 namespace std {
 template<>
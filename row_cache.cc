@@ -27,11 +27,17 @@
 #include <seastar/util/defer.hh>
 #include "memtable.hh"
 #include "partition_snapshot_reader.hh"
+#include "partition_slice_builder.hh"
 #include <chrono>
 #include "utils/move.hh"
 #include <boost/version.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/find_if.hpp>
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/intrusive/parent_from_member.hpp>
 #include <sys/sdt.h>
 #include "stdx.hh"
+#include "utils/stall_detector.hh"
 
 using namespace std::chrono_literals;
 
@@ -62,7 +68,9 @@ cache_tracker& global_cache_tracker() {
     return instance;
 }
 
-cache_tracker::cache_tracker() {
+cache_tracker::cache_tracker()
+    : _version_merger(_region)
+{
     setup_metrics();
 
     _region.make_evictable([this] {
@@ -71,27 +79,53 @@ cache_tracker::cache_tracker() {
           // the rbtree, so linearize anything we read
           return with_linearized_managed_bytes([&] {
            try {
-            auto evict_last = [this](lru_type& lru) {
+            auto evict_last = [this](table_lru& t, lru_type& lru) {
                 cache_entry& ce = lru.back();
                 auto it = row_cache::partitions_type::s_iterator_to(ce);
                 clear_continuity(*std::next(it));
                 lru.pop_back_and_dispose(current_deleter<cache_entry>());
+                --t._partitions;
+                ++t._evictions;
+                on_evicted_from(t);
             };
-            if (!_wide_partition_lru.empty() && (_normal_eviction_count == 0 || _lru.empty())) {
-                evict_last(_wide_partition_lru);
+            auto normal = table_to_evict(&table_lru::_lru);
+            auto wide = table_to_evict(&table_lru::_wide_partition_lru);
+            if (!_index_lru.empty() && (_partition_eviction_count == 0 || (!normal && !wide))) {
+                _index_lru.evict();
+                _partition_eviction_count = _partition_index_eviction_ratio;
+                return memory::reclaiming_result::reclaimed_something;
+            }
+            if (wide && (_normal_eviction_count == 0 || !normal)) {
+                evict_last(*wide, wide->_wide_partition_lru);
                 _normal_eviction_count = _normal_large_eviction_ratio;
                 ++_stats.wide_partition_evictions;
             } else {
-                if (_lru.empty()) {
+                if (!normal) {
                     return memory::reclaiming_result::reclaimed_nothing;
                 }
-                evict_last(_lru);
+                cache_entry& ce = normal->_lru.back();
+                if (ce.wide_partition() && ce.evict_row_range()) {
+                    // The entry stays, as the least recently used one, until
+                    // all of its rows are gone.
+                    if (!ce.has_row_ranges()) {
+                        ce._lru_link.unlink();
+                        normal->_wide_partition_lru.push_front(ce);
+                    }
+                    ++_stats.row_range_evictions;
+                    on_evicted_from(*normal);
+                    return memory::reclaiming_result::reclaimed_something;
+                }
+                evict_last(*normal, normal->_lru);
                 if (_normal_eviction_count > 0) {
                     --_normal_eviction_count;
                 }
             }
+            if (_partition_eviction_count > 0) {
+                --_partition_eviction_count;
+            }
             --_stats.partitions;
             ++_stats.evictions;
+            _insertions_at_last_eviction = _stats.insertions;
             ++_stats.modification_count;
             return memory::reclaiming_result::reclaimed_something;
            } catch (std::bad_alloc&) {
@@ -107,6 +141,7 @@ cache_tracker::cache_tracker() {
 
 cache_tracker::~cache_tracker() {
     clear();
+    _tables.clear();
 }
 
 void
@@ -123,9 +158,20 @@ cache_tracker::setup_metrics() {
         sm::make_derive("total_operations_merges", sm::description("total number of operation merged"), _stats.merges),
         sm::make_derive("total_operations_evictions", sm::description("total number of operation eviction"), _stats.evictions),
         sm::make_derive("total_operations_wide_partition_evictions", sm::description("total number of operation wide partition eviction"), _stats.wide_partition_evictions),
+        sm::make_derive("total_operations_row_range_evictions", sm::description("total number of evictions of rows of wide partitions"), _stats.row_range_evictions),
         sm::make_derive("total_operations_wide_partition_mispopulations", sm::description("total number of operation wide partition mispopulations"), _stats.wide_partition_mispopulations),
         sm::make_derive("total_operations_removals", sm::description("total number of operation removals"), _stats.removals),
-        sm::make_gauge("objects_partitions", sm::description("total number of partition objects"), _stats.partitions)
+        sm::make_derive("total_operations_range_scans_from_cache", sm::description("total number of range scans served from cache alone"), _stats.range_scans_from_cache),
+        sm::make_derive("total_operations_range_scans_from_underlying", sm::description("total number of range scans which read a part of the range from sstables"), _stats.range_scans_from_underlying),
+        sm::make_derive("total_operations_admission_rejections", sm::description("total number of partitions read from sstables and not cached, because they were read less often than the ones they would evict"), _stats.admission_rejections),
+        sm::make_gauge("objects_partitions", sm::description("total number of partition objects"), _stats.partitions),
+        // Shard-wide, those cover versions of memtable partitions too.
+        sm::make_derive("partition_version_merges", sm::description("total number of partition versions merged in the background"),
+            [] { return partition_version_merger::shard_stats().merged_versions; }),
+        sm::make_gauge("pending_partition_version_merges", sm::description("number of released snapshots waiting for their versions to be merged"),
+            [] { return partition_version_merger::shard_stats().pending; }),
+        sm::make_histogram("partition_version_chain_length", sm::description("number of versions of partitions at the time their snapshots are released"),
+            [] { return partition_version_merger::shard_stats().chain_length.get_histogram(); })
     });
 }
 
@@ -144,42 +190,132 @@ void cache_tracker::clear() {
                 clear_continuity(*it);
             }
         };
-        clear(_lru);
-        clear(_wide_partition_lru);
+        for (auto& t : _tables) {
+            clear(t._lru);
+            clear(t._wide_partition_lru);
+            t._partitions = 0;
+        }
     });
+    _index_lru.evict_all();
     _stats.removals += _stats.partitions;
     _stats.partitions = 0;
     ++_stats.modification_count;
 }
 
-void cache_tracker::touch(cache_entry& e) {
-    auto move_to_front = [this] (lru_type& lru, cache_entry& e) {
-        lru.erase(lru.iterator_to(e));
-        lru.push_front(e);
-    };
-    move_to_front(e.wide_partition() ? _wide_partition_lru : _lru, e);
+cache_tracker::table_lru::table_lru(table_lru&& o) noexcept
+    : _link()
+    , _lru(std::move(o._lru))
+    , _wide_partition_lru(std::move(o._wide_partition_lru))
+    , _eviction_weight(o._eviction_weight)
+    , _virtual_time(o._virtual_time)
+    , _partitions(o._partitions)
+    , _evictions(o._evictions)
+{
+    _link.swap_nodes(o._link);
+}
+
+cache_tracker::table_lru& cache_tracker::table_lru::operator=(table_lru&& o) noexcept {
+    if (this != &o) {
+        this->~table_lru();
+        new (this) table_lru(std::move(o));
+    }
+    return *this;
+}
+
+void cache_tracker::register_table(table_lru& t) {
+    t._virtual_time = _eviction_clock;
+    _tables.push_back(t);
+}
+
+cache_tracker::table_lru* cache_tracker::table_to_evict(lru_type table_lru::* lru) {
+    table_lru* victim = nullptr;
+    for (auto& t : _tables) {
+        if (!(t.*lru).empty() && (!victim || t._virtual_time < victim->_virtual_time)) {
+            victim = &t;
+        }
+    }
+    return victim;
+}
+
+void cache_tracker::evict(cache_entry& ce) noexcept {
+    auto it = row_cache::partitions_type::s_iterator_to(ce);
+    auto& partitions = row_cache::partitions_type::container_from_iterator(it);
+    table_lru& t = bi::get_parent_from_member(&partitions, &row_cache::_partitions)->_lru;
+    if (ce.wide_partition() && !ce.has_row_ranges()) {
+        ++_stats.wide_partition_evictions;
+    }
+    clear_continuity(*std::next(it));
+    ce._lru_link.unlink();
+    current_deleter<cache_entry>()(&ce);
+    --t._partitions;
+    ++t._evictions;
+    on_evicted_from(t);
+    --_stats.partitions;
+    ++_stats.evictions;
+    ++_stats.modification_count;
+    _insertions_at_last_eviction = _stats.insertions;
 }
 
-void cache_tracker::insert(cache_entry& entry) {
+void cache_tracker::enable_segment_eviction() {
+    // Entries are allocated before their contents, so most of the objects
+    // of a segment belong to entries which start in it or in the segments
+    // evicted before it. Objects of other entries, including those updated
+    // after population, are moved out of the segment.
+    _region.make_segment_evictable([this] (const migrate_fn_type* migrator, void* obj) {
+        if (migrator != &standard_migrator<cache_entry>::object) {
+            return;
+        }
+        auto& ce = *static_cast<cache_entry*>(obj);
+        if (!ce.is_evictable()) {
+            return;
+        }
+        with_allocator(_region.allocator(), [&] {
+            try {
+                with_linearized_managed_bytes([&] {
+                    evict(ce);
+                });
+            } catch (std::bad_alloc&) {
+                // Same as in the LRU evictor.
+                clear();
+            }
+        });
+    });
+}
+
+void cache_tracker::on_evicted_from(table_lru& t) {
+    _eviction_clock = t._virtual_time;
+    t._virtual_time += t._eviction_weight;
+}
+
+void cache_tracker::touch(table_lru& t, cache_entry& e) {
+    // The entry may move between LRUs when a wide partition gains rows.
+    e._lru_link.unlink();
+    lru_for(t, e).push_front(e);
+}
+
+void cache_tracker::insert(table_lru& t, cache_entry& entry) {
     ++_stats.insertions;
     ++_stats.partitions;
     ++_stats.modification_count;
-    if (entry.wide_partition()) {
-        _wide_partition_lru.push_front(entry);
-    } else {
-        _lru.push_front(entry);
+    if (!t._partitions) {
+        // A table which had nothing to evict doesn't get to catch up with
+        // the others by having its partitions evicted first.
+        t._virtual_time = std::max(t._virtual_time, _eviction_clock);
     }
+    ++t._partitions;
+    lru_for(t, entry).push_front(entry);
 }
 
-void cache_tracker::mark_wide(cache_entry& entry) {
+void cache_tracker::mark_wide(table_lru& t, cache_entry& entry) {
     if (entry._lru_link.is_linked()) {
         entry._lru_link.unlink();
     }
     entry.set_wide_partition();
-    _wide_partition_lru.push_front(entry);
+    t._wide_partition_lru.push_front(entry);
 }
 
-void cache_tracker::on_erase() {
+void cache_tracker::on_erase(table_lru& t) {
+    --t._partitions;
     --_stats.partitions;
     ++_stats.removals;
     ++_stats.modification_count;
@@ -189,6 +325,18 @@ void cache_tracker::on_merge() {
     ++_stats.merges;
 }
 
+void cache_tracker::on_range_scan(bool from_underlying) {
+    if (from_underlying) {
+        ++_stats.range_scans_from_underlying;
+    } else {
+        ++_stats.range_scans_from_cache;
+    }
+}
+
+void cache_tracker::on_admission_rejection() {
+    ++_stats.admission_rejections;
+}
+
 void cache_tracker::on_hit() {
     ++_stats.hits;
 }
@@ -318,9 +466,11 @@ class just_cache_scanning_reader final {
 private:
     void update_iterators() {
         auto cmp = cache_entry::compare(_cache._schema);
+        // A range marker at a token bound of the range is out of it, but
+        // tells whether the end of the range is continuous.
         auto update_end = [&] {
             if (_range->end()) {
-                if (_range->end()->is_inclusive()) {
+                if (_range->end()->is_inclusive() && _range->end()->value().has_key()) {
                     _end = _cache._partitions.upper_bound(_range->end()->value(), cmp);
                 } else {
                     _end = _cache._partitions.lower_bound(_range->end()->value(), cmp);
@@ -334,7 +484,7 @@ class just_cache_scanning_reader final {
         auto modification_count = _cache.get_cache_tracker().modification_count();
         if (!_last) {
             if (_range->start()) {
-                if (_range->start()->is_inclusive()) {
+                if (_range->start()->is_inclusive() && _range->start()->value().has_key()) {
                     _it = _cache._partitions.lower_bound(_range->start()->value(), cmp);
                 } else {
                     _it = _cache._partitions.upper_bound(_range->start()->value(), cmp);
@@ -367,16 +517,28 @@ class just_cache_scanning_reader final {
         return _cache._read_section(_cache._tracker.region(), [this] {
           return with_linearized_managed_bytes([&] {
             update_iterators();
+            // The range in front of a partition is continuous if it is so
+            // in front of each of the range markers within it, too.
+            bool continuous = true;
+            while (_it != _end && _it->is_range_marker()) {
+                continuous &= _it->continuous();
+                _cache._tracker.touch(_cache._lru, *_it);
+                ++_it;
+            }
             if (_it == _end) {
-                return make_ready_future<cache_data>(cache_data { {}, _it->continuous() });
+                if (_it->is_range_marker()) {
+                    _cache._tracker.touch(_cache._lru, *_it);
+                }
+                return make_ready_future<cache_data>(cache_data { {}, continuous && _it->continuous() });
             }
             cache_entry& ce = *_it;
             ++_it;
             _last = ce.key();
             _cache.upgrade_entry(ce);
-            _cache._tracker.touch(ce);
+            _cache._tracker.touch(_cache._lru, ce);
+            _cache.on_access(ce.key().token());
             _cache.on_hit();
-            cache_data cd { { }, ce.continuous() };
+            cache_data cd { { }, continuous && ce.continuous() };
             if (ce.wide_partition()) {
                 return ce.read_wide(_cache, _schema, _slice, _pc, _fwd).then([this, cd = std::move(cd)] (auto smopt) mutable {
                     if (smopt) {
@@ -437,7 +599,7 @@ class range_populating_reader {
         _cache.on_uncached_wide_partition();
         _cache._tracker.on_wide_partition_mispopulation();
         _cache.mark_partition_as_wide(dk, &_last_key);
-        _last_key.reset(dk, _populate_phase);
+        _last_key.reset(dht::ring_position(dk), _populate_phase);
 
         _large_partition_range = dht::partition_range::make_singular(dk);
         _large_partition_reader = _cache._underlying(_schema, _large_partition_range, _slice, _pc, _trace_state, _fwd);
@@ -457,21 +619,16 @@ class range_populating_reader {
         if (_last_key._populate_phase != _populate_phase) {
             return;
         }
-        if (!_range.end() || !_range.end()->is_inclusive()) {
+        if (_range.end() && !_range.end()->value().has_key()) {
+            // Token ranges end in between partitions, so a range marker is
+            // needed to record that the range is complete.
+            _cache.mark_range_bound(_range.end()->value(), &_last_key);
+        } else if (!_range.end() || !_range.end()->is_inclusive()) {
             cache_entry::compare cmp(_cache._schema);
             auto it = _range.end() ? _cache._partitions.find(_range.end()->value(), cmp)
                                    : std::prev(_cache._partitions.end());
-            if (it != _cache._partitions.end()) {
-                if (it == _cache._partitions.begin()) {
-                    if (!_last_key._key) {
-                        it->set_continuous(true);
-                    }
-                } else {
-                    auto prev = std::prev(it);
-                    if (prev->key().equal(*_cache._schema, *_last_key._key)) {
-                        it->set_continuous(true);
-                    }
-                }
+            if (it != _cache._partitions.end() && _cache.follows(it, _last_key)) {
+                it->set_continuous(true);
             }
         }
     }
@@ -509,7 +666,7 @@ class range_populating_reader {
 
                 _cache.on_miss();
                 _cache.populate(*mo, &_last_key);
-                _last_key.reset(mo->decorated_key(), _populate_phase);
+                _last_key.reset(dht::ring_position(mo->decorated_key()), _populate_phase);
 
                 mo->upgrade(_schema);
                 auto ck_ranges = query::clustering_key_filter_ranges::get_ranges(*_schema, _slice, mo->key());
@@ -527,7 +684,12 @@ class range_populating_reader {
         if (!_range.start()) {
             _last_key.reset({ }, phase);
         } else if (!_range.start()->is_inclusive() && _range.start()->value().has_key()) {
-            _last_key.reset(_range.start()->value().as_decorated_key(), phase);
+            _last_key.reset(_range.start()->value(), phase);
+        } else if (!_range.start()->value().has_key()) {
+            // So that what's read from the start of the token range can be
+            // continuous with it.
+            _cache.mark_range_bound(_range.start()->value());
+            _last_key.reset(_range.start()->value(), phase);
         } else {
             // Inclusive start bound, cannot set continuity flag.
             _last_key.reset(stdx::nullopt, phase - 1);
@@ -544,6 +706,7 @@ class range_populating_reader {
 };
 
 class scanning_and_populating_reader final : public mutation_reader::impl {
+    row_cache& _cache;
     const dht::partition_range* _pr;
     schema_ptr _schema;
     dht::partition_range _secondary_range;
@@ -554,6 +717,7 @@ class scanning_and_populating_reader final : public mutation_reader::impl {
     mutation_reader::forwarding _fwd_mr;
     streamed_mutation_opt _next_primary;
     bool _secondary_in_progress = false;
+    bool _read_from_secondary = false;
     bool _first_element = true;
     stdx::optional<dht::decorated_key> _last_key;
 private:
@@ -604,6 +768,7 @@ class scanning_and_populating_reader final : public mutation_reader::impl {
                 }
 
                 _secondary_in_progress = true;
+                _read_from_secondary = true;
                 return _secondary_reader.fast_forward_to(_secondary_range).then([this] {
                     return read_from_secondary();
                 });
@@ -631,7 +796,8 @@ class scanning_and_populating_reader final : public mutation_reader::impl {
                                     tracing::trace_state_ptr trace_state,
                                     streamed_mutation::forwarding fwd,
                                     mutation_reader::forwarding fwd_mr)
-        : _pr(&range)
+        : _cache(cache)
+        , _pr(&range)
         , _schema(s)
         , _primary_reader(s, cache, range, slice, pc, fwd)
         , _secondary_reader(cache, s, slice, pc, trace_state, fwd)
@@ -639,6 +805,10 @@ class scanning_and_populating_reader final : public mutation_reader::impl {
         , _fwd_mr(fwd_mr)
     { }
 
+    ~scanning_and_populating_reader() {
+        _cache._tracker.on_range_scan(_read_from_secondary);
+    }
+
     future<streamed_mutation_opt> operator()() {
         if (_secondary_in_progress) {
             return read_from_secondary();
@@ -655,6 +825,49 @@ class scanning_and_populating_reader final : public mutation_reader::impl {
     }
 };
 
+// The rows of a wide partition are cached only for a part of the partition,
+// which as a whole is known not to fit in cache, and only when the reader
+// is not fast forwarded.
+static bool can_cache_rows(const query::clustering_row_ranges& ck_ranges, streamed_mutation::forwarding fwd) {
+    return !fwd && !(ck_ranges.size() == 1 && ck_ranges.front().is_full());
+}
+
+// Reads rows of a wide partition which are not all in cache.
+class wide_partition_reader final : public mutation_reader::impl {
+    schema_ptr _schema;
+    row_cache& _cache;
+    dht::decorated_key _key;
+    const query::partition_slice& _slice;
+    const io_priority_class _pc;
+    tracing::trace_state_ptr _trace_state;
+    streamed_mutation::forwarding _fwd;
+    bool _done = false;
+public:
+    wide_partition_reader(schema_ptr s,
+            row_cache& cache,
+            dht::decorated_key key,
+            const query::partition_slice& slice,
+            const io_priority_class& pc,
+            tracing::trace_state_ptr trace_state,
+            streamed_mutation::forwarding fwd)
+        : _schema(std::move(s))
+        , _cache(cache)
+        , _key(std::move(key))
+        , _slice(slice)
+        , _pc(pc)
+        , _trace_state(std::move(trace_state))
+        , _fwd(fwd)
+    { }
+
+    virtual future<streamed_mutation_opt> operator()() override {
+        if (_done) {
+            return make_ready_future<streamed_mutation_opt>();
+        }
+        _done = true;
+        return _cache.read_wide(_key, _schema, _slice, _pc, _trace_state, _fwd);
+    }
+};
+
 mutation_reader
 row_cache::make_scanning_reader(schema_ptr s,
                                 const dht::partition_range& range,
@@ -687,12 +900,20 @@ row_cache::make_reader(schema_ptr s,
             auto i = _partitions.find(dk, cache_entry::compare(_schema));
             if (i != _partitions.end()) {
                 cache_entry& e = *i;
-                _tracker.touch(e);
+                _tracker.touch(_lru, e);
+                on_access(dk.token());
                 upgrade_entry(e);
                 mutation_reader reader;
-                if (e.wide_partition()) {
-                    reader = _underlying(s, range, slice, pc, std::move(trace_state), fwd, fwd_mr);
-                    _tracker.on_uncached_wide_partition();
+                if (e.wide_partition() && e.has_rows(slice)) {
+                    reader = make_reader_returning(e.read(*this, s, slice, fwd));
+                    on_hit();
+                } else if (e.wide_partition()) {
+                    if (fwd_mr || !can_cache_rows(slice.row_ranges(*_schema, dk.key()), fwd)) {
+                        reader = _underlying(s, range, slice, pc, std::move(trace_state), fwd, fwd_mr);
+                        _tracker.on_uncached_wide_partition();
+                    } else {
+                        reader = make_mutation_reader<wide_partition_reader>(s, *this, e.key(), slice, pc, std::move(trace_state), fwd);
+                    }
                     on_miss();
                 } else {
                     reader = make_reader_returning(e.read(*this, s, slice, fwd));
@@ -716,7 +937,7 @@ row_cache::~row_cache() {
     with_allocator(_tracker.allocator(), [this] {
         _partitions.clear_and_dispose([this, deleter = current_deleter<cache_entry>()] (auto&& p) mutable {
             if (!p->is_dummy_entry()) {
-                _tracker.on_erase();
+                _tracker.on_erase(_lru);
             }
             deleter(p);
         });
@@ -726,26 +947,27 @@ row_cache::~row_cache() {
 void row_cache::clear_now() noexcept {
     with_allocator(_tracker.allocator(), [this] {
         auto it = _partitions.erase_and_dispose(_partitions.begin(), partitions_end(), [this, deleter = current_deleter<cache_entry>()] (auto&& p) mutable {
-            _tracker.on_erase();
+            _tracker.on_erase(_lru);
             deleter(p);
         });
         _tracker.clear_continuity(*it);
     });
 }
 
-template<typename CreateEntry, typename VisitEntry>
+template<typename Key, typename CreateEntry, typename VisitEntry>
 //requires requires(CreateEntry create, VisitEntry visit, row_cache::partitions_type::iterator it) {
 //        { create(it) } -> row_cache::partitions_type::iterator;
 //        { visit(it) } -> void;
 //    }
-void row_cache::do_find_or_create_entry(const dht::decorated_key& key,
+void row_cache::do_find_or_create_entry(const Key& key,
     const previous_entry_pointer* previous, CreateEntry&& create_entry, VisitEntry&& visit_entry)
 {
     with_allocator(_tracker.allocator(), [&] {
         _populate_section(_tracker.region(), [&] {
             with_linearized_managed_bytes([&] {
-                auto i = _partitions.lower_bound(key, cache_entry::compare(_schema));
-                if (i == _partitions.end() || !i->key().equal(*_schema, key)) {
+                auto cmp = cache_entry::compare(_schema);
+                auto i = _partitions.lower_bound(key, cmp);
+                if (i == _partitions.end() || cmp(key, *i)) {
                     i = create_entry(i);
                 } else {
                     visit_entry(i);
@@ -755,9 +977,7 @@ void row_cache::do_find_or_create_entry(const dht::decorated_key& key,
                     return;
                 }
 
-                if ((!previous->_key && i == _partitions.begin())
-                    || (previous->_key && i != _partitions.begin()
-                        && std::prev(i)->key().equal(*_schema, *previous->_key))) {
+                if (follows(i, *previous)) {
                     i->set_continuous(true);
                 }
             });
@@ -765,26 +985,88 @@ void row_cache::do_find_or_create_entry(const dht::decorated_key& key,
     });
 }
 
+bool row_cache::follows(partitions_type::iterator i, const previous_entry_pointer& previous) {
+    if (i == _partitions.begin()) {
+        return !previous._key;
+    }
+    if (!previous._key) {
+        return false;
+    }
+    auto cmp = cache_entry::compare(_schema);
+    auto prev = std::prev(i);
+    return !cmp(*prev, *previous._key) && !cmp(*previous._key, *prev);
+}
+
 void row_cache::mark_partition_as_wide(const dht::decorated_key& key, const previous_entry_pointer* previous) {
     do_find_or_create_entry(key, previous, [&] (auto i) {
         cache_entry* entry = current_allocator().construct<cache_entry>(
                 _schema, key, cache_entry::wide_partition_tag{});
-        _tracker.insert(*entry);
+        _tracker.insert(_lru, *entry);
+        return _partitions.insert(i, *entry);
+    }, [&] (auto i) {
+        _tracker.mark_wide(_lru, *i);
+    });
+}
+
+void row_cache::mark_range_bound(const dht::ring_position& pos, const previous_entry_pointer* previous) {
+    do_find_or_create_entry(pos, previous, [&] (auto i) {
+        cache_entry* entry = current_allocator().construct<cache_entry>(
+                _schema, pos, cache_entry::range_marker_tag{});
+        // Splitting a continuous range leaves both parts continuous.
+        entry->set_continuous(i->continuous());
+        _tracker.insert(_lru, *entry);
         return _partitions.insert(i, *entry);
     }, [&] (auto i) {
-        _tracker.mark_wide(*i);
+        _tracker.touch(_lru, *i);
     });
 }
 
+void row_cache::on_access(const dht::token& t) {
+    if (_sketch) {
+        _sketch->increment(std::hash<dht::token>()(t));
+    }
+}
+
+bool row_cache::admit(const dht::decorated_key& dk) {
+    if (!_sketch) {
+        return true;
+    }
+    auto h = std::hash<dht::token>()(dk.token());
+    _sketch->increment(h);
+    const auto& lru = _lru.lru();
+    if (!_tracker.is_full() || lru.empty()) {
+        return true;
+    }
+    // Ties go to the partition already in cache, so that a scan reading
+    // each partition once doesn't replace partitions read once before it.
+    auto victim = std::hash<dht::token>()(lru.back().key().token());
+    return _sketch->estimate(h) > _sketch->estimate(victim);
+}
+
+void row_cache::set_frequency_admission(bool enabled) {
+    if (!enabled) {
+        _sketch.reset();
+    } else if (!_sketch) {
+        _sketch = std::make_unique<utils::frequency_sketch>();
+    }
+}
+
 void row_cache::populate(const mutation& m, const previous_entry_pointer* previous) {
+    if (!admit(m.decorated_key())) {
+        // A scanning reader continues from the previous partition it
+        // populated, so the range over this one doesn't become continuous.
+        ++_admission_rejections;
+        _tracker.on_admission_rejection();
+        return;
+    }
     do_find_or_create_entry(m.decorated_key(), previous, [&] (auto i) {
         cache_entry* entry = current_allocator().construct<cache_entry>(
                 m.schema(), m.decorated_key(), m.partition());
         upgrade_entry(*entry);
-        _tracker.insert(*entry);
+        _tracker.insert(_lru, *entry);
         return _partitions.insert(i, *entry);
     }, [&] (auto i) {
-        _tracker.touch(*i);
+        _tracker.touch(_lru, *i);
         // We cache whole partitions right now, so if cache already has this partition,
         // it must be complete, so do nothing.
         _tracker.on_miss_already_populated();  // #1534
@@ -795,6 +1077,45 @@ future<> row_cache::clear() {
     return invalidate(query::full_partition_range);
 }
 
+// Rows of a memtable partition which are merged into cache in one step of
+// row_cache::update(), between which it may be preempted.
+static constexpr size_t rows_per_update_step = 128;
+
+// If src has more than max_rows clustered rows, moves the first max_rows of
+// them to the returned partition. Otherwise, src is small enough to be
+// merged in one step, and a disengaged optional is returned.
+// Doesn't allocate from the current allocator.
+static stdx::optional<mutation_partition> take_rows_prefix(const schema& s, mutation_partition& src, size_t max_rows) {
+    auto& rows = src.clustered_rows();
+    auto end = rows.begin();
+    for (size_t n = 0; n < max_rows && end != rows.end(); ++n) {
+        ++end;
+    }
+    if (end == rows.end()) {
+        return stdx::nullopt;
+    }
+    stdx::optional<mutation_partition> chunk(stdx::in_place, s.shared_from_this());
+    auto& chunk_rows = chunk->clustered_rows();
+    while (rows.begin() != end) {
+        auto& e = *rows.begin();
+        rows.erase(rows.begin());
+        chunk_rows.insert_before(chunk_rows.end(), e);
+    }
+    return chunk;
+}
+
+// Reverts take_rows_prefix(). Rows of chunk all sort before rows of dst.
+static void put_rows_back(mutation_partition& chunk, mutation_partition& dst) noexcept {
+    auto& rows = dst.clustered_rows();
+    auto& chunk_rows = chunk.clustered_rows();
+    auto first = rows.begin();
+    while (!chunk_rows.empty()) {
+        auto& e = *chunk_rows.begin();
+        chunk_rows.erase(chunk_rows.begin());
+        rows.insert_before(first, e);
+    }
+}
+
 future<> row_cache::update(memtable& m, partition_presence_checker presence_checker) {
     m.on_detach_from_region_group();
     _tracker.region().merge(m); // Now all data in memtable belongs to cache
@@ -804,6 +1125,7 @@ future<> row_cache::update(memtable& m, partition_presence_checker presence_chec
     auto t = seastar::thread(attr, [this, &m, presence_checker = std::move(presence_checker)] {
         auto cleanup = defer([&] {
             with_allocator(_tracker.allocator(), [&m, this] () {
+                utils::stall_context_scope stall_context(utils::stall_context::row_cache_update);
                 logalloc::reclaim_lock _(_tracker.region());
                 bool blow_cache = false;
                 // Note: clear_and_dispose() ought not to look up any keys, so it doesn't require
@@ -826,8 +1148,13 @@ future<> row_cache::update(memtable& m, partition_presence_checker presence_chec
             });
         });
         _populate_phaser.advance_and_await().get();
+        // Set when some rows of the first partition in the memtable were moved
+        // to cache, but not all of them yet. Readers meanwhile get the rest from
+        // the sstable the memtable was flushed to, which they read instead of it.
+        bool partially_merged = false;
         while (!m.partitions.empty()) {
-            with_allocator(_tracker.allocator(), [this, &m, &presence_checker] () {
+            with_allocator(_tracker.allocator(), [this, &m, &presence_checker, &partially_merged] () {
+                utils::stall_context_scope stall_context(utils::stall_context::row_cache_update);
                 unsigned quota = 30;
                 auto cmp = cache_entry::compare(_schema);
                 {
@@ -848,25 +1175,56 @@ future<> row_cache::update(memtable& m, partition_presence_checker presence_chec
                             // If cache doesn't contain the entry we cannot insert it because the mutation may be incomplete.
                             // FIXME: keep a bitmap indicating which sstables we do cover, so we don't have to
                             //        search it.
-                            if (cache_i != partitions_end() && cache_i->key().equal(*_schema, mem_e.key())) {
-                              if (!cache_i->wide_partition()) {
-                                cache_entry& entry = *cache_i;
+                            if (cache_i != partitions_end() && !cache_i->is_range_marker() && cache_i->key().equal(*_schema, mem_e.key())) {
+                              cache_entry& entry = *cache_i;
+                              if (!entry.wide_partition()) {
                                 upgrade_entry(entry);
+                                // Large partitions are merged a few rows at a time, so that
+                                // merging them doesn't stall the reactor. Rows can be moved
+                                // only if no reader holds a snapshot of the memtable partition.
+                                auto mp = mem_e.partition().exclusive_partition();
+                                stdx::optional<mutation_partition> chunk;
+                                if (mp) {
+                                    chunk = take_rows_prefix(*mem_e.schema(), *mp, rows_per_update_step);
+                                }
+                                if (chunk) {
+                                    try {
+                                        entry.partition().apply(*_schema, std::move(*chunk), *mem_e.schema());
+                                    } catch (...) {
+                                        put_rows_back(*chunk, *mp);
+                                        throw;
+                                    }
+                                    partially_merged = true;
+                                    _tracker.touch(_lru, entry);
+                                    --quota;
+                                    return;
+                                }
                                 entry.partition().apply(*_schema, std::move(mem_e.partition()), *mem_e.schema());
-                                _tracker.touch(entry);
+                                _tracker.touch(_lru, entry);
+                                _tracker.on_merge();
+                              } else if (entry.has_row_ranges()) {
+                                // Only the rows in ranges present in cache are kept.
+                                upgrade_entry(entry);
+                                auto ranges = entry.row_ranges();
+                                auto mp = mutation_partition(std::move(mem_e.partition()), *mem_e.schema(), ranges);
+                                entry.partition().apply(*_schema, std::move(mp), *mem_e.schema());
+                                _tracker.touch(_lru, entry);
                                 _tracker.on_merge();
                               }
-                            } else if (presence_checker(mem_e.key()) ==
+                            } else if (!partially_merged && presence_checker(mem_e.key()) ==
                                     partition_presence_checker_result::definitely_doesnt_exist) {
+                                // If the entry was evicted while partially merged, the rest
+                                // of the memtable partition isn't a complete partition.
                                 cache_entry* entry = current_allocator().construct<cache_entry>(
                                         mem_e.schema(), std::move(mem_e.key()), std::move(mem_e.partition()));
-                                _tracker.insert(*entry);
+                                _tracker.insert(_lru, *entry);
                                 _partitions.insert(cache_i, *entry);
                             } else {
                                 _tracker.clear_continuity(*cache_i);
                             }
                             i = m.partitions.erase(i);
                             current_allocator().destroy(&mem_e);
+                            partially_merged = false;
                             --quota;
                            }
                           });
@@ -893,12 +1251,58 @@ void row_cache::touch(const dht::decorated_key& dk) {
   with_linearized_managed_bytes([&] {
     auto i = _partitions.find(dk, cache_entry::compare(_schema));
     if (i != _partitions.end()) {
-        _tracker.touch(*i);
+        _tracker.touch(_lru, *i);
     }
   });
  });
 }
 
+bool row_cache::contains(const dht::decorated_key& dk) {
+  return _read_section(_tracker.region(), [&] {
+    return with_linearized_managed_bytes([&] {
+      auto i = _partitions.find(dk, cache_entry::compare(_schema));
+      return i != _partitions.end() && !i->is_range_marker();
+    });
+  });
+}
+
+std::vector<partition_key> row_cache::recently_used_keys(size_t n) {
+    std::vector<partition_key> keys;
+    _read_section(_tracker.region(), [&] {
+        keys.clear();
+        for (auto&& e : _lru.lru()) {
+            if (keys.size() == n) {
+                break;
+            }
+            if (!e.is_range_marker()) {
+                keys.push_back(e.key().key());
+            }
+        }
+    });
+    return keys;
+}
+
+memory_footprint row_cache::footprint() const {
+    memory_footprint f;
+    for (const cache_entry& e : _partitions) {
+        f.objects += sizeof(cache_entry);
+        if (e.is_dummy_entry() || e.is_range_marker()) {
+            continue;
+        }
+        ++f.partitions;
+        f.keys += e.key().key().external_memory_usage();
+        f.objects += e._row_ranges.size() * sizeof(cached_row_range);
+        e.partition().for_each_version([&f] (const partition_version& v) {
+            f.add(v);
+        });
+    }
+    auto occupancy = _tracker.region().occupancy();
+    if (occupancy.used_space()) {
+        f.fragmentation = uint64_t(double(occupancy.free_space()) * f.total() / occupancy.used_space());
+    }
+    return f;
+}
+
 void row_cache::invalidate_locked(const dht::decorated_key& dk) {
     auto pos = _partitions.lower_bound(dk, cache_entry::compare(_schema));
     if (pos == partitions_end() || !pos->key().equal(*_schema, dk)) {
@@ -906,7 +1310,7 @@ void row_cache::invalidate_locked(const dht::decorated_key& dk) {
     } else {
         auto it = _partitions.erase_and_dispose(pos,
             [this, &dk, deleter = current_deleter<cache_entry>()](auto&& p) mutable {
-                _tracker.on_erase();
+                _tracker.on_erase(_lru);
                 deleter(p);
             });
         _tracker.clear_continuity(*it);
@@ -955,7 +1359,7 @@ void row_cache::invalidate_unwrapped(const dht::partition_range& range) {
     }
     with_allocator(_tracker.allocator(), [this, begin, end] {
         auto it = _partitions.erase_and_dispose(begin, end, [this, deleter = current_deleter<cache_entry>()] (auto&& p) mutable {
-            _tracker.on_erase();
+            _tracker.on_erase(_lru);
             deleter(p);
         });
         assert(it != _partitions.end());
@@ -971,6 +1375,9 @@ row_cache::row_cache(schema_ptr s, mutation_source fallback_factory,
     , _underlying(std::move(fallback_factory))
     , _max_cached_partition_size_in_bytes(max_cached_partition_size_in_bytes)
 {
+    _tracker.register_table(_lru);
+    _lru.set_eviction_weight(_schema->caching_options().eviction_weight());
+    set_frequency_admission(_schema->caching_options().frequency_admission());
     with_allocator(_tracker.allocator(), [this] {
         cache_entry* entry = current_allocator().construct<cache_entry>(cache_entry::dummy_entry_tag());
         _partitions.insert(*entry);
@@ -996,30 +1403,191 @@ cache_entry::cache_entry(cache_entry&& o) noexcept
         container_type::node_algorithms::replace_node(o._cache_link.this_ptr(), _cache_link.this_ptr());
         container_type::node_algorithms::init(o._cache_link.this_ptr());
     }
+    _row_ranges.swap(o._row_ranges);
+}
+
+cache_entry::~cache_entry() {
+    _row_ranges.clear_and_dispose(current_deleter<cached_row_range>());
+}
+
+cached_row_range::cached_row_range(cached_row_range&& o) noexcept
+    : _link()
+    , _range(std::move(o._range))
+{
+    if (o._link.is_linked()) {
+        auto prev = o._link.prev_;
+        o._link.unlink();
+        list_type::node_algorithms::link_after(prev, _link.this_ptr());
+    }
+}
+
+query::clustering_row_ranges cache_entry::row_ranges() const {
+    auto ranges = boost::copy_range<query::clustering_row_ranges>(_row_ranges
+        | boost::adaptors::transformed(std::mem_fn(&cached_row_range::range)));
+    position_in_partition::less_compare less(*_schema);
+    boost::sort(ranges, [&] (const query::clustering_range& a, const query::clustering_range& b) {
+        return less(position_in_partition_view::for_range_start(a), position_in_partition_view::for_range_start(b));
+    });
+    return ranges;
+}
+
+bool cache_entry::has_rows(const query::partition_slice& slice) {
+    if (_row_ranges.empty()) {
+        return false;
+    }
+    position_in_partition::less_compare less(*_schema);
+    std::vector<cached_row_range*> holding;
+    for (auto&& r : slice.row_ranges(*_schema, _key.key())) {
+        auto it = boost::find_if(_row_ranges, [&] (const cached_row_range& cr) {
+            return !less(position_in_partition_view::for_range_start(r), position_in_partition_view::for_range_start(cr.range()))
+                && !less(position_in_partition_view::for_range_end(cr.range()), position_in_partition_view::for_range_end(r));
+        });
+        if (it == _row_ranges.end()) {
+            return false;
+        }
+        holding.push_back(&*it);
+    }
+    for (auto cr : holding) {
+        cr->_link.unlink();
+        _row_ranges.push_front(*cr);
+    }
+    return true;
+}
+
+void cache_entry::add_row_range(const query::clustering_range& range) {
+    position_in_partition::less_compare less(*_schema);
+    auto start = range.start();
+    auto end = range.end();
+    // Ranges which overlap or touch the new one are merged with it, so that
+    // the rows of every range are contiguous in the partition.
+    auto it = _row_ranges.begin();
+    while (it != _row_ranges.end()) {
+        auto& r = it->range();
+        auto current = query::clustering_range(start, end);
+        if (less(position_in_partition_view::for_range_end(r), position_in_partition_view::for_range_start(current))
+                || less(position_in_partition_view::for_range_end(current), position_in_partition_view::for_range_start(r))) {
+            ++it;
+            continue;
+        }
+        if (less(position_in_partition_view::for_range_start(r), position_in_partition_view::for_range_start(current))) {
+            start = r.start();
+        }
+        if (less(position_in_partition_view::for_range_end(current), position_in_partition_view::for_range_end(r))) {
+            end = r.end();
+        }
+        it = _row_ranges.erase_and_dispose(it, current_deleter<cached_row_range>());
+    }
+    auto cr = current_allocator().construct<cached_row_range>(query::clustering_range(std::move(start), std::move(end)));
+    _row_ranges.push_front(*cr);
+}
+
+bool cache_entry::evict_row_range() {
+    auto mp = _pe.exclusive_partition();
+    if (_row_ranges.empty() || !mp) {
+        return false;
+    }
+    // Range tombstones are left behind. They are few, and still valid.
+    auto& r = _row_ranges.back().range();
+    mp->clustered_rows().erase_and_dispose(mp->lower_bound(*_schema, r), mp->upper_bound(*_schema, r),
+        current_deleter<rows_entry>());
+    _row_ranges.pop_back_and_dispose(current_deleter<cached_row_range>());
+    if (_row_ranges.empty()) {
+        _pe = {};
+    }
+    return true;
 }
 
 void row_cache::set_schema(schema_ptr new_schema) noexcept {
     _schema = std::move(new_schema);
+    _lru.set_eviction_weight(_schema->caching_options().eviction_weight());
+    try {
+        set_frequency_admission(_schema->caching_options().frequency_admission());
+    } catch (...) {
+        clogger.warn("Failed to enable frequency admission for {}.{}: {}", _schema->ks_name(), _schema->cf_name(), std::current_exception());
+    }
 }
 
 future<streamed_mutation_opt> cache_entry::read_wide(row_cache& rc,
     schema_ptr s, const query::partition_slice& slice, const io_priority_class& pc, streamed_mutation::forwarding fwd)
+{
+    if (has_rows(slice)) {
+        return make_ready_future<streamed_mutation_opt>(read(rc, s, slice, fwd));
+    }
+    return rc.read_wide(_key, std::move(s), slice, pc, nullptr, fwd);
+}
+
+future<streamed_mutation_opt> row_cache::read_wide(const dht::decorated_key& dk, schema_ptr s, const query::partition_slice& slice,
+    const io_priority_class& pc, tracing::trace_state_ptr trace_state, streamed_mutation::forwarding fwd)
 {
     struct range_and_underlyig_reader {
         dht::partition_range _range;
+        query::partition_slice _slice;
         mutation_reader _reader;
-        range_and_underlyig_reader(row_cache& rc, schema_ptr s, dht::partition_range pr,
-                                   const query::partition_slice& slice, const io_priority_class& pc, streamed_mutation::forwarding fwd)
+        range_and_underlyig_reader(row_cache& rc, schema_ptr s, dht::partition_range pr, query::partition_slice slice,
+                                   const io_priority_class& pc, tracing::trace_state_ptr trace_state, streamed_mutation::forwarding fwd)
                 : _range(std::move(pr))
-                , _reader(rc._underlying(s, _range, slice, pc, nullptr, fwd))
+                , _slice(std::move(slice))
+                , _reader(rc._underlying(s, _range, _slice, pc, std::move(trace_state), fwd))
         { }
         range_and_underlyig_reader(range_and_underlyig_reader&&) = delete;
     };
-    rc._tracker.on_uncached_wide_partition();
-    auto pr = dht::partition_range::make_singular(_key);
-    auto rd_ptr = std::make_unique<range_and_underlyig_reader>(rc, s, std::move(pr), slice, pc, fwd);
+    _tracker.on_uncached_wide_partition();
+    auto& ck_ranges = slice.row_ranges(*_schema, dk.key());
+    auto read_uncached = [this, dk, s, &slice, &pc, trace_state, fwd] {
+        auto rd_ptr = std::make_unique<range_and_underlyig_reader>(*this, s, dht::partition_range::make_singular(dk), slice, pc, trace_state, fwd);
+        auto& r_a_ur = *rd_ptr;
+        return r_a_ur._reader().finally([rd_ptr = std::move(rd_ptr)] {});
+    };
+    if (!can_cache_rows(ck_ranges, fwd)) {
+        return read_uncached();
+    }
+
+    // Whole rows are cached, so all the columns are read.
+    auto population_slice = partition_slice_builder(*_schema).with_ranges(ck_ranges).build();
+    auto rd_ptr = std::make_unique<range_and_underlyig_reader>(*this, _schema, dht::partition_range::make_singular(dk),
+        std::move(population_slice), pc, trace_state, streamed_mutation::forwarding::no);
     auto& r_a_ur = *rd_ptr;
-    return r_a_ur._reader().finally([rd_ptr = std::move(rd_ptr)] {});
+    return r_a_ur._reader().then([this, s, &slice, read_uncached = std::move(read_uncached), op = _populate_phaser.start()] (streamed_mutation_opt smopt) mutable {
+        return try_to_read(_max_cached_partition_size_in_bytes, std::move(smopt)).then(
+                [this, s, &slice, read_uncached = std::move(read_uncached), op = std::move(op)] (is_wide_partition is_wide, mutation_opt&& mo) mutable {
+            if (is_wide == is_wide_partition::yes) {
+                return read_uncached();
+            }
+            if (!mo) {
+                return make_ready_future<streamed_mutation_opt>();
+            }
+            populate_rows(*mo, slice.row_ranges(*_schema, mo->key()));
+            mo->upgrade(s);
+            auto ck_ranges = query::clustering_key_filter_ranges::get_ranges(*s, slice, mo->key());
+            auto filtered_partition = mutation_partition(std::move(mo->partition()), *mo->schema(), std::move(ck_ranges));
+            mo->partition() = std::move(filtered_partition);
+            return make_ready_future<streamed_mutation_opt>(streamed_mutation_from_mutation(std::move(*mo)));
+        });
+    }).finally([rd_ptr = std::move(rd_ptr)] {});
+}
+
+void row_cache::populate_rows(const mutation& m, const query::clustering_row_ranges& ck_ranges) {
+    if (ck_ranges.empty()) {
+        return;
+    }
+    with_allocator(_tracker.allocator(), [&] {
+        _populate_section(_tracker.region(), [&] {
+            with_linearized_managed_bytes([&] {
+                auto i = _partitions.find(m.decorated_key(), cache_entry::compare(_schema));
+                // The entry could have been evicted or invalidated meanwhile.
+                if (i == _partitions.end() || !i->wide_partition()) {
+                    return;
+                }
+                cache_entry& e = *i;
+                upgrade_entry(e);
+                e.partition().apply(*_schema, m.partition(), *m.schema());
+                for (auto&& r : ck_ranges) {
+                    e.add_row_range(r);
+                }
+                _tracker.touch(_lru, e);
+            });
+        });
+    });
 }
 
 streamed_mutation cache_entry::read(row_cache& rc, const schema_ptr& s, streamed_mutation::forwarding fwd) {
@@ -1027,7 +1595,6 @@ streamed_mutation cache_entry::read(row_cache& rc, const schema_ptr& s, streamed
 }
 
 streamed_mutation cache_entry::read(row_cache& rc, const schema_ptr& s, const query::partition_slice& slice, streamed_mutation::forwarding fwd) {
-    assert(!wide_partition());
     if (_schema->version() != s->version()) {
         auto ck_ranges = query::clustering_key_filter_ranges::get_ranges(*s, slice, _key.key());
         auto mp = mutation_partition(_pe.squashed(_schema, s), *s, std::move(ck_ranges));
@@ -1036,7 +1603,7 @@ streamed_mutation cache_entry::read(row_cache& rc, const schema_ptr& s, const qu
     }
     auto ckr = query::clustering_key_filter_ranges::get_ranges(*s, slice, _key.key());
     auto snp = _pe.read(_schema);
-    return make_partition_snapshot_reader(_schema, _key, std::move(ckr), snp, rc._tracker.region(), rc._read_section, { }, fwd);
+    return make_partition_snapshot_reader(_schema, _key, std::move(ckr), snp, rc._tracker.region(), rc._read_section, rc._tracker.version_merger(), { }, fwd);
 }
 
 const schema_ptr& row_cache::schema() const {
@@ -1045,10 +1612,6 @@ const schema_ptr& row_cache::schema() const {
 
 void row_cache::upgrade_entry(cache_entry& e) {
     if (e._schema != _schema) {
-        if (e.wide_partition()) {
-            e._schema = _schema;
-            return;
-        }
         auto& r = _tracker.region();
         assert(!r.reclaiming_enabled());
         with_allocator(r.allocator(), [this, &e] {
@@ -33,7 +33,10 @@
 #include "utils/phased_barrier.hh"
 #include "utils/histogram.hh"
 #include "partition_version.hh"
+#include "memory_footprint.hh"
 #include "utils/estimated_histogram.hh"
+#include "utils/lru.hh"
+#include "utils/frequency_sketch.hh"
 #include "tracing/trace_state.hh"
 #include <seastar/core/metrics_registration.hh>
 
@@ -41,6 +44,32 @@ namespace bi = boost::intrusive;
 
 class row_cache;
 
+// A range of rows of a wide partition which are all present in cache.
+//
+// Wide partitions don't fit in cache as a whole, so cache_entry holds only
+// the rows in clustering ranges which were read, along with the static row
+// and the partition tombstone, which are always complete. Ranges are kept
+// disjoint, and ordered by the time they were last read, so that the rows
+// which were not read recently can be evicted on their own.
+class cached_row_range {
+    using link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+
+    link_type _link;
+    query::clustering_range _range;
+    friend class cache_entry;
+public:
+    using list_type = bi::list<cached_row_range,
+        bi::member_hook<cached_row_range, link_type, &cached_row_range::_link>,
+        bi::constant_time_size<false>>; // we need this to have bi::auto_unlink on hooks.
+
+    explicit cached_row_range(query::clustering_range r)
+        : _range(std::move(r))
+    { }
+    cached_row_range(cached_row_range&&) noexcept;
+
+    const query::clustering_range& range() const { return _range; }
+};
+
 // Intrusive set entry which holds partition data.
 //
 // TODO: Make memtables use this format too.
@@ -62,9 +91,13 @@ class cache_entry {
         bool _continuous : 1;
         bool _wide_partition : 1;
         bool _dummy_entry : 1;
+        bool _range_marker : 1;
+        bool _after_token_keys : 1;
     } _flags{};
     lru_link_type _lru_link;
     cache_link_type _cache_link;
+    // Ranges of rows held by a wide partition entry, most recently read first.
+    cached_row_range::list_type _row_ranges;
     friend class size_calculator;
 public:
     friend class row_cache;
@@ -77,6 +110,22 @@ class cache_entry {
         _flags._dummy_entry = true;
     }
 
+    // Range markers are entries at ring positions which are not keys, the
+    // bounds of token ranges, with no partition data. They only carry the
+    // continuity of the range in front of them, so that scans of token
+    // ranges can find out the ranges are complete in cache. They are evicted
+    // like partitions.
+    struct range_marker_tag{};
+
+    // Requires: !pos.has_key()
+    cache_entry(schema_ptr s, const dht::ring_position& pos, range_marker_tag)
+        : _schema(std::move(s))
+        , _key{pos.token(), partition_key::make_empty()}
+    {
+        _flags._range_marker = true;
+        _flags._after_token_keys = pos.bound() == dht::ring_position::token_bound::end;
+    }
+
     struct wide_partition_tag{};
 
     cache_entry(schema_ptr s, const dht::decorated_key& key, wide_partition_tag)
@@ -105,6 +154,7 @@ class cache_entry {
     { }
 
     cache_entry(cache_entry&&) noexcept;
+    ~cache_entry();
 
     bool is_evictable() { return _lru_link.is_linked(); }
     const dht::decorated_key& key() const { return _key; }
@@ -114,19 +164,37 @@ class cache_entry {
     schema_ptr& schema() { return _schema; }
     // Requires: !wide_partition()
     streamed_mutation read(row_cache&, const schema_ptr&, streamed_mutation::forwarding);
-    // Requires: !wide_partition()
+    // Requires: !wide_partition() || has_rows(slice)
     streamed_mutation read(row_cache&, const schema_ptr&, const query::partition_slice&, streamed_mutation::forwarding);
+    // Reads from cache if it has all the rows selected by the slice,
+    // otherwise reads from the underlying source and caches the rows.
     // May return disengaged optional if the partition is empty.
     future<streamed_mutation_opt> read_wide(row_cache&, schema_ptr, const query::partition_slice&, const io_priority_class&, streamed_mutation::forwarding);
+    // Returns true if all the rows selected by the slice are in cache, and
+    // marks the ranges holding them as recently read.
+    // Requires: wide_partition()
+    bool has_rows(const query::partition_slice&);
+    // Extends the ranges of rows present in cache with a given one.
+    // The rows must have been applied to partition() already.
+    void add_row_range(const query::clustering_range&);
+    bool has_row_ranges() const { return !_row_ranges.empty(); }
+    // Returns the ranges of rows present in cache, in clustering order.
+    query::clustering_row_ranges row_ranges() const;
+    // Evicts the rows in the least recently read range. Returns false if
+    // there are no rows to evict on their own, in which case the whole
+    // entry has to be evicted.
+    bool evict_row_range();
     bool continuous() const { return _flags._continuous; }
     void set_continuous(bool value) { _flags._continuous = value; }
     bool wide_partition() const { return _flags._wide_partition; }
     void set_wide_partition() {
         _flags._wide_partition = true;
         _pe = {};
+        _row_ranges.clear_and_dispose(current_deleter<cached_row_range>());
     }
 
     bool is_dummy_entry() const { return _flags._dummy_entry; }
+    bool is_range_marker() const { return _flags._range_marker; }
 
     struct compare {
         dht::decorated_key::less_comparator _c;
@@ -135,10 +203,23 @@ class cache_entry {
             : _c(std::move(s))
         {}
 
+        // Compares the position of a range marker with the one of a token
+        // and its relation to keys, as in ring_position::relation_to_keys().
+        static int tri_compare_marker(const cache_entry& m, const dht::token& t, int relation_to_keys) {
+            auto r = dht::tri_compare(m._key.token(), t);
+            if (r) {
+                return r;
+            }
+            return (m._flags._after_token_keys ? 1 : -1) - relation_to_keys;
+        }
+
         bool operator()(const dht::decorated_key& k1, const cache_entry& k2) const {
             if (k2.is_dummy_entry()) {
                 return true;
             }
+            if (k2.is_range_marker()) {
+                return tri_compare_marker(k2, k1.token(), 0) > 0;
+            }
             return _c(k1, k2._key);
         }
 
@@ -146,6 +227,9 @@ class cache_entry {
             if (k2.is_dummy_entry()) {
                 return true;
             }
+            if (k2.is_range_marker()) {
+                return tri_compare_marker(k2, k1.token(), k1.relation_to_keys()) > 0;
+            }
             return _c(k1, k2._key);
         }
 
@@ -156,6 +240,12 @@ class cache_entry {
             if (k2.is_dummy_entry()) {
                 return true;
             }
+            if (k1.is_range_marker()) {
+                return tri_compare_marker(k1, k2._key.token(), k2.is_range_marker() ? (k2._flags._after_token_keys ? 1 : -1) : 0) < 0;
+            }
+            if (k2.is_range_marker()) {
+                return tri_compare_marker(k2, k1._key.token(), 0) > 0;
+            }
             return _c(k1._key, k2._key);
         }
 
@@ -163,6 +253,9 @@ class cache_entry {
             if (k1.is_dummy_entry()) {
                 return false;
             }
+            if (k1.is_range_marker()) {
+                return tri_compare_marker(k1, k2.token(), 0) < 0;
+            }
             return _c(k1._key, k2);
         }
 
@@ -170,6 +263,9 @@ class cache_entry {
             if (k1.is_dummy_entry()) {
                 return false;
             }
+            if (k1.is_range_marker()) {
+                return tri_compare_marker(k1, k2.token(), k2.relation_to_keys()) < 0;
+            }
             return _c(k1._key, k2);
         }
     };
@@ -181,11 +277,51 @@ class cache_tracker final {
     using lru_type = bi::list<cache_entry,
         bi::member_hook<cache_entry, cache_entry::lru_link_type, &cache_entry::_lru_link>,
         bi::constant_time_size<false>>; // we need this to have bi::auto_unlink on hooks.
+
+    // The partitions of one table in cache, in LRU order.
+    //
+    // Tables are evicted from in turn, so that each loses partitions at a
+    // rate inversely proportional to its eviction weight, and a scan over
+    // one table can't push all of the working set of others out of cache.
+    // This is start-time fair queueing: the table with the lowest virtual
+    // time is evicted from next, and its virtual time advances by its weight.
+    class table_lru {
+        using link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+
+        link_type _link;
+        lru_type _lru;
+        lru_type _wide_partition_lru;
+        float _eviction_weight = 1;
+        double _virtual_time = 0;
+        uint64_t _partitions = 0;
+        uint64_t _evictions = 0;
+        friend class cache_tracker;
+    public:
+        table_lru() = default;
+        table_lru(table_lru&&) noexcept;
+        table_lru& operator=(table_lru&&) noexcept;
+
+        float eviction_weight() const { return _eviction_weight; }
+        // Requires: weight > 0
+        void set_eviction_weight(float weight) { _eviction_weight = weight; }
+        uint64_t partitions() const { return _partitions; }
+        uint64_t evictions() const { return _evictions; }
+        // Most recently used first.
+        const lru_type& lru() const { return _lru; }
+    };
 private:
+    using table_list_type = bi::list<table_lru,
+        bi::member_hook<table_lru, table_lru::link_type, &table_lru::_link>,
+        bi::constant_time_size<false>>; // we need this to have bi::auto_unlink on hooks.
+
     // We will try to evict large partition after that many normal evictions
     const uint32_t _normal_large_eviction_ratio = 1000;
     // Number of normal evictions to perform before we try to evict large partition
     uint32_t _normal_eviction_count = _normal_large_eviction_ratio;
+    // We will try to evict an sstable index page after that many partition evictions
+    const uint32_t _partition_index_eviction_ratio = 8;
+    // Number of partition evictions to perform before we try to evict an index page
+    uint32_t _partition_eviction_count = _partition_index_eviction_ratio;
 public:
     struct stats {
         uint64_t hits;
@@ -197,36 +333,72 @@ class cache_tracker final {
         uint64_t merges;
         uint64_t evictions;
         uint64_t wide_partition_evictions;
+        uint64_t row_range_evictions;
         uint64_t removals;
         uint64_t partitions;
         uint64_t modification_count;
+        uint64_t range_scans_from_cache;
+        uint64_t range_scans_from_underlying;
+        uint64_t admission_rejections;
     };
 private:
     stats _stats{};
+    // Value of _stats.insertions at the last eviction of a partition.
+    uint64_t _insertions_at_last_eviction = 0;
     seastar::metrics::metric_groups _metrics;
     logalloc::region _region;
-    lru_type _lru;
-    lru_type _wide_partition_lru;
+    partition_version_merger _version_merger;
+    table_list_type _tables;
+    // Virtual time of the table evicted from last.
+    double _eviction_clock = 0;
+    // Cached sstable index pages. They live outside of _region, but are
+    // evicted along with its contents.
+    lru _index_lru;
 private:
     void setup_metrics();
+    // Wide partition entries holding rows are evicted along with normal ones.
+    static lru_type& lru_for(table_lru& t, cache_entry& e) {
+        return e.wide_partition() && !e.has_row_ranges() ? t._wide_partition_lru : t._lru;
+    }
+    table_lru* table_to_evict(lru_type table_lru::* lru);
+    void on_evicted_from(table_lru&);
+    // Evicts an entry regardless of its position in LRU.
+    void evict(cache_entry&) noexcept;
 public:
     cache_tracker();
     ~cache_tracker();
     void clear();
-    void touch(cache_entry&);
-    void insert(cache_entry&);
-    void mark_wide(cache_entry&);
+    // Makes the region reclaim memory by evicting whole segments, oldest
+    // first, along with the entries whose objects they hold, before evicting
+    // in LRU order.
+    void enable_segment_eviction();
+    void register_table(table_lru&);
+    void touch(table_lru&, cache_entry&);
+    void insert(table_lru&, cache_entry&);
+    void mark_wide(table_lru&, cache_entry&);
     void clear_continuity(cache_entry& ce);
-    void on_erase();
+    void on_erase(table_lru&);
     void on_merge();
     void on_hit();
     void on_miss();
     void on_miss_already_populated();
     void on_uncached_wide_partition();
     void on_wide_partition_mispopulation();
+    // Called when a range scan is done, with whether any part of it had to
+    // be read from the underlying data source.
+    void on_range_scan(bool from_underlying);
+    void on_admission_rejection();
+    // Whether cache has run out of memory recently, so that caching a
+    // partition is likely to evict another one. It's considered full until
+    // it gains as many partitions as it holds without evicting any.
+    bool is_full() const {
+        return _stats.insertions - _insertions_at_last_eviction < _stats.partitions;
+    }
     allocation_strategy& allocator();
     logalloc::region& region();
     const logalloc::region& region() const;
+    lru& index_lru() { return _index_lru; }
+    partition_version_merger& version_merger() { return _version_merger; }
     uint64_t modification_count() const { return _stats.modification_count; }
     uint64_t partitions() const { return _stats.partitions; }
     uint64_t uncached_wide_partitions() const { return _stats.uncached_wide_partitions; }
@@ -262,8 +434,13 @@ class row_cache final {
     };
 private:
     cache_tracker& _tracker;
+    cache_tracker::table_lru _lru;
     stats _stats{};
     schema_ptr _schema;
+    // Estimated read frequencies of the table's partitions, kept only when
+    // frequency admission is enabled.
+    std::unique_ptr<utils::frequency_sketch> _sketch;
+    uint64_t _admission_rejections = 0;
     partitions_type _partitions; // Cached partitions are complete.
     mutation_source _underlying;
     uint64_t _max_cached_partition_size_in_bytes;
@@ -291,7 +468,19 @@ class row_cache final {
     void on_hit();
     void on_miss();
     void on_uncached_wide_partition();
+    // Counts a read of the partition at the given token towards its
+    // estimated frequency.
+    void on_access(const dht::token&);
+    // Decides whether a partition missing from cache, which was just read
+    // from the underlying source, should be cached.
+    bool admit(const dht::decorated_key&);
     void upgrade_entry(cache_entry&);
+    // Reads the rows of a wide partition selected by the slice from the
+    // underlying source, and caches them if they fit within
+    // _max_cached_partition_size_in_bytes.
+    future<streamed_mutation_opt> read_wide(const dht::decorated_key&, schema_ptr, const query::partition_slice&,
+                                            const io_priority_class&, tracing::trace_state_ptr, streamed_mutation::forwarding);
+    void populate_rows(const mutation& m, const query::clustering_row_ranges&);
     void invalidate_locked(const dht::decorated_key&);
     void invalidate_unwrapped(const dht::partition_range&);
     void clear_now() noexcept;
@@ -299,9 +488,11 @@ class row_cache final {
 
     struct previous_entry_pointer {
         utils::phased_barrier::phase_type _populate_phase;
-        stdx::optional<dht::decorated_key> _key;
+        // The position of a partition or of a range marker, or disengaged
+        // for the beginning of the ring.
+        stdx::optional<dht::ring_position> _key;
 
-        void reset(stdx::optional<dht::decorated_key> key, utils::phased_barrier::phase_type populate_phase) {
+        void reset(stdx::optional<dht::ring_position> key, utils::phased_barrier::phase_type populate_phase) {
             _populate_phase = populate_phase;
             _key = std::move(key);
         }
@@ -312,14 +503,18 @@ class row_cache final {
         // (not to mention avoiding lookups in just_cache_scanning_reader.
     };
 
-    template<typename CreateEntry, typename VisitEntry>
+    // Key is either a dht::decorated_key or a dht::ring_position.
+    template<typename Key, typename CreateEntry, typename VisitEntry>
     //requires requires(CreateEntry create, VisitEntry visit, partitions_type::iterator it) {
     //        { create(it) } -> partitions_type::iterator;
     //        { visit(it) } -> void;
     //    }
-    void do_find_or_create_entry(const dht::decorated_key& key, const previous_entry_pointer* previous,
+    void do_find_or_create_entry(const Key& key, const previous_entry_pointer* previous,
                                  CreateEntry&& create_entry, VisitEntry&& visit_entry);
 
+    // Returns true if the entry right before i is the one previous points to.
+    bool follows(partitions_type::iterator i, const previous_entry_pointer& previous);
+
     partitions_type::iterator partitions_end() {
         return std::prev(_partitions.end());
     }
@@ -343,6 +538,36 @@ class row_cache final {
                                 mutation_reader::forwarding fwd_mr = mutation_reader::forwarding::no);
 
     const stats& stats() const { return _stats; }
+
+    // Tables with higher weights lose fewer partitions to eviction.
+    // The weight comes from the table's caching options, and is reset to
+    // it when the schema changes.
+    float eviction_weight() const { return _lru.eviction_weight(); }
+    // Requires: weight > 0
+    void set_eviction_weight(float weight) { _lru.set_eviction_weight(weight); }
+    uint64_t cached_partitions() const { return _lru.partitions(); }
+    uint64_t evictions() const { return _lru.evictions(); }
+
+    // With frequency admission, once cache is full, a partition read from
+    // the underlying source is cached only if it was read more often
+    // recently than the table's least recently used partition, which it
+    // would push out. This keeps partitions read just once, as in scans,
+    // from evicting the frequently read ones (TinyLFU).
+    // Enabled by the table's caching options, and reset to them when the
+    // schema changes.
+    bool frequency_admission() const { return bool(_sketch); }
+    void set_frequency_admission(bool);
+    uint64_t admission_rejections() const { return _admission_rejections; }
+
+    // Keys of the at most n most recently used partitions in cache, most
+    // recent first. Wide partitions are not included.
+    std::vector<partition_key> recently_used_keys(size_t n);
+
+    // Memory used by the cached partitions of this table. The region is
+    // shared by all tables, so fragmentation is this table's share of its
+    // unused space, in proportion to the memory it uses.
+    // Walks all entries without yielding, so it's meant for diagnostics.
+    memory_footprint footprint() const;
 public:
     // Populate cache from given mutation. The mutation must contain all
     // information there is for its partition in the underlying data sources.
@@ -351,6 +576,11 @@ class row_cache final {
     // Caches an information that a partition with a given key is wide.
     void mark_partition_as_wide(const dht::decorated_key& key, const previous_entry_pointer* previous = nullptr);
 
+    // Inserts a range marker at a given position, which is not a key, unless
+    // there is one already. If previous is given, the range between it and
+    // the marker becomes continuous.
+    void mark_range_bound(const dht::ring_position& pos, const previous_entry_pointer* previous = nullptr);
+
     // Clears the cache.
     // Guarantees that cache will not be populated using readers created
     // before this method was invoked.
@@ -360,11 +590,19 @@ class row_cache final {
     // has just been flushed to the underlying data source.
     // The memtable can be queried during the process, but must not be written.
     // After the update is complete, memtable is empty.
+    //
+    // The update yields between partitions, and within large partitions, so
+    // it shouldn't stall the reactor regardless of the size of the memtable.
+    // The memtable must be marked as flushed beforehand, so that readers see
+    // the data not merged into cache yet in the sstable it was flushed to.
     future<> update(memtable&, partition_presence_checker underlying_negative);
 
     // Moves given partition to the front of LRU if present in cache.
     void touch(const dht::decorated_key&);
 
+    // Whether the given partition is present in cache.
+    bool contains(const dht::decorated_key&);
+
     // Removes given partition from cache.
     //
     // Guarantees that cache will not be populated with given key
@@ -393,8 +631,8 @@ class row_cache final {
     const schema_ptr& schema() const;
 
     friend class just_cache_scanning_reader;
+    friend class wide_partition_reader;
     friend class scanning_and_populating_reader;
     friend class range_populating_reader;
     friend class cache_tracker;
-    friend class mark_end_as_continuous;
 };
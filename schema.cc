@@ -116,6 +116,10 @@ void schema::rebuild() {
         _columns_by_name[def.name()] = &def;
     }
 
+    _has_multi_cell_collections = boost::algorithm::any_of(all_columns(), [] (const column_definition& cdef) {
+        return cdef.type->is_collection() && cdef.type->is_multi_cell();
+    });
+
     static_assert(row_column_ids_are_ordered_by_name::value, "row columns don't need to be ordered by name");
     if (!std::is_sorted(regular_columns().begin(), regular_columns().end(), column_definition::name_comparator())) {
         throw std::runtime_error("Regular columns should be sorted by name");
@@ -328,13 +332,6 @@ sstring schema::thrift_key_validator() const {
     }
 }
 
-bool
-schema::has_multi_cell_collections() const {
-    return boost::algorithm::any_of(all_columns(), [] (const column_definition& cdef) {
-        return cdef.type->is_collection() && cdef.type->is_multi_cell();
-    });
-}
-
 bool operator==(const schema& x, const schema& y)
 {
     return x._raw._id == y._raw._id
@@ -361,6 +358,8 @@ bool operator==(const schema& x, const schema& y)
         && x._raw._compaction_strategy == y._raw._compaction_strategy
         && x._raw._compaction_strategy_options == y._raw._compaction_strategy_options
         && x._raw._caching_options == y._raw._caching_options
+        && x._raw._cdc == y._raw._cdc
+        && x._raw._per_partition_rate_limit_options == y._raw._per_partition_rate_limit_options
         && x._raw._dropped_columns == y._raw._dropped_columns
         && x._raw._collections == y._raw._collections
         && indirect_equal_to<std::unique_ptr<::view_info>>()(x._view_info, y._view_info)
@@ -500,6 +499,8 @@ std::ostream& operator<<(std::ostream& os, const schema& s) {
     os << ",minIndexInterval=" << s._raw._min_index_interval;
     os << ",maxIndexInterval=" << s._raw._max_index_interval;
     os << ",speculativeRetry=" << s._raw._speculative_retry.to_sstring();
+    os << ",cdc=" << std::boolalpha << s._raw._cdc;
+    os << ",perPartitionRateLimit=" << s._raw._per_partition_rate_limit_options.to_sstring();
     os << ",droppedColumns={}";
     os << ",triggers=[]";
     os << ",isDense=" << std::boolalpha << s._raw._is_dense;
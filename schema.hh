@@ -37,6 +37,7 @@
 #include "compress.hh"
 #include "compaction_strategy.hh"
 #include "caching_options.hh"
+#include "db/per_partition_rate_limit_options.hh"
 #include "stdx.hh"
 
 using column_count_type = uint32_t;
@@ -427,6 +428,10 @@ class schema final : public enable_lw_shared_from_this<schema> {
         sstables::compaction_strategy_type _compaction_strategy = sstables::compaction_strategy_type::size_tiered;
         std::map<sstring, sstring> _compaction_strategy_options;
         caching_options _caching_options;
+        // Whether the changes to the table are recorded in its change log,
+        // see cdc/log.hh.
+        bool _cdc = false;
+        db::per_partition_rate_limit_options _per_partition_rate_limit_options;
         table_schema_version _version;
         std::unordered_map<sstring, dropped_column> _dropped_columns;
         std::map<bytes, data_type> _collections;
@@ -448,6 +453,7 @@ class schema final : public enable_lw_shared_from_this<schema> {
     lw_shared_ptr<compound_type<allow_prefixes::no>> _partition_key_type;
     lw_shared_ptr<compound_type<allow_prefixes::yes>> _clustering_key_type;
     column_mapping _column_mapping;
+    bool _has_multi_cell_collections = false;
     friend class schema_builder;
 public:
     using row_column_ids_are_ordered_by_name = std::true_type;
@@ -586,6 +592,14 @@ class schema final : public enable_lw_shared_from_this<schema> {
         return _raw._caching_options;
     }
 
+    bool cdc() const {
+        return _raw._cdc;
+    }
+
+    const db::per_partition_rate_limit_options& per_partition_rate_limit_options() const {
+        return _raw._per_partition_rate_limit_options;
+    }
+
     const column_definition* get_column_definition(const bytes& name) const;
     const column_definition& column_at(column_kind, column_id) const;
     const_iterator regular_begin() const;
@@ -600,7 +614,9 @@ class schema final : public enable_lw_shared_from_this<schema> {
     const column_definition& regular_column_at(column_id id) const;
     const column_definition& static_column_at(column_id id) const;
     bool is_last_partition_key(const column_definition& def) const;
-    bool has_multi_cell_collections() const;
+    bool has_multi_cell_collections() const {
+        return _has_multi_cell_collections;
+    }
     bool has_static_columns() const;
     column_count_type partition_key_size() const;
     column_count_type clustering_key_size() const;
@@ -164,6 +164,24 @@ struct schema_builder {
         return _raw._speculative_retry;
     }
 
+    schema_builder& set_cdc(bool cdc) {
+        _raw._cdc = cdc;
+        return *this;
+    }
+
+    bool get_cdc() const {
+        return _raw._cdc;
+    }
+
+    schema_builder& set_per_partition_rate_limit_options(db::per_partition_rate_limit_options options) {
+        _raw._per_partition_rate_limit_options = options;
+        return *this;
+    }
+
+    const db::per_partition_rate_limit_options& get_per_partition_rate_limit_options() const {
+        return _raw._per_partition_rate_limit_options;
+    }
+
     schema_builder& set_bloom_filter_fp_chance(double fp) {
         _raw._bloom_filter_fp_chance = fp;
         return *this;
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include "cache_warmup.hh"
+#include "core/fstream.hh"
+#include "db/config.hh"
+#include "db/system_keyspace.hh"
+#include "lister.hh"
+#include "log.hh"
+#include "service/priority_manager.hh"
+#include "types.hh"
+#include "utils/serialization.hh"
+
+namespace service {
+
+static logging::logger cwlogger("cache_warmup");
+
+// Saved keys files hold:
+//
+//   version: uint32
+//   keys: (size: uint32, partition key: bytes[size])*
+//
+// in the order of the LRU, most recently used first.
+static constexpr uint32_t format_version = 1;
+
+static constexpr auto file_suffix = ".keys";
+
+cache_warmup::cache_warmup(seastar::sharded<database>& db)
+    : _db(db.local())
+    , _dir(_db.get_config().saved_caches_directory())
+    , _save_period(_db.get_config().row_cache_save_period())
+    , _keys_to_save(_db.get_config().row_cache_keys_to_save())
+    , _limiter(size_t(_db.get_config().row_cache_warmup_throughput_mb_per_sec()) * 1024 * 1024 / smp::count)
+    , _timer([this] {
+        _saving = save().then([this] {
+            if (!_gate.is_closed()) {
+                _timer.arm(_save_period);
+            }
+        });
+    })
+{ }
+
+sstring cache_warmup::file_prefix(const schema& s) const {
+    return sprint("%s/%s-%s-%s-", _dir, s.ks_name(), s.cf_name(), s.id());
+}
+
+sstring cache_warmup::file_name(const schema& s, unsigned shard) const {
+    return file_prefix(s) + to_sstring(shard) + file_suffix;
+}
+
+static bool is_saved(const column_family& cf) {
+    return cf.schema()->ks_name() != db::system_keyspace::NAME;
+}
+
+void cache_warmup::start() {
+    if (_save_period.count()) {
+        _timer.arm(_save_period);
+    }
+
+    // Runs in the background, requests are served meanwhile.
+    (void)with_gate(_gate, [this] {
+        return engine().file_exists(_dir).then([this] (bool exists) {
+            if (!exists) {
+                return make_ready_future<>();
+            }
+            auto files = make_lw_shared<std::vector<sstring>>();
+            return lister::scan_dir(_dir, { directory_entry_type::regular }, [files] (lister::path dir, directory_entry de) {
+                if (boost::algorithm::ends_with(de.name, file_suffix)) {
+                    files->push_back((dir / de.name.c_str()).native());
+                }
+                return make_ready_future<>();
+            }).then([this, files] {
+                return do_for_each(*files, [this] (const sstring& name) {
+                    for (auto&& e : _db.get_column_families()) {
+                        auto& cf = *e.second;
+                        if (is_saved(cf) && boost::algorithm::starts_with(name, file_prefix(*cf.schema()))) {
+                            return load(name, cf.schema());
+                        }
+                    }
+                    return make_ready_future<>();
+                });
+            });
+        });
+    }).then_wrapped([] (future<> f) {
+        try {
+            f.get();
+            cwlogger.info("Done warming up caches");
+        } catch (...) {
+            cwlogger.warn("Failed to warm up caches: {}", std::current_exception());
+        }
+    });
+}
+
+future<> cache_warmup::load(sstring file_name, schema_ptr s) {
+    return open_file_dma(file_name, open_flags::ro).then([] (file f) {
+        return f.size().then([f] (uint64_t size) mutable {
+            return do_with(make_file_input_stream(std::move(f)), [size] (input_stream<char>& in) {
+                return in.read_exactly(size).finally([&in] {
+                    return in.close();
+                });
+            });
+        });
+    }).then([this, s = std::move(s), file_name] (temporary_buffer<char> buf) {
+        std::vector<dht::decorated_key> keys;
+        try {
+            auto v = bytes_view(reinterpret_cast<const int8_t*>(buf.get()), buf.size());
+            auto version = read_simple<uint32_t>(v);
+            if (version != format_version) {
+                cwlogger.warn("Ignoring {}, it has unknown format version {}", file_name, version);
+                return make_ready_future<>();
+            }
+            while (!v.empty()) {
+                auto size = read_simple<uint32_t>(v);
+                auto dk = dht::global_partitioner().decorate_key(*s, partition_key::from_bytes(read_simple_bytes(v, size)));
+                if (dht::shard_of(dk.token()) == engine().cpu_id()) {
+                    keys.push_back(std::move(dk));
+                }
+            }
+        } catch (const marshal_exception&) {
+            cwlogger.warn("Ignoring the rest of {}, it is truncated", file_name);
+        }
+        cwlogger.debug("Reading {} partitions of {}.{} into cache", keys.size(), s->ks_name(), s->cf_name());
+        return warm_up(s->id(), std::move(keys));
+    });
+}
+
+future<> cache_warmup::warm_up(utils::UUID id, std::vector<dht::decorated_key> keys) {
+    struct state {
+        utils::UUID id;
+        std::vector<dht::decorated_key> keys;
+        size_t next = 0;
+    };
+    return do_with(state{id, std::move(keys)}, [this] (state& st) {
+        return repeat([this, &st] {
+            // The table may be dropped while it's being warmed up.
+            auto i = _db.get_column_families().find(st.id);
+            if (st.next == st.keys.size() || i == _db.get_column_families().end() || _gate.is_closed()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            auto cf = i->second;
+            auto s = cf->schema();
+            auto range = make_lw_shared<dht::partition_range>(dht::partition_range::make_singular(std::move(st.keys[st.next++])));
+            auto reader = make_lw_shared<mutation_reader>(cf->make_reader(s, *range, query::full_slice,
+                get_local_cache_warmup_priority()));
+            // Reading a partition through the cache populates it.
+            return (*reader)().then([] (streamed_mutation_opt smo) {
+                if (!smo) {
+                    return make_ready_future<size_t>(0);
+                }
+                return do_with(std::move(*smo), size_t(0), [] (streamed_mutation& sm, size_t& size) {
+                    return repeat([&sm, &size] {
+                        return sm().then([&size] (mutation_fragment_opt mf) {
+                            if (!mf) {
+                                return stop_iteration::yes;
+                            }
+                            size += mf->memory_usage();
+                            return stop_iteration::no;
+                        });
+                    }).then([&size] {
+                        return size;
+                    });
+                });
+            }).then([this, reader, range, cf] (size_t size) {
+                return _limiter.reserve(size);
+            }).then([] {
+                return stop_iteration::no;
+            });
+        });
+    });
+}
+
+future<> cache_warmup::save(column_family& cf) {
+    auto s = cf.schema();
+    auto keys = cf.get_row_cache().recently_used_keys(_keys_to_save ? _keys_to_save : std::numeric_limits<size_t>::max());
+    size_t size = sizeof(uint32_t);
+    for (auto&& k : keys) {
+        size += sizeof(uint32_t) + k.representation().size();
+    }
+    bytes buf(bytes::initialized_later(), size);
+    auto out = buf.begin();
+    serialize_int32(out, format_version);
+    for (auto&& k : keys) {
+        auto v = k.representation();
+        serialize_int32(out, v.size());
+        out = std::copy(v.begin(), v.end(), out);
+    }
+    auto name = file_name(*s, engine().cpu_id());
+    auto tmp_name = name + ".tmp";
+    // Written to a temporary file first, so that a crash leaves either the
+    // old keys or the new ones.
+    return open_file_dma(tmp_name, open_flags::wo | open_flags::create | open_flags::truncate).then([buf = std::move(buf)] (file f) mutable {
+        return do_with(make_file_output_stream(std::move(f)), std::move(buf), [] (output_stream<char>& out, bytes& buf) {
+            return out.write(reinterpret_cast<const char*>(buf.data()), buf.size()).then([&out] {
+                return out.flush();
+            }).finally([&out] {
+                return out.close();
+            });
+        });
+    }).then([tmp_name, name] {
+        return rename_file(tmp_name, name);
+    });
+}
+
+future<> cache_warmup::save() {
+    return with_gate(_gate, [this] {
+        return recursive_touch_directory(_dir).then([this] {
+            auto tables = make_lw_shared<std::vector<lw_shared_ptr<column_family>>>();
+            for (auto&& e : _db.get_column_families()) {
+                if (is_saved(*e.second)) {
+                    tables->push_back(e.second);
+                }
+            }
+            return do_for_each(*tables, [this, tables] (lw_shared_ptr<column_family>& cf) {
+                return save(*cf);
+            });
+        });
+    }).handle_exception([] (auto ep) {
+        cwlogger.warn("Failed to save caches: {}", ep);
+    });
+}
+
+future<> cache_warmup::stop() {
+    _timer.cancel();
+    return _gate.close().then([this] {
+        return std::move(_saving);
+    });
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "database.hh"
+#include "core/timer.hh"
+#include "core/gate.hh"
+#include "core/sharded.hh"
+#include "utils/rate_limiter.hh"
+
+namespace service {
+
+// Saves the keys of the most recently used partitions in the cache of each
+// table to saved_caches_directory, every row_cache_save_period seconds, and
+// reads them back into cache in the background when the node starts. So a
+// restarted node doesn't serve its working set from disk until the cache
+// fills up again.
+//
+// Each shard saves the tables it owns to its own files, and on start reads
+// the files of all shards, keeping the keys it owns, so saved keys survive a
+// change of the number of shards.
+class cache_warmup {
+    database& _db;
+    sstring _dir;
+    std::chrono::seconds _save_period;
+    size_t _keys_to_save;
+    // In bytes of partitions read, per second.
+    utils::rate_limiter _limiter;
+    timer<lowres_clock> _timer;
+    seastar::gate _gate;
+    future<> _saving = make_ready_future<>();
+private:
+    sstring file_prefix(const schema& s) const;
+    sstring file_name(const schema& s, unsigned shard) const;
+    future<> save(column_family& cf);
+    future<> load(sstring file_name, schema_ptr s);
+    future<> warm_up(utils::UUID table, std::vector<dht::decorated_key> keys);
+public:
+    explicit cache_warmup(seastar::sharded<database>& db);
+
+    // Starts reading saved partitions into cache, and saving caches periodically.
+    void start();
+
+    // Saves the keys of the most recently used partitions of all tables.
+    future<> save();
+
+    future<> stop();
+};
+
+}
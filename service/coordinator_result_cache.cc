@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/coordinator_result_cache.hh"
+#include "transport/messages/result_message.hh"
+
+namespace service {
+
+void coordinator_result_cache::erase(lru_type::iterator it) {
+    for (auto&& t : it->tokens) {
+        auto range = _by_partition.equal_range(std::make_pair(it->table, t));
+        for (auto i = range.first; i != range.second; ++i) {
+            if (i->second == it) {
+                _by_partition.erase(i);
+                break;
+            }
+        }
+    }
+    _entries.erase(it->k);
+    _memory -= it->memory;
+    _lru.erase(it);
+}
+
+coordinator_result_cache::result_ptr coordinator_result_cache::find(const key& k, clock_type::time_point now) {
+    auto i = _entries.find(k);
+    if (i == _entries.end()) {
+        ++_stats.misses;
+        return { };
+    }
+    auto it = i->second;
+    if (it->expiry <= now) {
+        ++_stats.misses;
+        erase(it);
+        return { };
+    }
+    ++_stats.hits;
+    _lru.splice(_lru.begin(), _lru, it);
+    return it->result;
+}
+
+void coordinator_result_cache::insert(uint64_t epoch, key k, result_ptr result, utils::UUID table, std::vector<dht::token> tokens,
+        size_t memory, std::chrono::milliseconds ttl, clock_type::time_point now) {
+    // The key is kept both in the entry and in the index.
+    memory += 2 * k.values.size() + tokens.size() * sizeof(dht::token) + sizeof(entry);
+    if (epoch != this->epoch(table, tokens) || memory > _max_memory / 8) {
+        return;
+    }
+    auto i = _entries.find(k);
+    if (i != _entries.end()) {
+        erase(i->second);
+    }
+    while (_memory + memory > _max_memory && !_lru.empty()) {
+        ++_stats.evictions;
+        erase(std::prev(_lru.end()));
+    }
+    _lru.push_front(entry{std::move(k), std::move(result), table, std::move(tokens),
+            now + std::chrono::duration_cast<clock_type::duration>(ttl), memory});
+    auto it = _lru.begin();
+    _entries.emplace(it->k, it);
+    for (auto&& t : it->tokens) {
+        _by_partition.emplace(std::make_pair(table, t), it);
+    }
+    _memory += memory;
+    ++_stats.insertions;
+}
+
+uint64_t coordinator_result_cache::epoch(const utils::UUID& table, const std::vector<dht::token>& tokens) {
+    uint64_t ret = 0;
+    for (auto&& t : tokens) {
+        ret += epoch_of(table, t);
+    }
+    return ret;
+}
+
+void coordinator_result_cache::invalidate(const utils::UUID& table, const dht::token& token) {
+    ++epoch_of(table, token);
+    auto range = _by_partition.equal_range(std::make_pair(table, token));
+    while (range.first != range.second) {
+        auto it = range.first->second;
+        ++_stats.invalidations;
+        // erase() removes the entry from _by_partition, so look it up again.
+        erase(it);
+        range = _by_partition.equal_range(std::make_pair(table, token));
+    }
+}
+
+}
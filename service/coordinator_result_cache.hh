@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <core/lowres_clock.hh>
+#include <core/shared_ptr.hh>
+#include "bytes.hh"
+#include "dht/i_partitioner.hh"
+#include "utils/UUID.hh"
+#include "seastarx.hh"
+
+namespace cql_transport {
+namespace messages {
+class result_message;
+}
+}
+
+namespace service {
+
+// Keeps the results a coordinator shard returned for prepared statements
+// reading single partitions of tables with caching option
+// coordinator_ttl_in_ms set, so that repeating such a read with the same
+// bound values is answered without contacting any replica.
+//
+// Entries expire after the table's ttl, and are evicted least recently used
+// first once they use more memory than the cache may. Writes coordinated by
+// this node drop the entries of the partitions they touch, on all shards.
+// Writes coordinated by other nodes are only seen once the entry expires.
+//
+// A read which overlapped an invalidation of its partitions may have got
+// the data from before the write, so its result isn't inserted: callers
+// take the epoch of the partitions before the read and pass it to insert().
+// Invalidations are counted in a fixed number of buckets the partitions
+// hash to, so that writes to other partitions rarely prevent insertions.
+class coordinator_result_cache {
+public:
+    using clock_type = lowres_clock;
+    using result_ptr = ::shared_ptr<cql_transport::messages::result_message>;
+    struct key {
+        uint64_t statement_id;
+        bytes values;
+
+        bool operator==(const key& o) const {
+            return statement_id == o.statement_id && values == o.values;
+        }
+    };
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t insertions = 0;
+        uint64_t invalidations = 0;
+        uint64_t evictions = 0;
+    };
+private:
+    struct key_hash {
+        size_t operator()(const key& k) const {
+            return std::hash<bytes_view>()(bytes_view(k.values)) ^ std::hash<uint64_t>()(k.statement_id);
+        }
+    };
+    struct entry {
+        key k;
+        result_ptr result;
+        utils::UUID table;
+        std::vector<dht::token> tokens;
+        clock_type::time_point expiry;
+        size_t memory;
+    };
+    using lru_type = std::list<entry>; // Most recently used first.
+    struct partition_hash {
+        size_t operator()(const std::pair<utils::UUID, dht::token>& p) const {
+            return std::hash<utils::UUID>()(p.first) ^ std::hash<dht::token>()(p.second);
+        }
+    };
+
+    static constexpr size_t epoch_buckets = 1024;
+
+    size_t _max_memory;
+    size_t _memory = 0;
+    std::array<uint64_t, epoch_buckets> _epochs{};
+    lru_type _lru;
+    std::unordered_map<key, lru_type::iterator, key_hash> _entries;
+    std::unordered_multimap<std::pair<utils::UUID, dht::token>, lru_type::iterator, partition_hash> _by_partition;
+    stats _stats;
+private:
+    void erase(lru_type::iterator it);
+    uint64_t& epoch_of(const utils::UUID& table, const dht::token& token) {
+        return _epochs[partition_hash()(std::make_pair(table, token)) % epoch_buckets];
+    }
+public:
+    explicit coordinator_result_cache(size_t max_memory) : _max_memory(max_memory) { }
+
+    // Returns the result stored for the key, or null.
+    result_ptr find(const key& k, clock_type::time_point now = clock_type::now());
+
+    // Changes whenever the partitions with the given tokens of the table
+    // are invalidated.
+    uint64_t epoch(const utils::UUID& table, const std::vector<dht::token>& tokens);
+
+    // Stores the result of reading the partitions with the given tokens of
+    // the table, unless they were invalidated since epoch was taken.
+    // memory is the size of the result.
+    void insert(uint64_t epoch, key k, result_ptr result, utils::UUID table, std::vector<dht::token> tokens,
+            size_t memory, std::chrono::milliseconds ttl, clock_type::time_point now = clock_type::now());
+
+    // Drops the results which read the partition with the token.
+    void invalidate(const utils::UUID& table, const dht::token& token);
+
+    size_t memory_used() const {
+        return _memory;
+    }
+
+    size_t size() const {
+        return _entries.size();
+    }
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
+
+}
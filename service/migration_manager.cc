@@ -41,6 +41,8 @@
 
 #include "schema_registry.hh"
 #include "service/migration_manager.hh"
+#include "index/secondary_index_manager.hh"
+#include "cdc/log.hh"
 
 #include "service/migration_listener.hh"
 #include "message/messaging_service.hh"
@@ -167,7 +169,16 @@ future<> migration_manager::maybe_schedule_schema_pull(const utils::UUID& their_
     } else {
         // Include a delay to make sure we have a chance to apply any changes being
         // pushed out simultaneously. See CASSANDRA-5025
-        return sleep(migration_delay).then([this, &proxy, endpoint] {
+        //
+        // The version is looked up again once the delay is over, so any
+        // number of changes seen meanwhile are covered by the same pull.
+        auto it = _delayed_schema_pulls.find(endpoint);
+        if (it != _delayed_schema_pulls.end()) {
+            mlogger.debug("Schema pull from {} already scheduled", endpoint);
+            return it->second.get_future();
+        }
+        auto f = sleep(migration_delay).then([this, &proxy, endpoint] {
+            _delayed_schema_pulls.erase(endpoint);
             // grab the latest version of the schema since it may have changed again since the initial scheduling
             auto& gossiper = gms::get_local_gossiper();
             auto ep_state = gossiper.get_endpoint_state_for_endpoint(endpoint);
@@ -185,12 +196,35 @@ future<> migration_manager::maybe_schedule_schema_pull(const utils::UUID& their_
             mlogger.debug("submitting migration task for {}", endpoint);
             return submit_migration_task(endpoint);
         });
+        return _delayed_schema_pulls.emplace(endpoint, std::move(f)).first->second.get_future();
     }
 }
 
 future<> migration_manager::submit_migration_task(const gms::inet_address& endpoint)
 {
-    return service::migration_task::run_may_throw(get_storage_proxy(), endpoint);
+    auto it = _schema_pulls.find(endpoint);
+    if (it != _schema_pulls.end()) {
+        mlogger.debug("Schema pull from {} in progress, pulling again after it", endpoint);
+        it->second.pull_again = true;
+        return it->second.done.get_shared_future();
+    }
+    auto done = _schema_pulls[endpoint].done.get_shared_future();
+    repeat([this, endpoint] {
+        _schema_pulls[endpoint].pull_again = false;
+        return service::migration_task::run_may_throw(get_storage_proxy(), endpoint).then([this, endpoint] {
+            return _schema_pulls[endpoint].pull_again ? stop_iteration::no : stop_iteration::yes;
+        });
+    }).then_wrapped([this, endpoint] (future<> f) {
+        auto it = _schema_pulls.find(endpoint);
+        auto done = std::move(it->second.done);
+        _schema_pulls.erase(it);
+        if (f.failed()) {
+            done.set_exception(f.get_exception());
+        } else {
+            done.set_value();
+        }
+    });
+    return done;
 }
 
 future<> migration_manager::merge_schema_from(netw::messaging_service::msg_addr id)
@@ -470,6 +504,20 @@ future<> migration_manager::announce_new_keyspace(lw_shared_ptr<keyspace_metadat
     return announce(std::move(mutations), announce_locally);
 }
 
+// Adds the creation of the cdc log table of cfm, if it needs one.
+static future<std::vector<mutation>> add_cdc_log_mutations(database& db, lw_shared_ptr<keyspace_metadata> keyspace,
+        schema_ptr cfm, api::timestamp_type ts, std::vector<mutation> mutations) {
+    if (!cfm->cdc() || db.has_schema(cfm->ks_name(), cdc::log_name(cfm->cf_name()))) {
+        return make_ready_future<std::vector<mutation>>(std::move(mutations));
+    }
+    auto log = cdc::create_log_schema(*cfm);
+    mlogger.info("Create cdc log table '{}.{}'", log->ks_name(), log->cf_name());
+    return db::schema_tables::make_create_table_mutations(keyspace, log, ts).then([mutations = std::move(mutations)] (auto&& log_mutations) mutable {
+        std::move(log_mutations.begin(), log_mutations.end(), std::back_inserter(mutations));
+        return std::move(mutations);
+    });
+}
+
 future<> migration_manager::announce_new_column_family(schema_ptr cfm, bool announce_locally) {
 #if 0
     cfm.validate();
@@ -481,8 +529,11 @@ future<> migration_manager::announce_new_column_family(schema_ptr cfm, bool anno
             throw exceptions::already_exists_exception(cfm->ks_name(), cfm->cf_name());
         }
         mlogger.info("Create new ColumnFamily: {}", cfm);
-        return db::schema_tables::make_create_table_mutations(keyspace.metadata(), cfm, api::new_timestamp())
-            .then([announce_locally, this] (auto&& mutations) {
+        auto ts = api::new_timestamp();
+        return db::schema_tables::make_create_table_mutations(keyspace.metadata(), cfm, ts)
+            .then([&db, keyspace = keyspace.metadata(), cfm, ts] (auto&& mutations) {
+                return add_cdc_log_mutations(db, keyspace, cfm, ts, std::move(mutations));
+            }).then([announce_locally, this] (auto&& mutations) {
                 return announce(std::move(mutations), announce_locally);
             });
     } catch (const no_such_keyspace& e) {
@@ -505,9 +556,9 @@ future<> migration_manager::announce_column_family_update(schema_ptr cfm, bool f
         mlogger.info("Update table '{}.{}' From {} To {}", cfm->ks_name(), cfm->cf_name(), *old_schema, *cfm);
         auto&& keyspace = db.find_keyspace(cfm->ks_name()).metadata();
         return db::schema_tables::make_update_table_mutations(keyspace, old_schema, cfm, ts, from_thrift)
-            .then([announce_locally, keyspace, ts, view_updates = std::move(view_updates)] (auto&& mutations) {
+            .then([&db, announce_locally, keyspace, cfm, ts, view_updates = std::move(view_updates)] (auto&& mutations) {
                 return map_reduce(view_updates,
-                    [keyspace = std::move(keyspace), ts] (auto&& view) {
+                    [keyspace, ts] (auto&& view) {
                         auto& old_view = keyspace->cf_meta_data().at(view->cf_name());
                         mlogger.info("Update view '{}.{}' From {} To {}", view->ks_name(), view->cf_name(), *old_view, *view);
                         return db::schema_tables::make_update_view_mutations(keyspace, view_ptr(old_view), std::move(view), ts, false);
@@ -516,7 +567,9 @@ future<> migration_manager::announce_column_family_update(schema_ptr cfm, bool f
                         std::move(view_mutations.begin(), view_mutations.end(), std::back_inserter(result));
                         return std::move(result);
                     })
-                .then([announce_locally] (auto&& mutations) {
+                .then([&db, keyspace, cfm, ts] (auto&& mutations) {
+                    return add_cdc_log_mutations(db, keyspace, cfm, ts, std::move(mutations));
+                }).then([announce_locally] (auto&& mutations) {
                     return announce(std::move(mutations), announce_locally);
                 });
             });
@@ -621,17 +674,45 @@ future<> migration_manager::announce_column_family_drop(const sstring& ks_name,
         if (schema->is_view()) {
             throw exceptions::invalid_request_exception("Cannot use DROP TABLE on Materialized View");
         }
-        auto&& views = old_cfm.views();
+        // The index tables go away with the table.
+        std::vector<view_ptr> index_tables;
+        std::vector<view_ptr> views;
+        for (auto&& v : old_cfm.views()) {
+            (secondary_index::is_index_table(*schema, *v) ? index_tables : views).push_back(v);
+        }
         if (!views.empty()) {
             throw exceptions::invalid_request_exception(sprint(
                         "Cannot drop table when materialized views still depend on it (%s.{%s})",
                         ks_name, ::join(", ", views | boost::adaptors::transformed([](auto&& v) { return v->cf_name(); }))));
         }
         mlogger.info("Drop table '{}.{}'", schema->ks_name(), schema->cf_name());
-        return db::schema_tables::make_drop_table_mutations(db.find_keyspace(ks_name).metadata(), schema, api::new_timestamp())
-            .then([announce_locally] (auto&& mutations) {
-                return announce(std::move(mutations), announce_locally);
+        auto keyspace = db.find_keyspace(ks_name).metadata();
+        auto ts = api::new_timestamp();
+        return map_reduce(index_tables.begin(), index_tables.end(), [keyspace, ts] (const view_ptr& v) {
+            return db::schema_tables::make_drop_view_mutations(keyspace, v, ts);
+        }, std::vector<mutation>(), [] (std::vector<mutation> all, std::vector<mutation> m) {
+            std::move(m.begin(), m.end(), std::back_inserter(all));
+            return all;
+        }).then([keyspace, schema, ts] (std::vector<mutation> index_table_mutations) {
+            return db::schema_tables::make_drop_table_mutations(keyspace, schema, ts).then([index_table_mutations = std::move(index_table_mutations)] (auto&& mutations) mutable {
+                std::move(mutations.begin(), mutations.end(), std::back_inserter(index_table_mutations));
+                return std::move(index_table_mutations);
+            });
+        }).then([&db, keyspace, schema, ts] (std::vector<mutation> mutations) {
+            // The cdc log goes away with the table too, even if cdc was disabled since.
+            auto log_name = cdc::log_name(schema->cf_name());
+            if (!db.has_schema(schema->ks_name(), log_name)) {
+                return make_ready_future<std::vector<mutation>>(std::move(mutations));
+            }
+            auto log = db.find_schema(schema->ks_name(), log_name);
+            mlogger.info("Drop cdc log table '{}.{}'", log->ks_name(), log->cf_name());
+            return db::schema_tables::make_drop_table_mutations(keyspace, log, ts).then([mutations = std::move(mutations)] (auto&& log_mutations) mutable {
+                std::move(log_mutations.begin(), log_mutations.end(), std::back_inserter(mutations));
+                return std::move(mutations);
             });
+        }).then([announce_locally] (auto&& mutations) {
+            return announce(std::move(mutations), announce_locally);
+        });
     } catch (const no_such_column_family& e) {
         throw exceptions::configuration_exception(sprint("Cannot drop non existing table '%s' in keyspace '%s'.", cf_name, ks_name));
     }
@@ -48,14 +48,27 @@
 #include "gms/inet_address.hh"
 #include "message/messaging_service_fwd.hh"
 #include "utils/UUID.hh"
+#include "core/shared_future.hh"
 
 #include <vector>
+#include <unordered_map>
 
 namespace service {
 
 class migration_manager : public seastar::async_sharded_service<migration_manager> {
     std::vector<migration_listener*> _listeners;
 
+    // A schema pull in progress from some endpoint. Pulls requested while
+    // one is in progress are coalesced into a single one run after it, since
+    // the one in progress may have missed the changes which prompted them.
+    struct schema_pull {
+        shared_promise<> done;
+        bool pull_again = false;
+    };
+    std::unordered_map<gms::inet_address, schema_pull> _schema_pulls;
+    // Endpoints for which a delayed pull is already scheduled.
+    std::unordered_map<gms::inet_address, shared_future<>> _delayed_schema_pulls;
+
     static const std::chrono::milliseconds migration_delay;
 public:
     migration_manager();
@@ -45,6 +45,7 @@
 
 #include "bytes.hh"
 #include "keys.hh"
+#include "utils/UUID.hh"
 
 namespace service {
 
@@ -54,9 +55,12 @@ class paging_state final {
     partition_key _partition_key;
     std::experimental::optional<clustering_key> _clustering_key;
     uint32_t _remaining;
+    uint32_t _rows_fetched_for_last_partition;
+    utils::UUID _query_uuid;
 
 public:
-    paging_state(partition_key pk, std::experimental::optional<clustering_key> ck, uint32_t rem);
+    paging_state(partition_key pk, std::experimental::optional<clustering_key> ck, uint32_t rem,
+            uint32_t rows_fetched_for_last_partition = 0, utils::UUID query_uuid = utils::UUID());
 
     /**
      * Last processed key, i.e. where to start from in next paging round
@@ -77,6 +81,20 @@ class paging_state final {
     uint32_t get_remaining() const {
         return _remaining;
     }
+    /**
+     * Rows returned so far from the last partition, which count towards
+     * its PER PARTITION LIMIT in the next paging round.
+     */
+    uint32_t get_rows_fetched_for_last_partition() const {
+        return _rows_fetched_for_last_partition;
+    }
+    /**
+     * The id of the query, by which the replicas resume the reads of the
+     * last page, see query::querier_cache.
+     */
+    utils::UUID get_query_uuid() const {
+        return _query_uuid;
+    }
 
     static ::shared_ptr<paging_state> deserialize(bytes_opt bytes);
     bytes_opt serialize() const;
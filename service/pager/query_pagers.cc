@@ -77,7 +77,15 @@ class service::pager::query_pagers::impl : public query_pager {
             _max = state->get_remaining();
             _last_pkey = state->get_partition_key();
             _last_ckey = state->get_clustering_key();
+            _rows_fetched_for_last_partition = state->get_rows_fetched_for_last_partition();
+            _query_uuid = state->get_query_uuid();
         }
+        // Paging states of older nodes have no query id.
+        _cmd->is_first_page = !_last_pkey || _query_uuid == utils::UUID();
+        if (_query_uuid == utils::UUID()) {
+            _query_uuid = utils::make_random_uuid();
+        }
+        _cmd->query_uuid = _query_uuid;
 
         if (_last_pkey) {
             auto dpk = dht::global_partitioner().decorate_key(*_schema, *_last_pkey);
@@ -228,15 +236,32 @@ class service::pager::query_pagers::impl : public query_pager {
             uint32_t page_size, gc_clock::time_point now) {
 
         class myvisitor : public cql3::selection::result_set_builder::visitor {
+            const schema& _schema;
+            uint32_t _per_partition_limit;
+            // The partition the previous page ended in, if the first
+            // partition of this page may be its continuation.
+            std::experimental::optional<partition_key> _continued_pkey;
+            uint32_t _continued_rows;
         public:
             uint32_t total_rows = 0;
+            // Rows returned by replicas beyond the per partition limit of a
+            // partition continued from the previous page.
+            uint32_t dropped_rows = 0;
+            uint32_t last_partition_rows = 0;
             std::experimental::optional<partition_key> last_pkey;
             std::experimental::optional<clustering_key> last_ckey;
 
             myvisitor(cql3::selection::result_set_builder& builder,
                     const schema& s,
-                    const cql3::selection::selection& selection)
-                    : visitor(builder, s, selection) {
+                    const cql3::selection::selection& selection,
+                    uint32_t per_partition_limit,
+                    std::experimental::optional<partition_key> continued_pkey,
+                    uint32_t continued_rows)
+                    : visitor(builder, s, selection)
+                    , _schema(s)
+                    , _per_partition_limit(per_partition_limit)
+                    , _continued_pkey(std::move(continued_pkey))
+                    , _continued_rows(continued_rows) {
             }
 
             void accept_new_partition(uint32_t) {
@@ -245,6 +270,13 @@ class service::pager::query_pagers::impl : public query_pager {
             void accept_new_partition(const partition_key& key, uint32_t row_count) {
                 qlogger.trace("Accepting partition: {} ({})", key, row_count);
                 total_rows += std::max(row_count, 1u);
+                last_partition_rows = 0;
+                if (_continued_pkey) {
+                    if (_continued_pkey->equal(_schema, key)) {
+                        last_partition_rows = _continued_rows;
+                    }
+                    _continued_pkey = { };
+                }
                 last_pkey = key;
                 last_ckey = { };
                 visitor::accept_new_partition(key, row_count);
@@ -253,6 +285,11 @@ class service::pager::query_pagers::impl : public query_pager {
                     const query::result_row_view& static_row,
                     const query::result_row_view& row) {
                 last_ckey = key;
+                if (last_partition_rows >= _per_partition_limit) {
+                    ++dropped_rows;
+                    return;
+                }
+                ++last_partition_rows;
                 visitor::accept_new_row(key, static_row, row);
             }
             void accept_new_row(const query::result_row_view& static_row,
@@ -264,7 +301,16 @@ class service::pager::query_pagers::impl : public query_pager {
             }
         };
 
-        myvisitor v(builder, *_schema, *_selection);
+        // Replicas limit the rows of each partition, but not knowing how
+        // many rows of the partition the previous page ended in were already
+        // returned, they may return too many of its rows.
+        auto per_partition_limit = _cmd->slice.partition_row_limit();
+        std::experimental::optional<partition_key> continued_pkey;
+        if (_has_clustering_keys && _last_ckey && per_partition_limit != query::max_rows) {
+            continued_pkey = _last_pkey;
+        }
+        myvisitor v(builder, *_schema, *_selection, per_partition_limit, std::move(continued_pkey),
+                _rows_fetched_for_last_partition);
         query::result_view::consume(*results, _cmd->slice, v);
 
         if (_last_pkey) {
@@ -276,10 +322,16 @@ class service::pager::query_pagers::impl : public query_pager {
             _cmd->slice.clear_range(*_schema, *_last_pkey);
         }
 
-        _max = _max - v.total_rows;
+        _max = _max - (v.total_rows - v.dropped_rows);
         _exhausted = (v.total_rows < page_size && !results->is_short_read()) || _max == 0;
         _last_pkey = v.last_pkey;
         _last_ckey = v.last_ckey;
+        _rows_fetched_for_last_partition = v.last_partition_rows;
+        if (_rows_fetched_for_last_partition >= per_partition_limit) {
+            // Nothing more to return from the last partition, skip what is
+            // left of it, as if the page ended on its static row.
+            _last_ckey = { };
+        }
 
         qlogger.debug("Fetched {} rows, max_remain={} {}", v.total_rows, _max, _exhausted ? "(exh)" : "");
 
@@ -303,7 +355,7 @@ class service::pager::query_pagers::impl : public query_pager {
         return _exhausted ?
                         nullptr :
                         ::make_shared<const paging_state>(*_last_pkey,
-                                        _last_ckey, _max);
+                                        _last_ckey, _max, _rows_fetched_for_last_partition, _query_uuid);
     }
 
 private:
@@ -314,6 +366,11 @@ class service::pager::query_pagers::impl : public query_pager {
 
     std::experimental::optional<partition_key> _last_pkey;
     std::experimental::optional<clustering_key> _last_ckey;
+    // Rows returned so far from the partition of _last_pkey.
+    uint32_t _rows_fetched_for_last_partition = 0;
+    // Identifies the query to the replicas, which keep its reads between
+    // pages.
+    utils::UUID _query_uuid;
 
     schema_ptr _schema;
     ::shared_ptr<cql3::selection::selection> _selection;
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "mutation.hh"
+#include "stdx.hh"
+#include "core/future.hh"
+
+namespace service {
+
+namespace paxos {
+
+// The conditional update of a partition which storage_proxy::cas() applies
+// as a lightweight transaction.
+class cas_request {
+public:
+    virtual ~cas_request() = default;
+    // Called with the current data of the partition, if it has any, once
+    // the transaction has a ballot. Returns the update to apply, with cells
+    // of the given timestamp, or nothing if the conditions don't hold.
+    virtual future<stdx::optional<mutation>> apply(const stdx::optional<mutation>& current, api::timestamp_type ts) = 0;
+};
+
+}
+
+}
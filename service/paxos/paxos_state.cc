@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/paxos/paxos_state.hh"
+#include "service/storage_proxy.hh"
+#include "db/system_keyspace.hh"
+#include "database.hh"
+#include "utils/hash.hh"
+#include "core/semaphore.hh"
+
+namespace service {
+
+namespace paxos {
+
+namespace {
+
+// Serializes the rounds on each partition on this shard, so that the state
+// of one in system.paxos is read and updated by one phase at a time.
+class key_lock_map {
+    using semaphore = basic_semaphore<default_timeout_exception_factory, paxos_state::clock_type>;
+    using key_type = std::pair<utils::UUID, dht::token>;
+    struct lock {
+        semaphore sem{1};
+        unsigned users = 0;
+    };
+    std::unordered_map<key_type, lock, utils::tuple_hash> _locks;
+public:
+    template <typename Func>
+    futurize_t<std::result_of_t<Func()>> with_locked_key(const schema& s, const dht::token& token, paxos_state::clock_type::time_point timeout, Func&& func) {
+        auto key = key_type(s.id(), token);
+        auto& l = _locks[key];
+        ++l.users;
+        return get_units(l.sem, 1, timeout).then([func = std::forward<Func>(func)] (auto units) mutable {
+            return futurize_apply(func).finally([units = std::move(units)] { });
+        }).finally([this, key = std::move(key)] {
+            auto it = _locks.find(key);
+            if (--it->second.users == 0) {
+                _locks.erase(it);
+            }
+        });
+    }
+};
+
+thread_local key_lock_map key_locks;
+
+}
+
+future<prepare_response> paxos_state::prepare(tracing::trace_state_ptr tr_state, schema_ptr s, lw_shared_ptr<query::read_command> cmd,
+        partition_key key, utils::UUID ballot, clock_type::time_point timeout) {
+    auto dk = dht::global_partitioner().decorate_key(*s, std::move(key));
+    auto token = dk.token();
+    return key_locks.with_locked_key(*s, token, timeout, [tr_state = std::move(tr_state), s = std::move(s), cmd = std::move(cmd),
+            dk = std::move(dk), ballot, timeout] () mutable {
+        return db::system_keyspace::load_paxos_state(dk.key(), s).then([tr_state = std::move(tr_state), s, cmd = std::move(cmd),
+                dk = std::move(dk), ballot, timeout] (paxos_state state) mutable {
+            if (!ballot_less(state.promised_ballot(), ballot)) {
+                tracing::trace(tr_state, "Promise rejected; {} is not sufficiently newer than {}", ballot, state.promised_ballot());
+                return make_ready_future<prepare_response>(prepare_response{false, state.promised_ballot(), {}, {}, {}});
+            }
+            tracing::trace(tr_state, "Promising ballot {}", ballot);
+            // The read is done along with saving the promise, which saves
+            // the coordinator a round trip to the replicas. The data it sees
+            // is as of the most recent commit we return, since learning a
+            // decision takes the lock too.
+            auto f_promise = db::system_keyspace::save_paxos_promise(*s, dk.key(), ballot);
+            auto f_read = do_with(dht::partition_range::make_singular(dk), [tr_state, s, cmd, timeout] (const dht::partition_range& pr) {
+                auto& db = get_local_storage_proxy().get_db().local();
+                return db.get_result_memory_limiter().new_mutation_read(query::result_memory_limiter::maximum_result_size).then(
+                        [&db, &pr, tr_state, s, cmd, timeout] (query::result_memory_accounter ma) {
+                    return db.query_mutations(s, *cmd, pr, std::move(ma), tr_state, timeout);
+                }).then([] (reconcilable_result rr, cache_temperature) {
+                    // Let go of the memory accounting of this shard, as the
+                    // result is sent to the coordinator from another one.
+                    return reconcilable_result(rr.row_count(), std::move(rr.partitions()), rr.is_short_read());
+                });
+            });
+            return when_all_succeed(std::move(f_promise), std::move(f_read)).then([state = std::move(state), ballot] (reconcilable_result data) {
+                return prepare_response{true, ballot, state.accepted(), state.most_recent_commit(), std::move(data)};
+            });
+        });
+    });
+}
+
+future<bool> paxos_state::accept(tracing::trace_state_ptr tr_state, schema_ptr s, proposal p, clock_type::time_point timeout) {
+    auto m = p.update.to_mutation(s);
+    auto token = m.token();
+    return key_locks.with_locked_key(*s, token, timeout, [tr_state = std::move(tr_state), s = std::move(s), p = std::move(p),
+            key = m.key()] () mutable {
+        return db::system_keyspace::load_paxos_state(key, s).then([tr_state = std::move(tr_state), s, p = std::move(p),
+                key = std::move(key)] (paxos_state state) {
+            if (ballot_less(p.ballot, state.promised_ballot())) {
+                tracing::trace(tr_state, "Rejecting proposal for {} because in_progress is now {}", p.ballot, state.promised_ballot());
+                return make_ready_future<bool>(false);
+            }
+            tracing::trace(tr_state, "Accepting proposal {}", p.ballot);
+            return db::system_keyspace::save_paxos_proposal(*s, key, p).then([] {
+                return true;
+            });
+        });
+    });
+}
+
+future<> paxos_state::learn(tracing::trace_state_ptr tr_state, schema_ptr s, proposal decision, clock_type::time_point timeout) {
+    auto m = decision.update.to_mutation(s);
+    auto token = m.token();
+    return key_locks.with_locked_key(*s, token, timeout, [tr_state = std::move(tr_state), s = std::move(s), decision = std::move(decision),
+            m = std::move(m), timeout] () mutable {
+        tracing::trace(tr_state, "Committing proposal {}", decision.ballot);
+        // Learning the same decision twice, or an older one than the most
+        // recent, is harmless: the cells of the update have the timestamp of
+        // its ballot, and so does the update of system.paxos.
+        return do_with(std::move(m), std::move(decision), [s = std::move(s), timeout] (const mutation& m, const proposal& decision) {
+            return get_local_storage_proxy().mutate_locally(m, timeout).then([s, &m, &decision] {
+                return db::system_keyspace::save_paxos_decision(*s, m.key(), decision);
+            });
+        });
+    });
+}
+
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "service/paxos/proposal.hh"
+#include "query-request.hh"
+#include "schema.hh"
+#include "tracing/tracing.hh"
+#include "core/lowres_clock.hh"
+
+namespace service {
+
+namespace paxos {
+
+// The state of the Paxos rounds on a partition on one of its replicas: the
+// highest ballot it promised, the last proposal it accepted and the last
+// decision it learned. It's kept in system.paxos, and the rounds on a
+// partition are handled one at a time, on the shard which owns it.
+class paxos_state {
+public:
+    using clock_type = lowres_clock;
+private:
+    utils::UUID _promised_ballot;
+    stdx::optional<proposal> _accepted;
+    stdx::optional<proposal> _most_recent_commit;
+public:
+    paxos_state() = default;
+    paxos_state(utils::UUID promised_ballot, stdx::optional<proposal> accepted, stdx::optional<proposal> most_recent_commit)
+        : _promised_ballot(std::move(promised_ballot))
+        , _accepted(std::move(accepted))
+        , _most_recent_commit(std::move(most_recent_commit)) {
+    }
+    const utils::UUID& promised_ballot() const {
+        return _promised_ballot;
+    }
+    const stdx::optional<proposal>& accepted() const {
+        return _accepted;
+    }
+    const stdx::optional<proposal>& most_recent_commit() const {
+        return _most_recent_commit;
+    }
+
+    // The handlers of the phases of the rounds on the replica. They must be
+    // called on the shard which owns the partition.
+
+    // Promises not to accept the proposals of rounds before the one of
+    // ballot, if it's the highest so far, and then reads the data of the
+    // partition with cmd for the coordinator to check the conditions
+    // against.
+    static future<prepare_response> prepare(tracing::trace_state_ptr tr_state, schema_ptr s, lw_shared_ptr<query::read_command> cmd,
+            partition_key key, utils::UUID ballot, clock_type::time_point timeout);
+    // Accepts the proposal unless a later ballot was promised. Returns
+    // whether it was.
+    static future<bool> accept(tracing::trace_state_ptr tr_state, schema_ptr s, proposal p, clock_type::time_point timeout);
+    // Applies the update of the decision to the partition, and records it
+    // as the most recent one.
+    static future<> learn(tracing::trace_state_ptr tr_state, schema_ptr s, proposal decision, clock_type::time_point timeout);
+};
+
+}
+
+}
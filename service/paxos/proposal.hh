@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "utils/UUID.hh"
+#include "canonical_mutation.hh"
+#include "mutation_query.hh"
+#include "stdx.hh"
+
+namespace service {
+
+namespace paxos {
+
+// Orders the ballots of Paxos rounds, which are time UUIDs, by their time,
+// then by the node which made them. The null UUID, used for no ballot, comes
+// before any other.
+inline bool ballot_less(const utils::UUID& a, const utils::UUID& b) {
+    if (b == utils::UUID()) {
+        return false;
+    }
+    if (a == utils::UUID()) {
+        return true;
+    }
+    if (a.timestamp() != b.timestamp()) {
+        return a.timestamp() < b.timestamp();
+    }
+    return uint64_t(a.get_least_significant_bits()) < uint64_t(b.get_least_significant_bits());
+}
+
+// An update of a partition proposed in the Paxos round of the ballot. Once
+// accepted by a quorum of the replicas of the partition, it's decided. Its
+// cells have the timestamp of the ballot.
+struct proposal {
+    utils::UUID ballot;
+    canonical_mutation update;
+};
+
+// The answer of a replica to the prepare of a ballot.
+struct prepare_response {
+    // If false, the replica promised the higher promised_ballot before, and
+    // nothing else is set.
+    bool promised;
+    utils::UUID promised_ballot;
+    // The proposal the replica accepted last, if it didn't learn a decision
+    // of the same or a later round since.
+    stdx::optional<proposal> accepted;
+    // The last decision the replica learned, whose update its data has.
+    stdx::optional<proposal> most_recent_commit;
+    // The data of the partition the prepare read, as of most_recent_commit.
+    stdx::optional<reconcilable_result> data;
+};
+
+}
+
+}
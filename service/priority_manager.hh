@@ -18,11 +18,16 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#pragma once
+
 #include <seastar/core/future.hh>
 #include <seastar/core/distributed.hh>
 #include <seastar/core/reactor.hh>
+#include <unordered_map>
+#include <experimental/optional>
 
 #include "seastarx.hh"
+#include "utils/rate_limiter.hh"
 
 namespace service {
 class priority_manager {
@@ -32,6 +37,14 @@ class priority_manager {
     ::io_priority_class _stream_write_priority;
     ::io_priority_class _sstable_query_read;
     ::io_priority_class _compaction_priority;
+    ::io_priority_class _cache_warmup_priority;
+    // Query reads of the workloads given their own share of the disk, by
+    // workload name, see add_workload().
+    std::unordered_map<sstring, ::io_priority_class> _workload_query_read;
+    // Bytes per second the background classes may read and write on this
+    // shard, see bandwidth_limiter().
+    utils::token_bucket_rate_limiter _compaction_bandwidth;
+    utils::token_bucket_rate_limiter _streaming_bandwidth;
 
 public:
     const ::io_priority_class&
@@ -59,18 +72,71 @@ class priority_manager {
         return _sstable_query_read;
     }
 
+    // The class of the sstable reads of queries of the given workload, the
+    // name of an authenticated user, or of the queries of all others.
+    const ::io_priority_class&
+    sstable_query_read_priority(const std::experimental::optional<sstring>& workload) {
+        if (workload) {
+            auto i = _workload_query_read.find(*workload);
+            if (i != _workload_query_read.end()) {
+                return i->second;
+            }
+        }
+        return _sstable_query_read;
+    }
+
+    // Gives the query reads of the workload their own class, so that they
+    // get the given share of the disk, whatever the load of other workloads.
+    // Must be called on all shards.
+    void add_workload(const sstring& name, uint32_t shares) {
+        _workload_query_read.emplace(name, engine().register_one_priority_class("query_" + name, shares));
+    }
+
+    bool has_workload(const sstring& name) const {
+        return _workload_query_read.count(name);
+    }
+
     const ::io_priority_class&
     compaction_priority() {
         return _compaction_priority;
     }
 
+    const ::io_priority_class&
+    cache_warmup_priority() {
+        return _cache_warmup_priority;
+    }
+
+    utils::token_bucket_rate_limiter& compaction_bandwidth_limiter() {
+        return _compaction_bandwidth;
+    }
+
+    // Of both streaming reads and writes.
+    utils::token_bucket_rate_limiter& streaming_bandwidth_limiter() {
+        return _streaming_bandwidth;
+    }
+
+    // The limiter the file I/O of the given class is subjected to, if any.
+    utils::token_bucket_rate_limiter* bandwidth_limiter(const ::io_priority_class& pc) {
+        if (pc.id() == _compaction_priority.id()) {
+            return &_compaction_bandwidth;
+        }
+        if (pc.id() == _stream_read_priority.id() || pc.id() == _stream_write_priority.id()) {
+            return &_streaming_bandwidth;
+        }
+        return nullptr;
+    }
+
     priority_manager()
-        : _commitlog_priority(engine().register_one_priority_class("commitlog", 100))
+        // Commitlog writes are few next to those of compaction, but writes
+        // wait for them, so their share is large enough that a compaction
+        // storm doesn't queue them behind its own.
+        : _commitlog_priority(engine().register_one_priority_class("commitlog", 1000))
         , _mt_flush_priority(engine().register_one_priority_class("memtable_flush", 100))
         , _stream_read_priority(engine().register_one_priority_class("streaming_read", 20))
         , _stream_write_priority(engine().register_one_priority_class("streaming_write", 20))
         , _sstable_query_read(engine().register_one_priority_class("query", 100))
         , _compaction_priority(engine().register_one_priority_class("compaction", 100))
+        , _cache_warmup_priority(engine().register_one_priority_class("cache_warmup", 10))
 
     {}
 };
@@ -101,8 +167,18 @@ get_local_sstable_query_read_priority() {
     return get_local_priority_manager().sstable_query_read_priority();
 }
 
+const inline ::io_priority_class&
+get_local_sstable_query_read_priority(const std::experimental::optional<sstring>& workload) {
+    return get_local_priority_manager().sstable_query_read_priority(workload);
+}
+
 const inline ::io_priority_class&
 get_local_compaction_priority() {
     return get_local_priority_manager().compaction_priority();
 }
+
+const inline ::io_priority_class&
+get_local_cache_warmup_priority() {
+    return get_local_priority_manager().cache_warmup_priority();
+}
 }
@@ -52,6 +52,8 @@
 #include "gms/gossiper.hh"
 #include "storage_service.hh"
 #include "core/future-util.hh"
+#include "core/circular_buffer.hh"
+#include "core/sleep.hh"
 #include "db/read_repair_decision.hh"
 #include "db/config.hh"
 #include "db/batchlog_manager.hh"
@@ -67,6 +69,7 @@
 #include <boost/range/algorithm/remove_if.hpp>
 #include <boost/range/algorithm/heap_algorithm.hpp>
 #include <boost/range/numeric.hpp>
+#include <boost/range/irange.hpp>
 #include <boost/range/algorithm/sort.hpp>
 #include <boost/range/empty.hpp>
 #include <boost/range/algorithm/min_element.hpp>
@@ -78,6 +81,18 @@
 #include <seastar/util/lazy.hh>
 #include "core/metrics.hh"
 #include <seastar/core/execution_stage.hh>
+#include "cql3/selection/selection.hh"
+#include "cql3/selection/raw_selector.hh"
+#include "cql3/functions/functions.hh"
+#include "cql3/functions/aggregate_function.hh"
+#include "cql3/query_options.hh"
+#include "service/pager/query_pagers.hh"
+#include "service/query_state.hh"
+#include "cdc/log.hh"
+#include "service/paxos/paxos_state.hh"
+#include "service/paxos/cas_request.hh"
+#include "utils/UUID_gen.hh"
+#include <boost/algorithm/cxx11/all_of.hpp>
 
 namespace service {
 
@@ -249,6 +264,17 @@ class abstract_write_response_handler : public enable_shared_from_this<abstract_
                  _throttled = true;
                  _proxy->_throttled_writes.push_back(_id);
                  ++_proxy->_stats.throttled_writes;
+                 return;
+             }
+             auto view_update_delay = _proxy->view_update_delay(get_schema());
+             if (view_update_delay.count()) {
+                 _throttled = true;
+                 ++_proxy->_stats.view_update_delayed_writes;
+                 // Keeps the handler alive, which then acknowledges the
+                 // write once the delay is over.
+                 sleep(view_update_delay).then([h = shared_from_this()] {
+                     h->unthrottle();
+                 });
              } else {
                  unthrottle();
              }
@@ -355,6 +381,29 @@ bool storage_proxy::need_throttle_writes() const {
     return _stats.background_write_bytes > memory::stats().total_memory() / 10 || _stats.queued_write_bytes > 6*1024*1024;
 }
 
+// The delay grows linearly with the backlog, up to max_view_update_delay
+// when the backlog reaches its maximum. Writes to tables without views are
+// not delayed, as they don't add to the backlog.
+constexpr std::chrono::milliseconds storage_proxy::max_view_update_delay;
+
+std::chrono::microseconds storage_proxy::view_update_delay(const schema_ptr& s) const {
+    auto backlog = view_update_backlog();
+    if (!backlog) {
+        return std::chrono::microseconds(0);
+    }
+    auto& db = _db.local();
+    if (!db.column_family_exists(s->id()) || db.find_column_family(s).views().empty()) {
+        return std::chrono::microseconds(0);
+    }
+    auto fraction = std::min(1.0, double(backlog) / _max_view_update_backlog);
+    return std::chrono::duration_cast<std::chrono::microseconds>(fraction * max_view_update_delay);
+}
+
+semaphore_units<> storage_proxy::track_view_update(size_t size) {
+    _view_update_backlog_sem.consume(size);
+    return semaphore_units<>(_view_update_backlog_sem, size);
+}
+
 void storage_proxy::unthrottle() {
    while(!need_throttle_writes() && !_throttled_writes.empty()) {
        auto id = _throttled_writes.front();
@@ -482,11 +531,32 @@ inline uint64_t& storage_proxy::split_stats::get_ep_stat(gms::inet_address ep) {
 }
 
 storage_proxy::~storage_proxy() {}
-storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
+storage_proxy::storage_proxy(distributed<database>& db)
+        : _db(db)
+        , _cross_shard_batches(smp::count)
+        , _counter_coalescing_timer([this] { flush_counter_updates(); })
+        , _background_read_repair(_db.local().get_config().background_read_repair())
+        , _max_queued_read_repairs(_db.local().get_config().background_read_repair_queue_size())
+        , _read_repair_sem(_db.local().get_config().background_read_repair_concurrency())
+        , _max_view_update_backlog(memory::stats().total_memory() / 10)
+        , _view_update_backlog_sem(_max_view_update_backlog)
+        , _result_cache(size_t(_db.local().get_config().coordinator_result_cache_size_in_mb()) * 1024 * 1024 / smp::count) {
+    auto& cfg = _db.local().get_config();
+    if (cfg.hinted_handoff_enabled()) {
+        // The throttle is for the whole node.
+        _hints_manager.emplace(cfg.hints_directory(), *this, std::chrono::milliseconds(cfg.max_hint_window_in_ms()),
+                size_t(cfg.hinted_handoff_throttle_in_kb()) * 1024 / smp::count);
+    }
+    if (cfg.dynamic_snitch()) {
+        _dynamic_snitch.emplace(cfg.dynamic_snitch_badness_threshold(),
+                std::chrono::milliseconds(cfg.dynamic_snitch_reset_interval_in_ms()));
+    }
     namespace sm = seastar::metrics;
     _metrics.add_group(COORDINATOR_STATS_CATEGORY, {
         sm::make_histogram("read_latency", sm::description("The general read latency histogram"), [this]{return _stats.estimated_read.get_histogram();}),
         sm::make_histogram("write_latency", sm::description("The general write latency histogram"), [this]{return _stats.estimated_write.get_histogram();}),
+        sm::make_histogram("partitions_per_read", sm::description("The histogram of the number of partitions read by single partition queries, i.e. the sizes of IN restrictions on the partition key"),
+                       [this]{return _stats.partitions_per_read.get_histogram();}),
         sm::make_queue_length("foreground_writes", [this] { return _stats.writes - _stats.background_writes; },
                        sm::description("number of currently pending foreground write requests")),
 
@@ -499,6 +569,33 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("throttled_writes", [this] { return _stats.throttled_writes; },
                        sm::description("number of throttled write requests")),
 
+        sm::make_total_operations("cas_operations", _stats.cas_operations,
+                       sm::description("number of lightweight transactions coordinated by this Node")),
+
+        sm::make_total_operations("cas_contentions", _stats.cas_contentions,
+                       sm::description("number of Paxos rounds of lightweight transactions retried because of a concurrent one")),
+
+        sm::make_total_operations("cas_not_applied", _stats.cas_not_applied,
+                       sm::description("number of lightweight transactions whose conditions didn't hold")),
+
+        sm::make_queue_length("view_update_backlog", [this] { return view_update_backlog(); },
+                       sm::description("bytes of view updates sent and not yet applied by the view replicas")),
+
+        sm::make_total_operations("view_update_delayed_writes", [this] { return _stats.view_update_delayed_writes; },
+                       sm::description("number of writes to tables with views acknowledged with a delay because of the view update backlog")),
+
+        sm::make_total_operations("batched_mutations", _stats.batched_mutations,
+                       sm::description("number of mutations sent to replicas coalesced with others in one message")),
+
+        sm::make_total_operations("mutation_batches", _stats.mutation_batches,
+                       sm::description("number of messages carrying coalesced mutations sent to replicas")),
+
+        sm::make_total_operations("coalesced_counter_updates", _stats.coalesced_counter_updates,
+                       sm::description("number of counter updates combined with others before being sent to their leader")),
+
+        sm::make_total_operations("combined_counter_updates", _stats.combined_counter_updates,
+                       sm::description("number of counter updates sent to leaders on behalf of several combined ones")),
+
         sm::make_current_bytes("queued_write_bytes", [this] { return _stats.queued_write_bytes; },
                        sm::description("number of bytes in pending write requests")),
 
@@ -514,6 +611,12 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("read_retries", [this] { return _stats.read_retries; },
                        sm::description("number of read retry attempts")),
 
+        sm::make_total_operations("speculative_reads", [this] { return _stats.speculative_reads; },
+                       sm::description("number of read requests sent to an extra replica because the others were slower than the speculative_retry percentile")),
+
+        sm::make_total_operations("wasted_speculative_reads", [this] { return _stats.wasted_speculative_reads; },
+                       sm::description("number of speculative read requests the read completed without, because the other replicas replied first")),
+
         sm::make_total_operations("canceled_read_repairs", [this] { return _stats.global_read_repairs_canceled_due_to_concurrent_write; },
                        sm::description("number of global read repairs canceled due to a concurrent write")),
 
@@ -523,6 +626,18 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("background_read_repairs", [this] { return _stats.read_repair_repaired_background; },
                        sm::description("number of background read repairs")),
 
+        sm::make_total_operations("deferred_read_repairs", [this] { return _stats.deferred_read_repairs; },
+                       sm::description("number of read repairs written after replying to the client, in background_read_repair mode")),
+
+        sm::make_queue_length("queued_read_repairs", [this] { return _stats.queued_read_repairs; },
+                       sm::description("number of deferred read repairs currently queued or being written")),
+
+        sm::make_total_operations("dropped_read_repairs", [this] { return _stats.dropped_read_repairs; },
+                       sm::description("number of deferred read repairs dropped because too many were queued already")),
+
+        sm::make_total_operations("failed_read_repairs", [this] { return _stats.failed_read_repairs; },
+                       sm::description("number of deferred read repairs which failed to be written")),
+
         sm::make_total_operations("write_timeouts", [this] { return _stats.write_timeouts._count; },
                        sm::description("number of write request failed due to a timeout")),
 
@@ -540,6 +655,21 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
 
         sm::make_total_operations("range_unavailable", [this] { return _stats.range_slice_unavailables._count; },
                        sm::description("number of range read operations failed due to an \"unavailable\" error")),
+
+        sm::make_total_operations("result_cache_hits", [this] { return _result_cache.get_stats().hits; },
+                       sm::description("number of reads answered from the coordinator result cache")),
+
+        sm::make_total_operations("result_cache_misses", [this] { return _result_cache.get_stats().misses; },
+                       sm::description("number of reads of tables with a coordinator_ttl_in_ms not found in the coordinator result cache")),
+
+        sm::make_total_operations("result_cache_invalidations", [this] { return _result_cache.get_stats().invalidations; },
+                       sm::description("number of coordinator result cache entries dropped because of a write to their partition")),
+
+        sm::make_total_operations("result_cache_evictions", [this] { return _result_cache.get_stats().evictions; },
+                       sm::description("number of coordinator result cache entries evicted to make room for others")),
+
+        sm::make_current_bytes("result_cache_bytes", [this] { return _result_cache.memory_used(); },
+                       sm::description("number of bytes used by the coordinator result cache")),
     });
 
     _metrics.add_group(REPLICA_STATS_CATEGORY, {
@@ -555,6 +685,12 @@ storage_proxy::storage_proxy(distributed<database>& db) : _db(db) {
         sm::make_total_operations("forwarding_errors", _stats.forwarding_errors,
                        sm::description("number of errors during forwarding mutations to other replica Nodes")),
 
+        sm::make_total_operations("cross_shard_mutations", _stats.cross_shard_mutations,
+                       sm::description("number of mutations applied on another shard of this Node")),
+
+        sm::make_total_operations("cross_shard_mutation_batches", _stats.cross_shard_mutation_batches,
+                       sm::description("number of messages carrying mutations to be applied on another shard of this Node")),
+
         sm::make_total_operations("reads", _stats.replica_data_reads,
                        sm::description("number of remote data read requests this Node received"), {storage_proxy::split_stats::op_type_label("data")}),
 
@@ -965,20 +1101,202 @@ storage_proxy::response_id_type storage_proxy::unique_response_handler::release(
 #endif
 
 
+future<>
+storage_proxy::apply_on_shard(unsigned shard, const schema_ptr& s, const frozen_mutation& m, clock_type::time_point timeout) {
+    if (shard == engine().cpu_id()) {
+        return _db.local().apply(s, m, timeout);
+    }
+    ++_stats.cross_shard_mutations;
+    auto& batch = _cross_shard_batches[shard];
+    batch.mutations.push_back(cross_shard_mutation{s, &m, timeout});
+    batch.promises.emplace_back();
+    auto f = batch.promises.back().get_future();
+    if (!_cross_shard_flush_scheduled) {
+        _cross_shard_flush_scheduled = true;
+        // Let the other requests of this poll period queue theirs first.
+        with_gate(_cross_shard_gate, [this] {
+            return later().then([this] {
+                flush_cross_shard_mutations();
+            });
+        });
+    }
+    return f;
+}
+
+void storage_proxy::flush_cross_shard_mutations() {
+    _cross_shard_flush_scheduled = false;
+    for (unsigned shard = 0; shard < _cross_shard_batches.size(); ++shard) {
+        if (_cross_shard_batches[shard].mutations.empty()) {
+            continue;
+        }
+        with_gate(_cross_shard_gate, [this, shard, batch = std::exchange(_cross_shard_batches[shard], {})] () mutable {
+            return send_cross_shard_batch(shard, std::move(batch));
+        });
+    }
+}
+
+future<> storage_proxy::send_cross_shard_batch(unsigned shard, cross_shard_batch batch) {
+    ++_stats.cross_shard_mutation_batches;
+    // The mutations are destroyed on this shard, with the lambda, after they
+    // have been applied.
+    if (batch.mutations.size() == 1) {
+        // The common case of a lightly loaded shard, which needs no grouping.
+        auto& m = batch.mutations.front();
+        return _db.invoke_on(shard, [s = global_schema_ptr(m.schema), fm = m.fm, timeout = m.timeout] (database& db) {
+            return db.apply(s, *fm, timeout);
+        }).then_wrapped([p = std::move(batch.promises.front())] (future<> f) mutable {
+            f.forward_to(std::move(p));
+        });
+    }
+
+    // The mutations of the same schema are applied together, and share
+    // their outcome. They are grouped here, so that the target shard looks
+    // each schema up once.
+    struct group {
+        global_schema_ptr schema;
+        std::vector<const frozen_mutation*> mutations;
+        clock_type::time_point timeout = clock_type::time_point::min();
+
+        explicit group(const schema_ptr& s) : schema(s) { }
+    };
+    std::vector<group> groups;
+    std::vector<std::vector<promise<>>> promises;
+    std::unordered_map<table_schema_version, size_t> group_of;
+    for (size_t i = 0; i < batch.mutations.size(); ++i) {
+        auto& m = batch.mutations[i];
+        auto it = group_of.emplace(m.schema->version(), groups.size()).first;
+        if (it->second == groups.size()) {
+            groups.emplace_back(m.schema);
+            promises.emplace_back();
+        }
+        auto& g = groups[it->second];
+        g.mutations.push_back(m.fm);
+        g.timeout = std::max(g.timeout, m.timeout);
+        promises[it->second].push_back(std::move(batch.promises[i]));
+    }
+
+    return _db.invoke_on(shard, [groups = std::move(groups)] (database& db) {
+        return do_with(std::vector<std::exception_ptr>(groups.size()), [&db, &groups] (std::vector<std::exception_ptr>& errors) {
+            return parallel_for_each(boost::irange<size_t>(0, groups.size()), [&db, &groups, &errors] (size_t i) {
+                auto& g = groups[i];
+                return db.apply(g.schema, g.mutations, g.timeout).handle_exception([&errors, i] (std::exception_ptr ep) {
+                    errors[i] = std::move(ep);
+                });
+            }).then([&errors] {
+                return std::move(errors);
+            });
+        });
+    }).then_wrapped([promises = std::move(promises)] (future<std::vector<std::exception_ptr>> f) mutable {
+        if (f.failed()) {
+            auto ep = f.get_exception();
+            for (auto&& ps : promises) {
+                for (auto&& p : ps) {
+                    p.set_exception(ep);
+                }
+            }
+            return;
+        }
+        auto errors = f.get0();
+        for (size_t i = 0; i < promises.size(); ++i) {
+            for (auto&& p : promises[i]) {
+                if (errors[i]) {
+                    p.set_exception(errors[i]);
+                } else {
+                    p.set_value();
+                }
+            }
+        }
+    });
+}
+
+// Mutations to be forwarded by the replica to other DCs, and traced ones,
+// are sent on their own.
+bool storage_proxy::can_batch_mutation(const std::vector<gms::inet_address>& forward, const tracing::trace_state_ptr& tr_state) const {
+    return forward.empty() && !tr_state
+        && _db.local().get_config().mutation_batch_size_in_kb()
+        && get_local_storage_service().cluster_supports_mutation_batch();
+}
+
+future<> storage_proxy::send_batched_mutation(gms::inet_address ep, clock_type::time_point timeout, const frozen_mutation& m, response_id_type response_id) {
+    ++_stats.batched_mutations;
+    auto& batch = _mutation_batches[ep];
+    batch.mutations.push_back(m);
+    batch.response_ids.push_back(response_id);
+    batch.size += m.representation().size();
+    batch.timeout = std::max(batch.timeout, timeout);
+    batch.promises.emplace_back();
+    auto f = batch.promises.back().get_future();
+    if (batch.size >= size_t(_db.local().get_config().mutation_batch_size_in_kb()) * 1024) {
+        send_queued_mutation_batch(ep, batch);
+    } else if (!_mutation_batches_flush_scheduled) {
+        _mutation_batches_flush_scheduled = true;
+        // Let the other writes of this poll period join the batches first.
+        with_gate(_mutation_batches_gate, [this] {
+            return later().then([this] {
+                flush_mutation_batches();
+            });
+        });
+    }
+    return f;
+}
+
+void storage_proxy::flush_mutation_batches() {
+    _mutation_batches_flush_scheduled = false;
+    for (auto&& e : _mutation_batches) {
+        send_queued_mutation_batch(e.first, e.second);
+    }
+    _mutation_batches.clear();
+}
+
+void storage_proxy::flush_mutation_batch(gms::inet_address ep) {
+    auto it = _mutation_batches.find(ep);
+    if (it != _mutation_batches.end()) {
+        send_queued_mutation_batch(ep, it->second);
+        _mutation_batches.erase(it);
+    }
+}
+
+void storage_proxy::send_queued_mutation_batch(gms::inet_address ep, mutation_batch& batch) {
+    if (batch.mutations.empty()) {
+        return;
+    }
+    with_gate(_mutation_batches_gate, [this, ep, batch = std::exchange(batch, {})] () mutable {
+        return send_mutation_batch(ep, std::move(batch));
+    });
+}
+
+future<> storage_proxy::send_mutation_batch(gms::inet_address ep, mutation_batch batch) {
+    ++_stats.mutation_batches;
+    return do_with(std::move(batch), [ep] (mutation_batch& batch) {
+        auto& ms = netw::get_local_messaging_service();
+        return ms.send_mutation_batch(netw::messaging_service::msg_addr{ep, 0}, batch.timeout, batch.mutations, batch.response_ids,
+                utils::fb_utilities::get_broadcast_address(), engine().cpu_id()).then_wrapped([&batch] (future<> f) {
+            if (f.failed()) {
+                auto ep = f.get_exception();
+                for (auto&& p : batch.promises) {
+                    p.set_exception(ep);
+                }
+            } else {
+                for (auto&& p : batch.promises) {
+                    p.set_value();
+                }
+            }
+        });
+    });
+}
+
 future<>
 storage_proxy::mutate_locally(const mutation& m, clock_type::time_point timeout) {
     auto shard = _db.local().shard_of(m);
-    return _db.invoke_on(shard, [s = global_schema_ptr(m.schema()), m = freeze(m), timeout] (database& db) -> future<> {
-        return db.apply(s, m, timeout);
+    return do_with(freeze(m), [this, shard, s = m.schema(), timeout] (const frozen_mutation& fm) {
+        return apply_on_shard(shard, s, fm, timeout);
     });
 }
 
 future<>
 storage_proxy::mutate_locally(const schema_ptr& s, const frozen_mutation& m, clock_type::time_point timeout) {
     auto shard = _db.local().shard_of(m);
-    return _db.invoke_on(shard, [&m, gs = global_schema_ptr(s), timeout] (database& db) -> future<> {
-        return db.apply(gs, m, timeout);
-    });
+    return apply_on_shard(shard, s, m, timeout);
 }
 
 future<>
@@ -1055,7 +1373,7 @@ storage_proxy::create_write_response_handler(const mutation& m, db::consistency_
         // The idea is that if we have over maxHintsInProgress hints in flight, this is probably due to
         // a small number of nodes causing problems, so we should avoid shutting down writes completely to
         // healthy nodes.  Any node with no hintsInProgress is considered healthy.
-        throw overloaded_exception(_total_hints_in_progress);
+        throw overloaded_exception(_hints_manager->hints_in_progress());
     }
 
     // filter live endpoints from dead ones
@@ -1207,7 +1525,80 @@ future<> storage_proxy::mutate_counters(Range&& mutations, db::consistency_level
     if (boost::empty(mutations)) {
         return make_ready_future<>();
     }
+    // Traced updates are sent on their own, so that their traces are theirs.
+    if (_db.local().get_config().counter_update_coalescing_window_in_us() && !tr_state) {
+        return coalesce_counter_updates(std::forward<Range>(mutations), cl);
+    }
+    return send_counter_updates(std::forward<Range>(mutations), cl, std::move(tr_state));
+}
 
+template<typename Range>
+future<> storage_proxy::coalesce_counter_updates(Range&& mutations, db::consistency_level cl) {
+    std::vector<future<>> waiting;
+    for (auto& m : mutations) {
+        auto& s = m.schema();
+        auto it = boost::find_if(_pending_counter_updates, [&] (const pending_counter_updates& p) {
+            return p.s->version() == s->version() && p.cl == cl;
+        });
+        if (it == _pending_counter_updates.end()) {
+            _pending_counter_updates.emplace_back(s, cl);
+            it = std::prev(_pending_counter_updates.end());
+        }
+        auto pit = it->partitions.find(m.key());
+        if (pit == it->partitions.end()) {
+            auto key = m.key();
+            pit = it->partitions.emplace(std::move(key), pending_counter_update{std::move(m), {}}).first;
+        } else {
+            if (pit->second.waiters.size() == 1) {
+                // The first update of the partition is now combined too.
+                ++_stats.combined_counter_updates;
+                ++_stats.coalesced_counter_updates;
+            }
+            ++_stats.coalesced_counter_updates;
+            pit->second.m.apply(std::move(m));
+        }
+        pit->second.waiters.emplace_back();
+        waiting.push_back(pit->second.waiters.back().get_future());
+    }
+    if (!_counter_coalescing_timer.armed()) {
+        _counter_coalescing_timer.arm(std::chrono::microseconds(_db.local().get_config().counter_update_coalescing_window_in_us()));
+    }
+    return parallel_for_each(waiting, [] (future<>& f) {
+        return std::move(f);
+    });
+}
+
+void storage_proxy::flush_counter_updates() {
+    for (auto&& p : std::exchange(_pending_counter_updates, {})) {
+        std::vector<mutation> mutations;
+        std::vector<promise<>> waiters;
+        mutations.reserve(p.partitions.size());
+        for (auto&& e : p.partitions) {
+            mutations.push_back(std::move(e.second.m));
+            std::move(e.second.waiters.begin(), e.second.waiters.end(), std::back_inserter(waiters));
+        }
+        // Sent together, the updates of a table share their outcome anyway.
+        with_gate(_counter_coalescing_gate, [this, cl = p.cl, mutations = std::move(mutations)] () mutable {
+            return do_with(std::move(mutations), [this, cl] (std::vector<mutation>& mutations) {
+                return send_counter_updates(mutations, cl, nullptr);
+            });
+        }).then_wrapped([waiters = std::move(waiters)] (future<> f) mutable {
+            if (f.failed()) {
+                auto ep = f.get_exception();
+                for (auto&& w : waiters) {
+                    w.set_exception(ep);
+                }
+            } else {
+                for (auto&& w : waiters) {
+                    w.set_value();
+                }
+            }
+        });
+    }
+}
+
+template<typename Range>
+future<> storage_proxy::send_counter_updates(Range&& mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state) {
     slogger.trace("mutate_counters cl={}", cl);
     mlogger.trace("counter mutations={}", mutations);
 
@@ -1279,13 +1670,44 @@ future<> storage_proxy::mutate(std::vector<mutation> mutations, db::consistency_
 }
 
 future<> storage_proxy::do_mutate(std::vector<mutation> mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state, bool raw_counters) {
+    auto cached = cached_partitions(mutations);
     auto mid = raw_counters ? mutations.begin() : boost::range::partition(mutations, [] (auto&& m) {
         return m.schema()->is_counter();
     });
-    return seastar::when_all_succeed(
+    auto f = seastar::when_all_succeed(
         mutate_counters(boost::make_iterator_range(mutations.begin(), mid), cl, tr_state),
         mutate_internal(boost::make_iterator_range(mid, mutations.end()), cl, false, tr_state)
     );
+    if (cached.empty()) {
+        return f;
+    }
+    // Even a failed write may have been applied by some replicas.
+    return f.finally([this, cached = std::move(cached)] () mutable {
+        return invalidate_result_cache(std::move(cached));
+    });
+}
+
+std::vector<storage_proxy::partition_id> storage_proxy::cached_partitions(const std::vector<mutation>& mutations) {
+    std::vector<partition_id> ret;
+    for (auto&& m : mutations) {
+        if (m.schema()->caching_options().coordinator_ttl().count()) {
+            ret.emplace_back(m.schema()->id(), m.token());
+        }
+    }
+    return ret;
+}
+
+future<> storage_proxy::invalidate_result_cache(std::vector<partition_id> partitions) {
+    if (partitions.empty()) {
+        return make_ready_future<>();
+    }
+    // The write is acknowledged only once no shard can return results from
+    // before it, those which read it concurrently are not inserted.
+    return get_storage_proxy().invoke_on_all([partitions = std::move(partitions)] (storage_proxy& p) {
+        for (auto&& id : partitions) {
+            p._result_cache.invalidate(id.first, id.second);
+        }
+    });
 }
 
 future<> storage_proxy::replicate_counter_from_leader(mutation m, db::consistency_level cl, tracing::trace_state_ptr tr_state,
@@ -1336,6 +1758,7 @@ storage_proxy::mutate_with_triggers(std::vector<mutation> mutations, db::consist
             return mutate_atomically(augmented, consistencyLevel);
         } else {
 #endif
+    cdc::append_log_mutations(_db.local(), mutations);
     if (should_mutate_atomically) {
         assert(!raw_counters);
         return mutate_atomically(std::move(mutations), cl, std::move(tr_state));
@@ -1367,19 +1790,39 @@ storage_proxy::mutate_atomically(std::vector<mutation> mutations, db::consistenc
         db::consistency_level _cl;
         tracing::trace_state_ptr _trace_state;
 
+        // Whether the batchlog entry is kept in this shard's part of the
+        // local batchlog, see the batchlog_local_writes option.
+        const bool _local_batchlog;
         const utils::UUID _batch_uuid;
         const std::unordered_set<gms::inet_address> _batchlog_endpoints;
 
+        // The batchlog is partitioned by the batch id, so the local entry
+        // lands on this shard if the id is picked among those it owns.
+        utils::UUID make_batch_uuid() const {
+            auto uuid = utils::UUID_gen::get_time_UUID();
+            if (!_local_batchlog) {
+                return uuid;
+            }
+            auto schema = _p._db.local().find_schema(db::system_keyspace::NAME, db::system_keyspace::BATCHLOG);
+            while (_p._db.local().shard_of(dht::global_partitioner().get_token(*schema, partition_key::from_singular(*schema, uuid))) != engine().cpu_id()) {
+                uuid = utils::UUID_gen::get_time_UUID();
+            }
+            return uuid;
+        }
     public:
         context(storage_proxy & p, std::vector<mutation>&& mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state)
                 : _p(p)
                 , _mutations(std::move(mutations))
                 , _cl(cl)
                 , _trace_state(std::move(tr_state))
-                , _batch_uuid(utils::UUID_gen::get_time_UUID())
+                , _local_batchlog(_p._db.local().get_config().batchlog_local_writes())
+                , _batch_uuid(make_batch_uuid())
                 , _batchlog_endpoints(
                         [this]() -> std::unordered_set<gms::inet_address> {
                             auto local_addr = utils::fb_utilities::get_broadcast_address();
+                            if (_local_batchlog) {
+                                return {local_addr};
+                            }
                             auto topology = service::get_storage_service().local().get_token_metadata().get_topology();
                             auto local_endpoints = topology.get_datacenter_racks().at(get_local_dc()); // note: origin copies, so do that here too...
                             auto local_rack = locator::i_endpoint_snitch::get_local_snitch_ptr()->get_rack(local_addr);
@@ -1398,6 +1841,11 @@ storage_proxy::mutate_atomically(std::vector<mutation> mutations, db::consistenc
         }
 
         future<> send_batchlog_mutation(mutation m, db::consistency_level cl = db::consistency_level::ONE) {
+            if (_local_batchlog) {
+                // The batchlog is a system table, so the write is in the
+                // commitlog once applied.
+                return _p.mutate_locally(m);
+            }
             return _p.mutate_prepare<>(std::array<mutation, 1>{std::move(m)}, cl, db::write_type::BATCH_LOG, [this] (const mutation& m, db::consistency_level cl, db::write_type type) {
                 auto& ks = _p._db.local().find_keyspace(m.schema()->ks_name());
                 return _p.create_write_response_handler(ks, cl, type, std::make_unique<shared_mutation>(m), _batchlog_endpoints, {}, {}, _trace_state);
@@ -1442,15 +1890,373 @@ storage_proxy::mutate_atomically(std::vector<mutation> mutations, db::consistenc
       }
     };
 
+    auto cached = cached_partitions(mutations);
     return mk_ctxt(std::move(mutations), cl).then([this] (lw_shared_ptr<context> ctxt) {
         return ctxt->run().finally([ctxt]{});
+    }).finally([this, cached = std::move(cached)] () mutable {
+        return invalidate_result_cache(std::move(cached));
     }).then_wrapped([p = shared_from_this(), lc, tr_state = std::move(tr_state)] (future<> f) mutable {
         return p->mutate_end(std::move(f), lc, std::move(tr_state));
     });
 }
 
+storage_proxy::paxos_participants
+storage_proxy::get_paxos_participants(const schema& s, const dht::token& token, db::consistency_level cl_for_paxos) {
+    keyspace& ks = _db.local().find_keyspace(s.ks_name());
+    auto& rs = ks.get_replication_strategy();
+    std::vector<gms::inet_address> natural_endpoints = rs.get_natural_endpoints(token);
+    std::vector<gms::inet_address> pending_endpoints =
+        get_local_storage_service().get_token_metadata().pending_endpoints_for(token, s.ks_name());
+
+    if (cl_for_paxos == db::consistency_level::LOCAL_SERIAL) {
+        natural_endpoints.erase(boost::range::remove_if(natural_endpoints, std::not1(std::cref(db::is_local))), natural_endpoints.end());
+        pending_endpoints.erase(boost::range::remove_if(pending_endpoints, std::not1(std::cref(db::is_local))), pending_endpoints.end());
+    }
+    auto itend = boost::range::remove_if(pending_endpoints, [&natural_endpoints] (gms::inet_address& p) {
+        return boost::range::find(natural_endpoints, p) != natural_endpoints.end();
+    });
+    pending_endpoints.erase(itend, pending_endpoints.end());
+
+    size_t participants = natural_endpoints.size() + pending_endpoints.size();
+    size_t required = participants / 2 + 1;
+    // With more than one pending endpoint, two quorums of the participants
+    // of different coordinators may not intersect.
+    if (pending_endpoints.size() > 1) {
+        throw exceptions::unavailable_exception(cl_for_paxos, required, 0);
+    }
+
+    auto all = boost::range::join(natural_endpoints, pending_endpoints);
+    std::vector<gms::inet_address> live_endpoints;
+    live_endpoints.reserve(participants);
+    std::copy_if(all.begin(), all.end(), std::back_inserter(live_endpoints),
+            std::bind1st(std::mem_fn(&gms::failure_detector::is_alive), &gms::get_local_failure_detector()));
+    if (live_endpoints.size() < required) {
+        throw exceptions::unavailable_exception(cl_for_paxos, required, live_endpoints.size());
+    }
+    return paxos_participants{std::move(live_endpoints), required};
+}
+
+utils::UUID storage_proxy::new_paxos_ballot(const utils::UUID& min_ballot) {
+    using namespace std::chrono;
+    auto micros = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    micros = std::max(micros, _last_ballot_micros + 1);
+    if (min_ballot != utils::UUID()) {
+        micros = std::max(micros, utils::UUID_gen::micros_timestamp(min_ballot) + 1);
+    }
+    _last_ballot_micros = micros;
+    return utils::UUID_gen::get_time_UUID(system_clock::time_point(microseconds(micros)));
+}
+
+future<paxos::prepare_response>
+storage_proxy::paxos_prepare_on_shard(schema_ptr s, const query::read_command& cmd, partition_key key, const dht::token& token,
+        utils::UUID ballot, clock_type::time_point timeout, tracing::trace_state_ptr tr_state) {
+    return get_storage_proxy().invoke_on(_db.local().shard_of(token), [gs = global_schema_ptr(s), cmd, key = std::move(key), ballot, timeout,
+            gt = tracing::global_trace_state_ptr(std::move(tr_state))] (storage_proxy&) mutable {
+        return paxos::paxos_state::prepare(gt, gs, make_lw_shared<query::read_command>(std::move(cmd)), std::move(key), ballot, timeout);
+    });
+}
+
+future<bool>
+storage_proxy::paxos_accept_on_shard(schema_ptr s, const dht::token& token, paxos::proposal p, clock_type::time_point timeout,
+        tracing::trace_state_ptr tr_state) {
+    return get_storage_proxy().invoke_on(_db.local().shard_of(token), [gs = global_schema_ptr(s), p = std::move(p), timeout,
+            gt = tracing::global_trace_state_ptr(std::move(tr_state))] (storage_proxy&) mutable {
+        return paxos::paxos_state::accept(gt, gs, std::move(p), timeout);
+    });
+}
+
+future<>
+storage_proxy::paxos_learn_on_shard(schema_ptr s, const dht::token& token, paxos::proposal decision, clock_type::time_point timeout,
+        tracing::trace_state_ptr tr_state) {
+    return get_storage_proxy().invoke_on(_db.local().shard_of(token), [gs = global_schema_ptr(s), decision = std::move(decision), timeout,
+            gt = tracing::global_trace_state_ptr(std::move(tr_state))] (storage_proxy&) mutable {
+        return paxos::paxos_state::learn(gt, gs, std::move(decision), timeout);
+    });
+}
+
+// Runs the Paxos rounds of a lightweight transaction on a partition, until
+// one of them decides on its update, or finds that its conditions don't
+// hold, or until cas_contention_timeout_in_ms.
+class cas_coordinator : public enable_lw_shared_from_this<cas_coordinator> {
+    using clock_type = storage_proxy::clock_type;
+    shared_ptr<storage_proxy> _proxy;
+    schema_ptr _schema;
+    shared_ptr<paxos::cas_request> _request;
+    lw_shared_ptr<query::read_command> _cmd;
+    dht::decorated_key _key;
+    db::consistency_level _cl;
+    std::vector<gms::inet_address> _participants;
+    size_t _required;
+    clock_type::time_point _cas_timeout;
+    tracing::trace_state_ptr _tr_state;
+    // The highest ballot the replicas promised to others, which the next one
+    // of ours must be later than.
+    utils::UUID _min_ballot;
+
+    using prepare_responses = std::vector<std::pair<gms::inet_address, paxos::prepare_response>>;
+public:
+    cas_coordinator(shared_ptr<storage_proxy> proxy, schema_ptr s, shared_ptr<paxos::cas_request> request, lw_shared_ptr<query::read_command> cmd,
+            dht::decorated_key key, db::consistency_level cl, storage_proxy::paxos_participants participants,
+            clock_type::time_point cas_timeout, tracing::trace_state_ptr tr_state)
+        : _proxy(std::move(proxy))
+        , _schema(std::move(s))
+        , _request(std::move(request))
+        , _cmd(std::move(cmd))
+        , _key(std::move(key))
+        , _cl(cl)
+        , _participants(std::move(participants.live_endpoints))
+        , _required(participants.required)
+        , _cas_timeout(cas_timeout)
+        , _tr_state(std::move(tr_state)) {
+    }
+
+    future<bool> run() {
+        return repeat_until_value([self = shared_from_this()] {
+            return self->round();
+        });
+    }
+private:
+    clock_type::time_point write_timeout() const {
+        return clock_type::now() + std::chrono::milliseconds(_proxy->_db.local().get_config().write_request_timeout_in_ms());
+    }
+
+    exceptions::mutation_write_timeout_exception timeout_error(size_t received) const {
+        return exceptions::mutation_write_timeout_exception(_schema->ks_name(), _schema->cf_name(), _cl, received, _required, db::write_type::CAS);
+    }
+
+    // Sends a request to each of the endpoints with func, and resolves with
+    // the responses once required of them succeeded, or fails once too many
+    // failed for that.
+    template <typename T, typename Func>
+    future<std::vector<T>> collect(const std::vector<gms::inet_address>& endpoints, size_t required, Func&& func) {
+        struct state {
+            std::vector<T> responses;
+            size_t failures = 0;
+            bool done = false;
+            promise<std::vector<T>> pr;
+        };
+        auto st = make_lw_shared<state>();
+        auto f = st->pr.get_future();
+        auto max_failures = endpoints.size() - required;
+        for (auto& ep : endpoints) {
+            func(ep).then_wrapped([self = shared_from_this(), st, ep, required, max_failures] (future<T> f) {
+                if (st->done) {
+                    f.ignore_ready_future();
+                    return;
+                }
+                if (f.failed()) {
+                    auto ex = f.get_exception();
+                    slogger.debug("Paxos request to {} failed: {}", ep, ex);
+                    if (++st->failures > max_failures) {
+                        st->done = true;
+                        st->pr.set_exception(self->timeout_error(st->responses.size()));
+                    }
+                    return;
+                }
+                st->responses.push_back(std::get<0>(f.get()));
+                if (st->responses.size() == required) {
+                    st->done = true;
+                    st->pr.set_value(std::move(st->responses));
+                }
+            });
+        }
+        return f;
+    }
+
+    future<prepare_responses> prepare(utils::UUID ballot) {
+        auto timeout = write_timeout();
+        return collect<prepare_responses::value_type>(_participants, _required, [this, ballot, timeout] (gms::inet_address ep) {
+            auto f = is_me(ep)
+                    ? _proxy->paxos_prepare_on_shard(_schema, *_cmd, _key.key(), _key.token(), ballot, timeout, _tr_state)
+                    : netw::get_local_messaging_service().send_paxos_prepare(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _key.key(), ballot);
+            return f.then([ep] (paxos::prepare_response r) {
+                return std::make_pair(ep, std::move(r));
+            });
+        });
+    }
+
+    // Resolves with whether a quorum accepted the proposal.
+    future<bool> accept(const paxos::proposal& p) {
+        auto timeout = write_timeout();
+        return collect<bool>(_participants, _required, [this, &p, timeout] (gms::inet_address ep) {
+            if (is_me(ep)) {
+                return _proxy->paxos_accept_on_shard(_schema, _key.token(), p, timeout, _tr_state);
+            }
+            return netw::get_local_messaging_service().send_paxos_accept(netw::messaging_service::msg_addr{ep, 0}, timeout, p);
+        }).then([] (std::vector<bool> accepted) {
+            return boost::algorithm::all_of_equal(accepted, true);
+        });
+    }
+
+    future<bool> learn_on(gms::inet_address ep, const paxos::proposal& decision, clock_type::time_point timeout) {
+        auto f = is_me(ep)
+                ? _proxy->paxos_learn_on_shard(_schema, _key.token(), decision, timeout, _tr_state)
+                : netw::get_local_messaging_service().send_paxos_learn(netw::messaging_service::msg_addr{ep, 0}, timeout, decision);
+        return f.then([] {
+            return true;
+        });
+    }
+
+    // Resolves once required of the endpoints learned the decision.
+    future<> learn(const std::vector<gms::inet_address>& endpoints, size_t required, const paxos::proposal& decision) {
+        auto timeout = write_timeout();
+        return collect<bool>(endpoints, required, [this, &decision, timeout] (gms::inet_address ep) {
+            return learn_on(ep, decision, timeout);
+        }).discard_result();
+    }
+
+    // Sends the decision to all participants without waiting for them. A
+    // replica which doesn't get it is given it by the prepare of the next
+    // round on the partition, before its data is used.
+    void learn_in_background(const paxos::proposal& decision) {
+        auto timeout = write_timeout();
+        for (auto& ep : _participants) {
+            learn_on(ep, decision, timeout).then_wrapped([ep] (future<bool> f) {
+                if (f.failed()) {
+                    slogger.debug("Failed to send a Paxos decision to {}: {}", ep, f.get_exception());
+                }
+            });
+        }
+    }
+
+    // Retries with a later ballot after a random delay, so that competing
+    // coordinators don't keep preempting each other.
+    future<stdx::optional<bool>> contended() {
+        ++_proxy->_stats.cas_contentions;
+        auto delay = std::chrono::milliseconds(std::uniform_int_distribution<>(0, 100)(_proxy->_urandom));
+        return sleep(delay).then([] {
+            return stdx::optional<bool>();
+        });
+    }
+
+    // The data of the partition, as of the most recent decision.
+    mutation_opt current_data(const prepare_responses& responses, const stdx::optional<paxos::proposal>& most_recent_commit) const {
+        mutation_opt current;
+        for (auto& r : responses) {
+            for (auto& p : r.second.data->partitions()) {
+                apply(current, p.mut().unfreeze(_schema));
+            }
+        }
+        if (most_recent_commit) {
+            apply(current, most_recent_commit->update.to_mutation(_schema));
+        }
+        return current;
+    }
+
+    future<stdx::optional<bool>> round() {
+        if (clock_type::now() >= _cas_timeout) {
+            return make_exception_future<stdx::optional<bool>>(timeout_error(0));
+        }
+        auto ballot = _proxy->new_paxos_ballot(_min_ballot);
+        tracing::trace(_tr_state, "Preparing {}", ballot);
+        return prepare(ballot).then([self = shared_from_this(), ballot] (prepare_responses responses) {
+            return self->after_prepare(ballot, std::move(responses));
+        });
+    }
+
+    future<stdx::optional<bool>> after_prepare(utils::UUID ballot, prepare_responses responses) {
+        for (auto& r : responses) {
+            if (!r.second.promised) {
+                tracing::trace(_tr_state, "Some replicas have already promised a higher ballot than ours; aborting");
+                if (paxos::ballot_less(_min_ballot, r.second.promised_ballot)) {
+                    _min_ballot = r.second.promised_ballot;
+                }
+                return contended();
+            }
+        }
+
+        stdx::optional<paxos::proposal> most_recent_commit;
+        for (auto& r : responses) {
+            auto& mrc = r.second.most_recent_commit;
+            if (mrc && (!most_recent_commit || paxos::ballot_less(most_recent_commit->ballot, mrc->ballot))) {
+                most_recent_commit = mrc;
+            }
+        }
+        auto mrc_ballot = most_recent_commit ? most_recent_commit->ballot : utils::UUID();
+
+        // A proposal of a later round than the most recent decision may have
+        // been decided, so it's finished with our ballot before we go on.
+        stdx::optional<paxos::proposal> in_progress;
+        for (auto& r : responses) {
+            auto& accepted = r.second.accepted;
+            if (accepted && paxos::ballot_less(mrc_ballot, accepted->ballot)
+                    && (!in_progress || paxos::ballot_less(in_progress->ballot, accepted->ballot))) {
+                in_progress = accepted;
+            }
+        }
+        if (in_progress) {
+            tracing::trace(_tr_state, "Finishing incomplete paxos round {}", in_progress->ballot);
+            auto refreshed = make_lw_shared<paxos::proposal>(paxos::proposal{ballot, std::move(in_progress->update)});
+            return accept(*refreshed).then([self = shared_from_this(), refreshed] (bool accepted) {
+                if (!accepted) {
+                    return self->contended();
+                }
+                return self->learn(self->_participants, self->_required, *refreshed).then([] {
+                    return stdx::optional<bool>();
+                });
+            });
+        }
+
+        // The replicas which didn't learn the most recent decision are given
+        // it now, so that a quorum has it before the next one is made.
+        std::vector<gms::inet_address> missing_mrc;
+        for (auto& r : responses) {
+            auto& mrc = r.second.most_recent_commit;
+            if (paxos::ballot_less(mrc ? mrc->ballot : utils::UUID(), mrc_ballot)) {
+                missing_mrc.push_back(r.first);
+            }
+        }
+        auto f = make_ready_future<>();
+        if (!missing_mrc.empty()) {
+            tracing::trace(_tr_state, "Repairing replicas that missed the most recent commit");
+            f = do_with(std::move(missing_mrc), *most_recent_commit, [self = shared_from_this()] (const std::vector<gms::inet_address>& endpoints,
+                    const paxos::proposal& decision) {
+                return self->learn(endpoints, endpoints.size(), decision);
+            });
+        }
+        return f.then([self = shared_from_this(), ballot, responses = std::move(responses), most_recent_commit = std::move(most_recent_commit)] {
+            auto current = self->current_data(responses, most_recent_commit);
+            return self->_request->apply(current, utils::UUID_gen::micros_timestamp(ballot));
+        }).then([self = shared_from_this(), ballot] (mutation_opt update) {
+            if (!update) {
+                tracing::trace(self->_tr_state, "CAS precondition does not match current values");
+                ++self->_proxy->_stats.cas_not_applied;
+                return make_ready_future<stdx::optional<bool>>(false);
+            }
+            auto p = make_lw_shared<paxos::proposal>(paxos::proposal{ballot, canonical_mutation(*update)});
+            return self->accept(*p).then([self, p, update = std::move(update)] (bool accepted) mutable {
+                if (!accepted) {
+                    return self->contended();
+                }
+                tracing::trace(self->_tr_state, "CAS successful");
+                self->learn_in_background(*p);
+                return self->_proxy->invalidate_result_cache(storage_proxy::cached_partitions({std::move(*update)})).then([] {
+                    return stdx::optional<bool>(true);
+                });
+            });
+        });
+    }
+};
+
+future<bool>
+storage_proxy::cas(schema_ptr s, shared_ptr<paxos::cas_request> request, lw_shared_ptr<query::read_command> cmd, partition_key key,
+        db::consistency_level cl_for_paxos, tracing::trace_state_ptr tr_state) {
+    try {
+        db::validate_for_cas(cl_for_paxos);
+        auto dk = dht::global_partitioner().decorate_key(*s, std::move(key));
+        auto participants = get_paxos_participants(*s, dk.token(), cl_for_paxos);
+        auto cas_timeout = clock_type::now() + std::chrono::milliseconds(_db.local().get_config().cas_contention_timeout_in_ms());
+        ++_stats.cas_operations;
+        auto coordinator = make_lw_shared<cas_coordinator>(shared_from_this(), std::move(s), std::move(request), std::move(cmd), std::move(dk),
+                cl_for_paxos, std::move(participants), cas_timeout, std::move(tr_state));
+        return coordinator->run();
+    } catch (...) {
+        return make_exception_future<bool>(std::current_exception());
+    }
+}
+
 bool storage_proxy::cannot_hint(gms::inet_address target) {
-    return _total_hints_in_progress > _max_hints_in_progress
+    return _hints_manager && _hints_manager->hints_in_progress() > _max_hints_in_progress
             && (get_hints_in_progress_for(target) > 0 && should_hint(target));
 }
 
@@ -1469,6 +2275,30 @@ future<> storage_proxy::send_to_endpoint(mutation m, gms::inet_address target, d
         });
 }
 
+future<> storage_proxy::send_to_endpoint(std::vector<mutation> mutations, gms::inet_address target, db::write_type type) {
+    utils::latency_counter lc;
+    lc.start();
+
+    return mutate_prepare(mutations, db::consistency_level::ONE, type,
+        [this, target] (const mutation& m, db::consistency_level cl, db::write_type type) {
+            auto& ks = _db.local().find_keyspace(m.schema()->ks_name());
+            return create_write_response_handler(ks, cl, type, std::make_unique<shared_mutation>(m), {target}, {}, {}, nullptr);
+        }).then([this, target] (std::vector<unique_response_handler> ids) {
+            return mutate_begin_batched(std::move(ids), target);
+        }).then_wrapped([p = shared_from_this(), lc] (future<>&& f) {
+            return p->mutate_end(std::move(f), lc, nullptr);
+        });
+}
+
+// Like mutate_begin(), for mutations whose only target is target. They are
+// queued in its MUTATION_BATCH, see send_batched_mutation(), which is sent at
+// once rather than after the other writes of the poll period.
+future<> storage_proxy::mutate_begin_batched(std::vector<unique_response_handler> ids, gms::inet_address target) {
+    auto f = mutate_begin(std::move(ids), db::consistency_level::ONE);
+    flush_mutation_batch(target);
+    return f;
+}
+
 /**
  * Send the mutations to the right targets, write it locally if it corresponds or writes a hint when the node
  * is not available.
@@ -1527,8 +2357,11 @@ void storage_proxy::send_to_live_endpoints(storage_proxy::response_id_type respo
         auto& tr_state = handler_ptr->get_trace_state();
         tracing::trace(tr_state, "Sending a mutation to /{}", coordinator);
 
-        return ms.send_mutation(netw::messaging_service::msg_addr{coordinator, 0}, timeout, m,
-                std::move(forward), my_address, engine().cpu_id(), response_id, tracing::make_trace_info(tr_state)).finally([this, p = shared_from_this(), h = std::move(handler_ptr), msize] {
+        auto f = can_batch_mutation(forward, tr_state)
+                ? send_batched_mutation(coordinator, timeout, m, response_id)
+                : ms.send_mutation(netw::messaging_service::msg_addr{coordinator, 0}, timeout, m,
+                        std::move(forward), my_address, engine().cpu_id(), response_id, tracing::make_trace_info(tr_state));
+        return f.finally([this, p = shared_from_this(), h = std::move(handler_ptr), msize] {
             _stats.queued_write_bytes -= msize;
             unthrottle();
         });
@@ -1589,43 +2422,17 @@ size_t storage_proxy::hint_to_dead_endpoints(std::unique_ptr<mutation_holder>& m
 }
 
 size_t storage_proxy::get_hints_in_progress_for(gms::inet_address target) {
-    auto it = _hints_in_progress.find(target);
-
-    if (it == _hints_in_progress.end()) {
-        return 0;
-    }
-
-    return it->second;
+    return _hints_manager ? _hints_manager->hints_in_progress_for(target) : 0;
 }
 
 bool storage_proxy::submit_hint(std::unique_ptr<mutation_holder>& mh, gms::inet_address target)
 {
-    warn(unimplemented::cause::HINT);
-    // local write that time out should be handled by LocalMutationRunnable
-    assert(is_me(target));
-    return false;
-#if 0
-    HintRunnable runnable = new HintRunnable(target)
-    {
-        public void runMayThrow()
-        {
-            int ttl = HintedHandOffManager.calculateHintTTL(mutation);
-            if (ttl > 0)
-            {
-                slogger.debug("Adding hint for {}", target);
-                writeHintForMutation(mutation, System.currentTimeMillis(), ttl, target);
-                // Notify the handler only for CL == ANY
-                if (responseHandler != null && responseHandler.consistencyLevel == ConsistencyLevel.ANY)
-                    responseHandler.response(null);
-            } else
-            {
-                slogger.debug("Skipped writing hint for {} (ttl {})", target, ttl);
-            }
-        }
-    };
-
-    return submitHint(runnable);
-#endif
+    auto fm = mh->get_mutation_for(target);
+    if (!fm) {
+        return false;
+    }
+    slogger.debug("Adding hint for {}", target);
+    return _hints_manager->store_hint(target, mh->schema(), std::move(fm));
 }
 
 #if 0
@@ -1787,6 +2594,34 @@ future<> storage_proxy::schedule_repair(std::unordered_map<dht::token, std::unor
     return mutate_internal(diffs | boost::adaptors::map_values, cl, false, std::move(trace_state));
 }
 
+void storage_proxy::schedule_background_repair(std::unordered_map<dht::token, std::unordered_map<gms::inet_address, std::experimental::optional<mutation>>> diffs, db::consistency_level cl, tracing::trace_state_ptr trace_state) {
+    if (diffs.empty()) {
+        return;
+    }
+    if (_read_repair_gate.is_closed() || _read_repair_sem.waiters() >= _max_queued_read_repairs) {
+        // The replicas stay inconsistent until another read or a repair
+        // finds them so.
+        _stats.dropped_read_repairs++;
+        tracing::trace(trace_state, "Dropping read repair, too many are queued");
+        return;
+    }
+    _stats.deferred_read_repairs++;
+    _stats.queued_read_repairs++;
+    with_gate(_read_repair_gate, [this, diffs = std::move(diffs), cl, trace_state = std::move(trace_state)] () mutable {
+        return with_semaphore(_read_repair_sem, 1, [this, diffs = std::move(diffs), cl, trace_state = std::move(trace_state)] () mutable {
+            return schedule_repair(std::move(diffs), cl, std::move(trace_state));
+        });
+    }).then_wrapped([this] (future<> f) {
+        _stats.queued_read_repairs--;
+        try {
+            f.get();
+        } catch (...) {
+            _stats.failed_read_repairs++;
+            slogger.debug("Background read repair failed: {}", std::current_exception());
+        }
+    });
+}
+
 class abstract_read_resolver {
 protected:
     db::consistency_level _cl;
@@ -1824,7 +2659,12 @@ class abstract_read_resolver {
             return; // do not report connection closed exception, gossiper does that
         } catch (rpc::timeout_error&) {
             return; // do not report timeouts, the whole operation will timeout and be reported
+        } catch (timed_out_error&) {
+            return; // the local replica gave up after the timeout, same as above
         } catch(std::exception& e) {
+            if (_timedout) {
+                return; // remote replicas give up on reads after the timeout too
+            }
             why = e.what();
         } catch(...) {
             why = "Unknown exception";
@@ -2412,12 +3252,16 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     promise<foreign_ptr<lw_shared_ptr<query::result>>> _result_promise;
     tracing::trace_state_ptr _trace_state;
     lw_shared_ptr<column_family> _cf;
+    // All the replicas of a read hash their results the same way.
+    query::digest_algorithm _digest_algorithm;
 
 public:
     abstract_read_executor(schema_ptr s, lw_shared_ptr<column_family> cf, shared_ptr<storage_proxy> proxy, lw_shared_ptr<query::read_command> cmd, dht::partition_range pr, db::consistency_level cl, size_t block_for,
             std::vector<gms::inet_address> targets, tracing::trace_state_ptr trace_state) :
                            _schema(std::move(s)), _proxy(std::move(proxy)), _cmd(std::move(cmd)), _partition_range(std::move(pr)), _cl(cl), _block_for(block_for), _targets(std::move(targets)), _trace_state(std::move(trace_state)),
-                           _cf(std::move(cf)) {
+                           _cf(std::move(cf)),
+                           _digest_algorithm(service::get_local_storage_service().cluster_supports_murmur3_digest()
+                                   ? query::digest_algorithm::MURMUR3 : query::digest_algorithm::MD5) {
         _proxy->_stats.reads++;
     }
     virtual ~abstract_read_executor() {
@@ -2429,7 +3273,7 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         ++_proxy->_stats.mutation_data_read_attempts.get_ep_stat(ep);
         if (is_me(ep)) {
             tracing::trace(_trace_state, "read_mutation_data: querying locally");
-            return _proxy->query_mutations_locally(_schema, cmd, _partition_range, _trace_state);
+            return _proxy->query_mutations_locally(_schema, cmd, _partition_range, _trace_state, query::result_memory_limiter::maximum_result_size, timeout);
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_mutation_data: sending a message to /{}", ep);
@@ -2444,11 +3288,12 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         if (is_me(ep)) {
             tracing::trace(_trace_state, "read_data: querying locally");
             auto qrr = want_digest ? query::result_request::result_and_digest : query::result_request::only_result;
-            return _proxy->query_singular_local(_schema, _cmd, _partition_range, qrr, _trace_state);
+            return _proxy->query_singular_local(_schema, _cmd, _partition_range, qrr, _trace_state, query::result_memory_limiter::maximum_result_size, timeout,
+                    _digest_algorithm);
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_data: sending a message to /{}", ep);
-            auto da = want_digest ? query::digest_algorithm::MD5 : query::digest_algorithm::none;
+            auto da = want_digest ? _digest_algorithm : query::digest_algorithm::none;
             return ms.send_read_data(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range, da).then([this, ep](query::result&& result, rpc::optional<cache_temperature> hit_rate) {
                 tracing::trace(_trace_state, "read_data: got response from /{}", ep);
                 return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(make_foreign(::make_lw_shared<query::result>(std::move(result))), hit_rate.value_or(cache_temperature::invalid()));
@@ -2459,11 +3304,12 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
         ++_proxy->_stats.digest_read_attempts.get_ep_stat(ep);
         if (is_me(ep)) {
             tracing::trace(_trace_state, "read_digest: querying locally");
-            return _proxy->query_singular_local_digest(_schema, _cmd, _partition_range, _trace_state);
+            return _proxy->query_singular_local_digest(_schema, _cmd, _partition_range, _trace_state, query::result_memory_limiter::maximum_result_size, timeout,
+                    _digest_algorithm);
         } else {
             auto& ms = netw::get_local_messaging_service();
             tracing::trace(_trace_state, "read_digest: sending a message to /{}", ep);
-            return ms.send_read_digest(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range).then([this, ep] (query::result_digest d, rpc::optional<api::timestamp_type> t,
+            return ms.send_read_digest(netw::messaging_service::msg_addr{ep, 0}, timeout, *_cmd, _partition_range, _digest_algorithm).then([this, ep] (query::result_digest d, rpc::optional<api::timestamp_type> t,
                     rpc::optional<cache_temperature> hit_rate) {
                 tracing::trace(_trace_state, "read_digest: got response from /{}", ep);
                 return make_ready_future<query::result_digest, api::timestamp_type, cache_temperature>(d, t ? t.value() : api::missing_timestamp, hit_rate.value_or(cache_temperature::invalid()));
@@ -2487,9 +3333,11 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     }
     future<> make_data_requests(digest_resolver_ptr resolver, targets_iterator begin, targets_iterator end, clock_type::time_point timeout, bool want_digest) {
         return parallel_for_each(begin, end, [this, resolver = std::move(resolver), timeout, want_digest] (gms::inet_address ep) {
-            return make_data_request(ep, timeout, want_digest).then_wrapped([this, resolver, ep] (future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> f) {
+            auto start = utils::latency_counter::now();
+            return make_data_request(ep, timeout, want_digest).then_wrapped([this, resolver, ep, start] (future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> f) {
                 try {
                     auto v = f.get();
+                    got_response(ep, start);
                     _cf->set_hit_rate(ep, std::get<1>(v));
                     resolver->add_data(ep, std::get<0>(std::move(v)));
                     ++_proxy->_stats.data_read_completed.get_ep_stat(ep);
@@ -2502,9 +3350,11 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
     }
     future<> make_digest_requests(digest_resolver_ptr resolver, targets_iterator begin, targets_iterator end, clock_type::time_point timeout) {
         return parallel_for_each(begin, end, [this, resolver = std::move(resolver), timeout] (gms::inet_address ep) {
-            return make_digest_request(ep, timeout).then_wrapped([this, resolver, ep] (future<query::result_digest, api::timestamp_type, cache_temperature> f) {
+            auto start = utils::latency_counter::now();
+            return make_digest_request(ep, timeout).then_wrapped([this, resolver, ep, start] (future<query::result_digest, api::timestamp_type, cache_temperature> f) {
                 try {
                     auto v = f.get();
+                    got_response(ep, start);
                     _cf->set_hit_rate(ep, std::get<2>(v));
                     resolver->add_digest(ep, std::get<0>(v), std::get<1>(v));
                     ++_proxy->_stats.digest_read_completed.get_ep_stat(ep);
@@ -2522,6 +3372,15 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
                         make_digest_requests(resolver, _targets.begin() + 1, _targets.end(), timeout)).discard_result();
     }
     virtual void got_cl() {}
+    // Called for each successful data or digest reply, before the resolver
+    // sees it.
+    virtual void got_response(gms::inet_address ep, utils::latency_counter::time_point start) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(utils::latency_counter::now() - start);
+        _cf->add_replica_read_latency(ep, latency);
+        if (_proxy->_dynamic_snitch) {
+            _proxy->_dynamic_snitch->add_latency(ep, latency);
+        }
+    }
     uint32_t original_row_limit() const {
         return _cmd->row_limit;
     }
@@ -2551,6 +3410,12 @@ class abstract_read_executor : public enable_shared_from_this<abstract_read_exec
                         && !data_resolver->any_partition_short_read()) {
                     auto result = ::make_foreign(::make_lw_shared(
                             to_data_query_result(std::move(*rr_opt), _schema, _cmd->slice, _cmd->row_limit, cmd->partition_limit)));
+                    if (_proxy->_background_read_repair) {
+                        // Trade the guarantees below for the latency of the repair.
+                        _proxy->schedule_background_repair(data_resolver->get_diffs_for_repair(), _cl, _trace_state);
+                        _result_promise.set_value(std::move(result));
+                        return;
+                    }
                     // wait for write to complete before returning result to prevent multiple concurrent read requests to
                     // trigger repair multiple times and to prevent quorum read to return an old value, even after a quorum
                     // another read had returned a newer value (but the newer value had not yet been sent to the other replicas)
@@ -2677,6 +3542,35 @@ class never_speculating_read_executor : public abstract_read_executor {
     using abstract_read_executor::abstract_read_executor;
 };
 
+// Reads from the coordinator itself, when it is the only target. There is
+// nobody to compare digests with, so the data is returned as soon as it
+// is read, without going through a resolver.
+class local_read_executor : public abstract_read_executor {
+public:
+    using abstract_read_executor::abstract_read_executor;
+    virtual future<foreign_ptr<lw_shared_ptr<query::result>>> execute(storage_proxy::clock_type::time_point timeout) override {
+        auto ep = _targets[0];
+        auto start = utils::latency_counter::now();
+        return with_timeout(timeout, make_data_request(ep, timeout, false)).then_wrapped([this, exec = shared_from_this(), ep, start] (future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> f) {
+            try {
+                auto v = f.get();
+                got_response(ep, start);
+                _cf->set_hit_rate(ep, std::get<1>(v));
+                ++_proxy->_stats.data_read_completed.get_ep_stat(ep);
+                return std::get<0>(std::move(v));
+            } catch (timed_out_error&) {
+                throw read_timeout_exception(_schema->ks_name(), _schema->cf_name(), _cl, 0, _block_for, false);
+            } catch (...) {
+                ++_proxy->_stats.data_read_errors.get_ep_stat(ep);
+                slogger.error("Exception when reading locally: {}", std::current_exception());
+                // Reported like the other executors report failed reads,
+                // but without waiting for the timeout.
+                throw read_timeout_exception(_schema->ks_name(), _schema->cf_name(), _cl, 0, _block_for, false);
+            }
+        });
+    }
+};
+
 // this executor always asks for one additional data reply
 class always_speculating_read_executor : public abstract_read_executor {
 public:
@@ -2693,11 +3587,35 @@ class always_speculating_read_executor : public abstract_read_executor {
 // this executor sends request to an additional replica after some time below timeout
 class speculating_read_executor : public abstract_read_executor {
     timer<storage_proxy::clock_type> _speculate_timer;
+    bool _speculated = false;
+    bool _got_speculative_response = false;
+private:
+    // For PERCENTILE, the slowest of the given percentile of the latencies of
+    // the replicas read from first, so that the extra replica is only read
+    // from when one of them is slower than usual.
+    std::chrono::microseconds speculation_delay() const {
+        auto& sr = _schema->speculative_retry();
+        if (sr.get_type() != speculative_retry::type::PERCENTILE) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<double, std::milli>(sr.get_value()));
+        }
+        auto delay = std::chrono::microseconds(0);
+        for (auto ep = _targets.begin(); ep != _targets.end() - 1; ++ep) {
+            auto latency = _cf->get_replica_read_latency(*ep, sr.get_value());
+            if (!latency) {
+                // Not enough samples yet.
+                return std::chrono::milliseconds(_proxy->get_db().local().get_config().read_request_timeout_in_ms() / 2);
+            }
+            delay = std::max(delay, *latency);
+        }
+        return delay;
+    }
 public:
     using abstract_read_executor::abstract_read_executor;
     virtual future<> make_requests(digest_resolver_ptr resolver, storage_proxy::clock_type::time_point timeout) {
         _speculate_timer.set_callback([this, resolver, timeout] {
             if (!resolver->is_completed()) { // at the time the callback runs request may be completed already
+                _speculated = true;
+                _proxy->_stats.speculative_reads++;
                 resolver->add_wait_targets(1); // we send one more request so wait for it too
                 // FIXME: consider disabling for CL=*ONE
                 bool want_digest = true;
@@ -2707,12 +3625,9 @@ class speculating_read_executor : public abstract_read_executor {
                 f.finally([exec = shared_from_this()]{});
             }
         });
-        auto& sr = _schema->speculative_retry();
-        auto t = (sr.get_type() == speculative_retry::type::PERCENTILE) ?
-            // FIXME: the timeout should come from previous latency statistics for a partition
-            std::chrono::milliseconds(_proxy->get_db().local().get_config().read_request_timeout_in_ms()/2) :
-            std::chrono::milliseconds(unsigned(sr.get_value()));
-        _speculate_timer.arm(t);
+        // The timer runs on lowres_clock, so delays below its resolution
+        // round up to the next tick.
+        _speculate_timer.arm(std::chrono::duration_cast<storage_proxy::clock_type::duration>(speculation_delay()));
 
         // if CL + RR result in covering all replicas, getReadExecutor forces AlwaysSpeculating.  So we know
         // that the last replica in our list is "extra."
@@ -2732,8 +3647,17 @@ class speculating_read_executor : public abstract_read_executor {
                             make_digest_requests(resolver, _targets.begin() + 1, _targets.end() - 1, timeout)).discard_result();
         }
     }
+    virtual void got_response(gms::inet_address ep, utils::latency_counter::time_point start) override {
+        abstract_read_executor::got_response(ep, start);
+        if (_speculated && ep == _targets.back()) {
+            _got_speculative_response = true;
+        }
+    }
     virtual void got_cl() override {
         _speculate_timer.cancel();
+        if (_speculated && !_got_speculative_response) {
+            _proxy->_stats.wasted_speculative_reads++;
+        }
     }
 };
 
@@ -2799,6 +3723,9 @@ ::shared_ptr<abstract_read_executor> storage_proxy::get_read_executor(lw_shared_
     // Speculative retry is disabled *OR* there are simply no extra replicas to speculate.
     if (retry_type == speculative_retry::type::NONE || block_for == all_replicas.size()
             || (repair_decision == db::read_repair_decision::DC_LOCAL && is_datacenter_local(cl) && block_for == target_replicas.size())) {
+        if (target_replicas.size() == 1 && is_me(target_replicas[0])) {
+            return ::make_shared<local_read_executor>(schema, cf, p, cmd, std::move(pr), cl, block_for, std::move(target_replicas), std::move(trace_state));
+        }
         return ::make_shared<never_speculating_read_executor>(schema, cf, p, cmd, std::move(pr), cl, block_for, std::move(target_replicas), std::move(trace_state));
     }
 
@@ -2828,17 +3755,19 @@ ::shared_ptr<abstract_read_executor> storage_proxy::get_read_executor(lw_shared_
 }
 
 future<query::result_digest, api::timestamp_type, cache_temperature>
-storage_proxy::query_singular_local_digest(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state, uint64_t max_size) {
-    return query_singular_local(std::move(s), std::move(cmd), pr, query::result_request::only_digest, std::move(trace_state), max_size).then([] (foreign_ptr<lw_shared_ptr<query::result>> result, cache_temperature hit_rate) {
+storage_proxy::query_singular_local_digest(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state, uint64_t max_size,
+        clock_type::time_point timeout, query::digest_algorithm da) {
+    return query_singular_local(std::move(s), std::move(cmd), pr, query::result_request::only_digest, std::move(trace_state), max_size, timeout, da).then([] (foreign_ptr<lw_shared_ptr<query::result>> result, cache_temperature hit_rate) {
         return make_ready_future<query::result_digest, api::timestamp_type, cache_temperature>(*result->digest(), result->last_modified(), hit_rate);
     });
 }
 
 future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>
-storage_proxy::query_singular_local(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, query::result_request request, tracing::trace_state_ptr trace_state, uint64_t max_size) {
+storage_proxy::query_singular_local(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, query::result_request request, tracing::trace_state_ptr trace_state, uint64_t max_size,
+        clock_type::time_point timeout, query::digest_algorithm da) {
     unsigned shard = _db.local().shard_of(pr.start()->value().token());
-    return _db.invoke_on(shard, [max_size, gs = global_schema_ptr(s), prv = dht::partition_range_vector({pr}) /* FIXME: pr is copied */, cmd, request, gt = tracing::global_trace_state_ptr(std::move(trace_state))] (database& db) mutable {
-        return db.query(gs, *cmd, request, prv, gt, max_size).then([](auto&& f, cache_temperature ht) {
+    return _db.invoke_on(shard, [max_size, gs = global_schema_ptr(s), prv = dht::partition_range_vector({pr}) /* FIXME: pr is copied */, cmd, request, gt = tracing::global_trace_state_ptr(std::move(trace_state)), timeout, da] (database& db) mutable {
+        return db.query(gs, *cmd, request, prv, gt, max_size, timeout, da).then([](auto&& f, cache_temperature ht) {
             return make_ready_future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature>(make_foreign(std::move(f)), ht);
         });
     });
@@ -2871,21 +3800,98 @@ storage_proxy::query_singular(lw_shared_ptr<query::read_command> cmd, dht::parti
         }
         exec.push_back(get_read_executor(cmd, std::move(pr), cl, trace_state));
     }
+    _stats.partitions_per_read.add(exec.size());
+
+    // The partitions are read concurrently, but at most
+    // max_concurrent_partition_reads of them at a time, so that a large IN
+    // doesn't flood the replicas. Results are merged in the order of the
+    // ranges as soon as they arrive, and no more partitions are read once
+    // the limits of the command are reached.
+    struct singular_read {
+        std::vector<::shared_ptr<abstract_read_executor>> exec;
+        size_t next = 0;
+        circular_buffer<future<foreign_ptr<lw_shared_ptr<query::result>>>> in_flight;
+        query::result_merger merger;
+        uint32_t row_count = 0;
+        uint32_t partition_count = 0;
+
+        singular_read(std::vector<::shared_ptr<abstract_read_executor>> e, uint32_t row_limit, uint32_t partition_limit)
+            : exec(std::move(e)), merger(row_limit, partition_limit) {
+            merger.reserve(exec.size());
+        }
+    };
+    auto concurrency = std::max<size_t>(_db.local().get_config().max_concurrent_partition_reads(), 1);
+    auto rs = make_lw_shared<singular_read>(std::move(exec), cmd->row_limit, cmd->partition_limit);
+    auto start_reads = [rs, timeout, concurrency] {
+        while (rs->next < rs->exec.size() && rs->in_flight.size() < concurrency) {
+            rs->in_flight.push_back(rs->exec[rs->next++]->execute(timeout));
+        }
+    };
+    start_reads();
 
-    query::result_merger merger(cmd->row_limit, cmd->partition_limit);
-    merger.reserve(exec.size());
-
-    auto f = ::map_reduce(exec.begin(), exec.end(), [timeout] (::shared_ptr<abstract_read_executor>& rex) {
-        return rex->execute(timeout);
-    }, std::move(merger));
+    auto f = repeat([rs, cmd, start_reads] {
+        if (rs->in_flight.empty()) {
+            return make_ready_future<stop_iteration>(stop_iteration::yes);
+        }
+        auto f = std::move(rs->in_flight.front());
+        rs->in_flight.pop_front();
+        return f.then([rs, cmd, start_reads] (foreign_ptr<lw_shared_ptr<query::result>> result) {
+            if (!result->row_count() || !result->partition_count()) {
+                result->calculate_counts(cmd->slice);
+            }
+            rs->row_count += result->row_count().value();
+            rs->partition_count += result->partition_count().value();
+            auto short_read = result->is_short_read();
+            rs->merger(std::move(result));
+            if (short_read || rs->row_count >= cmd->row_limit || rs->partition_count >= cmd->partition_limit) {
+                return stop_iteration::yes;
+            }
+            start_reads();
+            return stop_iteration::no;
+        });
+    }).then([rs] {
+        return rs->merger.get();
+    });
 
-    return f.handle_exception([exec = std::move(exec), p = shared_from_this()] (std::exception_ptr eptr) {
-        // hold onto exec until read is complete
+    return f.finally([rs] {
+        // Reads started before the limits were reached are not needed.
+        for (auto&& f : rs->in_flight) {
+            std::move(f).then_wrapped([rs] (auto&& f) {
+                f.ignore_ready_future();
+            });
+        }
+        rs->in_flight.clear();
+    }).handle_exception([p = shared_from_this()] (std::exception_ptr eptr) {
         p->handle_read_error(eptr, false);
         return make_exception_future<foreign_ptr<lw_shared_ptr<query::result>>>(eptr);
     });
 }
 
+// Picks the number of ranges to query in parallel in the next round of a
+// range scan, from what the ranges queried so far returned. The round should
+// be enough to fill the rest of the page, but not read much more than fits in
+// a result. Empty ranges double the concurrency, so that scanning a sparse
+// table soon keeps all replicas and their shards busy.
+static int next_concurrency_factor(const std::vector<foreign_ptr<lw_shared_ptr<query::result>>>& results,
+        size_t fetched_ranges, size_t remaining_ranges, int concurrency_factor, uint32_t remaining_row_count) {
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    for (auto&& r : results) {
+        rows += r->row_count().value_or(0);
+        bytes += r->buf().size();
+    }
+    double factor;
+    if (!rows) {
+        factor = 2.0 * concurrency_factor;
+    } else {
+        auto rows_per_range = double(rows) / fetched_ranges;
+        auto bytes_per_range = std::max(double(bytes) / fetched_ranges, 1.0);
+        factor = std::min(std::ceil(remaining_row_count / rows_per_range),
+                std::ceil(query::result_memory_limiter::maximum_result_size / bytes_per_range));
+    }
+    return std::max(1, int(std::min(factor, double(std::max<size_t>(remaining_ranges, 1)))));
+}
+
 future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>
 storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::time_point timeout, std::vector<foreign_ptr<lw_shared_ptr<query::result>>>&& results,
         lw_shared_ptr<query::read_command> cmd, db::consistency_level cl, dht::partition_range_vector::iterator&& i,
@@ -2950,7 +3956,11 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
                     return *boost::range::min_element(range | boost::adaptors::transformed(ep_to_hr));
                 };
                 auto merged = find_min(filtered_merged) * 1.2; // give merged set 20% boost
-                if (merged < find_min(filtered_endpoints) && merged < find_min(next_filtered_endpoints)) {
+                auto current = find_min(filtered_endpoints);
+                auto next = find_min(next_filtered_endpoints);
+                // Nodes which don't report their hit rates (negative) make the comparison
+                // meaningless, like they make filter_for_query() ignore hit rates.
+                if (merged >= 0 && current >= 0 && next >= 0 && merged < current && merged < next) {
                     // if lowest cache hits rate of a merged set is smaller than lowest cache hit
                     // rate of un-merged sets then do not merge. The idea is that we better issue
                     // two different range reads with highest chance of hitting a cache then one read that
@@ -2993,12 +4003,37 @@ storage_proxy::query_partition_key_range_concurrent(storage_proxy::clock_type::t
         }
         remaining_row_count -= result->row_count().value();
         remaining_partition_count -= result->partition_count().value();
+        auto short_read = result->is_short_read();
+        if (!short_read && i != ranges.end() && remaining_row_count && remaining_partition_count
+                && cmd->slice.options.contains<query::partition_slice::option::allow_short_read>()) {
+            // Each replica result is limited in size, but the ranges of a
+            // scan of large rows can add up to much more than that before
+            // the row limit is reached. End the page once the results hold
+            // as much as a single result may, the pager continues from there.
+            size_t bytes = 0;
+            uint32_t rows = 0;
+            for (auto&& r : results) {
+                bytes += r->buf().size();
+                rows += r->row_count().value_or(0);
+            }
+            bytes += result->buf().size();
+            rows += result->row_count().value();
+            if (rows && bytes >= query::result_memory_limiter::maximum_result_size) {
+                tracing::trace(trace_state, "Range scan results reached {} bytes, returning a short page", bytes);
+                result->mark_as_short_read();
+                short_read = query::short_read::yes;
+            }
+        }
         results.emplace_back(std::move(result));
-        if (i == ranges.end() || !remaining_row_count || !remaining_partition_count) {
+        // Ranges after a short read are dropped by result_merger, don't read them.
+        if (i == ranges.end() || !remaining_row_count || !remaining_partition_count || short_read) {
             return make_ready_future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>>(std::move(results));
         } else {
             cmd->row_limit = remaining_row_count;
             cmd->partition_limit = remaining_partition_count;
+            concurrency_factor = next_concurrency_factor(results, std::distance(ranges.begin(), i), std::distance(i, ranges.end()),
+                    concurrency_factor, remaining_row_count);
+            tracing::trace(trace_state, "Querying the next {} ranges in parallel", concurrency_factor);
             return p->query_partition_key_range_concurrent(timeout, std::move(results), cmd, cl, std::move(i),
                     std::move(ranges), concurrency_factor, std::move(trace_state), remaining_row_count, remaining_partition_count);
         }
@@ -3193,6 +4228,161 @@ storage_proxy::do_query(schema_ptr s,
     }
 #endif
 
+// The page size of the queries reading the rows to aggregate, like the one
+// select_statement uses for aggregates.
+static constexpr uint32_t aggregation_page_size = 10000;
+
+static shared_ptr<cql3::functions::aggregate_function>
+merging_function(const schema& s, const query::aggregate_selector& selector) {
+    using namespace cql3::functions;
+    // Counts add up, the other aggregates are merged by the function itself.
+    shared_ptr<function> f;
+    if (!selector.column_name || selector.function_name == "count") {
+        f = functions::find(function_name::native_function("sum"), { long_type });
+    } else {
+        auto def = s.get_column_definition(to_bytes(*selector.column_name));
+        f = functions::find(function_name::native_function(selector.function_name), { def->type });
+    }
+    return dynamic_pointer_cast<aggregate_function>(f);
+}
+
+// Merges the partial aggregates of selectors, computed over disjoint ranges.
+static std::vector<bytes_opt>
+merge_partial_aggregates(const schema& s, const std::vector<query::aggregate_selector>& selectors,
+        const std::vector<std::vector<bytes_opt>>& partials, cql_serialization_format sf) {
+    std::vector<bytes_opt> ret;
+    ret.reserve(selectors.size());
+    for (size_t i = 0; i < selectors.size(); ++i) {
+        auto aggregate = merging_function(s, selectors[i])->new_aggregate();
+        for (auto&& p : partials) {
+            aggregate->add_input(sf, { p[i] });
+        }
+        ret.emplace_back(aggregate->compute(sf));
+    }
+    return ret;
+}
+
+future<std::vector<bytes_opt>>
+storage_proxy::query_aggregates(schema_ptr s,
+        lw_shared_ptr<query::read_command> cmd,
+        std::vector<query::aggregate_selector> selectors,
+        dht::partition_range_vector partition_ranges,
+        db::consistency_level cl,
+        tracing::trace_state_ptr trace_state) {
+    keyspace& ks = _db.local().find_keyspace(s->ks_name());
+    auto my_address = utils::fb_utilities::get_broadcast_address();
+    std::unordered_map<gms::inet_address, dht::partition_range_vector> ranges_per_endpoint;
+
+    if (ks.get_replication_strategy().get_type() == locator::replication_strategy_type::local) {
+        ranges_per_endpoint.emplace(my_address, std::move(partition_ranges));
+    } else {
+        for (auto&& r : partition_ranges) {
+            for (auto&& range : get_restricted_ranges(ks, *s, std::move(r))) {
+                auto endpoints = get_live_sorted_endpoints(ks, end_token(range));
+                if (db::is_datacenter_local(cl)) {
+                    endpoints.erase(boost::range::remove_if(endpoints, std::not1(std::cref(db::is_local))), endpoints.end());
+                }
+                // With no live replica the read fails on this node, with the
+                // usual error.
+                auto ep = endpoints.empty() ? my_address : endpoints.front();
+                ranges_per_endpoint[ep].emplace_back(std::move(range));
+            }
+        }
+    }
+
+    auto timeout = clock_type::now() + std::chrono::milliseconds(_db.local().get_config().range_request_timeout_in_ms());
+    return do_with(std::move(ranges_per_endpoint), std::move(selectors), std::vector<std::vector<bytes_opt>>(),
+            [this, s, cmd, cl, timeout, trace_state = std::move(trace_state)] (auto& ranges_per_endpoint, auto& selectors, auto& partials) {
+        return parallel_for_each(ranges_per_endpoint, [this, s, cmd, cl, timeout, trace_state, &selectors, &partials] (auto& ep_ranges) {
+            auto f = [&] {
+                if (is_me(ep_ranges.first)) {
+                    tracing::trace(trace_state, "Aggregating {} ranges locally", ep_ranges.second.size());
+                    return this->query_aggregates_locally(s, cmd, selectors, std::move(ep_ranges.second), cl, trace_state);
+                }
+                tracing::trace(trace_state, "Sending aggregation of {} ranges to /{}", ep_ranges.second.size(), ep_ranges.first);
+                auto& ms = netw::get_local_messaging_service();
+                return ms.send_aggregate(netw::messaging_service::msg_addr{ep_ranges.first, 0}, timeout, *cmd, selectors, ep_ranges.second, cl);
+            }();
+            return f.then([&partials] (std::vector<bytes_opt> partial) {
+                partials.emplace_back(std::move(partial));
+            });
+        }).then([s, cmd, &selectors, &partials] {
+            return merge_partial_aggregates(*s, selectors, partials, cmd->slice.cql_format());
+        });
+    });
+}
+
+future<std::vector<bytes_opt>>
+storage_proxy::query_aggregates_locally(schema_ptr s,
+        lw_shared_ptr<query::read_command> cmd,
+        const std::vector<query::aggregate_selector>& selectors,
+        dht::partition_range_vector partition_ranges,
+        db::consistency_level cl,
+        tracing::trace_state_ptr trace_state) {
+    // A single pass over the ranges, so that shards which own none of them
+    // are neither scanned for nor sent anything.
+    std::vector<dht::partition_range_vector> ranges_per_shard(smp::count);
+    auto sharder = dht::ring_position_range_vector_sharder(std::move(partition_ranges));
+    for (auto rprs = sharder.next(*s); rprs; rprs = sharder.next(*s)) {
+        ranges_per_shard[rprs->shard].emplace_back(std::move(rprs->ring_range));
+    }
+    return do_with(std::vector<std::vector<bytes_opt>>(), std::move(ranges_per_shard), [s, cmd, &selectors, cl, trace_state] (auto& partials, auto& ranges_per_shard) {
+        return parallel_for_each(boost::irange(0u, smp::count), [&] (unsigned shard) {
+            auto& shard_ranges = ranges_per_shard[shard];
+            if (shard_ranges.empty()) {
+                return make_ready_future<>();
+            }
+            return get_storage_proxy().invoke_on(shard, [gs = global_schema_ptr(s), cmd = *cmd, &selectors, shard_ranges = std::move(shard_ranges), cl,
+                    gt = tracing::global_trace_state_ptr(trace_state)] (storage_proxy& sp) mutable {
+                return sp.query_aggregates_on_shard(gs, make_lw_shared<query::read_command>(std::move(cmd)), selectors, std::move(shard_ranges), cl, gt.get());
+            }).then([&partials] (std::vector<bytes_opt> partial) {
+                partials.emplace_back(std::move(partial));
+            });
+        }).then([s, cmd, &selectors, &partials] {
+            return merge_partial_aggregates(*s, selectors, partials, cmd->slice.cql_format());
+        });
+    });
+}
+
+// Aggregates the rows of partition_ranges by paging through them, like
+// select_statement does for aggregates on the coordinator.
+future<std::vector<bytes_opt>>
+storage_proxy::query_aggregates_on_shard(schema_ptr s,
+        lw_shared_ptr<query::read_command> cmd,
+        const std::vector<query::aggregate_selector>& selectors,
+        dht::partition_range_vector partition_ranges,
+        db::consistency_level cl,
+        tracing::trace_state_ptr trace_state) {
+    std::vector<::shared_ptr<cql3::selection::raw_selector>> raw_selectors;
+    for (auto&& selector : selectors) {
+        std::vector<::shared_ptr<cql3::selection::selectable::raw>> args;
+        if (selector.column_name) {
+            args.emplace_back(::make_shared<cql3::column_identifier::raw>(*selector.column_name, true));
+        }
+        auto name = cql3::functions::function_name::native_function(selector.function_name);
+        raw_selectors.emplace_back(::make_shared<cql3::selection::raw_selector>(
+                ::make_shared<cql3::selection::selectable::with_function::raw>(std::move(name), std::move(args)), nullptr));
+    }
+    auto selection = cql3::selection::selection::from_selectors(_db.local(), s, raw_selectors);
+
+    auto state = make_lw_shared<service::query_state>(service::client_state::for_internal_calls());
+    state->get_trace_state() = std::move(trace_state);
+    auto options = make_lw_shared<cql3::query_options>(cl, std::vector<cql3::raw_value>());
+    cmd->slice.options.set<query::partition_slice::option::allow_short_read>();
+    auto now = cmd->timestamp;
+    auto sf = cmd->slice.cql_format();
+    auto p = service::pager::query_pagers::pager(s, selection, *state, *options, std::move(cmd), std::move(partition_ranges));
+
+    return do_with(cql3::selection::result_set_builder(*selection, now, sf), [p, now, state, options, selection] (auto& builder) {
+        return do_until([p] { return p->is_exhausted(); }, [p, &builder, now] {
+            return p->fetch_page(builder, aggregation_page_size, now);
+        }).then([&builder] {
+            auto rs = builder.build();
+            return rs->rows().front();
+        });
+    });
+}
+
 std::vector<gms::inet_address> storage_proxy::get_live_endpoints(keyspace& ks, const dht::token& token) {
     auto& rs = ks.get_replication_strategy();
     std::vector<gms::inet_address> eps = rs.get_natural_endpoints(token);
@@ -3204,11 +4394,15 @@ std::vector<gms::inet_address> storage_proxy::get_live_endpoints(keyspace& ks, c
 std::vector<gms::inet_address> storage_proxy::get_live_sorted_endpoints(keyspace& ks, const dht::token& token) {
     auto eps = get_live_endpoints(ks, token);
     locator::i_endpoint_snitch::get_local_snitch_ptr()->sort_by_proximity(utils::fb_utilities::get_broadcast_address(), eps);
-    // FIXME: before dynamic snitch is implement put local address (if present) at the beginning
+    // Put local address (if present) at the beginning, unless the dynamic
+    // snitch finds it too slow.
     auto it = boost::range::find(eps, utils::fb_utilities::get_broadcast_address());
     if (it != eps.end() && it != eps.begin()) {
         std::iter_swap(it, eps.begin());
     }
+    if (_dynamic_snitch) {
+        _dynamic_snitch->sort_by_score(eps);
+    }
     return eps;
 }
 
@@ -3362,33 +4556,7 @@ bool storage_proxy::should_hint(gms::inet_address ep) noexcept {
     if (is_me(ep)) { // do not hint to local address
         return false;
     }
-
-    return false;
-#if 0
-    if (DatabaseDescriptor.shouldHintByDC())
-    {
-        final String dc = DatabaseDescriptor.getEndpointSnitch().getDatacenter(ep);
-        //Disable DC specific hints
-        if(!DatabaseDescriptor.hintedHandoffEnabled(dc))
-        {
-            HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-            return false;
-        }
-    }
-    else if (!DatabaseDescriptor.hintedHandoffEnabled())
-    {
-        HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-        return false;
-    }
-
-    boolean hintWindowExpired = Gossiper.instance.getEndpointDowntime(ep) > DatabaseDescriptor.getMaxHintWindow();
-    if (hintWindowExpired)
-    {
-        HintedHandOffManager.instance.metrics.incrPastWindow(ep);
-        Tracing.trace("Not hinting {} which has been down {}ms", ep, Gossiper.instance.getEndpointDowntime(ep));
-    }
-    return !hintWindowExpired;
-#endif
+    return _hints_manager && _hints_manager->can_hint_for(ep);
 }
 
 future<> storage_proxy::truncate_blocking(sstring keyspace, sstring cfname) {
@@ -3602,6 +4770,26 @@ future<> storage_proxy::truncate_blocking(sstring keyspace, sstring cfname) {
     }
 #endif
 
+static void log_failed_mutation(gms::inet_address reply_to, unsigned shard, std::exception_ptr eptr) {
+    seastar::log_level l = seastar::log_level::warn;
+    try {
+        std::rethrow_exception(eptr);
+    } catch (timed_out_error&) {
+        // ignore timeouts so that logs are not flooded.
+        // database total_writes_timedout counter was incremented.
+        l = seastar::log_level::debug;
+    } catch (...) {
+        // ignore
+    }
+    slogger.log(l, "Failed to apply mutation from {}#{}: {}", reply_to, shard, eptr);
+}
+
+// Replicas stop reading once the coordinator's timeout expired. Older
+// coordinators don't send it, so their reads run to completion.
+static storage_proxy::clock_type::time_point replica_read_timeout(rpc::opt_time_point t) {
+    return t.value_or(storage_proxy::clock_type::time_point::max());
+}
+
 void storage_proxy::init_messaging_service() {
     auto& ms = netw::get_local_messaging_service();
     ms.register_counter_mutation([] (const rpc::client_info& cinfo, rpc::opt_time_point t, std::vector<frozen_mutation> fms, db::consistency_level cl, stdx::optional<tracing::trace_info> trace_info) {
@@ -3668,18 +4856,8 @@ void storage_proxy::init_messaging_service() {
                     return ms.send_mutation_done(netw::messaging_service::msg_addr{reply_to, shard}, shard, response_id).then_wrapped([] (future<> f) {
                         f.ignore_ready_future();
                     });
-                }).handle_exception([reply_to, shard, &p] (std::exception_ptr eptr) {
-                    seastar::log_level l = seastar::log_level::warn;
-                    try {
-                        std::rethrow_exception(eptr);
-                    } catch (timed_out_error&) {
-                        // ignore timeouts so that logs are not flooded.
-                        // database total_writes_timedout counter was incremented.
-                        l = seastar::log_level::debug;
-                    } catch (...) {
-                        // ignore
-                    }
-                    slogger.log(l, "Failed to apply mutation from {}#{}: {}", reply_to, shard, eptr);
+                }).handle_exception([reply_to, shard] (std::exception_ptr eptr) {
+                    log_failed_mutation(reply_to, shard, std::move(eptr));
                 }),
                 parallel_for_each(forward.begin(), forward.end(), [reply_to, shard, response_id, &m, &p, trace_state_ptr, timeout] (gms::inet_address forward) {
                     auto& ms = netw::get_local_messaging_service();
@@ -3698,6 +4876,23 @@ void storage_proxy::init_messaging_service() {
             });
         });
     });
+    ms.register_aggregate([] (const rpc::client_info& cinfo, rpc::opt_time_point t, query::read_command cmd, std::vector<query::aggregate_selector> selectors, dht::partition_range_vector ranges, db::consistency_level cl) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        if (cmd.trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*cmd.trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "aggregate: message received from /{}", src_addr.addr);
+        }
+        return do_with(std::move(selectors), get_local_shared_storage_proxy(), [cmd = make_lw_shared<query::read_command>(std::move(cmd)), ranges = std::move(ranges), cl,
+                src_addr = std::move(src_addr), trace_state_ptr = std::move(trace_state_ptr)] (std::vector<query::aggregate_selector>& selectors, shared_ptr<storage_proxy>& p) mutable {
+            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, &selectors, &p, ranges = std::move(ranges), cl, trace_state_ptr] (schema_ptr s) mutable {
+                return p->query_aggregates_locally(std::move(s), cmd, selectors, std::move(ranges), cl, trace_state_ptr);
+            }).finally([trace_state_ptr] {
+                tracing::trace(trace_state_ptr, "aggregate handling is done");
+            });
+        });
+    });
     ms.register_mutation_done([] (const rpc::client_info& cinfo, unsigned shard, storage_proxy::response_id_type response_id) {
         auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         return get_storage_proxy().invoke_on(shard, [from, response_id] (storage_proxy& sp) {
@@ -3705,7 +4900,59 @@ void storage_proxy::init_messaging_service() {
             return netw::messaging_service::no_wait();
         });
     });
-    ms.register_read_data([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda) {
+    ms.register_mutation_batch([] (const rpc::client_info& cinfo, rpc::opt_time_point t, std::vector<frozen_mutation> in, std::vector<storage_proxy::response_id_type> response_ids, gms::inet_address reply_to, unsigned shard) {
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+
+        storage_proxy::clock_type::time_point timeout;
+        if (!t) {
+            auto timeout_in_ms = get_local_shared_storage_proxy()->_db.local().get_config().write_request_timeout_in_ms();
+            timeout = clock_type::now() + std::chrono::milliseconds(timeout_in_ms);
+        } else {
+            timeout = *t;
+        }
+
+        return do_with(std::move(in), std::move(response_ids), std::vector<storage_proxy::response_id_type>(), get_local_shared_storage_proxy(),
+                [src_addr = std::move(src_addr), reply_to, shard, timeout] (const std::vector<frozen_mutation>& mutations, const std::vector<storage_proxy::response_id_type>& response_ids,
+                        std::vector<storage_proxy::response_id_type>& applied, shared_ptr<storage_proxy>& p) {
+            p->_stats.received_mutations += mutations.size();
+            return parallel_for_each(boost::irange<size_t>(0, mutations.size()), [&mutations, &response_ids, &applied, &p, src_addr, reply_to, shard, timeout] (size_t i) {
+                auto& m = mutations[i];
+                // mutate_locally() may throw, putting it into apply() converts exception to a future.
+                return futurize<void>::apply([timeout, &p, &m, src_addr] () mutable {
+                    // FIXME: get_schema_for_write() doesn't timeout
+                    return get_schema_for_write(m.schema_version(), std::move(src_addr)).then([&m, &p, timeout] (schema_ptr s) {
+                        return p->mutate_locally(std::move(s), m, timeout);
+                    });
+                }).then([&applied, &response_ids, i] {
+                    applied.push_back(response_ids[i]);
+                }).handle_exception([reply_to, shard] (std::exception_ptr eptr) {
+                    log_failed_mutation(reply_to, shard, std::move(eptr));
+                });
+            }).then([&applied, reply_to, shard] {
+                if (applied.empty()) {
+                    return make_ready_future<rpc::no_wait_type>(netw::messaging_service::no_wait());
+                }
+                // One acknowledgement for all the mutations applied; the
+                // others time out on the coordinator, as if each had been
+                // sent on its own.
+                auto& ms = netw::get_local_messaging_service();
+                return ms.send_mutation_batch_done(netw::messaging_service::msg_addr{reply_to, shard}, shard, std::move(applied)).then_wrapped([] (future<> f) {
+                    f.ignore_ready_future();
+                    return netw::messaging_service::no_wait();
+                });
+            });
+        });
+    });
+    ms.register_mutation_batch_done([] (const rpc::client_info& cinfo, unsigned shard, std::vector<storage_proxy::response_id_type> response_ids) {
+        auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
+        return get_storage_proxy().invoke_on(shard, [from, response_ids = std::move(response_ids)] (storage_proxy& sp) {
+            for (auto response_id : response_ids) {
+                sp.got_response(response_id, from);
+            }
+            return netw::messaging_service::no_wait();
+        });
+    });
+    ms.register_read_data([] (const rpc::client_info& cinfo, rpc::opt_time_point t, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda) {
         tracing::trace_state_ptr trace_state_ptr;
         auto src_addr = netw::messaging_service::get_source(cinfo);
         if (cmd.trace_info) {
@@ -3715,10 +4962,11 @@ void storage_proxy::init_messaging_service() {
         }
         auto da = oda.value_or(query::digest_algorithm::MD5);
         auto max_size = cinfo.retrieve_auxiliary<uint64_t>("max_result_size");
-        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), da, max_size] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
+        auto timeout = replica_read_timeout(t);
+        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), da, max_size, timeout] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
             p->_stats.replica_data_reads++;
             auto src_ip = src_addr.addr;
-            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, da, &pr, &p, &trace_state_ptr, max_size] (schema_ptr s) {
+            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, da, &pr, &p, &trace_state_ptr, max_size, timeout] (schema_ptr s) {
                 auto pr2 = compat::unwrap(std::move(pr), *s);
                 if (pr2.second) {
                     // this function assumes singular queries but doesn't validate
@@ -3730,16 +4978,17 @@ void storage_proxy::init_messaging_service() {
                     qrr = query::result_request::only_result;
                     break;
                 case query::digest_algorithm::MD5:
+                case query::digest_algorithm::MURMUR3:
                     qrr = query::result_request::result_and_digest;
                     break;
                 }
-                return p->query_singular_local(std::move(s), cmd, std::move(pr2.first), qrr, trace_state_ptr, max_size);
+                return p->query_singular_local(std::move(s), cmd, std::move(pr2.first), qrr, trace_state_ptr, max_size, timeout, da);
             }).finally([&trace_state_ptr, src_ip] () mutable {
                 tracing::trace(trace_state_ptr, "read_data handling is done, sending a response to /{}", src_ip);
             });
         });
     });
-    ms.register_read_mutation_data([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr) {
+    ms.register_read_mutation_data([] (const rpc::client_info& cinfo, rpc::opt_time_point t, query::read_command cmd, compat::wrapping_partition_range pr) {
         tracing::trace_state_ptr trace_state_ptr;
         auto src_addr = netw::messaging_service::get_source(cinfo);
         if (cmd.trace_info) {
@@ -3748,26 +4997,27 @@ void storage_proxy::init_messaging_service() {
             tracing::trace(trace_state_ptr, "read_mutation_data: message received from /{}", src_addr.addr);
         }
         auto max_size = cinfo.retrieve_auxiliary<uint64_t>("max_result_size");
+        auto timeout = replica_read_timeout(t);
         return do_with(std::move(pr),
                        get_local_shared_storage_proxy(),
                        std::move(trace_state_ptr),
                        compat::one_or_two_partition_ranges({}),
-                       [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), max_size] (
+                       [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), max_size, timeout] (
                                compat::wrapping_partition_range& pr,
                                shared_ptr<storage_proxy>& p,
                                tracing::trace_state_ptr& trace_state_ptr,
                                compat::one_or_two_partition_ranges& unwrapped) mutable {
             p->_stats.replica_mutation_data_reads++;
             auto src_ip = src_addr.addr;
-            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, &pr, &p, &trace_state_ptr, max_size, &unwrapped] (schema_ptr s) mutable {
+            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, &pr, &p, &trace_state_ptr, max_size, &unwrapped, timeout] (schema_ptr s) mutable {
                 unwrapped = compat::unwrap(std::move(pr), *s);
-                return p->query_mutations_locally(std::move(s), std::move(cmd), unwrapped, trace_state_ptr, max_size);
+                return p->query_mutations_locally(std::move(s), std::move(cmd), unwrapped, trace_state_ptr, max_size, timeout);
             }).finally([&trace_state_ptr, src_ip] () mutable {
                 tracing::trace(trace_state_ptr, "read_mutation_data handling is done, sending a response to /{}", src_ip);
             });
         });
     });
-    ms.register_read_digest([] (const rpc::client_info& cinfo, query::read_command cmd, compat::wrapping_partition_range pr) {
+    ms.register_read_digest([] (const rpc::client_info& cinfo, rpc::opt_time_point t, query::read_command cmd, compat::wrapping_partition_range pr, rpc::optional<query::digest_algorithm> oda) {
         tracing::trace_state_ptr trace_state_ptr;
         auto src_addr = netw::messaging_service::get_source(cinfo);
         if (cmd.trace_info) {
@@ -3775,22 +5025,54 @@ void storage_proxy::init_messaging_service() {
             tracing::begin(trace_state_ptr);
             tracing::trace(trace_state_ptr, "read_digest: message received from /{}", src_addr.addr);
         }
+        auto da = oda.value_or(query::digest_algorithm::MD5);
         auto max_size = cinfo.retrieve_auxiliary<uint64_t>("max_result_size");
-        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), max_size] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
+        auto timeout = replica_read_timeout(t);
+        return do_with(std::move(pr), get_local_shared_storage_proxy(), std::move(trace_state_ptr), [&cinfo, cmd = make_lw_shared<query::read_command>(std::move(cmd)), src_addr = std::move(src_addr), da, max_size, timeout] (compat::wrapping_partition_range& pr, shared_ptr<storage_proxy>& p, tracing::trace_state_ptr& trace_state_ptr) mutable {
             p->_stats.replica_digest_reads++;
             auto src_ip = src_addr.addr;
-            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, &pr, &p, &trace_state_ptr, max_size] (schema_ptr s) {
+            return get_schema_for_read(cmd->schema_version, std::move(src_addr)).then([cmd, da, &pr, &p, &trace_state_ptr, max_size, timeout] (schema_ptr s) {
                 auto pr2 = compat::unwrap(std::move(pr), *s);
                 if (pr2.second) {
                     // this function assumes singular queries but doesn't validate
                     throw std::runtime_error("READ_DIGEST called with wrapping range");
                 }
-                return p->query_singular_local_digest(std::move(s), cmd, std::move(pr2.first), trace_state_ptr, max_size);
+                return p->query_singular_local_digest(std::move(s), cmd, std::move(pr2.first), trace_state_ptr, max_size, timeout, da);
             }).finally([&trace_state_ptr, src_ip] () mutable {
                 tracing::trace(trace_state_ptr, "read_digest handling is done, sending a response to /{}", src_ip);
             });
         });
     });
+    ms.register_paxos_prepare([] (const rpc::client_info& cinfo, rpc::opt_time_point t, query::read_command cmd, partition_key key, utils::UUID ballot) {
+        tracing::trace_state_ptr trace_state_ptr;
+        auto src_addr = netw::messaging_service::get_source(cinfo);
+        if (cmd.trace_info) {
+            trace_state_ptr = tracing::tracing::get_local_tracing_instance().create_session(*cmd.trace_info);
+            tracing::begin(trace_state_ptr);
+            tracing::trace(trace_state_ptr, "paxos_prepare: message received from /{}", src_addr.addr);
+        }
+        auto timeout = t.value_or(clock_type::time_point::max());
+        auto schema_version = cmd.schema_version;
+        return get_schema_for_read(schema_version, std::move(src_addr)).then([cmd = std::move(cmd), key = std::move(key), ballot, timeout,
+                trace_state_ptr = std::move(trace_state_ptr)] (schema_ptr s) mutable {
+            auto token = dht::global_partitioner().get_token(*s, key);
+            return get_local_storage_proxy().paxos_prepare_on_shard(std::move(s), cmd, std::move(key), token, ballot, timeout, std::move(trace_state_ptr));
+        });
+    });
+    ms.register_paxos_accept([] (const rpc::client_info& cinfo, rpc::opt_time_point t, paxos::proposal proposal) {
+        auto timeout = t.value_or(clock_type::time_point::max());
+        auto& sp = get_local_storage_proxy();
+        auto s = sp._db.local().find_schema(proposal.update.column_family_id());
+        auto token = proposal.update.to_mutation(s).token();
+        return sp.paxos_accept_on_shard(std::move(s), token, std::move(proposal), timeout, nullptr);
+    });
+    ms.register_paxos_learn([] (const rpc::client_info& cinfo, rpc::opt_time_point t, paxos::proposal decision) {
+        auto timeout = t.value_or(clock_type::time_point::max());
+        auto& sp = get_local_storage_proxy();
+        auto s = sp._db.local().find_schema(decision.update.column_family_id());
+        auto token = decision.update.to_mutation(s).token();
+        return sp.paxos_learn_on_shard(std::move(s), token, std::move(decision), timeout, nullptr);
+    });
     ms.register_truncate([](sstring ksname, sstring cfname) {
         return do_with(utils::make_joinpoint([] { return db_clock::now();}),
                         [ksname, cfname](auto& tsf) {
@@ -3812,9 +5094,15 @@ void storage_proxy::uninit_messaging_service() {
     auto& ms = netw::get_local_messaging_service();
     ms.unregister_mutation();
     ms.unregister_mutation_done();
+    ms.unregister_mutation_batch();
+    ms.unregister_mutation_batch_done();
+    ms.unregister_aggregate();
     ms.unregister_read_data();
     ms.unregister_read_mutation_data();
     ms.unregister_read_digest();
+    ms.unregister_paxos_prepare();
+    ms.unregister_paxos_accept();
+    ms.unregister_paxos_learn();
     ms.unregister_truncate();
 }
 
@@ -3992,67 +5280,35 @@ class mutation_result_merger {
 
 future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature>
 storage_proxy::query_mutations_locally(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr,
-                                       tracing::trace_state_ptr trace_state, uint64_t max_size) {
+                                       tracing::trace_state_ptr trace_state, uint64_t max_size, clock_type::time_point timeout) {
     if (pr.is_singular()) {
         unsigned shard = _db.local().shard_of(pr.start()->value().token());
-        return _db.invoke_on(shard, [max_size, cmd, &pr, gs=global_schema_ptr(s), gt = tracing::global_trace_state_ptr(std::move(trace_state))] (database& db) mutable {
-          return db.get_result_memory_limiter().new_mutation_read(max_size).then([&] (query::result_memory_accounter ma) {
-            return db.query_mutations(gs, *cmd, pr, std::move(ma), gt).then([] (reconcilable_result&& result, cache_temperature ht) {
+        return _db.invoke_on(shard, [max_size, cmd, &pr, gs=global_schema_ptr(s), gt = tracing::global_trace_state_ptr(std::move(trace_state)), timeout] (database& db) mutable {
+          return db.get_result_memory_limiter().new_mutation_read(max_size).then([&, timeout] (query::result_memory_accounter ma) {
+            return db.query_mutations(gs, *cmd, pr, std::move(ma), gt, timeout).then([] (reconcilable_result&& result, cache_temperature ht) {
                 return make_ready_future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature>(make_foreign(make_lw_shared(std::move(result))), ht);
             });
           });
         });
     } else {
-        return query_nonsingular_mutations_locally(std::move(s), std::move(cmd), {pr}, std::move(trace_state), max_size);
+        return query_nonsingular_mutations_locally(std::move(s), std::move(cmd), {pr}, std::move(trace_state), max_size, timeout);
     }
 }
 
 future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature>
 storage_proxy::query_mutations_locally(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const compat::one_or_two_partition_ranges& pr,
-                                       tracing::trace_state_ptr trace_state, uint64_t max_size) {
+                                       tracing::trace_state_ptr trace_state, uint64_t max_size, clock_type::time_point timeout) {
     if (!pr.second) {
-        return query_mutations_locally(std::move(s), std::move(cmd), pr.first, std::move(trace_state), max_size);
+        return query_mutations_locally(std::move(s), std::move(cmd), pr.first, std::move(trace_state), max_size, timeout);
     } else {
-        return query_nonsingular_mutations_locally(std::move(s), std::move(cmd), pr, std::move(trace_state), max_size);
+        return query_nonsingular_mutations_locally(std::move(s), std::move(cmd), pr, std::move(trace_state), max_size, timeout);
     }
 }
 
-}
-
-namespace {
-
-struct element_and_shard {
-    unsigned element;   // element in a partition range vector
-    unsigned shard;
-};
-
-bool operator==(element_and_shard a, element_and_shard b) {
-    return a.element == b.element && a.shard == b.shard;
-}
-
-}
-
-namespace std {
-
-template <>
-struct hash<element_and_shard> {
-    size_t operator()(element_and_shard es) const {
-        return es.element * 31 + es.shard;
-    }
-};
-
-}
-
-namespace service {
-
-struct partition_range_and_sort_key {
-    query::partition_range pr;
-    unsigned sort_key_shard_order;   // for the same source partition range, we sort in shard order
-};
-
 future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature>
 storage_proxy::query_nonsingular_mutations_locally(schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range_vector& prs,
-                                                   tracing::trace_state_ptr trace_state, uint64_t max_size) {
+                                                   tracing::trace_state_ptr trace_state, uint64_t max_size,
+                                                   clock_type::time_point timeout) {
     // no one permitted us to modify *cmd, so make a copy
     auto shard_cmd = make_lw_shared<query::read_command>(*cmd);
     return do_with(cmd,
@@ -4060,18 +5316,18 @@ storage_proxy::query_nonsingular_mutations_locally(schema_ptr s, lw_shared_ptr<q
             0u,
             false,
             static_cast<unsigned>(prs.size()),
-            std::unordered_map<element_and_shard, partition_range_and_sort_key>{},
+            stdx::optional<dht::ring_position_exponential_vector_sharder_result>{},
             mutation_result_merger{s, cmd},
             dht::ring_position_exponential_vector_sharder{prs},
             global_schema_ptr(s),
             tracing::global_trace_state_ptr(std::move(trace_state)),
             cache_temperature(0.0f),
-            [this, s, max_size] (lw_shared_ptr<query::read_command>& cmd,
+            [this, s, max_size, timeout] (lw_shared_ptr<query::read_command>& cmd,
                     lw_shared_ptr<query::read_command>& shard_cmd,
                     unsigned& mutation_result_merger_key,
                     bool& no_more_ranges,
                     unsigned& partition_range_count,
-                    std::unordered_map<element_and_shard, partition_range_and_sort_key>& shards_for_this_iteration,
+                    stdx::optional<dht::ring_position_exponential_vector_sharder_result>& this_iteration_subranges,
                     mutation_result_merger& mrm,
                     dht::ring_position_exponential_vector_sharder& rpevs,
                     global_schema_ptr& gs,
@@ -4088,21 +5344,25 @@ storage_proxy::query_nonsingular_mutations_locally(schema_ptr s, lw_shared_ptr<q
             //
             // We use the ring_position_exponential_vector_sharder to give us subranges that follow
             // this scheme.
-            shards_for_this_iteration.clear();
+            //
+            // The sharder only returns the shards which own a part of the ranges, each at most
+            // once per iteration, and all from the same element of prs, so its result can be
+            // dispatched as is, the position of a subrange within it being its shard order.
+            //
             // If we're reading from less than smp::count shards, then we can just append
             // each shard in order without sorting.  If we're reading from more, then
             // we'll read from some shards at least twice, so the partitions within will be
             // out-of-order wrt. other shards
-            auto this_iteration_subranges = rpevs.next(*s);
+            this_iteration_subranges = rpevs.next(*s);
             auto retain_shard_order = true;
+            auto elem = 0u;
+            auto subrange_count = 0u;
             no_more_ranges = true;
             if (this_iteration_subranges) {
                 no_more_ranges = false;
                 retain_shard_order = this_iteration_subranges->inorder;
-                auto sort_key = 0u;
-                for (auto&& now : this_iteration_subranges->per_shard_ranges) {
-                    shards_for_this_iteration.emplace(element_and_shard{this_iteration_subranges->element, now.shard}, partition_range_and_sort_key{now.ring_range, sort_key++});
-                }
+                elem = this_iteration_subranges->element;
+                subrange_count = this_iteration_subranges->per_shard_ranges.size();
             }
 
             auto key_base = mutation_result_merger_key;
@@ -4115,14 +5375,12 @@ storage_proxy::query_nonsingular_mutations_locally(schema_ptr s, lw_shared_ptr<q
             shard_cmd->partition_limit = cmd->partition_limit - mrm.partition_count();
             shard_cmd->row_limit = cmd->row_limit - mrm.row_count();
 
-            return parallel_for_each(shards_for_this_iteration, [&, key_base, retain_shard_order] (const std::pair<const element_and_shard, partition_range_and_sort_key>& elem_shard_range) {
-                auto&& elem = elem_shard_range.first.element;
-                auto&& shard = elem_shard_range.first.shard;
-                auto&& range = elem_shard_range.second.pr;
-                auto sort_key_shard_order = elem_shard_range.second.sort_key_shard_order;
-                return _db.invoke_on(shard, [&, range, gt, fstate = mrm.memory().state_for_another_shard()] (database& db) {
+            return parallel_for_each(boost::irange(0u, subrange_count), [&, key_base, retain_shard_order, elem] (unsigned sort_key_shard_order) {
+                auto&& shard = this_iteration_subranges->per_shard_ranges[sort_key_shard_order].shard;
+                auto&& range = this_iteration_subranges->per_shard_ranges[sort_key_shard_order].ring_range;
+                return _db.invoke_on(shard, [&, gt, fstate = mrm.memory().state_for_another_shard(), timeout] (database& db) {
                     query::result_memory_accounter accounter(db.get_result_memory_limiter(), std::move(fstate));
-                    return db.query_mutations(gs, *shard_cmd, range, std::move(accounter), std::move(gt)).then([&hit_rate] (reconcilable_result&& rr, cache_temperature ht) {
+                    return db.query_mutations(gs, *shard_cmd, range, std::move(accounter), std::move(gt), timeout).then([&hit_rate] (reconcilable_result&& rr, cache_temperature ht) {
                         hit_rate = ht;
                         return make_foreign(make_lw_shared(std::move(rr)));
                     });
@@ -4154,7 +5412,17 @@ storage_proxy::query_nonsingular_mutations_locally(schema_ptr s, lw_shared_ptr<q
 future<>
 storage_proxy::stop() {
     uninit_messaging_service();
-    return make_ready_future<>();
+    _counter_coalescing_timer.cancel();
+    flush_counter_updates();
+    return when_all(_cross_shard_gate.close(), _mutation_batches_gate.close(), _read_repair_gate.close(),
+            _counter_coalescing_gate.close()).then([this] (auto) {
+        return _hints_manager ? _hints_manager->stop() : make_ready_future<>();
+    });
+}
+
+future<>
+storage_proxy::start_hints_manager() {
+    return _hints_manager ? _hints_manager->start() : make_ready_future<>();
 }
 
 }
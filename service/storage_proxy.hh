@@ -53,6 +53,12 @@
 #include "tracing/trace_state.hh"
 #include <seastar/core/metrics.hh>
 #include "frozen_mutation.hh"
+#include "schema_registry.hh"
+#include "core/gate.hh"
+#include "db/hints/manager.hh"
+#include "locator/dynamic_snitch.hh"
+#include "service/coordinator_result_cache.hh"
+#include "service/paxos/proposal.hh"
 
 namespace compat {
 
@@ -66,6 +72,10 @@ class abstract_write_response_handler;
 class abstract_read_executor;
 class mutation_holder;
 
+namespace paxos {
+class cas_request;
+}
+
 class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*implements StorageProxyMBean*/ {
 public:
     using clock_type = lowres_clock;
@@ -154,16 +164,46 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         uint64_t read_repair_repaired_background = 0;
         uint64_t global_read_repairs_canceled_due_to_concurrent_write = 0;
 
+        // read repairs the client didn't wait for, in background_read_repair
+        // mode: those ever queued, those currently queued or being written,
+        // and those dropped because the queue was full, or which failed
+        uint64_t deferred_read_repairs = 0;
+        uint64_t queued_read_repairs = 0;
+        uint64_t dropped_read_repairs = 0;
+        uint64_t failed_read_repairs = 0;
+
         // number of mutations received as a coordinator
         uint64_t received_mutations = 0;
 
         // number of counter updates received as a leader
         uint64_t received_counter_updates = 0;
 
+        // number of counter updates combined with others by this coordinator,
+        // and of the updates they were combined into
+        uint64_t coalesced_counter_updates = 0;
+        uint64_t combined_counter_updates = 0;
+
         // number of forwarded mutations
         uint64_t forwarded_mutations = 0;
         uint64_t forwarding_errors = 0;
 
+        // number of mutations applied on another shard of this node, and of
+        // the batches they were sent in
+        uint64_t cross_shard_mutations = 0;
+        uint64_t cross_shard_mutation_batches = 0;
+
+        // number of mutations sent to replicas in a MUTATION_BATCH, and of
+        // those messages
+        uint64_t batched_mutations = 0;
+        uint64_t mutation_batches = 0;
+
+        // number of lightweight transactions coordinated, of their Paxos
+        // rounds retried because of contention, and of those whose
+        // conditions didn't hold
+        uint64_t cas_operations = 0;
+        uint64_t cas_contentions = 0;
+        uint64_t cas_not_applied = 0;
+
         // number of read requests received as a replica
         uint64_t replica_data_reads = 0;
         uint64_t replica_digest_reads = 0;
@@ -175,6 +215,8 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         utils::estimated_histogram estimated_read;
         utils::estimated_histogram estimated_write;
         utils::estimated_histogram estimated_range;
+        // Partitions read by each single partition query, more than one with IN.
+        utils::estimated_histogram partitions_per_read;
         uint64_t writes = 0;
         uint64_t background_writes = 0; // client no longer waits for the write
         uint64_t background_write_bytes = 0;
@@ -182,7 +224,10 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         uint64_t reads = 0;
         uint64_t background_reads = 0; // client no longer waits for the read
         uint64_t read_retries = 0; // read is retried with new limit
+        uint64_t speculative_reads = 0; // requests sent to an extra replica after a delay
+        uint64_t wasted_speculative_reads = 0; // speculative requests the read completed without
         uint64_t throttled_writes = 0; // total number of writes ever delayed due to throttling
+        uint64_t view_update_delayed_writes = 0; // total number of writes delayed for the view update backlog
 
         // Data read attempts
         split_stats data_read_attempts;
@@ -215,16 +260,112 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     // just skip an entry if request no longer exists.
     circular_buffer<response_id_type> _throttled_writes;
     constexpr static size_t _max_hints_in_progress = 128; // origin multiplies by FBUtilities.getAvailableProcessors() but we already sharded
-    size_t _total_hints_in_progress = 0;
-    std::unordered_map<gms::inet_address, size_t> _hints_in_progress;
+    // Disengaged if hinted handoff is disabled.
+    std::experimental::optional<db::hints::manager> _hints_manager;
+    // Disengaged if the dynamic snitch is disabled.
+    std::experimental::optional<locator::dynamic_snitch> _dynamic_snitch;
+    coordinator_result_cache _result_cache;
     stats _stats;
     static constexpr float CONCURRENT_SUBREQUESTS_MARGIN = 0.10;
     // for read repair chance calculation
     std::default_random_engine _urandom;
     std::uniform_real_distribution<> _read_repair_chance = std::uniform_real_distribution<>(0,1);
     seastar::metrics::metric_groups _metrics;
+
+    // Mutations to be applied on other shards wait here, per shard, until the
+    // tasks ready in the current poll period have run, and are then sent to
+    // their shard in one message.
+    struct cross_shard_mutation {
+        // Of this shard, made global for the target one when the batch is
+        // sent, once for each schema.
+        schema_ptr schema;
+        // Kept alive by the caller until the mutation is applied.
+        const frozen_mutation* fm;
+        clock_type::time_point timeout;
+    };
+    struct cross_shard_batch {
+        std::vector<cross_shard_mutation> mutations;
+        std::vector<promise<>> promises;
+    };
+    std::vector<cross_shard_batch> _cross_shard_batches;
+    bool _cross_shard_flush_scheduled = false;
+    seastar::gate _cross_shard_gate;
+
+    // Mutations to be sent to a replica wait here until the tasks ready in
+    // the current poll period have run, or until they reach
+    // mutation_batch_size_in_kb, and are then sent in one MUTATION_BATCH.
+    // Each keeps its own response handler, whose id is sent along.
+    struct mutation_batch {
+        std::vector<frozen_mutation> mutations;
+        std::vector<response_id_type> response_ids;
+        std::vector<promise<>> promises;
+        size_t size = 0;
+        clock_type::time_point timeout = clock_type::time_point::min();
+    };
+    std::unordered_map<gms::inet_address, mutation_batch> _mutation_batches;
+    bool _mutation_batches_flush_scheduled = false;
+    seastar::gate _mutation_batches_gate;
+
+    // With counter_update_coalescing_window_in_us set, counter updates wait
+    // here for the window to end. The updates of the same partition and
+    // consistency level are applied to each other, which sums their deltas,
+    // and their writers share the outcome of the combined update.
+    struct pending_counter_update {
+        mutation m;
+        std::vector<promise<>> waiters;
+    };
+    struct pending_counter_updates {
+        schema_ptr s;
+        db::consistency_level cl;
+        std::unordered_map<partition_key, pending_counter_update, partition_key::hashing, partition_key::equality> partitions;
+
+        pending_counter_updates(schema_ptr schema, db::consistency_level cl)
+            : s(std::move(schema)), cl(cl), partitions(8, partition_key::hashing(*s), partition_key::equality(*s)) { }
+    };
+    std::vector<pending_counter_updates> _pending_counter_updates;
+    timer<clock_type> _counter_coalescing_timer;
+    seastar::gate _counter_coalescing_gate;
+
+    // In background_read_repair mode reads reply before the repairing
+    // mutations are written, which wait here for one of
+    // background_read_repair_concurrency units. At most
+    // background_read_repair_queue_size wait, further ones are dropped.
+    bool _background_read_repair;
+    size_t _max_queued_read_repairs;
+    semaphore _read_repair_sem;
+    seastar::gate _read_repair_gate;
+
+    // The view updates generated on this shard and not yet applied by their
+    // view replicas hold units of _view_update_backlog_sem, whose count is
+    // consumed rather than waited for. Writes to base tables are acknowledged
+    // with a delay growing with the backlog, so that clients are slowed down
+    // to the rate at which the view updates complete.
+    size_t _max_view_update_backlog;
+    semaphore _view_update_backlog_sem;
+    static constexpr std::chrono::milliseconds max_view_update_delay{1000};
+
+    // The time of the last ballot this shard made for a Paxos round, in
+    // microseconds, so that its ballots keep increasing.
+    int64_t _last_ballot_micros = 0;
+
+    // The replicas a lightweight transaction on a partition runs its Paxos
+    // rounds with, and the number of them which make a quorum.
+    struct paxos_participants {
+        std::vector<gms::inet_address> live_endpoints;
+        size_t required;
+    };
 private:
     void uninit_messaging_service();
+    future<> apply_on_shard(unsigned shard, const schema_ptr& s, const frozen_mutation& m, clock_type::time_point timeout);
+    void flush_cross_shard_mutations();
+    future<> send_cross_shard_batch(unsigned shard, cross_shard_batch batch);
+    bool can_batch_mutation(const std::vector<gms::inet_address>& forward, const tracing::trace_state_ptr& tr_state) const;
+    future<> send_batched_mutation(gms::inet_address ep, clock_type::time_point timeout, const frozen_mutation& m, response_id_type response_id);
+    void flush_mutation_batches();
+    void flush_mutation_batch(gms::inet_address ep);
+    void send_queued_mutation_batch(gms::inet_address ep, mutation_batch& batch);
+    future<> send_mutation_batch(gms::inet_address ep, mutation_batch batch);
+    future<> mutate_begin_batched(std::vector<unique_response_handler> ids, gms::inet_address target);
     future<foreign_ptr<lw_shared_ptr<query::result>>> query_singular(lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector&& partition_ranges, db::consistency_level cl, tracing::trace_state_ptr trace_state);
     response_id_type register_response_handler(shared_ptr<abstract_write_response_handler>&& h);
     void remove_response_handler(response_id_type id);
@@ -250,11 +391,18 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     future<foreign_ptr<lw_shared_ptr<query::result>>, cache_temperature> query_singular_local(schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr,
                                                                            query::result_request request,
                                                                            tracing::trace_state_ptr trace_state,
-                                                                           uint64_t max_size = query::result_memory_limiter::maximum_result_size);
+                                                                           uint64_t max_size = query::result_memory_limiter::maximum_result_size,
+                                                                           clock_type::time_point timeout = clock_type::time_point::max(),
+                                                                           query::digest_algorithm da = query::digest_algorithm::MD5);
     future<query::result_digest, api::timestamp_type, cache_temperature> query_singular_local_digest(schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range& pr, tracing::trace_state_ptr trace_state,
-                                                                                  uint64_t max_size  = query::result_memory_limiter::maximum_result_size);
+                                                                                  uint64_t max_size  = query::result_memory_limiter::maximum_result_size,
+                                                                                  clock_type::time_point timeout = clock_type::time_point::max(),
+                                                                                  query::digest_algorithm da = query::digest_algorithm::MD5);
     future<foreign_ptr<lw_shared_ptr<query::result>>> query_partition_key_range(lw_shared_ptr<query::read_command> cmd, dht::partition_range_vector partition_ranges, db::consistency_level cl, tracing::trace_state_ptr trace_state);
     dht::partition_range_vector get_restricted_ranges(keyspace& ks, const schema& s, dht::partition_range range);
+    future<std::vector<bytes_opt>> query_aggregates_on_shard(schema_ptr, lw_shared_ptr<query::read_command> cmd,
+            const std::vector<query::aggregate_selector>& selectors, dht::partition_range_vector partition_ranges,
+            db::consistency_level cl, tracing::trace_state_ptr trace_state);
     float estimate_result_rows_per_range(lw_shared_ptr<query::read_command> cmd, keyspace& ks);
     static std::vector<gms::inet_address> intersection(const std::vector<gms::inet_address>& l1, const std::vector<gms::inet_address>& l2);
     future<std::vector<foreign_ptr<lw_shared_ptr<query::result>>>> query_partition_key_range_concurrent(clock_type::time_point timeout,
@@ -273,13 +421,16 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     future<> mutate_begin(std::vector<unique_response_handler> ids, db::consistency_level cl, stdx::optional<clock_type::time_point> timeout_opt = { });
     future<> mutate_end(future<> mutate_result, utils::latency_counter, tracing::trace_state_ptr trace_state);
     future<> schedule_repair(std::unordered_map<dht::token, std::unordered_map<gms::inet_address, std::experimental::optional<mutation>>> diffs, db::consistency_level cl, tracing::trace_state_ptr trace_state);
+    void schedule_background_repair(std::unordered_map<dht::token, std::unordered_map<gms::inet_address, std::experimental::optional<mutation>>> diffs, db::consistency_level cl, tracing::trace_state_ptr trace_state);
     bool need_throttle_writes() const;
     void unthrottle();
+    std::chrono::microseconds view_update_delay(const schema_ptr& s) const;
     void handle_read_error(std::exception_ptr eptr, bool range);
     template<typename Range>
     future<> mutate_internal(Range mutations, db::consistency_level cl, bool counter_write, tracing::trace_state_ptr tr_state, stdx::optional<clock_type::time_point> timeout_opt = { });
     future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> query_nonsingular_mutations_locally(
-            schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range_vector& pr, tracing::trace_state_ptr trace_state, uint64_t max_size);
+            schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range_vector& pr, tracing::trace_state_ptr trace_state, uint64_t max_size,
+            clock_type::time_point timeout);
 
     struct frozen_mutation_and_schema {
         frozen_mutation fm;
@@ -291,9 +442,34 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
                                                     tracing::trace_state_ptr trace_state);
 
     gms::inet_address find_leader_for_counter_update(const mutation& m, db::consistency_level cl);
+    template<typename Range>
+    future<> send_counter_updates(Range&& mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state);
+    template<typename Range>
+    future<> coalesce_counter_updates(Range&& mutations, db::consistency_level cl);
+    void flush_counter_updates();
 
     future<> do_mutate(std::vector<mutation> mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state, bool);
     friend class mutate_executor;
+
+    paxos_participants get_paxos_participants(const schema& s, const dht::token& token, db::consistency_level cl_for_paxos);
+    // A ballot later than any this shard made, and than min_ballot.
+    utils::UUID new_paxos_ballot(const utils::UUID& min_ballot);
+    // The phases of the Paxos rounds on this node, run on the shard which
+    // owns the partition.
+    future<paxos::prepare_response> paxos_prepare_on_shard(schema_ptr s, const query::read_command& cmd, partition_key key, const dht::token& token,
+            utils::UUID ballot, clock_type::time_point timeout, tracing::trace_state_ptr tr_state);
+    future<bool> paxos_accept_on_shard(schema_ptr s, const dht::token& token, paxos::proposal p, clock_type::time_point timeout,
+            tracing::trace_state_ptr tr_state);
+    future<> paxos_learn_on_shard(schema_ptr s, const dht::token& token, paxos::proposal decision, clock_type::time_point timeout,
+            tracing::trace_state_ptr tr_state);
+    friend class cas_coordinator;
+
+    using partition_id = std::pair<utils::UUID, dht::token>;
+    // The partitions the mutations write to which coordinators may have
+    // results of in their result caches.
+    static std::vector<partition_id> cached_partitions(const std::vector<mutation>& mutations);
+    // Drops the cached results of the partitions on all shards.
+    future<> invalidate_result_cache(std::vector<partition_id> partitions);
 public:
     storage_proxy(distributed<database>& db);
     ~storage_proxy();
@@ -302,6 +478,16 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     }
 
     void init_messaging_service();
+    future<> start_hints_manager();
+
+    coordinator_result_cache& result_cache() {
+        return _result_cache;
+    }
+
+    // nullptr if hinted handoff is disabled.
+    db::hints::manager* hints_manager() {
+        return _hints_manager ? &*_hints_manager : nullptr;
+    }
 
     // Applies mutation on this node.
     // Resolves with timed_out_error when timeout is reached.
@@ -348,12 +534,45 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
     */
     future<> mutate_atomically(std::vector<mutation> mutations, db::consistency_level cl, tracing::trace_state_ptr tr_state);
 
+    /**
+    * Applies the update of a conditional request to a partition, as a
+    * lightweight transaction: only if its conditions hold on the data of the
+    * partition read with cmd, and linearizably with the other ones on it.
+    *
+    * A Paxos round takes two round trips to a quorum of the replicas: the
+    * prepare of its ballot, which also reads the data, and the accept of the
+    * update. The decision is then sent to all replicas without waiting for
+    * them, to be applied before they handle the next round on the partition,
+    * so non-serial reads may not see it for a short while.
+    *
+    * @param cl_for_paxos SERIAL or LOCAL_SERIAL
+    * @return whether the update was applied
+    */
+    future<bool> cas(schema_ptr s, shared_ptr<paxos::cas_request> request, lw_shared_ptr<query::read_command> cmd, partition_key key,
+            db::consistency_level cl_for_paxos, tracing::trace_state_ptr tr_state);
+
     // Send a mutation to one specific remote target.
     // Inspired by Cassandra's StorageProxy.sendToHintedEndpoints but without
     // hinted handoff support, and just one target. See also
     // send_to_live_endpoints() - another take on the same original function.
     future<> send_to_endpoint(mutation m, gms::inet_address target, db::write_type type);
 
+    // Like above, but for several mutations, which are sent to a remote
+    // target together in a single MUTATION_BATCH when the cluster supports it.
+    future<> send_to_endpoint(std::vector<mutation> mutations, gms::inet_address target, db::write_type type);
+
+    // Accounts for size bytes of view updates in the view update backlog
+    // until the returned units are destroyed.
+    semaphore_units<> track_view_update(size_t size);
+    // The bytes of view updates sent by this shard and not yet applied.
+    size_t view_update_backlog() const {
+        return _max_view_update_backlog - _view_update_backlog_sem.available_units();
+    }
+    // The backlog at which base table writes are delayed the most.
+    size_t max_view_update_backlog() const {
+        return _max_view_update_backlog;
+    }
+
     /**
      * Performs the truncate operatoin, which effectively deletes all data from
      * the column family cfname
@@ -377,21 +596,49 @@ class storage_proxy : public seastar::async_sharded_service<storage_proxy> /*imp
         db::consistency_level cl,
         tracing::trace_state_ptr trace_state);
 
+    /*
+     * Computes the aggregates of selectors over partition_ranges, returning
+     * their values in the order of selectors.
+     *
+     * Instead of bringing all rows to the coordinator, each range is
+     * aggregated by the closest live replica owning it, which reads it at
+     * the requested consistency level and sends back only the partial
+     * aggregates, merged here.
+     */
+    future<std::vector<bytes_opt>> query_aggregates(schema_ptr,
+        lw_shared_ptr<query::read_command> cmd,
+        std::vector<query::aggregate_selector> selectors,
+        dht::partition_range_vector partition_ranges,
+        db::consistency_level cl,
+        tracing::trace_state_ptr trace_state);
+
+    // Computes the aggregates of selectors over partition_ranges on this
+    // node, on all shards in parallel, each aggregating the data it owns.
+    future<std::vector<bytes_opt>> query_aggregates_locally(schema_ptr,
+        lw_shared_ptr<query::read_command> cmd,
+        const std::vector<query::aggregate_selector>& selectors,
+        dht::partition_range_vector partition_ranges,
+        db::consistency_level cl,
+        tracing::trace_state_ptr trace_state);
+
     future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> query_mutations_locally(
         schema_ptr, lw_shared_ptr<query::read_command> cmd, const dht::partition_range&,
         tracing::trace_state_ptr trace_state = nullptr,
-        uint64_t max_size = query::result_memory_limiter::maximum_result_size);
+        uint64_t max_size = query::result_memory_limiter::maximum_result_size,
+        clock_type::time_point timeout = clock_type::time_point::max());
 
 
     future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> query_mutations_locally(
         schema_ptr, lw_shared_ptr<query::read_command> cmd, const compat::one_or_two_partition_ranges&,
         tracing::trace_state_ptr trace_state = nullptr,
-        uint64_t max_size = query::result_memory_limiter::maximum_result_size);
+        uint64_t max_size = query::result_memory_limiter::maximum_result_size,
+        clock_type::time_point timeout = clock_type::time_point::max());
 
     future<foreign_ptr<lw_shared_ptr<reconcilable_result>>, cache_temperature> query_mutations_locally(
             schema_ptr s, lw_shared_ptr<query::read_command> cmd, const dht::partition_range_vector& pr,
             tracing::trace_state_ptr trace_state = nullptr,
-            uint64_t max_size = query::result_memory_limiter::maximum_result_size);
+            uint64_t max_size = query::result_memory_limiter::maximum_result_size,
+            clock_type::time_point timeout = clock_type::time_point::max());
 
 
     future<> stop();
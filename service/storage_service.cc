@@ -85,6 +85,16 @@ static const sstring LARGE_PARTITIONS_FEATURE = "LARGE_PARTITIONS";
 static const sstring MATERIALIZED_VIEWS_FEATURE = "MATERIALIZED_VIEWS";
 static const sstring COUNTERS_FEATURE = "COUNTERS";
 static const sstring INDEXES_FEATURE = "INDEXES";
+static const sstring STREAM_SSTABLE_FILES_FEATURE = "STREAM_SSTABLE_FILES";
+static const sstring AGGREGATION_PUSHDOWN_FEATURE = "AGGREGATION_PUSHDOWN";
+static const sstring REPLICA_FILTERING_FEATURE = "REPLICA_FILTERING";
+static const sstring MUTATION_BATCH_FEATURE = "MUTATION_BATCH";
+static const sstring ROW_LEVEL_REPAIR_FEATURE = "ROW_LEVEL_REPAIR";
+static const sstring REPAIR_CHECKSUM_RANGES_FEATURE = "REPAIR_CHECKSUM_RANGES";
+static const sstring MURMUR3_REPAIR_CHECKSUM_FEATURE = "MURMUR3_REPAIR_CHECKSUM";
+static const sstring MURMUR3_DIGEST_FEATURE = "MURMUR3_DIGEST";
+static const sstring LWT_FEATURE = "LWT";
+static const sstring EVICTION_WEIGHT_FEATURE = "EVICTION_WEIGHT";
 
 distributed<storage_service> _the_storage_service;
 
@@ -125,6 +135,16 @@ sstring storage_service::get_config_supported_features() {
         RANGE_TOMBSTONES_FEATURE,
         LARGE_PARTITIONS_FEATURE,
         COUNTERS_FEATURE,
+        STREAM_SSTABLE_FILES_FEATURE,
+        AGGREGATION_PUSHDOWN_FEATURE,
+        REPLICA_FILTERING_FEATURE,
+        MUTATION_BATCH_FEATURE,
+        ROW_LEVEL_REPAIR_FEATURE,
+        REPAIR_CHECKSUM_RANGES_FEATURE,
+        MURMUR3_REPAIR_CHECKSUM_FEATURE,
+        MURMUR3_DIGEST_FEATURE,
+        LWT_FEATURE,
+        EVICTION_WEIGHT_FEATURE,
     };
     if (service::get_local_storage_service()._db.local().get_config().experimental()) {
         features.push_back(MATERIALIZED_VIEWS_FEATURE);
@@ -186,6 +206,22 @@ bool storage_service::should_bootstrap() {
     return is_auto_bootstrap() && !db::system_keyspace::bootstrap_complete() && !get_seeds().count(get_broadcast_address());
 }
 
+// Runs inside seastar::async context
+bool storage_service::can_fast_restart(const std::vector<inet_address>& loaded_endpoints,
+        const std::unordered_map<inet_address, sstring>& peer_features) {
+    if (!_db.local().get_config().fast_restart() || !get_property_load_ring_state()) {
+        return false;
+    }
+    if (!db::system_keyspace::bootstrap_complete() || db().local().is_replacing()) {
+        return false;
+    }
+    if (loaded_endpoints.empty() || peer_features.empty()) {
+        return false;
+    }
+    auto saved_tokens = db::system_keyspace::get_saved_tokens().get0();
+    return saved_tokens.size() == _db.local().get_config().num_tokens();
+}
+
 // Runs inside seastar::async context
 void storage_service::prepare_to_join(std::vector<inet_address> loaded_endpoints) {
     if (_joined) {
@@ -233,7 +269,18 @@ void storage_service::prepare_to_join(std::vector<inet_address> loaded_endpoints
         }
         auto local_features = get_config_supported_features();
 
-        if (seeds.count(my_ep)) {
+        if (can_fast_restart(loaded_endpoints, peer_features)) {
+            // This node already is a member of the ring and knows about its
+            // peers from the system tables, so instead of waiting for a
+            // shadow round, which can take up to ten times the ring delay
+            // when seeds are restarting too, check features against the
+            // persisted state and let gossip reconcile it in the background.
+            slogger.info("Fast restart: using persisted ring state of {} endpoints, checking remote features with system table", loaded_endpoints.size());
+            gossiper.check_knows_remote_features(local_features, peer_features);
+            get_storage_service().invoke_on_all([] (auto& ss) {
+                ss._fast_restart = true;
+            }).get();
+        } else if (seeds.count(my_ep)) {
             // This node is a seed node
             if (peer_features.empty()) {
                 // This is a competely new seed node, skip the check
@@ -1355,6 +1402,16 @@ future<> storage_service::init_server(int delay) {
             ss._range_tombstones_feature = gms::feature(RANGE_TOMBSTONES_FEATURE);
             ss._large_partitions_feature = gms::feature(LARGE_PARTITIONS_FEATURE);
             ss._counters_feature = gms::feature(COUNTERS_FEATURE);
+            ss._stream_sstable_files_feature = gms::feature(STREAM_SSTABLE_FILES_FEATURE);
+            ss._aggregation_pushdown_feature = gms::feature(AGGREGATION_PUSHDOWN_FEATURE);
+            ss._replica_filtering_feature = gms::feature(REPLICA_FILTERING_FEATURE);
+            ss._mutation_batch_feature = gms::feature(MUTATION_BATCH_FEATURE);
+            ss._row_level_repair_feature = gms::feature(ROW_LEVEL_REPAIR_FEATURE);
+            ss._repair_checksum_ranges_feature = gms::feature(REPAIR_CHECKSUM_RANGES_FEATURE);
+            ss._murmur3_repair_checksum_feature = gms::feature(MURMUR3_REPAIR_CHECKSUM_FEATURE);
+            ss._murmur3_digest_feature = gms::feature(MURMUR3_DIGEST_FEATURE);
+            ss._lwt_feature = gms::feature(LWT_FEATURE);
+            ss._eviction_weight_feature = gms::feature(EVICTION_WEIGHT_FEATURE);
 
             if (ss._db.local().get_config().experimental()) {
                 ss._materialized_views_feature = gms::feature(MATERIALIZED_VIEWS_FEATURE);
@@ -2021,8 +2078,10 @@ future<> storage_service::start_native_transport() {
         auto ceo = cfg.client_encryption_options();
         auto keepalive = cfg.rpc_keepalive();
         cql_transport::cql_load_balance lb = cql_transport::parse_load_balance(cfg.load_balance());
-        return seastar::net::dns::resolve_name(addr).then([cserver, addr, &cfg, lb, keepalive, ceo = std::move(ceo)] (seastar::net::inet_address ip) {
-            return cserver->start(std::ref(service::get_storage_proxy()), std::ref(cql3::get_query_processor()), lb).then([cserver, &cfg, addr, ip, ceo, keepalive]() {
+        auto max_flush_delay = std::chrono::microseconds(cfg.native_transport_max_flush_delay_in_us());
+        lowres_clock::duration max_queue_time = std::chrono::milliseconds(cfg.native_transport_max_queue_time_in_ms());
+        return seastar::net::dns::resolve_name(addr).then([cserver, addr, &cfg, lb, keepalive, max_flush_delay, max_queue_time, ceo = std::move(ceo)] (seastar::net::inet_address ip) {
+            return cserver->start(std::ref(service::get_storage_proxy()), std::ref(cql3::get_query_processor()), lb, max_flush_delay, max_queue_time).then([cserver, &cfg, addr, ip, ceo, keepalive]() {
                 // #293 - do not stop anything
                 //engine().at_exit([cserver] {
                 //    return cserver->stop();
@@ -2033,6 +2092,7 @@ future<> storage_service::start_native_transport() {
                 struct listen_cfg {
                     ipv4_addr addr;
                     std::shared_ptr<seastar::tls::credentials_builder> cred;
+                    bool is_shard_aware = false;
                 };
 
                 std::vector<listen_cfg> configs({ { ipv4_addr{ip, cfg.native_transport_port()} }});
@@ -2065,11 +2125,16 @@ future<> storage_service::start_native_transport() {
                     }
                 }
 
+                // Encrypted like native_transport_port.
+                if (cfg.native_shard_aware_transport_port()) {
+                    configs.emplace_back(listen_cfg{ipv4_addr{ip, cfg.native_shard_aware_transport_port()}, configs.front().cred, true});
+                }
+
                 return f.then([cserver, configs = std::move(configs), keepalive] {
                     return parallel_for_each(configs, [cserver, keepalive](const listen_cfg & cfg) {
-                        return cserver->invoke_on_all(&cql_transport::cql_server::listen, cfg.addr, cfg.cred, keepalive).then([cfg] {
-                            slogger.info("Starting listening for CQL clients on {} ({})"
-                                            , cfg.addr, cfg.cred ? "encrypted" : "unencrypted"
+                        return cserver->invoke_on_all(&cql_transport::cql_server::listen, cfg.addr, cfg.cred, keepalive, cfg.is_shard_aware).then([cfg] {
+                            slogger.info("Starting listening for CQL clients on {} ({}{})"
+                                            , cfg.addr, cfg.cred ? "encrypted" : "unencrypted", cfg.is_shard_aware ? ", shard-aware" : ""
                                             );
                         });
                     });
@@ -2764,7 +2829,7 @@ void storage_service::add_expire_time_if_found(inet_address endpoint, int64_t ex
 // For more details, see the commends on column_family::load_new_sstables
 // All the global operations are going to happen here, and just the reloading happens
 // in there.
-future<> storage_service::load_new_sstables(sstring ks_name, sstring cf_name) {
+future<> storage_service::load_new_sstables(sstring ks_name, sstring cf_name, bool load_and_stream) {
     class max_element {
         int64_t _result = 0;
     public:
@@ -2783,6 +2848,12 @@ future<> storage_service::load_new_sstables(sstring ks_name, sstring cf_name) {
         _loading_new_sstables = true;
     }
 
+    if (load_and_stream) {
+        return this->load_and_stream(ks_name, cf_name).finally([this] {
+            _loading_new_sstables = false;
+        });
+    }
+
     slogger.info("Loading new SSTables for {}.{}...", ks_name, cf_name);
 
     // First, we need to stop SSTable creation for that CF in all shards. This is a really horrible
@@ -2881,6 +2952,109 @@ future<> storage_service::load_new_sstables(sstring ks_name, sstring cf_name) {
     });
 }
 
+// The sstables are read on every shard of this node, each streaming the
+// partitions it owns, to all replicas of their token at once. Nothing of
+// them is loaded here, unless this node is one of the replicas.
+future<> storage_service::load_and_stream(sstring ks_name, sstring cf_name) {
+    slogger.info("Loading and streaming new SSTables for {}.{}...", ks_name, cf_name);
+    return distributed_loader::get_upload_dir_sstables(_db, ks_name, cf_name).then([this, ks_name, cf_name] (std::vector<sstables::entry_descriptor> descriptors) {
+        if (descriptors.empty()) {
+            slogger.info("No new SSTables were found for {}.{}", ks_name, cf_name);
+            return make_ready_future<>();
+        }
+        auto& cf = _db.local().find_column_family(ks_name, cf_name);
+        auto source = streaming::external_sstables{cf.dir() + "/upload", descriptors};
+
+        // The ranges of every replica, including the pending ones, like for writes.
+        std::unordered_map<inet_address, dht::token_range_vector> ranges_by_endpoint;
+        for (auto& ep : _token_metadata.get_all_endpoints()) {
+            ranges_by_endpoint[ep] = get_ranges_for_endpoint(ks_name, ep);
+        }
+        for (auto& x : _token_metadata.get_pending_ranges_mm(ks_name)) {
+            auto& ranges = ranges_by_endpoint[x.second];
+            if (x.first.is_wrap_around(dht::token_comparator())) {
+                auto unwrapped = x.first.unwrap();
+                ranges.emplace_back(std::move(unwrapped.first));
+                ranges.emplace_back(std::move(unwrapped.second));
+            } else {
+                ranges.emplace_back(x.first);
+            }
+        }
+
+        auto plan = make_lw_shared<streaming::stream_plan>("load_and_stream");
+        dht::token_range_vector local_ranges;
+        for (auto& x : ranges_by_endpoint) {
+            if (x.first == get_broadcast_address()) {
+                local_ranges = std::move(x.second);
+            } else if (!x.second.empty()) {
+                plan->transfer_sstables(x.first, ks_name, cf_name, std::move(x.second), source);
+            }
+        }
+        auto plan_id = utils::UUID_gen::get_time_UUID();
+        return when_all_succeed(plan->execute().discard_result(),
+                load_and_stream_locally(ks_name, cf_name, plan_id, std::move(local_ranges), source)).then([this, plan, ks_name, cf_name, descriptors = std::move(descriptors)] () mutable {
+            slogger.info("Done streaming {} new SSTables for {}.{}, deleting them", descriptors.size(), ks_name, cf_name);
+            return distributed_loader::remove_upload_dir_sstables(_db, ks_name, cf_name, std::move(descriptors));
+        });
+    }).handle_exception([ks_name, cf_name] (std::exception_ptr ep) {
+        slogger.error("Loading and streaming of new SSTables failed to {}.{} due to {}", ks_name, cf_name, ep);
+        return make_exception_future<>(std::move(ep));
+    });
+}
+
+// The part of the sstables this node is a replica of is written the way
+// streamed data is received, without going through the network.
+future<> storage_service::load_and_stream_locally(sstring ks_name, sstring cf_name, utils::UUID plan_id, dht::token_range_vector ranges,
+        streaming::external_sstables source) {
+    if (ranges.empty()) {
+        return make_ready_future<>();
+    }
+    return _db.invoke_on_all([ks_name, cf_name, plan_id, ranges, source] (database& db) {
+        auto& cf = db.find_column_family(ks_name, cf_name);
+        auto s = cf.schema();
+        auto prs = std::move(dht::split_ranges_to_shards(ranges, *s)[engine().cpu_id()]);
+        if (prs.empty()) {
+            return make_ready_future<>();
+        }
+        size_t fragment_size = std::max<size_t>(1, db.get_config().stream_mutation_fragment_size_in_kb()) * 1024;
+        return do_with(std::move(source), std::move(prs), [&cf, s, plan_id, fragment_size] (auto& source, auto& prs) {
+            return streaming::open_external_sstables(cf, source).then([&cf, s, plan_id, fragment_size, &prs] (lw_shared_ptr<sstables::sstable_set> sstables) {
+                return do_with(cf.make_streaming_reader(s, prs, std::move(sstables)), [s, plan_id, fragment_size] (mutation_reader& reader) {
+                    return repeat([&reader, s, plan_id, fragment_size] {
+                        return reader().then([s, plan_id, fragment_size] (streamed_mutation_opt smopt) {
+                            if (!smopt) {
+                                return make_ready_future<stop_iteration>(stop_iteration::yes);
+                            }
+                            return fragment_and_freeze(std::move(*smopt), [s, plan_id] (frozen_mutation fm, bool fragmented) {
+                                return do_with(std::move(fm), [s, plan_id, fragmented] (const frozen_mutation& fm) {
+                                    return service::get_local_storage_proxy().mutate_streaming_mutation(s, plan_id, fm, fragmented);
+                                });
+                            }, fragment_size).then([] {
+                                return stop_iteration::no;
+                            });
+                        });
+                    });
+                });
+            });
+        });
+    }).then([this, ks_name, cf_name, plan_id, ranges] {
+        return _db.invoke_on_all([ks_name, cf_name, plan_id, ranges] (database& db) {
+            dht::partition_range_vector query_ranges;
+            query_ranges.reserve(ranges.size());
+            for (auto& range : ranges) {
+                query_ranges.push_back(dht::to_partition_range(range));
+            }
+            return db.find_column_family(ks_name, cf_name).flush_streaming_mutations(plan_id, std::move(query_ranges));
+        });
+    }).handle_exception([this, ks_name, cf_name, plan_id] (std::exception_ptr ep) {
+        return _db.invoke_on_all([ks_name, cf_name, plan_id] (database& db) {
+            return db.find_column_family(ks_name, cf_name).fail_streaming_mutations(plan_id);
+        }).then([ep = std::move(ep)] () mutable {
+            return make_exception_future<>(std::move(ep));
+        });
+    });
+}
+
 void storage_service::set_load_broadcaster(shared_ptr<load_broadcaster> lb) {
     _lb = lb;
 }
@@ -218,6 +218,10 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
 
     bool _joined = false;
 
+    // Set when this node restarted from its persisted ring state, without
+    // waiting for gossip to learn about the cluster first.
+    bool _fast_restart = false;
+
 public:
     enum class mode { STARTING, NORMAL, JOINING, LEAVING, DECOMMISSIONED, MOVING, DRAINING, DRAINED };
 private:
@@ -263,6 +267,16 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
     gms::feature _materialized_views_feature;
     gms::feature _counters_feature;
     gms::feature _indexes_feature;
+    gms::feature _stream_sstable_files_feature;
+    gms::feature _aggregation_pushdown_feature;
+    gms::feature _replica_filtering_feature;
+    gms::feature _mutation_batch_feature;
+    gms::feature _row_level_repair_feature;
+    gms::feature _repair_checksum_ranges_feature;
+    gms::feature _murmur3_repair_checksum_feature;
+    gms::feature _murmur3_digest_feature;
+    gms::feature _lwt_feature;
+    gms::feature _eviction_weight_feature;
 
 public:
     void enable_all_features() {
@@ -271,6 +285,16 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
         _materialized_views_feature.enable();
         _counters_feature.enable();
         _indexes_feature.enable();
+        _stream_sstable_files_feature.enable();
+        _aggregation_pushdown_feature.enable();
+        _replica_filtering_feature.enable();
+        _mutation_batch_feature.enable();
+        _row_level_repair_feature.enable();
+        _repair_checksum_ranges_feature.enable();
+        _murmur3_repair_checksum_feature.enable();
+        _murmur3_digest_feature.enable();
+        _lwt_feature.enable();
+        _eviction_weight_feature.enable();
     }
 
     void finish_bootstrapping() {
@@ -404,11 +428,16 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
 #endif
 private:
     bool should_bootstrap();
+    bool can_fast_restart(const std::vector<inet_address>& loaded_endpoints,
+            const std::unordered_map<inet_address, sstring>& peer_features);
     void prepare_to_join(std::vector<inet_address> loaded_endpoints);
     void join_token_ring(int delay);
 public:
     future<> join_ring();
     bool is_joined();
+    bool is_fast_restart() const {
+        return _fast_restart;
+    }
 
     future<> rebuild(sstring source_dc);
 
@@ -2080,11 +2109,21 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
      * This should not be called in parallel for the same keyspace / column family, and doing
      * so will throw an std::runtime_exception.
      *
+     * With load_and_stream, the SSTables of the upload directory are instead
+     * split by token owner and streamed to all the replicas of their data,
+     * which needn't include this node, and are deleted once they were.
+     *
      * @param ks_name the keyspace in which to search for new SSTables.
      * @param cf_name the column family in which to search for new SSTables.
+     * @param load_and_stream whether to stream the SSTables to their replicas.
      * @return a future<> when the operation finishes.
      */
-    future<> load_new_sstables(sstring ks_name, sstring cf_name);
+    future<> load_new_sstables(sstring ks_name, sstring cf_name, bool load_and_stream = false);
+private:
+    future<> load_and_stream(sstring ks_name, sstring cf_name);
+    future<> load_and_stream_locally(sstring ks_name, sstring cf_name, utils::UUID plan_id, dht::token_range_vector ranges,
+            streaming::external_sstables source);
+public:
 #if 0
     /**
      * #{@inheritDoc}
@@ -2236,6 +2275,46 @@ class storage_service : public service::migration_listener, public gms::i_endpoi
     bool cluster_supports_indexes() const {
         return bool(_indexes_feature);
     }
+
+    bool cluster_supports_stream_sstable_files() const {
+        return bool(_stream_sstable_files_feature);
+    }
+
+    bool cluster_supports_aggregation_pushdown() const {
+        return bool(_aggregation_pushdown_feature);
+    }
+
+    bool cluster_supports_replica_filtering() const {
+        return bool(_replica_filtering_feature);
+    }
+
+    bool cluster_supports_mutation_batch() const {
+        return bool(_mutation_batch_feature);
+    }
+
+    bool cluster_supports_row_level_repair() const {
+        return bool(_row_level_repair_feature);
+    }
+
+    bool cluster_supports_repair_checksum_ranges() const {
+        return bool(_repair_checksum_ranges_feature);
+    }
+
+    bool cluster_supports_murmur3_repair_checksum() const {
+        return bool(_murmur3_repair_checksum_feature);
+    }
+
+    bool cluster_supports_murmur3_digest() const {
+        return bool(_murmur3_digest_feature);
+    }
+
+    bool cluster_supports_lwt() const {
+        return bool(_lwt_feature);
+    }
+
+    bool cluster_supports_eviction_weight() const {
+        return bool(_eviction_weight_feature);
+    }
 };
 
 inline future<> init_storage_service(distributed<database>& db) {
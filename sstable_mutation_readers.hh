@@ -35,9 +35,10 @@ class sstable_range_wrapping_reader final : public mutation_reader::impl {
             const query::partition_slice& slice,
             const io_priority_class& pc,
             streamed_mutation::forwarding fwd,
-            mutation_reader::forwarding fwd_mr)
+            mutation_reader::forwarding fwd_mr,
+            reader_resource_tracker resource_tracker = no_resource_tracking())
         : _sst(sst)
-        , _smr(sst->read_range_rows(std::move(s), pr, slice, pc, fwd, fwd_mr)) {
+        , _smr(sst->read_range_rows(std::move(s), pr, slice, pc, fwd, fwd_mr, std::move(resource_tracker))) {
     }
     virtual future<streamed_mutation_opt> operator()() override {
         return _smr.read();
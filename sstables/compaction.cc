@@ -64,6 +64,7 @@
 #include "db_clock.hh"
 #include "mutation_compactor.hh"
 #include "leveled_manifest.hh"
+#include "time_window_compaction_strategy.hh"
 
 namespace sstables {
 
@@ -78,7 +79,15 @@ class sstable_reader final : public ::mutation_reader::impl {
             , _reader(_sst->read_rows(schema, service::get_local_compaction_priority()))
             {}
     virtual future<streamed_mutation_opt> operator()() override {
-        return _reader.read().handle_exception([sst = _sst] (auto ep) {
+        return _reader.read().then([this] (streamed_mutation_opt smo) {
+            if (!smo) {
+                // Let go of the exhausted sstable, so that its files can be
+                // closed as soon as an incremental compaction releases it.
+                _reader = make_empty_reader();
+                _sst = nullptr;
+            }
+            return smo;
+        }).handle_exception([sst = _sst] (auto ep) {
             clogger.error("Compaction found an exception when reading sstable {} : {}",
                     sst->get_filename(), ep);
             return make_exception_future<streamed_mutation_opt>(ep);
@@ -86,23 +95,79 @@ class sstable_reader final : public ::mutation_reader::impl {
     }
 };
 
-static api::timestamp_type get_max_purgeable_timestamp(const column_family& cf, sstable_set::incremental_selector& selector,
-        const std::unordered_set<shared_sstable>& compacting_set, const dht::decorated_key& dk) {
-    auto timestamp = api::max_timestamp;
-    stdx::optional<utils::hashed_key> hk;
-    for (auto&& sst : boost::range::join(selector.select(dk.token()), cf.compacted_undeleted_sstables())) {
-        if (compacting_set.count(sst)) {
-            continue;
+// Finds the timestamp below which the tombstones of a partition can be
+// purged: the minimum timestamp of the sstables outside the compaction which
+// may have the partition. Only sstables whose minimum timestamp is below the
+// one found so far, and whose token range has the partition, have their
+// filter probed. The sstables selected for a token range are kept sorted by
+// their minimum timestamp while the selection stays the same, so the first
+// one whose filter has the key gives the result.
+class max_purgeable_timestamp_finder {
+    const column_family& _cf;
+    sstable_set::incremental_selector& _selector;
+    const std::unordered_set<shared_sstable>& _compacting;
+    std::vector<shared_sstable> _selection;
+    size_t _compacting_size = 0;
+    std::vector<shared_sstable> _candidates;
+    uint64_t& _probes;
+private:
+    static bool may_have(const shared_sstable& sst, const dht::token& t) {
+        return sst->get_first_decorated_key().token() <= t && t <= sst->get_last_decorated_key().token();
+    }
+    static api::timestamp_type min_timestamp(const shared_sstable& sst) {
+        return sst->get_stats_metadata().min_timestamp;
+    }
+    void update_candidates(const std::vector<shared_sstable>& selection) {
+        if (selection == _selection && _compacting.size() == _compacting_size) {
+            return;
+        }
+        _selection = selection;
+        _compacting_size = _compacting.size();
+        _candidates.clear();
+        for (auto&& sst : selection) {
+            if (!_compacting.count(sst)) {
+                _candidates.push_back(sst);
+            }
         }
-        if (!hk) {
-            hk = sstables::sstable::make_hashed_key(*cf.schema(), dk.key());
+        boost::sort(_candidates, [] (const shared_sstable& a, const shared_sstable& b) {
+            return min_timestamp(a) < min_timestamp(b);
+        });
+    }
+public:
+    max_purgeable_timestamp_finder(const column_family& cf, sstable_set::incremental_selector& selector,
+            const std::unordered_set<shared_sstable>& compacting, uint64_t& probes)
+        : _cf(cf), _selector(selector), _compacting(compacting), _probes(probes) {
+    }
+
+    api::timestamp_type operator()(const dht::decorated_key& dk) {
+        auto& t = dk.token();
+        update_candidates(_selector.select(t));
+        auto timestamp = api::max_timestamp;
+        stdx::optional<utils::hashed_key> hk;
+        auto has_key = [&] (const shared_sstable& sst) {
+            if (!hk) {
+                hk = sstables::sstable::make_hashed_key(*_cf.schema(), dk.key());
+            }
+            ++_probes;
+            return sst->filter_has_key(*hk);
+        };
+        for (auto&& sst : _candidates) {
+            if (min_timestamp(sst) >= timestamp) {
+                break;
+            }
+            if (may_have(sst, t) && has_key(sst)) {
+                timestamp = min_timestamp(sst);
+                break;
+            }
         }
-        if (sst->filter_has_key(*hk)) {
-            timestamp = std::min(timestamp, sst->get_stats_metadata().min_timestamp);
+        for (auto&& sst : _cf.compacted_undeleted_sstables()) {
+            if (min_timestamp(sst) < timestamp && !_compacting.count(sst) && may_have(sst, t) && has_key(sst)) {
+                timestamp = min_timestamp(sst);
+            }
         }
+        return timestamp;
     }
-    return timestamp;
-}
+};
 
 static bool belongs_to_current_node(const dht::token& t, const dht::token_range_vector& sorted_owned_ranges) {
     auto low = std::lower_bound(sorted_owned_ranges.begin(), sorted_owned_ranges.end(), t,
@@ -147,18 +212,58 @@ static std::vector<shared_sstable> get_uncompacting_sstables(column_family& cf,
 
 class compaction;
 
+static api::timestamp_type max_timestamp(const schema& s, column_kind kind, const row& cells) {
+    auto timestamp = api::min_timestamp;
+    cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection& c) {
+        auto&& cdef = s.column_at(kind, id);
+        if (cdef.is_atomic()) {
+            timestamp = std::max(timestamp, c.as_atomic_cell().timestamp());
+            return;
+        }
+        auto ctype = static_pointer_cast<const collection_type_impl>(cdef.type);
+        auto mview = ctype->deserialize_mutation_form(c.as_collection_mutation());
+        timestamp = std::max(timestamp, mview.tomb.timestamp);
+        for (auto& cp : mview.cells) {
+            timestamp = std::max(timestamp, cp.second.timestamp());
+        }
+    });
+    return timestamp;
+}
+
+// Routes the compacted data to the writers of the streams it belongs to.
 class compacting_sstable_writer {
     compaction& _c;
+    const schema& _schema;
+    stdx::optional<dht::decorated_key> _dk;
+    // Writer of the stream the current partition goes to as a whole, if any.
     sstable_writer* _writer = nullptr;
+    // Streams the current partition was started in, if split by timestamp.
+    std::vector<std::pair<output_splitter::stream_id, sstable_writer*>> _open_streams;
+private:
+    template <typename Timestamp>
+    sstable_writer& writer_for(Timestamp&& timestamp);
 public:
-    explicit compacting_sstable_writer(compaction& c) : _c(c) {}
+    compacting_sstable_writer(compaction& c, const schema& s) : _c(c), _schema(s) {}
 
     void consume_new_partition(const dht::decorated_key& dk);
 
-    void consume(tombstone t) { _writer->consume(t); }
-    stop_iteration consume(static_row&& sr, tombstone, bool) { return _writer->consume(std::move(sr)); }
-    stop_iteration consume(clustering_row&& cr, row_tombstone, bool) { return _writer->consume(std::move(cr)); }
-    stop_iteration consume(range_tombstone&& rt) { return _writer->consume(std::move(rt)); }
+    void consume(tombstone t) {
+        writer_for([&] { return t.timestamp; }).consume(t);
+    }
+    stop_iteration consume(static_row&& sr, tombstone, bool) {
+        auto& writer = writer_for([&] { return max_timestamp(_schema, column_kind::static_column, sr.cells()); });
+        return writer.consume(std::move(sr));
+    }
+    stop_iteration consume(clustering_row&& cr, row_tombstone, bool) {
+        auto& writer = writer_for([&] {
+            return std::max({cr.marker().timestamp(), cr.tomb().tomb().timestamp,
+                max_timestamp(_schema, column_kind::regular_column, cr.cells())});
+        });
+        return writer.consume(std::move(cr));
+    }
+    stop_iteration consume(range_tombstone&& rt) {
+        return writer_for([&] { return rt.tomb.timestamp; }).consume(std::move(rt));
+    }
 
     stop_iteration consume_end_of_partition();
     void consume_end_of_stream();
@@ -166,6 +271,16 @@ class compacting_sstable_writer {
 
 class compaction {
 protected:
+    struct output {
+        shared_sstable sst;
+        stdx::optional<sstable_writer> writer;
+        // Shared by the sstables of the stream, which are written in token
+        // order and so form a run. The streams overlap each other in time
+        // windows, or are written to different shards or ranges, so each
+        // stream is a run of its own.
+        utils::UUID run_identifier = utils::make_random_uuid();
+    };
+
     column_family& _cf;
     std::vector<shared_sstable> _sstables;
     uint64_t _max_sstable_size;
@@ -174,12 +289,20 @@ class compaction {
     uint64_t _estimated_partitions = 0;
     std::vector<unsigned long> _ancestors;
     db::replay_position _rp;
+    // Bases for the delta encoding of the output, see sstable_writer_config.
+    encoding_stats _enc_stats;
+    // Splits the output into streams; without one, there's only stream 0.
+    output_splitter_ptr _splitter;
+    // sstable being currently written, for each stream.
+    std::map<output_splitter::stream_id, output> _outputs;
 protected:
-    compaction(column_family& cf, std::vector<shared_sstable> sstables, uint64_t max_sstable_size, uint32_t sstable_level)
+    compaction(column_family& cf, std::vector<shared_sstable> sstables, uint64_t max_sstable_size, uint32_t sstable_level,
+            output_splitter_ptr splitter = {})
         : _cf(cf)
         , _sstables(std::move(sstables))
         , _max_sstable_size(max_sstable_size)
         , _sstable_level(sstable_level)
+        , _splitter(std::move(splitter))
     {
         _cf.get_compaction_manager().register_compaction(_info);
     }
@@ -189,10 +312,11 @@ class compaction {
         return ceil(double(_estimated_partitions) / estimated_sstables);
     }
 
-    void setup_new_sstable(shared_sstable& sst) {
+    void setup_new_sstable(shared_sstable& sst, utils::UUID run_identifier) {
         _info->new_sstables.push_back(sst);
         sst->get_metadata_collector().set_replay_position(_rp);
         sst->get_metadata_collector().sstable_level(_sstable_level);
+        sst->set_run_identifier(run_identifier);
         for (auto ancestor : _ancestors) {
             sst->add_ancestor(ancestor);
         }
@@ -216,13 +340,11 @@ class compaction {
         std::vector<::mutation_reader> readers;
         auto schema = _cf.schema();
         sstring formatted_msg = "[";
+        auto min_timestamp = api::max_timestamp;
 
         for (auto& sst : _sstables) {
             // We also capture the sstable, so we keep it alive while the read isn't done
             readers.emplace_back(make_mutation_reader<sstable_reader>(sst, schema));
-            // FIXME: If the sstables have cardinality estimation bitmaps, use that
-            // for a better estimate for the number of partitions in the merged
-            // sstable than just adding up the lengths of individual sstables.
             _estimated_partitions += sst->get_estimated_key_count();
             _info->total_partitions += sst->get_estimated_key_count();
             // Compacted sstable keeps track of its ancestors.
@@ -237,7 +359,14 @@ class compaction {
             // this is kind of ok, esp. since we will hopefully not be trying to recover based on
             // compacted sstables anyway (CL should be clean by then).
             _rp = std::max(_rp, sst->get_stats_metadata().position);
+            min_timestamp = std::min(min_timestamp, sst->get_stats_metadata().min_timestamp);
+        }
+        if (!_sstables.empty()) {
+            _enc_stats.min_timestamp = min_timestamp;
         }
+        // Partitions present in several of the sstables are written once, so
+        // that the output sstables, and their bloom filters, are smaller.
+        _estimated_partitions = ceil(_estimated_partitions * distinct_partitions_ratio(_sstables));
         formatted_msg += "]";
         _info->sstables = _sstables.size();
         _info->ks = schema->ks_name();
@@ -262,16 +391,25 @@ class compaction {
         // - there is no easy way, currently, to know the exact number of total partitions.
         // By the time being, using estimated key count.
         sstring formatted_msg = sprint("%ld sstables to [%s]. %ld bytes to %ld (~%d%% of original) in %dms = %.2fMB/s. " \
-            "~%ld total partitions merged to %ld.",
+            "~%ld total partitions merged to %ld. %ld filter probes for purgeable tombstones.",
             _info->sstables, new_sstables_msg, _info->start_size, _info->end_size, int(ratio * 100),
             std::chrono::duration_cast<std::chrono::milliseconds>(duration).count(), throughput,
-            _info->total_partitions, _info->total_keys_written);
+            _info->total_partitions, _info->total_keys_written, _info->purgeable_filter_probes);
         report_finish(formatted_msg, ended_at);
     }
 
     virtual void report_start(const sstring& formatted_msg) const = 0;
     virtual void report_finish(const sstring& formatted_msg, std::chrono::time_point<db_clock> ended_at) const = 0;
 
+    // New sstables which weren't handed over yet, and so are deleted if the
+    // compaction doesn't complete.
+    virtual std::vector<shared_sstable> unpublished_sstables() const {
+        return _info->new_sstables;
+    }
+    // Called once all the new sstables are sealed.
+    virtual void on_end_of_compaction() {
+    }
+
     virtual std::function<api::timestamp_type(const dht::decorated_key&)> max_purgeable_func() {
         return [] (const dht::decorated_key& dk) {
             return api::min_timestamp;
@@ -284,15 +422,61 @@ class compaction {
         };
     }
 
-    // select a sstable writer based on decorated key.
-    virtual sstable_writer* select_sstable_writer(const dht::decorated_key& dk) = 0;
-    // stop current writer
-    virtual void stop_sstable_writer() = 0;
-    // finish all writers.
-    virtual void finish_sstable_writer() = 0;
+    // Creates a new sstable for the given stream.
+    virtual shared_sstable create_new_sstable(output_splitter::stream_id stream) = 0;
+    // Shard the sstables of the given stream will belong to.
+    virtual shard_id stream_shard(output_splitter::stream_id stream) const {
+        return engine().cpu_id();
+    }
+    // Called whenever an sstable is sealed.
+    virtual void on_new_sstable_sealed(const shared_sstable& sst) {
+    }
+
+    stdx::optional<output_splitter::stream_id> partition_stream(const dht::decorated_key& dk) const {
+        if (!_splitter) {
+            return output_splitter::stream_id(0);
+        }
+        return _splitter->partition_stream(dk);
+    }
+
+    output_splitter::stream_id timestamp_stream(api::timestamp_type timestamp) const {
+        return _splitter->timestamp_stream(timestamp);
+    }
+
+    // Writer of the given stream, which starts a new sstable if needed.
+    sstable_writer& stream_writer(output_splitter::stream_id stream) {
+        auto& o = _outputs[stream];
+        if (!o.writer) {
+            o.sst = create_new_sstable(stream);
+            setup_new_sstable(o.sst, o.run_identifier);
+
+            auto&& priority = service::get_local_compaction_priority();
+            sstable_writer_config cfg;
+            cfg.max_sstable_size = _max_sstable_size;
+            cfg.enc_stats = _enc_stats;
+            o.writer.emplace(o.sst->get_writer(*_cf.schema(), partitions_per_sstable(), cfg, priority, stream_shard(stream)));
+        }
+        return *o.writer;
+    }
+
+    // Seals the sstable being written for the given stream.
+    void stop_sstable_writer(output_splitter::stream_id stream) {
+        auto& o = _outputs[stream];
+        finish_new_sstable(o.writer, o.sst);
+        on_new_sstable_sealed(o.sst);
+    }
+
+    // Seals the sstables being written for all streams.
+    void finish_sstable_writers() {
+        for (auto& p : _outputs) {
+            if (p.second.writer) {
+                stop_sstable_writer(p.first);
+            }
+        }
+    }
 
     compacting_sstable_writer get_compacting_sstable_writer() {
-        return compacting_sstable_writer(*this);
+        return compacting_sstable_writer(*this, *_cf.schema());
     }
 
     const schema_ptr& schema() const {
@@ -309,41 +493,74 @@ void compacting_sstable_writer::consume_new_partition(const dht::decorated_key&
         // Compaction manager will catch this exception and re-schedule the compaction.
         throw compaction_stop_exception(_c._info->ks, _c._info->cf, _c._info->stop_requested);
     }
-    _writer = _c.select_sstable_writer(dk);
-    _writer->consume_new_partition(dk);
+    auto stream = _c.partition_stream(dk);
+    if (stream) {
+        _writer = &_c.stream_writer(*stream);
+        _writer->consume_new_partition(dk);
+        _open_streams.emplace_back(*stream, _writer);
+    } else {
+        // The partition is started in a stream only once a fragment goes to it.
+        _dk = dk;
+    }
     _c._info->total_keys_written++;
 }
 
+template <typename Timestamp>
+sstable_writer& compacting_sstable_writer::writer_for(Timestamp&& timestamp) {
+    if (_writer) {
+        return *_writer;
+    }
+    auto stream = _c.timestamp_stream(timestamp());
+    auto it = boost::find_if(_open_streams, [stream] (auto& p) { return p.first == stream; });
+    if (it != _open_streams.end()) {
+        return *it->second;
+    }
+    auto& writer = _c.stream_writer(stream);
+    writer.consume_new_partition(*_dk);
+    _open_streams.emplace_back(stream, &writer);
+    return writer;
+}
+
 stop_iteration compacting_sstable_writer::consume_end_of_partition() {
-    auto ret = _writer->consume_end_of_partition();
-    if (ret == stop_iteration::yes) {
-        // stop sstable writer being currently used.
-        _c.stop_sstable_writer();
+    for (auto& p : _open_streams) {
+        if (p.second->consume_end_of_partition() == stop_iteration::yes) {
+            // the sstable of this stream reached its size limit.
+            _c.stop_sstable_writer(p.first);
+        }
     }
-    return ret;
+    _open_streams.clear();
+    _writer = nullptr;
+    _dk = stdx::nullopt;
+    return stop_iteration::no;
 }
 
 void compacting_sstable_writer::consume_end_of_stream() {
     // this will stop any writer opened by compaction.
-    _c.finish_sstable_writer();
+    _c.finish_sstable_writers();
 }
 
 class regular_compaction : public compaction {
     std::function<shared_sstable()> _creator;
     // store a clone of sstable set for column family, which needs to be alive for incremental selector.
-    const sstable_set _set;
+    sstable_set _set;
     // used to incrementally calculate max purgeable timestamp, as we iterate through decorated keys.
-    sstable_set::incremental_selector _selector;
-    // sstable being currently written.
-    shared_sstable _sst;
-    stdx::optional<sstable_writer> _writer;
+    stdx::optional<sstable_set::incremental_selector> _selector;
+    // input sstables which weren't released yet.
+    std::unordered_set<shared_sstable> _compacting;
+    // set for incremental compaction.
+    compaction_replacer_fn _replacer;
+    // number of new sstables handed to the replacer. They're handed over in
+    // the order they are created.
+    size_t _published = 0;
 public:
     regular_compaction(column_family& cf, std::vector<shared_sstable> sstables, std::function<shared_sstable()> creator,
-            uint64_t max_sstable_size, uint32_t sstable_level)
-        : compaction(cf, std::move(sstables), max_sstable_size, sstable_level)
+            uint64_t max_sstable_size, uint32_t sstable_level, compaction_replacer_fn replacer = {}, output_splitter_ptr splitter = {})
+        : compaction(cf, std::move(sstables), max_sstable_size, sstable_level, std::move(splitter))
         , _creator(std::move(creator))
         , _set(cf.get_sstable_set())
         , _selector(_set.make_incremental_selector())
+        , _compacting(_sstables.begin(), _sstables.end())
+        , _replacer(std::move(replacer))
     {
     }
 
@@ -368,10 +585,7 @@ class regular_compaction : public compaction {
     }
 
     virtual std::function<api::timestamp_type(const dht::decorated_key&)> max_purgeable_func() override {
-        std::unordered_set<shared_sstable> compacting(_sstables.begin(), _sstables.end());
-        return [this, compacting = std::move(compacting)] (const dht::decorated_key& dk) {
-            return get_max_purgeable_timestamp(_cf, _selector, compacting, dk);
-        };
+        return max_purgeable_timestamp_finder(_cf, *_selector, _compacting, _info->purgeable_filter_probes);
     }
 
     virtual std::function<bool(const streamed_mutation& sm)> filter_func() const override {
@@ -380,35 +594,76 @@ class regular_compaction : public compaction {
         };
     }
 
-    virtual sstable_writer* select_sstable_writer(const dht::decorated_key& dk) override {
-        if (!_writer) {
-            _sst = _creator();
-            setup_new_sstable(_sst);
+    virtual shared_sstable create_new_sstable(output_splitter::stream_id stream) override {
+        return _creator();
+    }
 
-            auto&& priority = service::get_local_compaction_priority();
-            sstable_writer_config cfg;
-            cfg.max_sstable_size = _max_sstable_size;
-            _writer.emplace(_sst->get_writer(*_cf.schema(), partitions_per_sstable(), cfg, priority));
+    virtual void on_new_sstable_sealed(const shared_sstable& sst) override {
+        // With several streams, data up to the end of the sealed sstable may
+        // still be in the writers of the others.
+        if (_replacer && !_splitter) {
+            maybe_release_exhausted_sstables(sst->get_last_decorated_key());
         }
-        return &*_writer;
     }
 
-    virtual void stop_sstable_writer() override {
-        finish_new_sstable(_writer, _sst);
+    virtual std::vector<shared_sstable> unpublished_sstables() const override {
+        return std::vector<shared_sstable>(_info->new_sstables.begin() + _published, _info->new_sstables.end());
     }
 
-    virtual void finish_sstable_writer() override {
-        if (_writer) {
-            stop_sstable_writer();
+    virtual void on_end_of_compaction() override {
+        if (_replacer && (!_compacting.empty() || _published < _info->new_sstables.size())) {
+            auto removed = boost::copy_range<std::vector<shared_sstable>>(_compacting);
+            _compacting.clear();
+            publish(std::move(removed));
+        }
+    }
+private:
+    void publish(std::vector<shared_sstable> removed) {
+        auto added = unpublished_sstables();
+        _published = _info->new_sstables.size();
+        _replacer(std::move(removed), std::move(added));
+    }
+
+    // All the input data up to and including the key the last sealed sstable
+    // ends with was written out. The input sstables which end at or before
+    // it are exhausted, and can be replaced by the sealed sstables, unless an
+    // input sstable which isn't exhausted starts at or before it too. Data in
+    // such an sstable may be shadowed by tombstones purged by this compaction,
+    // so it must go away together with the exhausted ones.
+    void maybe_release_exhausted_sstables(const dht::decorated_key& last) {
+        auto& s = *_cf.schema();
+        std::vector<shared_sstable> exhausted;
+        for (auto& sst : _compacting) {
+            if (sst->get_last_decorated_key().tri_compare(s, last) <= 0) {
+                exhausted.push_back(sst);
+            } else if (sst->get_first_decorated_key().tri_compare(s, last) <= 0) {
+                return;
+            }
+        }
+        if (exhausted.empty()) {
+            return;
         }
+        clogger.debug("Replacing {} exhausted sstable(s) of {}.{} with {} new sstable(s)",
+                exhausted.size(), _info->ks, _info->cf, _info->new_sstables.size() - _published);
+        for (auto& sst : exhausted) {
+            _compacting.erase(sst);
+        }
+        _sstables = boost::copy_range<std::vector<shared_sstable>>(_compacting);
+        publish(std::move(exhausted));
+        // Drop the references the snapshot of the sstable set holds to the
+        // released sstables.
+        _selector = stdx::nullopt;
+        _set = _cf.get_sstable_set();
+        _selector.emplace(_set.make_incremental_selector());
     }
 };
 
 class cleanup_compaction final : public regular_compaction {
 public:
     cleanup_compaction(column_family& cf, std::vector<shared_sstable> sstables, std::function<shared_sstable()> creator,
-            uint64_t max_sstable_size, uint32_t sstable_level)
-        : regular_compaction(cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level)
+            uint64_t max_sstable_size, uint32_t sstable_level, compaction_replacer_fn replacer = {}, output_splitter_ptr splitter = {})
+        : regular_compaction(cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level, std::move(replacer),
+                std::move(splitter))
     {
         _info->type = compaction_type::Cleanup;
     }
@@ -439,16 +694,14 @@ class cleanup_compaction final : public regular_compaction {
 
 
 class resharding_compaction final : public compaction {
-    std::vector<std::pair<shared_sstable, stdx::optional<sstable_writer>>> _output_sstables;
-    shard_id _shard; // shard of current sstable writer
     std::function<shared_sstable(shard_id)> _sstable_creator;
 public:
     resharding_compaction(std::vector<shared_sstable> sstables, column_family& cf, std::function<shared_sstable(shard_id)> creator,
             uint64_t max_sstable_size, uint32_t sstable_level)
-        : compaction(cf, std::move(sstables), max_sstable_size, sstable_level)
-        , _output_sstables(smp::count)
+        : compaction(cf, std::move(sstables), max_sstable_size, sstable_level, make_shard_splitter())
         , _sstable_creator(std::move(creator))
     {
+        _info->type = compaction_type::Reshard;
     }
 
     void report_start(const sstring& formatted_msg) const override {
@@ -459,41 +712,68 @@ class resharding_compaction final : public compaction {
         clogger.info("Resharded {}", formatted_msg);
     }
 
-    sstable_writer* select_sstable_writer(const dht::decorated_key& dk) override {
-        _shard = dht::shard_of(dk.token());
-        auto& sst = _output_sstables[_shard].first;
-        auto& writer = _output_sstables[_shard].second;
+    // Streams are shards.
+    shared_sstable create_new_sstable(output_splitter::stream_id stream) override {
+        return _sstable_creator(shard_id(stream));
+    }
 
-        if (!writer) {
-            sst = _sstable_creator(_shard);
-            setup_new_sstable(sst);
+    shard_id stream_shard(output_splitter::stream_id stream) const override {
+        return shard_id(stream);
+    }
+};
 
-            sstable_writer_config cfg;
-            cfg.max_sstable_size = _max_sstable_size;
-            auto&& priority = service::get_local_compaction_priority();
-            writer.emplace(sst->get_writer(*_cf.schema(), partitions_per_sstable(), cfg, priority, _shard));
-        }
-        return &*writer;
+class shard_splitter final : public output_splitter {
+public:
+    virtual stdx::optional<stream_id> partition_stream(const dht::decorated_key& dk) const override {
+        return stream_id(dht::shard_of(dk.token()));
     }
+};
 
-    void stop_sstable_writer() override {
-        auto& sst = _output_sstables[_shard].first;
-        auto& writer = _output_sstables[_shard].second;
+output_splitter_ptr make_shard_splitter() {
+    return ::make_shared<shard_splitter>();
+}
+
+class token_range_splitter final : public output_splitter {
+    std::vector<dht::token> _boundaries;
+public:
+    explicit token_range_splitter(std::vector<dht::token> boundaries) : _boundaries(std::move(boundaries)) {}
 
-        finish_new_sstable(writer, sst);
+    virtual stdx::optional<stream_id> partition_stream(const dht::decorated_key& dk) const override {
+        return stream_id(std::distance(_boundaries.begin(), std::lower_bound(_boundaries.begin(), _boundaries.end(), dk.token())));
     }
+};
 
-    void finish_sstable_writer() override {
-        for (auto& p : _output_sstables) {
-            if (p.second) {
-                finish_new_sstable(p.second, p.first);
-            }
-        }
+output_splitter_ptr make_token_range_splitter(std::vector<dht::token> boundaries) {
+    return ::make_shared<token_range_splitter>(std::move(boundaries));
+}
+
+class time_window_splitter final : public output_splitter {
+    api::timestamp_type _window_size;
+public:
+    explicit time_window_splitter(api::timestamp_type window_size) : _window_size(window_size) {}
+
+    virtual stdx::optional<stream_id> partition_stream(const dht::decorated_key& dk) const override {
+        return stdx::nullopt;
+    }
+
+    virtual stream_id timestamp_stream(api::timestamp_type timestamp) const override {
+        return time_window_manifest::get_window_lower_bound(_window_size, timestamp);
     }
 };
 
+output_splitter_ptr make_time_window_splitter(api::timestamp_type window_size) {
+    return ::make_shared<time_window_splitter>(window_size);
+}
+
+seastar::thread_scheduling_group& compaction_scheduling_group() {
+    static thread_local seastar::thread_scheduling_group group(std::chrono::milliseconds(1), 1.0);
+    return group;
+}
+
 future<std::vector<shared_sstable>> compaction::run(std::unique_ptr<compaction> c) {
-    return seastar::async([c = std::move(c)] () mutable {
+    auto attr = seastar::thread_attributes();
+    attr.scheduling_group = &compaction_scheduling_group();
+    return seastar::async(attr, [c = std::move(c)] () mutable {
         auto reader = c->setup();
 
         auto cr = c->get_compacting_sstable_writer();
@@ -504,12 +784,14 @@ future<std::vector<shared_sstable>> compaction::run(std::unique_ptr<compaction>
         try {
             consume_flattened_in_thread(reader, cfc, c->filter_func());
         } catch (...) {
-            delete_sstables_for_interrupted_compaction(c->_info->new_sstables, c->_info->ks, c->_info->cf);
+            auto unpublished = c->unpublished_sstables();
+            delete_sstables_for_interrupted_compaction(unpublished, c->_info->ks, c->_info->cf);
             c = nullptr; // make sure writers are stopped while running in thread context
             throw;
         }
 
         c->finish(std::move(start_time), db_clock::now());
+        c->on_end_of_compaction();
 
         return std::move(c->_info->new_sstables);
     });
@@ -526,11 +808,13 @@ static std::unique_ptr<compaction> make_compaction(bool cleanup, Params&&... par
 
 future<std::vector<shared_sstable>>
 compact_sstables(std::vector<shared_sstable> sstables, column_family& cf, std::function<shared_sstable()> creator,
-        uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup) {
+        uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup, compaction_replacer_fn replacer,
+        output_splitter_ptr splitter) {
     if (sstables.empty()) {
         throw std::runtime_error(sprint("Called compaction with empty set on behalf of {}.{}", cf.schema()->ks_name(), cf.schema()->cf_name()));
     }
-    auto c = make_compaction(cleanup, cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level);
+    auto c = make_compaction(cleanup, cf, std::move(sstables), std::move(creator), max_sstable_size, sstable_level,
+            std::move(replacer), std::move(splitter));
     return compaction::run(std::move(c));
 }
 
@@ -544,6 +828,36 @@ reshard_sstables(std::vector<shared_sstable> sstables, column_family& cf, std::f
     return compaction::run(std::move(c));
 }
 
+double distinct_partitions_ratio(const std::vector<shared_sstable>& sstables) {
+    if (sstables.size() < 2) {
+        return 1;
+    }
+    stdx::optional<hll::HyperLogLog> merged;
+    double sum = 0;
+    try {
+        for (auto& sst : sstables) {
+            auto cardinality = sst->get_cardinality();
+            if (!cardinality) {
+                return 1;
+            }
+            sum += cardinality->estimate();
+            if (!merged) {
+                merged = std::move(cardinality);
+            } else {
+                merged->merge(*cardinality);
+            }
+        }
+    } catch (std::invalid_argument&) {
+        // Estimates of different precisions can't be merged.
+        return 1;
+    }
+    if (sum <= 0) {
+        return 1;
+    }
+    // Dividing cardinality estimates by each other cancels out most of their bias.
+    return std::min(1.0, merged->estimate() / sum);
+}
+
 std::vector<sstables::shared_sstable>
 get_fully_expired_sstables(column_family& cf, std::vector<sstables::shared_sstable>& compacting, int32_t gc_before) {
     clogger.debug("Checking droppable sstables in {}.{}", cf.schema()->ks_name(), cf.schema()->cf_name());
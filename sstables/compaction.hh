@@ -24,6 +24,7 @@
 
 #include "sstables.hh"
 #include <functional>
+#include <seastar/core/thread.hh>
 
 namespace sstables {
 
@@ -34,6 +35,15 @@ namespace sstables {
         int level;
         // Threshold size for sstable(s) to be created.
         uint64_t max_sstable_bytes;
+        // Called with the input sstables an incremental compaction released
+        // before it was done, see compact_sstables().
+        std::function<void(const std::vector<sstables::shared_sstable>&)> release_exhausted;
+        // Directory the output goes to, if not the one new sstables of the
+        // table go to.
+        sstring output_dir;
+        // The fully expired sstables among the input, if the strategy looked
+        // for them. They're deleted rather than compacted.
+        std::vector<sstables::shared_sstable> expired;
 
         compaction_descriptor() = default;
 
@@ -43,6 +53,45 @@ namespace sstables {
             , max_sstable_bytes(max_sstable_bytes) {}
     };
 
+    // Replaces the sstables removed by a compaction with the ones it added.
+    // An incremental compaction calls it every time some of its input sstables
+    // are exhausted, and once more for the rest when it's done.
+    using compaction_replacer_fn = std::function<void(std::vector<sstables::shared_sstable> removed,
+            std::vector<sstables::shared_sstable> added)>;
+
+    // Interposed between the reader and the writers of a compaction, it splits
+    // the compacted data into several streams, each written to sstables of its
+    // own, so that the data is read and written once however it's laid out.
+    // A partition either goes as a whole to one stream, for example the one of
+    // its shard or token range, or has its fragments split by timestamp, for
+    // example by time window. Every stream receives its partitions in order.
+    class output_splitter {
+    public:
+        using stream_id = int64_t;
+
+        virtual ~output_splitter() {}
+        // Returns the stream all the data of the partition goes to, or a
+        // disengaged optional if its fragments are split by timestamp.
+        virtual stdx::optional<stream_id> partition_stream(const dht::decorated_key& dk) const = 0;
+        // Returns the stream a fragment goes to, given its max timestamp.
+        // Only called for partitions which have no stream of their own.
+        virtual stream_id timestamp_stream(api::timestamp_type timestamp) const {
+            return 0;
+        }
+    };
+
+    using output_splitter_ptr = ::shared_ptr<const output_splitter>;
+
+    // The stream of a partition is the shard owning it.
+    output_splitter_ptr make_shard_splitter();
+    // The stream of a partition is the index of the subrange its token falls
+    // in, boundaries being the sorted upper bounds (inclusive) of all the
+    // subranges but the last.
+    output_splitter_ptr make_token_range_splitter(std::vector<dht::token> boundaries);
+    // The stream of a fragment is the lower bound of the time window of the
+    // given size its max timestamp falls in.
+    output_splitter_ptr make_time_window_splitter(api::timestamp_type window_size);
+
     struct resharding_descriptor {
         std::vector<sstables::shared_sstable> sstables;
         uint64_t max_sstable_bytes;
@@ -56,6 +105,7 @@ namespace sstables {
         Validation = 2,
         Scrub = 3,
         Index_build = 4,
+        Reshard = 5,
     };
 
     static inline sstring compaction_name(compaction_type type) {
@@ -70,6 +120,8 @@ namespace sstables {
             return "SCRUB";
         case compaction_type::Index_build:
             return "INDEX_BUILD";
+        case compaction_type::Reshard:
+            return "RESHARD";
         default:
             throw std::runtime_error("Invalid Compaction Type");
         }
@@ -84,6 +136,9 @@ namespace sstables {
         uint64_t end_size = 0;
         uint64_t total_partitions = 0;
         uint64_t total_keys_written = 0;
+        // Probes of the filters of sstables outside the compaction, to find
+        // whether tombstones can be purged.
+        uint64_t purgeable_filter_probes = 0;
         std::vector<shared_sstable> new_sstables;
         sstring stop_requested;
 
@@ -107,9 +162,22 @@ namespace sstables {
     // If cleanup is true, mutation that doesn't belong to current node will be
     // cleaned up, log messages will inform the user that compact_sstables runs for
     // cleaning operation, and compaction history will not be updated.
+    // The new sstables form an sstable run: they share a run identifier.
+    // If replacer is given, the compaction is incremental. Whenever a new sstable
+    // is sealed after which no input sstable is left partially compacted, the
+    // sealed sstables are handed to the replacer together with the input
+    // sstables they replace, so that the space of the latter can be reclaimed
+    // before the compaction is done. The remaining ones are handed to it at the end.
+    // If splitter is given, the output is split into its streams. Input sstables
+    // are then only released at the end, as the streams are sealed independently.
     future<std::vector<shared_sstable>> compact_sstables(std::vector<shared_sstable> sstables,
             column_family& cf, std::function<shared_sstable()> creator,
-            uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup = false);
+            uint64_t max_sstable_size, uint32_t sstable_level, bool cleanup = false,
+            compaction_replacer_fn replacer = {}, output_splitter_ptr splitter = {});
+
+    // Scheduling group of the threads compactions run in. Its CPU quota is
+    // adjusted to the compaction backlog, see compaction_controller.
+    seastar::thread_scheduling_group& compaction_scheduling_group();
 
     // Compacts a set of N shared sstables into M sstables. For every shard involved,
     // i.e. which owns any of the sstables, a new unshared sstable is created.
@@ -117,6 +185,12 @@ namespace sstables {
             column_family& cf, std::function<shared_sstable(shard_id)> creator,
         uint64_t max_sstable_size, uint32_t sstable_level);
 
+    // The fraction of the partitions of the sstables which are distinct, as far
+    // as the cardinality estimates of the sstables tell: the number of
+    // partitions merging them yields is about this times the sum of their
+    // partitions. Is 1 if any of them has no cardinality estimate.
+    double distinct_partitions_ratio(const std::vector<shared_sstable>& sstables);
+
     // Return the most interesting bucket applying the size-tiered strategy.
     std::vector<sstables::shared_sstable>
     size_tiered_most_interesting_bucket(lw_shared_ptr<sstable_list> candidates);
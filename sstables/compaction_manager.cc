@@ -23,7 +23,12 @@
 #include "database.hh"
 #include <seastar/core/metrics.hh>
 #include "exceptions.hh"
+#include "utils/task_group.hh"
 #include <cmath>
+#include <boost/algorithm/cxx11/none_of.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include <boost/range/algorithm/sort.hpp>
+#include <boost/range/algorithm/find.hpp>
 
 static logging::logger cmlog("compaction_manager");
 
@@ -61,19 +66,37 @@ class compacting_sstable_registration {
             _cm->deregister_compacting_sstables(_compacting);
         }
     }
+
+    // Deregisters the sstables an incremental compaction is done with.
+    void release_compacting(const std::vector<sstables::shared_sstable>& sstables) {
+        _cm->deregister_compacting_sstables(sstables);
+        std::unordered_set<sstables::shared_sstable> released(sstables.begin(), sstables.end());
+        _compacting.erase(std::remove_if(_compacting.begin(), _compacting.end(), [&released] (auto& sst) {
+            return released.count(sst);
+        }), _compacting.end());
+    }
 };
 
+static void release_exhausted_on_the_go(sstables::compaction_descriptor& descriptor,
+        lw_shared_ptr<compacting_sstable_registration> compacting) {
+    descriptor.release_exhausted = [compacting = std::move(compacting)] (const std::vector<sstables::shared_sstable>& exhausted) {
+        compacting->release_compacting(exhausted);
+    };
+}
+
 class compaction_weight_registration {
     compaction_manager* _cm;
     column_family* _cf;
     int _weight;
+    compaction_manager::level_footprint _footprint;
 public:
-    compaction_weight_registration(compaction_manager* cm, column_family* cf, int weight)
+    compaction_weight_registration(compaction_manager* cm, column_family* cf, int weight, compaction_manager::level_footprint footprint)
         : _cm(cm)
         , _cf(cf)
         , _weight(weight)
+        , _footprint(std::move(footprint))
     {
-        _cm->register_weight(_cf, _weight);
+        _cm->register_weight(_cf, _weight, _footprint);
     }
 
     compaction_weight_registration& operator=(const compaction_weight_registration&) = delete;
@@ -91,6 +114,7 @@ class compaction_weight_registration {
         : _cm(other._cm)
         , _cf(other._cf)
         , _weight(other._weight)
+        , _footprint(std::move(other._footprint))
     {
         other._cm = nullptr;
         other._cf = nullptr;
@@ -99,7 +123,7 @@ class compaction_weight_registration {
 
     ~compaction_weight_registration() {
         if (_cm) {
-            _cm->deregister_weight(_cf, _weight);
+            _cm->deregister_weight(_cf, _weight, _footprint);
         }
     }
 };
@@ -132,6 +156,41 @@ static inline int calculate_weight(const std::vector<sstables::shared_sstable>&
     return calculate_weight(get_total_size(sstables));
 }
 
+// Levels above 0 which a compaction job reads from or writes to, and the
+// token range of its input, which its output is within.
+static compaction_manager::level_footprint get_footprint(const sstables::compaction_descriptor& descriptor) {
+    compaction_manager::level_footprint footprint;
+    auto& levels = footprint.levels;
+    auto add = [&levels] (uint32_t level) {
+        if (level > 0 && boost::find(levels, level) == levels.end()) {
+            levels.push_back(level);
+        }
+    };
+    add(descriptor.level);
+    for (auto& sst : descriptor.sstables) {
+        add(sst->get_sstable_level());
+    }
+    boost::sort(levels);
+    if (!descriptor.sstables.empty()) {
+        footprint.first = descriptor.sstables.front()->get_first_decorated_key().token();
+        footprint.last = descriptor.sstables.front()->get_last_decorated_key().token();
+        for (auto& sst : descriptor.sstables) {
+            footprint.first = std::min(footprint.first, sst->get_first_decorated_key().token());
+            footprint.last = std::max(footprint.last, sst->get_last_decorated_key().token());
+        }
+    }
+    return footprint;
+}
+
+bool compaction_manager::level_footprint::conflicts_with(const level_footprint& o) const {
+    if (last < o.first || o.last < first) {
+        return false;
+    }
+    return boost::algorithm::any_of(levels, [&o] (uint32_t level) {
+        return boost::find(o.levels, level) != o.levels.end();
+    });
+}
+
 int compaction_manager::trim_to_compact(column_family* cf, sstables::compaction_descriptor& descriptor) {
     int weight = calculate_weight(descriptor.sstables);
     // NOTE: a compaction job with level > 0 cannot be trimmed because leveled
@@ -144,7 +203,7 @@ int compaction_manager::trim_to_compact(column_family* cf, sstables::compaction_
         return weight;
     }
 
-    std::unordered_set<int>& s = it->second;
+    auto& s = it->second.weights;
     uint64_t total_size = get_total_size(descriptor.sstables);
     int min_threshold = cf->schema()->min_compaction_threshold();
 
@@ -160,20 +219,34 @@ int compaction_manager::trim_to_compact(column_family* cf, sstables::compaction_
     return weight;
 }
 
-bool compaction_manager::can_register_weight(column_family* cf, int weight, bool parallel_compaction) {
+bool compaction_manager::can_register_weight(column_family* cf, int weight, const level_footprint& footprint, bool parallel_compaction) {
     auto it = _weight_tracker.find(cf);
-    if (it == _weight_tracker.end()) {
+    if (it == _weight_tracker.end() || it->second.weights.empty()) {
         return true;
     }
-    std::unordered_set<int>& s = it->second;
-    // Only one weight is allowed if parallel compaction is disabled.
-    if (!parallel_compaction && !s.empty()) {
+    auto& ongoing = it->second;
+    // Only one job is allowed if parallel compaction is disabled.
+    if (!parallel_compaction) {
+        return false;
+    }
+    auto running = ongoing.weights.size();
+    auto max_concurrency = std::max(cf->max_concurrent_compactions(), 1U);
+    if (running >= max_concurrency) {
+        return false;
+    }
+    if (running + 1 == max_concurrency
+            && weight >= *std::min_element(ongoing.weights.begin(), ongoing.weights.end())) {
         return false;
     }
-    // TODO: Maybe allow only *smaller* compactions to start? That can be done
-    // by returning true only if weight is not in the set and is lower than any
-    // entry in the set.
-    if (s.count(weight)) {
+    if (!footprint.levels.empty()) {
+        // Jobs of a leveled strategy must not read or write a level another
+        // job is working on in an overlapping token range, or the level could
+        // end up with overlapping sstables. Their weights don't matter.
+        return boost::algorithm::none_of(ongoing.footprints, [&footprint] (const level_footprint& f) {
+            return footprint.conflicts_with(f);
+        });
+    }
+    if (ongoing.weights.count(weight)) {
         // If reached this point, it means that there is an ongoing compaction
         // with the weight of the compaction job.
         return false;
@@ -181,19 +254,22 @@ bool compaction_manager::can_register_weight(column_family* cf, int weight, bool
     return true;
 }
 
-void compaction_manager::register_weight(column_family* cf, int weight) {
-    auto it = _weight_tracker.find(cf);
-    if (it == _weight_tracker.end()) {
-        _weight_tracker.insert({cf, {weight}});
-    } else {
-        it->second.insert(weight);
+void compaction_manager::register_weight(column_family* cf, int weight, const level_footprint& footprint) {
+    auto& ongoing = _weight_tracker[cf];
+    ongoing.weights.insert(weight);
+    if (!footprint.levels.empty()) {
+        ongoing.footprints.push_back(footprint);
     }
 }
 
-void compaction_manager::deregister_weight(column_family* cf, int weight) {
+void compaction_manager::deregister_weight(column_family* cf, int weight, const level_footprint& footprint) {
     auto it = _weight_tracker.find(cf);
     assert(it != _weight_tracker.end());
-    it->second.erase(weight);
+    auto& ongoing = it->second;
+    ongoing.weights.erase(ongoing.weights.find(weight));
+    if (!footprint.levels.empty()) {
+        ongoing.footprints.erase(boost::find(ongoing.footprints, footprint));
+    }
 }
 
 std::vector<sstables::shared_sstable> compaction_manager::get_candidates(const column_family& cf) {
@@ -293,9 +369,11 @@ future<> compaction_manager::submit_major_compaction(column_family* cf) {
             // FIXME: we need to make major compaction compaction strategy aware. For example,
             // leveled strategy may want to promote the merged sstables of a level N.
             auto sstables = get_candidates(*cf);
-            auto compacting = compacting_sstable_registration(this, sstables);
+            auto compacting = make_lw_shared<compacting_sstable_registration>(this, sstables);
+            auto descriptor = sstables::compaction_descriptor(std::move(sstables));
+            release_exhausted_on_the_go(descriptor, compacting);
 
-            return cf->compact_sstables(sstables::compaction_descriptor(std::move(sstables))).then([compacting = std::move(compacting)] {});
+            return cf->compact_sstables(std::move(descriptor)).then([compacting = std::move(compacting)] {});
         });
     }).then_wrapped([this, task] (future<> f) {
         _stats.active_tasks--;
@@ -344,6 +422,7 @@ void compaction_manager::register_metrics() {
 void compaction_manager::start() {
     _stopped = false;
     register_metrics();
+    utils::set_task_group_queue_length(utils::task_group::compaction, [this] { return _stats.pending_tasks; });
 }
 
 future<> compaction_manager::stop() {
@@ -354,6 +433,7 @@ future<> compaction_manager::stop() {
     _stopped = true;
     // Reset the metrics registry
     _metrics.clear();
+    utils::set_task_group_queue_length(utils::task_group::compaction, {});
     // Stop all ongoing compaction.
     for (auto& info : _compactions) {
         info->stop("shutdown");
@@ -419,16 +499,18 @@ void compaction_manager::submit(column_family* cf) {
             sstables::compaction_strategy cs = cf.get_compaction_strategy();
             sstables::compaction_descriptor descriptor = cs.get_sstables_for_compaction(cf, get_candidates(cf));
             int weight = trim_to_compact(&cf, descriptor);
+            auto footprint = get_footprint(descriptor);
 
             // Stop compaction task immediately if strategy is satisfied or job cannot run in parallel.
-            if (descriptor.sstables.empty() || !can_register_weight(&cf, weight, cs.parallel_compaction())) {
+            if (descriptor.sstables.empty() || !can_register_weight(&cf, weight, footprint, cs.parallel_compaction())) {
                 _stats.pending_tasks--;
                 cmlog.debug("Refused compaction job ({} sstable(s)) of weight {} for {}.{}",
                     descriptor.sstables.size(), weight, cf.schema()->ks_name(), cf.schema()->cf_name());
                 return make_ready_future<stop_iteration>(stop_iteration::yes);
             }
-            auto compacting = compacting_sstable_registration(this, descriptor.sstables);
-            auto c_weight = compaction_weight_registration(this, &cf, weight);
+            auto compacting = make_lw_shared<compacting_sstable_registration>(this, descriptor.sstables);
+            release_exhausted_on_the_go(descriptor, compacting);
+            auto c_weight = compaction_weight_registration(this, &cf, weight, std::move(footprint));
             cmlog.debug("Accepted compaction job ({} sstable(s)) of weight {} for {}.{}",
                 descriptor.sstables.size(), weight, cf.schema()->ks_name(), cf.schema()->cf_name());
 
@@ -543,13 +625,15 @@ future<> compaction_manager::remove(column_family* cf) {
 }
 
 void compaction_manager::stop_compaction(sstring type) {
-    // TODO: this method only works for compaction of type compaction and cleanup.
+    // TODO: this method only works for compaction of type compaction, cleanup and reshard.
     // Other types are: validation, scrub, index_build.
     sstables::compaction_type target_type;
     if (type == "COMPACTION") {
         target_type = sstables::compaction_type::Compaction;
     } else if (type == "CLEANUP") {
         target_type = sstables::compaction_type::Cleanup;
+    } else if (type == "RESHARD") {
+        target_type = sstables::compaction_type::Reshard;
     } else {
         throw std::runtime_error(sprint("Compaction of type %s cannot be stopped by compaction manager", type.c_str()));
     }
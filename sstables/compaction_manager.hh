@@ -33,6 +33,8 @@
 #include <vector>
 #include <list>
 #include <functional>
+#include <unordered_map>
+#include <unordered_set>
 #include "sstables/compaction.hh"
 
 class column_family;
@@ -49,6 +51,20 @@ class compaction_manager {
         uint64_t active_tasks = 0; // Number of compaction going on.
         int64_t errors = 0;
     };
+    // Levels above 0 a leveled job reads or writes, and the token range it
+    // spans. Level 0 is excluded, since its sstables may overlap, so jobs on
+    // disjoint sstables of it can run in parallel.
+    struct level_footprint {
+        std::vector<uint32_t> levels;
+        dht::token first;
+        dht::token last;
+
+        // Whether the jobs may write overlapping sstables into a level.
+        bool conflicts_with(const level_footprint& o) const;
+        bool operator==(const level_footprint& o) const {
+            return levels == o.levels && first == o.first && last == o.last;
+        }
+    };
 private:
     struct task {
         column_family* compacting_cf = nullptr;
@@ -73,9 +89,16 @@ class compaction_manager {
     // a sstable from being compacted twice.
     std::unordered_set<sstables::shared_sstable> _compacting_sstables;
 
-    // Keep track of weight of ongoing compaction for each column family.
-    // That's used to allow parallel compaction on the same column family.
-    std::unordered_map<column_family*, std::unordered_set<int>> _weight_tracker;
+    // What the ongoing compactions of a column family are working on. That's
+    // used to allow parallel compaction on the same column family, as long as
+    // the jobs don't step on each other.
+    struct ongoing_compactions {
+        // Weight of every job.
+        std::unordered_multiset<int> weights;
+        // Footprint of every leveled job.
+        std::list<level_footprint> footprints;
+    };
+    std::unordered_map<column_family*, ongoing_compactions> _weight_tracker;
 
     // Purpose is to serialize major compaction across all column families, so as to
     // reduce disk space requirement.
@@ -85,14 +108,21 @@ class compaction_manager {
 private:
     future<> task_stop(lw_shared_ptr<task> task);
 
-    // Return true if weight is not registered. If parallel_compaction is not
-    // true, only one weight is allowed to be registered.
-    bool can_register_weight(column_family* cf, int weight, bool parallel_compaction);
-    // Register weight for a column family. Do that only if can_register_weight()
-    // returned true.
-    void register_weight(column_family* cf, int weight);
-    // Deregister weight for a column family.
-    void deregister_weight(column_family* cf, int weight);
+    // Return true if a job of the given weight and footprint may run
+    // alongside the ongoing compactions of the column family.
+    // A job which touches levels above 0 may run if no ongoing job touches
+    // any of them in an overlapping token range; any other job, if no
+    // ongoing job has its weight. If parallel_compaction is not true, only
+    // one job is allowed at a time.
+    // At most column_family::max_concurrent_compactions() jobs run in
+    // parallel, and the last of those slots is kept for a job lighter than
+    // all the ongoing ones, so that big jobs cannot starve small ones.
+    bool can_register_weight(column_family* cf, int weight, const level_footprint& footprint, bool parallel_compaction);
+    // Register weight and footprint of a job for a column family. Do that
+    // only if can_register_weight() returned true.
+    void register_weight(column_family* cf, int weight, const level_footprint& footprint);
+    // Deregister weight and footprint of a job for a column family.
+    void deregister_weight(column_family* cf, int weight, const level_footprint& footprint);
 
     // If weight of compaction job is taken, it will be trimmed until its new
     // weight is not taken or its size is equal to minimum threshold.
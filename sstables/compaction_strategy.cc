@@ -48,10 +48,16 @@
 #include "cql3/statements/property_definitions.hh"
 #include "leveled_manifest.hh"
 #include "sstable_set.hh"
-#include "compatible_ring_position.hh"
+#include "utils/interval_tree.hh"
 #include <boost/range/algorithm/find.hpp>
-#include <boost/icl/interval_map.hpp>
+#include <boost/range/algorithm/remove_if.hpp>
+#include <boost/range/adaptor/filtered.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/min_element.hpp>
+#include <boost/range/numeric.hpp>
+#include <boost/algorithm/cxx11/none_of.hpp>
 #include "date_tiered_compaction_strategy.hh"
+#include "time_window_compaction_strategy.hh"
 
 logging::logger date_tiered_manifest::logger = logging::logger("DateTieredCompactionStrategy");
 
@@ -72,7 +78,26 @@ class sstable_set_impl {
     virtual std::vector<shared_sstable> select(const dht::partition_range& range) const = 0;
     virtual void insert(shared_sstable sst) = 0;
     virtual void erase(shared_sstable sst) = 0;
+    virtual std::vector<shared_sstable> all() const = 0;
+    virtual size_t size() const = 0;
     virtual std::unique_ptr<incremental_selector_impl> make_incremental_selector() const = 0;
+    // Sets which don't keep the sstables by time look at each of them.
+    virtual std::vector<shared_sstable> select_since(const dht::partition_range& range, api::timestamp_type min_timestamp) const {
+        auto ssts = select(range);
+        ssts.erase(boost::remove_if(ssts, [min_timestamp] (const shared_sstable& sst) {
+            return sst->get_stats_metadata().max_timestamp < min_timestamp;
+        }), ssts.end());
+        return ssts;
+    }
+    virtual void for_each_time_window(api::timestamp_type window_size,
+            std::function<stop_iteration (api::timestamp_type, std::vector<shared_sstable>)> func) const {
+        auto buckets = time_window_manifest::get_buckets(all(), window_size).first;
+        for (auto it = buckets.rbegin(); it != buckets.rend(); ++it) {
+            if (func(it->first, std::move(it->second)) == stop_iteration::yes) {
+                return;
+            }
+        }
+    }
 };
 
 sstable_set::sstable_set(std::unique_ptr<sstable_set_impl> impl, lw_shared_ptr<sstable_list> all)
@@ -82,7 +107,7 @@ sstable_set::sstable_set(std::unique_ptr<sstable_set_impl> impl, lw_shared_ptr<s
 
 sstable_set::sstable_set(const sstable_set& x)
         : _impl(x._impl->clone())
-        , _all(make_lw_shared(sstable_list(*x._all))) {
+        , _all(x._all) {
 }
 
 sstable_set::sstable_set(sstable_set&&) noexcept = default;
@@ -104,21 +129,55 @@ sstable_set::select(const dht::partition_range& range) const {
     return _impl->select(range);
 }
 
+std::vector<shared_sstable>
+sstable_set::select(const dht::partition_range& range, api::timestamp_type min_timestamp) const {
+    return _impl->select_since(range, min_timestamp);
+}
+
+void
+sstable_set::for_each_time_window(api::timestamp_type window_size,
+        std::function<stop_iteration (api::timestamp_type, std::vector<shared_sstable>)> func) const {
+    _impl->for_each_time_window(window_size, std::move(func));
+}
+
+lw_shared_ptr<sstable_list>
+sstable_set::all() const {
+    if (!_all) {
+        auto ssts = _impl->all();
+        _all = make_lw_shared<sstable_list>(ssts.begin(), ssts.end());
+    }
+    return _all;
+}
+
+size_t
+sstable_set::size() const {
+    return _impl->size();
+}
+
 void
 sstable_set::insert(shared_sstable sst) {
     _impl->insert(sst);
-    try {
-        _all->insert(sst);
-    } catch (...) {
-        _impl->erase(sst);
-        throw;
+    // The list may be shared with copies of this set, or held by whoever
+    // asked for it, so it's changed only when it's ours alone.
+    if (_all && _all.owned()) {
+        try {
+            _all->insert(sst);
+        } catch (...) {
+            _all = { };
+        }
+    } else {
+        _all = { };
     }
 }
 
 void
 sstable_set::erase(shared_sstable sst) {
     _impl->erase(sst);
-    _all->erase(sst);
+    if (_all && _all.owned()) {
+        _all->erase(sst);
+    } else {
+        _all = { };
+    }
 }
 
 sstable_set::~sstable_set() = default;
@@ -146,35 +205,61 @@ sstable_set::make_incremental_selector() const {
     return incremental_selector(_impl->make_incremental_selector());
 }
 
+// The sstables keyed by the tokens of their first and last partitions, so
+// that the sstables which may hold the partitions of a range are found
+// without looking at the others.
+using token_interval_tree = utils::interval_tree<dht::token, shared_sstable>;
+
+static void insert_by_tokens(token_interval_tree& tree, shared_sstable sst) {
+    auto first = sst->get_first_decorated_key().token();
+    auto last = sst->get_last_decorated_key().token();
+    tree.insert(std::move(first), std::move(last), std::move(sst));
+}
+
+static bool erase_by_tokens(token_interval_tree& tree, const shared_sstable& sst) {
+    return tree.erase(sst->get_first_decorated_key().token(), sst);
+}
+
+static std::vector<shared_sstable> select_by_tokens(const token_interval_tree& tree, const dht::partition_range& range) {
+    auto& start = range.start() ? range.start()->value().token() : dht::minimum_token();
+    auto& end = range.end() ? range.end()->value().token() : dht::maximum_token();
+    return tree.overlapping(start, end);
+}
+
 // default sstable_set, not specialized for anything
 class bag_sstable_set : public sstable_set_impl {
-    // erasing is slow, but select() is fast
-    std::vector<shared_sstable> _sstables;
+    token_interval_tree _sstables;
 public:
     virtual std::unique_ptr<sstable_set_impl> clone() const override {
         return std::make_unique<bag_sstable_set>(*this);
     }
     virtual std::vector<shared_sstable> select(const dht::partition_range& range = query::full_partition_range) const override {
-        return _sstables;
+        return select_by_tokens(_sstables, range);
     }
     virtual void insert(shared_sstable sst) override {
-        _sstables.push_back(std::move(sst));
+        insert_by_tokens(_sstables, std::move(sst));
     }
     virtual void erase(shared_sstable sst) override {
-        _sstables.erase(boost::find(_sstables, sst));
+        erase_by_tokens(_sstables, sst);
+    }
+    virtual std::vector<shared_sstable> all() const override {
+        return _sstables.values();
+    }
+    virtual size_t size() const override {
+        return _sstables.size();
     }
     virtual std::unique_ptr<incremental_selector_impl> make_incremental_selector() const override;
     class incremental_selector;
 };
 
 class bag_sstable_set::incremental_selector : public incremental_selector_impl {
-    const std::vector<shared_sstable>& _sstables;
+    const token_interval_tree& _sstables;
 public:
-    incremental_selector(const std::vector<shared_sstable>& sstables)
+    incremental_selector(const token_interval_tree& sstables)
         : _sstables(sstables) {
     }
     virtual std::pair<dht::token_range, std::vector<shared_sstable>> select(const dht::token& token) override {
-        return std::make_pair(dht::token_range::make_open_ended_both_sides(), _sstables);
+        return std::make_pair(dht::token_range::make_open_ended_both_sides(), _sstables.values());
     }
 };
 
@@ -185,40 +270,14 @@ std::unique_ptr<incremental_selector_impl> bag_sstable_set::make_incremental_sel
 // specialized when sstables are partitioned in the token range space
 // e.g. leveled compaction strategy
 class partitioned_sstable_set : public sstable_set_impl {
-    using value_set = std::unordered_set<shared_sstable>;
-    using interval_map_type = boost::icl::interval_map<compatible_ring_position, value_set>;
-    using interval_type = interval_map_type::interval_type;
-    using map_iterator = interval_map_type::const_iterator;
-private:
     schema_ptr _schema;
-    std::vector<shared_sstable> _unleveled_sstables;
-    interval_map_type _leveled_sstables;
+    // Level 0 sstables overlap each other.
+    token_interval_tree _unleveled_sstables;
+    // The sstables of each of the other levels don't overlap each other.
+    token_interval_tree _leveled_sstables;
 private:
-    static interval_type make_interval(const schema& s, const dht::partition_range& range) {
-        return interval_type::closed(
-                compatible_ring_position(s, range.start()->value()),
-                compatible_ring_position(s, range.end()->value()));
-    }
-    interval_type make_interval(const dht::partition_range& range) const {
-        return make_interval(*_schema, range);
-    }
-    interval_type singular(const dht::ring_position& rp) const {
-        auto crp = compatible_ring_position(*_schema, rp);
-        return interval_type::closed(crp, crp);
-    }
-    std::pair<map_iterator, map_iterator> query(const dht::partition_range& range) const {
-        if (range.start() && range.end()) {
-            return _leveled_sstables.equal_range(make_interval(range));
-        }
-        else if (range.start() && !range.end()) {
-            auto start = singular(range.start()->value());
-            return { _leveled_sstables.lower_bound(start), _leveled_sstables.end() };
-        } else if (!range.start() && range.end()) {
-            auto end = singular(range.end()->value());
-            return { _leveled_sstables.begin(), _leveled_sstables.upper_bound(end) };
-        } else {
-            return { _leveled_sstables.begin(), _leveled_sstables.end() };
-        }
+    token_interval_tree& tree_of(const shared_sstable& sst) {
+        return sst->get_sstable_level() == 0 ? _unleveled_sstables : _leveled_sstables;
     }
 public:
     explicit partitioned_sstable_set(schema_ptr schema)
@@ -228,96 +287,310 @@ class partitioned_sstable_set : public sstable_set_impl {
         return std::make_unique<partitioned_sstable_set>(*this);
     }
     virtual std::vector<shared_sstable> select(const dht::partition_range& range) const override {
-        auto ipair = query(range);
-        auto b = std::move(ipair.first);
-        auto e = std::move(ipair.second);
-        value_set result;
-        while (b != e) {
-            boost::copy(b++->second, std::inserter(result, result.end()));
-        }
-        auto r = _unleveled_sstables;
-        r.insert(r.end(), result.begin(), result.end());
+        auto r = select_by_tokens(_unleveled_sstables, range);
+        _leveled_sstables.for_each_overlapping(
+                range.start() ? range.start()->value().token() : dht::minimum_token(),
+                range.end() ? range.end()->value().token() : dht::maximum_token(),
+                [&r] (const shared_sstable& sst) {
+            r.push_back(sst);
+        });
         return r;
     }
     virtual void insert(shared_sstable sst) override {
-        if (sst->get_sstable_level() == 0) {
-            _unleveled_sstables.push_back(std::move(sst));
-        } else {
-            auto first = sst->get_first_decorated_key().token();
-            auto last = sst->get_last_decorated_key().token();
-            using bound = dht::partition_range::bound;
-            _leveled_sstables.add({
-                    make_interval(
-                            dht::partition_range(
-                                    bound(dht::ring_position::starting_at(first)),
-                                    bound(dht::ring_position::ending_at(last)))),
-                    value_set({sst})});
-        }
+        auto& tree = tree_of(sst);
+        insert_by_tokens(tree, std::move(sst));
     }
     virtual void erase(shared_sstable sst) override {
-        if (sst->get_sstable_level() == 0) {
-            _unleveled_sstables.erase(std::remove(_unleveled_sstables.begin(), _unleveled_sstables.end(), sst), _unleveled_sstables.end());
-        } else {
-            auto first = sst->get_first_decorated_key().token();
-            auto last = sst->get_last_decorated_key().token();
-            using bound = dht::partition_range::bound;
-            _leveled_sstables.subtract({
-                    make_interval(
-                            dht::partition_range(
-                                    bound(dht::ring_position::starting_at(first)),
-                                    bound(dht::ring_position::ending_at(last)))),
-                    value_set({sst})});
+        // The level may have changed since the sstable was inserted.
+        if (!erase_by_tokens(tree_of(sst), sst)) {
+            erase_by_tokens(_unleveled_sstables, sst);
+            erase_by_tokens(_leveled_sstables, sst);
         }
     }
+    virtual std::vector<shared_sstable> all() const override {
+        auto r = _unleveled_sstables.values();
+        _leveled_sstables.for_each([&r] (const shared_sstable& sst) {
+            r.push_back(sst);
+        });
+        return r;
+    }
+    virtual size_t size() const override {
+        return _unleveled_sstables.size() + _leveled_sstables.size();
+    }
     virtual std::unique_ptr<incremental_selector_impl> make_incremental_selector() const override;
     class incremental_selector;
 };
 
+// Holds its own versions of the trees, which are cheap to copy, so it's not
+// affected by later changes to the set.
 class partitioned_sstable_set::incremental_selector : public incremental_selector_impl {
-    schema_ptr _schema;
-    const std::vector<shared_sstable>& _unleveled_sstables;
-    map_iterator _it;
-    const map_iterator _end;
-private:
-    static dht::token_range to_token_range(const interval_type& i) {
-        return dht::token_range::make({i.lower().token(), boost::icl::is_left_closed(i.bounds())},
-            {i.upper().token(), boost::icl::is_right_closed(i.bounds())});
-    }
+    const std::vector<shared_sstable> _unleveled_sstables;
+    const token_interval_tree _leveled_sstables;
 public:
-    incremental_selector(schema_ptr schema, const std::vector<shared_sstable>& unleveled_sstables, const interval_map_type& leveled_sstables)
-        : _schema(std::move(schema))
-        , _unleveled_sstables(unleveled_sstables)
-        , _it(leveled_sstables.begin())
-        , _end(leveled_sstables.end()) {
+    incremental_selector(const token_interval_tree& unleveled_sstables, const token_interval_tree& leveled_sstables)
+        : _unleveled_sstables(unleveled_sstables.values())
+        , _leveled_sstables(leveled_sstables) {
     }
+    // The selection stays the same from token up to whichever comes first of
+    // the end of a selected sstable and the start of another one.
     virtual std::pair<dht::token_range, std::vector<shared_sstable>> select(const dht::token& token) override {
-        auto pr = dht::partition_range::make(dht::ring_position::starting_at(token), dht::ring_position::ending_at(token));
-        auto interval = make_interval(*_schema, std::move(pr));
         auto ssts = _unleveled_sstables;
+        const dht::token* end = nullptr;
+        _leveled_sstables.for_each_overlapping(token, token, [&] (const shared_sstable& sst) {
+            ssts.push_back(sst);
+            auto& last = sst->get_last_decorated_key().token();
+            if (!end || last < *end) {
+                end = &last;
+            }
+        });
+        auto next = _leveled_sstables.first_start_after(token);
+        if (next && (!end || !(*end < *next))) {
+            return std::make_pair(dht::token_range::make({token, true}, {*next, false}), std::move(ssts));
+        }
+        if (end) {
+            return std::make_pair(dht::token_range::make({token, true}, {*end, true}), std::move(ssts));
+        }
+        return std::make_pair(dht::token_range::make_starting_with({token, true}), std::move(ssts));
+    }
+};
 
-        while (_it != _end) {
-            if (boost::icl::contains(_it->first, interval)) {
-                ssts.insert(ssts.end(), _it->second.begin(), _it->second.end());
-                return std::make_pair(to_token_range(_it->first), std::move(ssts));
+std::unique_ptr<incremental_selector_impl> partitioned_sstable_set::make_incremental_selector() const {
+    return std::make_unique<incremental_selector>(_unleveled_sstables, _leveled_sstables);
+}
+
+// Used by the time window compaction strategy. Keeps the sstables grouped by
+// the time window of their max timestamp, so that they are handed out newest
+// window first, and so that the windows older than the data looked for are
+// skipped as a whole.
+class time_window_sstable_set : public sstable_set_impl {
+    using windows_type = std::map<api::timestamp_type, token_interval_tree, std::greater<api::timestamp_type>>;
+    api::timestamp_type _window_size;
+    windows_type _windows;
+private:
+    api::timestamp_type window_of(const shared_sstable& sst) const {
+        return time_window_manifest::get_window_lower_bound(_window_size, sst->get_stats_metadata().max_timestamp);
+    }
+public:
+    explicit time_window_sstable_set(api::timestamp_type window_size)
+            : _window_size(window_size) {
+    }
+    // The trees share their nodes with those of the copy, so copying the set
+    // takes time linear only in the number of windows.
+    virtual std::unique_ptr<sstable_set_impl> clone() const override {
+        return std::make_unique<time_window_sstable_set>(*this);
+    }
+    // Newest window first, like select().
+    virtual std::vector<shared_sstable> all() const override {
+        std::vector<shared_sstable> ret;
+        for (auto& w : _windows) {
+            w.second.for_each([&ret] (const shared_sstable& sst) {
+                ret.push_back(sst);
+            });
+        }
+        return ret;
+    }
+    virtual size_t size() const override {
+        size_t ret = 0;
+        for (auto& w : _windows) {
+            ret += w.second.size();
+        }
+        return ret;
+    }
+    virtual std::vector<shared_sstable> select(const dht::partition_range& range) const override {
+        std::vector<shared_sstable> ret;
+        for (auto& w : _windows) {
+            auto ssts = select_by_tokens(w.second, range);
+            ret.insert(ret.end(), ssts.begin(), ssts.end());
+        }
+        return ret;
+    }
+    // The max timestamps of the sstables of a window are all below its end,
+    // so the windows which end by min_timestamp, and all the older ones, are
+    // not looked at. Only the sstables of the window holding min_timestamp
+    // are checked one by one.
+    virtual std::vector<shared_sstable> select_since(const dht::partition_range& range, api::timestamp_type min_timestamp) const override {
+        std::vector<shared_sstable> ret;
+        for (auto& w : _windows) {
+            if (w.first + _window_size <= min_timestamp) {
+                break;
+            }
+            auto ssts = select_by_tokens(w.second, range);
+            for (auto& sst : ssts) {
+                if (w.first >= min_timestamp || sst->get_stats_metadata().max_timestamp >= min_timestamp) {
+                    ret.push_back(std::move(sst));
+                }
             }
-            // we don't want to skip current interval if token lies before it.
-            if (boost::icl::lower_less(interval, _it->first)) {
-                return std::make_pair(dht::token_range::make({token, true}, {_it->first.lower().token(), false}),
-                    std::move(ssts));
+        }
+        return ret;
+    }
+    virtual void for_each_time_window(api::timestamp_type window_size,
+            std::function<stop_iteration (api::timestamp_type, std::vector<shared_sstable>)> func) const override {
+        if (window_size != _window_size) {
+            return sstable_set_impl::for_each_time_window(window_size, std::move(func));
+        }
+        for (auto& w : _windows) {
+            if (func(w.first, w.second.values()) == stop_iteration::yes) {
+                return;
             }
-            _it++;
         }
-        return std::make_pair(dht::token_range::make_open_ended_both_sides(), std::move(ssts));
     }
+    virtual void insert(shared_sstable sst) override {
+        auto window = window_of(sst);
+        insert_by_tokens(_windows[window], std::move(sst));
+    }
+    virtual void erase(shared_sstable sst) override {
+        auto it = _windows.find(window_of(sst));
+        if (it == _windows.end()) {
+            return;
+        }
+        erase_by_tokens(it->second, sst);
+        if (it->second.empty()) {
+            _windows.erase(it);
+        }
+    }
+    virtual std::unique_ptr<incremental_selector_impl> make_incremental_selector() const override;
+    class incremental_selector;
 };
 
-std::unique_ptr<incremental_selector_impl> partitioned_sstable_set::make_incremental_selector() const {
-    return std::make_unique<incremental_selector>(_schema, _unleveled_sstables, _leveled_sstables);
+// The selection stays the same from token up to whichever comes first, in
+// any window, of the end of a selected sstable and the start of another one.
+class time_window_sstable_set::incremental_selector : public incremental_selector_impl {
+    const time_window_sstable_set& _set;
+public:
+    incremental_selector(const time_window_sstable_set& set)
+        : _set(set) {
+    }
+    virtual std::pair<dht::token_range, std::vector<shared_sstable>> select(const dht::token& token) override {
+        std::vector<shared_sstable> ssts;
+        const dht::token* end = nullptr;
+        const dht::token* next = nullptr;
+        for (auto& w : _set._windows) {
+            w.second.for_each_overlapping(token, token, [&] (const shared_sstable& sst) {
+                ssts.push_back(sst);
+                auto& last = sst->get_last_decorated_key().token();
+                if (!end || last < *end) {
+                    end = &last;
+                }
+            });
+            auto n = w.second.first_start_after(token);
+            if (n && (!next || *n < *next)) {
+                next = n;
+            }
+        }
+        if (next && (!end || !(*end < *next))) {
+            return std::make_pair(dht::token_range::make({token, true}, {*next, false}), std::move(ssts));
+        }
+        if (end) {
+            return std::make_pair(dht::token_range::make({token, true}, {*end, true}), std::move(ssts));
+        }
+        return std::make_pair(dht::token_range::make_starting_with({token, true}), std::move(ssts));
+    }
+};
+
+std::unique_ptr<incremental_selector_impl> time_window_sstable_set::make_incremental_selector() const {
+    return std::make_unique<incremental_selector>(*this);
+}
+
+static std::vector<shared_sstable> current_sstables(column_family& cf) {
+    return boost::copy_range<std::vector<shared_sstable>>(*cf.get_sstables());
+}
+
+// When sstables are merged tier by tier, fan_out at a time, every byte is
+// rewritten once for every tier it has yet to climb before all the data ends
+// up in a single sstable. The fragments of an sstable run are one sstable.
+static double size_tiered_backlog(const std::vector<shared_sstable>& sstables, int fan_out) {
+    std::unordered_map<utils::UUID, uint64_t> run_sizes;
+    uint64_t total = 0;
+    for (auto& sst : sstables) {
+        run_sizes[sst->run_identifier()] += sst->data_size();
+        total += sst->data_size();
+    }
+    double backlog = 0;
+    auto log_fan_out = std::log(std::max(fan_out, 2));
+    for (auto& entry : run_sizes) {
+        if (entry.second) {
+            backlog += entry.second * std::log(double(total) / entry.second) / log_fan_out;
+        }
+    }
+    return backlog;
 }
 
 class compaction_strategy_impl {
+    static constexpr double DEFAULT_TOMBSTONE_THRESHOLD = 0.2;
+    // In seconds, 1 day
+    static constexpr long DEFAULT_TOMBSTONE_COMPACTION_INTERVAL = 86400;
+    const sstring TOMBSTONE_THRESHOLD_OPTION = "tombstone_threshold";
+    const sstring TOMBSTONE_COMPACTION_INTERVAL_OPTION = "tombstone_compaction_interval";
+    const sstring UNCHECKED_TOMBSTONE_COMPACTION_OPTION = "unchecked_tombstone_compaction";
+    // In seconds, 10 minutes
+    static constexpr long DEFAULT_EXPIRED_SSTABLE_CHECK_FREQUENCY = 600;
+    const sstring EXPIRED_SSTABLE_CHECK_FREQUENCY_OPTION = "expired_sstable_check_frequency_seconds";
+    // 0 disables moving sstables to cold storage.
+    static constexpr long DEFAULT_COLD_STORAGE_AFTER_DAYS = 0;
+    const sstring COLD_STORAGE_AFTER_DAYS_OPTION = "cold_storage_after_days";
+
+    db_clock::duration _expired_sstable_check_frequency = std::chrono::seconds(long(DEFAULT_EXPIRED_SSTABLE_CHECK_FREQUENCY));
+    db_clock::time_point _last_expired_check;
+    std::chrono::hours _cold_storage_after = std::chrono::hours(0);
 protected:
-    bool _use_clustering_key_filter = false;
+    bool _use_clustering_key_filter = true;
+    double _tombstone_threshold = DEFAULT_TOMBSTONE_THRESHOLD;
+    db_clock::duration _tombstone_compaction_interval = std::chrono::seconds(long(DEFAULT_TOMBSTONE_COMPACTION_INTERVAL));
+    bool _unchecked_tombstone_compaction = false;
+
+    compaction_strategy_impl() = default;
+
+    explicit compaction_strategy_impl(const std::map<sstring, sstring>& options) {
+        using namespace cql3::statements;
+
+        auto get_value = [&options] (const sstring& name) -> std::experimental::optional<sstring> {
+            auto it = options.find(name);
+            if (it == options.end()) {
+                return std::experimental::nullopt;
+            }
+            return it->second;
+        };
+        _tombstone_threshold = property_definitions::to_double(TOMBSTONE_THRESHOLD_OPTION,
+            get_value(TOMBSTONE_THRESHOLD_OPTION), DEFAULT_TOMBSTONE_THRESHOLD);
+        auto interval = property_definitions::to_long(TOMBSTONE_COMPACTION_INTERVAL_OPTION,
+            get_value(TOMBSTONE_COMPACTION_INTERVAL_OPTION), DEFAULT_TOMBSTONE_COMPACTION_INTERVAL);
+        _tombstone_compaction_interval = std::chrono::seconds(interval);
+        auto unchecked = get_value(UNCHECKED_TOMBSTONE_COMPACTION_OPTION);
+        _unchecked_tombstone_compaction = unchecked && *unchecked == "true";
+        auto frequency = property_definitions::to_long(EXPIRED_SSTABLE_CHECK_FREQUENCY_OPTION,
+            get_value(EXPIRED_SSTABLE_CHECK_FREQUENCY_OPTION), DEFAULT_EXPIRED_SSTABLE_CHECK_FREQUENCY);
+        _expired_sstable_check_frequency = std::chrono::seconds(frequency);
+        auto cold_storage_after = property_definitions::to_long(COLD_STORAGE_AFTER_DAYS_OPTION,
+            get_value(COLD_STORAGE_AFTER_DAYS_OPTION), DEFAULT_COLD_STORAGE_AFTER_DAYS);
+        if (cold_storage_after < 0) {
+            throw exceptions::configuration_exception(sprint("%s must be non-negative, got %d", COLD_STORAGE_AFTER_DAYS_OPTION, cold_storage_after));
+        }
+        _cold_storage_after = std::chrono::hours(24 * cold_storage_after);
+    }
+
+    // Return the fully expired sstables among candidates, which compaction
+    // deletes without rewriting them. Looking for them is expensive, so it's
+    // only done every expired_sstable_check_frequency_seconds.
+    std::vector<shared_sstable> maybe_get_fully_expired_sstables(column_family& cf, std::vector<shared_sstable>& candidates) {
+        auto now = db_clock::now();
+        if (now - _last_expired_check < _expired_sstable_check_frequency) {
+            return {};
+        }
+        _last_expired_check = now;
+        auto gc_before = gc_clock::now() - cf.schema()->gc_grace_seconds();
+        return get_fully_expired_sstables(cf, candidates, gc_before.time_since_epoch().count());
+    }
+
+    // Return true if compacting the sstable alone is expected to purge enough
+    // of its tombstones: it is older than tombstone_compaction_interval, more
+    // than tombstone_threshold of its cells are droppable tombstones, and no
+    // other sstable overlapping it may hold data older than its newest cell,
+    // which would keep its tombstones from being purged.
+    bool worth_dropping_tombstones(const shared_sstable& sst, column_family& cf, gc_clock::time_point gc_before) const;
+
+    // Return the sstable among candidates whose tombstones are most worth
+    // dropping, or nullptr if none of them is.
+    shared_sstable most_worth_dropping_tombstones(const std::vector<shared_sstable>& candidates, column_family& cf) const;
 public:
     virtual ~compaction_strategy_impl() {}
     virtual compaction_descriptor get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) = 0;
@@ -331,21 +604,119 @@ class compaction_strategy_impl {
     virtual std::unique_ptr<sstable_set_impl> make_sstable_set(schema_ptr schema) const {
         return std::make_unique<bag_sstable_set>();
     }
+    virtual uint64_t fragment_size() const {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    // Bytes left to be written by compaction, before the strategy is satisfied.
+    virtual double backlog(column_family& cf) const {
+        return size_tiered_backlog(current_sstables(cf), cf.schema()->min_compaction_threshold());
+    }
+    virtual output_splitter_ptr make_output_splitter() const {
+        return {};
+    }
     bool use_clustering_key_filter() const {
         return _use_clustering_key_filter;
     }
+
+    // Return a job moving the candidate with the oldest data to the cold
+    // data directory of the table, if its data is all older than
+    // cold_storage_after_days. The move is a compaction of the sstable alone,
+    // which writes its output to that directory.
+    compaction_descriptor get_sstables_for_cold_storage(column_family& cf, const std::vector<shared_sstable>& candidates) const;
 };
 
+compaction_descriptor compaction_strategy_impl::get_sstables_for_cold_storage(column_family& cf, const std::vector<shared_sstable>& candidates) const {
+    if (_cold_storage_after.count() == 0 || cf.cold_dir().empty()) {
+        return compaction_descriptor();
+    }
+    auto threshold = api::new_timestamp() - std::chrono::duration_cast<std::chrono::microseconds>(_cold_storage_after).count();
+    shared_sstable oldest;
+    for (auto& sst : candidates) {
+        if (sst->is_shared() || sst->get_dir() == cf.cold_dir()) {
+            continue;
+        }
+        auto max_timestamp = sst->get_stats_metadata().max_timestamp;
+        if (max_timestamp < threshold && (!oldest || max_timestamp < oldest->get_stats_metadata().max_timestamp)) {
+            oldest = sst;
+        }
+    }
+    if (!oldest) {
+        return compaction_descriptor();
+    }
+    clogger.info("Moving {} of {}.{} to cold storage", oldest->get_filename(), cf.schema()->ks_name(), cf.schema()->cf_name());
+    auto descriptor = compaction_descriptor({oldest}, oldest->get_sstable_level());
+    descriptor.output_dir = cf.cold_dir();
+    return descriptor;
+}
+
+bool compaction_strategy_impl::worth_dropping_tombstones(const shared_sstable& sst, column_family& cf, gc_clock::time_point gc_before) const {
+    if (db_clock::now() - sst->data_file_write_time() < _tombstone_compaction_interval) {
+        return false;
+    }
+    if (sst->estimate_droppable_tombstone_ratio(gc_before) <= _tombstone_threshold) {
+        return false;
+    }
+    if (_unchecked_tombstone_compaction) {
+        return true;
+    }
+    auto others = boost::copy_range<std::vector<shared_sstable>>(*cf.get_sstables()
+            | boost::adaptors::filtered([&sst] (const shared_sstable& other) { return other != sst; }));
+    auto max_timestamp = sst->get_stats_metadata().max_timestamp;
+    return boost::algorithm::none_of(leveled_manifest::overlapping(*cf.schema(), sst, others), [max_timestamp] (const shared_sstable& other) {
+        return other->get_stats_metadata().min_timestamp <= max_timestamp;
+    });
+}
+
+shared_sstable compaction_strategy_impl::most_worth_dropping_tombstones(const std::vector<shared_sstable>& candidates, column_family& cf) const {
+    auto gc_before = gc_clock::now() - cf.schema()->gc_grace_seconds();
+    shared_sstable best;
+    double best_ratio = 0;
+    for (auto& sst : candidates) {
+        if (!worth_dropping_tombstones(sst, cf, gc_before)) {
+            continue;
+        }
+        auto ratio = sst->estimate_droppable_tombstone_ratio(gc_before);
+        if (!best || ratio > best_ratio) {
+            best = sst;
+            best_ratio = ratio;
+        }
+    }
+    return best;
+}
+
+// Spreads resharding jobs across all shards so that every shard has about the
+// same amount of data to rewrite: the biggest jobs are placed first, each at the
+// least loaded shard. Jobs don't share sstables, so they all run in parallel,
+// one at a time per shard.
+static void balance_resharding_jobs(std::vector<resharding_descriptor>& jobs) {
+    auto job_size = [] (const resharding_descriptor& job) {
+        return boost::accumulate(job.sstables | boost::adaptors::transformed(std::mem_fn(&sstable::data_size)), uint64_t(0));
+    };
+    std::vector<std::pair<uint64_t, resharding_descriptor*>> by_size;
+    by_size.reserve(jobs.size());
+    for (auto& job : jobs) {
+        by_size.emplace_back(job_size(job), &job);
+    }
+    std::stable_sort(by_size.begin(), by_size.end(), [] (auto& a, auto& b) { return a.first > b.first; });
+
+    std::vector<uint64_t> shard_load(smp::count, 0);
+    for (auto& p : by_size) {
+        auto shard = std::distance(shard_load.begin(), boost::min_element(shard_load));
+        p.second->reshard_at = shard;
+        shard_load[shard] += p.first;
+    }
+}
+
 std::vector<resharding_descriptor>
 compaction_strategy_impl::get_resharding_jobs(column_family& cf, std::vector<sstables::shared_sstable> candidates) {
     std::vector<resharding_descriptor> jobs;
-    shard_id reshard_at_current = 0;
 
     clogger.debug("Trying to get resharding jobs for {}.{}...", cf.schema()->ks_name(), cf.schema()->cf_name());
     for (auto& candidate : candidates) {
         auto level = candidate->get_sstable_level();
-        jobs.push_back(resharding_descriptor{{std::move(candidate)}, std::numeric_limits<uint64_t>::max(), reshard_at_current++ % smp::count, level});
+        jobs.push_back(resharding_descriptor{{std::move(candidate)}, std::numeric_limits<uint64_t>::max(), 0, level});
     }
+    balance_resharding_jobs(jobs);
     return jobs;
 }
 
@@ -363,6 +734,10 @@ class null_compaction_strategy : public compaction_strategy_impl {
         return 0;
     }
 
+    virtual double backlog(column_family& cf) const override {
+        return 0;
+    }
+
     virtual compaction_strategy_type type() const {
         return compaction_strategy_type::null;
     }
@@ -400,11 +775,15 @@ class size_tiered_compaction_strategy_options {
     const sstring BUCKET_LOW_KEY = "bucket_low";
     const sstring BUCKET_HIGH_KEY = "bucket_high";
     const sstring COLD_READS_TO_OMIT_KEY = "cold_reads_to_omit";
+    const sstring SSTABLE_SIZE_KEY = "sstable_size_in_mb";
 
     uint64_t min_sstable_size = DEFAULT_MIN_SSTABLE_SIZE;
     double bucket_low = DEFAULT_BUCKET_LOW;
     double bucket_high = DEFAULT_BUCKET_HIGH;
     double cold_reads_to_omit =  DEFAULT_COLD_READS_TO_OMIT;
+    // If set, the output of a compaction is split into fragments of this size,
+    // which let the compaction release its input incrementally.
+    uint64_t sstable_size = std::numeric_limits<uint64_t>::max();
 public:
     static std::experimental::optional<sstring> get_value(const std::map<sstring, sstring>& options, const sstring& name) {
         auto it = options.find(name);
@@ -428,6 +807,12 @@ class size_tiered_compaction_strategy_options {
 
         tmp_value = get_value(options, COLD_READS_TO_OMIT_KEY);
         cold_reads_to_omit = property_definitions::to_double(COLD_READS_TO_OMIT_KEY, tmp_value, DEFAULT_COLD_READS_TO_OMIT);
+
+        tmp_value = get_value(options, SSTABLE_SIZE_KEY);
+        auto sstable_size_in_mb = property_definitions::to_long(SSTABLE_SIZE_KEY, tmp_value, 0);
+        if (sstable_size_in_mb > 0) {
+            sstable_size = uint64_t(sstable_size_in_mb) << 20;
+        }
     }
 
     size_tiered_compaction_strategy_options() {
@@ -484,32 +869,48 @@ class size_tiered_compaction_strategy_options {
 class size_tiered_compaction_strategy : public compaction_strategy_impl {
     size_tiered_compaction_strategy_options _options;
 
-    // Return a list of pair of shared_sstable and its respective size.
-    std::vector<std::pair<sstables::shared_sstable, uint64_t>> create_sstable_and_length_pairs(const std::vector<sstables::shared_sstable>& sstables) const;
+    // The fragments of an sstable run are bucketed, and compacted, as a whole.
+    using sstable_run = std::vector<sstables::shared_sstable>;
 
-    // Group files of similar size into buckets.
-    std::vector<std::vector<sstables::shared_sstable>> get_buckets(const std::vector<sstables::shared_sstable>& sstables) const;
+    // Group sstables into runs. An sstable which is not part of a run is
+    // a run of its own.
+    static std::vector<sstable_run> get_runs(const std::vector<sstables::shared_sstable>& sstables);
+
+    static uint64_t run_size(const sstable_run& run) {
+        uint64_t n = 0;
+        for (auto& sstable : run) {
+            // FIXME: Switch to sstable->bytes_on_disk() afterwards. That's what C* uses.
+            n += sstable->data_size();
+        }
+        return n;
+    }
+
+    // Return a list of pair of sstable run and its respective size.
+    std::vector<std::pair<sstable_run, uint64_t>> create_run_and_length_pairs(std::vector<sstable_run> runs) const;
+
+    // Group runs of similar size into buckets.
+    std::vector<std::vector<sstable_run>> get_buckets(const std::vector<sstables::shared_sstable>& sstables) const;
 
     // Maybe return a bucket of sstables to compact
     std::vector<sstables::shared_sstable>
-    most_interesting_bucket(std::vector<std::vector<sstables::shared_sstable>> buckets, unsigned min_threshold, unsigned max_threshold);
+    most_interesting_bucket(std::vector<std::vector<sstable_run>> buckets, unsigned min_threshold, unsigned max_threshold);
 
-    // Return the average size of a given list of sstables.
-    uint64_t avg_size(std::vector<sstables::shared_sstable>& sstables) {
-        assert(sstables.size() > 0); // this should never fail
+    // Return the average size of a given list of runs.
+    uint64_t avg_size(std::vector<sstable_run>& runs) {
+        assert(runs.size() > 0); // this should never fail
         uint64_t n = 0;
 
-        for (auto& sstable : sstables) {
-            // FIXME: Switch to sstable->bytes_on_disk() afterwards. That's what C* uses.
-            n += sstable->data_size();
+        for (auto& run : runs) {
+            n += run_size(run);
         }
 
-        return n / sstables.size();
+        return n / runs.size();
     }
 public:
     size_tiered_compaction_strategy() = default;
-    size_tiered_compaction_strategy(const std::map<sstring, sstring>& options) :
-        _options(options) {}
+    size_tiered_compaction_strategy(const std::map<sstring, sstring>& options)
+        : compaction_strategy_impl(options)
+        , _options(options) {}
 
     virtual compaction_descriptor get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) override;
 
@@ -521,37 +922,56 @@ class size_tiered_compaction_strategy : public compaction_strategy_impl {
     virtual compaction_strategy_type type() const {
         return compaction_strategy_type::size_tiered;
     }
+
+    virtual uint64_t fragment_size() const override {
+        return _options.sstable_size;
+    }
 };
 
-std::vector<std::pair<sstables::shared_sstable, uint64_t>>
-size_tiered_compaction_strategy::create_sstable_and_length_pairs(const std::vector<sstables::shared_sstable>& sstables) const {
+std::vector<size_tiered_compaction_strategy::sstable_run>
+size_tiered_compaction_strategy::get_runs(const std::vector<sstables::shared_sstable>& sstables) {
+    std::unordered_map<utils::UUID, sstable_run> runs;
+    std::vector<sstable_run> ret;
+
+    for (auto& sstable : sstables) {
+        runs[sstable->run_identifier()].push_back(sstable);
+    }
+    ret.reserve(runs.size());
+    for (auto& entry : runs) {
+        ret.push_back(std::move(entry.second));
+    }
+    return ret;
+}
+
+std::vector<std::pair<size_tiered_compaction_strategy::sstable_run, uint64_t>>
+size_tiered_compaction_strategy::create_run_and_length_pairs(std::vector<sstable_run> runs) const {
 
-    std::vector<std::pair<sstables::shared_sstable, uint64_t>> sstable_length_pairs;
-    sstable_length_pairs.reserve(sstables.size());
+    std::vector<std::pair<sstable_run, uint64_t>> run_length_pairs;
+    run_length_pairs.reserve(runs.size());
 
-    for(auto& sstable : sstables) {
-        auto sstable_size = sstable->data_size();
-        assert(sstable_size != 0);
+    for(auto& run : runs) {
+        auto size = run_size(run);
+        assert(size != 0);
 
-        sstable_length_pairs.emplace_back(sstable, sstable_size);
+        run_length_pairs.emplace_back(std::move(run), size);
     }
 
-    return sstable_length_pairs;
+    return run_length_pairs;
 }
 
-std::vector<std::vector<sstables::shared_sstable>>
+std::vector<std::vector<size_tiered_compaction_strategy::sstable_run>>
 size_tiered_compaction_strategy::get_buckets(const std::vector<sstables::shared_sstable>& sstables) const {
-    // sstables sorted by size of its data file.
-    auto sorted_sstables = create_sstable_and_length_pairs(sstables);
+    // runs sorted by size of their data files.
+    auto sorted_runs = create_run_and_length_pairs(get_runs(sstables));
 
-    std::sort(sorted_sstables.begin(), sorted_sstables.end(), [] (auto& i, auto& j) {
+    std::sort(sorted_runs.begin(), sorted_runs.end(), [] (auto& i, auto& j) {
         return i.second < j.second;
     });
 
-    std::map<size_t, std::vector<sstables::shared_sstable>> buckets;
+    std::map<size_t, std::vector<sstable_run>> buckets;
 
     bool found;
-    for (auto& pair : sorted_sstables) {
+    for (auto& pair : sorted_runs) {
         found = false;
         size_t size = pair.second;
 
@@ -559,7 +979,7 @@ size_tiered_compaction_strategy::get_buckets(const std::vector<sstables::shared_
         // group in the same bucket if it's w/in 50% of the average for this bucket,
         // or this file and the bucket are all considered "small" (less than `minSSTableSize`)
         for (auto& entry : buckets) {
-            std::vector<sstables::shared_sstable> bucket = entry.second;
+            std::vector<sstable_run> bucket = entry.second;
             size_t old_average_size = entry.first;
 
             if ((size > (old_average_size * _options.bucket_low) && size < (old_average_size * _options.bucket_high)) ||
@@ -578,13 +998,13 @@ size_tiered_compaction_strategy::get_buckets(const std::vector<sstables::shared_
 
         // no similar bucket found; put it in a new one
         if (!found) {
-            std::vector<sstables::shared_sstable> new_bucket;
+            std::vector<sstable_run> new_bucket;
             new_bucket.push_back(pair.first);
             buckets.insert({ size, std::move(new_bucket) });
         }
     }
 
-    std::vector<std::vector<sstables::shared_sstable>> bucket_list;
+    std::vector<std::vector<sstable_run>> bucket_list;
     bucket_list.reserve(buckets.size());
 
     for (auto& entry : buckets) {
@@ -595,10 +1015,10 @@ size_tiered_compaction_strategy::get_buckets(const std::vector<sstables::shared_
 }
 
 std::vector<sstables::shared_sstable>
-size_tiered_compaction_strategy::most_interesting_bucket(std::vector<std::vector<sstables::shared_sstable>> buckets,
+size_tiered_compaction_strategy::most_interesting_bucket(std::vector<std::vector<sstable_run>> buckets,
         unsigned min_threshold, unsigned max_threshold)
 {
-    std::vector<std::pair<std::vector<sstables::shared_sstable>, uint64_t>> pruned_buckets_and_hotness;
+    std::vector<std::pair<std::vector<sstable_run>, uint64_t>> pruned_buckets_and_hotness;
     pruned_buckets_and_hotness.reserve(buckets.size());
 
     // FIXME: add support to get hotness for each bucket.
@@ -609,7 +1029,13 @@ size_tiered_compaction_strategy::most_interesting_bucket(std::vector<std::vector
         // By the time being, we will only compact buckets that meet the threshold.
         bucket.resize(std::min(bucket.size(), size_t(max_threshold)));
         if (bucket.size() >= min_threshold) {
-            auto avg = avg_size(bucket);
+            // Scored by the size it compacts down to, so that buckets whose
+            // sstables share many partitions are compacted sooner.
+            std::vector<sstables::shared_sstable> sstables;
+            for (auto& run : bucket) {
+                sstables.insert(sstables.end(), run.begin(), run.end());
+            }
+            auto avg = uint64_t(avg_size(bucket) * distinct_partitions_ratio(sstables));
             pruned_buckets_and_hotness.push_back({ std::move(bucket), avg });
         }
     }
@@ -624,7 +1050,10 @@ size_tiered_compaction_strategy::most_interesting_bucket(std::vector<std::vector
 
         return i.second < j.second;
     });
-    auto hottest = std::move(min.first);
+    std::vector<sstables::shared_sstable> hottest;
+    for (auto& run : min.first) {
+        hottest.insert(hottest.end(), run.begin(), run.end());
+    }
 
     return hottest;
 }
@@ -634,17 +1063,32 @@ compaction_descriptor size_tiered_compaction_strategy::get_sstables_for_compacti
     int min_threshold = cfs.schema()->min_compaction_threshold();
     int max_threshold = cfs.schema()->max_compaction_threshold();
 
+    auto expired = maybe_get_fully_expired_sstables(cfs, candidates);
+    if (!expired.empty()) {
+        clogger.debug("size-tiered: Dropping {} fully expired sstables", expired.size());
+        auto desc = sstables::compaction_descriptor(expired);
+        desc.expired = std::move(expired);
+        return desc;
+    }
+
     // TODO: Add support to filter cold sstables (for reference: SizeTieredCompactionStrategy::filterColdSSTables).
 
     auto buckets = get_buckets(candidates);
 
     std::vector<sstables::shared_sstable> most_interesting = most_interesting_bucket(std::move(buckets), min_threshold, max_threshold);
-    if (most_interesting.empty()) {
+    if (!most_interesting.empty()) {
+        return sstables::compaction_descriptor(std::move(most_interesting));
+    }
+
+    // If there is no sstable to compact in standard way, try compacting a single sstable whose droppable
+    // tombstone ratio is greater than threshold.
+    auto sst = most_worth_dropping_tombstones(candidates, cfs);
+    if (!sst) {
         // nothing to do
         return sstables::compaction_descriptor();
     }
-
-    return sstables::compaction_descriptor(std::move(most_interesting));
+    clogger.debug("size-tiered: Compacting {} to drop its tombstones", sst->get_filename());
+    return sstables::compaction_descriptor(std::vector<sstables::shared_sstable>{ sst });
 }
 
 int64_t size_tiered_compaction_strategy::estimated_pending_compactions(column_family& cf) const {
@@ -697,15 +1141,173 @@ size_tiered_most_interesting_bucket(const std::list<sstables::shared_sstable>& c
     return most_interesting;
 }
 
+//
+// Time window compaction strategy is meant for time series. Sstables are
+// grouped by the fixed time window of their max timestamp. The newest window
+// is compacted with size-tiered compaction while it is being written to. Once
+// a window is closed, all of its sstables are compacted together, so that each
+// window ends up with a single sstable which is not compacted again.
+//
+class time_window_compaction_strategy : public compaction_strategy_impl {
+    time_window_compaction_strategy_options _options;
+    size_tiered_compaction_strategy _stcs;
+    db_clock::time_point _last_expired_check;
+public:
+    time_window_compaction_strategy(const std::map<sstring, sstring>& options)
+        : _options(options)
+        , _stcs(options)
+    { }
+
+    virtual compaction_descriptor get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) override;
+
+    virtual int64_t estimated_pending_compactions(column_family& cf) const override;
+
+    virtual double backlog(column_family& cf) const override;
+
+    virtual compaction_strategy_type type() const {
+        return compaction_strategy_type::time_window;
+    }
+
+    virtual std::unique_ptr<sstable_set_impl> make_sstable_set(schema_ptr schema) const override {
+        return std::make_unique<time_window_sstable_set>(_options.window_size());
+    }
+
+    // Data which isn't in the window of its sstable, e.g. written out of
+    // order, goes to the sstable of its own window once compacted.
+    virtual output_splitter_ptr make_output_splitter() const override {
+        return make_time_window_splitter(_options.window_size());
+    }
+private:
+    std::vector<sstables::shared_sstable>
+    get_next_non_expired_sstables(column_family& cf, std::vector<sstables::shared_sstable> non_expiring_sstables);
+
+    // Trims the bucket to the max_threshold smallest sstables.
+    static void trim_to_threshold(std::vector<sstables::shared_sstable>& bucket, int max_threshold) {
+        std::sort(bucket.begin(), bucket.end(), [] (auto& i, auto& j) {
+            return i->ondisk_data_size() < j->ondisk_data_size();
+        });
+        bucket.resize(std::min(bucket.size(), size_t(max_threshold)));
+    }
+};
+
+compaction_descriptor time_window_compaction_strategy::get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) {
+    if (candidates.empty()) {
+        return sstables::compaction_descriptor();
+    }
+
+    // Find fully expired sstables, which will be included no matter what.
+    // Looking for them is expensive, so it's only done every once in a while.
+    std::vector<sstables::shared_sstable> expired;
+    auto now = db_clock::now();
+    if (now - _last_expired_check > _options.get_expired_sstable_check_frequency()) {
+        auto gc_before = gc_clock::now() - cfs.schema()->gc_grace_seconds();
+        expired = get_fully_expired_sstables(cfs, candidates, gc_before.time_since_epoch().count());
+        _last_expired_check = now;
+    }
+
+    std::unordered_set<sstables::shared_sstable> expired_set(expired.begin(), expired.end());
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&expired_set] (auto& sst) {
+        return expired_set.count(sst);
+    }), candidates.end());
+
+    auto compaction_candidates = get_next_non_expired_sstables(cfs, std::move(candidates));
+    compaction_candidates.insert(compaction_candidates.end(), expired.begin(), expired.end());
+    clogger.debug("timewindow: Compacting {} sstables, {} of them fully expired", compaction_candidates.size(), expired.size());
+    if (compaction_candidates.empty()) {
+        return sstables::compaction_descriptor();
+    }
+    auto desc = sstables::compaction_descriptor(std::move(compaction_candidates));
+    desc.expired = std::move(expired);
+    return desc;
+}
+
+std::vector<sstables::shared_sstable>
+time_window_compaction_strategy::get_next_non_expired_sstables(column_family& cf, std::vector<sstables::shared_sstable> non_expiring_sstables) {
+    int min_threshold = cf.schema()->min_compaction_threshold();
+    int max_threshold = cf.schema()->max_compaction_threshold();
+    std::unordered_set<sstables::shared_sstable> candidates(non_expiring_sstables.begin(), non_expiring_sstables.end());
+    std::vector<sstables::shared_sstable> ret;
+    bool current = true;
+
+    // Newest window first, straight from the windows of the sstable set, so
+    // that the windows older than the first one with work to do aren't
+    // looked at.
+    cf.get_sstable_set().for_each_time_window(_options.window_size(), [&] (api::timestamp_type, std::vector<sstables::shared_sstable> bucket) {
+        bucket.erase(boost::remove_if(bucket, [&candidates] (const sstables::shared_sstable& sst) {
+            return !candidates.count(sst);
+        }), bucket.end());
+        if (bucket.empty()) {
+            return stop_iteration::no;
+        }
+        if (std::exchange(current, false)) {
+            // The current window still receives new sstables, so size-tiered
+            // compaction keeps the number of its sstables down in the meantime.
+            if (bucket.size() >= size_t(min_threshold)) {
+                auto desc = _stcs.get_sstables_for_compaction(cf, std::move(bucket));
+                if (!desc.sstables.empty()) {
+                    ret = std::move(desc.sstables);
+                    return stop_iteration::yes;
+                }
+            }
+        } else if (bucket.size() >= 2) {
+            // A closed window is compacted into a single sstable.
+            trim_to_threshold(bucket, max_threshold);
+            ret = std::move(bucket);
+            return stop_iteration::yes;
+        }
+        return stop_iteration::no;
+    });
+    return ret;
+}
+
+int64_t time_window_compaction_strategy::estimated_pending_compactions(column_family& cf) const {
+    int min_threshold = cf.schema()->min_compaction_threshold();
+    int max_threshold = cf.schema()->max_compaction_threshold();
+    int64_t n = 0;
+    bool current = true;
+
+    cf.get_sstable_set().for_each_time_window(_options.window_size(), [&] (api::timestamp_type, std::vector<sstables::shared_sstable> bucket) {
+        auto threshold = std::exchange(current, false) ? size_t(min_threshold) : size_t(2);
+        if (bucket.size() >= threshold) {
+            n += std::ceil(double(bucket.size()) / max_threshold);
+        }
+        return stop_iteration::no;
+    });
+    return n;
+}
+
+double time_window_compaction_strategy::backlog(column_family& cf) const {
+    double backlog = 0;
+    bool current = true;
+
+    cf.get_sstable_set().for_each_time_window(_options.window_size(), [&] (api::timestamp_type, std::vector<sstables::shared_sstable> bucket) {
+        if (std::exchange(current, false)) {
+            backlog += size_tiered_backlog(bucket, cf.schema()->min_compaction_threshold());
+        } else if (bucket.size() >= 2) {
+            // A closed window is rewritten once, into a single sstable.
+            for (auto& sst : bucket) {
+                backlog += sst->data_size();
+            }
+        }
+        return stop_iteration::no;
+    });
+    return backlog;
+}
+
 class leveled_compaction_strategy : public compaction_strategy_impl {
     static constexpr int32_t DEFAULT_MAX_SSTABLE_SIZE_IN_MB = 160;
     const sstring SSTABLE_SIZE_OPTION = "sstable_size_in_mb";
+    // Number of L0 sstables above which L0 is size-tiered, 0 disables it.
+    const sstring L0_STCS_THRESHOLD_OPTION = "l0_stcs_threshold";
 
     int32_t _max_sstable_size_in_mb = DEFAULT_MAX_SSTABLE_SIZE_IN_MB;
+    int32_t _l0_stcs_threshold = leveled_manifest::DEFAULT_L0_STCS_THRESHOLD;
     stdx::optional<std::vector<stdx::optional<dht::decorated_key>>> _last_compacted_keys;
     std::vector<int> _compaction_counter;
 public:
-    leveled_compaction_strategy(const std::map<sstring, sstring>& options) {
+    leveled_compaction_strategy(const std::map<sstring, sstring>& options)
+        : compaction_strategy_impl(options)
+    {
         using namespace cql3::statements;
 
         auto tmp_value = size_tiered_compaction_strategy_options::get_value(options, SSTABLE_SIZE_OPTION);
@@ -717,6 +1319,11 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
             clogger.warn("Max sstable size of {}MB is configured. Testing done for CASSANDRA-5727 indicates that performance improves up to 160MB",
                 _max_sstable_size_in_mb);
         }
+        tmp_value = size_tiered_compaction_strategy_options::get_value(options, L0_STCS_THRESHOLD_OPTION);
+        _l0_stcs_threshold = property_definitions::to_int(L0_STCS_THRESHOLD_OPTION, tmp_value, leveled_manifest::DEFAULT_L0_STCS_THRESHOLD);
+        if (_l0_stcs_threshold < 0) {
+            throw exceptions::configuration_exception(sprint("%s must be non negative, got %d", L0_STCS_THRESHOLD_OPTION, _l0_stcs_threshold));
+        }
         _compaction_counter.resize(leveled_manifest::MAX_LEVELS);
     }
 
@@ -732,9 +1339,7 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
 
     virtual int64_t estimated_pending_compactions(column_family& cf) const override;
 
-    virtual bool parallel_compaction() const override {
-        return false;
-    }
+    virtual double backlog(column_family& cf) const override;
 
     virtual compaction_strategy_type type() const {
         return compaction_strategy_type::leveled;
@@ -745,19 +1350,34 @@ class leveled_compaction_strategy : public compaction_strategy_impl {
 };
 
 compaction_descriptor leveled_compaction_strategy::get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) {
+    auto expired = maybe_get_fully_expired_sstables(cfs, candidates);
+    if (!expired.empty()) {
+        clogger.debug("leveled: Dropping {} fully expired sstables", expired.size());
+        auto desc = sstables::compaction_descriptor(expired);
+        desc.expired = std::move(expired);
+        return desc;
+    }
+
     // NOTE: leveled_manifest creation may be slightly expensive, so later on,
     // we may want to store it in the strategy itself. However, the sstable
     // lists managed by the manifest may become outdated. For example, one
     // sstable in it may be marked for deletion after compacted.
     // Currently, we create a new manifest whenever it's time for compaction.
-    leveled_manifest manifest = leveled_manifest::create(cfs, candidates, _max_sstable_size_in_mb);
+    leveled_manifest manifest = leveled_manifest::create(cfs, candidates, _max_sstable_size_in_mb, _l0_stcs_threshold);
     if (!_last_compacted_keys) {
         generate_last_compacted_keys(manifest);
     }
     auto candidate = manifest.get_compaction_candidates(*_last_compacted_keys, _compaction_counter);
 
     if (candidate.sstables.empty()) {
-        return sstables::compaction_descriptor();
+        // Rewriting an sstable alone keeps it within its own key range, so it
+        // can stay in its level.
+        auto sst = most_worth_dropping_tombstones(candidates, cfs);
+        if (!sst) {
+            return sstables::compaction_descriptor();
+        }
+        clogger.debug("leveled: Compacting {} to drop its tombstones", sst->get_filename());
+        return sstables::compaction_descriptor(std::vector<sstables::shared_sstable>{ sst }, sst->get_sstable_level(), uint64_t(_max_sstable_size_in_mb) << 20);
     }
 
     clogger.debug("leveled: Compacting {} out of {} sstables", candidate.sstables.size(), cfs.get_sstables()->size());
@@ -769,13 +1389,11 @@ std::vector<resharding_descriptor> leveled_compaction_strategy::get_resharding_j
     leveled_manifest manifest = leveled_manifest::create(cf, candidates, _max_sstable_size_in_mb);
 
     std::vector<resharding_descriptor> descriptors;
-    shard_id target_shard = 0;
-    auto get_shard = [&target_shard] { return target_shard++ % smp::count; };
 
     // Basically, we'll iterate through all levels, and for each, we'll sort the
     // sstables by first key because there's a need to reshard together adjacent
     // sstables.
-    // The shard at which the job will run is chosen in a round-robin fashion.
+    // The shard at which each job will run is chosen once all of them are known.
     for (auto level = 0U; level <= manifest.get_level_count(); level++) {
         uint64_t max_sstable_size = !level ? std::numeric_limits<uint64_t>::max() : (_max_sstable_size_in_mb*1024*1024);
         auto& sstables = manifest.get_level(level);
@@ -783,7 +1401,7 @@ std::vector<resharding_descriptor> leveled_compaction_strategy::get_resharding_j
             return i->compare_by_first_key(*j) < 0;
         });
 
-        resharding_descriptor current_descriptor = resharding_descriptor{{}, max_sstable_size, get_shard(), level};
+        resharding_descriptor current_descriptor = resharding_descriptor{{}, max_sstable_size, 0, level};
 
         for (auto it = sstables.begin(); it != sstables.end(); it++) {
             current_descriptor.sstables.push_back(*it);
@@ -791,10 +1409,11 @@ std::vector<resharding_descriptor> leveled_compaction_strategy::get_resharding_j
             auto next = std::next(it);
             if (current_descriptor.sstables.size() == smp::count || next == sstables.end()) {
                 descriptors.push_back(std::move(current_descriptor));
-                current_descriptor = resharding_descriptor{{}, max_sstable_size, get_shard(), level};
+                current_descriptor = resharding_descriptor{{}, max_sstable_size, 0, level};
             }
         }
     }
+    balance_resharding_jobs(descriptors);
     return descriptors;
 }
 
@@ -847,23 +1466,41 @@ int64_t leveled_compaction_strategy::estimated_pending_compactions(column_family
     return manifest.get_estimated_tasks();
 }
 
+// Data is rewritten once for every level it has yet to be promoted through,
+// before settling in the highest level in use.
+double leveled_compaction_strategy::backlog(column_family& cf) const {
+    std::vector<uint64_t> level_sizes(leveled_manifest::MAX_LEVELS, 0);
+    uint32_t top_level = 0;
+    for (auto& sst : *cf.get_sstables()) {
+        auto level = std::min(sst->get_sstable_level(), uint32_t(leveled_manifest::MAX_LEVELS - 1));
+        level_sizes[level] += sst->data_size();
+        top_level = std::max(top_level, level);
+    }
+    double backlog = 0;
+    for (uint32_t level = 0; level < top_level; level++) {
+        backlog += double(level_sizes[level]) * (top_level - level);
+    }
+    return backlog;
+}
+
 class date_tiered_compaction_strategy : public compaction_strategy_impl {
     date_tiered_manifest _manifest;
 public:
     date_tiered_compaction_strategy(const std::map<sstring, sstring>& options)
         : _manifest(options)
-    {
-        _use_clustering_key_filter = true;
-    }
+    { }
 
     virtual compaction_descriptor get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) override {
         auto gc_before = gc_clock::now() - cfs.schema()->gc_grace_seconds();
-        auto sstables = _manifest.get_next_sstables(cfs, candidates, gc_before);
+        std::vector<sstables::shared_sstable> expired;
+        auto sstables = _manifest.get_next_sstables(cfs, candidates, gc_before, &expired);
         clogger.debug("datetiered: Compacting {} out of {} sstables", sstables.size(), candidates.size());
         if (sstables.empty()) {
             return sstables::compaction_descriptor();
         }
-        return sstables::compaction_descriptor(std::move(sstables));
+        auto desc = sstables::compaction_descriptor(std::move(sstables));
+        desc.expired = std::move(expired);
+        return desc;
     }
 
     virtual int64_t estimated_pending_compactions(column_family& cf) const override {
@@ -888,7 +1525,12 @@ compaction_strategy_type compaction_strategy::type() const {
 }
 
 compaction_descriptor compaction_strategy::get_sstables_for_compaction(column_family& cfs, std::vector<sstables::shared_sstable> candidates) {
-    return _compaction_strategy_impl->get_sstables_for_compaction(cfs, std::move(candidates));
+    auto descriptor = _compaction_strategy_impl->get_sstables_for_compaction(cfs, candidates);
+    if (descriptor.sstables.empty()) {
+        // Cold data is moved away only once the strategy is satisfied.
+        return _compaction_strategy_impl->get_sstables_for_cold_storage(cfs, candidates);
+    }
+    return descriptor;
 }
 
 std::vector<resharding_descriptor> compaction_strategy::get_resharding_jobs(column_family& cf, std::vector<sstables::shared_sstable> candidates) {
@@ -907,6 +1549,18 @@ int64_t compaction_strategy::estimated_pending_compactions(column_family& cf) co
     return _compaction_strategy_impl->estimated_pending_compactions(cf);
 }
 
+uint64_t compaction_strategy::fragment_size() const {
+    return _compaction_strategy_impl->fragment_size();
+}
+
+output_splitter_ptr compaction_strategy::make_output_splitter() const {
+    return _compaction_strategy_impl->make_output_splitter();
+}
+
+double compaction_strategy::backlog(column_family& cf) const {
+    return _compaction_strategy_impl->backlog(cf);
+}
+
 bool compaction_strategy::use_clustering_key_filter() const {
     return _compaction_strategy_impl->use_clustering_key_filter();
 }
@@ -937,6 +1591,9 @@ compaction_strategy make_compaction_strategy(compaction_strategy_type strategy,
     case compaction_strategy_type::date_tiered:
         impl = make_shared<date_tiered_compaction_strategy>(date_tiered_compaction_strategy(options));
         break;
+    case compaction_strategy_type::time_window:
+        impl = make_shared<time_window_compaction_strategy>(time_window_compaction_strategy(options));
+        break;
     default:
         throw std::runtime_error("strategy not supported");
     }
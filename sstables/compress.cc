@@ -31,12 +31,122 @@
 #include <lz4.h>
 #include <zlib.h>
 #include <snappy-c.h>
+#include <zstd.h>
 
 #include "unimplemented.hh"
 #include "stdx.hh"
 
 namespace sstables {
 
+class zstd_processor {
+    struct cdict_deleter {
+        void operator()(ZSTD_CDict* d) const { ZSTD_freeCDict(d); }
+    };
+    struct ddict_deleter {
+        void operator()(ZSTD_DDict* d) const { ZSTD_freeDDict(d); }
+    };
+    int _level;
+    std::unique_ptr<ZSTD_CDict, cdict_deleter> _cdict;
+    std::unique_ptr<ZSTD_DDict, ddict_deleter> _ddict;
+
+    // Contexts hold no state between calls, so one per thread is enough.
+    static ZSTD_CCtx* cctx() {
+        static thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> ctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+        return ctx.get();
+    }
+    static ZSTD_DCtx* dctx() {
+        static thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> ctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        return ctx.get();
+    }
+    static size_t check(size_t ret, const char* what) {
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error(sprint("zstd %s failure: %s", what, ZSTD_getErrorName(ret)));
+        }
+        return ret;
+    }
+public:
+    zstd_processor(int level, bytes_view dictionary) : _level(level) {
+        if (!dictionary.empty()) {
+            _cdict.reset(ZSTD_createCDict(dictionary.data(), dictionary.size(), level));
+            _ddict.reset(ZSTD_createDDict(dictionary.data(), dictionary.size()));
+            if (!_cdict || !_ddict) {
+                throw std::runtime_error("zstd dictionary initialization failure");
+            }
+        }
+    }
+    size_t compress(const char* input, size_t input_len, char* output, size_t output_len) const {
+        if (_cdict) {
+            return check(ZSTD_compress_usingCDict(cctx(), output, output_len, input, input_len, _cdict.get()), "compression");
+        }
+        return check(ZSTD_compressCCtx(cctx(), output, output_len, input, input_len, _level), "compression");
+    }
+    size_t uncompress(const char* input, size_t input_len, char* output, size_t output_len) const {
+        if (_ddict) {
+            return check(ZSTD_decompress_usingDDict(dctx(), output, output_len, input, input_len, _ddict.get()), "uncompression");
+        }
+        return check(ZSTD_decompressDCtx(dctx(), output, output_len, input, input_len), "uncompression");
+    }
+    static size_t compress_max_size(size_t input_len) {
+        return ZSTD_compressBound(input_len);
+    }
+
+    // Compresses with a context of its own, which holds the state of the
+    // frame between steps.
+    class incremental_compressor : public chunk_compressor {
+        std::shared_ptr<const zstd_processor> _processor;
+        std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> _cctx;
+        ZSTD_inBuffer _in;
+        ZSTD_outBuffer _out;
+    public:
+        explicit incremental_compressor(std::shared_ptr<const zstd_processor> p)
+                : _processor(std::move(p)), _cctx(ZSTD_createCCtx(), ZSTD_freeCCtx) {
+            if (!_cctx) {
+                throw std::bad_alloc();
+            }
+        }
+        virtual void start(const char* input, size_t input_len, char* output, size_t output_len) override {
+            auto cctx = _cctx.get();
+            check(ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only), "compression");
+            if (_processor->_cdict) {
+                check(ZSTD_CCtx_refCDict(cctx, _processor->_cdict.get()), "compression");
+            } else {
+                check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, _processor->_level), "compression");
+            }
+            check(ZSTD_CCtx_setPledgedSrcSize(cctx, input_len), "compression");
+            _in = ZSTD_inBuffer{input, input_len, 0};
+            _out = ZSTD_outBuffer{output, output_len, 0};
+        }
+        virtual bool step() override {
+            auto end = std::min(_in.size, _in.pos + step_size);
+            ZSTD_inBuffer in{_in.src, end, _in.pos};
+            auto directive = end == _in.size ? ZSTD_e_end : ZSTD_e_continue;
+            auto remaining = check(ZSTD_compressStream2(_cctx.get(), &_out, &in, directive), "compression");
+            _in.pos = in.pos;
+            if (_out.pos == _out.size && (remaining || _in.pos != _in.size)) {
+                throw std::runtime_error("possible overflow during compression");
+            }
+            return directive == ZSTD_e_end && !remaining;
+        }
+        virtual size_t compressed_size() const override {
+            return _out.pos;
+        }
+    };
+};
+
+static std::shared_ptr<const zstd_processor> make_zstd_processor(const disk_array<uint32_t, option>& options) {
+    int level = compression_parameters::DEFAULT_ZSTD_COMPRESSION_LEVEL;
+    bytes dictionary;
+    for (auto& opt : options.elements) {
+        auto value = sstring(reinterpret_cast<const char*>(opt.value.value.data()), opt.value.value.size());
+        if (opt.key.value == compression_parameters::COMPRESSION_LEVEL) {
+            level = std::stoi(value);
+        } else if (opt.key.value == compression_parameters::ZSTD_DICTIONARY) {
+            dictionary = from_hex(value);
+        }
+    }
+    return std::make_shared<const zstd_processor>(level, dictionary);
+}
+
 void compression::update(uint64_t compressed_file_length) {
     // FIXME: also process _compression.options (just for crc-check frequency)
      if (name.value == "LZ4Compressor") {
@@ -45,6 +155,8 @@ void compression::update(uint64_t compressed_file_length) {
          _uncompress = uncompress_snappy;
      } else if (name.value == "DeflateCompressor") {
          _uncompress = uncompress_deflate;
+     } else if (name.value == "ZstdCompressor") {
+         _zstd = make_zstd_processor(options);
      } else {
          throw std::runtime_error("unsupported compression type");
      }
@@ -65,11 +177,142 @@ void compression::set_compressor(compressor c) {
          _compress = compress_deflate;
          _compress_max_size = compress_max_size_deflate;
          name.value = "DeflateCompressor";
+     } else if (c == compressor::zstd) {
+         _zstd = std::make_shared<const zstd_processor>(compression_parameters::DEFAULT_ZSTD_COMPRESSION_LEVEL, bytes_view());
+         name.value = "ZstdCompressor";
      } else {
          throw std::runtime_error("unsupported compressor type");
      }
 }
 
+void compression::set_compressor(const compression_parameters& cp) {
+    if (cp.get_compressor() != compressor::zstd) {
+        set_compressor(cp.get_compressor());
+        return;
+    }
+    auto level = cp.compression_level();
+    auto& dictionary = cp.zstd_dictionary();
+    _zstd = std::make_shared<const zstd_processor>(level, dictionary ? from_hex(*dictionary) : bytes());
+    name.value = "ZstdCompressor";
+    options.elements.push_back({compression_parameters::COMPRESSION_LEVEL, to_bytes(to_sstring(level))});
+    if (dictionary) {
+        options.elements.push_back({compression_parameters::ZSTD_DICTIONARY, to_bytes(*dictionary)});
+    }
+}
+
+size_t compression::uncompress(const char* input, size_t input_len, char* output, size_t output_len) const {
+    if (_zstd) {
+        return _zstd->uncompress(input, input_len, output, output_len);
+    }
+    if (!_uncompress) {
+        throw std::runtime_error("uncompress is not supported");
+    }
+    return _uncompress(input, input_len, output, output_len);
+}
+
+size_t compression::compress(const char* input, size_t input_len, char* output, size_t output_len) const {
+    if (_zstd) {
+        return _zstd->compress(input, input_len, output, output_len);
+    }
+    if (!_compress) {
+        throw std::runtime_error("compress is not supported");
+    }
+    return _compress(input, input_len, output, output_len);
+}
+
+namespace {
+
+class one_step_compressor : public chunk_compressor {
+    const compression& _compression;
+    const char* _input;
+    size_t _input_len;
+    char* _output;
+    size_t _output_len;
+    size_t _compressed_size = 0;
+public:
+    explicit one_step_compressor(const compression& c) : _compression(c) { }
+    virtual void start(const char* input, size_t input_len, char* output, size_t output_len) override {
+        _input = input;
+        _input_len = input_len;
+        _output = output;
+        _output_len = output_len;
+    }
+    virtual bool step() override {
+        _compressed_size = _compression.compress(_input, _input_len, _output, _output_len);
+        return true;
+    }
+    virtual size_t compressed_size() const override {
+        return _compressed_size;
+    }
+};
+
+// Same output as compress_deflate().
+class deflate_compressor : public chunk_compressor {
+    z_stream _zs;
+    size_t _output_len;
+    const char* _end;
+public:
+    deflate_compressor() {
+        _zs.zalloc = Z_NULL;
+        _zs.zfree = Z_NULL;
+        _zs.opaque = Z_NULL;
+        _zs.avail_in = 0;
+        _zs.next_in = Z_NULL;
+        if (deflateInit(&_zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            throw std::runtime_error("deflate compression init failure");
+        }
+    }
+    ~deflate_compressor() {
+        deflateEnd(&_zs);
+    }
+    virtual void start(const char* input, size_t input_len, char* output, size_t output_len) override {
+        if (deflateReset(&_zs) != Z_OK) {
+            throw std::runtime_error("deflate compression init failure");
+        }
+        _zs.next_in = reinterpret_cast<unsigned char*>(const_cast<char*>(input));
+        _zs.avail_in = 0;
+        _zs.next_out = reinterpret_cast<unsigned char*>(output);
+        _zs.avail_out = output_len;
+        _output_len = output_len;
+        _end = input + input_len;
+    }
+    virtual bool step() override {
+        auto next = reinterpret_cast<const char*>(_zs.next_in);
+        _zs.avail_in = std::min(size_t(_end - next), step_size);
+        bool last = next + _zs.avail_in == _end;
+        auto res = deflate(&_zs, last ? Z_FINISH : Z_NO_FLUSH);
+        if (last && res == Z_STREAM_END) {
+            return true;
+        }
+        if (res != Z_OK || last || _zs.avail_in) {
+            throw std::runtime_error("deflate compression failure");
+        }
+        return false;
+    }
+    virtual size_t compressed_size() const override {
+        return _output_len - _zs.avail_out;
+    }
+};
+
+}
+
+std::unique_ptr<chunk_compressor> compression::make_chunk_compressor() const {
+    if (_zstd) {
+        return std::make_unique<zstd_processor::incremental_compressor>(_zstd);
+    }
+    if (_compress == compress_deflate) {
+        return std::make_unique<deflate_compressor>();
+    }
+    return std::make_unique<one_step_compressor>(*this);
+}
+
+size_t compression::compress_max_size(size_t input_len) const {
+    if (_zstd) {
+        return zstd_processor::compress_max_size(input_len);
+    }
+    return _compress_max_size(input_len);
+}
+
 // locate() takes a byte position in the uncompressed stream, and finds the
 // the location of the compressed chunk on disk which contains it, and the
 // offset in this chunk.
@@ -278,13 +521,13 @@ class compressed_file_data_source_impl : public data_source_impl {
         }
         return _input_stream->read_exactly(addr.chunk_len).
             then([this, addr](temporary_buffer<char> buf) {
-                // The last 4 bytes of the chunk are the adler32 checksum
-                // of the rest of the (compressed) chunk.
+                // The last 4 bytes of the chunk are the checksum of the
+                // rest of the (compressed) chunk.
                 auto compressed_len = addr.chunk_len - 4;
                 // FIXME: Do not always calculate checksum - Cassandra has a
                 // probability (defaulting to 1.0, but still...)
                 auto checksum = read_be<uint32_t>(buf.get() + compressed_len);
-                if (checksum != checksum_adler32(buf.get(), compressed_len)) {
+                if (checksum != _compression_metadata->chunk_checksum(buf.get(), compressed_len)) {
                     throw std::runtime_error("compressed chunk failed checksum");
                 }
 
@@ -33,12 +33,16 @@
 // a "compression_metadata" object, which also contains additional information
 // needed from decompression - such as the chunk size and compressor type.
 //
-// Cassandra supports three different compression algorithms for the chunks,
-// LZ4, Snappy, and Deflate - the default (and therefore most important) is
-// LZ4. Each compressor is an implementation of the "compressor" class.
+// Cassandra supports four different compression algorithms for the chunks,
+// LZ4, Snappy, Deflate and Zstd - the default (and therefore most important)
+// is LZ4. Each compressor is an implementation of the "compressor" class.
+// Zstd additionally takes a compression level and, optionally, a dictionary,
+// which are recorded in the CompressionInfo options.
 //
 // Each compressed chunk is followed by a 4-byte checksum of the compressed
-// data, using the Adler32 algorithm. In Cassandra, there is a parameter
+// data, using the Adler32 algorithm, or, in sstables which record so in
+// their Scylla component, the hardware-accelerated CRC32C. In Cassandra,
+// there is a parameter
 // "crc_check_chance" (defaulting to 1.0) which determines the probability
 // of us verifying the checksum of each chunk we read.
 //
@@ -48,6 +52,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <memory>
 #include <zlib.h>
 
 #include "core/file.hh"
@@ -55,6 +60,7 @@
 #include "core/shared_ptr.hh"
 #include "types.hh"
 #include "../compress.hh"
+#include "utils/crc.hh"
 
 // An "uncompress_func" is a function which uncompresses the given compressed
 // input chunk, and writes the uncompressed data into the given output buffer.
@@ -102,8 +108,45 @@ inline uint32_t checksum_adler32_combine(uint32_t adler1, uint32_t adler2, size_
     return adler32_combine(adler1, adler2, input_len2);
 }
 
+// Standard CRC32C, resumable like zlib's crc32(): checksum_crc32c(0, ...)
+// starts a new computation.
+inline uint32_t checksum_crc32c(uint32_t crc, const char* input, size_t input_len) {
+    utils::crc32 c(~crc);
+    c.process(reinterpret_cast<const uint8_t*>(input), input_len);
+    return ~c.get();
+}
+
+inline uint32_t checksum_crc32c(const char* input, size_t input_len) {
+    return checksum_crc32c(0, input, input_len);
+}
+
 namespace sstables {
 
+// Compresses and uncompresses chunks with zstd, using the level and
+// dictionary the sstable was written with. Immutable, so it can be shared by
+// all readers of the sstable on every shard.
+class zstd_processor;
+
+// Compresses a chunk a piece of its input at a time, so that writers can
+// yield between the pieces instead of stalling the reactor for as long as
+// compressing a whole chunk takes with the slower algorithms. The result is
+// the same format compression::compress() produces. Algorithms which can't
+// compress incrementally, and are fast, compress the whole chunk in one step.
+class chunk_compressor {
+public:
+    // The amount of input compressed by each step.
+    static constexpr size_t step_size = 16 * 1024;
+
+    virtual ~chunk_compressor() {}
+    // Starts compressing the input into the output, which must be at least
+    // compress_max_size() of the input. Both must live until done.
+    virtual void start(const char* input, size_t input_len, char* output, size_t output_len) = 0;
+    // Compresses some more of the input. Returns true once it all was.
+    virtual bool step() = 0;
+    // The size of the compressed chunk, once step() returned true.
+    virtual size_t compressed_size() const = 0;
+};
+
 struct compression {
     disk_string<uint16_t> name;
     disk_array<uint32_t, option> options;
@@ -120,17 +163,24 @@ struct compression {
     compress_func *_compress = nullptr;
     // Return maximum length of data that compressor may output.
     compress_max_size_func *_compress_max_size = nullptr;
+    // Set instead of the above for zstd, which needs the level and dictionary.
+    std::shared_ptr<const zstd_processor> _zstd;
     // Variables *not* found in the "Compression Info" file (added by update()):
     uint64_t _compressed_file_length = 0;
     uint32_t _full_checksum;
+    // Recorded in the Scylla component, set by the sstable after loading it.
+    sstables::checksum_type _checksum_type = sstables::checksum_type::adler32;
 public:
     // Set the compressor algorithm, please check the definition of enum compressor.
     void set_compressor(compressor c);
+    // Same, with the algorithm-specific parameters, which are also added to
+    // options so that readers can recreate the compressor.
+    void set_compressor(const compression_parameters& cp);
     // After changing _compression, update() must be called to update
     // additional variables depending on it.
     void update(uint64_t compressed_file_length);
     operator bool() const {
-        return _uncompress != nullptr;
+        return _uncompress != nullptr || _zstd;
     }
     // locate() locates in the compressed file the given byte position of
     // the uncompressed data:
@@ -161,35 +211,47 @@ struct compression {
         _compressed_file_length = compressed_file_length;
     }
 
+    sstables::checksum_type get_checksum_type() const {
+        return _checksum_type;
+    }
+    // Must be called before init_full_checksum() when writing.
+    void set_checksum_type(sstables::checksum_type t) {
+        _checksum_type = t;
+    }
+
+    uint32_t chunk_checksum(const char* input, size_t input_len) const {
+        if (_checksum_type == sstables::checksum_type::crc32c) {
+            return checksum_crc32c(input, input_len);
+        }
+        return checksum_adler32(input, input_len);
+    }
+
     uint32_t full_checksum() const {
         return _full_checksum;
     }
     void init_full_checksum() {
-        _full_checksum = init_checksum_adler32();
+        _full_checksum = _checksum_type == sstables::checksum_type::crc32c ? 0 : init_checksum_adler32();
     }
-    void update_full_checksum(uint32_t checksum, size_t size) {
-        _full_checksum = checksum_adler32_combine(_full_checksum, checksum, size);
+    // Extends the full checksum with a chunk, whose chunk_checksum() is given.
+    void update_full_checksum(uint32_t checksum, const char* input, size_t input_len) {
+        if (_checksum_type == sstables::checksum_type::crc32c) {
+            // Unlike adler32, there is no cheap way of combining crcs.
+            _full_checksum = checksum_crc32c(_full_checksum, input, input_len);
+        } else {
+            _full_checksum = checksum_adler32_combine(_full_checksum, checksum, input_len);
+        }
     }
 
     size_t uncompress(
             const char* input, size_t input_len,
-            char* output, size_t output_len) const {
-        if (!_uncompress) {
-            throw std::runtime_error("uncompress is not supported");
-        }
-        return _uncompress(input, input_len, output, output_len);
-    }
+            char* output, size_t output_len) const;
     size_t compress(
             const char* input, size_t input_len,
-            char* output, size_t output_len) const {
-        if (!_compress) {
-            throw std::runtime_error("compress is not supported");
-        }
-        return _compress(input, input_len, output, output_len);
-    }
-    size_t compress_max_size(size_t input_len) const {
-        return _compress_max_size(input_len);
-    }
+            char* output, size_t output_len) const;
+    size_t compress_max_size(size_t input_len) const;
+    // Each writer needs a compressor of its own, as they keep the state of
+    // the chunk being compressed.
+    std::unique_ptr<chunk_compressor> make_chunk_compressor() const;
     friend class sstable;
 };
 
@@ -24,6 +24,7 @@
 #include "core/future.hh"
 #include "core/iostream.hh"
 #include "sstables/exceptions.hh"
+#include "vint-serialization.hh"
 #include <seastar/core/byteorder.hh>
 
 template<typename T>
@@ -56,6 +57,7 @@ class continuous_data_consumer {
         READING_U32,
         READING_U64,
         READING_BYTES,
+        READING_UNSIGNED_VINT,
     } _prestate = prestate::NONE;
 
     // state for non-NONE prestates
@@ -72,6 +74,8 @@ class continuous_data_consumer {
         uint16_t uint16;
         uint8_t  uint8;
     } _read_int;
+    // state for READING_UNSIGNED_VINT prestate (the value goes to _u64)
+    bytes::value_type _read_vint[max_vint_length];
     // state for READING_BYTES prestate
     temporary_buffer<char> _read_bytes;
     temporary_buffer<char>* _read_bytes_where; // which temporary_buffer to set, _key or _val?
@@ -127,6 +131,23 @@ class continuous_data_consumer {
             return read_status::waiting;
         }
     }
+    // Read a variable-length unsigned integer (see vint-serialization.hh)
+    // into _u64.
+    inline read_status read_unsigned_vint(temporary_buffer<char>& data) {
+        if (data.size()) {
+            auto len = unsigned_vint::serialized_size_from_first_byte(data[0]);
+            if (data.size() >= len) {
+                _u64 = unsigned_vint::deserialize(bytes_view(reinterpret_cast<const bytes::value_type*>(data.get()), len));
+                data.trim_front(len);
+                return read_status::ready;
+            }
+        }
+        std::copy(data.begin(), data.end(), _read_vint);
+        _pos = data.size();
+        data.trim(0);
+        _prestate = prestate::READING_UNSIGNED_VINT;
+        return read_status::waiting;
+    }
     inline read_status read_bytes(temporary_buffer<char>& data, uint32_t len, temporary_buffer<char>& where) {
         if (data.size() >=  len) {
             where = data.share(0, len);
@@ -166,6 +187,23 @@ class continuous_data_consumer {
                 *_read_bytes_where = std::move(_read_bytes);
                 _prestate = prestate::NONE;
             }
+        } else if (_prestate == prestate::READING_UNSIGNED_VINT) {
+            if (!data) {
+                return;
+            }
+            if (_pos == 0) {
+                _read_vint[_pos++] = data[0];
+                data.trim_front(1);
+            }
+            auto len = unsigned_vint::serialized_size_from_first_byte(_read_vint[0]);
+            auto n = std::min((size_t)(len - _pos), data.size());
+            std::copy(data.begin(), data.begin() + n, _read_vint + _pos);
+            data.trim_front(n);
+            _pos += n;
+            if (_pos == len) {
+                _u64 = unsigned_vint::deserialize(bytes_view(_read_vint, len));
+                _prestate = prestate::NONE;
+            }
         } else {
             // in the middle of reading an integer
             unsigned len;
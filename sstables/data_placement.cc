@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <sys/statvfs.h>
+#include <seastar/core/metrics.hh>
+#include <seastar/core/reactor.hh>
+
+#include "data_placement.hh"
+#include "log.hh"
+
+static logging::logger dplog("data_placement");
+
+data_placement::write::write(data_placement& placement, unsigned directory, uint64_t estimated_size)
+    : _placement(&placement)
+    , _directory(directory)
+    , _estimated_size(estimated_size)
+{
+    auto& stats = _placement->_directories[_directory].stats;
+    stats.writes_in_progress++;
+    stats.bytes_in_progress += _estimated_size;
+}
+
+data_placement::write::write(write&& o) noexcept
+    : _placement(std::exchange(o._placement, nullptr))
+    , _directory(o._directory)
+    , _estimated_size(o._estimated_size)
+{ }
+
+data_placement::write& data_placement::write::operator=(write&& o) noexcept {
+    if (this != &o) {
+        this->~write();
+        new (this) write(std::move(o));
+    }
+    return *this;
+}
+
+data_placement::write::~write() {
+    if (_placement) {
+        auto& stats = _placement->_directories[_directory].stats;
+        stats.writes_in_progress--;
+        stats.bytes_in_progress -= _estimated_size;
+    }
+}
+
+void data_placement::write::written(uint64_t bytes) {
+    if (_placement) {
+        auto& d = _placement->_directories[_directory];
+        d.stats.sstables_written++;
+        d.stats.bytes_written += bytes;
+        // Until the next refresh sees it.
+        d.available -= std::min(d.available, bytes);
+    }
+}
+
+unsigned data_placement::choose(const std::vector<directory>& directories, uint64_t size) {
+    auto room = [] (const directory& d) {
+        return d.available - std::min(d.available, d.stats.bytes_in_progress);
+    };
+    bool any_fits = std::any_of(directories.begin(), directories.end(), [&] (const directory& d) {
+        return room(d) >= size;
+    });
+    unsigned best = 0;
+    double best_score = -1;
+    for (unsigned i = 0; i < directories.size(); ++i) {
+        auto& d = directories[i];
+        if (any_fits && room(d) < size) {
+            continue;
+        }
+        auto score = double(room(d)) / (d.stats.writes_in_progress + 1);
+        if (score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+data_placement::data_placement(std::vector<sstring> paths, std::chrono::milliseconds interval)
+    : _interval(interval)
+    , _timer([this] {
+        if (_gate.get_count()) {
+            return;
+        }
+        with_gate(_gate, [this] {
+            return refresh();
+        });
+    })
+{
+    namespace sm = seastar::metrics;
+    for (auto& path : paths) {
+        _directories.push_back(directory{path});
+    }
+    for (auto& d : _directories) {
+        auto dir_label = sm::label_instance("directory", d.path);
+        _metrics.add_group("data_directory", {
+            sm::make_derive("sstables_written", sm::description("number of sstables written to the data directory"), { dir_label }, d.stats.sstables_written),
+            sm::make_derive("bytes_written", sm::description("bytes of sstables written to the data directory"), { dir_label }, d.stats.bytes_written),
+            sm::make_gauge("writes_in_progress", sm::description("number of sstables being written to the data directory"), { dir_label }, d.stats.writes_in_progress),
+            sm::make_gauge("available_bytes", sm::description("free space of the data directory at the last refresh"), { dir_label }, d.available),
+        });
+    }
+    with_gate(_gate, [this] {
+        return refresh();
+    });
+    _timer.arm_periodic(_interval);
+}
+
+future<> data_placement::refresh() {
+    return parallel_for_each(_directories, [] (directory& d) {
+        return engine().statvfs(d.path).then_wrapped([&d] (future<struct statvfs> f) {
+            try {
+                auto st = f.get0();
+                d.available = uint64_t(st.f_bavail) * st.f_frsize;
+            } catch (...) {
+                dplog.warn("Failed to get the free space of {}: {}", d.path, std::current_exception());
+            }
+        });
+    });
+}
+
+future<> data_placement::stop() {
+    _timer.cancel();
+    return _gate.close();
+}
+
+data_placement::write data_placement::place(uint64_t estimated_size) {
+    return write(*this, choose(_directories, estimated_size), estimated_size);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <vector>
+#include "core/gate.hh"
+#include "core/sstring.hh"
+#include "core/timer.hh"
+#include <seastar/core/metrics_registration.hh>
+
+// Spreads the sstables a shard writes across the data directories, which
+// are assumed to be on separate disks (JBOD).
+//
+// A new sstable goes to the directory with the most free space per write in
+// progress, among those with room for it, so that a disk which is busy or
+// filling up gets fewer sstables. Free space is refreshed periodically, and
+// the estimated sizes of the writes in progress are taken off it in between.
+class data_placement {
+public:
+    struct directory_stats {
+        uint64_t sstables_written = 0;
+        uint64_t bytes_written = 0;
+        uint64_t writes_in_progress = 0;
+        // The estimated sizes of the writes in progress.
+        uint64_t bytes_in_progress = 0;
+    };
+    struct directory {
+        sstring path;
+        // As of the last refresh.
+        uint64_t available = 0;
+        directory_stats stats;
+    };
+
+    // Accounts a write to a directory while it's alive.
+    class write {
+        data_placement* _placement = nullptr;
+        unsigned _directory = 0;
+        uint64_t _estimated_size = 0;
+    public:
+        write() = default;
+        write(data_placement& placement, unsigned directory, uint64_t estimated_size);
+        write(write&&) noexcept;
+        write& operator=(write&&) noexcept;
+        ~write();
+        // The index of the data directory to write to.
+        unsigned directory() const {
+            return _directory;
+        }
+        // Records that an sstable of the given size was written.
+        void written(uint64_t bytes);
+    };
+private:
+    std::vector<directory> _directories;
+    std::chrono::milliseconds _interval;
+    timer<lowres_clock> _timer;
+    seastar::gate _gate;
+    seastar::metrics::metric_groups _metrics;
+public:
+    // The index of the directory an sstable of about size bytes should go to.
+    // Exposed for testing.
+    static unsigned choose(const std::vector<directory>& directories, uint64_t size);
+public:
+    // Refreshes the free space of the data directories every interval.
+    data_placement(std::vector<sstring> paths, std::chrono::milliseconds interval);
+    data_placement(data_placement&&) = delete;
+
+    future<> refresh();
+    future<> stop();
+
+    // Picks the directory for a new sstable of about estimated_size bytes.
+    write place(uint64_t estimated_size);
+
+    const std::vector<directory>& directories() const {
+        return _directories;
+    }
+};
@@ -148,7 +148,8 @@ class date_tiered_manifest {
     }
 
     std::vector<sstables::shared_sstable>
-    get_next_sstables(column_family& cf, std::vector<sstables::shared_sstable>& uncompacting, gc_clock::time_point gc_before) {
+    get_next_sstables(column_family& cf, std::vector<sstables::shared_sstable>& uncompacting, gc_clock::time_point gc_before,
+            std::vector<sstables::shared_sstable>* expired_out = nullptr) {
         if (cf.get_sstables()->empty()) {
             return {};
         }
@@ -175,6 +176,9 @@ class date_tiered_manifest {
         if (!expired.empty()) {
             compaction_candidates.insert(compaction_candidates.end(), expired.begin(), expired.end());
         }
+        if (expired_out) {
+            *expired_out = std::move(expired);
+        }
         return compaction_candidates;
     }
 
@@ -59,6 +59,27 @@ struct disk_array {
     std::deque<Members> elements;
 };
 
+// Integers, string lengths and array lengths which are stored as
+// variable-length integers on disk (see vint-serialization.hh). They appear
+// only in components of the sa format.
+template <typename T>
+struct vint {
+    static_assert(std::is_integral<T>::value, "vint must wrap an integer type");
+    T value;
+};
+
+struct disk_string_vint_size {
+    bytes value;
+    explicit operator bytes_view() const {
+        return value;
+    }
+};
+
+template <typename Members>
+struct disk_array_vint_size {
+    std::deque<Members> elements;
+};
+
 template <typename Size, typename Key, typename Value>
 struct disk_hash {
     std::unordered_map<Key, Value, std::hash<Key>> map;
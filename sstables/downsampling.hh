@@ -47,6 +47,7 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <cstdlib>
 
 namespace sstables {
 
@@ -174,32 +175,38 @@ class downsampling {
             return (original_indexes[index + 1] - original_indexes[index]) * min_index_interval;
         }
     }
-#if 0
-    public static int[] getStartPoints(int currentSamplingLevel, int newSamplingLevel)
-    {
-        List<Integer> allStartPoints = getSamplingPattern(BASE_SAMPLING_LEVEL);
+
+    /**
+     * Returns the indexes, within each `current_sampling_level` entries of a summary at that level, of the entries
+     * to remove to get it down to `new_sampling_level`: an entry at index i goes if (i - start) is a multiple of
+     * `current_sampling_level` for one of the returned starts.
+     *
+     * @param current_sampling_level the sampling level of the summary
+     * @param new_sampling_level the sampling level to downsample it to, lower than current_sampling_level
+     */
+    static std::vector<int> get_start_points(int current_sampling_level, int new_sampling_level) {
+        const std::vector<int>& all_start_points = get_sampling_pattern(BASE_SAMPLING_LEVEL);
 
         // calculate starting indexes for sampling rounds
-        int initialRound = BASE_SAMPLING_LEVEL - currentSamplingLevel;
-        int numRounds = Math.abs(currentSamplingLevel - newSamplingLevel);
-        int[] startPoints = new int[numRounds];
-        for (int i = 0; i < numRounds; ++i)
-        {
-            int start = allStartPoints.get(initialRound + i);
+        int initial_round = BASE_SAMPLING_LEVEL - current_sampling_level;
+        int num_rounds = std::abs(current_sampling_level - new_sampling_level);
+        std::vector<int> start_points;
+        start_points.reserve(num_rounds);
+        for (int i = 0; i < num_rounds; ++i) {
+            int start = all_start_points[initial_round + i];
 
             // our "ideal" start points will be affected by the removal of items in earlier rounds, so go through all
             // earlier rounds, and if we see an index that comes before our ideal start point, decrement the start point
             int adjustment = 0;
-            for (int j = 0; j < initialRound; ++j)
-            {
-                if (allStartPoints.get(j) < start)
+            for (int j = 0; j < initial_round; ++j) {
+                if (all_start_points[j] < start) {
                     adjustment++;
+                }
             }
-            startPoints[i] = start - adjustment;
+            start_points.push_back(start - adjustment);
         }
-        return startPoints;
+        return start_points;
     }
-#endif
 };
 
 }
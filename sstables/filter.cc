@@ -43,17 +43,39 @@ future<> sstable::read_filter(const io_priority_class& pc) {
         return this->read_simple<sstable::component_type::Filter>(filter, pc).then([this, &filter] {
             large_bitset bs(filter.buckets.elements.size() * 64);
             bs.load(filter.buckets.elements.begin(), filter.buckets.elements.end());
-            _components->filter = utils::filter::create_filter(filter.hashes, std::move(bs));
+            if (this->get_filter_type() == filter_type::blocked) {
+                _components->filter = utils::filter::create_blocked_filter(filter.hashes, std::move(bs));
+            } else {
+                _components->filter = utils::filter::create_filter(filter.hashes, std::move(bs));
+            }
         });
     });
 }
 
+void sstable::load_deferred_filter() {
+    _components->filter_deferred = false;
+    // Keeps accepting every key if the Filter can't be read, which costs
+    // lookups, not correctness.
+    read_filter(default_priority_class()).handle_exception([sst = shared_from_this()] (std::exception_ptr ep) {
+        sstlog.warn("Failed to read deferred filter of {}: {}", sst->get_filename(), ep);
+    });
+}
+
+future<> sstable::load_deferred_filter_now() {
+    if (!_components->filter_deferred) {
+        return make_ready_future<>();
+    }
+    _components->filter_deferred = false;
+    return read_filter(default_priority_class());
+}
+
 void sstable::write_filter(const io_priority_class& pc) {
     if (!has_component(sstable::component_type::Filter)) {
         return;
     }
 
-    auto f = static_cast<utils::filter::murmur3_bloom_filter *>(_components->filter.get());
+    // Both the classic and the blocked filters are stored the same way.
+    auto f = static_cast<utils::filter::bloom_filter *>(_components->filter.get());
 
     auto&& bs = f->bits();
     std::deque<uint64_t> v(align_up(bs.size(), size_t(64)) / 64);
@@ -32,6 +32,10 @@ class filter_tracker {
 
     uint64_t last_false_positive = 0;
     uint64_t last_true_positive = 0;
+
+    // Lookups, and the number of cache lines they touched at most.
+    uint64_t probes = 0;
+    uint64_t probe_cost = 0;
 public:
     void add_false_positive() {
         false_positive++;
@@ -41,5 +45,10 @@ class filter_tracker {
         true_positive++;
     }
 
+    void add_probe(unsigned cost) {
+        probes++;
+        probe_cost += cost;
+    }
+
     friend class sstables::sstable;
 };
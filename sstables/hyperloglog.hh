@@ -98,6 +98,21 @@ static inline size_t write_unsigned_var_int(unsigned int value, uint8_t* to) {
     return size;
 }
 
+static inline unsigned int read_unsigned_var_int(const uint8_t*& from, const uint8_t* end) {
+    unsigned int value = 0;
+    for (unsigned shift = 0; shift < 32; shift += 7) {
+        if (from == end) {
+            throw std::invalid_argument("truncated cardinality data");
+        }
+        auto b = *from++;
+        value |= (unsigned int)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return value;
+        }
+    }
+    throw std::invalid_argument("malformed cardinality data");
+}
+
 /** @class HyperLogLog
  *  @brief Implement of 'HyperLogLog' estimate cardinality algorithm
  */
@@ -137,11 +152,41 @@ class HyperLogLog {
         alphaMM_ = alpha * m_ * m_;
     }
 
+    /**
+     * Reads back what get_bytes() wrote, e.g. from the compaction metadata
+     * of an sstable.
+     *
+     * @exception std::invalid_argument the data is malformed, or in the
+     *            sparse format, which isn't supported.
+     */
+    static HyperLogLog from_bytes(const uint8_t* data, size_t size) {
+        static constexpr int version = 2;
+
+        auto end = data + size;
+        if (size < sizeof(int32_t) || read_be<int32_t>(reinterpret_cast<const char*>(data)) != -version) {
+            throw std::invalid_argument("unsupported cardinality data version");
+        }
+        data += sizeof(int32_t);
+        auto b = read_unsigned_var_int(data, end);
+        read_unsigned_var_int(data, end); // sp
+        auto type = read_unsigned_var_int(data, end);
+        if (type != 0) {
+            throw std::invalid_argument("sparse cardinality data isn't supported");
+        }
+        if (b < 4 || 16 < b) {
+            throw std::invalid_argument("malformed cardinality data");
+        }
+        HyperLogLog hll(b);
+        auto registers = read_unsigned_var_int(data, end);
+        if (registers != hll.m_ || size_t(end - data) < registers) {
+            throw std::invalid_argument("malformed cardinality data");
+        }
+        std::copy(data, data + registers, hll.M_.begin());
+        return hll;
+    }
+
     static HyperLogLog from_bytes(temporary_buffer<uint8_t> bytes) {
-        // FIXME: implement class that creates a HyperLogLog from an array of bytes.
-        // This will useful if we need to work with the cardinality data from the
-        // compaction metadata.
-        abort();
+        return from_bytes(bytes.get(), bytes.size());
     }
 
     /**
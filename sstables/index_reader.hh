@@ -181,22 +181,25 @@ class index_reader {
     shared_index_lists::list_ptr _prev_list;
 
     const io_priority_class& _pc;
+    reader_resource_tracker _resource_tracker;
 
     struct reader {
         index_consumer _consumer;
         index_consume_entry_context<index_consumer> _context;
 
-        static auto create_file_input_stream(shared_sstable sst, const io_priority_class& pc, uint64_t begin, uint64_t end) {
+        static auto create_file_input_stream(shared_sstable sst, const io_priority_class& pc, const reader_resource_tracker& resource_tracker,
+                uint64_t begin, uint64_t end) {
             file_input_stream_options options;
             options.buffer_size = sst->sstable_buffer_size;
             options.read_ahead = 2;
             options.io_priority_class = pc;
-            return make_file_input_stream(sst->_index_file, begin, end - begin, std::move(options));
+            return sst->make_index_input_stream(resource_tracker.track(sst->_index_file), begin, end - begin, std::move(options));
         }
 
-        reader(shared_sstable sst, const io_priority_class& pc, uint64_t begin, uint64_t end, uint64_t quantity)
+        reader(shared_sstable sst, const io_priority_class& pc, const reader_resource_tracker& resource_tracker,
+                uint64_t begin, uint64_t end, uint64_t quantity)
             : _consumer(quantity)
-            , _context(_consumer, create_file_input_stream(sst, pc, begin, end), begin, end - begin)
+            , _context(_consumer, create_file_input_stream(sst, pc, resource_tracker, begin, end), begin, end - begin)
         { }
     };
 
@@ -208,6 +211,8 @@ class index_reader {
     uint64_t _current_pi_idx = 0; // Points to upper bound of the cursor.
     uint64_t _data_file_position = 0;
     indexable_element _element = indexable_element::partition;
+    // Where the data of the partition ends, for readers created from the key cache.
+    stdx::optional<uint64_t> _cached_partition_end;
 private:
     future<> advance_to_end() {
         sstlog.trace("index {}: advance_to_end()", this);
@@ -250,7 +255,7 @@ class index_reader {
             return close_reader().then_wrapped([this, position, end, quantity, summary_idx] (auto&& f) {
                 try {
                     f.get();
-                    _reader.emplace(_sstable, _pc, position, end, quantity);
+                    _reader.emplace(_sstable, _pc, _resource_tracker, position, end, quantity);
                 } catch (...) {
                     _reader = stdx::nullopt;
                     throw;
@@ -298,11 +303,28 @@ class index_reader {
         return advance_to_end();
     }
 public:
-    index_reader(shared_sstable sst, const io_priority_class& pc)
+    index_reader(shared_sstable sst, const io_priority_class& pc, reader_resource_tracker resource_tracker = no_resource_tracking())
         : _sstable(std::move(sst))
         , _pc(pc)
+        , _resource_tracker(std::move(resource_tracker))
     {
         sstlog.trace("index {}: index_reader for {}", this, _sstable->get_filename());
+        ++_sstable->_index_readers;
+        ++_sstable->_index_reads;
+    }
+
+    // Creates a reader positioned on a partition found in the key cache,
+    // without reading the index. Such a reader can only move within the
+    // partition, or to its end.
+    index_reader(shared_sstable sst, const io_priority_class& pc, reader_resource_tracker resource_tracker,
+            const key_cache::cached_partition& p)
+        : index_reader(std::move(sst), pc, std::move(resource_tracker))
+    {
+        _previous_summary_idx = p.summary_idx;
+        _current_summary_idx = p.summary_idx;
+        _current_list = _sstable->_index_lists.make_uncached(p.summary_idx, index_list{p.entry});
+        _data_file_position = p.entry.position();
+        _cached_partition_end = p.data_end;
     }
 
     index_reader(const index_reader& r)
@@ -310,14 +332,21 @@ class index_reader {
         , _current_list(r._current_list)
         , _prev_list(r._prev_list)
         , _pc(r._pc)
+        , _resource_tracker(r._resource_tracker)
         , _previous_summary_idx(r._previous_summary_idx)
         , _current_summary_idx(r._current_summary_idx)
         , _current_index_idx(r._current_index_idx)
         , _current_pi_idx(r._current_pi_idx)
         , _data_file_position(r._data_file_position)
         , _element(r._element)
+        , _cached_partition_end(r._cached_partition_end)
     {
         sstlog.trace("index {}: index_reader for {}", this, _sstable->get_filename());
+        ++_sstable->_index_readers;
+    }
+
+    ~index_reader() {
+        --_sstable->_index_readers;
     }
 
     // Cannot be used twice on the same summary_idx and together with advance_to().
@@ -346,6 +375,45 @@ class index_reader {
         return pi.get_deletion_time();
     }
 
+    // Returns the clustering prefixes at which the promoted index blocks of
+    // current partition start, in clustering order. Empty if the partition
+    // has no promoted index, or the schema no clustering key.
+    // Can be called only when partition_data_ready().
+    std::vector<clustering_key_prefix> promoted_index_block_starts() {
+        const schema& s = *_sstable->_schema;
+        std::vector<clustering_key_prefix> starts;
+        if (!s.clustering_key_size()) {
+            return starts;
+        }
+        index_entry& e = current_partition_entry();
+        promoted_index* pi = nullptr;
+        try {
+            pi = e.get_promoted_index(s);
+        } catch (...) {
+            sstlog.error("Failed to get promoted index for sstable {}, page {}, index {}: {}", _sstable->get_filename(),
+                _current_summary_idx, _current_index_idx, std::current_exception());
+        }
+        if (!pi) {
+            return starts;
+        }
+        starts.reserve(pi->size());
+        for (size_t i = 0; i < pi->size(); ++i) {
+            auto&& start = (*pi)[i].start;
+            if (start.is_static()) {
+                continue;
+            }
+            std::vector<bytes> components;
+            for (auto&& v : start.values()) {
+                if (components.size() == s.clustering_key_size()) {
+                    break;
+                }
+                components.emplace_back(to_bytes(v));
+            }
+            starts.emplace_back(clustering_key_prefix::from_exploded(std::move(components)));
+        }
+        return starts;
+    }
+
     // Returns the key for current partition.
     // Can be called only when partition_data_ready().
     // The result is valid as long as index_reader is valid.
@@ -413,7 +481,8 @@ class index_reader {
 
         if (sstlog.is_enabled(seastar::log_level::trace)) {
             sstlog.trace("index {}: promoted index:", this);
-            for (auto&& e : pi->entries) {
+            for (size_t i = 0; i < pi->size(); ++i) {
+                auto&& e = (*pi)[i];
                 sstlog.trace("  {}-{}: +{} len={}", e.start, e.end, e.offset, e.width);
             }
         }
@@ -424,17 +493,17 @@ class index_reader {
         };
 
         // Optimize short skips which typically land in the same block
-        if (_current_pi_idx >= pi->entries.size() || cmp_with_start(pos, pi->entries[_current_pi_idx])) {
+        if (_current_pi_idx >= pi->size() || cmp_with_start(pos, (*pi)[_current_pi_idx])) {
             sstlog.trace("index {}: position in current block", this);
             return make_ready_future<>();
         }
 
-        auto i = std::upper_bound(pi->entries.begin() + _current_pi_idx, pi->entries.end(), pos, cmp_with_start);
-        _current_pi_idx = std::distance(pi->entries.begin(), i);
-        if (i != pi->entries.begin()) {
+        auto i = pi->upper_bound(_current_pi_idx, pos, cmp_with_start);
+        _current_pi_idx = i;
+        if (i != 0) {
             --i;
         }
-        _data_file_position = e.position() + i->offset;
+        _data_file_position = e.position() + (*pi)[i].offset;
         _element = indexable_element::cell;
         sstlog.trace("index {}: skipped to cell, _current_pi_idx={}, _data_file_position={}", this, _current_pi_idx, _data_file_position);
         return make_ready_future<>();
@@ -468,7 +537,7 @@ class index_reader {
             sstlog.error("Failed to get promoted index for sstable {}, page {}, index {}: {}", _sstable->get_filename(),
                 _current_summary_idx, _current_index_idx, std::current_exception());
         }
-        if (!pi || pi->entries.empty()) {
+        if (!pi || pi->empty()) {
             sstlog.trace("index {}: no promoted index", this);
             return advance_to_next_partition();
         }
@@ -478,13 +547,13 @@ class index_reader {
             return pos_cmp(pos, e.start);
         };
 
-        auto i = std::upper_bound(pi->entries.begin() + _current_pi_idx, pi->entries.end(), pos, cmp_with_start);
-        _current_pi_idx = std::distance(pi->entries.begin(), i);
-        if (i == pi->entries.end()) {
+        auto i = pi->upper_bound(_current_pi_idx, pos, cmp_with_start);
+        _current_pi_idx = i;
+        if (i == pi->size()) {
             return advance_to_next_partition();
         }
 
-        _data_file_position = e.position() + i->offset;
+        _data_file_position = e.position() + (*pi)[i].offset;
         _element = indexable_element::cell;
         sstlog.trace("index {}: skipped to cell, _current_pi_idx={}, _data_file_position={}", this, _current_pi_idx, _data_file_position);
         return make_ready_future<>();
@@ -503,10 +572,33 @@ class index_reader {
         });
     }
 
+    // Returns the key cache entry of the current partition, if where its
+    // data ends is known without reading more of the index.
+    // Can be called only when partition_data_ready().
+    stdx::optional<key_cache::cached_partition> make_cached_partition() {
+        auto& summary = _sstable->get_summary();
+        uint64_t data_end;
+        if (_cached_partition_end) {
+            data_end = *_cached_partition_end;
+        } else if (_current_index_idx + 1 < _current_list->size()) {
+            data_end = (*_current_list)[_current_index_idx + 1].position();
+        } else if (_current_summary_idx + 1 >= summary.header.size) {
+            data_end = data_file_end();
+        } else {
+            return stdx::nullopt;
+        }
+        return key_cache::cached_partition{current_partition_entry(), _current_summary_idx, data_end};
+    }
+
     // Moves the cursor to the beginning of next partition.
     // Can be called only when !eof().
     future<> advance_to_next_partition() {
         sstlog.trace("index {}: advance_to_next_partition()", this);
+        if (_cached_partition_end) {
+            _data_file_position = *_cached_partition_end;
+            _element = indexable_element::partition;
+            return make_ready_future<>();
+        }
         if (!_current_list) {
             return advance_to_page(0).then([this] {
                 return advance_to_next_partition();
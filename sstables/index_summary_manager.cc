@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/algorithm/stable_partition.hpp>
+#include <boost/range/numeric.hpp>
+#include <seastar/core/metrics.hh>
+
+#include "index_summary_manager.hh"
+#include "downsampling.hh"
+#include "log.hh"
+
+static logging::logger ismlog("index_summary_manager");
+
+using sstables::downsampling;
+
+index_summary_manager::index_summary_manager(size_t capacity, std::chrono::milliseconds interval, sstables_provider sstables)
+    : _capacity(capacity)
+    , _interval(interval)
+    , _sstables(std::move(sstables))
+    , _timer([this] {
+        if (_gate.get_count()) {
+            // The previous redistribution is still running.
+            return;
+        }
+        with_gate(_gate, [this] {
+            return redistribute();
+        }).handle_exception([] (std::exception_ptr ep) {
+            ismlog.warn("Failed to redistribute index summaries: {}", ep);
+        });
+    })
+{
+    namespace sm = seastar::metrics;
+    _metrics.add_group("index_summary", {
+        sm::make_gauge("memory_used", sm::description("memory used by the index summaries at the last redistribution"), _stats.memory_used),
+        sm::make_derive("redistributions", sm::description("number of times the index summary budget was redistributed"), _stats.redistributions),
+        sm::make_derive("downsamples", sm::description("number of index summaries downsampled"), _stats.downsamples),
+        sm::make_derive("upsamples", sm::description("number of index summaries upsampled"), _stats.upsamples),
+    });
+    _timer.arm_periodic(_interval);
+}
+
+future<> index_summary_manager::stop() {
+    _timer.cancel();
+    return _gate.close();
+}
+
+std::vector<index_summary_manager::plan_entry>
+index_summary_manager::plan(size_t capacity, const std::vector<std::pair<sstables::shared_sstable, double>>& read_rates) {
+    struct candidate {
+        sstables::shared_sstable sst;
+        double read_rate;
+        double full_memory;
+        double min_memory;
+        int min_sampling_level;
+        double extra = 0;
+        bool capped = false;
+    };
+    std::vector<candidate> candidates;
+    candidates.reserve(read_rates.size());
+    double total_full_memory = 0;
+    double total_min_memory = 0;
+    for (auto&& sst_and_rate : read_rates) {
+        auto& sst = sst_and_rate.first;
+        auto& header = sst->get_summary().header;
+        auto full_memory = double(sst->summary_memory_usage()) * downsampling::BASE_SAMPLING_LEVEL / header.sampling_level;
+        auto max_index_interval = std::max<int64_t>(sst->get_schema()->max_index_interval(), header.min_index_interval);
+        int min_sampling_level = std::max<int64_t>(1, (int64_t(downsampling::BASE_SAMPLING_LEVEL) * header.min_index_interval + max_index_interval - 1) / max_index_interval);
+        auto min_memory = full_memory * min_sampling_level / downsampling::BASE_SAMPLING_LEVEL;
+        candidates.push_back(candidate{sst, sst_and_rate.second, full_memory, min_memory, min_sampling_level});
+        total_full_memory += full_memory;
+        total_min_memory += min_memory;
+    }
+
+    if (total_full_memory > capacity) {
+        // Every summary gets its minimum, and what is left of the budget is
+        // shared by read rate, the share of a summary which would exceed
+        // its full sampling going to the others.
+        auto remaining = std::max(0.0, double(capacity) - total_min_memory);
+        auto total_read_rate = boost::accumulate(candidates | boost::adaptors::transformed([] (const candidate& c) { return c.read_rate; }), 0.0);
+        auto weight = [total_read_rate] (const candidate& c) {
+            // Without reads, share by size.
+            return total_read_rate > 0 ? c.read_rate : c.full_memory - c.min_memory;
+        };
+        while (remaining > 1) {
+            double total_weight = 0;
+            for (auto&& c : candidates) {
+                total_weight += c.capped ? 0 : weight(c);
+            }
+            if (total_weight <= 0) {
+                break;
+            }
+            auto distributed = 0.0;
+            bool newly_capped = false;
+            for (auto&& c : candidates) {
+                if (c.capped) {
+                    continue;
+                }
+                auto share = remaining * weight(c) / total_weight;
+                auto room = c.full_memory - c.min_memory - c.extra;
+                if (share >= room) {
+                    share = room;
+                    c.capped = true;
+                    newly_capped = true;
+                }
+                c.extra += share;
+                distributed += share;
+            }
+            remaining -= distributed;
+            if (!newly_capped) {
+                break;
+            }
+        }
+    }
+
+    std::vector<plan_entry> ret;
+    ret.reserve(candidates.size());
+    for (auto&& c : candidates) {
+        auto current = c.sst->summary_sampling_level();
+        int level = downsampling::BASE_SAMPLING_LEVEL;
+        if (total_full_memory > capacity && c.full_memory > 0) {
+            level = (c.min_memory + c.extra) * downsampling::BASE_SAMPLING_LEVEL / c.full_memory;
+            level = std::min(std::max(level, c.min_sampling_level), int(downsampling::BASE_SAMPLING_LEVEL));
+        }
+        if ((level > current && level < current * upsample_threshold && level != downsampling::BASE_SAMPLING_LEVEL)
+                || (level < current && level > current * downsample_threshold)) {
+            level = current;
+        }
+        ret.push_back(plan_entry{c.sst, level});
+    }
+    return ret;
+}
+
+future<> index_summary_manager::redistribute() {
+    auto all = _sstables();
+    auto interval = std::chrono::duration<double>(_interval).count();
+    std::unordered_map<sstring, uint64_t> index_reads;
+    std::vector<std::pair<sstables::shared_sstable, double>> read_rates;
+    uint64_t memory_used = 0;
+    for (auto&& sst : all) {
+        memory_used += sst->summary_memory_usage();
+        if (!sst->can_resample_summary()) {
+            continue;
+        }
+        auto name = sst->get_filename();
+        auto reads = sst->index_reads();
+        auto i = _last_index_reads.find(name);
+        auto last = i != _last_index_reads.end() && i->second <= reads ? i->second : 0;
+        read_rates.emplace_back(sst, (reads - last) / interval);
+        index_reads.emplace(std::move(name), reads);
+    }
+    _last_index_reads = std::move(index_reads);
+    _stats.memory_used = memory_used;
+    ++_stats.redistributions;
+
+    auto entries = plan(_capacity, read_rates);
+    // Free memory before using more of it.
+    boost::stable_partition(entries, [] (const plan_entry& e) {
+        return e.sampling_level < e.sst->summary_sampling_level();
+    });
+    return do_with(std::move(entries), [this] (auto& entries) {
+        return do_for_each(entries, [this] (const plan_entry& e) {
+            auto current = e.sst->summary_sampling_level();
+            if (e.sampling_level == current) {
+                return make_ready_future<>();
+            }
+            return e.sst->resample_summary(e.sampling_level).then([this, &e, current] (bool resampled) {
+                if (!resampled) {
+                    return;
+                }
+                ismlog.debug("Resampled summary of {} from level {} to {}", e.sst->get_filename(), current, e.sampling_level);
+                ++(e.sampling_level < current ? _stats.downsamples : _stats.upsamples);
+            }).handle_exception([&e] (std::exception_ptr ep) {
+                ismlog.warn("Failed to resample summary of {}: {}", e.sst->get_filename(), ep);
+            });
+        });
+    });
+}
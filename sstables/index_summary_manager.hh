@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "core/gate.hh"
+#include "core/timer.hh"
+#include <seastar/core/metrics_registration.hh>
+#include "sstables/sstables.hh"
+
+// Keeps the memory used by the index summaries of a shard's sstables within
+// a budget, like Cassandra's IndexSummaryManager.
+//
+// Periodically, the budget is redistributed across the sstables in proportion
+// to their read rates since the previous redistribution: the summaries of
+// sstables read less than their share are downsampled, and those read more
+// are upsampled back, up to full sampling. No summary goes below the sampling
+// level at which the gap between its entries reaches the max_index_interval of
+// its table. Small changes are skipped, since upsampling reads the whole Index.
+class index_summary_manager {
+public:
+    using sstables_provider = std::function<std::vector<sstables::shared_sstable>()>;
+    struct stats {
+        uint64_t redistributions = 0;
+        uint64_t downsamples = 0;
+        uint64_t upsamples = 0;
+        uint64_t memory_used = 0;
+    };
+    // Resampling is skipped unless the sampling level changes by at least
+    // these factors.
+    static constexpr double upsample_threshold = 1.5;
+    static constexpr double downsample_threshold = 0.75;
+private:
+    size_t _capacity;
+    std::chrono::milliseconds _interval;
+    sstables_provider _sstables;
+    // Index reads of each sstable at the previous redistribution, by file name.
+    std::unordered_map<sstring, uint64_t> _last_index_reads;
+    timer<lowres_clock> _timer;
+    seastar::gate _gate;
+    stats _stats;
+    seastar::metrics::metric_groups _metrics;
+public:
+    struct plan_entry {
+        sstables::shared_sstable sst;
+        int sampling_level;
+    };
+    // The sampling level of each sstable, given the read rate of each.
+    // Exposed for testing.
+    static std::vector<plan_entry> plan(size_t capacity, const std::vector<std::pair<sstables::shared_sstable, double>>& read_rates);
+public:
+    // Redistributes capacity bytes every interval.
+    index_summary_manager(size_t capacity, std::chrono::milliseconds interval, sstables_provider sstables);
+    index_summary_manager(index_summary_manager&&) = delete;
+
+    future<> redistribute();
+    future<> stop();
+
+    const stats& get_stats() const {
+        return _stats;
+    }
+};
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <boost/intrusive/list.hpp>
+#include "keys.hh"
+#include "schema.hh"
+#include "sstables/types.hh"
+#include "utils/lru.hh"
+
+namespace sstables {
+
+// Where the partitions of an sstable recently read by key are, so that point
+// reads of hot partitions go straight to the data file, without looking them
+// up in the summary and the index.
+//
+// Entries are linked into the index page lru of the shard's cache_tracker, so
+// that they are evicted together with row_cache under memory pressure. On top
+// of that, the key caches of a shard use at most the capacity set with
+// set_shard_capacity(), evicting their least recently used entries. A capacity
+// of 0 disables them.
+class key_cache {
+public:
+    struct stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t populations = 0;
+        uint64_t evictions = 0;
+        uint64_t used_bytes = 0;
+    };
+
+    // The index entry of a partition and where its data ends.
+    struct cached_partition {
+        index_entry entry;
+        uint64_t summary_idx;
+        uint64_t data_end;
+    };
+private:
+    using shard_lru_hook = bi::list_base_hook<bi::link_mode<bi::auto_unlink>>;
+
+    class entry final : public evictable, public shard_lru_hook {
+    public:
+        key_cache& parent;
+        partition_key key;
+        cached_partition partition;
+        size_t memory_usage;
+
+        entry(key_cache& parent, const partition_key& key, cached_partition partition)
+            : parent(parent)
+            , key(key)
+            , partition(std::move(partition))
+            , memory_usage(sizeof(entry) + 4 * sizeof(void*) + key.external_memory_usage()
+                           + this->partition.entry.get_key_bytes().size()
+                           + this->partition.entry.get_promoted_index_bytes().size())
+        { }
+        virtual void on_evicted() noexcept override {
+            ++_shard_stats.evictions;
+            parent.erase(parent._entries.find(key));
+        }
+    };
+    using map_type = std::unordered_map<partition_key, std::unique_ptr<entry>, partition_key::hashing, partition_key::equality>;
+    // Least recently used at the back.
+    using shard_lru_type = bi::list<entry, bi::base_hook<shard_lru_hook>, bi::constant_time_size<false>>;
+
+    map_type _entries;
+    uint64_t _hits = 0;
+    uint64_t _misses = 0;
+    static thread_local stats _shard_stats;
+    static thread_local size_t _shard_capacity;
+    static thread_local shard_lru_type _shard_lru;
+
+    void erase(map_type::iterator it) noexcept {
+        _shard_stats.used_bytes -= it->second->memory_usage;
+        _entries.erase(it);
+    }
+
+    void touch(entry& e) noexcept {
+        cache_lru().touch(e);
+        e.shard_lru_hook::unlink();
+        _shard_lru.push_front(e);
+    }
+
+    static void evict_until_fits() noexcept {
+        // The most recently inserted entry, at the front, is never evicted.
+        while (_shard_stats.used_bytes > _shard_capacity && !_shard_lru.empty() && &_shard_lru.back() != &_shard_lru.front()) {
+            auto& e = _shard_lru.back();
+            e.unlink_from_lru();
+            e.on_evicted();
+        }
+    }
+
+    // The lru shared with row_cache. Defined in sstables.cc, so that this
+    // header doesn't need to know about cache_tracker.
+    static lru& cache_lru();
+public:
+    explicit key_cache(const schema& s)
+        : _entries(0, partition_key::hashing(s), partition_key::equality(s))
+    { }
+    key_cache(key_cache&&) = delete;
+
+    ~key_cache() {
+        clear();
+    }
+
+    static bool enabled(const schema& s) {
+        return _shard_capacity && s.caching_options().cache_keys();
+    }
+
+    // The cached partition with the given key, if any. The result is valid
+    // until the next call to insert().
+    const cached_partition* find(const partition_key& key) {
+        auto it = _entries.find(key);
+        if (it == _entries.end()) {
+            ++_misses;
+            ++_shard_stats.misses;
+            return nullptr;
+        }
+        ++_hits;
+        ++_shard_stats.hits;
+        touch(*it->second);
+        return &it->second->partition;
+    }
+
+    void insert(const partition_key& key, cached_partition partition) {
+        if (_entries.count(key)) {
+            return;
+        }
+        auto e = std::make_unique<entry>(*this, key, std::move(partition));
+        auto& ref = *e;
+        _entries.emplace(key, std::move(e));
+        _shard_stats.used_bytes += ref.memory_usage;
+        ++_shard_stats.populations;
+        cache_lru().add(ref);
+        _shard_lru.push_front(ref);
+        evict_until_fits();
+    }
+
+    void clear() noexcept {
+        for (auto&& kv : _entries) {
+            _shard_stats.used_bytes -= kv.second->memory_usage;
+        }
+        _entries.clear();
+    }
+
+    size_t size() const {
+        return _entries.size();
+    }
+
+    uint64_t hits() const {
+        return _hits;
+    }
+
+    uint64_t misses() const {
+        return _misses;
+    }
+
+    static void set_shard_capacity(size_t capacity) {
+        _shard_capacity = capacity;
+        evict_until_fits();
+    }
+
+    static const stats& shard_stats() { return _shard_stats; }
+};
+
+}
@@ -59,6 +59,9 @@ class leveled_manifest {
     schema_ptr _schema;
     std::vector<std::list<sstables::shared_sstable>> _generations;
     uint64_t _max_sstable_size_in_bytes;
+    // Number of L0 sstables above which L0 is size-tiered compacted, or 0
+    // if it never is.
+    int _l0_stcs_threshold = DEFAULT_L0_STCS_THRESHOLD;
 #if 0
     private final SizeTieredCompactionStrategyOptions options;
 #endif
@@ -77,6 +80,8 @@ class leveled_manifest {
 
     static constexpr int MAX_LEVELS = 9; // log10(1000^3);
 
+    static constexpr int DEFAULT_L0_STCS_THRESHOLD = MAX_COMPACTING_L0;
+
     leveled_manifest(column_family& cfs, int max_sstable_size_in_MB)
         : logger("LeveledManifest")
         , _schema(cfs.schema())
@@ -98,8 +103,10 @@ class leveled_manifest {
     }
 #endif
 
-    static leveled_manifest create(column_family& cfs, std::vector<sstables::shared_sstable>& sstables, int max_sstable_size_in_mb) {
+    static leveled_manifest create(column_family& cfs, std::vector<sstables::shared_sstable>& sstables, int max_sstable_size_in_mb,
+            int l0_stcs_threshold = DEFAULT_L0_STCS_THRESHOLD) {
         leveled_manifest manifest = leveled_manifest(cfs, max_sstable_size_in_mb);
+        manifest._l0_stcs_threshold = l0_stcs_threshold;
 
         // ensure all SSTables are in the manifest
         for (auto& sstable : sstables) {
@@ -266,14 +273,27 @@ class leveled_manifest {
         // We don't have that luxury.
         //
         // So instead, we
-        // 1) force compacting higher levels first, which minimizes the i/o needed to compact
-        //    optimially which gives us a long term win, and
-        // 2) if L0 falls behind, we will size-tiered compact it to reduce read overhead until
-        //    we can catch up on the higher levels.
+        // 1) if L0 falls behind, we will size-tiered compact it to reduce read overhead until
+        //    we can catch up on the higher levels, and
+        // 2) force compacting higher levels first, which minimizes the i/o needed to compact
+        //    optimially which gives us a long term win.
         //
         // This isn't a magic wand -- if you are consistently writing too fast for LCS to keep
         // up, you're still screwed.  But if instead you have intermittent bursts of activity,
         // it can help a lot.
+        //
+        // L0 is size-tiered as soon as it's over the threshold, whichever the score of higher
+        // levels: its sstables all overlap L1 after a burst, so the L0 to L1 compaction would
+        // rewrite L1 once per batch of MAX_COMPACTING_L0 sstables, while reads would touch
+        // every one of them. A size-tiered job only touches L0, so compaction manager runs it
+        // alongside jobs of higher levels.
+        if (_l0_stcs_threshold > 0 && get_level_size(0) > size_t(_l0_stcs_threshold)) {
+            auto most_interesting = size_tiered_most_interesting_bucket(get_level(0));
+            if (!most_interesting.empty()) {
+                logger.debug("L0 is too far behind, performing size-tiering there first");
+                return sstables::compaction_descriptor(std::move(most_interesting));
+            }
+        }
         for (auto i = _generations.size() - 1; i > 0; i--) {
             auto& sstables = get_level(i);
             if (sstables.empty()) {
@@ -289,16 +309,6 @@ class leveled_manifest {
             logger.debug("Compaction score for level {} is {}", i, score);
 
             if (score > 1.001) {
-                // before proceeding with a higher level, let's see if L0 is far enough behind to warrant STCS
-                // TODO: we shouldn't proceed with size tiered strategy if cassandra.disable_stcs_in_l0 is true.
-                if (get_level_size(0) > MAX_COMPACTING_L0) {
-                    auto most_interesting = size_tiered_most_interesting_bucket(get_level(0));
-                    if (!most_interesting.empty()) {
-                        logger.debug("L0 is too far behind, performing size-tiering there first");
-                        return sstables::compaction_descriptor(std::move(most_interesting));
-                    }
-                }
-                // L0 is fine, proceed with this level
                 auto info = get_candidates_for(i, last_compacted_keys);
                 if (!info.candidates.empty()) {
                     int next_level = get_next_level(info.candidates, info.can_promote);
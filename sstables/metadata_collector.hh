@@ -190,8 +190,8 @@ class metadata_collector {
     static constexpr double NO_COMPRESSION_RATIO = -1.0;
 
     static hll::HyperLogLog hyperloglog(int p, int sp) {
-        // FIXME: hll::HyperLogLog doesn't support sparse format, so ignoring parameters by the time being.
-        return hll::HyperLogLog();
+        // FIXME: hll::HyperLogLog doesn't support sparse format, so ignoring sp by the time being.
+        return hll::HyperLogLog(p);
     }
 private:
     // EH of 150 can track a max value of 1697806495183, i.e., > 1.5PB
@@ -54,6 +54,7 @@ class mp_row_consumer : public row_consumer {
 private:
     schema_ptr _schema;
     const io_priority_class& _pc;
+    reader_resource_tracker _resource_tracker;
     const query::partition_slice& _slice;
     bool _out_of_range = false;
     stdx::optional<query::clustering_key_filter_ranges> _ck_ranges;
@@ -97,6 +98,13 @@ class mp_row_consumer : public row_consumer {
     // _range_tombstones holds only tombstones which are relevant for current ranges.
     range_tombstone_stream _range_tombstones;
     bool _first_row_encountered = false;
+
+    // Whether the values of the cells of each column are needed, by column
+    // id, when the slice projects columns, see partition_slice::project_columns().
+    // The cells of the other columns are built without their value.
+    bool _project_columns;
+    std::vector<bool> _regular_value_needed;
+    std::vector<bool> _static_value_needed;
 public:
     void set_streamed_mutation(sstable_streamed_mutation* sm) {
         _sm = sm;
@@ -312,18 +320,36 @@ class mp_row_consumer : public row_consumer {
     mp_row_consumer(const schema_ptr schema,
                     const query::partition_slice& slice,
                     const io_priority_class& pc,
+                    reader_resource_tracker resource_tracker,
                     streamed_mutation::forwarding fwd)
             : _schema(schema)
             , _pc(pc)
+            , _resource_tracker(std::move(resource_tracker))
             , _slice(slice)
             , _fwd(fwd)
             , _range_tombstones(*_schema)
-    { }
+            , _project_columns(slice.project_columns() && !_schema->is_counter())
+    {
+        if (_project_columns) {
+            _regular_value_needed.resize(_schema->regular_columns_count());
+            _static_value_needed.resize(_schema->static_columns_count());
+            for (auto id : slice.regular_columns) {
+                _regular_value_needed[id] = true;
+            }
+            for (auto& f : slice.filters()) {
+                _regular_value_needed[f.id] = true;
+            }
+            for (auto id : slice.static_columns) {
+                _static_value_needed[id] = true;
+            }
+        }
+    }
 
     mp_row_consumer(const schema_ptr schema,
                     const io_priority_class& pc,
+                    reader_resource_tracker resource_tracker,
                     streamed_mutation::forwarding fwd)
-            : mp_row_consumer(schema, query::full_slice, pc, fwd) { }
+            : mp_row_consumer(schema, query::full_slice, pc, std::move(resource_tracker), fwd) { }
 
     virtual proceed consume_row_start(sstables::key_view key, sstables::deletion_time deltime) override {
         if (!_is_mutation_end) {
@@ -492,6 +518,14 @@ class mp_row_consumer : public row_consumer {
         });
     }
 
+    bytes_view projected_value(const column_definition& cdef, bytes_view value) const {
+        if (!_project_columns) {
+            return value;
+        }
+        auto& needed = cdef.is_static() ? _static_value_needed : _regular_value_needed;
+        return needed[cdef.id] ? value : bytes_view();
+    }
+
     atomic_cell make_atomic_cell(uint64_t timestamp, bytes_view value, uint32_t ttl, uint32_t expiration) {
         if (ttl) {
             return atomic_cell::make_live(timestamp, value,
@@ -503,7 +537,7 @@ class mp_row_consumer : public row_consumer {
 
     virtual proceed consume_cell(bytes_view col_name, bytes_view value, int64_t timestamp, int32_t ttl, int32_t expiration) override {
         return do_consume_cell(col_name, timestamp, ttl, expiration, [&] (auto&& col) {
-            auto ac = make_atomic_cell(timestamp, value, ttl, expiration);
+            auto ac = make_atomic_cell(timestamp, projected_value(*col.cdef, value), ttl, expiration);
 
             bool is_multi_cell = col.collection_extra_data.size();
             if (is_multi_cell != col.cdef->type->is_multi_cell()) {
@@ -679,6 +713,10 @@ class mp_row_consumer : public row_consumer {
         return _pc;
     }
 
+    virtual reader_resource_tracker resource_tracker() override {
+        return _resource_tracker;
+    }
+
     // Returns true if the consumer is positioned at partition boundary,
     // meaning that after next read either get_mutation() will
     // return engaged mutation or end of stream was reached.
@@ -800,7 +838,7 @@ struct sstable_data_source : public enable_lw_shared_from_this<sstable_data_sour
 
     index_reader& lh_index() {
         if (!_lh_index) {
-            _lh_index = _sst->get_index_reader(_consumer.io_priority());
+            _lh_index = _sst->get_index_reader(_consumer.io_priority(), _consumer.resource_tracker());
         }
         return *_lh_index;
     }
@@ -982,10 +1020,11 @@ sstables::sstable::read_row(schema_ptr schema,
                             const sstables::key& key,
                             const query::partition_slice& slice,
                             const io_priority_class& pc,
-                            streamed_mutation::forwarding fwd)
+                            streamed_mutation::forwarding fwd,
+                            reader_resource_tracker resource_tracker)
 {
-    return do_with(dht::global_partitioner().decorate_key(*schema, key.to_partition_key(*schema)), [this, schema, &slice, &pc, fwd] (auto& dk) {
-        return this->read_row(schema, dk, slice, pc, fwd);
+    return do_with(dht::global_partitioner().decorate_key(*schema, key.to_partition_key(*schema)), [this, schema, &slice, &pc, fwd, resource_tracker] (auto& dk) {
+        return this->read_row(schema, dk, slice, pc, fwd, resource_tracker);
     });
 }
 
@@ -1023,18 +1062,34 @@ promoted_index promoted_index_view::parse(const schema& s) const {
     del_time.marked_for_delete_at = consume_be<uint64_t>(data);
 
     auto num_blocks = consume_be<uint32_t>(data);
-    std::deque<promoted_index::entry> entries;
+    auto blocks = data;
+    std::vector<uint32_t> block_offsets;
+    block_offsets.reserve(num_blocks);
     while (num_blocks--) {
-        uint16_t len = consume_be<uint16_t>(data);
-        auto start_ck = composite_view(consume_bytes(data, len), s.is_compound());
-        len = consume_be<uint16_t>(data);
-        auto end_ck = composite_view(consume_bytes(data, len), s.is_compound());
-        uint64_t offset = consume_be<uint64_t>(data);
-        uint64_t width = consume_be<uint64_t>(data);
-        entries.emplace_back(promoted_index::entry{start_ck, end_ck, offset, width});
+        block_offsets.push_back(blocks.size() - data.size());
+        consume_bytes(data, consume_be<uint16_t>(data));
+        consume_bytes(data, consume_be<uint16_t>(data));
+        consume_bytes(data, 2 * sizeof(uint64_t));
     }
 
-    return promoted_index{del_time, std::move(entries)};
+    return promoted_index(del_time, blocks, std::move(block_offsets), s.is_compound());
+}
+
+// Cannot fail, parse() checked the lengths of all blocks.
+const promoted_index::entry& promoted_index::operator[](size_t i) const {
+    auto it = _entries.find(i);
+    if (it != _entries.end()) {
+        return it->second;
+    }
+    auto data = _blocks;
+    data.remove_prefix(_block_offsets[i]);
+    uint16_t len = consume_be<uint16_t>(data);
+    auto start_ck = composite_view(consume_bytes(data, len), _is_compound);
+    len = consume_be<uint16_t>(data);
+    auto end_ck = composite_view(consume_bytes(data, len), _is_compound);
+    uint64_t offset = consume_be<uint64_t>(data);
+    uint64_t width = consume_be<uint64_t>(data);
+    return _entries.emplace(i, entry{start_ck, end_ck, offset, width}).first->second;
 }
 
 sstables::deletion_time promoted_index_view::get_deletion_time() const {
@@ -1055,7 +1110,7 @@ class mutation_reader::impl {
          const io_priority_class &pc,
          streamed_mutation::forwarding fwd)
         : _get_data_source([this, sst = std::move(sst), s = std::move(schema), toread, last_end, &pc, fwd] {
-            auto consumer = mp_row_consumer(s, query::full_slice, pc, fwd);
+            auto consumer = mp_row_consumer(s, query::full_slice, pc, no_resource_tracking(), fwd);
             auto ds = make_lw_shared<sstable_data_source>(std::move(s), std::move(sst), std::move(consumer), std::move(toread), last_end);
             return make_ready_future<lw_shared_ptr<sstable_data_source>>(std::move(ds));
         }) { }
@@ -1063,7 +1118,7 @@ class mutation_reader::impl {
          const io_priority_class &pc,
          streamed_mutation::forwarding fwd)
         : _get_data_source([this, sst = std::move(sst), s = std::move(schema), &pc, fwd] {
-            auto consumer = mp_row_consumer(s, query::full_slice, pc, fwd);
+            auto consumer = mp_row_consumer(s, query::full_slice, pc, no_resource_tracking(), fwd);
             auto ds = make_lw_shared<sstable_data_source>(std::move(s), std::move(sst), std::move(consumer));
             return make_ready_future<lw_shared_ptr<sstable_data_source>>(std::move(ds));
         }) { }
@@ -1072,16 +1127,17 @@ class mutation_reader::impl {
          const dht::partition_range& pr,
          const query::partition_slice& slice,
          const io_priority_class& pc,
+         reader_resource_tracker resource_tracker,
          streamed_mutation::forwarding fwd,
          ::mutation_reader::forwarding fwd_mr)
-        : _get_data_source([this, pr, sst = std::move(sst), s = std::move(schema), &pc, &slice, fwd, fwd_mr] () mutable {
-            auto lh_index = sst->get_index_reader(pc); // lh = left hand
-            auto rh_index = sst->get_index_reader(pc);
+        : _get_data_source([this, pr, sst = std::move(sst), s = std::move(schema), &pc, resource_tracker = std::move(resource_tracker), &slice, fwd, fwd_mr] () mutable {
+            auto lh_index = sst->get_index_reader(pc, resource_tracker); // lh = left hand
+            auto rh_index = sst->get_index_reader(pc, resource_tracker);
             auto f = seastar::when_all_succeed(lh_index->advance_to_start(pr), rh_index->advance_to_end(pr));
-            return f.then([this, lh_index = std::move(lh_index), rh_index = std::move(rh_index), sst = std::move(sst), s = std::move(s), &pc, &slice, fwd, fwd_mr] () mutable {
+            return f.then([this, lh_index = std::move(lh_index), rh_index = std::move(rh_index), sst = std::move(sst), s = std::move(s), &pc, resource_tracker, &slice, fwd, fwd_mr] () mutable {
                 sstable::disk_read_range drr{lh_index->data_file_position(),
                                              rh_index->data_file_position()};
-                auto consumer = mp_row_consumer(s, slice, pc, fwd);
+                auto consumer = mp_row_consumer(s, slice, pc, std::move(resource_tracker), fwd);
                 auto ds = make_lw_shared<sstable_data_source>(std::move(s), std::move(sst), std::move(consumer), drr, (fwd_mr ? sst->data_size() : drr.end), std::move(lh_index), std::move(rh_index));
                 ds->_index_in_current_partition = true;
                 ds->_will_likely_slice = sstable_data_source::will_likely_slice(slice);
@@ -1257,11 +1313,37 @@ sstables::sstable::read_row(schema_ptr schema,
     dht::ring_position_view key,
     const query::partition_slice& slice,
     const io_priority_class& pc,
-    streamed_mutation::forwarding fwd)
+    streamed_mutation::forwarding fwd,
+    reader_resource_tracker resource_tracker)
 {
-    auto lh_index = get_index_reader(pc);
+    auto make_data_source = [this, &slice, &pc, fwd, resource_tracker] (schema_ptr s,
+            std::unique_ptr<index_reader> lh_index, std::unique_ptr<index_reader> rh_index) mutable {
+        auto consumer = mp_row_consumer(s, slice, pc, std::move(resource_tracker), fwd);
+        auto ds = make_lw_shared<sstable_data_source>(sstable_data_source::single_partition_tag(), std::move(s),
+            shared_from_this(), std::move(consumer), std::move(lh_index), std::move(rh_index));
+        ds->_will_likely_slice = sstable_data_source::will_likely_slice(slice);
+        ds->_index_in_current_partition = true;
+        return ds->read_partition().finally([ds]{});
+    };
+
+    bool use_key_cache = key.key() && key_cache::enabled(*_schema);
+    if (use_key_cache) {
+        if (auto p = _key_cache.find(*key.key())) {
+            _filter_tracker.add_true_positive();
+            auto lh_index = std::make_unique<index_reader>(shared_from_this(), pc, resource_tracker, *p);
+            auto rh_index = std::make_unique<index_reader>(*lh_index);
+            auto f = advance_to_upper_bound(*rh_index, *_schema, slice, key);
+            return f.then([make_data_source = std::move(make_data_source), lh_index = std::move(lh_index), rh_index = std::move(rh_index),
+                    s = std::move(schema)] () mutable {
+                return make_data_source(std::move(s), std::move(lh_index), std::move(rh_index));
+            });
+        }
+    }
+
+    auto lh_index = get_index_reader(pc, resource_tracker);
     auto f = lh_index->advance_and_check_if_present(key);
-    return f.then([this, &slice, &pc, fwd, lh_index = std::move(lh_index), s = std::move(schema), key] (bool present) mutable {
+    return f.then([this, &slice, make_data_source = std::move(make_data_source), lh_index = std::move(lh_index), s = std::move(schema), key,
+            use_key_cache] (bool present) mutable {
         if (!present) {
             _filter_tracker.add_false_positive();
             return make_ready_future<streamed_mutation_opt>(stdx::nullopt);
@@ -1269,15 +1351,43 @@ sstables::sstable::read_row(schema_ptr schema,
 
         _filter_tracker.add_true_positive();
 
+        if (use_key_cache) {
+            if (auto p = lh_index->make_cached_partition()) {
+                _key_cache.insert(*key.key(), std::move(*p));
+            }
+        }
+
         auto rh_index = std::make_unique<index_reader>(*lh_index);
         auto f = advance_to_upper_bound(*rh_index, *_schema, slice, key);
-        return f.then([this, &slice, &pc, fwd, lh_index = std::move(lh_index), rh_index = std::move(rh_index), s = std::move(s)] () mutable {
-            auto consumer = mp_row_consumer(s, slice, pc, fwd);
-            auto ds = make_lw_shared<sstable_data_source>(sstable_data_source::single_partition_tag(), std::move(s),
-                shared_from_this(), std::move(consumer), std::move(lh_index), std::move(rh_index));
-            ds->_will_likely_slice = sstable_data_source::will_likely_slice(slice);
-            ds->_index_in_current_partition = true;
-            return ds->read_partition().finally([ds]{});
+        return f.then([make_data_source = std::move(make_data_source), lh_index = std::move(lh_index), rh_index = std::move(rh_index),
+                s = std::move(s)] () mutable {
+            return make_data_source(std::move(s), std::move(lh_index), std::move(rh_index));
+        });
+    });
+}
+
+future<std::vector<clustering_key_prefix>>
+sstable::get_promoted_index_block_starts(const dht::decorated_key& key, const io_priority_class& pc) {
+    if (!filter_has_key(*_schema, key)) {
+        return make_ready_future<std::vector<clustering_key_prefix>>();
+    }
+    if (key_cache::enabled(*_schema)) {
+        if (auto p = _key_cache.find(key.key())) {
+            auto index = std::make_unique<index_reader>(shared_from_this(), pc, no_resource_tracking(), *p);
+            auto starts = index->promoted_index_block_starts();
+            auto f = index->close();
+            return f.then([index = std::move(index), starts = std::move(starts)] () mutable {
+                return std::move(starts);
+            });
+        }
+    }
+    auto index = get_index_reader(pc);
+    auto f = index->advance_and_check_if_present(key);
+    return f.then([index = std::move(index)] (bool present) mutable {
+        auto starts = present ? index->promoted_index_block_starts() : std::vector<clustering_key_prefix>();
+        auto f = index->close();
+        return f.then([index = std::move(index), starts = std::move(starts)] () mutable {
+            return std::move(starts);
         });
     });
 }
@@ -1288,9 +1398,10 @@ sstable::read_range_rows(schema_ptr schema,
                          const query::partition_slice& slice,
                          const io_priority_class& pc,
                          streamed_mutation::forwarding fwd,
-                         ::mutation_reader::forwarding fwd_mr) {
+                         ::mutation_reader::forwarding fwd_mr,
+                         reader_resource_tracker resource_tracker) {
     return std::make_unique<mutation_reader::impl>(
-        shared_from_this(), std::move(schema), range, slice, pc, fwd, fwd_mr);
+        shared_from_this(), std::move(schema), range, slice, pc, std::move(resource_tracker), fwd, fwd_mr);
 }
 
 }
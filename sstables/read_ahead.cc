@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <deque>
+#include "core/align.hh"
+#include "core/future-util.hh"
+#include "sstables/read_ahead.hh"
+
+namespace sstables {
+
+constexpr size_t read_ahead_window::min_buffer_size;
+
+class adaptive_file_data_source_impl : public data_source_impl {
+    // Reads end on this boundary, when they can, so that the next ones
+    // start aligned.
+    static constexpr uint64_t alignment = 4096;
+
+    struct pending_read {
+        uint64_t size;
+        future<temporary_buffer<char>> buf;
+    };
+
+    file _file;
+    io_priority_class _pc;
+    // Of the next read to issue.
+    uint64_t _pos;
+    uint64_t _end;
+    read_ahead_window _window;
+    lw_shared_ptr<read_ahead_stats> _stats;
+    // Oldest first.
+    std::deque<pending_read> _pending;
+    future<> _dropped_reads = make_ready_future<>();
+    bool _first_get = true;
+    bool _skipped = false;
+private:
+    void issue_read() {
+        auto end = std::min(_end, _pos + _window.buffer_size());
+        if (end < _end && align_down(end, alignment) > _pos) {
+            end = align_down(end, alignment);
+        }
+        auto size = end - _pos;
+        _pending.push_back(pending_read{size, _file.dma_read_bulk<char>(_pos, size, _pc)});
+        _pos = end;
+        ++_stats->reads;
+        _stats->bytes_read += size;
+    }
+
+    void drop(pending_read r, uint64_t wasted) {
+        _stats->wasted_bytes += wasted;
+        _dropped_reads = _dropped_reads.then([buf = std::move(r.buf)] () mutable {
+            return buf.then_wrapped([] (future<temporary_buffer<char>> f) {
+                f.ignore_ready_future();
+            });
+        });
+    }
+
+    void update_window() {
+        if (_skipped) {
+            _window.on_skip();
+        } else if (!_first_get) {
+            auto was_sequential = _window.is_sequential();
+            _window.on_sequential_read();
+            if (!was_sequential && _window.is_sequential()) {
+                ++_stats->sequential_readers;
+            }
+        }
+        _first_get = false;
+        _skipped = false;
+    }
+public:
+    adaptive_file_data_source_impl(file f, uint64_t pos, uint64_t len, const io_priority_class& pc,
+            read_ahead_window window, lw_shared_ptr<read_ahead_stats> stats)
+        : _file(std::move(f))
+        , _pc(pc)
+        , _pos(pos)
+        , _end(pos + len)
+        , _window(std::move(window))
+        , _stats(std::move(stats))
+    { }
+
+    virtual future<temporary_buffer<char>> get() override {
+        update_window();
+        if (_pending.empty()) {
+            if (_pos == _end) {
+                return make_ready_future<temporary_buffer<char>>();
+            }
+            issue_read();
+        }
+        auto buf = std::move(_pending.front().buf);
+        _pending.pop_front();
+        while (_pending.size() < _window.read_ahead() && _pos < _end) {
+            issue_read();
+        }
+        return buf;
+    }
+
+    virtual future<temporary_buffer<char>> skip(uint64_t n) override {
+        _skipped = true;
+        while (!_pending.empty()) {
+            auto& r = _pending.front();
+            if (n < r.size) {
+                // The rest of this read is consumed as usual.
+                _stats->wasted_bytes += n;
+                auto buf = std::move(r.buf);
+                _pending.pop_front();
+                return buf.then([n] (temporary_buffer<char> buf) {
+                    buf.trim_front(std::min<uint64_t>(n, buf.size()));
+                    return buf;
+                });
+            }
+            n -= r.size;
+            auto size = r.size;
+            auto read = std::move(r);
+            _pending.pop_front();
+            drop(std::move(read), size);
+        }
+        _pos = std::min(_end, _pos + n);
+        return make_ready_future<temporary_buffer<char>>();
+    }
+
+    virtual future<> close() override {
+        while (!_pending.empty()) {
+            auto& r = _pending.front();
+            auto size = r.size;
+            auto read = std::move(r);
+            _pending.pop_front();
+            drop(std::move(read), size);
+        }
+        return std::move(_dropped_reads);
+    }
+};
+
+constexpr uint64_t adaptive_file_data_source_impl::alignment;
+
+input_stream<char> make_adaptive_file_input_stream(file f, uint64_t pos, uint64_t len, const io_priority_class& pc,
+        read_ahead_window window, lw_shared_ptr<read_ahead_stats> stats) {
+    return input_stream<char>(data_source(std::make_unique<adaptive_file_data_source_impl>(
+            std::move(f), pos, len, pc, std::move(window), std::move(stats))));
+}
+
+}
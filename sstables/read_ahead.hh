@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include "core/file.hh"
+#include "core/iostream.hh"
+#include "core/shared_ptr.hh"
+
+namespace sstables {
+
+struct read_ahead_stats {
+    uint64_t reads = 0;
+    uint64_t bytes_read = 0;
+    // Bytes read from disk which the reader skipped over or never got to.
+    uint64_t wasted_bytes = 0;
+    // Readers which were found to scan, and started to read ahead.
+    uint64_t sequential_readers = 0;
+};
+
+// How much a reader of the data file reads at a time, adapted to the way it
+// reads.
+//
+// A reader starts with a single buffer and no read-ahead, which suits point
+// reads. Every buffer it consumes right after the previous one doubles the
+// buffer size and then, once at the largest size, adds a buffer of
+// read-ahead, so that a scan soon keeps several large reads in flight. A
+// skip tells the reader isn't scanning anymore, and starts over.
+class read_ahead_window {
+    size_t _initial_buffer_size;
+    size_t _max_buffer_size;
+    unsigned _max_read_ahead;
+    size_t _buffer_size;
+    unsigned _read_ahead = 0;
+public:
+    static constexpr size_t min_buffer_size = 16 * 1024;
+
+    read_ahead_window(size_t initial_buffer_size, size_t max_buffer_size, unsigned max_read_ahead)
+        : _initial_buffer_size(std::min(initial_buffer_size, max_buffer_size))
+        , _max_buffer_size(max_buffer_size)
+        , _max_read_ahead(max_read_ahead)
+        , _buffer_size(_initial_buffer_size)
+    { }
+
+    // For reads of len bytes which ask for nothing past them: the first
+    // buffer fits them all.
+    static read_ahead_window for_point_read(size_t len, size_t max_buffer_size, unsigned max_read_ahead) {
+        return read_ahead_window(std::max(len, min_buffer_size), max_buffer_size, max_read_ahead);
+    }
+
+    // For reads which may go on until the end of the file.
+    static read_ahead_window for_scan(size_t max_buffer_size, unsigned max_read_ahead) {
+        return read_ahead_window(min_buffer_size, max_buffer_size, max_read_ahead);
+    }
+
+    size_t buffer_size() const {
+        return _buffer_size;
+    }
+
+    unsigned read_ahead() const {
+        return _read_ahead;
+    }
+
+    bool is_sequential() const {
+        return _read_ahead > 0;
+    }
+
+    // The reader consumed a buffer right after the previous one.
+    void on_sequential_read() {
+        if (_buffer_size < _max_buffer_size) {
+            _buffer_size = std::min(_buffer_size * 2, _max_buffer_size);
+        } else if (_read_ahead < _max_read_ahead) {
+            ++_read_ahead;
+        }
+    }
+
+    void on_skip() {
+        _buffer_size = _initial_buffer_size;
+        _read_ahead = 0;
+    }
+};
+
+// Reads [pos, pos + len) of f, as sized by window, accounting for the reads
+// in stats.
+input_stream<char> make_adaptive_file_input_stream(file f, uint64_t pos, uint64_t len, const io_priority_class& pc,
+        read_ahead_window window, lw_shared_ptr<read_ahead_stats> stats);
+
+}
@@ -21,6 +21,8 @@
 
 #include "sstables.hh"
 #include "consumer.hh"
+#include "db/marshal/type_parser.hh"
+#include <deque>
 
 namespace sstables {
 
@@ -387,6 +389,629 @@ class data_consume_rows_context : public data_consumer::continuous_data_consumer
     }
 };
 
+// data_consume_rows_context_m reads the data file of an sa sstable, see
+// sstable::write_row_m().
+//
+// To reuse row_consumer, which was designed around ka's column-oriented
+// layout, every row is translated into the sequence of "atoms" the ka writer
+// would have written for it, with the same column names. The row body is
+// read into memory as a whole (its size precedes it), decoded into a queue
+// of atoms, and these are fed one by one to the consumer, which may stop
+// after any of them.
+class data_consume_rows_context_m : public data_consumer::continuous_data_consumer<data_consume_rows_context_m> {
+private:
+    enum class state {
+        PARTITION_START,
+        PARTITION_KEY_BYTES,
+        DELETION_TIME,
+        DELETION_TIME_2,
+        DELETION_TIME_3,
+        FLAGS,
+        FLAGS_2,
+        EXTENDED_FLAGS,
+        EXTENDED_FLAGS_2,
+        MARKER_KIND,
+        MARKER_KIND_2,
+        MARKER_SIZE,
+        MARKER_SIZE_2,
+        CK_BLOCK_START,
+        CK_BLOCK_HEADER,
+        CK_BLOCK_HEADER_2,
+        CK_VALUE_START,
+        CK_VALUE_LENGTH,
+        CK_VALUE_LENGTH_2,
+        CK_VALUE_BYTES,
+        CK_VALUE_BYTES_2,
+        ROW_SIZE,
+        ROW_SIZE_2,
+        ROW_BODY,
+        ROW_BODY_2,
+        EMIT_ATOMS,
+    } _state = state::PARTITION_START;
+
+    struct column_info {
+        const column_definition* cdef; // null if dropped since the write
+        bool is_complex;
+    };
+
+    struct atom {
+        enum class kind { cell, counter_cell, deleted_cell, range_tombstone, shadowable_row_tombstone };
+        kind k;
+        bytes name;
+        bytes end_name;
+        bytes value;
+        int64_t timestamp;
+        int32_t ttl;
+        int32_t expiration;
+        deletion_time deltime;
+    };
+
+    row_consumer& _consumer;
+    const schema& _schema;
+    encoding_stats _enc_stats;
+    std::vector<column_info> _regular_columns;
+    std::vector<column_info> _static_columns;
+
+    temporary_buffer<char> _key;
+    temporary_buffer<char> _val;
+
+    unfiltered_flags_m _flags;
+    unfiltered_extended_flags_m _ext_flags;
+    bound_kind_m _marker_kind;
+    size_t _ck_size;
+    std::vector<bytes> _ck_values;
+    size_t _ck_block_end;
+    uint64_t _ck_block_header;
+
+    std::deque<atom> _atoms;
+    // Start of the range tombstone opened by the last open marker.
+    stdx::optional<bytes> _open_marker;
+
+    static std::vector<column_info> make_columns(const schema& s,
+            const disk_array_vint_size<serialization_header::column_desc>& columns) {
+        std::vector<column_info> ret;
+        for (auto& c : columns.elements) {
+            auto cdef = s.get_column_definition(c.name.value);
+            if (cdef) {
+                ret.push_back({ cdef, !cdef->is_atomic() });
+            } else {
+                auto type = db::marshal::type_parser::parse(sstring(reinterpret_cast<const char*>(c.type_name.value.data()), c.type_name.value.size()));
+                ret.push_back({ nullptr, type->is_multi_cell() });
+            }
+        }
+        return ret;
+    }
+
+    bool is_static() const {
+        return (_ext_flags & unfiltered_extended_flags_m::is_static) != unfiltered_extended_flags_m::none;
+    }
+
+    static uint64_t read_vint(bytes_view& v) {
+        if (v.empty()) {
+            throw malformed_sstable_exception("truncated sa row");
+        }
+        auto len = unsigned_vint::serialized_size_from_first_byte(v.front());
+        if (v.size() < len) {
+            throw malformed_sstable_exception("truncated sa row");
+        }
+        auto value = unsigned_vint::deserialize(v);
+        v.remove_prefix(len);
+        return value;
+    }
+
+    static bytes_view read_vint_bytes(bytes_view& v) {
+        auto len = read_vint(v);
+        if (v.size() < len) {
+            throw malformed_sstable_exception("truncated sa row");
+        }
+        auto ret = v.substr(0, len);
+        v.remove_prefix(len);
+        return ret;
+    }
+
+    int64_t read_timestamp(bytes_view& v) const {
+        return int64_t(read_vint(v) + uint64_t(_enc_stats.min_timestamp));
+    }
+
+    int32_t read_local_deletion_time(bytes_view& v) const {
+        return int32_t(read_vint(v) + uint64_t(_enc_stats.min_local_deletion_time));
+    }
+
+    int32_t read_ttl(bytes_view& v) const {
+        return int32_t(read_vint(v) + uint64_t(_enc_stats.min_ttl));
+    }
+
+    deletion_time read_deletion_time(bytes_view& v) const {
+        deletion_time d;
+        d.marked_for_delete_at = read_timestamp(v);
+        d.local_deletion_time = read_local_deletion_time(v);
+        return d;
+    }
+
+    composite make_clustering_composite() const {
+        return composite::from_clustering_element(_schema, clustering_key_prefix::from_exploded(_schema, _ck_values));
+    }
+
+    void push_cell(bytes name, bytes_view value, int64_t timestamp, int32_t ttl, int32_t expiration) {
+        _atoms.push_back({ atom::kind::cell, std::move(name), {}, to_bytes(value), timestamp, ttl, expiration, {} });
+    }
+
+    void push_deleted_cell(bytes name, deletion_time d) {
+        _atoms.push_back({ atom::kind::deleted_cell, std::move(name), {}, {}, 0, 0, 0, d });
+    }
+
+    void push_range_tombstone(bytes start, bytes end, deletion_time d) {
+        _atoms.push_back({ atom::kind::range_tombstone, std::move(start), std::move(end), {}, 0, 0, 0, d });
+    }
+
+    // The name the ka writer gives to the cell of an atomic column.
+    bytes atomic_cell_name(const composite& ck, const column_definition& cdef) const {
+        if (is_static()) {
+            if (_schema.is_compound()) {
+                return serialize_colname(ck, { bytes_view(cdef.name()) }, composite::eoc::none);
+            }
+            return cdef.name();
+        }
+        if (_schema.is_compound()) {
+            if (_schema.is_dense()) {
+                return to_bytes(bytes_view(ck));
+            }
+            return serialize_colname(ck, { bytes_view(cdef.name()) }, composite::eoc::none);
+        }
+        if (_schema.is_dense()) {
+            return _ck_values.front();
+        }
+        return cdef.name();
+    }
+
+    void decode_cell(bytes_view& v, const column_info& col, const composite& ck, int64_t row_timestamp,
+            int32_t row_ttl, int32_t row_expiration) {
+        if (v.empty()) {
+            throw malformed_sstable_exception("truncated sa row");
+        }
+        auto flags = column_flags_m(v.front());
+        v.remove_prefix(1);
+        auto has = [flags] (column_flags_m f) { return (flags & f) != column_flags_m::none; };
+        bool is_deleted = has(column_flags_m::is_deleted);
+        bool is_expiring = has(column_flags_m::is_expiring);
+        bool use_row_ttl = has(column_flags_m::use_row_ttl);
+
+        int64_t timestamp = has(column_flags_m::use_row_timestamp) ? row_timestamp : read_timestamp(v);
+        int32_t ttl = 0, expiration = 0;
+        if (is_deleted || is_expiring) {
+            if (use_row_ttl) {
+                ttl = row_ttl;
+                expiration = row_expiration;
+            } else {
+                expiration = read_local_deletion_time(v);
+                if (is_expiring) {
+                    ttl = read_ttl(v);
+                }
+            }
+        }
+        bytes_view path;
+        if (col.is_complex) {
+            path = read_vint_bytes(v);
+        }
+        bytes_view value;
+        if (!is_deleted && !has(column_flags_m::has_empty_value)) {
+            value = read_vint_bytes(v);
+        }
+        if (!col.cdef) {
+            return;
+        }
+
+        bytes name = col.is_complex
+                   ? serialize_colname(ck, { bytes_view(col.cdef->name()), path }, composite::eoc::none)
+                   : atomic_cell_name(ck, *col.cdef);
+        if (is_deleted) {
+            deletion_time d;
+            d.marked_for_delete_at = timestamp;
+            d.local_deletion_time = expiration;
+            push_deleted_cell(std::move(name), d);
+        } else if (col.cdef->is_counter()) {
+            _atoms.push_back({ atom::kind::counter_cell, std::move(name), {}, to_bytes(value), timestamp, 0, 0, {} });
+        } else {
+            push_cell(std::move(name), value, timestamp, ttl, expiration);
+        }
+    }
+
+    void decode_row(bytes_view v) {
+        read_vint(v); // size of the previous unfiltered
+        auto has = [this] (unfiltered_flags_m f) { return (_flags & f) != unfiltered_flags_m::none; };
+        auto ck = is_static() ? composite::static_prefix(_schema) : make_clustering_composite();
+
+        int64_t row_timestamp = api::missing_timestamp;
+        int32_t row_ttl = 0, row_expiration = 0;
+        if (has(unfiltered_flags_m::has_timestamp)) {
+            row_timestamp = read_timestamp(v);
+            bool dead = false;
+            if (has(unfiltered_flags_m::has_ttl)) {
+                row_ttl = read_ttl(v);
+                row_expiration = read_local_deletion_time(v);
+                dead = row_ttl == expired_liveness_ttl;
+            }
+            if (!is_static() && _schema.is_compound() && !_schema.is_dense()) {
+                auto name = serialize_colname(ck, { bytes_view() }, composite::eoc::none);
+                if (dead) {
+                    deletion_time d;
+                    d.marked_for_delete_at = row_timestamp;
+                    d.local_deletion_time = row_expiration;
+                    push_deleted_cell(std::move(name), d);
+                } else {
+                    push_cell(std::move(name), bytes_view(), row_timestamp, row_ttl, row_expiration);
+                }
+            }
+            if (dead) {
+                row_ttl = row_expiration = 0;
+            }
+        }
+        if (has(unfiltered_flags_m::has_deletion)) {
+            push_range_tombstone(serialize_colname(ck, {}, composite::eoc::start),
+                    serialize_colname(ck, {}, composite::eoc::end), read_deletion_time(v));
+        }
+        if ((_ext_flags & unfiltered_extended_flags_m::has_shadowable_deletion) != unfiltered_extended_flags_m::none) {
+            _atoms.push_back({ atom::kind::shadowable_row_tombstone, serialize_colname(ck, {}, composite::eoc::start),
+                    {}, {}, 0, 0, 0, read_deletion_time(v) });
+        }
+
+        auto& columns = is_static() ? _static_columns : _regular_columns;
+        std::vector<bool> present(columns.size(), true);
+        if (!has(unfiltered_flags_m::has_all_columns)) {
+            auto superset = columns.size();
+            if (superset < 64) {
+                auto missing = read_vint(v);
+                for (size_t i = 0; i < superset; ++i) {
+                    present[i] = !(missing & (uint64_t(1) << i));
+                }
+            } else {
+                auto missing_count = read_vint(v);
+                if (missing_count > superset) {
+                    throw malformed_sstable_exception("invalid sa column subset");
+                }
+                auto present_count = superset - missing_count;
+                bool list_present = present_count < superset / 2;
+                std::fill(present.begin(), present.end(), !list_present);
+                for (size_t i = 0; i < (list_present ? present_count : missing_count); ++i) {
+                    auto idx = read_vint(v);
+                    if (idx >= superset) {
+                        throw malformed_sstable_exception("invalid sa column index");
+                    }
+                    present[idx] = list_present;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (!present[i]) {
+                continue;
+            }
+            auto& col = columns[i];
+            if (!col.is_complex) {
+                decode_cell(v, col, ck, row_timestamp, row_ttl, row_expiration);
+                continue;
+            }
+            if (has(unfiltered_flags_m::has_complex_deletion)) {
+                auto d = read_deletion_time(v);
+                if (col.cdef && !d.live()) {
+                    auto name = bytes_view(col.cdef->name());
+                    push_range_tombstone(serialize_colname(ck, { name }, composite::eoc::start),
+                            serialize_colname(ck, { name }, composite::eoc::end), d);
+                }
+            }
+            auto count = read_vint(v);
+            for (uint64_t j = 0; j < count; ++j) {
+                decode_cell(v, col, ck, row_timestamp, row_ttl, row_expiration);
+            }
+        }
+    }
+
+    static composite::eoc marker_eoc(bound_kind_m kind) {
+        switch (kind) {
+        case bound_kind_m::incl_start:
+        case bound_kind_m::excl_end:
+        case bound_kind_m::excl_end_incl_start:
+            return composite::eoc::start;
+        case bound_kind_m::excl_start:
+        case bound_kind_m::incl_end:
+        case bound_kind_m::incl_end_excl_start:
+            return composite::eoc::end;
+        default:
+            throw malformed_sstable_exception(sprint("unexpected range tombstone bound kind %d", int(kind)));
+        }
+    }
+
+    void decode_marker(bytes_view v) {
+        read_vint(v); // size of the previous unfiltered
+        auto name = serialize_colname(make_clustering_composite(), {}, marker_eoc(_marker_kind));
+        auto close = [&] (bytes end) {
+            auto d = read_deletion_time(v);
+            if (!_open_marker) {
+                throw malformed_sstable_exception("range tombstone close marker without an open one");
+            }
+            push_range_tombstone(std::move(*_open_marker), std::move(end), d);
+            _open_marker = {};
+        };
+        switch (_marker_kind) {
+        case bound_kind_m::incl_start:
+        case bound_kind_m::excl_start:
+            _open_marker = std::move(name);
+            break;
+        case bound_kind_m::incl_end:
+        case bound_kind_m::excl_end:
+            close(std::move(name));
+            break;
+        case bound_kind_m::excl_end_incl_start:
+        case bound_kind_m::incl_end_excl_start: {
+            // A boundary closes the previous tombstone and opens the next one
+            // at the same position, with the opposite inclusiveness.
+            auto start_eoc = _marker_kind == bound_kind_m::excl_end_incl_start ? composite::eoc::start : composite::eoc::end;
+            close(name);
+            read_deletion_time(v); // the tombstone which starts here is repeated by its close marker
+            _open_marker = serialize_colname(make_clustering_composite(), {}, start_eoc);
+            break;
+        }
+        default:
+            throw malformed_sstable_exception(sprint("unexpected range tombstone bound kind %d", int(_marker_kind)));
+        }
+    }
+
+    row_consumer::proceed emit(atom& a) {
+        switch (a.k) {
+        case atom::kind::cell:
+            return _consumer.consume_cell(a.name, a.value, a.timestamp, a.ttl, a.expiration);
+        case atom::kind::counter_cell:
+            return _consumer.consume_counter_cell(a.name, a.value, a.timestamp);
+        case atom::kind::deleted_cell:
+            return _consumer.consume_deleted_cell(a.name, a.deltime);
+        case atom::kind::range_tombstone:
+            return _consumer.consume_range_tombstone(a.name, a.end_name, a.deltime);
+        case atom::kind::shadowable_row_tombstone:
+            return _consumer.consume_shadowable_row_tombstone(a.name, a.deltime);
+        }
+        abort();
+    }
+public:
+    bool non_consuming() const {
+        return (((_state == state::DELETION_TIME_3)
+                || (_state == state::FLAGS_2)
+                || (_state == state::EXTENDED_FLAGS_2)
+                || (_state == state::MARKER_KIND_2)
+                || (_state == state::MARKER_SIZE_2)
+                || (_state == state::CK_BLOCK_START)
+                || (_state == state::CK_BLOCK_HEADER_2)
+                || (_state == state::CK_VALUE_START)
+                || (_state == state::CK_VALUE_LENGTH_2)
+                || (_state == state::CK_VALUE_BYTES_2)
+                || (_state == state::ROW_SIZE_2)
+                || (_state == state::ROW_BODY_2)
+                || (_state == state::EMIT_ATOMS)) && (_prestate == prestate::NONE));
+    }
+
+    row_consumer::proceed process_state(temporary_buffer<char>& data) {
+        sstlog.trace("data_consume_row_context_m {}: state={}, size={}", this, static_cast<int>(_state), data.size());
+        switch (_state) {
+        case state::PARTITION_START:
+            if (read_16(data) != read_status::ready) {
+                _state = state::PARTITION_KEY_BYTES;
+                break;
+            }
+        case state::PARTITION_KEY_BYTES:
+            if (read_bytes(data, _u16, _key) != read_status::ready) {
+                _state = state::DELETION_TIME;
+                break;
+            }
+        case state::DELETION_TIME:
+            if (read_32(data) != read_status::ready) {
+                _state = state::DELETION_TIME_2;
+                break;
+            }
+            // fallthrough
+        case state::DELETION_TIME_2:
+            if (read_64(data) != read_status::ready) {
+                _state = state::DELETION_TIME_3;
+                break;
+            }
+            // fallthrough
+        case state::DELETION_TIME_3: {
+            deletion_time del;
+            del.local_deletion_time = _u32;
+            del.marked_for_delete_at = _u64;
+            auto ret = _consumer.consume_row_start(key_view(to_bytes_view(_key)), del);
+            _key.release();
+            _open_marker = {};
+            _state = state::FLAGS;
+            if (ret == row_consumer::proceed::no) {
+                return row_consumer::proceed::no;
+            }
+            break;
+        }
+        case state::FLAGS:
+            if (read_8(data) != read_status::ready) {
+                _state = state::FLAGS_2;
+                break;
+            }
+            // fallthrough
+        case state::FLAGS_2:
+            _flags = unfiltered_flags_m(_u8);
+            _ext_flags = unfiltered_extended_flags_m::none;
+            if ((_flags & unfiltered_flags_m::end_of_partition) != unfiltered_flags_m::none) {
+                _state = state::PARTITION_START;
+                if (_consumer.consume_row_end() == row_consumer::proceed::no) {
+                    return row_consumer::proceed::no;
+                }
+                break;
+            }
+            if ((_flags & unfiltered_flags_m::extension_flag) == unfiltered_flags_m::none) {
+                goto flags_done;
+            }
+            _state = state::EXTENDED_FLAGS;
+            break;
+        case state::EXTENDED_FLAGS:
+            if (read_8(data) != read_status::ready) {
+                _state = state::EXTENDED_FLAGS_2;
+                break;
+            }
+            // fallthrough
+        case state::EXTENDED_FLAGS_2:
+            _ext_flags = unfiltered_extended_flags_m(_u8);
+        flags_done:
+            _ck_values.clear();
+            if ((_flags & unfiltered_flags_m::is_marker) != unfiltered_flags_m::none) {
+                _state = state::MARKER_KIND;
+            } else {
+                _ck_size = is_static() ? 0 : _schema.clustering_key_size();
+                _state = state::CK_BLOCK_START;
+            }
+            break;
+        case state::MARKER_KIND:
+            if (read_8(data) != read_status::ready) {
+                _state = state::MARKER_KIND_2;
+                break;
+            }
+            // fallthrough
+        case state::MARKER_KIND_2:
+            _marker_kind = bound_kind_m(_u8);
+            _state = state::MARKER_SIZE;
+            break;
+        case state::MARKER_SIZE:
+            if (read_16(data) != read_status::ready) {
+                _state = state::MARKER_SIZE_2;
+                break;
+            }
+            // fallthrough
+        case state::MARKER_SIZE_2:
+            _ck_size = _u16;
+            _state = state::CK_BLOCK_START;
+            break;
+        case state::CK_BLOCK_START:
+            _state = _ck_values.size() == _ck_size ? state::ROW_SIZE : state::CK_BLOCK_HEADER;
+            break;
+        case state::CK_BLOCK_HEADER:
+            if (read_unsigned_vint(data) != read_status::ready) {
+                _state = state::CK_BLOCK_HEADER_2;
+                break;
+            }
+            // fallthrough
+        case state::CK_BLOCK_HEADER_2:
+            _ck_block_header = _u64;
+            _ck_block_end = std::min(_ck_size, _ck_values.size() + 32);
+            _state = state::CK_VALUE_START;
+            break;
+        case state::CK_VALUE_START: {
+            if (_ck_values.size() == _ck_block_end) {
+                _state = state::CK_BLOCK_START;
+                break;
+            }
+            auto shift = (_ck_values.size() % 32) * 2;
+            if (_ck_block_header & (uint64_t(1) << shift)) {
+                _ck_values.emplace_back();
+            } else {
+                _state = state::CK_VALUE_LENGTH;
+            }
+            break;
+        }
+        case state::CK_VALUE_LENGTH:
+            if (read_unsigned_vint(data) != read_status::ready) {
+                _state = state::CK_VALUE_LENGTH_2;
+                break;
+            }
+            // fallthrough
+        case state::CK_VALUE_LENGTH_2:
+            _state = state::CK_VALUE_BYTES;
+            break;
+        case state::CK_VALUE_BYTES:
+            if (read_bytes(data, _u64, _val) != read_status::ready) {
+                _state = state::CK_VALUE_BYTES_2;
+                break;
+            }
+            // fallthrough
+        case state::CK_VALUE_BYTES_2:
+            _ck_values.push_back(to_bytes(to_bytes_view(_val)));
+            _val.release();
+            _state = state::CK_VALUE_START;
+            break;
+        case state::ROW_SIZE:
+            if (read_unsigned_vint(data) != read_status::ready) {
+                _state = state::ROW_SIZE_2;
+                break;
+            }
+            // fallthrough
+        case state::ROW_SIZE_2:
+            _state = state::ROW_BODY;
+            break;
+        case state::ROW_BODY:
+            if (read_bytes(data, _u64, _val) != read_status::ready) {
+                _state = state::ROW_BODY_2;
+                break;
+            }
+            // fallthrough
+        case state::ROW_BODY_2:
+            if ((_flags & unfiltered_flags_m::is_marker) != unfiltered_flags_m::none) {
+                decode_marker(to_bytes_view(_val));
+            } else {
+                decode_row(to_bytes_view(_val));
+            }
+            _val.release();
+            _state = state::EMIT_ATOMS;
+            break;
+        case state::EMIT_ATOMS:
+            while (!_atoms.empty()) {
+                auto a = std::move(_atoms.front());
+                _atoms.pop_front();
+                if (emit(a) == row_consumer::proceed::no) {
+                    return row_consumer::proceed::no;
+                }
+            }
+            _state = state::FLAGS;
+            break;
+        default:
+            throw malformed_sstable_exception("unknown state");
+        }
+
+        return row_consumer::proceed::yes;
+    }
+
+    data_consume_rows_context_m(row_consumer& consumer, const schema& s, const serialization_header& header,
+            input_stream<char> && input, uint64_t start, uint64_t maxlen)
+                : continuous_data_consumer(std::move(input), start, maxlen)
+                , _consumer(consumer)
+                , _schema(s)
+                , _regular_columns(make_columns(s, header.regular_columns))
+                , _static_columns(make_columns(s, header.static_columns)) {
+        _enc_stats.min_timestamp = header.get_min_timestamp();
+        _enc_stats.min_local_deletion_time = header.get_min_local_deletion_time();
+        _enc_stats.min_ttl = header.get_min_ttl();
+    }
+
+    void verify_end_state() {
+        // As in data_consume_rows_context, reading may stop between the
+        // unfiltereds of a partition.
+        if (_state == state::FLAGS || (_state == state::EMIT_ATOMS && _atoms.empty())) {
+            _consumer.consume_row_end();
+            return;
+        }
+        if (_state != state::PARTITION_START || _prestate != prestate::NONE) {
+            throw malformed_sstable_exception("end of input, but not end of row");
+        }
+    }
+
+    void reset(indexable_element el) {
+        _atoms.clear();
+        switch (el) {
+        case indexable_element::partition:
+            _state = state::PARTITION_START;
+            break;
+        case indexable_element::cell:
+            _state = state::FLAGS;
+            break;
+        default:
+            assert(0);
+        }
+        _consumer.reset(el);
+    }
+};
+
 // data_consume_rows() and data_consume_rows_at_once() both can read just a
 // single row or many rows. The difference is that data_consume_rows_at_once()
 // is optimized to reading one or few rows (reading it all into memory), while
@@ -395,32 +1020,55 @@ class data_consume_rows_context : public data_consumer::continuous_data_consumer
 class data_consume_context::impl {
 private:
     shared_sstable _sst;
+    // Exactly one of the contexts is set, depending on the sstable's format.
     std::unique_ptr<data_consume_rows_context> _ctx;
+    std::unique_ptr<data_consume_rows_context_m> _ctx_m;
+
+    template <typename Func>
+    auto with_context(Func&& func) {
+        return _ctx_m ? func(*_ctx_m) : func(*_ctx);
+    }
 public:
     impl(shared_sstable sst, row_consumer& consumer, input_stream<char>&& input, uint64_t start, uint64_t maxlen)
         : _sst(std::move(sst))
-        , _ctx(new data_consume_rows_context(consumer, std::move(input), start, maxlen))
-    { }
+    {
+        if (_sst->get_version() == sstable::version_types::sa) {
+            _ctx_m.reset(new data_consume_rows_context_m(consumer, *_sst->get_schema(), _sst->get_serialization_header(),
+                    std::move(input), start, maxlen));
+        } else {
+            _ctx.reset(new data_consume_rows_context(consumer, std::move(input), start, maxlen));
+        }
+    }
     ~impl() {
         if (_ctx) {
             auto f = _ctx->close();
-            f.handle_exception([ctx = std::move(_ctx), sst = std::move(_sst)] (auto) { });
+            f.handle_exception([ctx = std::move(_ctx), sst = _sst] (auto) { });
+        }
+        if (_ctx_m) {
+            auto f = _ctx_m->close();
+            f.handle_exception([ctx = std::move(_ctx_m), sst = std::move(_sst)] (auto) { });
         }
     }
     future<> read() {
-        return _ctx->consume_input(*_ctx);
+        return with_context([] (auto& ctx) {
+            return ctx.consume_input(ctx);
+        });
     }
     future<> fast_forward_to(uint64_t begin, uint64_t end) {
-        _ctx->reset(indexable_element::partition);
-        return _ctx->fast_forward_to(begin, end);
+        return with_context([begin, end] (auto& ctx) {
+            ctx.reset(indexable_element::partition);
+            return ctx.fast_forward_to(begin, end);
+        });
     }
     future<> skip_to(indexable_element el, uint64_t begin) {
-        sstlog.trace("data_consume_rows_context {}: skip_to({} -> {}, el={})", _ctx.get(), _ctx->position(), begin, static_cast<int>(el));
-        if (begin <= _ctx->position()) {
-            return make_ready_future<>();
-        }
-        _ctx->reset(el);
-        return _ctx->skip_to(begin);
+        return with_context([el, begin] (auto& ctx) {
+            sstlog.trace("data_consume_rows_context {}: skip_to({} -> {}, el={})", &ctx, ctx.position(), begin, static_cast<int>(el));
+            if (begin <= ctx.position()) {
+                return make_ready_future<>();
+            }
+            ctx.reset(el);
+            return ctx.skip_to(begin);
+        });
     }
 };
 
@@ -452,14 +1100,17 @@ data_consume_context sstable::data_consume_rows(
     // returned context, and may make small skips.
     return std::make_unique<data_consume_context::impl>(shared_from_this(),
             consumer, data_stream(toread.start, last_end - toread.start,
-                consumer.io_priority(), _partition_range_history), toread.start, toread.end - toread.start);
+                consumer.io_priority(), consumer.resource_tracker(), _partition_range_history,
+                read_ahead_window::for_scan(sstable_buffer_size, data_read_ahead)), toread.start, toread.end - toread.start);
 }
 
 data_consume_context sstable::data_consume_single_partition(
         row_consumer& consumer, sstable::disk_read_range toread) {
     return std::make_unique<data_consume_context::impl>(shared_from_this(),
             consumer, data_stream(toread.start, toread.end - toread.start,
-                 consumer.io_priority(), _single_partition_history), toread.start, toread.end - toread.start);
+                 consumer.io_priority(), consumer.resource_tracker(), _single_partition_history,
+                 read_ahead_window::for_point_read(toread.end - toread.start, sstable_buffer_size, data_read_ahead)),
+            toread.start, toread.end - toread.start);
 }
 
 
@@ -469,8 +1120,14 @@ data_consume_context sstable::data_consume_rows(row_consumer& consumer) {
 
 future<> sstable::data_consume_rows_at_once(row_consumer& consumer,
         uint64_t start, uint64_t end) {
-    return data_read(start, end - start, consumer.io_priority()).then([&consumer]
+    return data_read(start, end - start, consumer.io_priority()).then([this, &consumer]
                                                (temporary_buffer<char> buf) {
+        if (_version == version_types::sa) {
+            data_consume_rows_context_m ctx(consumer, *_schema, get_serialization_header(), input_stream<char>(), 0, -1);
+            ctx.process(buf);
+            ctx.verify_end_state();
+            return;
+        }
         data_consume_rows_context ctx(consumer, input_stream<char>(), 0, -1);
         ctx.process(buf);
         ctx.verify_end_state();
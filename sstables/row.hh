@@ -27,6 +27,7 @@
 #include "core/temporary_buffer.hh"
 #include "consumer.hh"
 #include "sstables/types.hh"
+#include "reader_concurrency_semaphore.hh"
 
 // sstables::data_consume_row feeds the contents of a single row into a
 // row_consumer object:
@@ -94,5 +95,10 @@ class row_consumer {
     // Under which priority class to place I/O coming from this consumer
     virtual const io_priority_class& io_priority() = 0;
 
+    // What the buffers read for this consumer are charged to
+    virtual reader_resource_tracker resource_tracker() {
+        return no_resource_tracking();
+    }
+
     virtual ~row_consumer() { }
 };
@@ -25,14 +25,21 @@
 #include <vector>
 #include <seastar/core/shared_future.hh>
 #include <seastar/core/future.hh>
+#include "utils/lru.hh"
+#include "memory_footprint.hh"
 
 namespace sstables {
 
 using index_list = std::vector<index_entry>;
 
 // Associative cache of summary index -> index_list
-// Entries stay around as long as there is any live external reference (list_ptr) to them.
 // Supports asynchronous insertion, ensures that only one entry will be loaded.
+//
+// Loaded entries stay around after the last external reference (list_ptr) to
+// them is gone, until they are evicted. They are linked into the index page
+// lru of the shard's cache_tracker, so that they are evicted together with
+// row_cache under memory pressure. Entries which are still referenced may be
+// evicted too, in which case they are freed when the last reference goes away.
 class shared_index_lists {
 public:
     using key_type = uint64_t;
@@ -40,26 +47,60 @@ class shared_index_lists {
         uint64_t hits = 0; // Number of times entry was found ready
         uint64_t misses = 0; // Number of times entry was not found
         uint64_t blocks = 0; // Number of times entry was not ready (>= misses)
+        uint64_t populations = 0; // Number of entries inserted into the cache
+        uint64_t evictions = 0; // Number of entries evicted from the cache
+        uint64_t used_bytes = 0; // Approximate memory used by cached entries
     };
 private:
-    class entry : public enable_lw_shared_from_this<entry> {
+    class entry : public enable_lw_shared_from_this<entry>, public evictable {
     public:
         key_type key;
         index_list list;
         shared_promise<> loaded;
         shared_index_lists& parent;
+        size_t memory_usage = 0;
 
         entry(shared_index_lists& parent, key_type key)
             : key(key), parent(parent)
         { }
         ~entry() {
-            parent._lists.erase(key);
+            _shard_stats.used_bytes -= memory_usage;
+        }
+        // Drops the reference held by the cache, which may destroy this.
+        virtual void on_evicted() noexcept override {
+            ++_shard_stats.evictions;
+            parent.erase(*this);
         }
         bool operator==(const entry& e) const { return key == e.key; }
         bool operator!=(const entry& e) const { return key != e.key; }
     };
-    std::unordered_map<key_type, entry*> _lists;
+    std::unordered_map<key_type, lw_shared_ptr<entry>> _lists;
     static thread_local stats _shard_stats;
+
+    // Removes e from the map, unless it was replaced already.
+    void erase(entry& e) {
+        auto i = _lists.find(e.key);
+        if (i != _lists.end() && i->second.get() == &e) {
+            _lists.erase(i);
+        }
+    }
+
+    bool contains(const entry& e) const {
+        auto i = _lists.find(e.key);
+        return i != _lists.end() && i->second.get() == &e;
+    }
+
+    static size_t memory_usage_of(const index_list& list) {
+        size_t size = sizeof(index_list) + list.capacity() * sizeof(index_entry);
+        for (auto&& ie : list) {
+            size += ie.get_key_bytes().size() + ie.get_promoted_index_bytes().size();
+        }
+        return size;
+    }
+
+    // The lru shared with row_cache. Defined in sstables.cc, so that this
+    // header doesn't need to know about cache_tracker.
+    static lru& cache_lru();
 public:
     // Pointer to index_list
     class list_ptr {
@@ -85,6 +126,23 @@ class shared_index_lists {
     shared_index_lists(shared_index_lists&&) = delete;
     shared_index_lists(const shared_index_lists&) = delete;
 
+    ~shared_index_lists() {
+        // Entries may outlive us if they are still referenced, so make sure
+        // they can't be evicted through us anymore.
+        for (auto&& kv : _lists) {
+            kv.second->unlink_from_lru();
+        }
+    }
+
+    // Drops all entries. Entries which are still referenced are kept alive
+    // by their references.
+    void clear() {
+        for (auto&& kv : _lists) {
+            kv.second->unlink_from_lru();
+        }
+        _lists.clear();
+    }
+
     // Returns a future which resolves with a shared pointer to index_list for given key.
     // Always returns a valid pointer if succeeds. The pointer is never invalidated externally.
     //
@@ -97,17 +155,32 @@ class shared_index_lists {
         auto i = _lists.find(key);
         lw_shared_ptr<entry> e;
         if (i != _lists.end()) {
-            e = i->second->shared_from_this();
+            e = i->second;
+            if (e->is_linked()) {
+                cache_lru().touch(*e);
+            }
         } else {
             ++_shard_stats.misses;
             e = make_lw_shared<entry>(*this, key);
-            auto res = _lists.emplace(key, e.get());
+            auto res = _lists.emplace(key, e);
             assert(res.second);
             loader(key).then_wrapped([e](future<index_list>&& f) mutable {
                 if (f.failed()) {
+                    // Let the next reader retry.
+                    e->parent.erase(*e);
                     e->loaded.set_exception(f.get_exception());
                 } else {
-                    e->list = f.get0();
+                    // The entries may share the read buffers, which we don't
+                    // want to keep around for as long as the page is cached,
+                    // so copy them.
+                    auto list = f.get0();
+                    e->list = index_list(list.begin(), list.end());
+                    if (e->parent.contains(*e)) {
+                        e->memory_usage = memory_usage_of(e->list);
+                        _shard_stats.used_bytes += e->memory_usage;
+                        ++_shard_stats.populations;
+                        cache_lru().add(*e);
+                    }
                     e->loaded.set_value();
                 }
             });
@@ -124,6 +197,37 @@ class shared_index_lists {
         }
     }
 
+    // Returns a pointer to list, which isn't put in the cache, for readers
+    // which already have the entries they need.
+    list_ptr make_uncached(key_type key, index_list list) {
+        auto e = make_lw_shared<entry>(*this, key);
+        e->list = std::move(list);
+        e->loaded.set_value();
+        return list_ptr(std::move(e));
+    }
+
+    // Drops all cached entries.
+    void evict_all() {
+        for (auto&& kv : _lists) {
+            kv.second->unlink_from_lru();
+        }
+        _lists.clear();
+    }
+
+    // Adds the loaded entries, counting one partition per index entry.
+    // Promoted indexes count as tree nodes.
+    void add_footprint(memory_footprint& f) const {
+        for (auto&& kv : _lists) {
+            auto& list = kv.second->list;
+            f.partitions += list.size();
+            f.objects += sizeof(entry) + sizeof(index_list) + list.capacity() * sizeof(index_entry);
+            for (auto&& ie : list) {
+                f.keys += ie.get_key_bytes().size();
+                f.tree_nodes += ie.get_promoted_index_bytes().size();
+            }
+        }
+    }
+
     static const stats& shard_stats() { return _shard_stats; }
 };
 
@@ -23,6 +23,8 @@
 
 #include "sstables.hh"
 #include "query-request.hh" // for partition_range; FIXME: move it out of there
+#include "timestamp.hh"
+#include <seastar/core/future-util.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <vector>
 
@@ -34,8 +36,9 @@ class incremental_selector_impl;
 class sstable_set {
     std::unique_ptr<sstable_set_impl> _impl;
     // used to support column_family::get_sstable(), which wants to return an sstable_list
-    // that has a reference somewhere
-    lw_shared_ptr<sstable_list> _all;
+    // that has a reference somewhere. Built on demand and shared between copies of the
+    // set, so that copying and changing the set doesn't copy all the sstables.
+    mutable lw_shared_ptr<sstable_list> _all;
 public:
     ~sstable_set();
     sstable_set(std::unique_ptr<sstable_set_impl> impl, lw_shared_ptr<sstable_list> all);
@@ -44,7 +47,18 @@ class sstable_set {
     sstable_set& operator=(const sstable_set&);
     sstable_set& operator=(sstable_set&&) noexcept;
     std::vector<shared_sstable> select(const dht::partition_range& range) const;
-    lw_shared_ptr<sstable_list> all() const { return _all; }
+    // Selects the sstables which may hold data of the range written at or
+    // after min_timestamp, going by their max timestamp.
+    std::vector<shared_sstable> select(const dht::partition_range& range, api::timestamp_type min_timestamp) const;
+    // Calls func with the sstables of each time window of window_size, in
+    // which an sstable falls by its max timestamp, newest window first, until
+    // func returns stop_iteration::yes.
+    void for_each_time_window(api::timestamp_type window_size,
+            std::function<stop_iteration (api::timestamp_type window, std::vector<shared_sstable> sstables)> func) const;
+    // Takes time linear in the number of sstables when the set was changed
+    // since it was last called.
+    lw_shared_ptr<sstable_list> all() const;
+    size_t size() const;
     void insert(shared_sstable sst);
     void erase(shared_sstable sst);
 
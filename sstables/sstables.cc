@@ -41,6 +41,7 @@
 #include "index_reader.hh"
 #include "remove.hh"
 #include "memtable.hh"
+#include "row_cache.hh"
 #include "range.hh"
 #include "downsampling.hh"
 #include <boost/filesystem/operations.hpp>
@@ -53,12 +54,15 @@
 #include <regex>
 #include <core/align.hh>
 #include "utils/phased_barrier.hh"
+#include "utils/bloom_filter.hh"
 #include "range_tombstone_list.hh"
 #include "counters.hh"
 #include "binary_search.hh"
+#include "vint-serialization.hh"
 
 #include "checked-file-impl.hh"
 #include "service/storage_service.hh"
+#include "db/system_keyspace.hh"
 
 thread_local disk_error_signal_type sstable_read_error;
 thread_local disk_error_signal_type sstable_write_error;
@@ -158,7 +162,8 @@ class file_random_access_reader : public random_access_reader {
 
 std::unordered_map<sstable::version_types, sstring, enum_hash<sstable::version_types>> sstable::_version_string = {
     { sstable::version_types::ka , "ka" },
-    { sstable::version_types::la , "la" }
+    { sstable::version_types::la , "la" },
+    { sstable::version_types::sa , "sa" }
 };
 
 std::unordered_map<sstable::format_types, sstring, enum_hash<sstable::format_types>> sstable::_format_string = {
@@ -219,6 +224,9 @@ static void check_truncate_and_assign(T& to, const U from) {
     }
 }
 
+// Selects the variable-length encoding of an integer, used by the sa format.
+struct use_vint_tag {};
+
 // Base parser, parses an integer type
 template <typename T>
 typename std::enable_if_t<std::is_integral<T>::value, void>
@@ -468,6 +476,73 @@ inline void write(file_writer& out, const disk_array<Size, Members>& arr) {
     write(out, arr.elements);
 }
 
+future<> parse(random_access_reader& in, uint64_t& value, use_vint_tag) {
+    return in.read_exactly(1).then([&in, &value] (auto first) {
+        check_buf_size(first, 1);
+        auto len = unsigned_vint::serialized_size_from_first_byte(first[0]);
+        if (len == 1) {
+            value = unsigned_vint::deserialize(to_bytes_view(first));
+            return make_ready_future<>();
+        }
+        return in.read_exactly(len - 1).then([&value, len, first = std::move(first)] (auto rest) {
+            check_buf_size(rest, len - 1);
+            bytes buf(bytes::initialized_later(), len);
+            buf[0] = first[0];
+            std::copy(rest.begin(), rest.end(), buf.begin() + 1);
+            value = unsigned_vint::deserialize(buf);
+        });
+    });
+}
+
+inline void write(file_writer& out, uint64_t value, use_vint_tag) {
+    std::array<bytes::value_type, max_vint_length> buf;
+    auto len = unsigned_vint::serialize(value, buf.begin());
+    out.write(reinterpret_cast<const char*>(buf.data()), len).get();
+}
+
+template <typename T>
+future<> parse(random_access_reader& in, vint<T>& v) {
+    auto value = std::make_unique<uint64_t>();
+    auto f = parse(in, *value, use_vint_tag());
+    return f.then([&v, value = std::move(value)] {
+        check_truncate_and_assign(v.value, *value);
+    });
+}
+
+template <typename T>
+inline void write(file_writer& out, const vint<T>& v) {
+    write(out, uint64_t(v.value), use_vint_tag());
+}
+
+future<> parse(random_access_reader& in, disk_string_vint_size& s) {
+    auto len = std::make_unique<uint64_t>();
+    auto f = parse(in, *len, use_vint_tag());
+    return f.then([&in, &s, len = std::move(len)] {
+        return parse(in, *len, s.value);
+    });
+}
+
+inline void write(file_writer& out, const disk_string_vint_size& s) {
+    write(out, uint64_t(s.value.size()), use_vint_tag());
+    write(out, s.value);
+}
+
+template <typename Members>
+future<> parse(random_access_reader& in, disk_array_vint_size<Members>& arr) {
+    auto len = make_lw_shared<uint64_t>();
+    auto f = parse(in, *len, use_vint_tag());
+    return f.then([&in, &arr, len] {
+        arr.elements.resize(*len);
+        return parse(in, *len, arr.elements);
+    }).finally([len] {});
+}
+
+template <typename Members>
+inline void write(file_writer& out, const disk_array_vint_size<Members>& arr) {
+    write(out, uint64_t(arr.elements.size()), use_vint_tag());
+    write(out, arr.elements);
+}
+
 template <typename Size, typename Key, typename Value>
 future<> parse(random_access_reader& in, Size& len, std::unordered_map<Key, Value>& map) {
     return do_with(Size(), [&in, len, &map] (Size& count) {
@@ -719,6 +794,8 @@ future<> parse(random_access_reader& in, statistics& s) {
                     return parse<compaction_metadata>(in, s.contents[val.first]);
                 case metadata_type::Stats:
                     return parse<stats_metadata>(in, s.contents[val.first]);
+                case metadata_type::Serialization:
+                    return parse<serialization_header>(in, s.contents[val.first]);
                 default:
                     sstlog.warn("Invalid metadata type at Statistics file: {} ", int(val.first));
                     return make_ready_future<>();
@@ -972,8 +1049,8 @@ future<index_list> sstable::read_indexes(uint64_t summary_idx, const io_priority
     });
 }
 
-std::unique_ptr<index_reader> sstable::get_index_reader(const io_priority_class& pc) {
-    return std::make_unique<index_reader>(shared_from_this(), pc);
+std::unique_ptr<index_reader> sstable::get_index_reader(const io_priority_class& pc, reader_resource_tracker resource_tracker) {
+    return std::make_unique<index_reader>(shared_from_this(), pc, std::move(resource_tracker));
 }
 
 template <sstable::component_type Type, typename T>
@@ -1178,6 +1255,10 @@ future<> sstable::update_info_for_opened_data() {
         _data_file_write_time = db_clock::from_time_t(st.st_mtime);
     }).then([this] {
         return _index_file.size().then([this] (auto size) {
+            if (_components->index_compression) {
+                _components->index_compression->update(size);
+                size = _components->index_compression->uncompressed_file_length();
+            }
             _index_file_size = size;
         });
     }).then([this] {
@@ -1224,13 +1305,27 @@ future<> sstable::create_data() {
 // This interface is only used during tests, snapshot loading and early initialization.
 // No need to set tunable priorities for it.
 future<> sstable::load(const io_priority_class& pc) {
-    return read_toc().then([this, &pc] {
+    return load(pc, false);
+}
+
+future<> sstable::load(const io_priority_class& pc, bool defer_filter) {
+    return read_toc().then([this, &pc, defer_filter] {
         return seastar::when_all_succeed(
                 read_statistics(pc),
                 read_compression(pc),
-                read_scylla_metadata(pc),
-                read_filter(pc),
-                read_summary(pc)).then([this] {
+                read_scylla_metadata(pc).then([this, &pc, defer_filter] {
+                    // Regenerating a missing summary reads the index, whose
+                    // compression is recorded in the scylla metadata.
+                    auto summary = read_summary(pc);
+                    if (defer_filter && has_component(component_type::Filter)) {
+                        _components->filter = std::make_unique<utils::filter::always_present_filter>();
+                        _components->filter_deferred = true;
+                        return summary;
+                    }
+                    // The filter type is recorded in the scylla metadata.
+                    return seastar::when_all_succeed(read_filter(pc), std::move(summary));
+                })).then([this] {
+            _components->compression.set_checksum_type(get_checksum_type());
             validate_min_max_metadata();
             set_clustering_components_ranges();
             return open_data();
@@ -1251,18 +1346,25 @@ future<> sstable::load(sstables::foreign_sstable_open_info info) {
 future<sstable_open_info> sstable::load_shared_components(const schema_ptr& s, sstring dir, int generation, version_types v, format_types f,
         const io_priority_class& pc) {
     auto sst = make_lw_shared<sstables::sstable>(s, dir, generation, v, f);
-    return sst->load(pc).then([sst] () mutable {
+    return sst->load(pc, true).then([sst] () mutable {
         auto shards = sst->get_shards_for_this_sstable();
-        auto info = sstable_open_info{make_lw_shared<shareable_components>(std::move(*sst->_components)),
-            std::move(shards), std::move(sst->_data_file), std::move(sst->_index_file)};
-        return make_ready_future<sstable_open_info>(std::move(info));
+        // The components of an sstable owned by several shards are read by
+        // all of them, so its filter can't be replaced later on.
+        auto f = shards.size() > 1 ? sst->load_deferred_filter_now() : make_ready_future<>();
+        return f.then([sst, shards = std::move(shards)] () mutable {
+            auto info = sstable_open_info{make_lw_shared<shareable_components>(std::move(*sst->_components)),
+                std::move(shards), std::move(sst->_data_file), std::move(sst->_index_file)};
+            return make_ready_future<sstable_open_info>(std::move(info));
+        });
     });
 }
 
 future<foreign_sstable_open_info> sstable::get_open_info() & {
-    return _components.copy().then([this] (auto c) mutable {
+    return load_deferred_filter_now().then([this] {
+        return _components.copy();
+    }).then([this] (auto c) mutable {
         return foreign_sstable_open_info{std::move(c), this->get_shards_for_this_sstable(), _data_file.dup(), _index_file.dup(),
-            _generation, _version, _format};
+            _generation, _version, _format, _dir};
     });
 }
 
@@ -1285,7 +1387,7 @@ static void output_promoted_index_entry(bytes_ostream& promoted_index,
 }
 
 // FIXME: use this in write_column_name() instead of repeating the code
-static bytes serialize_colname(const composite& clustering_key,
+bytes serialize_colname(const composite& clustering_key,
         const std::vector<bytes_view>& column_names, composite::eoc marker) {
     auto c = composite::from_exploded(column_names, marker);
     auto ck_bview = bytes_view(clustering_key);
@@ -1655,6 +1757,366 @@ void sstable::write_static_row(file_writer& out, const schema& schema, const row
     });
 }
 
+// Writing of the data file in the sa format.
+//
+// sa is Scylla's own format. Its data file is modelled on that of the
+// Cassandra 3.x "mc" format, but it's not compatible with it, hence the
+// different version name: Cassandra can't read sa sstables, and mc sstables
+// written by Cassandra are refused (see entry_descriptor::make_descriptor()).
+//
+// Every row, static row and range tombstone marker is written as an
+// "unfiltered": flags, the clustering prefix, the size of the rest of the
+// unfiltered, the size of the previous unfiltered and the body. Timestamps,
+// deletion times and TTLs are written as variable-length deltas against the
+// sstable's encoding_stats, and cells which share the row's timestamp or TTL
+// don't repeat them. Unlike mc, which omits the length of values of
+// fixed-size types, all values are length-prefixed.
+//
+// Range tombstones are written as an open marker immediately followed by its
+// close marker, at the position of the start bound, the same way the ka
+// format places them. The Index, Summary and Statistics components keep the
+// ka layout, with the serialization header added to Statistics, and no
+// promoted index is written, so reads always start at the beginning of a
+// partition.
+
+static void write_vint(bytes_ostream& out, uint64_t value) {
+    auto p = out.write_place_holder(unsigned_vint::serialized_size(value));
+    unsigned_vint::serialize(value, p);
+}
+
+static void write_vint_bytes(bytes_ostream& out, bytes_view value) {
+    write_vint(out, value.size());
+    out.write(value);
+}
+
+static void write_delta_timestamp(bytes_ostream& out, api::timestamp_type ts, const encoding_stats& enc_stats) {
+    write_vint(out, uint64_t(ts) - uint64_t(enc_stats.min_timestamp));
+}
+
+static void write_delta_local_deletion_time(bytes_ostream& out, int32_t ldt, const encoding_stats& enc_stats) {
+    write_vint(out, uint64_t(int64_t(ldt) - enc_stats.min_local_deletion_time));
+}
+
+static void write_delta_ttl(bytes_ostream& out, int32_t ttl, const encoding_stats& enc_stats) {
+    write_vint(out, uint64_t(int64_t(ttl) - enc_stats.min_ttl));
+}
+
+static void write_delta_deletion_time(bytes_ostream& out, tombstone t, const encoding_stats& enc_stats) {
+    if (t) {
+        write_delta_timestamp(out, t.timestamp, enc_stats);
+        write_delta_local_deletion_time(out, t.deletion_time.time_since_epoch().count(), enc_stats);
+    } else {
+        write_delta_timestamp(out, std::numeric_limits<int64_t>::min(), enc_stats);
+        write_delta_local_deletion_time(out, std::numeric_limits<int32_t>::max(), enc_stats);
+    }
+}
+
+// Writes the values of a clustering prefix. Each block of up to 32 values is
+// preceded by a header with two bits per value, the lower of which marks
+// empty values (which are then omitted).
+static void write_clustering_prefix_values(bytes_ostream& out, const std::vector<bytes_view>& values) {
+    for (size_t block = 0; block < values.size(); block += 32) {
+        auto end = std::min(values.size(), block + 32);
+        uint64_t header = 0;
+        for (size_t i = block; i < end; ++i) {
+            if (values[i].empty()) {
+                header |= uint64_t(1) << ((i - block) * 2);
+            }
+        }
+        write_vint(out, header);
+        for (size_t i = block; i < end; ++i) {
+            if (!values[i].empty()) {
+                write_vint_bytes(out, values[i]);
+            }
+        }
+    }
+}
+
+template <typename Prefix>
+static std::vector<bytes_view> explode_prefix(const schema& s, const Prefix& prefix) {
+    return boost::copy_range<std::vector<bytes_view>>(prefix.components(s));
+}
+
+// Writes which of the columns of the header are present in the row. Tables
+// with fewer than 64 columns use a bitmap of the missing ones, wider tables
+// the count of missing columns followed by whichever of the present or
+// missing column indexes is shorter.
+static void write_missing_columns(bytes_ostream& out, const std::vector<bool>& present, size_t present_count) {
+    auto superset = present.size();
+    if (superset < 64) {
+        uint64_t missing = 0;
+        for (size_t i = 0; i < superset; ++i) {
+            if (!present[i]) {
+                missing |= uint64_t(1) << i;
+            }
+        }
+        write_vint(out, missing);
+        return;
+    }
+    write_vint(out, superset - present_count);
+    bool list_present = present_count < superset / 2;
+    for (size_t i = 0; i < superset; ++i) {
+        if (present[i] == list_present) {
+            write_vint(out, i);
+        }
+    }
+}
+
+static bytes serialize_counter_value(atomic_cell_view cell) {
+    counter_cell_view ccv(cell);
+    auto shard_count = ccv.shard_count();
+
+    static constexpr auto header_entry_size = sizeof(int16_t);
+    static constexpr auto counter_shard_size = 32u; // counter_id: 16 + clock: 8 + value: 8
+    auto total_size = sizeof(int16_t) + shard_count * (header_entry_size + counter_shard_size);
+
+    bytes value(bytes::initialized_later(), total_size);
+    auto out = value.begin();
+    auto put = [&out] (auto v) {
+        write_be(reinterpret_cast<char*>(out), v);
+        out += sizeof(v);
+    };
+    put(int16_t(shard_count));
+    for (auto i = 0u; i < shard_count; i++) {
+        put(int16_t(std::numeric_limits<int16_t>::min() + i));
+    }
+    for (auto&& s : ccv.shards()) {
+        auto uuid = s.id().to_uuid();
+        put(int64_t(uuid.get_most_significant_bits()));
+        put(int64_t(uuid.get_least_significant_bits()));
+        put(int64_t(s.logical_clock()));
+        put(int64_t(s.value()));
+    }
+    return value;
+}
+
+void sstable::write_cell_m(bytes_ostream& out, atomic_cell_view cell, const column_definition& cdef,
+        const row_time_properties_m& row_props, bytes_view cell_path) {
+    auto& enc_stats = _sa_write.enc_stats;
+    uint64_t timestamp = cell.timestamp();
+
+    update_cell_stats(_c_stats, timestamp);
+
+    bool is_deleted = cell.is_dead(_now);
+    bool is_expiring = !is_deleted && cell.is_live_and_has_ttl();
+    bool use_row_timestamp = row_props.timestamp && *row_props.timestamp == cell.timestamp();
+    bool use_row_ttl = is_expiring && row_props.ttl && *row_props.ttl == cell.ttl() && *row_props.expiry == cell.expiry();
+    bytes counter_value;
+    bytes_view value;
+    if (!is_deleted) {
+        if (cdef.is_counter()) {
+            assert(!cell.is_counter_update());
+            counter_value = serialize_counter_value(cell);
+            value = counter_value;
+        } else {
+            value = cell.value();
+        }
+    }
+
+    column_flags_m flags = column_flags_m::none;
+    if (is_deleted) {
+        flags = flags | column_flags_m::is_deleted;
+    } else if (is_expiring) {
+        flags = flags | column_flags_m::is_expiring;
+    }
+    if (value.empty()) {
+        flags = flags | column_flags_m::has_empty_value;
+    }
+    if (use_row_timestamp) {
+        flags = flags | column_flags_m::use_row_timestamp;
+    }
+    if (use_row_ttl) {
+        flags = flags | column_flags_m::use_row_ttl;
+    }
+    out.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+
+    if (!use_row_timestamp) {
+        write_delta_timestamp(out, timestamp, enc_stats);
+    }
+    if (is_deleted) {
+        int32_t deletion_time = cell.deletion_time().time_since_epoch().count();
+        _c_stats.update_max_local_deletion_time(deletion_time);
+        _c_stats.tombstone_histogram.update(deletion_time);
+        write_delta_local_deletion_time(out, deletion_time, enc_stats);
+    } else if (is_expiring) {
+        int32_t expiration = cell.expiry().time_since_epoch().count();
+        _c_stats.update_max_local_deletion_time(expiration);
+        if (!use_row_ttl) {
+            write_delta_local_deletion_time(out, expiration, enc_stats);
+            write_delta_ttl(out, cell.ttl().count(), enc_stats);
+        }
+    } else {
+        _c_stats.update_max_local_deletion_time(std::numeric_limits<int>::max());
+    }
+    if (!cdef.is_atomic()) {
+        write_vint_bytes(out, cell_path);
+    }
+    if (!value.empty()) {
+        write_vint_bytes(out, value);
+    }
+}
+
+void sstable::write_row_m(file_writer& out, const schema& schema, const clustering_key_prefix* ck,
+        const row& cells, const row_marker& marker, row_tombstone tomb) {
+    auto& enc_stats = _sa_write.enc_stats;
+    bool is_static = !ck;
+    auto kind = is_static ? column_kind::static_column : column_kind::regular_column;
+    auto flags = unfiltered_flags_m::none;
+    auto ext_flags = is_static ? unfiltered_extended_flags_m::is_static : unfiltered_extended_flags_m::none;
+    bytes_ostream body;
+    row_time_properties_m row_props;
+
+    if (!marker.is_missing()) {
+        update_cell_stats(_c_stats, marker.timestamp());
+        flags = flags | unfiltered_flags_m::has_timestamp;
+        write_delta_timestamp(body, marker.timestamp(), enc_stats);
+        row_props.timestamp = marker.timestamp();
+        if (marker.is_dead(_now)) {
+            int32_t deletion_time = marker.deletion_time().time_since_epoch().count();
+            _c_stats.tombstone_histogram.update(deletion_time);
+            flags = flags | unfiltered_flags_m::has_ttl;
+            write_delta_ttl(body, expired_liveness_ttl, enc_stats);
+            write_delta_local_deletion_time(body, deletion_time, enc_stats);
+        } else if (marker.is_expiring()) {
+            flags = flags | unfiltered_flags_m::has_ttl;
+            write_delta_ttl(body, marker.ttl().count(), enc_stats);
+            write_delta_local_deletion_time(body, marker.expiry().time_since_epoch().count(), enc_stats);
+            row_props.ttl = marker.ttl();
+            row_props.expiry = marker.expiry();
+        }
+    }
+    if (tomb) {
+        if (tomb.regular()) {
+            flags = flags | unfiltered_flags_m::has_deletion;
+            write_delta_deletion_time(body, tomb.regular(), enc_stats);
+            write_deletion_time_stats(tomb.regular());
+        }
+        if (tomb.is_shadowable()) {
+            ext_flags = ext_flags | unfiltered_extended_flags_m::has_shadowable_deletion;
+            write_delta_deletion_time(body, tomb.shadowable().tomb(), enc_stats);
+            write_deletion_time_stats(tomb.shadowable().tomb());
+        }
+    }
+
+    auto column_count = is_static ? schema.static_columns_count() : schema.regular_columns_count();
+    std::vector<bool> present(column_count, false);
+    size_t present_count = 0;
+    bool has_complex_deletion = false;
+    cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection& c) {
+        present[id] = true;
+        ++present_count;
+        auto&& cdef = schema.column_at(kind, id);
+        if (!cdef.is_atomic()) {
+            auto ctype = static_pointer_cast<const collection_type_impl>(cdef.type);
+            has_complex_deletion |= bool(ctype->deserialize_mutation_form(c.as_collection_mutation()).tomb);
+        }
+    });
+    if (present_count == column_count) {
+        flags = flags | unfiltered_flags_m::has_all_columns;
+    } else {
+        write_missing_columns(body, present, present_count);
+    }
+    if (has_complex_deletion) {
+        flags = flags | unfiltered_flags_m::has_complex_deletion;
+    }
+
+    cells.for_each_cell([&] (column_id id, const atomic_cell_or_collection& c) {
+        auto&& cdef = schema.column_at(kind, id);
+        if (cdef.is_atomic()) {
+            write_cell_m(body, c.as_atomic_cell(), cdef, row_props);
+            return;
+        }
+        auto ctype = static_pointer_cast<const collection_type_impl>(cdef.type);
+        auto mview = ctype->deserialize_mutation_form(c.as_collection_mutation());
+        if (has_complex_deletion) {
+            write_delta_deletion_time(body, mview.tomb, enc_stats);
+            if (mview.tomb) {
+                write_deletion_time_stats(mview.tomb);
+            }
+        }
+        write_vint(body, mview.cells.size());
+        for (auto& cp : mview.cells) {
+            write_cell_m(body, cp.second, cdef, row_props, cp.first);
+        }
+    });
+
+    bool extended = ext_flags != unfiltered_extended_flags_m::none;
+    if (extended) {
+        flags = flags | unfiltered_flags_m::extension_flag;
+    }
+    bytes_ostream header;
+    header.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    if (extended) {
+        header.write(reinterpret_cast<const char*>(&ext_flags), sizeof(ext_flags));
+    }
+    if (!is_static) {
+        write_clustering_prefix_values(header, explode_prefix(schema, *ck));
+    }
+    write_unfiltered_m(out, std::move(header), std::move(body));
+}
+
+// Outputs an unfiltered whose flags and clustering prefix were serialized
+// into header, followed by its size, the size of the previous unfiltered and
+// the body.
+void sstable::write_unfiltered_m(file_writer& out, bytes_ostream header, bytes_ostream body) {
+    auto start = out.offset();
+    auto prev_size = _sa_write.prev_unfiltered_size;
+    write(out, std::move(header));
+    bytes_ostream sizes;
+    write_vint(sizes, unsigned_vint::serialized_size(prev_size) + body.size());
+    write_vint(sizes, prev_size);
+    write(out, std::move(sizes));
+    write(out, std::move(body));
+    _sa_write.prev_unfiltered_size = out.offset() - start;
+}
+
+void sstable::write_deletion_time_stats(const tombstone& t) {
+    uint32_t deletion_time = t.deletion_time.time_since_epoch().count();
+    update_cell_stats(_c_stats, t.timestamp);
+    _c_stats.update_max_local_deletion_time(deletion_time);
+    _c_stats.tombstone_histogram.update(deletion_time);
+}
+
+void sstable::write_clustered_row_m(file_writer& out, const schema& schema, const clustering_row& clustered_row) {
+    if (schema.clustering_key_size()) {
+        column_name_helper::min_max_components(schema, _collector.min_column_names(), _collector.max_column_names(),
+            clustered_row.key().components());
+    }
+    write_row_m(out, schema, &clustered_row.key(), clustered_row.cells(), clustered_row.marker(), clustered_row.tomb());
+}
+
+void sstable::write_static_row_m(file_writer& out, const schema& schema, const row& static_row) {
+    write_row_m(out, schema, nullptr, static_row, row_marker(), row_tombstone());
+}
+
+void sstable::write_range_tombstone_m(file_writer& out, const schema& schema, const range_tombstone& rt) {
+    if (!rt.tomb) {
+        return;
+    }
+    auto write_marker = [&] (const clustering_key_prefix& prefix, bound_kind_m kind) {
+        auto flags = unfiltered_flags_m::is_marker;
+        auto values = explode_prefix(schema, prefix);
+        bytes_ostream header;
+        header.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+        header.write(reinterpret_cast<const char*>(&kind), sizeof(kind));
+        char size[2];
+        write_be(size, uint16_t(values.size()));
+        header.write(size, sizeof(size));
+        write_clustering_prefix_values(header, values);
+        bytes_ostream body;
+        write_delta_deletion_time(body, rt.tomb, _sa_write.enc_stats);
+        write_unfiltered_m(out, std::move(header), std::move(body));
+    };
+    write_deletion_time_stats(rt.tomb);
+    write_marker(rt.start, rt.start_kind == bound_kind::excl_start ? bound_kind_m::excl_start : bound_kind_m::incl_start);
+    write_marker(rt.end, rt.end_kind == bound_kind::excl_end ? bound_kind_m::excl_end : bound_kind_m::incl_end);
+}
+
+void sstable::write_end_of_partition_m(file_writer& out) {
+    auto flags = unfiltered_flags_m::end_of_partition;
+    write(out, flags);
+}
+
 static void write_index_header(file_writer& out, disk_string_view<uint16_t>& key, uint64_t pos) {
     write(out, key, pos);
 }
@@ -1709,9 +2171,10 @@ static void seal_summary(summary& s,
     }
 }
 
-static void prepare_compression(compression& c, const schema& schema) {
+static void prepare_compression(compression& c, const schema& schema, checksum_type ct) {
     const auto& cp = schema.get_compressor_params();
-    c.set_compressor(cp.get_compressor());
+    c.set_compressor(cp);
+    c.set_checksum_type(ct);
     c.chunk_len = cp.chunk_length();
     c.data_len = 0;
     // FIXME: crc_check_chance can be configured by the user.
@@ -1770,11 +2233,53 @@ create_sharding_metadata(schema_ptr schema, const dht::decorated_key& first_key,
 }
 
 
+static disk_string_vint_size type_name(const data_type& type) {
+    return { to_bytes(type->name()) };
+}
+
+// The serialization header describes the types of the key and of every
+// column, which the sa format needs to read rows: unlike ka, cells don't
+// carry their column names.
+static serialization_header make_serialization_header(const schema& s, const encoding_stats& enc_stats) {
+    serialization_header header;
+    header.min_timestamp_base.value = uint64_t(enc_stats.min_timestamp) - encoding_stats::timestamp_epoch;
+    header.min_local_deletion_time_base.value = uint64_t(enc_stats.min_local_deletion_time) - encoding_stats::deletion_time_epoch;
+    header.min_ttl_base.value = uint64_t(enc_stats.min_ttl) - encoding_stats::ttl_epoch;
+
+    auto& pk_types = s.partition_key_type()->types();
+    if (pk_types.size() == 1) {
+        header.pk_type_name = type_name(pk_types.front());
+    } else {
+        sstring name = "org.apache.cassandra.db.marshal.CompositeType(";
+        bool first = true;
+        for (auto& t : pk_types) {
+            if (!first) {
+                name += ",";
+            }
+            name += t->name();
+            first = false;
+        }
+        name += ")";
+        header.pk_type_name.value = to_bytes(name);
+    }
+    for (auto& cdef : s.clustering_key_columns()) {
+        header.clustering_key_types_names.elements.push_back(type_name(cdef.type));
+    }
+    for (auto& cdef : s.static_columns()) {
+        header.static_columns.elements.push_back({ { cdef.name() }, type_name(cdef.type) });
+    }
+    for (auto& cdef : s.regular_columns()) {
+        header.regular_columns.elements.push_back({ { cdef.name() }, type_name(cdef.type) });
+    }
+    return header;
+}
+
 // In the beginning of the statistics file, there is a disk_hash used to
 // map each metadata type to its correspondent position in the file.
 static void seal_statistics(statistics& s, metadata_collector& collector,
         const sstring partitioner, double bloom_filter_fp_chance, schema_ptr schema,
-        const dht::decorated_key& first_key, const dht::decorated_key& last_key) {
+        const dht::decorated_key& first_key, const dht::decorated_key& last_key,
+        stdx::optional<serialization_header> header = {}) {
     validation_metadata validation;
     compaction_metadata compaction;
     stats_metadata stats;
@@ -1789,6 +2294,10 @@ static void seal_statistics(statistics& s, metadata_collector& collector,
     collector.construct_stats(stats);
     s.contents[metadata_type::Stats] = std::make_unique<stats_metadata>(std::move(stats));
 
+    if (header) {
+        s.contents[metadata_type::Serialization] = std::make_unique<serialization_header>(std::move(*header));
+    }
+
     populate_statistics_offsets(s);
 }
 
@@ -1802,14 +2311,6 @@ size_t components_writer::get_offset() {
     }
 }
 
-file_writer components_writer::index_file_writer(sstable& sst, const io_priority_class& pc) {
-    file_output_stream_options options;
-    options.buffer_size = sst.sstable_buffer_size;
-    options.io_priority_class = pc;
-    options.write_behind = 10;
-    return file_writer(std::move(sst._index_file), std::move(options));
-}
-
 // Get the currently loaded configuration, or the default configuration in
 // case none has been loaded (this happens, for example, in unit tests).
 static const db::config& get_config() {
@@ -1822,6 +2323,45 @@ static const db::config& get_config() {
     }
 }
 
+// Index entries are small and read a summary interval at a time, so their
+// chunks are smaller than those of the data.
+static constexpr uint32_t index_compression_chunk_length = 8 * 1024;
+
+static compressor index_compressor_from_config(const sstring& name) {
+    static const std::unordered_map<sstring, compressor> compressors = {
+        { "none", compressor::none },
+        { "lz4", compressor::lz4 },
+        { "snappy", compressor::snappy },
+        { "deflate", compressor::deflate },
+        { "zstd", compressor::zstd },
+    };
+    auto i = compressors.find(name);
+    if (i == compressors.end()) {
+        throw std::invalid_argument(sprint("Unknown sstable_index_compression: %s", name));
+    }
+    return i->second;
+}
+
+file_writer components_writer::index_file_writer(sstable& sst, const sstable_writer_config& cfg, const io_priority_class& pc) {
+    file_output_stream_options options;
+    options.buffer_size = sst.sstable_buffer_size;
+    options.io_priority_class = pc;
+    options.write_behind = 10;
+    auto c = cfg.index_compressor.value_or(index_compressor_from_config(get_config().sstable_index_compression()));
+    if (c == compressor::none) {
+        return file_writer(std::move(sst._index_file), std::move(options));
+    }
+    // The chunks of the index are always checksummed with adler32, the
+    // checksum type in the scylla metadata is that of the data.
+    sst._components->index_compression.emplace();
+    auto& ic = *sst._components->index_compression;
+    ic.set_compressor(c);
+    ic.chunk_len = index_compression_chunk_length;
+    ic.data_len = 0;
+    ic.init_full_checksum();
+    return file_writer(make_compressed_file_output_stream(std::move(sst._index_file), std::move(options), &ic));
+}
+
 components_writer::components_writer(sstable& sst, const schema& s, file_writer& out,
                                      uint64_t estimated_partitions,
                                      const sstable_writer_config& cfg,
@@ -1829,12 +2369,23 @@ components_writer::components_writer(sstable& sst, const schema& s, file_writer&
     : _sst(sst)
     , _schema(s)
     , _out(out)
-    , _index(index_file_writer(sst, pc))
+    , _index(index_file_writer(sst, cfg, pc))
     , _max_sstable_size(cfg.max_sstable_size)
+    , _large_partition_threshold(uint64_t(get_config().compaction_large_partition_warning_threshold_mb()) << 20)
+    , _large_row_threshold(uint64_t(get_config().compaction_large_row_warning_threshold_mb()) << 20)
     , _tombstone_written(false)
 {
-    _sst._components->filter = utils::i_filter::get_filter(estimated_partitions, _schema.bloom_filter_fp_chance());
+    auto ft = cfg.filter_kind.value_or(get_config().sstable_filter_type() == "blocked"
+            ? filter_type::blocked : filter_type::classic);
+    if (ft == filter_type::blocked) {
+        _sst._components->filter = utils::i_filter::get_blocked_filter(estimated_partitions, _schema.bloom_filter_fp_chance());
+        _sst._components->scylla_metadata.emplace();
+        _sst._components->scylla_metadata->data.set<scylla_metadata_type::FilterType>(filter_type_metadata{uint32_t(ft)});
+    } else {
+        _sst._components->filter = utils::i_filter::get_filter(estimated_partitions, _schema.bloom_filter_fp_chance());
+    }
     _sst._pi_write.desired_block_size = cfg.promoted_index_block_size.value_or(get_config().column_index_size_in_kb() * 1024);
+    _sst._sa_write.enc_stats = cfg.enc_stats;
 
     prepare_summary(_sst._components->summary, estimated_partitions, _schema.min_index_interval());
 
@@ -1871,6 +2422,9 @@ void components_writer::consume_new_partition(const dht::decorated_key& dk) {
     write(_out, p_key);
 
     _tombstone_written = false;
+    _sst._sa_write.prev_unfiltered_size = 0;
+    _largest_row_size = 0;
+    _largest_row_key = {};
 }
 
 void components_writer::consume(tombstone t) {
@@ -1895,20 +2449,73 @@ void components_writer::consume(tombstone t) {
     _sst._pi_write.deltime = d;
 }
 
+// Key components, separated by ':'.
+template <typename Columns>
+static sstring key_to_string(const Columns& columns, const std::vector<bytes>& components) {
+    sstring ret;
+    auto type = columns.begin();
+    for (auto&& component : components) {
+        if (!ret.empty()) {
+            ret += ":";
+        }
+        ret += type++->type->to_string(component);
+    }
+    return ret;
+}
+
+void components_writer::note_row_size(uint64_t start_offset, const clustering_key_prefix* key) {
+    auto size = _out.offset() - start_offset;
+    if (size > _large_row_threshold && size > _largest_row_size) {
+        _largest_row_size = size;
+        _largest_row_key = key ? key_to_string(_schema.clustering_key_columns(), key->explode(_schema)) : sstring();
+    }
+}
+
+void components_writer::maybe_record_large_partition(uint64_t partition_size) {
+    if (partition_size <= _large_partition_threshold && !_largest_row_size) {
+        return;
+    }
+    auto pk = key_to_string(_schema.partition_key_columns(), _partition_key->to_partition_key(_schema).explode(_schema));
+    if (_largest_row_size) {
+        sstlog.warn("Writing large row {}/{}:{} ({}) of {} bytes to {}", _schema.ks_name(), _schema.cf_name(), pk,
+                _largest_row_key, _largest_row_size, _sst.get_filename());
+    } else {
+        sstlog.warn("Writing large partition {}/{}:{} of {} bytes to {}", _schema.ks_name(), _schema.cf_name(), pk,
+                partition_size, _sst.get_filename());
+    }
+    _large_partitions.push_back(large_partition{std::move(pk), partition_size, std::move(_largest_row_key), _largest_row_size});
+}
+
 stop_iteration components_writer::consume(static_row&& sr) {
     ensure_tombstone_is_written();
-    _sst.write_static_row(_out, _schema, sr.cells());
+    auto start_offset = _out.offset();
+    if (_sst._version == sstable::version_types::sa) {
+        _sst.write_static_row_m(_out, _schema, sr.cells());
+    } else {
+        _sst.write_static_row(_out, _schema, sr.cells());
+    }
+    note_row_size(start_offset, nullptr);
     return stop_iteration::no;
 }
 
 stop_iteration components_writer::consume(clustering_row&& cr) {
     ensure_tombstone_is_written();
-    _sst.write_clustered_row(_out, _schema, cr);
+    auto start_offset = _out.offset();
+    if (_sst._version == sstable::version_types::sa) {
+        _sst.write_clustered_row_m(_out, _schema, cr);
+    } else {
+        _sst.write_clustered_row(_out, _schema, cr);
+    }
+    note_row_size(start_offset, &cr.key());
     return stop_iteration::no;
 }
 
 stop_iteration components_writer::consume(range_tombstone&& rt) {
     ensure_tombstone_is_written();
+    if (_sst._version == sstable::version_types::sa) {
+        _sst.write_range_tombstone_m(_out, _schema, rt);
+        return stop_iteration::no;
+    }
     // Remember the range tombstone so when we need to open a new promoted
     // index block, we can figure out which ranges are still open and need
     // to be repeated in the data file. Note that apply() also drops ranges
@@ -1939,11 +2546,16 @@ stop_iteration components_writer::consume_end_of_partition() {
     _sst._pi_write.block_first_colname = {};
 
     ensure_tombstone_is_written();
-    int16_t end_of_row = 0;
-    write(_out, end_of_row);
+    if (_sst._version == sstable::version_types::sa) {
+        _sst.write_end_of_partition_m(_out);
+    } else {
+        int16_t end_of_row = 0;
+        write(_out, end_of_row);
+    }
 
     // compute size of the current row.
     _sst._c_stats.row_size = _out.offset() - _sst._c_stats.start_offset;
+    maybe_record_large_partition(_sst._c_stats.row_size);
     // update is about merging column_stats with the data being stored by collector.
     _sst._collector.update(_schema, std::move(_sst._c_stats));
     _sst._c_stats.reset();
@@ -1966,8 +2578,22 @@ void components_writer::consume_end_of_stream() {
     }
 
     _sst.set_first_and_last_keys();
+    stdx::optional<serialization_header> header;
+    if (_sst._version == sstable::version_types::sa) {
+        header = make_serialization_header(_schema, _sst._sa_write.enc_stats);
+    }
     seal_statistics(_sst._components->statistics, _sst._collector, dht::global_partitioner().name(), _schema.bloom_filter_fp_chance(),
-            _sst._schema, _sst.get_first_decorated_key(), _sst.get_last_decorated_key());
+            _sst._schema, _sst.get_first_decorated_key(), _sst.get_last_decorated_key(), std::move(header));
+
+    // Writing to system.large_partitions while flushing a system table could
+    // wait on the very flush, so only the warning is left for those.
+    if (_schema.ks_name() == db::system_keyspace::NAME) {
+        return;
+    }
+    for (auto&& lp : _large_partitions) {
+        db::system_keyspace::record_large_partition(_schema.ks_name(), _schema.cf_name(), _sst.get_filename(),
+                std::move(lp.partition_key), lp.partition_size, std::move(lp.clustering_key), lp.row_size).get();
+    }
 }
 
 future<> sstable::write_components(memtable& mt, bool backup, const io_priority_class& pc, bool leave_unsealed) {
@@ -1988,17 +2614,55 @@ sstable::read_scylla_metadata(const io_priority_class& pc) {
         if (!has_component(component_type::Scylla)) {
             return make_ready_future<>();
         }
-        return read_simple<component_type::Scylla>(*_components->scylla_metadata, pc);
+        return read_simple<component_type::Scylla>(*_components->scylla_metadata, pc).then([this] {
+            load_index_compression();
+        });
     });
 }
 
+void sstable::load_index_compression() {
+    auto icm = _components->scylla_metadata->data.get<scylla_metadata_type::IndexCompression, index_compression_metadata>();
+    if (!icm) {
+        return;
+    }
+    _components->index_compression.emplace();
+    auto& ic = *_components->index_compression;
+    ic.name = icm->name;
+    ic.options = icm->options;
+    ic.chunk_len = icm->chunk_len;
+    ic.data_len = icm->data_len;
+    ic.offsets = icm->offsets;
+}
+
+input_stream<char> sstable::make_index_input_stream(file f, uint64_t begin, uint64_t len, file_input_stream_options options) {
+    if (_components->index_compression) {
+        return make_compressed_file_input_stream(std::move(f), &*_components->index_compression, begin, len, std::move(options));
+    }
+    return make_file_input_stream(std::move(f), begin, len, std::move(options));
+}
+
 void
 sstable::write_scylla_metadata(const io_priority_class& pc, shard_id shard) {
     auto&& first_key = get_first_decorated_key();
     auto&& last_key = get_last_decorated_key();
     auto sm = create_sharding_metadata(_schema, first_key, last_key, shard);
+    auto ft = get_filter_type();
     _components->scylla_metadata.emplace();
     _components->scylla_metadata->data.set<scylla_metadata_type::Sharding>(std::move(sm));
+    if (ft != filter_type::classic) {
+        _components->scylla_metadata->data.set<scylla_metadata_type::FilterType>(filter_type_metadata{uint32_t(ft)});
+    }
+    auto ct = _components->compression.get_checksum_type();
+    if (has_component(component_type::CompressionInfo) && ct != checksum_type::adler32) {
+        _components->scylla_metadata->data.set<scylla_metadata_type::ChecksumType>(checksum_type_metadata{uint32_t(ct)});
+    }
+    if (_components->index_compression) {
+        auto& ic = *_components->index_compression;
+        _components->scylla_metadata->data.set<scylla_metadata_type::IndexCompression>(index_compression_metadata{
+                ic.name, ic.options, ic.chunk_len, ic.data_len, ic.offsets});
+    }
+    _components->scylla_metadata->data.set<scylla_metadata_type::RunIdentifier>(run_identifier_metadata{
+            _run_identifier.get_most_significant_bits(), _run_identifier.get_least_significant_bits()});
 
     write_simple<component_type::Scylla>(*_components->scylla_metadata, pc);
 }
@@ -2013,7 +2677,7 @@ void sstable_writer::prepare_file_writer()
     if (!_compression_enabled) {
         _writer = std::make_unique<checksummed_file_writer>(std::move(_sst._data_file), std::move(options), true);
     } else {
-        prepare_compression(_sst._components->compression, _schema);
+        prepare_compression(_sst._components->compression, _schema, _checksum_type);
         _writer = std::make_unique<file_writer>(make_compressed_file_output_stream(std::move(_sst._data_file), std::move(options), &_sst._components->compression));
     }
 }
@@ -2050,6 +2714,8 @@ sstable_writer::sstable_writer(sstable& sst, const schema& s, uint64_t estimated
     , _backup(cfg.backup)
     , _leave_unsealed(cfg.leave_unsealed)
     , _shard(shard)
+    , _checksum_type(cfg.compression_checksum.value_or(get_config().sstable_compression_checksum() == "crc32c"
+            ? checksum_type::crc32c : checksum_type::adler32))
 {
     _sst.generate_toc(_schema.get_compressor_params().get_compressor(), _schema.bloom_filter_fp_chance());
     _sst.write_toc(_pc);
@@ -2107,6 +2773,10 @@ future<> sstable::generate_summary(const io_priority_class& pc) {
     }
 
     sstlog.info("Summary file {} not found. Generating Summary...", filename(sstable::component_type::Summary));
+    return generate_summary(pc, _components->summary);
+}
+
+future<> sstable::generate_summary(const io_priority_class& pc, summary& sum) {
     class summary_generator {
         summary& _summary;
     public:
@@ -2126,23 +2796,29 @@ future<> sstable::generate_summary(const io_priority_class& pc) {
         }
     };
 
-    return open_checked_file_dma(_read_error_handler, filename(component_type::Index), open_flags::ro).then([this, &pc] (file index_file) {
-        return do_with(std::move(index_file), [this, &pc] (file index_file) {
-            return index_file.size().then([this, &pc, index_file] (auto size) {
+    return read_scylla_metadata(pc).then([this, &pc] {
+        return open_checked_file_dma(_read_error_handler, filename(component_type::Index), open_flags::ro);
+    }).then([this, &pc, &sum] (file index_file) {
+        return do_with(std::move(index_file), [this, &pc, &sum] (file index_file) {
+            return index_file.size().then([this, &pc, &sum, index_file] (auto size) {
+                if (_components->index_compression) {
+                    _components->index_compression->update(size);
+                    size = _components->index_compression->uncompressed_file_length();
+                }
                 // an upper bound. Surely to be less than this.
                 auto estimated_partitions = size / sizeof(uint64_t);
-                prepare_summary(_components->summary, estimated_partitions, _schema->min_index_interval());
+                prepare_summary(sum, estimated_partitions, _schema->min_index_interval());
 
                 file_input_stream_options options;
                 options.buffer_size = sstable_buffer_size;
                 options.io_priority_class = pc;
-                auto stream = make_file_input_stream(index_file, 0, size, std::move(options));
-                return do_with(summary_generator(_components->summary), [this, &pc, stream = std::move(stream), size] (summary_generator& s) mutable {
+                auto stream = make_index_input_stream(index_file, 0, size, std::move(options));
+                return do_with(summary_generator(sum), [this, &pc, &sum, stream = std::move(stream), size] (summary_generator& s) mutable {
                     auto ctx = make_lw_shared<index_consume_entry_context<summary_generator>>(s, std::move(stream), 0, size);
                     return ctx->consume_input(*ctx).finally([ctx] {
                         return ctx->close();
-                    }).then([this, ctx, &s] {
-                        seal_summary(_components->summary, std::move(s.first_key), std::move(s.last_key));
+                    }).then([this, ctx, &s, &sum] {
+                        seal_summary(sum, std::move(s.first_key), std::move(s.last_key));
                     });
                 });
             }).then([index_file] () mutable {
@@ -2155,6 +2831,69 @@ future<> sstable::generate_summary(const io_priority_class& pc) {
     });
 }
 
+// Drops the entries of s which aren't part of a summary at new_sampling_level,
+// like Cassandra's IndexSummaryBuilder.downsample().
+static summary downsample_summary(const summary& s, int new_sampling_level) {
+    auto current_sampling_level = int(s.header.sampling_level);
+    auto start_points = downsampling::get_start_points(current_sampling_level, new_sampling_level);
+
+    summary ret;
+    ret.header = s.header;
+    ret.header.sampling_level = new_sampling_level;
+    ret.first_key = s.first_key;
+    ret.last_key = s.last_key;
+    ret.keys_written = s.keys_written;
+    for (size_t i = 0; i < s.entries.size(); ++i) {
+        auto skip = std::any_of(start_points.begin(), start_points.end(), [&] (int start) {
+            return (int64_t(i) - start) % current_sampling_level == 0;
+        });
+        if (!skip) {
+            ret.entries.push_back(s.entries[i]);
+        }
+    }
+
+    ret.header.size = ret.entries.size();
+    ret.header.memory_size = ret.header.size * sizeof(uint32_t);
+    for (auto& e : ret.entries) {
+        ret.positions.push_back(ret.header.memory_size);
+        ret.header.memory_size += e.key.size() + sizeof(e.position);
+    }
+    return ret;
+}
+
+bool sstable::can_resample_summary() const {
+    return !_shared && !_index_readers && !_components->summary.entries.empty();
+}
+
+future<bool> sstable::resample_summary(int new_sampling_level, const io_priority_class& pc) {
+    assert(new_sampling_level > 0 && new_sampling_level <= downsampling::BASE_SAMPLING_LEVEL);
+    auto current_sampling_level = summary_sampling_level();
+    if (new_sampling_level == current_sampling_level || !can_resample_summary()) {
+        return make_ready_future<bool>(false);
+    }
+    auto install = [this] (summary&& s) {
+        // The cached index pages are keyed by summary entry.
+        if (!can_resample_summary()) {
+            return false;
+        }
+        _index_lists.clear();
+        _components->summary = std::move(s);
+        return true;
+    };
+    if (new_sampling_level < current_sampling_level) {
+        return make_ready_future<bool>(install(downsample_summary(_components->summary, new_sampling_level)));
+    }
+    // Entries dropped by downsampling can only be found again in the Index.
+    return do_with(summary(), [this, &pc, new_sampling_level, install] (summary& full) {
+        return generate_summary(pc, full).then([this, &full, new_sampling_level, install] {
+            if (new_sampling_level == downsampling::BASE_SAMPLING_LEVEL) {
+                return install(std::move(full));
+            }
+            return install(downsample_summary(full, new_sampling_level));
+        });
+    });
+}
+
 uint64_t sstable::data_size() const {
     if (has_component(sstable::component_type::CompressionInfo)) {
         return _components->compression.data_len;
@@ -2162,6 +2901,20 @@ uint64_t sstable::data_size() const {
     return _data_file_size;
 }
 
+double sstable::estimate_droppable_tombstone_ratio(gc_clock::time_point gc_before) const {
+    auto& st = get_stats_metadata();
+    auto estimated_count = st.estimated_column_count.count();
+    if (!estimated_count) {
+        return 0;
+    }
+    estimated_count *= st.estimated_column_count.mean();
+    if (estimated_count <= 0) {
+        return 0;
+    }
+    auto droppable = st.estimated_tombstone_drop_time.sum(gc_before.time_since_epoch().count());
+    return droppable / estimated_count;
+}
+
 uint64_t sstable::ondisk_data_size() const {
     return _data_file_size;
 }
@@ -2202,6 +2955,9 @@ const sstring sstable::filename(sstring dir, sstring ks, sstring cf, version_typ
         },
         { sstable::version_types::la, [] (entry_descriptor d) {
             return _version_string.at(d.version) + "-" + to_sstring(d.generation) + "-" + _format_string.at(d.format) + "-" + _component_map.at(d.component); }
+        },
+        { sstable::version_types::sa, [] (entry_descriptor d) {
+            return _version_string.at(d.version) + "-" + to_sstring(d.generation) + "-" + _format_string.at(d.format) + "-" + _component_map.at(d.component); }
         }
     };
 
@@ -2212,7 +2968,8 @@ const sstring sstable::filename(sstring dir, sstring ks, sstring cf, version_typ
                                 format_types format, sstring component) {
     static std::unordered_map<version_types, const char*, enum_hash<version_types>> fmtmap = {
         { sstable::version_types::ka, "{0}-{1}-{2}-{3}-{5}" },
-        { sstable::version_types::la, "{2}-{3}-{4}-{5}" }
+        { sstable::version_types::la, "{2}-{3}-{4}-{5}" },
+        { sstable::version_types::sa, "{2}-{3}-{4}-{5}" }
     };
 
     return dir + "/" + seastar::format(fmtmap[version], ks, cf, _version_string.at(version), to_sstring(generation), _format_string.at(format), component);
@@ -2230,6 +2987,11 @@ std::vector<std::pair<sstable::component_type, sstring>> sstable::all_components
     return all;
 }
 
+future<file> sstable::open_component_file(const sstring& component) const {
+    auto name = filename(_dir, _schema->ks_name(), _schema->cf_name(), _version, _generation, _format, component);
+    return open_checked_file_dma(_read_error_handler, std::move(name), open_flags::ro);
+}
+
 future<> sstable::create_links(sstring dir, int64_t generation) const {
     // TemporaryTOC is always first, TOC is always last
     auto dst = sstable::filename(dir, _schema->ks_name(), _schema->cf_name(), _version, generation, _format, component_type::TemporaryTOC);
@@ -2258,6 +3020,14 @@ future<> sstable::create_links(sstring dir, int64_t generation) const {
     });
 }
 
+future<> sstable::create_snapshot_links(sstring dir) const {
+    return parallel_for_each(all_components(), [this, dir] (auto p) {
+        auto src = sstable::filename(_dir, _schema->ks_name(), _schema->cf_name(), _version, _generation, _format, p.second);
+        auto dst = sstable::filename(dir, _schema->ks_name(), _schema->cf_name(), _version, _generation, _format, p.second);
+        return this->sstable_write_io_check(::link_file, std::move(src), std::move(dst));
+    });
+}
+
 future<> sstable::set_generation(int64_t new_generation) {
     return create_links(_dir, new_generation).then([this] {
         return remove_file(filename(component_type::TOC)).then([this] {
@@ -2278,8 +3048,10 @@ future<> sstable::set_generation(int64_t new_generation) {
 }
 
 entry_descriptor entry_descriptor::make_descriptor(sstring fname) {
-    static std::regex la("la-(\\d+)-(\\w+)-(.*)");
+    static std::regex la("(la|sa)-(\\d+)-(\\w+)-(.*)");
     static std::regex ka("(\\w+)-(\\w+)-ka-(\\d+)-(.*)");
+    // Cassandra 3.x formats, whose files are named like la's.
+    static std::regex m("(m[a-z])-(\\d+)-(\\w+)-(.*)");
 
     std::smatch match;
 
@@ -2295,10 +3067,11 @@ entry_descriptor entry_descriptor::make_descriptor(sstring fname) {
     if (std::regex_match(s, match, la)) {
         sstring ks = "";
         sstring cf = "";
-        version = sstable::version_types::la;
-        generation = match[1].str();
-        format = sstring(match[2].str());
-        component = sstring(match[3].str());
+        sstring v = match[1].str();
+        version = sstable::version_from_sstring(v);
+        generation = match[2].str();
+        format = sstring(match[3].str());
+        component = sstring(match[4].str());
     } else if (std::regex_match(s, match, ka)) {
         ks = match[1].str();
         cf = match[2].str();
@@ -2306,6 +3079,8 @@ entry_descriptor entry_descriptor::make_descriptor(sstring fname) {
         format = sstring("big");
         generation = match[3].str();
         component = sstring(match[4].str());
+    } else if (std::regex_match(s, match, m)) {
+        throw malformed_sstable_exception(sprint("file %s is in the Cassandra 3.x %s format, which is not supported.", fname, match[1].str()));
     } else {
         throw malformed_sstable_exception(sprint("invalid version for file %s. Name doesn't match any known version.", fname));
     }
@@ -2320,6 +3095,14 @@ sstable::format_types sstable::format_from_sstring(sstring &s) {
     return reverse_map(s, _format_string);
 }
 
+const sstring& sstable::version_to_sstring(version_types v) {
+    return _version_string.at(v);
+}
+
+const sstring& sstable::format_to_sstring(format_types f) {
+    return _format_string.at(f);
+}
+
 sstable::component_type sstable::component_from_sstring(sstring &s) {
     try {
         return reverse_map(s, _component_map);
@@ -2328,22 +3111,25 @@ sstable::component_type sstable::component_from_sstring(sstring &s) {
     }
 }
 
-input_stream<char> sstable::data_stream(uint64_t pos, size_t len, const io_priority_class& pc, lw_shared_ptr<file_input_stream_history> history) {
-    file_input_stream_options options;
-    options.buffer_size = sstable_buffer_size;
-    options.io_priority_class = pc;
-    options.read_ahead = 4;
-    options.dynamic_adjustments = std::move(history);
+input_stream<char> sstable::data_stream(uint64_t pos, size_t len, const io_priority_class& pc, const reader_resource_tracker& resource_tracker,
+        lw_shared_ptr<file_input_stream_history> history, read_ahead_window window) {
+    auto f = resource_tracker.track(_data_file);
     if (_components->compression) {
-        return make_compressed_file_input_stream(_data_file, &_components->compression,
+        file_input_stream_options options;
+        options.buffer_size = sstable_buffer_size;
+        options.io_priority_class = pc;
+        options.read_ahead = data_read_ahead;
+        options.dynamic_adjustments = std::move(history);
+        return make_compressed_file_input_stream(std::move(f), &_components->compression,
                 pos, len, std::move(options));
     } else {
-        return make_file_input_stream(_data_file, pos, len, std::move(options));
+        return make_adaptive_file_input_stream(std::move(f), pos, len, pc, std::move(window), _read_ahead_stats);
     }
 }
 
 future<temporary_buffer<char>> sstable::data_read(uint64_t pos, size_t len, const io_priority_class& pc) {
-    return do_with(data_stream(pos, len, pc, { }), [len] (auto& stream) {
+    auto window = read_ahead_window::for_point_read(len, sstable_buffer_size, data_read_ahead);
+    return do_with(data_stream(pos, len, pc, no_resource_tracking(), { }, std::move(window)), [len] (auto& stream) {
         return stream.read_exactly(len).finally([&stream] {
             return stream.close();
         });
@@ -2621,10 +3407,11 @@ sstable::get_sstable_key_range(const schema& s) {
 
 future<std::vector<shard_id>>
 sstable::get_owning_shards_from_unloaded() {
-    return when_all(read_summary(default_priority_class()), read_scylla_metadata(default_priority_class())).then(
-            [this] (std::tuple<future<>, future<>> rets) {
-        std::get<0>(rets).get();
-        std::get<1>(rets).get();
+    // Regenerating a missing summary needs the index compression from the
+    // scylla metadata.
+    return read_scylla_metadata(default_priority_class()).then([this] {
+        return read_summary(default_priority_class());
+    }).then([this] {
         set_first_and_last_keys();
         return get_shards_for_this_sstable();
     });
@@ -2668,9 +3455,16 @@ std::vector<dht::decorated_key> sstable::get_key_samples(const schema& s, const
     auto index_range = get_sample_indexes_for_range(range);
     std::vector<dht::decorated_key> res;
     if (index_range) {
+        std::vector<key_view> keys;
+        keys.reserve(index_range->second - index_range->first);
         for (auto idx = index_range->first; idx < index_range->second; ++idx) {
-            auto pkey = _components->summary.entries[idx].get_key().to_partition_key(s);
-            res.push_back(dht::global_partitioner().decorate_key(s, std::move(pkey)));
+            keys.push_back(_components->summary.entries[idx].get_key());
+        }
+        // The keys are in legacy form, which the tokens are computed from.
+        auto tokens = dht::global_partitioner().get_tokens(keys);
+        res.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            res.push_back(dht::decorated_key{std::move(tokens[i]), keys[i].to_partition_key(s)});
         }
     }
     return res;
@@ -2684,6 +3478,20 @@ uint64_t sstable::estimated_keys_for_range(const dht::token_range& range) {
     return std::max(uint64_t(1), estimated_keys);
 }
 
+stdx::optional<hll::HyperLogLog> sstable::get_cardinality() const {
+    auto entry = _components->statistics.contents.find(metadata_type::Compaction);
+    if (entry == _components->statistics.contents.end() || !entry->second) {
+        return stdx::nullopt;
+    }
+    auto& elements = static_cast<compaction_metadata*>(entry->second.get())->cardinality.elements;
+    std::vector<uint8_t> bytes(elements.begin(), elements.end());
+    try {
+        return hll::HyperLogLog::from_bytes(bytes.data(), bytes.size());
+    } catch (std::invalid_argument&) {
+        return stdx::nullopt;
+    }
+}
+
 std::vector<unsigned>
 sstable::get_shards_for_this_sstable() const {
     std::unordered_set<unsigned> shards;
@@ -2766,6 +3574,19 @@ atomic_deletion_cancelled::what() const noexcept {
 }
 
 thread_local shared_index_lists::stats shared_index_lists::_shard_stats;
+
+lru& shared_index_lists::cache_lru() {
+    return global_cache_tracker().index_lru();
+}
+
+thread_local key_cache::stats key_cache::_shard_stats;
+thread_local size_t key_cache::_shard_capacity = 0;
+thread_local key_cache::shard_lru_type key_cache::_shard_lru;
+
+lru& key_cache::cache_lru() {
+    return global_cache_tracker().index_lru();
+}
+
 static thread_local seastar::metrics::metric_groups metrics;
 
 void init_metrics() {
@@ -2777,6 +3598,22 @@ void init_metrics() {
             sm::description("Index page requests which initiated a read from disk")),
         sm::make_derive("index_page_blocks", [] { return shared_index_lists::shard_stats().blocks; },
             sm::description("Index page requests which needed to wait due to page not being loaded yet")),
+        sm::make_derive("index_page_populations", [] { return shared_index_lists::shard_stats().populations; },
+            sm::description("Index pages inserted into the cache")),
+        sm::make_derive("index_page_evictions", [] { return shared_index_lists::shard_stats().evictions; },
+            sm::description("Index pages evicted from the cache")),
+        sm::make_gauge("index_page_used_bytes", [] { return shared_index_lists::shard_stats().used_bytes; },
+            sm::description("Approximate amount of memory used by cached index pages")),
+        sm::make_derive("key_cache_hits", [] { return key_cache::shard_stats().hits; },
+            sm::description("Partition reads which found the position of the partition in the key cache")),
+        sm::make_derive("key_cache_misses", [] { return key_cache::shard_stats().misses; },
+            sm::description("Partition reads which looked the partition up in the index")),
+        sm::make_derive("key_cache_populations", [] { return key_cache::shard_stats().populations; },
+            sm::description("Partition positions inserted into the key cache")),
+        sm::make_derive("key_cache_evictions", [] { return key_cache::shard_stats().evictions; },
+            sm::description("Partition positions evicted from the key cache")),
+        sm::make_gauge("key_cache_used_bytes", [] { return key_cache::shard_stats().used_bytes; },
+            sm::description("Approximate amount of memory used by the key cache")),
     });
 }
 
@@ -51,6 +51,9 @@
 #include "disk-error-handler.hh"
 #include "atomic_deletion.hh"
 #include "sstables/shared_index_lists.hh"
+#include "sstables/key_cache.hh"
+#include "sstables/read_ahead.hh"
+#include "utils/UUID.hh"
 
 namespace sstables {
 
@@ -124,8 +127,32 @@ struct sstable_open_info;
 
 class index_reader;
 
+// Serializes a ka column name: the clustering key followed by the given
+// components and end-of-component marker.
+bytes serialize_colname(const composite& clustering_key,
+        const std::vector<bytes_view>& column_names, composite::eoc marker);
+
+// Timestamp and TTL of an sa row's liveness info, which its cells may share.
+struct row_time_properties_m {
+    stdx::optional<api::timestamp_type> timestamp;
+    stdx::optional<gc_clock::duration> ttl;
+    stdx::optional<gc_clock::time_point> expiry;
+};
+
 struct sstable_writer_config {
     std::experimental::optional<size_t> promoted_index_block_size;
+    // Bases against which the sa format delta-encodes timestamps, deletion
+    // times and TTLs. The defaults are always correct, but tighter (larger)
+    // minimums, e.g. those of the input sstables of a compaction, give
+    // shorter encodings.
+    encoding_stats enc_stats;
+    // Layout of the bloom filter; defaults to the sstable_filter_type option.
+    std::experimental::optional<filter_type> filter_kind;
+    // Checksum of compressed chunks; defaults to the
+    // sstable_compression_checksum option.
+    std::experimental::optional<checksum_type> compression_checksum;
+    // Compression of Index.db; defaults to the sstable_index_compression option.
+    std::experimental::optional<compressor> index_compressor;
     uint64_t max_sstable_size = std::numeric_limits<uint64_t>::max();
     bool backup = false;
     bool leave_unsealed = false;
@@ -148,9 +175,14 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         Scylla,
         Unknown,
     };
-    enum class version_types { ka, la };
+    // sa is Scylla's own format, modelled on Cassandra 3.x's mc but not
+    // compatible with it.
+    enum class version_types { ka, la, sa };
     enum class format_types { big };
     static const size_t default_buffer_size = 128*1024;
+    // The most buffers the reads of the data file keep in flight ahead of
+    // the one being consumed.
+    static const unsigned data_read_ahead = 4;
 public:
     sstable(schema_ptr schema, sstring dir, int64_t generation, version_types v, format_types f, gc_clock::time_point now = gc_clock::now(),
             io_error_handler_gen error_handler_gen = default_io_error_handler_gen(), size_t buffer_size = default_buffer_size)
@@ -238,6 +270,8 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     static component_type component_from_sstring(sstring& s);
     static version_types version_from_sstring(sstring& s);
     static format_types format_from_sstring(sstring& s);
+    static const sstring& version_to_sstring(version_types v);
+    static const sstring& format_to_sstring(format_types f);
     static const sstring filename(sstring dir, sstring ks, sstring cf, version_types version, int64_t generation,
                                   format_types format, component_type component);
     static const sstring filename(sstring dir, sstring ks, sstring cf, version_types version, int64_t generation,
@@ -253,6 +287,8 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // this variant will be useful for testing purposes and also when loading
     // a new sstable from scratch for sharing its components.
     future<> load(const io_priority_class& pc = default_priority_class());
+    // Like load(pc), leaving the Filter to maybe_load_deferred_filter() if defer_filter.
+    future<> load(const io_priority_class& pc, bool defer_filter);
     future<> open_data();
     future<> update_info_for_opened_data();
 
@@ -267,19 +303,31 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // a filter on the clustering keys which we want to read, which
     // additionally determines also if all the static columns will also be
     // returned in the result.
+    //
+    // The buffers read from the index and data files are charged through
+    // resource_tracker.
     future<streamed_mutation_opt> read_row(
         schema_ptr schema,
         dht::ring_position_view key,
         const query::partition_slice& slice = query::full_slice,
         const io_priority_class& pc = default_priority_class(),
-        streamed_mutation::forwarding fwd = streamed_mutation::forwarding::no);
+        streamed_mutation::forwarding fwd = streamed_mutation::forwarding::no,
+        reader_resource_tracker resource_tracker = no_resource_tracking());
 
     future<streamed_mutation_opt> read_row(
         schema_ptr schema,
         const sstables::key& key,
         const query::partition_slice& slice = query::full_slice,
         const io_priority_class& pc = default_priority_class(),
-        streamed_mutation::forwarding fwd = streamed_mutation::forwarding::no);
+        streamed_mutation::forwarding fwd = streamed_mutation::forwarding::no,
+        reader_resource_tracker resource_tracker = no_resource_tracking());
+
+    // Returns the clustering prefixes at which the promoted index blocks of
+    // the partition with given key start, in clustering order. Empty if the
+    // sstable doesn't have the partition, or it fits in a single block.
+    future<std::vector<clustering_key_prefix>> get_promoted_index_block_starts(
+        const dht::decorated_key& key,
+        const io_priority_class& pc = default_priority_class());
 
     // Returns a mutation_reader for given range of partitions
     mutation_reader read_range_rows(
@@ -288,7 +336,8 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         const query::partition_slice& slice = query::full_slice,
         const io_priority_class& pc = default_priority_class(),
         streamed_mutation::forwarding fwd = streamed_mutation::forwarding::no,
-        ::mutation_reader::forwarding fwd_mr = ::mutation_reader::forwarding::yes);
+        ::mutation_reader::forwarding fwd_mr = ::mutation_reader::forwarding::yes,
+        reader_resource_tracker resource_tracker = no_resource_tracking());
 
     // read_rows() returns each of the rows in the sstable, in sequence,
     // converted to a "mutation" data structure.
@@ -334,6 +383,11 @@ class sstable : public enable_lw_shared_from_this<sstable> {
 
     uint64_t estimated_keys_for_range(const dht::token_range& range);
 
+    // The estimate of the number of distinct partition keys, stored in the
+    // compaction metadata, or a disengaged optional if the sstable has none
+    // which can be read back (e.g. one in the sparse format of Cassandra).
+    stdx::optional<hll::HyperLogLog> get_cardinality() const;
+
     std::vector<dht::decorated_key> get_key_samples(const schema& s, const dht::token_range& range);
 
     // mark_for_deletion() specifies that a sstable isn't relevant to the
@@ -364,11 +418,27 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         _shared = false;
     }
 
+    // Sstables written by the same compaction, as fragments of its output,
+    // share a run identifier. An sstable which doesn't record one is a run
+    // of its own.
+    utils::UUID run_identifier() const {
+        const auto* ri = _components->scylla_metadata
+                ? _components->scylla_metadata->data.get<scylla_metadata_type::RunIdentifier, run_identifier_metadata>()
+                : nullptr;
+        return ri ? utils::UUID(ri->msb, ri->lsb) : _run_identifier;
+    }
+
+    // Must be called before the sstable is written.
+    void set_run_identifier(utils::UUID id) {
+        _run_identifier = id;
+    }
+
     // Returns uncompressed size of data component.
     uint64_t data_size() const;
     // Returns on-disk size of data component.
     uint64_t ondisk_data_size() const;
 
+    // Returns the size of the index entries, uncompressed.
     uint64_t index_size() const {
         return _index_file_size;
     }
@@ -380,6 +450,10 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return _data_file_write_time;
     }
 
+    // Estimated ratio of the cells of this sstable which are tombstones that
+    // may be purged at gc_before, as told by the tombstone drop time histogram.
+    double estimate_droppable_tombstone_ratio(gc_clock::time_point gc_before) const;
+
     uint64_t filter_memory_size() const {
         return _components->filter->memory_size();
     }
@@ -415,12 +489,21 @@ class sstable : public enable_lw_shared_from_this<sstable> {
 
     std::vector<std::pair<component_type, sstring>> all_components() const;
 
+    // Opens a component file for reading, e.g. to stream it as is.
+    future<file> open_component_file(const sstring& component) const;
+
     future<> create_links(sstring dir, int64_t generation) const;
 
     future<> create_links(sstring dir) const {
         return create_links(dir, _generation);
     }
 
+    // Hard-links all the components into dir at once, without syncing it,
+    // which is left to the caller. Unlike create_links(), this can leave dir
+    // with only some of the links after a crash: snapshots tell they are
+    // complete by their manifest, which is written after that.
+    future<> create_snapshot_links(sstring dir) const;
+
     /**
      * Note. This is using the Origin definition of
      * max_data_age, which is load time. This could maybe
@@ -439,10 +522,15 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // Immutable components that can be shared among shards.
     struct shareable_components {
         sstables::compression compression;
+        // Set if Index.db is compressed, from the Scylla component.
+        stdx::optional<sstables::compression> index_compression;
         utils::filter_ptr filter;
         sstables::summary summary;
         sstables::statistics statistics;
         stdx::optional<sstables::scylla_metadata> scylla_metadata;
+        // The Filter wasn't read yet, and filter accepts every key until
+        // it is, see maybe_load_deferred_filter().
+        bool filter_deferred = false;
     };
 private:
     size_t sstable_buffer_size = default_buffer_size;
@@ -474,6 +562,7 @@ class sstable : public enable_lw_shared_from_this<sstable> {
 
     lw_shared_ptr<file_input_stream_history> _single_partition_history = make_lw_shared<file_input_stream_history>();
     lw_shared_ptr<file_input_stream_history> _partition_range_history = make_lw_shared<file_input_stream_history>();
+    lw_shared_ptr<read_ahead_stats> _read_ahead_stats = make_lw_shared<read_ahead_stats>();
 
     // _pi_write is used temporarily for building the promoted
     // index (column sample) of one partition when writing a new sstable.
@@ -492,6 +581,12 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         size_t desired_block_size;
     } _pi_write;
 
+    // _sa_write holds the state of writing the data file in the sa format.
+    struct {
+        encoding_stats enc_stats;
+        uint64_t prev_unfiltered_size = 0;
+    } _sa_write;
+
     void maybe_flush_pi_block(file_writer& out,
             const composite& clustering_key,
             const std::vector<bytes_view>& column_names);
@@ -503,6 +598,13 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     format_types _format;
 
     filter_tracker _filter_tracker;
+    key_cache _key_cache{*_schema};
+    utils::UUID _run_identifier = utils::make_random_uuid();
+
+    // Index readers alive, which may refer to the summary by index.
+    uint64_t _index_readers = 0;
+    // Index readers ever created, a measure of the read rate.
+    uint64_t _index_reads = 0;
 
     bool _marked_for_deletion = false;
 
@@ -529,9 +631,24 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     void write_compression(const io_priority_class& pc);
 
     future<> read_scylla_metadata(const io_priority_class& pc);
+    // Sets up the compression of the index recorded in the scylla metadata.
+    void load_index_compression();
     void write_scylla_metadata(const io_priority_class& pc, shard_id shard = engine().cpu_id());
 
     future<> read_filter(const io_priority_class& pc);
+    // Reading the Filter of sstables owned by a single shard is deferred
+    // until the first lookup, so that loading them at startup reads less,
+    // and the filters of sstables which are never read aren't read at all.
+    void maybe_load_deferred_filter() {
+        if (__builtin_expect(_components->filter_deferred, false)) {
+            load_deferred_filter();
+        }
+    }
+    // Reads the Filter in the background.
+    void load_deferred_filter();
+    // Reads the Filter now, for when the components are about to be shared
+    // with other shards.
+    future<> load_deferred_filter_now();
 
     void write_filter(const io_priority_class& pc);
 
@@ -544,6 +661,8 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // To be called when we try to load an SSTable that lacks a Summary. Could
     // happen if old tools are being used.
     future<> generate_summary(const io_priority_class& pc);
+    // Builds a summary at full sampling from the Index into s.
+    future<> generate_summary(const io_priority_class& pc, summary& s);
 
     future<> read_statistics(const io_priority_class& pc);
     void write_statistics(const io_priority_class& pc);
@@ -576,8 +695,17 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     // of bytes to be read using this stream, we can make better choices
     // about the buffer size to read, and where exactly to stop reading
     // (even when a large buffer size is used).
+    //
+    // Reads of uncompressed data files adapt their buffer size and read-ahead
+    // to the way they are consumed, starting from window. Compressed ones
+    // read chunks through a stream adjusted by history.
     input_stream<char> data_stream(uint64_t pos, size_t len, const io_priority_class& pc,
-                                   lw_shared_ptr<file_input_stream_history> history);
+                                   const reader_resource_tracker& resource_tracker,
+                                   lw_shared_ptr<file_input_stream_history> history,
+                                   read_ahead_window window);
+
+    // A stream of the uncompressed index, from begin for len bytes.
+    input_stream<char> make_index_input_stream(file f, uint64_t begin, uint64_t len, file_input_stream_options options);
 
     // Read exactly the specific byte range from the data file (after
     // uncompression, if the file is compressed). This can be used to read
@@ -607,17 +735,33 @@ class sstable : public enable_lw_shared_from_this<sstable> {
     void write_row_tombstone(file_writer& out, const composite& key, const row_tombstone t);
     void write_deletion_time(file_writer& out, const tombstone t);
 
+    // sa format
+    void write_cell_m(bytes_ostream& out, atomic_cell_view cell, const column_definition& cdef,
+            const row_time_properties_m& row_props, bytes_view cell_path = {});
+    void write_row_m(file_writer& out, const schema& schema, const clustering_key_prefix* ck,
+            const row& cells, const row_marker& marker, row_tombstone tomb);
+    void write_unfiltered_m(file_writer& out, bytes_ostream header, bytes_ostream body);
+    void write_deletion_time_stats(const tombstone& t);
+    void write_clustered_row_m(file_writer& out, const schema& schema, const clustering_row& clustered_row);
+    void write_static_row_m(file_writer& out, const schema& schema, const row& static_row);
+    void write_range_tombstone_m(file_writer& out, const schema& schema, const range_tombstone& rt);
+    void write_end_of_partition_m(file_writer& out);
+
     stdx::optional<std::pair<uint64_t, uint64_t>> get_sample_indexes_for_range(const dht::token_range& range);
 public:
-    std::unique_ptr<index_reader> get_index_reader(const io_priority_class& pc);
+    std::unique_ptr<index_reader> get_index_reader(const io_priority_class& pc, reader_resource_tracker resource_tracker = no_resource_tracking());
 
     future<> read_toc();
 
     bool filter_has_key(const key& key) {
+        maybe_load_deferred_filter();
+        _filter_tracker.add_probe(_components->filter->probe_cost());
         return _components->filter->is_present(bytes_view(key));
     }
 
     bool filter_has_key(utils::hashed_key key) {
+        maybe_load_deferred_filter();
+        _filter_tracker.add_probe(_components->filter->probe_cost());
         return _components->filter->is_present(key);
     }
 
@@ -643,6 +787,34 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         _filter_tracker.last_true_positive = _filter_tracker.true_positive;
         return t;
     }
+    uint64_t filter_get_probes() const {
+        return _filter_tracker.probes;
+    }
+    // Total number of cache lines touched by the filter lookups, at most.
+    uint64_t filter_get_probe_cost() const {
+        return _filter_tracker.probe_cost;
+    }
+    const key_cache& get_key_cache() const {
+        return _key_cache;
+    }
+    // Where the reads of the data file account for their read-ahead, shared
+    // by the sstables of a table.
+    void set_read_ahead_stats(lw_shared_ptr<read_ahead_stats> stats) {
+        _read_ahead_stats = std::move(stats);
+    }
+    filter_type get_filter_type() const {
+        const auto* ft = _components->scylla_metadata
+                ? _components->scylla_metadata->data.get<scylla_metadata_type::FilterType, filter_type_metadata>()
+                : nullptr;
+        return ft ? filter_type(ft->type) : filter_type::classic;
+    }
+    // Checksum of the compressed chunks.
+    checksum_type get_checksum_type() const {
+        const auto* ct = _components->scylla_metadata
+                ? _components->scylla_metadata->data.get<scylla_metadata_type::ChecksumType, checksum_type_metadata>()
+                : nullptr;
+        return ct ? checksum_type(ct->type) : checksum_type::adler32;
+    }
 
     const stats_metadata& get_stats_metadata() const {
         auto entry = _components->statistics.contents.find(metadata_type::Stats);
@@ -668,6 +840,27 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         const compaction_metadata& s = *static_cast<compaction_metadata *>(p.get());
         return s;
     }
+    const serialization_header& get_serialization_header() const {
+        auto entry = _components->statistics.contents.find(metadata_type::Serialization);
+        if (entry == _components->statistics.contents.end()) {
+            throw std::runtime_error("Serialization header not available");
+        }
+        auto& p = entry->second;
+        if (!p) {
+            throw std::runtime_error("Statistics is malformed");
+        }
+        const serialization_header& s = *static_cast<serialization_header *>(p.get());
+        return s;
+    }
+    version_types get_version() const {
+        return _version;
+    }
+    format_types get_format() const {
+        return _format;
+    }
+    const schema_ptr& get_schema() const {
+        return _schema;
+    }
     std::vector<unsigned> get_shards_for_this_sstable() const;
 
     uint32_t get_sstable_level() const {
@@ -685,6 +878,29 @@ class sstable : public enable_lw_shared_from_this<sstable> {
         return _components->summary;
     }
 
+    uint64_t summary_memory_usage() const {
+        return _components->summary.memory_footprint();
+    }
+    int summary_sampling_level() const {
+        return _components->summary.header.sampling_level;
+    }
+    uint64_t index_reads() const {
+        return _index_reads;
+    }
+    // Whether the summary can be resampled now: it isn't shared with other
+    // shards, and no index reader refers to its entries.
+    bool can_resample_summary() const;
+    // Replaces the summary with one at new_sampling_level. Downsampling drops
+    // entries of the current summary, upsampling reads the Index. Returns
+    // false if the summary couldn't be replaced, because can_resample_summary()
+    // was false by the time the new one was built.
+    future<bool> resample_summary(int new_sampling_level, const io_priority_class& pc = default_priority_class());
+
+    // Adds the memory used by the index pages of this sstable in cache.
+    void add_index_cache_footprint(memory_footprint& f) const {
+        _index_lists.add_footprint(f);
+    }
+
     // Return sstable key range as range<partition_key> reading only the summary component.
     future<range<partition_key>>
     get_sstable_key_range(const schema& s);
@@ -764,18 +980,34 @@ future<> delete_atomically(std::vector<sstable_to_delete> ssts);
 void cancel_atomic_deletions();
 
 class components_writer {
+    // A partition, or a row of it, above the large data thresholds, to be
+    // recorded in system.large_partitions once the sstable is written.
+    struct large_partition {
+        sstring partition_key;
+        uint64_t partition_size;
+        sstring clustering_key;
+        uint64_t row_size;
+    };
     sstable& _sst;
     const schema& _schema;
     file_writer& _out;
     file_writer _index;
     uint64_t _max_sstable_size;
+    uint64_t _large_partition_threshold;
+    uint64_t _large_row_threshold;
     bool _tombstone_written;
     // Remember first and last keys, which we need for the summary file.
     stdx::optional<key> _first_key, _last_key;
     stdx::optional<key> _partition_key;
+    // The largest row of the current partition, if above _large_row_threshold.
+    uint64_t _largest_row_size = 0;
+    sstring _largest_row_key;
+    std::vector<large_partition> _large_partitions;
 private:
+    void note_row_size(uint64_t start_offset, const clustering_key_prefix* key);
+    void maybe_record_large_partition(uint64_t partition_size);
     size_t get_offset();
-    file_writer index_file_writer(sstable& sst, const io_priority_class& pc);
+    file_writer index_file_writer(sstable& sst, const sstable_writer_config& cfg, const io_priority_class& pc);
     void ensure_tombstone_is_written() {
         if (!_tombstone_written) {
             consume(tombstone());
@@ -803,6 +1035,7 @@ class sstable_writer {
     std::unique_ptr<file_writer> _writer;
     stdx::optional<components_writer> _components_writer;
     shard_id _shard; // Specifies which shard new sstable will belong to.
+    checksum_type _checksum_type;
 private:
     void prepare_file_writer();
     void finish_file_writer();
@@ -812,7 +1045,7 @@ class sstable_writer {
     ~sstable_writer();
     sstable_writer(sstable_writer&& o) : _sst(o._sst), _schema(o._schema), _pc(o._pc), _backup(o._backup),
             _leave_unsealed(o._leave_unsealed), _compression_enabled(o._compression_enabled), _writer(std::move(o._writer)),
-            _components_writer(std::move(o._components_writer)), _shard(o._shard) {}
+            _components_writer(std::move(o._components_writer)), _shard(o._shard), _checksum_type(o._checksum_type) {}
     void consume_new_partition(const dht::decorated_key& dk) { return _components_writer->consume_new_partition(dk); }
     void consume(tombstone t) { _components_writer->consume(t); }
     stop_iteration consume(static_row&& sr) { return _components_writer->consume(std::move(sr)); }
@@ -832,6 +1065,8 @@ struct foreign_sstable_open_info {
     uint64_t generation;
     sstable::version_types version;
     sstable::format_types format;
+    // The directory of the sstable, if known.
+    sstring dir;
 };
 
 // can only be used locally
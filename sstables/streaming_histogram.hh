@@ -42,6 +42,8 @@
 #pragma once
 
 #include "disk_types.hh"
+#include <algorithm>
+#include <vector>
 
 namespace sstables {
 
@@ -145,43 +147,47 @@ struct streaming_histogram {
     template <typename Describer>
     auto describe_type(Describer f) { return f(max_bin_size, bin); }
 
-    // FIXME: convert Java code below.
-#if 0
     /**
      * Calculates estimated number of points in interval [-inf,b].
      *
      * @param b upper bound of a interval to calculate sum
      * @return estimated number of points in a interval [-inf,b].
      */
-    public double sum(double b)
-    {
-        double sum = 0;
+    double sum(double b) const {
+        std::vector<std::pair<double, uint64_t>> points(bin.map.begin(), bin.map.end());
+        std::sort(points.begin(), points.end());
+
         // find the points pi, pnext which satisfy pi <= b < pnext
-        Map.Entry<Double, Long> pnext = bin.higherEntry(b);
-        if (pnext == null)
-        {
+        auto pnext = std::upper_bound(points.begin(), points.end(), b, [] (double b, auto& p) {
+            return b < p.first;
+        });
+        double sum = 0;
+        if (pnext == points.end()) {
             // if b is greater than any key in this histogram,
             // just count all appearance and return
-            for (Long value : bin.values())
-                sum += value;
+            for (auto& p : points) {
+                sum += p.second;
+            }
+            return sum;
         }
-        else
-        {
-            Map.Entry<Double, Long> pi = bin.floorEntry(b);
-            if (pi == null)
-                return 0;
-            // calculate estimated count mb for point b
-            double weight = (b - pi.getKey()) / (pnext.getKey() - pi.getKey());
-            double mb = pi.getValue() + (pnext.getValue() - pi.getValue()) * weight;
-            sum += (pi.getValue() + mb) * weight / 2;
-
-            sum += pi.getValue() / 2.0;
-            for (Long value : bin.headMap(pi.getKey(), false).values())
-                sum += value;
+        if (pnext == points.begin()) {
+            return 0;
+        }
+        auto pi = std::prev(pnext);
+        // calculate estimated count mb for point b
+        double weight = (b - pi->first) / (pnext->first - pi->first);
+        double mb = pi->second + (double(pnext->second) - pi->second) * weight;
+        sum += (pi->second + mb) * weight / 2;
+
+        sum += pi->second / 2.0;
+        for (auto it = points.begin(); it != pi; ++it) {
+            sum += it->second;
         }
         return sum;
     }
 
+    // FIXME: convert Java code below.
+#if 0
     public Map<Double, Long> getAsMap()
     {
         return Collections.unmodifiableMap(bin);
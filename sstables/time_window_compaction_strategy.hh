@@ -0,0 +1,162 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Copyright (C) 2017 ScyllaDB
+ *
+ * Modified by ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <vector>
+#include "sstables.hh"
+#include "timestamp.hh"
+#include "exceptions/exceptions.hh"
+#include "date_tiered_compaction_strategy.hh"
+
+namespace sstables {
+
+static constexpr int DEFAULT_COMPACTION_WINDOW_SIZE = 1;
+static constexpr int64_t DEFAULT_EXPIRED_SSTABLE_CHECK_FREQUENCY_SECONDS = 600;
+
+class time_window_compaction_strategy_options {
+    const sstring DEFAULT_COMPACTION_WINDOW_UNIT = "DAYS";
+    const sstring DEFAULT_TIMESTAMP_RESOLUTION = "MICROSECONDS";
+    const sstring COMPACTION_WINDOW_UNIT_KEY = "compaction_window_unit";
+    const sstring COMPACTION_WINDOW_SIZE_KEY = "compaction_window_size";
+    const sstring TIMESTAMP_RESOLUTION_KEY = "timestamp_resolution";
+    const sstring EXPIRED_SSTABLE_CHECK_FREQUENCY_SECONDS_KEY = "expired_sstable_check_frequency_seconds";
+
+    // Window size in the timestamp resolution of the table.
+    api::timestamp_type sstable_window_size;
+    std::chrono::seconds expired_sstable_check_frequency{DEFAULT_EXPIRED_SSTABLE_CHECK_FREQUENCY_SECONDS};
+public:
+    time_window_compaction_strategy_options(const std::map<sstring, sstring>& options) {
+        using namespace cql3::statements;
+
+        auto tmp_value = get_value(options, TIMESTAMP_RESOLUTION_KEY);
+        auto timestamp_resolution = tmp_value ? tmp_value.value() : DEFAULT_TIMESTAMP_RESOLUTION;
+
+        tmp_value = get_value(options, COMPACTION_WINDOW_UNIT_KEY);
+        auto unit = tmp_value ? tmp_value.value() : DEFAULT_COMPACTION_WINDOW_UNIT;
+        std::chrono::seconds window_unit;
+        if (unit == "MINUTES") {
+            window_unit = std::chrono::minutes(1);
+        } else if (unit == "HOURS") {
+            window_unit = std::chrono::hours(1);
+        } else if (unit == "DAYS") {
+            window_unit = std::chrono::hours(24);
+        } else {
+            throw exceptions::configuration_exception(sprint("%s is not valid for %s, use one of MINUTES, HOURS or DAYS",
+                    unit, COMPACTION_WINDOW_UNIT_KEY));
+        }
+
+        tmp_value = get_value(options, COMPACTION_WINDOW_SIZE_KEY);
+        auto window_size = property_definitions::to_int(COMPACTION_WINDOW_SIZE_KEY, tmp_value, DEFAULT_COMPACTION_WINDOW_SIZE);
+        if (window_size < 1) {
+            throw exceptions::configuration_exception(sprint("%s must be at least 1, got %d", COMPACTION_WINDOW_SIZE_KEY, window_size));
+        }
+
+        sstable_window_size = duration_conversor::convert(timestamp_resolution, window_unit * window_size);
+        if (sstable_window_size <= 0) {
+            throw exceptions::configuration_exception(sprint("%s is too coarse for a window of %d %s",
+                    timestamp_resolution, window_size, unit));
+        }
+
+        tmp_value = get_value(options, EXPIRED_SSTABLE_CHECK_FREQUENCY_SECONDS_KEY);
+        auto frequency = property_definitions::to_long(EXPIRED_SSTABLE_CHECK_FREQUENCY_SECONDS_KEY, tmp_value,
+                DEFAULT_EXPIRED_SSTABLE_CHECK_FREQUENCY_SECONDS);
+        if (frequency < 0) {
+            throw exceptions::configuration_exception(sprint("%s must not be negative", EXPIRED_SSTABLE_CHECK_FREQUENCY_SECONDS_KEY));
+        }
+        expired_sstable_check_frequency = std::chrono::seconds(frequency);
+    }
+
+    time_window_compaction_strategy_options()
+        : sstable_window_size(duration_conversor::convert<std::chrono::microseconds>(std::chrono::hours(24) * DEFAULT_COMPACTION_WINDOW_SIZE)) {
+    }
+
+    api::timestamp_type window_size() const {
+        return sstable_window_size;
+    }
+
+    std::chrono::seconds get_expired_sstable_check_frequency() const {
+        return expired_sstable_check_frequency;
+    }
+private:
+    static std::experimental::optional<sstring> get_value(const std::map<sstring, sstring>& options, const sstring& name) {
+        auto it = options.find(name);
+        if (it == options.end()) {
+            return std::experimental::nullopt;
+        }
+        return it->second;
+    }
+};
+
+// Sstables are assigned to fixed, non-overlapping time windows by their
+// max timestamp. Only the sstables of the newest window receive new writes,
+// so older windows are compacted once, into a single sstable, and never again.
+class time_window_manifest {
+public:
+    // Returns the lower bound of the window the timestamp belongs to.
+    static api::timestamp_type get_window_lower_bound(api::timestamp_type window_size, api::timestamp_type timestamp) {
+        auto remainder = timestamp % window_size;
+        // Round towards negative infinity, so that negative timestamps also
+        // land in the right window.
+        if (remainder < 0) {
+            remainder += window_size;
+        }
+        return timestamp - remainder;
+    }
+
+    // Groups the sstables by the window of their max timestamp.
+    // Returns the windows, and the lower bound of the newest one.
+    static std::pair<std::map<api::timestamp_type, std::vector<shared_sstable>>, api::timestamp_type>
+    get_buckets(const std::vector<shared_sstable>& sstables, api::timestamp_type window_size) {
+        std::map<api::timestamp_type, std::vector<shared_sstable>> buckets;
+        auto max_lower_bound = std::numeric_limits<api::timestamp_type>::min();
+        for (auto& sst : sstables) {
+            auto lower_bound = get_window_lower_bound(window_size, sst->get_stats_metadata().max_timestamp);
+            buckets[lower_bound].push_back(sst);
+            max_lower_bound = std::max(max_lower_bound, lower_bound);
+        }
+        return { std::move(buckets), max_lower_bound };
+    }
+};
+
+}
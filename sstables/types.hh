@@ -96,7 +96,13 @@ enum class indexable_element {
 // Exploded view of promoted index.
 // Contains pointers into external buffer, so that buffer must be kept alive
 // as long as this is used.
-struct promoted_index {
+//
+// Only the positions of the blocks are found up front, by reading the lengths
+// of their keys. Each block is parsed when first accessed, and kept, so that
+// a binary search in the index of a wide partition parses only the blocks it
+// visits.
+class promoted_index {
+public:
     struct entry {
         composite_view start;
         composite_view end;
@@ -104,7 +110,47 @@ struct promoted_index {
         uint64_t width;
     };
     deletion_time del_time;
-    std::deque<entry> entries;
+private:
+    bytes_view _blocks;
+    bool _is_compound;
+    // The offset of each block in _blocks.
+    std::vector<uint32_t> _block_offsets;
+    mutable std::unordered_map<uint32_t, entry> _entries;
+public:
+    promoted_index(deletion_time del_time, bytes_view blocks, std::vector<uint32_t> block_offsets, bool is_compound)
+        : del_time(del_time)
+        , _blocks(blocks)
+        , _is_compound(is_compound)
+        , _block_offsets(std::move(block_offsets))
+    { }
+
+    size_t size() const {
+        return _block_offsets.size();
+    }
+
+    bool empty() const {
+        return _block_offsets.empty();
+    }
+
+    const entry& operator[](size_t i) const;
+
+    // The index of the first block at or after first for which less(key, block)
+    // holds, or size() if there is none.
+    template <typename Key, typename Less>
+    size_t upper_bound(size_t first, const Key& key, Less&& less) const {
+        auto count = size() - first;
+        while (count > 0) {
+            auto step = count / 2;
+            auto i = first + step;
+            if (!less(key, (*this)[i])) {
+                first = i + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
+        }
+        return first;
+    }
 };
 
 class promoted_index_view {
@@ -346,6 +392,66 @@ struct sharding_metadata {
 };
 
 
+// Lower bounds of the timestamps, local deletion times and TTLs stored in an
+// sa sstable. Every cell, row and tombstone stores its values as deltas
+// against these, so the tighter the bounds, the shorter the encoding.
+// The defaults are the epochs Cassandra uses when no statistics are known.
+struct encoding_stats {
+    static constexpr api::timestamp_type timestamp_epoch = 1442880000000000; // 2015-09-22, in microseconds
+    static constexpr int32_t deletion_time_epoch = 1442880000;
+    static constexpr int32_t ttl_epoch = 0;
+
+    api::timestamp_type min_timestamp = timestamp_epoch;
+    int32_t min_local_deletion_time = deletion_time_epoch;
+    int32_t min_ttl = ttl_epoch;
+};
+
+// Describes the column layout of an sa sstable and the bases against which
+// timestamps, deletion times and TTLs are delta-encoded.
+//
+// Rows refer to columns by their position in static_columns or
+// regular_columns, so the lists are kept exactly as written, and readers must
+// map them to the current schema by name.
+struct serialization_header : public metadata_base<serialization_header> {
+    vint<uint64_t> min_timestamp_base;
+    vint<uint64_t> min_local_deletion_time_base;
+    vint<uint64_t> min_ttl_base;
+    disk_string_vint_size pk_type_name;
+    disk_array_vint_size<disk_string_vint_size> clustering_key_types_names;
+    struct column_desc {
+        disk_string_vint_size name;
+        disk_string_vint_size type_name;
+
+        template <typename Describer>
+        auto describe_type(Describer f) { return f(name, type_name); }
+    };
+    disk_array_vint_size<column_desc> static_columns;
+    disk_array_vint_size<column_desc> regular_columns;
+
+    template <typename Describer>
+    auto describe_type(Describer f) {
+        return f(
+            min_timestamp_base,
+            min_local_deletion_time_base,
+            min_ttl_base,
+            pk_type_name,
+            clustering_key_types_names,
+            static_columns,
+            regular_columns
+        );
+    }
+
+    api::timestamp_type get_min_timestamp() const {
+        return api::timestamp_type(min_timestamp_base.value + encoding_stats::timestamp_epoch);
+    }
+    int32_t get_min_local_deletion_time() const {
+        return int32_t(min_local_deletion_time_base.value + encoding_stats::deletion_time_epoch);
+    }
+    int32_t get_min_ttl() const {
+        return int32_t(min_ttl_base.value + encoding_stats::ttl_epoch);
+    }
+};
+
 // Numbers are found on disk, so they do matter. Also, setting their sizes of
 // that of an uint32_t is a bit wasteful, but it simplifies the code a lot
 // since we can now still use a strongly typed enum without introducing a
@@ -354,16 +460,80 @@ enum class metadata_type : uint32_t {
     Validation = 0,
     Compaction = 1,
     Stats = 2,
+    Serialization = 3,
+};
+
+
+// Layout of the bits in Filter.db. Both layouts share the same on-disk
+// encoding, so sstables with a non-classic filter record its type in
+// Scylla.db.
+enum class filter_type : uint32_t {
+    classic = 0,
+    blocked = 1,
+};
+
+struct filter_type_metadata {
+    uint32_t type;
+
+    template <typename Describer>
+    auto describe_type(Describer f) { return f(type); }
+};
+
+// Algorithm used for the checksums of compressed chunks, and for the full
+// checksum of the data file recorded in Digest.db. Sstables which don't
+// record one in Scylla.db use adler32.
+enum class checksum_type : uint32_t {
+    adler32 = 0,
+    crc32c = 1,
+};
+
+struct checksum_type_metadata {
+    uint32_t type;
+
+    template <typename Describer>
+    auto describe_type(Describer f) { return f(type); }
 };
 
+// Identifies the sstable run the sstable belongs to. A run is a set of
+// sstables with disjoint token ranges, written by the same compaction.
+struct run_identifier_metadata {
+    int64_t msb;
+    int64_t lsb;
+
+    template <typename Describer>
+    auto describe_type(Describer f) { return f(msb, lsb); }
+};
+
+// Describes the chunks of a compressed Index.db, as CompressionInfo.db
+// describes those of Data.db: offsets has the position in the file of each
+// chunk of chunk_len bytes of index entries. The positions the Summary
+// points to are in the uncompressed entries.
+struct index_compression_metadata {
+    disk_string<uint16_t> name;
+    disk_array<uint32_t, option> options;
+    uint32_t chunk_len;
+    uint64_t data_len;
+    disk_array<uint32_t, uint64_t> offsets;
+
+    template <typename Describer>
+    auto describe_type(Describer f) { return f(name, options, chunk_len, data_len, offsets); }
+};
 
 enum class scylla_metadata_type : uint32_t {
     Sharding = 1,
+    FilterType = 2,
+    ChecksumType = 3,
+    RunIdentifier = 4,
+    IndexCompression = 5,
 };
 
 struct scylla_metadata {
     disk_set_of_tagged_union<scylla_metadata_type,
-            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::Sharding, sharding_metadata>
+            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::Sharding, sharding_metadata>,
+            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::FilterType, filter_type_metadata>,
+            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::ChecksumType, checksum_type_metadata>,
+            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::RunIdentifier, run_identifier_metadata>,
+            disk_tagged_union_member<scylla_metadata_type, scylla_metadata_type::IndexCompression, index_compression_metadata>
             > data;
 
     template <typename Describer>
@@ -414,5 +584,74 @@ inline column_mask operator&(column_mask m1, column_mask m2) {
 inline column_mask operator|(column_mask m1, column_mask m2) {
     return column_mask(static_cast<uint8_t>(m1) | static_cast<uint8_t>(m2));
 }
+
+// Flags of the sa format. Each unfiltered (row or range tombstone marker)
+// in the data file starts with unfiltered_flags_m, optionally followed by
+// unfiltered_extended_flags_m, and each cell starts with column_flags_m.
+enum class unfiltered_flags_m : uint8_t {
+    none = 0x00,
+    end_of_partition = 0x01,
+    is_marker = 0x02,
+    has_timestamp = 0x04,
+    has_ttl = 0x08,
+    has_deletion = 0x10,
+    has_all_columns = 0x20,
+    has_complex_deletion = 0x40,
+    extension_flag = 0x80,
+};
+
+enum class unfiltered_extended_flags_m : uint8_t {
+    none = 0x00,
+    is_static = 0x01,
+    has_shadowable_deletion = 0x02,
+};
+
+enum class column_flags_m : uint8_t {
+    none = 0x00,
+    is_deleted = 0x01,
+    is_expiring = 0x02,
+    has_empty_value = 0x04,
+    use_row_timestamp = 0x08,
+    use_row_ttl = 0x10,
+};
+
+// Kinds of clustering prefixes of range tombstone markers in the sa format,
+// numbered after Cassandra's ClusteringPrefix.Kind.
+enum class bound_kind_m : uint8_t {
+    excl_end = 0,
+    incl_start = 1,
+    excl_end_incl_start = 2,
+    static_clustering = 3,
+    clustering = 4,
+    incl_end_excl_start = 5,
+    incl_end = 6,
+    excl_start = 7,
+};
+
+// TTL with which the sa format encodes the liveness of a row whose marker was
+// deleted; the local deletion time then is the marker's deletion time.
+static constexpr int32_t expired_liveness_ttl = std::numeric_limits<int32_t>::max();
+
+template <typename T>
+struct is_flags_m : std::false_type {};
+template <> struct is_flags_m<unfiltered_flags_m> : std::true_type {};
+template <> struct is_flags_m<unfiltered_extended_flags_m> : std::true_type {};
+template <> struct is_flags_m<column_flags_m> : std::true_type {};
+
+template <typename Flags>
+inline std::enable_if_t<is_flags_m<Flags>::value, Flags> operator&(Flags f1, Flags f2) {
+    return Flags(static_cast<uint8_t>(f1) & static_cast<uint8_t>(f2));
+}
+
+template <typename Flags>
+inline std::enable_if_t<is_flags_m<Flags>::value, Flags> operator|(Flags f1, Flags f2) {
+    return Flags(static_cast<uint8_t>(f1) | static_cast<uint8_t>(f2));
+}
+
+template <typename Flags>
+inline std::enable_if_t<is_flags_m<Flags>::value, bool> has_flag(Flags flags, Flags f) {
+    return (flags & f) != Flags::none;
+}
+
 }
 
@@ -23,6 +23,8 @@
 
 #include "core/iostream.hh"
 #include "core/fstream.hh"
+#include "core/future-util.hh"
+#include "core/reactor.hh"
 #include "types.hh"
 #include "compress.hh"
 #include <seastar/core/byteorder.hh>
@@ -189,48 +191,77 @@ output_stream<char> make_checksummed_file_output_stream(file f, struct checksum&
 // compressed_file_data_sink_impl works as a filter for a file output stream,
 // where the buffer flushed will be compressed and its checksum computed, then
 // the result passed to a regular output stream.
+//
+// Chunks are compressed in the background, in order, a piece at a time with
+// a preemption check between the pieces. put() only waits for the previous
+// chunk, so chunk N+1 is filled while chunk N is compressed and the file
+// stream writes chunk N-1 behind.
 class compressed_file_data_sink_impl : public data_sink_impl {
     output_stream<char> _out;
     sstables::compression* _compression_metadata;
+    std::unique_ptr<sstables::chunk_compressor> _compressor;
     size_t _pos = 0;
-public:
-    compressed_file_data_sink_impl(file f, sstables::compression* cm, file_output_stream_options options)
-            : _out(make_file_output_stream(std::move(f), options))
-            , _compression_metadata(cm) {}
-
-    future<> put(net::packet data) { abort(); }
-    virtual future<> put(temporary_buffer<char> buf) override {
+    // Compression and write of the last chunk put.
+    future<> _pending = make_ready_future<>();
+private:
+    future<> compress_and_write(temporary_buffer<char> buf) {
         auto output_len = _compression_metadata->compress_max_size(buf.size());
         // account space for checksum that goes after compressed data.
         temporary_buffer<char> compressed(output_len + 4);
+        _compressor->start(buf.get(), buf.size(), compressed.get_write(), output_len);
+        return repeat([this] {
+            if (_compressor->step()) {
+                return make_ready_future<stop_iteration>(stop_iteration::yes);
+            }
+            if (need_preempt()) {
+                return later().then([] { return stop_iteration::no; });
+            }
+            return make_ready_future<stop_iteration>(stop_iteration::no);
+        }).then([this, buf = std::move(buf), compressed = std::move(compressed), output_len] () mutable {
+            auto len = _compressor->compressed_size();
+            if (len > output_len) {
+                throw std::runtime_error("possible overflow during compression");
+            }
 
-        // compress flushed data.
-        auto len = _compression_metadata->compress(buf.get(), buf.size(), compressed.get_write(), output_len);
-        if (len > output_len) {
-            throw std::runtime_error("possible overflow during compression");
-        }
+            _compression_metadata->offsets.elements.push_back(_pos);
+            // account compressed data + 32-bit checksum.
+            _pos += len + 4;
+            _compression_metadata->set_compressed_file_length(_pos);
+            // total length of the uncompressed data.
+            _compression_metadata->data_len += buf.size();
 
-        _compression_metadata->offsets.elements.push_back(_pos);
-        // account compressed data + 32-bit checksum.
-        _pos += len + 4;
-        _compression_metadata->set_compressed_file_length(_pos);
-        // total length of the uncompressed data.
-        _compression_metadata->data_len += buf.size();
+            // compute 32-bit checksum for compressed data.
+            uint32_t per_chunk_checksum = _compression_metadata->chunk_checksum(compressed.get(), len);
+            _compression_metadata->update_full_checksum(per_chunk_checksum, compressed.get(), len);
 
-        // compute 32-bit checksum for compressed data.
-        uint32_t per_chunk_checksum = checksum_adler32(compressed.get(), len);
-        _compression_metadata->update_full_checksum(per_chunk_checksum, len);
+            // write checksum into buffer after compressed data.
+            write_be<uint32_t>(compressed.get_write() + len, per_chunk_checksum);
 
-        // write checksum into buffer after compressed data.
-        write_be<uint32_t>(compressed.get_write() + len, per_chunk_checksum);
+            compressed.trim(len + 4);
 
-        compressed.trim(len + 4);
+            auto f = _out.write(compressed.get(), compressed.size());
+            return f.then([compressed = std::move(compressed)] {});
+        });
+    }
+public:
+    compressed_file_data_sink_impl(file f, sstables::compression* cm, file_output_stream_options options)
+            : _out(make_file_output_stream(std::move(f), options))
+            , _compression_metadata(cm)
+            , _compressor(cm->make_chunk_compressor()) {}
 
-        auto f = _out.write(compressed.get(), compressed.size());
-        return f.then([compressed = std::move(compressed)] {});
+    future<> put(net::packet data) { abort(); }
+    virtual future<> put(temporary_buffer<char> buf) override {
+        return std::exchange(_pending, make_ready_future<>()).then([this, buf = std::move(buf)] () mutable {
+            _pending = compress_and_write(std::move(buf));
+        });
+    }
+    virtual future<> flush() override {
+        return std::exchange(_pending, make_ready_future<>());
     }
     virtual future<> close() {
-        return _out.close();
+        return std::exchange(_pending, make_ready_future<>()).finally([this] {
+            return _out.close();
+        });
     }
 };
 
@@ -55,20 +55,66 @@ std::ostream& operator<<(std::ostream& out, const position_range& range) {
     return out << "{" << range.start() << ", " << range.end() << "}";
 }
 
+namespace {
+
+// Free blocks for the data of mutation fragments, up to a limit.
+class fragment_data_pool {
+    static constexpr size_t max_free = 1024;
+    std::vector<void*> _free;
+public:
+    fragment_data_pool() {
+        _free.reserve(max_free);
+    }
+    ~fragment_data_pool() {
+        for (auto p : _free) {
+            ::operator delete(p);
+        }
+    }
+    void* allocate(size_t size) {
+        if (_free.empty()) {
+            return ::operator new(size);
+        }
+        auto p = _free.back();
+        _free.pop_back();
+        return p;
+    }
+    void deallocate(void* p) noexcept {
+        if (_free.size() < max_free) {
+            _free.push_back(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+};
+
+thread_local fragment_data_pool fragment_data_pool_instance;
+
+}
+
+std::unique_ptr<mutation_fragment::data, mutation_fragment::data_deleter> mutation_fragment::make_data() {
+    auto p = fragment_data_pool_instance.allocate(sizeof(data));
+    return std::unique_ptr<data, data_deleter>(new (p) data());
+}
+
+void mutation_fragment::data_deleter::operator()(data* d) const noexcept {
+    d->~data();
+    fragment_data_pool_instance.deallocate(d);
+}
+
 mutation_fragment::mutation_fragment(static_row&& r)
-    : _kind(kind::static_row), _data(std::make_unique<data>())
+    : _kind(kind::static_row), _data(make_data())
 {
     new (&_data->_static_row) static_row(std::move(r));
 }
 
 mutation_fragment::mutation_fragment(clustering_row&& r)
-    : _kind(kind::clustering_row), _data(std::make_unique<data>())
+    : _kind(kind::clustering_row), _data(make_data())
 {
     new (&_data->_clustering_row) clustering_row(std::move(r));
 }
 
 mutation_fragment::mutation_fragment(range_tombstone&& r)
-    : _kind(kind::range_tombstone), _data(std::make_unique<data>())
+    : _kind(kind::range_tombstone), _data(make_data())
 {
     new (&_data->_range_tombstone) range_tombstone(std::move(r));
 }
@@ -503,9 +549,13 @@ mutation_fragment_opt range_tombstone_stream::get_next()
 }
 
 void range_tombstone_stream::forward_to(position_in_partition_view pos) {
-    _list.erase_where([this, &pos] (const range_tombstone& rt) {
-        return !_cmp(pos, rt.end_position());
-    });
+    // The tombstones are disjoint, so the ones which end before pos are a
+    // prefix of the list.
+    auto it = _list.begin();
+    while (it != _list.end() && !_cmp(pos, it->end_position())) {
+        ++it;
+    }
+    _list.erase(_list.begin(), it);
 }
 
 void range_tombstone_stream::apply(const range_tombstone_list& list, const query::clustering_range& range) {
@@ -170,9 +170,15 @@ class mutation_fragment {
             range_tombstone _range_tombstone;
         };
     };
+    // The data of fragments is recycled by a per-shard pool, since readers
+    // create and destroy fragments in quick succession.
+    struct data_deleter {
+        void operator()(data* d) const noexcept;
+    };
+    static std::unique_ptr<data, data_deleter> make_data();
 private:
     kind _kind;
-    std::unique_ptr<data> _data;
+    std::unique_ptr<data, data_deleter> _data;
 
     mutation_fragment() = default;
     explicit operator bool() const noexcept { return bool(_data); }
@@ -43,6 +43,7 @@
 #include "streaming/stream_session.hh"
 #include "streaming/session_info.hh"
 #include "streaming/progress_info.hh"
+#include "dht/i_partitioner.hh"
 
 namespace streaming {
 
@@ -53,6 +54,7 @@ class stream_event {
         STREAM_PREPARED,
         STREAM_COMPLETE,
         FILE_PROGRESS,
+        TABLE_COMPLETE,
     };
 
     type event_type;
@@ -94,4 +96,19 @@ struct session_prepared_event : public stream_event {
     }
 };
 
+// The ranges of a table sent by the peer were received and written.
+struct table_complete_event : public stream_event {
+    using UUID = utils::UUID;
+    using inet_address = gms::inet_address;
+    inet_address peer;
+    UUID cf_id;
+    dht::token_range_vector ranges;
+    table_complete_event(UUID plan_id_, inet_address peer_, UUID cf_id_, dht::token_range_vector ranges_)
+        : stream_event(stream_event::type::TABLE_COMPLETE, plan_id_)
+        , peer(peer_)
+        , cf_id(cf_id_)
+        , ranges(std::move(ranges_)) {
+    }
+};
+
 } // namespace streaming
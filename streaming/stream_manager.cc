@@ -42,6 +42,7 @@
 #include "log.hh"
 #include "streaming/stream_session_state.hh"
 #include <seastar/core/metrics.hh>
+#include "utils/task_group.hh"
 
 namespace streaming {
 
@@ -50,7 +51,8 @@ extern logging::logger sslog;
 distributed<stream_manager> _the_stream_manager;
 
 
-stream_manager::stream_manager() {
+stream_manager::stream_manager(uint64_t send_rate)
+    : _send_rate_limiter(send_rate) {
     namespace sm = seastar::metrics;
 
     _metrics.add_group("streaming", {
@@ -60,6 +62,14 @@ stream_manager::stream_manager() {
         sm::make_derive("total_outgoing_bytes", [this] { return get_progress_on_local_shard().bytes_sent; },
                         sm::description("This is a sent bytes rate.")),
     });
+    // The sends waiting for one of the slots of the limiter.
+    utils::set_task_group_queue_length(utils::task_group::streaming, [this] { return _mutation_send_limiter.waiters(); });
+}
+
+future<> stream_manager::stop() {
+    utils::set_task_group_queue_length(utils::task_group::streaming, {});
+    fail_all_sessions();
+    return make_ready_future<>();
 }
 
 void stream_manager::register_sending(shared_ptr<stream_result_future> result) {
@@ -41,6 +41,7 @@
 #include "core/shared_ptr.hh"
 #include "core/distributed.hh"
 #include "utils/UUID.hh"
+#include "utils/rate_limiter.hh"
 #include "gms/i_endpoint_state_change_subscriber.hh"
 #include "gms/inet_address.hh"
 #include "gms/endpoint_state.hh"
@@ -95,12 +96,18 @@ class stream_manager : public gms::i_endpoint_state_change_subscriber, public en
     std::unordered_map<UUID, shared_ptr<stream_result_future>> _receiving_streams;
     std::unordered_map<UUID, std::unordered_map<gms::inet_address, stream_bytes>> _stream_bytes;
     semaphore _mutation_send_limiter{256};
+    // Bytes per second sent over the network by all the outgoing streams of
+    // this shard. Disk I/O is limited separately, by the streaming bandwidth
+    // limiter of the priority_manager.
+    utils::token_bucket_rate_limiter _send_rate_limiter;
     seastar::metrics::metric_groups _metrics;
 
 public:
-    stream_manager();
+    // At most send_rate bytes per second are sent, 0 meaning unthrottled.
+    explicit stream_manager(uint64_t send_rate = 0);
 
     semaphore& mutation_send_limiter() { return _mutation_send_limiter; }
+    utils::token_bucket_rate_limiter& send_rate_limiter() { return _send_rate_limiter; }
 
     void register_sending(shared_ptr<stream_result_future> result);
 
@@ -125,10 +132,7 @@ class stream_manager : public gms::i_endpoint_state_change_subscriber, public en
 
     void show_streams();
 
-    future<> stop() {
-        fail_all_sessions();
-        return make_ready_future<>();
-    }
+    future<> stop();
 
     void update_progress(UUID cf_id, gms::inet_address peer, progress_info::direction dir, size_t fm_size);
     future<> update_all_progress_info();
@@ -66,6 +66,13 @@ stream_plan& stream_plan::transfer_ranges(inet_address to, sstring keyspace, dht
     return *this;
 }
 
+stream_plan& stream_plan::transfer_sstables(inet_address to, sstring keyspace, sstring column_family, dht::token_range_vector ranges, external_sstables source) {
+    _range_added = true;
+    auto session = _coordinator->get_or_create_session(to);
+    session->add_transfer_sstables(std::move(keyspace), std::move(column_family), std::move(ranges), std::move(source));
+    return *this;
+}
+
 future<stream_state> stream_plan::execute() {
     sslog.debug("[Stream #{}] Executing stream_plan description={} range_added={}", _plan_id, _description, _range_added);
     if (!_range_added) {
@@ -127,6 +127,19 @@ class stream_plan {
      */
     stream_plan& transfer_ranges(inet_address to, sstring keyspace, dht::token_range_vector ranges, std::vector<sstring> column_families);
 
+    /**
+     * Add transfer task to send the data of sstables which are not part of
+     * {@code column_family}, in {@code ranges}, to its replica {@code to}.
+     *
+     * @param to endpoint address of receiver
+     * @param keyspace name of keyspace
+     * @param column_family the column family the data belongs to
+     * @param ranges ranges to send
+     * @param source the sstables to read the data from
+     * @return this object for chaining
+     */
+    stream_plan& transfer_sstables(inet_address to, sstring keyspace, sstring column_family, dht::token_range_vector ranges, external_sstables source);
+
     stream_plan& listeners(std::vector<stream_event_handler*> handlers);
 public:
     /**
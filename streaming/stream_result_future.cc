@@ -153,4 +153,8 @@ void stream_result_future::handle_progress(progress_info progress) {
     fire_stream_event(progress_event(plan_id, std::move(progress)));
 }
 
+void stream_result_future::handle_table_complete(inet_address peer, UUID cf_id, dht::token_range_vector ranges) {
+    fire_stream_event(table_complete_event(plan_id, peer, cf_id, std::move(ranges)));
+}
+
 } // namespace streaming
@@ -124,6 +124,8 @@ class stream_result_future {
 
     void handle_progress(progress_info progress);
 
+    void handle_table_complete(inet_address peer, UUID cf_id, dht::token_range_vector ranges);
+
     template <typename Event>
     void fire_stream_event(Event event);
 
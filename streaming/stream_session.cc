@@ -58,6 +58,11 @@
 #include "service/priority_manager.hh"
 #include "query-request.hh"
 #include "schema_registry.hh"
+#include "sstables/remove.hh"
+#include "core/fstream.hh"
+#include "checked-file-impl.hh"
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include "utils/task_group.hh"
 
 namespace streaming {
 
@@ -130,7 +135,9 @@ void stream_session::init_messaging_service_handler() {
                                plan_id, from.addr, cf_id);
                     return make_ready_future<>();
                 }
-                return service::get_storage_proxy().local().mutate_streaming_mutation(std::move(s), plan_id, fm, fragmented).then_wrapped([plan_id, cf_id, from] (auto&& f) {
+                return utils::run_in_task_group(utils::task_group::streaming, [s = std::move(s), plan_id, &fm, fragmented] {
+                    return service::get_storage_proxy().local().mutate_streaming_mutation(s, plan_id, fm, fragmented);
+                }).then_wrapped([plan_id, cf_id, from] (auto&& f) {
                     try {
                         f.get();
                         return make_ready_future<>();
@@ -146,32 +153,48 @@ void stream_session::init_messaging_service_handler() {
             });
         });
     });
+    ms().register_stream_sstable_file([] (const rpc::client_info& cinfo, UUID plan_id, UUID cf_id, int64_t sstable_id,
+            sstring version, sstring format, sstring component, uint64_t offset, bytes data, unsigned dst_cpu_id) {
+        const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
+        return smp::submit_to(dst_cpu_id, [plan_id, cf_id, sstable_id, version = std::move(version), format = std::move(format),
+                component = std::move(component), offset, data = std::move(data), from] () mutable {
+            auto session = get_session(plan_id, from, "STREAM_SSTABLE_FILE", cf_id);
+            get_local_stream_manager().update_progress(plan_id, from, progress_info::direction::IN, data.size());
+            return session->receive_sstable_file(cf_id, sstable_id, std::move(version), std::move(format),
+                    std::move(component), offset, std::move(data)).finally([session] {});
+        });
+    });
     ms().register_stream_mutation_done([] (const rpc::client_info& cinfo, UUID plan_id, dht::token_range_vector ranges, UUID cf_id, unsigned dst_cpu_id) {
         const auto& from = cinfo.retrieve_auxiliary<gms::inet_address>("baddr");
         return smp::submit_to(dst_cpu_id, [ranges = std::move(ranges), plan_id, cf_id, from] () mutable {
             auto session = get_session(plan_id, from, "STREAM_MUTATION_DONE", cf_id);
-            return session->get_db().invoke_on_all([ranges = std::move(ranges), plan_id, from, cf_id] (database& db) {
-                if (!db.column_family_exists(cf_id)) {
-                    sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
-                                plan_id, from, cf_id);
-                    return make_ready_future<>();
-                }
-                dht::partition_range_vector query_ranges;
-                try {
-                    auto& cf = db.find_column_family(cf_id);
-                    query_ranges.reserve(ranges.size());
-                    for (auto& range : ranges) {
-                        query_ranges.push_back(dht::to_partition_range(range));
+            return session->load_received_sstables(cf_id).then([session, ranges, plan_id, from, cf_id] () mutable {
+                return session->get_db().invoke_on_all([ranges = std::move(ranges), plan_id, from, cf_id] (database& db) {
+                    if (!db.column_family_exists(cf_id)) {
+                        sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
+                                    plan_id, from, cf_id);
+                        return make_ready_future<>();
                     }
-                    return cf.flush_streaming_mutations(plan_id, std::move(query_ranges));
-                } catch (no_such_column_family) {
-                    sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
-                                plan_id, from, cf_id);
-                    return make_ready_future<>();
-                } catch (...) {
-                    throw;
+                    dht::partition_range_vector query_ranges;
+                    try {
+                        auto& cf = db.find_column_family(cf_id);
+                        query_ranges.reserve(ranges.size());
+                        for (auto& range : ranges) {
+                            query_ranges.push_back(dht::to_partition_range(range));
+                        }
+                        return cf.flush_streaming_mutations(plan_id, std::move(query_ranges));
+                    } catch (no_such_column_family) {
+                        sslog.warn("[Stream #{}] STREAM_MUTATION_DONE from {}: cf_id={} is missing, assume the table is dropped",
+                                    plan_id, from, cf_id);
+                        return make_ready_future<>();
+                    } catch (...) {
+                        throw;
+                    }
+                });
+            }).then([session, ranges = std::move(ranges), plan_id, from, cf_id] () mutable {
+                if (auto sr = get_stream_result_future(plan_id)) {
+                    sr->handle_table_complete(from, cf_id, std::move(ranges));
                 }
-            }).then([session, cf_id] {
                 session->receive_task_completed(cf_id);
             });
         });
@@ -201,7 +224,8 @@ future<> stream_session::init_streaming_service(distributed<database>& db) {
     // engine().at_exit([] {
     //     return get_stream_manager().stop();
     // });
-    return get_stream_manager().start().then([] {
+    auto send_rate = uint64_t(db.local().get_config().streaming_throughput_mb_per_sec()) * 1024 * 1024 / smp::count;
+    return get_stream_manager().start(send_rate).then([] {
         gms::get_local_gossiper().register_(get_local_stream_manager().shared_from_this());
         return _db->invoke_on_all([] (auto& db) {
             init_messaging_service_handler();
@@ -430,15 +454,168 @@ void stream_session::add_transfer_ranges(sstring keyspace, dht::token_range_vect
     }
 }
 
+void stream_session::add_transfer_sstables(sstring keyspace, sstring column_family, dht::token_range_vector ranges, external_sstables source) {
+    auto cf_id = get_local_db().find_column_family(keyspace, column_family).schema()->id();
+    // The data of a column family has a single source in a session.
+    if (_transfers.count(cf_id)) {
+        throw std::runtime_error(sprint("[Stream #%s] %s.%s is already transferred", plan_id(), keyspace, column_family));
+    }
+    _transfers.emplace(cf_id, stream_transfer_task(shared_from_this(), cf_id, std::move(ranges), 0, std::move(source)));
+}
+
 future<> stream_session::receiving_failed(UUID cf_id)
 {
-    return get_db().invoke_on_all([cf_id, plan_id = plan_id()] (database& db) {
-        try {
-            auto& cf = db.find_column_family(cf_id);
-            return cf.fail_streaming_mutations(plan_id);
-        } catch (no_such_column_family) {
+    return discard_received_sstables(cf_id).then([cf_id, plan_id = plan_id()] {
+        return get_db().invoke_on_all([cf_id, plan_id] (database& db) {
+            try {
+                auto& cf = db.find_column_family(cf_id);
+                return cf.fail_streaming_mutations(plan_id);
+            } catch (no_such_column_family) {
+                return make_ready_future<>();
+            }
+        });
+    });
+}
+
+// Sstables streamed as whole files are staged here until the transfer of
+// their column family is done. Nothing in this directory is ever loaded on
+// its own.
+static sstring sstable_staging_dir(const column_family& cf) {
+    return cf.dir() + "/streaming";
+}
+
+future<> stream_session::receive_sstable_file(UUID cf_id, int64_t sstable_id, sstring version, sstring format,
+        sstring component, uint64_t offset, bytes data) {
+    auto& cf = get_local_db().find_column_family(cf_id);
+    auto& sstables = _incoming_sstables[cf_id];
+    auto it = sstables.find(sstable_id);
+    if (it == sstables.end()) {
+        auto in = make_lw_shared<incoming_sstable>();
+        in->generation = cf.calculate_generation_for_new_table();
+        in->version = sstables::sstable::version_from_sstring(version);
+        in->format = sstables::sstable::format_from_sstring(format);
+        it = sstables.emplace(sstable_id, std::move(in)).first;
+    }
+    auto in = it->second;
+    auto schema = cf.schema();
+    auto dir = sstable_staging_dir(cf);
+    return with_semaphore(in->sem, 1, [this, in, schema, dir = std::move(dir), component = std::move(component), offset, data = std::move(data)] () mutable {
+        if (in->out && in->component == component) {
+            auto written = in->out->offset();
+            if (offset + data.size() <= written) {
+                // A retry of a chunk we already have.
+                return make_ready_future<>();
+            }
+            if (offset != written) {
+                throw std::runtime_error(sprint("[Stream #%s] STREAM_SSTABLE_FILE: unexpected offset %d of %s, expected %d",
+                        plan_id(), offset, component, written));
+            }
+            return in->out->write(data);
+        }
+        if (boost::algorithm::any_of_equal(in->files, component)) {
             return make_ready_future<>();
         }
+        if (offset != 0) {
+            throw std::runtime_error(sprint("[Stream #%s] STREAM_SSTABLE_FILE: %s does not start at offset 0", plan_id(), component));
+        }
+        auto f = make_ready_future<>();
+        if (in->out) {
+            f = in->out->close().then([in] {
+                in->out = {};
+            });
+        }
+        return f.then([dir] {
+            return io_check(touch_directory, dir);
+        }).then([in, schema, dir, component] {
+            auto name = sstables::sstable::filename(dir, schema->ks_name(), schema->cf_name(), in->version, in->generation, in->format, component);
+            in->files.push_back(component);
+            return open_checked_file_dma(sstable_write_error_handler, std::move(name),
+                    open_flags::wo | open_flags::create | open_flags::truncate);
+        }).then([in, component, data = std::move(data)] (file f) mutable {
+            file_output_stream_options options;
+            options.buffer_size = 128 * 1024;
+            options.io_priority_class = service::get_local_streaming_write_priority();
+            in->component = std::move(component);
+            in->out = sstables::file_writer(std::move(f), std::move(options));
+            return in->out->write(data);
+        });
+    });
+}
+
+future<> stream_session::load_received_sstables(UUID cf_id) {
+    auto it = _incoming_sstables.find(cf_id);
+    if (it == _incoming_sstables.end()) {
+        return make_ready_future<>();
+    }
+    auto incoming = std::move(it->second);
+    _incoming_sstables.erase(it);
+    if (!get_local_db().column_family_exists(cf_id)) {
+        return make_ready_future<>();
+    }
+    auto& cf = get_local_db().find_column_family(cf_id);
+    auto schema = cf.schema();
+    auto dir = sstable_staging_dir(cf);
+    auto datadir = cf.dir();
+    sslog.debug("[Stream #{}] Loading {} sstables received as files, cf_id={}", plan_id(), incoming.size(), cf_id);
+    return do_with(std::move(incoming), std::vector<sstables::entry_descriptor>(), [schema, dir, datadir] (auto& incoming, auto& descriptors) {
+        return do_for_each(incoming, [schema, dir, datadir, &descriptors] (auto& p) {
+            auto in = p.second;
+            return with_semaphore(in->sem, 1, [in] {
+                return in->out ? in->out->close() : make_ready_future<>();
+            }).then([in, schema, dir, datadir, &descriptors] {
+                auto sst = make_lw_shared<sstables::sstable>(schema, dir, in->generation, in->version, in->format);
+                // The new generation is unique in the column family, so the
+                // sstable can be linked under it.
+                return sst->read_toc().then([sst, datadir] {
+                    return sst->create_links(datadir);
+                }).then([sst] {
+                    return sstables::remove_by_toc_name(sst->toc_filename());
+                }).then([in, schema, &descriptors] {
+                    descriptors.emplace_back(schema->ks_name(), schema->cf_name(), in->version, in->generation, in->format,
+                            sstables::sstable::component_type::TOC);
+                });
+            });
+        }).then([schema, &descriptors] {
+            if (descriptors.empty()) {
+                return make_ready_future<>();
+            }
+            // Also drops the cache of the column family, which may be stale.
+            return distributed_loader::load_new_sstables(get_db(), schema->ks_name(), schema->cf_name(), std::move(descriptors));
+        });
+    });
+}
+
+future<> stream_session::discard_received_sstables(UUID cf_id) {
+    auto it = _incoming_sstables.find(cf_id);
+    if (it == _incoming_sstables.end()) {
+        return make_ready_future<>();
+    }
+    auto incoming = std::move(it->second);
+    _incoming_sstables.erase(it);
+    schema_ptr schema;
+    sstring dir;
+    try {
+        auto& cf = get_local_db().find_column_family(cf_id);
+        schema = cf.schema();
+        dir = sstable_staging_dir(cf);
+    } catch (no_such_column_family) {
+        // The staging directory went away with the table.
+        return make_ready_future<>();
+    }
+    return do_with(std::move(incoming), [schema, dir] (auto& incoming) {
+        return parallel_for_each(incoming, [schema, dir] (auto& p) {
+            auto in = p.second;
+            return with_semaphore(in->sem, 1, [in] {
+                return in->out ? in->out->close() : make_ready_future<>();
+            }).then([in, schema, dir] {
+                return parallel_for_each(in->files, [in, schema, dir] (const sstring& component) {
+                    auto name = sstables::sstable::filename(dir, schema->ks_name(), schema->cf_name(), in->version, in->generation, in->format, component);
+                    return sstable_io_check(sstable_write_error_handler, remove_file, std::move(name));
+                });
+            });
+        });
+    }).handle_exception([plan_id = plan_id(), cf_id] (auto ep) {
+        sslog.warn("[Stream #{}] Failed to remove sstables received as files, cf_id={}: {}", plan_id, cf_id, ep);
     });
 }
 
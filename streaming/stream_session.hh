@@ -52,6 +52,7 @@
 #include "streaming/stream_manager.hh"
 #include "streaming/session_info.hh"
 #include "sstables/sstables.hh"
+#include "sstables/writer.hh"
 #include "query-request.hh"
 #include "dht/i_partitioner.hh"
 #include <map>
@@ -184,6 +185,23 @@ class stream_session : public enable_shared_from_this<stream_session> {
     lowres_clock::time_point _last_stream_progress;
 
     session_info _session_info;
+
+    // An sstable streamed to us as whole component files. It is written to
+    // the staging directory of its column family, and loaded when the
+    // transfer of the column family is done.
+    struct incoming_sstable {
+        int64_t generation;
+        sstables::sstable::version_types version;
+        sstables::sstable::format_types format;
+        // Component files are received one after another.
+        sstring component;
+        std::experimental::optional<sstables::file_writer> out;
+        std::vector<sstring> files;
+        // Serializes retried chunks with the original ones.
+        semaphore sem{1};
+    };
+    // By column family, and by generation of the sstable on the sender.
+    std::unordered_map<UUID, std::map<int64_t, lw_shared_ptr<incoming_sstable>>> _incoming_sstables;
 public:
     void start_keep_alive_timer() {
         _keep_alive.rearm(lowres_clock::now() + _keep_alive_interval);
@@ -255,6 +273,12 @@ class stream_session : public enable_shared_from_this<stream_session> {
      */
     void add_transfer_ranges(sstring keyspace, dht::token_range_vector ranges, std::vector<sstring> column_families);
 
+    /**
+     * Set up transfer of the data of the given external sstables, in the given
+     * ranges, to the column family.
+     */
+    void add_transfer_sstables(sstring keyspace, sstring column_family, dht::token_range_vector ranges, external_sstables source);
+
     std::vector<column_family*> get_column_family_stores(const sstring& keyspace, const std::vector<sstring>& column_families);
 
     void close_session(stream_session_state final_state);
@@ -331,6 +355,14 @@ class stream_session : public enable_shared_from_this<stream_session> {
 
     future<> update_progress();
 
+    // Writes a chunk of a component of an sstable streamed as whole files.
+    future<> receive_sstable_file(UUID cf_id, int64_t sstable_id, sstring version, sstring format,
+            sstring component, uint64_t offset, bytes data);
+
+    // Moves the sstables received as whole files into the column family
+    // directory and loads them on the shards which own them.
+    future<> load_received_sstables(UUID cf_id);
+
     void receive_task_completed(UUID cf_id);
     void transfer_task_completed(UUID cf_id);
 private:
@@ -339,6 +371,7 @@ class stream_session : public enable_shared_from_this<stream_session> {
     void prepare_receiving(stream_summary& summary);
     void start_streaming_files();
     future<> receiving_failed(UUID cf_id);
+    future<> discard_received_sstables(UUID cf_id);
 };
 
 } // namespace streaming
@@ -52,19 +52,64 @@
 #include "service/storage_service.hh"
 #include <boost/icl/interval.hpp>
 #include <boost/icl/interval_set.hpp>
+#include <boost/algorithm/cxx11/any_of.hpp>
+#include "utils/task_group.hh"
 
 namespace streaming {
 
 extern logging::logger sslog;
 
-stream_transfer_task::stream_transfer_task(shared_ptr<stream_session> session, UUID cf_id, dht::token_range_vector ranges, long total_size)
+stream_transfer_task::stream_transfer_task(shared_ptr<stream_session> session, UUID cf_id, dht::token_range_vector ranges, long total_size,
+        std::experimental::optional<external_sstables> source)
     : stream_task(session, cf_id)
     , _ranges(std::move(ranges))
-    , _total_size(total_size) {
+    , _total_size(total_size)
+    , _source(std::move(source)) {
+}
+
+future<lw_shared_ptr<sstables::sstable_set>> open_external_sstables(column_family& cf, const external_sstables& source) {
+    auto schema = cf.schema();
+    auto set = make_lw_shared(cf.get_compaction_strategy().make_sstable_set(schema));
+    return do_for_each(source.descriptors, [schema, set, &source] (const sstables::entry_descriptor& comps) {
+        auto sst = make_lw_shared<sstables::sstable>(schema, source.dir, comps.generation, comps.version, comps.format);
+        return sst->load().then([set, sst] {
+            set->insert(sst);
+        });
+    }).then([set] {
+        return set;
+    });
 }
 
 stream_transfer_task::~stream_transfer_task() = default;
 
+// Size of the chunks in which sstables streamed as whole files are sent.
+static constexpr size_t sstable_file_chunk_size = 128 * 1024;
+
+// An sstable can be streamed as is, instead of re-serializing its mutations,
+// when all of its data belongs to one of the streamed ranges. Shared sstables
+// are left to the mutation path, since they are also visible to other shards.
+static std::vector<sstables::shared_sstable>
+select_sstables_to_stream_as_files(database& db, column_family& cf, const dht::token_range_vector& ranges) {
+    std::vector<sstables::shared_sstable> ret;
+    // The receiver must know how to load them.
+    if (!db.get_config().stream_sstable_files() || !service::get_local_storage_service().cluster_supports_stream_sstable_files()) {
+        return ret;
+    }
+    for (auto& sst : *cf.get_sstables()) {
+        if (sst->is_shared()) {
+            continue;
+        }
+        auto sst_range = dht::token_range::make(sst->get_first_decorated_key().token(), sst->get_last_decorated_key().token());
+        auto contains_sstable = [&sst_range] (const dht::token_range& r) {
+            return r.contains(sst_range, dht::token_comparator());
+        };
+        if (boost::algorithm::any_of(ranges, contains_sstable)) {
+            ret.push_back(sst);
+        }
+    }
+    return ret;
+}
+
 struct send_info {
     database& db;
     utils::UUID plan_id;
@@ -75,10 +120,13 @@ struct send_info {
     size_t mutations_nr{0};
     semaphore mutations_done{0};
     bool error_logged = false;
+    // Streamed as whole files, and so excluded from the reader.
+    std::vector<sstables::shared_sstable> sstables;
     mutation_reader reader;
     send_info(database& db_, utils::UUID plan_id_, utils::UUID cf_id_,
               dht::partition_range_vector prs_, netw::messaging_service::msg_addr id_,
-              uint32_t dst_cpu_id_)
+              uint32_t dst_cpu_id_, const dht::token_range_vector& ranges,
+              lw_shared_ptr<sstables::sstable_set> external = {})
         : db(db_)
         , plan_id(plan_id_)
         , cf_id(cf_id_)
@@ -86,7 +134,14 @@ struct send_info {
         , id(id_)
         , dst_cpu_id(dst_cpu_id_) {
         auto& cf = db.find_column_family(this->cf_id);
-        reader = cf.make_streaming_reader(cf.schema(), this->prs);
+        if (external) {
+            // External sstables usually span the ranges of many replicas,
+            // so they are always split into mutations.
+            reader = cf.make_streaming_reader(cf.schema(), this->prs, std::move(external));
+            return;
+        }
+        sstables = select_sstables_to_stream_as_files(db, cf, ranges);
+        reader = cf.make_streaming_reader(cf.schema(), this->prs, sstables);
     }
 };
 
@@ -94,7 +149,9 @@ future<> do_send_mutations(lw_shared_ptr<send_info> si, frozen_mutation fm, bool
     return get_local_stream_manager().mutation_send_limiter().wait().then([si, fragmented, fm = std::move(fm)] () mutable {
         sslog.debug("[Stream #{}] SEND STREAM_MUTATION to {}, cf_id={}", si->plan_id, si->id, si->cf_id);
         auto fm_size = fm.representation().size();
-        netw::get_local_messaging_service().send_stream_mutation(si->id, si->plan_id, std::move(fm), si->dst_cpu_id, fragmented).then([si, fm_size] {
+        get_local_stream_manager().send_rate_limiter().reserve(fm_size).then([si, fragmented, fm = std::move(fm)] () mutable {
+            return netw::get_local_messaging_service().send_stream_mutation(si->id, si->plan_id, std::move(fm), si->dst_cpu_id, fragmented);
+        }).then([si, fm_size] {
             sslog.debug("[Stream #{}] GOT STREAM_MUTATION Reply from {}", si->plan_id, si->id.addr);
             get_local_stream_manager().update_progress(si->plan_id, si->id.addr, progress_info::direction::OUT, fm_size);
             si->mutations_done.signal();
@@ -116,7 +173,9 @@ future<> send_mutations(lw_shared_ptr<send_info> si) {
     return repeat([si] () {
         return si->reader().then([si] (auto smopt) {
             if (smopt && si->db.column_family_exists(si->cf_id)) {
-                size_t fragment_size = default_frozen_fragment_size;
+                // Large partitions are sent a bounded batch of fragments at a time, so that
+                // neither side ever holds more than a fragment of a partition per message.
+                size_t fragment_size = std::max<size_t>(1, si->db.get_config().stream_mutation_fragment_size_in_kb()) * 1024;
                 // Mutations cannot be sent fragmented if the receiving side doesn't support that.
                 if (!service::get_local_storage_service().cluster_supports_large_partitions()) {
                     fragment_size = std::numeric_limits<size_t>::max();
@@ -134,6 +193,59 @@ future<> send_mutations(lw_shared_ptr<send_info> si) {
     });
 }
 
+future<> send_sstable_component(lw_shared_ptr<send_info> si, sstables::shared_sstable sst, sstring component) {
+    return sst->open_component_file(component).then([si, sst, component = std::move(component)] (file f) {
+        file_input_stream_options options;
+        options.buffer_size = sstable_file_chunk_size;
+        options.read_ahead = 1;
+        options.io_priority_class = service::get_local_streaming_read_priority();
+        auto in = make_file_input_stream(std::move(f), 0, std::move(options));
+        return do_with(std::move(in), uint64_t(0), [si, sst, component] (input_stream<char>& in, uint64_t& offset) {
+            return repeat([si, sst, component, &in, &offset] {
+                return in.read_exactly(sstable_file_chunk_size).then([si, sst, component, &offset] (temporary_buffer<char> buf) {
+                    auto chunk_offset = offset;
+                    auto size = buf.size();
+                    offset += size;
+                    return get_local_stream_manager().mutation_send_limiter().wait().then([size] {
+                        return get_local_stream_manager().send_rate_limiter().reserve(size);
+                    }).then([si, sst, component, chunk_offset, buf = std::move(buf)] {
+                        sslog.debug("[Stream #{}] SEND STREAM_SSTABLE_FILE to {}, cf_id={}, sstable={}, component={}, offset={}",
+                                si->plan_id, si->id, si->cf_id, sst->generation(), component, chunk_offset);
+                        auto data = bytes(reinterpret_cast<const int8_t*>(buf.get()), buf.size());
+                        return netw::get_local_messaging_service().send_stream_sstable_file(si->id, si->plan_id, si->cf_id, sst->generation(),
+                                sstables::sstable::version_to_sstring(sst->get_version()), sstables::sstable::format_to_sstring(sst->get_format()),
+                                component, chunk_offset, std::move(data), si->dst_cpu_id);
+                    }).then([si, size] {
+                        get_local_stream_manager().update_progress(si->plan_id, si->id.addr, progress_info::direction::OUT, size);
+                        // A short read means we reached the end of the file. An
+                        // empty file is still sent, so that the receiver creates it.
+                        return size < sstable_file_chunk_size ? stop_iteration::yes : stop_iteration::no;
+                    }).finally([] {
+                        get_local_stream_manager().mutation_send_limiter().signal();
+                    });
+                });
+            }).finally([&in] {
+                return in.close();
+            });
+        });
+    });
+}
+
+// The receiver writes the components of each sstable one after another, so
+// they are sent sequentially.
+future<> send_sstables(lw_shared_ptr<send_info> si) {
+    return parallel_for_each(si->sstables, [si] (sstables::shared_sstable sst) {
+        return do_with(sst->all_components(), [si, sst] (auto& components) {
+            return do_for_each(components, [si, sst] (auto& component) {
+                return send_sstable_component(si, sst, component.second);
+            });
+        });
+    }).handle_exception([si] (auto ep) {
+        sslog.warn("[Stream #{}] stream_transfer_task: Fail to send STREAM_SSTABLE_FILE to {}: {}", si->plan_id, si->id, ep);
+        return make_exception_future<>(ep);
+    });
+}
+
 void stream_transfer_task::start() {
     auto plan_id = session->plan_id();
     auto cf_id = this->cf_id;
@@ -146,9 +258,20 @@ void stream_transfer_task::start() {
     parallel_for_each(_shard_ranges, [this, dst_cpu_id, plan_id, cf_id, id] (auto& item) {
         auto& shard = item.first;
         auto& prs = item.second;
-        return session->get_db().invoke_on(shard, [plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs)] (database& db) mutable {
-            auto si = make_lw_shared<send_info>(db, plan_id, cf_id, prs, id, dst_cpu_id);
-            return send_mutations(std::move(si));
+        return session->get_db().invoke_on(shard, [plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs), &ranges = _ranges, source = _source] (database& db) mutable {
+            auto opened = make_ready_future<lw_shared_ptr<sstables::sstable_set>>();
+            if (source) {
+                auto& cf = db.find_column_family(cf_id);
+                opened = do_with(std::move(*source), [&cf] (const external_sstables& source) {
+                    return open_external_sstables(cf, source);
+                });
+            }
+            return opened.then([&db, plan_id, cf_id, id, dst_cpu_id, prs = std::move(prs), &ranges] (lw_shared_ptr<sstables::sstable_set> external) mutable {
+                auto si = make_lw_shared<send_info>(db, plan_id, cf_id, std::move(prs), id, dst_cpu_id, ranges, std::move(external));
+                return utils::run_in_task_group(utils::task_group::streaming, [si] {
+                    return seastar::when_all_succeed(send_sstables(si), send_mutations(si));
+                });
+            });
         });
     }).then([this, plan_id, cf_id, id] {
         sslog.debug("[Stream #{}] SEND STREAM_MUTATION_DONE to {}, cf_id={}", plan_id, id, cf_id);
@@ -44,12 +44,25 @@
 #include "sstables/sstables.hh"
 #include <map>
 #include <seastar/core/semaphore.hh>
+#include <experimental/optional>
+
+class column_family;
 
 namespace streaming {
 
 class stream_session;
 class send_info;
 
+// Sstables which are not part of the column family, streamed instead of
+// its data, such as the ones imported with load-and-stream.
+struct external_sstables {
+    sstring dir;
+    std::vector<sstables::entry_descriptor> descriptors;
+};
+
+// Opens the external sstables on the current shard.
+future<lw_shared_ptr<sstables::sstable_set>> open_external_sstables(column_family& cf, const external_sstables& source);
+
 /**
  * StreamTransferTask sends sections of SSTable files in certain ColumnFamily.
  */
@@ -61,10 +74,12 @@ class stream_transfer_task : public stream_task {
     dht::token_range_vector _ranges;
     std::map<unsigned, dht::partition_range_vector> _shard_ranges;
     long _total_size;
+    std::experimental::optional<external_sstables> _source;
 public:
     using UUID = utils::UUID;
     stream_transfer_task(stream_transfer_task&&) = default;
-    stream_transfer_task(shared_ptr<stream_session> session, UUID cf_id, dht::token_range_vector ranges, long total_size = 0);
+    stream_transfer_task(shared_ptr<stream_session> session, UUID cf_id, dht::token_range_vector ranges, long total_size = 0,
+            std::experimental::optional<external_sstables> source = {});
     ~stream_transfer_task();
 public:
     virtual void abort() override {
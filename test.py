@@ -35,6 +35,7 @@ boost_tests = [
     'schema_registry_test',
     'range_test',
     'mutation_reader_test',
+    'flat_mutation_reader_test',
     'cql_query_test',
     'storage_proxy_test',
     'schema_change_test',
@@ -60,10 +61,14 @@ boost_tests = [
     'log_histogram_test',
     'crc_test',
     'flush_queue_test',
+    'loading_cache_test',
+    'task_group_test',
+    'rate_limiter_test',
     'config_test',
     'dynamic_bitset_test',
     'gossip_test',
     'managed_vector_test',
+    'bptree_test',
     'map_difference_test',
     'memtable_test',
     'mutation_query_test',
@@ -79,6 +84,11 @@ boost_tests = [
     'virtual_reader_test',
     'counter_test',
     'cell_locker_test',
+    'vint_serialization_test',
+    'top_k_test',
+    'frequency_sketch_test',
+    'interval_tree_test',
+    'latency_histogram_test',
 ]
 
 other_tests = [
@@ -23,6 +23,8 @@
 
 #include <boost/test/unit_test.hpp>
 #include <utility>
+#include <thread>
+#include <vector>
 #include "utils/UUID_gen.hh"
 
 BOOST_AUTO_TEST_CASE(test_generation_of_name_based_UUID) {
@@ -50,3 +52,26 @@ BOOST_AUTO_TEST_CASE(test_UUID_comparison) {
         BOOST_REQUIRE_GT(p.first, p.second);
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_time_UUIDs_of_different_threads_differ) {
+    auto generate = [] {
+        std::vector<UUID> uuids;
+        for (int i = 0; i < 1000; ++i) {
+            uuids.push_back(utils::UUID_gen::get_time_UUID());
+        }
+        return uuids;
+    };
+    auto mine = generate();
+    std::vector<UUID> theirs;
+    std::thread([&] { theirs = generate(); }).join();
+
+    for (auto&& uuids : { mine, theirs }) {
+        for (size_t i = 1; i < uuids.size(); ++i) {
+            BOOST_REQUIRE_EQUAL(uuids[i].version(), 1);
+            BOOST_REQUIRE_GT(uuids[i].timestamp(), uuids[i - 1].timestamp());
+            BOOST_REQUIRE_EQUAL(uuids[i].get_least_significant_bits(), uuids[0].get_least_significant_bits());
+        }
+    }
+    // Each thread has its own clock, so they must not share a node.
+    BOOST_REQUIRE_NE(mine[0].get_least_significant_bits(), theirs[0].get_least_significant_bits());
+}
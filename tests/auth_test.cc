@@ -195,6 +195,54 @@ SEASTAR_TEST_CASE(test_password_authenticator_operations) {
 }
 
 
+SEASTAR_TEST_CASE(test_password_authenticator_changed_password) {
+    db::config cfg;
+    cfg.authenticator = auth::password_authenticator::PASSWORD_AUTHENTICATOR_NAME;
+
+    return do_with_cql_env([](cql_test_env&) {
+        sstring username("fisk");
+        sstring password("notter");
+        sstring new_password("hejkotte");
+
+        using namespace auth;
+        using option = authenticator::option;
+        using user_ptr = ::shared_ptr<authenticated_user>;
+
+        auto USERNAME_KEY = authenticator::USERNAME_KEY;
+        auto PASSWORD_KEY = authenticator::PASSWORD_KEY;
+
+        auto authenticate = [=] (sstring password) {
+            return authenticator::get().authenticate({ { USERNAME_KEY, username }, { PASSWORD_KEY, password } });
+        };
+
+        // The verified password is remembered, but not past a change of it.
+        return authenticator::get().create(username, { { option::PASSWORD, password} }).then([=] {
+            return authenticate(password).then([=](user_ptr user) {
+                BOOST_REQUIRE_EQUAL(user->name(), username);
+            });
+        }).then([=] {
+            return authenticate(password).then([=](user_ptr user) {
+                BOOST_REQUIRE_EQUAL(user->name(), username);
+            });
+        }).then([=] {
+            return authenticator::get().alter(username, { { option::PASSWORD, new_password} });
+        }).then([=] {
+            return authenticate(password).then_wrapped([](future<user_ptr>&& f) {
+                try {
+                    f.get();
+                    BOOST_FAIL("should not reach");
+                } catch (exceptions::authentication_exception&) {
+                    // ok
+                }
+            });
+        }).then([=] {
+            return authenticate(new_password).then([=](user_ptr user) {
+                BOOST_REQUIRE_EQUAL(user->name(), username);
+            });
+        });
+    }, cfg);
+}
+
 SEASTAR_TEST_CASE(test_cassandra_hash) {
     db::config cfg;
     cfg.authenticator = auth::password_authenticator::PASSWORD_AUTHENTICATOR_NAME;
@@ -35,6 +35,7 @@
 #include "transport/messages/result_message.hh"
 #include "cql3/query_processor.hh"
 #include "db/batchlog_manager.hh"
+#include "db/config.hh"
 
 #include "disk-error-handler.hh"
 #include "message/messaging_service.hh"
@@ -84,3 +85,22 @@ SEASTAR_TEST_CASE(test_execute_batch) {
     });
 }
 
+
+SEASTAR_TEST_CASE(test_local_batchlog_writes) {
+    db::config cfg;
+    cfg.batchlog_local_writes(true);
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table cf (p1 varchar, c1 int, r1 int, PRIMARY KEY (p1, c1));").get();
+        e.execute_cql("begin batch "
+                "insert into cf (p1, c1, r1) values ('key1', 1, 100); "
+                "insert into cf (p1, c1, r1) values ('key2', 2, 200); "
+                "apply batch;").get();
+
+        assert_that(e.execute_cql("select r1 from cf where p1 = 'key1' and c1 = 1;").get0())
+            .is_rows().with_rows({{int32_type->decompose(100)}});
+        assert_that(e.execute_cql("select r1 from cf where p1 = 'key2' and c1 = 2;").get0())
+            .is_rows().with_rows({{int32_type->decompose(200)}});
+        // The entry is removed from the batchlog once the batch is applied.
+        BOOST_REQUIRE_EQUAL(db::get_batchlog_manager().local().count_all_batches().get0(), 0);
+    }, cfg);
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <limits>
+#include <random>
+#include <set>
+
+#include "utils/bptree.hh"
+#include "utils/logalloc.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+struct entry {
+    bplus::member_hook _link;
+    int _key;
+
+    explicit entry(int key) : _key(key) { }
+    entry(entry&& o) noexcept;
+
+    struct compare {
+        bool operator()(const entry& a, const entry& b) const { return a._key < b._key; }
+        bool operator()(const entry& a, int b) const { return a._key < b; }
+        bool operator()(int a, const entry& b) const { return a < b._key; }
+    };
+
+    // Coarse on purpose, so that some comparisons fall back to compare.
+    struct prefix {
+        uint64_t operator()(int key) const { return uint64_t(int64_t(key) - std::numeric_limits<int>::min()) >> 3; }
+        uint64_t operator()(const entry& e) const { return (*this)(e._key); }
+    };
+};
+
+// Small nodes, so that trees get a few levels deep.
+using tree_type = bplus::tree<entry, bplus::member_hook_of<entry, &entry::_link>, entry::compare, entry::prefix, 4>;
+
+entry::entry(entry&& o) noexcept
+    : _key(o._key)
+{
+    tree_type::replace(o, *this);
+}
+
+static void verify(const tree_type& t, const std::set<int>& expected) {
+    BOOST_REQUIRE_EQUAL(t.size(), expected.size());
+    auto i = expected.begin();
+    for (auto&& e : t) {
+        BOOST_REQUIRE(i != expected.end());
+        BOOST_REQUIRE_EQUAL(e._key, *i);
+        ++i;
+    }
+    BOOST_REQUIRE(i == expected.end());
+}
+
+template<typename Iterator>
+static void check_same(Iterator i, const tree_type& t, std::set<int>::const_iterator expected, const std::set<int>& s) {
+    BOOST_REQUIRE_EQUAL(i == t.end(), expected == s.end());
+    if (expected != s.end()) {
+        BOOST_REQUIRE_EQUAL(i->_key, *expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_lookups_and_updates_against_std_set) {
+    logalloc::region reg;
+    with_allocator(reg.allocator(), [&] {
+        std::default_random_engine rng;
+        std::uniform_int_distribution<int> key_dist(-500, 500);
+        std::uniform_int_distribution<int> op_dist(0, 9);
+
+        tree_type t;
+        std::set<int> expected;
+
+        for (int i = 0; i < 20000; ++i) {
+            auto key = key_dist(rng);
+            auto op = op_dist(rng);
+            if (op < 5) {
+                auto it = t.lower_bound(key);
+                check_same(it, t, expected.lower_bound(key), expected);
+                if (it == t.end() || it->_key != key) {
+                    auto e = current_allocator().construct<entry>(key);
+                    if (op % 2) {
+                        t.insert(it, *e);
+                    } else {
+                        t.insert(*e);
+                    }
+                    expected.insert(key);
+                }
+            } else if (op < 8) {
+                auto it = t.find(key);
+                BOOST_REQUIRE_EQUAL(it != t.end(), expected.count(key));
+                if (it != t.end()) {
+                    auto next = t.erase_and_dispose(it, current_deleter<entry>());
+                    check_same(next, t, expected.upper_bound(key), expected);
+                    expected.erase(key);
+                }
+            } else if (op < 9) {
+                check_same(t.upper_bound(key), t, expected.upper_bound(key), expected);
+            } else {
+                reg.full_compaction();
+            }
+            if (i % 1000 == 0) {
+                verify(t, expected);
+            }
+        }
+        verify(t, expected);
+
+        for (auto&& e : t) {
+            BOOST_REQUIRE(&*t.iterator_to(e) == &e);
+        }
+
+        while (!t.empty()) {
+            t.erase_and_dispose(t.begin(), current_deleter<entry>());
+        }
+    });
+}
+
+BOOST_AUTO_TEST_CASE(test_compaction_and_move) {
+    logalloc::region reg;
+    with_allocator(reg.allocator(), [&] {
+        std::set<int> expected;
+        tree_type t;
+        for (int i = 0; i < 1000; ++i) {
+            t.insert(*current_allocator().construct<entry>(i * 7 % 1000));
+            expected.insert(i);
+        }
+        verify(t, expected);
+        BOOST_REQUIRE_GT(t.memory_usage(), 0);
+        BOOST_REQUIRE_GE(reg.occupancy().used_space(), t.memory_usage() + expected.size() * sizeof(entry));
+
+        reg.full_compaction();
+        verify(t, expected);
+
+        tree_type t2(std::move(t));
+        BOOST_REQUIRE(t.empty());
+        reg.full_compaction();
+        verify(t2, expected);
+
+        t2.clear_and_dispose(current_deleter<entry>());
+        BOOST_REQUIRE(t2.empty());
+        BOOST_REQUIRE_EQUAL(t2.memory_usage(), 0);
+        BOOST_REQUIRE(t2.begin() == t2.end());
+    });
+    BOOST_REQUIRE_EQUAL(reg.occupancy().used_space(), 0);
+}
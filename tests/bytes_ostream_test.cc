@@ -275,3 +275,51 @@ BOOST_AUTO_TEST_CASE(test_append_big_and_small_chunks) {
     buf.append(big);
     buf.append(small);
 }
+
+BOOST_AUTO_TEST_CASE(test_reserved_size_is_written_in_one_chunk) {
+    int count = 1000;
+
+    bytes_ostream buf;
+    buf.reserve(count * sizeof(int));
+    append_sequence(buf, count);
+    BOOST_REQUIRE(buf.is_linearized());
+    assert_sequence(buf, count);
+
+    // Writing more than reserved still works.
+    bytes_ostream small;
+    small.reserve(sizeof(int));
+    append_sequence(small, count);
+    assert_sequence(small, count);
+
+    // Large buffers go to max_chunk_size() chunks right away, but not beyond.
+    bytes_ostream big;
+    big.reserve(bytes_ostream::max_chunk_size() * 4);
+    append_sequence(big, bytes_ostream::max_chunk_size());
+    std::vector<bytes_view> frags(big.begin(), big.end());
+    BOOST_REQUIRE_GT(frags.size(), 1);
+    for (size_t i = 0; i < frags.size(); ++i) {
+        if (i + 1 < frags.size()) {
+            BOOST_REQUIRE_GT(frags[i].size(), bytes_ostream::max_chunk_size() / 2);
+        }
+        BOOST_REQUIRE_LE(frags[i].size(), bytes_ostream::max_chunk_size());
+    }
+    assert_sequence(big, bytes_ostream::max_chunk_size());
+}
+
+BOOST_AUTO_TEST_CASE(test_to_packet) {
+    int count = 64*1024;
+
+    bytes_ostream buf;
+    append_sequence(buf, count);
+    std::vector<bytes_view> frags(buf.begin(), buf.end());
+
+    auto p = std::move(buf).to_packet();
+    BOOST_REQUIRE(buf.empty());
+    BOOST_REQUIRE_EQUAL(p.len(), count * sizeof(int));
+    BOOST_REQUIRE_EQUAL(p.nr_frags(), frags.size());
+    for (size_t i = 0; i < frags.size(); ++i) {
+        // Not copied.
+        BOOST_REQUIRE(p.frag(i).base == reinterpret_cast<const char*>(frags[i].data()));
+        BOOST_REQUIRE_EQUAL(p.frag(i).size, frags[i].size());
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+
+#include "database.hh"
+#include "cdc/log.hh"
+
+#include "tests/test-utils.hh"
+#include "tests/cql_test_env.hh"
+#include "tests/cql_assertions.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+SEASTAR_TEST_CASE(test_log_written_with_base) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table cf (p int, c int, v int, primary key (p, c)) with cdc = true;").get();
+        BOOST_REQUIRE(e.local_db().has_schema("ks", cdc::log_name("cf")));
+        for (auto p = 0; p < 3; ++p) {
+            e.execute_cql(sprint("insert into cf (p, c, v) values (%d, 0, 0);", p)).get();
+        }
+        e.execute_cql("begin unlogged batch "
+                      "insert into cf (p, c, v) values (7, 0, 0); "
+                      "insert into cf (p, c, v) values (8, 0, 0); "
+                      "apply batch;").get();
+        auto msg = e.execute_cql("select key from cf_scylla_cdc_log;").get0();
+        assert_that(msg).is_rows().with_size(5);
+
+        // The log only has the changes made while cdc is enabled.
+        e.execute_cql("create table other (p int primary key, v int);").get();
+        e.execute_cql("insert into other (p, v) values (0, 0);").get();
+        BOOST_REQUIRE(!e.local_db().has_schema("ks", cdc::log_name("other")));
+        e.execute_cql("alter table other with cdc = true;").get();
+        BOOST_REQUIRE(e.local_db().has_schema("ks", cdc::log_name("other")));
+        e.execute_cql("insert into other (p, v) values (1, 1);").get();
+        msg = e.execute_cql("select key from other_scylla_cdc_log;").get0();
+        assert_that(msg).is_rows().with_size(1);
+    });
+}
+
+SEASTAR_TEST_CASE(test_log_dropped_with_base) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table cf (p int primary key, v int) with cdc = true;").get();
+        e.execute_cql("alter table cf with cdc = false;").get();
+        e.execute_cql("insert into cf (p, v) values (0, 0);").get();
+        auto msg = e.execute_cql("select key from cf_scylla_cdc_log;").get0();
+        assert_that(msg).is_rows().is_empty();
+        e.execute_cql("drop table cf;").get();
+        BOOST_REQUIRE(!e.local_db().has_schema("ks", cdc::log_name("cf")));
+    });
+}
@@ -22,11 +22,13 @@
 
 #include <boost/test/unit_test.hpp>
 #include <boost/range/adaptor/map.hpp>
+#include <boost/range/irange.hpp>
 
 #include <stdlib.h>
 #include <iostream>
 #include <unordered_map>
 #include <unordered_set>
+#include <map>
 #include <set>
 
 #include "tests/test-utils.hh"
@@ -39,6 +41,10 @@
 #include "tmpdir.hh"
 #include "db/commitlog/commitlog.hh"
 #include "db/commitlog/rp_set.hh"
+#include "db/commitlog/commitlog_entry.hh"
+#include "schema_builder.hh"
+#include "mutation.hh"
+#include "frozen_mutation.hh"
 #include "log.hh"
 
 #include "disk-error-handler.hh"
@@ -105,6 +111,28 @@ SEASTAR_TEST_CASE(test_commitlog_written_to_disk_batch){
         });
 }
 
+SEASTAR_TEST_CASE(test_commitlog_written_to_disk_group){
+    commitlog::config cfg;
+    cfg.mode = commitlog::sync_mode::GROUP;
+    return cl_test(cfg, [](commitlog& log) {
+            auto uuid = utils::UUID_gen::get_time_UUID();
+            // Concurrent writes share syncs.
+            return parallel_for_each(boost::irange(0, 100), [&log, uuid] (int) {
+                sstring tmp = "hej bubba cow";
+                return log.add_mutation(uuid, tmp.size(), [tmp](db::commitlog::output& dst) {
+                            dst.write(tmp.begin(), tmp.end());
+                        }).then([](db::rp_handle h) {
+                            BOOST_CHECK_NE(h.rp(), db::replay_position());
+                        });
+            }).then([&log] {
+                auto n = log.get_num_group_syncs();
+                BOOST_REQUIRE(n > 0);
+                BOOST_REQUIRE(n < 100);
+                BOOST_REQUIRE(log.get_flush_count() > 0);
+            });
+        });
+}
+
 SEASTAR_TEST_CASE(test_commitlog_written_to_disk_periodic){
     return cl_test([](commitlog& log) {
             auto state = make_lw_shared(false);
@@ -285,6 +313,55 @@ SEASTAR_TEST_CASE(test_commitlog_delete_when_over_disk_limit) {
         });
 }
 
+SEASTAR_TEST_CASE(test_commitlog_reuse_segments) {
+    commitlog::config cfg;
+    cfg.commitlog_segment_size_in_mb = 1;
+    cfg.reuse_segments = true;
+    return cl_test(cfg, [](commitlog& log) {
+            auto uuid = utils::UUID_gen::get_time_UUID();
+            auto set = make_lw_shared<rp_set>();
+            auto count = make_lw_shared<size_t>(0);
+            auto add = [&log, uuid, set, count] {
+                sstring tmp = "hej bubba cow";
+                return log.add_mutation(uuid, tmp.size(), [tmp](db::commitlog::output& dst) {
+                            dst.write(tmp.begin(), tmp.end());
+                        }).then([set, count](db::rp_handle h) {
+                            set->put(std::move(h));
+                            ++(*count);
+                        });
+            };
+            return do_until([set]() { return set->size() > 2; }, add).then([&log] {
+                return log.sync_all_segments();
+            }).then([&log, uuid, set, count, add] {
+                log.discard_completed_segments(uuid, *set);
+                *count = 0;
+                // The new segments are made of the recycled ones, and must
+                // show none of what was written to those before.
+                return do_until([&log, count]() { return log.get_num_segments_reused() > 0 && log.get_active_segment_names().size() > 2; }, add);
+            }).then([&log] {
+                return log.sync_all_segments();
+            }).then([&log, count] {
+                auto read_count = make_lw_shared<size_t>(0);
+                return do_with(log.get_active_segment_names(), [read_count] (auto& segments) {
+                    return do_for_each(segments, [read_count] (sstring path) {
+                        return db::commitlog::read_log_file(path, [read_count](temporary_buffer<char> buf, db::replay_position rp) {
+                            sstring str(buf.get(), buf.size());
+                            BOOST_CHECK_EQUAL(str, "hej bubba cow");
+                            (*read_count)++;
+                            return make_ready_future<>();
+                        }).then([](auto s) {
+                            return do_with(std::move(s), [](auto& s) {
+                                return s->done();
+                            });
+                        });
+                    });
+                }).then([read_count, count] {
+                    BOOST_REQUIRE_GE(*read_count, *count);
+                });
+            });
+        });
+}
+
 SEASTAR_TEST_CASE(test_commitlog_reader){
     static auto count_mutations_in_segment = [] (sstring path) -> future<size_t> {
         auto count = make_lw_shared<size_t>(0);
@@ -352,6 +429,120 @@ SEASTAR_TEST_CASE(test_commitlog_reader){
         });
 }
 
+SEASTAR_TEST_CASE(test_commitlog_compressed_segments){
+    commitlog::config cfg;
+    cfg.compress_segments = true;
+    return cl_test(cfg, [](commitlog& log) {
+            auto rps = make_lw_shared<std::set<db::replay_position>>();
+            auto uuid = utils::UUID_gen::get_time_UUID();
+            return do_for_each(boost::irange(0, 1000), [&log, uuid, rps] (int i) {
+                // Compressible, and each entry different to check the order.
+                sstring tmp = sstring(200, 'a') + to_sstring(i);
+                return log.add_mutation(uuid, tmp.size(), [tmp](db::commitlog::output& dst) {
+                            dst.write(tmp.begin(), tmp.end());
+                        }).then([rps](db::rp_handle h) {
+                            BOOST_CHECK_NE(h.rp(), db::replay_position());
+                            rps->insert(h.release());
+                        });
+            }).then([&log] {
+                return log.sync_all_segments();
+            }).then([&log, rps] {
+                BOOST_REQUIRE_GT(log.get_bytes_uncompressed(), 0);
+                BOOST_REQUIRE_LT(log.get_bytes_compressed(), log.get_bytes_uncompressed());
+                auto read_rps = make_lw_shared<std::vector<db::replay_position>>();
+                return do_with(log.get_active_segment_names(), [read_rps] (auto& segments) {
+                    return do_for_each(segments, [read_rps] (sstring path) {
+                        return db::commitlog::read_log_file(path, [read_rps](temporary_buffer<char> buf, db::replay_position rp) {
+                            sstring str(buf.get(), buf.size());
+                            BOOST_CHECK_EQUAL(str, sstring(200, 'a') + to_sstring(read_rps->size()));
+                            read_rps->push_back(rp);
+                            return make_ready_future<>();
+                        }).then([](auto s) {
+                            return do_with(std::move(s), [](auto& s) {
+                                return s->done();
+                            });
+                        });
+                    });
+                }).then([read_rps, rps] {
+                    // The entries are found at the positions they were written at.
+                    BOOST_REQUIRE_EQUAL(read_rps->size(), rps->size());
+                    BOOST_REQUIRE(std::equal(read_rps->begin(), read_rps->end(), rps->begin()));
+                });
+            });
+        });
+}
+
+SEASTAR_TEST_CASE(test_commitlog_segment_index){
+    return cl_test([](commitlog& log) {
+            auto rps = make_lw_shared<std::map<utils::UUID, std::vector<db::replay_position>>>();
+            auto uuid1 = utils::UUID_gen::get_time_UUID();
+            auto uuid2 = utils::UUID_gen::get_time_UUID();
+            return do_for_each(boost::irange(0, 100), [&log, uuid1, uuid2, rps] (int i) {
+                auto uuid = i < 30 || i % 2 ? uuid1 : uuid2;
+                sstring tmp = "hej bubba cow";
+                return log.add_mutation(uuid, tmp.size(), [tmp](db::commitlog::output& dst) {
+                            dst.write(tmp.begin(), tmp.end());
+                        }).then([rps, uuid](db::rp_handle h) {
+                            (*rps)[uuid].push_back(h.release());
+                        });
+            }).then([&log, rps] {
+                auto segments = log.get_active_segment_names();
+                BOOST_REQUIRE_EQUAL(segments.size(), 1);
+                // The index is written once the segment is closed.
+                return log.shutdown().then([segment = segments.front()] {
+                    return db::commitlog::read_segment_index(segment);
+                }).then([rps] (stdx::optional<db::commitlog::segment_index> index) {
+                    BOOST_REQUIRE(index);
+                    BOOST_REQUIRE_EQUAL(index->tables.size(), rps->size());
+                    for (auto&& p : *rps) {
+                        auto& positions = index->tables.at(p.first);
+                        BOOST_REQUIRE_EQUAL(positions.first, p.second.front().pos);
+                        BOOST_REQUIRE_EQUAL(positions.second, p.second.back().pos);
+                    }
+                });
+            });
+        });
+}
+
+SEASTAR_TEST_CASE(test_commitlog_column_mapping_written_once){
+    return cl_test([](commitlog& log) {
+        auto s = schema_builder("ks", "cf")
+                .with_column("pk", bytes_type, column_kind::partition_key)
+                .with_column("v", bytes_type)
+                .build();
+        mutation m(partition_key::from_single_value(*s, to_bytes("key")), s);
+        m.partition().apply(tombstone(1, gc_clock::now()));
+        auto fm = make_lw_shared<frozen_mutation>(freeze(m));
+        // Every entry is synced, so that each ends up in a chunk of its own.
+        return do_for_each(boost::irange(0, 10), [&log, s, fm] (int) {
+            commitlog_entry_writer cew(s, *fm);
+            return log.add_entry(s->id(), cew, commitlog::timeout_clock::time_point::max()).then([&log] (db::rp_handle h) {
+                h.release();
+                return log.sync_all_segments();
+            });
+        }).then([&log] {
+            auto segments = log.get_active_segment_names();
+            BOOST_REQUIRE_EQUAL(segments.size(), 1);
+            auto with_mapping = make_lw_shared<size_t>(0);
+            auto entries = make_lw_shared<size_t>(0);
+            return db::commitlog::read_log_file(segments.front(), [with_mapping, entries](temporary_buffer<char> buf, db::replay_position rp) {
+                commitlog_entry_reader cer(buf);
+                *with_mapping += bool(cer.get_column_mapping());
+                BOOST_REQUIRE_EQUAL(commitlog_entry_reader::has_column_mapping(buf), bool(cer.get_column_mapping()));
+                ++*entries;
+                return make_ready_future<>();
+            }).then([](auto s) {
+                return do_with(std::move(s), [](auto& s) {
+                    return s->done();
+                });
+            }).then([with_mapping, entries] {
+                BOOST_REQUIRE_EQUAL(*entries, 10);
+                BOOST_REQUIRE_EQUAL(*with_mapping, 1);
+            });
+        });
+    });
+}
+
 static future<> corrupt_segment(sstring seg, uint64_t off, uint32_t value) {
     return open_file_dma(seg, open_flags::rw).then([off, value](file f) {
         size_t size = align_up<size_t>(off, 4096);
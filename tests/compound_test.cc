@@ -331,3 +331,84 @@ BOOST_AUTO_TEST_CASE(test_composite_validity) {
     BOOST_REQUIRE_EQUAL(is_valid({'\x00', '\x01', 'a'}), false);
     BOOST_REQUIRE_EQUAL(is_valid({'\x00', '\x02', 'a'}), false);
 }
+
+static bytes make_timeuuid(uint64_t timestamp, uint64_t lsb) {
+    uint64_t msb = ((timestamp & 0xffffffff) << 32) | (((timestamp >> 32) & 0xffff) << 16) | 0x1000 | ((timestamp >> 48) & 0x0fff);
+    return utils::UUID(msb, lsb).serialize();
+}
+
+template <allow_prefixes AllowPrefixes>
+static void test_compare_like_types(std::vector<data_type> types, std::vector<std::vector<bytes>> values) {
+    compound_type<AllowPrefixes> t(types);
+
+    // All combinations of the values, and their prefixes if allowed.
+    std::vector<std::vector<bytes>> keys = {{}};
+    for (auto&& component_values : values) {
+        std::vector<std::vector<bytes>> longer;
+        for (auto&& key : keys) {
+            for (auto&& v : component_values) {
+                longer.push_back(key);
+                longer.back().push_back(v);
+            }
+        }
+        if (AllowPrefixes == allow_prefixes::yes) {
+            keys.insert(keys.end(), longer.begin(), longer.end());
+        } else {
+            keys = std::move(longer);
+        }
+    }
+    auto serialized = boost::copy_range<std::vector<bytes>>(keys | boost::adaptors::transformed([&] (auto&& key) {
+        return t.serialize_value(key);
+    }));
+
+    BOOST_REQUIRE(t.is_byte_comparable_encodable());
+    auto encoded = boost::copy_range<std::vector<bytes>>(serialized | boost::adaptors::transformed([&] (auto&& key) {
+        auto e = t.encode_byte_comparable(key);
+        BOOST_REQUIRE(e);
+        return *e;
+    }));
+
+    auto sign = [] (int r) { return r < 0 ? -1 : r > 0 ? 1 : 0; };
+    for (size_t i = 0; i < serialized.size(); ++i) {
+        for (size_t j = 0; j < serialized.size(); ++j) {
+            auto& k1 = serialized[i];
+            auto& k2 = serialized[j];
+            auto expected = lexicographical_tri_compare(types.begin(), types.end(),
+                t.begin(k1), t.end(k1), t.begin(k2), t.end(k2), tri_compare);
+            BOOST_REQUIRE_EQUAL(sign(t.compare(k1, k2)), sign(expected));
+            BOOST_REQUIRE_EQUAL(sign(compare_unsigned(encoded[i], encoded[j])), sign(expected));
+            auto expected_prefix_equality = prefix_equality_tri_compare(types.begin(),
+                t.begin(k1), t.end(k1), t.begin(k2), t.end(k2), tri_compare);
+            BOOST_REQUIRE_EQUAL(sign(t.prefix_equality_compare(k1, k2)), sign(expected_prefix_equality));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_specialized_compare) {
+    auto int32_values = std::vector<bytes>{bytes(), int32_type->decompose(int32_t(-5)), int32_type->decompose(int32_t(0)), int32_type->decompose(int32_t(7))};
+    auto long_values = std::vector<bytes>{bytes(), long_type->decompose(int64_t(-1)), long_type->decompose(int64_t(3)), long_type->decompose(int64_t(1) << 40)};
+    auto timeuuid_values = std::vector<bytes>{bytes(), make_timeuuid(1, 1), make_timeuuid(1, 0x8000000000000000), make_timeuuid(1ull << 40, 1), make_timeuuid(2, 1)};
+    auto text_values = to_bytes_vec({"", "a", "ab", "b"});
+    auto simple_date_values = std::vector<bytes>{bytes(), bytes({'\x00', '\x00', '\x00', '\x01'}), bytes({'\x80', '\x00', '\x00', '\x00'})};
+    auto date_values = std::vector<bytes>{bytes(), long_type->decompose(int64_t(-1)), long_type->decompose(int64_t(3))};
+
+    test_compare_like_types<allow_prefixes::no>({int32_type}, {int32_values});
+    test_compare_like_types<allow_prefixes::yes>({int32_type}, {int32_values});
+    test_compare_like_types<allow_prefixes::no>({timeuuid_type}, {timeuuid_values});
+    test_compare_like_types<allow_prefixes::no>({reversed_type_impl::get_instance(long_type)}, {long_values});
+    test_compare_like_types<allow_prefixes::yes>({int32_type, reversed_type_impl::get_instance(long_type), utf8_type},
+        {int32_values, long_values, text_values});
+    test_compare_like_types<allow_prefixes::yes>({reversed_type_impl::get_instance(timeuuid_type), bytes_type},
+        {timeuuid_values, text_values});
+    // Leading components compared with a single memcmp().
+    test_compare_like_types<allow_prefixes::yes>({simple_date_type, date_type, utf8_type},
+        {simple_date_values, date_values, text_values});
+    test_compare_like_types<allow_prefixes::no>({simple_date_type, date_type, utf8_type},
+        {simple_date_values, date_values, text_values});
+    // Zero bytes in, and at the end of, variable size values.
+    test_compare_like_types<allow_prefixes::yes>({bytes_type, reversed_type_impl::get_instance(bytes_type)},
+        {{bytes(), bytes({'\x00'}), bytes({'\x00', '\x00'}), bytes({'\x00', '\x01'}), bytes({'\x01'}), bytes({'\xff'})},
+         {bytes(), bytes({'\x00'}), bytes({'\x01', '\x00'}), bytes({'\x01'}), bytes({'\xff', '\x00'})}});
+
+    BOOST_REQUIRE(!compound_type<allow_prefixes::yes>({int32_type, varint_type}).is_byte_comparable_encodable());
+}
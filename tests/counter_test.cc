@@ -20,6 +20,7 @@
  */
 
 #include "counters.hh"
+#include "counter_shard_cache.hh"
 
 #include <seastar/core/thread.hh>
 
@@ -434,3 +435,72 @@ SEASTAR_TEST_CASE(test_transfer_updates_to_shards) {
     });
 }
 
+SEASTAR_TEST_CASE(test_counter_shard_cache) {
+    return seastar::async([] {
+        storage_service_for_tests ssft;
+
+        auto s = get_schema();
+        counter_shard_cache_tracker tracker(1 << 20);
+        counter_shard_cache cache(s, tracker);
+
+        auto pk = partition_key::from_single_value(*s, int32_type->decompose(0));
+        auto ck = clustering_key::from_single_value(*s, int32_type->decompose(0));
+        auto& col = *s->get_column_definition(utf8_type->decompose(sstring("c1")));
+        auto& scol = *s->get_column_definition(utf8_type->decompose(sstring("s1")));
+
+        mutation m1(pk, s);
+        m1.set_clustered_cell(ck, col, atomic_cell::make_live_counter_update(api::new_timestamp(), 5));
+        m1.set_static_cell(scol, atomic_cell::make_live_counter_update(api::new_timestamp(), 4));
+
+        mutation m2(pk, s);
+        m2.set_clustered_cell(ck, col, atomic_cell::make_live_counter_update(api::new_timestamp(), 9));
+        m2.set_static_cell(scol, atomic_cell::make_live_counter_update(api::new_timestamp(), 8));
+
+        auto m = m1;
+        BOOST_REQUIRE(!cache.transform_counter_updates_to_shards(m, 0));
+        BOOST_REQUIRE_EQUAL(m, m1);
+        transform_counter_updates_to_shards(m, nullptr, 0);
+        auto m0 = m;
+        cache.store(m0);
+        BOOST_REQUIRE_EQUAL(cache.size(), 1);
+
+        // The cached shards give the same result as reading them.
+        auto expected = m2;
+        transform_counter_updates_to_shards(expected, &m0, 3);
+        m = m2;
+        BOOST_REQUIRE(cache.transform_counter_updates_to_shards(m, 3));
+        BOOST_REQUIRE_EQUAL(m, expected);
+
+        auto ccv = counter_cell_view(get_counter_cell(m));
+        BOOST_REQUIRE_EQUAL(ccv.total_value(), 14);
+        ccv = counter_cell_view(get_static_counter_cell(m));
+        BOOST_REQUIRE_EQUAL(ccv.total_value(), 12);
+
+        // Cells not updated yet aren't cached.
+        auto ck2 = clustering_key::from_single_value(*s, int32_type->decompose(1));
+        mutation m3(pk, s);
+        m3.set_clustered_cell(ck2, col, atomic_cell::make_live_counter_update(api::new_timestamp(), 1));
+        auto m3_copy = m3;
+        BOOST_REQUIRE(!cache.transform_counter_updates_to_shards(m3, 0));
+        BOOST_REQUIRE_EQUAL(m3, m3_copy);
+
+        // Writes which don't delete anything keep the cache.
+        cache.store(m);
+        cache.invalidate(m);
+        BOOST_REQUIRE_EQUAL(cache.size(), 1);
+
+        mutation m4(pk, s);
+        m4.set_clustered_cell(ck, col, atomic_cell::make_dead(api::new_timestamp() / 2, gc_clock::now()));
+        cache.invalidate(freeze(m4), *s);
+        BOOST_REQUIRE(cache.empty());
+        m = m2;
+        BOOST_REQUIRE(!cache.transform_counter_updates_to_shards(m, 0));
+
+        cache.store(m0);
+        m4 = mutation(pk, s);
+        m4.partition().apply(tombstone(api::new_timestamp(), gc_clock::now()));
+        cache.invalidate(m4);
+        BOOST_REQUIRE(cache.empty());
+        BOOST_REQUIRE_EQUAL(tracker.memory_usage(), 0);
+    });
+}
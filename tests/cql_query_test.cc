@@ -34,6 +34,9 @@
 #include "core/sleep.hh"
 #include "transport/messages/result_message.hh"
 #include "utils/big_decimal.hh"
+#include "cql3/query_processor.hh"
+#include "db/config.hh"
+#include "service/storage_proxy.hh"
 
 #include "disk-error-handler.hh"
 
@@ -1255,6 +1258,18 @@ SEASTAR_TEST_CASE(test_table_compression) {
             assert(!f.failed());
             e.require_table_exists("ks", "tb4");
             BOOST_REQUIRE(e.local_db().find_schema("ks", "tb4")->get_compressor_params().get_compressor() == compressor::deflate);
+            return e.execute_cql("create table tb6 (foo text PRIMARY KEY, bar text) with compression = { 'sstable_compression' : 'LZ4Compressor', 'compression_level' : 3 };");
+        }).then_wrapped([&e] (auto f) {
+            assert_that_failed(f);
+            return e.execute_cql("create table tb6 (foo text PRIMARY KEY, bar text) with compression = { 'sstable_compression' : 'ZstdCompressor', 'compression_level' : 23 };");
+        }).then_wrapped([&e] (auto f) {
+            assert_that_failed(f);
+            return e.execute_cql("create table tb6 (foo text PRIMARY KEY, bar text) with compression = { 'sstable_compression' : 'ZstdCompressor', 'compression_level' : 9 };");
+        }).then_wrapped([&e] (auto f) {
+            assert(!f.failed());
+            e.require_table_exists("ks", "tb6");
+            BOOST_REQUIRE(e.local_db().find_schema("ks", "tb6")->get_compressor_params().get_compressor() == compressor::zstd);
+            BOOST_REQUIRE(e.local_db().find_schema("ks", "tb6")->get_compressor_params().compression_level() == 9);
         });
     });
 }
@@ -2306,3 +2321,436 @@ SEASTAR_TEST_CASE(test_pg_style_string_literal) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_prepared_statements_cache_eviction) {
+    db::config cfg;
+    cfg.prepared_statements_cache_size_mb = 1;
+
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk text, c text, PRIMARY KEY (pk));").get();
+        auto literal = sstring(sstring::initialized_later(), 1024);
+        std::fill(literal.begin(), literal.end(), 'x');
+        auto make_query = [&] (int i) {
+            return sprint("insert into test (pk, c) values ('%d', '%s');", i, literal);
+        };
+
+        // Well over the size of the cache of any shard.
+        const int statements = 2048;
+        auto first = e.prepare(make_query(0)).get0();
+        for (int i = 1; i < statements; ++i) {
+            e.prepare(make_query(i)).get();
+        }
+        auto& qp = e.local_qp();
+        BOOST_REQUIRE(!qp.get_prepared(first));
+        auto last = qp.compute_id(make_query(statements - 1), "ks");
+        BOOST_REQUIRE(qp.get_prepared(last));
+
+        try {
+            e.execute_prepared(first, {}).get();
+            BOOST_FAIL("Should have failed");
+        } catch (const not_prepared_exception&) {
+            // expected
+        }
+
+        // Clients prepare evicted statements again.
+        first = e.prepare(make_query(0)).get0();
+        e.execute_prepared(first, {}).get();
+        assert_that(e.execute_cql("select pk from test;").get0()).is_rows().with_rows({
+            { utf8_type->decompose(sstring("0")) },
+        });
+    }, cfg);
+}
+
+SEASTAR_TEST_CASE(test_aggregates_computed_on_replicas) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v int, d double, PRIMARY KEY (pk, ck));").get();
+
+        auto check = [&] (sstring query, std::initializer_list<bytes_opt> row) {
+            assert_that(e.execute_cql(query).get0()).is_rows().with_size(1).with_row(row);
+        };
+
+        // Aggregates of an empty table.
+        check("select count(*), count(v), sum(v), min(v), max(v) from test;",
+                { long_type->decompose(0L), long_type->decompose(0L), int32_type->decompose(0), {}, {} });
+
+        // Enough partitions to be spread over all shards, and rows without v.
+        int64_t count = 0;
+        int32_t sum = 0;
+        for (int pk = 0; pk < 100; ++pk) {
+            for (int ck = 0; ck < 3; ++ck) {
+                if (ck == 2) {
+                    e.execute_cql(sprint("insert into test (pk, ck) values (%d, %d);", pk, ck)).get();
+                    continue;
+                }
+                auto v = pk * 10 + ck - 500;
+                e.execute_cql(sprint("insert into test (pk, ck, v, d) values (%d, %d, %d, %d.5);", pk, ck, v, v)).get();
+                ++count;
+                sum += v;
+            }
+        }
+
+        check("select count(*) from test;", { long_type->decompose(300L) });
+        check("select count(1) from test;", { long_type->decompose(300L) });
+        check("select count(v), sum(v), min(v), max(v) from test;",
+                { long_type->decompose(count), int32_type->decompose(sum), int32_type->decompose(-500), int32_type->decompose(491) });
+        check("select min(d), max(d) from test;", { double_type->decompose(-500.5), double_type->decompose(491.5) });
+        check("select count(*), sum(v) from test where pk = 7;", { long_type->decompose(3L), int32_type->decompose(-859) });
+        check("select count(*) from test where pk in (1, 2, 3) and ck > 0;", { long_type->decompose(6L) });
+    });
+}
+
+SEASTAR_TEST_CASE(test_sum_and_avg_of_varint_and_decimal) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int primary key, vi varint, de decimal);").get();
+
+        auto check = [&] (sstring query, std::initializer_list<bytes_opt> row) {
+            assert_that(e.execute_cql(query).get0()).is_rows().with_size(1).with_row(row);
+        };
+
+        check("select sum(vi), avg(vi), sum(de), avg(de) from test;",
+                { varint_type->from_string("0"), varint_type->from_string("0"), decimal_type->from_string("0"), decimal_type->from_string("0") });
+
+        e.execute_cql("insert into test (pk, vi, de) values (1, 9223372036854775807, 1.5);").get();
+        e.execute_cql("insert into test (pk, vi, de) values (2, 9223372036854775807, 0.25);").get();
+        e.execute_cql("insert into test (pk, vi, de) values (3, -5, 1e-30);").get();
+        e.execute_cql("insert into test (pk) values (4);").get();
+
+        // The varint sum overflows 64 bits, and the decimal one needs more
+        // than 64 bits at the scale of the last value.
+        check("select sum(vi), avg(vi) from test;",
+                { varint_type->from_string("18446744073709551609"), varint_type->from_string("6148914691236517203") });
+        check("select sum(de), avg(de) from test;",
+                { decimal_type->from_string("1.750000000000000000000000000001"), decimal_type->from_string("0.583333333333333333333333333334") });
+        check("select sum(vi), sum(de) from test where pk in (1, 2);",
+                { varint_type->from_string("18446744073709551614"), decimal_type->from_string("1.75") });
+    });
+}
+
+SEASTAR_TEST_CASE(test_select_bypass_cache) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v int, PRIMARY KEY (pk, ck));").get();
+        for (int pk = 0; pk < 10; ++pk) {
+            e.execute_cql(sprint("insert into test (pk, ck, v) values (%d, 0, %d);", pk, pk)).get();
+        }
+        auto cached_partitions = [&] {
+            return e.db().map_reduce0([] (database& db) {
+                return db.find_column_family("ks", "test").get_row_cache().num_entries();
+            }, size_t(0), std::plus<size_t>()).get0();
+        };
+        e.db().invoke_on_all([] (database& db) {
+            return db.flush_all_memtables().then([&db] {
+                return db.find_column_family("ks", "test").get_row_cache().invalidate(query::full_partition_range);
+            });
+        }).get();
+        auto empty = cached_partitions();
+
+        auto msg = e.execute_cql("select v from test where pk = 3 bypass cache;").get0();
+        assert_that(msg).is_rows().with_rows({{ int32_type->decompose(3) }});
+        msg = e.execute_cql("select count(*) from test bypass cache;").get0();
+        assert_that(msg).is_rows().with_rows({{ long_type->decompose(10L) }});
+        BOOST_REQUIRE_EQUAL(cached_partitions(), empty);
+
+        // Unflushed writes are seen too.
+        e.execute_cql("insert into test (pk, ck, v) values (3, 1, 4);").get();
+        msg = e.execute_cql("select v from test where pk = 3 bypass cache;").get0();
+        assert_that(msg).is_rows().with_rows({{ int32_type->decompose(3) }, { int32_type->decompose(4) }});
+
+        e.execute_cql("select v from test;").get();
+        BOOST_REQUIRE_GT(cached_partitions(), empty);
+
+        // Not a reserved keyword.
+        e.execute_cql("create table cache (bypass int PRIMARY KEY);").get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_per_partition_limit) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v int, PRIMARY KEY (pk, ck));").get();
+        for (int pk = 0; pk < 3; ++pk) {
+            for (int ck = 0; ck < 5; ++ck) {
+                e.execute_cql(sprint("insert into test (pk, ck, v) values (%d, %d, %d);", pk, ck, pk * 10 + ck)).get();
+            }
+        }
+        auto i = [] (int v) { return int32_type->decompose(v); };
+
+        auto msg = e.execute_cql("select v from test where pk = 1 per partition limit 2;").get0();
+        assert_that(msg).is_rows().with_rows({{ i(10) }, { i(11) }});
+        msg = e.execute_cql("select v from test where pk = 1 order by ck desc per partition limit 2;").get0();
+        assert_that(msg).is_rows().with_rows({{ i(14) }, { i(13) }});
+        msg = e.execute_cql("select v from test per partition limit 2;").get0();
+        assert_that(msg).is_rows().with_rows_ignore_order({
+            { i(0) }, { i(1) }, { i(10) }, { i(11) }, { i(20) }, { i(21) }
+        });
+        msg = e.execute_cql("select v from test where pk in (0, 2) per partition limit 1;").get0();
+        assert_that(msg).is_rows().with_rows_ignore_order({{ i(0) }, { i(20) }});
+        msg = e.execute_cql("select v from test per partition limit 3 limit 4;").get0();
+        assert_that(msg).is_rows().with_size(4);
+
+        BOOST_REQUIRE_THROW(e.execute_cql("select v from test per partition limit 0;").get(), exceptions::invalid_request_exception);
+        BOOST_REQUIRE_THROW(e.execute_cql("select distinct pk from test per partition limit 1;").get(), exceptions::invalid_request_exception);
+        BOOST_REQUIRE_THROW(e.execute_cql("select count(*) from test per partition limit 1;").get(), exceptions::invalid_request_exception);
+
+        // Not reserved keywords.
+        e.execute_cql("create table partition (per int PRIMARY KEY);").get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_group_by) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck1 int, ck2 int, v int, PRIMARY KEY (pk, ck1, ck2));").get();
+        for (int pk = 0; pk < 3; ++pk) {
+            for (int ck1 = 0; ck1 < 2; ++ck1) {
+                for (int ck2 = 0; ck2 < 3; ++ck2) {
+                    e.execute_cql(sprint("insert into test (pk, ck1, ck2, v) values (%d, %d, %d, %d);",
+                            pk, ck1, ck2, pk * 100 + ck1 * 10 + ck2)).get();
+                }
+            }
+        }
+        auto i = [] (int v) { return int32_type->decompose(v); };
+        auto l = [] (int64_t v) { return long_type->decompose(v); };
+
+        auto msg = e.execute_cql("select pk, ck1, sum(v), count(*) from test where pk = 1 group by pk, ck1;").get0();
+        assert_that(msg).is_rows().with_rows({
+            { i(1), i(0), i(303), l(3) },
+            { i(1), i(1), i(333), l(3) },
+        });
+        msg = e.execute_cql("select pk, max(v) from test group by pk;").get0();
+        assert_that(msg).is_rows().with_rows_ignore_order({{ i(0), i(12) }, { i(1), i(112) }, { i(2), i(212) }});
+        // The grouping columns need not be selected.
+        msg = e.execute_cql("select count(*) from test where pk in (0, 2) group by pk, ck1, ck2;").get0();
+        assert_that(msg).is_rows().with_size(12);
+        // Without aggregates, a row of each group.
+        msg = e.execute_cql("select pk, ck1 from test where pk = 2 group by pk, ck1;").get0();
+        assert_that(msg).is_rows().with_rows({{ i(2), i(0) }, { i(2), i(1) }});
+        // The limit is on the groups.
+        msg = e.execute_cql("select count(*) from test where pk = 1 group by pk, ck1 limit 1;").get0();
+        assert_that(msg).is_rows().with_rows({{ l(3) }});
+        msg = e.execute_cql("select count(*) from test group by pk limit 2;").get0();
+        assert_that(msg).is_rows().with_rows({{ l(6) }, { l(6) }});
+        // No groups, no rows.
+        msg = e.execute_cql("select count(*) from test where pk = 7 group by pk;").get0();
+        assert_that(msg).is_rows().is_empty();
+
+        BOOST_REQUIRE_THROW(e.execute_cql("select count(*) from test group by ck1;").get(), exceptions::invalid_request_exception);
+        BOOST_REQUIRE_THROW(e.execute_cql("select count(*) from test group by pk, ck2;").get(), exceptions::invalid_request_exception);
+        BOOST_REQUIRE_THROW(e.execute_cql("select count(*) from test group by pk, v;").get(), exceptions::invalid_request_exception);
+        BOOST_REQUIRE_THROW(e.execute_cql("select distinct pk from test group by pk;").get(), exceptions::invalid_request_exception);
+        BOOST_REQUIRE_THROW(e.execute_cql("select pk, count(*) from test;").get(), exceptions::invalid_request_exception);
+
+        // Not a reserved keyword.
+        e.execute_cql("create table groups (group int PRIMARY KEY);").get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_filtering_on_regular_columns) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v int, s text, PRIMARY KEY (pk, ck));").get();
+        for (int pk = 0; pk < 4; ++pk) {
+            for (int ck = 0; ck < 4; ++ck) {
+                e.execute_cql(sprint("insert into test (pk, ck, v, s) values (%d, %d, %d, '%d');", pk, ck, pk + ck, ck)).get();
+            }
+        }
+        e.execute_cql("insert into test (pk, ck) values (5, 0);").get();
+        auto i = [] (int v) { return int32_type->decompose(v); };
+
+        auto msg = e.execute_cql("select pk, ck from test where v = 3 allow filtering;").get0();
+        assert_that(msg).is_rows().with_rows_ignore_order({
+            { i(0), i(3) }, { i(1), i(2) }, { i(2), i(1) }, { i(3), i(0) }
+        });
+        msg = e.execute_cql("select pk, ck from test where pk = 2 and v >= 4 allow filtering;").get0();
+        assert_that(msg).is_rows().with_rows({{ i(2), i(2) }, { i(2), i(3) }});
+        msg = e.execute_cql("select pk, ck from test where pk = 2 and v > 2 and v < 5 allow filtering;").get0();
+        assert_that(msg).is_rows().with_rows({{ i(2), i(1) }, { i(2), i(2) }});
+        msg = e.execute_cql("select pk, ck from test where v in (0, 6) allow filtering;").get0();
+        assert_that(msg).is_rows().with_rows_ignore_order({{ i(0), i(0) }, { i(3), i(3) }});
+        msg = e.execute_cql("select pk, ck from test where s = '1' and v = 1 allow filtering;").get0();
+        assert_that(msg).is_rows().with_rows({{ i(0), i(1) }});
+
+        // Limits count the rows left after filtering.
+        msg = e.execute_cql("select ck from test where pk = 1 and v > 1 limit 2 allow filtering;").get0();
+        assert_that(msg).is_rows().with_rows({{ i(1) }, { i(2) }});
+        msg = e.execute_cql("select count(*) from test where v < 3 allow filtering;").get0();
+        assert_that(msg).is_rows().with_rows({{ long_type->decompose(6L) }});
+
+        BOOST_REQUIRE_THROW(e.execute_cql("select * from test where v = 3;").get(), exceptions::invalid_request_exception);
+        BOOST_REQUIRE_THROW(e.execute_cql("select distinct pk from test where v = 3 allow filtering;").get(), exceptions::invalid_request_exception);
+    });
+}
+
+SEASTAR_TEST_CASE(test_select_with_large_in_on_partition_key) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v int, PRIMARY KEY (pk, ck));").get();
+        std::vector<sstring> keys;
+        for (int pk = 0; pk < 200; ++pk) {
+            e.execute_cql(sprint("insert into test (pk, ck, v) values (%d, 0, %d);", pk, pk)).get();
+            e.execute_cql(sprint("insert into test (pk, ck, v) values (%d, 1, %d);", pk, pk)).get();
+            keys.push_back(to_sstring(pk));
+        }
+        // More partitions than are read concurrently.
+        auto in = ::join(", ", keys) + ", 1000";
+
+        auto msg = e.execute_cql(sprint("select v from test where pk in (%s);", in)).get0();
+        assert_that(msg).is_rows().with_size(400);
+        msg = e.execute_cql(sprint("select v from test where pk in (%s) limit 5;", in)).get0();
+        assert_that(msg).is_rows().with_size(5);
+        msg = e.execute_cql(sprint("select count(*) from test where pk in (%s);", in)).get0();
+        assert_that(msg).is_rows().with_rows({{ long_type->decompose(400L) }});
+    });
+}
+
+SEASTAR_TEST_CASE(test_simple_selection_rows_are_serialized) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v text, PRIMARY KEY (pk, ck));").get();
+        e.execute_cql("insert into test (pk, ck, v) values (1, 1, 'a');").get();
+        e.execute_cql("insert into test (pk, ck) values (1, 2);").get();
+
+        auto msg = e.execute_cql("select ck, v, pk from test where pk = 1;").get0();
+        auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+        BOOST_REQUIRE(rows);
+        BOOST_REQUIRE(rows->rs().serialized_rows());
+        BOOST_REQUIRE_EQUAL(rows->rs().size(), 2);
+        assert_that(msg).is_rows().with_rows({
+            { int32_type->decompose(1), utf8_type->decompose(sstring("a")), int32_type->decompose(1) },
+            { int32_type->decompose(2), {}, int32_type->decompose(1) },
+        });
+        BOOST_REQUIRE(!rows->rs().serialized_rows());
+
+        msg = e.execute_cql("select writetime(v) from test where pk = 1;").get0();
+        rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
+        BOOST_REQUIRE(!rows->rs().serialized_rows());
+    });
+}
+
+SEASTAR_TEST_CASE(test_unprepared_statements_are_cached) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, v int, PRIMARY KEY (pk));").get();
+        e.execute_cql("insert into test (pk, v) values (1, 1);").get();
+        auto& qp = e.local_qp();
+
+        auto select = [&] (sstring query) {
+            auto invocations = qp.get_stats().prepare_invocations;
+            auto msg = e.execute_cql(query).get0();
+            return std::make_pair(msg, qp.get_stats().prepare_invocations - invocations);
+        };
+        auto r = select("select * from test where pk = 1;");
+        BOOST_REQUIRE_EQUAL(r.second, 1);
+        r = select("  select * from test where pk = 1 ");
+        BOOST_REQUIRE_EQUAL(r.second, 0);
+        assert_that(r.first).is_rows().with_rows({{ int32_type->decompose(1), int32_type->decompose(1) }});
+
+        // Schema changes invalidate the cached statements.
+        e.execute_cql("alter table test add w int;").get();
+        r = select("select * from test where pk = 1;");
+        BOOST_REQUIRE_EQUAL(r.second, 1);
+        assert_that(r.first).is_rows().with_rows({{ int32_type->decompose(1), int32_type->decompose(1), {} }});
+
+        e.execute_cql("drop table test;").get();
+        e.execute_cql("create table test (pk int, v text, PRIMARY KEY (pk));").get();
+        e.execute_cql("insert into test (pk, v) values (1, 'a');").get();
+        r = select("select * from test where pk = 1;");
+        BOOST_REQUIRE_EQUAL(r.second, 1);
+        assert_that(r.first).is_rows().with_rows({{ int32_type->decompose(1), utf8_type->decompose(sstring("a")) }});
+    });
+}
+
+SEASTAR_TEST_CASE(test_large_partitions_recorded) {
+    db::config cfg;
+    // Every partition is large, and no row is.
+    cfg.compaction_large_partition_warning_threshold_mb = 0;
+    cfg.compaction_large_row_warning_threshold_mb = 1;
+
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v text, PRIMARY KEY (pk, ck));").get();
+        e.execute_cql("insert into test (pk, ck, v) values (1, 1, 'a');").get();
+        e.execute_cql("insert into test (pk, ck, v) values (2, 1, 'b');").get();
+        e.db().invoke_on_all([] (database& db) {
+            return db.find_column_family("ks", "test").flush();
+        }).get();
+        auto msg = e.execute_cql("select partition_key, row_size from system.large_partitions where keyspace_name = 'ks' and table_name = 'test';").get0();
+        assert_that(msg).is_rows().with_rows_ignore_order({
+            {utf8_type->decompose(sstring("1")), long_type->decompose(int64_t(0))},
+            {utf8_type->decompose(sstring("2")), long_type->decompose(int64_t(0))},
+        });
+    }, cfg);
+}
+
+SEASTAR_TEST_CASE(test_conditional_updates) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        auto applied = [] (bool v) { return boolean_type->decompose(v); };
+        e.execute_cql("create table test (pk int, ck int, v int, PRIMARY KEY (pk, ck));").get();
+
+        auto msg = e.execute_cql("insert into test (pk, ck, v) values (1, 1, 1) if not exists;").get0();
+        assert_that(msg).is_rows().with_rows({{ applied(true) }});
+        msg = e.execute_cql("insert into test (pk, ck, v) values (1, 1, 2) if not exists;").get0();
+        assert_that(msg).is_rows().with_rows({{ applied(false), int32_type->decompose(1), int32_type->decompose(1), int32_type->decompose(1) }});
+
+        msg = e.execute_cql("update test set v = 3 where pk = 1 and ck = 1 if v = 2;").get0();
+        assert_that(msg).is_rows().with_rows({{ applied(false), int32_type->decompose(1) }});
+        msg = e.execute_cql("update test set v = 3 where pk = 1 and ck = 1 if v = 1;").get0();
+        assert_that(msg).is_rows().with_rows({{ applied(true) }});
+        msg = e.execute_cql("update test set v = 4 where pk = 1 and ck = 2 if v = 1;").get0();
+        assert_that(msg).is_rows().with_rows({{ applied(false) }});
+
+        msg = e.execute_cql("delete from test where pk = 1 and ck = 1 if exists;").get0();
+        assert_that(msg).is_rows().with_rows({{ applied(true) }});
+        msg = e.execute_cql("select * from test where pk = 1;").get0();
+        assert_that(msg).is_rows().with_size(0);
+
+        BOOST_REQUIRE_THROW(e.execute_cql("update test set v = 1 where pk in (1, 2) and ck = 1 if v = 1;").get(),
+                exceptions::invalid_request_exception);
+    });
+}
+
+SEASTAR_TEST_CASE(test_coalesced_counter_updates) {
+    db::config cfg;
+    cfg.counter_update_coalescing_window_in_us = 10000;
+
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int primary key, c1 counter, c2 counter);").get();
+        auto coalesced = service::get_local_storage_proxy().get_stats().coalesced_counter_updates;
+
+        // Concurrent updates of the same partition are combined, and those
+        // of the other partitions are sent along.
+        parallel_for_each(boost::irange(0, 100), [&] (int i) {
+            return e.execute_cql(sprint("update test set c1 = c1 + %d, c2 = c2 - 1 where pk = %d;", i, i % 2)).discard_result();
+        }).get();
+        BOOST_REQUIRE_GT(service::get_local_storage_proxy().get_stats().coalesced_counter_updates, coalesced);
+
+        assert_that(e.execute_cql("select pk, c1, c2 from test;").get0()).is_rows().with_rows_ignore_order({
+            {int32_type->decompose(0), long_type->decompose(2450L), long_type->decompose(-50L)},
+            {int32_type->decompose(1), long_type->decompose(2500L), long_type->decompose(-50L)},
+        });
+
+        // Updates made on their own still apply.
+        e.execute_cql("update test set c1 = c1 + 1 where pk = 0;").get();
+        assert_that(e.execute_cql("select c1 from test where pk = 0;").get0()).is_rows().with_rows({
+            {long_type->decompose(2451L)},
+        });
+    }, cfg);
+}
+
+SEASTAR_TEST_CASE(test_simple_write_path) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table test (pk int, ck int, v1 int, v2 text, PRIMARY KEY (pk, ck));").get();
+        auto insert = e.prepare("insert into test (pk, ck, v2, v1) values (?, ?, ?, ?) using timestamp 10;").get0();
+        auto update = e.prepare("update test using ttl 1000 set v1 = ? where pk = ? and ck in (?, ?);").get0();
+        auto i32 = [] (int v) { return cql3::raw_value::make_value(int32_type->decompose(v)); };
+
+        e.execute_prepared(insert, {i32(1), i32(1), cql3::raw_value::make_value(utf8_type->decompose(sstring("a"))), i32(10)}).get();
+        // A null deletes the cell, an unset value leaves it alone.
+        e.execute_prepared(insert, {i32(1), i32(2), cql3::raw_value::make_null(), i32(20)}).get();
+        e.execute_prepared(insert, {i32(1), i32(1), cql3::raw_value::make_unset_value(), i32(11)}).get();
+        // The same row twice.
+        e.execute_prepared(update, {i32(30), i32(2), i32(3), i32(3)}).get();
+
+        assert_that(e.execute_cql("select ck, v1, v2, writetime(v1) from test where pk = 1;").get0()).is_rows().with_rows({
+            {int32_type->decompose(1), int32_type->decompose(11), utf8_type->decompose(sstring("a")), long_type->decompose(int64_t(10))},
+            {int32_type->decompose(2), int32_type->decompose(20), {}, long_type->decompose(int64_t(10))},
+        });
+        auto msg = e.execute_cql("select ck, v1, ttl(v1) from test where pk = 2;").get0();
+        assert_that(msg).is_rows().with_size(1);
+        // The row of an UPDATE has no marker.
+        e.execute_prepared(update, {cql3::raw_value::make_null(), i32(2), i32(3), i32(3)}).get();
+        assert_that(e.execute_cql("select * from test where pk = 2;").get0()).is_rows().with_size(0);
+    });
+}
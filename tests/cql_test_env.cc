@@ -132,6 +132,14 @@ class single_node_cql_env : public cql_test_env {
     virtual future<::shared_ptr<cql_transport::messages::result_message>> execute_prepared(
         bytes id,
         std::vector<cql3::raw_value> values) override
+    {
+        return execute_prepared(std::move(id), std::move(values), db::consistency_level::ONE);
+    }
+
+    virtual future<::shared_ptr<cql_transport::messages::result_message>> execute_prepared(
+        bytes id,
+        std::vector<cql3::raw_value> values,
+        db::consistency_level cl) override
     {
         auto prepared = local_qp().get_prepared(id);
         if (!prepared) {
@@ -140,7 +148,7 @@ class single_node_cql_env : public cql_test_env {
         auto stmt = prepared->statement;
         assert(stmt->get_bound_terms() == values.size());
 
-        auto options = ::make_shared<cql3::query_options>(std::move(values));
+        auto options = ::make_shared<cql3::query_options>(cl, std::move(values));
         options->prepare(prepared->bound_names);
 
         auto qs = make_query_state();
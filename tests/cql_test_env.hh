@@ -32,6 +32,7 @@
 #include "transport/messages/result_message_base.hh"
 #include "cql3/query_options_fwd.hh"
 #include "cql3/values.hh"
+#include "db/consistency_level_type.hh"
 #include "bytes.hh"
 #include "schema.hh"
 
@@ -64,6 +65,9 @@ class cql_test_env {
     virtual future<::shared_ptr<cql_transport::messages::result_message>> execute_prepared(
         bytes id, std::vector<cql3::raw_value> values) = 0;
 
+    virtual future<::shared_ptr<cql_transport::messages::result_message>> execute_prepared(
+        bytes id, std::vector<cql3::raw_value> values, db::consistency_level cl) = 0;
+
     virtual future<> create_table(std::function<schema(const sstring&)> schema_maker) = 0;
 
     virtual future<> require_keyspace_exists(const sstring& ks_name) = 0;
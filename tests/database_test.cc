@@ -20,6 +20,8 @@
  */
 
 
+#include <fstream>
+
 #include <seastar/core/thread.hh>
 #include <seastar/tests/test-utils.hh>
 
@@ -79,3 +81,254 @@ SEASTAR_TEST_CASE(test_querying_with_limits) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_paged_query_resumes_cached_querier) {
+    return do_with_cql_env([](cql_test_env& e) {
+        return seastar::async([&] {
+            e.execute_cql("create table ks.wide (pk int, ck int, v int, primary key (pk, ck));").get();
+            for (int i = 0; i < 10; ++i) {
+                e.execute_cql(sprint("insert into ks.wide (pk, ck, v) values (0, %d, %d);", i, i)).get();
+            }
+            auto& db = e.local_db();
+            auto& cache = db.get_querier_cache();
+            auto s = db.find_schema("ks", "wide");
+            auto pkey = partition_key::from_single_value(*s, int32_type->decompose(0));
+            auto pranges = dht::partition_range_vector{
+                dht::partition_range::make_singular(dht::global_partitioner().decorate_key(*s, pkey))};
+
+            auto slice = partition_slice_builder(*s).build();
+            slice.options.set<query::partition_slice::option::send_partition_key>();
+            slice.options.set<query::partition_slice::option::send_clustering_key>();
+            auto cmd = query::read_command(s->id(), s->version(), slice, 4);
+            cmd.query_uuid = utils::make_random_uuid();
+            cmd.is_first_page = true;
+            auto max_size = std::numeric_limits<size_t>::max();
+
+            auto query_page = [&] (int last_ck) {
+                if (last_ck >= 0) {
+                    auto ck = clustering_key_prefix::from_single_value(*s, int32_type->decompose(last_ck));
+                    cmd.slice.set_range(*s, pkey, {query::clustering_range::make_starting_with({ck, false})});
+                    cmd.is_first_page = false;
+                }
+                auto result = db.query(s, cmd, query::result_request::only_result, pranges, nullptr, max_size).get0();
+                return query::result_set::from_raw_result(s, cmd.slice, *result);
+            };
+
+            auto ck = [] (int32_t v) {
+                return a_row().with_column(to_bytes("ck"), v);
+            };
+
+            auto rs = query_page(-1);
+            assert_that(rs).has_size(4).has(ck(3));
+            BOOST_REQUIRE_EQUAL(cache.get_stats().population, 1);
+
+            rs = query_page(3);
+            assert_that(rs).has_size(4).has(ck(4)).has(ck(7));
+            BOOST_REQUIRE_EQUAL(cache.get_stats().lookups, 1);
+            BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 0);
+            BOOST_REQUIRE_EQUAL(cache.get_stats().population, 1);
+
+            // A page which doesn't start where the last one ended reads
+            // with a new querier.
+            rs = query_page(5);
+            assert_that(rs).has_size(4).has(ck(6)).has(ck(9));
+            BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 1);
+            BOOST_REQUIRE_EQUAL(cache.get_stats().population, 2);
+
+            // The querier of the second page reads the last rows and runs
+            // out of them, so isn't kept.
+            rs = query_page(7);
+            assert_that(rs).has_size(2).has(ck(8)).has(ck(9));
+            BOOST_REQUIRE_EQUAL(cache.get_stats().misses, 1);
+            BOOST_REQUIRE_EQUAL(cache.get_stats().population, 1);
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_reads_naming_rows_skip_older_sstables) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table ks.ts (pk int, ck int, v int, primary key (pk, ck));").get();
+        auto& db = e.local_db();
+        auto& cf = db.find_column_family("ks", "ts");
+        for (int ts = 1; ts <= 3; ++ts) {
+            e.execute_cql(sprint("insert into ks.ts (pk, ck, v) values (0, 1, %d) using timestamp %d;", ts, ts)).get();
+            cf.flush().get();
+        }
+        auto s = cf.schema();
+        auto pkey = partition_key::from_single_value(*s, int32_type->decompose(0));
+        auto pranges = dht::partition_range_vector{
+            dht::partition_range::make_singular(dht::global_partitioner().decorate_key(*s, pkey))};
+        auto max_size = std::numeric_limits<size_t>::max();
+
+        auto query = [&] (query::clustering_range range) {
+            auto slice = partition_slice_builder(*s).with_range(std::move(range)).with_regular_column(to_bytes("v")).build();
+            slice.options.set<query::partition_slice::option::bypass_cache>();
+            auto cmd = query::read_command(s->id(), s->version(), slice, query::max_rows);
+            auto result = db.query(s, cmd, query::result_request::only_result, pranges, nullptr, max_size).get0();
+            return query::result_set::from_raw_result(s, cmd.slice, *result);
+        };
+        auto ck = clustering_key_prefix::from_single_value(*s, int32_type->decompose(1));
+
+        // The newest sstable has the row, written after all the data of the
+        // other two.
+        auto rs = query(query::clustering_range::make_singular(ck));
+        assert_that(rs).has_only(a_row().with_column(to_bytes("v"), 3));
+        BOOST_REQUIRE_EQUAL(cf.cf_stats()->sstables_skipped_by_timestamp, 2);
+
+        // Ranges don't name their rows, so all sstables are read.
+        rs = query(query::clustering_range::make_starting_with({ck, true}));
+        assert_that(rs).has_only(a_row().with_column(to_bytes("v"), 3));
+        BOOST_REQUIRE_EQUAL(cf.cf_stats()->sstables_skipped_by_timestamp, 2);
+    });
+}
+
+SEASTAR_TEST_CASE(test_reads_naming_rows_narrow_to_incomplete_rows) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table ks.ts (pk int, ck int, v int, primary key (pk, ck));").get();
+        auto& db = e.local_db();
+        auto& cf = db.find_column_family("ks", "ts");
+        e.execute_cql("insert into ks.ts (pk, ck, v) values (0, 1, 1) using timestamp 1;").get();
+        e.execute_cql("insert into ks.ts (pk, ck, v) values (0, 2, 1) using timestamp 1;").get();
+        cf.flush().get();
+        e.execute_cql("insert into ks.ts (pk, ck, v) values (0, 1, 2) using timestamp 2;").get();
+        cf.flush().get();
+        e.execute_cql("insert into ks.ts (pk, ck, v) values (0, 1, 3) using timestamp 3;").get();
+        cf.flush().get();
+
+        auto s = cf.schema();
+        auto pkey = partition_key::from_single_value(*s, int32_type->decompose(0));
+        auto pranges = dht::partition_range_vector{
+            dht::partition_range::make_singular(dht::global_partitioner().decorate_key(*s, pkey))};
+        auto ck1 = clustering_key_prefix::from_single_value(*s, int32_type->decompose(1));
+        auto ck2 = clustering_key_prefix::from_single_value(*s, int32_type->decompose(2));
+        auto slice = partition_slice_builder(*s)
+            .with_ranges({query::clustering_range::make_singular(ck1), query::clustering_range::make_singular(ck2)})
+            .with_regular_column(to_bytes("v"))
+            .build();
+        slice.options.set<query::partition_slice::option::bypass_cache>();
+        auto cmd = query::read_command(s->id(), s->version(), slice, query::max_rows);
+
+        // The newest sstable completes the first row, the oldest one has
+        // the second, which only the oldest one is asked for.
+        auto result = db.query(s, cmd, query::result_request::only_result, pranges, nullptr,
+            std::numeric_limits<size_t>::max()).get0();
+        assert_that(query::result_set::from_raw_result(s, cmd.slice, *result))
+            .has_size(2)
+            .has(a_row().with_column(to_bytes("ck"), 1).with_column(to_bytes("v"), 3))
+            .has(a_row().with_column(to_bytes("ck"), 2).with_column(to_bytes("v"), 1));
+        BOOST_REQUIRE_EQUAL(cf.cf_stats()->sstables_skipped_by_timestamp, 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_snapshot_lists_all_sstables) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table ks.cf (k int primary key, v int);").get();
+        for (int i = 0; i < 3; ++i) {
+            e.execute_cql(sprint("insert into ks.cf (k, v) values (%d, %d);", i, i)).get();
+            e.db().invoke_on_all([] (database& db) {
+                return db.find_column_family("ks", "cf").flush();
+            }).get();
+        }
+        e.db().invoke_on_all([] (database& db) {
+            return db.find_column_family("ks", "cf").snapshot("test");
+        }).get();
+
+        auto& cf = e.local_db().find_column_family("ks", "cf");
+        BOOST_REQUIRE(cf.snapshot_exists("test").get0());
+        std::ifstream manifest(cf.dir() + "/snapshots/test/manifest.json");
+        std::string json((std::istreambuf_iterator<char>(manifest)), std::istreambuf_iterator<char>());
+        size_t sstables = 0;
+        e.db().map_reduce0([] (database& db) {
+            return db.find_column_family("ks", "cf").get_sstables()->size();
+        }, size_t(0), std::plus<size_t>()).then([&sstables] (size_t n) {
+            sstables = n;
+        }).get();
+        BOOST_REQUIRE_EQUAL(sstables, 3);
+        size_t listed = 0;
+        for (auto pos = json.find("Data.db"); pos != std::string::npos; pos = json.find("Data.db", pos + 1)) {
+            ++listed;
+        }
+        BOOST_REQUIRE_EQUAL(listed, sstables);
+    });
+}
+
+SEASTAR_TEST_CASE(test_applying_mutations_together) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table ks.cf (k text, v int, primary key (k));").get();
+        auto& db = e.local_db();
+        auto s = db.find_schema("ks", "cf");
+        std::vector<frozen_mutation> fms;
+        dht::partition_range_vector pranges;
+        for (uint32_t i = 1; i <= 8; ++i) {
+            auto pkey = partition_key::from_single_value(*s, to_bytes(sprint("key%d", i)));
+            mutation m(pkey, s);
+            m.set_clustered_cell(clustering_key_prefix::make_empty(), "v", data_value(int32_t(i)), 1);
+            fms.push_back(freeze(m));
+            pranges.emplace_back(dht::partition_range::make_singular(dht::global_partitioner().decorate_key(*s, std::move(pkey))));
+        }
+        std::vector<const frozen_mutation*> batch;
+        for (auto& fm : fms) {
+            batch.push_back(&fm);
+        }
+        db.apply(s, batch).get();
+
+        auto cmd = query::read_command(s->id(), s->version(), partition_slice_builder(*s).build(), query::max_rows);
+        auto result = db.query(s, cmd, query::result_request::only_result, pranges, nullptr, std::numeric_limits<size_t>::max()).get0();
+        assert_that(query::result_set::from_raw_result(s, cmd.slice, *result)).has_size(8);
+    });
+}
+
+SEASTAR_TEST_CASE(test_per_partition_rate_limit_option) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table ks.cf (k text, v int, primary key (k)) with per_partition_rate_limit = {'max_writes_per_second': 10};").get();
+        auto& db = e.local_db();
+        auto s = db.find_schema("ks", "cf");
+        BOOST_REQUIRE_EQUAL(s->per_partition_rate_limit_options().max_writes_per_second(), 10);
+        BOOST_REQUIRE_EQUAL(s->per_partition_rate_limit_options().max_reads_per_second(), 0);
+        BOOST_REQUIRE(db.find_column_family(s).has_rate_limit());
+
+        e.execute_cql("alter table ks.cf with per_partition_rate_limit = {'max_reads_per_second': 5};").get();
+        s = db.find_schema("ks", "cf");
+        BOOST_REQUIRE_EQUAL(s->per_partition_rate_limit_options().max_writes_per_second(), 0);
+        BOOST_REQUIRE_EQUAL(s->per_partition_rate_limit_options().max_reads_per_second(), 5);
+
+        e.execute_cql("alter table ks.cf with per_partition_rate_limit = {};").get();
+        s = db.find_schema("ks", "cf");
+        BOOST_REQUIRE(!s->per_partition_rate_limit_options().enabled());
+        BOOST_REQUIRE(!db.find_column_family(s).has_rate_limit());
+
+        BOOST_REQUIRE_THROW(e.execute_cql("alter table ks.cf with per_partition_rate_limit = {'max_writes_per_second': -1};").get(),
+                exceptions::configuration_exception);
+    });
+}
+
+SEASTAR_TEST_CASE(test_per_partition_rate_limiter) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table ks.cf (k text, v int, primary key (k));").get();
+        auto s = e.local_db().find_schema("ks", "cf");
+        using op_type = db::per_partition_rate_limiter::op_type;
+        db::per_partition_rate_limiter limiter(s, db::per_partition_rate_limit_options(2, 0));
+        auto key1 = partition_key::from_single_value(*s, to_bytes("key1"));
+        auto key2 = partition_key::from_single_value(*s, to_bytes("key2"));
+        auto now = db::per_partition_rate_limiter::clock_type::now();
+
+        BOOST_REQUIRE(limiter.account(op_type::write, key1, now));
+        BOOST_REQUIRE(limiter.account(op_type::write, key1, now));
+        BOOST_REQUIRE(!limiter.account(op_type::write, key1, now));
+        BOOST_REQUIRE(!limiter.account(op_type::write, key1, now));
+        BOOST_REQUIRE(limiter.account(op_type::write, key2, now));
+        for (int i = 0; i < 10; ++i) {
+            BOOST_REQUIRE(limiter.account(op_type::read, key1, now));
+        }
+
+        // A new window starts every second.
+        now += db::per_partition_rate_limiter::window;
+        BOOST_REQUIRE(limiter.account(op_type::write, key1, now));
+
+        auto offenders = limiter.top_offenders(10);
+        BOOST_REQUIRE(offenders.reads.empty());
+        BOOST_REQUIRE_EQUAL(offenders.writes.size(), 1);
+        BOOST_REQUIRE(partition_key::equality(*s)(offenders.writes[0].item, key1));
+        BOOST_REQUIRE_EQUAL(offenders.writes[0].count, 2);
+    });
+}
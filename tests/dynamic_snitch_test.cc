@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include "locator/dynamic_snitch.hh"
+
+#include "tests/test-utils.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+using namespace std::chrono_literals;
+
+static const gms::inet_address ep1("127.0.0.1");
+static const gms::inet_address ep2("127.0.0.2");
+static const gms::inet_address ep3("127.0.0.3");
+
+SEASTAR_TEST_CASE(test_keeps_proximity_order_within_threshold) {
+    locator::dynamic_snitch ds(0.1, 1h);
+    ds.add_latency(ep1, 1050us);
+    ds.add_latency(ep2, 1000us);
+    ds.add_latency(ep3, 1000us);
+    std::vector<gms::inet_address> eps{ep1, ep2, ep3};
+    ds.sort_by_score(eps);
+    BOOST_REQUIRE(eps == std::vector<gms::inet_address>({ep1, ep2, ep3}));
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_moves_slow_endpoint_back) {
+    locator::dynamic_snitch ds(0.1, 1h);
+    ds.add_latency(ep1, 10000us);
+    ds.add_latency(ep2, 1000us);
+    ds.add_latency(ep3, 1000us);
+    std::vector<gms::inet_address> eps{ep1, ep2, ep3};
+    ds.sort_by_score(eps);
+    // Equal scores keep their proximity order.
+    BOOST_REQUIRE(eps == std::vector<gms::inet_address>({ep2, ep3, ep1}));
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_needs_all_scores) {
+    locator::dynamic_snitch ds(0.1, 1h);
+    ds.add_latency(ep1, 10000us);
+    ds.add_latency(ep2, 1000us);
+    std::vector<gms::inet_address> eps{ep1, ep2, ep3};
+    ds.sort_by_score(eps);
+    BOOST_REQUIRE(eps == std::vector<gms::inet_address>({ep1, ep2, ep3}));
+    BOOST_REQUIRE(!ds.get_score(ep3));
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_score_follows_latency) {
+    locator::dynamic_snitch ds(0.1, 1h);
+    ds.add_latency(ep1, 1000us);
+    for (int i = 0; i < 100; ++i) {
+        ds.add_latency(ep1, 100us);
+    }
+    BOOST_REQUIRE(ds.get_score(ep1));
+    BOOST_REQUIRE_CLOSE(*ds.get_score(ep1), 100, 1);
+    return make_ready_future<>();
+}
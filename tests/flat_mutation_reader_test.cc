@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <boost/range/algorithm/sort.hpp>
+
+#include "tests/test-utils.hh"
+#include "tests/mutation_assertions.hh"
+#include "tests/mutation_reader_assertions.hh"
+#include "tests/mutation_source_test.hh"
+
+#include "flat_mutation_reader.hh"
+#include "core/thread.hh"
+#include "schema_builder.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+// Random mutations, in the order of their keys, with distinct keys.
+static std::vector<mutation> make_sorted_mutations(random_mutation_generator& gen, size_t n) {
+    auto s = gen.schema();
+    std::vector<mutation> ms;
+    for (size_t i = 0; i < n; ++i) {
+        ms.emplace_back(gen());
+    }
+    boost::sort(ms, [&s] (const mutation& a, const mutation& b) {
+        return a.decorated_key().less_compare(*s, b.decorated_key());
+    });
+    std::vector<mutation> ret;
+    for (auto&& m : ms) {
+        if (!ret.empty() && ret.back().decorated_key().equal(*s, m.decorated_key())) {
+            ret.back().apply(m);
+        } else {
+            ret.emplace_back(std::move(m));
+        }
+    }
+    return ret;
+}
+
+static flat_mutation_reader make_flat_reader_returning(schema_ptr s, std::vector<mutation> ms) {
+    return flat_mutation_reader_from_mutation_reader(s, make_reader_returning_many(std::move(ms)));
+}
+
+SEASTAR_TEST_CASE(test_flat_reader_round_trip) {
+    return seastar::async([] {
+        random_mutation_generator gen(random_mutation_generator::generate_counters::no);
+        auto ms = make_sorted_mutations(gen, 32);
+
+        assert_that(mutation_reader_from_flat_mutation_reader(make_flat_reader_returning(gen.schema(), ms)))
+            .produces(ms)
+            .produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(test_flat_reader_emits_partitions_in_order) {
+    return seastar::async([] {
+        random_mutation_generator gen(random_mutation_generator::generate_counters::no);
+        auto s = gen.schema();
+        auto ms = make_sorted_mutations(gen, 16);
+
+        auto rd = make_flat_reader_returning(s, ms);
+        auto it = ms.begin();
+        bool in_partition = false;
+        while (auto f = rd().get0()) {
+            if (f->is_partition_start()) {
+                BOOST_REQUIRE(!in_partition);
+                BOOST_REQUIRE(it != ms.end());
+                BOOST_REQUIRE(f->as_partition_start().key().equal(*s, it->decorated_key()));
+                BOOST_REQUIRE(f->as_partition_start().partition_tombstone() == it->partition().partition_tombstone());
+                in_partition = true;
+            } else if (f->is_partition_end()) {
+                BOOST_REQUIRE(in_partition);
+                in_partition = false;
+                ++it;
+            } else {
+                BOOST_REQUIRE(in_partition);
+            }
+        }
+        BOOST_REQUIRE(!in_partition);
+        BOOST_REQUIRE(it == ms.end());
+    });
+}
+
+SEASTAR_TEST_CASE(test_combined_flat_reader) {
+    return seastar::async([] {
+        random_mutation_generator gen(random_mutation_generator::generate_counters::no);
+        auto s = gen.schema();
+        auto ms = make_sorted_mutations(gen, 32);
+
+        // Every third partition is in both readers.
+        std::vector<mutation> a;
+        std::vector<mutation> b;
+        for (size_t i = 0; i < ms.size(); ++i) {
+            if (i % 3 == 0 || i % 2 == 0) {
+                a.push_back(ms[i]);
+            }
+            if (i % 3 == 0 || i % 2 == 1) {
+                b.push_back(ms[i]);
+            }
+        }
+
+        std::vector<flat_mutation_reader> readers;
+        readers.push_back(make_flat_reader_returning(s, a));
+        readers.push_back(make_flat_reader_returning(s, b));
+        assert_that(mutation_reader_from_flat_mutation_reader(make_combined_flat_reader(s, std::move(readers))))
+            .produces(ms)
+            .produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(test_combined_flat_reader_merges_partitions) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("pk", bytes_type, column_kind::partition_key)
+            .with_column("v", bytes_type, column_kind::regular_column)
+            .build();
+
+        mutation m1(partition_key::from_single_value(*s, "key1"), s);
+        m1.set_clustered_cell(clustering_key::make_empty(), "v", data_value(bytes("v1")), 1);
+
+        mutation m2(partition_key::from_single_value(*s, "key1"), s);
+        m2.set_clustered_cell(clustering_key::make_empty(), "v", data_value(bytes("v2")), 2);
+
+        std::vector<flat_mutation_reader> readers;
+        readers.push_back(make_flat_reader_returning(s, {m1}));
+        readers.push_back(make_flat_reader_returning(s, {m2}));
+        assert_that(mutation_reader_from_flat_mutation_reader(make_combined_flat_reader(s, std::move(readers))))
+            .produces(m2)
+            .produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(test_consuming_flat_reader) {
+    return seastar::async([] {
+        random_mutation_generator gen(random_mutation_generator::generate_counters::no);
+        auto s = gen.schema();
+        auto ms = make_sorted_mutations(gen, 16);
+
+        struct consumer {
+            schema_ptr s;
+            std::vector<mutation>& result;
+
+            void consume_new_partition(const dht::decorated_key& dk) {
+                result.emplace_back(dk, s);
+            }
+            void consume(tombstone t) {
+                result.back().partition().apply(t);
+            }
+            stop_iteration consume(static_row&& sr) {
+                result.back().partition().static_row().apply(*s, column_kind::static_column, std::move(sr.cells()));
+                return stop_iteration::no;
+            }
+            stop_iteration consume(clustering_row&& cr) {
+                auto& dr = result.back().partition().clustered_row(*s, std::move(cr.key()));
+                dr.apply(cr.tomb());
+                dr.apply(cr.marker());
+                dr.cells().apply(*s, column_kind::regular_column, std::move(cr.cells()));
+                return stop_iteration::no;
+            }
+            stop_iteration consume(range_tombstone&& rt) {
+                result.back().partition().apply_row_tombstone(*s, std::move(rt));
+                return stop_iteration::no;
+            }
+            stop_iteration consume_end_of_partition() {
+                return stop_iteration::no;
+            }
+            void consume_end_of_stream() { }
+        };
+
+        std::vector<mutation> result;
+        auto rd = make_flat_reader_returning(s, ms);
+        rd.consume(consumer{s, result}).get();
+
+        BOOST_REQUIRE_EQUAL(result.size(), ms.size());
+        for (size_t i = 0; i < ms.size(); ++i) {
+            assert_that(result[i]).is_equal_to(ms[i]);
+        }
+    });
+}
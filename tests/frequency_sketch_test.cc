@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+#include "utils/frequency_sketch.hh"
+
+BOOST_AUTO_TEST_CASE(test_estimates_are_not_underestimates) {
+    utils::frequency_sketch sketch(1024);
+    BOOST_REQUIRE_EQUAL(sketch.width(), 1024);
+
+    std::default_random_engine rng;
+    std::vector<uint64_t> hot;
+    for (int i = 0; i < 8; i++) {
+        hot.push_back(rng());
+    }
+    for (int round = 0; round < 10; round++) {
+        for (auto h : hot) {
+            sketch.increment(h);
+        }
+        // One-hit wonders in between.
+        for (int i = 0; i < 100; i++) {
+            sketch.increment(rng());
+        }
+    }
+    for (auto h : hot) {
+        BOOST_REQUIRE_GE(sketch.estimate(h), 10);
+    }
+    // Collisions in all rows are unlikely with so few items.
+    unsigned cold_over_one = 0;
+    for (int i = 0; i < 1000; i++) {
+        cold_over_one += sketch.estimate(rng()) > 1;
+    }
+    BOOST_REQUIRE_LT(cold_over_one, 10);
+}
+
+BOOST_AUTO_TEST_CASE(test_counts_saturate_and_age) {
+    utils::frequency_sketch sketch(1024);
+    for (int i = 0; i < 100; i++) {
+        sketch.increment(1);
+    }
+    BOOST_REQUIRE_EQUAL(sketch.estimate(1), 15);
+
+    // Saturated counts are not additions, so only the others age them.
+    std::default_random_engine rng;
+    uint64_t n = 0;
+    while (sketch.estimate(1) == 15 && n++ < 2 * sketch.sample_size()) {
+        sketch.increment(rng());
+    }
+    BOOST_REQUIRE_GE(n, sketch.sample_size() - 15);
+    BOOST_REQUIRE_LE(sketch.estimate(1), 8);
+
+    sketch.clear();
+    BOOST_REQUIRE_EQUAL(sketch.estimate(1), 0);
+}
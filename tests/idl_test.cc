@@ -350,3 +350,47 @@ BOOST_AUTO_TEST_CASE(test_skip_does_not_deserialize)
         BOOST_REQUIRE(prev == final_composite_test_object::construction_count);
     }
 }
+
+BOOST_AUTO_TEST_CASE(test_views_of_non_writable_types)
+{
+    std::vector<simple_compound> vec1 = { { 1, 2 }, { 3, 4 }, { 5, 6 } };
+    std::vector<simple_compound> vec2 = { { 7, 8 }, { 9, 10 } };
+    vectors_of_compounds voc = { vec1, wrapped_vector { vec2 } };
+
+    bytes_ostream buf1;
+    ser::serialize(buf1, voc);
+
+    auto bv1 = buf1.linearize();
+    auto in1 = ser::as_input_stream(bv1);
+    auto voc_view = ser::deserialize(in1, boost::type<ser::vectors_of_compounds_view>());
+    auto&& first_view = voc_view.first();
+    BOOST_REQUIRE_EQUAL(vec1.size(), first_view.size());
+    for (size_t i = 0; i < first_view.size(); i++) {
+        BOOST_REQUIRE_EQUAL(vec1[i].foo, first_view[i].foo());
+        BOOST_REQUIRE_EQUAL(vec1[i].bar, first_view[i].bar());
+    }
+    auto&& second_view = voc_view.second().vector();
+    BOOST_REQUIRE_EQUAL(vec2.size(), second_view.size());
+    for (size_t i = 0; i < second_view.size(); i++) {
+        BOOST_REQUIRE_EQUAL(vec2[i], simple_compound(second_view[i]));
+    }
+    BOOST_REQUIRE_EQUAL(voc.second, wrapped_vector(voc_view.second()));
+
+    compound_with_optional cwo = { {}, { 11, 12 } };
+    bytes_ostream buf2;
+    ser::serialize(buf2, cwo);
+    auto in2 = ser::as_input_stream(buf2.linearize());
+    auto cwo_view = ser::deserialize(in2, boost::type<ser::compound_with_optional_view>());
+    BOOST_REQUIRE(!cwo_view.first());
+    BOOST_REQUIRE_EQUAL(cwo_view.second().bar(), 12);
+    BOOST_REQUIRE_EQUAL(cwo, compound_with_optional(cwo_view));
+
+    non_final_composite_test_object x({13, 14});
+    bytes_ostream buf3;
+    ser::serialize(buf3, x);
+    auto in3 = ser::as_input_stream(buf3.linearize());
+    auto prev = non_final_composite_test_object::construction_count;
+    auto x_view = ser::deserialize(in3, boost::type<ser::non_final_composite_test_object_view>());
+    BOOST_REQUIRE_EQUAL(x_view.x().foo(), 13);
+    BOOST_REQUIRE(prev == non_final_composite_test_object::construction_count);
+}
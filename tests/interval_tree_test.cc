@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+#include "utils/interval_tree.hh"
+
+BOOST_AUTO_TEST_CASE(test_overlapping_intervals_are_found) {
+    utils::interval_tree<int, int> tree;
+    tree.insert(0, 10, 1);
+    tree.insert(5, 6, 2);
+    tree.insert(20, 30, 3);
+    tree.insert(8, 25, 4);
+    tree.insert(40, 40, 5);
+
+    BOOST_REQUIRE_EQUAL(tree.size(), 5);
+    BOOST_REQUIRE(tree.overlapping(0, 4) == std::vector<int>({1}));
+    BOOST_REQUIRE(tree.overlapping(6, 6) == std::vector<int>({1, 2}));
+    BOOST_REQUIRE(tree.overlapping(9, 20) == std::vector<int>({1, 4, 3}));
+    BOOST_REQUIRE(tree.overlapping(31, 39).empty());
+    BOOST_REQUIRE(tree.overlapping(40, 100) == std::vector<int>({5}));
+    BOOST_REQUIRE(tree.overlapping(-10, -1).empty());
+    BOOST_REQUIRE(tree.values() == std::vector<int>({1, 2, 4, 3, 5}));
+
+    BOOST_REQUIRE(tree.erase(4));
+    BOOST_REQUIRE(!tree.erase(4));
+    BOOST_REQUIRE(tree.overlapping(11, 19).empty());
+    BOOST_REQUIRE(tree.overlapping(9, 20) == std::vector<int>({1, 3}));
+}
+
+BOOST_AUTO_TEST_CASE(test_against_linear_scan) {
+    std::default_random_engine rng;
+    std::uniform_int_distribution<int> position(0, 1000);
+    std::uniform_int_distribution<int> width(0, 50);
+
+    utils::interval_tree<int, int> tree;
+    std::vector<std::pair<int, int>> intervals;
+    for (int i = 0; i < 500; ++i) {
+        auto start = position(rng);
+        auto end = start + width(rng);
+        tree.insert(start, end, i);
+        intervals.emplace_back(start, end);
+        if (i % 7 == 0) {
+            auto victim = i / 2;
+            tree.erase(victim);
+            intervals[victim] = {-1, -2};
+        }
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        auto start = position(rng);
+        auto end = start + width(rng);
+        auto found = tree.overlapping(start, end);
+        std::sort(found.begin(), found.end());
+        std::vector<int> expected;
+        for (int j = 0; j < int(intervals.size()); ++j) {
+            if (intervals[j].first <= end && intervals[j].second >= start) {
+                expected.push_back(j);
+            }
+        }
+        BOOST_REQUIRE(found == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_copies_are_independent) {
+    utils::interval_tree<int, int> tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(i, i + 5, i);
+    }
+    auto copy = tree;
+
+    BOOST_REQUIRE(tree.erase(10, 10));
+    BOOST_REQUIRE(!tree.erase(11, 10));
+    tree.insert(10, 10, 1000);
+    copy.insert(50, 50, 2000);
+
+    BOOST_REQUIRE_EQUAL(tree.size(), 100);
+    BOOST_REQUIRE_EQUAL(copy.size(), 101);
+    BOOST_REQUIRE(tree.overlapping(10, 10) == std::vector<int>({5, 6, 7, 8, 9, 1000}));
+    BOOST_REQUIRE(copy.overlapping(10, 10) == std::vector<int>({5, 6, 7, 8, 9, 10}));
+    BOOST_REQUIRE(tree.overlapping(50, 50) == std::vector<int>({45, 46, 47, 48, 49, 50}));
+    BOOST_REQUIRE(copy.overlapping(50, 50) == std::vector<int>({45, 46, 47, 48, 49, 50, 2000}));
+}
+
+BOOST_AUTO_TEST_CASE(test_first_start_after) {
+    utils::interval_tree<int, int> tree;
+    BOOST_REQUIRE(!tree.first_start_after(0));
+    tree.insert(10, 20, 1);
+    tree.insert(30, 40, 2);
+    tree.insert(30, 35, 3);
+
+    BOOST_REQUIRE_EQUAL(*tree.first_start_after(0), 10);
+    BOOST_REQUIRE_EQUAL(*tree.first_start_after(10), 30);
+    BOOST_REQUIRE_EQUAL(*tree.first_start_after(29), 30);
+    BOOST_REQUIRE(!tree.first_start_after(30));
+}
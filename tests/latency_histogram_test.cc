@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include "utils/latency_histogram.hh"
+
+BOOST_AUTO_TEST_CASE(test_bucket_bounds) {
+    using utils::latency_histogram;
+    auto check = [] (uint64_t v) {
+        auto b = latency_histogram::bucket_of(v);
+        auto upper = latency_histogram::bucket_upper_bound(b);
+        BOOST_REQUIRE_GE(upper, v);
+        BOOST_REQUIRE_EQUAL(latency_histogram::bucket_of(upper), b);
+        BOOST_REQUIRE_NE(latency_histogram::bucket_of(upper + 1), b);
+        // Buckets are at most a quarter of their lower bound wide.
+        BOOST_REQUIRE_LE(upper - v, v / 4);
+    };
+    for (uint64_t v = 0; v < 100000; ++v) {
+        check(v);
+    }
+    for (uint64_t v = 100000; v < utils::latency_histogram_options.max_size; v += 997) {
+        check(v);
+    }
+    BOOST_REQUIRE_EQUAL(latency_histogram::bucket_of(uint64_t(1) << 40), latency_histogram::bucket_count - 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_quantiles_and_merge) {
+    utils::latency_histogram a, b;
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        a.add(i);
+        b.add(i + 1000);
+    }
+    BOOST_REQUIRE_EQUAL(a.count(), 1000);
+    BOOST_REQUIRE_EQUAL(a.sum(), 500500);
+    BOOST_REQUIRE_EQUAL(a.max(), 1000);
+    auto median = a.quantile(0.5);
+    BOOST_REQUIRE_GE(median, 500);
+    BOOST_REQUIRE_LE(median, 500 * 5 / 4);
+    BOOST_REQUIRE_EQUAL(a.quantile(1), 1000);
+
+    a += b;
+    BOOST_REQUIRE_EQUAL(a.count(), 2000);
+    BOOST_REQUIRE_EQUAL(a.max(), 2000);
+    median = a.quantile(0.5);
+    BOOST_REQUIRE_GE(median, 1000);
+    BOOST_REQUIRE_LE(median, 1000 * 5 / 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_sampled_latencies) {
+    utils::latency_histogram h;
+    h.add(std::chrono::microseconds(100), 10);
+    BOOST_REQUIRE_EQUAL(h.count(), 10);
+    BOOST_REQUIRE_EQUAL(h.sum(), 1000);
+    // A sample which doesn't count anything new is ignored.
+    h.add(std::chrono::microseconds(5000), 10);
+    BOOST_REQUIRE_EQUAL(h.count(), 10);
+    BOOST_REQUIRE_EQUAL(h.max(), 100);
+    h.add(std::chrono::microseconds(200), 11);
+    BOOST_REQUIRE_EQUAL(h.count(), 11);
+    BOOST_REQUIRE_EQUAL(h.buckets()[utils::latency_histogram::bucket_of(100)], 10);
+}
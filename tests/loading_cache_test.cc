@@ -0,0 +1,125 @@
+/*
+ * Copyright 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/shared_future.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+
+#include "seastarx.hh"
+#include "tests/test-utils.hh"
+#include "exceptions/exceptions.hh"
+#include "utils/loading_cache.hh"
+#include "log.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+static logging::logger test_logger("loading_cache_test");
+
+using namespace std::chrono_literals;
+
+SEASTAR_TEST_CASE(test_values_are_reloaded_in_the_background_in_batches) {
+    return seastar::async([] {
+        using cache_type = utils::loading_cache<int, int>;
+        unsigned loads = 0;
+        std::vector<std::vector<int>> batches;
+        promise<> reloaded;
+        shared_future<> release_reload(reloaded.get_future());
+        int version = 0;
+
+        cache_type cache(100, 10s, 100ms, test_logger,
+            [&] (const int& k) {
+                ++loads;
+                return make_ready_future<int>(k + version);
+            },
+            [&] (const std::vector<int>& keys) {
+                batches.push_back(keys);
+                return release_reload.get_future().then([&keys, &version] {
+                    cache_type::reload_result_type result;
+                    for (auto k : keys) {
+                        result.emplace_back(k + version);
+                    }
+                    return result;
+                });
+            });
+
+        BOOST_REQUIRE_EQUAL(cache.get(1).get0(), 1);
+        BOOST_REQUIRE_EQUAL(cache.get(2).get0(), 2);
+        BOOST_REQUIRE_EQUAL(loads, 2);
+
+        version = 10;
+        while (batches.empty()) {
+            sleep(10ms).get();
+        }
+
+        // Both values got due at once, and are reloaded together.
+        BOOST_REQUIRE_EQUAL(batches.size(), 1);
+        auto keys = batches[0];
+        std::sort(keys.begin(), keys.end());
+        BOOST_REQUIRE(keys == std::vector<int>({1, 2}));
+
+        // The old values are served while the reload is in progress.
+        auto f = cache.get(1);
+        BOOST_REQUIRE(f.available());
+        BOOST_REQUIRE_EQUAL(f.get0(), 1);
+        BOOST_REQUIRE_EQUAL(loads, 2);
+
+        reloaded.set_value();
+        while (cache.get(2).get0() != 12) {
+            sleep(10ms).get();
+        }
+        BOOST_REQUIRE_EQUAL(cache.get(1).get0(), 11);
+        BOOST_REQUIRE_EQUAL(loads, 2);
+
+        cache.stop().get();
+    });
+}
+
+SEASTAR_TEST_CASE(test_failed_reloads_keep_the_old_value) {
+    return seastar::async([] {
+        unsigned loads = 0;
+        bool fail = false;
+
+        utils::loading_cache<int, int> cache(100, 10s, 100ms, test_logger,
+            [&] (const int& k) {
+                ++loads;
+                if (fail) {
+                    return make_exception_future<int>(std::runtime_error("injected"));
+                }
+                return make_ready_future<int>(k);
+            });
+
+        BOOST_REQUIRE_EQUAL(cache.get(1).get0(), 1);
+
+        fail = true;
+        auto loads_before = loads;
+        while (loads < loads_before + 2) {
+            sleep(10ms).get();
+        }
+        BOOST_REQUIRE_EQUAL(cache.get(1).get0(), 1);
+
+        cache.stop().get();
+    });
+}
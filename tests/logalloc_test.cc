@@ -307,6 +307,97 @@ SEASTAR_TEST_CASE(test_merging) {
     });
 }
 
+struct evictable_item {
+    using link_type = boost::intrusive::list_member_hook<boost::intrusive::link_mode<boost::intrusive::auto_unlink>>;
+    link_type link;
+    unsigned id;
+    bool pinned;
+
+    evictable_item(unsigned id, bool pinned) : id(id), pinned(pinned) { }
+    evictable_item(evictable_item&& o) noexcept : id(o.id), pinned(o.pinned) {
+        link.swap_nodes(o.link);
+    }
+};
+
+using evictable_item_list = boost::intrusive::list<evictable_item,
+    boost::intrusive::member_hook<evictable_item, evictable_item::link_type, &evictable_item::link>,
+    boost::intrusive::constant_time_size<false>>;
+
+SEASTAR_TEST_CASE(test_segment_eviction) {
+    return seastar::async([] {
+        region reg;
+        with_allocator(reg.allocator(), [&] {
+            evictable_item_list items;
+            reg.make_segment_evictable([] (const migrate_fn_type* migrator, void* obj) {
+                auto item = static_cast<evictable_item*>(obj);
+                if (migrator == &standard_migrator<evictable_item>::object && !item->pinned) {
+                    current_allocator().destroy(item);
+                }
+            });
+
+            // Items are allocated in order, so the oldest segments have no
+            // pinned items, the following ones some, and the youngest ones
+            // only pinned ones.
+            const unsigned per_segment = segment_size / sizeof(evictable_item);
+            const unsigned count = per_segment * 6;
+            for (unsigned i = 0; i < count; i++) {
+                bool pinned = i >= per_segment * 4 || (i >= per_segment * 2 && i % 10 == 0);
+                items.push_back(*current_allocator().construct<evictable_item>(i, pinned));
+            }
+
+            auto total = reg.occupancy().total_space();
+            auto counter = reg.reclaim_counter();
+            BOOST_REQUIRE(reg.evict_oldest_segment() == memory::reclaiming_result::reclaimed_something);
+            BOOST_REQUIRE(reg.reclaim_counter() != counter);
+            // Freed without moving anything into another segment.
+            BOOST_REQUIRE_EQUAL(reg.occupancy().total_space(), total - segment_size);
+
+            // The oldest items are gone, the others are intact.
+            auto expected = items.front().id;
+            BOOST_REQUIRE_GT(expected, 0);
+            for (auto&& item : items) {
+                BOOST_REQUIRE_EQUAL(item.id, expected++);
+            }
+            BOOST_REQUIRE_EQUAL(expected, count);
+
+            while (items.front().id < per_segment * 2) {
+                BOOST_REQUIRE(reg.evict_oldest_segment() == memory::reclaiming_result::reclaimed_something);
+            }
+
+            // Pinned items are moved out of the segment instead.
+            auto first = items.front().id;
+            BOOST_REQUIRE(reg.evict_oldest_segment() == memory::reclaiming_result::reclaimed_something);
+            expected = first;
+            bool evicted = false;
+            for (auto&& item : items) {
+                while (expected < item.id) {
+                    BOOST_REQUIRE(expected % 10 != 0);
+                    evicted = true;
+                    ++expected;
+                }
+                BOOST_REQUIRE_EQUAL(item.id, expected++);
+            }
+            BOOST_REQUIRE(evicted);
+
+            auto has_unpinned = [&] {
+                return std::any_of(items.begin(), items.end(), [] (const evictable_item& item) { return !item.pinned; });
+            };
+            while (has_unpinned()) {
+                BOOST_REQUIRE(reg.evict_oldest_segment() == memory::reclaiming_result::reclaimed_something);
+            }
+
+            // Segments of only pinned items are left as they are.
+            auto remaining = std::distance(items.begin(), items.end());
+            BOOST_REQUIRE(reg.evict_oldest_segment() == memory::reclaiming_result::reclaimed_nothing);
+            BOOST_REQUIRE_EQUAL(std::distance(items.begin(), items.end()), remaining);
+
+            items.clear_and_dispose([] (evictable_item* item) {
+                current_allocator().destroy(item);
+            });
+        });
+    });
+}
+
 #ifndef DEFAULT_ALLOCATOR
 SEASTAR_TEST_CASE(test_region_lock) {
     return seastar::async([] {
@@ -713,6 +804,66 @@ SEASTAR_TEST_CASE(test_region_groups_fifo_order) {
     });
 }
 
+SEASTAR_TEST_CASE(test_region_groups_weighted_fair_admission) {
+    // tests that blocked requests of different admission classes are released in
+    // proportion to the weights of the classes, in terms of their costs
+    return seastar::async([] {
+        region_group_reclaimer simple_reclaimer(logalloc::segment_size);
+
+        test_region_group rg(simple_reclaimer);
+        region_group::admission_class large(rg);
+        region_group::admission_class small(rg);
+        region_group::admission_class heavy(rg, 2);
+
+        auto region = std::make_unique<test_region>(rg);
+        region->alloc();
+        BOOST_REQUIRE_GE(rg.memory_used(), logalloc::segment_size);
+
+        auto order = make_lw_shared<sstring>();
+        std::vector<future<>> executions;
+        auto run = [&] (region_group::admission_class& cls, size_t cost, char c) {
+            auto fut = rg.run_when_memory_available(cls, cost, [order, c] {
+                *order += c;
+            });
+            BOOST_REQUIRE_EQUAL(fut.available(), false);
+            executions.push_back(std::move(fut));
+        };
+
+        // Requests of a class costing 10 times more than those of another
+        // one, queued first, don't hold up the cheaper ones.
+        for (int i = 0; i < 3; ++i) {
+            run(large, 10, 'L');
+        }
+        for (int i = 0; i < 5; ++i) {
+            run(small, 1, 's');
+        }
+        BOOST_REQUIRE_EQUAL(rg.blocked_requests(), 8);
+        BOOST_REQUIRE_EQUAL(small.blocked_requests(), 5);
+
+        region.reset();
+        quiesce(when_all(executions.begin(), executions.end()));
+        BOOST_REQUIRE_EQUAL(*order, "sssssLLL");
+        BOOST_REQUIRE_EQUAL(small.wait_time()._count, 5);
+        BOOST_REQUIRE_EQUAL(large.wait_time()._count, 3);
+
+        // A class with twice the weight gets released twice as often.
+        region = std::make_unique<test_region>(rg);
+        region->alloc();
+        order->clear();
+        executions.clear();
+        for (int i = 0; i < 6; ++i) {
+            run(heavy, 1, 'h');
+            run(small, 1, 's');
+        }
+
+        region.reset();
+        quiesce(when_all(executions.begin(), executions.end()));
+        BOOST_REQUIRE_EQUAL(order->size(), 12);
+        BOOST_REQUIRE_EQUAL(std::count(order->begin(), order->begin() + 9, 'h'), 6);
+        BOOST_REQUIRE_EQUAL(rg.blocked_requests(), 0);
+    });
+}
+
 SEASTAR_TEST_CASE(test_region_groups_linear_hierarchy_throttling_moving_restriction) {
     // Hierarchy here is A -> B -> C.
     // We will fill B causing an execution in C to fail. We then fill A and free B.
@@ -1187,3 +1338,96 @@ SEASTAR_TEST_CASE(test_reclaiming_runs_as_long_as_there_is_soft_pressure) {
         });
     });
 }
+
+#ifndef DEFAULT_ALLOCATOR
+SEASTAR_TEST_CASE(test_huge_page_coverage) {
+    return seastar::async([] {
+        static constexpr size_t huge_page_size = 2 << 20;
+        auto check = [] {
+            auto hp = shard_tracker().huge_pages();
+            BOOST_REQUIRE_GE(hp.total_bytes, shard_tracker().occupancy().total_space());
+            BOOST_REQUIRE_LE(hp.huge_page_bytes, hp.total_bytes);
+            BOOST_REQUIRE_EQUAL(hp.huge_page_bytes % huge_page_size, 0);
+            return hp;
+        };
+
+        region reg;
+        with_allocator(reg.allocator(), [&] {
+            std::vector<managed_bytes> objs;
+            // Enough segments for zones spanning several huge pages.
+            while (shard_tracker().occupancy().used_space() < 4 * huge_page_size) {
+                objs.emplace_back(managed_bytes::initialized_later(), 1024);
+            }
+            auto hp = check();
+            // The zones are aligned to huge pages, so only the ends of
+            // zones too small for them aren't covered.
+            BOOST_REQUIRE_GT(hp.huge_page_bytes, 0);
+
+            objs.clear();
+        });
+        reg.full_compaction();
+        shard_tracker().reclaim_all_free_segments();
+        check();
+    });
+}
+#endif
+
+#ifndef DEFAULT_ALLOCATOR // Because we need memory::stats().free_memory();
+SEASTAR_TEST_CASE(test_background_reclaim) {
+    return seastar::async([] {
+        region reg;
+        std::vector<managed_bytes> objs;
+        size_t evictions = 0;
+        reg.make_evictable([&] {
+            if (objs.empty()) {
+                return memory::reclaiming_result::reclaimed_nothing;
+            }
+            with_allocator(reg.allocator(), [&] {
+                objs.pop_back();
+            });
+            ++evictions;
+            return memory::reclaiming_result::reclaimed_something;
+        });
+
+        static constexpr size_t filled = 64 << 20;
+        auto initial_free = memory::stats().free_memory();
+        with_allocator(reg.allocator(), [&] {
+            while (memory::stats().free_memory() + filled > initial_free) {
+                objs.emplace_back(managed_bytes::initialized_later(), 1024);
+            }
+        });
+        auto target = memory::stats().free_memory() + filled / 2;
+
+        shard_tracker().start_background_reclaim(target, 1);
+        auto stop_reclaim = defer([] { shard_tracker().stop_background_reclaim(); });
+
+        // Waits until a few reclaim periods went by without any eviction.
+        auto wait_for_idle_reclaimer = [&] {
+            for (int i = 0; i < 1000; i++) {
+                auto before = evictions;
+                sleep(std::chrono::milliseconds(50)).get();
+                if (evictions == before) {
+                    return;
+                }
+            }
+            BOOST_FAIL("background reclaim didn't stop");
+        };
+        wait_for_idle_reclaimer();
+        BOOST_REQUIRE_GT(evictions, 0);
+        // Only what was needed to reach the target was evicted.
+        BOOST_REQUIRE(!objs.empty());
+
+        auto evicted = evictions;
+        sleep(std::chrono::milliseconds(100)).get();
+        BOOST_REQUIRE_EQUAL(evictions, evicted);
+
+        // Free segments kept in zones count as free for allocations.
+        shard_tracker().reclaim_all_free_segments();
+        BOOST_REQUIRE_GE(memory::stats().free_memory(), target);
+
+        with_allocator(reg.allocator(), [&] {
+            objs.clear();
+        });
+    });
+}
+#endif
@@ -129,6 +129,7 @@ sstring random_string(size_t size) {
 }
 
 struct mutation_settings {
+    size_t partition_count;
     size_t column_count;
     size_t column_name_size;
     size_t row_count;
@@ -137,7 +138,7 @@ struct mutation_settings {
     size_t data_size;
 };
 
-static mutation make_mutation(mutation_settings settings) {
+static schema_ptr make_schema(const mutation_settings& settings) {
     auto builder = schema_builder("ks", "cf")
         .with_column("pk", bytes_type, column_kind::partition_key)
         .with_column("ck", bytes_type, column_kind::clustering_key);
@@ -146,8 +147,10 @@ static mutation make_mutation(mutation_settings settings) {
         builder.with_column(to_bytes(random_string(settings.column_name_size)), bytes_type);
     }
 
-    auto s = builder.build();
+    return builder.build();
+}
 
+static mutation make_mutation(schema_ptr s, const mutation_settings& settings) {
     mutation m(partition_key::from_single_value(*s, bytes_type->decompose(data_value(random_bytes(settings.partition_key_size)))), s);
 
     for (size_t i = 0; i < settings.row_count; ++i) {
@@ -162,6 +165,8 @@ static mutation make_mutation(mutation_settings settings) {
 }
 
 struct sizes {
+    memory_footprint memtable_footprint;
+    memory_footprint cache_footprint;
     size_t memtable;
     size_t cache;
     size_t sstable;
@@ -170,8 +175,10 @@ struct sizes {
     size_t query_result;
 };
 
-static sizes calculate_sizes(const mutation& m) {
+// Sizes of the first mutation, and footprints of all of them.
+static sizes calculate_sizes(const std::vector<mutation>& ms) {
     sizes result;
+    auto& m = ms.front();
     auto s = m.schema();
     auto mt = make_lw_shared<memtable>(s);
     cache_tracker tracker;
@@ -187,6 +194,13 @@ static sizes calculate_sizes(const mutation& m) {
     result.memtable = mt->occupancy().used_space();
     result.cache = tracker.region().occupancy().used_space() - cache_initial_occupancy;     
     result.frozen = freeze(m).representation().size();
+
+    for (auto i = std::next(ms.begin()); i != ms.end(); ++i) {
+        mt->apply(*i);
+        cache.populate(*i);
+    }
+    result.memtable_footprint = mt->footprint();
+    result.cache_footprint = cache.footprint();
     result.canonical = canonical_mutation(m).representation().size();
     result.query_result = m.query(partition_slice_builder(*s).build(), query::result_request::only_result).buf().size();
 
@@ -203,12 +217,26 @@ static sizes calculate_sizes(const mutation& m) {
     return result;
 }
 
+static void print_footprint(const sstring& name, const memory_footprint& f) {
+    std::cout << "footprint of " << f.partitions << " partitions, " << f.rows << " rows, " << f.cells
+              << " cells in " << name << ":\n";
+    std::cout << " - objects:        " << f.objects << "\n";
+    std::cout << " - keys:           " << f.keys << "\n";
+    std::cout << " - tree nodes:     " << f.tree_nodes << "\n";
+    std::cout << " - values:         " << f.values << "\n";
+    std::cout << " - fragmentation:  " << f.fragmentation << "\n";
+    std::cout << " - total:          " << f.total() << "\n";
+    std::cout << " - bytes per row:  " << f.bytes_per_row() << "\n";
+    std::cout << " - bytes per cell: " << f.bytes_per_cell() << "\n";
+}
+
 int main(int argc, char** argv) {
     namespace bpo = boost::program_options;
     app_template app;
     app.add_options()
         ("column-count", bpo::value<size_t>()->default_value(5), "column count")
         ("column-name-size", bpo::value<size_t>()->default_value(2), "column name size")
+        ("partition-count", bpo::value<size_t>()->default_value(1), "partition count, for the memory footprint breakdown")
         ("row-count", bpo::value<size_t>()->default_value(1), "row count")
         ("partition-key-size", bpo::value<size_t>()->default_value(10), "partition key size")
         ("clustering-key-size", bpo::value<size_t>()->default_value(10), "clustering key size")
@@ -218,6 +246,7 @@ int main(int argc, char** argv) {
       return do_with_cql_env([&] (auto&& env) {
         return seastar::async([&] {
             mutation_settings settings;
+            settings.partition_count = std::max<size_t>(app.configuration()["partition-count"].as<size_t>(), 1);
             settings.column_count = app.configuration()["column-count"].as<size_t>();
             settings.column_name_size = app.configuration()["column-name-size"].as<size_t>();
             settings.row_count = app.configuration()["row-count"].as<size_t>();
@@ -225,8 +254,12 @@ int main(int argc, char** argv) {
             settings.clustering_key_size = app.configuration()["clustering-key-size"].as<size_t>();
             settings.data_size = app.configuration()["data-size"].as<size_t>();
 
-            auto m = make_mutation(settings);
-            auto sizes = calculate_sizes(m);
+            auto s = make_schema(settings);
+            std::vector<mutation> ms;
+            for (size_t i = 0; i < settings.partition_count; ++i) {
+                ms.push_back(make_mutation(s, settings));
+            }
+            auto sizes = calculate_sizes(ms);
 
             std::cout << "mutation footprint:" << "\n";
             std::cout << " - in cache:     " << sizes.cache << "\n";
@@ -236,6 +269,10 @@ int main(int argc, char** argv) {
             std::cout << " - canonical:    " << sizes.canonical << "\n";
             std::cout << " - query result: " << sizes.query_result << "\n";
 
+            std::cout << "\n";
+            print_footprint("memtable", sizes.memtable_footprint);
+            print_footprint("cache", sizes.cache_footprint);
+
             std::cout << "\n";
             size_calculator::print_cache_entry_size();
         });
@@ -32,6 +32,7 @@
 #include "mutation_source_test.hh"
 #include "mutation_reader_assertions.hh"
 #include "mutation_assertions.hh"
+#include "simple_schema.hh"
 
 #include "disk-error-handler.hh"
 
@@ -318,3 +319,119 @@ SEASTAR_TEST_CASE(test_segment_migration_during_flush) {
         BOOST_REQUIRE(std::is_sorted(virtual_dirty_values.begin(), virtual_dirty_values.end()));
     });
 }
+
+SEASTAR_TEST_CASE(test_memory_footprint) {
+    return seastar::async([] {
+        simple_schema ss;
+        auto s = ss.schema();
+        auto mt = make_lw_shared<memtable>(s);
+
+        auto f = mt->footprint();
+        BOOST_REQUIRE_EQUAL(f.partitions, 0);
+        BOOST_REQUIRE_EQUAL(f.rows, 0);
+        BOOST_REQUIRE_EQUAL(f.cells, 0);
+
+        const int partitions = 10;
+        const int rows_per_partition = 20;
+        auto long_value = sstring(sstring::initialized_later(), 100);
+        std::fill(long_value.begin(), long_value.end(), 'x');
+        for (auto&& pk : ss.make_pkeys(partitions)) {
+            mutation m(pk, s);
+            ss.add_static_row(m, "s");
+            for (int i = 0; i < rows_per_partition; ++i) {
+                // Long enough not to be stored inline.
+                ss.add_row(m, ss.make_ckey(sprint("%040d", i)), long_value);
+            }
+            mt->apply(m);
+        }
+
+        f = mt->footprint();
+        BOOST_REQUIRE_EQUAL(f.partitions, partitions);
+        BOOST_REQUIRE_EQUAL(f.rows, partitions * rows_per_partition);
+        BOOST_REQUIRE_EQUAL(f.cells, partitions * (rows_per_partition + 1));
+        BOOST_REQUIRE_GE(f.objects, f.rows * sizeof(rows_entry));
+        BOOST_REQUIRE_GE(f.keys, f.rows * 40);
+        BOOST_REQUIRE_GE(f.values, f.rows * long_value.size());
+        BOOST_REQUIRE_GT(f.tree_nodes, 0);
+        BOOST_REQUIRE_EQUAL(f.total(), mt->occupancy().total_space());
+        BOOST_REQUIRE_EQUAL(f.bytes_per_row(), f.total() / f.rows);
+    });
+}
+
+SEASTAR_TEST_CASE(test_partition_versions_are_merged_in_background) {
+    return seastar::async([] {
+        simple_schema ss;
+        auto s = ss.schema();
+        auto mt = make_lw_shared<memtable>(s);
+        auto& stats = partition_version_merger::shard_stats();
+        auto merged_before = stats.merged_versions;
+
+        auto pk = ss.make_pkey(0);
+        mutation expected(pk, s);
+        std::vector<mutation_reader> readers;
+        std::vector<streamed_mutation> streams;
+        const int versions = 10;
+        for (int i = 0; i < versions; ++i) {
+            mutation m(pk, s);
+            ss.add_row(m, ss.make_ckey(i), "v");
+            mt->apply(m);
+            expected.apply(m);
+            // Holding a snapshot makes the next write create a new version.
+            readers.push_back(mt->make_reader(s));
+            streams.push_back(std::move(*readers.back()().get0()));
+        }
+
+        streams.clear();
+        readers.clear();
+        while (stats.pending) {
+            later().get();
+        }
+        BOOST_REQUIRE_EQUAL(stats.merged_versions - merged_before, versions - 1);
+
+        assert_that(mt->make_reader(s))
+            .produces(expected)
+            .produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(test_token_filter_skips_absent_partitions) {
+    return seastar::async([] {
+        schema_ptr s = schema_builder("ks", "cf")
+                .with_column("pk", bytes_type, column_kind::partition_key)
+                .with_column("col", bytes_type, column_kind::regular_column)
+                .build();
+
+        auto mt = make_lw_shared<memtable>(s);
+        // More than the initial capacity of the filter, so that it's grown.
+        std::vector<mutation> ring = make_ring(s, 3000);
+        for (auto&& m : ring) {
+            set_column(m, "col");
+            mt->apply(m);
+        }
+
+        for (auto&& m : ring) {
+            BOOST_REQUIRE(mt->may_contain(m.decorated_key()));
+            auto pr = dht::partition_range::make_singular(m.decorated_key());
+            assert_that(mt->make_reader(s, pr))
+                .produces(m)
+                .produces_end_of_stream();
+        }
+
+        unsigned false_positives = 0;
+        for (auto&& m : make_ring(s, 3000)) {
+            if (mt->may_contain(m.decorated_key())) {
+                ++false_positives;
+            }
+            auto pr = dht::partition_range::make_singular(m.decorated_key());
+            BOOST_REQUIRE(!mt->has_partitions_in(pr));
+            assert_that(mt->make_reader(s, pr))
+                .produces_end_of_stream();
+        }
+        BOOST_REQUIRE_LT(false_positives, 300);
+
+        mt->clear_gently().get();
+        for (auto&& m : ring) {
+            BOOST_REQUIRE(!mt->may_contain(m.decorated_key()));
+        }
+    });
+}
@@ -22,6 +22,7 @@
 #define BOOST_TEST_MODULE core
 
 #include <boost/test/unit_test.hpp>
+#include <numeric>
 
 #include "utils/murmur_hash.hh"
 #include "bytes.hh"
@@ -120,5 +121,42 @@ BOOST_AUTO_TEST_CASE(test_hash_output) {
             utils::murmur_hash::hash3_x64_128(prefix.begin(), prefix.size(), seed, dst);
             assert_hashes_equal(prefix, dst, expected);
         }
+
+        // Test the incremental version, fed in pieces of growing sizes
+        {
+            utils::murmur_hash::hasher3_x64_128 h(seed);
+            size_t pos = 0;
+            for (size_t piece = 0; pos < prefix.size(); ++piece) {
+                auto n = std::min(piece, prefix.size() - pos);
+                h.update(reinterpret_cast<const char*>(prefix.begin() + pos), n);
+                pos += n;
+            }
+            std::array<uint64_t,2> dst;
+            h.finalize(dst);
+            assert_hashes_equal(prefix, dst, expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_hash_output) {
+    // All prefixes, so that short and long keys are mixed in all ways, and
+    // prefixes of bytes with the sign bit set, which are sign extended.
+    bytes negative(bytes::initialized_later(), 20);
+    std::iota(negative.begin(), negative.end(), -100);
+    std::vector<bytes_view> keys;
+    for (size_t i = 0; i <= full_sequence.size(); ++i) {
+        keys.push_back(bytes_view(full_sequence.begin(), i));
+    }
+    for (size_t i = 0; i <= negative.size(); ++i) {
+        keys.push_back(bytes_view(negative.begin(), i));
+    }
+
+    std::vector<std::array<uint64_t, 2>> results(keys.size());
+    utils::murmur_hash::hash3_x64_128(keys.data(), keys.size(), seed, results.data());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::array<uint64_t, 2> expected;
+        utils::murmur_hash::hash3_x64_128(keys[i], seed, expected);
+        BOOST_REQUIRE_EQUAL(results[i][0], expected[0]);
+        BOOST_REQUIRE_EQUAL(results[i][1], expected[1]);
     }
 }
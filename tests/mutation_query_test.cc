@@ -530,3 +530,28 @@ SEASTAR_TEST_CASE(test_partition_limit) {
         }
     });
 }
+
+SEASTAR_TEST_CASE(test_query_fails_after_timeout) {
+    return seastar::async([] {
+        auto s = make_schema();
+        auto now = gc_clock::now();
+
+        mutation m1(partition_key::from_single_value(*s, "key1"), s);
+        m1.set_clustered_cell(clustering_key::from_single_value(*s, bytes("A")), "v1", data_value(bytes("A:v")), 1);
+
+        auto src = make_source({m1});
+        auto slice = make_full_slice(*s);
+        auto expired = reader_timeout_clock::now() - std::chrono::seconds(1);
+
+        BOOST_REQUIRE_THROW(mutation_query(s, src, query::full_partition_range, slice, query::max_rows, query::max_partitions, now,
+                { }, nullptr, service::get_local_sstable_query_read_priority(), expired).get0(), timed_out_error);
+
+        query::result::builder builder(slice, query::result_request::only_result, { });
+        BOOST_REQUIRE_THROW(data_query(s, src, query::full_partition_range, slice, query::max_rows, query::max_partitions, now,
+                builder, nullptr, service::get_local_sstable_query_read_priority(), expired).get(), timed_out_error);
+
+        reconcilable_result result = mutation_query(s, src, query::full_partition_range, slice, query::max_rows, query::max_partitions, now,
+                { }, nullptr, service::get_local_sstable_query_read_priority(), reader_timeout_clock::now() + std::chrono::seconds(60)).get0();
+        assert_that(to_result_set(result, s, slice)).has_size(1);
+    });
+}
@@ -28,6 +28,8 @@
 #include "tests/mutation_reader_assertions.hh"
 
 #include "mutation_reader.hh"
+#include "memtable.hh"
+#include "partition_slice_builder.hh"
 #include "core/do_with.hh"
 #include "core/thread.hh"
 #include "schema_builder.hh"
@@ -309,6 +311,74 @@ SEASTAR_TEST_CASE(test_fast_forwarding_combining_reader) {
     });
 }
 
+// Opens the reader of each run of mutations only once the scan reaches its
+// first key, and closes it after its last one.
+class lazy_combined_reader final : public combined_mutation_reader {
+    schema_ptr _s;
+    std::deque<std::vector<mutation>> _pending;
+    std::list<mutation_reader> _open;
+    size_t _max_open = 0;
+protected:
+    virtual std::vector<mutation_reader*> create_new_readers(const dht::decorated_key* key) override {
+        std::vector<mutation_reader*> readers;
+        while (!_pending.empty() && (!key || !key->less_compare(*_s, _pending.front().front().decorated_key()))) {
+            _open.push_back(make_reader_returning_many(std::move(_pending.front())));
+            _pending.pop_front();
+            readers.push_back(&_open.back());
+            _max_open = std::max(_max_open, _open.size());
+            if (!key) {
+                break;
+            }
+        }
+        return readers;
+    }
+    virtual bool on_readers_exhausted(const std::vector<mutation_reader*>& readers) override {
+        _open.remove_if([&] (const mutation_reader& r) {
+            return std::find(readers.begin(), readers.end(), &r) != readers.end();
+        });
+        return true;
+    }
+public:
+    // runs must be sorted by their first key.
+    lazy_combined_reader(schema_ptr s, std::vector<std::vector<mutation>> runs)
+        : _s(std::move(s))
+        , _pending(std::make_move_iterator(runs.begin()), std::make_move_iterator(runs.end())) {
+        init_mutation_reader_set({ });
+    }
+    size_t max_open() const {
+        return _max_open;
+    }
+};
+
+SEASTAR_TEST_CASE(test_combining_reader_opens_readers_lazily) {
+    return seastar::async([] {
+        auto s = make_schema();
+        auto keys = generate_keys(s, 8);
+
+        // Two levels of non-overlapping runs, the second level overlapping
+        // the first one, and a run overlapping everything.
+        std::vector<std::vector<mutation>> runs {
+            { make_mutation_with_key(s, keys[0]), make_mutation_with_key(s, keys[7]) },
+            { make_mutation_with_key(s, keys[0]), make_mutation_with_key(s, keys[1]) },
+            { make_mutation_with_key(s, keys[1]), make_mutation_with_key(s, keys[2]) },
+            { make_mutation_with_key(s, keys[2]), make_mutation_with_key(s, keys[3]) },
+            { make_mutation_with_key(s, keys[3]), make_mutation_with_key(s, keys[5]) },
+            { make_mutation_with_key(s, keys[4]), make_mutation_with_key(s, keys[5]) },
+            { make_mutation_with_key(s, keys[6]), make_mutation_with_key(s, keys[7]) },
+        };
+
+        auto impl = std::make_unique<lazy_combined_reader>(s, std::move(runs));
+        auto& lazy = *impl;
+        auto reader = mutation_reader(std::move(impl));
+        auto assertions = assert_that(std::move(reader));
+        for (auto&& key : keys) {
+            assertions.produces(key);
+        }
+        assertions.produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(lazy.max_open(), 3);
+    });
+}
+
 SEASTAR_TEST_CASE(test_multi_range_reader) {
         return seastar::async([] {
             auto s = make_schema();
@@ -341,3 +411,155 @@ SEASTAR_TEST_CASE(test_multi_range_reader) {
                     .produces_end_of_stream();
         });
 }
+
+SEASTAR_TEST_CASE(test_restricted_reader_admission) {
+    return seastar::async([] {
+        auto s = make_schema();
+        auto keys = generate_keys(s, 1);
+        auto m = make_mutation_with_key(s, keys[0]);
+
+        reader_concurrency_semaphore sem(2, 2 * reader_concurrency_semaphore::new_reader_base_cost);
+        restricted_mutation_reader_config config;
+        config.sem = &sem;
+
+        auto make_reader = [&] {
+            return make_restricted_reader(config, [&] (reader_resource_tracker) {
+                return make_reader_returning(m);
+            });
+        };
+
+        auto reader1 = make_reader();
+        auto reader2 = make_reader();
+        auto reader3 = make_reader();
+
+        // Readers are only admitted once read from.
+        BOOST_REQUIRE_EQUAL(sem.available_resources().count, 2);
+        auto f1 = reader1();
+        auto f2 = reader2();
+        BOOST_REQUIRE(f1.available());
+        BOOST_REQUIRE(f2.available());
+        BOOST_REQUIRE_EQUAL(sem.available_resources().count, 0);
+
+        auto f3 = reader3();
+        BOOST_REQUIRE(!f3.available());
+        BOOST_REQUIRE_EQUAL(sem.waiters(), 1);
+
+        {
+            auto destroyed = std::move(reader1);
+        }
+        f3.get();
+        BOOST_REQUIRE_EQUAL(sem.waiters(), 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_reader_concurrency_semaphore_memory) {
+    return seastar::async([] {
+        reader_concurrency_semaphore sem(10, 2 * reader_concurrency_semaphore::new_reader_base_cost);
+
+        auto permit1 = sem.wait_admission().get0();
+        // The buffers of the first reader use up the memory, so the next
+        // reader waits for them even though there are reader slots left.
+        permit1->consume_memory(reader_concurrency_semaphore::new_reader_base_cost);
+        auto f2 = sem.wait_admission();
+        BOOST_REQUIRE(!f2.available());
+        BOOST_REQUIRE_EQUAL(sem.available_resources().count, 9);
+
+        permit1->signal_memory(reader_concurrency_semaphore::new_reader_base_cost);
+        auto permit2 = f2.get0();
+        BOOST_REQUIRE_EQUAL(sem.available_resources().count, 8);
+
+        permit1 = { };
+        permit2 = { };
+        BOOST_REQUIRE_EQUAL(sem.available_resources().count, 10);
+        BOOST_REQUIRE_EQUAL(sem.available_resources().memory, 2 * reader_concurrency_semaphore::new_reader_base_cost);
+
+        auto permit3 = sem.wait_admission().get0();
+        permit3->consume_memory(2 * reader_concurrency_semaphore::new_reader_base_cost);
+        BOOST_REQUIRE_THROW(sem.wait_admission(reader_concurrency_semaphore::clock::now()).get(), semaphore_timed_out);
+    });
+}
+
+SEASTAR_TEST_CASE(test_reversing_by_windows) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("pk", bytes_type, column_kind::partition_key)
+            .with_column("ck", int32_type, column_kind::clustering_key)
+            .with_column("s1", bytes_type, column_kind::static_column)
+            .with_column("v", bytes_type, column_kind::regular_column)
+            .build();
+        auto make_ck = [&s] (int32_t v) {
+            return clustering_key::from_single_value(*s, int32_type->decompose(v));
+        };
+
+        // Rows large enough for a window to fill the buffer of the reader.
+        mutation m(partition_key::from_single_value(*s, "key1"), s);
+        m.set_static_cell("s1", data_value(bytes("s")), 1);
+        for (int32_t i = 0; i < 20; ++i) {
+            m.set_clustered_cell(make_ck(i), "v", data_value(bytes(4096, int8_t('v'))), 2);
+        }
+        m.partition().apply_row_tombstone(*s, range_tombstone(make_ck(3), bound_kind::incl_start,
+            make_ck(12), bound_kind::incl_end, tombstone(1, gc_clock::now())));
+
+        auto mt = make_lw_shared<memtable>(s);
+        mt->apply(m);
+        size_t reads = 0;
+        auto source = mutation_source([&] (schema_ptr s, const dht::partition_range& pr, const query::partition_slice& slice) {
+            ++reads;
+            return mt->as_data_source()(s, pr, slice);
+        });
+        auto splitter = [&] (const dht::decorated_key&) {
+            return make_ready_future<std::vector<clustering_key_prefix>>(std::vector<clustering_key_prefix>{
+                make_ck(5), make_ck(10), make_ck(15)});
+        };
+
+        auto slice = partition_slice_builder(*s).reversed().build();
+        auto pr = dht::partition_range::make_singular(m.decorated_key());
+        auto rd = source(s, pr, slice);
+        auto rsm = reverse_streamed_mutation_by_windows(std::move(*rd().get0()), source, slice,
+            default_priority_class(), nullptr, splitter);
+        reads = 0;
+
+        struct rebuilder {
+            schema_ptr s;
+            mutation& m;
+            stdx::optional<clustering_key> last;
+
+            stop_iteration consume(static_row&& sr) {
+                BOOST_REQUIRE(!last);
+                m.partition().static_row().apply(*s, column_kind::static_column, std::move(sr.cells()));
+                return stop_iteration::no;
+            }
+            stop_iteration consume(clustering_row&& cr) {
+                if (last) {
+                    BOOST_REQUIRE(clustering_key::less_compare(*s)(cr.key(), *last));
+                }
+                last = cr.key();
+                auto& dr = m.partition().clustered_row(*s, std::move(cr.key()));
+                dr.apply(cr.tomb());
+                dr.apply(cr.marker());
+                dr.cells().apply(*s, column_kind::regular_column, std::move(cr.cells()));
+                return stop_iteration::no;
+            }
+            stop_iteration consume(range_tombstone&& rt) {
+                rt.flip();
+                m.partition().apply_row_tombstone(*s, std::move(rt));
+                return stop_iteration::no;
+            }
+        };
+
+        mutation result(m.decorated_key(), s);
+        rebuilder r{s, result, {}};
+
+        // Only the last window is read for the first rows.
+        auto mf = rsm().get0();
+        BOOST_REQUIRE(mf && mf->is_static_row());
+        std::move(*mf).consume(r);
+        BOOST_REQUIRE_EQUAL(reads, 1);
+
+        while ((mf = rsm().get0())) {
+            std::move(*mf).consume(r);
+        }
+        BOOST_REQUIRE_EQUAL(reads, 4);
+        assert_that(result).is_equal_to(m);
+    });
+}
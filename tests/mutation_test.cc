@@ -37,6 +37,7 @@
 #include "schema_builder.hh"
 #include "query-result-set.hh"
 #include "query-result-reader.hh"
+#include "query-result-writer.hh"
 #include "partition_slice_builder.hh"
 #include "tmpdir.hh"
 
@@ -203,6 +204,34 @@ SEASTAR_TEST_CASE(test_map_mutations) {
     });
 }
 
+SEASTAR_TEST_CASE(test_collection_merge) {
+    return seastar::async([] {
+        auto my_map_type = map_type_impl::get_instance(int32_type, utf8_type, true);
+        auto key = [] (int32_t k) { return int32_type->decompose(k); };
+        auto cell = [] (api::timestamp_type ts, sstring v) -> atomic_cell { return atomic_cell::make_live(ts, utf8_type->decompose(v)); };
+
+        map_type_impl::mutation a{{}, {{key(1), cell(1, "a1")}, {key(3), cell(3, "a3")}, {key(4), cell(2, "a4")}}};
+        map_type_impl::mutation b{tombstone(1, gc_clock::now()), {{key(2), cell(2, "b2")}, {key(3), cell(2, "b3")}, {key(4), cell(3, "b4")}, {key(5), cell(3, "b5")}}};
+        auto merged_cm = my_map_type->merge(my_map_type->serialize_mutation_form(a), my_map_type->serialize_mutation_form(b));
+        auto merged = my_map_type->deserialize_mutation_form(merged_cm);
+
+        // The tombstone of b kills key 1 in a, the newest cell of each key wins.
+        BOOST_REQUIRE(merged.tomb == b.tomb);
+        std::vector<std::pair<int32_t, sstring>> expected = {{2, "b2"}, {3, "a3"}, {4, "b4"}, {5, "b5"}};
+        BOOST_REQUIRE_EQUAL(merged.cells.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            BOOST_REQUIRE_EQUAL(value_cast<int32_t>(int32_type->deserialize(merged.cells[i].first)), expected[i].first);
+            BOOST_REQUIRE_EQUAL(value_cast<sstring>(utf8_type->deserialize(merged.cells[i].second.value())), expected[i].second);
+        }
+
+        // Merging with an empty collection gives the same one back.
+        auto empty = my_map_type->serialize_mutation_form(map_type_impl::mutation{});
+        auto sa = my_map_type->serialize_mutation_form(a);
+        BOOST_REQUIRE(bytes_view(my_map_type->merge(sa, empty).data) == bytes_view(sa.data));
+        BOOST_REQUIRE(bytes_view(my_map_type->merge(empty, sa).data) == bytes_view(sa.data));
+    });
+}
+
 SEASTAR_TEST_CASE(test_set_mutations) {
     return seastar::async([] {
         auto my_set_type = set_type_impl::get_instance(int32_type, true);
@@ -1057,13 +1086,17 @@ static mutation compacted(const mutation& m) {
 
 SEASTAR_TEST_CASE(test_query_digest) {
     return seastar::async([] {
-        auto check_digests_equal = [] (const mutation& m1, const mutation& m2) {
-            auto ps1 = partition_slice_builder(*m1.schema()).build();
-            auto ps2 = partition_slice_builder(*m2.schema()).build();
-            auto digest1 = *m1.query(ps1, query::result_request::only_digest).digest();
-            auto digest2 = *m2.query(ps2, query::result_request::only_digest).digest();
-            if (digest1 != digest2) {
-                BOOST_FAIL(sprint("Digest should be the same for %s and %s", m1, m2));
+        auto digest_of = [] (const mutation& m, query::digest_algorithm da) {
+            auto ps = partition_slice_builder(*m.schema()).build();
+            query::result::builder builder(ps, query::result_request::only_digest, { }, da);
+            mutation(m).query(builder, ps);
+            return *builder.build().digest();
+        };
+        auto check_digests_equal = [&] (const mutation& m1, const mutation& m2) {
+            for (auto da : { query::digest_algorithm::MD5, query::digest_algorithm::MURMUR3 }) {
+                if (digest_of(m1, da) != digest_of(m2, da)) {
+                    BOOST_FAIL(sprint("Digest should be the same for %s and %s", m1, m2));
+                }
             }
         };
 
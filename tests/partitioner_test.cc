@@ -923,6 +923,36 @@ BOOST_AUTO_TEST_CASE(test_split_range_single_shard) {
     return test_something_with_some_interesting_ranges_and_partitioners(do_test_split_range_to_single_shard);
 }
 
+static
+void
+do_test_range_vector_sharder(const dht::i_partitioner& part, const schema& s, const dht::partition_range& pr) {
+    dht::set_global_partitioner(part.name());
+
+    auto cmp = dht::ring_position_comparator(s);
+    auto ranges_per_shard = std::vector<dht::partition_range_vector>(part.shard_count());
+    auto sharder = dht::ring_position_range_vector_sharder(part, dht::partition_range_vector{pr});
+    for (auto x = sharder.next(s); x; x = sharder.next(s)) {
+        BOOST_REQUIRE(x->element == 0);
+        BOOST_REQUIRE(x->shard < part.shard_count());
+        ranges_per_shard[x->shard].push_back(std::move(x->ring_range));
+    }
+    for (auto shard : boost::irange(0u, part.shard_count())) {
+        auto reference_ranges = dht::split_range_to_single_shard(part, s, pr, shard);
+        auto& ranges = ranges_per_shard[shard];
+        BOOST_REQUIRE(ranges.size() == reference_ranges.size());
+        for (auto&& rs : boost::combine(ranges, reference_ranges)) {
+            auto&& r1 = normalize(boost::get<0>(rs));
+            auto&& r2 = normalize(boost::get<1>(rs));
+            BOOST_REQUIRE(r1.contains(r2, cmp));
+            BOOST_REQUIRE(r2.contains(r1, cmp));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_range_vector_sharder) {
+    return test_something_with_some_interesting_ranges_and_partitioners(do_test_range_vector_sharder);
+}
+
 // tests for range_split() utility function in repair/range_split.hh
 static int test_split(int N, int K) {
     auto t1 = token_from_long(0x6000'0000'0000'0000);
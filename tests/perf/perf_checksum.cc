@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sstables/compress.hh"
+#include "tests/perf/perf.hh"
+
+#include "disk-error-handler.hh"
+
+#include <random>
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+volatile uint32_t black_hole;
+
+// Compares the checksums which can protect compressed sstable chunks.
+int main(int argc, char* argv[]) {
+    std::default_random_engine rng;
+    std::uniform_int_distribution<int> dist(0, 255);
+
+    for (size_t size : { 4096, 16384, 65536 }) {
+        std::vector<char> chunk(size);
+        std::generate(chunk.begin(), chunk.end(), [&] { return char(dist(rng)); });
+
+        uint32_t sink = 0;
+
+        std::cout << "Timing adler32 of " << size << " bytes...\n";
+
+        time_it([&] {
+            sink += checksum_adler32(chunk.data(), chunk.size());
+        }, 5, 100);
+
+        std::cout << "Timing crc32c of " << size << " bytes...\n";
+
+        time_it([&] {
+            sink += checksum_crc32c(chunk.data(), chunk.size());
+        }, 5, 100);
+
+        black_hole = sink;
+    }
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <random>
+#include <unordered_set>
+#include "tests/cql_test_env.hh"
+#include "core/app-template.hh"
+#include "core/sleep.hh"
+#include "database.hh"
+#include "db/config.hh"
+#include "sstables/compaction_manager.hh"
+#include <seastar/core/reactor.hh>
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+// Writes a workload to a table through memtable flushes, letting the
+// compaction manager compact the table with the strategy under test, and
+// reports how fast and how efficiently it keeps up.
+//
+// Workloads:
+//  - overwrite: every write overwrites the single row of a random partition;
+//  - ttl: the same, with cells expiring after --ttl seconds;
+//  - wide: writes go to a random row out of --rows-per-partition, in a
+//    random partition;
+//  - tombstones: half of the writes delete the row of a random partition.
+//
+// Tables have gc_grace_seconds = 0, so expired cells and tombstones may be
+// purged as soon as compaction gets to them.
+
+struct workload_config {
+    sstring name;
+    unsigned partitions;
+    unsigned rows_per_partition;
+    unsigned value_size;
+    unsigned writes_per_flush;
+    unsigned flushes;
+    unsigned report_every;
+    gc_clock::duration ttl;
+};
+
+class workload {
+    const workload_config& _cfg;
+    schema_ptr _s;
+    const column_definition& _v;
+    std::default_random_engine _rng;
+    std::uniform_int_distribution<int64_t> _partition;
+    std::uniform_int_distribution<int64_t> _row;
+    std::uniform_int_distribution<int> _coin{0, 1};
+    bytes _value;
+    api::timestamp_type _timestamp = 1;
+public:
+    workload(const workload_config& cfg, schema_ptr s)
+        : _cfg(cfg)
+        , _s(s)
+        , _v(*s->get_column_definition("v"))
+        , _partition(0, cfg.partitions - 1)
+        , _row(0, (cfg.name == "wide" ? cfg.rows_per_partition : 1) - 1)
+        , _value(bytes::initialized_later(), cfg.value_size)
+    {
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::generate(_value.begin(), _value.end(), [&] { return int8_t(byte(_rng)); });
+    }
+
+    mutation next() {
+        auto pk = partition_key::from_singular(*_s, _partition(_rng));
+        auto ck = clustering_key::from_singular(*_s, _row(_rng));
+        auto ts = _timestamp++;
+        mutation m(pk, _s);
+        if (_cfg.name == "tombstones" && _coin(_rng)) {
+            m.partition().apply_delete(*_s, ck, tombstone(ts, gc_clock::now()));
+        } else if (_cfg.name == "ttl") {
+            m.set_clustered_cell(ck, _v, atomic_cell::make_live(ts, _value, gc_clock::now() + _cfg.ttl, _cfg.ttl));
+        } else {
+            m.set_clustered_cell(ck, _v, atomic_cell::make_live(ts, _value));
+        }
+        return m;
+    }
+};
+
+static uint64_t disk_size(column_family& cf) {
+    uint64_t size = 0;
+    for (auto& sst : *cf.get_sstables()) {
+        size += sst->data_size();
+    }
+    return size;
+}
+
+static void wait_for_compactions(compaction_manager& cm) {
+    while (cm.get_stats().pending_tasks || cm.get_stats().active_tasks) {
+        sleep(std::chrono::milliseconds(100)).get();
+    }
+}
+
+static constexpr double MB = 1 << 20;
+
+static void run_strategy(cql_test_env& env, const workload_config& cfg, const sstring& strategy) {
+    // Unquoted CQL identifiers are case-insensitive.
+    auto table = boost::algorithm::to_lower_copy(sprint("perf_%s_%s", cfg.name, strategy));
+    env.execute_cql(sprint("create table ks.%s (pk bigint, ck bigint, v blob, primary key (pk, ck)) "
+            "with compaction = {'class': '%s'} and gc_grace_seconds = 0;", table, strategy)).get();
+    auto& db = env.local_db();
+    auto& cf = db.find_column_family("ks", table);
+    auto& cm = db.get_compaction_manager();
+    workload w(cfg, cf.schema());
+
+    std::cout << "Strategy: " << strategy << ", workload: " << cfg.name << "\n";
+    std::cout << sprint("%-8s %-10s %-10s %-12s %-12s %-10s\n", "flushes", "time [s]", "sstables", "flushed [MB]", "on disk [MB]", "write amp.");
+
+    std::unordered_set<int64_t> seen;
+    uint64_t flushed = 0;
+    auto account_flushed = [&] {
+        for (auto& sst : *cf.get_sstables()) {
+            // Compaction outputs are the ones with ancestors.
+            if (seen.insert(sst->generation()).second && sst->ancestors().empty()) {
+                flushed += sst->data_size();
+            }
+        }
+    };
+    auto write_amplification = [&] {
+        return flushed ? double(flushed + cf.get_stats().compaction_bytes_written) / flushed : 0;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto busy_start = engine().total_busy_time();
+    auto elapsed = [&] {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::vector<std::pair<double, uint64_t>> disk_samples;
+
+    for (unsigned flush = 1; flush <= cfg.flushes; flush++) {
+        for (unsigned i = 0; i < cfg.writes_per_flush; i++) {
+            cf.apply(w.next());
+            if (i % 1000 == 0) {
+                seastar::thread::yield();
+            }
+        }
+        cf.flush().get();
+        account_flushed();
+        disk_samples.emplace_back(elapsed(), disk_size(cf));
+        if (flush % cfg.report_every == 0 || flush == cfg.flushes) {
+            std::cout << sprint("%-8d %-10.2f %-10d %-12.2f %-12.2f %-10.2f\n", flush, elapsed(), cf.sstables_count(),
+                flushed / MB, disk_samples.back().second / MB, write_amplification());
+        }
+    }
+    wait_for_compactions(cm);
+    account_flushed();
+
+    auto duration = elapsed();
+    auto busy = std::chrono::duration<double>(engine().total_busy_time() - busy_start).count();
+    auto compacted_read = cf.get_stats().compaction_bytes_read;
+    auto compacted_written = cf.get_stats().compaction_bytes_written;
+    auto before_major = disk_size(cf);
+
+    // The size of the table once compacted into a single sstable is the
+    // size of its live data, to which space amplification is relative.
+    cm.submit_major_compaction(&cf).get();
+    auto live = disk_size(cf);
+    double max_space_amplification = 0;
+    for (auto& sample : disk_samples) {
+        max_space_amplification = std::max(max_space_amplification, live ? double(sample.second) / live : 0);
+    }
+
+    std::cout << sprint("Compaction read %.2f MB and wrote %.2f MB in %.2f s: %.2f MB/s written\n",
+        compacted_read / MB, compacted_written / MB, duration, compacted_written / MB / duration);
+    std::cout << sprint("CPU: %.2f s busy, %.2f ns per byte written\n", busy,
+        busy * 1e9 / std::max(flushed + compacted_written, uint64_t(1)));
+    std::cout << sprint("Write amplification: %.2f\n", write_amplification());
+    std::cout << sprint("Space amplification: %.2f at the end, %.2f at most (live data: %.2f MB)\n",
+        live ? double(before_major) / live : 0, max_space_amplification, live / MB);
+    std::cout << "\n";
+
+    env.execute_cql(sprint("drop table ks.%s;", table)).get();
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("strategies", bpo::value<std::string>()->default_value("SizeTieredCompactionStrategy,LeveledCompactionStrategy,"
+            "DateTieredCompactionStrategy,TimeWindowCompactionStrategy"), "comma-separated list of compaction strategies to run")
+        ("workload", bpo::value<std::string>()->default_value("overwrite"), "one of: overwrite (default), ttl, wide, tombstones")
+        ("partitions", bpo::value<unsigned>()->default_value(100000), "number of distinct partitions written to")
+        ("rows-per-partition", bpo::value<unsigned>()->default_value(1000), "number of distinct rows in a partition, for the wide workload")
+        ("value-size", bpo::value<unsigned>()->default_value(100), "size in bytes of each value")
+        ("writes-per-flush", bpo::value<unsigned>()->default_value(100000), "number of writes between memtable flushes")
+        ("flushes", bpo::value<unsigned>()->default_value(50), "number of memtable flushes")
+        ("report-every", bpo::value<unsigned>()->default_value(5), "number of flushes between progress reports")
+        ("ttl", bpo::value<unsigned>()->default_value(10), "time to live of cells, in seconds, for the ttl workload")
+        ("verbose", "Enables more logging")
+        ;
+
+    return app.run(argc, argv, [&app] {
+        auto& opts = app.configuration();
+        auto wcfg = make_lw_shared<workload_config>();
+        wcfg->name = opts["workload"].as<std::string>();
+        wcfg->partitions = opts["partitions"].as<unsigned>();
+        wcfg->rows_per_partition = opts["rows-per-partition"].as<unsigned>();
+        wcfg->value_size = opts["value-size"].as<unsigned>();
+        wcfg->writes_per_flush = opts["writes-per-flush"].as<unsigned>();
+        wcfg->flushes = opts["flushes"].as<unsigned>();
+        wcfg->report_every = std::max(opts["report-every"].as<unsigned>(), 1U);
+        wcfg->ttl = std::chrono::seconds(opts["ttl"].as<unsigned>());
+        if (wcfg->name != "overwrite" && wcfg->name != "ttl" && wcfg->name != "wide" && wcfg->name != "tombstones") {
+            throw std::invalid_argument("Invalid workload: " + wcfg->name);
+        }
+        std::vector<sstring> strategies;
+        boost::split(strategies, opts["strategies"].as<std::string>(), boost::is_any_of(","));
+
+        if (!opts.count("verbose")) {
+            logging::logger_registry().set_all_loggers_level(seastar::log_level::warn);
+        }
+
+        db::config cfg;
+        cfg.enable_cache = false;
+        cfg.enable_commitlog = false;
+
+        return do_with_cql_env([wcfg, strategies = std::move(strategies)] (cql_test_env& env) {
+            return seastar::async([&env, wcfg, &strategies] {
+                for (auto& strategy : strategies) {
+                    run_strategy(env, *wcfg, strategy);
+                }
+            });
+        }, cfg);
+    });
+}
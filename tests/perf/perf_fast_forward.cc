@@ -19,7 +19,10 @@
  * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <fstream>
+#include <boost/algorithm/string.hpp>
 #include <boost/range/irange.hpp>
+#include <json/json.h>
 #include "tests/cql_test_env.hh"
 #include "tests/perf/perf.hh"
 #include "core/app-template.hh"
@@ -122,7 +125,26 @@ struct test_result {
         });
     }
 
-    auto table_row() {
+    Json::Value to_json() const {
+        Json::Value v(Json::objectValue);
+        v["time_s"] = duration_in_seconds();
+        v["fragments"] = Json::UInt64(fragments_read);
+        v["fragments_per_s"] = fragment_rate();
+        v["aio_reads"] = Json::UInt64(aio_reads());
+        v["aio_read_kib"] = Json::UInt64(aio_read_bytes() / 1024);
+        v["reads_blocked"] = Json::UInt64(reads_blocked());
+        v["read_aheads_dropped"] = Json::UInt64(read_aheads_discarded());
+        v["index_hits"] = Json::UInt64(index_hits());
+        v["index_misses"] = Json::UInt64(index_misses());
+        v["index_blocks"] = Json::UInt64(index_blocks());
+        v["cache_hits"] = Json::UInt64(cache_hits());
+        v["cache_misses"] = Json::UInt64(cache_misses());
+        v["cache_insertions"] = Json::UInt64(cache_insertions());
+        v["cpu_utilization"] = cpu_utilization();
+        return v;
+    }
+
+    auto table_row() const {
         return make_printable([this] (std::ostream& out) {
             out << sprint("%10.6f %9d %10.0f %6d %10d %7d %7d %8d %8d %8d %8d %8d %8d %5.1f%%",
                 duration_in_seconds(), fragments_read, fragment_rate(),
@@ -134,6 +156,71 @@ struct test_result {
     }
 };
 
+// The results of the test cases run, by test group and by parameters, for
+// --output-json and --baseline.
+static Json::Value results(Json::objectValue);
+static sstring current_group;
+
+// Prints the row of a test case after its parameters, as they appear in the
+// table, and records its result.
+static void report(const sstring& params, const test_result& r) {
+    std::cout << params << r.table_row() << "\n";
+    std::vector<std::string> words;
+    auto trimmed = boost::trim_copy(std::string(params));
+    boost::split(words, trimmed, boost::is_space(), boost::token_compress_on);
+    words.erase(std::remove(words.begin(), words.end(), "->"), words.end());
+    auto key = boost::join(words, " ");
+    auto& group = results[current_group];
+    // Test cases may run the same read more than once.
+    auto unique_key = key;
+    for (int n = 2; group.isMember(unique_key); ++n) {
+        unique_key = sprint("%s #%d", key, n);
+    }
+    group[unique_key] = r.to_json();
+}
+
+// A metric which regressed if it went down, or up, by more than tolerance.
+struct tracked_metric {
+    const char* name;
+    bool higher_is_better;
+};
+
+static const tracked_metric tracked_metrics[] = {
+    {"fragments_per_s", true},
+    {"aio_reads", false},
+    {"aio_read_kib", false},
+    {"index_misses", false},
+    {"cache_misses", false},
+};
+
+static void compare_with_baseline(const Json::Value& baseline, double tolerance) {
+    std::cout << "Comparing with baseline, tolerance " << tolerance * 100 << "%:\n";
+    for (auto&& group : results.getMemberNames()) {
+        for (auto&& test : results[group].getMemberNames()) {
+            if (!baseline.isMember(group) || !baseline[group].isMember(test)) {
+                std::cout << sprint("  %s: %s: no baseline\n", group, test);
+                continue;
+            }
+            auto& current = results[group][test];
+            auto& base = baseline[group][test];
+            for (auto&& m : tracked_metrics) {
+                if (!base.isMember(m.name)) {
+                    continue;
+                }
+                auto was = base[m.name].asDouble();
+                auto is = current[m.name].asDouble();
+                // Counters which were zero may go up by one before it counts.
+                auto regressed = m.higher_is_better
+                        ? is < was * (1 - tolerance)
+                        : is > std::max(was * (1 + tolerance), was + 1);
+                if (regressed) {
+                    print_error(sprint("%s: %s: %s regressed from %g to %g", group, test, m.name, was, is));
+                }
+            }
+        }
+    }
+}
+
 static void check_no_disk_reads(const test_result& r) {
     if (r.aio_reads()) {
         print_error("Expected no disk reads");
@@ -339,12 +426,20 @@ static test_result slice_partitions(column_family& cf, int n, int offset = 0, in
     return {before, fragments};
 }
 
+using random_bytes_engine = std::independent_bits_engine<std::default_random_engine, 8, uint8_t>;
+
+// Seeded by populate(), so that datasets populated with the same seed are
+// the same.
+static random_bytes_engine& random_bytes() {
+    static thread_local random_bytes_engine engine;
+    return engine;
+}
+
 static
 bytes make_blob(size_t blob_size) {
-    static thread_local std::independent_bits_engine<std::default_random_engine, 8, uint8_t> random_bytes;
     bytes big_blob(bytes::initialized_later(), blob_size);
     for (auto&& b : big_blob) {
-        b = random_bytes();
+        b = random_bytes()();
     }
     return big_blob;
 }
@@ -353,8 +448,14 @@ struct table_config {
     sstring name;
     int n_rows;
     int value_size;
+    unsigned seed;
 };
 
+// ks.test_rt has a range tombstone this many rows apart, covering this many
+// rows. The tombstones are older than the rows, so they delete none of them.
+static const int range_tombstone_stride = 100;
+static const int range_tombstone_width = 10;
+
 static test_result test_forwarding_with_restriction(column_family& cf, table_config& cfg, bool single_partition) {
     auto first_key = cfg.n_rows / 2;
     auto slice = partition_slice_builder(*cf.schema())
@@ -405,29 +506,45 @@ static void drop_keyspace_if_exists(cql_test_env& env, sstring name) {
 
 static
 table_config read_config(cql_test_env& env, const sstring& name) {
-    auto msg = env.execute_cql(sprint("select n_rows, value_size from ks.config where name = '%s'", name)).get0();
+    auto msg = env.execute_cql(sprint("select n_rows, value_size, seed from ks.config where name = '%s'", name)).get0();
     auto rows = dynamic_pointer_cast<cql_transport::messages::result_message::rows>(msg);
     if (rows->rs().size() < 1) {
         throw std::runtime_error("config not found. Did you run --populate ?");
     }
     const std::vector<bytes_opt>& config_row = rows->rs().rows()[0];
-    if (config_row.size() != 2) {
+    if (config_row.size() != 3) {
         throw std::runtime_error("config row has invalid size");
     }
     auto n_rows = value_cast<int>(int32_type->deserialize(*config_row[0]));
     auto value_size = value_cast<int>(int32_type->deserialize(*config_row[1]));
-    return {name, n_rows, value_size};
+    auto seed = config_row[2] ? unsigned(value_cast<int>(int32_type->deserialize(*config_row[2]))) : 0u;
+    return {name, n_rows, value_size, seed};
+}
+
+// Writes cfg.n_rows rows to partition 0 of table.
+static
+void insert_rows(cql_test_env& env, const sstring& table, const table_config& cfg) {
+    auto insert_id = env.prepare(sprint("update %s set \"value\" = ? where \"pk\" = 0 and \"ck\" = ?;", table)).get0();
+
+    for (int ck = 0; ck < cfg.n_rows; ++ck) {
+        env.execute_prepared(insert_id, {{
+                                             cql3::raw_value::make_value(data_value(make_blob(cfg.value_size)).serialize()),
+                                             cql3::raw_value::make_value(data_value(ck).serialize())
+                                         }}).get();
+    }
 }
 
 static
 void populate(cql_test_env& env, table_config cfg) {
     drop_keyspace_if_exists(env, "ks");
+    random_bytes().seed(cfg.seed);
 
     env.execute_cql("CREATE KEYSPACE ks WITH REPLICATION = {'class' : 'SimpleStrategy', 'replication_factor' : 1};").get();
 
     std::cout << "Saving test config...\n";
-    env.execute_cql("create table config (name text primary key, n_rows int, value_size int)").get();
-    env.execute_cql(sprint("insert into ks.config (name, n_rows, value_size) values ('%s', %d, %d)", cfg.name, cfg.n_rows, cfg.value_size)).get();
+    env.execute_cql("create table config (name text primary key, n_rows int, value_size int, seed int)").get();
+    env.execute_cql(sprint("insert into ks.config (name, n_rows, value_size, seed) values ('%s', %d, %d, %d)",
+            cfg.name, cfg.n_rows, cfg.value_size, int(cfg.seed))).get();
 
     std::cout << "Creating test tables...\n";
 
@@ -440,16 +557,36 @@ void populate(cql_test_env& env, table_config cfg) {
     {
         std::cout << "Populating ks.test with " << cfg.n_rows << " rows...";
 
-        auto insert_id = env.prepare("update test set \"value\" = ? where \"pk\" = 0 and \"ck\" = ?;").get0();
+        insert_rows(env, "test", cfg);
 
-        for (int ck = 0; ck < cfg.n_rows; ++ck) {
-            env.execute_prepared(insert_id, {{
-                                                 cql3::raw_value::make_value(data_value(make_blob(cfg.value_size)).serialize()),
-                                                 cql3::raw_value::make_value(data_value(ck).serialize())
+        column_family& cf = db.find_column_family("ks", "test");
+
+        std::cout << "flushing...\n";
+        cf.flush().get();
+
+        std::cout << "compacting...\n";
+        cf.compact_all_sstables().get();
+    }
+
+    // Large partition with rows and range tombstones
+    env.execute_cql("create table test_rt (pk int, ck int, value blob, primary key (pk, ck))"
+        " WITH compression = { 'sstable_compression' : '' };").get();
+
+    {
+        std::cout << "Populating ks.test_rt with " << cfg.n_rows << " rows and range tombstones...";
+
+        insert_rows(env, "test_rt", cfg);
+
+        auto delete_id = env.prepare("delete from test_rt using timestamp 1 where \"pk\" = 0 and \"ck\" >= ? and \"ck\" < ?;").get0();
+
+        for (int ck = 0; ck < cfg.n_rows; ck += range_tombstone_stride) {
+            env.execute_prepared(delete_id, {{
+                                                 cql3::raw_value::make_value(data_value(ck).serialize()),
+                                                 cql3::raw_value::make_value(data_value(ck + range_tombstone_width).serialize())
                                              }}).get();
         }
 
-        column_family& cf = db.find_column_family("ks", "test");
+        column_family& cf = db.find_column_family("ks", "test_rt");
 
         std::cout << "flushing...\n";
         cf.flush().get();
@@ -520,6 +657,10 @@ int main(int argc, char** argv) {
         ("rows", bpo::value<int>()->default_value(1000000), "Number of CQL rows in a partition. Relevant only for population.")
         ("value-size", bpo::value<int>()->default_value(100), "Size of value stored in a cell. Relevant only for population.")
         ("name", bpo::value<std::string>()->default_value("default"), "Name of the configuration")
+        ("seed", bpo::value<unsigned>()->default_value(0), "Seed of the random values written. Relevant only for population.")
+        ("output-json", bpo::value<std::string>(), "Writes the results to this file as JSON")
+        ("baseline", bpo::value<std::string>(), "Compares the results with those in this file, written by --output-json, and fails on regressions")
+        ("tolerance", bpo::value<double>()->default_value(10), "Percentage by which results may be worse than the baseline before they count as regressions")
         ;
 
     return app.run(argc, argv, [&app] {
@@ -544,7 +685,8 @@ int main(int argc, char** argv) {
                 if (app.configuration().count("populate")) {
                     int n_rows = app.configuration()["rows"].as<int>();
                     int value_size = app.configuration()["value-size"].as<int>();
-                    table_config cfg{name, n_rows, value_size};
+                    unsigned seed = app.configuration()["seed"].as<unsigned>();
+                    table_config cfg{name, n_rows, value_size, seed};
                     populate(env, cfg);
                 } else {
                     database& db = env.local_db();
@@ -554,7 +696,7 @@ int main(int argc, char** argv) {
                     bool cache_enabled = app.configuration().count("enable-cache");
                     bool new_test_case = false;
 
-                    std::cout << "Config: rows: " << cfg.n_rows << ", value size: " << cfg.value_size << "\n";
+                    std::cout << "Config: rows: " << cfg.n_rows << ", value size: " << cfg.value_size << ", seed: " << cfg.seed << "\n";
 
                     ::sleep(1s).get(); // wait for system table flushes to quiesce
 
@@ -568,7 +710,8 @@ int main(int argc, char** argv) {
                         global_cache_tracker().clear();
                     };
 
-                    auto on_test_group = [&] {
+                    auto on_test_group = [&] (const sstring& name) {
+                        current_group = name;
                         if (!app.configuration().count("keep-cache-across-test-groups")
                             && !app.configuration().count("keep-cache-across-test-cases")) {
                             clear_cache();
@@ -590,7 +733,7 @@ int main(int argc, char** argv) {
                             int_range live_range({0}, {cfg.n_rows - 1});
 
                             if (cache_enabled) {
-                                on_test_group();
+                                on_test_group("large-partition-slicing-cache");
                                 std::cout
                                     << "Testing effectiveness of caching of large partition, single-key slicing reads:\n";
                                 std::cout << sprint("%-2s %-14s ", "", "range") << test_result::table_header() << "\n";
@@ -598,8 +741,7 @@ int main(int argc, char** argv) {
                                 };
                                 auto test = [&](int_range range) {
                                     auto r = test_slicing_using_restrictions(cf, range);
-                                    std::cout << sprint("%-2s %-14s ", new_test_case ? "->" : "", sprint("%s", range))
-                                              << r.table_row() << "\n";
+                                    report(sprint("%-2s %-14s ", new_test_case ? "->" : "", sprint("%s", range)), r);
                                     new_test_case = false;
                                     check_fragment_count(r, cardinality(intersection(range, live_range)));
                                     return r;
@@ -685,13 +827,13 @@ int main(int argc, char** argv) {
                             }
 
                             {
-                                on_test_group();
+                                on_test_group("large-partition-skips");
                                 std::cout << "Testing scanning large partition with skips. \n"
                                           << "Reads whole range interleaving reads with skips according to read-skip pattern:\n";
                                 std::cout << sprint("%-7s %-7s ", "read", "skip") << test_result::table_header() << "\n";
                                 auto do_test = [&] (int n_read, int n_skip) {
                                     auto r = scan_rows_with_stride(cf, cfg.n_rows, n_read, n_skip);
-                                    std::cout << sprint("%-7d %-7d ", n_read, n_skip) << r.table_row() << "\n";
+                                    report(sprint("%-7d %-7d ", n_read, n_skip), r);
                                     check_fragment_count(r, count_for_skip_pattern(cfg.n_rows, n_read, n_skip));
                                 };
                                 auto test = [&] (int n_read, int n_skip) {
@@ -732,13 +874,13 @@ int main(int argc, char** argv) {
                             }
 
                             {
-                                on_test_group();
+                                on_test_group("large-partition-slicing");
                                 std::cout << "Testing slicing of large partition:\n";
                                 std::cout << sprint("%-7s %-7s ", "offset", "read") << test_result::table_header() << "\n";
                                 auto test = [&] (int offset, int read) {
                                     on_test_case();
                                     auto r = slice_rows(cf, offset, read);
-                                    std::cout << sprint("%-7d %-7d ", offset, read) << r.table_row() << "\n";
+                                    report(sprint("%-7d %-7d ", offset, read), r);
                                     check_fragment_count(r, std::min(cfg.n_rows - offset, read));
                                 };
 
@@ -754,14 +896,14 @@ int main(int argc, char** argv) {
                             }
 
                             {
-                                on_test_group();
+                                on_test_group("large-partition-slicing-single-key");
                                 std::cout << "Testing slicing of large partition, single-partition reader:\n";
                                 std::cout << sprint("%-7s %-7s ", "offset", "read") << test_result::table_header()
                                           << "\n";
                                 auto test = [&](int offset, int read) {
                                     on_test_case();
                                     auto r = slice_rows_single_key(cf, offset, read);
-                                    std::cout << sprint("%-7d %-7d ", offset, read) << r.table_row() << "\n";
+                                    report(sprint("%-7d %-7d ", offset, read), r);
                                     check_fragment_count(r, std::min(cfg.n_rows - offset, read));
                                 };
 
@@ -777,14 +919,14 @@ int main(int argc, char** argv) {
                             }
 
                             {
-                                on_test_group();
+                                on_test_group("large-partition-select-few-rows");
                                 std::cout << "Testing selecting few rows from a large partition:\n";
                                 std::cout << sprint("%-7s %-7s ", "stride", "rows") << test_result::table_header()
                                           << "\n";
                                 auto test = [&](int stride, int read) {
                                     on_test_case();
                                     auto r = select_spread_rows(cf, stride, read);
-                                    std::cout << sprint("%-7d %-7d ", stride, read) << r.table_row() << "\n";
+                                    report(sprint("%-7d %-7d ", stride, read), r);
                                     check_fragment_count(r, read);
                                 };
 
@@ -797,19 +939,89 @@ int main(int argc, char** argv) {
                             }
 
                             {
-                                on_test_group();
+                                on_test_group("large-partition-forwarding");
                                 std::cout << "Testing forwarding with clustering restriction in a large partition:\n";
                                 std::cout << sprint("%-7s ", "pk-scan") << test_result::table_header() << "\n";
 
                                 on_test_case();
                                 auto r = test_forwarding_with_restriction(cf, cfg, false);
                                 check_fragment_count(r, 2);
-                                std::cout << sprint("%-7s ", "yes") << r.table_row() << "\n";
+                                report(sprint("%-7s ", "yes"), r);
 
                                 on_test_case();
                                 r = test_forwarding_with_restriction(cf, cfg, true);
                                 check_fragment_count(r, 2);
-                                std::cout << sprint("%-7s ", "no")  << r.table_row() << "\n";
+                                report(sprint("%-7s ", "no"), r);
+                            }
+
+                            if (cache_enabled) {
+                                on_test_group("large-partition-cache-vs-disk");
+                                std::cout << "Testing slicing of large partition from disk, then from cache:\n";
+                                std::cout << sprint("%-7s %-7s %-5s ", "offset", "read", "from") << test_result::table_header() << "\n";
+                                auto test = [&] (int offset, int read) {
+                                    on_test_case();
+                                    auto range = int_range::make({offset}, {offset + read - 1});
+                                    auto r = test_slicing_using_restrictions(cf, range);
+                                    report(sprint("%-7d %-7d %-5s ", offset, read, "disk"), r);
+                                    check_fragment_count(r, cardinality(intersection(range, live_range)));
+                                    r = test_slicing_using_restrictions(cf, range);
+                                    report(sprint("%-7d %-7d %-5s ", offset, read, "cache"), r);
+                                    check_fragment_count(r, cardinality(intersection(range, live_range)));
+                                    check_no_disk_reads(r);
+                                };
+
+                                test(0, 1);
+                                test(0, 32);
+                                test(0, 4096);
+
+                                test(cfg.n_rows / 2, 1);
+                                test(cfg.n_rows / 2, 32);
+                                test(cfg.n_rows / 2, 4096);
+                            }
+                        });
+                    }).get();
+
+                    column_family& cf_rt = db.find_column_family("ks", "test_rt");
+                    cf_rt.run_with_compaction_disabled([&] {
+                        return seastar::async([&] {
+                            // Every fragment range also has the range tombstones
+                            // overlapping it, so fragment counts aren't checked.
+                            {
+                                on_test_group("large-partition-range-tombstones-skips");
+                                std::cout << "Testing scanning large partition with range tombstones, with skips:\n";
+                                std::cout << sprint("%-7s %-7s ", "read", "skip") << test_result::table_header() << "\n";
+                                auto test = [&] (int n_read, int n_skip) {
+                                    on_test_case();
+                                    auto r = scan_rows_with_stride(cf_rt, cfg.n_rows, n_read, n_skip);
+                                    report(sprint("%-7d %-7d ", n_read, n_skip), r);
+                                };
+
+                                test(1, 0);
+                                test(1, 1);
+                                test(1, 64);
+                                test(1, 4096);
+                                test(64, 1);
+                                test(64, 64);
+                                test(64, 4096);
+                            }
+
+                            {
+                                on_test_group("large-partition-range-tombstones-slicing");
+                                std::cout << "Testing slicing of large partition with range tombstones:\n";
+                                std::cout << sprint("%-7s %-7s ", "offset", "read") << test_result::table_header() << "\n";
+                                auto test = [&] (int offset, int read) {
+                                    on_test_case();
+                                    auto r = slice_rows(cf_rt, offset, read);
+                                    report(sprint("%-7d %-7d ", offset, read), r);
+                                };
+
+                                test(0, 1);
+                                test(0, 256);
+                                test(0, 4096);
+
+                                test(cfg.n_rows / 2, 1);
+                                test(cfg.n_rows / 2, 256);
+                                test(cfg.n_rows / 2, 4096);
                             }
                         });
                     }).get();
@@ -818,14 +1030,14 @@ int main(int argc, char** argv) {
                     cf2.run_with_compaction_disabled([&] {
                         return seastar::async([&] {
                             {
-                                on_test_group();
+                                on_test_group("small-partition-skips");
                                 std::cout << "Testing scanning small partitions with skips. \n"
                                           << "Reads whole range interleaving reads with skips according to read-skip pattern:\n";
                                 std::cout << sprint("%-2s %-7s %-7s ", "", "read", "skip") << test_result::table_header() << "\n";
 
                                 auto do_test = [&] (int n_read, int n_skip) {
                                     auto r = scan_with_stride_partitions(cf2, cfg.n_rows, n_read, n_skip);
-                                    std::cout << sprint("%-2s %-7d %-7d ", new_test_case ? "->" : "", n_read, n_skip) << r.table_row() << "\n";
+                                    report(sprint("%-2s %-7d %-7d ", new_test_case ? "->" : "", n_read, n_skip), r);
                                     new_test_case = false;
                                     check_fragment_count(r, count_for_skip_pattern(cfg.n_rows, n_read, n_skip));
                                     return r;
@@ -869,13 +1081,13 @@ int main(int argc, char** argv) {
                             }
 
                             {
-                                on_test_group();
+                                on_test_group("small-partition-slicing");
                                 std::cout << "Testing slicing small partitions:\n";
                                 std::cout << sprint("%-7s %-7s ", "offset", "read") << test_result::table_header() << "\n";
                                 auto test = [&] (int offset, int read) {
                                     on_test_case();
                                     auto r = slice_partitions(cf2, cfg.n_rows, offset, read);
-                                    std::cout << sprint("%-7d %-7d ", offset, read) << r.table_row() << "\n";
+                                    report(sprint("%-7d %-7d ", offset, read), r);
                                     check_fragment_count(r, std::min(cfg.n_rows - offset, read));
                                 };
 
@@ -891,6 +1103,32 @@ int main(int argc, char** argv) {
                             }
                         });
                     }).get();
+
+                    if (app.configuration().count("output-json")) {
+                        Json::Value root(Json::objectValue);
+                        root["config"]["name"] = std::string(cfg.name);
+                        root["config"]["rows"] = cfg.n_rows;
+                        root["config"]["value_size"] = cfg.value_size;
+                        root["config"]["seed"] = cfg.seed;
+                        root["config"]["cache"] = cache_enabled;
+                        root["results"] = results;
+                        auto path = app.configuration()["output-json"].as<std::string>();
+                        std::ofstream out(path);
+                        out << Json::StyledWriter().write(root);
+                        if (!out) {
+                            throw std::runtime_error(sprint("failed to write %s", path));
+                        }
+                    }
+
+                    if (app.configuration().count("baseline")) {
+                        auto path = app.configuration()["baseline"].as<std::string>();
+                        std::ifstream in(path);
+                        Json::Value baseline;
+                        if (!Json::Reader().parse(in, baseline)) {
+                            throw std::runtime_error(sprint("failed to parse %s", path));
+                        }
+                        compare_with_baseline(baseline["results"], app.configuration()["tolerance"].as<double>() / 100);
+                    }
                 }
             });
         }, cfg).then([] {
@@ -20,8 +20,12 @@
  */
 
 #include "utils/murmur_hash.hh"
+#include "digester.hh"
 #include "tests/perf/perf.hh"
 
+#include <cryptopp/sha.h>
+#include <numeric>
+
 #include "disk-error-handler.hh"
 
 thread_local disk_error_signal_type commit_error;
@@ -53,5 +57,87 @@ int main(int argc, char* argv[]) {
         sink += dst[1];
     });
 
+    // Short keys, like most partition keys, hashed one at a time and in a
+    // batch, as when computing many tokens at once.
+    {
+        std::vector<bytes> keys;
+        for (int i = 0; i < 100; ++i) {
+            keys.push_back(bytes(bytes::initialized_later(), 8 + i % 8));
+            std::iota(keys.back().begin(), keys.back().end(), i);
+        }
+        std::vector<bytes_view> views(keys.begin(), keys.end());
+        std::vector<std::array<uint64_t, 2>> results(keys.size());
+
+        std::cout << "Timing hash of 100 short keys, one at a time...\n";
+
+        time_it([&] {
+            for (size_t i = 0; i < views.size(); ++i) {
+                utils::murmur_hash::hash3_x64_128(views[i], seed, results[i]);
+            }
+            sink += results[0][0];
+        });
+
+        std::cout << "Timing hash of 100 short keys, in a batch...\n";
+
+        time_it([&] {
+            utils::murmur_hash::hash3_x64_128(views.data(), views.size(), seed, results.data());
+            sink += results[0][0];
+        });
+    }
+
+    // The hashes repair checksums can be built on, fed cell-sized pieces
+    // as when hashing a partition.
+    for (size_t size : { 16, 64, 1024 }) {
+        auto piece = bytes(bytes::initialized_later(), size);
+        std::iota(piece.begin(), piece.end(), 0);
+        auto ptr = reinterpret_cast<const char*>(piece.begin());
+
+        std::cout << "Timing SHA-256 of 100 pieces of " << size << " bytes...\n";
+
+        time_it([&] {
+            CryptoPP::SHA256 h;
+            for (int i = 0; i < 100; ++i) {
+                h.Update(reinterpret_cast<const byte*>(ptr), size);
+            }
+            std::array<uint8_t, 32> digest;
+            h.Final(digest.data());
+            sink += digest[0];
+        });
+
+        std::cout << "Timing incremental hash of 100 pieces of " << size << " bytes...\n";
+
+        time_it([&] {
+            utils::murmur_hash::hasher3_x64_128 h(seed);
+            for (int i = 0; i < 100; ++i) {
+                h.update(ptr, size);
+            }
+            std::array<uint64_t,2> dst;
+            h.finalize(dst);
+            sink += dst[0];
+            sink += dst[1];
+        });
+    }
+
+    // The digests of query results, fed cell-sized pieces as when hashing
+    // the rows of a read.
+    for (size_t size : { 16, 64, 1024 }) {
+        auto piece = bytes(bytes::initialized_later(), size);
+        std::iota(piece.begin(), piece.end(), 0);
+        auto ptr = reinterpret_cast<const char*>(piece.begin());
+
+        for (auto da : { query::digest_algorithm::MD5, query::digest_algorithm::MURMUR3 }) {
+            std::cout << "Timing " << (da == query::digest_algorithm::MD5 ? "MD5" : "murmur3")
+                      << " query digest of 100 pieces of " << size << " bytes...\n";
+
+            time_it([&] {
+                query::digester d(da);
+                for (int i = 0; i < 100; ++i) {
+                    d.update(ptr, size);
+                }
+                sink += d.finalize_array()[0];
+            });
+        }
+    }
+
     black_hole = sink;
 }
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <random>
+#include <boost/range/algorithm/sort.hpp>
+
+#include "compound.hh"
+#include "tests/perf/perf.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+volatile uint64_t black_hole;
+
+static bytes random_value(std::mt19937& gen, const data_type& type) {
+    auto u = type->underlying_type();
+    if (u == int32_type) {
+        return int32_type->decompose(int32_t(gen()));
+    } else if (u == long_type) {
+        return long_type->decompose(int64_t(gen()) << 32 | gen());
+    } else if (u == timeuuid_type) {
+        uint64_t timestamp = gen() % 1000;
+        uint64_t msb = ((timestamp & 0xffffffff) << 32) | 0x1000;
+        return utils::UUID(msb, uint64_t(gen()) << 32 | gen()).serialize();
+    } else {
+        // Few distinct prefixes, so that keys often differ only past them.
+        auto s = sprint("key-%d-%d", gen() % 16, gen());
+        return to_bytes(s);
+    }
+}
+
+// Times sorting of random keys of the given types, with the compound's
+// comparator and with one calling abstract_type::compare() for each
+// component, as compound_type used to.
+static void time_sort(const sstring& name, std::vector<data_type> types) {
+    std::mt19937 gen(0);
+    compound_type<allow_prefixes::yes> t(types);
+    std::vector<bytes> keys;
+    for (int i = 0; i < 1000; ++i) {
+        std::vector<bytes> values;
+        for (auto&& type : types) {
+            values.push_back(random_value(gen, type));
+        }
+        keys.push_back(t.serialize_value(values));
+    }
+    auto views = std::vector<bytes_view>(keys.begin(), keys.end());
+    uint64_t sink = 0;
+
+    std::cout << "Timing sort of 1000 " << name << " keys, specialized...\n";
+    time_it([&] {
+        auto v = views;
+        boost::sort(v, [&] (bytes_view k1, bytes_view k2) {
+            return t.less(k1, k2);
+        });
+        sink += v.front().size();
+    }, 5, 10);
+
+    std::cout << "Timing sort of 1000 " << name << " keys, virtual...\n";
+    time_it([&] {
+        auto v = views;
+        boost::sort(v, [&] (bytes_view k1, bytes_view k2) {
+            return lexicographical_tri_compare(types.begin(), types.end(),
+                t.begin(k1), t.end(k1), t.begin(k2), t.end(k2), tri_compare) < 0;
+        });
+        sink += v.front().size();
+    }, 5, 10);
+
+    black_hole = sink;
+}
+
+int main(int argc, char* argv[]) {
+    time_sort("int", {int32_type});
+    time_sort("bigint", {long_type});
+    time_sort("timeuuid", {timeuuid_type});
+    time_sort("text", {utf8_type});
+    time_sort("(text, timeuuid)", {utf8_type, timeuuid_type});
+    time_sort("(int, bigint desc, blob)", {int32_type, reversed_type_impl::get_instance(long_type), bytes_type});
+}
@@ -21,6 +21,7 @@
  */
 
 #include "database.hh"
+#include "frozen_mutation.hh"
 #include "perf.hh"
 #include <seastar/core/app-template.hh>
 
@@ -52,6 +53,25 @@ int main(int argc, char* argv[]) {
             m.set_clustered_cell(c_key, col, make_atomic_cell(value));
             mt.apply(std::move(m));
         });
+
+        std::cout << "Timing frozen mutation of single column within one row...\n";
+
+        mutation m(key, s);
+        m.set_clustered_cell(c_key, *s->get_column_definition("r1"), make_atomic_cell(value));
+        auto fm = freeze(m);
+
+        time_it([&] {
+            mt.apply(fm, s);
+        });
+
+        std::cout << "Timing frozen mutation of single column into a new partition...\n";
+
+        int32_t next_key = 0;
+        time_it([&] {
+            mutation m(partition_key::from_exploded(*s, {to_bytes(to_sstring(next_key++))}), s);
+            m.set_clustered_cell(c_key, *s->get_column_definition("r1"), make_atomic_cell(value));
+            mt.apply(freeze(m), s);
+        });
         engine().exit(0);
     });
 }
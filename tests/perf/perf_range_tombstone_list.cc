@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <random>
+#include <algorithm>
+
+#include "range_tombstone_list.hh"
+#include "streamed_mutation.hh"
+#include "schema_builder.hh"
+#include "tests/perf/perf.hh"
+#include <seastar/core/app-template.hh>
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+volatile uint64_t black_hole;
+
+static clustering_key_prefix make_key(const schema& s, int32_t v) {
+    return clustering_key_prefix::from_exploded(s, {int32_type->decompose(v)});
+}
+
+// Tombstones [2i, 2i + width], so that a width of 1 or more makes each
+// overlap the next ones.
+static std::vector<range_tombstone> make_tombstones(const schema& s, int n, int width, bool increasing_timestamps) {
+    std::vector<range_tombstone> rts;
+    for (int i = 0; i < n; ++i) {
+        auto ts = increasing_timestamps ? i : 1;
+        rts.emplace_back(make_key(s, 2 * i), bound_kind::incl_start, make_key(s, 2 * i + width), bound_kind::incl_end,
+                         tombstone(ts, gc_clock::now()));
+    }
+    return rts;
+}
+
+static void time_apply(const sstring& name, const schema& s, const std::vector<range_tombstone>& rts) {
+    std::cout << "Timing apply of " << rts.size() << " " << name << " range tombstones...\n";
+    time_it([&] {
+        range_tombstone_list list(s);
+        for (auto&& rt : rts) {
+            list.apply(s, rt);
+        }
+        black_hole = list.size();
+    }, 5, 1);
+}
+
+static range_tombstone_list make_list(const schema& s, const std::vector<range_tombstone>& rts) {
+    range_tombstone_list list(s);
+    for (auto&& rt : rts) {
+        list.apply(s, rt);
+    }
+    return list;
+}
+
+int main(int argc, char* argv[]) {
+    return app_template().run_deprecated(argc, argv, [] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("pk", utf8_type, column_kind::partition_key)
+            .with_column("ck", int32_type, column_kind::clustering_key)
+            .with_column("v", int32_type)
+            .build();
+        const int n = 10000;
+        std::mt19937 gen(0);
+
+        auto disjoint = make_tombstones(*s, n, 0, true);
+        time_apply("disjoint, in order,", *s, disjoint);
+
+        auto shuffled = disjoint;
+        std::shuffle(shuffled.begin(), shuffled.end(), gen);
+        time_apply("disjoint, in random order,", *s, shuffled);
+
+        time_apply("overlapping, newer ones last,", *s, make_tombstones(*s, n, 5, true));
+        time_apply("overlapping, with equal timestamps,", *s, make_tombstones(*s, n, 5, false));
+
+        auto list = make_list(*s, disjoint);
+        std::cout << "Timing apply of a list of " << n << " range tombstones to an empty one...\n";
+        time_it([&] {
+            range_tombstone_list dst(*s);
+            dst.apply(*s, list);
+            black_hole = dst.size();
+        }, 5, 1);
+
+        auto interleaved = make_list(*s, make_tombstones(*s, n, 1, false));
+        std::cout << "Timing apply of a list of " << n << " range tombstones to an overlapping one...\n";
+        time_it([&] {
+            range_tombstone_list dst(interleaved);
+            dst.apply(*s, list);
+            black_hole = dst.size();
+        }, 5, 1);
+
+        std::cout << "Timing forwarding of a range tombstone stream across " << n << " range tombstones...\n";
+        std::vector<clustering_key_prefix> keys;
+        for (int i = 0; i < n; ++i) {
+            keys.push_back(make_key(*s, 2 * i + 1));
+        }
+        time_it([&] {
+            range_tombstone_stream stream(*s);
+            stream.apply(list);
+            for (auto&& key : keys) {
+                stream.forward_to(position_in_partition_view(position_in_partition_view::clustering_row_tag_t(), key));
+            }
+        }, 5, 1);
+
+        engine().exit(0);
+    });
+}
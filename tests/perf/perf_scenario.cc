@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs a scenario of mixed read, write and scan workloads against a node,
+// through the coordinator path of CQL statements, and reports the
+// throughput of each shard and the latency percentiles of each kind of
+// operation, step by step.
+//
+// A scenario file has a step per line, made of key=value settings which
+// override the command line defaults for that step:
+//
+//   # warm up, then a read-mostly load at QUORUM
+//   name=warmup duration=5 write=100
+//   name=mixed duration=30 read=80 write=15 scan=5 rate=5000 cl=QUORUM
+//
+// The ratios are relative weights. A rate limits the operations per second
+// of each shard; latencies are then measured from the time each operation
+// was due, so that a stalled shard shows up in them.
+
+#include <fstream>
+#include <random>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/range/irange.hpp>
+#include "tests/cql_test_env.hh"
+#include "tests/perf/perf.hh"
+#include "core/app-template.hh"
+#include "core/sleep.hh"
+#include "db/config.hh"
+#include "utils/estimated_histogram.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+enum class op_type { read, write, scan };
+static constexpr unsigned op_types = 3;
+
+static const char* op_name(op_type op) {
+    switch (op) {
+    case op_type::read: return "read";
+    case op_type::write: return "write";
+    case op_type::scan: return "scan";
+    }
+    abort();
+}
+
+static db::consistency_level parse_consistency_level(const sstring& name) {
+    static const std::unordered_map<sstring, db::consistency_level> levels = {
+        {"ANY", db::consistency_level::ANY},
+        {"ONE", db::consistency_level::ONE},
+        {"TWO", db::consistency_level::TWO},
+        {"THREE", db::consistency_level::THREE},
+        {"QUORUM", db::consistency_level::QUORUM},
+        {"ALL", db::consistency_level::ALL},
+        {"LOCAL_QUORUM", db::consistency_level::LOCAL_QUORUM},
+        {"EACH_QUORUM", db::consistency_level::EACH_QUORUM},
+        {"LOCAL_ONE", db::consistency_level::LOCAL_ONE},
+    };
+    auto it = levels.find(boost::to_upper_copy(name));
+    if (it == levels.end()) {
+        throw std::invalid_argument(sprint("unknown consistency level %s", name));
+    }
+    return it->second;
+}
+
+struct step {
+    sstring name = "default";
+    unsigned duration_in_seconds = 10;
+    unsigned ratios[op_types] = { 1, 0, 0 };
+    // Operations per second of each shard, 0 for as many as possible.
+    unsigned rate = 0;
+    unsigned concurrency = 100;
+    db::consistency_level cl = db::consistency_level::ONE;
+};
+
+std::ostream& operator<<(std::ostream& os, const step& s) {
+    return os << "{name=" << s.name
+           << ", duration=" << s.duration_in_seconds
+           << ", read=" << s.ratios[0]
+           << ", write=" << s.ratios[1]
+           << ", scan=" << s.ratios[2]
+           << ", rate=" << s.rate
+           << ", concurrency=" << s.concurrency
+           << ", cl=" << s.cl
+           << "}";
+}
+
+static step parse_step(const sstring& line, step s) {
+    std::vector<sstring> settings;
+    boost::split(settings, line, boost::is_any_of(" \t"), boost::token_compress_on);
+    for (auto&& setting : settings) {
+        if (setting.empty()) {
+            continue;
+        }
+        auto eq = setting.find('=');
+        if (eq == sstring::npos) {
+            throw std::invalid_argument(sprint("expected key=value, got %s", setting));
+        }
+        auto key = setting.substr(0, eq);
+        auto value = setting.substr(eq + 1);
+        auto number = [&] {
+            return boost::lexical_cast<unsigned>(value);
+        };
+        if (key == "name") {
+            s.name = value;
+        } else if (key == "duration") {
+            s.duration_in_seconds = number();
+        } else if (key == "read") {
+            s.ratios[unsigned(op_type::read)] = number();
+        } else if (key == "write") {
+            s.ratios[unsigned(op_type::write)] = number();
+        } else if (key == "scan") {
+            s.ratios[unsigned(op_type::scan)] = number();
+        } else if (key == "rate") {
+            s.rate = number();
+        } else if (key == "concurrency") {
+            s.concurrency = number();
+        } else if (key == "cl") {
+            s.cl = parse_consistency_level(value);
+        } else {
+            throw std::invalid_argument(sprint("unknown setting %s", key));
+        }
+    }
+    if (!s.ratios[0] && !s.ratios[1] && !s.ratios[2]) {
+        throw std::invalid_argument(sprint("step %s runs no operations", s.name));
+    }
+    return s;
+}
+
+static std::vector<step> load_scenario(const sstring& path, const step& defaults) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error(sprint("cannot open scenario %s", path));
+    }
+    std::vector<step> steps;
+    std::string line;
+    while (std::getline(in, line)) {
+        auto trimmed = boost::trim_copy(line);
+        if (trimmed.empty() || trimmed[0] == '#') {
+            continue;
+        }
+        steps.push_back(parse_step(sstring(trimmed), defaults));
+    }
+    return steps;
+}
+
+struct workload {
+    unsigned partitions;
+    unsigned rows_per_partition;
+    unsigned scan_limit;
+    bytes read_id;
+    bytes write_id;
+    bytes scan_id;
+};
+
+struct shard_result {
+    double seconds = 0;
+    uint64_t errors = 0;
+    uint64_t ops[op_types] = { };
+    utils::estimated_histogram latencies[op_types];
+};
+
+// Runs a step on a shard.
+class step_runner {
+    using clk = std::chrono::steady_clock;
+
+    cql_test_env& _env;
+    const step _step;
+    const workload _workload;
+    std::default_random_engine _random{engine().cpu_id()};
+    std::discrete_distribution<unsigned> _op_distribution;
+    clk::time_point _start;
+    clk::time_point _end;
+    uint64_t _issued = 0;
+    shard_result _result;
+private:
+    future<> execute(op_type op) {
+        auto pk = [this] {
+            return cql3::raw_value::make_value(long_type->decompose(int64_t(_random() % _workload.partitions)));
+        };
+        auto ck = [this] {
+            return cql3::raw_value::make_value(int32_type->decompose(int32_t(_random() % _workload.rows_per_partition)));
+        };
+        switch (op) {
+        case op_type::read:
+            return _env.execute_prepared(_workload.read_id, {pk(), ck()}, _step.cl).discard_result();
+        case op_type::write:
+            return _env.execute_prepared(_workload.write_id, {pk(), ck(), cql3::raw_value::make_value(bytes(bytes::initialized_later(), 64))},
+                    _step.cl).discard_result();
+        case op_type::scan: {
+            auto token = cql3::raw_value::make_value(long_type->decompose(int64_t(_random())));
+            return _env.execute_prepared(_workload.scan_id, {std::move(token)}, _step.cl).discard_result();
+        }
+        }
+        abort();
+    }
+
+    // The time the next operation is due, to keep to the rate.
+    clk::time_point next_due() {
+        auto due = _step.rate
+                ? _start + std::chrono::duration_cast<clk::duration>(std::chrono::duration<double>(double(_issued) / _step.rate))
+                : clk::now();
+        ++_issued;
+        return due;
+    }
+
+    future<> run_worker() {
+        return do_until([this] { return clk::now() >= _end; }, [this] {
+            auto due = next_due();
+            if (due >= _end) {
+                return sleep(std::chrono::duration_cast<std::chrono::microseconds>(_end - clk::now()));
+            }
+            auto wait = due - clk::now();
+            auto f = wait > clk::duration(0) ? sleep(std::chrono::duration_cast<std::chrono::microseconds>(wait)) : make_ready_future<>();
+            return f.then([this, due] {
+                auto op = op_type(_op_distribution(_random));
+                return execute(op).then_wrapped([this, op, due] (future<> f) {
+                    try {
+                        f.get();
+                        ++_result.ops[unsigned(op)];
+                        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(clk::now() - due);
+                        _result.latencies[unsigned(op)].add(latency.count());
+                    } catch (...) {
+                        ++_result.errors;
+                    }
+                });
+            });
+        });
+    }
+public:
+    step_runner(cql_test_env& env, step s, workload w)
+        : _env(env)
+        , _step(std::move(s))
+        , _workload(std::move(w))
+        , _op_distribution({double(_step.ratios[0]), double(_step.ratios[1]), double(_step.ratios[2])})
+    { }
+
+    future<shard_result> run() {
+        _start = clk::now();
+        _end = _start + std::chrono::seconds(_step.duration_in_seconds);
+        auto workers = boost::irange(0u, _step.concurrency);
+        return parallel_for_each(workers.begin(), workers.end(), [this] (unsigned) {
+            return run_worker();
+        }).then([this] {
+            _result.seconds = std::chrono::duration<double>(clk::now() - _start).count();
+            return std::move(_result);
+        });
+    }
+
+    future<> stop() {
+        return make_ready_future<>();
+    }
+};
+
+static void report(const step& s, const std::vector<shard_result>& results) {
+    std::cout << "Step " << s.name << ":\n";
+    shard_result total;
+    for (auto shard : boost::irange<size_t>(0, results.size())) {
+        auto& r = results[shard];
+        uint64_t ops = 0;
+        for (auto op : boost::irange(0u, op_types)) {
+            ops += r.ops[op];
+            total.ops[op] += r.ops[op];
+            total.latencies[op].merge(r.latencies[op]);
+        }
+        total.errors += r.errors;
+        total.seconds = std::max(total.seconds, r.seconds);
+        std::cout << sprint("  shard %d: %.2f ops/s, %d errors\n", shard, ops / r.seconds, r.errors);
+    }
+    std::cout << sprint("  %-6s %12s %10s %10s %10s %10s %10s\n", "op", "ops/s", "p50 us", "p90 us", "p99 us", "p999 us", "max us");
+    for (auto op : boost::irange(0u, op_types)) {
+        auto& h = total.latencies[op];
+        if (!total.ops[op]) {
+            continue;
+        }
+        std::cout << sprint("  %-6s %12.2f %10d %10d %10d %10d %10d\n", op_name(op_type(op)), total.ops[op] / total.seconds,
+                h.percentile(0.5), h.percentile(0.9), h.percentile(0.99), h.percentile(0.999), h.max());
+    }
+    std::cout << sprint("  %d errors\n", total.errors);
+}
+
+static future<> populate(cql_test_env& env, const workload& w) {
+    std::cout << "Writing " << w.partitions << " partitions of " << w.rows_per_partition << " rows..." << std::endl;
+    auto partitions = boost::irange(0u, w.partitions);
+    return do_for_each(partitions.begin(), partitions.end(), [&env, &w] (unsigned pk) {
+        auto rows = boost::irange(0u, w.rows_per_partition);
+        return do_for_each(rows.begin(), rows.end(), [&env, &w, pk] (unsigned ck) {
+            return env.execute_prepared(w.write_id, {
+                    cql3::raw_value::make_value(long_type->decompose(int64_t(pk))),
+                    cql3::raw_value::make_value(int32_type->decompose(int32_t(ck))),
+                    cql3::raw_value::make_value(bytes(bytes::initialized_later(), 64))}).discard_result();
+        });
+    });
+}
+
+static future<> run_scenario(cql_test_env& env, workload& w, const std::vector<step>& steps) {
+    return env.execute_cql("create table ks.scenario (pk bigint, ck int, v blob, primary key (pk, ck));").discard_result().then([&env, &w] {
+        return env.prepare("select v from ks.scenario where pk = ? and ck = ?;").then([&w] (bytes id) {
+            w.read_id = std::move(id);
+        });
+    }).then([&env, &w] {
+        return env.prepare("insert into ks.scenario (pk, ck, v) values (?, ?, ?);").then([&w] (bytes id) {
+            w.write_id = std::move(id);
+        });
+    }).then([&env, &w] {
+        return env.prepare(sprint("select pk, ck, v from ks.scenario where token(pk) >= ? limit %d;", w.scan_limit)).then([&w] (bytes id) {
+            w.scan_id = std::move(id);
+        });
+    }).then([&env, &w] {
+        return populate(env, w);
+    }).then([&env, &w, &steps] {
+        return do_for_each(steps, [&env, &w] (const step& s) {
+            std::cout << "Running step " << s << std::endl;
+            auto runner = make_shared<distributed<step_runner>>();
+            return runner->start(std::ref(env), s, w).then([runner] {
+                return runner->map([] (step_runner& r) {
+                    return r.run();
+                });
+            }).then([&s] (std::vector<shard_result> results) {
+                report(s, results);
+            }).finally([runner] {
+                return runner->stop().finally([runner] { });
+            });
+        });
+    });
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("scenario", bpo::value<sstring>(), "file with the steps to run, one per line")
+        ("partitions", bpo::value<unsigned>()->default_value(10000), "number of partitions")
+        ("rows-per-partition", bpo::value<unsigned>()->default_value(10), "number of rows in each partition")
+        ("scan-limit", bpo::value<unsigned>()->default_value(100), "rows read by each scan")
+        ("duration", bpo::value<unsigned>()->default_value(10), "duration of each step in seconds")
+        ("read", bpo::value<unsigned>()->default_value(1), "weight of single-row reads")
+        ("write", bpo::value<unsigned>()->default_value(0), "weight of single-row writes")
+        ("scan", bpo::value<unsigned>()->default_value(0), "weight of token range scans")
+        ("rate", bpo::value<unsigned>()->default_value(0), "operations per second of each shard, 0 for as many as possible")
+        ("concurrency", bpo::value<unsigned>()->default_value(100), "workers per shard")
+        ("cl", bpo::value<sstring>()->default_value("ONE"), "consistency level of the operations");
+
+    return app.run(argc, argv, [&app] {
+        auto& opts = app.configuration();
+        step defaults;
+        defaults.duration_in_seconds = opts["duration"].as<unsigned>();
+        defaults.ratios[unsigned(op_type::read)] = opts["read"].as<unsigned>();
+        defaults.ratios[unsigned(op_type::write)] = opts["write"].as<unsigned>();
+        defaults.ratios[unsigned(op_type::scan)] = opts["scan"].as<unsigned>();
+        defaults.rate = opts["rate"].as<unsigned>();
+        defaults.concurrency = opts["concurrency"].as<unsigned>();
+        defaults.cl = parse_consistency_level(opts["cl"].as<sstring>());
+        auto steps = opts.count("scenario")
+                ? load_scenario(opts["scenario"].as<sstring>(), defaults)
+                : std::vector<step>{parse_step("", defaults)};
+        auto w = make_lw_shared<workload>();
+        w->partitions = opts["partitions"].as<unsigned>();
+        w->rows_per_partition = opts["rows-per-partition"].as<unsigned>();
+        w->scan_limit = opts["scan-limit"].as<unsigned>();
+        return do_with_cql_env([w, steps = std::move(steps)] (cql_test_env& env) {
+            return run_scenario(env, *w, steps);
+        }).finally([w] { });
+    });
+}
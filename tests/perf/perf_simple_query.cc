@@ -24,6 +24,7 @@
 #include "tests/perf/perf.hh"
 #include "core/app-template.hh"
 #include "schema_builder.hh"
+#include "db/config.hh"
 
 #include "disk-error-handler.hh"
 
@@ -68,6 +69,8 @@ struct test_config {
     bool query_single_key;
     unsigned duration_in_seconds;
     bool counters;
+    bool inserts;
+    unsigned counter_cache_size_in_mb;
     unsigned operations_per_shard = 0;
 };
 
@@ -86,6 +89,8 @@ std::ostream& operator<<(std::ostream& os, const test_config& cfg) {
            << ", mode=" << cfg.mode
            << ", query_single_key=" << (cfg.query_single_key ? "yes" : "no")
            << ", counters=" << (cfg.counters ? "yes" : "no")
+           << ", inserts=" << (cfg.inserts ? "yes" : "no")
+           << ", counter_cache_size_in_mb=" << cfg.counter_cache_size_in_mb
            << "}";
 }
 
@@ -127,6 +132,30 @@ future<> test_write(cql_test_env& env, test_config& cfg) {
         });
 }
 
+// Prepared INSERTs binding all their values, as most clients write.
+future<> test_insert(cql_test_env& env, test_config& cfg) {
+    return env.prepare("INSERT INTO cf (\"KEY\", \"C0\", \"C1\", \"C2\", \"C3\", \"C4\") VALUES (?, ?, ?, ?, ?, ?);")
+        .then([&env, &cfg](auto id) {
+            auto values = make_lw_shared<std::vector<bytes>>(std::vector<bytes>{
+                from_hex("8f75da6b3dcec90c8a404fb9a5f6b0621e62d39c69ba5758e5f41b78311fbb26cc7a"),
+                from_hex("a8761a2127160003033a8f4f3d1069b7833ebe24ef56b3beee728c2b686ca516fa51"),
+                from_hex("583449ce81bfebc2e1a695eb59aad5fcc74d6d7311fc6197b10693e1a161ca2e1c64"),
+                from_hex("62bcb1dbc0ff953abc703bcb63ea954f437064c0c45366799658bd6b91d0f92908d7"),
+                from_hex("222fcbe31ffa1e689540e1499b87fa3f9c781065fccd10e4772b4c7039c2efd0fb27"),
+            });
+            return time_parallel([&env, &cfg, id, values] {
+                bytes key = make_key(cfg.query_single_key ? 0 : std::rand() % cfg.partitions);
+                std::vector<cql3::raw_value> params;
+                params.reserve(values->size() + 1);
+                params.push_back(cql3::raw_value::make_value(std::move(key)));
+                for (auto&& v : *values) {
+                    params.push_back(cql3::raw_value::make_value(v));
+                }
+                return env.execute_prepared(id, std::move(params)).discard_result();
+            }, cfg.concurrency, cfg.duration_in_seconds, cfg.operations_per_shard);
+        });
+}
+
 future<> test_delete(cql_test_env& env, test_config& cfg) {
     return create_partitions(env, cfg).then([&env] {
         return env.prepare("DELETE \"C0\", \"C1\", \"C2\", \"C3\", \"C4\" FROM cf WHERE \"KEY\" = ?");
@@ -144,7 +173,7 @@ future<> test_counter_update(cql_test_env& env, test_config& cfg) {
                            "\"C1\" = \"C1\" + 2,"
                            "\"C2\" = \"C2\" + 3,"
                            "\"C3\" = \"C3\" + 4,"
-                           "\"C4\" = \"C4\" + 5"
+                           "\"C4\" = \"C4\" + 5 "
                            "WHERE \"KEY\" = ?;")
         .then([&env, &cfg] (auto id) {
             return time_parallel([&env, &cfg, id] {
@@ -184,6 +213,8 @@ future<> do_test(cql_test_env& env, test_config& cfg) {
             case test_config::run_mode::write:
                 if (cfg.counters) {
                     return test_counter_update(env, cfg);
+                } else if (cfg.inserts) {
+                    return test_insert(env, cfg);
                 } else {
                     return test_write(env, cfg);
                 }
@@ -205,9 +236,13 @@ int main(int argc, char** argv) {
         ("query-single-key", "test reading with a single key instead of random keys")
         ("concurrency", bpo::value<unsigned>()->default_value(100), "workers per core")
         ("operations-per-shard", bpo::value<unsigned>(), "run this many operations per shard (overrides duration)")
-        ("counters", "test counters");
+        ("counters", "test counters")
+        ("inserts", "with --write, test prepared INSERTs binding all their values rather than UPDATEs of constants")
+        ("counter-cache-size-in-mb", bpo::value<unsigned>()->default_value(50), "memory for the local counter shards of recently updated counters, 0 makes every counter update read first");
 
     return app.run(argc, argv, [&app] {
+        db::config db_cfg;
+        db_cfg.counter_cache_size_in_mb = app.configuration()["counter-cache-size-in-mb"].as<unsigned>();
         return do_with_cql_env([&app] (auto&& env) {
             auto cfg = make_lw_shared<test_config>();
             cfg->partitions = app.configuration()["partitions"].as<unsigned>();
@@ -215,6 +250,8 @@ int main(int argc, char** argv) {
             cfg->concurrency = app.configuration()["concurrency"].as<unsigned>();
             cfg->query_single_key = app.configuration().count("query-single-key");
             cfg->counters = app.configuration().count("counters");
+            cfg->inserts = app.configuration().count("inserts");
+            cfg->counter_cache_size_in_mb = app.configuration()["counter-cache-size-in-mb"].as<unsigned>();
             if (app.configuration().count("write")) {
                 cfg->mode = test_config::run_mode::write;
             } else if (app.configuration().count("delete")) {
@@ -226,6 +263,6 @@ int main(int argc, char** argv) {
                 cfg->operations_per_shard = app.configuration()["operations-per-shard"].as<unsigned>();
             }
             return do_test(env, *cfg).finally([cfg] {});
-        });
+        }, db_cfg);
     });
 }
@@ -57,18 +57,34 @@ future<> test_sequential_read(distributed<test_env>& dt) {
     return time_runs(iterations, parallelism, dt, &test_env::read_sequential_partitions);
 }
 
+future<> test_random_read(distributed<test_env>& dt) {
+    return time_runs(iterations, parallelism, dt, &test_env::read_random_partitions);
+}
+
+future<> test_compaction(distributed<test_env>& dt) {
+    return dt.invoke_on_all([] (test_env &t) {
+        return t.write_compaction_inputs();
+    }).then([&dt] {
+        return time_runs(iterations, parallelism, dt, &test_env::compact_sstables);
+    });
+}
+
 enum class test_modes {
+    random_read,
     sequential_read,
     index_read,
     write,
     index_write,
+    compaction,
 };
 
 static std::unordered_map<sstring, test_modes> test_mode = {
+    {"random_read", test_modes::random_read },
     {"sequential_read", test_modes::sequential_read },
     {"index_read", test_modes::index_read },
     {"write", test_modes::write },
     {"index_write", test_modes::index_write },
+    {"compaction", test_modes::compaction },
 };
 
 int main(int argc, char** argv) {
@@ -82,7 +98,14 @@ int main(int argc, char** argv) {
         ("key_size", bpo::value<unsigned>()->default_value(128), "size of partition key")
         ("num_columns", bpo::value<unsigned>()->default_value(5), "number of columns per row")
         ("column_size", bpo::value<unsigned>()->default_value(64), "size in bytes for each column")
-        ("mode", bpo::value<sstring>()->default_value("index_write"), "one of: random_read, sequential_read, index_read, write, index_write (default)")
+        ("rows_per_partition", bpo::value<unsigned>()->default_value(0), "number of rows per partition; 0 for a table without clustering key")
+        ("sstable_format", bpo::value<sstring>()->default_value("ka"), "sstable format version: ka, la or sa")
+        ("compressor", bpo::value<sstring>()->default_value("LZ4Compressor"), "sstable compressor class, or none")
+        ("chunk_size", bpo::value<unsigned>()->default_value(4), "compression chunk size, in KB")
+        ("promoted_index_block_size", bpo::value<unsigned>()->default_value(64), "distance between promoted index entries, in KB")
+        ("random_reads", bpo::value<unsigned>()->default_value(10000), "number of partitions read by key in each random_read run")
+        ("sstables", bpo::value<unsigned>()->default_value(4), "number of sstables merged in each compaction run")
+        ("mode", bpo::value<sstring>()->default_value("index_write"), "one of: random_read, sequential_read, index_read, write, index_write (default), compaction")
         ("testdir", bpo::value<sstring>()->default_value("/var/lib/scylla/perf-tests"), "directory in which to store the sstables");
 
     return app.run_deprecated(argc, argv, [&app] {
@@ -96,7 +119,22 @@ int main(int argc, char** argv) {
         cfg.buffer_size = app.configuration()["buffer_size"].as<unsigned>() << 10;
         sstring dir = app.configuration()["testdir"].as<sstring>();
         cfg.dir = dir;
-        auto mode = test_mode[app.configuration()["mode"].as<sstring>()];
+        cfg.rows_per_partition = app.configuration()["rows_per_partition"].as<unsigned>();
+        auto format = app.configuration()["sstable_format"].as<sstring>();
+        cfg.version = sstable::version_from_sstring(format);
+        cfg.compressor = app.configuration()["compressor"].as<sstring>();
+        if (cfg.compressor == "none") {
+            cfg.compressor = "";
+        }
+        cfg.chunk_size_kb = app.configuration()["chunk_size"].as<unsigned>();
+        cfg.promoted_index_block_size = app.configuration()["promoted_index_block_size"].as<unsigned>() << 10;
+        cfg.random_reads = app.configuration()["random_reads"].as<unsigned>();
+        cfg.sstables = app.configuration()["sstables"].as<unsigned>();
+        auto it = test_mode.find(app.configuration()["mode"].as<sstring>());
+        if (it == test_mode.end()) {
+            throw std::invalid_argument("Invalid mode");
+        }
+        auto mode = it->second;
         if ((mode == test_modes::index_read) || (mode == test_modes::index_write)) {
             cfg.num_columns = 0;
             cfg.column_size = 0;
@@ -107,9 +145,15 @@ int main(int argc, char** argv) {
         return test->start(std::move(cfg)).then([mode, dir, test] {
             engine().at_exit([test] { return test->stop(); });
             if ((mode == test_modes::index_read) ||
-               (mode == test_modes::sequential_read)) {
-                return test->invoke_on_all([] (test_env &t) {
-                    return t.load_sstables(iterations);
+               (mode == test_modes::sequential_read) ||
+               (mode == test_modes::random_read)) {
+                return test->invoke_on_all([mode] (test_env &t) {
+                    return t.load_sstables(iterations).then([&t, mode] {
+                        if (mode == test_modes::random_read) {
+                            return t.load_keys();
+                        }
+                        return make_ready_future<>();
+                    });
                 }).then_wrapped([] (future<> f) {
                     try {
                         f.get();
@@ -118,7 +162,7 @@ int main(int argc, char** argv) {
                         throw;
                     }
                 });
-            } else if ((mode == test_modes::index_write) || (mode == test_modes::write)) {
+            } else if ((mode == test_modes::index_write) || (mode == test_modes::write) || (mode == test_modes::compaction)) {
                 return test_setup::create_empty_test_dir(dir);
             } else {
                 throw std::invalid_argument("Invalid mode");
@@ -128,6 +172,10 @@ int main(int argc, char** argv) {
                 return test_index_read(*test).then([test] {});
             } else if (mode == test_modes::sequential_read) {
                 return test_sequential_read(*test).then([test] {});
+            } else if (mode == test_modes::random_read) {
+                return test_random_read(*test).then([test] {});
+            } else if (mode == test_modes::compaction) {
+                return test_compaction(*test).then([test] {});
             } else if ((mode == test_modes::index_write) || (mode == test_modes::write)) {
                 return test_write(*test).then([test] {});
             } else {
@@ -26,9 +26,89 @@
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
 #include <boost/range/irange.hpp>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 using namespace sstables;
 
+// Counts the CPU cycles spent by the calling thread, through perf_event_open(2).
+// Where hardware counters aren't available (e.g. in most virtual machines, or
+// with a restrictive perf_event_paranoid), it counts nothing and valid()
+// returns false.
+class cycle_counter {
+    int _fd = -1;
+public:
+    cycle_counter() {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_hv = 1;
+        _fd = ::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (_fd < 0) {
+            // Unprivileged users may still count cycles spent in user space.
+            attr.exclude_kernel = 1;
+            _fd = ::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+    }
+    cycle_counter(const cycle_counter&) = delete;
+    ~cycle_counter() {
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+    }
+    bool valid() const {
+        return _fd >= 0;
+    }
+    uint64_t read() const {
+        uint64_t value = 0;
+        if (_fd < 0 || ::read(_fd, &value, sizeof(value)) != sizeof(value)) {
+            return 0;
+        }
+        return value;
+    }
+};
+
+// What a run did on one shard, or, once reduced, on all of them.
+struct run_result {
+    uint64_t partitions = 0;
+    uint64_t rows = 0;
+    double seconds = 0;
+    uint64_t cycles = 0;
+    bool cycles_valid = true;
+    uint64_t aio_reads = 0;
+    uint64_t aio_read_bytes = 0;
+    uint64_t aio_writes = 0;
+    uint64_t aio_write_bytes = 0;
+
+    run_result& operator+=(const run_result& o) {
+        partitions += o.partitions;
+        rows += o.rows;
+        // Shards run concurrently.
+        seconds = std::max(seconds, o.seconds);
+        cycles += o.cycles;
+        cycles_valid &= o.cycles_valid;
+        aio_reads += o.aio_reads;
+        aio_read_bytes += o.aio_read_bytes;
+        aio_writes += o.aio_writes;
+        aio_write_bytes += o.aio_write_bytes;
+        return *this;
+    }
+
+    double partitions_per_second() const {
+        return partitions / seconds;
+    }
+
+    double bytes_per_second() const {
+        return (aio_read_bytes + aio_write_bytes) / seconds;
+    }
+
+    double cycles_per_row() const {
+        return rows ? double(cycles) / rows : 0;
+    }
+};
+
 class test_env {
 public:
     struct conf {
@@ -36,11 +116,59 @@ class test_env {
         unsigned key_size;
         unsigned num_columns;
         unsigned column_size;
+        // Rows of each partition; 0 makes a table without clustering key,
+        // with a single row per partition.
+        unsigned rows_per_partition;
         size_t buffer_size;
         sstring dir;
+        sstable::version_types version;
+        // Empty for no compression.
+        sstring compressor;
+        unsigned chunk_size_kb;
+        // The distance between the entries of the promoted index.
+        size_t promoted_index_block_size;
+        // Partitions read by key in each random_read run.
+        unsigned random_reads;
+        // Input sstables of the compaction mode.
+        unsigned sstables;
     };
 
+    using clk = std::chrono::steady_clock;
+    static auto now() {
+        return clk::now();
+    }
+
 private:
+    // Taken before a run on the shard which does it.
+    class run_snapshot {
+        clk::time_point _start;
+        uint64_t _cycles;
+        reactor::io_stats _io;
+        const cycle_counter& _counter;
+    public:
+        explicit run_snapshot(const cycle_counter& counter)
+            : _start(now())
+            , _cycles(counter.read())
+            , _io(engine().get_io_stats())
+            , _counter(counter)
+        { }
+
+        run_result finish(uint64_t partitions, uint64_t rows) const {
+            auto io = engine().get_io_stats();
+            run_result r;
+            r.partitions = partitions;
+            r.rows = rows;
+            r.seconds = std::chrono::duration<double>(now() - _start).count();
+            r.cycles = _counter.read() - _cycles;
+            r.cycles_valid = _counter.valid();
+            r.aio_reads = io.aio_reads - _io.aio_reads;
+            r.aio_read_bytes = io.aio_read_bytes - _io.aio_read_bytes;
+            r.aio_writes = io.aio_writes - _io.aio_writes;
+            r.aio_write_bytes = io.aio_write_bytes - _io.aio_write_bytes;
+            return r;
+        }
+    };
+
     sstring dir() {
         return _cfg.dir + "/" + to_sstring(engine().cpu_id());
     }
@@ -61,12 +189,19 @@ class test_env {
         return random_string(_cfg.column_size);
     }
 
+    unsigned rows_per_partition() const {
+        return std::max(_cfg.rows_per_partition, 1u);
+    }
+
     conf _cfg;
     schema_ptr s;
     std::default_random_engine _generator;
     std::uniform_int_distribution<char> _distribution;
     lw_shared_ptr<memtable> _mt;
     std::vector<lw_shared_ptr<sstable>> _sst;
+    // The partitions of _sst[0], for random reads.
+    std::vector<sstables::key> _keys;
+    std::unique_ptr<cycle_counter> _cycles;
 
     schema_ptr create_schema() {
         std::vector<schema::column> columns;
@@ -75,11 +210,16 @@ class test_env {
             columns.push_back(schema::column{ to_bytes(sprint("column%04d", i)), utf8_type });
         }
 
+        std::vector<schema::column> clustering_key;
+        if (_cfg.rows_per_partition) {
+            clustering_key.push_back(schema::column{ "ck", int32_type });
+        }
+
         schema_builder builder(make_lw_shared(schema(generate_legacy_id("ks", "perf-test"), "ks", "perf-test",
             // partition key
             {{"name", utf8_type}},
             // clustering key
-            {},
+            { clustering_key },
             // regular columns
             { columns },
             // static columns
@@ -89,14 +229,62 @@ class test_env {
             // comment
             "Perf tests"
         )));
+        std::map<sstring, sstring> compression;
+        compression[compression_parameters::SSTABLE_COMPRESSION] = _cfg.compressor;
+        if (!_cfg.compressor.empty()) {
+            compression[compression_parameters::CHUNK_LENGTH_KB] = to_sstring(_cfg.chunk_size_kb);
+        }
+        builder.set_compressor_params(compression_parameters(compression));
         return builder.build(schema_builder::compact_storage::no);
     }
 
+    mutation make_mutation(partition_key key, api::timestamp_type ts) {
+        auto mut = mutation(std::move(key), s);
+        for (auto i : boost::irange(0u, rows_per_partition())) {
+            auto ck = _cfg.rows_per_partition
+                    ? clustering_key::from_single_value(*s, int32_type->decompose(int32_t(i)))
+                    : clustering_key::make_empty();
+            for (auto& cdef: s->regular_columns()) {
+                mut.set_clustered_cell(ck, cdef, atomic_cell::make_live(ts, utf8_type->decompose(random_column())));
+            }
+        }
+        return mut;
+    }
+
+    sstable_writer_config writer_config() const {
+        sstable_writer_config cfg;
+        cfg.promoted_index_block_size = _cfg.promoted_index_block_size;
+        return cfg;
+    }
+
+    future<> write_memtable(lw_shared_ptr<memtable> mt, sstring dir, int64_t generation) {
+        auto sst = sstables::test::make_test_sstable(_cfg.buffer_size, s, dir, generation, _cfg.version, sstable::format_types::big);
+        return sst->write_components(mt->make_flush_reader(s, default_priority_class()), mt->partition_count(), s, writer_config()).then([sst, mt] {});
+    }
+
+    future<> load_sstable(sstring dir, int64_t generation) {
+        auto sst = make_lw_shared<sstable>(s, dir, generation, _cfg.version, sstable::format_types::big);
+        _sst.push_back(sst);
+        return sst->load();
+    }
+
+    uint64_t check_partition(const mutation& m) {
+        auto rows = m.partition().clustered_rows().calculate_size();
+        auto row = m.partition().find_row(*s, _cfg.rows_per_partition
+                ? clustering_key::from_single_value(*s, int32_type->decompose(int32_t(0)))
+                : clustering_key::make_empty());
+        if (rows != rows_per_partition() || !row || row->size() != _cfg.num_columns) {
+            throw std::invalid_argument("Invalid sstable found. Maybe you ran write mode with different num_columns or rows_per_partition settings?");
+        }
+        return rows;
+    }
+
 public:
     test_env(conf cfg) : _cfg(std::move(cfg))
            , s(create_schema())
            , _distribution('@', '~')
            , _mt(make_lw_shared<memtable>(s))
+           , _cycles(std::make_unique<cycle_counter>())
     {}
 
     future<> stop() { return make_ready_future<>(); }
@@ -105,43 +293,65 @@ class test_env {
         auto idx = boost::irange(0, int(_cfg.partitions));
         return do_for_each(idx.begin(), idx.end(), [this] (auto iteration) {
             auto key = partition_key::from_deeply_exploded(*s, { this->random_key() });
-            auto mut = mutation(key, this->s);
-            for (auto& cdef: this->s->regular_columns()) {
-                mut.set_clustered_cell(clustering_key::make_empty(), cdef, atomic_cell::make_live(0, utf8_type->decompose(this->random_column())));
-            }
-            this->_mt->apply(std::move(mut));
+            this->_mt->apply(this->make_mutation(std::move(key), 0));
             return make_ready_future<>();
         });
     }
 
     future<> load_sstables(unsigned iterations) {
-        _sst.push_back(make_lw_shared<sstable>(s, this->dir(), 0, sstable::version_types::ka, sstable::format_types::big));
-        return _sst.back()->load();
+        return load_sstable(this->dir(), 0);
     }
 
-    using clk = std::chrono::steady_clock;
-    static auto now() {
-        return clk::now();
+    // Remembers the keys of the loaded sstable, as its index lists them.
+    future<> load_keys() {
+        return do_with(test(_sst[0]), [this] (auto& sst) {
+            auto idx = boost::irange(0, int(sst.get_summary().header.size));
+            return do_for_each(idx.begin(), idx.end(), [this, &sst] (uint64_t entry) {
+                return sst.read_indexes(entry).then([this] (auto il) {
+                    for (auto& ie : il) {
+                        _keys.push_back(sstables::key::from_bytes(to_bytes(ie.get_key_bytes())));
+                    }
+                });
+            });
+        });
     }
 
+    // Writes the input sstables of the compaction mode: all of them have the
+    // same partitions, so that the compaction merges each one of them, and
+    // later sstables have newer cells.
+    future<> write_compaction_inputs() {
+        auto keys = make_lw_shared<std::vector<partition_key>>();
+        for (unsigned i = 0; i < _cfg.partitions; ++i) {
+            keys->push_back(partition_key::from_deeply_exploded(*s, { random_key() }));
+        }
+        return test_setup::create_empty_test_dir(dir()).then([this, keys] {
+            auto gens = boost::irange(1, int(_cfg.sstables) + 1);
+            return do_for_each(gens.begin(), gens.end(), [this, keys] (int generation) {
+                auto mt = make_lw_shared<memtable>(s);
+                for (auto& key : *keys) {
+                    mt->apply(make_mutation(key, generation));
+                }
+                return write_memtable(mt, dir(), generation).then([this, generation] {
+                    return load_sstable(dir(), generation);
+                });
+            });
+        });
+    }
 
     // Mappers below
-    future<double> flush_memtable(int idx) {
-        auto start = test_env::now();
+    future<run_result> flush_memtable(int idx) {
+        auto snap = make_lw_shared<run_snapshot>(*_cycles);
         size_t partitions = _mt->partition_count();
         return test_setup::create_empty_test_dir(dir()).then([this, idx] {
-            auto sst = sstables::test::make_test_sstable(_cfg.buffer_size, s, dir(), idx, sstable::version_types::ka, sstable::format_types::big);
-            return sst->write_components(*_mt).then([sst] {});
-        }).then([start, partitions] {
-            auto end = test_env::now();
-            auto duration = std::chrono::duration<double>(end - start).count();
-            return partitions / duration;
+            return write_memtable(_mt, dir(), idx);
+        }).then([this, snap, partitions] {
+            return snap->finish(partitions, partitions * rows_per_partition());
         });
     }
 
-    future<double> read_all_indexes(int idx) {
-        return do_with(test(_sst[0]), [] (auto& sst) {
-            auto start = test_env::now();
+    future<run_result> read_all_indexes(int idx) {
+        return do_with(test(_sst[0]), [this] (auto& sst) {
+            auto snap = make_lw_shared<run_snapshot>(*_cycles);
             auto total = make_lw_shared<size_t>(0);
             auto& summary = sst.get_summary();
             auto idx = boost::irange(0, int(summary.header.size));
@@ -150,60 +360,118 @@ class test_env {
                 return sst.read_indexes(entry).then([total] (auto il) {
                     *total += il.size();
                 });
-            }).then([total, start] {
-                auto end = test_env::now();
-                auto duration = std::chrono::duration<double>(end - start).count();
-                return *total / duration;
+            }).then([total, snap] {
+                return snap->finish(*total, *total);
             });
         });
     }
 
-    future<double> read_sequential_partitions(int idx) {
+    future<run_result> read_sequential_partitions(int idx) {
         return do_with(_sst[0]->read_rows(s), [this] (sstables::mutation_reader& r) {
-            auto start = test_env::now();
+            auto snap = make_lw_shared<run_snapshot>(*_cycles);
             auto total = make_lw_shared<size_t>(0);
+            auto rows = make_lw_shared<uint64_t>(0);
             auto done = make_lw_shared<bool>(false);
-            return do_until([done] { return *done; }, [this, done, total, &r] {
+            return do_until([done] { return *done; }, [this, done, total, rows, &r] {
                 return r.read().then([] (auto sm) {
                     return mutation_from_streamed_mutation(std::move(sm));
-                }).then([this, done, total] (mutation_opt m) {
+                }).then([this, done, total, rows] (mutation_opt m) {
                     if (!m) {
                         *done = true;
                     } else {
-                        auto row = m->partition().find_row(*s, clustering_key::make_empty());
-                        if (!row || row->size() != _cfg.num_columns) {
-                            throw std::invalid_argument("Invalid sstable found. Maybe you ran write mode with different num_columns settings?");
-                        } else {
-                            (*total)++;
-                        }
+                        *rows += this->check_partition(*m);
+                        (*total)++;
                     }
                 });
-            }).then([total, start] {
-                auto end = test_env::now();
-                auto duration = std::chrono::duration<double>(end - start).count();
-                return *total / duration;
+            }).then([total, rows, snap] {
+                return snap->finish(*total, *rows);
+            });
+        });
+    }
+
+    // Reads random partitions by key, each looked up through the summary and
+    // the index.
+    future<run_result> read_random_partitions(int idx) {
+        if (_keys.empty()) {
+            throw std::invalid_argument("The sstable has no partitions");
+        }
+        auto snap = make_lw_shared<run_snapshot>(*_cycles);
+        auto rows = make_lw_shared<uint64_t>(0);
+        auto reads = boost::irange(0u, _cfg.random_reads);
+        return do_for_each(reads.begin(), reads.end(), [this, rows] (unsigned) {
+            auto& key = _keys[std::uniform_int_distribution<size_t>(0, _keys.size() - 1)(_generator)];
+            return _sst[0]->read_row(s, key).then([] (streamed_mutation_opt sm) {
+                return mutation_from_streamed_mutation(std::move(sm));
+            }).then([this, rows] (mutation_opt m) {
+                if (!m) {
+                    throw std::runtime_error("A partition listed in the index wasn't found");
+                }
+                *rows += this->check_partition(*m);
             });
+        }).then([this, snap, rows] {
+            return snap->finish(_cfg.random_reads, *rows);
+        });
+    }
+
+    // Merges the input sstables into a new one, the way compaction does.
+    future<run_result> compact_sstables(int idx) {
+        auto snap = make_lw_shared<run_snapshot>(*_cycles);
+        auto out_dir = dir() + "/compacted-" + to_sstring(idx);
+        return test_setup::create_empty_test_dir(out_dir).then([this, out_dir, idx] {
+            std::vector<::mutation_reader> readers;
+            for (auto& sst : _sst) {
+                readers.emplace_back(sst->read_rows(s));
+            }
+            auto reader = make_combined_reader(std::move(readers));
+            auto sst = sstables::test::make_test_sstable(_cfg.buffer_size, s, out_dir, _cfg.sstables + 1 + idx, _cfg.version, sstable::format_types::big);
+            return sst->write_components(std::move(reader), _cfg.partitions, s, writer_config()).then([sst] {});
+        }).then([this, snap] {
+            // Each input row is read once.
+            return snap->finish(_cfg.partitions, uint64_t(_cfg.partitions) * rows_per_partition() * _cfg.sstables);
         });
     }
 };
 
-// The function func should carry on with the test, and return the number of partitions processed.
-// time_runs will then map reduce it, and return the aggregate partitions / sec for the whole system.
+// The function func should carry on with the test, and return what the run did on
+// the shard. time_runs will then map reduce it, and report the aggregate rates for
+// the whole system.
 template <typename Func>
 future<> time_runs(unsigned iterations, unsigned parallelism, distributed<test_env>& dt, Func func) {
     using namespace boost::accumulators;
-    auto acc = make_lw_shared<accumulator_set<double, features<tag::mean, tag::error_of<tag::mean>>>>();
+    using accumulator = accumulator_set<double, features<tag::mean, tag::error_of<tag::mean>>>;
+    struct accumulators {
+        accumulator partitions;
+        accumulator bytes;
+        accumulator cycles;
+        accumulator aio_reads;
+        accumulator aio_writes;
+        bool cycles_valid = true;
+    };
+    auto acc = make_lw_shared<accumulators>();
     auto idx = boost::irange(0, int(iterations));
     return do_for_each(idx.begin(), idx.end(), [parallelism, acc, &dt, func] (auto iter) {
         auto idx = boost::irange(0, int(parallelism));
         return parallel_for_each(idx.begin(), idx.end(), [&dt, func, acc] (auto idx) {
-            return dt.map_reduce(adder<double>(), func, std::move(idx)).then([acc] (double result) {
+            return dt.map_reduce(adder<run_result>(), func, std::move(idx)).then([acc] (run_result result) {
                 auto& a = *acc;
-                a(result);
+                a.partitions(result.partitions_per_second());
+                a.bytes(result.bytes_per_second());
+                a.cycles(result.cycles_per_row());
+                a.aio_reads(result.aio_reads);
+                a.aio_writes(result.aio_writes);
+                a.cycles_valid &= result.cycles_valid;
                 return make_ready_future<>();
             });
         });
     }).then([acc, iterations, parallelism] {
-        std::cout << sprint("%.2f", mean(*acc)) << " +- " << sprint("%.2f", error_of<tag::mean>(*acc)) << " partitions / sec (" << iterations << " runs, " << parallelism << " concurrent ops)\n";
+        auto& a = *acc;
+        std::cout << sprint("%.2f", mean(a.partitions)) << " +- " << sprint("%.2f", error_of<tag::mean>(a.partitions)) << " partitions / sec (" << iterations << " runs, " << parallelism << " concurrent ops)\n";
+        std::cout << sprint("%.2f", mean(a.bytes) / (1 << 20)) << " +- " << sprint("%.2f", error_of<tag::mean>(a.bytes) / (1 << 20)) << " MiB / sec read and written\n";
+        if (a.cycles_valid) {
+            std::cout << sprint("%.1f", mean(a.cycles)) << " +- " << sprint("%.1f", error_of<tag::mean>(a.cycles)) << " cycles / row\n";
+        } else {
+            std::cout << "cycles / row: not available (no CPU cycle counter)\n";
+        }
+        std::cout << sprint("%.1f", mean(a.aio_reads)) << " aio reads, " << sprint("%.1f", mean(a.aio_writes)) << " aio writes per run\n";
     });
 }
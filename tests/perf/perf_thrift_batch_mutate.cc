@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the throughput of Thrift batch_mutate() requests, going through
+// the Thrift handler and the storage proxy, like the writes of
+// perf_simple_query go through CQL.
+
+#include "tests/cql_test_env.hh"
+#include "tests/perf/perf.hh"
+#include "core/app-template.hh"
+#include "schema_builder.hh"
+#include "thrift/handler.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+using mutation_map = std::map<std::string, std::map<std::string, std::vector<::cassandra::Mutation>>>;
+
+struct test_config {
+    unsigned partitions;
+    unsigned partitions_per_batch;
+    unsigned cells_per_partition;
+    unsigned value_size;
+    unsigned concurrency;
+    unsigned duration_in_seconds;
+    unsigned operations_per_shard = 0;
+};
+
+std::ostream& operator<<(std::ostream& os, const test_config& cfg) {
+    return os << "{partitions=" << cfg.partitions
+           << ", partitions_per_batch=" << cfg.partitions_per_batch
+           << ", cells_per_partition=" << cfg.cells_per_partition
+           << ", value_size=" << cfg.value_size
+           << ", concurrency=" << cfg.concurrency
+           << "}";
+}
+
+static std::string make_key(uint64_t sequence) {
+    return std::string(reinterpret_cast<const char*>(&sequence), sizeof(sequence));
+}
+
+static schema make_schema(const sstring& ks_name) {
+    // A dynamic column family, as created by Thrift applications.
+    return *schema_builder(ks_name, "cf")
+            .with_column("key", bytes_type, column_kind::partition_key)
+            .with_column("column1", bytes_type, column_kind::clustering_key)
+            .with_column("value", bytes_type)
+            .set_is_dense(true)
+            .set_is_compound(false)
+            .set_regular_column_name_type(utf8_type)
+            .build();
+}
+
+static mutation_map make_batch(const test_config& cfg) {
+    mutation_map batch;
+    auto timestamp = api::new_timestamp();
+    for (unsigned p = 0; p < cfg.partitions_per_batch; ++p) {
+        auto& mutations = batch[make_key(std::rand() % cfg.partitions)]["cf"];
+        for (unsigned c = 0; c < cfg.cells_per_partition; ++c) {
+            ::cassandra::Column col;
+            col.__set_name(make_key(c));
+            col.__set_value(std::string(cfg.value_size, 'v'));
+            col.__set_timestamp(timestamp);
+            ::cassandra::ColumnOrSuperColumn cosc;
+            cosc.__set_column(std::move(col));
+            ::cassandra::Mutation m;
+            m.__set_column_or_supercolumn(std::move(cosc));
+            mutations.emplace_back(std::move(m));
+        }
+    }
+    return batch;
+}
+
+static thread_local std::unique_ptr<::cassandra::CassandraCobSvIfFactory> handler_factory;
+static thread_local ::cassandra::CassandraCobSvIf* handler;
+
+static future<> start_handlers(cql_test_env& env) {
+    return smp::invoke_on_all([&env] {
+        handler_factory = create_handler_factory(env.db(), env.qp());
+        handler = handler_factory->getHandler(::apache::thrift::TConnectionInfo());
+        handler->set_keyspace([] { }, [] (::apache::thrift::TDelayedException*) {
+            throw std::runtime_error("set_keyspace() failed");
+        }, "ks");
+    });
+}
+
+static future<> stop_handlers() {
+    return smp::invoke_on_all([] {
+        handler_factory->releaseHandler(handler);
+        handler_factory = { };
+    });
+}
+
+static future<> batch_mutate(const test_config& cfg) {
+    auto batch = make_lw_shared<mutation_map>(make_batch(cfg));
+    auto done = make_lw_shared<promise<>>();
+    handler->batch_mutate([done] {
+        done->set_value();
+    }, [done] (::apache::thrift::TDelayedException* e) {
+        try {
+            e->throw_it();
+        } catch (...) {
+            done->set_exception(std::current_exception());
+        }
+    }, *batch, ::cassandra::ConsistencyLevel::ONE);
+    return done->get_future().finally([batch] { });
+}
+
+future<> do_test(cql_test_env& env, test_config& cfg) {
+    std::cout << "Running test with config: " << cfg << std::endl;
+    return env.create_table(make_schema).then([&env] {
+        return start_handlers(env);
+    }).then([&cfg] {
+        return time_parallel([&cfg] {
+            return batch_mutate(cfg);
+        }, cfg.concurrency, cfg.duration_in_seconds, cfg.operations_per_shard);
+    }).finally([] {
+        return stop_handlers();
+    });
+}
+
+int main(int argc, char** argv) {
+    namespace bpo = boost::program_options;
+    app_template app;
+    app.add_options()
+        ("partitions", bpo::value<unsigned>()->default_value(10000), "number of partitions")
+        ("partitions-per-batch", bpo::value<unsigned>()->default_value(10), "partitions written by each request")
+        ("cells-per-partition", bpo::value<unsigned>()->default_value(10), "cells written to each partition")
+        ("value-size", bpo::value<unsigned>()->default_value(100), "size of the cell values in bytes")
+        ("duration", bpo::value<unsigned>()->default_value(5), "test duration in seconds")
+        ("concurrency", bpo::value<unsigned>()->default_value(100), "workers per core")
+        ("operations-per-shard", bpo::value<unsigned>(), "run this many operations per shard (overrides duration)");
+
+    return app.run(argc, argv, [&app] {
+        return do_with_cql_env([&app] (auto&& env) {
+            auto cfg = make_lw_shared<test_config>();
+            cfg->partitions = app.configuration()["partitions"].as<unsigned>();
+            cfg->partitions_per_batch = app.configuration()["partitions-per-batch"].as<unsigned>();
+            cfg->cells_per_partition = app.configuration()["cells-per-partition"].as<unsigned>();
+            cfg->value_size = app.configuration()["value-size"].as<unsigned>();
+            cfg->duration_in_seconds = app.configuration()["duration"].as<unsigned>();
+            cfg->concurrency = app.configuration()["concurrency"].as<unsigned>();
+            if (app.configuration().count("operations-per-shard")) {
+                cfg->operations_per_shard = app.configuration()["operations-per-shard"].as<unsigned>();
+            }
+            return do_test(env, *cfg).finally([cfg] {});
+        });
+    });
+}
@@ -23,6 +23,7 @@
 #include <core/app-template.hh>
 #include <core/sstring.hh>
 #include <core/thread.hh>
+#include <core/reactor.hh>
 
 #include "utils/managed_bytes.hh"
 #include "utils/logalloc.hh"
@@ -50,6 +51,34 @@ clustering_key new_ckey(schema_ptr s) {
     return clustering_key::from_single_value(*s, to_bytes(sprint("ckey%d", next++)));
 }
 
+// Measures the longest time the reactor didn't get to run other tasks while
+// a background task keeps rescheduling itself.
+class stall_detector {
+    using clk = std::chrono::steady_clock;
+    clk::time_point _last;
+    clk::duration _max_stall{};
+    bool _stopped = false;
+    future<> _done = make_ready_future<>();
+public:
+    void start() {
+        _stopped = false;
+        _last = clk::now();
+        _done = do_until([this] { return _stopped; }, [this] {
+            auto now = clk::now();
+            _max_stall = std::max(_max_stall, now - _last);
+            _last = now;
+            return later();
+        });
+    }
+    void stop() {
+        _stopped = true;
+        _done.get();
+    }
+    clk::duration max_stall() const {
+        return _max_stall;
+    }
+};
+
 int main(int argc, char** argv) {
     namespace bpo = boost::program_options;
     app_template app;
@@ -89,6 +118,16 @@ int main(int argc, char** argv) {
                 mutations.emplace_back(std::move(m));
             }
 
+            // So that updates merge memtables into cached partitions, rather
+            // than just invalidating them.
+            if (update_cache) {
+                for (auto&& m : mutations) {
+                    cache.populate(m);
+                }
+            }
+
+            stall_detector stalls;
+
             time_it([&] {
                 auto mt = make_lw_shared<memtable>(s);
                 for (auto&& m : mutations) {
@@ -100,9 +139,16 @@ int main(int argc, char** argv) {
                 };
 
                 if (update_cache) {
+                    stalls.start();
                     cache.update(*mt, checker).get();
+                    stalls.stop();
                 }
             }, 5, 1);
+
+            if (update_cache) {
+                std::cout << sprint("max stall: %.3f ms\n",
+                    std::chrono::duration<double, std::milli>(stalls.max_stall()).count());
+            }
         });
     });
 }
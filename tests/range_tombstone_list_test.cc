@@ -690,3 +690,28 @@ BOOST_AUTO_TEST_CASE(test_difference_with_smaller_tombstone) {
     assert_rt(rtei(13, 14, 1), *it++);
     BOOST_REQUIRE(it == diff.end());
 }
+
+BOOST_AUTO_TEST_CASE(test_apply_list_to_empty_and_non_empty) {
+    range_tombstone_list l1(*s);
+    l1.apply(*s, rt(1, 2, 1));
+    l1.apply(*s, rt(5, 7, 1));
+    l1.apply(*s, rt(8, 11, 1));
+
+    range_tombstone_list empty(*s);
+    empty.apply(*s, l1);
+    auto it = empty.begin();
+    assert_rt(rt(1, 2, 1), *it++);
+    assert_rt(rt(5, 7, 1), *it++);
+    assert_rt(rt(8, 11, 1), *it++);
+    BOOST_REQUIRE(it == empty.end());
+
+    range_tombstone_list l2(*s);
+    l2.apply(*s, rt(6, 9, 2));
+    l2.apply(*s, l1);
+    it = l2.begin();
+    assert_rt(rt(1, 2, 1), *it++);
+    assert_rt(rtie(5, 6, 1), *it++);
+    assert_rt(rt(6, 9, 2), *it++);
+    assert_rt(rtei(9, 11, 1), *it++);
+    BOOST_REQUIRE(it == l2.end());
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+#include <seastar/core/thread.hh>
+
+#include "seastarx.hh"
+#include "tests/test-utils.hh"
+#include "utils/rate_limiter.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+SEASTAR_TEST_CASE(test_token_bucket_paces_reservations) {
+    return seastar::async([] {
+        utils::token_bucket_rate_limiter limiter(1000);
+
+        // Granted at once, even though it is larger than the bucket, which
+        // is then in debt for a tenth of a second.
+        auto f = limiter.reserve(100);
+        BOOST_REQUIRE(f.available());
+        f.get();
+
+        auto start = std::chrono::steady_clock::now();
+        auto f1 = limiter.reserve(1);
+        auto f2 = limiter.reserve(1);
+        BOOST_REQUIRE(!f1.available());
+        BOOST_REQUIRE_EQUAL(limiter.waiters(), 2);
+        f1.get();
+        f2.get();
+        BOOST_REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(90));
+        BOOST_REQUIRE_EQUAL(limiter.delayed(), 2);
+    });
+}
+
+SEASTAR_TEST_CASE(test_token_bucket_rate_changes) {
+    return seastar::async([] {
+        utils::token_bucket_rate_limiter limiter(1);
+
+        limiter.reserve(1000).get();
+        auto f = limiter.reserve(1);
+        BOOST_REQUIRE(!f.available());
+
+        // Lifting the limit lets the waiters through.
+        limiter.set_rate(0);
+        BOOST_REQUIRE(f.available());
+        f.get();
+        BOOST_REQUIRE(limiter.reserve(1000000).available());
+
+        limiter.set_rate(1);
+        limiter.reserve(1000).get();
+        f = limiter.reserve(1);
+        BOOST_REQUIRE(!f.available());
+        limiter.set_rate(1000000);
+        f.get();
+    });
+}
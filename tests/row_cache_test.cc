@@ -35,6 +35,8 @@
 #include "partition_slice_builder.hh"
 
 #include "disk-error-handler.hh"
+#include "tests/test_services.hh"
+#include "cql3/statements/cf_prop_defs.hh"
 
 thread_local disk_error_signal_type commit_error;
 thread_local disk_error_signal_type general_disk_error;
@@ -534,6 +536,69 @@ SEASTAR_TEST_CASE(test_query_of_incomplete_range_goes_to_underlying) {
     });
 }
 
+SEASTAR_TEST_CASE(test_token_range_scans_are_served_from_cache) {
+    return seastar::async([] {
+        auto s = make_schema();
+
+        std::vector<mutation> mutations = make_ring(s, 10);
+        require_no_token_duplicates(mutations);
+
+        auto mt = make_lw_shared<memtable>(s);
+        for (auto&& m : mutations) {
+            mt->apply(m);
+        }
+
+        int secondary_calls_count = 0;
+        cache_tracker tracker;
+        row_cache cache(s, mutation_source([&] (schema_ptr s, const dht::partition_range& range) {
+            return make_counting_reader(mt->as_data_source()(s, range), secondary_calls_count);
+        }), tracker);
+
+        auto token_range = [&] (int start, int end) {
+            return dht::to_partition_range(dht::token_range::make(
+                {mutations[start].token(), false}, {mutations[end].token(), true}));
+        };
+
+        auto range = token_range(2, 6);
+        assert_that(cache.make_reader(s, range))
+            .produces(slice(mutations, range))
+            .produces_end_of_stream();
+        auto calls = secondary_calls_count;
+        BOOST_REQUIRE_EQUAL(tracker.get_stats().range_scans_from_underlying, 1);
+
+        assert_that(cache.make_reader(s, range))
+            .produces(slice(mutations, range))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(secondary_calls_count, calls);
+        BOOST_REQUIRE_EQUAL(tracker.get_stats().range_scans_from_cache, 1);
+
+        auto subrange = token_range(3, 5);
+        assert_that(cache.make_reader(s, subrange))
+            .produces(slice(mutations, subrange))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(secondary_calls_count, calls);
+
+        // Ranges adjacent to a cached one are continuous with it once read.
+        auto next_range = token_range(6, 8);
+        assert_that(cache.make_reader(s, next_range))
+            .produces(slice(mutations, next_range))
+            .produces_end_of_stream();
+        calls = secondary_calls_count;
+        auto both = token_range(2, 8);
+        assert_that(cache.make_reader(s, both))
+            .produces(slice(mutations, both))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(secondary_calls_count, calls);
+
+        cache.invalidate(mutations[4].decorated_key()).get();
+        assert_that(cache.make_reader(s, range))
+            .produces(slice(mutations, range))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_GT(secondary_calls_count, calls);
+        BOOST_REQUIRE_EQUAL(tracker.get_stats().range_scans_from_cache, 3);
+    });
+}
+
 SEASTAR_TEST_CASE(test_single_key_queries_after_population_in_reverse_order) {
     return seastar::async([] {
         auto s = make_schema();
@@ -730,6 +795,54 @@ SEASTAR_TEST_CASE(test_update) {
     });
 }
 
+SEASTAR_TEST_CASE(test_update_of_large_partitions) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("pk", int32_type, column_kind::partition_key)
+            .with_column("ck", int32_type, column_kind::clustering_key)
+            .with_column("v", int32_type)
+            .build();
+
+        auto make_partition = [&] (int pk, int rows, api::timestamp_type ts) {
+            mutation m(partition_key::from_single_value(*s, int32_type->decompose(pk)), s);
+            for (int i = 0; i < rows; i++) {
+                m.set_clustered_cell(clustering_key_prefix::from_single_value(*s, int32_type->decompose(i)),
+                                     to_bytes("v"), data_value(pk + i), ts);
+            }
+            m.partition().apply(tombstone(ts - 1, gc_clock::now()));
+            return m;
+        };
+
+        cache_tracker tracker;
+        row_cache cache(s, make_lw_shared<memtable>(s)->as_data_source(), tracker);
+
+        std::vector<mutation> expected;
+        auto mt = make_lw_shared<memtable>(s);
+        for (int pk = 0; pk < 4; pk++) {
+            auto m1 = make_partition(pk, 1000, 10);
+            auto m2 = make_partition(pk, 1500, 20);
+            cache.populate(m1);
+            mt->apply(m2);
+            expected.push_back(m1 + m2);
+        }
+
+        // Rows of a partition some reader holds a snapshot of can't be moved
+        // to cache, which has to copy them.
+        auto range = dht::partition_range::make_singular(expected[0].decorated_key());
+        auto reader = mt->make_reader(s, range);
+        auto sm = reader().get0();
+        BOOST_REQUIRE(sm);
+
+        cache.update(*mt, [] (auto&& key) {
+            return partition_presence_checker_result::maybe_exists;
+        }).get();
+
+        for (auto&& m : expected) {
+            verify_has(cache, m);
+        }
+    });
+}
+
 #ifndef DEFAULT_ALLOCATOR
 SEASTAR_TEST_CASE(test_update_failure) {
     return seastar::async([] {
@@ -1380,6 +1493,85 @@ SEASTAR_TEST_CASE(test_slicing_mutation_reader) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rows_of_wide_partition_are_cached) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("pk", int32_type, column_kind::partition_key)
+            .with_column("ck", int32_type, column_kind::clustering_key)
+            .with_column("v", bytes_type)
+            .build();
+
+        auto pk = partition_key::from_exploded(*s, { int32_type->decompose(0) });
+        auto ck = [&] (int i) {
+            return clustering_key_prefix::from_single_value(*s, int32_type->decompose(i));
+        };
+        mutation m(pk, s);
+        for (auto i = 0; i < 100; i++) {
+            m.set_clustered_cell(ck(i), to_bytes("v"), data_value(bytes(1024, int8_t(i))), next_timestamp++);
+        }
+
+        auto mt = make_lw_shared<memtable>(s);
+        mt->apply(m);
+
+        cache_tracker tracker;
+        row_cache cache(s, mt->as_data_source(), tracker, 16 * 1024);
+
+        auto singular_range = dht::partition_range::make_singular(m.decorated_key());
+        auto sliced = [&] (const mutation& m, const query::partition_slice& ps) {
+            auto ck_ranges = query::clustering_key_filter_ranges::get_ranges(*s, ps, m.key());
+            return mutation(s, m.decorated_key(), mutation_partition(m.partition(), *s, std::move(ck_ranges)));
+        };
+
+        assert_that(cache.make_reader(s, singular_range))
+            .produces(m)
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(tracker.uncached_wide_partitions(), 1);
+
+        auto ps = partition_slice_builder(*s)
+            .with_range(query::clustering_range::make(ck(10), ck(11)))
+            .build();
+        assert_that(cache.make_reader(s, singular_range, ps))
+            .produces(sliced(m, ps))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(tracker.uncached_wide_partitions(), 2);
+
+        // The rows read before are served from cache.
+        assert_that(cache.make_reader(s, singular_range, ps))
+            .produces(sliced(m, ps))
+            .produces_end_of_stream();
+        auto ps_within = partition_slice_builder(*s)
+            .with_range(query::clustering_range::make_singular(ck(11)))
+            .build();
+        assert_that(cache.make_reader(s, query::full_partition_range, ps_within))
+            .produces(sliced(m, ps_within))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(tracker.uncached_wide_partitions(), 2);
+
+        // Rows outside of them are not.
+        auto ps_outside = partition_slice_builder(*s)
+            .with_range(query::clustering_range::make(ck(11), ck(12)))
+            .build();
+        assert_that(cache.make_reader(s, singular_range, ps_outside))
+            .produces(sliced(m, ps_outside))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(tracker.uncached_wide_partitions(), 3);
+
+        // Updates are applied to the cached rows.
+        mutation m2(pk, s);
+        m2.set_clustered_cell(ck(11), to_bytes("v"), data_value(bytes(1024, int8_t(0))), next_timestamp++);
+        mt->apply(m2);
+        auto mt2 = make_lw_shared<memtable>(s);
+        mt2->apply(m2);
+        cache.update(*mt2, make_default_partition_presence_checker()).get();
+        m.apply(m2);
+
+        assert_that(cache.make_reader(s, singular_range, ps))
+            .produces(sliced(m, ps))
+            .produces_end_of_stream();
+        BOOST_REQUIRE_EQUAL(tracker.uncached_wide_partitions(), 3);
+    });
+}
+
 SEASTAR_TEST_CASE(test_lru) {
     return seastar::async([] {
         auto s = make_schema();
@@ -1437,3 +1629,169 @@ SEASTAR_TEST_CASE(test_lru) {
                 .produces_end_of_stream();
     });
 }
+
+SEASTAR_TEST_CASE(test_eviction_weights) {
+    return seastar::async([] {
+        auto weighted_schema = [] (sstring name, sstring weight) {
+            return schema_builder("ks", name)
+                .with_column("pk", bytes_type, column_kind::partition_key)
+                .with_column("v", bytes_type, column_kind::regular_column)
+                .set_caching_options(caching_options::from_map(std::map<sstring, sstring>{{"eviction_weight", weight}}))
+                .build();
+        };
+        auto s1 = weighted_schema("cf1", "1");
+        auto s2 = weighted_schema("cf2", "4");
+
+        cache_tracker tracker;
+        row_cache cache1(s1, make_lw_shared<memtable>(s1)->as_data_source(), tracker);
+        row_cache cache2(s2, make_lw_shared<memtable>(s2)->as_data_source(), tracker);
+        BOOST_REQUIRE_EQUAL(cache2.eviction_weight(), 4);
+
+        for (int i = 0; i < 1000; i++) {
+            cache1.populate(make_new_mutation(s1));
+            cache2.populate(make_new_mutation(s2));
+        }
+        BOOST_REQUIRE_EQUAL(cache1.cached_partitions(), 1000);
+        BOOST_REQUIRE_EQUAL(cache2.cached_partitions(), 1000);
+
+        for (int i = 0; i < 500; i++) {
+            tracker.region().evict_some();
+        }
+        BOOST_REQUIRE_EQUAL(cache1.evictions(), 400);
+        BOOST_REQUIRE_EQUAL(cache2.evictions(), 100);
+        BOOST_REQUIRE_EQUAL(cache1.cached_partitions(), 600);
+        BOOST_REQUIRE_EQUAL(cache2.cached_partitions(), 900);
+
+        cache1.set_eviction_weight(4);
+        BOOST_REQUIRE_EQUAL(cache1.eviction_weight(), 4);
+
+        // A table alone in cache is evicted from regardless of its weight.
+        cache1.clear().get();
+        tracker.region().evict_some();
+        BOOST_REQUIRE_EQUAL(cache2.evictions(), 101);
+    });
+}
+
+SEASTAR_TEST_CASE(test_eviction_weight_requires_feature) {
+    return seastar::async([] {
+        storage_service_for_tests ssft(false);
+        auto props_with_caching = [] (std::map<sstring, sstring> caching) {
+            cql3::statements::cf_prop_defs props;
+            props.add_property(cql3::statements::cf_prop_defs::KW_CACHING, caching);
+            return props;
+        };
+
+        BOOST_REQUIRE_THROW(props_with_caching({{"keys", "ALL"}, {"eviction_weight", "4"}}).validate(),
+                exceptions::invalid_request_exception);
+        // The default weight isn't stored, so it's accepted by older nodes too.
+        props_with_caching({{"keys", "ALL"}, {"eviction_weight", "1"}}).validate();
+        props_with_caching({{"keys", "NONE"}}).validate();
+
+        ssft.enable_all_features();
+        props_with_caching({{"keys", "ALL"}, {"eviction_weight", "4"}}).validate();
+    });
+}
+
+SEASTAR_TEST_CASE(test_frequency_admission) {
+    return seastar::async([] {
+        auto s = schema_builder("ks", "cf")
+            .with_column("pk", bytes_type, column_kind::partition_key)
+            .with_column("v", bytes_type, column_kind::regular_column)
+            .set_caching_options(caching_options::from_map(std::map<sstring, sstring>{{"admission", "FREQUENT"}}))
+            .build();
+
+        std::vector<mutation> partitions;
+        auto mt = make_lw_shared<memtable>(s);
+        for (int i = 0; i < 12; i++) {
+            partitions.push_back(make_new_mutation(s));
+            mt->apply(partitions.back());
+        }
+
+        cache_tracker tracker;
+        row_cache cache(s, mt->as_data_source(), tracker);
+        BOOST_REQUIRE(cache.frequency_admission());
+
+        auto read = [&] (const mutation& m) {
+            auto pr = dht::partition_range::make_singular(dht::ring_position(m.decorated_key()));
+            assert_that(cache.make_reader(s, pr))
+                .produces(m)
+                .produces_end_of_stream();
+        };
+
+        // Until cache runs out of memory, everything is admitted.
+        for (int i = 0; i < 10; i++) {
+            read(partitions[i]);
+        }
+        BOOST_REQUIRE_EQUAL(cache.cached_partitions(), 10);
+
+        tracker.region().evict_some();
+        BOOST_REQUIRE_EQUAL(cache.cached_partitions(), 9);
+
+        // Read as often as the victim, so rejected, but still returned.
+        read(partitions[10]);
+        BOOST_REQUIRE_EQUAL(cache.cached_partitions(), 9);
+        BOOST_REQUIRE_EQUAL(cache.admission_rejections(), 1);
+        BOOST_REQUIRE_EQUAL(tracker.get_stats().admission_rejections, 1);
+
+        read(partitions[10]);
+        BOOST_REQUIRE_EQUAL(cache.cached_partitions(), 10);
+        BOOST_REQUIRE_EQUAL(cache.admission_rejections(), 1);
+
+        cache.set_frequency_admission(false);
+        BOOST_REQUIRE(!cache.frequency_admission());
+        read(partitions[11]);
+        BOOST_REQUIRE_EQUAL(cache.cached_partitions(), 11);
+        BOOST_REQUIRE_EQUAL(cache.admission_rejections(), 1);
+    });
+}
+
+SEASTAR_TEST_CASE(test_segment_eviction) {
+    return seastar::async([] {
+        auto s = make_schema();
+        cache_tracker tracker;
+        tracker.enable_segment_eviction();
+        row_cache cache(s, make_lw_shared<memtable>(s)->as_data_source(), tracker);
+
+        std::vector<mutation> partitions;
+        while (tracker.region().occupancy().total_space() < 4 * logalloc::segment_size) {
+            partitions.push_back(make_new_mutation(s));
+            cache.populate(partitions.back());
+        }
+
+        BOOST_REQUIRE(tracker.region().evict_oldest_segment() == memory::reclaiming_result::reclaimed_something);
+        BOOST_REQUIRE_GT(cache.evictions(), 0);
+        BOOST_REQUIRE_EQUAL(tracker.get_stats().evictions, cache.evictions());
+        BOOST_REQUIRE_EQUAL(cache.cached_partitions(), partitions.size() - cache.evictions());
+
+        // The partitions populated first are gone.
+        auto pr = dht::partition_range::make_singular(dht::ring_position(partitions.front().decorated_key()));
+        assert_that(cache.make_reader(s, pr))
+            .produces_end_of_stream();
+        pr = dht::partition_range::make_singular(dht::ring_position(partitions.back().decorated_key()));
+        assert_that(cache.make_reader(s, pr))
+            .produces(partitions.back())
+            .produces_end_of_stream();
+    });
+}
+
+SEASTAR_TEST_CASE(test_recently_used_keys) {
+    return seastar::async([] {
+        auto s = make_schema();
+        cache_tracker tracker;
+        row_cache cache(s, make_lw_shared<memtable>(s)->as_data_source(), tracker);
+
+        std::vector<mutation> partitions;
+        for (int i = 0; i < 3; i++) {
+            partitions.push_back(make_new_mutation(s));
+            cache.populate(partitions.back());
+        }
+        cache.touch(partitions[0].decorated_key());
+
+        auto keys = cache.recently_used_keys(2);
+        BOOST_REQUIRE_EQUAL(keys.size(), 2);
+        BOOST_REQUIRE(keys[0].equal(*s, partitions[0].key()));
+        BOOST_REQUIRE(keys[1].equal(*s, partitions[2].key()));
+
+        BOOST_REQUIRE_EQUAL(cache.recently_used_keys(10).size(), 3);
+    });
+}
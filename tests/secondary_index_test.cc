@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+
+#include "database.hh"
+
+#include "tests/test-utils.hh"
+#include "tests/cql_test_env.hh"
+#include "tests/cql_assertions.hh"
+
+#include "disk-error-handler.hh"
+
+thread_local disk_error_signal_type commit_error;
+thread_local disk_error_signal_type general_disk_error;
+
+SEASTAR_TEST_CASE(test_index_lookup) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table cf (p int, c int, v int, primary key (p, c));").get();
+        e.execute_cql("create index cf_v on cf (v);").get();
+        BOOST_REQUIRE(e.local_db().has_schema("ks", "cf_v_index"));
+        for (auto p = 0; p < 10; ++p) {
+            e.execute_cql(sprint("insert into cf (p, c, v) values (%d, 0, %d);", p, p % 2)).get();
+            e.execute_cql(sprint("insert into cf (p, c, v) values (%d, 1, 2);", p)).get();
+        }
+        e.execute_cql("update cf set v = 3 where p = 1 and c = 0;").get();
+
+        auto msg = e.execute_cql("select p, c from cf where v = 1;").get0();
+        assert_that(msg).is_rows().with_rows_ignore_order({
+            {int32_type->decompose(3), int32_type->decompose(0)},
+            {int32_type->decompose(5), int32_type->decompose(0)},
+            {int32_type->decompose(7), int32_type->decompose(0)},
+            {int32_type->decompose(9), int32_type->decompose(0)},
+        });
+
+        msg = e.execute_cql("select p, c from cf where v = 4;").get0();
+        assert_that(msg).is_rows().is_empty();
+
+        msg = e.execute_cql("select count(*) from cf where v = 2;").get0();
+        assert_that(msg).is_rows().with_row({long_type->decompose(int64_t(10))});
+
+        // The other restrictions are still filtered on.
+        msg = e.execute_cql("select p, c from cf where v = 2 and c = 1 and p = 4 allow filtering;").get0();
+        assert_that(msg).is_rows().with_row({int32_type->decompose(4), int32_type->decompose(1)});
+    });
+}
+
+SEASTAR_TEST_CASE(test_drop_index) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table cf (p int primary key, v int);").get();
+        e.execute_cql("create index cf_v on cf (v);").get();
+        BOOST_REQUIRE(e.local_db().has_schema("ks", "cf_v_index"));
+        e.execute_cql("drop index cf_v;").get();
+        BOOST_REQUIRE(!e.local_db().has_schema("ks", "cf_v_index"));
+
+        e.execute_cql("create index cf_v on cf (v);").get();
+        e.execute_cql("drop table cf;").get();
+        BOOST_REQUIRE(!e.local_db().has_schema("ks", "cf_v_index"));
+    });
+}
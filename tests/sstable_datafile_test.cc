@@ -41,16 +41,23 @@
 #include "range.hh"
 #include "partition_slice_builder.hh"
 #include "sstables/date_tiered_compaction_strategy.hh"
+#include "sstables/time_window_compaction_strategy.hh"
+#include "sstables/index_summary_manager.hh"
+#include "sstables/data_placement.hh"
+#include "sstables/downsampling.hh"
 #include "mutation_assertions.hh"
 #include "mutation_reader_assertions.hh"
 #include "counters.hh"
 #include "cell_locking.hh"
 #include "simple_schema.hh"
+#include "utils/bloom_filter.hh"
+#include "row_cache.hh"
 
 #include <stdio.h>
 #include <ftw.h>
 #include <unistd.h>
 #include <boost/range/algorithm/find_if.hpp>
+#include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/cxx11/all_of.hpp>
 
 using namespace sstables;
@@ -889,11 +896,11 @@ SEASTAR_TEST_CASE(datafile_generation_12) {
     });
 }
 
-static future<> sstable_compression_test(compressor c, unsigned generation) {
-    return test_setup::do_with_test_directory([c, generation] {
+static future<> sstable_compression_test(compression_parameters cp, unsigned generation, sstable_writer_config cfg = {}) {
+    return test_setup::do_with_test_directory([cp, generation, cfg] {
         // NOTE: set a given compressor algorithm to schema.
         schema_builder builder(complex_schema());
-        builder.set_compressor_params(c);
+        builder.set_compressor_params(cp);
         auto s = builder.build(schema_builder::compact_storage::no);
 
         auto mtp = make_lw_shared<memtable>(s);
@@ -908,8 +915,10 @@ static future<> sstable_compression_test(compressor c, unsigned generation) {
         mtp->apply(std::move(m));
 
         auto sst = make_lw_shared<sstable>(s, "tests/sstables/tests-temporary", generation, la, big);
-        return sst->write_components(*mtp).then([s, tomb, generation] {
-            return reusable_sst(s, "tests/sstables/tests-temporary", generation).then([s, tomb] (auto sstp) mutable {
+        auto rd = mtp->make_flush_reader(s, default_priority_class());
+        return sst->write_components(std::move(rd), mtp->partition_count(), s, cfg).then([s, tomb, generation, cfg] {
+            return reusable_sst(s, "tests/sstables/tests-temporary", generation).then([s, tomb, cfg] (auto sstp) mutable {
+                BOOST_REQUIRE(sstp->get_checksum_type() == cfg.compression_checksum.value_or(checksum_type::adler32));
                 return do_with(sstables::key("key1"), [sstp, s, tomb] (auto& key) {
                     return sstp->read_row(s, key).then([] (auto sm) {
                             return mutation_from_streamed_mutation(std::move(sm));
@@ -938,6 +947,135 @@ SEASTAR_TEST_CASE(datafile_generation_15) {
     return sstable_compression_test(compressor::deflate, 15);
 }
 
+SEASTAR_TEST_CASE(datafile_generation_57) {
+    return sstable_compression_test(compressor::zstd, 57);
+}
+
+SEASTAR_TEST_CASE(datafile_generation_58) {
+    // A raw-content dictionary is enough for zstd; trained ones start with a magic number.
+    compression_parameters cp({
+        { compression_parameters::SSTABLE_COMPRESSION, "ZstdCompressor" },
+        { compression_parameters::COMPRESSION_LEVEL, "19" },
+        { compression_parameters::ZSTD_DICTIONARY, to_hex(to_bytes("key1c1key1c2simple_column")) },
+    });
+    cp.validate();
+    return sstable_compression_test(cp, 58);
+}
+
+SEASTAR_TEST_CASE(datafile_generation_59) {
+    sstable_writer_config cfg;
+    cfg.compression_checksum = checksum_type::crc32c;
+    return sstable_compression_test(compressor::lz4, 59, cfg);
+}
+
+SEASTAR_TEST_CASE(test_compressed_index) {
+    return test_setup::do_with_test_directory([] {
+        return seastar::async([] {
+            auto s = schema_builder("ks", "cf")
+                .with_column("p", int32_type, column_kind::partition_key)
+                .with_column("r", int32_type)
+                .build();
+            const column_definition& r_col = *s->get_column_definition("r");
+
+            // Enough partitions for the index to span several chunks.
+            auto mt = make_lw_shared<memtable>(s);
+            std::vector<mutation> muts;
+            for (int32_t i = 0; i < 2000; i++) {
+                mutation m(partition_key::from_exploded(*s, {int32_type->decompose(i)}), s);
+                m.set_clustered_cell(clustering_key::make_empty(), r_col, make_atomic_cell(int32_type->decompose(i)));
+                mt->apply(m);
+                muts.push_back(std::move(m));
+            }
+
+            sstable_writer_config cfg;
+            cfg.index_compressor = compressor::lz4;
+            auto sst = make_lw_shared<sstable>(s, "tests/sstables/tests-temporary", 60, la, big);
+            sst->write_components(mt->make_flush_reader(s, default_priority_class()), mt->partition_count(), s, cfg).get();
+
+            auto check = [&] {
+                auto sstp = reusable_sst(s, "tests/sstables/tests-temporary", 60).get0();
+                for (auto& m : muts) {
+                    auto sm = sstp->read_row(s, sstables::key::from_partition_key(*s, m.key())).get0();
+                    auto mopt = mutation_from_streamed_mutation(std::move(sm)).get0();
+                    BOOST_REQUIRE(mopt);
+                    BOOST_REQUIRE_EQUAL(*mopt, m);
+                }
+            };
+            check();
+
+            // A missing summary is regenerated from the compressed index.
+            remove_file(sstable::filename("tests/sstables/tests-temporary", "ks", "cf", la, 60, big, sstable::component_type::Summary)).get();
+            check();
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_column_projection) {
+    return test_setup::do_with_test_directory([] {
+        return seastar::async([] {
+            auto s = schema_builder("ks", "cf")
+                .with_column("p", int32_type, column_kind::partition_key)
+                .with_column("c", int32_type, column_kind::clustering_key)
+                .with_column("r1", int32_type)
+                .with_column("r2", int32_type)
+                .build();
+            auto& r1 = *s->get_column_definition("r1");
+            auto& r2 = *s->get_column_definition("r2");
+            auto ck1 = clustering_key::from_exploded(*s, {int32_type->decompose(1)});
+            auto ck2 = clustering_key::from_exploded(*s, {int32_type->decompose(2)});
+
+            // No row markers, so that the rows are only alive by their cells.
+            mutation m(partition_key::from_exploded(*s, {int32_type->decompose(0)}), s);
+            m.set_clustered_cell(ck1, r1, make_atomic_cell(int32_type->decompose(1)));
+            m.set_clustered_cell(ck1, r2, make_atomic_cell(int32_type->decompose(2)));
+            m.set_clustered_cell(ck2, r2, make_atomic_cell(int32_type->decompose(3)));
+            auto mt = make_lw_shared<memtable>(s);
+            mt->apply(m);
+            auto sst = make_lw_shared<sstable>(s, "tests/sstables/tests-temporary", 61, la, big);
+            sst->write_components(*mt).get();
+            auto sstp = reusable_sst(s, "tests/sstables/tests-temporary", 61).get0();
+
+            auto read = [&] (const query::partition_slice& slice) {
+                auto sm = sstp->read_row(s, sstables::key::from_partition_key(*s, m.key()), slice).get0();
+                auto mopt = mutation_from_streamed_mutation(std::move(sm)).get0();
+                BOOST_REQUIRE(mopt);
+                return std::move(*mopt);
+            };
+            auto value_of = [&] (const mutation& m, const clustering_key& ck, const column_definition& cdef) {
+                auto row = m.partition().find_row(*s, ck);
+                BOOST_REQUIRE(row);
+                auto cell = row->find_cell(cdef.id);
+                BOOST_REQUIRE(cell);
+                auto ac = cell->as_atomic_cell();
+                BOOST_REQUIRE(ac.is_live());
+                return to_bytes(ac.value());
+            };
+
+            auto slice = partition_slice_builder(*s).with_regular_column("r1").build();
+            BOOST_REQUIRE_EQUAL(read(slice), m);
+
+            // The cells of the other columns are kept for the liveness of
+            // their rows, without their value.
+            slice.set_project_columns(true);
+            auto projected = read(slice);
+            BOOST_REQUIRE_EQUAL(value_of(projected, ck1, r1), int32_type->decompose(1));
+            BOOST_REQUIRE(value_of(projected, ck1, r2).empty());
+            BOOST_REQUIRE(value_of(projected, ck2, r2).empty());
+        });
+    });
+}
+
+SEASTAR_TEST_CASE(test_checksum_crc32c) {
+    // The check value of the Castagnoli polynomial.
+    sstring input = "123456789";
+    BOOST_REQUIRE_EQUAL(checksum_crc32c(input.data(), input.size()), 0xe3069283u);
+    // Checksums can be computed piecewise.
+    auto partial = checksum_crc32c(input.data(), 4);
+    BOOST_REQUIRE_EQUAL(checksum_crc32c(partial, input.data() + 4, input.size() - 4), 0xe3069283u);
+    BOOST_REQUIRE_EQUAL(checksum_crc32c(nullptr, 0), 0u);
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(datafile_generation_16) {
     return test_setup::do_with_test_directory([] {
         auto s = uncompressed_schema();
@@ -2083,6 +2221,55 @@ SEASTAR_TEST_CASE(leveled_06) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(leveled_stcs_in_l0) {
+    // Test that L0 is size-tiered once over the threshold, even though L1
+    // is over its ideal size.
+    auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+        {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+
+    column_family::config cfg;
+    cell_locker_stats cl_stats;
+    compaction_manager cm;
+    cfg.enable_disk_writes = false;
+    cfg.enable_commitlog = false;
+    auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+    cf->mark_ready_for_writes();
+
+    auto key_and_token_pair = token_generation_for_current_shard(2);
+    auto min_key = key_and_token_pair[0].first;
+    auto max_key = key_and_token_pair[1].first;
+
+    auto max_sstable_size_in_mb = 1;
+    auto max_sstable_size_in_bytes = max_sstable_size_in_mb*1024*1024;
+    auto l0_sstables = leveled_manifest::DEFAULT_L0_STCS_THRESHOLD + 8;
+    for (auto gen = 1; gen <= l0_sstables; gen++) {
+        add_sstable_for_leveled_test(cf, gen, max_sstable_size_in_bytes, /*level*/0, min_key, max_key);
+    }
+    auto max_bytes_for_l1 = leveled_manifest::max_bytes_for_level(1, max_sstable_size_in_bytes);
+    add_sstable_for_leveled_test(cf, l0_sstables + 1, max_bytes_for_l1*2, /*level*/1, min_key, max_key);
+
+    auto candidates = get_candidates_for_leveled_strategy(*cf);
+    std::vector<stdx::optional<dht::decorated_key>> last_compacted_keys(leveled_manifest::MAX_LEVELS);
+    std::vector<int> compaction_counter(leveled_manifest::MAX_LEVELS);
+    {
+        leveled_manifest manifest = leveled_manifest::create(*cf, candidates, max_sstable_size_in_mb);
+        auto candidate = manifest.get_compaction_candidates(last_compacted_keys, compaction_counter);
+        BOOST_REQUIRE(candidate.level == 0);
+        BOOST_REQUIRE(candidate.sstables.size() == size_t(s->max_compaction_threshold()));
+        for (auto& sst : candidate.sstables) {
+            BOOST_REQUIRE(sst->get_sstable_level() == 0);
+        }
+    }
+    {
+        // Disabled, the level over its ideal size is compacted first.
+        leveled_manifest manifest = leveled_manifest::create(*cf, candidates, max_sstable_size_in_mb, 0);
+        auto candidate = manifest.get_compaction_candidates(last_compacted_keys, compaction_counter);
+        BOOST_REQUIRE(candidate.level == 2);
+    }
+
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(leveled_invariant_fix) {
     auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
         {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
@@ -2211,6 +2398,38 @@ SEASTAR_TEST_CASE(check_read_indexes) {
     });
 }
 
+SEASTAR_TEST_CASE(test_index_page_cache) {
+    return seastar::async([] {
+        auto builder = schema_builder("test", "summary_test")
+            .with_column("a", int32_type, column_kind::partition_key);
+        builder.set_min_index_interval(256);
+        auto s = builder.build();
+
+        auto sst = make_lw_shared<sstable>(s, "tests/sstables/summary_test", 1,
+            sstables::sstable::version_types::ka, big);
+        sst->load().get();
+
+        auto stats = shared_index_lists::shard_stats();
+        BOOST_REQUIRE_EQUAL(sstables::test(sst).read_indexes(0).get0().size(), 130);
+        BOOST_REQUIRE_EQUAL(shared_index_lists::shard_stats().misses, stats.misses + 1);
+        BOOST_REQUIRE_EQUAL(shared_index_lists::shard_stats().populations, stats.populations + 1);
+        BOOST_REQUIRE(shared_index_lists::shard_stats().used_bytes > stats.used_bytes);
+
+        // The page outlives the reader which loaded it.
+        stats = shared_index_lists::shard_stats();
+        BOOST_REQUIRE_EQUAL(sstables::test(sst).read_indexes(0).get0().size(), 130);
+        BOOST_REQUIRE_EQUAL(shared_index_lists::shard_stats().misses, stats.misses);
+        BOOST_REQUIRE_EQUAL(shared_index_lists::shard_stats().hits, stats.hits + 1);
+
+        // Evicted pages have to be read again.
+        global_cache_tracker().index_lru().evict_all();
+        BOOST_REQUIRE_EQUAL(shared_index_lists::shard_stats().used_bytes, 0);
+        stats = shared_index_lists::shard_stats();
+        BOOST_REQUIRE_EQUAL(sstables::test(sst).read_indexes(0).get0().size(), 130);
+        BOOST_REQUIRE_EQUAL(shared_index_lists::shard_stats().misses, stats.misses + 1);
+    });
+}
+
 // Must run in a seastar thread
 static shared_sstable make_sstable_containing(std::function<shared_sstable()> sst_factory, std::vector<mutation> muts) {
     auto sst = sst_factory();
@@ -2944,6 +3163,35 @@ SEASTAR_TEST_CASE(get_fully_expired_sstables_test) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(strategies_drop_fully_expired_sstables_test) {
+    auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+        {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+    compaction_manager cm;
+    column_family::config cfg;
+    cell_locker_stats cl_stats;
+    auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+
+    auto key_and_token_pair = token_generation_for_current_shard(2);
+    auto min_key = key_and_token_pair[0].first;
+    auto max_key = key_and_token_pair[1].first;
+    auto expired = add_sstable_for_overlapping_test(cf, /*gen*/1, min_key, max_key, build_stats(0, 10, 10));
+    auto live = add_sstable_for_overlapping_test(cf, /*gen*/2, min_key, max_key, build_stats(20, 30, std::numeric_limits<int32_t>::max()));
+
+    for (auto type : {sstables::compaction_strategy_type::size_tiered, sstables::compaction_strategy_type::leveled}) {
+        auto cs = sstables::make_compaction_strategy(type, {});
+        auto desc = cs.get_sstables_for_compaction(*cf, { expired, live });
+        BOOST_REQUIRE(desc.sstables.size() == 1);
+        BOOST_REQUIRE(desc.sstables.front() == expired);
+        // Which compaction deletes rather than rewrites.
+        BOOST_REQUIRE(desc.expired == desc.sstables);
+        // The check is done at most every expired_sstable_check_frequency_seconds.
+        desc = cs.get_sstables_for_compaction(*cf, { expired, live });
+        BOOST_REQUIRE(desc.expired.empty());
+    }
+
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(basic_date_tiered_strategy_test) {
     auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
         {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
@@ -3034,6 +3282,315 @@ SEASTAR_TEST_CASE(date_tiered_strategy_test_2) {
     return make_ready_future<>();
 }
 
+SEASTAR_TEST_CASE(time_window_strategy_time_window_tests) {
+    using namespace std::chrono;
+
+    api::timestamp_type window_size = duration_cast<microseconds>(hours(1)).count();
+    // deterministic timestamp for Fri, 01 Jan 2016 00:00:00 GMT.
+    api::timestamp_type tstamp = duration_cast<microseconds>(seconds(1451606400)).count();
+
+    BOOST_REQUIRE(time_window_manifest::get_window_lower_bound(window_size, tstamp) == tstamp);
+    BOOST_REQUIRE(time_window_manifest::get_window_lower_bound(window_size, tstamp + window_size - 1) == tstamp);
+    BOOST_REQUIRE(time_window_manifest::get_window_lower_bound(window_size, tstamp + window_size) == tstamp + window_size);
+    // negative timestamps are rounded down, not towards zero.
+    BOOST_REQUIRE(time_window_manifest::get_window_lower_bound(window_size, -1) == -window_size);
+    BOOST_REQUIRE(time_window_manifest::get_window_lower_bound(window_size, -window_size) == -window_size);
+
+    std::map<sstring, sstring> options;
+    options.emplace(sstring("compaction_window_unit"), sstring("HOURS"));
+    options.emplace(sstring("compaction_window_size"), sstring("2"));
+    BOOST_REQUIRE(time_window_compaction_strategy_options(options).window_size() == 2 * window_size);
+
+    options.emplace(sstring("timestamp_resolution"), sstring("MILLISECONDS"));
+    BOOST_REQUIRE(time_window_compaction_strategy_options(options).window_size() == 2 * window_size / 1000);
+
+    options["compaction_window_unit"] = "WEEKS";
+    BOOST_REQUIRE_THROW(time_window_compaction_strategy_options{options}, exceptions::configuration_exception);
+    options["compaction_window_unit"] = "HOURS";
+    options["compaction_window_size"] = "0";
+    BOOST_REQUIRE_THROW(time_window_compaction_strategy_options{options}, exceptions::configuration_exception);
+
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(time_window_strategy_test) {
+    using namespace std::chrono;
+
+    auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+        {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+    compaction_manager cm;
+    column_family::config cfg;
+    cell_locker_stats cl_stats;
+    auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+
+    api::timestamp_type window_size = duration_cast<microseconds>(hours(1)).count();
+    api::timestamp_type now = duration_cast<microseconds>(db_clock::now().time_since_epoch()).count();
+    auto current_window = time_window_manifest::get_window_lower_bound(window_size, now);
+    auto previous_window = current_window - window_size;
+    int min_threshold = cf->schema()->min_compaction_threshold();
+    int64_t gen = 1;
+
+    auto add_sstable = [&] (api::timestamp_type timestamp) {
+        auto sst = add_sstable_for_overlapping_test(cf, gen++, "a", "a",
+            build_stats(timestamp, timestamp, std::numeric_limits<int32_t>::max()));
+        sstables::test(sst).set_data_file_size(1);
+        return sst;
+    };
+
+    std::map<sstring, sstring> options;
+    options.emplace(sstring("compaction_window_unit"), sstring("HOURS"));
+    options.emplace(sstring("compaction_window_size"), sstring("1"));
+    auto cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::time_window, options);
+
+    // a closed window with a single sstable has nothing to compact.
+    std::vector<sstables::shared_sstable> old_window = { add_sstable(previous_window) };
+    BOOST_REQUIRE(cs.get_sstables_for_compaction(*cf, old_window).sstables.empty());
+
+    // the current window is only compacted once it has min_threshold sstables.
+    std::vector<sstables::shared_sstable> new_window;
+    for (auto i = 1; i < min_threshold; i++) {
+        new_window.push_back(add_sstable(current_window + i));
+    }
+    BOOST_REQUIRE(cs.get_sstables_for_compaction(*cf, new_window).sstables.empty());
+    new_window.push_back(add_sstable(current_window));
+
+    // the newest window goes first.
+    old_window.push_back(add_sstable(previous_window + window_size - 1));
+    auto candidates = old_window;
+    candidates.insert(candidates.end(), new_window.begin(), new_window.end());
+    auto desc = cs.get_sstables_for_compaction(*cf, candidates);
+    BOOST_REQUIRE(desc.sstables.size() == size_t(min_threshold));
+    for (auto& sst : desc.sstables) {
+        BOOST_REQUIRE(sst->get_stats_metadata().max_timestamp >= current_window);
+    }
+
+    // a closed window with two sstables or more is compacted as a whole.
+    desc = cs.get_sstables_for_compaction(*cf, old_window);
+    BOOST_REQUIRE(desc.sstables.size() == 2);
+    for (auto& sst : desc.sstables) {
+        BOOST_REQUIRE(sst->get_stats_metadata().max_timestamp < current_window);
+    }
+
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(time_window_sstable_set_test) {
+    using namespace std::chrono;
+
+    std::map<sstring, sstring> options;
+    options.emplace(sstring("compaction_window_unit"), sstring("HOURS"));
+    options.emplace(sstring("compaction_window_size"), sstring("1"));
+    auto s = schema_builder(some_keyspace, some_column_family)
+            .with_column("p1", utf8_type, column_kind::partition_key)
+            .with_column("r1", utf8_type)
+            .set_compaction_strategy(sstables::compaction_strategy_type::time_window)
+            .set_compaction_strategy_options(options)
+            .build();
+    compaction_manager cm;
+    column_family::config cfg;
+    cell_locker_stats cl_stats;
+    auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+    auto key_and_token_pair = token_generation_for_current_shard(3);
+
+    api::timestamp_type window_size = duration_cast<microseconds>(hours(1)).count();
+    api::timestamp_type now = duration_cast<microseconds>(db_clock::now().time_since_epoch()).count();
+    auto current_window = time_window_manifest::get_window_lower_bound(window_size, now);
+    auto previous_window = current_window - window_size;
+    auto old_window = previous_window - window_size;
+    int64_t gen = 1;
+
+    auto add_sstable = [&] (api::timestamp_type timestamp, const sstring& key) {
+        auto sst = add_sstable_for_overlapping_test(cf, gen++, key, key,
+            build_stats(timestamp, timestamp, std::numeric_limits<int32_t>::max()));
+        sstables::test(sst).set_data_file_size(1);
+        return sst;
+    };
+    auto gens = [] (const std::vector<shared_sstable>& ssts) {
+        return boost::copy_range<std::set<int64_t>>(ssts | boost::adaptors::transformed(std::mem_fn(&sstable::generation)));
+    };
+
+    add_sstable(old_window, key_and_token_pair[0].first);
+    add_sstable(old_window + 1, key_and_token_pair[1].first);
+    add_sstable(previous_window, key_and_token_pair[0].first);
+    add_sstable(previous_window + window_size / 2, key_and_token_pair[1].first);
+    add_sstable(current_window, key_and_token_pair[0].first);
+    auto& set = cf->get_sstable_set();
+
+    // the windows ending before the timestamp looked for are skipped, and
+    // only the sstables of the window holding it are checked one by one.
+    auto full = query::full_partition_range;
+    BOOST_REQUIRE(gens(set.select(full, api::min_timestamp)) == std::set<int64_t>({1, 2, 3, 4, 5}));
+    BOOST_REQUIRE(gens(set.select(full, current_window)) == std::set<int64_t>({5}));
+    BOOST_REQUIRE(gens(set.select(full, previous_window + window_size / 2)) == std::set<int64_t>({4, 5}));
+    BOOST_REQUIRE(gens(set.select(full, old_window + 1)) == std::set<int64_t>({2, 3, 4, 5}));
+    BOOST_REQUIRE(set.select(full, current_window + window_size).empty());
+    auto singular = dht::partition_range::make_singular(dht::global_partitioner().decorate_key(*s,
+            partition_key::from_exploded(*s, {to_bytes(key_and_token_pair[1].first)})));
+    BOOST_REQUIRE(gens(set.select(singular, previous_window)) == std::set<int64_t>({4}));
+
+    // the incremental selector only hands out the sstables of the token.
+    auto sel = set.make_incremental_selector();
+    BOOST_REQUIRE(gens(sel.select(key_and_token_pair[0].second)) == std::set<int64_t>({1, 3, 5}));
+    BOOST_REQUIRE(gens(sel.select(key_and_token_pair[1].second)) == std::set<int64_t>({2, 4}));
+    BOOST_REQUIRE(sel.select(key_and_token_pair[2].second).empty());
+
+    // windows are walked newest first, and the walk stops when asked to.
+    std::vector<api::timestamp_type> windows;
+    set.for_each_time_window(window_size, [&] (api::timestamp_type window, std::vector<shared_sstable> ssts) {
+        windows.push_back(window);
+        return stop_iteration(window == previous_window);
+    });
+    BOOST_REQUIRE(windows == std::vector<api::timestamp_type>({current_window, previous_window}));
+    // windows of another size are made up from the sstables.
+    windows.clear();
+    set.for_each_time_window(3 * window_size, [&] (api::timestamp_type window, std::vector<shared_sstable> ssts) {
+        windows.push_back(window);
+        return stop_iteration::no;
+    });
+    BOOST_REQUIRE(!windows.empty() && windows.size() <= 2);
+    BOOST_REQUIRE(windows.front() == time_window_manifest::get_window_lower_bound(3 * window_size, current_window));
+
+    // the newest closed window with sstables to compact goes first, and
+    // sstables which aren't candidates are left out of their window.
+    auto cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::time_window, options);
+    auto candidates = boost::copy_range<std::vector<shared_sstable>>(*cf->get_sstables());
+    BOOST_REQUIRE(gens(cs.get_sstables_for_compaction(*cf, candidates).sstables) == std::set<int64_t>({3, 4}));
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [] (const shared_sstable& sst) {
+        return sst->generation() == 4;
+    }), candidates.end());
+    BOOST_REQUIRE(gens(cs.get_sstables_for_compaction(*cf, candidates).sstables) == std::set<int64_t>({1, 2}));
+    BOOST_REQUIRE(cs.estimated_pending_compactions(*cf) == 2);
+
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(cold_storage_test) {
+    using namespace std::chrono;
+
+    auto s = make_lw_shared(schema({}, some_keyspace, some_column_family,
+        {{"p1", utf8_type}}, {}, {}, {}, utf8_type));
+    compaction_manager cm;
+    column_family::config cfg;
+    cfg.cold_datadir = "/cold";
+    cell_locker_stats cl_stats;
+    auto cf = make_lw_shared<column_family>(s, cfg, column_family::no_commitlog(), cm, cl_stats);
+
+    api::timestamp_type now = duration_cast<microseconds>(db_clock::now().time_since_epoch()).count();
+    auto days_ago = [now] (int days) {
+        return now - duration_cast<microseconds>(hours(24 * days)).count();
+    };
+    int64_t gen = 1;
+    auto make_sstable = [&] (sstring dir, api::timestamp_type timestamp) {
+        auto sst = make_lw_shared<sstable>(s, dir, gen++, la, big);
+        sstables::test(sst).set_values("a", "a", build_stats(timestamp, timestamp, std::numeric_limits<int32_t>::max()));
+        sstables::test(sst).set_data_file_size(gen);
+        sst->set_unshared();
+        return sst;
+    };
+
+    std::map<sstring, sstring> options;
+    options.emplace(sstring("cold_storage_after_days"), sstring("2"));
+    auto cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, options);
+
+    auto recent = make_sstable("", days_ago(1));
+    auto old = make_sstable("", days_ago(3));
+    auto older = make_sstable("", days_ago(5));
+    auto already_cold = make_sstable("/cold", days_ago(10));
+
+    // The sstable with the oldest data not yet in cold storage is moved there.
+    auto desc = cs.get_sstables_for_compaction(*cf, {recent, old, older, already_cold});
+    BOOST_REQUIRE(desc.sstables == std::vector<sstables::shared_sstable>({older}));
+    BOOST_REQUIRE_EQUAL(desc.output_dir, "/cold");
+
+    desc = cs.get_sstables_for_compaction(*cf, {recent, already_cold});
+    BOOST_REQUIRE(desc.sstables.empty());
+
+    // Nothing is moved without the option.
+    auto no_cold_storage = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, {});
+    BOOST_REQUIRE(no_cold_storage.get_sstables_for_compaction(*cf, {recent, old, older}).sstables.empty());
+
+    BOOST_REQUIRE_THROW(sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, {{"cold_storage_after_days", "-1"}}),
+            exceptions::configuration_exception);
+
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(tombstone_compaction_test) {
+    BOOST_REQUIRE(smp::count == 1);
+    return seastar::async([] {
+        auto builder = schema_builder("tests", "tombstone_compaction")
+                .with_column("id", utf8_type, column_kind::partition_key)
+                .with_column("value", int32_type);
+        builder.set_gc_grace_seconds(0);
+        auto s = builder.build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto sst_gen = [s, tmp, gen = make_lw_shared<unsigned>(1)] () mutable {
+            return make_lw_shared<sstable>(s, tmp->path, (*gen)++, la, big);
+        };
+        compaction_manager cm;
+        cell_locker_stats cl_stats;
+        auto cf = make_lw_shared<column_family>(s, column_family::config(), column_family::no_commitlog(), cm, cl_stats);
+        cf->mark_ready_for_writes();
+
+        auto make_mutations = [&] (api::timestamp_type timestamp, bool dead) {
+            std::vector<mutation> muts;
+            if (dead) {
+                // a live cell keeps the sstable from being fully expired.
+                mutation m(partition_key::from_exploded(*s, {to_bytes("epsilon")}), s);
+                m.set_clustered_cell(clustering_key::make_empty(), bytes("value"), data_value(int32_t(1)), timestamp);
+                muts.push_back(std::move(m));
+            }
+            for (auto key : {"alpha", "beta", "gamma", "delta"}) {
+                mutation m(partition_key::from_exploded(*s, {to_bytes(key)}), s);
+                if (dead) {
+                    m.set_clustered_cell(clustering_key::make_empty(), *s->get_column_definition("value"),
+                        atomic_cell::make_dead(timestamp, gc_clock::now() - std::chrono::hours(1)));
+                } else {
+                    m.set_clustered_cell(clustering_key::make_empty(), bytes("value"), data_value(int32_t(1)), timestamp);
+                }
+                muts.push_back(std::move(m));
+            }
+            return muts;
+        };
+
+        auto deleted = make_sstable_containing(sst_gen, make_mutations(10, true));
+        column_family_test(cf).add_sstable(deleted);
+        BOOST_REQUIRE(deleted->estimate_droppable_tombstone_ratio(gc_clock::now()) > 0.5);
+        BOOST_REQUIRE(deleted->estimate_droppable_tombstone_ratio(gc_clock::now() - std::chrono::hours(2)) == 0);
+
+        // by default, an sstable just written is not old enough.
+        std::map<sstring, sstring> options;
+        auto cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, options);
+        BOOST_REQUIRE(cs.get_sstables_for_compaction(*cf, {deleted}).sstables.empty());
+
+        options.emplace(sstring("tombstone_compaction_interval"), sstring("0"));
+        cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, options);
+        auto desc = cs.get_sstables_for_compaction(*cf, {deleted});
+        BOOST_REQUIRE(desc.sstables.size() == 1);
+        BOOST_REQUIRE(desc.sstables.front() == deleted);
+
+        // newer data overlapping the sstable doesn't keep its tombstones from being purged.
+        auto newer = make_sstable_containing(sst_gen, make_mutations(20, false));
+        column_family_test(cf).add_sstable(newer);
+        desc = cs.get_sstables_for_compaction(*cf, {deleted, newer});
+        BOOST_REQUIRE(desc.sstables.size() == 1);
+        BOOST_REQUIRE(desc.sstables.front() == deleted);
+
+        // older data overlapping the sstable does.
+        auto older = make_sstable_containing(sst_gen, make_mutations(1, false));
+        column_family_test(cf).add_sstable(older);
+        BOOST_REQUIRE(cs.get_sstables_for_compaction(*cf, {deleted, newer, older}).sstables.empty());
+
+        // unless overlap checking is disabled.
+        options.emplace(sstring("unchecked_tombstone_compaction"), sstring("true"));
+        cs = sstables::make_compaction_strategy(sstables::compaction_strategy_type::size_tiered, options);
+        desc = cs.get_sstables_for_compaction(*cf, {deleted, newer, older});
+        BOOST_REQUIRE(desc.sstables.size() == 1);
+        BOOST_REQUIRE(desc.sstables.front() == deleted);
+    });
+}
+
 SEASTAR_TEST_CASE(test_promoted_index_read) {
     // create table promoted_index_read (
     //        pk int,
@@ -3581,6 +4138,233 @@ SEASTAR_TEST_CASE(test_skipping_using_index) {
     });
 }
 
+SEASTAR_TEST_CASE(test_key_cache) {
+    return seastar::async([] {
+        simple_schema table;
+        key_cache::set_shard_capacity(1 << 20);
+
+        const unsigned rows_per_part = 10;
+        // Each partition, and the partition without its first row.
+        std::vector<mutation> partitions;
+        std::vector<mutation> tails;
+        uint32_t row_id = 0;
+        for (unsigned i = 0; i < 10; ++i) {
+            mutation m(table.make_pkey(i), table.schema());
+            mutation tail(m.decorated_key(), table.schema());
+            for (unsigned j = 0; j < rows_per_part; ++j) {
+                auto ck = table.make_ckey(row_id++);
+                auto v = data_value(make_random_string(1));
+                auto ts = api::new_timestamp();
+                m.set_clustered_cell(ck, to_bytes("v"), v, ts);
+                if (j) {
+                    tail.set_clustered_cell(ck, to_bytes("v"), v, ts);
+                }
+            }
+            partitions.emplace_back(std::move(m));
+            tails.emplace_back(std::move(tail));
+        }
+        std::sort(partitions.begin(), partitions.end(), mutation_decorated_key_less_comparator());
+        std::sort(tails.begin(), tails.end(), mutation_decorated_key_less_comparator());
+
+        tmpdir dir;
+        sstable_writer_config cfg;
+        cfg.promoted_index_block_size = 1;
+        auto sst = make_sstable(dir.path, table.schema(), make_reader_returning_many(partitions), cfg);
+
+        auto read = [&] (const mutation& m, const query::partition_slice& slice) {
+            auto sm = sst->read_row(table.schema(), m.decorated_key(), slice).get0();
+            return mutation_from_streamed_mutation(std::move(sm)).get0();
+        };
+
+        for (auto&& m : partitions) {
+            assert_that(read(m, query::full_slice)).has_mutation().is_equal_to(m);
+        }
+        BOOST_REQUIRE_EQUAL(sst->get_key_cache().misses(), partitions.size());
+        BOOST_REQUIRE_EQUAL(sst->get_key_cache().hits(), 0);
+        BOOST_REQUIRE_EQUAL(sst->get_key_cache().size(), partitions.size());
+
+        for (unsigned i = 0; i < partitions.size(); ++i) {
+            auto& m = partitions[i];
+            assert_that(read(m, query::full_slice)).has_mutation().is_equal_to(m);
+
+            // Skips within the partition through the cached promoted index.
+            auto ck = m.partition().clustered_rows().begin()->key();
+            auto slice = partition_slice_builder(*table.schema())
+                .with_range(query::clustering_range::make_starting_with({ck, false}))
+                .build();
+            assert_that(read(m, slice)).has_mutation().is_equal_to(tails[i]);
+        }
+        BOOST_REQUIRE_EQUAL(sst->get_key_cache().misses(), partitions.size());
+        BOOST_REQUIRE_EQUAL(sst->get_key_cache().hits(), 2 * partitions.size());
+
+        key_cache::set_shard_capacity(0);
+        BOOST_REQUIRE_EQUAL(sst->get_key_cache().size(), 1);
+    });
+}
+
+SEASTAR_TEST_CASE(test_blocked_bloom_filter) {
+    return seastar::async([] {
+        simple_schema table;
+
+        std::vector<mutation> partitions;
+        for (auto&& key : table.make_pkeys(100)) {
+            mutation m(key, table.schema());
+            table.add_row(m, table.make_ckey(0), "v");
+            partitions.emplace_back(std::move(m));
+        }
+
+        tmpdir dir;
+        sstable_writer_config cfg;
+        cfg.filter_kind = sstables::filter_type::blocked;
+        auto sst = make_sstable(dir.path, table.schema(), make_reader_returning_many(partitions), cfg);
+        BOOST_REQUIRE(sst->get_filter_type() == sstables::filter_type::blocked);
+
+        // The filter type has to survive a reload from disk.
+        sst = reusable_sst(table.schema(), dir.path, 1).get0();
+        BOOST_REQUIRE(sst->get_filter_type() == sstables::filter_type::blocked);
+        for (auto&& m : partitions) {
+            BOOST_REQUIRE(sst->filter_has_key(*table.schema(), m.key()));
+        }
+        BOOST_REQUIRE_EQUAL(sst->filter_get_probes(), partitions.size());
+        BOOST_REQUIRE_EQUAL(sst->filter_get_probe_cost(), partitions.size());
+
+        sstable_writer_config classic_cfg;
+        classic_cfg.filter_kind = sstables::filter_type::classic;
+        tmpdir classic_dir;
+        auto classic = make_sstable(classic_dir.path, table.schema(), make_reader_returning_many(partitions), classic_cfg);
+        BOOST_REQUIRE(classic->get_filter_type() == sstables::filter_type::classic);
+    });
+}
+
+SEASTAR_TEST_CASE(test_deferred_bloom_filter) {
+    return seastar::async([] {
+        simple_schema table;
+
+        std::vector<mutation> partitions;
+        for (auto&& key : table.make_pkeys(100)) {
+            mutation m(key, table.schema());
+            table.add_row(m, table.make_ckey(0), "v");
+            partitions.emplace_back(std::move(m));
+        }
+
+        tmpdir dir;
+        auto written = make_sstable(dir.path, table.schema(), make_reader_returning_many(partitions), sstable_writer_config{});
+        auto filter_size = written->filter_memory_size();
+
+        auto sst = make_lw_shared<sstable>(table.schema(), dir.path, 1, sstables::sstable::version_types::ka, big);
+        sst->load(default_priority_class(), true).get();
+        BOOST_REQUIRE_NE(sst->filter_memory_size(), filter_size);
+
+        // The first lookup starts reading the filter, and is answered without it.
+        BOOST_REQUIRE(sst->filter_has_key(*table.schema(), partitions.front().key()));
+        while (sst->filter_memory_size() != filter_size) {
+            later().get();
+        }
+        for (auto&& m : partitions) {
+            BOOST_REQUIRE(sst->filter_has_key(*table.schema(), m.key()));
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_summary_resampling) {
+    return seastar::async([] {
+        simple_schema table;
+
+        std::vector<mutation> partitions;
+        for (auto&& key : table.make_pkeys(4096)) {
+            mutation m(key, table.schema());
+            table.add_row(m, table.make_ckey(0), "v");
+            partitions.emplace_back(std::move(m));
+        }
+
+        tmpdir dir;
+        make_sstable(dir.path, table.schema(), make_reader_returning_many(partitions), sstable_writer_config{});
+        auto sst = make_lw_shared<sstable>(table.schema(), dir.path, 1, sstables::sstable::version_types::ka, big);
+        sst->load().get();
+        sst->set_unshared();
+        BOOST_REQUIRE(sst->can_resample_summary());
+
+        auto full_entries = sst->get_summary().entries.size();
+        auto full_memory = sst->summary_memory_usage();
+        BOOST_REQUIRE_EQUAL(sst->summary_sampling_level(), downsampling::BASE_SAMPLING_LEVEL);
+        BOOST_REQUIRE_GT(full_entries, 1u);
+
+        auto verify_reads = [&] {
+            for (auto&& m : partitions) {
+                auto sm = sst->read_row(table.schema(), dht::ring_position_view(m.decorated_key())).get0();
+                auto read = mutation_from_streamed_mutation(std::move(sm)).get0();
+                BOOST_REQUIRE(read);
+                BOOST_REQUIRE_EQUAL(*read, m);
+            }
+        };
+
+        BOOST_REQUIRE(sst->resample_summary(64).get0());
+        BOOST_REQUIRE_EQUAL(sst->summary_sampling_level(), 64);
+        BOOST_REQUIRE_LT(sst->get_summary().entries.size(), full_entries);
+        BOOST_REQUIRE_LT(sst->summary_memory_usage(), full_memory);
+        verify_reads();
+
+        BOOST_REQUIRE(sst->resample_summary(downsampling::BASE_SAMPLING_LEVEL).get0());
+        BOOST_REQUIRE_EQUAL(sst->summary_sampling_level(), downsampling::BASE_SAMPLING_LEVEL);
+        BOOST_REQUIRE_EQUAL(sst->get_summary().entries.size(), full_entries);
+        verify_reads();
+
+        // A budget the summary fits in keeps full sampling, one it doesn't
+        // fit in shrinks it.
+        auto plan = index_summary_manager::plan(full_memory * 2, {{sst, 1.0}});
+        BOOST_REQUIRE_EQUAL(plan.size(), 1u);
+        BOOST_REQUIRE_EQUAL(plan[0].sampling_level, downsampling::BASE_SAMPLING_LEVEL);
+        plan = index_summary_manager::plan(full_memory / 4, {{sst, 1.0}});
+        BOOST_REQUIRE_EQUAL(plan.size(), 1u);
+        BOOST_REQUIRE_LT(plan[0].sampling_level, downsampling::BASE_SAMPLING_LEVEL);
+    });
+}
+
+SEASTAR_TEST_CASE(test_data_placement_choice) {
+    auto dir = [] (uint64_t available, uint64_t writes, uint64_t bytes_in_progress) {
+        data_placement::directory d;
+        d.available = available;
+        d.stats.writes_in_progress = writes;
+        d.stats.bytes_in_progress = bytes_in_progress;
+        return d;
+    };
+    // The most free space wins when nothing is being written.
+    BOOST_REQUIRE_EQUAL(data_placement::choose({dir(100, 0, 0), dir(300, 0, 0), dir(200, 0, 0)}, 10), 1u);
+    // Writes in progress count against a directory.
+    BOOST_REQUIRE_EQUAL(data_placement::choose({dir(100, 0, 0), dir(300, 2, 30), dir(200, 0, 0)}, 10), 2u);
+    // A directory without room for the sstable is skipped while some other has room.
+    BOOST_REQUIRE_EQUAL(data_placement::choose({dir(1000, 9, 0), dir(50, 0, 0)}, 60), 0u);
+    BOOST_REQUIRE_EQUAL(data_placement::choose({dir(1000, 0, 980), dir(100, 0, 0)}, 60), 1u);
+    // Without room anywhere, the one with the most is still picked.
+    BOOST_REQUIRE_EQUAL(data_placement::choose({dir(10, 0, 0), dir(50, 0, 0)}, 60), 1u);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_blocked_bloom_filter_false_positive_rate) {
+    const int64_t n = 100000;
+    const double fp_chance = 0.01;
+    auto filter = utils::i_filter::get_blocked_filter(n, fp_chance);
+    BOOST_REQUIRE(dynamic_cast<utils::filter::blocked_bloom_filter*>(filter.get()));
+    BOOST_REQUIRE_EQUAL(filter->probe_cost(), 1u);
+
+    auto key = [] (int64_t i) {
+        bytes b(bytes::initialized_later(), sizeof(i));
+        std::copy_n(reinterpret_cast<const int8_t*>(&i), sizeof(i), b.begin());
+        return b;
+    };
+    for (int64_t i = 0; i < n; ++i) {
+        filter->add(key(i));
+    }
+    int64_t false_positives = 0;
+    for (int64_t i = 0; i < n; ++i) {
+        BOOST_REQUIRE(filter->is_present(key(i)));
+        false_positives += filter->is_present(key(n + i));
+    }
+    BOOST_TEST_MESSAGE(sprint("false positive rate %f", double(false_positives) / n));
+    BOOST_REQUIRE(false_positives < n * fp_chance * 1.5);
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(test_unknown_component) {
     return seastar::async([] {
         auto tmp = make_lw_shared<tmpdir>();
@@ -3706,6 +4490,9 @@ SEASTAR_TEST_CASE(sstable_resharding_strategy_tests) {
         // until we move this test case to sstable_resharding_test.
         auto descriptors = stcs.get_resharding_jobs(*cf, { sst1, sst2 });
         BOOST_REQUIRE(descriptors.size() == 2);
+        for (auto& d : descriptors) {
+            BOOST_REQUIRE(d.reshard_at < smp::count);
+        }
     }
     {
         auto ssts = std::vector<sstables::shared_sstable>{ sst1, sst2 };
@@ -3716,3 +4503,277 @@ SEASTAR_TEST_CASE(sstable_resharding_strategy_tests) {
 
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(incremental_compaction_test) {
+    BOOST_REQUIRE(smp::count == 1);
+    return seastar::async([] {
+        cell_locker_stats cl_stats;
+
+        auto s = schema_builder("tests", "incremental_compaction")
+                .with_column("id", utf8_type, column_kind::partition_key)
+                .with_column("value", int32_type).build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto gen = make_lw_shared<unsigned>(1);
+        auto sst_gen = [s, tmp, gen] () mutable {
+            return make_lw_shared<sstable>(s, tmp->path, (*gen)++, la, big);
+        };
+
+        auto keys = token_generation_for_current_shard(20);
+        auto make_insert = [&] (const sstring& key, api::timestamp_type ts) {
+            mutation m(partition_key::from_exploded(*s, {to_bytes(key)}), s);
+            m.set_clustered_cell(clustering_key::make_empty(), bytes("value"), data_value(int32_t(1)), ts);
+            return m;
+        };
+        auto make_fragment = [&] (unsigned begin, unsigned end, api::timestamp_type ts) {
+            std::vector<mutation> muts;
+            for (auto i = begin; i < end; i++) {
+                muts.push_back(make_insert(keys[i].first, ts));
+            }
+            return make_sstable_containing(sst_gen, std::move(muts));
+        };
+
+        // Two runs of two fragments each, covering the same token ranges.
+        auto a1 = make_fragment(0, 10, 1);
+        auto a2 = make_fragment(10, 20, 1);
+        auto b1 = make_fragment(0, 10, 2);
+        auto b2 = make_fragment(10, 20, 2);
+
+        auto cm = make_lw_shared<compaction_manager>();
+        auto cf = make_lw_shared<column_family>(s, column_family::config(), column_family::no_commitlog(), *cm, cl_stats);
+        cf->mark_ready_for_writes();
+        for (auto&& sst : { a1, a2, b1, b2 }) {
+            column_family_test(cf).add_sstable(sst);
+        }
+
+        std::vector<std::pair<std::vector<shared_sstable>, std::vector<shared_sstable>>> replacements;
+        auto replacer = [&] (std::vector<shared_sstable> removed, std::vector<shared_sstable> added) {
+            replacements.emplace_back(std::move(removed), std::move(added));
+        };
+        // Every partition goes into an sstable of its own.
+        auto new_sstables = sstables::compact_sstables({ a1, a2, b1, b2 }, *cf, sst_gen, 1, 0, false, replacer).get0();
+        BOOST_REQUIRE(new_sstables.size() == 20);
+
+        auto generations = [] (const std::vector<shared_sstable>& ssts) {
+            return boost::copy_range<std::set<int64_t>>(ssts | boost::adaptors::transformed(std::mem_fn(&sstable::generation)));
+        };
+        // The first fragments are released as soon as the output is past them.
+        BOOST_REQUIRE(replacements.size() == 2);
+        BOOST_REQUIRE(generations(replacements[0].first) == std::set<int64_t>({ a1->generation(), b1->generation() }));
+        BOOST_REQUIRE(replacements[0].second.size() == 10);
+        BOOST_REQUIRE(generations(replacements[1].first) == std::set<int64_t>({ a2->generation(), b2->generation() }));
+        BOOST_REQUIRE(replacements[1].second.size() == 10);
+
+        // The output is a run, and the run identifier is persisted.
+        auto run_id = new_sstables.front()->run_identifier();
+        for (auto& sst : new_sstables) {
+            BOOST_REQUIRE(sst->run_identifier() == run_id);
+        }
+        BOOST_REQUIRE(a1->run_identifier() != run_id);
+        auto reloaded = reusable_sst(s, tmp->path, new_sstables.back()->generation()).get0();
+        BOOST_REQUIRE(reloaded->run_identifier() == run_id);
+    });
+}
+
+SEASTAR_TEST_CASE(compaction_output_splitter_test) {
+    BOOST_REQUIRE(smp::count == 1);
+    return seastar::async([] {
+        cell_locker_stats cl_stats;
+
+        auto s = schema_builder("tests", "compaction_output_splitter")
+                .with_column("p", utf8_type, column_kind::partition_key)
+                .with_column("c", int32_type, column_kind::clustering_key)
+                .with_column("value", int32_type).build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto gen = make_lw_shared<unsigned>(1);
+        auto sst_gen = [s, tmp, gen] () mutable {
+            return make_lw_shared<sstable>(s, tmp->path, (*gen)++, la, big);
+        };
+
+        // Every partition has a row in the first time window, and every
+        // other one a row in the second one too.
+        const api::timestamp_type window_size = 100;
+        auto keys = token_generation_for_current_shard(10);
+        std::vector<mutation> muts;
+        for (auto i = 0U; i < keys.size(); i++) {
+            mutation m(partition_key::from_exploded(*s, {to_bytes(keys[i].first)}), s);
+            m.set_clustered_cell(clustering_key::from_singular(*s, 1), bytes("value"), data_value(int32_t(1)), 10);
+            if (i % 2) {
+                m.set_clustered_cell(clustering_key::from_singular(*s, 2), bytes("value"), data_value(int32_t(2)), window_size + 50);
+            }
+            muts.push_back(std::move(m));
+        }
+        auto sst = make_sstable_containing(sst_gen, std::move(muts));
+
+        auto cm = make_lw_shared<compaction_manager>();
+        auto cf = make_lw_shared<column_family>(s, column_family::config(), column_family::no_commitlog(), *cm, cl_stats);
+        cf->mark_ready_for_writes();
+        column_family_test(cf).add_sstable(sst);
+
+        {
+            std::vector<std::pair<std::vector<shared_sstable>, std::vector<shared_sstable>>> replacements;
+            auto replacer = [&] (std::vector<shared_sstable> removed, std::vector<shared_sstable> added) {
+                replacements.emplace_back(std::move(removed), std::move(added));
+            };
+            auto new_sstables = sstables::compact_sstables({ sst }, *cf, sst_gen, std::numeric_limits<uint64_t>::max(), 0, false,
+                    replacer, make_time_window_splitter(window_size)).get0();
+            BOOST_REQUIRE(new_sstables.size() == 2);
+            boost::sort(new_sstables, [] (auto& a, auto& b) {
+                return a->get_stats_metadata().max_timestamp < b->get_stats_metadata().max_timestamp;
+            });
+            BOOST_REQUIRE(new_sstables[0]->get_stats_metadata().max_timestamp == 10);
+            BOOST_REQUIRE(new_sstables[1]->get_stats_metadata().min_timestamp == window_size + 50);
+            // Streams are sealed independently, so the input is only released at the end.
+            BOOST_REQUIRE(replacements.size() == 1);
+            BOOST_REQUIRE(replacements[0].second.size() == 2);
+            // Each window is a run of its own.
+            BOOST_REQUIRE(new_sstables[0]->run_identifier() != new_sstables[1]->run_identifier());
+        }
+        {
+            // With a tiny size limit every stream is cut into several sstables,
+            // which still share the run identifier of their stream.
+            auto new_sstables = sstables::compact_sstables({ sst }, *cf, sst_gen, 1, 0, false,
+                    {}, make_time_window_splitter(window_size)).get0();
+            BOOST_REQUIRE(new_sstables.size() == keys.size() + keys.size() / 2);
+            std::map<utils::UUID, std::set<api::timestamp_type>> windows_by_run;
+            for (auto& sst : new_sstables) {
+                auto window = sst->get_stats_metadata().max_timestamp / window_size;
+                BOOST_REQUIRE(sst->get_stats_metadata().min_timestamp / window_size == window);
+                windows_by_run[sst->run_identifier()].insert(window);
+            }
+            BOOST_REQUIRE(windows_by_run.size() == 2);
+            for (auto& run : windows_by_run) {
+                BOOST_REQUIRE(run.second.size() == 1);
+            }
+        }
+        {
+            auto new_sstables = sstables::compact_sstables({ sst }, *cf, sst_gen, std::numeric_limits<uint64_t>::max(), 0, false,
+                    {}, make_token_range_splitter({ keys[4].second })).get0();
+            BOOST_REQUIRE(new_sstables.size() == 2);
+            boost::sort(new_sstables, [] (auto& a, auto& b) {
+                return a->compare_by_first_key(*b) < 0;
+            });
+            BOOST_REQUIRE(new_sstables[0]->get_first_decorated_key().token() == keys[0].second);
+            BOOST_REQUIRE(new_sstables[0]->get_last_decorated_key().token() == keys[4].second);
+            BOOST_REQUIRE(new_sstables[1]->get_first_decorated_key().token() == keys[5].second);
+            BOOST_REQUIRE(new_sstables[1]->get_last_decorated_key().token() == keys.back().second);
+            BOOST_REQUIRE(new_sstables[0]->run_identifier() != new_sstables[1]->run_identifier());
+        }
+    });
+}
+
+SEASTAR_TEST_CASE(test_distinct_partitions_ratio) {
+    return seastar::async([] {
+        auto s = schema_builder("tests", "distinct_partitions_ratio")
+                .with_column("p", utf8_type, column_kind::partition_key)
+                .with_column("value", int32_type).build();
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto gen = make_lw_shared<unsigned>(1);
+        auto sst_gen = [s, tmp, gen] () mutable {
+            return make_lw_shared<sstable>(s, tmp->path, (*gen)++, la, big);
+        };
+
+        auto keys = token_generation_for_current_shard(200);
+        auto make_sstable = [&] (size_t first, size_t last) {
+            std::vector<mutation> muts;
+            for (auto i = first; i < last; i++) {
+                mutation m(partition_key::from_exploded(*s, {to_bytes(keys[i].first)}), s);
+                m.set_clustered_cell(clustering_key::make_empty(), bytes("value"), data_value(int32_t(i)), 1);
+                muts.push_back(std::move(m));
+            }
+            return make_sstable_containing(sst_gen, std::move(muts));
+        };
+        auto sst1 = make_sstable(0, 100);
+        auto sst2 = make_sstable(0, 100);
+        auto sst3 = make_sstable(100, 200);
+
+        // The cardinality is read back from the Statistics component.
+        auto reopened = reusable_sst(s, tmp->path, sst1->generation()).get0();
+        auto cardinality = reopened->get_cardinality();
+        BOOST_REQUIRE(cardinality);
+        BOOST_REQUIRE(std::abs(cardinality->estimate() - 100) < 5);
+
+        BOOST_REQUIRE(std::abs(distinct_partitions_ratio({ reopened, sst2 }) - 0.5) < 0.05);
+        BOOST_REQUIRE(distinct_partitions_ratio({ sst1, sst3 }) > 0.95);
+        BOOST_REQUIRE(distinct_partitions_ratio({ sst1 }) == 1);
+    });
+}
+
+SEASTAR_TEST_CASE(test_adaptive_read_ahead) {
+    return seastar::async([] {
+        auto window = read_ahead_window::for_scan(64 * 1024, 2);
+        BOOST_REQUIRE_EQUAL(window.buffer_size(), read_ahead_window::min_buffer_size);
+        BOOST_REQUIRE_EQUAL(window.read_ahead(), 0);
+        window.on_sequential_read();
+        window.on_sequential_read();
+        BOOST_REQUIRE_EQUAL(window.buffer_size(), 64 * 1024);
+        BOOST_REQUIRE(!window.is_sequential());
+        window.on_sequential_read();
+        window.on_sequential_read();
+        window.on_sequential_read();
+        BOOST_REQUIRE_EQUAL(window.read_ahead(), 2);
+        window.on_skip();
+        BOOST_REQUIRE_EQUAL(window.buffer_size(), read_ahead_window::min_buffer_size);
+        BOOST_REQUIRE_EQUAL(window.read_ahead(), 0);
+
+        auto tmp = make_lw_shared<tmpdir>();
+        auto fname = tmp->path + "/data";
+        const size_t size = 1 << 20;
+        auto content = [] (size_t pos) { return char(pos % 251); };
+        {
+            auto f = open_file_dma(fname, open_flags::wo | open_flags::create).get0();
+            auto out = make_file_output_stream(std::move(f));
+            for (size_t pos = 0; pos < size; ++pos) {
+                char c = content(pos);
+                out.write(&c, 1).get();
+            }
+            out.close().get();
+        }
+        auto f = open_file_dma(fname, open_flags::ro).get0();
+
+        // A scan reads ahead, and reads everything it read.
+        auto stats = make_lw_shared<read_ahead_stats>();
+        auto scan = make_adaptive_file_input_stream(f, 0, size, default_priority_class(),
+                read_ahead_window::for_scan(128 * 1024, 4), stats);
+        size_t pos = 0;
+        while (auto buf = scan.read().get0()) {
+            for (auto c : buf) {
+                BOOST_REQUIRE_EQUAL(c, content(pos++));
+            }
+        }
+        scan.close().get();
+        BOOST_REQUIRE_EQUAL(pos, size);
+        BOOST_REQUIRE_EQUAL(stats->bytes_read, size);
+        BOOST_REQUIRE_EQUAL(stats->wasted_bytes, 0);
+        BOOST_REQUIRE_EQUAL(stats->sequential_readers, 1);
+
+        // A point read reads its range in a single buffer.
+        stats = make_lw_shared<read_ahead_stats>();
+        auto point = make_adaptive_file_input_stream(f, 1000, 5000, default_priority_class(),
+                read_ahead_window::for_point_read(5000, 128 * 1024, 4), stats);
+        auto buf = point.read_exactly(5000).get0();
+        point.close().get();
+        BOOST_REQUIRE_EQUAL(buf.size(), 5000);
+        BOOST_REQUIRE_EQUAL(buf[0], content(1000));
+        BOOST_REQUIRE_EQUAL(stats->reads, 1);
+        BOOST_REQUIRE_EQUAL(stats->sequential_readers, 0);
+
+        // Skipping over what was read ahead wastes it.
+        stats = make_lw_shared<read_ahead_stats>();
+        auto skipping = make_adaptive_file_input_stream(f, 0, size, default_priority_class(),
+                read_ahead_window::for_scan(128 * 1024, 4), stats);
+        pos = 0;
+        while (pos < size / 2) {
+            auto buf = skipping.read().get0();
+            pos += buf.size();
+        }
+        skipping.skip(size / 4).get();
+        pos += size / 4;
+        buf = skipping.read_exactly(1).get0();
+        BOOST_REQUIRE_EQUAL(buf[0], content(pos));
+        skipping.close().get();
+        BOOST_REQUIRE_GE(stats->wasted_bytes, size / 4);
+    });
+}
@@ -85,6 +85,18 @@ SEASTAR_TEST_CASE(wrong_format_toc) {
     return broken_sst("tests/sstables/badtoc", 4);
 }
 
+// Files of Cassandra 3.x sstables are named like those of la and sa
+// sstables, but aren't in a layout Scylla can read.
+SEASTAR_TEST_CASE(foreign_format_descriptor) {
+    auto d = entry_descriptor::make_descriptor("sa-3-big-Data.db");
+    BOOST_REQUIRE(d.version == sstable::version_types::sa);
+    BOOST_REQUIRE_EQUAL(d.generation, 3);
+    BOOST_REQUIRE(d.component == sstable::component_type::Data);
+    BOOST_REQUIRE_THROW(entry_descriptor::make_descriptor("mc-3-big-Data.db"), malformed_sstable_exception);
+    BOOST_REQUIRE_THROW(entry_descriptor::make_descriptor("md-3-big-TOC.txt"), malformed_sstable_exception);
+    return make_ready_future<>();
+}
+
 SEASTAR_TEST_CASE(compression_truncated) {
     return broken_sst("tests/sstables/badcompression", 1);
 }
@@ -1334,3 +1346,44 @@ SEASTAR_TEST_CASE(test_skipping_in_compressed_stream) {
         expect_eof(in);
     });
 }
+
+SEASTAR_TEST_CASE(test_compressed_stream_round_trip) {
+    return seastar::async([] {
+        tmpdir tmp;
+        for (auto algorithm : { compressor::lz4, compressor::snappy, compressor::deflate, compressor::zstd }) {
+            auto file_path = tmp.path + "/test";
+            file f = open_file_dma(file_path, open_flags::create | open_flags::truncate | open_flags::wo).get0();
+
+            sstables::compression c;
+            c.set_compressor(algorithm);
+            c.chunk_len = 64 * 1024;
+            c.data_len = 0;
+            c.init_full_checksum();
+
+            // Several chunks, compressible but not trivially so, and each
+            // larger than a compression step, the last one partial.
+            std::vector<char> data(c.chunk_len * 5 + 1234);
+            for (size_t i = 0; i < data.size(); ++i) {
+                data[i] = "abcdefgh"[(i * 7 + i / 1000) % 8] + (i % 97 == 0);
+            }
+
+            auto out = make_compressed_file_output_stream(f, file_output_stream_options(), &c);
+            for (size_t pos = 0; pos < data.size(); pos += 10000) {
+                out.write(data.data() + pos, std::min(size_t(10000), data.size() - pos)).get();
+            }
+            out.close().get();
+
+            BOOST_REQUIRE_EQUAL(c.uncompressed_file_length(), data.size());
+            BOOST_REQUIRE_EQUAL(c.offsets.elements.size(), 6);
+            auto compressed_size = f.size().get0();
+            BOOST_REQUIRE_EQUAL(c.compressed_file_length(), compressed_size);
+            c.update(compressed_size);
+
+            f = open_file_dma(file_path, open_flags::ro).get0();
+            auto in = make_compressed_file_input_stream(f, &c, 0, data.size(), file_input_stream_options());
+            auto b = in.read_exactly(data.size()).get0();
+            BOOST_REQUIRE(std::equal(b.begin(), b.end(), data.begin(), data.end()));
+            in.close().get();
+        }
+    });
+}
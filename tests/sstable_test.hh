@@ -160,6 +160,10 @@ class test {
         _sst->set_first_and_last_keys();
         _sst->_components->statistics.contents[metadata_type::Compaction] = std::make_unique<compaction_metadata>();
     }
+
+    void set_data_file_size(uint64_t size) {
+        _sst->_data_file_size = size;
+    }
 };
 
 inline future<sstable_ptr> reusable_sst(schema_ptr schema, sstring dir, unsigned long generation) {
@@ -27,6 +27,8 @@
 #include "tests/cql_test_env.hh"
 #include "tests/mutation_source_test.hh"
 #include "tests/result_set_assertions.hh"
+#include "tests/cql_assertions.hh"
+#include "transport/messages/result_message.hh"
 #include "service/storage_proxy.hh"
 #include "partition_slice_builder.hh"
 #include "schema_builder.hh"
@@ -116,3 +118,88 @@ SEASTAR_TEST_CASE(test_get_restricted_ranges) {
         });
     });
 }
+
+SEASTAR_TEST_CASE(test_coordinator_result_cache) {
+    using namespace std::chrono_literals;
+    using cache_type = service::coordinator_result_cache;
+    cache_type cache(1024 * 1024);
+    auto now = cache_type::clock_type::now();
+    auto table = utils::make_random_uuid();
+    auto token = dht::global_partitioner().get_random_token();
+    auto other_token = dht::global_partitioner().get_random_token();
+    auto make_result = [] {
+        return ::make_shared<cql_transport::messages::result_message::void_message>();
+    };
+    auto key = [] (uint64_t id) {
+        return cache_type::key{id, bytes("values")};
+    };
+
+    BOOST_REQUIRE(!cache.find(key(1), now));
+
+    auto result = make_result();
+    cache.insert(cache.epoch(table, {token}), key(1), result, table, {token}, 100, 1000ms, now);
+    BOOST_REQUIRE(cache.find(key(1), now) == result);
+    BOOST_REQUIRE(!cache.find(cache_type::key{1, bytes("other values")}, now));
+
+    // Entries expire.
+    BOOST_REQUIRE(!cache.find(key(1), now + 1000ms));
+    BOOST_REQUIRE_EQUAL(cache.size(), 0);
+    BOOST_REQUIRE_EQUAL(cache.memory_used(), 0);
+
+    // Writes drop the entries of their partition only.
+    cache.insert(cache.epoch(table, {token}), key(1), make_result(), table, {token}, 100, 1000ms, now);
+    cache.insert(cache.epoch(table, {other_token}), key(2), make_result(), table, {other_token}, 100, 1000ms, now);
+    cache.insert(cache.epoch(table, {token, other_token}), key(3), make_result(), table, {token, other_token}, 100, 1000ms, now);
+    cache.invalidate(table, token);
+    BOOST_REQUIRE(!cache.find(key(1), now));
+    BOOST_REQUIRE(cache.find(key(2), now));
+    BOOST_REQUIRE(!cache.find(key(3), now));
+    BOOST_REQUIRE_EQUAL(cache.get_stats().invalidations, 2);
+
+    // Results read concurrently with a write are not inserted.
+    auto epoch = cache.epoch(table, {token});
+    cache.invalidate(table, token);
+    cache.insert(epoch, key(4), make_result(), table, {token}, 100, 1000ms, now);
+    BOOST_REQUIRE(!cache.find(key(4), now));
+
+    // The least recently used entries are evicted first.
+    cache_type small_cache(64 * 1024);
+    for (uint64_t id = 0; id < 16; ++id) {
+        small_cache.insert(0, key(id), make_result(), table, {}, 6 * 1024, 1000ms, now);
+        BOOST_REQUIRE(small_cache.find(key(0), now));
+    }
+    BOOST_REQUIRE_LE(small_cache.memory_used(), 64 * 1024);
+    BOOST_REQUIRE(small_cache.find(key(0), now));
+    BOOST_REQUIRE(!small_cache.find(key(1), now));
+    BOOST_REQUIRE(small_cache.find(key(15), now));
+    BOOST_REQUIRE_GT(small_cache.get_stats().evictions, 0);
+
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_coordinator_result_cache_invalidated_by_writes) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        e.execute_cql("create table cf (pk int, ck int, v int, primary key (pk, ck)) "
+                "with caching = {'keys': 'ALL', 'rows_per_partition': 'ALL', 'coordinator_ttl_in_ms': '3600000'};").get();
+        e.execute_cql("insert into cf (pk, ck, v) values (1, 1, 1);").get();
+
+        auto id = e.prepare("select v from cf where pk = ?;").get0();
+        auto select = [&] {
+            return e.execute_prepared(id, {cql3::raw_value::make_value(int32_type->decompose(1))}).get0();
+        };
+        auto& cache = service::get_local_storage_proxy().result_cache();
+
+        assert_that(select()).is_rows().with_rows({{int32_type->decompose(1)}});
+        assert_that(select()).is_rows().with_rows({{int32_type->decompose(1)}});
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits, 1);
+
+        e.execute_cql("update cf set v = 2 where pk = 1 and ck = 1;").get();
+        assert_that(select()).is_rows().with_rows({{int32_type->decompose(2)}});
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits, 1);
+
+        // Other statements and values are cached separately.
+        assert_that(e.execute_prepared(id, {cql3::raw_value::make_value(int32_type->decompose(2))}).get0())
+                .is_rows().is_empty();
+        BOOST_REQUIRE_EQUAL(cache.get_stats().hits, 1);
+    });
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <seastar/core/sleep.hh>
+#include <seastar/core/thread.hh>
+#include "tests/test-utils.hh"
+
+#include "utils/task_group.hh"
+
+using namespace std::chrono_literals;
+
+SEASTAR_TEST_CASE(test_tasks_are_accounted_until_they_resolve) {
+    return seastar::async([] {
+        auto g = utils::task_group::repair;
+        auto before = utils::get_task_group_stats(g);
+
+        promise<> p;
+        auto f = utils::run_in_task_group(g, [&p] {
+            return p.get_future();
+        });
+        auto running = utils::get_task_group_stats(g);
+        BOOST_REQUIRE_EQUAL(running.tasks, before.tasks + 1);
+        BOOST_REQUIRE_EQUAL(running.running_tasks, before.running_tasks + 1);
+
+        sleep(10ms).get();
+        p.set_value();
+        f.get();
+
+        auto after = utils::get_task_group_stats(g);
+        BOOST_REQUIRE_EQUAL(after.running_tasks, before.running_tasks);
+        BOOST_REQUIRE_EQUAL(after.failed_tasks, before.failed_tasks);
+        BOOST_REQUIRE(after.busy_time - before.busy_time >= 10ms);
+
+        // Time spent idle isn't busy time.
+        sleep(10ms).get();
+        BOOST_REQUIRE(utils::get_task_group_stats(g).busy_time == after.busy_time);
+    });
+}
+
+SEASTAR_TEST_CASE(test_failed_tasks_are_counted) {
+    return seastar::async([] {
+        auto g = utils::task_group::gossip;
+        auto before = utils::get_task_group_stats(g);
+        auto f = utils::run_in_task_group(g, [] {
+            throw std::runtime_error("failed");
+            return make_ready_future<>();
+        });
+        BOOST_REQUIRE_THROW(f.get(), std::runtime_error);
+        auto after = utils::get_task_group_stats(g);
+        BOOST_REQUIRE_EQUAL(after.tasks, before.tasks + 1);
+        BOOST_REQUIRE_EQUAL(after.failed_tasks, before.failed_tasks + 1);
+        BOOST_REQUIRE_EQUAL(after.running_tasks, 0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_queue_length_comes_from_its_owner) {
+    auto g = utils::task_group::streaming;
+    uint64_t queued = 3;
+    utils::set_task_group_queue_length(g, [&queued] { return queued; });
+    BOOST_REQUIRE_EQUAL(utils::get_task_group_stats(g).queued_tasks, 3);
+    queued = 1;
+    BOOST_REQUIRE_EQUAL(utils::get_task_group_stats(g).queued_tasks, 1);
+    utils::set_task_group_queue_length(g, {});
+    BOOST_REQUIRE_EQUAL(utils::get_task_group_stats(g).queued_tasks, 0);
+    return make_ready_future<>();
+}
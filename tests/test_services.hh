@@ -30,11 +30,18 @@
 class storage_service_for_tests {
     distributed<database> _db;
 public:
-    storage_service_for_tests() {
+    // Without features, the node behaves as if some other node of the
+    // cluster were not upgraded yet.
+    explicit storage_service_for_tests(bool enable_features = true) {
         auto thread = seastar::thread_impl::get();
         assert(thread);
         netw::get_messaging_service().start(gms::inet_address("127.0.0.1")).get();
         service::get_storage_service().start(std::ref(_db)).get();
+        if (enable_features) {
+            enable_all_features();
+        }
+    }
+    void enable_all_features() {
         service::get_storage_service().invoke_on_all([] (auto& ss) {
             ss.enable_all_features();
         }).get();
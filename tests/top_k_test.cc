@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+#include <random>
+
+#include "utils/top_k.hh"
+
+BOOST_AUTO_TEST_CASE(test_exact_counts_within_capacity) {
+    utils::space_saving_top_k<int> top(10);
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j <= i; j++) {
+            top.append(i);
+        }
+    }
+    top.append(0, 10);
+
+    auto res = top.top(3);
+    BOOST_REQUIRE_EQUAL(res.size(), 3);
+    BOOST_REQUIRE_EQUAL(res[0].item, 0);
+    BOOST_REQUIRE_EQUAL(res[0].count, 11);
+    BOOST_REQUIRE_EQUAL(res[1].item, 4);
+    BOOST_REQUIRE_EQUAL(res[1].count, 5);
+    BOOST_REQUIRE_EQUAL(res[2].item, 3);
+    BOOST_REQUIRE_EQUAL(res[2].count, 4);
+    for (auto&& r : res) {
+        BOOST_REQUIRE_EQUAL(r.error, 0);
+    }
+    BOOST_REQUIRE_EQUAL(top.top(100).size(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(test_heavy_hitters_are_found) {
+    constexpr size_t capacity = 64;
+    utils::space_saving_top_k<int> top(capacity);
+    std::map<int, uint64_t> counts;
+    std::default_random_engine rng;
+    std::uniform_int_distribution<int> noise(100, 100000);
+    std::uniform_int_distribution<int> coin(0, 9);
+    uint64_t total = 0;
+
+    for (int i = 0; i < 100000; i++) {
+        // Keys 0-4 are a third of the stream, the rest is uniform noise.
+        auto key = coin(rng) < 3 ? i % 5 : noise(rng);
+        top.append(key);
+        counts[key]++;
+        total++;
+    }
+    BOOST_REQUIRE_EQUAL(top.size(), capacity);
+
+    auto res = top.top(5);
+    BOOST_REQUIRE_EQUAL(res.size(), 5);
+    for (auto&& r : res) {
+        BOOST_REQUIRE_LT(r.item, 5);
+        BOOST_REQUIRE_GE(r.count, counts[r.item]);
+        BOOST_REQUIRE_LE(r.count - r.error, counts[r.item]);
+    }
+    for (auto&& r : top.top(capacity)) {
+        BOOST_REQUIRE_GE(r.count, counts[r.item]);
+        BOOST_REQUIRE_LE(r.error, total / capacity);
+    }
+}
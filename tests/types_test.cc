@@ -373,6 +373,24 @@ BOOST_AUTO_TEST_CASE(test_varint) {
     BOOST_CHECK_EQUAL(value_cast<boost::multiprecision::cpp_int>(varint_type->deserialize(from_hex("00ffffffffffffffffffffffffffffffff"))), boost::multiprecision::cpp_int("340282366920938463463374607431768211455"));
 
     test_parsing_fails(varint_type, "1A");
+
+    // Values which fit in 64 bits and those which don't.
+    BOOST_REQUIRE_EQUAL(varint_type->hash(from_hex("000000")), varint_type->hash(from_hex("00")));
+    BOOST_REQUIRE_EQUAL(varint_type->hash(from_hex("ffffffffffffffffff9000")), varint_type->hash(from_hex("9000")));
+    BOOST_REQUIRE_EQUAL(varint_type->hash(from_hex("0000ffffffffffffffffffffffffffffffff")), varint_type->hash(from_hex("00ffffffffffffffffffffffffffffffff")));
+    BOOST_REQUIRE(varint_type->equal(from_hex("00000000000000000000001000"), from_hex("1000")));
+    BOOST_REQUIRE_EQUAL(varint_type->compare(from_hex("80"), from_hex("7f")), -1);
+    BOOST_REQUIRE_EQUAL(varint_type->compare(from_hex("ff7fffffffffffffff"), from_hex("8000000000000000")), -1);
+    BOOST_REQUIRE_EQUAL(varint_type->compare(from_hex("008000000000000000"), from_hex("7fffffffffffffff")), 1);
+    for (auto&& v : { "0", "-1", "127", "128", "-128", "-129", "255", "-256", "9223372036854775807", "-9223372036854775808",
+                      "9223372036854775808", "-9223372036854775809", "340282366920938463463374607431768211455" }) {
+        auto num = boost::multiprecision::cpp_int(v);
+        auto b = varint_type->decompose(num);
+        BOOST_CHECK_EQUAL(value_cast<boost::multiprecision::cpp_int>(varint_type->deserialize(b)), num);
+        BOOST_CHECK_EQUAL(varint_type->to_string(b), v);
+    }
+    BOOST_REQUIRE_EQUAL(varint_type->decompose(boost::multiprecision::cpp_int(-128)), from_hex("ff80"));
+    BOOST_REQUIRE_EQUAL(varint_type->decompose(boost::multiprecision::cpp_int("-9223372036854775808")), from_hex("ff8000000000000000"));
 }
 
 BOOST_AUTO_TEST_CASE(test_decimal) {
@@ -425,6 +443,21 @@ BOOST_AUTO_TEST_CASE(test_decimal) {
     BOOST_REQUIRE(!decimal_type->equal(decimal_type->from_string("1.23e5"), decimal_type->from_string("123000.1")));
     BOOST_REQUIRE(!decimal_type->equal(decimal_type->from_string("1.23e5"), decimal_type->from_string("1231e2")));
     BOOST_REQUIRE(!decimal_type->equal(decimal_type->from_string("1.23e-2"), decimal_type->from_string("0.01231")));
+
+    auto same = [] (sstring a, sstring b) {
+        auto x = decimal_type->from_string(a);
+        auto y = decimal_type->from_string(b);
+        BOOST_REQUIRE_EQUAL(decimal_type->compare(x, y), 0);
+        BOOST_REQUIRE_EQUAL(decimal_type->hash(x), decimal_type->hash(y));
+    };
+    same("1", "1.000");
+    same("0", "0.00");
+    same("-12e3", "-12000");
+    same("1", "1.000000000000000000000000000000");
+    same("170141183460469231731687303715884105727", "170141183460469231731687303715884105727.000");
+    BOOST_REQUIRE_EQUAL(decimal_type->compare(decimal_type->from_string("1.5"), decimal_type->from_string("1.49999")), 1);
+    BOOST_REQUIRE_EQUAL(decimal_type->compare(decimal_type->from_string("-1.5"), decimal_type->from_string("-1.49999")), -1);
+    BOOST_REQUIRE_EQUAL(decimal_type->compare(decimal_type->from_string("1e30"), decimal_type->from_string("9223372036854775807")), 1);
 }
 
 BOOST_AUTO_TEST_CASE(test_compound_type_compare) {
@@ -513,6 +546,7 @@ BOOST_AUTO_TEST_CASE(test_ascii_type_validation) {
     ascii_type->validate(bytes());
     ascii_type->validate(bytes("foo"));
     test_validation_fails(ascii_type, bytes("fóo"));
+    test_validation_fails(ascii_type, bytes("0123456789abcdef0123456789abcdef") + from_hex("80"));
 }
 
 BOOST_AUTO_TEST_CASE(test_utf8_type_validation) {
@@ -520,6 +554,19 @@ BOOST_AUTO_TEST_CASE(test_utf8_type_validation) {
     utf8_type->validate(bytes("foo"));
     utf8_type->validate(bytes("fóo"));
     test_validation_fails(utf8_type, bytes("test") + from_hex("fe"));
+
+    // Sequences crossing, and cut at, the 16 byte blocks of the vectorized validator.
+    auto padding = bytes("0123456789abcde");
+    for (auto&& valid : { "c2a9", "e282ac", "f09f9880", "f48fbfbf", "ed9fbf" }) {
+        utf8_type->validate(from_hex(valid));
+        utf8_type->validate(padding + from_hex(valid));
+        utf8_type->validate(padding + padding + from_hex(valid) + padding);
+    }
+    for (auto&& invalid : { "80", "c0af", "c1bf", "e080af", "f08282ac", "eda080", "edbfbf", "f4908080", "f5808080", "ff", "c2", "e282", "f09f98" }) {
+        test_validation_fails(utf8_type, from_hex(invalid));
+        test_validation_fails(utf8_type, padding + from_hex(invalid));
+        test_validation_fails(utf8_type, padding + padding + from_hex(invalid) + padding);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(test_int32_type_validation) {
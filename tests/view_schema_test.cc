@@ -2538,3 +2538,24 @@ SEASTAR_TEST_CASE(complex_timestamp_deletion_test_with_flush) {
         });
     }, cfg);
 }
+
+SEASTAR_TEST_CASE(test_read_before_write_of_selected_columns) {
+    return do_with_cql_env_thread([] (auto& e) {
+        e.execute_cql("create table cf (p int, c int, v1 int, v2 int, v3 int, primary key (p, c))").get();
+        e.execute_cql("create materialized view vcf as select v2 from cf "
+                      "where p is not null and c is not null and v1 is not null "
+                      "primary key (v1, p, c)").get();
+
+        auto& cf = e.local_db().find_column_family("ks", "cf");
+        auto s = cf.schema();
+        auto columns = db::view::base_columns_needed_by_views(*s, cf.views());
+        BOOST_REQUIRE(columns == std::vector<column_id>({s->get_column_definition("v1")->id, s->get_column_definition("v2")->id}));
+
+        e.execute_cql("insert into cf (p, c, v1, v2, v3) values (0, 0, 1, 2, 3)").get();
+        e.execute_cql("update cf set v1 = 4 where p = 0 and c = 0").get();
+        auto msg = e.execute_cql("select v1, p, c, v2 from vcf").get0();
+        assert_that(msg).is_rows().with_rows({
+            {{int32_type->decompose(4)}, {int32_type->decompose(0)}, {int32_type->decompose(0)}, {int32_type->decompose(2)}},
+        });
+    });
+}
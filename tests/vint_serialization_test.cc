@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/unit_test.hpp>
+
+#include "vint-serialization.hh"
+
+#include <limits>
+#include <random>
+
+template <typename Vint>
+static void check_round_trip(typename Vint::value_type value) {
+    bytes buf(bytes::initialized_later(), max_vint_length);
+    auto size = Vint::serialize(value, buf.begin());
+    BOOST_REQUIRE_EQUAL(size, Vint::serialized_size(value));
+    BOOST_REQUIRE_EQUAL(size, Vint::serialized_size_from_first_byte(buf[0]));
+    BOOST_REQUIRE_EQUAL(Vint::deserialize(bytes_view(buf.data(), size)), value);
+}
+
+BOOST_AUTO_TEST_CASE(test_unsigned_vint_sizes) {
+    BOOST_REQUIRE_EQUAL(unsigned_vint::serialized_size(0), 1);
+    BOOST_REQUIRE_EQUAL(unsigned_vint::serialized_size(127), 1);
+    BOOST_REQUIRE_EQUAL(unsigned_vint::serialized_size(128), 2);
+    BOOST_REQUIRE_EQUAL(unsigned_vint::serialized_size((uint64_t(1) << 56) - 1), 8);
+    BOOST_REQUIRE_EQUAL(unsigned_vint::serialized_size(uint64_t(1) << 56), 9);
+    BOOST_REQUIRE_EQUAL(unsigned_vint::serialized_size(std::numeric_limits<uint64_t>::max()), 9);
+}
+
+BOOST_AUTO_TEST_CASE(test_unsigned_vint_round_trip) {
+    for (unsigned shift = 0; shift < 64; ++shift) {
+        auto v = uint64_t(1) << shift;
+        check_round_trip<unsigned_vint>(v - 1);
+        check_round_trip<unsigned_vint>(v);
+        check_round_trip<unsigned_vint>(v + 1);
+    }
+    check_round_trip<unsigned_vint>(std::numeric_limits<uint64_t>::max());
+
+    std::mt19937_64 rnd;
+    for (int i = 0; i < 10000; ++i) {
+        check_round_trip<unsigned_vint>(rnd() >> (rnd() % 64));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_signed_vint_round_trip) {
+    BOOST_REQUIRE_EQUAL(signed_vint::serialized_size(-1), 1);
+    BOOST_REQUIRE_EQUAL(signed_vint::serialized_size(-64), 1);
+    BOOST_REQUIRE_EQUAL(signed_vint::serialized_size(-65), 2);
+    check_round_trip<signed_vint>(0);
+    check_round_trip<signed_vint>(std::numeric_limits<int64_t>::min());
+    check_round_trip<signed_vint>(std::numeric_limits<int64_t>::max());
+
+    std::mt19937_64 rnd;
+    for (int i = 0; i < 10000; ++i) {
+        check_round_trip<signed_vint>(int64_t(rnd()) >> (rnd() % 64));
+    }
+}
@@ -219,3 +219,41 @@ SEASTAR_TEST_CASE(test_query_virtual_table) {
         }).discard_result();
     });
 }
+
+SEASTAR_TEST_CASE(test_size_estimates_follow_sstables) {
+    return do_with_cql_env_thread([] (cql_test_env& e) {
+        auto& qp = e.local_qp();
+        e.execute_cql("create table cf(pk int PRIMARY KEY, v int);").get();
+
+        auto insert_and_flush = [&] {
+            for (int i = 0; i < 1000; ++i) {
+                e.execute_cql(sprint("insert into cf (pk, v) values (%d, %d);", i, i)).get();
+            }
+            e.db().invoke_on_all([] (database& db) {
+                return db.find_column_family("ks", "cf").flush();
+            }).get();
+        };
+        auto total_partitions = [&] {
+            auto rs = qp.execute_internal("select partitions_count, mean_partition_size from system.size_estimates "
+                                          "where keyspace_name = 'ks' and table_name = 'cf';").get0();
+            int64_t total = 0;
+            for (auto& row : *rs) {
+                total += row.get_as<int64_t>("partitions_count");
+                if (row.get_as<int64_t>("partitions_count")) {
+                    BOOST_REQUIRE_GT(row.get_as<int64_t>("mean_partition_size"), 0);
+                }
+            }
+            return total;
+        };
+
+        BOOST_REQUIRE_EQUAL(total_partitions(), 0);
+
+        insert_and_flush();
+        auto partitions = total_partitions();
+        BOOST_REQUIRE_GT(partitions, 0);
+
+        // The same partitions in a second sstable aren't counted twice.
+        insert_and_flush();
+        BOOST_REQUIRE_EQUAL(total_partitions(), partitions);
+    });
+}
@@ -1863,30 +1863,29 @@ class thrift_handler : public CassandraCobSvIf {
         }
     }
     using mutation_map = std::map<std::string, std::map<std::string, std::vector<Mutation>>>;
-    using mutation_map_by_cf = std::unordered_map<std::string, std::unordered_map<std::string, std::vector<Mutation>>>;
-    static mutation_map_by_cf group_by_cf(mutation_map& m) {
-        mutation_map_by_cf ret;
-        for (auto&& key_cf : m) {
-            for (auto&& cf_mutations : key_cf.second) {
-                auto& mutations = ret[std::move(cf_mutations.first)][std::move(key_cf.first)];
-                std::move(cf_mutations.second.begin(), cf_mutations.second.end(), std::back_inserter(mutations));
-            }
-        }
-        return ret;
-    }
+    // The map has a single entry for each key and table, so each entry makes
+    // a mutation of its own, without regrouping the request by table. The
+    // cells are copied once, from the request into the mutations.
     static std::pair<std::vector<mutation>, std::vector<schema_ptr>> prepare_mutations(database& db, const sstring& ks_name, const mutation_map& m) {
         std::vector<mutation> muts;
         std::vector<schema_ptr> schemas;
-        auto m_by_cf = group_by_cf(const_cast<mutation_map&>(m));
-        for (auto&& cf_key : m_by_cf) {
-            auto schema = lookup_schema(db, ks_name, cf_key.first);
-            if (schema->is_view()) {
-                throw make_exception<InvalidRequestException>("Cannot modify Materialized Views directly");
-            }
-            schemas.emplace_back(schema);
-            for (auto&& key_mutations : cf_key.second) {
-                mutation m_to_apply(key_from_thrift(*schema, to_bytes_view(key_mutations.first)), schema);
-                for (auto&& m : key_mutations.second) {
+        std::unordered_map<stdx::string_view, schema_ptr> schema_by_name;
+        muts.reserve(std::accumulate(m.begin(), m.end(), size_t(0), [] (size_t acc, auto&& key_cf) {
+            return acc + key_cf.second.size();
+        }));
+        for (auto&& key_cf : m) {
+            auto key = to_bytes_view(key_cf.first);
+            for (auto&& cf_mutations : key_cf.second) {
+                auto& schema = schema_by_name[cf_mutations.first];
+                if (!schema) {
+                    schema = lookup_schema(db, ks_name, cf_mutations.first);
+                    if (schema->is_view()) {
+                        throw make_exception<InvalidRequestException>("Cannot modify Materialized Views directly");
+                    }
+                    schemas.emplace_back(schema);
+                }
+                mutation m_to_apply(key_from_thrift(*schema, key), schema);
+                for (auto&& m : cf_mutations.second) {
                     add_to_mutation(*schema, m, m_to_apply);
                 }
                 muts.emplace_back(std::move(m_to_apply));
@@ -43,7 +43,8 @@
 #include "tracing/trace_keyspace_helper.hh"
 #include "service/migration_manager.hh"
 #include "cql3/statements/create_table_statement.hh"
-#include "cql3/statements/batch_statement.hh"
+#include "service/storage_proxy.hh"
+#include <boost/iterator/counting_iterator.hpp>
 
 namespace tracing {
 
@@ -59,7 +60,6 @@ const sstring trace_keyspace_helper::NODE_SLOW_QUERY_LOG_TIME_IDX("node_slow_log
 
 struct trace_keyspace_backend_sesssion_state final : public backend_session_state_base {
     int64_t last_nanos = 0;
-    semaphore write_sem {1};
     virtual ~trace_keyspace_backend_sesssion_state() {}
 };
 
@@ -252,10 +252,39 @@ future<> trace_keyspace_helper::start() {
     }
 }
 
-void trace_keyspace_helper::write_one_session_records(lw_shared_ptr<one_session_records> records) {
-    with_gate(_pending_writes, [this, records = std::move(records)] {
-        auto num_records = records->size();
-        return this->flush_one_session_mutations(std::move(records)).finally([this, num_records] { _local_tracing.write_complete(num_records); });
+void trace_keyspace_helper::write_records_bulk(records_bulk& bulk) {
+    tlogger.trace("Writing {} sessions", bulk.size());
+
+    // Grab the records available so far, all new data will have to be
+    // handled in the next write event.
+    std::vector<session_writes> sessions;
+    sessions.reserve(bulk.size());
+    uint64_t num_records = 0;
+    for (auto& records : bulk) {
+        num_records += records->size();
+        // Check if a session's record is ready before handling events' records.
+        //
+        // New event's records and a session's record may become ready while a
+        // mutation with the current events' records is being written. We don't want
+        // to allow the situation when a session's record is written before the last
+        // event record from the same session.
+        bool session_record_is_ready = records->session_rec.ready();
+        auto events = std::move(records->events_recs);
+        records->events_recs.clear();
+        records->data_consumed();
+        sessions.push_back(session_writes{std::move(records), std::move(events), session_record_is_ready});
+    }
+
+    with_gate(_pending_writes, [this, sessions = std::move(sessions), num_records] () mutable {
+        // The bulks are written one after the other, so that the events of a
+        // session are written before its session's record, and bulks which
+        // can't be written fast enough leave records pending, so that new
+        // ones are dropped rather than piled up.
+        return with_semaphore(_write_sem, 1, [this, sessions = std::move(sessions)] () mutable {
+            return do_with(std::move(sessions), [this] (std::vector<session_writes>& sessions) {
+                return flush_bulk_mutations(sessions);
+            });
+        }).finally([this, num_records] { _local_tracing.write_complete(num_records); });
     }).handle_exception([this] (auto ep) {
         try {
             ++_stats.tracing_errors;
@@ -274,14 +303,7 @@ void trace_keyspace_helper::write_one_session_records(lw_shared_ptr<one_session_
     }).discard_result();
 }
 
-void trace_keyspace_helper::write_records_bulk(records_bulk& bulk) {
-    tlogger.trace("Writing {} sessions", bulk.size());
-    std::for_each(bulk.begin(), bulk.end(), [this] (records_bulk::value_type& one_session_records_ptr) {
-        write_one_session_records(std::move(one_session_records_ptr));
-    });
-}
-
-cql3::query_options trace_keyspace_helper::make_session_mutation_data(const one_session_records& session_records) {
+std::vector<cql3::raw_value> trace_keyspace_helper::make_session_mutation_data(const one_session_records& session_records) {
     const session_record& record = session_records.session_rec;
     auto millis_since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(record.started_at.time_since_epoch()).count();
     std::vector<std::pair<data_value, data_value>> parameters_values_vector;
@@ -301,10 +323,10 @@ cql3::query_options trace_keyspace_helper::make_session_mutation_data(const one_
         cql3::raw_value::make_value(int32_type->decompose((int32_t)(session_records.ttl.count())))
     };
 
-    return cql3::query_options(db::consistency_level::ANY, std::experimental::nullopt, std::move(values), false, cql3::query_options::specific_options::DEFAULT, cql_serialization_format::latest());
+    return values;
 }
 
-cql3::query_options trace_keyspace_helper::make_session_time_idx_mutation_data(const one_session_records& session_records) {
+std::vector<cql3::raw_value> trace_keyspace_helper::make_session_time_idx_mutation_data(const one_session_records& session_records) {
     auto started_at_duration = session_records.session_rec.started_at.time_since_epoch();
     // timestamp in minutes when the query began
     auto minutes_in_millis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration_cast<std::chrono::minutes>(started_at_duration)).count();
@@ -318,10 +340,10 @@ cql3::query_options trace_keyspace_helper::make_session_time_idx_mutation_data(c
         cql3::raw_value::make_value(int32_type->decompose(int32_t(session_records.ttl.count())))
     };
 
-    return cql3::query_options(db::consistency_level::ANY, std::experimental::nullopt, std::move(values), false, cql3::query_options::specific_options::DEFAULT, cql_serialization_format::latest());
+    return values;
 }
 
-cql3::query_options trace_keyspace_helper::make_slow_query_mutation_data(const one_session_records& session_records, const utils::UUID& start_time_id) {
+std::vector<cql3::raw_value> trace_keyspace_helper::make_slow_query_mutation_data(const one_session_records& session_records, const utils::UUID& start_time_id) {
     const session_record& record = session_records.session_rec;
     auto millis_since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(record.started_at.time_since_epoch()).count();
 
@@ -358,10 +380,10 @@ cql3::query_options trace_keyspace_helper::make_slow_query_mutation_data(const o
         cql3::raw_value::make_value(int32_type->decompose((int32_t)(record.slow_query_record_ttl.count())))
     });
 
-    return cql3::query_options(db::consistency_level::ANY, std::experimental::nullopt, std::move(values), false, cql3::query_options::specific_options::DEFAULT, cql_serialization_format::latest());
+    return values;
 }
 
-cql3::query_options trace_keyspace_helper::make_slow_query_time_idx_mutation_data(const one_session_records& session_records, const utils::UUID& start_time_id) {
+std::vector<cql3::raw_value> trace_keyspace_helper::make_slow_query_time_idx_mutation_data(const one_session_records& session_records, const utils::UUID& start_time_id) {
     auto started_at_duration = session_records.session_rec.started_at.time_since_epoch();
     // timestamp in minutes when the query began
     auto minutes_in_millis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration_cast<std::chrono::minutes>(started_at_duration)).count();
@@ -378,7 +400,7 @@ cql3::query_options trace_keyspace_helper::make_slow_query_time_idx_mutation_dat
         cql3::raw_value::make_value(int32_type->decompose(int32_t(session_records.session_rec.slow_query_record_ttl.count())))
     });
 
-    return cql3::query_options(db::consistency_level::ANY, std::experimental::nullopt, std::move(values), false, cql3::query_options::specific_options::DEFAULT, cql_serialization_format::latest());
+    return values;
 }
 
 std::vector<cql3::raw_value> trace_keyspace_helper::make_event_mutation_data(one_session_records& session_records, const event_record& record) {
@@ -399,79 +421,86 @@ std::vector<cql3::raw_value> trace_keyspace_helper::make_event_mutation_data(one
     return values;
 }
 
-future<> trace_keyspace_helper::apply_events_mutation(lw_shared_ptr<one_session_records> records, std::deque<event_record>& events_records) {
-    if (events_records.empty()) {
+future<> trace_keyspace_helper::apply_insertions(std::vector<shared_ptr<cql3::statements::modification_statement>> modifications, std::vector<std::vector<cql3::raw_value>> values) {
+    if (modifications.empty()) {
         return now();
     }
 
-    return _events.cache_table_info().then([this, records, &events_records] {
-        tlogger.trace("{}: storing {} events records: parent_id {} span_id {}", records->session_id, events_records.size(), records->parent_id, records->my_span_id);
-
-        std::vector<shared_ptr<cql3::statements::modification_statement>> modifications(events_records.size(), _events.insert_stmt());
-        std::vector<std::vector<cql3::raw_value>> values;
-        auto& qp = cql3::get_local_query_processor();
-
-        values.reserve(events_records.size());
-        std::for_each(events_records.begin(), events_records.end(), [&values, all_records = records, this] (event_record& one_event_record) { values.emplace_back(make_event_mutation_data(*all_records, one_event_record)); });
-
-        return do_with(
-            cql3::query_options::make_batch_options(cql3::query_options(db::consistency_level::ANY, std::experimental::nullopt, std::vector<cql3::raw_value>{}, false, cql3::query_options::specific_options::DEFAULT, cql_serialization_format::latest()), std::move(values)),
-            cql3::statements::batch_statement(cql3::statements::batch_statement::type::UNLOGGED, std::move(modifications), cql3::attributes::none(), qp.get_cql_stats()),
-            [this] (auto& batch_options, auto& batch) {
-                return batch.execute(service::get_storage_proxy(), _dummy_query_state, batch_options).then([] (shared_ptr<cql_transport::messages::result_message> res) { return now(); });
-            }
-        );
+    // Not a batch statement, which would warn about, or refuse, the size of
+    // a bulk of trace records. The records of the same partition, like the
+    // events of a session, come one after the other.
+    auto timestamp = api::new_timestamp();
+    return do_with(std::move(modifications), std::move(values), std::vector<mutation>(), [timestamp] (auto& modifications, auto& values, auto& mutations) {
+        return do_for_each(boost::make_counting_iterator<size_t>(0), boost::make_counting_iterator<size_t>(modifications.size()), [&, timestamp] (size_t i) {
+            auto opts = make_lw_shared<cql3::query_options>(db::consistency_level::ANY, std::experimental::nullopt, std::move(values[i]), false, cql3::query_options::specific_options::DEFAULT, cql_serialization_format::latest());
+            return modifications[i]->get_mutations(service::get_storage_proxy(), *opts, false, timestamp, nullptr).then([&mutations, opts] (std::vector<mutation> ms) {
+                for (auto&& m : ms) {
+                    if (!mutations.empty() && mutations.back().schema()->id() == m.schema()->id() && mutations.back().key().equal(*m.schema(), m.key())) {
+                        mutations.back().apply(std::move(m));
+                    } else {
+                        mutations.emplace_back(std::move(m));
+                    }
+                }
+            });
+        }).then([&mutations] {
+            return service::get_local_storage_proxy().mutate(std::move(mutations), db::consistency_level::ANY, nullptr);
+        });
     });
 }
 
-future<> trace_keyspace_helper::flush_one_session_mutations(lw_shared_ptr<one_session_records> records) {
-    // grab events records available so far
-    return do_with(std::move(records->events_recs), [this, records] (std::deque<event_record>& events_records) {
-        records->events_recs.clear();
-
-        // Check if a session's record is ready before handling events' records.
-        //
-        // New event's records and a session's record may become ready while a
-        // mutation with the current events' records is being written. We don't want
-        // to allow the situation when a session's record is written before the last
-        // event record from the same session.
-        bool session_record_is_ready = records->session_rec.ready();
-
-        // From this point on - all new data will have to be handled in the next write event
-        records->data_consumed();
+future<> trace_keyspace_helper::flush_bulk_mutations(std::vector<session_writes>& sessions) {
+    bool log_slow_queries = std::any_of(sessions.begin(), sessions.end(), [] (const session_writes& sw) {
+        return sw.session_record_is_ready && sw.records->do_log_slow_query;
+    });
 
-        // We want to serialize the creation of events mutations in order to ensure
-        // that mutations for events that were created first are going to be
-        // created first too.
-        auto backend_state_ptr = static_cast<trace_keyspace_backend_sesssion_state*>(records->backend_state_ptr.get());
-        semaphore& write_sem = backend_state_ptr->write_sem;
-        return with_semaphore(write_sem, 1, [this, records, session_record_is_ready, &events_records] {
-            return apply_events_mutation(records, events_records).then([this, session_record_is_ready, records] {
-                if (session_record_is_ready) {
-
-                    // if session is finished - store a session and a session time index entries
-                    tlogger.trace("{}: going to store a session event", records->session_id);
-                    return _sessions.insert(make_session_mutation_data, *records).then([this, records] {
-                        tlogger.trace("{}: going to store a {} entry", records->session_id, _sessions_time_idx.name());
-                        return _sessions_time_idx.insert(make_session_time_idx_mutation_data, *records);
-                    }).then([this, records] {
-                        if (!records->do_log_slow_query) {
-                            return now();
-                        }
-
-                        // if slow query log is requested - store a slow query log and a slow query log time index entries
-                        auto start_time_id = utils::UUID_gen::get_time_UUID(make_monotonic_UUID_tp(_slow_query_last_nanos, records->session_rec.started_at));
-                        tlogger.trace("{}: going to store a slow query event", records->session_id);
-                        return _slow_query_log.insert(make_slow_query_mutation_data, *records, start_time_id).then([this, records, start_time_id] {
-                            tlogger.trace("{}: going to store a {} entry", records->session_id, _slow_query_log_time_idx.name());
-                            return _slow_query_log_time_idx.insert(make_slow_query_time_idx_mutation_data, *records, start_time_id);
-                        });
-                    });
-                } else {
-                    return now();
-                }
-            });
-        }).finally([records] {});
+    return _events.cache_table_info().then([this] {
+        return _sessions.cache_table_info();
+    }).then([this] {
+        return _sessions_time_idx.cache_table_info();
+    }).then([this, log_slow_queries] {
+        if (!log_slow_queries) {
+            return now();
+        }
+        return _slow_query_log.cache_table_info().then([this] {
+            return _slow_query_log_time_idx.cache_table_info();
+        });
+    }).then([this, &sessions] {
+        // The events of all sessions, in a single write
+        std::vector<shared_ptr<cql3::statements::modification_statement>> modifications;
+        std::vector<std::vector<cql3::raw_value>> values;
+        for (auto& sw : sessions) {
+            tlogger.trace("{}: storing {} events records: parent_id {} span_id {}", sw.records->session_id, sw.events.size(), sw.records->parent_id, sw.records->my_span_id);
+            for (auto& one_event_record : sw.events) {
+                modifications.emplace_back(_events.insert_stmt());
+                values.emplace_back(make_event_mutation_data(*sw.records, one_event_record));
+            }
+        }
+        return apply_insertions(std::move(modifications), std::move(values));
+    }).then([this, &sessions] {
+        // ...and then the records of the sessions which are finished, and
+        // their index and slow query log entries, in another one.
+        std::vector<shared_ptr<cql3::statements::modification_statement>> modifications;
+        std::vector<std::vector<cql3::raw_value>> values;
+        auto add = [&] (const table_helper& t, std::vector<cql3::raw_value> v) {
+            modifications.emplace_back(t.insert_stmt());
+            values.emplace_back(std::move(v));
+        };
+        for (auto& sw : sessions) {
+            if (!sw.session_record_is_ready) {
+                continue;
+            }
+            auto& records = *sw.records;
+            tlogger.trace("{}: going to store a session event", records.session_id);
+            add(_sessions, make_session_mutation_data(records));
+            add(_sessions_time_idx, make_session_time_idx_mutation_data(records));
+            if (records.do_log_slow_query) {
+                auto start_time_id = utils::UUID_gen::get_time_UUID(make_monotonic_UUID_tp(_slow_query_last_nanos, records.session_rec.started_at));
+                tlogger.trace("{}: going to store a slow query event", records.session_id);
+                add(_slow_query_log, make_slow_query_mutation_data(records, start_time_id));
+                add(_slow_query_log_time_idx, make_slow_query_time_idx_mutation_data(records, start_time_id));
+            }
+        }
+        return apply_insertions(std::move(modifications), std::move(values));
     });
 }
 
@@ -67,6 +67,7 @@ class trace_keyspace_helper final : public i_tracing_backend_helper {
     static constexpr int bad_column_family_message_period = 10000;
 
     seastar::gate _pending_writes;
+    semaphore _write_sem{1};
     int64_t _slow_query_last_nanos = 0;
     service::query_state _dummy_query_state;
 
@@ -119,24 +120,6 @@ class trace_keyspace_helper final : public i_tracing_backend_helper {
         shared_ptr<cql3::statements::modification_statement> insert_stmt() const {
             return _insert_stmt;
         }
-
-        /**
-         * Execute a single insertion into the table.
-         *
-         * @tparam OptMaker cql_options maker functor type
-         * @tparam Args OptMaker arguments' types
-         * @param opt_maker cql_options maker functor
-         * @param opt_maker_args opt_maker arguments
-         */
-        template <typename OptMaker, typename... Args>
-        GCC6_CONCEPT( requires seastar::CanApply<OptMaker, Args...> )
-        future<> insert(OptMaker opt_maker, Args&&... opt_maker_args) {
-            return cache_table_info().then([this, opt_maker = std::move(opt_maker), args = std::forward_as_tuple(std::forward<Args>(opt_maker_args)...)] () mutable {
-                return do_with(apply(opt_maker, std::move(args)), [this] (auto& opts) {
-                    return _insert_stmt->execute(service::get_storage_proxy(), _ks_helper.get_dummy_qs(), opts);
-                });
-            }).discard_result();
-        }
     };
 
     table_helper _sessions;
@@ -152,6 +135,13 @@ class trace_keyspace_helper final : public i_tracing_backend_helper {
 
     seastar::metrics::metric_groups _metrics;
 
+    // The records of a session taken for a write.
+    struct session_writes {
+        lw_shared_ptr<one_session_records> records;
+        std::deque<event_record> events;
+        bool session_record_is_ready;
+    };
+
 public:
     trace_keyspace_helper(tracing& tr);
     virtual ~trace_keyspace_helper() {}
@@ -173,13 +163,6 @@ class trace_keyspace_helper final : public i_tracing_backend_helper {
     service::query_state& get_dummy_qs() { return _dummy_query_state; }
 
 private:
-    /**
-     * Write records of a single tracing session
-     *
-     * @param records records to write
-     */
-    void write_one_session_records(lw_shared_ptr<one_session_records> records);
-
     /**
      * Makes a monotonically increasing value in 100ns ("nanos") based on the given time
      * stamp and the "nanos" value of the previous event.
@@ -207,50 +190,48 @@ class trace_keyspace_helper final : public i_tracing_backend_helper {
     }
 
     /**
-     * Flush mutations of one particular tracing session. First "events"
-     * mutations and then, when they are complete, a "sessions" mutation.
-     *
-     * @note This function guaranties that it'll handle exactly the same number
-     * of records @param records had when the function was invoked.
+     * Flush mutations of the sessions of a bulk. First the "events" mutations
+     * of all of them, in a single write, and then, when they are complete,
+     * the "sessions" mutations of the finished ones, in another.
      *
-     * @param records records describing the session's records
+     * @param sessions the records taken for the write
      *
      * @return A future that resolves when applying of above mutations is
      *         complete.
+     *
+     * @note A caller must ensure that @param sessions is alive till the
+     * returned future resolves.
      */
-    future<> flush_one_session_mutations(lw_shared_ptr<one_session_records> records);
+    future<> flush_bulk_mutations(std::vector<session_writes>& sessions);
 
     /**
-     * Apply events records mutations.
-     *
-     * @param records all session records
-     * @param events_records events recods to apply
-     * @param start_point a time point when this tracing session data writing has started
+     * Apply the given insertions with a single write, merging those to the
+     * same partition.
      *
-     * @return a future that resolves when the mutation has been written.
+     * @param modifications INSERT statements
+     * @param values the values of each of the statements
      *
-     * @note A caller must ensure that @param events_records is alive till the
-     * returned future resolves.
+     * @return a future that resolves when the mutations have been written.
      */
-    future<> apply_events_mutation(lw_shared_ptr<one_session_records> records, std::deque<event_record>& events_records);
+    future<> apply_insertions(std::vector<shared_ptr<cql3::statements::modification_statement>> modifications, std::vector<std::vector<cql3::raw_value>> values);
 
     /**
      * Create a mutation data for a new session record
      *
      * @param all_records_handle handle to access an object with all records of this session
      *
-     * @return the relevant cql3::query_options object with the mutation data
+     * @return a vector with the mutation data
      */
-    static cql3::query_options make_session_mutation_data(const one_session_records& all_records_handle);
+    static std::vector<cql3::raw_value> make_session_mutation_data(const one_session_records& all_records_handle);
 
     /**
      * Create a mutation data for a new session_idx record
      *
      * @param all_records_handle handle to access an object with all records of this session
      *
-     * @return the relevant cql3::query_options object with the mutation data
+     * @return a vector with the mutation data
      */
-    static cql3::query_options make_session_time_idx_mutation_data(const one_session_records& all_records_handle);
+    static std::vector<cql3::raw_value> make_session_time_idx_mutation_data(const one_session_records& all_records_handle);
 
     /**
      * Create mutation for a new slow_query_log record
@@ -258,9 +239,9 @@ class trace_keyspace_helper final : public i_tracing_backend_helper {
      * @param all_records_handle handle to access an object with all records of this session
      * @param start_time_id time UUID generated from the query start time
      *
-     * @return the relevant mutation
+     * @return a vector with the mutation data
      */
-    static cql3::query_options make_slow_query_mutation_data(const one_session_records& all_records_handle, const utils::UUID& start_time_id);
+    static std::vector<cql3::raw_value> make_slow_query_mutation_data(const one_session_records& all_records_handle, const utils::UUID& start_time_id);
 
     /**
      * Create mutation for a new slow_query_log_time_idx record
@@ -268,9 +249,9 @@ class trace_keyspace_helper final : public i_tracing_backend_helper {
      * @param all_records_handle handle to access an object with all records of this session
      * @param start_time_id time UUID generated from the query start time
      *
-     * @return the relevant mutation
+     * @return a vector with the mutation data
      */
-    static cql3::query_options make_slow_query_time_idx_mutation_data(const one_session_records& all_records_handle, const utils::UUID& start_time_id);
+    static std::vector<cql3::raw_value> make_slow_query_time_idx_mutation_data(const one_session_records& all_records_handle, const utils::UUID& start_time_id);
 
     /**
      * Create a mutation data for a new trace point record
@@ -25,7 +25,6 @@
 #include <boost/range/irange.hpp>
 #include <boost/bimap.hpp>
 #include <boost/assign.hpp>
-#include <boost/locale/encoding_utf.hpp>
 #include <boost/range/adaptor/sliced.hpp>
 
 #include "cql3/statements/batch_statement.hh"
@@ -36,7 +35,9 @@
 #include "core/future-util.hh"
 #include "core/reactor.hh"
 #include "utils/UUID.hh"
+#include "utils/utf8.hh"
 #include "database.hh"
+#include "dht/i_partitioner.hh"
 #include "net/byteorder.hh"
 #include <seastar/core/metrics.hh>
 #include <seastar/net/byteorder.hh>
@@ -225,6 +226,8 @@ class cql_server::response {
     void write_string_map(std::map<sstring, sstring> string_map);
     void write_string_multimap(std::multimap<sstring, sstring> string_map);
     void write_value(bytes_opt value);
+    // Appends already serialized values.
+    void write(const bytes_ostream& out);
     void write(const cql3::metadata& m, bool skip = false);
     void write(const cql3::prepared_metadata& m, uint8_t version);
     future<> output(output_stream<char>& out, uint8_t version, cql_compression compression);
@@ -263,13 +266,16 @@ class cql_server::response {
     }
 };
 
-cql_server::cql_server(distributed<service::storage_proxy>& proxy, distributed<cql3::query_processor>& qp, cql_load_balance lb)
+cql_server::cql_server(distributed<service::storage_proxy>& proxy, distributed<cql3::query_processor>& qp, cql_load_balance lb,
+        std::chrono::microseconds max_flush_delay, lowres_clock::duration max_queue_time)
     : _proxy(proxy)
     , _query_processor(qp)
     , _max_request_size(memory::stats().total_memory() / 10)
     , _memory_available(_max_request_size)
     , _notifier(std::make_unique<event_notifier>())
     , _lb(lb)
+    , _max_flush_delay(max_flush_delay)
+    , _max_queue_time(max_queue_time)
 {
     namespace sm = seastar::metrics;
 
@@ -290,6 +296,9 @@ cql_server::cql_server(distributed<service::storage_proxy>& proxy, distributed<c
                         sm::description(
                             seastar::format("Holds a number of requests that are blocked due to reaching the memory quota limit ({}B). "
                                             "Non-zero value indicates that our bottleneck is memory and more specifically - the memory quota allocated for the \"CQL transport\" component.", _max_request_size))),
+
+        sm::make_derive("requests_shed", _requests_shed,
+                        sm::description("Counts a number of requests answered with OVERLOADED, because they waited for the memory quota for longer than native_transport_max_queue_time_in_ms.")),
     });
 }
 
@@ -315,9 +324,15 @@ future<> cql_server::stop() {
 }
 
 future<>
-cql_server::listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> creds, bool keepalive) {
+cql_server::listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> creds, bool keepalive, bool is_shard_aware) {
     listen_options lo;
     lo.reuse_address = true;
+    if (is_shard_aware) {
+        // Shard = client port % smp::count, so that drivers pick the shard
+        // they connect to by choosing their source port.
+        lo.lba = server_socket::load_balancing_algorithm::port;
+        _shard_aware_port = addr.port;
+    }
     server_socket ss;
     try {
         ss = creds
@@ -641,7 +656,17 @@ future<> cql_server::connection::process_request() {
                     f.length, mem_estimate, _server._max_request_size));
         }
 
-        return get_units(_server._memory_available, mem_estimate).then([this, length = f.length, flags = f.flags, op, stream, tracing_requested] (semaphore_units<> mem_permit) {
+        auto queued_at = lowres_clock::now();
+        return get_units(_server._memory_available, mem_estimate).then([this, length = f.length, flags = f.flags, op, stream, tracing_requested, queued_at] (semaphore_units<> mem_permit) {
+          if (_server._max_queue_time.count() && lowres_clock::now() - queued_at > _server._max_queue_time) {
+              // The client has probably given up on it already, and the
+              // work would only delay the requests queued behind.
+              ++_server._requests_shed;
+              return _read_buf.read_exactly(length).then([this, stream, mem_permit = std::move(mem_permit)] (temporary_buffer<char>) {
+                  return this->write_response(make_error(stream, exceptions::exception_code::OVERLOADED,
+                          "Request shed: the node is overloaded", tracing::trace_state_ptr()), _compression);
+              });
+          }
           return this->read_and_decompress_frame(length, flags).then([this, flags, op, stream, tracing_requested, mem_permit = std::move(mem_permit)] (temporary_buffer<char> buf) mutable {
 
             ++_server._requests_served;
@@ -1080,6 +1105,16 @@ shared_ptr<cql_server::response> cql_server::connection::make_supported(int16_t
     opts.insert({"CQL_VERSION", cql3::query_processor::CQL_VERSION});
     opts.insert({"COMPRESSION", "lz4"});
     opts.insert({"COMPRESSION", "snappy"});
+    // Lets drivers route each request to the connection of the shard owning its token.
+    auto& partitioner = dht::global_partitioner();
+    opts.insert({"SCYLLA_SHARD", sprint("%d", engine().cpu_id())});
+    opts.insert({"SCYLLA_NR_SHARDS", sprint("%d", smp::count)});
+    opts.insert({"SCYLLA_PARTITIONER", partitioner.name()});
+    opts.insert({"SCYLLA_SHARDING_ALGORITHM", "biased-token-round-robin"});
+    opts.insert({"SCYLLA_SHARDING_IGNORE_MSB", sprint("%d", partitioner.sharding_ignore_msb())});
+    if (_server._shard_aware_port) {
+        opts.insert({"SCYLLA_SHARD_AWARE_PORT", sprint("%d", _server._shard_aware_port)});
+    }
     auto response = make_shared<cql_server::response>(stream, cql_binary_opcode::SUPPORTED, tr_state);
     response->write_string_multimap(opts);
     return response;
@@ -1134,6 +1169,10 @@ class cql_server::fmt_visitor : public messages::result_message::visitor_base {
         auto& rs = m.rs();
         _response->write(rs.get_metadata(), _skip_metadata);
         _response->write_int(rs.size());
+        if (auto serialized = rs.serialized_rows()) {
+            _response->write(*serialized);
+            return;
+        }
         for (auto&& row : rs.rows()) {
             for (auto&& cell : row | boost::adaptors::sliced(0, rs.get_metadata().column_count())) {
                 _response->write_value(cell);
@@ -1182,16 +1221,48 @@ cql_server::connection::make_schema_change_event(const event::schema_change& eve
 
 future<> cql_server::connection::write_response(foreign_ptr<shared_ptr<cql_server::response>>&& response, cql_compression compression)
 {
+    ++_responses_to_write;
     _ready_to_respond = _ready_to_respond.then([this, compression, response = std::move(response)] () mutable {
         return do_with(std::move(response), [this, compression] (auto& response) {
-            return response->output(_write_buf, _version, compression).then([this] {
-                return _write_buf.flush();
-            });
+            return response->output(_write_buf, _version, compression);
+        }).then([this] {
+            --_responses_to_write;
+            return flush_responses();
         });
     });
     return make_ready_future<>();
 }
 
+// Pipelined requests complete in bursts. Rather than flushing the response
+// of each, which costs a syscall and a packet, responses written in the same
+// poll period are flushed together, unless the first of them has waited for
+// _max_flush_delay already. output_stream sends them in one vectored write.
+future<> cql_server::connection::flush_responses()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (!_has_unflushed_responses) {
+        _has_unflushed_responses = true;
+        _unflushed_since = now;
+    }
+    auto flush = [this] {
+        _has_unflushed_responses = false;
+        return _write_buf.flush();
+    };
+    if (now - _unflushed_since >= _server._max_flush_delay) {
+        return flush();
+    }
+    if (_responses_to_write) {
+        // The last of the queued responses flushes.
+        return make_ready_future<>();
+    }
+    return later().then([this, flush] {
+        if (_responses_to_write) {
+            return make_ready_future<>();
+        }
+        return flush();
+    });
+}
+
 void cql_server::connection::check_room(bytes_view& buf, size_t n)
 {
     if (buf.size() < n) {
@@ -1201,9 +1272,7 @@ void cql_server::connection::check_room(bytes_view& buf, size_t n)
 
 void cql_server::connection::validate_utf8(sstring_view s)
 {
-    try {
-        boost::locale::conv::utf_to_utf<char>(s.begin(), s.end(), boost::locale::conv::stop);
-    } catch (const boost::locale::conv::conversion_error& ex) {
+    if (!utils::utf8::validate(reinterpret_cast<const uint8_t*>(s.data()), s.size())) {
         throw exceptions::protocol_exception("Cannot decode string as UTF8");
     }
 }
@@ -1719,6 +1788,14 @@ void cql_server::response::write_string_multimap(std::multimap<sstring, sstring>
     }
 }
 
+void cql_server::response::write(const bytes_ostream& out)
+{
+    _body.reserve(_body.size() + out.size());
+    for (auto&& f : out.fragments()) {
+        _body.insert(_body.end(), f.begin(), f.end());
+    }
+}
+
 void cql_server::response::write_value(bytes_opt value)
 {
     if (!value) {
@@ -117,9 +117,20 @@ class cql_server {
     uint64_t _requests_served = 0;
     uint64_t _requests_serving = 0;
     cql_load_balance _lb;
+    // The port on which connections are handed to the shard selected by the
+    // source port of the client, advertised in SUPPORTED; 0 if none.
+    uint16_t _shard_aware_port = 0;
+    // How long responses may wait for others to be flushed with them.
+    std::chrono::microseconds _max_flush_delay;
+    // Requests waiting longer than this for _memory_available are answered
+    // with OVERLOADED without being processed; 0 if they are never shed.
+    lowres_clock::duration _max_queue_time;
+    uint64_t _requests_shed = 0;
 public:
-    cql_server(distributed<service::storage_proxy>& proxy, distributed<cql3::query_processor>& qp, cql_load_balance lb);
-    future<> listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> = {}, bool keepalive = false);
+    cql_server(distributed<service::storage_proxy>& proxy, distributed<cql3::query_processor>& qp, cql_load_balance lb,
+            std::chrono::microseconds max_flush_delay = std::chrono::microseconds(0),
+            lowres_clock::duration max_queue_time = lowres_clock::duration(0));
+    future<> listen(ipv4_addr addr, std::shared_ptr<seastar::tls::credentials_builder> = {}, bool keepalive = false, bool is_shard_aware = false);
     future<> do_accepts(int which, bool keepalive, ipv4_addr server_addr);
     future<> stop();
 public:
@@ -136,6 +147,10 @@ class cql_server {
         output_stream<char> _write_buf;
         seastar::gate _pending_requests_gate;
         future<> _ready_to_respond = make_ready_future<>();
+        // Responses queued on _ready_to_respond but not written yet.
+        unsigned _responses_to_write = 0;
+        bool _has_unflushed_responses = false;
+        std::chrono::steady_clock::time_point _unflushed_since;
         cql_protocol_version_type _version = 0;
         cql_compression _compression = cql_compression::none;
         cql_serialization_format _cql_serialization_format = cql_serialization_format::latest();
@@ -195,6 +210,7 @@ class cql_server {
         shared_ptr<cql_server::response> make_auth_challenge(int16_t, bytes, const tracing::trace_state_ptr& tr_state);
 
         future<> write_response(foreign_ptr<shared_ptr<cql_server::response>>&& response, cql_compression compression = cql_compression::none);
+        future<> flush_responses();
 
         void check_room(bytes_view& buf, size_t n);
         void validate_utf8(sstring_view s);
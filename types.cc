@@ -27,6 +27,7 @@
 #include "cql3/sets.hh"
 #include "types.hh"
 #include "core/print.hh"
+#include "core/bitops.hh"
 #include "net/ip.hh"
 #include "database.hh"
 #include "utils/serialization.hh"
@@ -41,9 +42,9 @@
 #include <boost/range/numeric.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/c_local_time_adjustor.hpp>
-#include <boost/locale/encoding_utf.hpp>
 #include <boost/multiprecision/cpp_int.hpp>
 #include "utils/big_decimal.hh"
+#include "utils/utf8.hh"
 #include "utils/date.h"
 #include "mutation_partition.hh"
 
@@ -287,14 +288,12 @@ struct string_type_impl : public concrete_type<sstring> {
     }
     virtual void validate(bytes_view v) const override {
         if (as_cql3_type() == cql3::cql3_type::ascii) {
-            if (std::any_of(v.begin(), v.end(), [] (int8_t b) { return b < 0; })) {
+            if (!utils::ascii::validate(v)) {
                 throw marshal_exception();
             }
         } else {
-            try {
-                boost::locale::conv::utf_to_utf<char>(v.begin(), v.end(), boost::locale::conv::stop);
-            } catch (const boost::locale::conv::conversion_error& ex) {
-                throw marshal_exception(ex.what());
+            if (!utils::utf8::validate(v)) {
+                throw marshal_exception("Validation failed - non-UTF8 character in a UTF8 string");
             }
         }
     }
@@ -597,18 +596,7 @@ struct timeuuid_type_impl : public concrete_type<utils::UUID> {
     }
 private:
     static int compare_bytes(bytes_view o1, bytes_view o2) {
-        auto compare_pos = [&] (unsigned pos, int mask, int ifequal) {
-            int d = (o1[pos] & mask) - (o2[pos] & mask);
-            return d ? d : ifequal;
-        };
-        return compare_pos(6, 0xf,
-            compare_pos(7, 0xff,
-                compare_pos(4, 0xff,
-                    compare_pos(5, 0xff,
-                        compare_pos(0, 0xff,
-                            compare_pos(1, 0xff,
-                                compare_pos(2, 0xff,
-                                    compare_pos(3, 0xff, 0))))))));
+        return timeuuid_compare_timestamps(o1, o2);
     }
     friend class uuid_type_impl;
 };
@@ -1273,6 +1261,50 @@ struct float_type_impl : floating_type_impl<float> {
 };
 
 
+stdx::optional<int64_t> varint_to_int64(bytes_view v) {
+    while (v.size() > 1 && ((v[0] == 0 && v[1] >= 0) || (v[0] == -1 && v[1] < 0))) {
+        v.remove_prefix(1);
+    }
+    if (v.empty() || v.size() > sizeof(int64_t)) {
+        return { };
+    }
+    uint64_t r = int64_t(v[0]);
+    for (auto b : v.substr(1)) {
+        r = (r << 8) | uint8_t(b);
+    }
+    return int64_t(r);
+}
+
+static bool fits_int64(const boost::multiprecision::cpp_int& num) {
+    return num >= std::numeric_limits<int64_t>::min() && num <= std::numeric_limits<int64_t>::max();
+}
+
+// The size of the encoding varint_type_impl produces: the magnitude and a
+// sign bit, so not always the shortest two's complement.
+static size_t int64_varint_size(int64_t v) {
+    uint64_t magnitude = v < 0 ? -uint64_t(v) : uint64_t(v);
+    if (!magnitude) {
+        return 1;
+    }
+    return (72 - count_leading_zeros(magnitude)) / 8;
+}
+
+static size_t hash_varint(int64_t v) {
+    return std::hash<int64_t>()(v);
+}
+
+// Equal decimals hash the same whatever their scale.
+static size_t hash_decimal(int64_t scale, int64_t unscaled) {
+    if (!unscaled) {
+        scale = 0;
+    }
+    while (unscaled && unscaled % 10 == 0) {
+        unscaled /= 10;
+        --scale;
+    }
+    return std::hash<int64_t>()(unscaled) * 31 + std::hash<int64_t>()(scale);
+}
+
 class varint_type_impl : public concrete_type<boost::multiprecision::cpp_int> {
 public:
     varint_type_impl() : concrete_type{varint_type_name} { }
@@ -1285,6 +1317,14 @@ class varint_type_impl : public concrete_type<boost::multiprecision::cpp_int> {
             return;
         }
         auto& num = std::move(num1).get();
+        if (fits_int64(num)) {
+            auto v = num.convert_to<int64_t>();
+            for (auto i = int64_varint_size(v); i > 0; --i) {
+                // Sign extended beyond 8 bytes, which only INT64_MIN needs.
+                *out++ = i > sizeof(int64_t) ? (v < 0 ? -1 : 0) : int8_t(uint64_t(v) >> (8 * (i - 1)));
+            }
+            return;
+        }
         boost::multiprecision::cpp_int pnum = boost::multiprecision::abs(num);
 
         std::vector<uint8_t> b;
@@ -1315,6 +1355,9 @@ class varint_type_impl : public concrete_type<boost::multiprecision::cpp_int> {
         if (!num) {
             return 1;
         }
+        if (fits_int64(num)) {
+            return int64_varint_size(num.convert_to<int64_t>());
+        }
         auto pnum = abs(num);
         return align_up(boost::multiprecision::msb(pnum) + 2, 8u) / 8;
     }
@@ -1325,6 +1368,11 @@ class varint_type_impl : public concrete_type<boost::multiprecision::cpp_int> {
         if (v2.empty()) {
             return 1;
         }
+        auto i1 = varint_to_int64(v1);
+        auto i2 = varint_to_int64(v2);
+        if (i1 && i2) {
+            return *i1 == *i2 ? 0 : *i1 < *i2 ? -1 : 1;
+        }
         auto a = from_value(deserialize(v1));
         auto b = from_value(deserialize(v2));
         return a == b ? 0 : a < b ? -1 : 1;
@@ -1333,6 +1381,10 @@ class varint_type_impl : public concrete_type<boost::multiprecision::cpp_int> {
         return compare(v1, v2) < 0;
     }
     virtual size_t hash(bytes_view v) const override {
+        auto i = varint_to_int64(v);
+        if (i) {
+            return hash_varint(*i);
+        }
         bytes b(v.begin(), v.end());
         return std::hash<sstring>()(to_string(b));
     }
@@ -1340,6 +1392,10 @@ class varint_type_impl : public concrete_type<boost::multiprecision::cpp_int> {
         if (v.empty()) {
             return make_empty();
         }
+        auto i = varint_to_int64(v);
+        if (i) {
+            return make_value(native_type(*i));
+        }
         auto negative = v.front() < 0;
         boost::multiprecision::cpp_int num;
         for (uint8_t b : v) {
@@ -1399,8 +1455,7 @@ class decimal_type_impl : public concrete_type<big_decimal> {
         auto&& bd = std::move(bd1).get();
         auto u = net::hton(bd.scale());
         out = std::copy_n(reinterpret_cast<const char*>(&u), sizeof(int32_t), out);
-        varint_type_impl::native_type unscaled_value = bd.unscaled_value();
-        varint_type->serialize(&unscaled_value, out);
+        varint_type->serialize(&bd.unscaled_value(), out);
     }
     virtual size_t serialized_size(const void* value) const override {
         if (!value) {
@@ -1411,8 +1466,7 @@ class decimal_type_impl : public concrete_type<big_decimal> {
             return 0;
         }
         auto&& bd = std::move(bd1).get();
-        varint_type_impl::native_type unscaled_value = bd.unscaled_value();
-        return sizeof(int32_t) + varint_type->serialized_size(&unscaled_value);
+        return sizeof(int32_t) + varint_type->serialized_size(&bd.unscaled_value());
     }
     virtual int32_t compare(bytes_view v1, bytes_view v2) const override {
         if (v1.empty()) {
@@ -1421,6 +1475,19 @@ class decimal_type_impl : public concrete_type<big_decimal> {
         if (v2.empty()) {
             return 1;
         }
+        if (v1.size() > sizeof(int32_t) && v2.size() > sizeof(int32_t)) {
+            auto in1 = v1;
+            auto in2 = v2;
+            int64_t scale1 = read_simple<int32_t>(in1);
+            int64_t scale2 = read_simple<int32_t>(in2);
+            auto i1 = varint_to_int64(in1);
+            auto i2 = varint_to_int64(in2);
+            auto max_scale = std::max(scale1, scale2);
+            if (i1 && i2 && multiply_by_power_of_ten(*i1, max_scale - scale1)
+                    && multiply_by_power_of_ten(*i2, max_scale - scale2)) {
+                return *i1 == *i2 ? 0 : *i1 < *i2 ? -1 : 1;
+            }
+        }
         auto a = from_value(deserialize(v1));
         auto b = from_value(deserialize(v2));
 
@@ -1439,6 +1506,23 @@ class decimal_type_impl : public concrete_type<big_decimal> {
         return compare(v1, v2) < 0;
     }
     virtual size_t hash(bytes_view v) const override {
+        if (v.size() > sizeof(int32_t)) {
+            auto in = v;
+            int64_t scale = read_simple<int32_t>(in);
+            auto i = varint_to_int64(in);
+            if (i) {
+                return hash_decimal(scale, *i);
+            }
+            // Trailing zeroes can bring large values into range.
+            auto bd = from_value(deserialize(v)).get();
+            auto unscaled = bd.unscaled_value();
+            for (scale = bd.scale(); unscaled && unscaled % 10 == 0; --scale) {
+                unscaled /= 10;
+            }
+            if (fits_int64(unscaled)) {
+                return hash_decimal(scale, unscaled.convert_to<int64_t>());
+            }
+        }
         bytes b(v.begin(), v.end());
         return std::hash<sstring>()(to_string(b));
     }
@@ -2189,43 +2273,124 @@ collection_type_impl::serialize_mutation_form_only_live(mutation_view mut, gc_cl
     }));
 }
 
+namespace {
+
+// Walks the cells of a serialized collection mutation, without
+// deserializing it into a vector first.
+class collection_mutation_cursor {
+    bytes_view _in;
+    tombstone _tomb;
+    uint32_t _remaining;
+    bytes_view _key;
+    bytes_view _value;
+    bool _done = false;
+public:
+    explicit collection_mutation_cursor(collection_mutation_view cm) : _in(cm.data) {
+        auto has_tomb = read_simple<bool>(_in);
+        if (has_tomb) {
+            auto ts = read_simple<api::timestamp_type>(_in);
+            auto ttl = read_simple<gc_clock::duration::rep>(_in);
+            _tomb = tombstone{ts, gc_clock::time_point(gc_clock::duration(ttl))};
+        }
+        _remaining = read_simple<uint32_t>(_in);
+        next();
+    }
+    tombstone tomb() const { return _tomb; }
+    bool done() const { return _done; }
+    bytes_view key() const { return _key; }
+    atomic_cell_view cell() const { return atomic_cell_view::from_bytes(_value); }
+    bytes_view serialized_cell() const { return _value; }
+    void next() {
+        if (!_remaining) {
+            _done = true;
+            return;
+        }
+        --_remaining;
+        auto ksize = read_simple<uint32_t>(_in);
+        _key = read_simple_bytes(_in, ksize);
+        auto vsize = read_simple<uint32_t>(_in);
+        _value = read_simple_bytes(_in, vsize);
+    }
+};
+
+}
+
+// Calls func(key, serialized_cell) for each cell of the merge of a and b, in
+// key order.
+template <typename Func>
+static void merge_collection_mutations(const abstract_type& key_type, collection_mutation_view a, collection_mutation_view b, Func&& func) {
+    collection_mutation_cursor ca(a);
+    collection_mutation_cursor cb(b);
+    // tombstone wins if timestamps equal here, unlike row tombstones
+    // FIXME: should we consider TTLs too?
+    auto skip_killed = [] (collection_mutation_cursor& c, tombstone t) {
+        while (!c.done() && t.timestamp >= c.cell().timestamp()) {
+            c.next();
+        }
+    };
+    auto ta = ca.tomb();
+    auto tb = cb.tomb();
+    skip_killed(ca, tb);
+    skip_killed(cb, ta);
+    while (!ca.done() || !cb.done()) {
+        auto cmp = ca.done() ? 1 : cb.done() ? -1 : key_type.compare(ca.key(), cb.key());
+        if (cmp < 0) {
+            func(ca.key(), ca.serialized_cell());
+            ca.next();
+        } else if (cmp > 0) {
+            func(cb.key(), cb.serialized_cell());
+            cb.next();
+        } else {
+            func(ca.key(), compare_atomic_cell_for_merge(ca.cell(), cb.cell()) > 0 ? ca.serialized_cell() : cb.serialized_cell());
+            ca.next();
+            cb.next();
+        }
+        skip_killed(ca, tb);
+        skip_killed(cb, ta);
+    }
+}
+
+// Merges a and b straight into the buffer of the result, which won't need to
+// be copied into the current allocator: the size of the result is computed
+// first, and the cells are then copied from a and b.
 collection_mutation
 collection_type_impl::merge(collection_mutation_view a, collection_mutation_view b) const {
-    auto aa = deserialize_mutation_form(a);
-    auto bb = deserialize_mutation_form(b);
-    mutation_view merged;
-    merged.cells.reserve(aa.cells.size() + bb.cells.size());
-    using element_type = std::pair<bytes_view, atomic_cell_view>;
     auto key_type = name_comparator();
-    auto compare = [key_type] (const element_type& e1, const element_type& e2) {
-        return key_type->less(e1.first, e2.first);
-    };
-    auto merge = [this] (const element_type& e1, const element_type& e2) {
-        // FIXME: use std::max()?
-        return std::make_pair(e1.first, compare_atomic_cell_for_merge(e1.second, e2.second) > 0 ? e1.second : e2.second);
-    };
-    // applied to a tombstone, returns a predicate checking whether a cell is killed by
-    // the tombstone
-    auto cell_killed = [] (const std::experimental::optional<tombstone>& t) {
-        return [&t] (const element_type& e) {
-            if (!t) {
-                return false;
-            }
-            // tombstone wins if timestamps equal here, unlike row tombstones
-            if (t->timestamp < e.second.timestamp()) {
-                return false;
-            }
-            return true;
-            // FIXME: should we consider TTLs too?
+    auto tomb = std::max(collection_mutation_cursor(a).tomb(), collection_mutation_cursor(b).tomb());
+    size_t size = 1 + 4;
+    if (tomb) {
+        size += sizeof(tomb.timestamp) + sizeof(tomb.deletion_time);
+    }
+    uint32_t count = 0;
+    merge_collection_mutations(*key_type, a, b, [&] (bytes_view key, bytes_view cell) {
+        size += 8 + key.size() + cell.size();
+        ++count;
+    });
+    auto write_to = [&] (bytes::iterator out) {
+        *out++ = bool(tomb);
+        if (tomb) {
+            write(out, tomb.timestamp);
+            write(out, tomb.deletion_time.time_since_epoch().count());
+        }
+        auto writeb = [&out] (bytes_view v) {
+            serialize_int32(out, v.size());
+            out = std::copy_n(v.begin(), v.size(), out);
         };
+        serialize_int32(out, count);
+        merge_collection_mutations(*key_type, a, b, [&] (bytes_view key, bytes_view cell) {
+            writeb(key);
+            writeb(cell);
+        });
     };
-    combine(aa.cells.begin(), std::remove_if(aa.cells.begin(), aa.cells.end(), cell_killed(bb.tomb)),
-            bb.cells.begin(), std::remove_if(bb.cells.begin(), bb.cells.end(), cell_killed(aa.tomb)),
-            std::back_inserter(merged.cells),
-            compare,
-            merge);
-    merged.tomb = std::max(aa.tomb, bb.tomb);
-    return serialize_mutation_form(merged);
+    managed_bytes ret(managed_bytes::initialized_later(), size);
+    if (ret.is_fragmented()) {
+        // Larger than the allocator can allocate contiguously.
+        bytes linear(bytes::initialized_later(), size);
+        write_to(linear.begin());
+        return collection_mutation{managed_bytes(linear)};
+    }
+    write_to(ret.begin());
+    return collection_mutation{std::move(ret)};
 }
 
 collection_mutation
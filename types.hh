@@ -231,6 +231,26 @@ inline int32_t compare_unsigned(bytes_view v1, bytes_view v2) {
     return (int32_t) (v1.size() - v2.size());
 }
 
+// Compares the timestamps of two serialized version 1 UUIDs.
+inline int timeuuid_compare_timestamps(bytes_view o1, bytes_view o2) {
+    auto compare_pos = [&] (unsigned pos, int mask, int ifequal) {
+        int d = (o1[pos] & mask) - (o2[pos] & mask);
+        return d ? d : ifequal;
+    };
+    return compare_pos(6, 0xf,
+        compare_pos(7, 0xff,
+            compare_pos(4, 0xff,
+                compare_pos(5, 0xff,
+                    compare_pos(0, 0xff,
+                        compare_pos(1, 0xff,
+                            compare_pos(2, 0xff,
+                                compare_pos(3, 0xff, 0))))))));
+}
+
+// The value of a serialized varint, when it fits in 64 bits, whatever the
+// number of redundant sign bytes it is encoded with.
+stdx::optional<int64_t> varint_to_int64(bytes_view v);
+
 struct empty_t {};
 
 class empty_value_exception : public std::exception {
@@ -1247,6 +1267,18 @@ shared_ptr<const abstract_type> data_type_for<double>() {
     return double_type;
 }
 
+template <>
+inline
+shared_ptr<const abstract_type> data_type_for<boost::multiprecision::cpp_int>() {
+    return varint_type;
+}
+
+template <>
+inline
+shared_ptr<const abstract_type> data_type_for<big_decimal>() {
+    return decimal_type;
+}
+
 namespace std {
 
 template <>
@@ -38,8 +38,8 @@
 
 #include "UUID_gen.hh"
 
-#include <stdlib.h>
 #include <atomic>
+#include <random>
 
 #define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
 #include <cryptopp/md5.h>
@@ -100,30 +100,80 @@ static int64_t make_node()
     // FIXME: Mix-in node's address. See the above commented-out code
     // which is what Cassandra's UUIDGen.java did. We can also get the MAC address.
 
-    // We should take current core number under consideration
-    // because create_time_safe() doesn't synchronize across cores and
-    // it's easy to get duplicates.
-    static std::atomic<unsigned> core_counter;
-    return core_counter.fetch_add(1);
+    // The random part is shared by the whole process and identifies it among
+    // the other processes, the index identifies the thread within it: each
+    // thread has its own clock, so two threads must never share a node.
+    static const int64_t process_node = [] {
+        std::random_device rd;
+        int64_t node = (int64_t(rd()) << 32) | rd();
+        // Since we don't use the mac address, the spec says that multicast
+        // bit (least significant bit of the first octet of the node ID) must be 1.
+        return (node & 0x0000fefffffff000L) | 0x0000010000000000L;
+    }();
+    static std::atomic<unsigned> thread_counter;
+    return process_node | (thread_counter.fetch_add(1, std::memory_order_relaxed) & 0xfff);
 }
 
-
 static int64_t make_clock_seq_and_node()
 {
     // The original Java code did this, shuffling the number of millis
     // since the epoch, and taking 14 bits of it. We don't do exactly
     // the same, but the idea is the same.
     //long clock = new Random(System.currentTimeMillis()).nextLong();
-    unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
-    int clock = rand_r(&seed);
+    int64_t clock = std::random_device()();
 
-    long lsb = 0;
+    int64_t lsb = 0;
     lsb |= 0x8000000000000000L;                 // variant (2 bits)
     lsb |= (clock & 0x0000000000003FFFL) << 48; // clock sequence (14 bits)
     lsb |= make_node();                          // 6 bytes
     return lsb;
 }
 
+namespace {
+
+// The generator state of this thread. It is constant-initialized, so that
+// accessing it needs no guard: clock_seq_and_node is computed on first use.
+struct generator_state {
+    int64_t last_nanos = 0;
+    int64_t clock_seq_and_node = 0;
+};
+
+thread_local generator_state state;
+
+}
+
+int64_t UUID_gen::clock_seq_and_node() {
+    // Never 0 once computed, thanks to the variant bit.
+    if (__builtin_expect(!state.clock_seq_and_node, false)) {
+        state.clock_seq_and_node = make_clock_seq_and_node();
+    }
+    return state.clock_seq_and_node;
+}
+
+// NOTE: In the original Java code this function was "synchronized". This isn't
+// needed since each thread has its own clock_seq_and_node.
+int64_t UUID_gen::create_time_safe()
+{
+    using namespace std::chrono;
+    int64_t millis = duration_cast<milliseconds>(
+            system_clock::now().time_since_epoch()).count();
+    int64_t nanos_since = (millis - START_EPOCH) * 10000;
+    if (nanos_since > state.last_nanos)
+        state.last_nanos = nanos_since;
+    else
+        nanos_since = ++state.last_nanos;
+
+    return create_time(nanos_since);
+}
+
+UUID UUID_gen::get_time_UUID() {
+    return UUID(create_time_safe(), clock_seq_and_node());
+}
+
+std::array<int8_t, 16> UUID_gen::get_time_UUID_bytes() {
+    return create_time_UUID_bytes(create_time_safe(), clock_seq_and_node());
+}
+
 UUID UUID_gen::get_name_UUID(bytes_view b) {
     return get_name_UUID(reinterpret_cast<const unsigned char*>(b.begin()), b.size());
 }
@@ -152,8 +202,5 @@ UUID UUID_gen::get_name_UUID(const unsigned char *s, size_t len) {
     return get_UUID(digest);
 }
 
-const thread_local int64_t UUID_gen::clock_seq_and_node = make_clock_seq_and_node();
-thread_local const std::unique_ptr<UUID_gen> UUID_gen::instance (new UUID_gen());
-
 
 } // namespace utils
@@ -56,7 +56,6 @@ class UUID_gen
 private:
     // A grand day! millis at 00:00:00.000 15 Oct 1582.
     static constexpr int64_t START_EPOCH = -12219292800000L;
-    static thread_local const int64_t clock_seq_and_node;
 
     /*
      * The min and max possible lsb for a UUID.
@@ -72,16 +71,10 @@ class UUID_gen
     static constexpr int64_t MIN_CLOCK_SEQ_AND_NODE = 0x8080808080808080L;
     static constexpr int64_t MAX_CLOCK_SEQ_AND_NODE = 0x7f7f7f7f7f7f7f7fL;
 
-    // placement of this singleton is important.  It needs to be instantiated *AFTER* the other statics.
-    static thread_local const std::unique_ptr<UUID_gen> instance;
-
-    int64_t last_nanos = 0;
-
-    UUID_gen()
-    {
-        // make sure someone didn't whack the clockSeqAndNode by changing the order of instantiation.
-        assert(clock_seq_and_node != 0);
-    }
+    // The clock sequence and node of the UUIDs generated by this thread. Each
+    // thread has its own, so that generating UUIDs, which each thread does
+    // with its own clock, stays unique without synchronization.
+    static int64_t clock_seq_and_node();
 
 public:
     /**
@@ -89,10 +82,7 @@ class UUID_gen
      *
      * @return a UUID instance
      */
-    static UUID get_time_UUID()
-    {
-        return UUID(instance->create_time_safe(), clock_seq_and_node);
-    }
+    static UUID get_time_UUID();
 
     /**
      * Creates a type 1 UUID (time-based UUID) with the timestamp of @param when, in milliseconds.
@@ -101,7 +91,7 @@ class UUID_gen
      */
     static UUID get_time_UUID(int64_t when)
     {
-        return UUID(create_time(from_unix_timestamp(when)), clock_seq_and_node);
+        return UUID(create_time(from_unix_timestamp(when)), clock_seq_and_node());
     }
 
     /**
@@ -115,7 +105,7 @@ class UUID_gen
         // "nanos" needs to be in 100ns intervals since the adoption of the Gregorian calendar in the West.
         uint64_t nanos = duration_cast<nanoseconds>(tp.time_since_epoch()).count() / 100;
         nanos -= (10000ULL * START_EPOCH);
-        return UUID(create_time(nanos), clock_seq_and_node);
+        return UUID(create_time(nanos), clock_seq_and_node());
     }
 
     static UUID get_time_UUID(int64_t when, int64_t clock_seq_and_node)
@@ -163,10 +153,7 @@ class UUID_gen
      *
      * @return a type 1 UUID represented as a byte[]
      */
-    static std::array<int8_t, 16> get_time_UUID_bytes()
-    {
-        return create_time_UUID_bytes(instance->create_time_safe());
-    }
+    static std::array<int8_t, 16> get_time_UUID_bytes();
 
     /**
      * Returns the smaller possible type 1 UUID having the provided timestamp.
@@ -241,13 +228,12 @@ class UUID_gen
         if (nanos >= 10000)
             throw new IllegalArgumentException();
 #endif
-        return create_time_UUID_bytes(instance->create_time_unsafe(time_millis, nanos));
+        return create_time_UUID_bytes(create_time_unsafe(time_millis, nanos), clock_seq_and_node());
     }
 
 private:
-    static std::array<int8_t, 16> create_time_UUID_bytes(uint64_t msb)
+    static std::array<int8_t, 16> create_time_UUID_bytes(uint64_t msb, uint64_t lsb)
     {
-        uint64_t lsb = clock_seq_and_node;
         std::array<int8_t, 16> uuid_bytes;
 
         for (int i = 0; i < 8; i++)
@@ -280,23 +266,9 @@ class UUID_gen
 
     // needs to return two different values for the same when.
     // we can generate at most 10k UUIDs per ms.
-    // NOTE: In the original Java code this function was "synchronized". This isn't
-    // needed if we assume our code will run on just one CPU.
-    int64_t create_time_safe()
-    {
-        using namespace std::chrono;
-        int64_t millis = duration_cast<milliseconds>(
-                system_clock::now().time_since_epoch()).count();
-        int64_t nanos_since = (millis - START_EPOCH) * 10000;
-        if (nanos_since > last_nanos)
-            last_nanos = nanos_since;
-        else
-            nanos_since = ++last_nanos;
-
-        return create_time(nanos_since);
-    }
+    static int64_t create_time_safe();
 
-    int64_t create_time_unsafe(int64_t when, int nanos)
+    static int64_t create_time_unsafe(int64_t when, int nanos)
     {
         uint64_t nanos_since = ((when - START_EPOCH) * 10000) + nanos;
         return create_time(nanos_since);
@@ -95,3 +95,31 @@ int big_decimal::compare(const big_decimal& other) const
     boost::multiprecision::cpp_int y = other._unscaled_value * boost::multiprecision::pow(rescale, max_scale - other._scale);
     return x == y ? 0 : x < y ? -1 : 1;
 }
+
+big_decimal& big_decimal::operator+=(const big_decimal& other)
+{
+    if (_scale == other._scale) {
+        _unscaled_value += other._unscaled_value;
+    } else {
+        boost::multiprecision::cpp_int rescale(10);
+        auto max_scale = std::max(_scale, other._scale);
+        _unscaled_value = _unscaled_value * boost::multiprecision::pow(rescale, max_scale - _scale)
+                + other._unscaled_value * boost::multiprecision::pow(rescale, max_scale - other._scale);
+        _scale = max_scale;
+    }
+    return *this;
+}
+
+big_decimal big_decimal::div(const boost::multiprecision::cpp_int& divisor) const
+{
+    boost::multiprecision::cpp_int quotient, remainder;
+    boost::multiprecision::divide_qr(_unscaled_value, divisor, quotient, remainder);
+    // The quotient is truncated towards zero.
+    auto twice_remainder = boost::multiprecision::abs(remainder) * 2;
+    auto abs_divisor = boost::multiprecision::abs(divisor);
+    if (twice_remainder > abs_divisor
+            || (twice_remainder == abs_divisor && boost::multiprecision::abs(quotient) % 2 != 0)) {
+        quotient += (_unscaled_value.sign() == divisor.sign()) ? 1 : -1;
+    }
+    return big_decimal(_scale, std::move(quotient));
+}
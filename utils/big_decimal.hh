@@ -42,4 +42,30 @@ class big_decimal {
     sstring to_string() const;
 
     int compare(const big_decimal& other) const;
+
+    // The scale of the sum is the larger of the two, like for BigDecimal.add().
+    big_decimal& operator+=(const big_decimal& other);
+
+    // Keeps the scale, rounding half even, like
+    // BigDecimal.divide(divisor, ROUND_HALF_EVEN).
+    big_decimal div(const boost::multiprecision::cpp_int& divisor) const;
 };
+
+// Multiplies v by 10^n, n >= 0. Returns false, leaving v unchanged, on
+// overflow.
+inline bool multiply_by_power_of_ten(int64_t& v, int64_t n) {
+    static constexpr int64_t powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+        10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000,
+        1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000,
+    };
+    if (!v) {
+        return true;
+    }
+    int64_t r;
+    if (n >= int64_t(sizeof(powers) / sizeof(powers[0])) || __builtin_mul_overflow(v, powers[n], &r)) {
+        return false;
+    }
+    v = r;
+    return true;
+}
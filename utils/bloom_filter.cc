@@ -44,6 +44,7 @@
 #include "bytes.hh"
 #include "utils/murmur_hash.hh"
 #include "core/shared_ptr.hh"
+#include "core/print.hh"
 #include "utils/large_bitset.hh"
 #include <array>
 #include <cstdlib>
@@ -88,6 +89,55 @@ bool bloom_filter::is_present(const bytes_view& key) {
     return is_present(make_hashed_key(key));
 }
 
+constexpr size_t blocked_bloom_filter::words_per_block;
+constexpr size_t blocked_bloom_filter::bits_per_block;
+
+blocked_bloom_filter::blocked_bloom_filter(int hashes, bitmap&& bs)
+    : bloom_filter(hashes, std::move(bs)) {
+    if (_bitset.size() == 0 || _bitset.size() % bits_per_block) {
+        throw std::invalid_argument(sprint("Invalid blocked bloom filter size %d: must be a non-zero multiple of %d bits",
+                _bitset.size(), bits_per_block));
+    }
+}
+
+std::pair<size_t, blocked_bloom_filter::block_mask> blocked_bloom_filter::locate(hashed_key key) const {
+    auto h = key.hash();
+    auto block = h[0] % nr_blocks();
+    // Double hashing within the block. An odd step visits distinct bits
+    // modulo bits_per_block, so there are no wasted probes.
+    uint32_t base = h[1];
+    uint32_t inc = (h[1] >> 32) | 1;
+    block_mask mask = {};
+    for (int i = 0; i < _hash_count; i++) {
+        auto bit = base % bits_per_block;
+        mask[bit / 64] |= uint64_t(1) << (bit % 64);
+        base += inc;
+    }
+    return { block * words_per_block, mask };
+}
+
+bool blocked_bloom_filter::is_present(hashed_key key) {
+    auto l = locate(key);
+    auto words = _bitset.words_at(l.first);
+    uint64_t missing = 0;
+    for (size_t i = 0; i < words_per_block; i++) {
+        missing |= l.second[i] & ~uint64_t(words[i]);
+    }
+    return !missing;
+}
+
+void blocked_bloom_filter::add(const bytes_view& key) {
+    auto l = locate(make_hashed_key(key));
+    auto words = _bitset.words_at(l.first);
+    for (size_t i = 0; i < words_per_block; i++) {
+        words[i] |= l.second[i];
+    }
+}
+
+bool blocked_bloom_filter::is_present(const bytes_view& key) {
+    return is_present(make_hashed_key(key));
+}
+
 filter_ptr create_filter(int hash, large_bitset&& bitset) {
     return std::make_unique<murmur3_bloom_filter>(hash, std::move(bitset));
 }
@@ -98,5 +148,16 @@ filter_ptr create_filter(int hash, int64_t num_elements, int buckets_per) {
     large_bitset bitset(num_bits);
     return std::make_unique<murmur3_bloom_filter>(hash, std::move(bitset));
 }
+
+filter_ptr create_blocked_filter(int hash, large_bitset&& bitset) {
+    return std::make_unique<blocked_bloom_filter>(hash, std::move(bitset));
+}
+
+filter_ptr create_blocked_filter(int hash, int64_t num_elements, int buckets_per) {
+    int64_t num_bits = (num_elements * buckets_per) + bloom_calculations::EXCESS;
+    num_bits = align_up<int64_t>(num_bits, blocked_bloom_filter::bits_per_block);
+    large_bitset bitset(num_bits);
+    return std::make_unique<blocked_bloom_filter>(hash, std::move(bitset));
+}
 }
 }
@@ -0,0 +1,700 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+#include "utils/allocation_strategy.hh"
+
+namespace bplus {
+
+template<typename T, typename Hook, typename Less, typename Prefix, size_t NodeSize>
+class tree;
+
+// Embedded in objects linked into a bplus::tree, points at the leaf holding them.
+//
+// The object's move constructor must call tree::replace() so that the leaf
+// points at the new location, like with boost::intrusive hooks.
+class member_hook {
+    void* _leaf = nullptr;
+
+    template<typename T, typename Hook, typename Less, typename Prefix, size_t NodeSize>
+    friend class tree;
+public:
+    member_hook() = default;
+    member_hook(const member_hook&) = delete;
+    member_hook& operator=(const member_hook&) = delete;
+
+    bool is_linked() const {
+        return _leaf;
+    }
+};
+
+// Selects the member_hook of T used by a tree.
+template<typename T, member_hook T::* Member>
+struct member_hook_of {
+    static member_hook& get(T& v) {
+        return v.*Member;
+    }
+};
+
+// An intrusive B+tree of objects of type T, ordered by Less, with unique keys.
+//
+// Nodes hold pointers to the objects, not the objects themselves, so that
+// they can be allocated and owned by the user. Next to each pointer, nodes
+// hold a 64-bit prefix of the object's key, given by Prefix, so that most
+// comparisons on the way down the tree are resolved by comparing integers in
+// the node, without touching the objects. The full comparator is used only
+// when prefixes are equal. Prefix must order objects like Less does, though
+// not strictly: a < b must imply prefix(a) <= prefix(b). Prefix is invoked
+// with T and with every key type used for lookups.
+//
+// Inner nodes keep, for each child, a pointer to the smallest object in its
+// subtree, which serves as the separator. So there are no separator keys to
+// copy and all keys live only in the objects.
+//
+// Nodes are allocated with current_allocator() and may be migrated by it,
+// so the tree can live in an LSA region. Nodes are freed when they become
+// empty, but are not merged when they underflow. This suits memtables, which
+// are only erased from in order, when they are cleared.
+//
+// Iterators are invalidated by insertion, erasure and migration of nodes.
+template<typename T, typename Hook, typename Less, typename Prefix, size_t NodeSize = 16>
+class tree {
+    static_assert(NodeSize >= 4, "nodes must hold at least 4 elements");
+
+    struct inner_node;
+
+    struct node_base {
+        inner_node* _parent = nullptr;
+        // Valid in the root only.
+        tree* _tree = nullptr;
+        uint16_t _size = 0;
+        bool _is_leaf;
+        // For leaves, the objects. For inner nodes, the smallest object
+        // in the subtree of each child.
+        uint64_t _prefixes[NodeSize];
+        T* _keys[NodeSize];
+
+        explicit node_base(bool is_leaf) : _is_leaf(is_leaf) { }
+
+        node_base(node_base&& o) noexcept
+            : _parent(o._parent)
+            , _tree(o._tree)
+            , _size(o._size)
+            , _is_leaf(o._is_leaf)
+        {
+            std::copy_n(o._prefixes, _size, _prefixes);
+            std::copy_n(o._keys, _size, _keys);
+            if (_parent) {
+                _parent->_children[_parent->index_of(&o)] = this;
+            } else {
+                _tree->_root = this;
+            }
+        }
+
+        bool full() const {
+            return _size == NodeSize;
+        }
+
+        void set_key(unsigned i, T* key, uint64_t prefix) {
+            _keys[i] = key;
+            _prefixes[i] = prefix;
+        }
+
+        void shift_right(unsigned i) {
+            std::copy_backward(_prefixes + i, _prefixes + _size, _prefixes + _size + 1);
+            std::copy_backward(_keys + i, _keys + _size, _keys + _size + 1);
+        }
+
+        void shift_left(unsigned i) {
+            std::copy(_prefixes + i + 1, _prefixes + _size, _prefixes + i);
+            std::copy(_keys + i + 1, _keys + _size, _keys + i);
+        }
+    };
+
+    struct leaf_node : node_base {
+        leaf_node* _prev = nullptr;
+        leaf_node* _next = nullptr;
+
+        leaf_node() : node_base(true) { }
+
+        leaf_node(leaf_node&& o) noexcept
+            : node_base(std::move(o))
+            , _prev(o._prev)
+            , _next(o._next)
+        {
+            for (unsigned i = 0; i < this->_size; ++i) {
+                Hook::get(*this->_keys[i])._leaf = this;
+            }
+            if (_prev) {
+                _prev->_next = this;
+            }
+            if (_next) {
+                _next->_prev = this;
+            }
+        }
+
+        unsigned index_of(const T* key) const {
+            return std::find(this->_keys, this->_keys + this->_size, key) - this->_keys;
+        }
+    };
+
+    struct inner_node : node_base {
+        node_base* _children[NodeSize];
+
+        inner_node() : node_base(false) { }
+
+        inner_node(inner_node&& o) noexcept
+            : node_base(std::move(o))
+        {
+            std::copy_n(o._children, this->_size, _children);
+            for (unsigned i = 0; i < this->_size; ++i) {
+                _children[i]->_parent = this;
+            }
+        }
+
+        unsigned index_of(const node_base* child) const {
+            return std::find(_children, _children + this->_size, child) - _children;
+        }
+    };
+
+    template<bool Const>
+    class iterator_base {
+        leaf_node* _leaf = nullptr;
+        unsigned _idx = 0;
+
+        iterator_base(leaf_node* leaf, unsigned idx) : _leaf(leaf), _idx(idx) {
+            if (_leaf && _idx == _leaf->_size) {
+                _leaf = _leaf->_next;
+                _idx = 0;
+            }
+        }
+
+        friend class tree;
+        friend class iterator_base<!Const>;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::conditional_t<Const, const T, T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        iterator_base() = default;
+
+        template<bool C = Const, typename = std::enable_if_t<C>>
+        iterator_base(const iterator_base<false>& o) : _leaf(o._leaf), _idx(o._idx) { }
+
+        reference operator*() const {
+            return *_leaf->_keys[_idx];
+        }
+
+        pointer operator->() const {
+            return _leaf->_keys[_idx];
+        }
+
+        iterator_base& operator++() {
+            if (++_idx == _leaf->_size) {
+                _leaf = _leaf->_next;
+                _idx = 0;
+            }
+            return *this;
+        }
+
+        iterator_base operator++(int) {
+            auto it = *this;
+            operator++();
+            return it;
+        }
+
+        template<bool C>
+        bool operator==(const iterator_base<C>& o) const {
+            return _leaf == o._leaf && _idx == o._idx;
+        }
+
+        template<bool C>
+        bool operator!=(const iterator_base<C>& o) const {
+            return !(*this == o);
+        }
+    };
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using iterator = iterator_base<false>;
+    using const_iterator = iterator_base<true>;
+private:
+    node_base* _root = nullptr;
+    size_t _size = 0;
+    Less _less;
+    Prefix _prefix;
+private:
+    // Whether the i-th key of n is less than key.
+    template<typename K>
+    bool key_less(const node_base& n, unsigned i, const K& key, uint64_t prefix, const Less& less) const {
+        return n._prefixes[i] < prefix || (n._prefixes[i] == prefix && less(*n._keys[i], key));
+    }
+
+    // Whether key is less than the i-th key of n.
+    template<typename K>
+    bool less_key(const K& key, uint64_t prefix, const node_base& n, unsigned i, const Less& less) const {
+        return prefix < n._prefixes[i] || (prefix == n._prefixes[i] && less(key, *n._keys[i]));
+    }
+
+    // The child of n whose subtree holds the keys not less than key, if any.
+    template<typename K>
+    unsigned child_for(const inner_node& n, const K& key, uint64_t prefix, const Less& less) const {
+        unsigned i = 1;
+        while (i < n._size && !less_key(key, prefix, n, i, less)) {
+            ++i;
+        }
+        return i - 1;
+    }
+
+    template<typename K>
+    leaf_node* leaf_for(const K& key, uint64_t prefix, const Less& less) const {
+        auto n = _root;
+        while (!n->_is_leaf) {
+            auto& in = static_cast<inner_node&>(*n);
+            n = in._children[child_for(in, key, prefix, less)];
+        }
+        return static_cast<leaf_node*>(n);
+    }
+
+    template<typename K>
+    iterator do_lower_bound(const K& key, const Less& less) const {
+        if (!_root) {
+            return iterator();
+        }
+        auto prefix = _prefix(key);
+        auto leaf = leaf_for(key, prefix, less);
+        unsigned i = 0;
+        while (i < leaf->_size && key_less(*leaf, i, key, prefix, less)) {
+            ++i;
+        }
+        return iterator(leaf, i);
+    }
+
+    template<typename K>
+    iterator do_upper_bound(const K& key, const Less& less) const {
+        if (!_root) {
+            return iterator();
+        }
+        auto prefix = _prefix(key);
+        auto leaf = leaf_for(key, prefix, less);
+        unsigned i = 0;
+        while (i < leaf->_size && !less_key(key, prefix, *leaf, i, less)) {
+            ++i;
+        }
+        return iterator(leaf, i);
+    }
+
+    template<typename K>
+    iterator do_find(const K& key, const Less& less) const {
+        auto i = do_lower_bound(key, less);
+        if (i != iterator() && !less(key, *i)) {
+            return i;
+        }
+        return iterator();
+    }
+
+    // Propagates a change of the smallest key of n to its ancestors.
+    static void update_min(node_base* n) noexcept {
+        auto key = n->_keys[0];
+        auto prefix = n->_prefixes[0];
+        while (n->_parent) {
+            auto parent = n->_parent;
+            auto i = parent->index_of(n);
+            parent->set_key(i, key, prefix);
+            if (i) {
+                break;
+            }
+            n = parent;
+        }
+    }
+
+    void insert_into_leaf(leaf_node* leaf, unsigned i, T& value, uint64_t prefix) noexcept {
+        leaf->shift_right(i);
+        leaf->set_key(i, &value, prefix);
+        leaf->_size++;
+        Hook::get(value)._leaf = leaf;
+        _size++;
+        if (i == 0) {
+            update_min(leaf);
+        }
+    }
+
+    // Moves the upper half of the full i-th child of parent to a new node,
+    // which becomes the (i + 1)-th child. parent must not be full.
+    void split_child(inner_node* parent, unsigned i) {
+        auto child = parent->_children[i];
+        node_base* sibling;
+        if (child->_is_leaf) {
+            sibling = current_allocator().construct<leaf_node>();
+        } else {
+            sibling = current_allocator().construct<inner_node>();
+        }
+        constexpr unsigned half = NodeSize / 2;
+        std::copy(child->_prefixes + half, child->_prefixes + NodeSize, sibling->_prefixes);
+        std::copy(child->_keys + half, child->_keys + NodeSize, sibling->_keys);
+        sibling->_size = NodeSize - half;
+        child->_size = half;
+        sibling->_parent = parent;
+        if (child->_is_leaf) {
+            auto l = static_cast<leaf_node*>(child);
+            auto s = static_cast<leaf_node*>(sibling);
+            for (unsigned j = 0; j < s->_size; ++j) {
+                Hook::get(*s->_keys[j])._leaf = s;
+            }
+            s->_prev = l;
+            s->_next = l->_next;
+            if (l->_next) {
+                l->_next->_prev = s;
+            }
+            l->_next = s;
+        } else {
+            auto in = static_cast<inner_node*>(child);
+            auto s = static_cast<inner_node*>(sibling);
+            std::copy(in->_children + half, in->_children + NodeSize, s->_children);
+            for (unsigned j = 0; j < s->_size; ++j) {
+                s->_children[j]->_parent = s;
+            }
+        }
+        parent->shift_right(i + 1);
+        std::copy_backward(parent->_children + i + 1, parent->_children + parent->_size, parent->_children + parent->_size + 1);
+        parent->set_key(i + 1, sibling->_keys[0], sibling->_prefixes[0]);
+        parent->_children[i + 1] = sibling;
+        parent->_size++;
+    }
+
+    void grow_root() {
+        auto root = current_allocator().construct<inner_node>();
+        root->_tree = this;
+        root->set_key(0, _root->_keys[0], _root->_prefixes[0]);
+        root->_children[0] = _root;
+        root->_size = 1;
+        _root->_parent = root;
+        _root->_tree = nullptr;
+        _root = root;
+    }
+
+    // Frees the empty node n, and its ancestors which become empty.
+    void remove_node(node_base* n) noexcept {
+        while (true) {
+            auto parent = n->_parent;
+            if (!parent) {
+                destroy_node(n);
+                _root = nullptr;
+                return;
+            }
+            auto i = parent->index_of(n);
+            destroy_node(n);
+            parent->shift_left(i);
+            std::copy(parent->_children + i + 1, parent->_children + parent->_size, parent->_children + i);
+            parent->_size--;
+            if (parent->_size) {
+                if (i == 0) {
+                    update_min(parent);
+                }
+                break;
+            }
+            n = parent;
+        }
+        while (!_root->_is_leaf && _root->_size == 1) {
+            auto root = static_cast<inner_node*>(_root);
+            _root = root->_children[0];
+            _root->_parent = nullptr;
+            _root->_tree = this;
+            destroy_node(root);
+        }
+    }
+
+    static void destroy_node(node_base* n) noexcept {
+        if (n->_is_leaf) {
+            current_allocator().destroy(static_cast<leaf_node*>(n));
+        } else {
+            current_allocator().destroy(static_cast<inner_node*>(n));
+        }
+    }
+
+    template<typename Disposer>
+    static void dispose_subtree(node_base* n, Disposer& d) noexcept {
+        if (n->_is_leaf) {
+            for (unsigned i = 0; i < n->_size; ++i) {
+                Hook::get(*n->_keys[i])._leaf = nullptr;
+                d(n->_keys[i]);
+            }
+        } else {
+            auto in = static_cast<inner_node*>(n);
+            for (unsigned i = 0; i < in->_size; ++i) {
+                dispose_subtree(in->_children[i], d);
+            }
+        }
+        destroy_node(n);
+    }
+
+    static size_t memory_usage_of(const node_base* n) noexcept {
+        if (n->_is_leaf) {
+            return sizeof(leaf_node);
+        }
+        auto in = static_cast<const inner_node*>(n);
+        size_t size = sizeof(inner_node);
+        for (unsigned i = 0; i < in->_size; ++i) {
+            size += memory_usage_of(in->_children[i]);
+        }
+        return size;
+    }
+
+    leaf_node* leftmost() const {
+        auto n = _root;
+        while (n && !n->_is_leaf) {
+            n = static_cast<inner_node*>(n)->_children[0];
+        }
+        return static_cast<leaf_node*>(n);
+    }
+public:
+    explicit tree(Less less = Less(), Prefix prefix = Prefix())
+        : _less(std::move(less))
+        , _prefix(std::move(prefix))
+    { }
+
+    tree(tree&& o) noexcept
+        : _root(o._root)
+        , _size(o._size)
+        , _less(std::move(o._less))
+        , _prefix(std::move(o._prefix))
+    {
+        o._root = nullptr;
+        o._size = 0;
+        if (_root) {
+            _root->_tree = this;
+        }
+    }
+
+    tree(const tree&) = delete;
+    tree& operator=(const tree&) = delete;
+
+    // Must be empty, the tree doesn't own the objects.
+    ~tree() {
+        assert(empty());
+    }
+
+    bool empty() const {
+        return !_size;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    // Memory used by the nodes, not including the objects.
+    size_t memory_usage() const {
+        return _root ? memory_usage_of(_root) : 0;
+    }
+
+    iterator begin() {
+        return iterator(leftmost(), 0);
+    }
+    iterator end() {
+        return iterator();
+    }
+    const_iterator begin() const {
+        return iterator(leftmost(), 0);
+    }
+    const_iterator end() const {
+        return const_iterator();
+    }
+    const_iterator cbegin() const {
+        return begin();
+    }
+    const_iterator cend() const {
+        return end();
+    }
+
+    // Returns the first element not less than key.
+    template<typename K>
+    iterator lower_bound(const K& key, const Less& less) {
+        return do_lower_bound(key, less);
+    }
+    template<typename K>
+    const_iterator lower_bound(const K& key, const Less& less) const {
+        return do_lower_bound(key, less);
+    }
+    template<typename K>
+    iterator lower_bound(const K& key) {
+        return do_lower_bound(key, _less);
+    }
+    template<typename K>
+    const_iterator lower_bound(const K& key) const {
+        return do_lower_bound(key, _less);
+    }
+
+    // Returns the first element greater than key.
+    template<typename K>
+    iterator upper_bound(const K& key, const Less& less) {
+        return do_upper_bound(key, less);
+    }
+    template<typename K>
+    const_iterator upper_bound(const K& key, const Less& less) const {
+        return do_upper_bound(key, less);
+    }
+    template<typename K>
+    iterator upper_bound(const K& key) {
+        return do_upper_bound(key, _less);
+    }
+    template<typename K>
+    const_iterator upper_bound(const K& key) const {
+        return do_upper_bound(key, _less);
+    }
+
+    template<typename K>
+    iterator find(const K& key, const Less& less) {
+        return do_find(key, less);
+    }
+    template<typename K>
+    const_iterator find(const K& key, const Less& less) const {
+        return do_find(key, less);
+    }
+    template<typename K>
+    iterator find(const K& key) {
+        return do_find(key, _less);
+    }
+    template<typename K>
+    const_iterator find(const K& key) const {
+        return do_find(key, _less);
+    }
+
+    iterator iterator_to(T& value) {
+        auto leaf = static_cast<leaf_node*>(Hook::get(value)._leaf);
+        return iterator(leaf, leaf->index_of(&value));
+    }
+
+    // Inserts value, which must not be equal to any element of the tree.
+    // Provides the strong exception guarantee.
+    iterator insert(T& value) {
+        auto prefix = _prefix(value);
+        if (!_root) {
+            auto leaf = current_allocator().construct<leaf_node>();
+            leaf->_tree = this;
+            _root = leaf;
+        } else if (_root->full()) {
+            grow_root();
+            split_child(static_cast<inner_node*>(_root), 0);
+        }
+        // Full nodes are split on the way down, so that there is room in the
+        // parent for the new sibling.
+        auto n = _root;
+        while (!n->_is_leaf) {
+            auto in = static_cast<inner_node*>(n);
+            auto i = child_for(*in, value, prefix, _less);
+            if (in->_children[i]->full()) {
+                split_child(in, i);
+                if (!less_key(value, prefix, *in, i + 1, _less)) {
+                    ++i;
+                }
+            }
+            n = in->_children[i];
+        }
+        auto leaf = static_cast<leaf_node*>(n);
+        unsigned i = 0;
+        while (i < leaf->_size && key_less(*leaf, i, value, prefix, _less)) {
+            ++i;
+        }
+        insert_into_leaf(leaf, i, value, prefix);
+        return iterator(leaf, i);
+    }
+
+    // Inserts value before hint, which must be the lower_bound() of value.
+    // Avoids walking down the tree when there is room in hint's leaf.
+    iterator insert(iterator hint, T& value) {
+        if (!hint._leaf || hint._leaf->full()) {
+            return insert(value);
+        }
+        insert_into_leaf(hint._leaf, hint._idx, value, _prefix(value));
+        return hint;
+    }
+
+    // Returns the element following the erased one.
+    iterator erase(iterator it) noexcept {
+        auto leaf = it._leaf;
+        auto i = it._idx;
+        Hook::get(*leaf->_keys[i])._leaf = nullptr;
+        leaf->shift_left(i);
+        leaf->_size--;
+        _size--;
+        if (!leaf->_size) {
+            auto next = leaf->_next;
+            if (leaf->_prev) {
+                leaf->_prev->_next = next;
+            }
+            if (next) {
+                next->_prev = leaf->_prev;
+            }
+            remove_node(leaf);
+            return iterator(next, 0);
+        }
+        if (i == 0) {
+            update_min(leaf);
+        }
+        return iterator(leaf, i);
+    }
+
+    template<typename Disposer>
+    iterator erase_and_dispose(iterator it, Disposer d) noexcept {
+        auto& value = *it;
+        auto next = erase(it);
+        d(&value);
+        return next;
+    }
+
+    template<typename Disposer>
+    void clear_and_dispose(Disposer d) noexcept {
+        if (_root) {
+            dispose_subtree(_root, d);
+            _root = nullptr;
+            _size = 0;
+        }
+    }
+
+    // To be called from the move constructor of T, after which moved_from
+    // is no longer linked.
+    static void replace(T& moved_from, T& value) noexcept {
+        auto& hook = Hook::get(moved_from);
+        if (!hook._leaf) {
+            return;
+        }
+        auto leaf = static_cast<leaf_node*>(hook._leaf);
+        auto i = leaf->index_of(&moved_from);
+        leaf->_keys[i] = &value;
+        Hook::get(value)._leaf = leaf;
+        hook._leaf = nullptr;
+        if (i == 0) {
+            update_min(leaf);
+        }
+    }
+};
+
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+// The splitmix64 finalizer, which mixes the bits of a hash well.
+inline uint64_t mix64(uint64_t h) {
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+// The counters of a Count-Min sketch: an item, given by its hash, maps to
+// one counter in each of the rows, and its count is estimated by the
+// smallest of them. How the counters are updated is up to the user, see
+// frequency_sketch and db::per_partition_rate_limiter.
+template<typename Counter>
+class count_min_sketch {
+public:
+    using counter_type = Counter;
+    static constexpr unsigned rows = 4;
+private:
+    std::vector<Counter> _counters;
+    uint64_t _mask;
+private:
+    size_t index(uint64_t hash, unsigned row) const {
+        // A different seed for each row.
+        return row * (_mask + 1) + (mix64(hash + 0x9e3779b97f4a7c15ULL * (row + 1)) & _mask);
+    }
+public:
+    // The number of counters in each row is width rounded up to a power of 2.
+    explicit count_min_sketch(size_t width) {
+        size_t w = 1;
+        while (w < width) {
+            w <<= 1;
+        }
+        _counters.resize(w * rows);
+        _mask = w - 1;
+    }
+
+    // The counters of the item, one per row.
+    std::array<Counter*, rows> counters(uint64_t hash) {
+        std::array<Counter*, rows> ret;
+        for (unsigned row = 0; row < rows; ++row) {
+            ret[row] = &_counters[index(hash, row)];
+        }
+        return ret;
+    }
+
+    Counter estimate(uint64_t hash) const {
+        Counter ret = _counters[index(hash, 0)];
+        for (unsigned row = 1; row < rows; ++row) {
+            ret = std::min(ret, _counters[index(hash, row)]);
+        }
+        return ret;
+    }
+
+    template<typename Func>
+    void for_each_counter(Func&& func) {
+        std::for_each(_counters.begin(), _counters.end(), func);
+    }
+
+    void clear() {
+        std::fill(_counters.begin(), _counters.end(), Counter(0));
+    }
+
+    size_t width() const { return _mask + 1; }
+};
+
+}
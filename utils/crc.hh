@@ -22,39 +22,66 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#else
 #include <smmintrin.h>
+#endif
 
 namespace utils {
 
+// Both SSE4.2 and the ARMv8 CRC extension implement the Castagnoli
+// polynomial (CRC32C).
+namespace crc32_detail {
+
+#if defined(__aarch64__)
+inline uint32_t step(uint32_t crc, uint8_t v) { return __crc32cb(crc, v); }
+inline uint32_t step(uint32_t crc, uint16_t v) { return __crc32ch(crc, v); }
+inline uint32_t step(uint32_t crc, uint32_t v) { return __crc32cw(crc, v); }
+inline uint32_t step(uint32_t crc, uint64_t v) { return __crc32cd(crc, v); }
+#else
+inline uint32_t step(uint32_t crc, uint8_t v) { return _mm_crc32_u8(crc, v); }
+inline uint32_t step(uint32_t crc, uint16_t v) { return _mm_crc32_u16(crc, v); }
+inline uint32_t step(uint32_t crc, uint32_t v) { return _mm_crc32_u32(crc, v); }
+inline uint32_t step(uint32_t crc, uint64_t v) { return _mm_crc32_u64(crc, v); }
+#endif
+
+}
+
+// Raw CRC32C: no pre- or post-conditioning is applied, so that the
+// computation can be resumed from any value returned by get().
 class crc32 {
     uint32_t _r = 0;
 public:
+    crc32() = default;
+    explicit crc32(uint32_t r) : _r(r) {}
     // All process() functions assume input is in
     // host byte order (i.e. equivalent to storing
     // the value in a buffer and crcing the buffer).
     void process(int8_t in) {
-        _r = _mm_crc32_u8(_r, in);
+        _r = crc32_detail::step(_r, uint8_t(in));
     }
     void process(uint8_t in) {
-        _r = _mm_crc32_u8(_r, in);
+        _r = crc32_detail::step(_r, uint8_t(in));
     }
     void process(int16_t in) {
-        _r = _mm_crc32_u16(_r, in);
+        _r = crc32_detail::step(_r, uint16_t(in));
     }
     void process(uint16_t in) {
-        _r = _mm_crc32_u16(_r, in);
+        _r = crc32_detail::step(_r, uint16_t(in));
     }
     void process(int32_t in) {
-        _r = _mm_crc32_u32(_r, in);
+        _r = crc32_detail::step(_r, uint32_t(in));
     }
     void process(uint32_t in) {
-        _r = _mm_crc32_u32(_r, in);
+        _r = crc32_detail::step(_r, uint32_t(in));
     }
     void process(int64_t in) {
-        _r = _mm_crc32_u64(_r, in);
+        _r = crc32_detail::step(_r, uint64_t(in));
     }
     void process(uint64_t in) {
-        _r = _mm_crc32_u64(_r, in);
+        _r = crc32_detail::step(_r, uint64_t(in));
     }
     void process(const uint8_t* in, size_t size) {
         if ((reinterpret_cast<uintptr_t>(in) & 1) && size >= 1) {
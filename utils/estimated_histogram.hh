@@ -41,6 +41,7 @@
 
 #pragma once
 
+#include <cassert>
 #include <cmath>
 #include <algorithm>
 #include <vector>
@@ -280,33 +281,29 @@ struct estimated_histogram {
         return 0;
     }
 
+#endif
+
     /**
      * @param percentile
-     * @return estimated value at given percentile
+     * @return estimated value at given percentile. Values which overflowed
+     * the histogram count as the largest offset.
      */
-    public long percentile(double percentile)
-    {
-        assert percentile >= 0 && percentile <= 1.0;
-        int lastBucket = buckets.length() - 1;
-        if (buckets.get(lastBucket) > 0)
-            throw new IllegalStateException("Unable to compute when histogram overflowed");
-
-        long pcount = (long) Math.floor(count() * percentile);
-        if (pcount == 0)
+    int64_t percentile(double percentile) const {
+        assert(percentile >= 0 && percentile <= 1.0);
+        int64_t pcount = std::floor(count() * percentile);
+        if (pcount == 0) {
             return 0;
-
-        long elements = 0;
-        for (int i = 0; i < lastBucket; i++)
-        {
-            elements += buckets.get(i);
-            if (elements >= pcount)
-                return bucketOffsets[i];
         }
-        return 0;
+        int64_t elements = 0;
+        for (size_t i = 0; i < bucket_offsets.size(); i++) {
+            elements += buckets[i];
+            if (elements >= pcount) {
+                return bucket_offsets[i];
+            }
+        }
+        return bucket_offsets.back();
     }
 
-#endif
-
     /**
      * @return the mean histogram value (average of bucket offsets, weighted by count)
      */
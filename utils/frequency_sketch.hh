@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include "utils/count_min_sketch.hh"
+
+namespace utils {
+
+// Estimates how often items occur in a stream, in constant memory, using a
+// Count-Min sketch with small saturating counters, as in TinyLFU (Einziger,
+// Friedman, Manes: "TinyLFU: A Highly Efficient Cache Admission Policy").
+//
+// Each item is counted in one counter of each of the rows, and its estimate
+// is the smallest of them, so it may be an overestimate due to collisions
+// but never an underestimate, until aging. Once as many items were counted
+// as ten times the number of counters of a row, all counters are halved, so
+// that the estimates reflect recent history rather than all of it.
+//
+// Items are given by their hashes, which should be well mixed.
+class frequency_sketch {
+public:
+    using count_type = uint8_t;
+    static constexpr count_type max_count = 15;
+    static constexpr unsigned rows = count_min_sketch<count_type>::rows;
+private:
+    count_min_sketch<count_type> _sketch;
+    uint64_t _additions = 0;
+    uint64_t _sample_size;
+private:
+    void age() {
+        _sketch.for_each_counter([] (count_type& c) {
+            c >>= 1;
+        });
+        _additions /= 2;
+    }
+public:
+    // The number of counters in each row is width rounded up to a power of 2.
+    explicit frequency_sketch(size_t width = 4096)
+        : _sketch(width)
+        , _sample_size(10 * _sketch.width()) {
+    }
+
+    void increment(uint64_t hash) {
+        bool added = false;
+        for (auto c : _sketch.counters(hash)) {
+            if (*c < max_count) {
+                ++*c;
+                added = true;
+            }
+        }
+        if (added && ++_additions == _sample_size) {
+            age();
+        }
+    }
+
+    count_type estimate(uint64_t hash) const {
+        return _sketch.estimate(hash);
+    }
+
+    void clear() {
+        _sketch.clear();
+        _additions = 0;
+    }
+
+    size_t width() const { return _sketch.width(); }
+    uint64_t sample_size() const { return _sample_size; }
+};
+
+}
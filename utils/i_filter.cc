@@ -52,6 +52,23 @@ filter_ptr i_filter::get_filter(int64_t num_elements, int target_buckets_per_ele
     return filter::create_filter(spec.K, num_elements, spec.buckets_per_element);
 }
 
+filter_ptr i_filter::get_blocked_filter(int64_t num_elements, double max_false_pos_probability) {
+    if (max_false_pos_probability > 1.0) {
+        throw std::invalid_argument(sprint("Invalid probability %f: must be lower than 1.0", max_false_pos_probability));
+    }
+
+    if (max_false_pos_probability == 1.0) {
+        return std::make_unique<filter::always_present_filter>();
+    }
+
+    int buckets_per_element = bloom_calculations::max_buckets_per_element(num_elements);
+    auto spec = bloom_calculations::compute_bloom_spec(buckets_per_element, max_false_pos_probability);
+    // Keys cluster unevenly across blocks, which costs somewhat in the false
+    // positive rate. One extra bucket per element more than makes up for it
+    // at the usual rates.
+    return filter::create_blocked_filter(spec.K, num_elements, spec.buckets_per_element + 1);
+}
+
 hashed_key make_hashed_key(bytes_view b) {
     std::array<uint64_t, 2> h;
     utils::murmur_hash::hash3_x64_128(b, 0, h);
@@ -71,6 +71,9 @@ struct i_filter {
 
     virtual size_t memory_size() = 0;
 
+    // Upper bound on the number of cache lines a single lookup touches.
+    virtual unsigned probe_cost() const = 0;
+
     /**
      * @return The smallest bloom_filter that can provide the given false
      *         positive probability rate for the given number of elements.
@@ -84,5 +87,11 @@ struct i_filter {
      *         probability for the given number of elements.
      */
     static filter_ptr get_filter(int64_t num_elements, int target_buckets_per_elem);
+    /**
+     * @return A cache-line-blocked bloom_filter for the given number of
+     *         elements, which provides about the given false positive
+     *         probability.
+     */
+    static filter_ptr get_blocked_filter(int64_t num_elements, double max_false_pos_prob);
 };
 }
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "core/shared_ptr.hh"
+#include "seastarx.hh"
+
+namespace utils {
+
+// A collection of values, each with a closed interval of keys, which finds
+// the values whose intervals overlap a given one while visiting only
+// O(log n) intervals which don't.
+//
+// The intervals are kept in a treap ordered by their start, in which each
+// node remembers the largest end in its subtree. A lookup skips the subtrees
+// which end before the interval it looks for, and those which start after it.
+//
+// The tree is persistent: nodes are never modified once built, and changes
+// rebuild only the O(log n) nodes on the paths to the changed ones, sharing
+// the rest with the previous version. So copying a tree takes constant time,
+// and the copies can be changed independently of each other, which lets
+// readers hold on to a version while newer ones are made.
+template<typename Key, typename Value, typename Less = std::less<Key>>
+class interval_tree {
+    struct node;
+    using node_ptr = lw_shared_ptr<node>;
+    struct node {
+        Key start;
+        Key end;
+        Value value;
+        // The largest end in the subtree of this node.
+        Key max_end;
+        uint32_t priority;
+        node_ptr left;
+        node_ptr right;
+    };
+    node_ptr _root;
+    size_t _size = 0;
+    Less _less;
+private:
+    static uint32_t random_priority() {
+        static thread_local std::minstd_rand rng;
+        return rng();
+    }
+
+    const Key& max(const Key& a, const Key& b) const {
+        return _less(a, b) ? b : a;
+    }
+
+    // A copy of n with the given children.
+    node_ptr make(const node& n, node_ptr left, node_ptr right) const {
+        auto max_end = n.end;
+        if (left) {
+            max_end = max(max_end, left->max_end);
+        }
+        if (right) {
+            max_end = max(max_end, right->max_end);
+        }
+        return make_lw_shared<node>(node{n.start, n.end, n.value, std::move(max_end), n.priority, std::move(left), std::move(right)});
+    }
+
+    // Splits t into the nodes which start at or before key, and those which
+    // start after it.
+    std::pair<node_ptr, node_ptr> split(const node_ptr& t, const Key& key) const {
+        if (!t) {
+            return { };
+        }
+        if (_less(key, t->start)) {
+            auto p = split(t->left, key);
+            return { std::move(p.first), make(*t, std::move(p.second), t->right) };
+        }
+        auto p = split(t->right, key);
+        return { make(*t, t->left, std::move(p.first)), std::move(p.second) };
+    }
+
+    // Requires: the nodes of a start at or before those of b.
+    node_ptr merge(const node_ptr& a, const node_ptr& b) const {
+        if (!a) {
+            return b;
+        }
+        if (!b) {
+            return a;
+        }
+        if (a->priority > b->priority) {
+            return make(*a, a->left, merge(a->right, b));
+        }
+        return make(*b, merge(a, b->left), b->right);
+    }
+
+    // Returns t without the nodes which start at start and hold value,
+    // counting them in erased.
+    node_ptr erase(const node_ptr& t, const Key& start, const Value& value, size_t& erased) const {
+        if (!t) {
+            return t;
+        }
+        if (_less(start, t->start)) {
+            auto left = erase(t->left, start, value, erased);
+            return left.get() == t->left.get() ? t : make(*t, std::move(left), t->right);
+        }
+        if (_less(t->start, start)) {
+            auto right = erase(t->right, start, value, erased);
+            return right.get() == t->right.get() ? t : make(*t, t->left, std::move(right));
+        }
+        // Nodes with the same start may be on both sides.
+        auto left = erase(t->left, start, value, erased);
+        auto right = erase(t->right, start, value, erased);
+        if (t->value == value) {
+            ++erased;
+            return merge(left, right);
+        }
+        if (left.get() == t->left.get() && right.get() == t->right.get()) {
+            return t;
+        }
+        return make(*t, std::move(left), std::move(right));
+    }
+
+    template<typename Func>
+    void visit(const node* t, const Key& start, const Key& end, Func& func) const {
+        while (t) {
+            if (_less(t->max_end, start)) {
+                return;
+            }
+            visit(t->left.get(), start, end, func);
+            if (_less(end, t->start)) {
+                return;
+            }
+            if (!_less(t->end, start)) {
+                func(t->value);
+            }
+            t = t->right.get();
+        }
+    }
+
+    template<typename Func>
+    static void visit_all(const node* t, Func& func) {
+        while (t) {
+            visit_all(t->left.get(), func);
+            func(*t);
+            t = t->right.get();
+        }
+    }
+public:
+    explicit interval_tree(Less less = Less())
+        : _less(std::move(less))
+    { }
+
+    // Adds value with the interval [start, end], after the values with
+    // intervals starting at the same key.
+    void insert(Key start, Key end, Value value) {
+        auto p = split(_root, start);
+        auto max_end = end;
+        auto n = make_lw_shared<node>(node{std::move(start), std::move(end), std::move(value), std::move(max_end), random_priority(), { }, { }});
+        _root = merge(merge(p.first, n), p.second);
+        ++_size;
+    }
+
+    // Removes the values equal to value with intervals starting at start.
+    // Returns whether there were any.
+    bool erase(const Key& start, const Value& value) {
+        size_t erased = 0;
+        _root = erase(_root, start, value, erased);
+        _size -= erased;
+        return erased;
+    }
+
+    // Removes the values equal to value. Returns whether there were any.
+    // Looks at all values, so prefer the overload taking the start of the
+    // interval when it's known.
+    bool erase(const Value& value) {
+        std::vector<Key> starts;
+        auto collect = [&] (const node& n) {
+            if (n.value == value) {
+                starts.push_back(n.start);
+            }
+        };
+        visit_all(_root.get(), collect);
+        for (auto&& start : starts) {
+            erase(start, value);
+        }
+        return !starts.empty();
+    }
+
+    // Calls func with each value whose interval overlaps [start, end], in
+    // the order of the starts of their intervals.
+    template<typename Func>
+    void for_each_overlapping(const Key& start, const Key& end, Func&& func) const {
+        visit(_root.get(), start, end, func);
+    }
+
+    std::vector<Value> overlapping(const Key& start, const Key& end) const {
+        std::vector<Value> ret;
+        for_each_overlapping(start, end, [&ret] (const Value& v) {
+            ret.push_back(v);
+        });
+        return ret;
+    }
+
+    // Returns the smallest start of an interval which is after key, or
+    // nullptr if there's none. The pointer is valid as long as this tree,
+    // or a copy of it, is neither changed nor destroyed.
+    const Key* first_start_after(const Key& key) const {
+        const Key* ret = nullptr;
+        for (auto t = _root.get(); t;) {
+            if (_less(key, t->start)) {
+                ret = &t->start;
+                t = t->left.get();
+            } else {
+                t = t->right.get();
+            }
+        }
+        return ret;
+    }
+
+    // Calls func with each value, in the order of the starts of their intervals.
+    template<typename Func>
+    void for_each(Func&& func) const {
+        auto visitor = [&func] (const node& n) {
+            func(n.value);
+        };
+        visit_all(_root.get(), visitor);
+    }
+
+    std::vector<Value> values() const {
+        std::vector<Value> ret;
+        ret.reserve(_size);
+        for_each([&ret] (const Value& v) {
+            ret.push_back(v);
+        });
+        return ret;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return !_root;
+    }
+};
+
+}
@@ -82,6 +82,16 @@ class large_bitset {
         _storage[idx1][idx2] &= ~(int_type(1) << idx3);
     }
     void clear();
+    // Direct access to the underlying words. The storage is fragmented, but
+    // words are contiguous within each 128k fragment, so any naturally
+    // aligned group of up to 16384 words can be accessed through the
+    // returned pointer.
+    int_type* words_at(size_t int_idx) {
+        return _storage[int_idx / ints_per_block()].get() + int_idx % ints_per_block();
+    }
+    const int_type* words_at(size_t int_idx) const {
+        return _storage[int_idx / ints_per_block()].get() + int_idx % ints_per_block();
+    }
     // load data from host bitmap (in host byte order); returns end bit position
     template <typename IntegerIterator>
     size_t load(IntegerIterator start, IntegerIterator finish, size_t position = 0);
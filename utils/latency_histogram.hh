@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include "utils/log_histogram.hh"
+
+namespace utils {
+
+// Latencies are counted in microseconds, from 1us to about 33s, in 4
+// sub-buckets per power of two, so a bucket is at most 25% wide.
+constexpr log_histogram_options latency_histogram_options{1, 2, 1 << 25};
+
+// A histogram of latencies with buckets laid out as in log_histogram, kept
+// in a fixed array of counters. It doesn't allocate, neither to count nor to
+// be merged with another, so that the histograms of all the tables of all the
+// shards can be added up cheaply.
+class latency_histogram {
+public:
+    static constexpr size_t bucket_count = latency_histogram_options.number_of_buckets();
+    using duration = std::chrono::steady_clock::duration;
+private:
+    static_assert(latency_histogram_options.min_size == 1, "bucket_upper_bound() assumes that only 0 is below min_size");
+    static constexpr size_t sub_bucket_shift = latency_histogram_options.sub_bucket_shift;
+    static constexpr size_t sub_bucket_mask = (size_t(1) << sub_bucket_shift) - 1;
+
+    std::array<uint64_t, bucket_count> _buckets{};
+    uint64_t _count = 0;
+    uint64_t _sum = 0;
+    uint64_t _max = 0;
+public:
+    static size_t bucket_of(uint64_t us) {
+        return latency_histogram_options.bucket_of(std::min<uint64_t>(us, latency_histogram_options.max_size));
+    }
+
+    // Returns the largest latency, in microseconds, counted in bucket i.
+    static uint64_t bucket_upper_bound(size_t i) {
+        if (i == 0) {
+            return 0;
+        }
+        auto t = i + sub_bucket_mask;
+        auto pow2_index = (t >> sub_bucket_shift) - 1;
+        auto sub_bucket_index = t & sub_bucket_mask;
+        if (pow2_index < sub_bucket_shift) {
+            // Powers of two smaller than the number of sub-buckets don't use
+            // all of them, and each value has its own.
+            return (uint64_t(1) << pow2_index) + (sub_bucket_index >> (sub_bucket_shift - pow2_index));
+        }
+        return (uint64_t(1) << pow2_index) + (uint64_t(sub_bucket_index + 1) << (pow2_index - sub_bucket_shift)) - 1;
+    }
+
+    void add(uint64_t us, uint64_t n = 1) {
+        _buckets[bucket_of(us)] += n;
+        _count += n;
+        _sum += us * n;
+        _max = std::max(_max, us);
+    }
+
+    // Counts a sampled latency, as estimated_histogram::add() does: the
+    // operations which weren't sampled since the last one are assumed to
+    // have taken as long, so that count() ends up being new_count.
+    void add(duration latency, uint64_t new_count) {
+        if (new_count <= _count) {
+            return;
+        }
+        add(std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), new_count - _count);
+    }
+
+    latency_histogram& operator+=(const latency_histogram& o) {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            _buckets[i] += o._buckets[i];
+        }
+        _count += o._count;
+        _sum += o._sum;
+        _max = std::max(_max, o._max);
+        return *this;
+    }
+
+    uint64_t count() const {
+        return _count;
+    }
+    // In microseconds.
+    uint64_t sum() const {
+        return _sum;
+    }
+    uint64_t max() const {
+        return _max;
+    }
+    double mean() const {
+        return _count ? double(_sum) / _count : 0;
+    }
+    // Returns an upper bound of the latency below which a fraction q of the
+    // operations completed, in microseconds.
+    uint64_t quantile(double q) const {
+        uint64_t target = q * _count;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += _buckets[i];
+            if (seen > target || (seen == _count && _buckets[i])) {
+                return std::min(bucket_upper_bound(i), _max);
+            }
+        }
+        return 0;
+    }
+    const std::array<uint64_t, bucket_count>& buckets() const {
+        return _buckets;
+    }
+    void clear() {
+        _buckets.fill(0);
+        _count = 0;
+        _sum = 0;
+        _max = 0;
+    }
+};
+
+}
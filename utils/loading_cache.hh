@@ -23,9 +23,12 @@
 
 #include <chrono>
 #include <unordered_map>
+#include <experimental/optional>
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/unordered_set.hpp>
+#include <boost/range/irange.hpp>
 
+#include <seastar/core/gate.hh>
 #include <seastar/core/timer.hh>
 
 #include "utils/exceptions.hh"
@@ -51,6 +54,7 @@ class timestamped_val : public auto_unlink_list_hook, public bi::unordered_set_b
     loading_cache_clock_type::time_point _last_read;
     lru_list_type& _lru_list; /// MRU item is at the front, LRU - at the back
     Key _key;
+    bool _reloading = false;
 
 public:
     struct key_eq {
@@ -112,6 +116,15 @@ class timestamped_val : public auto_unlink_list_hook, public bi::unordered_set_b
         return _key;
     }
 
+    /// Whether a background reload of the value is in progress.
+    bool reloading() const noexcept {
+        return _reloading;
+    }
+
+    void set_reloading(bool reloading) noexcept {
+        _reloading = reloading;
+    }
+
     friend bool operator==(const timestamped_val& a, const timestamped_val& b){
         return EqualPred()(a.key(), b.key());
     }
@@ -161,16 +174,34 @@ class loading_cache {
     typedef Tp value_type;
     typedef Key key_type;
     typedef typename set_type::iterator iterator;
-
+    /// The values reloaded for a list of keys, in the same order. A
+    /// disengaged value means that the key failed to reload.
+    typedef std::vector<std::experimental::optional<Tp>> reload_result_type;
+
+    /// Values are loaded with load() the first time they are asked for, and
+    /// then reloaded in the background, while their old value is served,
+    /// before they are older than refresh. Values which haven't been read for
+    /// expiry, or which kept failing to reload for that long, are dropped.
     template<typename Func>
     loading_cache(size_t max_size, std::chrono::milliseconds expiry, std::chrono::milliseconds refresh, logging::logger& logger, Func&& load)
+                : loading_cache(max_size, expiry, refresh, logger, std::forward<Func>(load), nullptr) {
+    }
+
+    /// Like the above, with the background reloads going through
+    /// reload(const std::vector<Key>&), which gets all the keys due for a
+    /// reload at once, so that it may batch them. The keys remain alive until
+    /// the returned future resolves.
+    template<typename Func, typename ReloadFunc>
+    loading_cache(size_t max_size, std::chrono::milliseconds expiry, std::chrono::milliseconds refresh, logging::logger& logger, Func&& load, ReloadFunc&& reload)
                 : _buckets(initial_num_buckets)
                 , _set(bi_set_bucket_traits(_buckets.data(), _buckets.size()))
                 , _max_size(max_size)
                 , _expiry(expiry)
                 , _refresh(refresh)
+                , _timer_period(std::max(std::min(refresh, expiry) / 2, std::chrono::milliseconds(1)))
                 , _logger(logger)
-                , _load(std::forward<Func>(load)) {
+                , _load(std::forward<Func>(load))
+                , _reload(std::forward<ReloadFunc>(reload)) {
 
         // If expiration period is zero - caching is disabled
         if (!caching_enabled()) {
@@ -183,13 +214,19 @@ class loading_cache {
         }
 
         _timer.set_callback([this] { on_timer(); });
-        _timer.arm(_refresh);
+        _timer.arm(_timer_period);
     }
 
     ~loading_cache() {
         _set.clear_and_dispose([] (ts_value_type* ptr) { loading_cache::destroy_ts_value(ptr); });
     }
 
+    /// Waits for the background reloads in progress, and stops starting new ones.
+    future<> stop() {
+        _timer.cancel();
+        return _reloads.close();
+    }
+
     future<Tp> get(const Key& k) {
         // If caching is disabled - always load in the foreground
         if (!caching_enabled()) {
@@ -259,20 +296,68 @@ class loading_cache {
         }).finally([sm] {});
     }
 
-    future<> reload(ts_value_type& ts_val) {
-        return _load(ts_val.key()).then_wrapped([this, &ts_val] (auto&& f) {
+    future<reload_result_type> reload_each(const std::vector<Key>& keys) {
+        auto result = make_lw_shared<reload_result_type>(keys.size());
+        auto idx = boost::irange<size_t>(0, keys.size());
+        return parallel_for_each(idx.begin(), idx.end(), [this, &keys, result] (size_t i) {
+            return _load(keys[i]).then([result, i] (Tp t) {
+                (*result)[i] = std::move(t);
+            });
+        }).then_wrapped([this, result] (future<> f) {
+            try {
+                f.get();
+            } catch (std::exception& e) {
+                _logger.debug("reload failed: {}", e.what());
+            } catch (...) {
+                _logger.debug("reload failed: unknown error");
+            }
+            return std::move(*result);
+        });
+    }
+
+    // Reloads, in one go, the values which would get older than _refresh
+    // before the next timer tick.
+    future<> reload_due(loading_cache_clock_type::time_point now) {
+        auto keys = make_lw_shared<std::vector<Key>>();
+        for (auto& ts_val : _set) {
+            _logger.trace("on_timer(): {}: checking the value age", ts_val.key());
+            if (ts_val && !ts_val.reloading() && ts_val.loaded() + _refresh <= now + _timer_period) {
+                _logger.trace("on_timer(): {}: reloading the value", ts_val.key());
+                ts_val.set_reloading(true);
+                keys->push_back(ts_val.key());
+            }
+        }
+        if (keys->empty()) {
+            return make_ready_future<>();
+        }
+        auto f = _reload ? _reload(*keys) : reload_each(*keys);
+        return f.then_wrapped([this, keys] (future<reload_result_type> f) {
             // The exceptions are related to the load operation itself.
             // We should ignore them for the background reads - if
             // they persist the value will age and will be reloaded in
             // the forground. If the foreground READ fails the error
             // will be propagated up to the user and will fail the
             // corresponding query.
+            reload_result_type values;
             try {
-                ts_val = f.get0();
+                values = f.get0();
             } catch (std::exception& e) {
-                _logger.debug("{}: reload failed: {}", ts_val.key(), e.what());
+                _logger.debug("reload of {} values failed: {}", keys->size(), e.what());
             } catch (...) {
-                _logger.debug("{}: reload failed: unknown error", ts_val.key());
+                _logger.debug("reload of {} values failed: unknown error", keys->size());
+            }
+            for (size_t i = 0; i < keys->size(); ++i) {
+                // The value may have been evicted while it was reloading.
+                auto it = _set.find((*keys)[i], Hash(), typename ts_value_type::key_eq());
+                if (it == _set.end()) {
+                    continue;
+                }
+                it->set_reloading(false);
+                if (i < values.size() && values[i]) {
+                    *it = std::move(*values[i]);
+                } else {
+                    _logger.debug("{}: reload failed", (*keys)[i]);
+                }
             }
         });
     }
@@ -354,17 +439,14 @@ class loading_cache {
         // check if rehashing is needed and do it if it is.
         rehash();
 
-        // Reload all those which vlaue needs to be reloaded.
-        parallel_for_each(_set.begin(), _set.end(), [this, curr_time = timer_start_tp] (auto& ts_val) {
-            _logger.trace("on_timer(): {}: checking the value age", ts_val.key());
-            if (ts_val && ts_val.loaded() + _refresh < curr_time) {
-                _logger.trace("on_timer(): {}: reloading the value", ts_val.key());
-                return this->reload(ts_val);
-            }
-            return now();
-        }).finally([this, timer_start_tp] {
-            _logger.trace("on_timer(): rearming");
-            _timer.arm(timer_start_tp + _refresh);
+        // Reload all those which value needs to be reloaded.
+        with_gate(_reloads, [this, timer_start_tp] {
+            return reload_due(timer_start_tp).finally([this, timer_start_tp] {
+                if (!_reloads.is_closed()) {
+                    _logger.trace("on_timer(): rearming");
+                    _timer.arm(timer_start_tp + _timer_period);
+                }
+            });
         });
     }
 
@@ -376,9 +458,12 @@ class loading_cache {
     size_t _max_size;
     std::chrono::milliseconds _expiry;
     std::chrono::milliseconds _refresh;
+    std::chrono::milliseconds _timer_period;
     logging::logger& _logger;
     std::function<future<Tp>(const Key&)> _load;
+    std::function<future<reload_result_type>(const std::vector<Key>&)> _reload;
     timer<lowres_clock> _timer;
+    seastar::gate _reloads;
 };
 
 }
@@ -28,6 +28,7 @@
 #include <boost/intrusive/slist.hpp>
 #include <boost/range/adaptors.hpp>
 #include <stack>
+#include <sys/mman.h>
 
 #include <seastar/core/memory.hh>
 #include <seastar/core/align.hh>
@@ -38,6 +39,7 @@
 #include "log.hh"
 #include "utils/dynamic_bitset.hh"
 #include "utils/log_histogram.hh"
+#include "utils/stall_detector.hh"
 
 namespace bi = boost::intrusive;
 
@@ -85,6 +87,10 @@ class tracker::impl {
     bool _reclaiming_enabled = true;
     size_t _reclamation_step = 1;
     bool _abort_on_bad_alloc = false;
+    timer<clock> _background_reclaim_timer;
+    size_t _background_reclaim_target = 0;
+    clock::duration _background_reclaim_budget;
+    uint64_t _background_reclaimed_bytes = 0;
 private:
     // Prevents tracker's reclaimer from running while live. Reclaimer may be
     // invoked synchronously with allocator. This guard ensures that this
@@ -112,6 +118,9 @@ class tracker::impl {
     reactor::idle_cpu_handler_result compact_on_idle(reactor::work_waiting_on_reactor check_for_work);
     size_t compact_and_evict(size_t bytes);
     size_t compact_and_evict_locked(size_t bytes);
+    void start_background_reclaim(size_t free_memory_target, float cpu_fraction);
+    void stop_background_reclaim() { _background_reclaim_timer.cancel(); }
+    void background_reclaim();
     void full_compaction();
     void reclaim_all_free_segments();
     occupancy_stats region_occupancy();
@@ -144,6 +153,14 @@ reactor::idle_cpu_handler_result tracker::compact_on_idle(reactor::work_waiting_
     return _impl->compact_on_idle(check_for_work);
 }
 
+void tracker::start_background_reclaim(size_t free_memory_target, float cpu_fraction) {
+    _impl->start_background_reclaim(free_memory_target, cpu_fraction);
+}
+
+void tracker::stop_background_reclaim() {
+    _impl->stop_background_reclaim();
+}
+
 occupancy_stats tracker::region_occupancy() {
     return _impl->region_occupancy();
 }
@@ -197,6 +214,8 @@ struct segment {
 
 class segment_zone;
 
+static constexpr size_t huge_page_size = 2 << 20;
+
 static constexpr size_t max_managed_object_size = segment_size * 0.1;
 static constexpr size_t max_used_space_for_compaction = segment_size * 0.85;
 static constexpr size_t min_free_space_for_compaction = segment_size - max_used_space_for_compaction;
@@ -210,10 +229,14 @@ static_assert(min_free_space_for_compaction >= max_managed_object_size,
 extern constexpr log_histogram_options segment_descriptor_hist_options(min_free_space_for_compaction, 3, segment_size);
 
 struct segment_descriptor : public log_histogram_hook<segment_descriptor_hist_options> {
+    using age_link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+
     bool _lsa_managed;
     segment::size_type _free_space;
     region::impl* _region;
     segment_zone* _zone;
+    // Links closed segments of a region in the order they were closed in.
+    age_link_type _age_link;
 
     segment_descriptor()
         : _lsa_managed(false), _region(nullptr)
@@ -238,6 +261,10 @@ struct segment_descriptor : public log_histogram_hook<segment_descriptor_hist_op
 
 using segment_descriptor_hist = log_histogram<segment_descriptor, segment_descriptor_hist_options>;
 
+using segment_age_list = bi::list<segment_descriptor,
+    bi::member_hook<segment_descriptor, segment_descriptor::age_link_type, &segment_descriptor::_age_link>,
+    bi::constant_time_size<false>>;
+
 #ifndef DEFAULT_ALLOCATOR
 
 struct free_segment : public boost::intrusive::list_base_hook<> {
@@ -359,6 +386,12 @@ class segment_zone : public bi::set_base_hook<>, public bi::slist_base_hook<> {
 
     bool empty() const { return !used_segment_count(); }
     size_t segment_count() const { return _segments.size(); }
+    // The part of the zone made of whole, aligned huge pages.
+    size_t huge_page_memory() const {
+        auto start = align_up(reinterpret_cast<uintptr_t>(_base), uintptr_t(huge_page_size));
+        auto end = align_down(reinterpret_cast<uintptr_t>(_base + segment_count()), uintptr_t(huge_page_size));
+        return end > start ? end - start : 0;
+    }
     size_t used_segment_count() const { return _used_segment_count; }
     size_t free_segment_count() const { return _segments.size() - _used_segment_count; }
 
@@ -381,7 +414,16 @@ std::unique_ptr<segment_zone> segment_zone::try_creating_zone()
             continue;
         }
         memory::disable_abort_on_alloc_failure_temporarily no_abort_guard;
-        auto ptr = aligned_alloc(segment::size, size << segment::size_shift);
+        // Zones are aligned to huge pages, if possible, so that they are made
+        // of whole ones and can be backed by transparent huge pages, unless
+        // the memory is backed by hugetlbfs already. Seastar's allocator
+        // keeps the memory of each shard local to its NUMA node.
+        auto ptr = aligned_alloc(huge_page_size, size << segment::size_shift);
+        if (ptr) {
+            ::madvise(ptr, size << segment::size_shift, MADV_HUGEPAGE);
+        } else {
+            ptr = aligned_alloc(segment::size, size << segment::size_shift);
+        }
         if (!ptr) {
             continue;
         }
@@ -522,14 +564,26 @@ class segment_pool {
     struct stats {
         size_t segments_migrated;
         size_t segments_compacted;
+        size_t segments_evicted;
+        size_t segments_partially_evicted;
     };
 private:
     stats _stats{};
 public:
     size_t zone_count() const { return _all_zones.size(); }
+    huge_page_coverage huge_pages() const {
+        huge_page_coverage hp{};
+        for (auto&& zone : _all_zones) {
+            hp.total_bytes += zone.segment_count() * segment::size;
+            hp.huge_page_bytes += zone.huge_page_memory();
+        }
+        return hp;
+    }
     const stats& statistics() const { return _stats; }
     void on_segment_migration() { _stats.segments_migrated++; }
     void on_segment_compaction() { _stats.segments_compacted++; }
+    void on_segment_eviction() { _stats.segments_evicted++; }
+    void on_partial_segment_eviction() { _stats.segments_partially_evicted++; }
     size_t free_segments_in_zones() const { return _free_segments_in_zones; }
     size_t free_segments() const { return _free_segments_in_zones + _emergency_reserve.size(); }
 };
@@ -858,14 +912,19 @@ class segment_pool {
     struct stats {
         size_t segments_migrated;
         size_t segments_compacted;
+        size_t segments_evicted;
+        size_t segments_partially_evicted;
     };
 private:
     stats _stats{};
 public:
     size_t zone_count() const { return 0; }
+    huge_page_coverage huge_pages() const { return {}; }
     const stats& statistics() const { return _stats; }
     void on_segment_migration() { _stats.segments_migrated++; }
     void on_segment_compaction() { _stats.segments_compacted++; }
+    void on_segment_eviction() { _stats.segments_evicted++; }
+    void on_partial_segment_eviction() { _stats.segments_partially_evicted++; }
     size_t free_segments_in_zones() const { return 0; }
     size_t free_segments() const { return 0; }
 public:
@@ -1065,6 +1124,8 @@ class region_impl : public allocation_strategy {
     segment* _active = nullptr;
     size_t _active_offset;
     segment_descriptor_hist _segment_descs; // Contains only closed segments
+    // Closed segments, least recently closed first.
+    segment_age_list _segments_by_age;
     occupancy_stats _closed_occupancy;
     occupancy_stats _non_lsa_occupancy;
     // This helps us keeping track of the region_group* heap. That's because we call update before
@@ -1079,6 +1140,10 @@ class region_impl : public allocation_strategy {
     uint64_t _id;
     uint64_t _reclaim_counter = 0;
     eviction_fn _eviction_fn;
+    object_eviction_fn _object_eviction_fn;
+    // The segment being evicted by evict_oldest_segment(), which objects
+    // freed from are not accounted in _segment_descs and _closed_occupancy.
+    segment* _evicted_segment = nullptr;
 
     region_group::region_heap::handle_type _heap_handle;
 private:
@@ -1152,7 +1217,9 @@ class region_impl : public allocation_strategy {
         llogger.trace("Closing segment {}, used={}, waste={} [B]", _active, _active->occupancy(), segment::size - _active_offset);
         _closed_occupancy += _active->occupancy();
 
-        _segment_descs.push(shard_segment_pool.descriptor(_active));
+        auto& desc = shard_segment_pool.descriptor(_active);
+        _segment_descs.push(desc);
+        _segments_by_age.push_back(desc);
         _active = nullptr;
     }
 
@@ -1165,6 +1232,9 @@ class region_impl : public allocation_strategy {
     }
 
     void free_segment(segment* seg, segment_descriptor& desc) noexcept {
+        if (desc._age_link.is_linked()) {
+            desc._age_link.unlink();
+        }
         shard_segment_pool.free_segment(seg, desc);
         if (_group) {
             _evictable_space -= segment_size;
@@ -1340,6 +1410,11 @@ class region_impl : public allocation_strategy {
         auto npos = const_cast<char*>(pos);
         desc.encode(npos);
 
+        if (seg == _evicted_segment) {
+            seg_desc.record_free(dead_size);
+            return;
+        }
+
         if (seg != _active) {
             _closed_occupancy -= seg->occupancy();
         }
@@ -1397,6 +1472,9 @@ class region_impl : public allocation_strategy {
             shard_segment_pool.set_region(desc, this);
         }
         _segment_descs.merge(other._segment_descs);
+        // Ages of the segments of both regions are not interleaved, which
+        // is good enough for an approximation.
+        _segments_by_age.splice(_segments_by_age.end(), other._segments_by_age);
 
         _closed_occupancy += other._closed_occupancy;
         _non_lsa_occupancy += other._non_lsa_occupancy;
@@ -1438,6 +1516,7 @@ class region_impl : public allocation_strategy {
         if (src != _active) {
             _segment_descs.erase(src_desc);
             _segment_descs.push(dst_desc);
+            dst_desc._age_link.swap_nodes(src_desc._age_link);
             segment_size = segment::size;
         } else {
             _active = dst;
@@ -1516,6 +1595,49 @@ class region_impl : public allocation_strategy {
         _eviction_fn = std::move(fn);
     }
 
+    void make_segment_evictable(object_eviction_fn fn) {
+        _object_eviction_fn = std::move(fn);
+    }
+
+    // Returns true if evict_oldest_segment() should be tried before evict_some().
+    bool is_segment_evictable() const {
+        return is_evictable() && bool(_object_eviction_fn) && !_segments_by_age.empty();
+    }
+
+    // Evicts all objects of the least recently closed segment and frees it.
+    // Objects which the object eviction function leaves alone are moved
+    // elsewhere, as in compaction. Returns reclaimed_nothing if none of them
+    // could be evicted.
+    memory::reclaiming_result evict_oldest_segment() {
+        if (!_object_eviction_fn || _segments_by_age.empty()) {
+            return memory::reclaiming_result::reclaimed_nothing;
+        }
+        compaction_lock _(*this);
+        ++_reclaim_counter;
+        auto& desc = _segments_by_age.front();
+        _segment_descs.erase(desc);
+        _closed_occupancy -= desc.occupancy();
+        segment* seg = shard_segment_pool.segment_from(desc);
+        llogger.debug("Evicting segment {} from region {}, {}", seg, id(), seg->occupancy());
+        auto free_space = desc._free_space;
+        _evicted_segment = seg;
+        for_each_live(seg, [this] (const object_descriptor* desc, void* obj) {
+            _object_eviction_fn(desc->migrator(), obj);
+        });
+        _evicted_segment = nullptr;
+        bool evicted = desc._free_space != free_space;
+        if (desc.is_empty()) {
+            free_segment(seg, desc);
+            shard_segment_pool.on_segment_eviction();
+        } else {
+            compact(seg, desc);
+            if (evicted) {
+                shard_segment_pool.on_partial_segment_eviction();
+            }
+        }
+        return evicted ? memory::reclaiming_result::reclaimed_something : memory::reclaiming_result::reclaimed_nothing;
+    }
+
     const eviction_fn& evictor() const {
         return _eviction_fn;
     }
@@ -1639,6 +1761,17 @@ const eviction_fn& region::evictor() const {
     return _impl->evictor();
 }
 
+void region::make_segment_evictable(object_eviction_fn fn) {
+    _impl->make_segment_evictable(std::move(fn));
+}
+
+memory::reclaiming_result region::evict_oldest_segment() {
+    if (_impl->reclaiming_enabled()) {
+        return _impl->evict_oldest_segment();
+    }
+    return memory::reclaiming_result::reclaimed_nothing;
+}
+
 allocation_strategy& region::allocator() {
     return *_impl;
 }
@@ -1669,6 +1802,10 @@ occupancy_stats tracker::impl::region_occupancy() {
     return total;
 }
 
+huge_page_coverage tracker::huge_pages() const {
+    return shard_segment_pool.huge_pages();
+}
+
 occupancy_stats tracker::impl::occupancy() {
     reclaiming_lock _(*this);
     auto occ = region_occupancy();
@@ -1711,6 +1848,17 @@ static void reclaim_from_evictable(region::impl& r, size_t target_mem_in_use) {
         }
         auto used_target = used - std::min(used, deficit - std::min(deficit, occupancy.free_space()));
         llogger.debug("Evicting {} bytes from region {}, occupancy={}", used - used_target, r.id(), r.occupancy());
+        // Whole segments are freed without compaction, so stop once the
+        // target is met rather than when the region has become sparse. Once
+        // there's a segment with nothing to evict, the rest of the oldest
+        // ones were likely filled by compaction, so fall back to
+        // evict_some().
+        while (r.is_segment_evictable() && r.evict_oldest_segment() == memory::reclaiming_result::reclaimed_something) {
+            if (shard_segment_pool.total_memory_in_use() <= target_mem_in_use) {
+                llogger.debug("Target met after evicting {} bytes", used - r.occupancy().used_space());
+                return;
+            }
+        }
         while (r.occupancy().used_space() > used_target || !r.is_compactible()) {
             if (r.evict_some() == memory::reclaiming_result::reclaimed_nothing) {
                 llogger.debug("Unable to evict more, evicted {} bytes", used - r.occupancy().used_space());
@@ -1818,12 +1966,40 @@ size_t tracker::impl::reclaim(size_t memory_to_release) {
     return compact_and_evict_locked(memory_to_release - mem_released) + mem_released;
 }
 
+// How often the background reclaimer checks free memory.
+static constexpr auto background_reclaim_period = std::chrono::milliseconds(10);
+
+// Free memory as seen by allocations, which can take free segments in zones
+// without reclaiming anything.
+static size_t free_memory_for_allocations() {
+    return memory::stats().free_memory() + shard_segment_pool.free_segments_in_zones() * segment::size;
+}
+
+void tracker::impl::start_background_reclaim(size_t free_memory_target, float cpu_fraction) {
+    _background_reclaim_target = free_memory_target;
+    _background_reclaim_budget = std::chrono::duration_cast<clock::duration>(background_reclaim_period * cpu_fraction);
+    _background_reclaim_timer.set_callback([this] { background_reclaim(); });
+    _background_reclaim_timer.arm_periodic(background_reclaim_period);
+}
+
+void tracker::impl::background_reclaim() {
+    auto deadline = clock::now() + _background_reclaim_budget;
+    while (free_memory_for_allocations() < _background_reclaim_target && clock::now() < deadline) {
+        auto released = compact_and_evict(_reclamation_step * segment::size);
+        if (!released) {
+            break;
+        }
+        _background_reclaimed_bytes += released;
+    }
+}
+
 size_t tracker::impl::compact_and_evict(size_t memory_to_release) {
     if (!_reclaiming_enabled) {
         return 0;
     }
     reclaiming_lock rl(*this);
     reclaim_timer timing_guard;
+    utils::stall_context_scope stall_context(utils::stall_context::lsa_compaction);
     return compact_and_evict_locked(memory_to_release);
 }
 
@@ -2026,11 +2202,23 @@ tracker::impl::impl() {
         sm::make_gauge("zones", [this] { return shard_segment_pool.zone_count(); },
                        sm::description("Holds a current number of zones.")),
 
+        sm::make_gauge("huge_page_space_in_zones", [this] { return shard_segment_pool.huge_pages().huge_page_bytes; },
+                       sm::description("Holds a current amount of memory in zones made of whole, aligned huge pages.")),
+
         sm::make_derive("segments_migrated", [this] { return shard_segment_pool.statistics().segments_migrated; },
                         sm::description("Counts a number of migrated segments.")),
 
         sm::make_derive("segments_compacted", [this] { return shard_segment_pool.statistics().segments_compacted; },
                         sm::description("Counts a number of compacted segments.")),
+
+        sm::make_derive("segments_evicted", [this] { return shard_segment_pool.statistics().segments_evicted; },
+                        sm::description("Counts a number of segments freed by evicting all of their objects.")),
+
+        sm::make_derive("segments_partially_evicted", [this] { return shard_segment_pool.statistics().segments_partially_evicted; },
+                        sm::description("Counts a number of evicted segments which had objects that couldn't be evicted moved out of them.")),
+
+        sm::make_derive("background_reclaimed_bytes", [this] { return _background_reclaimed_bytes; },
+                        sm::description("Counts a number of bytes reclaimed in the background, ahead of allocations.")),
     });
 }
 
@@ -2056,6 +2244,25 @@ region* region_group::get_largest_region() {
     return _maximal_rg->_regions.top()->_region;
 }
 
+region* region_group::get_largest_region(const std::function<bool(region&)>& pred) {
+    region* largest = nullptr;
+    size_t largest_space = 0;
+    std::function<void(const region_group&)> visit = [&] (const region_group& rg) {
+        for (auto&& r : rg._regions) {
+            auto space = r->evictable_occupancy().total_space();
+            if ((!largest || space > largest_space) && pred(*r->_region)) {
+                largest = r->_region;
+                largest_space = space;
+            }
+        }
+        for (auto&& child : rg._subgroups) {
+            visit(*child);
+        }
+    };
+    visit(*this);
+    return largest;
+}
+
 void
 region_group::add(region_group* child) {
     child->_subgroup_heap_handle = _subgroups.push(child);
@@ -2097,10 +2304,9 @@ region_group::start_releaser() {
                 return make_ready_future<stop_iteration>(stop_iteration::yes);
             }
 
-            if (!_blocked_requests.empty() && execution_permitted()) {
-                auto req = std::move(_blocked_requests.front());
-                _blocked_requests.pop_front();
-                req->allocate();
+            if (_blocked_requests && execution_permitted()) {
+                auto req = pop_blocked_request();
+                req.func->allocate();
                 return make_ready_future<stop_iteration>(stop_iteration::no);
             } else {
                 // Block reclaiming to prevent signal() from being called by reclaimer inside wait()
@@ -2114,9 +2320,68 @@ region_group::start_releaser() {
     });
 }
 
+region_group::blocked_request region_group::pop_blocked_request() {
+    admission_class* next = nullptr;
+    auto i = _active_classes.begin();
+    while (i != _active_classes.end()) {
+        auto cls = *i;
+        if (cls->_blocked_requests.empty()) {
+            cls->_active = false;
+            i = _active_classes.erase(i);
+            continue;
+        }
+        if (!next || cls->_blocked_requests.front().finish_tag < next->_blocked_requests.front().finish_tag) {
+            next = cls;
+        }
+        ++i;
+    }
+    auto req = std::move(next->_blocked_requests.front());
+    next->_blocked_requests.pop_front();
+    --_blocked_requests;
+    _virtual_time = req.finish_tag;
+    auto waited = std::chrono::steady_clock::now() - req.queued_at;
+    next->_wait_time.add(std::chrono::duration_cast<std::chrono::microseconds>(waited).count());
+    return req;
+}
+
+region_group::admission_class::admission_class(region_group& rg, float weight)
+    : _group(rg)
+    , _weight(weight)
+{
+    assert(weight > 0);
+}
+
+region_group::admission_class::~admission_class() {
+    while (!_blocked_requests.empty()) {
+        _blocked_requests.front().func->fail(std::make_exception_ptr(std::runtime_error("admission class destroyed")));
+        _blocked_requests.pop_front();
+        --_group._blocked_requests;
+    }
+    if (_active) {
+        _group._active_classes.erase(boost::range::find(_group._active_classes, this));
+    }
+}
+
+void region_group::admission_class::set_weight(float weight) {
+    assert(weight > 0);
+    _weight = weight;
+}
+
+void region_group::admission_class::block(std::unique_ptr<allocating_function> func, size_t cost, timeout_clock::time_point timeout) {
+    _finish_tag = std::max(_finish_tag, _group._virtual_time) + cost / _weight;
+    _blocked_requests.push_back(blocked_request{std::move(func), this, _finish_tag, std::chrono::steady_clock::now()}, timeout);
+    ++_group._blocked_requests;
+    ++_group._blocked_requests_counter;
+    if (!_active) {
+        _active = true;
+        _group._active_classes.push_back(this);
+    }
+}
+
 region_group::region_group(region_group *parent, region_group_reclaimer& reclaimer)
     : _parent(parent)
     , _reclaimer(reclaimer)
+    , _default_class(*this)
     , _releaser(reclaimer_can_block() ? start_releaser() : make_ready_future<>())
 {
     if (_parent) {
@@ -2220,8 +2485,9 @@ void allocating_section::set_std_reserve(size_t reserve) {
     _std_reserve = reserve;
 }
 
-void region_group::on_request_expiry::operator()(std::unique_ptr<allocating_function>& func) noexcept {
-    func->fail(std::make_exception_ptr(timed_out_error()));
+void region_group::on_request_expiry::operator()(blocked_request& req) noexcept {
+    req.func->fail(std::make_exception_ptr(timed_out_error()));
+    --req.cls->_group._blocked_requests;
 }
 
 }
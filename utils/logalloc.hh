@@ -22,6 +22,7 @@
 #pragma once
 
 #include <memory>
+#include <functional>
 #include <seastar/core/memory.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/shared_ptr.hh>
@@ -31,6 +32,7 @@
 #include <seastar/core/circular_buffer.hh>
 #include <seastar/core/expiring_fifo.hh>
 #include "allocation_strategy.hh"
+#include "estimated_histogram.hh"
 #include <boost/heap/binomial_heap.hpp>
 #include "seastarx.hh"
 
@@ -53,6 +55,14 @@ constexpr size_t segment_size = 1 << segment_size_shift;
 //
 using eviction_fn = std::function<memory::reclaiming_result()>;
 
+//
+// Evicts a live object of a segment which is being evicted as a whole, along
+// with whatever has to go together with it, by freeing it from the region. May
+// leave the object alone if it can't be evicted; it will then be moved to
+// another segment as in compaction. Must not throw.
+//
+using object_eviction_fn = std::function<void(const migrate_fn_type*, void* obj)>;
+
 //
 // Users of a region_group can pass an instance of the class region_group_reclaimer, and specialize
 // its methods start_reclaiming() and stop_reclaiming(). Those methods will be called when the LSA
@@ -208,23 +218,85 @@ class region_group {
         }
     };
 
-    struct on_request_expiry {
-        void operator()(std::unique_ptr<allocating_function>&) noexcept;
+public:
+    class admission_class;
+private:
+    struct blocked_request {
+        std::unique_ptr<allocating_function> func;
+        admission_class* cls;
+        // The virtual time at which the request is due, see admission_class.
+        double finish_tag;
+        std::chrono::steady_clock::time_point queued_at;
     };
 
-    // It is a more common idiom to just hold the promises in the circular buffer and make them
-    // ready. However, in the time between the promise being made ready and the function execution,
-    // it could be that our memory usage went up again. To protect against that, we have to recheck
-    // if memory is still available after the future resolves.
+    struct on_request_expiry {
+        void operator()(blocked_request&) noexcept;
+    };
+public:
+    // A class of requests run through run_when_memory_available(), like the
+    // writes to one table.
     //
-    // But we can greatly simplify it if we store the function itself in the circular_buffer, and
-    // execute it synchronously in release_requests() when we are sure memory is available.
+    // While requests are blocked, each class with blocked requests gets a
+    // share of the released ones proportional to its weight, in terms of
+    // the cost of the requests. So a class issuing many large requests
+    // doesn't hold up the requests of other classes, which would happen if
+    // they were all released in FIFO order. Within a class, requests are
+    // released in FIFO order.
     //
-    // This allows us to easily provide strong execution guarantees while keeping all re-check
-    // complication in release_requests and keep the main request execution path simpler.
-    expiring_fifo<std::unique_ptr<allocating_function>, on_request_expiry, timeout_clock> _blocked_requests;
-
+    // This is start-time fair queueing: each request is tagged with the
+    // virtual time at which it's due, which is its cost divided by the
+    // weight of its class after the previous request of the class, or after
+    // the current virtual time if the class had no blocked requests. The
+    // request with the lowest tag is released first, advancing the virtual
+    // time to its tag.
+    //
+    // Requests still blocked when their class is destroyed fail.
+    class admission_class {
+        region_group& _group;
+        float _weight;
+        double _finish_tag = 0;
+        bool _active = false;
+        // It is a more common idiom to just hold the promises in the circular buffer and make them
+        // ready. However, in the time between the promise being made ready and the function execution,
+        // it could be that our memory usage went up again. To protect against that, we have to recheck
+        // if memory is still available after the future resolves.
+        //
+        // But we can greatly simplify it if we store the function itself in the circular_buffer, and
+        // execute it synchronously in the releaser when we are sure memory is available.
+        //
+        // This allows us to easily provide strong execution guarantees while keeping all re-check
+        // complication in the releaser and keep the main request execution path simpler.
+        expiring_fifo<blocked_request, on_request_expiry, timeout_clock> _blocked_requests;
+        // In microseconds, of the requests which were blocked and released.
+        utils::estimated_histogram _wait_time;
+
+        friend class region_group;
+        friend struct on_request_expiry;
+        void block(std::unique_ptr<allocating_function>, size_t cost, timeout_clock::time_point timeout);
+    public:
+        // Requires: weight > 0
+        explicit admission_class(region_group& rg, float weight = 1);
+        ~admission_class();
+        admission_class(admission_class&&) = delete;
+        admission_class& operator=(admission_class&&) = delete;
+
+        region_group& group() { return _group; }
+        float weight() const { return _weight; }
+        // Requires: weight > 0
+        void set_weight(float weight);
+        size_t blocked_requests() const { return _blocked_requests.size(); }
+        // In microseconds, of the requests which had to wait for memory.
+        const utils::estimated_histogram& wait_time() const { return _wait_time; }
+    };
+private:
+    // Classes with blocked requests. Requests of a class may all expire
+    // while it's here, classes are removed by the releaser.
+    std::vector<admission_class*> _active_classes;
+    size_t _blocked_requests = 0;
     uint64_t _blocked_requests_counter = 0;
+    double _virtual_time = 0;
+    // For requests of no particular class.
+    admission_class _default_class;
 
     // All requests waiting for execution are kept in _blocked_requests (explained above) in the
     // region_group they were executed against. However, it could be that they are blocked not due
@@ -243,6 +315,7 @@ class region_group {
     bool _shutdown_requested = false;
 
     bool reclaimer_can_block() const;
+    blocked_request pop_blocked_request();
     future<> start_releaser();
     void notify_relief();
     friend void region_group_binomial_group_sanity_check(const region_group::region_heap& bh);
@@ -305,19 +378,29 @@ class region_group {
     // region_group (either this or an ancestor) falls below the threshold.
     //
     // Requests that are not allowed for execution are queued and released in FIFO order within the
-    // same region_group, but no guarantees are made regarding release ordering across different
-    // region_groups.
+    // same admission_class, and in a weighted-fair manner across the admission classes of the same
+    // region_group, see admission_class. No guarantees are made regarding release ordering across
+    // different region_groups.
     //
     // When timeout is reached first, the returned future is resolved with timed_out_error exception.
     template <typename Func>
     futurize_t<std::result_of_t<Func()>> run_when_memory_available(Func&& func, timeout_clock::time_point timeout = timeout_clock::time_point::max()) {
+        return run_when_memory_available(_default_class, 1, std::forward<Func>(func), timeout);
+    }
+
+    // Like above, with the request belonging to cls, which must be of this
+    // region_group, and counting as cost towards its share.
+    template <typename Func>
+    futurize_t<std::result_of_t<Func()>> run_when_memory_available(admission_class& cls, size_t cost, Func&& func,
+            timeout_clock::time_point timeout = timeout_clock::time_point::max()) {
         // We disallow future-returning functions here, because otherwise memory may be available
         // when we start executing it, but no longer available in the middle of the execution.
         static_assert(!is_future<std::result_of_t<Func()>>::value, "future-returning functions are not permitted.");
         using futurator = futurize<std::result_of_t<Func()>>;
 
+        assert(&cls._group == this);
         auto blocked_at = do_for_each_parent(this, [] (auto rg) {
-            return (rg->_blocked_requests.empty() && !rg->under_pressure()) ? stop_iteration::no : stop_iteration::yes;
+            return (!rg->_blocked_requests && !rg->under_pressure()) ? stop_iteration::no : stop_iteration::yes;
         });
 
         if (!blocked_at) {
@@ -326,8 +409,7 @@ class region_group {
 
         auto fn = std::make_unique<concrete_allocating_function<Func>>(std::forward<Func>(func));
         auto fut = fn->get_future();
-        _blocked_requests.push_back(std::move(fn), timeout);
-        ++_blocked_requests_counter;
+        cls.block(std::move(fn), cost, timeout);
 
         return fut;
     }
@@ -337,6 +419,10 @@ class region_group {
     // children.
     region* get_largest_region();
 
+    // Like get_largest_region(), but only considers the regions for which pred returns true.
+    // Visits all the regions below this group, so it is linear in their number.
+    region* get_largest_region(const std::function<bool(region&)>& pred);
+
     // Shutdown is mandatory for every user who has set a threshold
     // Can be called at most once.
     future<> shutdown() {
@@ -346,7 +432,7 @@ class region_group {
     }
 
     size_t blocked_requests() {
-        return _blocked_requests.size();
+        return _blocked_requests;
     }
 
     uint64_t blocked_requests_counter() const {
@@ -414,6 +500,14 @@ class region_group {
     friend class region_impl;
 };
 
+// All sizes in bytes.
+struct huge_page_coverage {
+    // Memory of all zones of LSA segments.
+    size_t total_bytes;
+    // The part of it made of whole, aligned huge pages.
+    size_t huge_page_bytes;
+};
+
 // Controller for all LSA regions. There's one per shard.
 class tracker {
 public:
@@ -442,6 +536,12 @@ class tracker {
     // or there are no more segments to compact.
     reactor::idle_cpu_handler_result compact_on_idle(reactor::work_waiting_on_reactor);
 
+    // Periodically compacts and evicts in the background while less than
+    // free_memory_target bytes are free, so that allocations don't have to
+    // reclaim memory themselves. Uses at most cpu_fraction of the CPU.
+    void start_background_reclaim(size_t free_memory_target, float cpu_fraction);
+    void stop_background_reclaim();
+
     // Compacts as much as possible. Very expensive, mainly for testing.
     // Guarantees that every live object from reclaimable regions will be moved.
     // Invalidates references to objects in all compactible and evictable regions.
@@ -455,6 +555,10 @@ class tracker {
     // Returns statistics for all segments allocated by LSA on this shard.
     occupancy_stats occupancy();
 
+    // Returns how much of the memory of LSA segments on this shard can be
+    // backed by huge pages.
+    huge_page_coverage huge_pages() const;
+
     impl& get_impl() { return *_impl; }
 
     // Set the minimum number of segments reclaimed during single reclamation cycle.
@@ -595,6 +699,19 @@ class region {
 
     const eviction_fn& evictor() const;
 
+    // Makes the region reclaim memory by evicting every object in its least
+    // recently closed segment together, so that the segment is freed without
+    // moving live data, before falling back to the eviction function and
+    // compaction. The age of a segment is approximate: it's the time it was
+    // filled up, either by allocations or by objects moved into it.
+    // Only takes effect for evictable regions.
+    void make_segment_evictable(object_eviction_fn);
+
+    // Evicts the least recently closed segment with the object eviction
+    // function. Returns reclaimed_nothing if none of its objects could be
+    // evicted, in which case they're all moved out of it. Mainly for testing.
+    memory::reclaiming_result evict_oldest_segment();
+
     friend class region_group;
     friend class allocating_section;
 };
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/intrusive/list.hpp>
+
+namespace bi = boost::intrusive;
+
+// An object which can be dropped by its owner when memory runs low.
+//
+// Unlinks itself from the lru when destroyed.
+class evictable {
+    friend class lru;
+    using lru_link_type = bi::list_member_hook<bi::link_mode<bi::auto_unlink>>;
+    lru_link_type _lru_link;
+protected:
+    // Prevent destruction via evictable pointer. LRU is not aware of allocation strategy.
+    ~evictable() = default;
+public:
+    // Called when the object is evicted. Should release the object, or at
+    // least drop all the references to it held by its owner.
+    virtual void on_evicted() noexcept = 0;
+
+    bool is_linked() const {
+        return _lru_link.is_linked();
+    }
+
+    void unlink_from_lru() noexcept {
+        _lru_link.unlink();
+    }
+};
+
+// Least recently used eviction order for objects allocated outside of LSA,
+// which need to share eviction with it.
+class lru {
+    using lru_type = bi::list<evictable,
+        bi::member_hook<evictable, evictable::lru_link_type, &evictable::_lru_link>,
+        bi::constant_time_size<false>>; // we need this to have bi::auto_unlink on hooks.
+    lru_type _list;
+public:
+    ~lru() {
+        evict_all();
+    }
+
+    void remove(evictable& e) noexcept {
+        _list.erase(_list.iterator_to(e));
+    }
+
+    void add(evictable& e) noexcept {
+        _list.push_back(e);
+    }
+
+    // Marks e as the most recently used.
+    void touch(evictable& e) noexcept {
+        remove(e);
+        add(e);
+    }
+
+    bool empty() const {
+        return _list.empty();
+    }
+
+    // Evicts the least recently used object. Returns false if there was none.
+    bool evict() noexcept {
+        if (_list.empty()) {
+            return false;
+        }
+        evictable& e = _list.front();
+        _list.pop_front();
+        e.on_evicted();
+        return true;
+    }
+
+    void evict_all() noexcept {
+        while (evict()) {}
+    }
+};
@@ -38,6 +38,7 @@
  */
 
 #include "murmur_hash.hh"
+#include <algorithm>
 
 namespace utils {
 
@@ -246,5 +247,68 @@ void hash3_x64_128(bytes_view key, uint64_t seed, std::array<uint64_t,2> &result
     result[1] = h2;
 }
 
+static constexpr size_t short_key_size = 15;
+static constexpr size_t lanes = 4;
+
+// hash3_x64_128() of lanes keys of at most short_key_size bytes. A key that
+// short has no full block, only a tail, and processing the missing half of
+// the tail of a key of at most 8 bytes is a no-op, since it is zero, so all
+// keys go through the same steps.
+static void hash3_x64_128_short_keys(const bytes_view* keys, uint64_t seed, std::array<uint64_t, 2>* results) {
+    const uint64_t c1 = 0x87c37b91114253d5L;
+    const uint64_t c2 = 0x4cf5ad432745937fL;
+
+    uint64_t k1[lanes];
+    uint64_t k2[lanes];
+    uint64_t h1[lanes];
+    uint64_t h2[lanes];
+
+    for (size_t l = 0; l < lanes; ++l) {
+        auto& key = keys[l];
+        k1[l] = 0;
+        k2[l] = 0;
+        // The bytes are signed, and sign extended, like in hash3_x64_128().
+        for (size_t i = 8; i < key.size(); ++i) {
+            k2[l] ^= uint64_t(key[i]) << ((i - 8) * 8);
+        }
+        for (size_t i = 0; i < std::min<size_t>(key.size(), 8); ++i) {
+            k1[l] ^= uint64_t(key[i]) << (i * 8);
+        }
+    }
+    for (size_t l = 0; l < lanes; ++l) {
+        k2[l] *= c2; k2[l] = rotl64(k2[l], 33); k2[l] *= c1; h2[l] = seed ^ k2[l];
+        k1[l] *= c1; k1[l] = rotl64(k1[l], 31); k1[l] *= c2; h1[l] = seed ^ k1[l];
+    }
+    for (size_t l = 0; l < lanes; ++l) {
+        h1[l] ^= uint32_t(keys[l].size());
+        h2[l] ^= uint32_t(keys[l].size());
+        h1[l] += h2[l];
+        h2[l] += h1[l];
+    }
+    for (size_t l = 0; l < lanes; ++l) {
+        h1[l] = fmix(h1[l]);
+        h2[l] = fmix(h2[l]);
+        h1[l] += h2[l];
+        h2[l] += h1[l];
+    }
+    for (size_t l = 0; l < lanes; ++l) {
+        results[l][0] = h1[l];
+        results[l][1] = h2[l];
+    }
+}
+
+void hash3_x64_128(const bytes_view* keys, size_t count, uint64_t seed, std::array<uint64_t, 2>* results) {
+    size_t i = 0;
+    while (i < count) {
+        if (i + lanes <= count && std::all_of(keys + i, keys + i + lanes, [] (bytes_view k) { return k.size() <= short_key_size; })) {
+            hash3_x64_128_short_keys(keys + i, seed, results + i);
+            i += lanes;
+        } else {
+            hash3_x64_128(keys[i], seed, results[i]);
+            ++i;
+        }
+    }
+}
+
 } // namespace murmur_hash
 } // namespace utils
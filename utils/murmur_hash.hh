@@ -40,6 +40,7 @@
 
 #include <cstdint>
 #include <array>
+#include <algorithm>
 
 #include "bytes.hh"
 
@@ -167,6 +168,108 @@ void hash3_x64_128(InputIterator in, uint32_t length, uint64_t seed, std::array<
 
 void hash3_x64_128(bytes_view key, uint64_t seed, std::array<uint64_t, 2>& result);
 
+// Calculates hash3_x64_128() of each of the count keys into results. Keys
+// shorter than 16 bytes, like most partition keys, are hashed four at a time,
+// the same step of the four hashes being done side by side and without
+// branches, so that the compiler can vectorize it and the CPU can overlap
+// the multiplications of the four.
+void hash3_x64_128(const bytes_view* keys, size_t count, uint64_t seed, std::array<uint64_t, 2>* results);
+
+// Calculates hash3_x64_128() of data fed to it in pieces, with the same
+// result as hash3_x64_128() of their concatenation, as bytes.
+class hasher3_x64_128 {
+    static constexpr uint64_t c1 = 0x87c37b91114253d5L;
+    static constexpr uint64_t c2 = 0x4cf5ad432745937fL;
+
+    uint64_t _h1;
+    uint64_t _h2;
+    uint64_t _length = 0;
+    // The bytes fed since the last full block.
+    std::array<int8_t, 16> _tail;
+    size_t _tail_size = 0;
+private:
+    void process_block(const int8_t* in) {
+        uint64_t k1 = read_block(in);
+        uint64_t k2 = read_block(in);
+
+        k1 *= c1; k1 = rotl64(k1,31); k1 *= c2; _h1 ^= k1;
+
+        _h1 = rotl64(_h1,27); _h1 += _h2; _h1 = _h1*5+0x52dce729;
+
+        k2 *= c2; k2  = rotl64(k2,33); k2 *= c1; _h2 ^= k2;
+
+        _h2 = rotl64(_h2,31); _h2 += _h1; _h2 = _h2*5+0x38495ab5;
+    }
+public:
+    explicit hasher3_x64_128(uint64_t seed = 0) : _h1(seed), _h2(seed) { }
+
+    void update(const char* ptr, size_t length) {
+        auto in = reinterpret_cast<const int8_t*>(ptr);
+        _length += length;
+        if (_tail_size) {
+            auto n = std::min(_tail.size() - _tail_size, length);
+            std::copy_n(in, n, _tail.begin() + _tail_size);
+            _tail_size += n;
+            in += n;
+            length -= n;
+            if (_tail_size < _tail.size()) {
+                return;
+            }
+            process_block(_tail.data());
+            _tail_size = 0;
+        }
+        for (; length >= _tail.size(); length -= _tail.size(), in += _tail.size()) {
+            process_block(in);
+        }
+        std::copy_n(in, length, _tail.begin());
+        _tail_size = length;
+    }
+
+    void finalize(std::array<uint64_t, 2>& result) const {
+        uint64_t h1 = _h1;
+        uint64_t h2 = _h2;
+        uint64_t k1 = 0;
+        uint64_t k2 = 0;
+        auto& tmp = _tail;
+
+        switch(_tail_size)
+        {
+            case 15: k2 ^= ((uint64_t) tmp[14]) << 48;
+            case 14: k2 ^= ((uint64_t) tmp[13]) << 40;
+            case 13: k2 ^= ((uint64_t) tmp[12]) << 32;
+            case 12: k2 ^= ((uint64_t) tmp[11]) << 24;
+            case 11: k2 ^= ((uint64_t) tmp[10]) << 16;
+            case 10: k2 ^= ((uint64_t) tmp[9]) << 8;
+            case  9: k2 ^= ((uint64_t) tmp[8]) << 0;
+                k2 *= c2; k2  = rotl64(k2,33); k2 *= c1; h2 ^= k2;
+            case  8: k1 ^= ((uint64_t) tmp[7]) << 56;
+            case  7: k1 ^= ((uint64_t) tmp[6]) << 48;
+            case  6: k1 ^= ((uint64_t) tmp[5]) << 40;
+            case  5: k1 ^= ((uint64_t) tmp[4]) << 32;
+            case  4: k1 ^= ((uint64_t) tmp[3]) << 24;
+            case  3: k1 ^= ((uint64_t) tmp[2]) << 16;
+            case  2: k1 ^= ((uint64_t) tmp[1]) << 8;
+            case  1: k1 ^= ((uint64_t) tmp[0]);
+                k1 *= c1; k1  = rotl64(k1,31); k1 *= c2; h1 ^= k1;
+        };
+
+        h1 ^= _length;
+        h2 ^= _length;
+
+        h1 += h2;
+        h2 += h1;
+
+        h1 = fmix(h1);
+        h2 = fmix(h2);
+
+        h1 += h2;
+        h2 += h1;
+
+        result[0] = h1;
+        result[1] = h2;
+    }
+};
+
 } // namespace murmur_hash
 
 } // namespace utils
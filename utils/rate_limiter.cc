@@ -48,3 +48,58 @@ future<> utils::rate_limiter::reserve(size_t u) {
         return reserve(r);
     });
 }
+
+utils::token_bucket_rate_limiter::token_bucket_rate_limiter(uint64_t rate)
+        : _rate(rate) {
+    _timer.set_callback([this] {
+        refill();
+        grant_waiters();
+    });
+}
+
+void utils::token_bucket_rate_limiter::refill() {
+    auto now = clock::now();
+    if (_rate) {
+        auto elapsed = std::chrono::duration<double>(now - _refilled).count();
+        _tokens = std::min(_tokens + elapsed * _rate, max_tokens());
+    }
+    _refilled = now;
+}
+
+void utils::token_bucket_rate_limiter::grant_waiters() {
+    while (!_waiters.empty() && (!_rate || _tokens >= 0)) {
+        if (_rate) {
+            _tokens -= _waiters.front().units;
+        }
+        _waiters.front().pr.set_value();
+        _waiters.pop_front();
+    }
+    if (!_waiters.empty() && !_timer.armed()) {
+        auto debt_paid_in = std::chrono::duration<double>(-_tokens / _rate);
+        _timer.arm(std::chrono::duration_cast<clock::duration>(debt_paid_in) + std::chrono::microseconds(1));
+    }
+}
+
+void utils::token_bucket_rate_limiter::set_rate(uint64_t rate) {
+    refill();
+    _rate = rate;
+    _tokens = _rate ? std::min(_tokens, max_tokens()) : 0;
+    _timer.cancel();
+    grant_waiters();
+}
+
+future<> utils::token_bucket_rate_limiter::reserve(size_t units) {
+    if (!_rate) {
+        return make_ready_future<>();
+    }
+    refill();
+    if (_waiters.empty() && _tokens >= 0) {
+        _tokens -= units;
+        return make_ready_future<>();
+    }
+    ++_delayed;
+    _waiters.push_back(waiter{units, promise<>()});
+    auto f = _waiters.back().pr.get_future();
+    grant_waiters();
+    return f;
+}
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <deque>
 #include "core/timer.hh"
 #include "core/semaphore.hh"
 #include "core/reactor.hh"
@@ -45,4 +46,59 @@ class rate_limiter {
     future<> reserve(size_t u);
 };
 
+/**
+ * A token bucket of units, e.g. bytes, refilled continuously at a rate which
+ * can be changed at any time.
+ *
+ * A reservation is granted at once as long as the bucket isn't in debt, even
+ * if it is larger than what the bucket holds, so that large ones aren't held
+ * back forever. Later reservations wait, in order, until the debt is paid
+ * off. While idle, the bucket fills up to a tenth of a second's worth of
+ * units, which bounds the bursts that follow.
+ */
+class token_bucket_rate_limiter {
+    using clock = std::chrono::steady_clock;
+
+    struct waiter {
+        size_t units;
+        promise<> pr;
+    };
+
+    // Units per second, 0 for unlimited.
+    uint64_t _rate;
+    double _tokens = 0;
+    clock::time_point _refilled = clock::now();
+    std::deque<waiter> _waiters;
+    timer<clock> _timer;
+    uint64_t _delayed = 0;
+
+    double max_tokens() const {
+        return _rate / 10.0;
+    }
+
+    void refill();
+    void grant_waiters();
+public:
+    explicit token_bucket_rate_limiter(uint64_t rate = 0);
+    token_bucket_rate_limiter(token_bucket_rate_limiter&&) = delete;
+
+    uint64_t rate() const {
+        return _rate;
+    }
+
+    // Waiting reservations are granted at the new rate, or at once if it is 0.
+    void set_rate(uint64_t rate);
+
+    future<> reserve(size_t units);
+
+    // Reservations which had to wait.
+    uint64_t delayed() const {
+        return _delayed;
+    }
+
+    size_t waiters() const {
+        return _waiters.size();
+    }
+};
+
 }
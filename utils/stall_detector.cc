@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <array>
+#include <csignal>
+#include <system_error>
+#include <cstdlib>
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <seastar/core/metrics.hh>
+
+#include "utils/stall_detector.hh"
+#include "log.hh"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace utils {
+
+static logging::logger sdlogger("stall_detector");
+
+constexpr std::chrono::seconds stall_detector::report_interval;
+
+static const std::array<const char*, size_t(stall_context::count)> context_names = {
+    "other", "row_cache_update", "lsa_compaction", "schema_merge",
+};
+
+static int stall_signal() {
+    return SIGRTMIN + 3;
+}
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Shared by the shard thread and its signal handler, so only lock free
+// atomics and trivially constructed members, which need no guard to be
+// initialised.
+struct stall_state {
+    static constexpr int max_frames = 64;
+    std::atomic<int64_t> threshold_ns;
+    std::atomic<int64_t> last_beat_ns;
+    // The beat the last stall was detected after, so that a stall is only
+    // counted once however long it lasts.
+    std::atomic<int64_t> stalled_beat_ns;
+    std::atomic<uint8_t> context;
+    std::array<std::atomic<uint64_t>, size_t(stall_context::count)> stalls;
+    // The backtrace of the last stall, until reported.
+    std::atomic<bool> pending;
+    void* frames[max_frames];
+    int frame_count;
+    int64_t stall_ns;
+    uint8_t stall_context;
+};
+
+static thread_local stall_state state;
+
+stall_context_scope::stall_context_scope(stall_context c)
+    : _prev(stall_context(state.context.load(std::memory_order_relaxed))) {
+    state.context.store(uint8_t(c), std::memory_order_relaxed);
+}
+
+stall_context_scope::~stall_context_scope() {
+    state.context.store(uint8_t(_prev), std::memory_order_relaxed);
+}
+
+static void on_stall_signal(int, siginfo_t*, void*) {
+    auto threshold = state.threshold_ns.load(std::memory_order_relaxed);
+    auto beat = state.last_beat_ns.load(std::memory_order_relaxed);
+    auto age = now_ns() - beat;
+    if (!threshold || age < threshold || state.stalled_beat_ns.load(std::memory_order_relaxed) == beat) {
+        return;
+    }
+    state.stalled_beat_ns.store(beat, std::memory_order_relaxed);
+    auto context = state.context.load(std::memory_order_relaxed);
+    state.stalls[context].fetch_add(1, std::memory_order_relaxed);
+    if (state.pending.load(std::memory_order_acquire)) {
+        return;
+    }
+    state.frame_count = ::backtrace(state.frames, stall_state::max_frames);
+    state.stall_ns = age;
+    state.stall_context = context;
+    state.pending.store(true, std::memory_order_release);
+}
+
+stall_detector::stall_detector(std::chrono::milliseconds threshold)
+    : _threshold(threshold)
+    , _beat([this] { beat(); })
+{
+    namespace sm = seastar::metrics;
+    auto context_label = sm::label("context");
+    for (size_t i = 0; i < context_names.size(); ++i) {
+        _metrics.add_group("stall_detector", {
+            sm::make_derive("stalls", [i] { return state.stalls[i].load(std::memory_order_relaxed); },
+                    sm::description("Counts the times the reactor ran a single task for longer than the stall threshold"),
+                    {context_label(context_names[i])}),
+        });
+    }
+    if (!_threshold.count()) {
+        return;
+    }
+
+    // The first call of backtrace() loads libgcc, which isn't safe to do
+    // from a signal handler.
+    void* frame;
+    ::backtrace(&frame, 1);
+
+    struct sigaction sa = {};
+    sa.sa_sigaction = on_stall_signal;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (::sigaction(stall_signal(), &sa, nullptr)) {
+        throw std::system_error(errno, std::system_category(), "sigaction");
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, stall_signal());
+    ::pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+
+    struct sigevent sev = {};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = stall_signal();
+    sev.sigev_notify_thread_id = ::syscall(SYS_gettid);
+    if (::timer_create(CLOCK_MONOTONIC, &sev, &_timer)) {
+        throw std::system_error(errno, std::system_category(), "timer_create");
+    }
+    _armed = true;
+
+    auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(_threshold) / 4;
+    state.threshold_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(_threshold).count(), std::memory_order_relaxed);
+    state.last_beat_ns.store(now_ns(), std::memory_order_relaxed);
+    struct itimerspec its = {};
+    its.it_interval.tv_sec = period.count() / 1000000000;
+    its.it_interval.tv_nsec = period.count() % 1000000000;
+    its.it_value = its.it_interval;
+    ::timer_settime(_timer, 0, &its, nullptr);
+    _beat.arm_periodic(period);
+}
+
+stall_detector::~stall_detector() {
+    if (_armed) {
+        state.threshold_ns.store(0, std::memory_order_relaxed);
+        ::timer_delete(_timer);
+    }
+}
+
+future<> stall_detector::stop() {
+    _beat.cancel();
+    if (_armed) {
+        state.threshold_ns.store(0, std::memory_order_relaxed);
+        ::timer_delete(_timer);
+        _armed = false;
+    }
+    return make_ready_future<>();
+}
+
+void stall_detector::beat() {
+    state.last_beat_ns.store(now_ns(), std::memory_order_relaxed);
+    if (state.pending.load(std::memory_order_acquire)) {
+        report();
+        state.pending.store(false, std::memory_order_release);
+    }
+}
+
+void stall_detector::report() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - _last_report < report_interval) {
+        ++_suppressed;
+        return;
+    }
+    _last_report = now;
+    sstring trace;
+    auto symbols = ::backtrace_symbols(state.frames, state.frame_count);
+    // Skips the frames of the signal handler.
+    for (int i = 2; i < state.frame_count; ++i) {
+        trace += "\n  ";
+        trace += symbols ? symbols[i] : sprint("%p", state.frames[i]);
+    }
+    ::free(symbols);
+    sdlogger.warn("Reactor stalled for {} ms in {} ({} stalls not reported since the last report), backtrace:{}",
+            state.stall_ns / 1000000, context_names[state.stall_context], _suppressed, trace);
+    _suppressed = 0;
+}
+
+}
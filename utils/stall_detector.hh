@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <seastar/core/future.hh>
+#include <seastar/core/timer.hh>
+#include <seastar/core/metrics_registration.hh>
+#include "seastarx.hh"
+
+namespace utils {
+
+// The code known to run for long without yielding, which the stalls are
+// attributed to.
+enum class stall_context : uint8_t {
+    other,
+    row_cache_update,
+    lsa_compaction,
+    schema_merge,
+    count, // Not a context.
+};
+
+// Attributes the stalls of the current shard to c until destroyed. Only
+// meant for code which doesn't yield, since the other tasks that would run
+// meanwhile would be attributed to c too.
+class stall_context_scope {
+    stall_context _prev;
+public:
+    explicit stall_context_scope(stall_context c);
+    ~stall_context_scope();
+    stall_context_scope(const stall_context_scope&) = delete;
+};
+
+// Detects the tasks which keep the reactor of a shard from polling for
+// longer than a threshold.
+//
+// A timer of the reactor beats every threshold / 4, and a POSIX timer of
+// the shard thread, delivered as a signal at the same period, checks the
+// age of the last beat. A beat older than the threshold means that the
+// shard has been running the same task, or blocked in it, since. The signal
+// handler then captures the backtrace of the task, and counts the stall
+// against the current stall_context. The next beat logs the backtrace,
+// symbolised, at most once every report_interval.
+//
+// The beats are only as frequent as the reactor runs its timers, so stalls
+// are detected from the threshold up to 1.25 times the threshold.
+class stall_detector {
+public:
+    static constexpr std::chrono::seconds report_interval{10};
+private:
+    std::chrono::milliseconds _threshold;
+    timer<> _beat;
+    timer_t _timer;
+    bool _armed = false;
+    std::chrono::steady_clock::time_point _last_report;
+    uint64_t _suppressed = 0;
+    seastar::metrics::metric_groups _metrics;
+private:
+    void beat();
+    void report();
+public:
+    // A threshold of 0 disables the detector.
+    explicit stall_detector(std::chrono::milliseconds threshold);
+    ~stall_detector();
+    future<> stop();
+};
+
+}
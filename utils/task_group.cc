@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <seastar/core/metrics.hh>
+#include <seastar/core/metrics_registration.hh>
+
+#include "utils/task_group.hh"
+
+namespace utils {
+
+static const std::array<const char*, size_t(task_group::count)> group_names = {
+    "compaction", "memtable_flush", "cache_update", "streaming", "repair", "gossip",
+};
+
+const char* task_group_name(task_group g) {
+    return group_names[size_t(g)];
+}
+
+namespace {
+
+struct group_state {
+    uint64_t tasks = 0;
+    uint64_t failed_tasks = 0;
+    uint64_t running_tasks = 0;
+    std::chrono::steady_clock::duration busy_time{};
+    std::chrono::steady_clock::time_point busy_since;
+    std::function<uint64_t()> queue_length;
+
+    std::chrono::steady_clock::duration current_busy_time() const {
+        if (!running_tasks) {
+            return busy_time;
+        }
+        return busy_time + (std::chrono::steady_clock::now() - busy_since);
+    }
+    uint64_t queued_tasks() const {
+        return queue_length ? queue_length() : 0;
+    }
+};
+
+struct task_groups {
+    std::array<group_state, size_t(task_group::count)> groups;
+    seastar::metrics::metric_groups metrics;
+
+    task_groups() {
+        namespace sm = seastar::metrics;
+        auto group_label = sm::label("group");
+        for (size_t i = 0; i < groups.size(); ++i) {
+            auto& g = groups[i];
+            metrics.add_group("task_group", {
+                sm::make_derive("tasks", [&g] { return g.tasks; },
+                        sm::description("Counts the tasks run by the background loop"), {group_label(group_names[i])}),
+                sm::make_derive("failed_tasks", [&g] { return g.failed_tasks; },
+                        sm::description("Counts the tasks of the background loop which failed"), {group_label(group_names[i])}),
+                sm::make_gauge("running_tasks", [&g] { return g.running_tasks; },
+                        sm::description("Holds the number of tasks of the background loop in progress"), {group_label(group_names[i])}),
+                sm::make_gauge("queued_tasks", [&g] { return g.queued_tasks(); },
+                        sm::description("Holds the number of tasks waiting to run in the background loop"), {group_label(group_names[i])}),
+                sm::make_derive("busy_time_us", [&g] {
+                    return std::chrono::duration_cast<std::chrono::microseconds>(g.current_busy_time()).count();
+                }, sm::description("Counts the microseconds during which at least one task of the background loop was in progress"),
+                        {group_label(group_names[i])}),
+            });
+        }
+    }
+};
+
+}
+
+static task_groups& local_task_groups() {
+    static thread_local task_groups groups;
+    return groups;
+}
+
+static group_state& local_group(task_group g) {
+    return local_task_groups().groups[size_t(g)];
+}
+
+task_group_stats get_task_group_stats(task_group g) {
+    auto& s = local_group(g);
+    task_group_stats ret;
+    ret.tasks = s.tasks;
+    ret.failed_tasks = s.failed_tasks;
+    ret.running_tasks = s.running_tasks;
+    ret.queued_tasks = s.queued_tasks();
+    ret.busy_time = s.current_busy_time();
+    return ret;
+}
+
+void set_task_group_queue_length(task_group g, std::function<uint64_t()> queue_length) {
+    local_group(g).queue_length = std::move(queue_length);
+}
+
+void task_group_task_started(task_group g) {
+    auto& s = local_group(g);
+    s.tasks++;
+    if (!s.running_tasks++) {
+        s.busy_since = std::chrono::steady_clock::now();
+    }
+}
+
+void task_group_task_finished(task_group g, bool failed) {
+    auto& s = local_group(g);
+    if (failed) {
+        s.failed_tasks++;
+    }
+    if (!--s.running_tasks) {
+        s.busy_time += std::chrono::steady_clock::now() - s.busy_since;
+    }
+}
+
+}
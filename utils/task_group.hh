@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <seastar/core/future.hh>
+#include <seastar/core/future-util.hh>
+#include "seastarx.hh"
+
+namespace utils {
+
+// The main background loops of a shard, accounted for separately so that
+// it can be told what a saturated shard spends its time on.
+//
+// The groups may overlap, the cache update done by a memtable flush is
+// also accounted to cache_update, for example.
+enum class task_group : uint8_t {
+    compaction,
+    memtable_flush,
+    cache_update,
+    streaming,
+    repair,
+    gossip,
+    count, // Not a group.
+};
+
+const char* task_group_name(task_group g);
+
+struct task_group_stats {
+    uint64_t tasks = 0;
+    uint64_t failed_tasks = 0;
+    uint64_t running_tasks = 0;
+    uint64_t queued_tasks = 0;
+    // The time during which at least one task of the group was running.
+    // As the reactor interleaves the tasks of all groups, this bounds the
+    // CPU time of the group from above.
+    std::chrono::steady_clock::duration busy_time{};
+};
+
+// The stats of g on the current shard.
+task_group_stats get_task_group_stats(task_group g);
+
+// Sets the length of the queue of tasks waiting to run in g on the current
+// shard, as known by the owner of the queue. An empty function resets it.
+void set_task_group_queue_length(task_group g, std::function<uint64_t()> queue_length);
+
+void task_group_task_started(task_group g);
+void task_group_task_finished(task_group g, bool failed);
+
+// Runs func as a task of g, from its call until its future resolves.
+template <typename Func>
+inline
+futurize_t<std::result_of_t<Func()>>
+run_in_task_group(task_group g, Func&& func) {
+    task_group_task_started(g);
+    return futurize_apply(std::forward<Func>(func)).then_wrapped([g] (auto f) {
+        task_group_task_finished(g, f.failed());
+        return f;
+    });
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "utils/count_min_sketch.hh"
+
+namespace utils {
+
+// A bloom filter of 64-bit hashes which tells, with one probe of a single
+// word, that an item was certainly not added. Each item sets three bits of
+// the one word selected by its hash, so the false positive rate is about 1%
+// while no more items than capacity() were added, and grows beyond it.
+//
+// Items are given by their hashes, which needn't be well mixed.
+class token_filter {
+    static constexpr unsigned bits_per_item = 16;
+    std::vector<uint64_t> _words;
+    uint64_t _mask;
+private:
+    static uint64_t bits(uint64_t h) {
+        return (uint64_t(1) << (h >> 46 & 63)) | (uint64_t(1) << (h >> 52 & 63)) | (uint64_t(1) << (h >> 58));
+    }
+public:
+    // The capacity is rounded up so that the number of words is a power of 2.
+    explicit token_filter(size_t capacity = 1024) {
+        size_t w = 1;
+        while (w * 64 < capacity * bits_per_item) {
+            w <<= 1;
+        }
+        _words.resize(w);
+        _mask = w - 1;
+    }
+
+    void add(uint64_t hash) {
+        auto h = mix64(hash);
+        _words[h & _mask] |= bits(h);
+    }
+
+    bool may_contain(uint64_t hash) const {
+        auto h = mix64(hash);
+        auto b = bits(h);
+        return (_words[h & _mask] & b) == b;
+    }
+
+    void clear() {
+        std::fill(_words.begin(), _words.end(), 0);
+    }
+
+    size_t capacity() const { return _words.size() * 64 / bits_per_item; }
+    size_t memory_usage() const { return _words.size() * sizeof(uint64_t); }
+};
+
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace utils {
+
+// Finds the most frequent items of a stream in constant memory, using the
+// Space-Saving algorithm (Metwally, Agrawal, El Abbadi: "Efficient
+// Computation of Frequent and Top-k Elements in Data Streams").
+//
+// At most capacity items are counted at a time. When a new item comes and
+// there is no room for it, it takes over the counter of the least frequent
+// item, inheriting its count as the error of its own. So the count of each
+// item is an overestimate, by at most its error, and any item occurring more
+// than 1/capacity of the time is guaranteed to be counted.
+//
+// Counters are kept in buckets of equal counts, ordered by count, so that
+// counting an item takes constant time.
+template<typename T, typename Hash = std::hash<T>, typename KeyEqual = std::equal_to<T>>
+class space_saving_top_k {
+public:
+    struct result {
+        T item;
+        uint64_t count;
+        uint64_t error;
+    };
+private:
+    struct bucket;
+    using bucket_list = std::list<bucket>;
+
+    struct counter {
+        T item;
+        uint64_t error;
+        typename bucket_list::iterator bucket;
+    };
+    using counter_list = std::list<counter>;
+
+    struct bucket {
+        uint64_t count;
+        counter_list counters;
+
+        explicit bucket(uint64_t c) : count(c) { }
+    };
+
+    size_t _capacity;
+    // In ascending order of counts.
+    bucket_list _buckets;
+    std::unordered_map<T, typename counter_list::iterator, Hash, KeyEqual> _counters;
+private:
+    void increment(typename counter_list::iterator c, uint64_t n) {
+        auto b = c->bucket;
+        auto count = b->count + n;
+        auto next = std::next(b);
+        while (next != _buckets.end() && next->count < count) {
+            ++next;
+        }
+        if (next == _buckets.end() || next->count != count) {
+            next = _buckets.emplace(next, count);
+        }
+        next->counters.splice(next->counters.end(), b->counters, c);
+        c->bucket = next;
+        if (b->counters.empty()) {
+            _buckets.erase(b);
+        }
+    }
+public:
+    // Requires: capacity > 0
+    explicit space_saving_top_k(size_t capacity, Hash hash = Hash(), KeyEqual equal = KeyEqual())
+        : _capacity(capacity)
+        , _counters(capacity, std::move(hash), std::move(equal))
+    { }
+
+    space_saving_top_k(space_saving_top_k&&) = default;
+    space_saving_top_k& operator=(space_saving_top_k&&) = default;
+
+    // Counts n occurrences of item.
+    void append(const T& item, uint64_t n = 1) {
+        auto i = _counters.find(item);
+        if (i != _counters.end()) {
+            increment(i->second, n);
+            return;
+        }
+        typename counter_list::iterator c;
+        if (_counters.size() < _capacity) {
+            if (_buckets.empty() || _buckets.front().count != 0) {
+                _buckets.emplace_front(0);
+            }
+            auto b = _buckets.begin();
+            c = b->counters.insert(b->counters.end(), counter{item, 0, b});
+        } else {
+            // Take over the counter of the least frequent item.
+            auto b = _buckets.begin();
+            c = b->counters.begin();
+            _counters.erase(c->item);
+            c->item = item;
+            c->error = b->count;
+        }
+        _counters.emplace(item, c);
+        increment(c, n);
+    }
+
+    // Returns at most k of the most frequent items, most frequent first.
+    std::vector<result> top(size_t k) const {
+        std::vector<result> ret;
+        for (auto b = _buckets.rbegin(); b != _buckets.rend() && ret.size() < k; ++b) {
+            for (auto c = b->counters.begin(); c != b->counters.end() && ret.size() < k; ++c) {
+                ret.push_back(result{c->item, b->count, c->error});
+            }
+        }
+        return ret;
+    }
+
+    size_t size() const { return _counters.size(); }
+    size_t capacity() const { return _capacity; }
+};
+
+}
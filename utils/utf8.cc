@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+#include "utf8.hh"
+
+namespace utils {
+
+namespace utf8 {
+
+#if defined(__SSE4_1__)
+
+// Validates 16 bytes at a time with the lookup algorithm of simdjson
+// (Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per
+// Byte"). The errors of each pair of consecutive bytes are looked up by the
+// nibbles of both, and where a byte has to be the third or fourth one of a
+// sequence it is checked against the lead byte two or three bytes back.
+namespace sse {
+
+// The error classes, set in the three lookup tables for the nibbles which
+// can take part in them, so that only the errors found in all three survive
+// the and.
+constexpr uint8_t TOO_SHORT = 1 << 0;       // 11______ 0_______, 11______ 11______
+constexpr uint8_t TOO_LONG = 1 << 1;        // 0_______ 10______
+constexpr uint8_t OVERLONG_3 = 1 << 2;      // 11100000 100_____
+constexpr uint8_t TOO_LARGE = 1 << 3;       // 11110100 1001____, 11110100 101_____, 11110101 10______...
+constexpr uint8_t SURROGATE = 1 << 4;       // 11101101 101_____
+constexpr uint8_t OVERLONG_2 = 1 << 5;      // 1100000_ 10______
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6;  // 11110101 1000____...
+constexpr uint8_t OVERLONG_4 = 1 << 6;      // 11110000 1000____
+constexpr uint8_t TWO_CONTS = 1 << 7;       // 10______ 10______, correct in 3 and 4 byte sequences
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+inline __m128i high_nibbles(__m128i v) {
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f));
+}
+
+inline __m128i low_nibbles(__m128i v) {
+    return _mm_and_si128(v, _mm_set1_epi8(0x0f));
+}
+
+// The errors of each byte of input and the one before it, in prev1.
+inline __m128i special_cases(__m128i input, __m128i prev1) {
+    const __m128i byte_1_high = _mm_setr_epi8(
+        // 0_______ ________
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        // 10______ ________
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        // 1100____ ________
+        TOO_SHORT | OVERLONG_2,
+        // 1101____ ________
+        TOO_SHORT,
+        // 1110____ ________
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        // 1111____ ________
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m128i byte_1_low = _mm_setr_epi8(
+        // ____0000 ________
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        // ____0001 ________
+        CARRY | OVERLONG_2,
+        // ____001_ ________
+        CARRY,
+        CARRY,
+        // ____0100 ________
+        CARRY | TOO_LARGE,
+        // ____0101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____011_ ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1___ ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m128i byte_2_high = _mm_setr_epi8(
+        // ________ 0_______
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        // ________ 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        // ________ 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        // ________ 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        // ________ 11______
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+    return _mm_and_si128(_mm_and_si128(
+            _mm_shuffle_epi8(byte_1_high, high_nibbles(prev1)),
+            _mm_shuffle_epi8(byte_1_low, low_nibbles(prev1))),
+            _mm_shuffle_epi8(byte_2_high, high_nibbles(input)));
+}
+
+// TWO_CONTS is an error unless the byte is the third or the fourth of a
+// sequence, which is exactly what it has to be then.
+inline __m128i multibyte_lengths(__m128i input, __m128i prev_input, __m128i sc) {
+    auto prev2 = _mm_alignr_epi8(input, prev_input, 16 - 2);
+    auto prev3 = _mm_alignr_epi8(input, prev_input, 16 - 3);
+    // Only 111_____ and 1111____ are left with the top bit set.
+    auto is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+    auto is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80));
+    auto must23_80 = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8(0x80));
+    return _mm_xor_si128(must23_80, sc);
+}
+
+// Non-zero if the last bytes of input start a sequence which doesn't end in it.
+inline __m128i incomplete(__m128i input) {
+    const __m128i max = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1);
+    return _mm_subs_epu8(input, max);
+}
+
+class validator {
+    __m128i _error = _mm_setzero_si128();
+    __m128i _prev_input = _mm_setzero_si128();
+    __m128i _prev_incomplete = _mm_setzero_si128();
+public:
+    void process(__m128i input) {
+        if (_mm_movemask_epi8(input) == 0) {
+            _error = _mm_or_si128(_error, _prev_incomplete);
+            _prev_incomplete = _mm_setzero_si128();
+        } else {
+            auto prev1 = _mm_alignr_epi8(input, _prev_input, 16 - 1);
+            auto sc = special_cases(input, prev1);
+            _error = _mm_or_si128(_error, multibyte_lengths(input, _prev_input, sc));
+            _prev_incomplete = incomplete(input);
+        }
+        _prev_input = input;
+    }
+    bool finish() {
+        _error = _mm_or_si128(_error, _prev_incomplete);
+        return _mm_testz_si128(_error, _error);
+    }
+};
+
+}
+
+bool validate(const uint8_t* data, size_t len) {
+    sse::validator v;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        v.process(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+    }
+    if (i < len) {
+        // Zeroes are ASCII, so the padding ends whatever sequence is pending.
+        uint8_t tail[16] = {};
+        std::memcpy(tail, data + i, len - i);
+        v.process(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tail)));
+    }
+    return v.finish();
+}
+
+#else
+
+static bool validate_scalar(const uint8_t* p, const uint8_t* end) {
+    while (p < end) {
+        uint8_t c = *p;
+        if (c < 0x80) {
+            ++p;
+            continue;
+        }
+        size_t n;
+        uint32_t cp;
+        uint32_t min;
+        if ((c & 0xe0) == 0xc0) {
+            n = 1;
+            cp = c & 0x1f;
+            min = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            n = 2;
+            cp = c & 0x0f;
+            min = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            n = 3;
+            cp = c & 0x07;
+            min = 0x10000;
+        } else {
+            return false;
+        }
+        if (size_t(end - p) <= n) {
+            return false;
+        }
+        for (size_t i = 1; i <= n; ++i) {
+            if ((p[i] & 0xc0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (p[i] & 0x3f);
+        }
+        if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+            return false;
+        }
+        p += n + 1;
+    }
+    return true;
+}
+
+bool validate(const uint8_t* data, size_t len) {
+    return validate_scalar(data, data + len);
+}
+
+#endif
+
+}
+
+namespace ascii {
+
+bool validate(const uint8_t* data, size_t len) {
+    size_t i = 0;
+#if defined(__SSE4_1__)
+    auto acc = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        acc = _mm_or_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+    }
+    if (_mm_movemask_epi8(acc)) {
+        return false;
+    }
+#endif
+    uint8_t rest = 0;
+    for (; i < len; ++i) {
+        rest |= data[i];
+    }
+    return rest < 0x80;
+}
+
+}
+
+}
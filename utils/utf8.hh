@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "bytes.hh"
+
+namespace utils {
+
+namespace utf8 {
+
+// Returns true if data is well formed UTF-8: no truncated or overlong
+// sequences, surrogates, or code points above U+10FFFF.
+bool validate(const uint8_t* data, size_t len);
+
+inline bool validate(bytes_view v) {
+    return validate(reinterpret_cast<const uint8_t*>(v.data()), v.size());
+}
+
+}
+
+namespace ascii {
+
+bool validate(const uint8_t* data, size_t len);
+
+inline bool validate(bytes_view v) {
+    return validate(reinterpret_cast<const uint8_t*>(v.data()), v.size());
+}
+
+}
+
+}
@@ -35,6 +35,20 @@ class view_info final {
     mutable stdx::optional<dht::partition_range_vector> _partition_ranges;
     // Lazily initializes the column id of a regular base table included in the view's PK, if any.
     mutable stdx::optional<stdx::optional<column_id>> _base_non_pk_column_in_view_pk;
+    // How the columns of the view and of a version of the base relate,
+    // computed the first time it is needed for that version, so that view
+    // updates don't look columns up by name.
+    struct base_dependent_columns {
+        table_schema_version base_version;
+        // The view column of each regular column of the base, by base column_id.
+        std::vector<const column_definition*> view_columns;
+        // The position in the base's all_columns() of each column of the
+        // view's primary key, partition key first.
+        std::vector<column_count_type> base_key_columns;
+    };
+    mutable stdx::optional<base_dependent_columns> _base_dependent_columns;
+
+    const base_dependent_columns& base_dependent(const schema& base) const;
 public:
     view_info(const schema& schema, const raw_view_info& raw_view_info);
 
@@ -62,6 +76,8 @@ class view_info final {
     const query::partition_slice& partition_slice() const;
     const dht::partition_range_vector& partition_ranges() const;
     const column_definition* view_column(const schema& base, column_id base_id) const;
+    // The base column of the given column of the view's primary key.
+    const column_definition& base_key_column(const schema& base, const column_definition& view_key_column) const;
     stdx::optional<column_id> base_non_pk_column_in_view_pk(const schema& base) const;
 
     friend bool operator==(const view_info& x, const view_info& y) {
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "vint-serialization.hh"
+
+#include <seastar/core/bitops.hh>
+
+#include <algorithm>
+#include <array>
+
+static inline uint64_t encode_zigzag(int64_t n) noexcept {
+    return (uint64_t(n) << 1) ^ uint64_t(n >> 63);
+}
+
+static inline int64_t decode_zigzag(uint64_t n) noexcept {
+    return int64_t(n >> 1) ^ -int64_t(n & 1);
+}
+
+vint_size_type unsigned_vint::serialized_size(value_type value) noexcept {
+    // Every byte of the encoding carries 7 bits of the value (the 9-byte
+    // encoding is the exception, but 64 bits fit in it anyway).
+    auto significant_bits = 64 - count_leading_zeros(value | 1);
+    return std::min(vint_size_type((significant_bits - 1) / 7 + 1), max_vint_length);
+}
+
+vint_size_type unsigned_vint::serialize(value_type value, bytes::iterator out) {
+    auto size = serialized_size(value);
+    if (size == max_vint_length) {
+        *out++ = bytes::value_type(0xff);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            *out++ = bytes::value_type(value >> shift);
+        }
+        return size;
+    }
+    auto extra = size - 1;
+    for (int i = extra; i >= 0; --i) {
+        out[i] = bytes::value_type(value);
+        value >>= 8;
+    }
+    // The extra-bytes count is encoded as leading one bits.
+    out[0] |= bytes::value_type(uint8_t(0xff << (8 - extra)));
+    return size;
+}
+
+vint_size_type unsigned_vint::serialized_size_from_first_byte(bytes::value_type first_byte) {
+    auto inverted = uint8_t(~uint8_t(first_byte));
+    if (inverted == 0) {
+        return max_vint_length;
+    }
+    return count_leading_zeros(uint32_t(inverted)) - 24 + 1;
+}
+
+unsigned_vint::value_type unsigned_vint::deserialize(bytes_view v) {
+    auto size = serialized_size_from_first_byte(v.front());
+    if (v.size() < size) {
+        throw std::out_of_range("Truncated vint");
+    }
+    auto extra = size - 1;
+    uint64_t value = extra == 8 ? 0 : uint8_t(v[0]) & (0xff >> extra);
+    for (vint_size_type i = 1; i < size; ++i) {
+        value = (value << 8) | uint8_t(v[i]);
+    }
+    return value;
+}
+
+vint_size_type signed_vint::serialized_size(value_type value) noexcept {
+    return unsigned_vint::serialized_size(encode_zigzag(value));
+}
+
+vint_size_type signed_vint::serialize(value_type value, bytes::iterator out) {
+    return unsigned_vint::serialize(encode_zigzag(value), out);
+}
+
+signed_vint::value_type signed_vint::deserialize(bytes_view v) {
+    return decode_zigzag(unsigned_vint::deserialize(v));
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 ScyllaDB
+ */
+
+/*
+ * This file is part of Scylla.
+ *
+ * Scylla is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Scylla is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Scylla.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "bytes.hh"
+
+#include <cstdint>
+
+// Variable-length integer encoding, as used by the Cassandra 3.x ("mc")
+// sstable format.
+//
+// The number of leading one bits of the first byte is the number of extra
+// bytes that follow it. The value is stored big-endian in the remaining bits
+// of the first byte and the extra bytes. Values which need more than 56 bits
+// are encoded as 0xff followed by the full 8-byte big-endian value, so the
+// encoding is never longer than 9 bytes.
+//
+// Signed values are zig-zag encoded first, so that small negative numbers
+// are also short.
+
+using vint_size_type = bytes::size_type;
+
+static constexpr vint_size_type max_vint_length = 9;
+
+struct unsigned_vint final {
+    using value_type = uint64_t;
+
+    static vint_size_type serialized_size(value_type) noexcept;
+
+    // Writes the encoding of value at out, which must have room for at least
+    // serialized_size(value) bytes. Returns the number of bytes written.
+    static vint_size_type serialize(value_type value, bytes::iterator out);
+
+    // Decodes the value at the front of v. v must contain the whole encoding,
+    // see serialized_size_from_first_byte().
+    static value_type deserialize(bytes_view v);
+
+    // Returns the length of the encoding which starts with first_byte.
+    static vint_size_type serialized_size_from_first_byte(bytes::value_type first_byte);
+};
+
+struct signed_vint final {
+    using value_type = int64_t;
+
+    static vint_size_type serialized_size(value_type) noexcept;
+
+    static vint_size_type serialize(value_type value, bytes::iterator out);
+
+    static value_type deserialize(bytes_view v);
+
+    static vint_size_type serialized_size_from_first_byte(bytes::value_type first_byte) {
+        return unsigned_vint::serialized_size_from_first_byte(first_byte);
+    }
+};